@@ -13,8 +13,11 @@
 // limitations under the License.
 #include "src/main/cpp/archive_utils.h"
 
+#include <algorithm>
+#include <atomic>
 #include <functional>
 #include <memory>
+#include <mutex>  // NOLINT
 #include <set>
 #include <string>
 #include <thread>  // NOLINT
@@ -28,7 +31,10 @@
 #include "src/main/cpp/util/logging.h"
 #include "src/main/cpp/util/path.h"
 #include "src/main/cpp/util/strings.h"
+#include "third_party/ijar/common.h"
+#include "third_party/ijar/mapped_file.h"
 #include "third_party/ijar/zip.h"
+#include "third_party/ijar/zlib_client.h"
 
 namespace blaze {
 
@@ -104,6 +110,285 @@ struct PartialZipExtractor : public devtools_ijar::ZipExtractorProcessor {
   bool done_ = false;
 };
 
+// The members of a zip file as listed by its central directory, at the end of
+// the file. Unlike the local headers that PartialZipExtractor walks from the
+// start, this tells where all of them are at once, so that they can be
+// uncompressed independently, and what they are without reading them.
+class ZipIndex {
+ public:
+  struct Member {
+    string name;
+    devtools_ijar::u2 method;
+    devtools_ijar::u4 compressed_size;
+    devtools_ijar::u4 uncompressed_size;
+    // Where the local header of the member is in the file.
+    size_t offset;
+  };
+
+  explicit ZipIndex(const string &archive_path)
+      : file_(archive_path.c_str()) {}
+
+  // Maps the file and reads its central directory. Returns false if that
+  // cannot be done, e.g. for ZIP64 files, which PartialZipExtractor has to
+  // read then.
+  bool Read();
+
+  // Stores the file members up to and including the one named `stop_entry`,
+  // in the order of the file, into `members`. Returns false if there is no
+  // such member.
+  bool MembersUntil(const string &stop_entry,
+                    vector<const Member *> *members) const;
+
+  // Returns the contents of `member` and stores their size into `size`,
+  // using `decompressor` if they are compressed; they stay valid until it
+  // is used again. Returns nullptr and sets `error` on failure.
+  const char *Contents(const Member &member,
+                       devtools_ijar::Decompressor *decompressor,
+                       size_t *size, string *error) const;
+
+ private:
+  devtools_ijar::MappedInputFile file_;
+  vector<Member> members_;
+  // The file members of members_.
+  vector<bool> is_file_;
+};
+
+bool ZipIndex::Read() {
+  using devtools_ijar::get_u2le;
+  using devtools_ijar::get_u4le;
+  static const size_t kEndRecordSize = 22;
+  static const size_t kMaxCommentSize = 0xffff;
+  static const size_t kCentralHeaderSize = 46;
+
+  if (!file_.Opened() || file_.Length() < kEndRecordSize) {
+    return false;
+  }
+  const devtools_ijar::u1 *start = file_.Buffer();
+  const size_t length = file_.Length();
+
+  // The end of central directory record may be followed by a comment.
+  size_t end_record = length - kEndRecordSize;
+  const size_t lowest = end_record > kMaxCommentSize
+                            ? end_record - kMaxCommentSize
+                            : 0;
+  while (true) {
+    const devtools_ijar::u1 *p = start + end_record;
+    if (get_u4le(p) == 0x06054b50) {
+      break;
+    }
+    if (end_record == lowest) {
+      return false;
+    }
+    --end_record;
+  }
+  const devtools_ijar::u1 *p = start + end_record + 10;
+  const devtools_ijar::u2 entries = get_u2le(p);
+  const devtools_ijar::u4 directory_size = get_u4le(p);
+  const devtools_ijar::u4 directory_offset = get_u4le(p);
+  if (entries == 0xffff || directory_size == 0xffffffff ||
+      directory_offset == 0xffffffff || directory_size > end_record ||
+      directory_offset > end_record - directory_size) {
+    return false;
+  }
+  // The offsets in the file are off by the size of what precedes the zip,
+  // like the client binary, unless "zip -A" adjusted them.
+  const size_t directory = end_record - directory_size;
+  const size_t shift = directory - directory_offset;
+
+  p = start + directory;
+  const devtools_ijar::u1 *end = start + end_record;
+  members_.reserve(entries);
+  is_file_.reserve(entries);
+  for (size_t i = 0; i < entries; ++i) {
+    if (static_cast<size_t>(end - p) < kCentralHeaderSize ||
+        get_u4le(p) != 0x02014b50) {
+      return false;
+    }
+    Member member;
+    p += 6;  // The versions and the flags.
+    member.method = get_u2le(p);
+    p += 8;  // The time, the date and the CRC.
+    member.compressed_size = get_u4le(p);
+    member.uncompressed_size = get_u4le(p);
+    const size_t name_length = get_u2le(p);
+    const size_t extra_length = get_u2le(p);
+    const size_t comment_length = get_u2le(p);
+    p += 4;  // The disk number and the internal attributes.
+    const devtools_ijar::u4 attributes = get_u4le(p);
+    const devtools_ijar::u4 offset = get_u4le(p);
+    if (static_cast<size_t>(end - p) <
+            name_length + extra_length + comment_length ||
+        member.compressed_size == 0xffffffff ||
+        member.uncompressed_size == 0xffffffff || offset == 0xffffffff ||
+        offset > directory_offset) {
+      return false;
+    }
+    member.name.assign(reinterpret_cast<const char *>(p), name_length);
+    member.offset = shift + offset;
+    p += name_length + extra_length + comment_length;
+    // Like in PartialZipExtractor, the attributes may not tell directories.
+    is_file_.push_back(!devtools_ijar::zipattr_is_dir(attributes) &&
+                       !member.name.empty() && member.name.back() != '/');
+    members_.push_back(std::move(member));
+  }
+  return true;
+}
+
+bool ZipIndex::MembersUntil(const string &stop_entry,
+                            vector<const Member *> *members) const {
+  members->clear();
+  for (size_t i = 0; i < members_.size(); ++i) {
+    if (is_file_[i]) {
+      members->push_back(&members_[i]);
+      if (members_[i].name == stop_entry) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+const char *ZipIndex::Contents(const Member &member,
+                               devtools_ijar::Decompressor *decompressor,
+                               size_t *size, string *error) const {
+  static const size_t kLocalHeaderSize = 30;
+  const devtools_ijar::u1 *start = file_.Buffer();
+  const size_t length = file_.Length();
+  if (length < kLocalHeaderSize || member.offset > length - kLocalHeaderSize) {
+    *error = "bad offset of '" + member.name + "'";
+    return nullptr;
+  }
+  const devtools_ijar::u1 *p = start + member.offset;
+  if (devtools_ijar::get_u4le(p) != 0x04034b50) {
+    *error = "bad local header of '" + member.name + "'";
+    return nullptr;
+  }
+  // The sizes in the local header may be deferred to a data descriptor, but
+  // not the lengths of the name and the extra field, which may differ from
+  // those of the central directory.
+  p = start + member.offset + 26;
+  const size_t name_length = devtools_ijar::get_u2le(p);
+  const size_t extra_length = devtools_ijar::get_u2le(p);
+  const size_t data = member.offset + kLocalHeaderSize + name_length +
+                      extra_length;
+  if (data > length || member.compressed_size > length - data) {
+    *error = "truncated data of '" + member.name + "'";
+    return nullptr;
+  }
+  if (member.method == 0) {
+    *size = member.compressed_size;
+    return reinterpret_cast<const char *>(start + data);
+  }
+  if (member.method != 8) {
+    *error = "unsupported compression method " +
+             blaze_util::ToString(member.method) + " of '" + member.name +
+             "'";
+    return nullptr;
+  }
+  devtools_ijar::DecompressedFile *uncompressed =
+      decompressor->UncompressFile(start + data, member.compressed_size,
+                                   member.uncompressed_size);
+  if (uncompressed == nullptr) {
+    *error = "cannot uncompress '" + member.name +
+             "': " + decompressor->GetError();
+    return nullptr;
+  }
+  *size = uncompressed->uncompressed_size;
+  const char *contents =
+      reinterpret_cast<const char *>(uncompressed->uncompressed_data);
+  free(uncompressed);
+  return contents;
+}
+
+// Returns the contents of the file member `stop_entry` of the zip file at
+// `archive_path`, and stores the names of the file members up to and
+// including it into `entry_names` if it is not nullptr. Only the central
+// directory and that member are read where ZipIndex can.
+static string ReadUntil(const string &archive_path, const string &stop_entry,
+                        vector<string> *entry_names) {
+  ZipIndex index(archive_path);
+  vector<const ZipIndex::Member *> members;
+  if (!index.Read() || !index.MembersUntil(stop_entry, &members)) {
+    PartialZipExtractor pze;
+    return pze.UnzipUntil(archive_path, stop_entry, entry_names);
+  }
+  if (entry_names != nullptr) {
+    entry_names->clear();
+    for (const ZipIndex::Member *member : members) {
+      entry_names->push_back(member->name);
+    }
+  }
+  devtools_ijar::Decompressor decompressor;
+  size_t size;
+  string error;
+  const char *contents =
+      index.Contents(*members.back(), &decompressor, &size, &error);
+  if (contents == nullptr) {
+    BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+        << "Error reading zip file '" << archive_path << "': " << error;
+  }
+  return string(contents, size);
+}
+
+// Uncompresses `members` of `index` on as many threads as there are cores and
+// dumps them into `output_dir`. Returns the contents of the last member.
+static string UncompressAndDump(const ZipIndex &index,
+                                vector<const ZipIndex::Member *> members,
+                                embedded_binaries::Dumper *dumper,
+                                const string &output_dir) {
+  const ZipIndex::Member *last = members.back();
+  // The biggest members first, so that the server jar, which takes longest,
+  // is not left to uncompress at the end while the other threads are idle.
+  std::stable_sort(
+      members.begin(), members.end(),
+      [](const ZipIndex::Member *a, const ZipIndex::Member *b) {
+        return a->uncompressed_size > b->uncompressed_size;
+      });
+  // The Dumper copies the contents and writes them on threads of its own, but
+  // is not thread-safe itself.
+  std::mutex mutex;
+  string last_contents;
+  string error;
+  std::atomic<size_t> next(0);
+  auto loop = [&]() {
+    devtools_ijar::Decompressor decompressor;
+    for (size_t i; (i = next++) < members.size();) {
+      const ZipIndex::Member &member = *members[i];
+      size_t size;
+      string member_error;
+      const char *contents =
+          index.Contents(member, &decompressor, &size, &member_error);
+      std::lock_guard<std::mutex> lock(mutex);
+      if (contents == nullptr) {
+        if (error.empty()) {
+          error = member_error;
+        }
+        continue;
+      }
+      dumper->Dump(contents, size,
+                   blaze_util::JoinPath(output_dir, member.name));
+      if (&member == last) {
+        last_contents.assign(contents, size);
+      }
+    }
+  };
+  // Uncompressing takes cpu, unlike writing and blessing.
+  vector<std::thread> threads;
+  const size_t cpus = std::thread::hardware_concurrency();
+  for (size_t t = 1; t < std::min(members.size(), cpus); ++t) {
+    threads.emplace_back(loop);
+  }
+  loop();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  if (!error.empty()) {
+    BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+        << "Failed to extract embedded binaries: " << error;
+  }
+  return last_contents;
+}
+
 // Installs Blaze by extracting the embedded data files, iff necessary.
 // The MD5-named install_base directory on disk is trusted; we assume
 // no-one has modified the extracted files beneath this directory once
@@ -123,11 +408,17 @@ ExtractionDurationMillis ExtractData(const string &self_path,
     string tmp_install = blaze_util::CreateTempDir(install_base + ".tmp.");
     ExtractArchiveOrDie(self_path, startup_options.product_name,
                         expected_install_md5, tmp_install);
+    uint64_t written = GetMillisecondsMonotonic();
     BlessFiles(tmp_install);
 
     uint64_t et = GetMillisecondsMonotonic();
-    const ExtractionDurationMillis extract_data_duration(
-        et - st, /*archived_extracted=*/true);
+    const ExtractionDurationMillis extract_data_duration(written - st,
+                                                         et - written);
+    BAZEL_LOG(INFO) << "Extracted the install base in "
+                    << extract_data_duration.millis << " ms (writing "
+                    << extract_data_duration.write_duration.millis
+                    << " ms, blessing and syncing "
+                    << extract_data_duration.bless_duration.millis << " ms)";
 
     // Now rename the completed installation to its final name.
     int attempts = 0;
@@ -170,15 +461,20 @@ ExtractionDurationMillis ExtractData(const string &self_path,
     }
     blaze_util::Path install_dir(install_base);
     // Check that all files are present and have timestamps from BlessFiles().
-    std::unique_ptr<blaze_util::IFileMtime> mtime(
-        blaze_util::CreateFileMtime());
-    for (const auto &it : archive_contents) {
-      blaze_util::Path path = install_dir.GetRelative(it);
-      if (!mtime->IsUntampered(path)) {
-        BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
-            << "corrupt installation: file '" << path.AsPrintablePath()
-            << "' is missing or modified.  Please remove '" << install_base
-            << "' and try again.";
+    // A shared install base is maintained by whoever provisions the volume it
+    // lives on, and usually can't be modified by us anyway, so its key is
+    // trusted instead of stat()ing every file on every invocation.
+    if (!startup_options.install_base_is_shared) {
+      std::unique_ptr<blaze_util::IFileMtime> mtime(
+          blaze_util::CreateFileMtime());
+      for (const auto &it : archive_contents) {
+        blaze_util::Path path = install_dir.GetRelative(it);
+        if (!mtime->IsUntampered(path)) {
+          BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+              << "corrupt installation: file '" << path.AsPrintablePath()
+              << "' is missing or modified.  Please remove '" << install_base
+              << "' and try again.";
+        }
       }
     }
     // Also check that the installed files claim to match this binary.
@@ -205,8 +501,7 @@ ExtractionDurationMillis ExtractData(const string &self_path,
 
 void DetermineArchiveContents(const string &archive_path, vector<string> *files,
                               string *install_md5) {
-  PartialZipExtractor pze;
-  *install_md5 = pze.UnzipUntil(archive_path, "install_base_key", files);
+  *install_md5 = ReadUntil(archive_path, "install_base_key", files);
 }
 
 void ExtractArchiveOrDie(const string &archive_path, const string &product_name,
@@ -226,12 +521,19 @@ void ExtractArchiveOrDie(const string &archive_path, const string &product_name,
 
   BAZEL_LOG(USER) << "Extracting " << product_name << " installation...";
 
-  PartialZipExtractor pze;
-  string install_md5 = pze.UnzipUntil(
-      archive_path, "install_base_key", nullptr,
-      [&](const char *name, const char *data, size_t size) {
-        dumper->Dump(data, size, blaze_util::JoinPath(output_dir, name));
-      });
+  string install_md5;
+  ZipIndex index(archive_path);
+  vector<const ZipIndex::Member *> members;
+  if (index.Read() && index.MembersUntil("install_base_key", &members)) {
+    install_md5 = UncompressAndDump(index, members, dumper.get(), output_dir);
+  } else {
+    PartialZipExtractor pze;
+    install_md5 = pze.UnzipUntil(
+        archive_path, "install_base_key", nullptr,
+        [&](const char *name, const char *data, size_t size) {
+          dumper->Dump(data, size, blaze_util::JoinPath(output_dir, name));
+        });
+  }
 
   if (!dumper->Finish(&error)) {
     BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
@@ -250,6 +552,28 @@ void ExtractArchiveOrDie(const string &archive_path, const string &product_name,
   }
 }
 
+// Extraction and blessing are dominated by the latency of the file system, so
+// they use more threads than there are cores (see also the Dumper).
+static const size_t kBlessThreads = 8;
+
+// Runs fn(i) for every i in [0, n) on up to kBlessThreads threads.
+static void ParallelFor(size_t n, const std::function<void(size_t)> &fn) {
+  std::atomic<size_t> next(0);
+  auto loop = [&]() {
+    for (size_t i; (i = next++) < n;) {
+      fn(i);
+    }
+  };
+  vector<std::thread> threads;
+  for (size_t t = 1; t < std::min(n, kBlessThreads); ++t) {
+    threads.emplace_back(loop);
+  }
+  loop();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
 void BlessFiles(const string &embedded_binaries) {
   blaze_util::Path embedded_binaries_(embedded_binaries);
 
@@ -262,49 +586,73 @@ void BlessFiles(const string &embedded_binaries) {
   // Walks the temporary directory recursively and collects full file paths.
   blaze_util::GetAllFilesUnder(embedded_binaries, &extracted_files);
 
+  // Set the time to a distantly futuristic value so we can observe tampering.
+  // Note that keeping a static, deterministic timestamp, such as the default
+  // timestamp set by unzip (1970-01-01) and using that to detect tampering is
+  // not enough, because we also need the timestamp to change between Bazel
+  // releases so that the metadata cache knows that the files may have
+  // changed. This is essential for the correctness of actions that use
+  // embedded binaries as artifacts.
   std::unique_ptr<blaze_util::IFileMtime> mtime(blaze_util::CreateFileMtime());
-  set<blaze_util::Path> synced_directories;
-  for (const auto &f : extracted_files) {
-    blaze_util::Path it(f);
-
-    // Set the time to a distantly futuristic value so we can observe tampering.
-    // Note that keeping a static, deterministic timestamp, such as the default
-    // timestamp set by unzip (1970-01-01) and using that to detect tampering is
-    // not enough, because we also need the timestamp to change between Bazel
-    // releases so that the metadata cache knows that the files may have
-    // changed. This is essential for the correctness of actions that use
-    // embedded binaries as artifacts.
+  std::mutex error_mutex;
+  string error;
+  ParallelFor(extracted_files.size(), [&](size_t i) {
+    blaze_util::Path it(extracted_files[i]);
     if (!mtime->SetToDistantFuture(it)) {
       string err = blaze_util::GetLastErrorString();
-      BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
-          << "failed to set timestamp on '" << it.AsPrintablePath()
-          << "': " << err;
+      std::lock_guard<std::mutex> lock(error_mutex);
+      if (error.empty()) {
+        error = "failed to set timestamp on '" + it.AsPrintablePath() +
+                "': " + err;
+      }
     }
+  });
+  if (!error.empty()) {
+    BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR) << error;
+  }
 
-    blaze_util::SyncFile(it);
-
-    blaze_util::Path directory = it.GetParent();
-
-    // Now walk up until embedded_binaries and sync every directory in between.
-    // synced_directories is used to avoid syncing the same directory twice.
-    // The !directory.empty() and !blaze_util::IsRootDirectory(directory)
-    // conditions are not strictly needed, but it makes this loop more robust,
-    // because otherwise, if due to some glitch, directory was not under
-    // embedded_binaries, it would get into an infinite loop.
+  // One syncfs() flushes the files, their timestamps and the directories.
+  if (blaze_util::SyncFileSystem(embedded_binaries_)) {
+    return;
+  }
+  BAZEL_LOG(INFO) << "Cannot sync the file system of '" << embedded_binaries
+                  << "' at once (" << blaze_util::GetLastErrorString()
+                  << "), syncing every file";
+
+  // Collect every directory between the files and embedded_binaries.
+  // The !directory.IsEmpty() and !blaze_util::IsRootDirectory(directory)
+  // conditions are not strictly needed, but it makes this loop more robust,
+  // because otherwise, if due to some glitch, directory was not under
+  // embedded_binaries, it would get into an infinite loop.
+  set<blaze_util::Path> directories;
+  for (const auto &f : extracted_files) {
+    blaze_util::Path directory = blaze_util::Path(f).GetParent();
     while (directory != embedded_binaries_ && !directory.IsEmpty() &&
            !blaze_util::IsRootDirectory(directory) &&
-           synced_directories.insert(directory).second) {
-      blaze_util::SyncFile(directory);
+           directories.insert(directory).second) {
       directory = directory.GetParent();
     }
   }
 
+  ParallelFor(extracted_files.size(), [&](size_t i) {
+    blaze_util::SyncFile(extracted_files[i]);
+  });
+
+  // Sync each directory once, after all of its children. A directory's path
+  // is longer than its parent's, so the longest paths go first.
+  vector<blaze_util::Path> ordered(directories.begin(), directories.end());
+  std::stable_sort(ordered.begin(), ordered.end(),
+                   [](const blaze_util::Path &a, const blaze_util::Path &b) {
+                     return a.AsNativePath().size() > b.AsNativePath().size();
+                   });
+  for (const auto &directory : ordered) {
+    blaze_util::SyncFile(directory);
+  }
   blaze_util::SyncFile(embedded_binaries_);
 }
 
 void ExtractBuildLabel(const string &archive_path, string *build_label) {
-  PartialZipExtractor pze;
-  *build_label = pze.UnzipUntil(archive_path, "build-label.txt");
+  *build_label = ReadUntil(archive_path, "build-label.txt", nullptr);
 }
 
 string GetServerJarPath(const vector<string> &archive_contents) {
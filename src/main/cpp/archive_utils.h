@@ -43,12 +43,21 @@ struct DurationMillis {
   static constexpr uint64_t kUnknownDuration = 0;
 };
 
-// DurationMillis that tracks if an archive was extracted.
+// DurationMillis that tracks if an archive was extracted, and how the time
+// was split between writing the files (ExtractArchiveOrDie) and blessing and
+// syncing them (BlessFiles).
 struct ExtractionDurationMillis : DurationMillis {
   const bool archive_extracted;
+  const DurationMillis write_duration;
+  const DurationMillis bless_duration;
   ExtractionDurationMillis() : DurationMillis(), archive_extracted(false) {}
   ExtractionDurationMillis(const uint64_t ms, const bool archive_extracted)
       : DurationMillis(ms), archive_extracted(archive_extracted) {}
+  ExtractionDurationMillis(const uint64_t write_ms, const uint64_t bless_ms)
+      : DurationMillis(write_ms + bless_ms),
+        archive_extracted(true),
+        write_duration(write_ms),
+        bless_duration(bless_ms) {}
 };
 
 // The reason for a blaze server restart.
@@ -92,7 +101,9 @@ struct LoggingInfo {
 
 // Extracts the archive and ensures success via calls to ExtractArchiveOrDie and
 // BlessFiles. If the install base, the location the archive is unpacked,
-// already exists, extraction is skipped. Kills the client if an error is
+// already exists, extraction is skipped; its files are checked unless it is a
+// shared install base (see StartupOptions::shared_install_base_root), which is
+// only checked by its install_base_key. Kills the client if an error is
 // encountered.
 ExtractionDurationMillis ExtractData(
     const std::string &self_path,
@@ -114,6 +125,9 @@ void ExtractArchiveOrDie(const std::string &archive_path,
 // have written are actually on the disk. Later, the blaze client calls
 // blaze_util::IFileMtime::IsUntampered to ensure the files were "blessed" with
 // these distant mtimes.
+// The files are blessed on several threads. Where the platform supports it,
+// one blaze_util::SyncFileSystem call makes them durable; otherwise each file
+// is synced, and then each directory once, after all of its children.
 void BlessFiles(const std::string &embedded_binaries);
 
 // Retrieves the build label (version string) from `archive_path` into
@@ -42,12 +42,14 @@
 #include <algorithm>
 #include <chrono>  // NOLINT (gRPC requires this)
 #include <cinttypes>
+#include <iterator>
 #include <map>
 #include <memory>
 #include <mutex>  // NOLINT
 #include <set>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <thread>  // NOLINT
 #include <unordered_set>
 #include <utility>
@@ -61,8 +63,13 @@
 #include "src/main/cpp/archive_utils.h"
 #include "src/main/cpp/blaze_util.h"
 #include "src/main/cpp/blaze_util_platform.h"
+#include "src/main/cpp/client_profile.h"
 #include "src/main/cpp/option_processor.h"
+#include "src/main/cpp/output_base_gc.h"
+#include "src/main/cpp/output_forwarder.h"
+#include "src/main/cpp/server_jvm_sizing.h"
 #include "src/main/cpp/server_process_info.h"
+#include "src/main/cpp/standby_servers.h"
 #include "src/main/cpp/startup_options.h"
 #include "src/main/cpp/util/bazel_log_handler.h"
 #include "src/main/cpp/util/errors.h"
@@ -70,6 +77,7 @@
 #include "src/main/cpp/util/file.h"
 #include "src/main/cpp/util/file_platform.h"
 #include "src/main/cpp/util/logging.h"
+#include "src/main/cpp/util/md5.h"
 #include "src/main/cpp/util/numbers.h"
 #include "src/main/cpp/util/path.h"
 #include "src/main/cpp/util/path_platform.h"
@@ -166,6 +174,17 @@ using std::vector;
 //   connections. It would also not be resilient against a dead server that
 //   left a PID file around.
 
+// The largest chunk of output the server may send in one RunResponse. It is
+// well below gRPC's default 4MB limit on received messages.
+static const int kMaxOutputChunkSize = 1024 * 1024;
+
+// How much output the client queues before it stops reading from the server.
+static const size_t kMaxBufferedOutputBytes = 16 * 1024 * 1024;
+
+// Arguments larger than this in total are passed to the server in a file
+// rather than in the RunRequest, which gRPC limits to 4MB by default.
+static const size_t kMaxInlineArgBytes = 1024 * 1024;
+
 // String string representation of RestartReason.
 static const char *ReasonString(RestartReason reason) {
   switch (reason) {
@@ -202,6 +221,16 @@ class BlazeServer final {
   // Whether there is an active connection to a server.
   bool Connected() const { return client_.get(); }
 
+  // Whether the connected server reported this install MD5 and startup
+  // options digest when it was connected to. If so, it is of the right version
+  // and has the right startup options.
+  bool HasIdentity(const std::string &install_md5,
+                   const std::string &startup_options_digest) const {
+    return Connected() && !server_install_md5_.empty() &&
+           server_install_md5_ == install_md5 &&
+           server_startup_options_digest_ == startup_options_digest;
+  }
+
   // Connect to the server. Returns if the connection was successful. Only
   // call this when this object is in disconnected state. If it returns true,
   // this object will be in connected state.
@@ -211,7 +240,7 @@ class BlazeServer final {
   // and stderr. Returns the desired exit code. Only call this when the server
   // is in connected state.
   unsigned int Communicate(
-      const std::string &command, const std::vector<std::string> &command_args,
+      const std::string &command, std::vector<std::string> command_args,
       const std::string &invocation_policy,
       const std::vector<RcStartupFlag> &original_startup_options,
       const LoggingInfo &logging_info,
@@ -233,17 +262,26 @@ class BlazeServer final {
 
  private:
   BlazeLock blaze_lock_;
+  // Whether blaze_lock_ is held. Communicate() releases it.
+  bool blaze_lock_held_;
 
   enum CancelThreadAction { NOTHING, JOIN, CANCEL, COMMAND_ID_RECEIVED };
 
   std::unique_ptr<CommandServer::Stub> client_;
+  // The stub that Cancel() uses, on a connection of its own. Protected by
+  // cancel_thread_mutex_.
+  std::unique_ptr<CommandServer::Stub> cancel_client_;
   std::string request_cookie_;
   std::string response_cookie_;
   std::string command_id_;
-
-  // protects command_id_ . Although we always set it before making the cancel
-  // thread do something with it, the mutex is still useful because it provides
-  // a memory fence.
+  // What the server reported about itself in the ping response, empty for a
+  // server of a version that reports nothing.
+  std::string server_install_md5_;
+  std::string server_startup_options_digest_;
+
+  // protects command_id_ and cancel_client_. Although we always set
+  // command_id_ before making the cancel thread do something with it, the
+  // mutex is still useful because it provides a memory fence.
   std::mutex cancel_thread_mutex_;
 
   // Pipe that the main thread sends actions to and the cancel thread receives
@@ -273,8 +311,10 @@ static BlazeServer *blaze_server;
 // objects before those.
 
 uint64_t BlazeServer::AcquireLock() {
-  return blaze::AcquireLock(output_base_, batch_, block_for_lock_,
-                            &blaze_lock_);
+  const uint64_t wait_ms =
+      blaze::AcquireLock(output_base_, batch_, block_for_lock_, &blaze_lock_);
+  blaze_lock_held_ = true;
+  return wait_ms;
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -291,6 +331,64 @@ static string EscapeForOptionSource(const string &input) {
   return result;
 }
 
+// Returns the dynamic class data sharing archive of the server, or an empty
+// path if the server doesn't use one. Only the embedded JDK is known to support
+// -XX:+AutoCreateSharedArchive.
+static blaze_util::Path GetClassDataArchive(
+    const StartupOptions &startup_options) {
+  if (!startup_options.server_class_data_sharing ||
+      startup_options.GetServerJavabaseAndType().second !=
+          StartupOptions::JavabaseType::EMBEDDED) {
+    return blaze_util::Path();
+  }
+  return startup_options.output_base.GetRelative("server").GetRelative(
+      "server.jsa");
+}
+
+static bool IsVolatileArg(std::string_view arg) {
+  // TODO(ccalvarin) when --batch is gone and the startup_options field in the
+  // gRPC message is always set, there is no reason for client options that are
+  // not used at server startup to be part of the startup command line. The
+  // server command line difference logic can be simplified then.
+  static const std::set<std::string_view> volatile_startup_options = {
+      "--option_sources=", "--max_idle_secs=", "--connect_timeout_secs=",
+      "--local_startup_timeout_secs=", "--client_debug=", "--preemptible=",
+      // Derived from the other arguments (see GetStartupOptionsDigest()).
+      "--startup_options_digest=",
+      // Internally, -XX:HeapDumpPath is set automatically via the user's TMPDIR
+      // environment variable. Since that can change based on the shell, we
+      // tolerate changes to it. Note that an explicit setting of
+      // -XX:HeapDumpPath via --host_jvm_args *will* trigger a restart.
+      "-XX:HeapDumpPath="};
+
+  // Split arg based on the first "=" if one exists in arg.
+  const std::string_view::size_type eq_pos = arg.find_first_of('=');
+  const std::string_view stripped_arg =
+      (eq_pos == std::string_view::npos) ? arg : arg.substr(0, eq_pos + 1);
+
+  return volatile_startup_options.count(stripped_arg);
+}
+
+// Returns a digest of the arguments that decide whether a running server can
+// be kept (see AreStartupOptionsDifferent()), in any order. argv[0] is left
+// out: it follows from the workspace and is changed on OpenBSD after this.
+static string GetStartupOptionsDigest(const vector<string> &server_exe_args) {
+  vector<string> args;
+  for (size_t i = 1; i < server_exe_args.size(); ++i) {
+    if (!IsVolatileArg(server_exe_args[i])) {
+      args.push_back(server_exe_args[i]);
+    }
+  }
+  std::sort(args.begin(), args.end());
+  blaze_util::Md5Digest digest;
+  for (const string &arg : args) {
+    digest.Update(arg.c_str(), arg.size() + 1);
+  }
+  unsigned char buf[blaze_util::Md5Digest::kDigestLength];
+  digest.Finish(buf);
+  return digest.String();
+}
+
 // Returns the JVM command argument array.
 static vector<string> GetServerExeArgs(const blaze_util::Path &jvm_path,
                                        const string &server_jar_path,
@@ -327,6 +425,32 @@ static vector<string> GetServerExeArgs(const blaze_util::Path &jvm_path,
     BAZEL_DIE(jvm_args_exit_code) << error;
   }
 
+  // The sizing comes before --host_jvm_args, which override it.
+  vector<string> sizing_args;
+  string sizing_flags;
+  string sizing_source;
+  if (startup_options.auto_size_server_jvm) {
+    UsableResources resources;
+    if (GetUsableResources(&resources.memory_bytes, &resources.cpus,
+                           &resources.numa_nodes)) {
+      // Generational ZGC needs JDK 21, which only the embedded JDK is known
+      // to be.
+      sizing_args = GetServerJvmSizingArgs(
+          resources,
+          startup_options.GetServerJavabaseAndType().second ==
+              StartupOptions::JavabaseType::EMBEDDED,
+          user_options);
+      blaze_util::JoinStrings(sizing_args, ' ', &sizing_flags);
+      sizing_source = "computed from " + DescribeUsableResources(resources);
+      BAZEL_LOG(INFO) << "Server JVM sizing " << sizing_source << ": "
+                      << sizing_flags;
+      result.insert(result.end(), sizing_args.begin(), sizing_args.end());
+    } else {
+      BAZEL_LOG(WARNING) << "--experimental_auto_size_server_jvm is not "
+                            "supported on this platform";
+    }
+  }
+
   // We put all directories on java.library.path that contain .so/.dll files.
   set<string> java_library_paths;
   std::stringstream java_library_path;
@@ -367,6 +491,17 @@ static vector<string> GetServerExeArgs(const blaze_util::Path &jvm_path,
     result.push_back("-Xdebug");
     result.push_back("-Xrunjdwp:transport=dt_socket,server=y,address=5005");
   }
+
+  // The JVM writes the archive when it exits if it is missing or doesn't match
+  // the JVM and the class path, and maps it at later starts. The flags are the
+  // same either way, so they don't make the client restart the server.
+  const blaze_util::Path class_data_archive =
+      GetClassDataArchive(startup_options);
+  if (!class_data_archive.IsEmpty()) {
+    result.push_back("-XX:+AutoCreateSharedArchive");
+    result.push_back("-XX:SharedArchiveFile=" +
+                     class_data_archive.AsJvmArgument());
+  }
   result.insert(result.end(), user_options.begin(), user_options.end());
 
   startup_options.AddJVMArgumentSuffix(real_install_dir, server_jar_path,
@@ -386,6 +521,11 @@ static vector<string> GetServerExeArgs(const blaze_util::Path &jvm_path,
     } else {
       result.push_back("--noshutdown_on_low_sys_mem");
     }
+    if (startup_options.scoped_server_pid > 0) {
+      result.push_back(
+          "--experimental_scoped_server_pid=" +
+          blaze_util::ToString(startup_options.scoped_server_pid));
+    }
   } else {
     // --batch must come first in the arguments to Java main() because
     // the code expects it to be at args[0] if it's been set.
@@ -433,11 +573,30 @@ static vector<string> GetServerExeArgs(const blaze_util::Path &jvm_path,
     result.push_back("--unix_digest_hash_attribute_name=" +
                      startup_options.unix_digest_hash_attribute_name);
   }
+  if (!startup_options.unix_digest_cache_attribute_name.empty()) {
+    result.push_back("--unix_digest_cache_attribute_name=" +
+                     startup_options.unix_digest_cache_attribute_name);
+  }
   if (startup_options.idle_server_tasks) {
     result.push_back("--idle_server_tasks");
   } else {
     result.push_back("--noidle_server_tasks");
   }
+  if (startup_options.unix_domain_socket) {
+    result.push_back("--experimental_unix_domain_socket");
+  } else {
+    result.push_back("--noexperimental_unix_domain_socket");
+  }
+
+  // The server only schedules itself if it is to do so per command.
+  if (startup_options.per_command_scheduling) {
+    result.push_back("--experimental_per_command_scheduling");
+    if (startup_options.batch_cpu_scheduling) {
+      result.push_back("--batch_cpu_scheduling");
+    }
+    result.push_back("--io_nice_level=" +
+                     blaze_util::ToString(startup_options.io_nice_level));
+  }
 
   if (startup_options.write_command_log) {
     result.push_back("--write_command_log");
@@ -488,6 +647,9 @@ static vector<string> GetServerExeArgs(const blaze_util::Path &jvm_path,
       result.push_back("--host_jvm_args=" + arg);
     }
   }
+  if (!sizing_args.empty()) {
+    result.push_back("--auto_sized_server_jvm_args=" + sizing_flags);
+  }
 
   // Pass in invocation policy as a startup argument for batch mode only.
   if (startup_options.batch && !startup_options.invocation_policy.empty()) {
@@ -502,6 +664,18 @@ static vector<string> GetServerExeArgs(const blaze_util::Path &jvm_path,
     result.push_back("--experimental_cgroup_parent=" +
                      startup_options.cgroup_parent);
   }
+  if (!startup_options.cgroup_memory_high.empty()) {
+    result.push_back("--experimental_cgroup_memory_high=" +
+                     startup_options.cgroup_memory_high);
+  }
+  if (!startup_options.cgroup_memory_max.empty()) {
+    result.push_back("--experimental_cgroup_memory_max=" +
+                     startup_options.cgroup_memory_max);
+  }
+  if (startup_options.server_numa_node >= 0) {
+    result.push_back("--experimental_server_numa_node=" +
+                     blaze_util::ToString(startup_options.server_numa_node));
+  }
 #endif
 
   startup_options.AddExtraOptions(&result);
@@ -519,8 +693,16 @@ static vector<string> GetServerExeArgs(const blaze_util::Path &jvm_path,
     option_sources += EscapeForOptionSource(it.first) + ":" +
                       EscapeForOptionSource(it.second);
   }
+  // What the sizing was computed from is recorded as its source.
+  if (!sizing_args.empty()) {
+    option_sources += string(first ? "" : ":") +
+                      EscapeForOptionSource("auto_sized_server_jvm_args") +
+                      ":" + EscapeForOptionSource(sizing_source);
+  }
 
   result.push_back(option_sources);
+  result.push_back("--startup_options_digest=" +
+                   GetStartupOptionsDigest(result));
   return result;
 }
 
@@ -572,6 +754,29 @@ static void EnsureServerDir(const blaze_util::Path &server_dir) {
   }
 }
 
+// Deletes the class data sharing archive of the server if it was written by
+// another version. The JVM itself only checks the class path, which stays the
+// same across versions with an explicit --install_base, so the install MD5 of
+// the archive is kept next to it.
+static void DeleteStaleClassDataArchive(const blaze_util::Path &server_dir,
+                                        const StartupOptions &startup_options,
+                                        const string &install_md5) {
+  const blaze_util::Path archive = server_dir.GetRelative("server.jsa");
+  const blaze_util::Path key_file = server_dir.GetRelative("server.jsa.key");
+  string key;
+  const bool has_key = blaze_util::ReadFile(key_file, &key);
+  if (GetClassDataArchive(startup_options).IsEmpty()) {
+    if (has_key) {
+      blaze_util::UnlinkPath(archive);
+      blaze_util::UnlinkPath(key_file);
+    }
+  } else if (!has_key || key != install_md5) {
+    blaze_util::UnlinkPath(archive);
+    EnsureServerDir(server_dir);
+    blaze_util::WriteFile(install_md5, key_file);
+  }
+}
+
 // Do a chdir into the workspace, and die if it fails.
 static const void GoToWorkspace(const WorkspaceLayout &workspace_layout,
                                 const string &workspace) {
@@ -583,6 +788,15 @@ static const void GoToWorkspace(const WorkspaceLayout &workspace_layout,
   }
 }
 
+// Applies --batch_cpu_scheduling and --io_nice_level to the server for as long
+// as it runs, unless the server is to apply them per command.
+static void SetServerScheduling(const StartupOptions &startup_options) {
+  if (!startup_options.per_command_scheduling) {
+    SetScheduling(startup_options.batch_cpu_scheduling,
+                  startup_options.io_nice_level);
+  }
+}
+
 static const bool IsServerMode(const string &command) {
   return "exec-server" == command;
 }
@@ -615,8 +829,7 @@ static void RunServerMode(
 
   GoToWorkspace(workspace_layout, workspace);
 
-  SetScheduling(startup_options.batch_cpu_scheduling,
-                startup_options.io_nice_level);
+  SetServerScheduling(startup_options);
 
   {
     WithEnvVars env_obj(PrepareEnvironmentForJvm());
@@ -639,6 +852,10 @@ static void RunBatchMode(
 
   const DurationMillis client_startup_duration(GetMillisecondsMonotonic() -
                                                logging_info->start_time_ms);
+  if (!startup_options.client_profile.IsEmpty()) {
+    ClientProfile::Get().Write(startup_options.client_profile,
+                               client_startup_duration.millis);
+  }
 
   BAZEL_LOG(INFO) << "Starting " << startup_options.product_name
                   << " in batch mode.";
@@ -672,8 +889,7 @@ static void RunBatchMode(
 
   GoToWorkspace(workspace_layout, workspace);
 
-  SetScheduling(startup_options.batch_cpu_scheduling,
-                startup_options.io_nice_level);
+  SetServerScheduling(startup_options);
 
   {
     WithEnvVars env_obj(PrepareEnvironmentForJvm());
@@ -743,7 +959,12 @@ static void ConnectOrDie(const OptionProcessor &option_processor,
     const auto next_attempt_time =
         attempt_time + std::chrono::milliseconds(100);
 
-    if (server->Connect()) {
+    bool connected;
+    {
+      ClientProfilePhase phase("Connect attempt");
+      connected = server->Connect();
+    }
+    if (connected) {
       return;
     }
 
@@ -757,7 +978,11 @@ static void ConnectOrDie(const OptionProcessor &option_processor,
       last_message_time = attempt_time;
     }
 
-    std::this_thread::sleep_until(next_attempt_time);
+    // Try again as soon as the server writes its server info file, rather
+    // than at the next multiple of the attempt interval.
+    server_startup->WaitForServerDirChange(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            next_attempt_time - std::chrono::system_clock::now()));
     if (!server_startup->IsStillAlive()) {
       option_processor.PrintStartupOptionsProvenanceMessage();
       if (server->ProcessInfo().jvm_log_file_append_) {
@@ -831,46 +1056,37 @@ static void StartServerAndConnect(
 
   logging_info->SetRestartReasonIfNotSet(NO_DAEMON);
 
-  SetScheduling(startup_options.batch_cpu_scheduling,
-                startup_options.io_nice_level);
+  SetServerScheduling(startup_options);
 
   BAZEL_LOG(USER) << "Starting local " << startup_options.product_name
                   << " server and connecting to it...";
+  if (!startup_options.standby_registry.empty()) {
+    StandbyServers(startup_options.standby_registry)
+        .ShutDownExcess(startup_options.output_base,
+                        startup_options.standby_servers);
+  }
+
   BlazeServerStartup *server_startup;
-  const int server_pid = ExecuteDaemon(
-      server_exe, server_exe_args, PrepareEnvironmentForJvm(),
-      server->ProcessInfo().jvm_log_file_,
-      server->ProcessInfo().jvm_log_file_append_, startup_options.install_base,
-      server_dir, startup_options, &server_startup);
+  int server_pid;
+  {
+    ClientProfilePhase phase("Spawn server process");
+    server_pid = ExecuteDaemon(
+        server_exe, server_exe_args, PrepareEnvironmentForJvm(),
+        server->ProcessInfo().jvm_log_file_,
+        server->ProcessInfo().jvm_log_file_append_,
+        startup_options.install_base, server_dir, startup_options,
+        &server_startup);
+  }
 
-  ConnectOrDie(option_processor, startup_options, server_pid, server_startup,
-               server);
+  {
+    ClientProfilePhase phase("Wait for server");
+    ConnectOrDie(option_processor, startup_options, server_pid, server_startup,
+                 server);
+  }
 
   delete server_startup;
 }
 
-static bool IsVolatileArg(const string &arg) {
-  // TODO(ccalvarin) when --batch is gone and the startup_options field in the
-  // gRPC message is always set, there is no reason for client options that are
-  // not used at server startup to be part of the startup command line. The
-  // server command line difference logic can be simplified then.
-  static const std::set<string> volatile_startup_options = {
-      "--option_sources=", "--max_idle_secs=", "--connect_timeout_secs=",
-      "--local_startup_timeout_secs=", "--client_debug=", "--preemptible=",
-      // Internally, -XX:HeapDumpPath is set automatically via the user's TMPDIR
-      // environment variable. Since that can change based on the shell, we
-      // tolerate changes to it. Note that an explicit setting of
-      // -XX:HeapDumpPath via --host_jvm_args *will* trigger a restart.
-      "-XX:HeapDumpPath="};
-
-  // Split arg based on the first "=" if one exists in arg.
-  const string::size_type eq_pos = arg.find_first_of('=');
-  const string stripped_arg =
-      (eq_pos == string::npos) ? arg : arg.substr(0, eq_pos + 1);
-
-  return volatile_startup_options.count(stripped_arg);
-}
-
 // Returns true if the server needs to be restarted to accommodate changes
 // between the two argument lists.
 static bool AreStartupOptionsDifferent(
@@ -881,6 +1097,10 @@ static bool AreStartupOptionsDifferent(
   // this version of Bazel: either the default value is listed explicitly or it
   // is not, but this has nothing to do with the user's command line: it is
   // defined by GetServerExeArgs(). Same applies for argument ordering.
+  if (running_server_args == requested_args) {
+    // The usual case, with nothing to tell about.
+    return false;
+  }
   bool options_different = false;
   if (running_server_args.size() != requested_args.size()) {
     BAZEL_LOG(INFO) << "The new command line has a different length from the "
@@ -901,7 +1121,8 @@ static bool AreStartupOptionsDifferent(
   // (d) Because of (b), some flags may have repeated values (e.g
   //     --host_jvm_args="foo" twice) so we cannot simply use two sets and take
   //     the set difference, but must consider the occurrences of each flag.
-  std::unordered_multiset<string> old_args, new_args;
+  // The sets only refer to the arguments, which outlive them.
+  std::unordered_multiset<std::string_view> old_args, new_args;
   for (const string &a : running_server_args) {
     if (!IsVolatileArg(a)) {
       old_args.insert(a);
@@ -921,15 +1142,15 @@ static bool AreStartupOptionsDifferent(
   if (!old_args.empty()) {
     BAZEL_LOG(INFO) << "Args from the running server that are not "
                        "included in the current request:";
-    for (const string &a : old_args) {
-      BAZEL_LOG(INFO) << "  " << a;
+    for (std::string_view a : old_args) {
+      BAZEL_LOG(INFO) << "  " << std::string(a);
     }
   }
   if (!new_args.empty()) {
     BAZEL_LOG(INFO) << "Args from the current request that were not "
                        "included when creating the server:";
-    for (const string &a : new_args) {
-      BAZEL_LOG(INFO) << "  " << a;
+    for (std::string_view a : new_args) {
+      BAZEL_LOG(INFO) << "  " << std::string(a);
     }
   }
 
@@ -1023,19 +1244,17 @@ static void EnsureCorrectRunningVersion(const StartupOptions &startup_options,
 
 static void CancelServer() { blaze_server->Cancel(); }
 
-// Runs the launcher in client/server mode. Ensures that there's indeed a
-// running server, then forwards the user's command to the server and the
-// server's response back to the user. Does not return - exits via exit or
-// signal.
-static ATTRIBUTE_NORETURN void RunClientServerMode(
+// Ensures that there's a running server in the workspace and connects to it,
+// starting a new one if necessary.
+static void EnsureServerConnected(
     const blaze_util::Path &server_exe, const vector<string> &server_exe_args,
     const blaze_util::Path &server_dir, const WorkspaceLayout &workspace_layout,
     const string &workspace, const OptionProcessor &option_processor,
     const StartupOptions &startup_options, LoggingInfo *logging_info,
-    const DurationMillis extract_data_duration,
-    const DurationMillis command_wait_duration_ms, BlazeServer *server) {
+    BlazeServer *server) {
   while (true) {
     if (!server->Connected()) {
+      ClientProfilePhase phase("Start server");
       StartServerAndConnect(server_exe, server_exe_args, server_dir,
                             workspace_layout, workspace, option_processor,
                             startup_options, logging_info, server);
@@ -1073,14 +1292,124 @@ static ATTRIBUTE_NORETURN void RunClientServerMode(
 
   BAZEL_LOG(INFO) << "Connected (server pid="
                   << server->ProcessInfo().server_pid_ << ").";
+}
+
+// Reads the commands of --command_list, one per line, each split into words
+// like a line of an rc file.
+static vector<vector<string>> ReadCommandList(const string &command_list) {
+  string contents;
+  if (command_list == "-") {
+    char buf[4096];
+    size_t size;
+    while ((size = fread(buf, 1, sizeof buf, stdin)) > 0) {
+      contents.append(buf, size);
+    }
+  } else if (!blaze_util::ReadFile(command_list, &contents)) {
+    BAZEL_DIE(blaze_exit_code::BAD_ARGV)
+        << "Cannot read the --command_list file '" << command_list
+        << "': " << GetLastErrorString();
+  }
+
+  vector<vector<string>> commands;
+  for (const string &line : blaze_util::Split(contents, '\n')) {
+    vector<string> words;
+    blaze_util::Tokenize(line, '#', &words);
+    if (!words.empty()) {
+      commands.push_back(std::move(words));
+    }
+  }
+  if (commands.empty()) {
+    BAZEL_DIE(blaze_exit_code::BAD_ARGV)
+        << "The --command_list '" << command_list << "' lists no commands";
+  }
+  return commands;
+}
+
+// Runs the commands of --command_list one after another in the server, which
+// is connected. Returns the exit code of the first command that failed, or
+// SUCCESS. Stops after a command that was interrupted.
+static unsigned int RunCommandList(
+    const blaze_util::Path &server_exe, const vector<string> &server_exe_args,
+    const blaze_util::Path &server_dir, const WorkspaceLayout &workspace_layout,
+    const string &workspace, const OptionProcessor &option_processor,
+    const StartupOptions &startup_options, LoggingInfo *logging_info,
+    const DurationMillis client_startup_duration,
+    const DurationMillis extract_data_duration,
+    const DurationMillis command_wait_duration_ms, BlazeServer *server) {
+  const vector<vector<string>> commands =
+      ReadCommandList(startup_options.command_list);
+  unsigned int result = blaze_exit_code::SUCCESS;
+  for (size_t i = 0; i < commands.size(); ++i) {
+    const string &command = commands[i][0];
+    const vector<string> args(commands[i].begin() + 1, commands[i].end());
+    if (IsServerMode(command)) {
+      BAZEL_DIE(blaze_exit_code::BAD_ARGV)
+          << "'" << command << "' cannot be run from a --command_list";
+    }
+    if (!server->Connected()) {
+      // An earlier command shut the server down.
+      server->AcquireLock();
+      EnsureServerConnected(server_exe, server_exe_args, server_dir,
+                            workspace_layout, workspace, option_processor,
+                            startup_options, logging_info, server);
+    }
+
+    // The time the client spent before the first command is only reported
+    // with it.
+    const unsigned int exit_code = server->Communicate(
+        command, option_processor.GetCommandArguments(command, args),
+        startup_options.invocation_policy,
+        startup_options.original_startup_options_, *logging_info,
+        i == 0 ? client_startup_duration : DurationMillis(),
+        i == 0 ? extract_data_duration : DurationMillis(),
+        i == 0 ? command_wait_duration_ms : DurationMillis());
+    string line;
+    blaze_util::JoinStrings(commands[i], ' ', &line);
+    BAZEL_LOG(USER) << "Command " << (i + 1) << "/" << commands.size()
+                    << " '" << line << "' exited with code " << exit_code;
+    if (result == blaze_exit_code::SUCCESS) {
+      result = exit_code;
+    }
+    if (exit_code == blaze_exit_code::INTERRUPTED) {
+      break;
+    }
+  }
+  return result;
+}
+
+// Runs the launcher in client/server mode. Ensures that there's indeed a
+// running server, then forwards the user's command (or the commands of
+// --command_list) to the server and the server's response back to the user.
+// Does not return - exits via exit or signal.
+static ATTRIBUTE_NORETURN void RunClientServerMode(
+    const blaze_util::Path &server_exe, const vector<string> &server_exe_args,
+    const blaze_util::Path &server_dir, const WorkspaceLayout &workspace_layout,
+    const string &workspace, const OptionProcessor &option_processor,
+    const StartupOptions &startup_options, LoggingInfo *logging_info,
+    const DurationMillis extract_data_duration,
+    const DurationMillis command_wait_duration_ms, BlazeServer *server) {
+  EnsureServerConnected(server_exe, server_exe_args, server_dir,
+                        workspace_layout, workspace, option_processor,
+                        startup_options, logging_info, server);
 
   // Wall clock time since process startup.
   const DurationMillis client_startup_duration =
       (GetMillisecondsMonotonic() - logging_info->start_time_ms);
+  if (!startup_options.client_profile.IsEmpty()) {
+    ClientProfile::Get().Write(startup_options.client_profile,
+                               client_startup_duration.millis);
+  }
 
   SignalHandler::Get().Install(startup_options.product_name,
                                startup_options.output_base,
                                &server->ProcessInfo(), CancelServer);
+  if (!startup_options.command_list.empty()) {
+    SignalHandler::Get().PropagateSignalOrExit(RunCommandList(
+        server_exe, server_exe_args, server_dir, workspace_layout, workspace,
+        option_processor, startup_options, logging_info,
+        client_startup_duration, extract_data_duration,
+        command_wait_duration_ms, server));
+  }
   SignalHandler::Get().PropagateSignalOrExit(server->Communicate(
       option_processor.GetCommand(), option_processor.GetCommandArguments(),
       startup_options.invocation_policy,
@@ -1120,16 +1449,32 @@ static void UpdateConfiguration(const string &install_md5,
                                 StartupOptions *startup_options) {
   // The default install_base is <output_user_root>/install/<md5(blaze)>
   // but if an install_base is specified on the command line, we use that as
-  // the base instead.
+  // the base instead. A pre-extracted one under --shared_install_base_root
+  // takes precedence over the default.
   if (startup_options->install_base.empty()) {
     if (server_mode) {
       BAZEL_DIE(blaze_exit_code::BAD_ARGV)
           << "exec-server requires --install_base";
     }
-    string install_user_root =
-        blaze_util::JoinPath(startup_options->output_user_root, "install");
-    startup_options->install_base =
-        blaze_util::JoinPath(install_user_root, install_md5);
+    string shared_install_base;
+    if (!startup_options->shared_install_base_root.empty()) {
+      shared_install_base = blaze_util::JoinPath(
+          startup_options->shared_install_base_root, install_md5);
+    }
+    if (!shared_install_base.empty() &&
+        blaze_util::IsDirectory(shared_install_base)) {
+      startup_options->install_base = shared_install_base;
+      startup_options->install_base_is_shared = true;
+    } else {
+      if (!shared_install_base.empty()) {
+        BAZEL_LOG(INFO) << "No shared install base at '" << shared_install_base
+                        << "', using a private one";
+      }
+      string install_user_root =
+          blaze_util::JoinPath(startup_options->output_user_root, "install");
+      startup_options->install_base =
+          blaze_util::JoinPath(install_user_root, install_md5);
+    }
   }
 
   if (startup_options->output_base.IsEmpty()) {
@@ -1137,8 +1482,21 @@ static void UpdateConfiguration(const string &install_md5,
       BAZEL_DIE(blaze_exit_code::BAD_ARGV)
           << "exec-server requires --output_base";
     }
-    startup_options->output_base = blaze_util::Path(
-        blaze::GetHashedBaseDir(startup_options->output_user_root, workspace));
+    if (startup_options->standby_servers > 0 && !startup_options->batch) {
+      // A separate output base, and so server, for every set of startup
+      // options.
+      const string key =
+          GetStandbyServerKey(startup_options->original_startup_options_);
+      startup_options->output_base = blaze_util::Path(blaze::GetHashedBaseDir(
+          startup_options->output_user_root,
+          key.empty() ? workspace : workspace + '\0' + key));
+      startup_options->standby_registry = blaze::GetHashedBaseDir(
+          blaze_util::JoinPath(startup_options->output_user_root, "standby"),
+          workspace);
+    } else {
+      startup_options->output_base = blaze_util::Path(blaze::GetHashedBaseDir(
+          startup_options->output_user_root, workspace));
+    }
   }
 
   if (!blaze_util::PathExists(startup_options->output_base)) {
@@ -1377,18 +1735,54 @@ static void RunLauncher(const string &self_path,
                         const OptionProcessor &option_processor,
                         const WorkspaceLayout &workspace_layout,
                         const string &workspace, LoggingInfo *logging_info) {
+  if (!startup_options.command_list.empty()) {
+    if (startup_options.batch) {
+      BAZEL_DIE(blaze_exit_code::BAD_ARGV)
+          << "--command_list cannot be used with --batch";
+    }
+    if (!option_processor.GetCommand().empty()) {
+      BAZEL_DIE(blaze_exit_code::BAD_ARGV)
+          << "A command cannot be given on the command line with "
+             "--command_list ('"
+          << option_processor.GetCommand() << "' was)";
+    }
+  }
+
   blaze_server = new BlazeServer(startup_options);
 
-  const DurationMillis command_wait_duration_ms(blaze_server->AcquireLock());
+  uint64_t lock_wait_ms;
+  {
+    ClientProfilePhase phase("Acquire client lock");
+    lock_wait_ms = blaze_server->AcquireLock();
+  }
+  const DurationMillis command_wait_duration_ms(lock_wait_ms);
   BAZEL_LOG(INFO) << "Acquired the client lock, waited "
                   << command_wait_duration_ms.millis << " milliseconds";
+  if (!startup_options.standby_registry.empty()) {
+    StandbyServers(startup_options.standby_registry)
+        .RecordUse(startup_options.output_base);
+  }
+  if (startup_options.output_base_max_age_days > 0) {
+    CollectUnusedOutputBases(startup_options.output_user_root,
+                             startup_options.output_base,
+                             startup_options.output_base_max_age_days);
+  }
 
   WarnFilesystemType(startup_options.output_base);
 
-  const ExtractionDurationMillis extract_data_duration = ExtractData(
-      self_path, archive_contents, install_md5, startup_options, logging_info);
+  // ExtractionDurationMillis has const members and can't be assigned to, so
+  // the phase is scoped to a lambda.
+  auto extract_data = [&]() {
+    ClientProfilePhase phase("Extract install base");
+    return ExtractData(self_path, archive_contents, install_md5,
+                       startup_options, logging_info);
+  };
+  const ExtractionDurationMillis extract_data_duration = extract_data();
 
-  blaze_server->Connect();
+  {
+    ClientProfilePhase phase("Connect to server");
+    blaze_server->Connect();
+  }
 
   if (!startup_options.batch && "shutdown" == option_processor.GetCommand() &&
       !blaze_server->Connected()) {
@@ -1398,8 +1792,6 @@ static void RunLauncher(const string &self_path,
     return;
   }
 
-  EnsureCorrectRunningVersion(startup_options, logging_info, blaze_server);
-
   const blaze_util::Path jvm_path = startup_options.GetJvm();
   const string server_jar_path = GetServerJarPath(archive_contents);
 
@@ -1428,14 +1820,29 @@ static void RunLauncher(const string &self_path,
   server_exe_args[0] = server_exe.AsNativePath();
 #endif
 
-  if (KillRunningServerIfDifferentStartupOptions(
-          startup_options, server_exe_args, logging_info, blaze_server) &&
-      "shutdown" == option_processor.GetCommand()) {
+  // A server that reports our install MD5 and startup options digest was
+  // started by a client like us, which checked the rest.
+  bool killed_server = false;
+  if (!blaze_server->HasIdentity(install_md5,
+                                 GetStartupOptionsDigest(server_exe_args))) {
+    {
+      ClientProfilePhase phase("Check server version");
+      EnsureCorrectRunningVersion(startup_options, logging_info,
+                                  blaze_server);
+    }
+    ClientProfilePhase phase("Check server startup options");
+    killed_server = KillRunningServerIfDifferentStartupOptions(
+        startup_options, server_exe_args, logging_info, blaze_server);
+  }
+  if (killed_server && "shutdown" == option_processor.GetCommand()) {
     return;
   }
 
   const blaze_util::Path server_dir =
       blaze_util::Path(startup_options.output_base).GetRelative("server");
+  // A server of another version is no longer running here, so it can't write
+  // its archive after this.
+  DeleteStaleClassDataArchive(server_dir, startup_options, install_md5);
   if (IsServerMode(option_processor.GetCommand())) {
     RunServerMode(server_exe, server_exe_args, server_dir, workspace_layout,
                   workspace, option_processor, startup_options, blaze_server);
@@ -1498,7 +1905,10 @@ int Main(int argc, const char *const *argv, WorkspaceLayout *workspace_layout,
 #endif  // if defined(_WIN32) || defined(__CYGWIN__)
 
   const string workspace = workspace_layout->GetWorkspace(cwd);
-  ParseOptionsOrDie(cwd, workspace, *option_processor, argc, argv);
+  {
+    ClientProfilePhase phase("Parse options");
+    ParseOptionsOrDie(cwd, workspace, *option_processor, argc, argv);
+  }
   StartupOptions *startup_options = option_processor->GetParsedStartupOptions();
   startup_options->MaybeLogStartupOptionWarnings();
 
@@ -1526,7 +1936,10 @@ int Main(int argc, const char *const *argv, WorkspaceLayout *workspace_layout,
 
   vector<string> archive_contents;
   string install_md5;
-  DetermineArchiveContents(self_path, &archive_contents, &install_md5);
+  {
+    ClientProfilePhase phase("Read archive contents");
+    DetermineArchiveContents(self_path, &archive_contents, &install_md5);
+  }
 
   UpdateConfiguration(install_md5, workspace,
                       IsServerMode(option_processor->GetCommand()),
@@ -1551,7 +1964,8 @@ static bool ProtoStringEqual(const StringTypeA &cookieA,
 }
 
 BlazeServer::BlazeServer(const StartupOptions &startup_options)
-    : process_info_(startup_options.output_base,
+    : blaze_lock_held_(false),
+      process_info_(startup_options.output_base,
                     startup_options.server_jvm_out),
       connect_timeout_secs_(startup_options.connect_timeout_secs),
       batch_(startup_options.batch),
@@ -1584,6 +1998,8 @@ bool BlazeServer::TryConnect(CommandServer::Stub *client) {
     return false;
   }
 
+  server_install_md5_ = response.install_md5();
+  server_startup_options_digest_ = response.startup_options_digest();
   return true;
 }
 
@@ -1604,11 +2020,17 @@ bool BlazeServer::Connect() {
   const std::string ipv4_prefix = "127.0.0.1:";
   const std::string ipv6_prefix_1 = "[0:0:0:0:0:0:0:1]:";
   const std::string ipv6_prefix_2 = "[::1]:";
+  // With --experimental_unix_domain_socket, a socket in the server directory
+  // or, on Linux, in the abstract namespace. Both are local by definition.
+  const std::string unix_prefix = "unix:";
+  const std::string unix_abstract_prefix = "unix-abstract:";
 
   // Make sure that we are being directed to localhost
   if (port.compare(0, ipv4_prefix.size(), ipv4_prefix) &&
       port.compare(0, ipv6_prefix_1.size(), ipv6_prefix_1) &&
-      port.compare(0, ipv6_prefix_2.size(), ipv6_prefix_2)) {
+      port.compare(0, ipv6_prefix_2.size(), ipv6_prefix_2) &&
+      port.compare(0, unix_prefix.size(), unix_prefix) &&
+      port.compare(0, unix_abstract_prefix.size(), unix_abstract_prefix)) {
     return false;
   }
 
@@ -1637,7 +2059,16 @@ bool BlazeServer::Connect() {
     return false;
   }
 
+  // Cancel requests get a connection of their own, so that they are not
+  // queued behind the output of the command on the connection it streams
+  // over. It is set up now so that it is ready when the user hits Ctrl-C.
+  channel_args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+  std::shared_ptr<grpc::Channel> cancel_channel(grpc::CreateCustomChannel(
+      port, grpc::InsecureChannelCredentials(), channel_args));
+  cancel_channel->GetState(/* try_to_connect= */ true);
+
   this->client_ = std::move(client);
+  this->cancel_client_ = CommandServer::NewStub(cancel_channel);
   process_info_.server_pid_ = server_pid;
   return true;
 }
@@ -1717,6 +2148,9 @@ void BlazeServer::CancelThread() {
 
 void BlazeServer::SendCancelMessage() {
   std::unique_lock<std::mutex> lock(cancel_thread_mutex_);
+  if (cancel_client_ == nullptr) {
+    return;
+  }
 
   command_server::CancelRequest request;
   request.set_cookie(request_cookie_);
@@ -1726,7 +2160,8 @@ void BlazeServer::SendCancelMessage() {
                        std::chrono::seconds(10));
   command_server::CancelResponse response;
   // There isn't a lot we can do if this request fails
-  grpc::Status status = client_->Cancel(&context, request, &response);
+  grpc::Status status =
+      cancel_client_->Cancel(&context, request, &response);
   if (!status.ok()) {
     BAZEL_LOG(USER) << "\nCould not interrupt server: (" << status.error_code()
                     << ") " << status.error_message().c_str() << "\n";
@@ -1785,6 +2220,7 @@ void BlazeServer::KillRunningServer() {
   // wait $GRPC_CLIENT_CHANNEL_BACKUP_POLL_INTERVAL_MS until we go away.
   // See http://b/143860035.
   client_.reset();
+  cancel_client_.reset();
 
   // Wait for the server process to terminate (if we know the server PID).
   // If it does not terminate itself gracefully within 1m, terminate it.
@@ -1803,7 +2239,7 @@ void BlazeServer::KillRunningServer() {
 }
 
 unsigned int BlazeServer::Communicate(
-    const string &command, const vector<string> &command_args,
+    const string &command, vector<string> command_args,
     const string &invocation_policy,
     const vector<RcStartupFlag> &original_startup_options,
     const LoggingInfo &logging_info,
@@ -1820,15 +2256,48 @@ unsigned int BlazeServer::Communicate(
                    command_wait_duration_ms, &arg_vector);
   }
 
-  arg_vector.insert(arg_vector.end(), command_args.begin(), command_args.end());
+  // The arguments are moved rather than copied: with a large environment or
+  // many rc files, there are thousands of them.
+  arg_vector.insert(arg_vector.end(),
+                    std::make_move_iterator(command_args.begin()),
+                    std::make_move_iterator(command_args.end()));
 
   command_server::RunRequest request;
   request.set_cookie(request_cookie_);
   request.set_block_for_lock(block_for_lock_);
   request.set_preemptible(preemptible_);
   request.set_client_description("pid=" + blaze::GetProcessIdAsString());
+  request.set_max_output_chunk_size(kMaxOutputChunkSize);
+  size_t arg_bytes = 0;
   for (const string &arg : arg_vector) {
-    request.add_arg(arg);
+    arg_bytes += arg.size() + 1;
+  }
+  // Deleted once the server has answered, by which time it has read it.
+  blaze_util::Path arg_file;
+  if (arg_bytes > kMaxInlineArgBytes) {
+    string content;
+    content.reserve(arg_bytes);
+    for (const string &arg : arg_vector) {
+      content.append(arg.data(), arg.size() + 1);
+    }
+    blaze_util::Md5Digest digest;
+    digest.Update(content.data(), content.size());
+    unsigned char buf[blaze_util::Md5Digest::kDigestLength];
+    digest.Finish(buf);
+    const string name = "run_request_args." + GetProcessIdAsString();
+    arg_file = output_base_.GetRelative("server").GetRelative(name);
+    if (!blaze_util::WriteFile(content, arg_file, 0600)) {
+      BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+          << "Couldn't write the arguments to " << arg_file.AsPrintablePath()
+          << ": " << GetLastErrorString();
+    }
+    request.set_arg_file(name);
+    request.set_arg_file_digest(digest.String());
+  } else {
+    request.mutable_arg()->Reserve(arg_vector.size());
+    for (string &arg : arg_vector) {
+      request.add_arg(std::move(arg));
+    }
   }
   if (!invocation_policy.empty()) {
     request.set_invocation_policy(invocation_policy);
@@ -1837,7 +2306,6 @@ unsigned int BlazeServer::Communicate(
   for (const auto &startup_option : original_startup_options) {
     command_server::StartupOption *proto_option_field =
         request.add_startup_options();
-    request.add_startup_options();
     proto_option_field->set_source(startup_option.source);
     proto_option_field->set_option(startup_option.value);
   }
@@ -1850,9 +2318,12 @@ unsigned int BlazeServer::Communicate(
   // Release the server lock because the gRPC handles concurrent clients just
   // fine. Note that this may result in two "waiting for other client" messages
   // (one during server startup and one emitted by the server)
-  BAZEL_LOG(INFO)
-      << "Releasing client lock, let the server manage concurrent requests.";
-  blaze::ReleaseLock(&blaze_lock_);
+  if (blaze_lock_held_) {
+    BAZEL_LOG(INFO)
+        << "Releasing client lock, let the server manage concurrent requests.";
+    blaze::ReleaseLock(&blaze_lock_);
+    blaze_lock_held_ = false;
+  }
 
   std::thread cancel_thread(&BlazeServer::CancelThread, this);
   bool command_id_set = false;
@@ -1860,43 +2331,41 @@ unsigned int BlazeServer::Communicate(
   command_server::RunResponse final_response;
   bool finished = false;
   bool finished_warning_emitted = false;
+  std::unique_ptr<OutputForwarder> output(
+      new OutputForwarder(kMaxBufferedOutputBytes));
 
   while (reader->Read(&response)) {
+    if (!arg_file.IsEmpty()) {
+      blaze_util::UnlinkPath(arg_file);
+      arg_file = blaze_util::Path();
+    }
+
     if (finished && !finished_warning_emitted) {
+      output->Flush();
       BAZEL_LOG(USER) << "\nServer returned messages after reporting exit code";
       finished_warning_emitted = true;
     }
 
     if (!ProtoStringEqual(response.cookie(), response_cookie_)) {
+      output->Flush();
       BAZEL_LOG(USER) << "\nServer response cookie invalid, exiting";
       return blaze_exit_code::INTERNAL_ERROR;
     }
 
-    const char *broken_pipe_name = nullptr;
-
-    if (response.finished()) {
-      final_response = response;
-      finished = true;
-    }
-
     if (!response.standard_output().empty()) {
-      size_t size = response.standard_output().size();
-      if (blaze_util::WriteToStdOutErr(response.standard_output().c_str(), size,
-                                       /* to_stdout */ true) ==
-          blaze_util::WriteResult::BROKEN_PIPE) {
-        broken_pipe_name = "standard output";
-      }
+      output->Write(/* to_stdout */ true, response.mutable_standard_output());
     }
 
     if (!response.standard_error().empty()) {
-      size_t size = response.standard_error().size();
-      if (blaze_util::WriteToStdOutErr(response.standard_error().c_str(), size,
-                                       /* to_stdout */ false) ==
-          blaze_util::WriteResult::BROKEN_PIPE) {
-        broken_pipe_name = "standard error";
-      }
+      output->Write(/* to_stdout */ false, response.mutable_standard_error());
     }
 
+    if (response.finished()) {
+      final_response = response;
+      finished = true;
+    }
+
+    const char *broken_pipe_name = output->BrokenPipeName();
     if (broken_pipe_name != nullptr && !pipe_broken) {
       pipe_broken = true;
       BAZEL_LOG(USER) << "\nCannot write to " << broken_pipe_name
@@ -1912,6 +2381,12 @@ unsigned int BlazeServer::Communicate(
     }
   }
 
+  // Write the rest of the output before anything else is printed.
+  output.reset();
+  if (!arg_file.IsEmpty()) {
+    blaze_util::UnlinkPath(arg_file);
+  }
+
   grpc::Status status = reader->Finish();
   reader.reset();
   context.reset();  // necessary for destroying client_ below to be effective
@@ -1923,6 +2398,10 @@ unsigned int BlazeServer::Communicate(
     // wait $GRPC_CLIENT_CHANNEL_BACKUP_POLL_INTERVAL_MS until we go away.
     // See http://b/143860035.
     client_.reset();
+    {
+      std::lock_guard<std::mutex> lock(cancel_thread_mutex_);
+      cancel_client_.reset();
+    }
     if (!AwaitServerProcessTermination(process_info_.server_pid_, output_base_,
                                        kPostShutdownGracePeriodSeconds)) {
       KillServerProcess(process_info_.server_pid_, output_base_);
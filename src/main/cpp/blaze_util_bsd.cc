@@ -245,4 +245,22 @@ int32_t GetExplicitSystemLimit(const int resource) {
   return -1;
 }
 
+// Not supported.
+bool GetSystemMemory(uint64_t *total_bytes, uint64_t *available_bytes) {
+  return false;
+}
+
+bool GetUsableResources(uint64_t *memory_bytes, double *cpus,
+                        int *numa_nodes) {
+  long pages = sysconf(_SC_PHYS_PAGES);  // NOLINT
+  long page_size = sysconf(_SC_PAGESIZE);  // NOLINT
+  if (pages <= 0 || page_size <= 0) {
+    return false;
+  }
+  *memory_bytes = static_cast<uint64_t>(pages) * page_size;
+  *cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  *numa_nodes = 1;
+  return true;
+}
+
 }  // namespace blaze
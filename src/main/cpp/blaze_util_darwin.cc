@@ -15,6 +15,7 @@
 #include "src/main/cpp/blaze_util_platform.h"
 
 #include <libproc.h>
+#include <mach/mach.h>
 #include <pthread/spawn.h>
 #include <signal.h>
 #include <spawn.h>
@@ -270,4 +271,37 @@ int32_t GetExplicitSystemLimit(const int resource) {
   return limit;
 }
 
+bool GetSystemMemory(uint64_t *total_bytes, uint64_t *available_bytes) {
+  uint64_t memsize;
+  size_t len = sizeof(memsize);
+  if (sysctlbyname("hw.memsize", &memsize, &len, nullptr, 0) == -1) {
+    return false;
+  }
+  vm_statistics64_data_t vm_stats;
+  mach_msg_type_number_t count = HOST_VM_INFO64_COUNT;
+  if (host_statistics64(mach_host_self(), HOST_VM_INFO64,
+                        reinterpret_cast<host_info64_t>(&vm_stats),
+                        &count) != KERN_SUCCESS) {
+    return false;
+  }
+  // Inactive and purgeable pages are reclaimed before anything is swapped.
+  *total_bytes = memsize;
+  *available_bytes = static_cast<uint64_t>(vm_stats.free_count +
+                                           vm_stats.inactive_count +
+                                           vm_stats.purgeable_count) *
+                     vm_page_size;
+  return true;
+}
+
+bool GetUsableResources(uint64_t *memory_bytes, double *cpus,
+                        int *numa_nodes) {
+  size_t len = sizeof(*memory_bytes);
+  if (sysctlbyname("hw.memsize", memory_bytes, &len, nullptr, 0) == -1) {
+    return false;
+  }
+  *cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  *numa_nodes = 1;
+  return true;
+}
+
 }   // namespace blaze.
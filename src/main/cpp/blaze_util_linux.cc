@@ -16,6 +16,7 @@
 #include <limits.h>
 #include <linux/magic.h>
 #include <pwd.h>
+#include <sched.h>
 #include <signal.h>
 #include <spawn.h>
 #include <stdio.h>
@@ -27,6 +28,8 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #include "src/main/cpp/blaze_util_platform.h"
 #include "src/main/cpp/util/errors.h"
 #include "src/main/cpp/util/exit_code.h"
@@ -232,4 +235,106 @@ int32_t GetExplicitSystemLimit(const int resource) {
   return -1;
 }
 
+bool GetSystemMemory(uint64_t *total_bytes, uint64_t *available_bytes) {
+  string meminfo;
+  if (!blaze_util::ReadFile("/proc/meminfo", &meminfo)) {
+    return false;
+  }
+  bool have_total = false, have_available = false;
+  for (const string &line : blaze_util::Split(meminfo, '\n')) {
+    unsigned long long kb;  // NOLINT
+    if (sscanf(line.c_str(), "MemTotal: %llu kB", &kb) == 1) {
+      *total_bytes = kb * 1024;
+      have_total = true;
+    } else if (sscanf(line.c_str(), "MemAvailable: %llu kB", &kb) == 1) {
+      *available_bytes = kb * 1024;
+      have_available = true;
+    }
+  }
+  return have_total && have_available;
+}
+
+// Lowers `*memory_bytes` and `*cpus` to the limits in the cgroup v2 directory
+// `dir`.
+static void ApplyCgroupV2Limits(const string &dir, uint64_t *memory_bytes,
+                                double *cpus) {
+  string content;
+  unsigned long long limit;  // NOLINT
+  if (blaze_util::ReadFile(dir + "/memory.max", &content) &&
+      sscanf(content.c_str(), "%llu", &limit) == 1) {
+    *memory_bytes = std::min<uint64_t>(*memory_bytes, limit);
+  }
+  long long quota, period;  // NOLINT
+  if (blaze_util::ReadFile(dir + "/cpu.max", &content) &&
+      sscanf(content.c_str(), "%lld %lld", &quota, &period) == 2 &&
+      quota > 0 && period > 0) {
+    *cpus = std::min(*cpus, static_cast<double>(quota) / period);
+  }
+}
+
+// Lowers `*memory_bytes` to the limit in the cgroup v1 memory controller
+// directory `dir`.
+static void ApplyCgroupV1MemoryLimit(const string &dir,
+                                     uint64_t *memory_bytes) {
+  string content;
+  unsigned long long limit;  // NOLINT
+  if (blaze_util::ReadFile(dir + "/memory.limit_in_bytes", &content) &&
+      sscanf(content.c_str(), "%llu", &limit) == 1) {
+    *memory_bytes = std::min<uint64_t>(*memory_bytes, limit);
+  }
+}
+
+bool GetUsableResources(uint64_t *memory_bytes, double *cpus,
+                        int *numa_nodes) {
+  uint64_t available_bytes;
+  if (!GetSystemMemory(memory_bytes, &available_bytes)) {
+    return false;
+  }
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) == 0) {
+    *cpus = CPU_COUNT(&cpu_set);
+  } else {
+    *cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+
+  // The limits of the ancestors of a cgroup apply to it too.
+  string cgroups;
+  if (blaze_util::ReadFile("/proc/self/cgroup", &cgroups)) {
+    for (const string &line : blaze_util::Split(cgroups, '\n')) {
+      if (line.compare(0, 3, "0::") == 0) {
+        for (string dir = "/sys/fs/cgroup" + line.substr(3);
+             dir.size() >= strlen("/sys/fs/cgroup");
+             dir = dir.substr(0, dir.rfind('/'))) {
+          ApplyCgroupV2Limits(dir, memory_bytes, cpus);
+        }
+      } else if (line.find(":memory:/") != string::npos) {
+        const string root = "/sys/fs/cgroup/memory";
+        for (string dir = root + line.substr(line.find(":memory:/") + 8);
+             dir.size() >= root.size(); dir = dir.substr(0, dir.rfind('/'))) {
+          ApplyCgroupV1MemoryLimit(dir, memory_bytes);
+        }
+      }
+    }
+  }
+
+  *numa_nodes = 1;
+  string online;
+  if (blaze_util::ReadFile("/sys/devices/system/node/online", &online)) {
+    // E.g. "0-1,3".
+    int count = 0;
+    for (const string &range : blaze_util::Split(online, ',')) {
+      int first, last;
+      int fields = sscanf(range.c_str(), "%d-%d", &first, &last);
+      if (fields == 2 && last >= first) {
+        count += last - first + 1;
+      } else if (fields == 1) {
+        ++count;
+      }
+    }
+    *numa_nodes = std::max(count, 1);
+  }
+  return true;
+}
+
 }  // namespace blaze
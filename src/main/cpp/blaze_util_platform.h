@@ -15,6 +15,7 @@
 #ifndef BAZEL_SRC_MAIN_CPP_BLAZE_UTIL_PLATFORM_H_
 #define BAZEL_SRC_MAIN_CPP_BLAZE_UTIL_PLATFORM_H_
 
+#include <chrono>  // NOLINT
 #include <cinttypes>
 #include <map>
 #include <memory>
@@ -172,6 +173,12 @@ class BlazeServerStartup {
  public:
   virtual ~BlazeServerStartup() {}
   virtual bool IsStillAlive() = 0;
+
+  // Waits until an entry is added to the server directory (the server
+  // renames its server info file into place once it accepts connections),
+  // the server dies, or `timeout` passes, whichever comes first. Where the
+  // directory can't be watched, only the latter two end the wait.
+  virtual void WaitForServerDirChange(std::chrono::milliseconds timeout) = 0;
 };
 
 
@@ -215,6 +222,11 @@ uint64_t AcquireLock(const blaze_util::Path& output_base, bool batch_mode,
 // usual.
 void ReleaseLock(BlazeLock* blaze_lock);
 
+// Acquires the lock on the output base if no one else holds it, without
+// waiting or writing the owner into the lock file. Returns false if the lock
+// is held or cannot be taken.
+bool TryAcquireLock(const blaze_util::Path& output_base, BlazeLock* blaze_lock);
+
 // Verifies whether the server process still exists. Returns true if it does.
 bool VerifyServerProcess(int pid, const blaze_util::Path& output_base);
 
@@ -284,6 +296,17 @@ int GetTerminalColumns();
 // function is implemented for the platform.
 int32_t GetExplicitSystemLimit(const int resource);
 
+// Gets the physical memory of the machine and how much of it is available to
+// new processes without swapping, in bytes. Returns false if this is not
+// known on this platform.
+bool GetSystemMemory(uint64_t* total_bytes, uint64_t* available_bytes);
+
+// Gets what the server may use of the machine: its physical memory, or the
+// memory limit of the client's cgroup or job if that is lower, the cpus the
+// client may run on, or the cpu quota of its cgroup if that is lower, and the
+// number of NUMA nodes. Returns false if this is not known on this platform.
+bool GetUsableResources(uint64_t* memory_bytes, double* cpus, int* numa_nodes);
+
 // Raises soft system resource limits to hard limits in an attempt to let
 // large builds work. This is a best-effort operation and may or may not be
 // implemented for a given platform. Returns true if all limits were properly
@@ -35,14 +35,26 @@
 #include <time.h>
 #include <unistd.h>
 
+#if defined(__linux__)
+#include <sys/inotify.h>
+#else
+#include <sys/event.h>
+#endif
+
 #include <algorithm>
 #include <cassert>
 #include <cinttypes>
+#include <condition_variable>  // NOLINT
 #include <cstdlib>
+#include <deque>
 #include <fstream>
 #include <iterator>
+#include <memory>
+#include <mutex>  // NOLINT
 #include <set>
 #include <string>
+#include <thread>  // NOLINT
+#include <vector>
 
 #include "src/main/cpp/blaze_util.h"
 #include "src/main/cpp/startup_options.h"
@@ -74,47 +86,126 @@ class PosixDumper : public Dumper {
   bool Finish(string* error) override;
 
  private:
-  PosixDumper() : was_error_(false) {}
+  struct Task {
+    std::unique_ptr<uint8_t[]> data;
+    size_t size;
+    string path;
+  };
+
+  PosixDumper() : was_error_(false), finished_(false) {}
 
+  // Writes the queued files until Finish() is called and the queue is empty.
+  void WriteLoop();
+  void SetError(const string& msg);
+
+  // Only accessed from the thread calling Dump().
   set<string> dir_cache_;
+  vector<std::thread> workers_;
+
+  std::mutex mutex_;
+  std::condition_variable queue_changed_;
+  std::deque<Task> queue_;
   string error_msg_;
   bool was_error_;
+  bool finished_;
 };
 
+// Writing the files is dominated by the latency of the file system, so more
+// threads than cores still help, like the Windows thread pool.
+static const size_t kDumperThreads = 8;
+
+// The number of files Dump() queues per thread before waiting for the
+// threads, which caps the memory held by copies of the file contents.
+static const size_t kMaxQueuedPerThread = 16;
+
 Dumper* Create(string* error) { return PosixDumper::Create(error); }
 
-PosixDumper* PosixDumper::Create(string* error) { return new PosixDumper(); }
+PosixDumper* PosixDumper::Create(string* error) {
+  std::unique_ptr<PosixDumper> result(new PosixDumper());
+  for (size_t i = 0; i < kDumperThreads; ++i) {
+    result->workers_.emplace_back(&PosixDumper::WriteLoop, result.get());
+  }
+  return result.release();
+}
 
 void PosixDumper::Dump(const void* data, const size_t size,
                        const string& path) {
-  if (was_error_) {
-    return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (was_error_ || finished_) {
+      return;
+    }
   }
 
   string dirname = blaze_util::Dirname(path);
   // Performance optimization: memoize the paths we already created a
   // directory for, to spare a stat in attempting to recreate an already
-  // existing directory.
+  // existing directory. Directories are created here rather than on the
+  // writing threads so that those never race to create the same one.
   if (dir_cache_.insert(dirname).second) {
     if (!blaze_util::MakeDirectories(dirname, 0777)) {
-      was_error_ = true;
       string msg = GetLastErrorString();
-      error_msg_ = string("couldn't create '") + path + "': " + msg;
+      SetError(string("couldn't create '") + path + "': " + msg);
+      return;
     }
   }
 
-  if (was_error_) {
-    return;
+  Task task{std::unique_ptr<uint8_t[]>(new uint8_t[size]), size, path};
+  memcpy(task.data.get(), data, size);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  queue_changed_.wait(lock, [this] {
+    return was_error_ || queue_.size() < kDumperThreads * kMaxQueuedPerThread;
+  });
+  if (!was_error_) {
+    queue_.push_back(std::move(task));
+    queue_changed_.notify_all();
   }
+}
+
+void PosixDumper::WriteLoop() {
+  for (;;) {
+    Task task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      queue_changed_.wait(lock,
+                          [this] { return finished_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      task = std::move(queue_.front());
+      queue_.pop_front();
+      queue_changed_.notify_all();
+    }
+    if (!blaze_util::WriteFile(task.data.get(), task.size, task.path, 0755)) {
+      string msg = GetLastErrorString();
+      SetError(string("Failed to write zipped file '") + task.path +
+               "': " + msg);
+    }
+  }
+}
 
-  if (!blaze_util::WriteFile(data, size, path, 0755)) {
+void PosixDumper::SetError(const string& msg) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!was_error_) {
     was_error_ = true;
-    string msg = GetLastErrorString();
-    error_msg_ = string("Failed to write zipped file '") + path + "': " + msg;
+    error_msg_ = msg;
+    queue_.clear();
+    queue_changed_.notify_all();
   }
 }
 
 bool PosixDumper::Finish(string* error) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    finished_ = true;
+    queue_changed_.notify_all();
+  }
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+
   if (was_error_ && error) {
     *error = error_msg_;
   }
@@ -318,6 +409,7 @@ ATTRIBUTE_NORETURN static void ExecuteProgram(
   // priority of Bazel on macOS from a QoS perspective, this could have
   // adverse scheduling effects on any tools invoked via ExecuteProgram.
   CharPP argv(args_vector);
+  blaze_util::FlushLogging();
   execv(exe.AsNativePath().c_str(), argv.get());
   string err = GetLastErrorString();
   BAZEL_DIE(blaze_exit_code::INTERNAL_ERROR)
@@ -346,22 +438,102 @@ bool SymlinkDirectories(const string& target, const blaze_util::Path& link) {
 // Notifies the client about the death of the server process by keeping a socket
 // open in the server. If the server dies for any reason, the socket will be
 // closed, which can be detected by the client.
+// Starts watching `dir` for entries created in or renamed into it, which
+// makes the returned descriptor readable until ClearDirectoryWatch is called.
+// Sets `dir_fd` to a descriptor that must stay open while the watch is used,
+// or -1. Returns -1 if the directory can't be watched.
+static int WatchDirectory(const blaze_util::Path &dir, int *dir_fd) {
+  *dir_fd = -1;
+#if defined(__linux__)
+  int watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (watch_fd < 0) {
+    return -1;
+  }
+  if (inotify_add_watch(watch_fd, dir.AsNativePath().c_str(),
+                        IN_CREATE | IN_MOVED_TO) < 0) {
+    close(watch_fd);
+    return -1;
+  }
+  return watch_fd;
+#else
+  *dir_fd = open(dir.AsNativePath().c_str(), O_RDONLY | O_CLOEXEC);
+  if (*dir_fd < 0) {
+    return -1;
+  }
+  int watch_fd = kqueue();
+  struct kevent change;
+  EV_SET(&change, *dir_fd, EVFILT_VNODE, EV_ADD | EV_CLEAR, NOTE_WRITE, 0,
+         nullptr);
+  if (watch_fd < 0 || kevent(watch_fd, &change, 1, nullptr, 0, nullptr) < 0) {
+    if (watch_fd >= 0) {
+      close(watch_fd);
+    }
+    close(*dir_fd);
+    *dir_fd = -1;
+    return -1;
+  }
+  return watch_fd;
+#endif
+}
+
+static void ClearDirectoryWatch(int watch_fd) {
+#if defined(__linux__)
+  char events[4096];
+  while (read(watch_fd, events, sizeof(events)) > 0) {
+  }
+#else
+  struct kevent event;
+  const struct timespec no_wait = {0, 0};
+  while (kevent(watch_fd, nullptr, 0, &event, 1, &no_wait) > 0) {
+  }
+#endif
+}
+
 class SocketBlazeServerStartup : public BlazeServerStartup {
  public:
-  SocketBlazeServerStartup(int pipe_fd);
+  SocketBlazeServerStartup(int pipe_fd, int watch_fd, int dir_fd);
   virtual ~SocketBlazeServerStartup();
   virtual bool IsStillAlive();
+  void WaitForServerDirChange(std::chrono::milliseconds timeout) override;
 
  private:
   int fd;
+  // Watches the server directory, or -1.
+  int watch_fd;
+  int dir_fd;
 };
 
-SocketBlazeServerStartup::SocketBlazeServerStartup(int fd)
-    : fd(fd) {
-}
+SocketBlazeServerStartup::SocketBlazeServerStartup(int fd, int watch_fd,
+                                                   int dir_fd)
+    : fd(fd), watch_fd(watch_fd), dir_fd(dir_fd) {}
 
 SocketBlazeServerStartup::~SocketBlazeServerStartup() {
   close(fd);
+  if (watch_fd >= 0) {
+    close(watch_fd);
+  }
+  if (dir_fd >= 0) {
+    close(dir_fd);
+  }
+}
+
+void SocketBlazeServerStartup::WaitForServerDirChange(
+    std::chrono::milliseconds timeout) {
+  // The socket becomes readable when the daemon closes its end, i.e. dies.
+  struct pollfd pfds[2];
+  pfds[0].fd = fd;
+  pfds[0].events = POLLIN;
+  pfds[1].fd = watch_fd;
+  pfds[1].events = POLLIN;
+  pfds[1].revents = 0;
+  const int nfds = watch_fd >= 0 ? 2 : 1;
+  int result;
+  do {
+    result = poll(pfds, nfds, std::max<int64_t>(0, timeout.count()));
+  } while (result < 0 && errno == EINTR);
+  if (result > 0 && (pfds[1].revents & POLLIN)) {
+    ClearDirectoryWatch(watch_fd);
+  }
 }
 
 bool SocketBlazeServerStartup::IsStillAlive() {
@@ -413,6 +585,18 @@ int ExecuteDaemon(const blaze_util::Path& exe,
   if (!options.cgroup_parent.empty()) {
     daemonize_args.push_back("-c");
     daemonize_args.push_back(options.cgroup_parent);
+    if (!options.cgroup_memory_high.empty()) {
+      daemonize_args.push_back("-m");
+      daemonize_args.push_back(options.cgroup_memory_high);
+    }
+    if (!options.cgroup_memory_max.empty()) {
+      daemonize_args.push_back("-M");
+      daemonize_args.push_back(options.cgroup_memory_max);
+    }
+  }
+  if (options.server_numa_node >= 0) {
+    daemonize_args.push_back("-n");
+    daemonize_args.push_back(blaze_util::ToString(options.server_numa_node));
   }
 #endif
   daemonize_args.push_back("--");
@@ -420,6 +604,10 @@ int ExecuteDaemon(const blaze_util::Path& exe,
   std::copy(args_vector.begin(), args_vector.end(),
             std::back_inserter(daemonize_args));
 
+  // Start watching before the server can write its server info file.
+  int dir_fd;
+  const int watch_fd = WatchDirectory(server_dir, &dir_fd);
+
   int fds[2];
 
   if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
@@ -485,7 +673,7 @@ int ExecuteDaemon(const blaze_util::Path& exe,
 
   WriteSystemSpecificProcessIdentifier(server_dir, server_pid);
 
-  *server_startup = new SocketBlazeServerStartup(fds[0]);
+  *server_startup = new SocketBlazeServerStartup(fds[0], watch_fd, dir_fd);
   return server_pid;
 }
 
@@ -601,15 +789,22 @@ void SigPrintf(const char *format, ...) {
   }
 }
 
-static int setlk(int fd, struct flock *lock) {
 #ifdef __linux__
 // If we're building with glibc <2.20, or another libc which predates
-// OFD locks, define the constant ourselves.  This assumes that the libc
+// OFD locks, define the constants ourselves.  This assumes that the libc
 // and kernel definitions for struct flock are identical.
+#ifndef F_OFD_GETLK
+#define F_OFD_GETLK 36
+#endif
 #ifndef F_OFD_SETLK
 #define F_OFD_SETLK 37
 #endif
+#ifndef F_OFD_SETLKW
+#define F_OFD_SETLKW 38
 #endif
+#endif
+
+static int setlk(int fd, struct flock *lock) {
 #ifdef F_OFD_SETLK
   // Prefer OFD locks if available.  POSIX locks can be lost "accidentally"
   // due to any close() on the lock file, and are not reliably preserved
@@ -633,6 +828,229 @@ static int setlk(int fd, struct flock *lock) {
   return -1;
 }
 
+// Like setlk(), but waits until the lock can be taken.
+static void setlkw(int fd, struct flock *lock) {
+  while (true) {
+#ifdef F_OFD_SETLKW
+    if (fcntl(fd, F_OFD_SETLKW, lock) == 0) return;
+    if (errno == EINTR) continue;
+    if (errno != EINVAL) {
+      BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+          << "unexpected result from F_OFD_SETLKW: " << GetLastErrorString();
+    }
+#endif
+    if (fcntl(fd, F_SETLKW, lock) == 0) return;
+    if (errno == EINTR) continue;
+    if (errno == EDEADLK) {
+      // The kernel's deadlock detection for POSIX locks is per process and
+      // can report false positives while other threads wait, too.
+      TrySleep(10);
+      continue;
+    }
+    BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+        << "unexpected result from F_SETLKW: " << GetLastErrorString();
+  }
+}
+
+// Returns whether another lock conflicts with `lock`, without taking it.
+static bool getlk(int fd, struct flock lock) {
+#ifdef F_OFD_GETLK
+  lock.l_pid = 0;
+  if (fcntl(fd, F_OFD_GETLK, &lock) == 0) return lock.l_type != F_UNLCK;
+  if (errno != EINVAL) {
+    BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+        << "unexpected result from F_OFD_GETLK: " << GetLastErrorString();
+  }
+#endif
+  if (fcntl(fd, F_GETLK, &lock) == 0) return lock.l_type != F_UNLCK;
+  BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+      << "unexpected result from F_GETLK: " << GetLastErrorString();
+  return false;
+}
+
+static struct flock LockRange(short type, off_t start, off_t len) {
+  struct flock lock = {};
+  lock.l_type = type;
+  lock.l_whence = SEEK_SET;
+  lock.l_start = start;
+  lock.l_len = len;
+  return lock;
+}
+
+namespace {
+
+// The clients waiting for the client lock of an output base, in the order
+// they started to wait, so that they get the lock in that order.
+//
+// The queue lives in the "lock_queue" file next to the lock file. Each
+// waiting client draws a ticket from the counter at the start of the file,
+// and holds a write lock on the byte of its ticket (at kSlotsStart + ticket)
+// until it has the client lock. A client waits for the next client ahead of
+// it by waiting for a read lock on that byte, and for the client lock itself
+// once no one is ahead of it any more, so it is woken as soon as the lock is
+// released. Clients that die while waiting leave the queue automatically,
+// because the kernel releases their locks.
+class LockQueue {
+ public:
+  LockQueue() : fd_(-1), ticket_(0) {}
+  ~LockQueue() { Leave(); }
+
+  // Draws a ticket. Returns false if the queue cannot be used, in which case
+  // the other methods do nothing.
+  bool Enter(const blaze_util::Path &output_base);
+
+  // Returns the number of clients that are waiting ahead of this one.
+  int CountAhead();
+
+  // Waits until no client is waiting ahead of this one.
+  void WaitForTurn();
+
+  // Records that this client has the client lock and leaves the queue.
+  void Leave();
+
+ private:
+  // The counter: the last ticket drawn and the last ticket that got the
+  // client lock, as two 64-bit integers. Locking its first byte guards it.
+  static constexpr off_t kCounterSize = 16;
+  static constexpr off_t kSlotsStart = 4096;
+
+  struct Counter {
+    uint64_t drawn;
+    uint64_t served;
+  };
+
+  Counter LockCounter();
+  void UnlockCounter(const Counter &counter, bool write);
+
+  // Returns the highest ticket below ours whose client is still waiting, or
+  // 0, counting the waiting clients into `count` if it is not null.
+  uint64_t FindAhead(int *count);
+
+  int fd_;
+  uint64_t ticket_;
+};
+
+LockQueue::Counter LockQueue::LockCounter() {
+  struct flock lock = LockRange(F_WRLCK, 0, 1);
+  setlkw(fd_, &lock);
+  Counter counter = {0, 0};
+  if (pread(fd_, &counter, sizeof counter, 0) != sizeof counter) {
+    counter = {0, 0};
+  }
+  return counter;
+}
+
+void LockQueue::UnlockCounter(const Counter &counter, bool write) {
+  if (write && pwrite(fd_, &counter, sizeof counter, 0) != sizeof counter) {
+    BAZEL_LOG(WARNING) << "pwrite() lock queue: " << GetLastErrorString();
+  }
+  struct flock lock = LockRange(F_UNLCK, 0, 1);
+  setlk(fd_, &lock);
+}
+
+bool LockQueue::Enter(const blaze_util::Path &output_base) {
+  blaze_util::Path queue_file = output_base.GetRelative("lock_queue");
+  fd_ = open(queue_file.AsNativePath().c_str(), O_CREAT | O_RDWR | O_CLOEXEC,
+             0644);
+  if (fd_ < 0) {
+    BAZEL_LOG(WARNING) << "cannot open '" << queue_file.AsPrintablePath()
+                       << "', waiting for the client lock out of order: "
+                       << GetLastErrorString();
+    return false;
+  }
+  Counter counter = LockCounter();
+  ticket_ = ++counter.drawn;
+  struct flock slot = LockRange(F_WRLCK, kSlotsStart + ticket_, 1);
+  if (setlk(fd_, &slot) == -1) {
+    // A client that drew this ticket is still waiting; the counter must have
+    // been reset. Start over after the highest ticket that could be in use.
+    BAZEL_LOG(WARNING) << "lock queue counter is inconsistent, resetting it";
+    counter.served = 0;
+    while (setlk(fd_, &slot) == -1) {
+      slot.l_start = kSlotsStart + ++ticket_;
+    }
+    counter.drawn = ticket_;
+  }
+  UnlockCounter(counter, true);
+  return true;
+}
+
+uint64_t LockQueue::FindAhead(int *count) {
+  Counter counter = LockCounter();
+  UnlockCounter(counter, false);
+  if (count != nullptr) *count = 0;
+  uint64_t ahead = 0;
+  for (uint64_t t = ticket_ - 1; t > counter.served && t < ticket_; --t) {
+    // Asking for a read lock only reports the write locks of waiting clients,
+    // not the read locks of clients waiting for them.
+    if (getlk(fd_, LockRange(F_RDLCK, kSlotsStart + t, 1))) {
+      if (ahead == 0) ahead = t;
+      if (count == nullptr) break;
+      ++*count;
+    }
+  }
+  return ahead;
+}
+
+int LockQueue::CountAhead() {
+  if (fd_ < 0) return 0;
+  int count;
+  FindAhead(&count);
+  return count;
+}
+
+void LockQueue::WaitForTurn() {
+  if (fd_ < 0) return;
+  while (uint64_t ahead = FindAhead(nullptr)) {
+    struct flock lock = LockRange(F_RDLCK, kSlotsStart + ahead, 1);
+    setlkw(fd_, &lock);
+    lock.l_type = F_UNLCK;
+    setlk(fd_, &lock);
+  }
+}
+
+void LockQueue::Leave() {
+  if (fd_ < 0) return;
+  Counter counter = LockCounter();
+  counter.served = std::max(counter.served, ticket_);
+  UnlockCounter(counter, true);
+  // Closing the file releases our slot.
+  close(fd_);
+  fd_ = -1;
+}
+
+// Waits for the queue and the client lock on a thread of its own, so that the
+// caller can report on the wait meanwhile.
+class LockWaiter {
+ public:
+  LockWaiter(LockQueue *queue, int lockfd, struct flock lock)
+      : done_(false) {
+    thread_ = std::thread([this, queue, lockfd, lock]() mutable {
+      queue->WaitForTurn();
+      setlkw(lockfd, &lock);
+      std::lock_guard<std::mutex> guard(mutex_);
+      done_ = true;
+      done_changed_.notify_all();
+    });
+  }
+
+  ~LockWaiter() { thread_.join(); }
+
+  // Returns true once the lock is taken, or false after `timeout`.
+  bool Wait(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> guard(mutex_);
+    return done_changed_.wait_for(guard, timeout, [this] { return done_; });
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable done_changed_;
+  bool done_;
+  std::thread thread_;
+};
+
+}  // namespace
+
 uint64_t AcquireLock(const blaze_util::Path& output_base, bool batch_mode,
                      bool block, BlazeLock* blaze_lock) {
   blaze_util::Path lockfile = output_base.GetRelative("lock");
@@ -654,61 +1072,74 @@ uint64_t AcquireLock(const blaze_util::Path& output_base, bool batch_mode,
     }
   }
 
-  struct flock lock = {};
-  lock.l_type = F_WRLCK;
-  lock.l_whence = SEEK_SET;
-  lock.l_start = 0;
   // This doesn't really matter now, but allows us to subdivide the lock
   // later if that becomes meaningful.  (Ranges beyond EOF can be locked.)
-  lock.l_len = 4096;
+  struct flock lock = LockRange(F_WRLCK, 0, 4096);
 
-  // Take the exclusive server lock.  If we fail, we busy-wait until the lock
-  // becomes available.
+  // Take the exclusive server lock.  If another command holds it, queue up
+  // behind the other waiting commands (see LockQueue), unless we are not to
+  // block.
   //
-  // We used to rely on fcntl(F_SETLKW) to lazy-wait for the lock to become
-  // available, which is theoretically fine, but doing so prevents us from
-  // determining if the PID of the server holding the lock has changed under the
-  // hood.  There have been multiple bug reports where users (especially macOS
-  // ones) mention that the Blaze invocation hangs on a non-existent PID.  This
-  // should help troubleshoot those scenarios in case there really is a bug
-  // somewhere.
-  bool multiple_attempts = false;
-  string owner;
+  // The wait happens on another thread, while this one keeps reading the lock
+  // file to tell the user who holds the lock.  There have been multiple bug
+  // reports where users (especially macOS ones) mention that the Blaze
+  // invocation hangs on a non-existent PID, so printing each new owner should
+  // help troubleshoot those scenarios in case there really is a bug somewhere.
+  LockQueue queue;
+  if (block) {
+    queue.Enter(output_base);
+  }
+  bool waited = false;
   const uint64_t start_time = GetMillisecondsMonotonic();
-  while (setlk(lockfd, &lock) == -1) {
-    string buffer(4096, 0);
-    ssize_t r = pread(lockfd, &buffer[0], buffer.size(), 0);
-    if (r < 0) {
-      BAZEL_LOG(WARNING) << "pread() lock file: " << strerror(errno);
-      r = 0;
-    }
-    buffer.resize(r);
-    if (owner != buffer) {
-      // Each time we learn a new lock owner, print it out.
-      owner = buffer;
-      BAZEL_LOG(USER) << "Another command holds the client lock: \n" << owner;
-      if (block) {
-        BAZEL_LOG(USER) << "Waiting for it to complete...";
+  if (queue.CountAhead() > 0 || setlk(lockfd, &lock) == -1) {
+    waited = true;
+    std::unique_ptr<LockWaiter> waiter;
+    string owner;
+    int ahead = -1;
+    do {
+      string buffer(4096, 0);
+      ssize_t r = pread(lockfd, &buffer[0], buffer.size(), 0);
+      if (r < 0) {
+        BAZEL_LOG(WARNING) << "pread() lock file: " << strerror(errno);
+        r = 0;
+      }
+      buffer.resize(r);
+      const int now_ahead = queue.CountAhead();
+      if (owner != buffer) {
+        // Each time we learn a new lock owner, print it out.
+        owner = buffer;
+        BAZEL_LOG(USER) << "Another command holds the client lock: \n"
+                        << owner;
+        ahead = -1;
+      }
+      if (!block) {
+        BAZEL_DIE(blaze_exit_code::LOCK_HELD_NOBLOCK_FOR_LOCK)
+            << "Exiting because the lock is held and --noblock_for_lock was "
+               "given.";
+      }
+      if (ahead != now_ahead) {
+        ahead = now_ahead;
+        if (ahead == 0) {
+          BAZEL_LOG(USER) << "Waiting for it to complete...";
+        } else {
+          BAZEL_LOG(USER) << "Waiting for it and " << ahead
+                          << " other queued command(s) to complete...";
+        }
         fflush(stderr);
       }
-    }
-
-    if (!block) {
-      BAZEL_DIE(blaze_exit_code::LOCK_HELD_NOBLOCK_FOR_LOCK)
-          << "Exiting because the lock is held and --noblock_for_lock was "
-             "given.";
-    }
-
-    TrySleep(500);
-    multiple_attempts = true;
+      if (waiter == nullptr) {
+        waiter.reset(new LockWaiter(&queue, lockfd, lock));
+      }
+    } while (!waiter->Wait(std::chrono::milliseconds(500)));
   }
+  queue.Leave();
   const uint64_t end_time = GetMillisecondsMonotonic();
 
   // If we took the lock on the first try, force the reported wait time to 0 to
   // avoid unnecessary noise in the logs.  In this metric, we are only
   // interested in knowing how long it took for other commands to complete, not
   // how fast acquiring a lock is.
-  const uint64_t wait_time = !multiple_attempts ? 0 : end_time - start_time;
+  const uint64_t wait_time = !waited ? 0 : end_time - start_time;
 
   // Identify ourselves in the lockfile.
   // The contents are printed for human consumption when another client
@@ -732,6 +1163,23 @@ void ReleaseLock(BlazeLock* blaze_lock) {
   close(blaze_lock->lockfd);
 }
 
+bool TryAcquireLock(const blaze_util::Path& output_base,
+                    BlazeLock* blaze_lock) {
+  blaze_util::Path lockfile = output_base.GetRelative("lock");
+  int lockfd =
+      open(lockfile.AsNativePath().c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+  if (lockfd < 0) {
+    return false;
+  }
+  struct flock lock = LockRange(F_WRLCK, 0, 4096);
+  if (setlk(lockfd, &lock) == -1) {
+    close(lockfd);
+    return false;
+  }
+  blaze_lock->lockfd = lockfd;
+  return true;
+}
+
 bool KillServerProcess(int pid, const blaze_util::Path& output_base) {
   // Kill the process and make sure it's dead before proceeding.
   errno = 0;
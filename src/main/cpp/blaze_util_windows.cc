@@ -612,7 +612,16 @@ static HANDLE CreateJvmOutputFile(const blaze_util::Path& path,
 
 class ProcessHandleBlazeServerStartup : public BlazeServerStartup {
  public:
-  ProcessHandleBlazeServerStartup(HANDLE _proc) : proc(_proc) {}
+  // `change` is a change notification handle for the server directory, or
+  // INVALID_HANDLE_VALUE.
+  ProcessHandleBlazeServerStartup(HANDLE _proc, HANDLE _change)
+      : proc(_proc), change(_change) {}
+
+  ~ProcessHandleBlazeServerStartup() override {
+    if (change != INVALID_HANDLE_VALUE) {
+      FindCloseChangeNotification(change);
+    }
+  }
 
   bool IsStillAlive() override {
     FILETIME dummy1, exit_time, dummy2, dummy3;
@@ -620,8 +629,22 @@ class ProcessHandleBlazeServerStartup : public BlazeServerStartup {
            exit_time.dwHighDateTime == 0 && exit_time.dwLowDateTime == 0;
   }
 
+  void WaitForServerDirChange(std::chrono::milliseconds timeout) override {
+    HANDLE handles[] = {proc, change};
+    const DWORD result = WaitForMultipleObjects(
+        /* nCount */ change != INVALID_HANDLE_VALUE ? 2 : 1,
+        /* lpHandles */ handles,
+        /* bWaitAll */ FALSE,
+        /* dwMilliseconds */ static_cast<DWORD>(
+            std::max<int64_t>(0, timeout.count())));
+    if (result == WAIT_OBJECT_0 + 1) {
+      FindNextChangeNotification(change);
+    }
+  }
+
  private:
   AutoHandle proc;
+  HANDLE change;
 };
 
 int ExecuteDaemon(const blaze_util::Path& exe,
@@ -700,6 +723,12 @@ int ExecuteDaemon(const blaze_util::Path& exe,
   CmdLine cmdline;
   CreateCommandLine(&cmdline, exe, wesc_args_vector);
 
+  // Start watching before the server can write its server info file.
+  HANDLE change = FindFirstChangeNotificationW(
+      /* lpPathName */ server_dir.AsNativePath().c_str(),
+      /* bWatchSubtree */ FALSE,
+      /* dwNotifyFilter */ FILE_NOTIFY_CHANGE_FILE_NAME);
+
   BOOL ok;
   {
     WithEnvVars env_obj(env);
@@ -728,7 +757,8 @@ int ExecuteDaemon(const blaze_util::Path& exe,
   WriteProcessStartupTime(server_dir, processInfo.hProcess);
 
   // Pass ownership of processInfo.hProcess
-  *server_startup = new ProcessHandleBlazeServerStartup(processInfo.hProcess);
+  *server_startup =
+      new ProcessHandleBlazeServerStartup(processInfo.hProcess, change);
 
   string pid_string = blaze_util::ToString(processInfo.dwProcessId);
   blaze_util::Path pid_file = server_dir.GetRelative(kServerPidFile);
@@ -1155,6 +1185,34 @@ void ReleaseLock(BlazeLock* blaze_lock) {
   CloseHandle(blaze_lock->handle);
 }
 
+bool TryAcquireLock(const blaze_util::Path& output_base,
+                    BlazeLock* blaze_lock) {
+  blaze_util::Path lockfile = output_base.GetRelative("lock");
+  blaze_lock->handle = ::CreateFileW(
+      /* lpFileName */ lockfile.AsNativePath().c_str(),
+      /* dwDesiredAccess */ GENERIC_READ | GENERIC_WRITE,
+      /* dwShareMode */ FILE_SHARE_READ,
+      /* lpSecurityAttributes */ nullptr,
+      /* dwCreationDisposition */ OPEN_ALWAYS,
+      /* dwFlagsAndAttributes */ FILE_ATTRIBUTE_NORMAL,
+      /* hTemplateFile */ nullptr);
+  if (blaze_lock->handle == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  OVERLAPPED overlapped = {0};
+  if (!LockFileEx(
+          /* hFile */ blaze_lock->handle,
+          /* dwFlags */ LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY,
+          /* dwReserved */ 0,
+          /* nNumberOfBytesToLockLow */ 1,
+          /* nNumberOfBytesToLockHigh */ 0,
+          /* lpOverlapped */ &overlapped)) {
+    CloseHandle(blaze_lock->handle);
+    return false;
+  }
+  return true;
+}
+
 #ifdef GetUserName
 // By including <windows.h>, we have GetUserName defined either as
 // GetUserNameA or GetUserNameW.
@@ -1243,6 +1301,46 @@ bool UnlimitCoredumps() {
   return true;  // Nothing to do so assume success.
 }
 
+bool GetSystemMemory(uint64_t* total_bytes, uint64_t* available_bytes) {
+  MEMORYSTATUSEX status;
+  status.dwLength = sizeof(status);
+  if (!GlobalMemoryStatusEx(&status)) {
+    return false;
+  }
+  *total_bytes = status.ullTotalPhys;
+  *available_bytes = status.ullAvailPhys;
+  return true;
+}
+
+bool GetUsableResources(uint64_t* memory_bytes, double* cpus,
+                        int* numa_nodes) {
+  MEMORYSTATUSEX status;
+  status.dwLength = sizeof(status);
+  if (!GlobalMemoryStatusEx(&status)) {
+    return false;
+  }
+  *memory_bytes = status.ullTotalPhys;
+  // A job that the client runs in may limit the memory of its processes.
+  JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits;
+  if (QueryInformationJobObject(nullptr, JobObjectExtendedLimitInformation,
+                                &limits, sizeof(limits), nullptr)) {
+    const DWORD flags = limits.BasicLimitInformation.LimitFlags;
+    if ((flags & JOB_OBJECT_LIMIT_JOB_MEMORY) &&
+        limits.JobMemoryLimit < *memory_bytes) {
+      *memory_bytes = limits.JobMemoryLimit;
+    }
+    if ((flags & JOB_OBJECT_LIMIT_PROCESS_MEMORY) &&
+        limits.ProcessMemoryLimit < *memory_bytes) {
+      *memory_bytes = limits.ProcessMemoryLimit;
+    }
+  }
+  *cpus = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+  ULONG highest_node;
+  *numa_nodes =
+      GetNumaHighestNodeNumber(&highest_node) ? highest_node + 1 : 1;
+  return true;
+}
+
 static const int MAX_KEY_LENGTH = 255;
 // We do not care about registry values longer than MAX_PATH
 static const int REG_VALUE_BUFFER_SIZE = MAX_PATH;
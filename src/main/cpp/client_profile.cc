@@ -0,0 +1,77 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/cpp/client_profile.h"
+
+#include <chrono>  // NOLINT
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "src/main/cpp/util/errors.h"
+#include "src/main/cpp/util/file.h"
+#include "src/main/cpp/util/logging.h"
+
+namespace blaze {
+
+ClientProfile ClientProfile::INSTANCE;
+
+void ClientProfile::AddPhase(const char *name,
+                             std::chrono::steady_clock::time_point start,
+                             std::chrono::steady_clock::time_point end) {
+  phases_.push_back({name, start, end});
+}
+
+static void AppendEvent(const char *name, int64_t ts_us, int64_t dur_us,
+                        std::string *out) {
+  char event[256];
+  snprintf(event, sizeof(event),
+           ",\n  {\"cat\":\"client phase\",\"name\":\"%s\",\"ph\":\"X\","
+           "\"ts\":%" PRId64 ",\"dur\":%" PRId64 ",\"pid\":0,\"tid\":0}",
+           name, ts_us, dur_us);
+  out->append(event);
+}
+
+void ClientProfile::Write(const blaze_util::Path &path,
+                          uint64_t client_startup_duration_ms) const {
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+  const auto origin = std::chrono::steady_clock::now();
+  const int64_t startup_us =
+      static_cast<int64_t>(client_startup_duration_ms) * 1000;
+
+  std::string trace =
+      "{\"otherData\":{\"client_startup_time_ms\":" +
+      std::to_string(client_startup_duration_ms) +
+      "},\"traceEvents\":[\n"
+      "  {\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,"
+      "\"args\":{\"name\":\"client\"}}";
+  AppendEvent("Client startup", -startup_us, startup_us, &trace);
+  for (const Phase &phase : phases_) {
+    AppendEvent(phase.name,
+                duration_cast<microseconds>(phase.start - origin).count(),
+                duration_cast<microseconds>(phase.end - phase.start).count(),
+                &trace);
+  }
+  trace += "\n]}\n";
+
+  if (!blaze_util::WriteFile(trace, path)) {
+    BAZEL_LOG(WARNING) << "Could not write the client profile to '"
+                       << path.AsPrintablePath()
+                       << "': " << blaze_util::GetLastErrorString();
+  }
+}
+
+}  // namespace blaze
@@ -0,0 +1,87 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_MAIN_CPP_CLIENT_PROFILE_H_
+#define BAZEL_SRC_MAIN_CPP_CLIENT_PROFILE_H_
+
+#include <chrono>  // NOLINT
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "src/main/cpp/util/path.h"
+
+namespace blaze {
+
+// Records the phases of the client's startup (parsing the rc files, taking
+// the lock, extracting, connecting, starting the server...) and writes them
+// as a JSON trace for --client_profile.
+//
+// Phases are always recorded, because --client_profile itself is only known
+// once the rc files have been parsed; recording is a clock read and a vector
+// append per phase.
+class ClientProfile {
+ public:
+  static ClientProfile &Get() { return INSTANCE; }
+
+  // Records a phase; `name` must be a string literal that needs no escaping
+  // in JSON.
+  void AddPhase(const char *name, std::chrono::steady_clock::time_point start,
+                std::chrono::steady_clock::time_point end);
+
+  // Writes the recorded phases to `path` in the Trace Event format that the
+  // server's --profile uses. The client's startup ends, and the command is
+  // handed to the server, `client_startup_duration_ms` after it started; this
+  // instant is the origin of the server's profile (unless the server had to
+  // wait for another command), so the client's phases are written with
+  // negative timestamps that line up with it. Errors are only logged.
+  void Write(const blaze_util::Path &path,
+             uint64_t client_startup_duration_ms) const;
+
+ private:
+  struct Phase {
+    const char *name;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point end;
+  };
+
+  ClientProfile() {}
+
+  static ClientProfile INSTANCE;
+
+  std::vector<Phase> phases_;
+};
+
+// Records the lifetime of this object as a phase of the ClientProfile.
+class ClientProfilePhase {
+ public:
+  // `name` must be a string literal that needs no escaping in JSON.
+  explicit ClientProfilePhase(const char *name)
+      : name_(name), start_(std::chrono::steady_clock::now()) {}
+  ~ClientProfilePhase() {
+    ClientProfile::Get().AddPhase(name_, start_,
+                                  std::chrono::steady_clock::now());
+  }
+
+  ClientProfilePhase(const ClientProfilePhase &) = delete;
+  ClientProfilePhase &operator=(const ClientProfilePhase &) = delete;
+
+ private:
+  const char *const name_;
+  const std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace blaze
+
+#endif  // BAZEL_SRC_MAIN_CPP_CLIENT_PROFILE_H_
@@ -22,11 +22,13 @@
 #include <cassert>
 #include <iterator>
 #include <set>
-#include <sstream>
+#include <string>
+#include <string_view>
 #include <utility>
 
 #include "src/main/cpp/blaze_util.h"
 #include "src/main/cpp/blaze_util_platform.h"
+#include "src/main/cpp/rc_file_cache.h"
 #include "src/main/cpp/util/file.h"
 #include "src/main/cpp/util/logging.h"
 #include "src/main/cpp/util/path.h"
@@ -414,14 +416,23 @@ blaze_exit_code::ExitCode OptionProcessor::GetRcFiles(
   // that don't point to real files.
   rc_files = internal::DedupeBlazercPaths(rc_files);
 
+  // The cache lives under the default output user root: the rc files may
+  // change --output_user_root, but can't be read before finding the cache.
+  const RcFileCache rc_file_cache(
+      blaze_util::JoinPath(startup_options_->output_user_root, "rc_cache"));
   std::set<std::string> read_files_canonical_paths;
   // Parse these potential files, in priority order;
   for (const std::string& top_level_bazelrc_path : rc_files) {
-    std::unique_ptr<RcFile> parsed_rc;
-    blaze_exit_code::ExitCode parse_rcfile_exit_code = ParseRcFile(
-        workspace_layout, workspace, top_level_bazelrc_path, &parsed_rc, error);
-    if (parse_rcfile_exit_code != blaze_exit_code::SUCCESS) {
-      return parse_rcfile_exit_code;
+    std::unique_ptr<RcFile> parsed_rc =
+        rc_file_cache.Lookup(top_level_bazelrc_path, workspace);
+    if (parsed_rc == nullptr) {
+      blaze_exit_code::ExitCode parse_rcfile_exit_code =
+          ParseRcFile(workspace_layout, workspace, top_level_bazelrc_path,
+                      &parsed_rc, error);
+      if (parse_rcfile_exit_code != blaze_exit_code::SUCCESS) {
+        return parse_rcfile_exit_code;
+      }
+      rc_file_cache.Store(top_level_bazelrc_path, workspace, *parsed_rc);
     }
 
     // Check that none of the rc files loaded this time are duplicate.
@@ -694,17 +705,26 @@ std::vector<std::string> OptionProcessor::GetBlazercAndEnvCommandArgs(
       for (const RcOption& rcoption : command_options.second) {
         const std::string& source_path =
             blazerc->canonical_source_paths()[rcoption.source_index];
-        std::ostringstream oss;
-        oss << "--default_override=" << rcfile_indexes[source_path] << ':'
-            << command << '=' << rcoption.option;
-        result.push_back(oss.str());
+        const std::string index =
+            blaze_util::ToString(rcfile_indexes[source_path]);
+        std::string arg;
+        arg.reserve(sizeof("--default_override=") + index.size() +
+                    command.size() + rcoption.option.size() + 1);
+        arg.append("--default_override=").append(index).append(1, ':');
+        arg.append(command).append(1, '=').append(rcoption.option);
+        result.push_back(std::move(arg));
       }
     }
   }
 
   // Pass the client environment to the server.
+  static constexpr std::string_view kClientEnv = "--client_env=";
+  result.reserve(result.size() + env.size() + 1);
   for (const string& env_var : env) {
-    result.push_back("--client_env=" + env_var);
+    std::string arg;
+    arg.reserve(kClientEnv.size() + env_var.size());
+    arg.append(kClientEnv).append(env_var);
+    result.push_back(std::move(arg));
   }
   result.push_back("--client_cwd=" + blaze_util::ConvertPath(cwd));
   return result;
@@ -712,16 +732,21 @@ std::vector<std::string> OptionProcessor::GetBlazercAndEnvCommandArgs(
 
 std::vector<std::string> OptionProcessor::GetCommandArguments() const {
   assert(cmd_line_ != nullptr);
+  return GetCommandArguments(cmd_line_->command, cmd_line_->command_args);
+}
+
+std::vector<std::string> OptionProcessor::GetCommandArguments(
+    const std::string& command,
+    const std::vector<std::string>& explicit_args) const {
   // When the user didn't specify a command, the server expects the command
   // arguments to be empty in order to display the help message.
-  if (cmd_line_->command.empty()) {
+  if (command.empty()) {
     return {};
   }
 
   std::vector<std::string> command_args = blazerc_and_env_command_args_;
-  command_args.insert(command_args.end(),
-                      cmd_line_->command_args.begin(),
-                      cmd_line_->command_args.end());
+  command_args.insert(command_args.end(), explicit_args.begin(),
+                      explicit_args.end());
   return command_args;
 }
 
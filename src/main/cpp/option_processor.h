@@ -105,6 +105,12 @@ class OptionProcessor {
   // executed in.
   std::vector<std::string> GetCommandArguments() const;
 
+  // Gets the arguments to `command` when `explicit_args` are the ones the user
+  // gave it, put together like GetCommandArguments(). For --command_list.
+  std::vector<std::string> GetCommandArguments(
+      const std::string& command,
+      const std::vector<std::string>& explicit_args) const;
+
   // Gets the arguments explicitly provided by the user's command line.
   std::vector<std::string> GetExplicitCommandArguments() const;
 
@@ -0,0 +1,166 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/cpp/output_base_gc.h"
+
+#include <chrono>  // NOLINT
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "src/main/cpp/blaze_util.h"
+#include "src/main/cpp/blaze_util_platform.h"
+#include "src/main/cpp/util/file.h"
+#include "src/main/cpp/util/file_platform.h"
+#include "src/main/cpp/util/logging.h"
+#include "src/main/cpp/util/numbers.h"
+#include "src/main/cpp/util/path.h"
+#include "absl/strings/numbers.h"
+
+namespace blaze {
+
+using std::string;
+using std::vector;
+
+// Appended to the name of an output base that is being deleted.
+static const char kDeletedSuffix[] = ".deleted";
+
+// Records when the output bases were last looked for.
+static const char kStampFile[] = "output_base_gc";
+
+static const uint64_t kDayMillis = 24 * 60 * 60 * 1000;
+
+namespace {
+
+class DirectoryReader : public blaze_util::DirectoryEntryConsumer {
+ public:
+  explicit DirectoryReader(vector<string> *directories)
+      : directories_(directories) {}
+
+  void Consume(const string &name, bool is_directory) override {
+    if (is_directory) {
+      directories_->push_back(name);
+    }
+  }
+
+ private:
+  vector<string> *directories_;
+};
+
+vector<string> ListDirectories(const string &path) {
+  vector<string> directories;
+  DirectoryReader reader(&directories);
+  blaze_util::ForEachDirectoryEntry(path, &reader);
+  return directories;
+}
+
+bool IsDeleted(const string &directory) {
+  const size_t suffix_length = sizeof(kDeletedSuffix) - 1;
+  return directory.size() > suffix_length &&
+         directory.compare(directory.size() - suffix_length, suffix_length,
+                           kDeletedSuffix) == 0;
+}
+
+uint64_t NowMillis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+bool IsServerRunning(const blaze_util::Path &output_base) {
+  string pid_string;
+  int pid;
+  return blaze_util::ReadFile(
+             output_base.GetRelative("server").GetRelative(kServerPidFile),
+             &pid_string, 32) &&
+         blaze_util::safe_strto32(pid_string, &pid) &&
+         VerifyServerProcess(pid, output_base);
+}
+
+}  // namespace
+
+vector<string> MoveAsideUnusedOutputBases(
+    const string &output_user_root, const blaze_util::Path &own_output_base,
+    uint64_t max_age_ms) {
+  const string own = own_output_base.AsPrintablePath();
+  std::unique_ptr<blaze_util::IFileMtime> mtime(
+      blaze_util::CreateFileMtime());
+  const uint64_t now = NowMillis();
+  vector<string> moved;
+  for (const string &directory : ListDirectories(output_user_root)) {
+    const blaze_util::Path output_base(directory);
+    // Install bases and the like have no lock file.
+    uint64_t last_use_ms;
+    if (IsDeleted(directory) || output_base.AsPrintablePath() == own ||
+        !mtime->GetMillisSinceEpoch(output_base.GetRelative("lock"),
+                                    &last_use_ms) ||
+        last_use_ms + max_age_ms > now) {
+      continue;
+    }
+    // A client holds the lock for as long as its command runs, an idle
+    // server does not.
+    BlazeLock lock;
+    if (!TryAcquireLock(output_base, &lock)) {
+      continue;
+    }
+    if (!IsServerRunning(output_base)) {
+      // The rename fails on Windows, where the lock file is open; the output
+      // base is then kept.
+      const string deleted = directory + kDeletedSuffix;
+      if (blaze_util::RenameDirectory(directory, deleted) ==
+          blaze_util::kRenameDirectorySuccess) {
+        BAZEL_LOG(INFO) << "Deleting '" << output_base.AsPrintablePath()
+                        << "', unused for " << (now - last_use_ms) / kDayMillis
+                        << " days";
+        moved.push_back(deleted);
+      }
+    }
+    ReleaseLock(&lock);
+  }
+  return moved;
+}
+
+void CollectUnusedOutputBases(const string &output_user_root,
+                              const blaze_util::Path &own_output_base,
+                              int max_age_days) {
+  const string stamp_file = blaze_util::JoinPath(output_user_root, kStampFile);
+  const uint64_t now = NowMillis();
+  string stamp;
+  uint64_t last_run_ms;
+  if (!blaze_util::ReadFile(stamp_file, &stamp) ||
+      !absl::SimpleAtoi(stamp, &last_run_ms) ||
+      last_run_ms + kDayMillis <= now) {
+    blaze_util::WriteFile(std::to_string(now), stamp_file);
+    MoveAsideUnusedOutputBases(output_user_root, own_output_base,
+                               max_age_days * kDayMillis);
+  }
+
+  vector<string> deleted;
+  for (const string &directory : ListDirectories(output_user_root)) {
+    if (IsDeleted(directory)) {
+      deleted.push_back(directory);
+    }
+  }
+  if (!deleted.empty()) {
+    std::thread([deleted] {
+      for (const string &directory : deleted) {
+        blaze_util::ForceRemoveRecursively(directory);
+      }
+    }).detach();
+  }
+}
+
+}  // namespace blaze
@@ -0,0 +1,46 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_MAIN_CPP_OUTPUT_BASE_GC_H_
+#define BAZEL_SRC_MAIN_CPP_OUTPUT_BASE_GC_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "src/main/cpp/util/path.h"
+
+namespace blaze {
+
+// Renames the output bases under `output_user_root`, other than
+// `own_output_base`, whose lock file was last modified more than `max_age_ms`
+// ago, so that they can be deleted without holding their lock. Output bases
+// whose lock is held or whose server is running are left alone. Returns the
+// new names.
+std::vector<std::string> MoveAsideUnusedOutputBases(
+    const std::string& output_user_root,
+    const blaze_util::Path& own_output_base, uint64_t max_age_ms);
+
+// Deletes the output bases under `output_user_root` that no command has used
+// for `max_age_days`. They are looked for at most once a day; the deletion
+// runs on a thread of its own while the command runs, and what is left of
+// them when the client exits is deleted by the next client. The caller holds
+// the lock of `own_output_base`.
+void CollectUnusedOutputBases(const std::string& output_user_root,
+                              const blaze_util::Path& own_output_base,
+                              int max_age_days);
+
+}  // namespace blaze
+
+#endif  // BAZEL_SRC_MAIN_CPP_OUTPUT_BASE_GC_H_
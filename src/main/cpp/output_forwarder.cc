@@ -0,0 +1,116 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/cpp/output_forwarder.h"
+
+#include <errno.h>
+
+#include <cstdio>
+#include <string>
+#include <utility>
+
+#include "src/main/cpp/util/file_platform.h"
+
+namespace blaze {
+
+// Chunks smaller than this are copied together before they are written.
+static const size_t kCoalesceBytes = 64 * 1024;
+
+OutputForwarder::OutputForwarder(size_t max_buffered_bytes)
+    : max_buffered_bytes_(max_buffered_bytes) {
+  // Anything the client itself wrote to stdout goes first.
+  fflush(stdout);
+  writer_ = std::thread(&OutputForwarder::WriteLoop, this);
+}
+
+OutputForwarder::~OutputForwarder() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_ = true;
+  }
+  changed_.notify_all();
+  writer_.join();
+}
+
+void OutputForwarder::Write(bool to_stdout, std::string *data) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  changed_.wait(lock, [this] {
+    return queued_bytes_ < max_buffered_bytes_ || queue_.empty();
+  });
+  queued_bytes_ += data->size();
+  queue_.push_back({to_stdout, std::move(*data)});
+  data->clear();
+  lock.unlock();
+  changed_.notify_all();
+}
+
+void OutputForwarder::Flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  changed_.wait(lock, [this] { return queue_.empty() && !writing_; });
+}
+
+void OutputForwarder::WriteLoop() {
+  std::string coalesced;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    changed_.wait(lock, [this] { return !queue_.empty() || done_; });
+    if (queue_.empty()) {
+      return;
+    }
+
+    // Take one large chunk, or as many small ones for the same stream as
+    // there are.
+    Chunk chunk = std::move(queue_.front());
+    queue_.pop_front();
+    size_t taken_bytes = chunk.data.size();
+    if (chunk.data.size() < kCoalesceBytes) {
+      coalesced.swap(chunk.data);
+      while (!queue_.empty() && queue_.front().to_stdout == chunk.to_stdout &&
+             coalesced.size() + queue_.front().data.size() <= kCoalesceBytes) {
+        coalesced.append(queue_.front().data);
+        taken_bytes += queue_.front().data.size();
+        queue_.pop_front();
+      }
+      chunk.data.swap(coalesced);
+    }
+    writing_ = true;
+    lock.unlock();
+
+    if (broken_pipe_name_.load() == nullptr) {
+      int result = blaze_util::WriteToStdOutErr(
+          chunk.data.data(), chunk.data.size(), chunk.to_stdout);
+      // Don't leave output in stdout's buffer while waiting for more.
+      if (result == blaze_util::WriteResult::SUCCESS && chunk.to_stdout &&
+          fflush(stdout) != 0 && errno == EPIPE) {
+        result = blaze_util::WriteResult::BROKEN_PIPE;
+      }
+      if (result == blaze_util::WriteResult::BROKEN_PIPE) {
+        broken_pipe_name_ =
+            chunk.to_stdout ? "standard output" : "standard error";
+      }
+    }
+    // Keep the buffer for coalescing the next chunks.
+    if (chunk.data.capacity() <= kCoalesceBytes) {
+      coalesced.swap(chunk.data);
+    }
+    coalesced.clear();
+
+    lock.lock();
+    writing_ = false;
+    queued_bytes_ -= taken_bytes;
+    changed_.notify_all();
+  }
+}
+
+}  // namespace blaze
@@ -0,0 +1,82 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_MAIN_CPP_OUTPUT_FORWARDER_H_
+#define BAZEL_SRC_MAIN_CPP_OUTPUT_FORWARDER_H_
+
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <cstddef>
+#include <deque>
+#include <mutex>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+
+namespace blaze {
+
+// Writes the output of a command to the client's stdout and stderr on a
+// thread of its own, so that receiving the next messages from the server
+// overlaps with writing the previous ones. Consecutive small chunks for the
+// same stream are written together. The order of the chunks is kept across
+// both streams.
+//
+// At most `max_buffered_bytes` are queued; Write() blocks beyond that, which
+// stops the caller from reading more from the server and so pushes back on
+// the server through gRPC's flow control.
+class OutputForwarder {
+ public:
+  explicit OutputForwarder(size_t max_buffered_bytes);
+
+  // Writes everything queued, then stops the thread.
+  ~OutputForwarder();
+
+  OutputForwarder(const OutputForwarder&) = delete;
+  OutputForwarder& operator=(const OutputForwarder&) = delete;
+
+  // Queues the contents of `data` for stdout or stderr, leaving `data` empty.
+  void Write(bool to_stdout, std::string* data);
+
+  // Waits until everything queued has been written.
+  void Flush();
+
+  // Returns "standard output" or "standard error" once a write to it failed
+  // because the reading end is closed, nullptr before. Output queued after
+  // that is dropped.
+  const char* BrokenPipeName() const { return broken_pipe_name_.load(); }
+
+ private:
+  struct Chunk {
+    bool to_stdout;
+    std::string data;
+  };
+
+  void WriteLoop();
+
+  const size_t max_buffered_bytes_;
+
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::deque<Chunk> queue_;
+  size_t queued_bytes_ = 0;
+  // Whether the writing thread is writing chunks that it took off the queue.
+  bool writing_ = false;
+  bool done_ = false;
+
+  std::atomic<const char*> broken_pipe_name_{nullptr};
+  std::thread writer_;
+};
+
+}  // namespace blaze
+
+#endif  // BAZEL_SRC_MAIN_CPP_OUTPUT_FORWARDER_H_
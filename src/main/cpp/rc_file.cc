@@ -16,6 +16,7 @@
 
 #include <memory>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
@@ -29,9 +30,9 @@
 #include "absl/functional/function_ref.h"
 #include "absl/memory/memory.h"
 #include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
-#include "absl/strings/str_split.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/span.h"
 
@@ -40,6 +41,15 @@ namespace blaze {
 static constexpr absl::string_view kCommandImport = "import";
 static constexpr absl::string_view kCommandTryImport = "try-import";
 
+// Returns a line of an rc file as it reads once its continuations are joined.
+static std::string DisplayLine(std::string_view line) {
+  std::string display(line);
+  blaze_util::Replace("\\\r\n", "", &display);
+  blaze_util::Replace("\\\n", "", &display);
+  blaze_util::StripWhitespace(&display);
+  return display;
+}
+
 /*static*/ std::unique_ptr<RcFile> RcFile::Parse(
     const std::string& filename, const WorkspaceLayout* workspace_layout,
     const std::string& workspace, ParseError* error, std::string* error_text,
@@ -60,6 +70,7 @@ RcFile::ParseError RcFile::ParseFile(const std::string& filename,
                                      std::vector<std::string>& import_stack,
                                      std::string* error_text) {
   BAZEL_LOG(INFO) << "Parsing the RcFile " << filename;
+  read_paths_.push_back(filename);
   std::string contents;
   if (std::string error_msg; !read_file(filename, &contents, &error_msg)) {
     *error_text = absl::StrFormat(
@@ -73,33 +84,21 @@ RcFile::ParseError RcFile::ParseFile(const std::string& filename,
   int rcfile_index = canonical_rcfile_paths_.size();
   canonical_rcfile_paths_.push_back(canonical_filename);
 
-  // A '\' at the end of a line continues the line.
-  blaze_util::Replace("\\\r\n", "", &contents);
-  blaze_util::Replace("\\\n", "", &contents);
-
-  std::vector<std::string> lines = absl::StrSplit(contents, '\n');
-  for (std::string& line : lines) {
-    blaze_util::StripWhitespace(&line);
-
-    // Check for an empty line.
-    if (line.empty()) continue;
-
-    std::vector<std::string> words;
-
-    // This will treat "#" as a comment, and properly
-    // quote single and double quotes, and treat '\'
-    // as an escape character.
-    // TODO(bazel-team): This function silently ignores
-    // dangling backslash escapes and missing end-quotes.
-    blaze_util::Tokenize(line, '#', &words);
-
-    // Could happen if line starts with "#"
-    if (words.empty()) continue;
-
+  // This will treat "#" as a comment, and properly quote single and double
+  // quotes, and treat '\' as an escape character. A '\' at the end of a line
+  // continues the line.
+  // TODO(bazel-team): This silently ignores dangling backslash escapes and
+  // missing end-quotes.
+  blaze_util::LineTokenizer lines(contents, '#');
+  std::vector<std::string> words;
+  while (lines.Next(&words)) {
     const absl::string_view command = words[0];
     if (command != kCommandImport && command != kCommandTryImport) {
-      for (absl::string_view word : absl::MakeConstSpan(words).subspan(1)) {
-        options_[command].push_back({std::string(word), rcfile_index});
+      if (words.size() > 1) {
+        std::vector<RcOption>& options = options_[command];
+        for (std::string& word : absl::MakeSpan(words).subspan(1)) {
+          options.push_back({std::move(word), rcfile_index});
+        }
       }
       continue;
     }
@@ -107,7 +106,7 @@ RcFile::ParseError RcFile::ParseFile(const std::string& filename,
     if (words.size() != 2) {
       *error_text = absl::StrFormat(
           "Invalid import declaration in config file '%s': '%s'",
-          canonical_filename, line);
+          canonical_filename, DisplayLine(lines.line()));
       return ParseError::INVALID_FORMAT;
     }
 
@@ -120,7 +119,7 @@ RcFile::ParseError RcFile::ParseFile(const std::string& filename,
         *error_text = absl::StrFormat(
             "Nonexistent path in import declaration in config file '%s': '%s'"
             " (are you in your source checkout/WORKSPACE?)",
-            canonical_filename, line);
+            canonical_filename, DisplayLine(lines.line()));
         return ParseError::INVALID_FORMAT;
       }
     }
@@ -160,6 +159,99 @@ RcFile::ParseError RcFile::ParseFile(const std::string& filename,
   return ParseError::NONE;
 }
 
+// The serialized form is a sequence of fields, each written as its length,
+// a ':' and its bytes.
+static void AppendField(absl::string_view field, std::string* out) {
+  absl::StrAppend(out, field.size(), ":", field);
+}
+
+static void AppendStrings(const std::vector<std::string>& strings,
+                          std::string* out) {
+  AppendField(absl::StrCat(strings.size()), out);
+  for (const std::string& s : strings) {
+    AppendField(s, out);
+  }
+}
+
+static bool ConsumeField(absl::string_view* in, std::string* field) {
+  size_t colon = in->find(':');
+  size_t size;
+  if (colon == absl::string_view::npos ||
+      !absl::SimpleAtoi(in->substr(0, colon), &size) ||
+      size > in->size() - colon - 1) {
+    return false;
+  }
+  field->assign(in->data() + colon + 1, size);
+  in->remove_prefix(colon + 1 + size);
+  return true;
+}
+
+static bool ConsumeNumber(absl::string_view* in, size_t* number) {
+  std::string field;
+  return ConsumeField(in, &field) && absl::SimpleAtoi(field, number);
+}
+
+static bool ConsumeStrings(absl::string_view* in,
+                           std::vector<std::string>* strings) {
+  size_t count;
+  if (!ConsumeNumber(in, &count) || count > in->size()) {
+    return false;
+  }
+  strings->resize(count);
+  for (std::string& s : *strings) {
+    if (!ConsumeField(in, &s)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string RcFile::Serialize() const {
+  std::string result;
+  AppendStrings(canonical_rcfile_paths_, &result);
+  AppendStrings(read_paths_, &result);
+  AppendField(absl::StrCat(options_.size()), &result);
+  for (const auto& [command, options] : options_) {
+    AppendField(command, &result);
+    AppendField(absl::StrCat(options.size()), &result);
+    for (const RcOption& option : options) {
+      AppendField(option.option, &result);
+      AppendField(absl::StrCat(option.source_index), &result);
+    }
+  }
+  return result;
+}
+
+/*static*/ std::unique_ptr<RcFile> RcFile::Deserialize(absl::string_view data) {
+  auto rcfile = absl::WrapUnique(new RcFile());
+  size_t commands;
+  if (!ConsumeStrings(&data, &rcfile->canonical_rcfile_paths_) ||
+      !ConsumeStrings(&data, &rcfile->read_paths_) ||
+      !ConsumeNumber(&data, &commands) || commands > data.size()) {
+    return nullptr;
+  }
+  for (size_t i = 0; i < commands; ++i) {
+    std::string command;
+    size_t count;
+    if (!ConsumeField(&data, &command) || !ConsumeNumber(&data, &count) ||
+        count > data.size()) {
+      return nullptr;
+    }
+    std::vector<RcOption>& options = rcfile->options_[command];
+    options.resize(count);
+    for (RcOption& option : options) {
+      size_t source_index;
+      if (!ConsumeField(&data, &option.option) ||
+          !ConsumeNumber(&data, &source_index) ||
+          source_index >= rcfile->canonical_rcfile_paths_.size()) {
+        return nullptr;
+      }
+      option.source_index = static_cast<int>(source_index);
+    }
+  }
+  return data.empty() ? std::move(rcfile) : nullptr;
+}
+
 bool RcFile::ReadFileDefault(const std::string& filename, std::string* contents,
                              std::string* error_msg) {
   return blaze_util::ReadFile(filename, contents, error_msg);
@@ -21,6 +21,7 @@
 #include "src/main/cpp/workspace_layout.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/functional/function_ref.h"
+#include "absl/strings/string_view.h"
 
 namespace blaze {
 
@@ -62,6 +63,17 @@ class RcFile {
   using OptionMap = absl::flat_hash_map<std::string, std::vector<RcOption>>;
   const OptionMap& options() const { return options_; }
 
+  // Returns every path the parse read or tried to read, as written in the
+  // imports: unlike canonical_source_paths(), this includes optional imports
+  // of files that did not exist. The result of the parse only changes if one
+  // of these does.
+  const std::vector<std::string>& read_paths() const { return read_paths_; }
+
+  // Converts the parsed file to a string and back, for RcFileCache.
+  // Deserialize returns nullptr if the string is malformed.
+  std::string Serialize() const;
+  static std::unique_ptr<RcFile> Deserialize(absl::string_view data);
+
  private:
   RcFile() = default;
 
@@ -84,6 +96,8 @@ class RcFile {
   std::vector<std::string> canonical_rcfile_paths_;
   // All options parsed from the file.
   OptionMap options_;
+  // The paths of all files read, see read_paths().
+  std::vector<std::string> read_paths_;
 };
 
 }  // namespace blaze
@@ -0,0 +1,151 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/cpp/rc_file_cache.h"
+
+#include <time.h>
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "src/main/cpp/rc_file.h"
+#include "src/main/cpp/util/file.h"
+#include "src/main/cpp/util/logging.h"
+#include "src/main/cpp/util/md5.h"
+#include "src/main/cpp/util/path.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/strip.h"
+#include "absl/strings/string_view.h"
+
+namespace blaze {
+
+// The first line of every entry. Change it whenever RcFile::Serialize or the
+// parsing of rc files changes, so that older entries are ignored.
+static constexpr absl::string_view kEntryHeader = "rc_file_cache 1\n";
+
+// A file modified this many seconds before being parsed may not have been
+// fully written, or be modified again within the resolution of its
+// timestamps.
+static constexpr time_t kRacyModificationSecs = 2;
+
+// Returns the identity of the file, or "-" if it does not exist. Sets
+// *is_recent if it was modified in the last kRacyModificationSecs.
+static std::string FileSignature(const std::string& path, bool* is_recent) {
+#if defined(_WIN32)
+  *is_recent = true;
+  return "";
+#else
+  struct stat buf;
+  if (stat(path.c_str(), &buf) != 0) {
+    return "-";
+  }
+  if (buf.st_mtime > time(nullptr) - kRacyModificationSecs) {
+    *is_recent = true;
+  }
+  return absl::StrCat(buf.st_dev, ":", buf.st_ino, ":", buf.st_size, ":",
+                      buf.st_mtime, ":", buf.st_ctime);
+#endif
+}
+
+// Returns the signatures of all files the parse read, one per line.
+static std::string Signatures(const RcFile& rc_file, bool* is_recent) {
+  std::string result;
+  for (const std::string& path : rc_file.read_paths()) {
+    absl::StrAppend(&result, FileSignature(path, is_recent), "\n");
+  }
+  return result;
+}
+
+RcFileCache::RcFileCache(const std::string& cache_dir)
+    : cache_dir_(cache_dir) {}
+
+std::string RcFileCache::EntryPath(const std::string& filename,
+                                   const std::string& workspace) const {
+  blaze_util::Md5Digest digest;
+  const std::string key =
+      absl::StrCat(filename, absl::string_view("\0", 1), workspace);
+  digest.Update(key.data(), key.size());
+  unsigned char buf[blaze_util::Md5Digest::kDigestLength];
+  digest.Finish(buf);
+  return blaze_util::JoinPath(cache_dir_, digest.String());
+}
+
+std::unique_ptr<RcFile> RcFileCache::Lookup(
+    const std::string& filename, const std::string& workspace) const {
+#if defined(_WIN32)
+  return nullptr;
+#else
+  std::string entry;
+  if (!blaze_util::ReadFile(EntryPath(filename, workspace), &entry)) {
+    return nullptr;
+  }
+  // The entry is the header, the size of the serialized RcFile on a line of
+  // its own, the serialized RcFile and the signatures of its read paths.
+  absl::string_view rest(entry);
+  size_t newline, size;
+  if (!absl::ConsumePrefix(&rest, kEntryHeader) ||
+      (newline = rest.find('\n')) == absl::string_view::npos ||
+      !absl::SimpleAtoi(rest.substr(0, newline), &size) ||
+      size > rest.size() - newline - 1) {
+    return nullptr;
+  }
+  rest.remove_prefix(newline + 1);
+  std::unique_ptr<RcFile> rc_file = RcFile::Deserialize(rest.substr(0, size));
+  rest.remove_prefix(size);
+  if (rc_file == nullptr || rc_file->read_paths().empty() ||
+      rc_file->read_paths()[0] != filename) {
+    return nullptr;
+  }
+  bool is_recent = false;
+  if (Signatures(*rc_file, &is_recent) != rest) {
+    return nullptr;
+  }
+  BAZEL_LOG(INFO) << "Using the cached parse of the RcFile " << filename;
+  return rc_file;
+#endif
+}
+
+void RcFileCache::Store(const std::string& filename,
+                        const std::string& workspace,
+                        const RcFile& rc_file) const {
+#if !defined(_WIN32)
+  bool is_recent = false;
+  const std::string serialized = rc_file.Serialize();
+  const std::string entry =
+      absl::StrCat(kEntryHeader, serialized.size(), "\n", serialized,
+                   Signatures(rc_file, &is_recent));
+  if (is_recent || !blaze_util::MakeDirectories(cache_dir_, 0755)) {
+    return;
+  }
+  // Write the entry under a temporary name and rename it into place, so that
+  // concurrent clients never read a partial entry.
+  const std::string path = EntryPath(filename, workspace);
+  const std::string tmp_path = absl::StrCat(path, ".tmp.", getpid());
+  if (!blaze_util::WriteFile(entry, tmp_path, 0644) ||
+      std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    BAZEL_LOG(INFO) << "Could not cache the parse of the RcFile " << filename;
+    blaze_util::UnlinkPath(tmp_path);
+  }
+#endif
+}
+
+}  // namespace blaze
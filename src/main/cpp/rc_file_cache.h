@@ -0,0 +1,56 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_MAIN_CPP_RC_FILE_CACHE_H_
+#define BAZEL_SRC_MAIN_CPP_RC_FILE_CACHE_H_
+
+#include <memory>
+#include <string>
+
+#include "src/main/cpp/rc_file.h"
+
+namespace blaze {
+
+// Keeps parsed rc files in a directory, so that an invocation only parses an
+// rc file again if one of the files that the previous parse read (see
+// RcFile::read_paths) has changed since. Every file is identified by its
+// device, inode, size, modification and status change time.
+//
+// The cache is best effort: missing, stale or malformed entries are misses,
+// and entries that can't be written are dropped. It is a no-op on Windows.
+class RcFileCache {
+ public:
+  explicit RcFileCache(const std::string& cache_dir);
+
+  // Returns the cached result of parsing `filename` in `workspace`, or nullptr
+  // if there is none or it is out of date.
+  std::unique_ptr<RcFile> Lookup(const std::string& filename,
+                                 const std::string& workspace) const;
+
+  // Caches the result of parsing `filename` in `workspace`. Files modified in
+  // the last couple of seconds could change again without changing their
+  // timestamps, so their parses are not cached.
+  void Store(const std::string& filename, const std::string& workspace,
+             const RcFile& rc_file) const;
+
+ private:
+  std::string EntryPath(const std::string& filename,
+                        const std::string& workspace) const;
+
+  const std::string cache_dir_;
+};
+
+}  // namespace blaze
+
+#endif  // BAZEL_SRC_MAIN_CPP_RC_FILE_CACHE_H_
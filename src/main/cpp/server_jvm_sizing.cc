@@ -0,0 +1,128 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/cpp/server_jvm_sizing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "src/main/cpp/util/strings.h"
+
+namespace blaze {
+
+using std::string;
+using std::vector;
+
+static const uint64_t kMiB = 1024 * 1024;
+static const uint64_t kGiB = 1024 * kMiB;
+
+// Whether one of `args` starts with one of `prefixes`.
+static bool HasAnyPrefix(const vector<string> &args,
+                         const vector<string> &prefixes) {
+  for (const string &arg : args) {
+    for (const string &prefix : prefixes) {
+      if (arg.compare(0, prefix.size(), prefix) == 0) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Whether `args` select a GC, e.g. with -XX:+UseParallelGC.
+static bool SelectsGc(const vector<string> &args) {
+  for (const string &arg : args) {
+    if (arg.compare(0, 8, "-XX:+Use") == 0 && arg.size() > 10 &&
+        arg.compare(arg.size() - 2, 2, "GC") == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+vector<string> GetServerJvmSizingArgs(const UsableResources &resources,
+                                      bool zgc_supported,
+                                      const vector<string> &user_jvm_args) {
+  vector<string> result;
+  int cpus = 0;
+  if (resources.cpus > 0) {
+    cpus = std::max(1, static_cast<int>(std::ceil(resources.cpus)));
+  }
+
+  uint64_t heap = 0;
+  if (resources.memory_bytes > 0) {
+    const uint64_t memory = resources.memory_bytes;
+    heap = std::min(memory, 16 * kGiB) / 2 +
+           (memory > 16 * kGiB ? (memory - 16 * kGiB) / 4 : 0);
+    heap = std::max(heap, 512 * kMiB);
+  }
+  const bool user_gc = SelectsGc(user_jvm_args);
+  const bool zgc =
+      !user_gc && zgc_supported && heap >= 16 * kGiB && cpus >= 8;
+  if (!zgc) {
+    // Compressed oops need a heap below 32 GiB.
+    heap = std::min(heap, 31 * kGiB);
+  }
+
+  if (heap > 0 &&
+      !HasAnyPrefix(user_jvm_args, {"-Xmx", "-XX:MaxHeapSize=",
+                                    "-XX:MaxRAM", "-XX:InitialRAM"})) {
+    result.push_back("-Xmx" + blaze_util::ToString(heap / kMiB) + "m");
+  }
+  if (!user_gc) {
+    if (zgc) {
+      result.push_back("-XX:+UseZGC");
+      result.push_back("-XX:+ZGenerational");
+    } else {
+      result.push_back("-XX:+UseG1GC");
+    }
+  }
+  if (cpus > 0) {
+    if (!HasAnyPrefix(user_jvm_args, {"-XX:ActiveProcessorCount="})) {
+      result.push_back("-XX:ActiveProcessorCount=" +
+                       blaze_util::ToString(cpus));
+    }
+    // Like the JVM's own defaults, but for the cpus the server may use.
+    const int parallel = cpus <= 8 ? cpus : 8 + (cpus - 8) * 5 / 8;
+    if (!HasAnyPrefix(user_jvm_args, {"-XX:ParallelGCThreads="})) {
+      result.push_back("-XX:ParallelGCThreads=" +
+                       blaze_util::ToString(parallel));
+    }
+    if (!user_gc && !HasAnyPrefix(user_jvm_args, {"-XX:ConcGCThreads="})) {
+      const int concurrent = std::max(1, zgc ? cpus / 4 : (parallel + 2) / 4);
+      result.push_back("-XX:ConcGCThreads=" +
+                       blaze_util::ToString(concurrent));
+    }
+  }
+  if (resources.numa_nodes > 1 &&
+      !HasAnyPrefix(user_jvm_args, {"-XX:+UseNUMA", "-XX:-UseNUMA"})) {
+    result.push_back("-XX:+UseNUMA");
+  }
+  return result;
+}
+
+string DescribeUsableResources(const UsableResources &resources) {
+  string result;
+  blaze_util::StringPrintf(
+      &result, "%llu MiB, %g cpus, %d NUMA node%s",
+      static_cast<unsigned long long>(resources.memory_bytes / kMiB),  // NOLINT
+      resources.cpus, resources.numa_nodes,
+      resources.numa_nodes == 1 ? "" : "s");
+  return result;
+}
+
+}  // namespace blaze
@@ -0,0 +1,58 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_MAIN_CPP_SERVER_JVM_SIZING_H_
+#define BAZEL_SRC_MAIN_CPP_SERVER_JVM_SIZING_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace blaze {
+
+// What the server may use of the machine, as GetUsableResources() reports it.
+struct UsableResources {
+  // 0 if unknown.
+  uint64_t memory_bytes = 0;
+  // 0 if unknown. A cpu quota may make it a fraction.
+  double cpus = 0;
+  int numa_nodes = 1;
+};
+
+// Returns the JVM flags that size the server for `resources` with
+// --experimental_auto_size_server_jvm:
+//
+// - The maximum heap is half of the first 16 GiB plus a quarter of the rest,
+//   so that a laptop leaves enough to the actions and a workstation does not
+//   collect a heap a fraction of its memory over and over.
+// - Generational ZGC if `zgc_supported` and the heap is 16 GiB or more on 8
+//   cpus or more, where its pauses stay short while G1's grow with the heap.
+//   G1 otherwise, with the heap below 32 GiB to keep compressed oops.
+// - The cpus the JVM sees, and its GC threads, follow the cpus the server may
+//   use rather than the ones of the machine.
+// - NUMA-aware allocation on more than one node.
+//
+// Flags that `user_jvm_args` already give are left out, and so are the ones
+// of a GC if they select another one: --host_jvm_args always wins.
+std::vector<std::string> GetServerJvmSizingArgs(
+    const UsableResources &resources, bool zgc_supported,
+    const std::vector<std::string> &user_jvm_args);
+
+// Describes `resources` for the provenance of the flags, e.g.
+// "16384 MiB, 7.5 cpus, 1 NUMA node".
+std::string DescribeUsableResources(const UsableResources &resources);
+
+}  // namespace blaze
+
+#endif  // BAZEL_SRC_MAIN_CPP_SERVER_JVM_SIZING_H_
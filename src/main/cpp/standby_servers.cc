@@ -0,0 +1,211 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/cpp/standby_servers.h"
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "src/main/cpp/blaze_util.h"
+#include "src/main/cpp/blaze_util_platform.h"
+#include "src/main/cpp/util/errors.h"
+#include "src/main/cpp/util/file.h"
+#include "src/main/cpp/util/file_platform.h"
+#include "src/main/cpp/util/logging.h"
+#include "src/main/cpp/util/numbers.h"
+#include "src/main/cpp/util/path.h"
+#include "absl/strings/numbers.h"
+
+namespace blaze {
+
+using std::string;
+using std::vector;
+
+// Startup options that only the client reads.
+static const char *const kClientOnlyStartupOptions[] = {
+    "block_for_lock",
+    "client_debug",
+    "client_profile",
+    "command_list",
+    "connect_timeout_secs",
+    "experimental_output_base_max_age_days",
+    "ignore_all_rc_files",
+    "local_startup_timeout_secs",
+    "standby_servers",
+};
+
+static bool IsClientOnlyStartupOption(const string &arg) {
+  string name = arg.substr(0, arg.find('='));
+  if (name.compare(0, 2, "--") == 0) {
+    name = name.substr(2);
+  }
+  for (const char *option : kClientOnlyStartupOptions) {
+    if (name == option || name == string("no") + option) {
+      return true;
+    }
+  }
+  return false;
+}
+
+string GetStandbyServerKey(
+    const vector<RcStartupFlag> &original_startup_options) {
+  string key;
+  for (const RcStartupFlag &flag : original_startup_options) {
+    if (!IsClientOnlyStartupOption(flag.value)) {
+      key.append(flag.value).push_back('\0');
+    }
+  }
+  return key;
+}
+
+namespace {
+
+class RegistryReader : public blaze_util::DirectoryEntryConsumer {
+ public:
+  explicit RegistryReader(vector<string> *files) : files_(files) {}
+
+  void Consume(const string &name, bool is_directory) override {
+    if (!is_directory) {
+      files_->push_back(name);
+    }
+  }
+
+ private:
+  vector<string> *files_;
+};
+
+uint64_t NowMillis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+// Returns the pid of the server running in `output_base`, or -1.
+int GetRunningServerPid(const blaze_util::Path &output_base) {
+  string pid_string;
+  int pid;
+  if (!blaze_util::ReadFile(
+          output_base.GetRelative("server").GetRelative(kServerPidFile),
+          &pid_string, 32) ||
+      !blaze_util::safe_strto32(pid_string, &pid) ||
+      !VerifyServerProcess(pid, output_base)) {
+    return -1;
+  }
+  return pid;
+}
+
+bool IsMemoryLow() {
+  uint64_t total_bytes, available_bytes;
+  return GetSystemMemory(&total_bytes, &available_bytes) &&
+         available_bytes < total_bytes / 4;
+}
+
+}  // namespace
+
+StandbyServers::StandbyServers(const string &registry)
+    : registry_(registry) {}
+
+string StandbyServers::RegistryFile(
+    const blaze_util::Path &output_base) const {
+  return GetHashedBaseDir(registry_, output_base.AsPrintablePath());
+}
+
+void StandbyServers::RecordUse(const blaze_util::Path &output_base) const {
+  if (!blaze_util::MakeDirectories(registry_, 0755) ||
+      !blaze_util::WriteFile(std::to_string(NowMillis()) + "\n" +
+                                 output_base.AsPrintablePath(),
+                             RegistryFile(output_base))) {
+    BAZEL_LOG(WARNING) << "Could not register '"
+                       << output_base.AsPrintablePath()
+                       << "' as a standby server: "
+                       << blaze_util::GetLastErrorString();
+  }
+}
+
+vector<StandbyServers::Entry> StandbyServers::ReadEntries() const {
+  vector<string> files;
+  RegistryReader reader(&files);
+  blaze_util::ForEachDirectoryEntry(registry_, &reader);
+
+  vector<Entry> entries;
+  for (const string &file : files) {
+    string content;
+    if (!blaze_util::ReadFile(file, &content)) {
+      continue;
+    }
+    const string::size_type newline = content.find('\n');
+    uint64_t last_use_ms;
+    if (newline == string::npos ||
+        !absl::SimpleAtoi(content.substr(0, newline), &last_use_ms)) {
+      blaze_util::UnlinkPath(file);
+      continue;
+    }
+    entries.push_back(
+        {file, blaze_util::Path(content.substr(newline + 1)), last_use_ms});
+  }
+  return entries;
+}
+
+void StandbyServers::ShutDownExcess(const blaze_util::Path &output_base,
+                                    int max_standby) const {
+  const string own_file = RegistryFile(output_base);
+  vector<Entry> standby;
+  for (Entry &entry : ReadEntries()) {
+    if (entry.registry_file == own_file) {
+      continue;
+    }
+    if (GetRunningServerPid(entry.output_base) < 0) {
+      // The output base stays on disk; it is registered again when it is next
+      // used.
+      blaze_util::UnlinkPath(entry.registry_file);
+      continue;
+    }
+    standby.push_back(entry);
+  }
+  std::sort(standby.begin(), standby.end(),
+            [](const Entry &a, const Entry &b) {
+              return a.last_use_ms < b.last_use_ms;
+            });
+
+  int excess = static_cast<int>(standby.size()) - max_standby;
+  for (const Entry &entry : standby) {
+    const bool memory_low = IsMemoryLow();
+    if (excess <= 0 && !memory_low) {
+      break;
+    }
+    // A client holds the lock for as long as its command runs.
+    BlazeLock lock;
+    if (!TryAcquireLock(entry.output_base, &lock)) {
+      BAZEL_LOG(INFO) << "Standby server in '"
+                      << entry.output_base.AsPrintablePath()
+                      << "' is busy, not shutting it down";
+      continue;
+    }
+    const int pid = GetRunningServerPid(entry.output_base);
+    if (pid > 0) {
+      BAZEL_LOG(INFO) << "Shutting down the standby server in '"
+                      << entry.output_base.AsPrintablePath() << "' (pid="
+                      << pid << (memory_low ? "), memory is low" : ")");
+      KillServerProcess(pid, entry.output_base);
+    }
+    blaze_util::UnlinkPath(entry.registry_file);
+    ReleaseLock(&lock);
+    --excess;
+  }
+}
+
+}  // namespace blaze
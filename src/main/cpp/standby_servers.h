@@ -0,0 +1,69 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_MAIN_CPP_STANDBY_SERVERS_H_
+#define BAZEL_SRC_MAIN_CPP_STANDBY_SERVERS_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "src/main/cpp/startup_options.h"
+#include "src/main/cpp/util/path.h"
+
+namespace blaze {
+
+// Returns the startup options that decide which server a command of a
+// workspace runs in with --standby_servers, in the order they were given.
+// Options that only affect the client are left out, so that changing them
+// does not move to another server.
+std::string GetStandbyServerKey(
+    const std::vector<RcStartupFlag>& original_startup_options);
+
+// The servers of one workspace with --standby_servers. Every set of startup
+// options has its own output base, registered here with the time a command
+// last used it; the servers of the other ones are left running as standby
+// servers instead of being restarted each time the startup options change.
+class StandbyServers {
+ public:
+  explicit StandbyServers(const std::string& registry);
+
+  // Records that a command is running in `output_base`. The caller holds its
+  // client lock.
+  void RecordUse(const blaze_util::Path& output_base) const;
+
+  // Shuts down the idle servers of output bases other than `output_base`,
+  // least recently used first, until at most `max_standby` remain and, where
+  // the platform reports it, at least a quarter of the physical memory is
+  // available. Servers that are running a command are left alone. Called
+  // before a new server is started in `output_base`.
+  void ShutDownExcess(const blaze_util::Path& output_base,
+                      int max_standby) const;
+
+ private:
+  struct Entry {
+    std::string registry_file;
+    blaze_util::Path output_base;
+    uint64_t last_use_ms;
+  };
+
+  std::string RegistryFile(const blaze_util::Path& output_base) const;
+  std::vector<Entry> ReadEntries() const;
+
+  const std::string registry_;
+};
+
+}  // namespace blaze
+
+#endif  // BAZEL_SRC_MAIN_CPP_STANDBY_SERVERS_H_
@@ -68,6 +68,7 @@ void StartupOptions::OverrideOptionSourcesKey(const std::string &flag_name,
 StartupOptions::StartupOptions(const string &product_name,
                                const WorkspaceLayout *workspace_layout)
     : product_name(product_name),
+      install_base_is_shared(false),
       ignore_all_rc_files(false),
       block_for_lock(true),
       host_jvm_debug(false),
@@ -75,6 +76,8 @@ StartupOptions::StartupOptions(const string &product_name,
       batch(false),
       batch_cpu_scheduling(false),
       io_nice_level(-1),
+      per_command_scheduling(false),
+      scoped_server_pid(0),
       shutdown_on_low_sys_mem(false),
       oom_more_eagerly(false),
       oom_more_eagerly_threshold(100),
@@ -84,6 +87,8 @@ StartupOptions::StartupOptions(const string &product_name,
       command_port(0),
       connect_timeout_secs(30),
       local_startup_timeout_secs(120),
+      standby_servers(0),
+      output_base_max_age_days(0),
       have_invocation_policy_(false),
       client_debug(false),
       preemptible(false),
@@ -96,8 +101,14 @@ StartupOptions::StartupOptions(const string &product_name,
       macos_qos_class(QOS_CLASS_UNSPECIFIED),
 #endif
       unlimit_coredumps(false),
+      server_class_data_sharing(false),
+      auto_size_server_jvm(false),
+      unix_domain_socket(false),
 #ifdef __linux__
       cgroup_parent(),
+      cgroup_memory_high(),
+      cgroup_memory_max(),
+      server_numa_node(-1),
 #endif
       windows_enable_symlinks(false) {
   // To ensure predictable behavior from PathFragmentConverter in Java,
@@ -144,19 +155,30 @@ StartupOptions::StartupOptions(const string &product_name,
   RegisterNullaryStartupFlag("autodetect_server_javabase",
                              &autodetect_server_javabase);
   RegisterNullaryStartupFlag("idle_server_tasks", &idle_server_tasks);
+  RegisterNullaryStartupFlag("experimental_per_command_scheduling",
+                             &per_command_scheduling);
   RegisterNullaryStartupFlag("shutdown_on_low_sys_mem",
                              &shutdown_on_low_sys_mem);
   RegisterNullaryStartupFlagNoRc("ignore_all_rc_files", &ignore_all_rc_files);
   RegisterNullaryStartupFlag("unlimit_coredumps", &unlimit_coredumps);
+  RegisterNullaryStartupFlag("experimental_server_class_data_sharing",
+                             &server_class_data_sharing);
+  RegisterNullaryStartupFlag("experimental_auto_size_server_jvm",
+                             &auto_size_server_jvm);
+  RegisterNullaryStartupFlag("experimental_unix_domain_socket",
+                             &unix_domain_socket);
   RegisterNullaryStartupFlag("watchfs", &watchfs);
   RegisterNullaryStartupFlag("write_command_log", &write_command_log);
   RegisterNullaryStartupFlag("windows_enable_symlinks",
                              &windows_enable_symlinks);
+  RegisterUnaryStartupFlag("client_profile");
+  RegisterUnaryStartupFlag("command_list");
   RegisterUnaryStartupFlag("command_port");
   RegisterUnaryStartupFlag("connect_timeout_secs");
   RegisterUnaryStartupFlag("local_startup_timeout_secs");
   RegisterUnaryStartupFlag("digest_function");
   RegisterUnaryStartupFlag("unix_digest_hash_attribute_name");
+  RegisterUnaryStartupFlag("unix_digest_cache_attribute_name");
   RegisterUnaryStartupFlag("server_javabase");
   RegisterUnaryStartupFlag("host_jvm_args");
   RegisterUnaryStartupFlag("host_jvm_profile");
@@ -168,8 +190,15 @@ StartupOptions::StartupOptions(const string &product_name,
   RegisterUnaryStartupFlag("output_base");
   RegisterUnaryStartupFlag("output_user_root");
   RegisterUnaryStartupFlag("server_jvm_out");
+  RegisterUnaryStartupFlag("shared_install_base_root");
+  RegisterUnaryStartupFlag("standby_servers");
   RegisterUnaryStartupFlag("failure_detail_out");
   RegisterUnaryStartupFlag("experimental_cgroup_parent");
+  RegisterUnaryStartupFlag("experimental_cgroup_memory_high");
+  RegisterUnaryStartupFlag("experimental_cgroup_memory_max");
+  RegisterUnaryStartupFlag("experimental_output_base_max_age_days");
+  RegisterUnaryStartupFlag("experimental_scoped_server_pid");
+  RegisterUnaryStartupFlag("experimental_server_numa_node");
 }
 
 StartupOptions::~StartupOptions() {}
@@ -274,6 +303,20 @@ blaze_exit_code::ExitCode StartupOptions::ProcessArg(
              nullptr) {
     output_user_root = blaze::AbsolutePathFromFlag(value);
     option_sources["output_user_root"] = rcfile;
+  } else if ((value = GetUnaryOption(arg, next_arg,
+                                     "--shared_install_base_root")) !=
+             nullptr) {
+    shared_install_base_root = blaze::AbsolutePathFromFlag(value);
+    option_sources["shared_install_base_root"] = rcfile;
+  } else if ((value = GetUnaryOption(arg, next_arg, "--client_profile")) !=
+             nullptr) {
+    client_profile = blaze_util::Path(blaze::AbsolutePathFromFlag(value));
+    option_sources["client_profile"] = rcfile;
+  } else if ((value = GetUnaryOption(arg, next_arg, "--command_list")) !=
+             nullptr) {
+    command_list =
+        string(value) == "-" ? "-" : blaze::AbsolutePathFromFlag(value);
+    option_sources["command_list"] = rcfile;
   } else if ((value = GetUnaryOption(arg, next_arg, "--server_jvm_out")) !=
              nullptr) {
     server_jvm_out = blaze_util::Path(blaze::AbsolutePathFromFlag(value));
@@ -312,6 +355,19 @@ blaze_exit_code::ExitCode StartupOptions::ProcessArg(
       return blaze_exit_code::BAD_ARGV;
     }
     option_sources["max_idle_secs"] = rcfile;
+  } else if ((value = GetUnaryOption(arg, next_arg,
+                                     "--experimental_scoped_server_pid")) !=
+             nullptr) {
+    if (!blaze_util::safe_strto32(value, &scoped_server_pid) ||
+        scoped_server_pid < 0) {
+      blaze_util::StringPrintf(
+          error,
+          "Invalid argument to --experimental_scoped_server_pid: '%s'.\n"
+          "Must be a process id, or 0 for none.\n",
+          value);
+      return blaze_exit_code::BAD_ARGV;
+    }
+    option_sources["experimental_scoped_server_pid"] = rcfile;
   } else if ((value = GetUnaryOption(arg, next_arg, "--macos_qos_class")) !=
              nullptr) {
     // We parse the value of this flag on all platforms even if it is
@@ -344,6 +400,32 @@ blaze_exit_code::ExitCode StartupOptions::ProcessArg(
       return blaze_exit_code::BAD_ARGV;
     }
     option_sources["connect_timeout_secs"] = rcfile;
+  } else if ((value = GetUnaryOption(arg, next_arg, "--standby_servers")) !=
+             nullptr) {
+    if (!blaze_util::safe_strto32(value, &standby_servers) ||
+        standby_servers < 0 || standby_servers > 16) {
+      blaze_util::StringPrintf(
+          error,
+          "Invalid argument to --standby_servers: '%s'.\n"
+          "Must be an integer between 0 and 16.\n",
+          value);
+      return blaze_exit_code::BAD_ARGV;
+    }
+    option_sources["standby_servers"] = rcfile;
+  } else if ((value = GetUnaryOption(
+                  arg, next_arg, "--experimental_output_base_max_age_days")) !=
+             nullptr) {
+    if (!blaze_util::safe_strto32(value, &output_base_max_age_days) ||
+        output_base_max_age_days < 0) {
+      blaze_util::StringPrintf(
+          error,
+          "Invalid argument to --experimental_output_base_max_age_days: "
+          "'%s'.\n"
+          "Must be a non-negative integer.\n",
+          value);
+      return blaze_exit_code::BAD_ARGV;
+    }
+    option_sources["experimental_output_base_max_age_days"] = rcfile;
   } else if ((value = GetUnaryOption(
                   arg, next_arg, "--local_startup_timeout_secs")) != nullptr) {
     if (!blaze_util::safe_strto32(value, &local_startup_timeout_secs) ||
@@ -365,6 +447,11 @@ blaze_exit_code::ExitCode StartupOptions::ProcessArg(
              nullptr) {
     unix_digest_hash_attribute_name = value;
     option_sources["unix_digest_hash_attribute_name"] = rcfile;
+  } else if ((value = GetUnaryOption(arg, next_arg,
+                                     "--unix_digest_cache_attribute_name")) !=
+             nullptr) {
+    unix_digest_cache_attribute_name = value;
+    option_sources["unix_digest_cache_attribute_name"] = rcfile;
   } else if ((value = GetUnaryOption(arg, next_arg, "--command_port")) !=
              nullptr) {
     if (!blaze_util::safe_strto32(value, &command_port) ||
@@ -392,6 +479,35 @@ blaze_exit_code::ExitCode StartupOptions::ProcessArg(
 #ifdef __linux__
     cgroup_parent = value;
     option_sources["cgroup_parent"] = rcfile;
+#endif
+  } else if ((value = GetUnaryOption(arg, next_arg,
+                                     "--experimental_cgroup_memory_high")) !=
+             nullptr) {
+#ifdef __linux__
+    cgroup_memory_high = value;
+    option_sources["cgroup_memory_high"] = rcfile;
+#endif
+  } else if ((value = GetUnaryOption(arg, next_arg,
+                                     "--experimental_cgroup_memory_max")) !=
+             nullptr) {
+#ifdef __linux__
+    cgroup_memory_max = value;
+    option_sources["cgroup_memory_max"] = rcfile;
+#endif
+  } else if ((value = GetUnaryOption(arg, next_arg,
+                                     "--experimental_server_numa_node")) !=
+             nullptr) {
+#ifdef __linux__
+    if (!blaze_util::safe_strto32(value, &server_numa_node) ||
+        server_numa_node < -1) {
+      blaze_util::StringPrintf(
+          error,
+          "Invalid argument to --experimental_server_numa_node: '%s'.\n"
+          "Must be the number of a NUMA node, or -1 for none.\n",
+          value);
+      return blaze_exit_code::BAD_ARGV;
+    }
+    option_sources["server_numa_node"] = rcfile;
 #endif
   } else {
     bool extra_argument_processed;
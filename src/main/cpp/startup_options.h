@@ -135,6 +135,13 @@ class StartupOptions {
   // Otherwise a default path in the output base is used.
   blaze_util::Path server_jvm_out;
 
+  // If set, the client writes a JSON trace of its own startup phases here.
+  blaze_util::Path client_profile;
+
+  // If set, the file (or "-" for stdin) listing the commands to run one after
+  // another, instead of a command on the command line.
+  std::string command_list;
+
   // If supplied, alternate location to write a serialized failure_detail proto.
   // Otherwise a default path in the output base is used.
   blaze_util::Path failure_detail_out;
@@ -155,6 +162,17 @@ class StartupOptions {
   // output_base.
   std::string output_user_root;
 
+  // A directory of pre-extracted install bases named by their install md5,
+  // typically on a read-only volume shared between users or containers. If
+  // it has one for this binary and --install_base is not given, that one is
+  // used instead of extracting a private copy.
+  std::string shared_install_base_root;
+
+  // Whether install_base was taken from shared_install_base_root. Such an
+  // install base is validated by its install_base_key alone, not file by
+  // file.
+  bool install_base_is_shared;
+
   // Override more finegrained rc file flags and ignore them all.
   bool ignore_all_rc_files;
 
@@ -181,8 +199,18 @@ class StartupOptions {
   // for best-effort scheduling. 0 is highest priority, 7 is lowest.
   int io_nice_level;
 
+  // If true, the server applies batch_cpu_scheduling and io_nice_level only
+  // while it runs a command that executes actions, and runs the others, such
+  // as query and info, at the normal priority.
+  bool per_command_scheduling;
+
   int max_idle_secs;
 
+  // If positive, the server shuts down once the process of this pid is gone,
+  // so that the commands run while it lives can share a server without
+  // leaving one behind.
+  int scoped_server_pid;
+
   bool shutdown_on_low_sys_mem;
 
   bool oom_more_eagerly;
@@ -237,6 +265,20 @@ class StartupOptions {
   // Local server startup timeout duration.
   int local_startup_timeout_secs;
 
+  // The number of idle servers kept running for other startup options of
+  // the same workspace. If positive and --output_base is not given, each set
+  // of startup options gets its own output base, so alternating between them
+  // does not restart the server.
+  int standby_servers;
+
+  // Where the servers of this workspace are registered (see
+  // standby_servers.h), or empty if standby_servers is not in effect.
+  std::string standby_registry;
+
+  // If positive, the output bases under output_user_root whose lock file was
+  // not touched for this many days are deleted (see output_base_gc.h).
+  int output_base_max_age_days;
+
   // Invocation policy proto, or an empty string.
   std::string invocation_policy;
   // Invocation policy can only be specified once.
@@ -257,6 +299,8 @@ class StartupOptions {
 
   std::string unix_digest_hash_attribute_name;
 
+  std::string unix_digest_cache_attribute_name;
+
   bool idle_server_tasks;
 
   // The startup options as received from the user and rc files, tagged with
@@ -271,8 +315,29 @@ class StartupOptions {
   // Whether to raise the soft coredump limit to the hard one or not.
   bool unlimit_coredumps;
 
+  // Whether the server JVM keeps a dynamic class data sharing archive of the
+  // classes it loads in the server directory, to start faster next time.
+  bool server_class_data_sharing;
+
+  // Whether the client sizes the heap, GC and GC threads of the server JVM
+  // for what it may use of the machine.
+  bool auto_size_server_jvm;
+
+  // Whether the server listens on a Unix domain socket rather than on a
+  // loopback TCP port, if it can.
+  bool unix_domain_socket;
+
 #ifdef __linux__
   std::string cgroup_parent;
+
+  // The memory.high and memory.max of the cgroup v2 sub-tree of the server
+  // and its actions, under cgroup_parent.
+  std::string cgroup_memory_high;
+  std::string cgroup_memory_max;
+
+  // The NUMA node whose cpus the server runs on and whose memory it prefers,
+  // or -1 to leave it to the scheduler.
+  int server_numa_node;
 #endif
 
   // Whether to create symbolic links on Windows for files. Requires
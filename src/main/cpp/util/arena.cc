@@ -0,0 +1,222 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/cpp/util/arena.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace blaze_util {
+
+static inline size_t AlignSize(size_t addr, size_t align) {
+  size_t mod = addr % align;
+  return mod == 0 ? addr : (addr - mod + align);
+}
+
+static inline uint8_t *GetArenaBase(Arena *arena) {
+  return (uint8_t *)(arena + 1);
+}
+
+Arena *AllocArena(size_t reserve_size, bool huge_pages) {
+  size_t page_size = GetPageSize();
+  size_t commit_size = AlignSize(sizeof(Arena), page_size);
+  reserve_size = AlignSize(reserve_size, page_size);
+  assert(sizeof(Arena) <= commit_size && commit_size <= reserve_size);
+  Arena *arena = (Arena *)ReserveMemory(reserve_size);
+  // The kernel backs an aligned huge page worth of memory with a huge page
+  // only once all of it is accessible, so the arena then commits such whole
+  // huge pages. The memory before the first of them keeps small pages.
+  size_t commit_alignment = page_size;
+  if (huge_pages && reserve_size >= HugePageSize()) {
+    AdviseHugePages(arena, reserve_size);
+    commit_alignment = HugePageSize();
+    uint8_t *end =
+        (uint8_t *)AlignSize((size_t)arena + commit_size, commit_alignment);
+    uint8_t *reserved = (uint8_t *)arena + reserve_size;
+    commit_size = (end < reserved ? end : reserved) - (uint8_t *)arena;
+  }
+  CommitMemory(arena, commit_size);
+  arena->top = GetArenaBase(arena);
+  arena->reserved = (uint8_t *)arena + reserve_size;
+  arena->committed = (uint8_t *)arena + commit_size;
+  arena->fd = -1;
+  arena->commit_alignment = commit_alignment;
+  return arena;
+}
+
+void FreeArena(Arena *arena) {
+  assert(arena->temp_memory_count == 0 && "Temporary memory still in use");
+  size_t reserved_size = arena->reserved - (uint8_t *)arena;
+  int fd = arena->fd;
+  ReleaseMemory(arena, reserved_size);
+  if (fd >= 0) {
+    CloseMemoryFile(fd);
+  }
+}
+
+Arena *AllocFileArena(const char *path, size_t reserve_size) {
+  size_t page_size = GetPageSize();
+  size_t commit_size = AlignSize(sizeof(Arena), page_size);
+  reserve_size = AlignSize(reserve_size, page_size);
+  int fd = OpenMemoryFile(path, /*create=*/true);
+  if (fd < 0) {
+    return 0;
+  }
+  Arena *arena = 0;
+  if (CommitFileMemory(fd, commit_size)) {
+    arena = (Arena *)ReserveFileMemory(fd, reserve_size, 0);
+  }
+  if (!arena) {
+    CloseMemoryFile(fd);
+    return 0;
+  }
+  arena->top = GetArenaBase(arena);
+  arena->reserved = (uint8_t *)arena + reserve_size;
+  arena->committed = (uint8_t *)arena + commit_size;
+  arena->temp_memory_count = 0;
+  arena->fd = fd;
+  arena->commit_alignment = page_size;
+  return arena;
+}
+
+Arena *LoadFileArena(const char *path, size_t reserve_size,
+                     ptrdiff_t *moved_by) {
+  reserve_size = AlignSize(reserve_size, GetPageSize());
+  int fd = OpenMemoryFile(path, /*create=*/false);
+  if (fd < 0) {
+    return 0;
+  }
+  // Where the arena was, as told by its header in the file.
+  Arena header;
+  size_t file_size;
+  if (!ReadMemoryFileHeader(fd, &header, sizeof(header), &file_size) ||
+      (uintptr_t)header.reserved < reserve_size) {
+    CloseMemoryFile(fd);
+    return 0;
+  }
+  uintptr_t old_base = (uintptr_t)header.reserved - reserve_size;
+  uintptr_t top = (uintptr_t)header.top;
+  uintptr_t committed = (uintptr_t)header.committed;
+  if (committed < old_base || committed - old_base != file_size ||
+      committed > (uintptr_t)header.reserved ||
+      top < old_base + sizeof(Arena) || top > committed ||
+      header.temp_memory_count != 0) {
+    CloseMemoryFile(fd);
+    return 0;
+  }
+  Arena *arena = (Arena *)ReserveFileMemory(fd, reserve_size,
+                                            (void *)old_base);
+  if (!arena) {
+    CloseMemoryFile(fd);
+    return 0;
+  }
+  ptrdiff_t delta = (ptrdiff_t)((uintptr_t)arena - old_base);
+  arena->reserved += delta;
+  arena->committed += delta;
+  arena->top += delta;
+  arena->fd = fd;
+  arena->commit_alignment = GetPageSize();
+  *moved_by = delta;
+  return arena;
+}
+
+void *GetArenaFirst(Arena *arena) {
+  void *result = (void *)AlignSize((size_t)GetArenaBase(arena), 8);
+  return result;
+}
+
+void *PushArena(Arena *arena, size_t size) {
+  size_t align = 8;
+
+  uint8_t *result = (uint8_t *)AlignSize((size_t)arena->top, align);
+  arena->top = result + size;
+  assert(arena->top <= arena->reserved && "OOM");
+
+  if (arena->top > arena->committed) {
+    uint8_t *new_committed =
+        (uint8_t *)AlignSize((size_t)arena->top, arena->commit_alignment);
+    if (new_committed > arena->reserved) {
+      new_committed = arena->reserved;
+    }
+    if (arena->fd >= 0) {
+      bool committed =
+          CommitFileMemory(arena->fd, new_committed - (uint8_t *)arena);
+      assert(committed && "Failed to grow the file of the arena");
+    } else {
+      size_t to_commit = new_committed - arena->committed;
+      CommitMemory(arena->committed, to_commit);
+    }
+    arena->committed = new_committed;
+    assert(arena->top <= arena->committed);
+  }
+
+  memset(result, 0, size);
+  return result;
+}
+
+void PopArena(Arena *arena, size_t size) {
+  arena->top -= size;
+  assert(arena->top >= GetArenaBase(arena));
+}
+
+TemporaryMemory BeginTemporaryMemory(Arena *arena) {
+  TemporaryMemory temp;
+  temp.arena = arena;
+  temp.top = arena->top;
+  ++arena->temp_memory_count;
+  return temp;
+}
+
+void EndTemporaryMemory(TemporaryMemory temp) {
+  Arena *arena = temp.arena;
+  assert(arena->temp_memory_count > 0 && temp.top <= arena->top);
+  PopArena(arena, arena->top - temp.top);
+  assert(arena->top == temp.top);
+  --arena->temp_memory_count;
+}
+
+constexpr size_t kScratchArenaCount = 2;
+thread_local Arena *t_scratch_arenas[kScratchArenaCount];
+
+Arena *GetScratchArena(Arena **conflicts, size_t count) {
+  Arena *result = 0;
+  for (size_t i = 0; i < kScratchArenaCount; ++i) {
+    Arena *candidate = t_scratch_arenas[i];
+    if (!candidate) {
+      result = AllocArena();
+      t_scratch_arenas[i] = result;
+      break;
+    }
+
+    bool conflict = false;
+    for (size_t j = 0; j < count; ++j) {
+      if (candidate == conflicts[j]) {
+        conflict = true;
+        break;
+      }
+    }
+
+    if (!conflict) {
+      result = candidate;
+      break;
+    }
+  }
+
+  assert(result && "No scratch arena available");
+  return result;
+}
+
+}  // namespace blaze_util
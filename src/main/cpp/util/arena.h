@@ -0,0 +1,167 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_MAIN_CPP_UTIL_ARENA_H_
+#define BAZEL_SRC_MAIN_CPP_UTIL_ARENA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace blaze_util {
+
+static inline size_t KiB(size_t size) { return size * 1024; }
+static inline size_t MiB(size_t size) { return KiB(size) * 1024; }
+static inline size_t GiB(size_t size) { return MiB(size) * 1024; }
+
+// The size of the huge pages that AllocArena() asks for, which is that of
+// x86-64 and of arm64 with 4 KiB pages.
+static inline size_t HugePageSize() { return MiB(2); }
+
+// Returns the number of bytes in a memory page.
+size_t GetPageSize();
+
+// Reserves `size` bytes of memory in the current process's memory space. The
+// memory is not committed so cannot be accessed. In order to access (sub)region
+// of the reserved memory, use CommitMemory().
+void *ReserveMemory(size_t size);
+
+// Commits a region of memory previously reserved with ReserveMemory(). The
+// memory is accessible and can be read and written after this call.
+void CommitMemory(void *ptr, size_t size);
+
+// Releases a region of memory previously reserved with ReserveMemory(). The
+// memory is no longer reserved and cannot be accessed.
+void ReleaseMemory(void *ptr, size_t size);
+
+// Asks for the region of memory previously reserved with ReserveMemory() to be
+// backed by huge pages where it is committed, as MADV_HUGEPAGE does on Linux.
+// Does nothing where the platform cannot do that.
+void AdviseHugePages(void *ptr, size_t size);
+
+// Opens the file at `path` for ReserveFileMemory(), and creates or truncates
+// it if `create` is set. Returns -1 on failure.
+int OpenMemoryFile(const char *path, bool create);
+
+// Reads the first `size` bytes of the file into `header`, and sets
+// `file_size`. Returns false if the file is shorter or cannot be read.
+bool ReadMemoryFileHeader(int fd, void *header, size_t size,
+                          size_t *file_size);
+
+void CloseMemoryFile(int fd);
+
+// Reserves `size` bytes of memory like ReserveMemory(), with the file `fd`
+// mapped over them, at `address` if that is free. What is written to the
+// memory is written to the file. Only the part of the memory that the file
+// covers can be accessed; CommitFileMemory() grows it. Returns 0 on failure.
+void *ReserveFileMemory(int fd, size_t size, void *address);
+
+// Sets the size of the file mapped by ReserveFileMemory(), which makes that
+// much of its memory accessible. Returns false on failure. The memory is
+// released with ReleaseMemory(), and the file keeps what was written to it.
+bool CommitFileMemory(int fd, size_t size);
+
+// Arena is a memory allocator that allocates memory from a reserved memory
+// region in a stack like manner. The memory is committed to OS on demand.
+// An arena is not thread safe: threads use arenas of their own, such as
+// their scratch arenas.
+struct Arena {
+  // The end of the reserved memory region.
+  uint8_t *reserved;
+  // The end of the committed memory region.
+  uint8_t *committed;
+  // The current top of the stack. This is the address of the first byte of
+  // memory that is not yet allocated.
+  //
+  // Invariant: top <= committed <= reserved
+  uint8_t *top;
+  uint32_t temp_memory_count;
+  // The file the arena is mapped from, or -1.
+  int fd;
+  // The committed memory region ends at a multiple of this, which is the
+  // huge page size if the arena asked for huge pages and the page size
+  // otherwise.
+  size_t commit_alignment;
+};
+
+// Allocates an arena of at most `reserve_size` bytes. With `huge_pages`, the
+// memory is committed in huge pages where the platform supports that, which
+// saves TLB misses for arenas that grow large, at the cost of committing up to
+// a huge page more than is used.
+Arena *AllocArena(size_t reserve_size = GiB(1), bool huge_pages = false);
+void FreeArena(Arena *arena);
+
+// Allocates an arena in the file at `path`, which is created or truncated.
+// What is pushed onto the arena stays in the file when the arena is freed,
+// or when the process dies, and LoadFileArena() maps it again. Returns 0 if
+// the file cannot be created.
+Arena *AllocFileArena(const char *path, size_t reserve_size);
+
+// Maps the arena in the file at `path` again, with the `reserve_size` it was
+// allocated with. The pointers in the arena are to where it was mapped
+// before: if it is mapped at another address now, `moved_by` is set to what
+// has to be added to them, and to 0 otherwise. Returns 0 if the file is
+// missing or doesn't hold an arena.
+Arena *LoadFileArena(const char *path, size_t reserve_size,
+                     ptrdiff_t *moved_by);
+
+// Returns the first block of memory that was pushed onto the arena.
+void *GetArenaFirst(Arena *arena);
+
+// PushArena allocates a block of memory of the given size in the arena. The
+// returned pointer is aligned to 8 bytes. The memory is zeroed.
+void *PushArena(Arena *arena, size_t size);
+void PopArena(Arena *arena, size_t size);
+
+#define PushArray(arena, type, count) \
+  (type *)::blaze_util::PushArena(arena, sizeof(type) * (count))
+
+struct TemporaryMemory {
+  Arena *arena;
+  uint8_t *top;
+};
+
+// Begins temporary memory allocations for the arena. The returned
+// TemporaryMemory must be passed to EndTemporaryMemory() when the memory is no
+// longer needed.
+TemporaryMemory BeginTemporaryMemory(Arena *arena);
+// Ends the temporary memory allocations. All memory allocated since
+// BeginTemporaryMemory() was called is freed.
+void EndTemporaryMemory(TemporaryMemory temp);
+
+// Gets a thread-local arena for temporary use. Use `conflicts` to avoid
+// returning the same arena as a previous call to GetScratchArena().
+Arena *GetScratchArena(Arena **conflicts, size_t count);
+
+// Begins the use of a thread-local scratch arena. The returned TemporaryMemory
+// must be passed to EndScratch() when the memory is no longer needed.
+static inline TemporaryMemory BeginScratch(Arena **conflicts, size_t count) {
+  return BeginTemporaryMemory(GetScratchArena(conflicts, count));
+}
+
+static inline TemporaryMemory BeginScratch(Arena *conflict) {
+  if (conflict) {
+    return BeginTemporaryMemory(GetScratchArena(&conflict, 1));
+  } else {
+    return BeginTemporaryMemory(GetScratchArena(0, 0));
+  }
+}
+
+// Ends the use of a thread-local scratch arena.
+static inline void EndScratch(TemporaryMemory scratch) {
+  EndTemporaryMemory(scratch);
+}
+
+}  // namespace blaze_util
+
+#endif  // BAZEL_SRC_MAIN_CPP_UTIL_ARENA_H_
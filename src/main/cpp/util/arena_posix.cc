@@ -0,0 +1,93 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "src/main/cpp/util/arena.h"
+
+namespace blaze_util {
+
+size_t GetPageSize() {
+  size_t result = getpagesize();
+  return result;
+}
+
+void *ReserveMemory(size_t size) {
+  void *result = mmap(0, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  assert(result != MAP_FAILED && "Failed to reserve memory");
+  return result;
+}
+
+void CommitMemory(void *ptr, size_t size) {
+  bool result = mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0;
+  assert(result && "Failed to commit memory");
+}
+
+void ReleaseMemory(void *ptr, size_t size) {
+  bool result = munmap(ptr, size) == 0;
+  assert(result && "Failed to release memory");
+}
+
+void AdviseHugePages(void *ptr, size_t size) {
+#ifdef MADV_HUGEPAGE
+  // This fails where transparent huge pages are disabled, which only costs
+  // the TLB misses they would have saved.
+  madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+}
+
+int OpenMemoryFile(const char *path, bool create) {
+  int flags = O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_TRUNC : 0);
+  int result = open(path, flags, 0644);
+  return result;
+}
+
+bool ReadMemoryFileHeader(int fd, void *header, size_t size,
+                          size_t *file_size) {
+  struct stat st;
+  bool result = fstat(fd, &st) == 0 && (size_t)st.st_size >= size &&
+                pread(fd, header, size, 0) == (ssize_t)size;
+  *file_size = result ? (size_t)st.st_size : 0;
+  return result;
+}
+
+void CloseMemoryFile(int fd) { close(fd); }
+
+void *ReserveFileMemory(int fd, size_t size, void *address) {
+  // The part beyond the end of the file faults when it is accessed, like
+  // memory that ReserveMemory() has not committed.
+  void *result =
+      mmap(address, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (result == MAP_FAILED) {
+    result = 0;
+  }
+  return result;
+}
+
+bool CommitFileMemory(int fd, size_t size) {
+  int error;
+  do {
+    error = ftruncate(fd, size) == 0 ? 0 : errno;
+  } while (error == EINTR);
+  bool result = error == 0;
+  return result;
+}
+
+}  // namespace blaze_util
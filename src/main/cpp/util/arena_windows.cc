@@ -0,0 +1,71 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+
+#include <assert.h>
+#include <stddef.h>
+
+#include "src/main/cpp/util/arena.h"
+
+namespace blaze_util {
+
+size_t GetPageSize() {
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  size_t result = info.dwPageSize;
+  return result;
+}
+
+void *ReserveMemory(size_t size) {
+  void *result = VirtualAlloc(0, size, MEM_RESERVE, PAGE_NOACCESS);
+  assert(result && "Failed to reserve memory");
+  return result;
+}
+
+void CommitMemory(void *ptr, size_t size) {
+  bool result = VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) != 0;
+  assert(result && "Failed to commit memory");
+}
+
+void ReleaseMemory(void *ptr, size_t size) {
+  // MEM_RELEASE releases the whole reservation, and wants a size of 0.
+  bool result = VirtualFree(ptr, 0, MEM_RELEASE) != 0;
+  assert(result && "Failed to release memory");
+}
+
+// Large pages need a privilege that processes don't usually have and cannot
+// be committed on demand, so arenas keep small pages on Windows.
+void AdviseHugePages(void *ptr, size_t size) {}
+
+// File arenas are not supported on Windows: the output service, which uses
+// them, doesn't run there.
+int OpenMemoryFile(const char *path, bool create) { return -1; }
+
+bool ReadMemoryFileHeader(int fd, void *header, size_t size,
+                          size_t *file_size) {
+  *file_size = 0;
+  return false;
+}
+
+void CloseMemoryFile(int fd) {}
+
+void *ReserveFileMemory(int fd, size_t size, void *address) { return 0; }
+
+bool CommitFileMemory(int fd, size_t size) { return false; }
+
+}  // namespace blaze_util
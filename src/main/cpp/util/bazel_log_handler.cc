@@ -14,12 +14,17 @@
 
 #include "src/main/cpp/util/bazel_log_handler.h"
 
+#include <atomic>
 #include <chrono>  // NOLINT -- for windows portability
+#include <condition_variable>  // NOLINT -- for windows portability
 #include <cstdio>
 #include <cstdlib>
 #include <ctime>
 #include <iostream>
+#include <mutex>  // NOLINT -- for windows portability
 #include <sstream>
+#include <thread>  // NOLINT -- for windows portability
+#include <utility>
 
 #include "src/main/cpp/util/exit_code.h"
 #include "src/main/cpp/util/file.h"
@@ -27,29 +32,6 @@
 
 namespace blaze_util {
 
-BazelLogHandler::BazelLogHandler()
-    : output_stream_set_(false),
-      logging_deactivated_(false),
-      user_buffer_stream_(new std::stringstream()),
-      debug_buffer_stream_(new std::stringstream()),
-      output_stream_(),
-      owned_output_stream_() {}
-
-BazelLogHandler::~BazelLogHandler() {
-  if (!logging_deactivated_) {
-    // If SetLoggingOutputStream was never called, dump the buffer to stderr,
-    // otherwise, flush the stream.
-    if (output_stream_ != nullptr) {
-      output_stream_->flush();
-    } else if (debug_buffer_stream_ != nullptr) {
-      std::cerr << debug_buffer_stream_->rdbuf();
-    } else {
-      std::cerr << "Illegal state - neither a logfile nor a logbuffer "
-                << "existed at program end." << '\n';
-    }
-  }
-}
-
 // Messages intended for the user (level USER, along with WARNINGs an ERRORs)
 // should be printed even if debug level logging was not requested.
 void PrintUserLevelMessageToStream(std::ostream* stream, LogLevel level,
@@ -64,31 +46,184 @@ void PrintUserLevelMessageToStream(std::ostream* stream, LogLevel level,
   // output. We ignore it here.
 }
 
-static std::string Timestamp() {
-  auto now = std::chrono::system_clock::now();
-  time_t s = std::chrono::system_clock::to_time_t(now);
+// Formats the wall clock time of the monotonic `time` as HH:MM:SS.mmm.
+static std::string Timestamp(std::chrono::steady_clock::time_point time) {
+  // The clocks are only read together once, so that the timestamps of the
+  // messages keep their order and spacing even if the wall clock is changed.
+  static const auto system_base = std::chrono::system_clock::now();
+  static const auto steady_base = std::chrono::steady_clock::now();
   auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-      now.time_since_epoch());
-  struct tm tmbuf = {};
+      (system_base + std::chrono::duration_cast<
+                         std::chrono::system_clock::duration>(
+                         time - steady_base))
+          .time_since_epoch());
+  time_t s = static_cast<time_t>(ms.count() / 1000);
+
+  // Most messages are logged in the same second as the previous one.
+  thread_local time_t cached_s = -1;
+  thread_local char cached[16];
+  if (s != cached_s) {
+    struct tm tmbuf = {};
 #ifdef _WIN32
-  tmbuf = *localtime(&s);  // NOLINT -- threadsafe on windows
+    tmbuf = *localtime(&s);  // NOLINT -- threadsafe on windows
 #else
-  localtime_r(&s, &tmbuf);
+    localtime_r(&s, &tmbuf);
 #endif
+    strftime(cached, sizeof cached, "%H:%M:%S", &tmbuf);
+    cached_s = s;
+  }
   char buf[16];
-  int r = strftime(buf, sizeof buf - 5, "%H:%M:%S", &tmbuf);
-  r += snprintf(buf + r, +5, ".%03d", static_cast<int>(ms.count() % 1000));
+  int r = snprintf(buf, sizeof buf, "%s.%03d", cached,
+                   static_cast<int>(ms.count() % 1000));
   return std::string(buf, r);
 }
 
 // For debug logs, print all logs, both debug logging and USER logs and above,
 // along with information about where the log message came from.
 void PrintDebugLevelMessageToStream(std::ostream* stream,
-                                    const std::string& filename, int line,
-                                    LogLevel level,
-                                    const std::string& message) {
-  (*stream) << "[" << LogLevelName(level) << " " << Timestamp() << " "
-            << filename << ":" << line << "] " << message << '\n';
+                                    const BazelLogHandler::Record& record) {
+  (*stream) << "[" << LogLevelName(record.level) << " "
+            << Timestamp(record.time) << " " << record.filename << ":"
+            << record.line << "] " << record.message << '\n';
+}
+
+// Writes the records to a stream on a thread of its own. The records are
+// passed through a bounded multi-producer queue (see "Bounded MPMC queue" by
+// Dmitry Vyukov): logging only takes a lock to wake the thread up when it
+// has run out of records to write.
+class BazelLogHandler::AsyncWriter {
+ public:
+  explicit AsyncWriter(std::ostream* stream)
+      : stream_(stream),
+        slots_(new Slot[kSlots]),
+        head_(0),
+        tail_(0),
+        idle_(false),
+        stopping_(false) {
+    for (size_t i = 0; i < kSlots; i++) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    thread_ = std::thread(&AsyncWriter::Run, this);
+  }
+
+  // Writes out the queued records.
+  ~AsyncWriter() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    wakeup_.notify_one();
+    thread_.join();
+  }
+
+  AsyncWriter(const AsyncWriter&) = delete;
+  AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+  void Push(Record record) {
+    Slot* slot;
+    size_t pos = head_.load(std::memory_order_relaxed);
+    for (;;) {
+      slot = &slots_[pos % kSlots];
+      size_t sequence = slot->sequence.load(std::memory_order_acquire);
+      if (sequence == pos) {
+        if (head_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (sequence + kSlots == pos + 1) {
+        // The queue is full: wait for the writer to make room.
+        std::this_thread::yield();
+        pos = head_.load(std::memory_order_relaxed);
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+    slot->record = std::move(record);
+    // Publishing the record and then checking idle_, while the writer sets
+    // idle_ and then checks for a record, makes sure that one of the two sees
+    // the other.
+    slot->sequence.store(pos + 1);
+    if (idle_.load()) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      wakeup_.notify_one();
+    }
+  }
+
+ private:
+  struct Slot {
+    // pos when the slot is free for the record at pos, pos + 1 when it holds
+    // it.
+    std::atomic<size_t> sequence;
+    Record record;
+  };
+
+  static constexpr size_t kSlots = 1024;
+
+  bool HasRecord() const {
+    return slots_[tail_ % kSlots].sequence.load() == tail_ + 1;
+  }
+
+  void Run() {
+    for (;;) {
+      while (HasRecord()) {
+        Slot* slot = &slots_[tail_ % kSlots];
+        PrintDebugLevelMessageToStream(stream_, slot->record);
+        slot->record.message.clear();
+        slot->sequence.store(tail_ + kSlots, std::memory_order_release);
+        tail_++;
+      }
+      stream_->flush();
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      idle_.store(true);
+      if (!HasRecord()) {
+        if (stopping_) {
+          return;
+        }
+        wakeup_.wait(lock);
+      }
+      idle_.store(false);
+    }
+  }
+
+  std::ostream* const stream_;
+  std::unique_ptr<Slot[]> slots_;
+  // The position of the next record to push.
+  std::atomic<size_t> head_;
+  // The position of the next record to write, only used by the thread.
+  size_t tail_;
+  // Whether the thread is about to wait for records, or waiting.
+  std::atomic<bool> idle_;
+  bool stopping_;  // Guarded by mutex_.
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+  std::thread thread_;
+};
+
+BazelLogHandler::BazelLogHandler()
+    : output_stream_set_(false),
+      logging_deactivated_(false),
+      buffer_(new std::vector<Record>()),
+      output_stream_(),
+      owned_output_stream_(),
+      async_writer_() {}
+
+BazelLogHandler::~BazelLogHandler() {
+  if (!logging_deactivated_) {
+    // If SetLoggingOutputStream was never called, dump the buffer to stderr,
+    // otherwise, flush the stream.
+    if (output_stream_ != nullptr) {
+      async_writer_ = nullptr;
+      output_stream_->flush();
+    } else if (buffer_ != nullptr) {
+      for (const Record& record : *buffer_) {
+        PrintDebugLevelMessageToStream(&std::cerr, record);
+      }
+    } else {
+      std::cerr << "Illegal state - neither a logfile nor a logbuffer "
+                << "existed at program end." << '\n';
+    }
+  }
 }
 
 void BazelLogHandler::HandleMessage(LogLevel level, const std::string& filename,
@@ -105,24 +240,25 @@ void BazelLogHandler::HandleMessage(LogLevel level, const std::string& filename,
     }
     return;
   }
+  Record record = {level, std::chrono::steady_clock::now(), filename, line,
+                   message};
   if (output_stream_ == nullptr) {
     // If we haven't decided whether messages should be logged to debug levels
-    // or not, buffer each version. This is redundant for USER levels and above,
-    // but is to make sure we can provide the right output to the user once we
-    // know that they do or do not want debug level information.
-    PrintUserLevelMessageToStream(user_buffer_stream_.get(), level, message);
-    PrintDebugLevelMessageToStream(debug_buffer_stream_.get(), filename, line,
-                                   level, message);
+    // or not, keep the message, to format it either way once we know whether
+    // the user does or does not want debug level information.
+    buffer_->push_back(std::move(record));
+  } else if (async_writer_ != nullptr) {
+    async_writer_->Push(std::move(record));
   } else {
     // If an output stream has been specifically set, it is for the full suite
     // of log messages. We don't print the user messages separately here as they
     // are included.
-    PrintDebugLevelMessageToStream(output_stream_, filename, line, level,
-                                   message);
+    PrintDebugLevelMessageToStream(output_stream_, record);
   }
 
   // If we have a fatal message, exit with the provided error code.
   if (level == LOGLEVEL_FATAL) {
+    Flush();
     if (owned_output_stream_ != nullptr) {
       // If this is is not being printed to stderr but to a custom stream,
       // also print the error message to stderr.
@@ -139,11 +275,11 @@ void BazelLogHandler::SetOutputStreamToStderr() {
   BAZEL_CHECK(!output_stream_set_) << "Tried to set log output a second time";
   output_stream_set_ = true;
 
-  FlushBufferToNewStreamAndSet(debug_buffer_stream_.get(), &std::cerr);
-  debug_buffer_stream_ = nullptr;
+  FlushBufferToNewStreamAndSet(false, &std::cerr);
   // The user asked for debug level information, which includes the user
-  // messages. We can discard the separate buffer at this point.
-  user_buffer_stream_ = nullptr;
+  // messages. We can discard the buffer at this point.
+  buffer_ = nullptr;
+  async_writer_.reset(new AsyncWriter(&std::cerr));
 }
 
 void BazelLogHandler::SetOutputStream(
@@ -158,12 +294,11 @@ void BazelLogHandler::SetOutputStream(
     logging_deactivated_ = true;
     // Flush the buffered user-level messages to stderr - these are messages
     // that are meant for the user even when debug logging is not set.
-    FlushBufferToNewStreamAndSet(user_buffer_stream_.get(), &std::cerr);
+    FlushBufferToNewStreamAndSet(true, &std::cerr);
 
-    user_buffer_stream_ = nullptr;
     // We discard the debug level logs, the user level ones were enough to
     // inform the user and debug logging was not requested.
-    debug_buffer_stream_ = nullptr;
+    buffer_ = nullptr;
     return;
   }
   owned_output_stream_ = std::move(new_output_stream);
@@ -173,21 +308,35 @@ void BazelLogHandler::SetOutputStream(
     BAZEL_LOG(ERROR) << "Provided stream failed.";
     return;
   }
-  FlushBufferToNewStreamAndSet(debug_buffer_stream_.get(),
-                               owned_output_stream_.get());
-  debug_buffer_stream_ = nullptr;
+  FlushBufferToNewStreamAndSet(false, owned_output_stream_.get());
   // The user asked for debug level information, which includes the user
-  // messages. We can discard the separate buffer at this point.
-  user_buffer_stream_ = nullptr;
+  // messages. We can discard the buffer at this point.
+  buffer_ = nullptr;
+}
+
+void BazelLogHandler::Flush() {
+  // Destroying the writer writes out the queued messages.
+  async_writer_ = nullptr;
+  if (output_stream_ != nullptr) {
+    output_stream_->flush();
+  }
 }
 
 void BazelLogHandler::FlushBufferToNewStreamAndSet(
-    std::stringstream* buffer, std::ostream* new_output_stream) {
+    bool user_level, std::ostream* new_output_stream) {
   // Flush the buffer to the new stream, and print new log lines to it.
   output_stream_ = new_output_stream;
-    // Transfer the contents of the buffer to the new stream, then remove the
-    // buffer.
-  (*output_stream_) << buffer->str();
+  // Transfer the contents of the buffer to the new stream, in the format that
+  // was asked for.
+  std::stringstream formatted;
+  for (const Record& record : *buffer_) {
+    if (user_level) {
+      PrintUserLevelMessageToStream(&formatted, record.level, record.message);
+    } else {
+      PrintDebugLevelMessageToStream(&formatted, record);
+    }
+  }
+  (*output_stream_) << formatted.str();
   output_stream_->flush();
 }
 
@@ -15,7 +15,11 @@
 #ifndef BAZEL_SRC_MAIN_CPP_BAZEL_LOG_HANDLER_H_
 #define BAZEL_SRC_MAIN_CPP_BAZEL_LOG_HANDLER_H_
 
+#include <chrono>  // NOLINT -- for windows portability
 #include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include "src/main/cpp/util/logging.h"
 
@@ -26,6 +30,12 @@ namespace blaze_util {
 // startup, logs are buffered until SetOutputStream is called. At that point,
 // all past log statements are dumped in the appropriate stream, and all
 // following statements are logged directly.
+//
+// Messages are only formatted once it is known where they go. Those logged to
+// stderr are handed to a thread that writes them out, through a fixed-size
+// lock-free queue, so that logging at high verbosity does not distort the
+// timings of the client. They are all written out when the handler is
+// destroyed, before a FATAL message exits, and by Flush().
 class BazelLogHandler : public blaze_util::LogHandler {
  public:
   BazelLogHandler();
@@ -37,19 +47,35 @@ class BazelLogHandler : public blaze_util::LogHandler {
   void SetOutputStream(
       std::unique_ptr<std::ostream> new_output_stream) override;
   void SetOutputStreamToStderr() override;
+  // Writes out the queued messages and stops the writer thread. The messages
+  // logged afterwards are written synchronously.
+  void Flush() override;
+
+  // A log message, as it was logged.
+  struct Record {
+    LogLevel level;
+    std::chrono::steady_clock::time_point time;
+    std::string filename;
+    int line;
+    std::string message;
+  };
 
  private:
-  void FlushBufferToNewStreamAndSet(std::stringstream* buffer,
+  class AsyncWriter;
+
+  void FlushBufferToNewStreamAndSet(bool user_level,
                                     std::ostream* new_output_stream);
   bool output_stream_set_;
   bool logging_deactivated_;
-  std::unique_ptr<std::stringstream> user_buffer_stream_;
-  std::unique_ptr<std::stringstream> debug_buffer_stream_;
+  // The messages logged before the output stream is set.
+  std::unique_ptr<std::vector<Record>> buffer_;
   // The actual output_stream to which all logs will be sent.
   std::ostream* output_stream_;
   // A unique pts to the output_stream, if we need to keep ownership of the
   // stream. In the case of stderr logging, this is null.
   std::unique_ptr<std::ostream> owned_output_stream_;
+  // Writes the messages to output_stream_ when it is stderr, or null.
+  std::unique_ptr<AsyncWriter> async_writer_;
 };
 }  // namespace blaze_util
 
@@ -17,7 +17,11 @@
 #include <limits.h>  // PATH_MAX
 
 #include <algorithm>
+#include <condition_variable>  // NOLINT
 #include <cstdlib>
+#include <iterator>
+#include <mutex>   // NOLINT
+#include <thread>  // NOLINT
 #include <vector>
 
 #include "src/main/cpp/util/errors.h"
@@ -93,25 +97,89 @@ bool WriteFile(const std::string &content, const Path &path,
   return WriteFile(content.c_str(), content.size(), path, perm);
 }
 
-class DirectoryTreeWalker : public DirectoryEntryConsumer {
+// Lists a tree on up to kWalkThreads threads. Each thread lists one directory
+// at a time, and queues the subdirectories it finds for whichever thread is
+// free next.
+class DirectoryTreeWalker {
  public:
-  DirectoryTreeWalker(vector<string> *files,
-                      _ForEachDirectoryEntry walk_entries)
-      : _files(files), _walk_entries(walk_entries) {}
-
-  void Consume(const string &path, bool follow_directory) override {
-    if (follow_directory) {
-      Walk(path);
-    } else {
-      _files->push_back(path);
+  explicit DirectoryTreeWalker(_ForEachDirectoryEntry walk_entries)
+      : _walk_entries(walk_entries), _busy(0) {}
+
+  void Walk(const string &path, vector<string> *files) {
+    // Most trees are small: only list them in parallel if there is more than
+    // the top directory to list.
+    Lister lister;
+    _walk_entries(path, &lister);
+    files->insert(files->end(), std::make_move_iterator(lister.files.begin()),
+                  std::make_move_iterator(lister.files.end()));
+    if (lister.directories.empty()) {
+      return;
+    }
+    _pending = std::move(lister.directories);
+
+    size_t threads = std::min<size_t>(
+        kWalkThreads,
+        std::max<unsigned>(1, std::thread::hardware_concurrency()));
+    vector<std::thread> workers;
+    for (size_t i = 1; i < threads; ++i) {
+      workers.emplace_back(&DirectoryTreeWalker::Work, this, files);
+    }
+    Work(files);
+    for (std::thread &worker : workers) {
+      worker.join();
     }
   }
 
-  void Walk(const string &path) { _walk_entries(path, this); }
-
  private:
-  vector<string> *_files;
+  static constexpr size_t kWalkThreads = 8;
+
+  class Lister : public DirectoryEntryConsumer {
+   public:
+    void Consume(const string &path, bool is_directory) override {
+      (is_directory ? directories : files).push_back(path);
+    }
+
+    vector<string> files;
+    vector<string> directories;
+  };
+
+  void Work(vector<string> *files) {
+    Lister lister;
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+      // Wait for a directory to list, or for the others to be done.
+      _cond.wait(lock, [this] { return !_pending.empty() || _busy == 0; });
+      if (_pending.empty()) {
+        break;
+      }
+      // Last in, first out, so that the queue stays as short as the tree is
+      // deep rather than as it is wide.
+      string dir = std::move(_pending.back());
+      _pending.pop_back();
+      _busy++;
+      lock.unlock();
+
+      lister.directories.clear();
+      _walk_entries(dir, &lister);
+
+      lock.lock();
+      _busy--;
+      for (string &subdir : lister.directories) {
+        _pending.push_back(std::move(subdir));
+      }
+      if (!lister.directories.empty() || _busy == 0) {
+        _cond.notify_all();
+      }
+    }
+    files->insert(files->end(), std::make_move_iterator(lister.files.begin()),
+                  std::make_move_iterator(lister.files.end()));
+  }
+
   _ForEachDirectoryEntry _walk_entries;
+  std::mutex _mutex;
+  std::condition_variable _cond;
+  vector<string> _pending;
+  size_t _busy;
 };
 
 void GetAllFilesUnder(const string &path, vector<string> *result) {
@@ -121,7 +189,7 @@ void GetAllFilesUnder(const string &path, vector<string> *result) {
 void _GetAllFilesUnder(const string &path,
                        vector<string> *result,
                        _ForEachDirectoryEntry walk_entries) {
-  DirectoryTreeWalker(result, walk_entries).Walk(path);
+  DirectoryTreeWalker(walk_entries).Walk(path, result);
 }
 
 }  // namespace blaze_util
@@ -70,9 +70,9 @@ bool WriteFile(const std::string &content, const Path &path,
 //
 // Does not follow symlinks / junctions.
 //
-// Populates `result` with the full paths of the files. Every entry will have
-// `path` as its prefix. If `path` is a file, `result` contains just this
-// file.
+// Populates `result` with the full paths of the files, in no particular order:
+// the subdirectories are listed in parallel. Every entry will have `path` as
+// its prefix. If `path` is a file, `result` contains just this file.
 void GetAllFilesUnder(const std::string &path,
                       std::vector<std::string> *result);
 
@@ -59,6 +59,10 @@ class IFileMtime {
   // a decade.
   // Returns true if the mtime was changed successfully.
   virtual bool SetToDistantFuture(const Path &path) = 0;
+
+  // Stores the mtime of `path` in milliseconds since the epoch in `result`.
+  // Returns false if querying the information failed.
+  virtual bool GetMillisSinceEpoch(const Path &path, uint64_t *result) = 0;
 };
 
 // Creates a platform-specific implementation of `IFileMtime`.
@@ -196,11 +200,24 @@ bool CanAccessDirectory(const Path &path);
 bool IsDirectory(const std::string& path);
 bool IsDirectory(const Path &path);
 
+// Returns the index of the first of `names` that exists in `directory` and is
+// not a directory, following symlinks, or -1 if there is none. Same as
+// checking PathExists() and !IsDirectory() for each of them, but on POSIX,
+// the names are looked up relative to the directory, with one stat each.
+int FindNonDirectory(const std::string &directory,
+                     const std::vector<std::string> &names);
+
 // Calls fsync() on the file (or directory) specified in 'file_path'.
 // pdie() if syncing fails.
 void SyncFile(const std::string& path);
 void SyncFile(const Path &path);
 
+// Flushes all pending writes to the file system containing 'path' with a
+// single syncfs() call, which is much cheaper than syncing every file of a
+// large tree one by one. Returns false (and sets errno) if the platform has no
+// such call or it fails; callers should then fall back to SyncFile.
+bool SyncFileSystem(const Path &path);
+
 // mkdir -p path. All newly created directories use the given mode.
 // `mode` should be an octal permission mask, e.g. 0755.
 // Returns false on failure, sets errno.
@@ -216,6 +233,10 @@ std::string CreateTempDir(const std::string &prefix);
 // (including if the path didn't exist to begin with). Does not follow symlinks.
 bool RemoveRecursively(const std::string &path);
 
+// Like RemoveRecursively, but also removes what is in directories that were
+// made read-only, like the ones Bazel leaves in an output base.
+bool ForceRemoveRecursively(const std::string &path);
+
 // Returns the current working directory.
 // The path is platform-specific (e.g. Windows path of Windows) and absolute.
 std::string GetCwd();
@@ -267,9 +288,9 @@ class DirectoryEntryConsumerW {
 //
 // Does not follow symlinks / junctions.
 //
-// Populates `result` with the full paths of the files. Every entry will have
-// `path` as its prefix. If `path` is a file, `result` contains just this
-// file.
+// Populates `result` with the full paths of the files, in no particular order:
+// the subdirectories are listed in parallel. Every entry will have `path` as
+// its prefix. If `path` is a file, `result` contains just this file.
 void GetAllFilesUnderW(const std::wstring &path,
                        std::vector<std::wstring> *result);
 
@@ -21,7 +21,7 @@
 #include <stdlib.h>  // getenv
 #include <string.h>  // strncmp
 #include <sys/stat.h>
-#include <unistd.h>  // access, open, close, fsync
+#include <unistd.h>  // access, open, close, fsync, syncfs
 #include <utime.h>   // utime
 
 #include <string>
@@ -151,9 +151,17 @@ string CreateTempDir(const std::string &prefix) {
   return result;
 }
 
-static bool RemoveDirRecursively(const std::string &path) {
-  DIR *dir;
-  if ((dir = opendir(path.c_str())) == nullptr) {
+// Removes what is in the directory open as `dirfd`, and closes it. With
+// `force`, a directory that is not writable is made writable first.
+static bool RemoveDirContents(int dirfd, bool force) {
+  struct stat dir_stat;
+  if (force && fstat(dirfd, &dir_stat) == 0 &&
+      (dir_stat.st_mode & S_IRWXU) != S_IRWXU) {
+    fchmod(dirfd, dir_stat.st_mode | S_IRWXU);
+  }
+  DIR *dir = fdopendir(dirfd);
+  if (dir == nullptr) {
+    close(dirfd);
     return false;
   }
 
@@ -163,20 +171,53 @@ static bool RemoveDirRecursively(const std::string &path) {
       continue;
     }
 
-    if (!RemoveRecursively(blaze_util::JoinPath(path, ent->d_name))) {
+    bool is_directory;
+#ifdef _DIRENT_HAVE_D_TYPE
+    if (ent->d_type != DT_UNKNOWN) {
+      is_directory = (ent->d_type == DT_DIR);
+    } else  // NOLINT (the brace is on the next line)
+#endif
+    {
+      struct stat buf;
+      if (fstatat(dirfd, ent->d_name, &buf, AT_SYMLINK_NOFOLLOW) == -1) {
+        if (errno == ENOENT) {
+          continue;
+        }
+        closedir(dir);
+        return false;
+      }
+      is_directory = S_ISDIR(buf.st_mode);
+    }
+
+    if (is_directory) {
+      int fd = openat(dirfd, ent->d_name,
+                      O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+      if (fd == -1 || !RemoveDirContents(fd, force)) {
+        closedir(dir);
+        return false;
+      }
+    }
+    if (unlinkat(dirfd, ent->d_name, is_directory ? AT_REMOVEDIR : 0) == -1 &&
+        errno != ENOENT) {
       closedir(dir);
       return false;
     }
   }
 
-  if (closedir(dir) != 0) {
+  return closedir(dir) == 0;
+}
+
+// Removes the directory and what is in it. The entries are opened and removed
+// relative to their directory, so each takes no lookup of its full path.
+static bool RemoveDirRecursively(const std::string &path, bool force) {
+  int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd == -1 || !RemoveDirContents(fd, force)) {
     return false;
   }
-
   return rmdir(path.c_str()) == 0;
 }
 
-bool RemoveRecursively(const std::string &path) {
+static bool RemoveRecursively(const std::string &path, bool force) {
   struct stat stat_buf;
   if (lstat(path.c_str(), &stat_buf) == -1) {
     // Non-existent is good enough.
@@ -184,12 +225,20 @@ bool RemoveRecursively(const std::string &path) {
   }
 
   if (S_ISDIR(stat_buf.st_mode) && !S_ISLNK(stat_buf.st_mode)) {
-    return RemoveDirRecursively(path);
+    return RemoveDirRecursively(path, force);
   } else {
     return UnlinkPath(path);
   }
 }
 
+bool RemoveRecursively(const std::string &path) {
+  return RemoveRecursively(path, false);
+}
+
+bool ForceRemoveRecursively(const std::string &path) {
+  return RemoveRecursively(path, true);
+}
+
 class PosixPipe : public IPipe {
  public:
   PosixPipe(int recv_socket, int send_socket)
@@ -430,6 +479,32 @@ bool IsDirectory(const string& path) {
 
 bool IsDirectory(const Path &path) { return IsDirectory(path.AsNativePath()); }
 
+int FindNonDirectory(const string &directory,
+                     const std::vector<string> &names) {
+  // With a descriptor of the directory, the kernel only has to resolve the
+  // names themselves rather than the whole path each time. Without one
+  // (e.g. the directory is not readable), do the same by path.
+#ifdef O_PATH
+  int dir_fd = open(directory.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+#else
+  int dir_fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+#endif
+  int found = -1;
+  for (size_t i = 0; i < names.size() && found < 0; ++i) {
+    struct stat buf;
+    int result = dir_fd >= 0
+                     ? fstatat(dir_fd, names[i].c_str(), &buf, 0)
+                     : stat(JoinPath(directory, names[i]).c_str(), &buf);
+    if (result == 0 && !S_ISDIR(buf.st_mode)) {
+      found = static_cast<int>(i);
+    }
+  }
+  if (dir_fd >= 0) {
+    close(dir_fd);
+  }
+  return found;
+}
+
 void SyncFile(const string& path) {
   const char* file_path = path.c_str();
   int fd = open(file_path, O_RDONLY);
@@ -447,6 +522,24 @@ void SyncFile(const string& path) {
 
 void SyncFile(const Path &path) { SyncFile(path.AsNativePath()); }
 
+bool SyncFileSystem(const Path &path) {
+#if defined(__linux__)
+  int fd = open(path.AsNativePath().c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  // Since Linux 5.8 syncfs() also reports writeback errors.
+  bool result = syncfs(fd) == 0;
+  int saved_errno = errno;
+  close(fd);
+  errno = saved_errno;
+  return result;
+#else
+  errno = ENOSYS;
+  return false;
+#endif
+}
+
 class PosixFileMtime : public IFileMtime {
  public:
   PosixFileMtime()
@@ -457,6 +550,7 @@ class PosixFileMtime : public IFileMtime {
   bool SetToNow(const Path &path) override;
   bool SetToNowIfPossible(const Path &path) override;
   bool SetToDistantFuture(const Path &path) override;
+  bool GetMillisSinceEpoch(const Path &path, uint64_t *result) override;
 
  private:
   // 9 years in the future.
@@ -506,6 +600,15 @@ bool PosixFileMtime::SetToDistantFuture(const Path &path) {
   return Set(path, distant_future_);
 }
 
+bool PosixFileMtime::GetMillisSinceEpoch(const Path &path, uint64_t *result) {
+  struct stat buf;
+  if (stat(path.AsNativePath().c_str(), &buf) || buf.st_mtime < 0) {
+    return false;
+  }
+  *result = static_cast<uint64_t>(buf.st_mtime) * 1000;
+  return true;
+}
+
 bool PosixFileMtime::Set(const Path &path, const struct utimbuf &mtime) {
   return utime(path.AsNativePath().c_str(), &mtime) == 0;
 }
@@ -554,20 +657,29 @@ bool ChangeDirectory(const string& path) {
 
 void ForEachDirectoryEntry(const string &path,
                            DirectoryEntryConsumer *consume) {
-  DIR *dir;
-  struct dirent *ent;
-
-  if ((dir = opendir(path.c_str())) == nullptr) {
+  int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd == -1) {
     // This is not a directory or it cannot be opened.
     return;
   }
+  DIR *dir = fdopendir(fd);
+  if (dir == nullptr) {
+    close(fd);
+    return;
+  }
 
+  // The full path of each entry is the same prefix and a different name: keep
+  // one buffer for all of them rather than joining the path for each.
+  string filename(blaze_util::JoinPath(path, "x"));
+  const size_t prefix = filename.size() - 1;
+  struct dirent *ent;
   while ((ent = readdir(dir)) != nullptr) {
     if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, "..")) {
       continue;
     }
 
-    string filename(blaze_util::JoinPath(path, ent->d_name));
+    filename.resize(prefix);
+    filename.append(ent->d_name);
     bool is_directory;
 // 'd_type' field isn't part of the POSIX spec.
 #ifdef _DIRENT_HAVE_D_TYPE
@@ -575,20 +687,20 @@ void ForEachDirectoryEntry(const string &path,
       is_directory = (ent->d_type == DT_DIR);
     } else  // NOLINT (the brace is on the next line)
 #endif
-      {
-        struct stat buf;
-        if (lstat(filename.c_str(), &buf) == -1) {
-          BAZEL_DIE(blaze_exit_code::INTERNAL_ERROR)
-              << "stat failed for filename '" << filename
-              << "': " << GetLastErrorString();
-        }
-        is_directory = S_ISDIR(buf.st_mode);
+    {
+      struct stat buf;
+      if (fstatat(fd, ent->d_name, &buf, AT_SYMLINK_NOFOLLOW) == -1) {
+        BAZEL_DIE(blaze_exit_code::INTERNAL_ERROR)
+            << "stat failed for filename '" << filename
+            << "': " << GetLastErrorString();
       }
+      is_directory = S_ISDIR(buf.st_mode);
+    }
 
-      consume->Consume(filename, is_directory);
+    consume->Consume(filename, is_directory);
   }
 
-    closedir(dir);
-  }
+  closedir(dir);
+}
 
 }  // namespace blaze_util
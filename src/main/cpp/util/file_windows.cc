@@ -19,9 +19,14 @@
 #include <wctype.h>  // iswalpha
 #include <windows.h>
 
+#include <algorithm>
+#include <condition_variable>  // NOLINT
+#include <iterator>
 #include <memory>  // unique_ptr
+#include <mutex>   // NOLINT
 #include <sstream>
 #include <string>
+#include <thread>  // NOLINT
 #include <vector>
 
 #include "src/main/cpp/util/errors.h"
@@ -117,6 +122,7 @@ class WindowsFileMtime : public IFileMtime {
   bool SetToNow(const Path& path) override;
   bool SetToNowIfPossible(const Path& path) override;
   bool SetToDistantFuture(const Path& path) override;
+  bool GetMillisSinceEpoch(const Path& path, uint64_t* result) override;
 
  private:
   // 9 years in the future.
@@ -197,6 +203,25 @@ bool WindowsFileMtime::SetToDistantFuture(const Path& path) {
   return Set(path, distant_future_);
 }
 
+bool WindowsFileMtime::GetMillisSinceEpoch(const Path& path,
+                                           uint64_t* result) {
+  WIN32_FILE_ATTRIBUTE_DATA info;
+  if (!::GetFileAttributesExW(path.AsNativePath().c_str(),
+                              GetFileExInfoStandard, &info)) {
+    return false;
+  }
+  ULARGE_INTEGER mtime;
+  mtime.LowPart = info.ftLastWriteTime.dwLowDateTime;
+  mtime.HighPart = info.ftLastWriteTime.dwHighDateTime;
+  // FILETIME counts 100ns intervals since 1601-01-01.
+  constexpr ULONGLONG kUnixEpoch = 116444736000000000ULL;
+  if (mtime.QuadPart < kUnixEpoch) {
+    return false;
+  }
+  *result = (mtime.QuadPart - kUnixEpoch) / 10000;
+  return true;
+}
+
 bool WindowsFileMtime::Set(const Path& path, FILETIME time) {
   AutoHandle handle(::CreateFileW(
       /* lpFileName */ path.AsNativePath().c_str(),
@@ -625,6 +650,16 @@ bool IsDirectory(const Path& path) {
   return IsDirectoryW(path.AsNativePath());
 }
 
+int FindNonDirectory(const string& directory, const vector<string>& names) {
+  for (size_t i = 0; i < names.size(); ++i) {
+    string path = JoinPath(directory, names[i]);
+    if (PathExists(path) && !IsDirectory(path)) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
 void SyncFile(const string& path) {
   // No-op on Windows native; unsupported by Cygwin.
   // fsync always fails on Cygwin with "Permission denied" for some reason.
@@ -632,6 +667,11 @@ void SyncFile(const string& path) {
 
 void SyncFile(const Path& path) {}
 
+bool SyncFileSystem(const Path& path) {
+  // Nothing to do, like SyncFile.
+  return true;
+}
+
 bool MakeDirectoriesW(const wstring& path, unsigned int mode) {
   if (path.empty()) {
     return false;
@@ -757,6 +797,12 @@ bool RemoveRecursively(const string& path) {
   return RemoveRecursivelyW(Path(path).AsNativePath());
 }
 
+bool ForceRemoveRecursively(const string& path) {
+  // The read-only attribute of a directory does not keep its entries from
+  // being removed on Windows.
+  return RemoveRecursivelyW(Path(path).AsNativePath());
+}
+
 static inline void ToLowerW(WCHAR* p) {
   while (*p) {
     *p++ = towlower(*p);
@@ -803,25 +849,92 @@ bool ChangeDirectory(const string& path) {
   return ::SetCurrentDirectoryA(spath.c_str()) == TRUE;
 }
 
-class DirectoryTreeWalkerW : public DirectoryEntryConsumerW {
+// Starts listing the directory `wpath`, which ends in a backslash. Asks for
+// the basic information only, which spares looking up the short names, and
+// for large fetches, which take fewer round trips to list a large directory.
+static HANDLE FindFirstEntry(const wstring& wpath, WIN32_FIND_DATAW* metadata) {
+  return ::FindFirstFileExW((wpath + L"*").c_str(), FindExInfoBasic, metadata,
+                            FindExSearchNameMatch, nullptr,
+                            FIND_FIRST_EX_LARGE_FETCH);
+}
+
+// Lists a tree on up to kWalkThreads threads, like DirectoryTreeWalker in
+// file.cc.
+class DirectoryTreeWalkerW {
  public:
-  DirectoryTreeWalkerW(vector<wstring>* files,
-                       _ForEachDirectoryEntryW walk_entries)
-      : _files(files), _walk_entries(walk_entries) {}
-
-  void Consume(const wstring& path, bool follow_directory) override {
-    if (follow_directory) {
-      Walk(path);
-    } else {
-      _files->push_back(path);
+  explicit DirectoryTreeWalkerW(_ForEachDirectoryEntryW walk_entries)
+      : _walk_entries(walk_entries), _busy(0) {}
+
+  void Walk(const wstring& path, vector<wstring>* files) {
+    ListerW lister;
+    _walk_entries(path, &lister);
+    files->insert(files->end(), std::make_move_iterator(lister.files.begin()),
+                  std::make_move_iterator(lister.files.end()));
+    if (lister.directories.empty()) {
+      return;
+    }
+    _pending = std::move(lister.directories);
+
+    size_t threads = std::min<size_t>(
+        kWalkThreads,
+        std::max<unsigned>(1, std::thread::hardware_concurrency()));
+    vector<std::thread> workers;
+    for (size_t i = 1; i < threads; ++i) {
+      workers.emplace_back(&DirectoryTreeWalkerW::Work, this, files);
+    }
+    Work(files);
+    for (std::thread& worker : workers) {
+      worker.join();
     }
   }
 
-  void Walk(const wstring& path) { _walk_entries(path, this); }
-
  private:
-  vector<wstring>* _files;
+  static constexpr size_t kWalkThreads = 8;
+
+  class ListerW : public DirectoryEntryConsumerW {
+   public:
+    void Consume(const wstring& path, bool is_directory) override {
+      (is_directory ? directories : files).push_back(path);
+    }
+
+    vector<wstring> files;
+    vector<wstring> directories;
+  };
+
+  void Work(vector<wstring>* files) {
+    ListerW lister;
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+      _cond.wait(lock, [this] { return !_pending.empty() || _busy == 0; });
+      if (_pending.empty()) {
+        break;
+      }
+      wstring dir = std::move(_pending.back());
+      _pending.pop_back();
+      _busy++;
+      lock.unlock();
+
+      lister.directories.clear();
+      _walk_entries(dir, &lister);
+
+      lock.lock();
+      _busy--;
+      for (wstring& subdir : lister.directories) {
+        _pending.push_back(std::move(subdir));
+      }
+      if (!lister.directories.empty() || _busy == 0) {
+        _cond.notify_all();
+      }
+    }
+    files->insert(files->end(), std::make_move_iterator(lister.files.begin()),
+                  std::make_move_iterator(lister.files.end()));
+  }
+
   _ForEachDirectoryEntryW _walk_entries;
+  std::mutex _mutex;
+  std::condition_variable _cond;
+  vector<wstring> _pending;
+  size_t _busy;
 };
 
 void ForEachDirectoryEntryW(const wstring& path,
@@ -850,15 +963,19 @@ void ForEachDirectoryEntryW(const wstring& path,
   // normalized (see NormalizeWindowsPath).
   wpath.append(L"\\");
   WIN32_FIND_DATAW metadata;
-  HANDLE handle = ::FindFirstFileW((wpath + L"*").c_str(), &metadata);
+  HANDLE handle = FindFirstEntry(wpath, &metadata);
   if (handle == INVALID_HANDLE_VALUE) {
     return;  // directory does not exist or is empty
   }
 
+  // The names of the entries all have the same prefix: keep one buffer for
+  // all of them.
+  wstring name(/* omit prefix */ 4 + wpath.c_str());
+  const size_t prefix = name.size();
   do {
     if (kDot != metadata.cFileName && kDotDot != metadata.cFileName) {
-      wstring wname = wpath + metadata.cFileName;
-      wstring name(/* omit prefix */ 4 + wname.c_str());
+      name.resize(prefix);
+      name.append(metadata.cFileName);
       bool is_dir = (metadata.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
       bool is_junc =
           (metadata.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
@@ -874,7 +991,7 @@ void GetAllFilesUnderW(const wstring& path, vector<wstring>* result) {
 
 void _GetAllFilesUnderW(const wstring& path, vector<wstring>* result,
                         _ForEachDirectoryEntryW walk_entries) {
-  DirectoryTreeWalkerW(result, walk_entries).Walk(path);
+  DirectoryTreeWalkerW(walk_entries).Walk(path, result);
 }
 
 void ForEachDirectoryEntry(const string &path,
@@ -902,14 +1019,17 @@ void ForEachDirectoryEntry(const string &path,
   // normalized (see NormalizeWindowsPath).
   wpath.append(L"\\");
   WIN32_FIND_DATAW metadata;
-  HANDLE handle = ::FindFirstFileW((wpath + L"*").c_str(), &metadata);
+  HANDLE handle = FindFirstEntry(wpath, &metadata);
   if (handle == INVALID_HANDLE_VALUE) {
     return;  // directory does not exist or is empty
   }
 
+  wstring wname(wpath);
+  const size_t prefix = wname.size();
   do {
     if (kDot != metadata.cFileName && kDotDot != metadata.cFileName) {
-      wstring wname = wpath + metadata.cFileName;
+      wname.resize(prefix);
+      wname.append(metadata.cFileName);
       string name(WstringToCstring(/* omit prefix */ 4 + wname.c_str()));
       bool is_dir = (metadata.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
       bool is_junc =
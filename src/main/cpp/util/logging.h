@@ -154,6 +154,10 @@ class LogHandler {
 
   virtual void SetOutputStream(std::unique_ptr<std::ostream> output_stream) = 0;
   virtual void SetOutputStreamToStderr() = 0;
+
+  // Writes out the messages that the handler has not written yet. Messages
+  // logged afterwards may be written synchronously.
+  virtual void Flush() {}
 };
 
 // Sets the log handler that routes all log messages.
@@ -165,6 +169,10 @@ void SetLogHandler(std::unique_ptr<LogHandler> new_handler);
 void SetLoggingOutputStream(std::unique_ptr<std::ostream> output_stream);
 void SetLoggingOutputStreamToStderr();
 
+// Writes out the messages logged so far, for when the process is about to be
+// replaced or to exit without running destructors.
+void FlushLogging();
+
 }  // namespace blaze_util
 
 #endif  // BAZEL_SRC_MAIN_CPP_LOGGING_H_
@@ -38,6 +38,12 @@ namespace blaze_util {
 // The <code>Context</code> class performs the actual MD5
 // computation. It works incrementally and can be fed a single byte at
 // a time if desired.
+//
+// The client only digests short strings with it (workspace paths for the
+// names of output bases, rc file keys), so its speed does not matter; the
+// install base key is computed when the binary is built. Output base names
+// are derived from MD5 digests and existing ones must keep their names, so
+// there is no reason to move these uses to another digest.
 class Md5Digest {
  public:
   Md5Digest();
@@ -323,15 +323,27 @@ static bool AsAbsoluteWindowsPathImpl(const std::wstring& path,
   if (!AsWindowsPath(path, result, error)) {
     return false;
   }
-  if (!IsRootOrAbsolute(*result, /* must_be_root */ false)) {
-    if (result->empty() || (result->size() == 1 && (*result)[0] == '.')) {
-      *result = GetCwdW();
-    } else {
-      *result = GetCwdW() + L"\\" + *result;
-    }
+  if (IsRootOrAbsolute(*result, /* must_be_root */ false) &&
+      !HasUncPrefix(result->c_str())) {
+    // AsWindowsPath normalized it already.
+    result->insert(0, L"\\\\?\\");
+    return true;
+  }
+  std::wstring joined;
+  if (IsRootOrAbsolute(*result, /* must_be_root */ false)) {
+    joined.swap(*result);
+  } else if (result->empty() ||
+             (result->size() == 1 && (*result)[0] == '.')) {
+    joined = GetCwdW();
+  } else {
+    joined = GetCwdW() + L"\\" + *result;
   }
 
-  *result = std::wstring(L"\\\\?\\") + bazel::windows::Normalize(*result);
+  // Normalizes straight into the result, after its "\\?\" prefix.
+  result->assign(joined.size() + 6, 0);
+  result->replace(0, 4, L"\\\\?\\");
+  result->resize(4 + bazel::windows::NormalizeTo(joined.c_str(), joined.size(),
+                                                 &(*result)[4]));
   return true;
 }
 
@@ -0,0 +1,48 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_MAIN_CPP_UTIL_PROBE_H_
+#define BAZEL_SRC_MAIN_CPP_UTIL_PROBE_H_
+
+// BAZEL_PROBE(provider, name, args...) marks a point of interest of a tool
+// with a statically defined tracing probe (USDT), such as
+//
+//   BAZEL_PROBE(singlejar, add_jar_begin, path, index);
+//
+// which can be traced in a running tool with, e.g.,
+//
+//   bpftrace -e 'usdt:/path/to/singlejar:singlejar:add_jar_begin {
+//                  printf("%s\n", str(arg0)); }'
+//
+// A probe is a single nop in the code, and a note in the binary saying where
+// it is and where its up to 12 integer or pointer arguments are, so it costs
+// nothing until a tracer attaches to it. Probes are compiled in where the
+// SystemTap headers (<sys/sdt.h>, in systemtap-sdt-dev or
+// systemtap-sdt-devel) are installed, and compile to nothing otherwise, and on
+// other platforms than Linux. The arguments are then not evaluated.
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define BAZEL_HAVE_PROBES 1
+#endif
+#endif
+
+#ifdef BAZEL_HAVE_PROBES
+#include <sys/sdt.h>
+#define BAZEL_PROBE(...) STAP_PROBEV(__VA_ARGS__)
+#else
+#define BAZEL_PROBE(...) ((void)0)
+#endif
+
+#endif  // BAZEL_SRC_MAIN_CPP_UTIL_PROBE_H_
@@ -241,6 +241,169 @@ void Tokenize(const string &str, const char &comment, vector<string> *words) {
   }
 }
 
+// A line continuation is a '\\' and a newline, with the continuations of
+// "\\\r\n" lines in between, if any: this is what joining the "\\\r\n"
+// lines first and then the "\\\n" lines leaves of them, which is how lines
+// used to be joined.
+
+size_t LineTokenizer::SkipContinuations(size_t pos) const {
+  while (pos + 1 < end_ && contents_[pos] == '\\') {
+    if (pos + 2 < end_ && contents_.compare(pos + 1, 2, "\r\n") == 0) {
+      pos += 3;
+      continue;
+    }
+    size_t next = pos + 1;
+    while (next + 2 < end_ && contents_.compare(next, 3, "\\\r\n") == 0) {
+      next += 3;
+    }
+    if (next == end_ || contents_[next] != '\n') {
+      break;
+    }
+    pos = next + 1;
+  }
+  return pos;
+}
+
+size_t LineTokenizer::ContinuationStart(size_t newline) const {
+  if (newline >= 2 && contents_.compare(newline - 2, 2, "\\\r") == 0) {
+    return newline - 2;
+  }
+  size_t pos = newline;
+  while (pos >= 3 && contents_.compare(pos - 3, 3, "\\\r\n") == 0) {
+    pos -= 3;
+  }
+  if (pos >= 1 && contents_[pos - 1] == '\\') {
+    return pos - 1;
+  }
+  return std::string_view::npos;
+}
+
+size_t LineTokenizer::EndOfLine(size_t pos) const {
+  for (;;) {
+    size_t newline = contents_.find('\n', pos);
+    if (newline == std::string_view::npos) {
+      return contents_.size();
+    }
+    if (ContinuationStart(newline) == std::string_view::npos) {
+      return newline;
+    }
+    pos = newline + 1;
+  }
+}
+
+bool LineTokenizer::ReadWord(string *word) {
+  char quote = '\0';
+  for (;;) {
+    // Append the characters that need no handling in one go.
+    size_t start = pos_;
+    while (pos_ < end_) {
+      char c = contents_[pos_];
+      if (c == '\\' ||
+          (quote ? c == quote
+                 : c == comment_ || c == '\'' || c == '"' ||
+                       strchr(kSeparator, c) != nullptr)) {
+        break;
+      }
+      ++pos_;
+    }
+    word->append(contents_.data() + start, pos_ - start);
+    if (pos_ == end_) {
+      return false;
+    }
+
+    char c = contents_[pos_];
+    if (c == '\\') {
+      size_t next = SkipContinuations(pos_);
+      if (next == pos_) {
+        // Absorb the escape.
+        next = SkipContinuations(pos_ + 1);
+        if (next == end_) {
+          pos_ = next;
+          return false;
+        }
+        word->push_back(contents_[next++]);
+      }
+      pos_ = next;
+    } else if (quote) {
+      // Absorb the closing quote.
+      quote = '\0';
+      ++pos_;
+    } else if (c == comment_) {
+      pos_ = end_;
+      return true;
+    } else if (c == '\'' || c == '"') {
+      // Absorb the opening quote.
+      quote = c;
+      ++pos_;
+    } else {
+      return false;
+    }
+  }
+}
+
+bool LineTokenizer::Next(vector<string> *words) {
+  assert(words);
+  while (next_line_ < contents_.size()) {
+    line_start_ = next_line_;
+    line_end_ = EndOfLine(line_start_);
+    next_line_ = line_end_ + 1;
+
+    // Strip the whitespace off both ends of the line, as it reads once its
+    // continuations are joined.
+    end_ = line_end_;
+    while (end_ > line_start_) {
+      char c = contents_[end_ - 1];
+      if (c == '\n') {
+        // Only a continuation can end a line with a newline.
+        end_ = ContinuationStart(end_ - 1);
+      } else if (ascii_isspace(c)) {
+        --end_;
+      } else {
+        break;
+      }
+    }
+    pos_ = line_start_;
+    for (;;) {
+      pos_ = SkipContinuations(pos_);
+      if (pos_ == end_ || !ascii_isspace(contents_[pos_])) {
+        break;
+      }
+      ++pos_;
+    }
+
+    size_t count = 0;
+    while (pos_ < end_) {
+      char c = contents_[pos_];
+      if (strchr(kSeparator, c) != nullptr) {
+        pos_ = SkipContinuations(pos_ + 1);
+        continue;
+      }
+      if (c == comment_) {
+        break;
+      }
+      // Reuse the strings of the previous lines.
+      if (count == words->size()) {
+        words->emplace_back();
+      } else {
+        (*words)[count].clear();
+      }
+      bool comment = ReadWord(&(*words)[count]);
+      if (!(*words)[count].empty()) {
+        ++count;
+      }
+      if (comment) {
+        break;
+      }
+    }
+    if (count > 0) {
+      words->resize(count);
+      return true;
+    }
+  }
+  words->clear();
+  return false;
+}
+
 // Evaluate a format string and store the result in 'str'.
 void StringPrintf(string *str, const char *format, ...) {
   assert(str);
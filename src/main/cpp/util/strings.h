@@ -16,6 +16,7 @@
 
 #include <memory>  // unique_ptr
 #include <string>
+#include <string_view>
 #include <vector>
 
 #ifdef BLAZE_OPENSOURCE
@@ -113,6 +114,56 @@ void StripWhitespace(std::string *str);
 void Tokenize(const std::string &str, const char &comment,
               std::vector<std::string> *words);
 
+// Tokenizes the lines of a text one after the other, like Tokenize() does, in
+// a single pass that copies nothing but the words, and into the same strings
+// from one line to the next:
+//
+//   LineTokenizer lines(contents, '#');
+//   std::vector<std::string> words;
+//   while (lines.Next(&words)) {
+//     ...
+//   }
+//
+// A '\' right before the end of a line ("\n" or "\r\n") continues the line
+// on the next one. Quotes do not span lines. The text must outlive the
+// tokenizer.
+class LineTokenizer {
+ public:
+  LineTokenizer(std::string_view contents, char comment)
+      : contents_(contents), comment_(comment) {}
+
+  // Replaces `words` with the words of the next line that has any and returns
+  // true, or returns false if there is no such line.
+  bool Next(std::vector<std::string> *words);
+
+  // The line that Next() last returned the words of, continuations included.
+  std::string_view line() const {
+    return contents_.substr(line_start_, line_end_ - line_start_);
+  }
+
+ private:
+  // Returns `pos`, or the position after the line continuations at it.
+  size_t SkipContinuations(size_t pos) const;
+  // Returns where the line continuation that ends with the newline at
+  // `newline` starts, or npos if that newline ends a line.
+  size_t ContinuationStart(size_t newline) const;
+  // Returns the position of the end of the line that `pos` is in.
+  size_t EndOfLine(size_t pos) const;
+  // Appends the word at pos_ to `word`, and returns whether it ended with a
+  // comment.
+  bool ReadWord(std::string *word);
+
+  std::string_view contents_;
+  char comment_;
+  // The current line, and where its text ends once stripped of whitespace.
+  size_t line_start_ = 0;
+  size_t line_end_ = 0;
+  size_t end_ = 0;
+  // The position being read in the current line, and the start of the next.
+  size_t pos_ = 0;
+  size_t next_line_ = 0;
+};
+
 // Evaluate a format string and store the result in 'str'.
 void StringPrintf(std::string *str, const char *format, ...);
 
@@ -0,0 +1,190 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/cpp/util/task_pool.h"
+
+#include <algorithm>
+
+namespace blaze_util {
+
+namespace {
+
+// The pool whose thread this is, and the index of the thread's queue.
+thread_local const TaskPool *current_pool = nullptr;
+thread_local size_t current_queue = 0;
+
+}  // namespace
+
+TaskPool::TaskPool(int threads) : queued_(0), idle_(0), started_(0) {
+  for (int i = 0; i <= std::max(threads, 0); ++i) {
+    queues_.emplace_back(new Queue());
+  }
+}
+
+TaskPool::~TaskPool() {
+  while (RunOne()) {
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  work_available_.notify_all();
+  for (std::thread &worker : workers_) {
+    worker.join();
+  }
+}
+
+size_t TaskPool::QueueOfCaller() const {
+  return current_pool == this ? current_queue : queues_.size() - 1;
+}
+
+void TaskPool::Run(Task task) {
+  // Counted first, so that the count is never below that of the tasks
+  // taken.
+  queued_++;
+  Queue *queue = queues_[QueueOfCaller()].get();
+  {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    queue->tasks.push_back(std::move(task));
+  }
+  // A thread that is going idle counts itself before it looks at queued_
+  // one last time, so either it sees the task or it is woken up here.
+  if (idle_ > 0) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    work_available_.notify_one();
+  } else if (started_ < threads()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!stopping_ && workers_.size() < static_cast<size_t>(threads())) {
+      workers_.emplace_back(&TaskPool::WorkLoop, this, workers_.size());
+      started_++;
+    }
+  }
+}
+
+bool TaskPool::RunOne() {
+  Task task;
+  if (!Take(QueueOfCaller(), &task)) {
+    return false;
+  }
+  task();
+  return true;
+}
+
+bool TaskPool::Take(size_t own, Task *task) {
+  if (queued_ == 0) {
+    return false;
+  }
+  const size_t external = queues_.size() - 1;
+  if (own != external) {
+    Queue *queue = queues_[own].get();
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    if (!queue->tasks.empty()) {
+      *task = std::move(queue->tasks.back());
+      queue->tasks.pop_back();
+      queued_--;
+      return true;
+    }
+  }
+  // Steal the oldest task, first of the tasks queued from outside, then of
+  // the next threads.
+  for (size_t i = 0; i < queues_.size(); ++i) {
+    size_t victim = (external + own + i) % queues_.size();
+    if (victim == own && own != external) {
+      continue;
+    }
+    Queue *queue = queues_[victim].get();
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    if (!queue->tasks.empty()) {
+      *task = std::move(queue->tasks.front());
+      queue->tasks.pop_front();
+      queued_--;
+      return true;
+    }
+  }
+  return false;
+}
+
+void TaskPool::WorkLoop(size_t own) {
+  current_pool = this;
+  current_queue = own;
+  for (;;) {
+    Task task;
+    if (Take(own, &task)) {
+      task();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_++;
+    work_available_.wait(lock, [this] { return stopping_ || queued_ > 0; });
+    idle_--;
+    if (queued_ == 0) {
+      return;
+    }
+  }
+}
+
+void TaskGroup::Run(TaskPool::Task task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_++;
+  }
+  pool_->Run([this, task = std::move(task)]() {
+    task();
+    // The last task notifies under the lock, so that Wait() cannot return,
+    // and the group go away, before it is done with it.
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--pending_ == 0) {
+      done_.notify_all();
+    }
+  });
+}
+
+void TaskGroup::Wait() {
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (pending_ == 0) {
+        return;
+      }
+    }
+    if (!pool_->RunOne()) {
+      // The remaining tasks are running on other threads. The tasks they
+      // add are usually run by those threads, but may be left for us
+      // where they run on a thread that is not the pool's.
+      std::unique_lock<std::mutex> lock(mutex_);
+      done_.wait_for(lock, kHelpInterval, [this] { return pending_ == 0; });
+    }
+  }
+}
+
+void ParallelFor(TaskPool *pool, size_t count,
+                 const std::function<void(size_t)> &fn) {
+  std::atomic<size_t> next(0);
+  auto loop = [&next, count, &fn]() {
+    size_t i;
+    while ((i = next++) < count) {
+      fn(i);
+    }
+  };
+  TaskGroup group(pool);
+  const size_t tasks =
+      std::min(count, static_cast<size_t>(pool->threads()));
+  for (size_t i = 0; i < tasks; ++i) {
+    group.Run(loop);
+  }
+  loop();
+  group.Wait();
+}
+
+}  // namespace blaze_util
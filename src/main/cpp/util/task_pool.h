@@ -0,0 +1,226 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_MAIN_CPP_UTIL_TASK_POOL_H_
+#define BAZEL_SRC_MAIN_CPP_UTIL_TASK_POOL_H_
+
+#include <stddef.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace blaze_util {
+
+// How often the threads that wait for tasks look for queued tasks to run.
+// Usually the tasks they wait for are done before then.
+constexpr std::chrono::milliseconds kHelpInterval(10);
+
+// A pool of threads that run tasks, for the native tools that split their
+// work into many small pieces.
+//
+// Each thread has a queue of its own: the tasks that a task queues go to the
+// queue of its thread, which takes the newest of them first, so that a tree
+// of tasks is walked depth first and stays in the cache. Threads out of work
+// steal the oldest task of another queue, which tends to be the largest
+// piece of work. Tasks queued from other threads go to a queue of their own,
+// which the pool's threads steal from.
+//
+// The threads are started as the tasks come in, and only while none of the
+// started ones is idle, so a pool that is only given a few tasks costs
+// little more than running them. The threads that wait for tasks, in
+// TaskGroup::Wait() and OrderedResults, run queued tasks meanwhile, so a pool
+// of N threads runs tasks on N + 1 threads, and a pool of no threads runs them
+// on the waiting thread alone.
+class TaskPool {
+ public:
+  using Task = std::function<void()>;
+
+  // Runs the tasks on up to `threads` threads.
+  explicit TaskPool(int threads);
+  // Runs the tasks that are still queued, then stops the threads.
+  ~TaskPool();
+
+  TaskPool(const TaskPool &) = delete;
+  TaskPool &operator=(const TaskPool &) = delete;
+
+  void Run(Task task);
+
+  // Runs a queued task on the calling thread. Returns false if there is
+  // none.
+  bool RunOne();
+
+  int threads() const { return static_cast<int>(queues_.size()) - 1; }
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  // The index of the calling thread's queue: that of the pool's thread, or
+  // that of the other threads.
+  size_t QueueOfCaller() const;
+  // Takes a task from the queue `own`, or steals one from the others.
+  bool Take(size_t own, Task *task);
+  void WorkLoop(size_t own);
+
+  // One queue for each thread, and the last one for the other threads.
+  std::vector<std::unique_ptr<Queue>> queues_;
+  // The number of tasks in the queues.
+  std::atomic<size_t> queued_;
+  // The number of threads waiting for tasks.
+  std::atomic<int> idle_;
+  // The number of threads started.
+  std::atomic<int> started_;
+
+  std::mutex mutex_;  // Guards workers_ and stopping_.
+  std::condition_variable work_available_;
+  std::vector<std::thread> workers_;
+  bool stopping_ = false;
+};
+
+// A set of tasks run on a pool, which can be waited for. The tasks may add
+// more tasks to the group.
+class TaskGroup {
+ public:
+  explicit TaskGroup(TaskPool *pool) : pool_(pool) {}
+  // Waits for the tasks.
+  ~TaskGroup() { Wait(); }
+
+  TaskGroup(const TaskGroup &) = delete;
+  TaskGroup &operator=(const TaskGroup &) = delete;
+
+  void Run(TaskPool::Task task);
+
+  // Waits until the tasks of the group are done, running queued tasks of the
+  // pool meanwhile.
+  void Wait();
+
+ private:
+  TaskPool *const pool_;
+  std::mutex mutex_;
+  std::condition_variable done_;
+  size_t pending_ = 0;  // Guarded by mutex_.
+};
+
+// Calls `fn` with each of 0 to `count` - 1 on the threads of `pool` and the
+// calling thread, and returns once all calls are done. The calls take the
+// next number as they finish, so that slow ones don't hold up the others.
+void ParallelFor(TaskPool *pool, size_t count,
+                 const std::function<void(size_t)> &fn);
+
+// Computes values on a pool and passes them on in the order they were added,
+// such as the entries of an output file that have to be written in the order
+// of the input. Results are passed to `consume` on the thread that adds the
+// values, as the oldest ones are done, and at most `max_pending` values are
+// computed ahead of them, so that the input can be read ahead of the output
+// without holding all of it in memory.
+template <typename T>
+class OrderedResults {
+ public:
+  OrderedResults(TaskPool *pool, size_t max_pending,
+                 std::function<void(T)> consume)
+      : pool_(pool), max_pending_(max_pending), consume_(std::move(consume)) {}
+  // Passes on the remaining values.
+  ~OrderedResults() { Finish(); }
+
+  OrderedResults(const OrderedResults &) = delete;
+  OrderedResults &operator=(const OrderedResults &) = delete;
+
+  // Adds the value that `compute` returns on the pool.
+  void Add(std::function<T()> compute) {
+    Slot *slot = NewSlot();
+    pool_->Run([this, slot, compute = std::move(compute)]() {
+      T value = compute();
+      std::lock_guard<std::mutex> lock(mutex_);
+      slot->value = std::move(value);
+      slot->done = true;
+      slot_done_.notify_all();
+    });
+    ConsumeDone(max_pending_);
+  }
+
+  // Adds a value that is known already, in its place between the computed
+  // ones.
+  void AddDone(T value) {
+    Slot *slot = NewSlot();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      slot->value = std::move(value);
+      slot->done = true;
+    }
+    ConsumeDone(max_pending_);
+  }
+
+  // Waits for the values added so far, and passes them on.
+  void Finish() { ConsumeDone(0); }
+
+ private:
+  struct Slot {
+    T value;
+    bool done = false;  // Guarded by mutex_.
+  };
+
+  Slot *NewSlot() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    slots_.emplace_back(new Slot());
+    return slots_.back().get();
+  }
+
+  // Passes on the values at the head that are done, waiting for the head to
+  // be done while more than `max_pending` values are not passed on yet.
+  void ConsumeDone(size_t max_pending) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!slots_.empty()) {
+      if (!slots_.front()->done) {
+        if (slots_.size() <= max_pending) {
+          return;
+        }
+        lock.unlock();
+        // Help with the values while waiting for the head.
+        const bool ran = pool_->RunOne();
+        lock.lock();
+        if (!ran) {
+          slot_done_.wait_for(lock, kHelpInterval,
+                              [this] { return slots_.front()->done; });
+        }
+        continue;
+      }
+      std::unique_ptr<Slot> slot = std::move(slots_.front());
+      slots_.pop_front();
+      lock.unlock();
+      consume_(std::move(slot->value));
+      lock.lock();
+    }
+  }
+
+  TaskPool *const pool_;
+  const size_t max_pending_;
+  const std::function<void(T)> consume_;
+  std::mutex mutex_;
+  std::condition_variable slot_done_;
+  std::deque<std::unique_ptr<Slot>> slots_;  // Not passed on yet.
+};
+
+}  // namespace blaze_util
+
+#endif  // BAZEL_SRC_MAIN_CPP_UTIL_TASK_POOL_H_
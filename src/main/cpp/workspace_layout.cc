@@ -32,14 +32,9 @@ string WorkspaceLayout::GetOutputRoot() const {
 }
 
 bool WorkspaceLayout::InWorkspace(const string &workspace) const {
-  for (auto boundaryFileName :
-       {"MODULE.bazel", "REPO.bazel", "WORKSPACE.bazel", "WORKSPACE"}) {
-    auto boundaryFilePath = blaze_util::JoinPath(workspace, boundaryFileName);
-    if (blaze_util::PathExists(boundaryFilePath) &&
-        !blaze_util::IsDirectory(boundaryFilePath))
-      return true;
-  }
-  return false;
+  static const vector<string> kBoundaryFileNames = {
+      "MODULE.bazel", "REPO.bazel", "WORKSPACE.bazel", "WORKSPACE"};
+  return blaze_util::FindNonDirectory(workspace, kBoundaryFileNames) >= 0;
 }
 
 string WorkspaceLayout::GetWorkspace(const string &cwd) const {
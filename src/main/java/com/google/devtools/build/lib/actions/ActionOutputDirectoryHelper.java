@@ -26,6 +26,7 @@ import java.io.IOException;
 import java.util.ArrayList;
 import java.util.Collection;
 import java.util.HashSet;
+import java.util.LinkedHashMap;
 import java.util.List;
 import java.util.Map;
 import java.util.Set;
@@ -140,12 +141,17 @@ public final class ActionOutputDirectoryHelper {
    * shared by multiple actions would only be created in the action filesystem for one of them.
    * Please use {@link #createActionFsOutputDirectories} instead.
    *
+   * <p>Directories that are not known yet and have the same closest known ancestor are created
+   * together, with {@link Path#createWritableDirectories}.
+   *
    * @throws CreateOutputDirectoryException if one of the output directories or one of its ancestor
    *     directories fails to be created
    */
   public void createOutputDirectories(Collection<Artifact> actionOutputs)
       throws CreateOutputDirectoryException {
-    Set<Path> done = new HashSet<>(); // avoid redundant calls for the same directory.
+    // The output directories to create, with the output roots that they are in. This also avoids
+    // redundant calls for the same directory.
+    Map<Path, Path> outputDirs = new LinkedHashMap<>();
     for (Artifact outputFile : actionOutputs) {
       Path outputDir;
       // Given we know that we are not using action file system, we can get safely get paths
@@ -156,8 +162,67 @@ public final class ActionOutputDirectoryHelper {
         outputDir = outputFile.getPath().getParentDirectory();
       }
 
-      if (done.add(outputDir)) {
-        createOutputDirectory(outputDir, outputFile.getRoot().getRoot().asPath());
+      outputDirs.putIfAbsent(outputDir, outputFile.getRoot().getRoot().asPath());
+    }
+
+    // The directories that are not known yet, by their closest known ancestor.
+    Map<Path, List<Path>> unknownDirs = new LinkedHashMap<>();
+    for (Map.Entry<Path, Path> entry : outputDirs.entrySet()) {
+      Path outputDir = entry.getKey();
+      Path rootPath = entry.getValue();
+      try {
+        createOutputRoot(rootPath);
+      } catch (IOException e) {
+        forceCreateDirectoryAndParents(outputDir, rootPath);
+        continue;
+      }
+      Path knownDir = outputDir;
+      while (!knownDir.equals(rootPath) && !knownDirectories.containsKey(knownDir.asFragment())) {
+        knownDir = knownDir.getParentDirectory();
+      }
+      if (!knownDir.equals(outputDir)) {
+        unknownDirs.computeIfAbsent(knownDir, k -> new ArrayList<>()).add(outputDir);
+      }
+    }
+
+    for (Map.Entry<Path, List<Path>> entry : unknownDirs.entrySet()) {
+      List<Path> dirs = entry.getValue();
+      if (dirs.size() == 1) {
+        createOutputDirectory(dirs.get(0), outputDirs.get(dirs.get(0)));
+      } else {
+        createOutputDirectoriesBelow(entry.getKey(), dirs, outputDirs);
+      }
+    }
+  }
+
+  /**
+   * Creates output directories below a known directory with a single call, falling back to {@link
+   * #forceCreateDirectoryAndParents} for those that cannot be created.
+   */
+  private void createOutputDirectoriesBelow(
+      Path knownDir, List<Path> dirs, Map<Path, Path> rootPaths)
+      throws CreateOutputDirectoryException {
+    List<PathFragment> relativeDirs = Lists.transform(dirs, dir -> dir.relativeTo(knownDir));
+    int[] results;
+    try {
+      results = knownDir.createWritableDirectories(relativeDirs);
+    } catch (IOException e) {
+      results = null;
+    }
+    for (int i = 0; i < dirs.size(); i++) {
+      Path dir = dirs.get(i);
+      if (results == null || results[i] < 0) {
+        /* Plan B. */
+        forceCreateDirectoryAndParents(dir, rootPaths.get(dir));
+        continue;
+      }
+      knownDirectories.put(
+          dir.asFragment(), results[i] > 0 ? DirectoryState.CREATED : DirectoryState.FOUND);
+      // The ancestors below knownDir exist now too, whether or not they were created.
+      Path parent = dir.getParentDirectory();
+      while (!parent.equals(knownDir)
+          && knownDirectories.putIfAbsent(parent.asFragment(), DirectoryState.FOUND) == null) {
+        parent = parent.getParentDirectory();
       }
     }
   }
@@ -254,18 +319,7 @@ public final class ActionOutputDirectoryHelper {
    * can only come from state left behind by previous invocations or external filesystem mutation.
    */
   private void createAndCheckForSymlinks(Path dir, Path rootPath) throws IOException {
-    PathFragment root = rootPath.asFragment();
-
-    // If the output root has not been created yet, do so now.
-    if (!knownDirectories.containsKey(root)) {
-      FileStatus stat = rootPath.statNullable(Symlinks.NOFOLLOW);
-      if (stat == null) {
-        rootPath.createDirectoryAndParents();
-        knownDirectories.put(root, DirectoryState.CREATED);
-      } else {
-        knownDirectories.put(root, DirectoryState.FOUND);
-      }
-    }
+    createOutputRoot(rootPath);
 
     // Walk up until the first known directory is found (must be root or below).
     List<Path> checkDirs = new ArrayList<>();
@@ -294,6 +348,20 @@ public final class ActionOutputDirectoryHelper {
     }
   }
 
+  /** Creates the output root if it has not been created yet. */
+  private void createOutputRoot(Path rootPath) throws IOException {
+    PathFragment root = rootPath.asFragment();
+    if (!knownDirectories.containsKey(root)) {
+      FileStatus stat = rootPath.statNullable(Symlinks.NOFOLLOW);
+      if (stat == null) {
+        rootPath.createDirectoryAndParents();
+        knownDirectories.put(root, DirectoryState.CREATED);
+      } else {
+        knownDirectories.put(root, DirectoryState.FOUND);
+      }
+    }
+  }
+
   /** An exception that occurred while attempting to create an output directory. */
   public static final class CreateOutputDirectoryException extends IOException {
     private final PathFragment directoryPath;
@@ -305,6 +305,32 @@ public class TestConfiguration extends Fragment {
         help = "If true, undeclared test outputs will be archived in a zip file.")
     public boolean zipUndeclaredTestOutputs;
 
+    @Option(
+        name = "experimental_compress_undeclared_test_outputs",
+        defaultValue = "false",
+        documentationCategory = OptionDocumentationCategory.TESTING,
+        effectTags = {OptionEffectTag.TEST_RUNNER},
+        metadataTags = {OptionMetadataTag.EXPERIMENTAL},
+        help =
+            "If true, and --zip_undeclared_test_outputs is set, the Windows test wrapper deflates"
+                + " undeclared test outputs in the zip file, reading and compressing them on"
+                + " several threads. On other platforms, the zip file is always compressed.")
+    public boolean compressUndeclaredTestOutputs;
+
+    @Option(
+        name = "experimental_undeclared_test_outputs_compression_level",
+        defaultValue = "-1",
+        documentationCategory = OptionDocumentationCategory.TESTING,
+        effectTags = {OptionEffectTag.TEST_RUNNER},
+        metadataTags = {OptionMetadataTag.EXPERIMENTAL},
+        help =
+            "The zlib level, from 1 (fastest) to 9 (smallest), that the Windows test wrapper"
+                + " deflates undeclared test outputs with if"
+                + " --experimental_compress_undeclared_test_outputs is set. Any other value means"
+                + " the default of zlib. Files that are compressed already, like images and"
+                + " archives, are stored as they are.")
+    public int undeclaredTestOutputsCompressionLevel;
+
     @Option(
         name = "use_target_platform_for_tests",
         defaultValue = "false",
@@ -440,6 +466,14 @@ public class TestConfiguration extends Fragment {
     return options.zipUndeclaredTestOutputs;
   }
 
+  public boolean getCompressUndeclaredTestOutputs() {
+    return options.compressUndeclaredTestOutputs;
+  }
+
+  public int getUndeclaredTestOutputsCompressionLevel() {
+    return options.undeclaredTestOutputsCompressionLevel;
+  }
+
   public boolean useTargetPlatformForTests() {
     return options.useTargetPlatformForTests;
   }
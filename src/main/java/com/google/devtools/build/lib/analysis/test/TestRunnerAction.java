@@ -533,6 +533,8 @@ public class TestRunnerAction extends AbstractAction
     fp.addInt(executionSettings.getTotalRuns());
     fp.addBoolean(configuration.isCodeCoverageEnabled());
     fp.addBoolean(testConfiguration.getZipUndeclaredTestOutputs());
+    fp.addBoolean(testConfiguration.getCompressUndeclaredTestOutputs());
+    fp.addInt(testConfiguration.getUndeclaredTestOutputsCompressionLevel());
     fp.addStringMap(getExecutionInfo());
   }
 
@@ -760,6 +762,13 @@ public class TestRunnerAction extends AbstractAction
 
     if (testConfiguration.getZipUndeclaredTestOutputs()) {
       env.put("TEST_UNDECLARED_OUTPUTS_ZIP", getUndeclaredOutputsZipPath().getPathString());
+      if (testConfiguration.getCompressUndeclaredTestOutputs()) {
+        env.put("TEST_UNDECLARED_OUTPUTS_ZIP_COMPRESS", "1");
+        int level = testConfiguration.getUndeclaredTestOutputsCompressionLevel();
+        if (level >= 1 && level <= 9) {
+          env.put("TEST_UNDECLARED_OUTPUTS_ZIP_COMPRESSION_LEVEL", Integer.toString(level));
+        }
+      }
     }
 
     env.put("TEST_UNDECLARED_OUTPUTS_DIR", getUndeclaredOutputsDir().getPathString());
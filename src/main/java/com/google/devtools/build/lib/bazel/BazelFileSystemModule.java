@@ -89,7 +89,11 @@ public class BazelFileSystemModule extends BlazeModule {
       fs = new WindowsFileSystem(digestHashFunction, options.enableWindowsSymlinks);
     } else {
       if (JniLoader.isJniAvailable()) {
-        fs = new UnixFileSystem(digestHashFunction, options.unixDigestHashAttributeName);
+        fs =
+            new UnixFileSystem(
+                digestHashFunction,
+                options.unixDigestHashAttributeName,
+                options.unixDigestCacheAttributeName);
       } else {
         fs = new JavaIoFileSystem(digestHashFunction);
       }
@@ -70,6 +70,71 @@ public class LocalExecutionOptions extends OptionsBase {
               + "period in --local_termination_grace_seconds before forcibly sending a SIGKILL.")
   public boolean processWrapperGracefulSigterm;
 
+  @Option(
+      name = "experimental_process_wrapper_server",
+      defaultValue = "false",
+      documentationCategory = OptionDocumentationCategory.UNDOCUMENTED,
+      effectTags = {OptionEffectTag.EXECUTION},
+      help =
+          "When true, run the process-wrapper commands of local actions on a long-lived "
+              + "process-wrapper server, which saves forking the Bazel server for every action. "
+              + "The server is started on demand and exits after some idle time.")
+  public boolean processWrapperServer;
+
+  @Option(
+      name = "experimental_process_wrapper_max_output_bytes",
+      defaultValue = "0",
+      documentationCategory = OptionDocumentationCategory.UNDOCUMENTED,
+      effectTags = {OptionEffectTag.EXECUTION},
+      help =
+          "If positive, the process-wrapper writes at most this many bytes of the stdout and of"
+              + " the stderr of local actions to disk: the first half as it comes, and the last"
+              + " half once the action has exited, after a line saying how much was dropped in"
+              + " between. The output of actions that print gigabytes then does not slow down"
+              + " the disk for every other action. 0 writes all of the output.")
+  public long processWrapperMaxOutputBytes;
+
+  @Option(
+      name = "experimental_local_perf_counters",
+      defaultValue = "false",
+      documentationCategory = OptionDocumentationCategory.UNDOCUMENTED,
+      effectTags = {OptionEffectTag.EXECUTION},
+      help =
+          "If true, the process-wrapper and the linux-sandbox count the instructions, cycles and"
+              + " last level cache misses of local actions in user space, and write them to the"
+              + " execution statistics of the actions. This needs hardware performance counters"
+              + " and a kernel.perf_event_paranoid of 2 or less; without, actions run as usual"
+              + " and have no such counts. Actions are then not run in pooled sandboxes.")
+  public boolean localPerfCounters;
+
+  @Option(
+      name = "experimental_local_memory_pressure_admission_wait",
+      defaultValue = "0",
+      documentationCategory = OptionDocumentationCategory.UNDOCUMENTED,
+      effectTags = {OptionEffectTag.EXECUTION},
+      help =
+          "If positive, the process-wrapper and the linux-sandbox wait for up to this many seconds"
+              + " before starting a local action while the memory pressure of the system is"
+              + " critical, so as not to add to the swapping of the actions that are running. The"
+              + " native memory pressure monitoring tells them directly, without waiting for the"
+              + " Java side.")
+  public int localMemoryPressureAdmissionWaitSeconds;
+
+  @Option(
+      name = "experimental_spread_local_actions_across_numa_nodes",
+      defaultValue = "false",
+      documentationCategory = OptionDocumentationCategory.UNDOCUMENTED,
+      effectTags = {
+        OptionEffectTag.EXECUTION,
+        OptionEffectTag.HOST_MACHINE_RESOURCE_OPTIMIZATIONS,
+      },
+      help =
+          "On Linux machines with more than one NUMA node, the process-wrapper and the"
+              + " linux-sandbox run each local action on the CPUs of one node and have it prefer"
+              + " the memory of that node, taking the nodes in turn. Actions then spread across"
+              + " the machine while each one stays off the interconnect between the nodes.")
+  public boolean spreadLocalActionsAcrossNumaNodes;
+
   @Option(
       name = "experimental_local_retries_on_crash",
       defaultValue = "0",
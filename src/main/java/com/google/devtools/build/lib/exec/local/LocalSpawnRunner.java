@@ -52,6 +52,7 @@ import com.google.devtools.build.lib.runtime.ProcessWrapper;
 import com.google.devtools.build.lib.server.FailureDetails;
 import com.google.devtools.build.lib.server.FailureDetails.FailureDetail;
 import com.google.devtools.build.lib.server.FailureDetails.Spawn.Code;
+import com.google.devtools.build.lib.shell.ExecutionStatistics;
 import com.google.devtools.build.lib.shell.Subprocess;
 import com.google.devtools.build.lib.shell.SubprocessBuilder;
 import com.google.devtools.build.lib.shell.TerminationStatus;
@@ -70,6 +71,7 @@ import java.util.ArrayList;
 import java.util.EnumMap;
 import java.util.List;
 import java.util.Map;
+import java.util.Optional;
 import java.util.logging.Level;
 import javax.annotation.Nullable;
 
@@ -376,7 +378,10 @@ public class LocalSpawnRunner implements SpawnRunner {
             localEnvProvider.rewriteLocalEnv(
                 spawn.getEnvironment(), binTools, commandTmpDir.getPathString());
 
-        SubprocessBuilder subprocessBuilder = new SubprocessBuilder();
+        SubprocessBuilder subprocessBuilder =
+            processWrapper != null && processWrapper.getServer() != null
+                ? new SubprocessBuilder(processWrapper.getServer())
+                : new SubprocessBuilder();
         subprocessBuilder.setWorkingDirectory(execRoot.getPathFile());
         subprocessBuilder.setStdout(outErr.getOutputPath().getPathFile());
         subprocessBuilder.setStderr(outErr.getErrorPath().getPathFile());
@@ -412,6 +417,7 @@ public class LocalSpawnRunner implements SpawnRunner {
         spawnResultBuilder.setStartTime(Instant.now());
         Stopwatch executionStopwatch = Stopwatch.createStarted();
         TerminationStatus terminationStatus;
+        Optional<ExecutionStatistics.ResourceUsage> resourceUsage = Optional.empty();
         try (SilentCloseable c =
             Profiler.instance()
                 .profile(ProfilerTask.LOCAL_PROCESS_TIME, spawn.getResourceOwner().getMnemonic())) {
@@ -422,6 +428,9 @@ public class LocalSpawnRunner implements SpawnRunner {
             subprocess.waitFor();
             terminationStatus =
                 new TerminationStatus(subprocess.exitValue(), subprocess.timedout());
+            if (statisticsPath == null) {
+              resourceUsage = ExecutionStatistics.getResourceUsage(subprocess);
+            }
           } catch (InterruptedException | IOException e) {
             subprocess.destroyAndWait();
             throw e;
@@ -471,6 +480,7 @@ public class LocalSpawnRunner implements SpawnRunner {
         if (statisticsPath != null) {
           spawnResultBuilder.setResourceUsageFromProto(statisticsPath);
         }
+        resourceUsage.ifPresent(spawnResultBuilder::setResourceUsage);
         spawnMetrics.setTotalTimeInMs((int) totalTimeStopwatch.elapsed().toMillis());
         spawnResultBuilder.setSpawnMetrics(spawnMetrics.build());
         return spawnResultBuilder.build();
@@ -67,6 +67,8 @@ public final class SystemLoadAdvisoryModule extends BlazeModule {
    *       <li>25 - kIOSystemLoadAdvisoryLevelOK
    *       <li>75 - kIOSystemLoadAdvisoryLevelBad
    *     </ul>
+   *     <p>Linux maps the CPU pressure stall information to the same values: 25 when tasks wait
+   *     for a CPU 20% of the time, and 75 when they do half of the time.
    */
   synchronized void systemLoadAdvisoryCallback(int value) {
     reportSystemLoadAdvisoryEvent(false, value);
@@ -83,7 +85,7 @@ public final class SystemLoadAdvisoryModule extends BlazeModule {
 
   private synchronized void reportSystemLoadAdvisoryEvent(boolean isInitialValue, int value) {
     String osDescription = "Unknown";
-    if (OS.getCurrent() == OS.DARWIN) {
+    if (OS.getCurrent() == OS.DARWIN || OS.getCurrent() == OS.LINUX) {
       osDescription = macOSSystemLoadAdvisoryDescription(value);
     }
     SystemLoadAdvisoryEvent event = new SystemLoadAdvisoryEvent(value, osDescription);
@@ -17,6 +17,7 @@ package com.google.devtools.build.lib.platform;
 import com.google.common.flogger.GoogleLogger;
 import com.google.devtools.build.lib.events.Reporter;
 import com.google.devtools.build.lib.jni.JniLoader;
+import java.io.IOException;
 import javax.annotation.Nullable;
 import javax.annotation.concurrent.GuardedBy;
 
@@ -45,6 +46,8 @@ public final class SystemMemoryPressureMonitor {
 
   private native int systemMemoryPressure();
 
+  private native void openAdmissionGateNative(String path) throws IOException;
+
   /** The possible memory pressure levels. */
   public enum Level {
     NORMAL("Normal"),
@@ -77,6 +80,18 @@ public final class SystemMemoryPressureMonitor {
     return Level.fromInt(systemMemoryPressure());
   }
 
+  /**
+   * Keeps the memory pressure level in the file at {@code path} from now on, straight from the
+   * native monitoring, so that the process-wrapper and the linux-sandbox can hold new actions back
+   * while it is critical. Only the first call per server opens a file; the following ones do
+   * nothing.
+   */
+  public void openAdmissionGate(String path) throws IOException {
+    if (JniLoader.isJniAvailable()) {
+      openAdmissionGateNative(path);
+    }
+  }
+
   public synchronized void setReporter(@Nullable Reporter reporter) {
     this.reporter = reporter;
     int pressure = systemMemoryPressure();
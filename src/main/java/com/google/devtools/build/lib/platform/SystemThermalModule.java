@@ -70,6 +70,13 @@ public final class SystemThermalModule extends BlazeModule {
    *       <li>90 - kOSThermalPressureLevelTrapping (Expect machine is about to die).
    *       <li>100 - kOSThermalPressureLevelSleeping (Machine is going to sleep to lower heat).
    *     </ul>
+   *     <p>For Linux the trip points of the hottest thermal zone map to:
+   *     <ul>
+   *       <li>0 - below all of them
+   *       <li>50 - passive (the kernel is throttling the CPUs)
+   *       <li>90 - hot
+   *       <li>100 - critical (the machine is about to shut down)
+   *     </ul>
    */
   synchronized void thermalCallback(int value) {
     reportThermalEvent(false, value);
@@ -86,10 +93,22 @@ public final class SystemThermalModule extends BlazeModule {
     };
   }
 
+  private String linuxThermalDescription(int value) {
+    return switch (value) {
+      case 0 -> "Nominal";
+      case 50 -> "Passive";
+      case 90 -> "Hot";
+      case 100 -> "Critical";
+      default -> "Unknown";
+    };
+  }
+
   private synchronized void reportThermalEvent(boolean isInitialValue, int value) {
     String osDescription = "Unknown";
     if (OS.getCurrent() == OS.DARWIN) {
       osDescription = macOSThermalDescription(value);
+    } else if (OS.getCurrent() == OS.LINUX) {
+      osDescription = linuxThermalDescription(value);
     }
     SystemThermalEvent event = new SystemThermalEvent(value, osDescription);
     String logString = event.logString();
@@ -45,6 +45,7 @@ import java.lang.management.ManagementFactory;
 import java.lang.management.MemoryMXBean;
 import java.time.Duration;
 import java.util.ArrayList;
+import java.util.Arrays;
 import java.util.LinkedHashMap;
 import java.util.List;
 import java.util.Map;
@@ -59,6 +60,7 @@ public class CollectLocalResourceUsage implements LocalResourceCollector {
   // TODO(twerth): Make these configurable.
   private static final Duration BUCKET_DURATION = Duration.ofSeconds(1);
   private static final Duration LOCAL_RESOURCES_COLLECT_SLEEP_INTERVAL = Duration.ofMillis(200);
+  private static final Duration NATIVE_RESOURCES_SAMPLE_INTERVAL = Duration.ofMillis(50);
 
   private final BugReporter bugReporter;
   private final boolean collectWorkerDataInProfiler;
@@ -83,6 +85,7 @@ public class CollectLocalResourceUsage implements LocalResourceCollector {
 
   private final ResourceEstimator resourceEstimator;
   private final boolean collectPressureStallIndicators;
+  private final boolean collectNativeResourceUsage;
 
   private final boolean collectSkyframeCounts;
 
@@ -98,6 +101,7 @@ public class CollectLocalResourceUsage implements LocalResourceCollector {
       boolean collectSystemNetworkUsage,
       boolean collectResourceManagerEstimation,
       boolean collectPressureStallIndicators,
+      boolean collectNativeResourceUsage,
       boolean collectSkyframeCounts) {
     this.bugReporter = checkNotNull(bugReporter);
     this.collectWorkerDataInProfiler = collectWorkerDataInProfiler;
@@ -107,6 +111,7 @@ public class CollectLocalResourceUsage implements LocalResourceCollector {
     this.collectResourceManagerEstimation = collectResourceManagerEstimation;
     this.resourceEstimator = resourceEstimator;
     this.collectPressureStallIndicators = collectPressureStallIndicators;
+    this.collectNativeResourceUsage = collectNativeResourceUsage;
     this.collector = new Collector();
 
     Preconditions.checkState(
@@ -153,6 +158,9 @@ public class CollectLocalResourceUsage implements LocalResourceCollector {
     if (collectPressureStallIndicators && OS.getCurrent() == OS.LINUX) {
       collectors.add(new PressureStallIndicatorCollector());
     }
+    if (collectNativeResourceUsage && NativeResourceSampler.isAvailable()) {
+      collectors.add(new NativeResourceUsageCollector());
+    }
 
     if (collectSkyframeCounts) {
       collectors.add(new SkyframeCountsCollector(graph));
@@ -212,6 +220,9 @@ public class CollectLocalResourceUsage implements LocalResourceCollector {
       } catch (InterruptedException e) {
         Thread.currentThread().interrupt();
       }
+      if (collectNativeResourceUsage && NativeResourceSampler.isAvailable()) {
+        NativeResourceSampler.stop();
+      }
       logCollectedData();
       collector = null;
     }
@@ -506,6 +517,166 @@ public class CollectLocalResourceUsage implements LocalResourceCollector {
     }
   }
 
+  /**
+   * Reports what {@link NativeResourceSampler} sampled since the last collection.
+   *
+   * <p>The sampler takes samples more often than this collector runs, and off the Java heap; each
+   * collection drains them all with a single JNI call.
+   */
+  private static class NativeResourceUsageCollector implements CounterSeriesCollector {
+    private static final CounterSeriesTask DISK_READ =
+        new CounterSeriesTask(
+            "Disk I/O (Bazel)", "disk read (MB/s)", CounterSeriesTask.Color.RAIL_RESPONSE);
+    private static final CounterSeriesTask DISK_WRITE =
+        new CounterSeriesTask(
+            "Disk I/O (Bazel)", "disk write (MB/s)", CounterSeriesTask.Color.RAIL_ANIMATION);
+    private static final CounterSeriesTask MAJOR_FAULTS =
+        new CounterSeriesTask(
+            "Major page faults (Bazel)", "major faults (/s)", CounterSeriesTask.Color.BAD);
+    private static final CounterSeriesTask RUNQUEUE_WAIT =
+        new CounterSeriesTask(
+            "CPU run queue wait (Bazel)",
+            "threads waiting for a cpu",
+            CounterSeriesTask.Color.THREAD_STATE_RUNNABLE);
+    private static final CounterSeriesTask STALLED_SOME_CPU =
+        new CounterSeriesTask(
+            "CPU stall time",
+            "cpu stalled (some, %)",
+            CounterSeriesTask.Color.THREAD_STATE_RUNNING);
+    private static final CounterSeriesTask STALLED_SOME_IO =
+        new CounterSeriesTask(
+            "I/O stall time",
+            "i/o stalled (some, %)",
+            CounterSeriesTask.Color.CQ_BUILD_ATTEMPT_FAILED);
+    private static final CounterSeriesTask STALLED_FULL_IO =
+        new CounterSeriesTask(
+            "I/O stall time", "i/o stalled (full, %)", CounterSeriesTask.Color.RAIL_ANIMATION);
+    private static final CounterSeriesTask STALLED_SOME_MEMORY =
+        new CounterSeriesTask(
+            "Memory stall time", "memory stalled (some, %)", CounterSeriesTask.Color.RAIL_IDLE);
+    private static final CounterSeriesTask STALLED_FULL_MEMORY =
+        new CounterSeriesTask(
+            "Memory stall time",
+            "memory stalled (full, %)",
+            CounterSeriesTask.Color.THREAD_STATE_UNKNOWN);
+    private static final CounterSeriesTask MEMORY_PRESSURE =
+        new CounterSeriesTask(
+            "Memory pressure (system)",
+            "memory pressure (0 normal, 1 warning, 2 critical)",
+            CounterSeriesTask.Color.TERRIBLE);
+    private static final CounterSeriesTask THERMAL_LOAD =
+        new CounterSeriesTask(
+            "Thermal load (system)", "thermal load (%)", CounterSeriesTask.Color.BAD);
+    private static final CounterSeriesTask CPU_SPEED =
+        new CounterSeriesTask(
+            "CPU speed limit (system)", "cpu speed (%)", CounterSeriesTask.Color.GOOD);
+    private static final CounterSeriesTask LOAD_ADVISORY =
+        new CounterSeriesTask(
+            "System load advisory", "load advisory (%)", CounterSeriesTask.Color.OLIVE);
+    private static final CounterSeriesTask DISK_FREE =
+        new CounterSeriesTask(
+            "Disk space (system)", "free disk space (GB)", CounterSeriesTask.Color.GREY);
+
+    private final long[] samples =
+        new long[NativeResourceSampler.CAPACITY * NativeResourceSampler.FIELD_COUNT];
+    private final long[] previous = new long[NativeResourceSampler.FIELD_COUNT];
+    private final long[] deltas = new long[NativeResourceSampler.FIELD_COUNT];
+    private boolean hasPrevious;
+
+    private NativeResourceUsageCollector() {
+      NativeResourceSampler.start((int) NATIVE_RESOURCES_SAMPLE_INTERVAL.toMillis());
+    }
+
+    @Override
+    public void collect(double deltaNanos, BiConsumer<CounterSeriesTask, Double> consumer) {
+      int count = NativeResourceSampler.drain(samples);
+      if (count == 0) {
+        return;
+      }
+      // The counters only go up, except for the run queue wait, which drops when threads exit on
+      // Linux, and counters that could not be read, which are 0: summing the deltas between
+      // consecutive samples and ignoring the negative ones tolerates both. Of the levels, the worst
+      // one of the samples is reported.
+      Arrays.fill(deltas, 0);
+      int first = 0;
+      if (!hasPrevious) {
+        System.arraycopy(samples, 0, previous, 0, NativeResourceSampler.FIELD_COUNT);
+        hasPrevious = true;
+        first = 1;
+      }
+      for (int i = first; i < count; i++) {
+        int offset = i * NativeResourceSampler.FIELD_COUNT;
+        for (int field = 0; field < NativeResourceSampler.MEMORY_PRESSURE; field++) {
+          long delta = samples[offset + field] - previous[field];
+          if (delta > 0) {
+            deltas[field] += delta;
+          }
+          previous[field] = samples[offset + field];
+        }
+      }
+      long memoryPressure = -1;
+      long thermalLoad = -1;
+      long cpuSpeed = -1;
+      long loadAdvisory = -1;
+      for (int i = 0; i < count; i++) {
+        int offset = i * NativeResourceSampler.FIELD_COUNT;
+        memoryPressure =
+            Math.max(memoryPressure, samples[offset + NativeResourceSampler.MEMORY_PRESSURE]);
+        thermalLoad = Math.max(thermalLoad, samples[offset + NativeResourceSampler.THERMAL_LOAD]);
+        long speed = samples[offset + NativeResourceSampler.CPU_SPEED];
+        if (speed >= 0 && (cpuSpeed < 0 || speed < cpuSpeed)) {
+          cpuSpeed = speed;
+        }
+        loadAdvisory =
+            Math.max(loadAdvisory, samples[offset + NativeResourceSampler.LOAD_ADVISORY]);
+      }
+      reportLevel(MEMORY_PRESSURE, memoryPressure, consumer);
+      reportLevel(THERMAL_LOAD, thermalLoad, consumer);
+      reportLevel(CPU_SPEED, cpuSpeed, consumer);
+      reportLevel(LOAD_ADVISORY, loadAdvisory, consumer);
+      long diskFree =
+          samples[(count - 1) * NativeResourceSampler.FIELD_COUNT
+              + NativeResourceSampler.DISK_FREE_BYTES];
+      if (diskFree >= 0) {
+        consumer.accept(DISK_FREE, diskFree / (1024.0 * 1024 * 1024));
+      }
+      double elapsedNanos = deltas[NativeResourceSampler.TIME_NANOS];
+      if (elapsedNanos <= 0) {
+        return;
+      }
+      double elapsedSeconds = elapsedNanos / 1e9;
+      double megabyte = 1024 * 1024;
+      consumer.accept(
+          DISK_READ, deltas[NativeResourceSampler.READ_BYTES] / megabyte / elapsedSeconds);
+      consumer.accept(
+          DISK_WRITE, deltas[NativeResourceSampler.WRITE_BYTES] / megabyte / elapsedSeconds);
+      consumer.accept(MAJOR_FAULTS, deltas[NativeResourceSampler.MAJOR_FAULTS] / elapsedSeconds);
+      consumer.accept(
+          RUNQUEUE_WAIT, deltas[NativeResourceSampler.RUNQUEUE_WAIT_NANOS] / elapsedNanos);
+      // The pressure stall information is only available on Linux.
+      if (OS.getCurrent() != OS.LINUX) {
+        return;
+      }
+      // The pressure stall times are in microseconds.
+      double percent = 100 * 1000 / elapsedNanos;
+      consumer.accept(
+          STALLED_SOME_CPU, deltas[NativeResourceSampler.CPU_SOME_MICROS] * percent);
+      consumer.accept(STALLED_SOME_IO, deltas[NativeResourceSampler.IO_SOME_MICROS] * percent);
+      consumer.accept(STALLED_FULL_IO, deltas[NativeResourceSampler.IO_FULL_MICROS] * percent);
+      consumer.accept(
+          STALLED_SOME_MEMORY, deltas[NativeResourceSampler.MEMORY_SOME_MICROS] * percent);
+      consumer.accept(
+          STALLED_FULL_MEMORY, deltas[NativeResourceSampler.MEMORY_FULL_MICROS] * percent);
+    }
+
+    private static void reportLevel(
+        CounterSeriesTask task, long level, BiConsumer<CounterSeriesTask, Double> consumer) {
+      if (level >= 0) {
+        consumer.accept(task, (double) level);
+      }
+    }
+  }
+
   private static class SkyframeCountsCollector implements CounterSeriesCollector {
     private record SkyFunctionProfilerTasks(
         CounterSeriesTask totalCounter, CounterSeriesTask doneCounter) {}
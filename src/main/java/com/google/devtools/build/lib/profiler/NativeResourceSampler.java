@@ -0,0 +1,106 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.devtools.build.lib.profiler;
+
+import com.google.devtools.build.lib.jni.JniLoader;
+import com.google.devtools.build.lib.util.OS;
+
+/**
+ * Samples counters of the server and of the system on a native thread at a fixed interval, into a
+ * ring buffer that is drained in bulk (see src/main/native/resource_sampler_jni.cc), so that all
+ * the counters of a sample are read at the same time.
+ *
+ * <p>A sample is {@link #FIELD_COUNT} longs, at the indices below. The ones before {@link
+ * #MEMORY_PRESSURE}, but the time, are running totals; the ones from it on are levels. Counters
+ * that cannot be read on the current platform are 0, and levels -1.
+ */
+public final class NativeResourceSampler {
+  /** The time of the sample, as {@link System#nanoTime}. */
+  public static final int TIME_NANOS = 0;
+
+  /** The major page faults of the server. */
+  public static final int MAJOR_FAULTS = 1;
+
+  /** The bytes that the server read from disk. */
+  public static final int READ_BYTES = 2;
+
+  /** The bytes that the server wrote to disk. */
+  public static final int WRITE_BYTES = 3;
+
+  /** The microseconds that some tasks of the system were stalled for a CPU. */
+  public static final int CPU_SOME_MICROS = 4;
+
+  /** The microseconds that some tasks of the system were stalled on I/O. */
+  public static final int IO_SOME_MICROS = 5;
+
+  /** The microseconds that all the tasks of the system were stalled on I/O. */
+  public static final int IO_FULL_MICROS = 6;
+
+  /** The microseconds that some tasks of the system were stalled on memory. */
+  public static final int MEMORY_SOME_MICROS = 7;
+
+  /** The microseconds that all the tasks of the system were stalled on memory. */
+  public static final int MEMORY_FULL_MICROS = 8;
+
+  /**
+   * The nanoseconds that the threads of the server waited for a CPU: the live ones on Linux, all of
+   * them on macOS.
+   */
+  public static final int RUNQUEUE_WAIT_NANOS = 9;
+
+  /** The memory pressure of the system, as ordered in {@code SystemMemoryPressureMonitor.Level}. */
+  public static final int MEMORY_PRESSURE = 10;
+
+  /** The thermal load of the system, as reported by {@code SystemThermalModule}. */
+  public static final int THERMAL_LOAD = 11;
+
+  /** The speed limit of the CPUs, in percent, as reported by {@code SystemCPUSpeedModule}. */
+  public static final int CPU_SPEED = 12;
+
+  /** The system load advisory, as reported by {@code SystemLoadAdvisoryModule}. */
+  public static final int LOAD_ADVISORY = 13;
+
+  /** The bytes available to the server on the volume of its working directory. */
+  public static final int DISK_FREE_BYTES = 14;
+
+  public static final int FIELD_COUNT = 15;
+
+  /** The number of samples that the ring buffer holds. */
+  public static final int CAPACITY = 4096;
+
+  static {
+    JniLoader.loadJni();
+  }
+
+  private NativeResourceSampler() {}
+
+  /** Whether the sampler is available: only on Linux and macOS, with the JNI library. */
+  public static boolean isAvailable() {
+    return (OS.getCurrent() == OS.LINUX || OS.getCurrent() == OS.DARWIN)
+        && JniLoader.isJniAvailable();
+  }
+
+  /** Starts taking a sample every {@code intervalMillis}, unless the sampler is already running. */
+  public static native void start(int intervalMillis);
+
+  /** Stops taking samples. The samples taken so far can still be drained. */
+  public static native void stop();
+
+  /**
+   * Moves the oldest samples that have not been drained yet into {@code samples}, as many as fit,
+   * and returns how many. Samples are dropped while the ring buffer is full.
+   */
+  public static native int drain(long[] samples);
+}
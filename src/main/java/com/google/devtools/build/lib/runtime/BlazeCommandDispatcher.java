@@ -60,7 +60,9 @@ import com.google.devtools.build.lib.util.DetailedExitCode;
 import com.google.devtools.build.lib.util.ExitCode;
 import com.google.devtools.build.lib.util.InterruptedFailureDetails;
 import com.google.devtools.build.lib.util.LoggingUtil;
+import com.google.devtools.build.lib.util.OS;
 import com.google.devtools.build.lib.util.Pair;
+import com.google.devtools.build.lib.util.ProcessUtils;
 import com.google.devtools.build.lib.util.io.CommandExtensionReporter;
 import com.google.devtools.build.lib.util.io.DelegatingOutErr;
 import com.google.devtools.build.lib.util.io.OutErr;
@@ -111,6 +113,9 @@ public class BlazeCommandDispatcher implements CommandDispatcher {
   private String currentClientDescription = null;
   private final AtomicReference<String> shutdownReason = new AtomicReference<>();
   private OutputStream logOutputStream = null;
+  // Whether the server is scheduled for commands that execute actions, with
+  // --experimental_per_command_scheduling. Only accessed by the command holding the lock.
+  @Nullable private Boolean scheduledForExecution = null;
   private final LoadingCache<BlazeCommand, OpaqueOptionsData> optionsDataCache =
       Caffeine.newBuilder()
           .build(
@@ -235,6 +240,7 @@ public class BlazeCommandDispatcher implements CommandDispatcher {
         !multipleAttempts ? 0 : (BlazeClock.nanoTime() - clockBefore) / (1000L * 1000L);
 
     try {
+      setScheduling(command.getClass().getAnnotation(Command.class));
       String retrievedShutdownReason = this.shutdownReason.get();
       if (retrievedShutdownReason != null) {
         outErr.printErrLn(retrievedShutdownReason);
@@ -288,6 +294,37 @@ public class BlazeCommandDispatcher implements CommandDispatcher {
     }
   }
 
+  /**
+   * With --experimental_per_command_scheduling, applies --batch_cpu_scheduling and --io_nice_level
+   * to the server only while it runs a command that executes actions, and runs the others, such as
+   * query and info, at the default priority. A build then yields to an interactive desktop without
+   * slowing down the queries of an IDE.
+   */
+  private void setScheduling(Command commandAnnotation) {
+    BlazeServerStartupOptions startupOptions =
+        runtime.getStartupOptionsProvider().getOptions(BlazeServerStartupOptions.class);
+    if (startupOptions == null
+        || !startupOptions.perCommandScheduling
+        || OS.getCurrent() != OS.LINUX) {
+      return;
+    }
+    boolean forExecution = commandAnnotation.buildPhase().executes();
+    if (scheduledForExecution != null && scheduledForExecution == forExecution) {
+      return;
+    }
+    try {
+      if (startupOptions.batchCpuScheduling) {
+        ProcessUtils.setBatchCpuScheduling(forExecution);
+      }
+      if (startupOptions.ioNiceLevel >= 0) {
+        ProcessUtils.setIoNiceLevel(forExecution ? startupOptions.ioNiceLevel : -1);
+      }
+      scheduledForExecution = forExecution;
+    } catch (IOException e) {
+      logger.atWarning().withCause(e).log("Failed to set the scheduling of the server");
+    }
+  }
+
   /**
    * For testing ONLY. Same as {@link CommandDispatcher#exec(InvocationPolicy, List, OutErr,
    * LockingMode, String, long, Optional, List, CommandExtensionReporter)} but automatically uses
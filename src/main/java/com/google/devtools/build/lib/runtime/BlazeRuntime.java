@@ -464,6 +464,7 @@ public final class BlazeRuntime implements BugReport.BlazeRuntimeInterface {
                 commandOptions.collectSystemNetworkUsage,
                 commandOptions.collectResourceEstimation,
                 commandOptions.collectPressureStallIndicators,
+                commandOptions.collectNativeResourceUsage,
                 commandOptions.collectSkyframeCounts));
         // Instead of logEvent() we're calling the low level function to pass the timings we took in
         // the launcher. We're setting the INIT phase marker so that it follows immediately the
@@ -1130,10 +1131,14 @@ public final class BlazeRuntime implements BugReport.BlazeRuntimeInterface {
               pidFileWatcher,
               runtime.clock,
               startupOptions.commandPort,
+              startupOptions.unixDomainSocket,
               runtime.getServerDirectory(),
               serverPid,
+              startupOptions.installMD5,
+              startupOptions.startupOptionsDigest,
               startupOptions.maxIdleSeconds,
               startupOptions.shutdownOnLowSysMem,
+              startupOptions.scopedServerPid,
               startupOptions.idleServerTasks,
               getSlowInterruptMessageSuffix(modules));
       rpcServerRef.set(rpcServer);
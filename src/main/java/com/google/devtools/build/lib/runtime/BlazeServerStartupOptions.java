@@ -105,6 +105,18 @@ public class BlazeServerStartupOptions extends OptionsBase {
       help = "This launcher option is intended for use only by tests.")
   public String installMD5;
 
+  @Option(
+      name = "startup_options_digest",
+      defaultValue = "", // NOTE: only for documentation, value is always passed by the client.
+      documentationCategory = OptionDocumentationCategory.UNDOCUMENTED,
+      effectTags = {OptionEffectTag.BAZEL_INTERNAL_CONFIGURATION},
+      metadataTags = {OptionMetadataTag.HIDDEN},
+      help =
+          "A digest of the other startup options, reported back to the client so that it can "
+              + "tell whether this server can run its commands without reading the server's "
+              + "command line.")
+  public String startupOptionsDigest;
+
   /* Note: The help string in this option applies to the client code; not
    * the server code. The server code will only accept a non-empty path; it's
    * the responsibility of the client to compute a proper default if
@@ -142,6 +154,21 @@ public class BlazeServerStartupOptions extends OptionsBase {
               + "shared between collaborating users.")
   public PathFragment outputUserRoot;
 
+  @Option(
+      name = "shared_install_base_root",
+      defaultValue = "", // NOTE: only for documentation, value never passed to the server.
+      documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+      effectTags = {OptionEffectTag.BAZEL_INTERNAL_CONFIGURATION},
+      converter = OptionsUtils.PathFragmentConverter.class,
+      valueHelp = "<path>",
+      help =
+          "A directory of pre-extracted install bases, each named by the install MD5 of the "
+              + "Bazel binary it belongs to, for example on a read-only volume shared between "
+              + "users or containers. If it has one for this binary and --install_base is not "
+              + "set, Bazel uses it instead of extracting itself under --output_user_root. Only "
+              + "its install_base_key is checked, not each of its files.")
+  public PathFragment sharedInstallBaseRoot;
+
   /**
    * Note: This option is only used by the C++ client, never by the Java server. It is included here
    * to make sure that the option is documented in the help output, which is auto-generated by Java
@@ -159,6 +186,39 @@ public class BlazeServerStartupOptions extends OptionsBase {
               + "in output_base.")
   public PathFragment serverJvmOut;
 
+  @Option(
+      name = "client_profile",
+      defaultValue = "null", // NOTE: only for documentation, value never passed to the server.
+      documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+      effectTags = {OptionEffectTag.AFFECTS_OUTPUTS, OptionEffectTag.BAZEL_MONITORING},
+      converter = OptionsUtils.PathFragmentConverter.class,
+      valueHelp = "<path>",
+      help =
+          "If set, the client writes a JSON trace of its own startup to this file: parsing the "
+              + "rc files, waiting for the client lock, extracting the install base, and "
+              + "connecting to or starting the server. Timestamps are in microseconds relative "
+              + "to the moment the command is handed to the server, which is also the origin of "
+              + "the --profile written by the server, unless the server had to wait for another "
+              + "command.")
+  public PathFragment clientProfile;
+
+  @Option(
+      name = "command_list",
+      defaultValue = "null", // NOTE: only for documentation, value never passed to the server.
+      documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+      effectTags = {OptionEffectTag.BAZEL_INTERNAL_CONFIGURATION},
+      valueHelp = "<path>",
+      help =
+          "If set, the client runs the commands listed in this file, or on stdin for '-', one "
+              + "after another in the same server, instead of a command given on the command "
+              + "line. Each line holds one command and its arguments, like a command line; "
+              + "empty lines and '#' comments are skipped. Every command gets the options of the "
+              + "rc files, and the client prints the exit code of each one. It exits with the "
+              + "exit code of the first command that failed, and stops after an interrupted one. "
+              + "A 'run' command replaces the client with the program it runs, so it has to be "
+              + "the last one.")
+  public String commandList;
+
   // Note: The help string in this option applies to the client code; not the server code. The
   // server code will only accept a non-empty path; it's the responsibility of the client to compute
   // a proper default if necessary.
@@ -223,6 +283,19 @@ public class BlazeServerStartupOptions extends OptionsBase {
               + "server when the system is low on free RAM. Linux only.")
   public boolean shutdownOnLowSysMem;
 
+  @Option(
+      name = "experimental_scoped_server_pid",
+      defaultValue = "0",
+      documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+      effectTags = {OptionEffectTag.EAGERNESS_TO_EXIT, OptionEffectTag.LOSES_INCREMENTAL_STATE},
+      valueHelp = "<pid>",
+      help =
+          "If positive, the build server shuts down as soon as the process with this pid exits, "
+              + "for example the script of a CI step. The commands run until then share the "
+              + "server, like without --batch, but no server is left running after the step, "
+              + "like with --batch. Changing this option restarts the server.")
+  public int scopedServerPid;
+
   @Option(
       name = "batch",
       defaultValue = "false",
@@ -251,7 +324,8 @@ public class BlazeServerStartupOptions extends OptionsBase {
 
   @Option(
       name = "io_nice_level",
-      defaultValue = "-1", // NOTE: only for documentation, value never passed to the server.
+      // NOTE: only passed to the server with --experimental_per_command_scheduling.
+      defaultValue = "-1",
       documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
       effectTags = {OptionEffectTag.HOST_MACHINE_RESOURCE_OPTIMIZATIONS},
       valueHelp = "{-1,0,1,2,3,4,5,6,7}",
@@ -264,7 +338,8 @@ public class BlazeServerStartupOptions extends OptionsBase {
 
   @Option(
       name = "batch_cpu_scheduling",
-      defaultValue = "false", // NOTE: only for documentation, value never passed to the server.
+      // NOTE: only passed to the server with --experimental_per_command_scheduling.
+      defaultValue = "false",
       documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
       effectTags = {OptionEffectTag.HOST_MACHINE_RESOURCE_OPTIMIZATIONS},
       help =
@@ -274,6 +349,17 @@ public class BlazeServerStartupOptions extends OptionsBase {
               + "call.")
   public boolean batchCpuScheduling;
 
+  @Option(
+      name = "experimental_per_command_scheduling",
+      defaultValue = "false",
+      documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+      effectTags = {OptionEffectTag.HOST_MACHINE_RESOURCE_OPTIMIZATIONS},
+      help =
+          "Only on Linux; if true, --batch_cpu_scheduling and --io_nice_level only apply while "
+              + "the server runs a command that executes actions, such as build or test. The "
+              + "other commands, such as query and info, run at the default priority.")
+  public boolean perCommandScheduling;
+
   @Option(
       name = "ignore_all_rc_files",
       defaultValue = "false", // NOTE: purely decorative, rc files are read by the client.
@@ -343,6 +429,21 @@ public class BlazeServerStartupOptions extends OptionsBase {
       help = "Port to start up the gRPC command server on. If 0, let the kernel choose.")
   public int commandPort;
 
+  @Option(
+      name = "experimental_unix_domain_socket",
+      defaultValue = "false", // NOTE: only for documentation, value is always passed by the client.
+      documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+      effectTags = {
+        OptionEffectTag.HOST_MACHINE_RESOURCE_OPTIMIZATIONS,
+        OptionEffectTag.LOSES_INCREMENTAL_STATE
+      },
+      help =
+          "If true, the server listens on a Unix domain socket in its directory rather than on a"
+              + " loopback TCP port, which makes short commands faster. On Linux, the socket is in"
+              + " the abstract namespace if the path of the output base is too long for one."
+              + " Ignored where Unix domain sockets are not supported, like on Windows.")
+  public boolean unixDomainSocket;
+
   @Option(
       name = "product_name",
       defaultValue = "bazel", // NOTE: only for documentation, value is always passed by the client.
@@ -402,6 +503,30 @@ public class BlazeServerStartupOptions extends OptionsBase {
       help = "The maximum amount of time the client waits to connect to the server")
   public int localStartupTimeoutSecs;
 
+  @Option(
+      name = "standby_servers",
+      defaultValue = "0", // NOTE: only for documentation, value is set and used by the client.
+      documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+      effectTags = {OptionEffectTag.LOSES_INCREMENTAL_STATE, OptionEffectTag.AFFECTS_OUTPUTS},
+      help =
+          "If positive and --output_base is not set, every set of startup options gets its own "
+              + "output base and server, and up to this many servers of other startup options of "
+              + "the workspace are kept running, so that switching back to them does not restart "
+              + "the server. The least recently used idle ones are shut down when a new server "
+              + "starts, also while less than a quarter of the physical memory is available.")
+  public int standbyServers;
+
+  @Option(
+      name = "experimental_output_base_max_age_days",
+      defaultValue = "0", // NOTE: only for documentation, value is set and used by the client.
+      documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+      effectTags = {OptionEffectTag.BAZEL_INTERNAL_CONFIGURATION},
+      help =
+          "If positive, the client deletes the output bases under --output_user_root that no "
+              + "command has used for this many days, at most once a day. Output bases with a "
+              + "running server or command are kept.")
+  public int outputBaseMaxAgeDays;
+
   @Option(
       name = "digest_function",
       defaultValue = "null",
@@ -439,6 +564,47 @@ public class BlazeServerStartupOptions extends OptionsBase {
               + " actually encounter a condition that triggers them.")
   public boolean unlimitCoredumps;
 
+  @Option(
+      name = "experimental_server_class_data_sharing",
+      defaultValue = "false", // NOTE: purely decorative, the JVM flags are set by the client.
+      documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+      effectTags = {
+        OptionEffectTag.LOSES_INCREMENTAL_STATE,
+        OptionEffectTag.HOST_MACHINE_RESOURCE_OPTIMIZATIONS,
+      },
+      help =
+          "If true, and the server runs on the embedded JDK, the server JVM saves the classes it"
+              + " loaded in a class data sharing archive in the output base when it exits, and"
+              + " maps them from there when the server starts again, which makes later server"
+              + " starts faster. The archive is specific to the Bazel version.")
+  public boolean serverClassDataSharing;
+
+  @Option(
+      name = "experimental_auto_size_server_jvm",
+      defaultValue = "false", // NOTE: purely decorative, the JVM flags are set by the client.
+      documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+      effectTags = {
+        OptionEffectTag.LOSES_INCREMENTAL_STATE,
+        OptionEffectTag.HOST_MACHINE_RESOURCE_OPTIMIZATIONS,
+      },
+      help =
+          "If true, the client sizes the heap of the server JVM, picks its garbage collector and"
+              + " sets its GC threads and processor count for the memory and cpus that the server"
+              + " may use: those of the machine, or the limits of the cgroup or job of the client"
+              + " if they are lower. Flags given with --host_jvm_args take precedence.")
+  public boolean autoSizeServerJvm;
+
+  @Option(
+      name = "auto_sized_server_jvm_args",
+      defaultValue = "",
+      documentationCategory = OptionDocumentationCategory.UNDOCUMENTED,
+      effectTags = {OptionEffectTag.NO_OP},
+      metadataTags = {OptionMetadataTag.HIDDEN},
+      help =
+          "The JVM flags that --experimental_auto_size_server_jvm set, for reporting only. Its"
+              + " source is what they were computed from.")
+  public String autoSizedServerJvmArgs;
+
   @Option(
       name = "macos_qos_class",
       defaultValue = "default", // Only for documentation; value is set and used by the client.
@@ -477,6 +643,20 @@ public class BlazeServerStartupOptions extends OptionsBase {
               + "that it causes a significant number of invocations of the getxattr() system call.")
   public String unixDigestHashAttributeName;
 
+  @Option(
+      name = "unix_digest_cache_attribute_name",
+      defaultValue = "",
+      documentationCategory = OptionDocumentationCategory.UNDOCUMENTED,
+      effectTags = {OptionEffectTag.BAZEL_INTERNAL_CONFIGURATION},
+      help =
+          "The name of an extended attribute in which Bazel caches the digests that it computes "
+              + "for files, together with the modification time, size and inode number of the "
+              + "file, such that it doesn't have to hash unchanged files again after a server "
+              + "restart. The name of --digest_function is appended to the name, e.g. "
+              + "user.bazel.digest.sha-256 for user.bazel.digest. Files whose attributes Bazel "
+              + "cannot set are hashed as usual.")
+  public String unixDigestCacheAttributeName;
+
   @Option(
       name = "autodetect_server_javabase",
       defaultValue = "true", // NOTE: only for documentation, value never passed to the server.
@@ -512,4 +692,55 @@ public class BlazeServerStartupOptions extends OptionsBase {
               + "of the controllers. This options does not have any effect on "
               + "platforms that do not support cgroups.")
   public String cgroupParent;
+
+  /** This is read by the client and passed to daemonize, see {@link #cgroupParent}. */
+  @Option(
+      name = "experimental_cgroup_memory_high",
+      defaultValue = "null",
+      documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+      effectTags = {
+        OptionEffectTag.BAZEL_MONITORING,
+        OptionEffectTag.EXECUTION,
+      },
+      valueHelp = "<bytes>",
+      help =
+          "With --experimental_cgroup_parent, on cgroup v2, starts the bazel server in a new "
+              + "cgroup under the parent that also holds the cgroups of its actions, and sets its "
+              + "memory.high to this value, for example 16G. The kernel then throttles the build "
+              + "as a whole when it gets close to the limit, which the server sees as memory "
+              + "pressure. The old cgroups of servers that are gone are removed. It is not an "
+              + "error if the cgroup cannot be set up: the server is then started in the parent "
+              + "itself.")
+  public String cgroupMemoryHigh;
+
+  /** This is read by the client and passed to daemonize, see {@link #cgroupParent}. */
+  @Option(
+      name = "experimental_cgroup_memory_max",
+      defaultValue = "null",
+      documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+      effectTags = {
+        OptionEffectTag.BAZEL_MONITORING,
+        OptionEffectTag.EXECUTION,
+      },
+      valueHelp = "<bytes>",
+      help =
+          "Like --experimental_cgroup_memory_high, but sets memory.max: the limit past which "
+              + "the kernel kills processes of the build.")
+  public String cgroupMemoryMax;
+
+  /** This is read by the client and passed to daemonize. */
+  @Option(
+      name = "experimental_server_numa_node",
+      defaultValue = "-1",
+      documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+      effectTags = {
+        OptionEffectTag.HOST_MACHINE_RESOURCE_OPTIMIZATIONS,
+        OptionEffectTag.EXECUTION,
+      },
+      valueHelp = "<node>",
+      help =
+          "Linux only. If not -1, the server runs on the CPUs of this NUMA node and prefers its"
+              + " memory, and so do the local actions that it starts unless"
+              + " --experimental_spread_local_actions_across_numa_nodes places them elsewhere.")
+  public int serverNumaNode;
 }
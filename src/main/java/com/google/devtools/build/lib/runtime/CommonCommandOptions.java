@@ -347,6 +347,18 @@ public class CommonCommandOptions extends OptionsBase {
       help = "If enabled, the profiler collects the Linux PSI data.")
   public boolean collectPressureStallIndicators;
 
+  @Option(
+      name = "experimental_collect_native_resource_usage",
+      defaultValue = "false",
+      documentationCategory = OptionDocumentationCategory.LOGGING,
+      effectTags = {OptionEffectTag.BAZEL_MONITORING},
+      help =
+          "If enabled, the profiler collects the disk I/O, major page faults and cpu run queue wait"
+              + " of the server, the free disk space, and the Linux PSI stall times or the macOS"
+              + " memory pressure, thermal load, cpu speed limit and load advisory, from samples"
+              + " that a native thread takes every 50ms. Only on Linux and macOS.")
+  public boolean collectNativeResourceUsage;
+
   @Option(
       name = "experimental_collect_skyframe_counts_in_profiler",
       defaultValue = "false",
@@ -15,20 +15,27 @@
 package com.google.devtools.build.lib.runtime;
 
 import com.google.common.annotations.VisibleForTesting;
+import com.google.common.base.Splitter;
 import com.google.common.collect.ImmutableList;
+import com.google.common.flogger.GoogleLogger;
 import com.google.devtools.build.lib.actions.ExecutionRequirements;
 import com.google.devtools.build.lib.exec.local.LocalExecutionOptions;
+import com.google.devtools.build.lib.platform.SystemMemoryPressureMonitor;
 import com.google.devtools.build.lib.util.OS;
 import com.google.devtools.build.lib.util.OsUtils;
+import com.google.devtools.build.lib.vfs.FileSystemUtils;
 import com.google.devtools.build.lib.vfs.Path;
 import com.google.errorprone.annotations.CanIgnoreReturnValue;
+import java.io.IOException;
 import java.time.Duration;
 import java.util.List;
 import java.util.Map;
+import java.util.concurrent.atomic.AtomicInteger;
 import javax.annotation.Nullable;
 
 /** Tracks process-wrapper configuration and allows building command lines that rely on it. */
 public final class ProcessWrapper {
+  private static final GoogleLogger logger = GoogleLogger.forEnclosingClass();
 
   /** Name of the process-wrapper binary, without any path components. */
   private static final String BIN_BASENAME = "process-wrapper" + OsUtils.executableExtension();
@@ -42,12 +49,131 @@ public final class ProcessWrapper {
   /** Whether to pass {@code --graceful_sigterm} or not to the process-wrapper. */
   private final boolean gracefulSigterm;
 
+  /** How much of the stdout and of the stderr of commands to write at most, or 0 for all. */
+  private final long maxOutputBytes;
+
+  /** Whether to write the hardware performance counters of commands to their statistics. */
+  private final boolean perfCounters;
+
+  /** The server to run the command lines on, or null to run the process-wrapper for each. */
+  @Nullable private final ProcessWrapperServer server;
+
+  /** The admission gate to wait at before running a command, or null for none. */
+  @Nullable private final AdmissionGate admissionGate;
+
+  /** The NUMA nodes to bind the commands to in turn, or null to leave them where they are. */
+  @Nullable private final NumaNodes numaNodes;
+
   /** Creates a new process-wrapper instance from explicit values. */
   @VisibleForTesting
   public ProcessWrapper(Path binPath, @Nullable Duration killDelay, boolean gracefulSigterm) {
+    this(
+        binPath,
+        killDelay,
+        gracefulSigterm,
+        /* maxOutputBytes= */ 0,
+        /* perfCounters= */ false,
+        /* server= */ null,
+        /* admissionGate= */ null,
+        /* numaNodes= */ null);
+  }
+
+  private ProcessWrapper(
+      Path binPath,
+      @Nullable Duration killDelay,
+      boolean gracefulSigterm,
+      long maxOutputBytes,
+      boolean perfCounters,
+      @Nullable ProcessWrapperServer server,
+      @Nullable AdmissionGate admissionGate,
+      @Nullable NumaNodes numaNodes) {
     this.binPath = binPath;
     this.killDelay = killDelay;
     this.gracefulSigterm = gracefulSigterm;
+    this.maxOutputBytes = maxOutputBytes;
+    this.perfCounters = perfCounters;
+    this.server = server;
+    this.admissionGate = admissionGate;
+    this.numaNodes = numaNodes;
+  }
+
+  /**
+   * The file in which the server keeps the memory pressure level for the tools that start local
+   * actions, and how long they wait for it to drop below critical at most.
+   */
+  public record AdmissionGate(Path path, Duration maxWait) {
+    /**
+     * Returns the admission gate of the server, which it opens if need be, or null if {@code
+     * --experimental_local_memory_pressure_admission_wait} is not set or the gate cannot be opened.
+     */
+    @Nullable
+    public static AdmissionGate fromCommandEnvironment(CommandEnvironment cmdEnv) {
+      LocalExecutionOptions options = cmdEnv.getOptions().getOptions(LocalExecutionOptions.class);
+      if (options == null || options.localMemoryPressureAdmissionWaitSeconds <= 0) {
+        return null;
+      }
+      Path path = cmdEnv.getOutputBase().getRelative("admission-gate");
+      try {
+        SystemMemoryPressureMonitor.getInstance().openAdmissionGate(path.getPathString());
+      } catch (IOException e) {
+        logger.atWarning().withCause(e).log("Cannot open the admission gate at %s", path);
+        return null;
+      }
+      return new AdmissionGate(
+          path, Duration.ofSeconds(options.localMemoryPressureAdmissionWaitSeconds));
+    }
+  }
+
+  /**
+   * The online NUMA nodes of the machine, which the tools that start local actions bind the actions
+   * to one after the other. The turn is shared by all of them, so that the actions of the
+   * process-wrapper and of the linux-sandbox spread together.
+   */
+  public record NumaNodes(ImmutableList<Integer> nodes) {
+    private static final AtomicInteger nextTurn = new AtomicInteger();
+
+    /**
+     * Returns the nodes to spread local actions across, or null if {@code
+     * --experimental_spread_local_actions_across_numa_nodes} is not set or there is only one.
+     */
+    @Nullable
+    public static NumaNodes fromCommandEnvironment(CommandEnvironment cmdEnv) {
+      LocalExecutionOptions options = cmdEnv.getOptions().getOptions(LocalExecutionOptions.class);
+      if (options == null
+          || !options.spreadLocalActionsAcrossNumaNodes
+          || OS.getCurrent() != OS.LINUX) {
+        return null;
+      }
+      Path online = cmdEnv.getRuntime().getFileSystem().getPath("/sys/devices/system/node/online");
+      ImmutableList<Integer> nodes;
+      try {
+        nodes = parseNodeList(new String(FileSystemUtils.readContentAsLatin1(online)).trim());
+      } catch (IOException | NumberFormatException e) {
+        logger.atWarning().withCause(e).log("Cannot read the NUMA nodes from %s", online);
+        return null;
+      }
+      return nodes.size() > 1 ? new NumaNodes(nodes) : null;
+    }
+
+    /** Parses a node list of the kernel, such as "0-1,4". */
+    @VisibleForTesting
+    static ImmutableList<Integer> parseNodeList(String list) {
+      ImmutableList.Builder<Integer> nodes = ImmutableList.builder();
+      for (String range : Splitter.on(',').omitEmptyStrings().split(list)) {
+        int dash = range.indexOf('-');
+        int first = Integer.parseInt(dash < 0 ? range : range.substring(0, dash));
+        int last = dash < 0 ? first : Integer.parseInt(range.substring(dash + 1));
+        for (int node = first; node <= last; node++) {
+          nodes.add(node);
+        }
+      }
+      return nodes.build();
+    }
+
+    /** Returns the node to bind the next action to. */
+    public int next() {
+      return nodes.get(Math.floorMod(nextTurn.getAndIncrement(), nodes.size()));
+    }
   }
 
   /**
@@ -62,19 +188,51 @@ public final class ProcessWrapper {
     Duration killDelay = options == null ? null : options.getLocalSigkillGraceSeconds();
 
     boolean gracefulSigterm = options != null && options.processWrapperGracefulSigterm;
+    long maxOutputBytes = options == null ? 0 : options.processWrapperMaxOutputBytes;
+    boolean perfCounters = options != null && options.localPerfCounters;
 
     Path path = cmdEnv.getBlazeWorkspace().getBinTools().getEmbeddedPath(BIN_BASENAME);
     if (OS.isPosixCompatible() && path != null && path.exists()) {
-      return new ProcessWrapper(path, killDelay, gracefulSigterm);
+      ProcessWrapperServer server = null;
+      if (options != null && options.processWrapperServer) {
+        server =
+            ProcessWrapperServer.of(
+                path, cmdEnv.getOutputBase().getRelative("process-wrapper.sock"));
+      }
+      return new ProcessWrapper(
+          path,
+          killDelay,
+          gracefulSigterm,
+          maxOutputBytes,
+          perfCounters,
+          server,
+          AdmissionGate.fromCommandEnvironment(cmdEnv),
+          NumaNodes.fromCommandEnvironment(cmdEnv));
     } else {
       return null;
     }
   }
 
+  /**
+   * Returns the factory to start the command lines of {@link #commandLineBuilder} with, or null
+   * to start them as usual.
+   */
+  @Nullable
+  public ProcessWrapperServer getServer() {
+    return server;
+  }
+
   /** Returns a new {@link CommandLineBuilder} for the process-wrapper tool. */
   public CommandLineBuilder commandLineBuilder(List<String> commandArguments) {
     return new CommandLineBuilder(
-        binPath.getPathString(), commandArguments, killDelay, gracefulSigterm);
+        binPath.getPathString(),
+        commandArguments,
+        killDelay,
+        gracefulSigterm,
+        maxOutputBytes,
+        perfCounters,
+        admissionGate,
+        numaNodes);
   }
 
   /**
@@ -86,6 +244,10 @@ public final class ProcessWrapper {
     private final List<String> commandArguments;
     @Nullable private final Duration killDelay;
     private boolean gracefulSigterm;
+    private final long maxOutputBytes;
+    private final boolean perfCounters;
+    @Nullable private final AdmissionGate admissionGate;
+    @Nullable private final NumaNodes numaNodes;
 
     private Path stdoutPath;
     private Path stderrPath;
@@ -96,11 +258,19 @@ public final class ProcessWrapper {
         String processWrapperPath,
         List<String> commandArguments,
         @Nullable Duration killDelay,
-        boolean gracefulSigterm) {
+        boolean gracefulSigterm,
+        long maxOutputBytes,
+        boolean perfCounters,
+        @Nullable AdmissionGate admissionGate,
+        @Nullable NumaNodes numaNodes) {
       this.processWrapperPath = processWrapperPath;
       this.commandArguments = commandArguments;
       this.killDelay = killDelay;
       this.gracefulSigterm = gracefulSigterm;
+      this.maxOutputBytes = maxOutputBytes;
+      this.perfCounters = perfCounters;
+      this.admissionGate = admissionGate;
+      this.numaNodes = numaNodes;
     }
 
     /** Sets the path to use for redirecting stdout, if any. */
@@ -159,10 +329,23 @@ public final class ProcessWrapper {
       }
       if (statisticsPath != null) {
         fullCommandLine.add("--stats=" + statisticsPath);
+        if (perfCounters) {
+          fullCommandLine.add("--perf_counters");
+        }
       }
       if (gracefulSigterm) {
         fullCommandLine.add("--graceful_sigterm");
       }
+      if (maxOutputBytes > 0) {
+        fullCommandLine.add("--max_output_bytes=" + maxOutputBytes);
+      }
+      if (admissionGate != null) {
+        fullCommandLine.add("--admission_gate=" + admissionGate.path());
+        fullCommandLine.add("--admission_wait=" + admissionGate.maxWait().getSeconds());
+      }
+      if (numaNodes != null) {
+        fullCommandLine.add("--numa_node=" + numaNodes.next());
+      }
 
       fullCommandLine.addAll(commandArguments);
 
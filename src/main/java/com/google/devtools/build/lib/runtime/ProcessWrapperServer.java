@@ -0,0 +1,256 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.devtools.build.lib.runtime;
+
+import static java.nio.charset.StandardCharsets.ISO_8859_1;
+
+import com.google.common.collect.ImmutableList;
+import com.google.devtools.build.lib.shell.JavaSubprocessFactory;
+import com.google.devtools.build.lib.shell.Subprocess;
+import com.google.devtools.build.lib.shell.SubprocessBuilder;
+import com.google.devtools.build.lib.shell.SubprocessBuilder.StreamAction;
+import com.google.devtools.build.lib.shell.SubprocessFactory;
+import com.google.devtools.build.lib.vfs.Path;
+import java.io.ByteArrayOutputStream;
+import java.io.File;
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.OutputStream;
+import java.net.UnixDomainSocketAddress;
+import java.nio.ByteBuffer;
+import java.nio.channels.ClosedByInterruptException;
+import java.nio.channels.SocketChannel;
+import java.util.Map;
+import javax.annotation.Nullable;
+
+/**
+ * Runs process-wrapper command lines on a process-wrapper server ({@code --server}), which saves
+ * forking the Bazel server for every command. The server is started on first use and exits by
+ * itself once it has been idle for a while.
+ *
+ * <p>Commands that the server cannot run like the process-wrapper would, because they don't run
+ * the process-wrapper or don't redirect their output to files, are started as usual.
+ */
+public final class ProcessWrapperServer implements SubprocessFactory {
+
+  /** The longest socket path that fits into a {@code sockaddr_un} on all supported systems. */
+  private static final int MAX_SOCKET_PATH_LENGTH = 100;
+
+  /** 128 + SIGKILL, for a command whose handler went away without reporting on it. */
+  private static final int KILLED_EXIT_CODE = 137;
+
+  private final String binPath;
+  private final String socketPath;
+
+  private ProcessWrapperServer(String binPath, String socketPath) {
+    this.binPath = binPath;
+    this.socketPath = socketPath;
+  }
+
+  /** Returns a server listening on {@code socketPath}, or null if the path is too long. */
+  @Nullable
+  public static ProcessWrapperServer of(Path binPath, Path socketPath) {
+    if (socketPath.getPathString().length() > MAX_SOCKET_PATH_LENGTH) {
+      return null;
+    }
+    return new ProcessWrapperServer(binPath.getPathString(), socketPath.getPathString());
+  }
+
+  @Override
+  public Subprocess create(SubprocessBuilder params) throws IOException {
+    ImmutableList<String> argv = params.getArgv();
+    if (!argv.get(0).equals(binPath)
+        || params.getEnv() == null
+        || params.getWorkingDirectory() == null
+        || params.getTimeoutMillis() > 0
+        || params.redirectErrorStream()
+        || params.getStdout() == StreamAction.STREAM
+        || params.getStderr() == StreamAction.STREAM) {
+      return JavaSubprocessFactory.INSTANCE.create(params);
+    }
+
+    // Paths and the other strings are in Bazel's internal encoding, where each character is a
+    // byte.
+    ByteArrayOutputStream request = new ByteArrayOutputStream();
+    addField(request, params.getWorkingDirectory().getPath());
+    for (Map.Entry<String, String> entry : params.getEnv().entrySet()) {
+      addField(request, entry.getKey() + "=" + entry.getValue());
+    }
+    addField(request, "");
+    addField(request, argv.get(0));
+    addField(request, "--stdout=" + redirectPath(params.getStdout(), params.getStdoutFile()));
+    addField(request, "--stderr=" + redirectPath(params.getStderr(), params.getStderrFile()));
+    for (String arg : argv.subList(1, argv.size())) {
+      addField(request, arg);
+    }
+
+    SocketChannel channel = connect();
+    try {
+      ByteBuffer buffer = ByteBuffer.allocate(Integer.BYTES + request.size());
+      buffer.putInt(request.size()).put(request.toByteArray()).flip();
+      while (buffer.hasRemaining()) {
+        channel.write(buffer);
+      }
+    } catch (IOException e) {
+      channel.close();
+      throw e;
+    }
+    return new ServerSubprocess(channel);
+  }
+
+  private static void addField(ByteArrayOutputStream request, String field) {
+    request.writeBytes(field.getBytes(ISO_8859_1));
+    request.write(0);
+  }
+
+  private static String redirectPath(StreamAction action, File file) {
+    return action == StreamAction.DISCARD ? "/dev/null" : file.getPath();
+  }
+
+  private SocketChannel connect() throws IOException {
+    UnixDomainSocketAddress address = UnixDomainSocketAddress.of(socketPath);
+    try {
+      return SocketChannel.open(address);
+    } catch (IOException e) {
+      // The server has not been started yet or has exited since.
+      startServer();
+      return SocketChannel.open(address);
+    }
+  }
+
+  /** Starts the server; the process-wrapper returns once the server listens on the socket. */
+  private synchronized void startServer() throws IOException {
+    Process process =
+        new ProcessBuilder(binPath, "--server=" + socketPath).redirectErrorStream(true).start();
+    process.getOutputStream().close();
+    String output = new String(process.getInputStream().readAllBytes(), ISO_8859_1);
+    int exitCode;
+    try {
+      exitCode = process.waitFor();
+    } catch (InterruptedException e) {
+      process.destroy();
+      Thread.currentThread().interrupt();
+      throw new IOException("Interrupted while starting the process-wrapper server", e);
+    }
+    if (exitCode != 0) {
+      throw new IOException(
+          String.format(
+              "Failed to start the process-wrapper server (exit code %d): %s", exitCode, output));
+    }
+  }
+
+  /**
+   * A command that runs on the server. Closing its side of the connection kills the command, and
+   * the server replies with its exit code once it is gone.
+   */
+  private static final class ServerSubprocess implements Subprocess {
+    private final SocketChannel channel;
+    private volatile int exitCode = -1;
+
+    private ServerSubprocess(SocketChannel channel) {
+      this.channel = channel;
+    }
+
+    @Override
+    public boolean destroy() {
+      try {
+        channel.shutdownOutput();
+      } catch (IOException e) {
+        // The connection is gone already, and so is the command.
+      }
+      return true;
+    }
+
+    @Override
+    public int exitValue() {
+      if (exitCode < 0) {
+        throw new IllegalThreadStateException("The command has not finished yet");
+      }
+      return exitCode;
+    }
+
+    @Override
+    public boolean finished() {
+      return exitCode >= 0;
+    }
+
+    @Override
+    public boolean isAlive() {
+      return exitCode < 0;
+    }
+
+    @Override
+    public boolean timedout() {
+      // The process-wrapper handles the timeout itself.
+      return false;
+    }
+
+    @Override
+    public synchronized void waitFor() throws InterruptedException {
+      if (exitCode >= 0) {
+        return;
+      }
+      ByteBuffer reply = ByteBuffer.allocate(Integer.BYTES);
+      try {
+        while (reply.hasRemaining()) {
+          if (channel.read(reply) < 0) {
+            break;
+          }
+        }
+      } catch (ClosedByInterruptException e) {
+        // Closing the connection kills the command, but we don't know when it is gone.
+        exitCode = KILLED_EXIT_CODE;
+        throw new InterruptedException();
+      } catch (IOException e) {
+        // Treated like a connection that was closed without a reply.
+      }
+      exitCode = reply.hasRemaining() ? KILLED_EXIT_CODE : reply.flip().getInt();
+      close();
+    }
+
+    @Override
+    public OutputStream getOutputStream() {
+      // The command's stdin is /dev/null.
+      return OutputStream.nullOutputStream();
+    }
+
+    @Nullable
+    @Override
+    public InputStream getInputStream() {
+      return null;
+    }
+
+    @Nullable
+    @Override
+    public InputStream getErrorStream() {
+      return null;
+    }
+
+    /** Returns -1, as the server doesn't tell the PID of the command. */
+    @Override
+    public long getProcessId() {
+      return -1;
+    }
+
+    @Override
+    public void close() {
+      try {
+        channel.close();
+      } catch (IOException e) {
+        // Nothing left to clean up.
+      }
+    }
+  }
+}
@@ -38,6 +38,7 @@ import java.util.Set;
 public class LinuxSandboxCommandLineBuilder {
   private final Path linuxSandboxPath;
   private Path hermeticSandboxPath;
+  private Path hermeticTemplateDirectory;
   private Path workingDirectory;
   private Duration timeout;
   private Duration killDelay;
@@ -48,14 +49,27 @@ public class LinuxSandboxCommandLineBuilder {
   private ImmutableSet<PathFragment> tmpfsDirectories = ImmutableSet.of();
   private Map<Path, Path> bindMounts = ImmutableMap.of();
   private Path statisticsPath;
+  private Path accessLogPath;
   private boolean useFakeHostname = false;
   private NetworkNamespace createNetworkNamespace = NetworkNamespace.NO_NETNS;
   private boolean useFakeRoot = false;
   private boolean useFakeUsername = false;
   private boolean enablePseudoterminal = false;
   private String sandboxDebugPath = null;
+  private Path poolDirectory = null;
+  private Path overlayLowerDirectory = null;
+  private Path overlayWorkDirectory = null;
+  private Path lazyInputsManifest = null;
+  private Path lazyInputsStore = null;
+  private Path lazyInputsRequests = null;
+  private long outputTailBytes = 0;
+  private boolean perfCounters = false;
+  private ImmutableList<PathFragment> rootPaths = ImmutableList.of();
   private boolean sigintSendsSigterm = false;
   private Set<java.nio.file.Path> cgroupsDirs = ImmutableSet.of();
+  private Path admissionGate = null;
+  private Duration admissionWait = null;
+  private int numaNode = -1;
 
   private LinuxSandboxCommandLineBuilder(Path linuxSandboxPath) {
     this.linuxSandboxPath = linuxSandboxPath;
@@ -76,6 +90,34 @@ public class LinuxSandboxCommandLineBuilder {
     return this;
   }
 
+  /**
+   * Sets the directory of the templates with the mount points of hermetic sandboxes, to show the
+   * sandbox on top of instead of creating them in it, if any.
+   */
+  @CanIgnoreReturnValue
+  public LinuxSandboxCommandLineBuilder setHermeticTemplateDirectory(Path templateDirectory) {
+    this.hermeticTemplateDirectory = templateDirectory;
+    return this;
+  }
+
+  /**
+   * Sets the admission gate to wait at, for up to {@code maxWait}, before starting the sandbox, if
+   * any.
+   */
+  @CanIgnoreReturnValue
+  public LinuxSandboxCommandLineBuilder setAdmissionGate(Path admissionGate, Duration maxWait) {
+    this.admissionGate = admissionGate;
+    this.admissionWait = maxWait;
+    return this;
+  }
+
+  /** Sets the NUMA node to run the command on, or -1 to leave it where it is. */
+  @CanIgnoreReturnValue
+  public LinuxSandboxCommandLineBuilder setNumaNode(int numaNode) {
+    this.numaNode = numaNode;
+    return this;
+  }
+
   /** Sets the working directory to use, if any. */
   @CanIgnoreReturnValue
   public LinuxSandboxCommandLineBuilder setWorkingDirectory(Path workingDirectory) {
@@ -162,6 +204,16 @@ public class LinuxSandboxCommandLineBuilder {
     return this;
   }
 
+  /**
+   * Sets the path for writing the paths of the files under the working directory that the command
+   * opened, if any.
+   */
+  @CanIgnoreReturnValue
+  public LinuxSandboxCommandLineBuilder setAccessLogPath(Path accessLogPath) {
+    this.accessLogPath = accessLogPath;
+    return this;
+  }
+
   /** Sets whether to use a fake 'localhost' hostname inside the sandbox. */
   @CanIgnoreReturnValue
   public LinuxSandboxCommandLineBuilder setUseFakeHostname(boolean useFakeHostname) {
@@ -208,6 +260,71 @@ public class LinuxSandboxCommandLineBuilder {
     return this;
   }
 
+  /**
+   * Sets the directory of the sandbox pool, whose servers keep namespaces to run commands in
+   * instead of setting up new ones for every command.
+   */
+  @CanIgnoreReturnValue
+  public LinuxSandboxCommandLineBuilder setPoolDirectory(Path poolDirectory) {
+    this.poolDirectory = poolDirectory;
+    return this;
+  }
+
+  /**
+   * Sets the directory to show through the working directory with an overlay, whose upper layer is
+   * the working directory, and the empty work directory of that overlay.
+   */
+  @CanIgnoreReturnValue
+  public LinuxSandboxCommandLineBuilder setOverlay(Path lowerDirectory, Path workDirectory) {
+    this.overlayLowerDirectory = lowerDirectory;
+    this.overlayWorkDirectory = workDirectory;
+    return this;
+  }
+
+  /**
+   * Sets the manifest of the inputs to show, without fetching them first, as the lower layer of the
+   * overlay, the content-addressed store to read their contents from, and the file or pipe to write
+   * the hashes of the missing ones to, or null to fail reading them. Needs {@link #setOverlay}.
+   */
+  @CanIgnoreReturnValue
+  public LinuxSandboxCommandLineBuilder setLazyInputs(
+      Path manifest, Path storeDirectory, Path requestsPath) {
+    this.lazyInputsManifest = manifest;
+    this.lazyInputsStore = storeDirectory;
+    this.lazyInputsRequests = requestsPath;
+    return this;
+  }
+
+  /**
+   * Sets how many bytes of the end of stdout and of stderr to keep, written once the command has
+   * exited; 0 keeps all of the output, written as it comes.
+   */
+  @CanIgnoreReturnValue
+  public LinuxSandboxCommandLineBuilder setOutputTailBytes(long outputTailBytes) {
+    this.outputTailBytes = outputTailBytes;
+    return this;
+  }
+
+  /**
+   * Sets whether to write the hardware performance counters of the command to the statistics, if
+   * the kernel lets the sandbox count them.
+   */
+  @CanIgnoreReturnValue
+  public LinuxSandboxCommandLineBuilder setPerfCounters(boolean perfCounters) {
+    this.perfCounters = perfCounters;
+    return this;
+  }
+
+  /**
+   * Sets the host paths to build the root of the sandbox from, instead of showing all of the
+   * filesystem, if any.
+   */
+  @CanIgnoreReturnValue
+  public LinuxSandboxCommandLineBuilder setRootPaths(ImmutableList<PathFragment> rootPaths) {
+    this.rootPaths = rootPaths;
+    return this;
+  }
+
   /**
    * Sets the directory to be used for cgroups. Cgroups can be used to set limits on resource usage
    * of a subprocess tree, and to gather statistics. Requires cgroups v2 and systemd. This directory
@@ -247,6 +364,13 @@ public class LinuxSandboxCommandLineBuilder {
     if (killDelay != null) {
       commandLineBuilder.add("-t", Long.toString(killDelay.getSeconds()));
     }
+    if (admissionGate != null) {
+      commandLineBuilder.add("-A", admissionGate.getPathString());
+      commandLineBuilder.add("-a", Long.toString(admissionWait.getSeconds()));
+    }
+    if (numaNode >= 0) {
+      commandLineBuilder.add("-u", Integer.toString(numaNode));
+    }
     if (stdoutPath != null) {
       commandLineBuilder.add("-l", stdoutPath.getPathString());
     }
@@ -269,9 +393,18 @@ public class LinuxSandboxCommandLineBuilder {
     }
     if (statisticsPath != null) {
       commandLineBuilder.add("-S", statisticsPath.getPathString());
+      if (perfCounters) {
+        commandLineBuilder.add("-E");
+      }
+    }
+    if (accessLogPath != null) {
+      commandLineBuilder.add("-I", accessLogPath.getPathString());
     }
     if (hermeticSandboxPath != null) {
       commandLineBuilder.add("-h", hermeticSandboxPath.getPathString());
+      if (hermeticTemplateDirectory != null) {
+        commandLineBuilder.add("-x", hermeticTemplateDirectory.getPathString());
+      }
     }
     if (useFakeHostname) {
       commandLineBuilder.add("-H");
@@ -293,6 +426,26 @@ public class LinuxSandboxCommandLineBuilder {
     if (sandboxDebugPath != null) {
       commandLineBuilder.add("-D", sandboxDebugPath);
     }
+    if (poolDirectory != null) {
+      commandLineBuilder.add("-Z", poolDirectory.getPathString());
+    }
+    if (overlayLowerDirectory != null) {
+      commandLineBuilder.add("-o", overlayLowerDirectory.getPathString());
+      commandLineBuilder.add("-O", overlayWorkDirectory.getPathString());
+      if (lazyInputsManifest != null) {
+        commandLineBuilder.add("-f", lazyInputsManifest.getPathString());
+        commandLineBuilder.add("-F", lazyInputsStore.getPathString());
+        if (lazyInputsRequests != null) {
+          commandLineBuilder.add("-g", lazyInputsRequests.getPathString());
+        }
+      }
+    }
+    if (outputTailBytes > 0) {
+      commandLineBuilder.add("-c", Long.toString(outputTailBytes));
+    }
+    for (PathFragment rootPath : rootPaths) {
+      commandLineBuilder.add("-r", rootPath.getPathString());
+    }
     if (sigintSendsSigterm) {
       commandLineBuilder.add("-i");
     }
@@ -14,6 +14,7 @@
 
 package com.google.devtools.build.lib.sandbox;
 
+import static com.google.common.collect.ImmutableList.toImmutableList;
 import static com.google.common.collect.ImmutableSet.toImmutableSet;
 import static com.google.devtools.build.lib.sandbox.LinuxSandboxCommandLineBuilder.NetworkNamespace.NETNS_WITH_LOOPBACK;
 import static com.google.devtools.build.lib.sandbox.LinuxSandboxCommandLineBuilder.NetworkNamespace.NO_NETNS;
@@ -43,6 +44,7 @@ import com.google.devtools.build.lib.exec.local.PosixLocalEnvProvider;
 import com.google.devtools.build.lib.profiler.Profiler;
 import com.google.devtools.build.lib.profiler.SilentCloseable;
 import com.google.devtools.build.lib.runtime.CommandEnvironment;
+import com.google.devtools.build.lib.runtime.ProcessWrapper;
 import com.google.devtools.build.lib.sandbox.SandboxHelpers.SandboxInputs;
 import com.google.devtools.build.lib.sandbox.SandboxHelpers.SandboxOutputs;
 import com.google.devtools.build.lib.sandbox.cgroups.VirtualCgroup;
@@ -135,8 +137,12 @@ final class LinuxSandboxedSpawnRunner extends AbstractSandboxSpawnRunner {
   private final Reporter reporter;
   private final Path slashTmp;
   private final ImmutableSet<Path> knownPathsToMountUnderHermeticTmp;
+  private final ImmutableList<PathFragment> knownRootPaths;
   private String cgroupsDir;
   private final VirtualCgroupFactory cgroupFactory;
+  @Nullable private final ProcessWrapper.AdmissionGate admissionGate;
+  @Nullable private final ProcessWrapper.NumaNodes numaNodes;
+  private final boolean perfCounters;
 
   /**
    * Creates a sandboxed spawn runner that uses the {@code linux-sandbox} tool.
@@ -177,9 +183,25 @@ final class LinuxSandboxedSpawnRunner extends AbstractSandboxSpawnRunner {
     this.timeoutKillDelay = timeoutKillDelay;
     this.localEnvProvider = new PosixLocalEnvProvider(cmdEnv.getClientEnv());
     this.treeDeleter = treeDeleter;
+    this.admissionGate = ProcessWrapper.AdmissionGate.fromCommandEnvironment(cmdEnv);
+    this.numaNodes = ProcessWrapper.NumaNodes.fromCommandEnvironment(cmdEnv);
+    LocalExecutionOptions localExecutionOptions =
+        cmdEnv.getOptions().getOptions(LocalExecutionOptions.class);
+    this.perfCounters = localExecutionOptions != null && localExecutionOptions.localPerfCounters;
     this.reporter = cmdEnv.getReporter();
     this.slashTmp = cmdEnv.getRuntime().getFileSystem().getPath("/tmp");
     this.knownPathsToMountUnderHermeticTmp = collectPathsToMountUnderHermeticTmp(cmdEnv);
+    // What the inputs of actions may be symlinks to, besides the paths given by the user.
+    this.knownRootPaths =
+        Stream.concat(
+                Stream.of(
+                    sandboxBase,
+                    cmdEnv.getOutputBase(),
+                    cmdEnv.getDirectories().getInstallBase()),
+                cmdEnv.getPackageLocator().getPathEntries().stream().map(Root::asPath))
+            .map(Path::asFragment)
+            .distinct()
+            .collect(toImmutableList());
   }
 
   private ImmutableSet<Path> collectPathsToMountUnderHermeticTmp(CommandEnvironment cmdEnv) {
@@ -325,6 +347,19 @@ final class LinuxSandboxedSpawnRunner extends AbstractSandboxSpawnRunner {
       sandboxDebugPath = sandboxPath.getRelative("debug.out");
       commandLineBuilder.setSandboxDebugPath(sandboxDebugPath.getPathString());
     }
+    if (sandboxOptions.linuxSandboxPool) {
+      commandLineBuilder.setPoolDirectory(sandboxBase.getRelative("pool"));
+    }
+    if (sandboxOptions.linuxSandboxOutputTailBytes > 0) {
+      commandLineBuilder.setOutputTailBytes(sandboxOptions.linuxSandboxOutputTailBytes);
+    }
+    if (!sandboxOptions.linuxSandboxRootPaths.isEmpty() && !sandboxOptions.useHermetic) {
+      commandLineBuilder.setRootPaths(
+          ImmutableList.<PathFragment>builder()
+              .addAll(sandboxOptions.linuxSandboxRootPaths)
+              .addAll(knownRootPaths)
+              .build());
+    }
 
     if (cgroupFactory != null) {
       ImmutableMap<String, Double> spawnResourceLimits = ImmutableMap.of();
@@ -348,15 +383,27 @@ final class LinuxSandboxedSpawnRunner extends AbstractSandboxSpawnRunner {
     if (!timeout.isZero()) {
       commandLineBuilder.setTimeout(timeout);
     }
+    if (admissionGate != null) {
+      commandLineBuilder.setAdmissionGate(admissionGate.path(), admissionGate.maxWait());
+    }
+    if (numaNodes != null) {
+      commandLineBuilder.setNumaNode(numaNodes.next());
+    }
     if (spawn.getExecutionInfo().containsKey(ExecutionRequirements.REQUIRES_FAKEROOT)) {
       commandLineBuilder.setUseFakeRoot(true);
     } else if (sandboxOptions.sandboxFakeUsername) {
       commandLineBuilder.setUseFakeUsername(true);
     }
     Path statisticsPath = sandboxPath.getRelative("stats.out");
-    commandLineBuilder.setStatisticsPath(statisticsPath);
+    commandLineBuilder.setStatisticsPath(statisticsPath).setPerfCounters(perfCounters);
+    Path openedInputsPath = getOpenedInputsPath(spawn, sandboxOptions);
     if (sandboxOptions.useHermetic) {
       commandLineBuilder.setHermeticSandboxPath(sandboxPath);
+      commandLineBuilder.setAccessLogPath(openedInputsPath);
+      if (sandboxOptions.hermeticLinuxSandboxTemplates) {
+        commandLineBuilder.setHermeticTemplateDirectory(
+            sandboxBase.getRelative("hermetic-templates"));
+      }
       return new HardlinkedSandboxedSpawn(
           sandboxPath,
           sandboxExecRoot,
@@ -371,6 +418,18 @@ final class LinuxSandboxedSpawnRunner extends AbstractSandboxSpawnRunner {
           sandboxOptions.sandboxDebug,
           spawn.getMnemonic());
     } else {
+      if (sandboxOptions.linuxSandboxOverlayInputs && areAtTheirExecPaths(inputs)) {
+        // The overlay shows the inputs where they are in the execroot, so no symlinks are needed.
+        Path overlayWorkDir = sandboxPath.getRelative("overlay_work");
+        overlayWorkDir.createDirectory();
+        commandLineBuilder
+            .setWorkingDirectory(sandboxExecRoot)
+            .setOverlay(execRoot, overlayWorkDir);
+        inputs = SandboxInputs.getEmptyInputs();
+      } else {
+        // There would be all of the execroot to record under the overlay.
+        commandLineBuilder.setAccessLogPath(openedInputsPath);
+      }
       return new SymlinkedSandboxedSpawn(
           sandboxPath,
           sandboxExecRoot,
@@ -388,6 +447,41 @@ final class LinuxSandboxedSpawnRunner extends AbstractSandboxSpawnRunner {
     }
   }
 
+  /**
+   * Returns where the linux-sandbox is to write the paths of the files of the sandbox that {@code
+   * spawn} opens, if they are to be recorded, creating its directory.
+   */
+  @Nullable
+  private Path getOpenedInputsPath(Spawn spawn, SandboxOptions sandboxOptions)
+      throws IOException {
+    ActionInput primaryOutput = Iterables.getFirst(spawn.getOutputFiles(), null);
+    if (sandboxOptions.linuxSandboxOpenedInputsDir == null || primaryOutput == null) {
+      return null;
+    }
+    Path path =
+        fileSystem
+            .getPath(sandboxOptions.linuxSandboxOpenedInputsDir)
+            .getRelative(primaryOutput.getExecPathString() + ".opened");
+    path.getParentDirectory().createDirectoryAndParents();
+    return path;
+  }
+
+  /**
+   * Returns whether all inputs are files that the action sees at the same path as in the execroot.
+   */
+  private boolean areAtTheirExecPaths(SandboxInputs inputs) {
+    if (!inputs.getSymlinks().isEmpty()) {
+      return false;
+    }
+    for (Map.Entry<PathFragment, Path> input : inputs.getFiles().entrySet()) {
+      Path path = input.getValue();
+      if (path == null || !path.equals(execRoot.getRelative(input.getKey()))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
   @Override
   public String getName() {
     return "linux-sandbox";
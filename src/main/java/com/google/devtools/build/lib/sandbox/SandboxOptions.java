@@ -363,6 +363,90 @@ public class SandboxOptions extends OptionsBase {
               + "then the input files will be copied instead.")
   public boolean useHermetic;
 
+  @Option(
+      name = "experimental_hermetic_linux_sandbox_templates",
+      defaultValue = "false",
+      documentationCategory = OptionDocumentationCategory.EXECUTION_STRATEGY,
+      effectTags = {OptionEffectTag.EXECUTION},
+      help =
+          "If set to true, the hermetic linux-sandbox keeps templates with the mount points of "
+              + "sandboxes in the sandbox base and shows each sandbox on top of one, instead of "
+              + "creating all of the mount points in every sandbox. The sandbox is then read-only "
+              + "except for /tmp, the execroot and the other writable directories. Needs Linux "
+              + "5.11 or later; else the mount points are created as usual. Only has an effect "
+              + "with --experimental_use_hermetic_linux_sandbox.")
+  public boolean hermeticLinuxSandboxTemplates;
+
+  @Option(
+      name = "experimental_linux_sandbox_pool",
+      defaultValue = "false",
+      documentationCategory = OptionDocumentationCategory.EXECUTION_STRATEGY,
+      effectTags = {OptionEffectTag.EXECUTION},
+      help =
+          "If set to true, the linux-sandbox runs actions in namespaces that a background process "
+              + "keeps set up, instead of setting up new namespaces for every action. Has no "
+              + "effect with --experimental_use_hermetic_linux_sandbox.")
+  public boolean linuxSandboxPool;
+
+  @Option(
+      name = "experimental_linux_sandbox_overlay_inputs",
+      defaultValue = "false",
+      documentationCategory = OptionDocumentationCategory.EXECUTION_STRATEGY,
+      effectTags = {OptionEffectTag.EXECUTION},
+      help =
+          "If set to true, the linux-sandbox shows the execroot to actions through an overlay "
+              + "whose upper layer is the sandbox directory, instead of creating a symlink for "
+              + "every input. Setting up the sandbox then takes the same time however many inputs "
+              + "there are, but actions can read all of the execroot, not only their inputs. "
+              + "Actions whose inputs are not at their exec paths still get symlinks. Has no "
+              + "effect with --experimental_use_hermetic_linux_sandbox.")
+  public boolean linuxSandboxOverlayInputs;
+
+  @Option(
+      name = "experimental_linux_sandbox_output_tail_bytes",
+      defaultValue = "0",
+      documentationCategory = OptionDocumentationCategory.EXECUTION_STRATEGY,
+      effectTags = {OptionEffectTag.EXECUTION},
+      help =
+          "If positive, the linux-sandbox keeps only this many bytes of the end of the stdout and "
+              + "of the stderr of actions in memory, and writes them out once the action has "
+              + "exited, instead of writing all of the output to disk as it comes. The output of "
+              + "actions that print more is truncated to its tail, after a line saying how much "
+              + "was dropped. 0 keeps all of the output.")
+  public long linuxSandboxOutputTailBytes;
+
+  @Option(
+      name = "experimental_linux_sandbox_root_path",
+      allowMultiple = true,
+      converter = OptionsUtils.AbsolutePathFragmentConverter.class,
+      defaultValue = "null",
+      documentationCategory = OptionDocumentationCategory.EXECUTION_STRATEGY,
+      effectTags = {OptionEffectTag.EXECUTION},
+      help =
+          "If set, the linux-sandbox builds the filesystem of actions from only these paths of "
+              + "the host, read-only, together with the output base, the install base, the "
+              + "package path and the paths that actions get anyway, instead of making all of the "
+              + "host's filesystem read-only. Setting up the sandbox then takes as long however "
+              + "many mounts the host has. Typical paths are /bin, /etc, /lib, /lib64 and /usr. "
+              + "Has no effect with --experimental_use_hermetic_linux_sandbox.")
+  public List<PathFragment> linuxSandboxRootPaths;
+
+  @Option(
+      name = "experimental_linux_sandbox_opened_inputs_dir",
+      converter = OptionsUtils.AbsolutePathFragmentConverter.class,
+      defaultValue = "null",
+      documentationCategory = OptionDocumentationCategory.EXECUTION_STRATEGY,
+      effectTags = {OptionEffectTag.EXECUTION},
+      help =
+          "If set, the linux-sandbox records which of the files in the sandbox of an action are "
+              + "opened while it runs, and writes their paths to <dir>/<primary output>.opened, "
+              + "one per line. Opens of the same files outside of the sandbox at the same time "
+              + "count too, so the list may name inputs that the action did not read, but none "
+              + "that it read is missed. There is no file if the list is not complete, like when "
+              + "the kernel is older than Linux 5.13 or too many files are recorded at once. "
+              + "Actions with --experimental_linux_sandbox_overlay_inputs are not recorded.")
+  public PathFragment linuxSandboxOpenedInputsDir;
+
   @Option(
       name = "incompatible_sandbox_hermetic_tmp",
       defaultValue = "true",
@@ -19,6 +19,7 @@ import com.google.common.base.Preconditions;
 import com.google.common.base.Strings;
 import com.google.common.collect.ImmutableList;
 import com.google.common.flogger.GoogleLogger;
+import com.google.common.hash.Hashing;
 import com.google.common.net.InetAddresses;
 import com.google.common.util.concurrent.ThreadFactoryBuilder;
 import com.google.devtools.build.lib.bugreport.BugReport;
@@ -63,6 +64,12 @@ import io.grpc.netty.NettyServerBuilder;
 import io.grpc.stub.ServerCallStreamObserver;
 import io.grpc.stub.StreamObserver;
 import io.netty.channel.epoll.Epoll;
+import io.netty.channel.epoll.EpollEventLoopGroup;
+import io.netty.channel.epoll.EpollServerDomainSocketChannel;
+import io.netty.channel.kqueue.KQueue;
+import io.netty.channel.kqueue.KQueueEventLoopGroup;
+import io.netty.channel.kqueue.KQueueServerDomainSocketChannel;
+import io.netty.channel.unix.DomainSocketAddress;
 import io.netty.channel.unix.Socket;
 import java.io.IOException;
 import java.io.OutputStream;
@@ -71,8 +78,10 @@ import java.nio.charset.StandardCharsets;
 import java.security.MessageDigest;
 import java.security.SecureRandom;
 import java.util.Optional;
+import java.util.concurrent.CompletableFuture;
 import java.util.concurrent.Executor;
 import java.util.concurrent.Executors;
+import java.util.concurrent.atomic.AtomicReference;
 import javax.annotation.Nullable;
 
 /**
@@ -114,10 +123,14 @@ public class GrpcServerImpl extends CommandServerGrpc.CommandServerImplBase impl
       PidFileWatcher pidFileWatcher,
       Clock clock,
       int port,
+      boolean unixDomainSocket,
       Path serverDirectory,
       int serverPid,
+      String installMd5,
+      String startupOptionsDigest,
       int maxIdleSeconds,
       boolean shutdownOnLowSysMem,
+      int scopedServerPid,
       boolean idleServerTasks,
       @Nullable String slowInterruptMessageSuffix) {
     SecureRandom random = new SecureRandom();
@@ -127,12 +140,16 @@ public class GrpcServerImpl extends CommandServerGrpc.CommandServerImplBase impl
         pidFileWatcher,
         clock,
         port,
+        unixDomainSocket,
         generateCookie(random, 16),
         generateCookie(random, 16),
         serverDirectory,
         serverPid,
+        installMd5,
+        startupOptionsDigest,
         maxIdleSeconds,
         shutdownOnLowSysMem,
+        scopedServerPid,
         idleServerTasks,
         slowInterruptMessageSuffix);
   }
@@ -243,7 +260,9 @@ public class GrpcServerImpl extends CommandServerGrpc.CommandServerImplBase impl
    * lock.
    */
   private static class RpcOutputStream extends OutputStream {
-    private static final int CHUNK_SIZE = 8192;
+    private static final int DEFAULT_CHUNK_SIZE = 8192;
+    // Stays well below gRPC's default limit of 4MB on received messages.
+    private static final int MAX_CHUNK_SIZE = 1024 * 1024;
 
     // Store commandId and responseCookie as ByteStrings to avoid String -> UTF8 bytes conversion
     // for each serialized chunk of output.
@@ -252,22 +271,30 @@ public class GrpcServerImpl extends CommandServerGrpc.CommandServerImplBase impl
 
     private final StreamType type;
     private final BlockingStreamObserver<RunResponse> observer;
+    private final int chunkSize;
 
+    /**
+     * Creates a stream that sends the output in chunks of at most {@code maxChunkSize} bytes, as
+     * requested by the client, or of the default size if that is not positive.
+     */
     RpcOutputStream(
         String commandId,
         String responseCookie,
         StreamType type,
-        BlockingStreamObserver<RunResponse> observer) {
+        BlockingStreamObserver<RunResponse> observer,
+        int maxChunkSize) {
       this.commandIdBytes = ByteString.copyFromUtf8(commandId);
       this.responseCookieBytes = ByteString.copyFromUtf8(responseCookie);
       this.type = type;
       this.observer = observer;
+      this.chunkSize =
+          maxChunkSize > 0 ? Math.min(maxChunkSize, MAX_CHUNK_SIZE) : DEFAULT_CHUNK_SIZE;
     }
 
     @Override
     public void write(byte[] b, int off, int inlen) throws IOException {
-      for (int i = 0; i < inlen; i += CHUNK_SIZE) {
-        ByteString input = ByteString.copyFrom(b, off + i, Math.min(CHUNK_SIZE, inlen - i));
+      for (int i = 0; i < inlen; i += chunkSize) {
+        ByteString input = ByteString.copyFrom(b, off + i, Math.min(chunkSize, inlen - i));
         RunResponse.Builder response = RunResponse
             .newBuilder()
             .setCookieBytes(responseCookieBytes)
@@ -306,6 +333,11 @@ public class GrpcServerImpl extends CommandServerGrpc.CommandServerImplBase impl
   private static final String REQUEST_COOKIE_FILE = "request_cookie";
   private static final String RESPONSE_COOKIE_FILE = "response_cookie";
   private static final String SERVER_INFO_FILE = "server_info.rawproto";
+  private static final String SOCKET_FILE = "server.socket";
+
+  // The longest socket path that fits in a sockaddr_un with its terminating NUL, which is 104
+  // bytes long on macOS and 108 on Linux.
+  private static final int MAX_SOCKET_PATH_LENGTH = 103;
 
 
   private final CommandManager commandManager;
@@ -318,9 +350,20 @@ public class GrpcServerImpl extends CommandServerGrpc.CommandServerImplBase impl
   private final String responseCookie;
   private final int maxIdleSeconds;
   private final boolean shutdownOnLowSysMem;
+  // The server shuts down when the process of this pid exits, if positive.
+  private final int scopedServerPid;
   private final PidFileWatcher pidFileWatcher;
   private final int serverPid;
+  // Reported to the client on ping, so that it can skip checking whether this server has the
+  // right version and startup options.
+  private final String installMd5;
+  private final String startupOptionsDigest;
   private final int port;
+  // Whether to listen on a Unix domain socket rather than on port, if possible.
+  private final boolean unixDomainSocket;
+  // The digest and the arguments of the last request that passed them in a file.
+  private final AtomicReference<Pair<String, ImmutableList<String>>> lastArgFile =
+      new AtomicReference<>();
 
   private Server server;
   private boolean serving;
@@ -332,12 +375,16 @@ public class GrpcServerImpl extends CommandServerGrpc.CommandServerImplBase impl
       PidFileWatcher pidFileWatcher,
       Clock clock,
       int port,
+      boolean unixDomainSocket,
       String requestCookie,
       String responseCookie,
       Path serverDirectory,
       int serverPid,
+      String installMd5,
+      String startupOptionsDigest,
       int maxIdleSeconds,
       boolean shutdownOnLowSysMem,
+      int scopedServerPid,
       boolean doIdleServerTasks,
       @Nullable String slowInterruptMessageSuffix) {
     this.dispatcher = dispatcher;
@@ -346,14 +393,18 @@ public class GrpcServerImpl extends CommandServerGrpc.CommandServerImplBase impl
 
     this.clock = clock;
     this.port = port;
+    this.unixDomainSocket = unixDomainSocket;
     this.requestCookie = requestCookie;
     this.responseCookie = responseCookie;
 
     this.serverDirectory = serverDirectory;
     this.serverPid = serverPid;
+    this.installMd5 = installMd5;
+    this.startupOptionsDigest = startupOptionsDigest;
 
     this.maxIdleSeconds = maxIdleSeconds;
     this.shutdownOnLowSysMem = shutdownOnLowSysMem;
+    this.scopedServerPid = scopedServerPid;
     this.serving = false;
 
     this.commandExecutorPool =
@@ -428,13 +479,74 @@ public class GrpcServerImpl extends CommandServerGrpc.CommandServerImplBase impl
     return server;
   }
 
+  /**
+   * Starts the server on a Unix domain socket in the server directory or, on Linux if the path of
+   * that is too long for a socket, in the abstract namespace, under a name derived from the server
+   * directory. Returns the address for the client, or null if the server could not be started that
+   * way, and is to listen on a TCP port instead.
+   */
+  @Nullable
+  private String bindDomainSocket() {
+    if (!Epoll.isAvailable() && !KQueue.isAvailable()) {
+      logger.atInfo().log("Unix domain sockets are not supported here, using TCP");
+      return null;
+    }
+    Path socketFile = serverDirectory.getChild(SOCKET_FILE);
+    String socketPath = socketFile.getPathString();
+    String target;
+    if (socketPath.getBytes(StandardCharsets.UTF_8).length <= MAX_SOCKET_PATH_LENGTH) {
+      target = "unix:" + socketPath;
+    } else if (Epoll.isAvailable()) {
+      // Anybody can connect to it, like to a TCP port, and is then asked for the request cookie.
+      String name =
+          "bazel-server-"
+              + Hashing.sha256()
+                  .hashString(serverDirectory.getPathString(), StandardCharsets.UTF_8)
+                  .toString()
+                  .substring(0, 32);
+      socketFile = null;
+      socketPath = "\0" + name;
+      target = "unix-abstract:" + name;
+    } else {
+      logger.atInfo().log("%s is too long for a Unix domain socket, using TCP", socketPath);
+      return null;
+    }
+
+    try {
+      if (socketFile != null) {
+        // Left over by a server that did not exit cleanly.
+        socketFile.delete();
+      }
+      NettyServerBuilder builder =
+          NettyServerBuilder.forAddress(new DomainSocketAddress(socketPath))
+              .addService(this)
+              .directExecutor();
+      if (Epoll.isAvailable()) {
+        builder
+            .channelType(EpollServerDomainSocketChannel.class)
+            .bossEventLoopGroup(new EpollEventLoopGroup(1))
+            .workerEventLoopGroup(new EpollEventLoopGroup());
+      } else {
+        builder
+            .channelType(KQueueServerDomainSocketChannel.class)
+            .bossEventLoopGroup(new KQueueEventLoopGroup(1))
+            .workerEventLoopGroup(new KQueueEventLoopGroup());
+      }
+      server = builder.build().start();
+    } catch (IOException e) {
+      logger.atWarning().withCause(e).log("Cannot listen on %s, using TCP", target);
+      return null;
+    }
+    if (socketFile != null) {
+      shutdownHooks.deleteAtExit(socketFile);
+    }
+    return target;
+  }
+
   // Suppress ErrorProne warnings for hardcoding "[::1]" and "127.0.0.1" instead of
   // InetAddress.getLoopbackAddress().
   @SuppressWarnings("AddressSelection")
-  @Override
-  public void serve() throws AbruptExitException {
-    Preconditions.checkState(!serving);
-
+  private String bindTcp() throws AbruptExitException {
     // For reasons only Apple knows, you cannot bind to IPv4-localhost when you run in a sandbox
     // that only allows loopback traffic, but binding to IPv6-localhost works fine. This would
     // however break on systems that don't support IPv6. So what we'll do is to try to bind to IPv6
@@ -471,6 +583,17 @@ public class GrpcServerImpl extends CommandServerGrpc.CommandServerImplBase impl
             ipv4Exception);
       }
     }
+    return InetAddresses.toUriString(address.getAddress()) + ":" + server.getPort();
+  }
+
+  @Override
+  public void serve() throws AbruptExitException {
+    Preconditions.checkState(!serving);
+
+    String address = unixDomainSocket ? bindDomainSocket() : null;
+    if (address == null) {
+      address = bindTcp();
+    }
 
     if (maxIdleSeconds > 0) {
       Thread timeoutAndMemoryCheckingThread =
@@ -481,6 +604,19 @@ public class GrpcServerImpl extends CommandServerGrpc.CommandServerImplBase impl
       timeoutAndMemoryCheckingThread.setDaemon(true);
       timeoutAndMemoryCheckingThread.start();
     }
+    if (scopedServerPid > 0) {
+      // A process that is already gone makes the server shut down right away.
+      Server scopedServer = server;
+      ProcessHandle.of(scopedServerPid)
+          .map(ProcessHandle::onExit)
+          .orElse(CompletableFuture.completedFuture(null))
+          .thenRun(
+              () -> {
+                logger.atInfo().log(
+                    "Process %d exited, shutting down the scoped server", scopedServerPid);
+                scopedServer.shutdown();
+              });
+    }
     serving = true;
 
     writeServerStatusFiles(address);
@@ -493,8 +629,7 @@ public class GrpcServerImpl extends CommandServerGrpc.CommandServerImplBase impl
     }
   }
 
-  private void writeServerStatusFiles(InetSocketAddress address) throws AbruptExitException {
-    String addressString = InetAddresses.toUriString(address.getAddress()) + ":" + server.getPort();
+  private void writeServerStatusFiles(String addressString) throws AbruptExitException {
     writeServerFile(PORT_FILE, addressString);
     writeServerFile(REQUEST_COOKIE_FILE, requestCookie);
     writeServerFile(RESPONSE_COOKIE_FILE, responseCookie);
@@ -531,26 +666,83 @@ public class GrpcServerImpl extends CommandServerGrpc.CommandServerImplBase impl
     shutdownHooks.deleteAtExit(file);
   }
 
+  /**
+   * Returns the arguments of the request, reading them from its argument file if it has one.
+   *
+   * <p>The arguments of the last request with an argument file are kept, so a client passing the
+   * same long list again (e.g. a long target list with unchanged rc files and environment) does
+   * not make the server read and decode it again.
+   */
+  private ImmutableList<String> getArgs(RunRequest request) throws IOException {
+    // UTF-8 won't do because we want to be able to pass arbitrary binary strings.
+    // Not that the internals of Bazel handle that correctly, but why not make at least this
+    // little part correct?
+    if (request.getArgFile().isEmpty()) {
+      return request.getArgList().stream()
+          .map(arg -> arg.toString(StandardCharsets.ISO_8859_1))
+          .collect(ImmutableList.toImmutableList());
+    }
+    String digest = request.getArgFileDigest();
+    Pair<String, ImmutableList<String>> last = lastArgFile.get();
+    if (!digest.isEmpty() && last != null && last.getFirst().equals(digest)) {
+      return last.getSecond();
+    }
+    byte[] content = FileSystemUtils.readContent(serverDirectory.getChild(request.getArgFile()));
+    ImmutableList.Builder<String> args = ImmutableList.builder();
+    int start = 0;
+    for (int i = 0; i < content.length; i++) {
+      if (content[i] == 0) {
+        args.add(new String(content, start, i - start, StandardCharsets.ISO_8859_1));
+        start = i + 1;
+      }
+    }
+    ImmutableList<String> result = args.build();
+    if (!digest.isEmpty()) {
+      lastArgFile.set(Pair.of(digest, result));
+    }
+    return result;
+  }
+
+  private static void rejectRequest(
+      BlockingStreamObserver<RunResponse> observer, FailureDetail failureDetail) {
+    try {
+      observer.onNext(
+          RunResponse.newBuilder()
+              .setFinished(true)
+              .setExitCode(ExitCode.LOCAL_ENVIRONMENTAL_ERROR.getNumericExitCode())
+              .setFailureDetail(failureDetail)
+              .build());
+      observer.onCompleted();
+    } catch (StatusRuntimeException e) {
+      logger.atInfo().withCause(e).log("Client cancelled command while rejecting it");
+    }
+  }
+
   private void executeCommand(RunRequest request, BlockingStreamObserver<RunResponse> observer) {
     boolean badCookie = !isValidRequestCookie(request.getCookie());
     if (badCookie || request.getClientDescription().isEmpty()) {
-      try {
-        FailureDetail failureDetail =
-            badCookie
-                ? createFailureDetail("Invalid RunRequest: bad cookie", GrpcServer.Code.BAD_COOKIE)
-                : createFailureDetail(
-                    "Invalid RunRequest: no client description",
-                    GrpcServer.Code.NO_CLIENT_DESCRIPTION);
-        observer.onNext(
-            RunResponse.newBuilder()
-                .setFinished(true)
-                .setExitCode(ExitCode.LOCAL_ENVIRONMENTAL_ERROR.getNumericExitCode())
-                .setFailureDetail(failureDetail)
-                .build());
-        observer.onCompleted();
-      } catch (StatusRuntimeException e) {
-        logger.atInfo().withCause(e).log("Client cancelled command while rejecting it");
-      }
+      rejectRequest(
+          observer,
+          badCookie
+              ? createFailureDetail("Invalid RunRequest: bad cookie", GrpcServer.Code.BAD_COOKIE)
+              : createFailureDetail(
+                  "Invalid RunRequest: no client description",
+                  GrpcServer.Code.NO_CLIENT_DESCRIPTION));
+      return;
+    }
+
+    ImmutableList<String> args;
+    try {
+      args = getArgs(request);
+    } catch (IOException | IllegalArgumentException e) {
+      rejectRequest(
+          observer,
+          createFailureDetail(
+              "Invalid RunRequest: cannot read argument file '"
+                  + request.getArgFile()
+                  + "': "
+                  + e.getMessage(),
+              GrpcServer.Code.ARG_FILE_UNREADABLE));
       return;
     }
 
@@ -590,17 +782,20 @@ public class GrpcServerImpl extends CommandServerGrpc.CommandServerImplBase impl
 
       OutErr rpcOutErr =
           OutErr.create(
-              new RpcOutputStream(command.getId(), responseCookie, StreamType.STDOUT, observer),
-              new RpcOutputStream(command.getId(), responseCookie, StreamType.STDERR, observer));
+              new RpcOutputStream(
+                  command.getId(),
+                  responseCookie,
+                  StreamType.STDOUT,
+                  observer,
+                  request.getMaxOutputChunkSize()),
+              new RpcOutputStream(
+                  command.getId(),
+                  responseCookie,
+                  StreamType.STDERR,
+                  observer,
+                  request.getMaxOutputChunkSize()));
 
       try {
-        // UTF-8 won't do because we want to be able to pass arbitrary binary strings.
-        // Not that the internals of Bazel handle that correctly, but why not make at least this
-        // little part correct?
-        ImmutableList<String> args = request.getArgList().stream()
-            .map(arg -> arg.toString(StandardCharsets.ISO_8859_1))
-            .collect(ImmutableList.toImmutableList());
-
         InvocationPolicy policy = InvocationPolicyParser.parsePolicy(request.getInvocationPolicy());
         logger.atInfo().log("%s", SafeRequestLogging.getRequestLogString(args));
         result =
@@ -681,7 +876,10 @@ public class GrpcServerImpl extends CommandServerGrpc.CommandServerImplBase impl
     try (RunningCommand command = commandManager.createCommand()) {
       PingResponse.Builder response = PingResponse.newBuilder();
       if (isValidRequestCookie(pingRequest.getCookie())) {
-        response.setCookie(responseCookie);
+        response
+            .setCookie(responseCookie)
+            .setInstallMd5(installMd5)
+            .setStartupOptionsDigest(startupOptionsDigest);
       }
 
       streamObserver.onNext(response.build());
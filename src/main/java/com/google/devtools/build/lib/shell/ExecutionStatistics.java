@@ -37,7 +37,12 @@ public final class ExecutionStatistics {
       Protos.ExecutionStatistics executionStatisticsProto =
           Protos.ExecutionStatistics.parseFrom(protoInputStream);
       if (executionStatisticsProto.hasResourceUsage()) {
-        return Optional.of(new ResourceUsage(executionStatisticsProto.getResourceUsage()));
+        return Optional.of(
+            new ResourceUsage(
+                executionStatisticsProto.getResourceUsage(),
+                executionStatisticsProto.hasCgroupStatistics()
+                    ? Optional.of(executionStatisticsProto.getCgroupStatistics())
+                    : Optional.empty()));
       } else {
         return Optional.empty();
       }
@@ -48,16 +53,78 @@ public final class ExecutionStatistics {
     }
   }
 
+  /**
+   * Provides execution statistics of a finished subprocess that the system accounted for itself,
+   * without a wrapper writing a {@code execution_statistics.proto} file. This is the case for the
+   * job objects that processes run in on Windows.
+   *
+   * <p>The job's totals are reported as {@link Protos.CgroupStatistics}, since they cover all
+   * processes of the command like those of a cgroup do.
+   *
+   * @param subprocess a subprocess that has been waited for
+   * @return a {@link ResourceUsage} object containing execution statistics, if available
+   */
+  public static Optional<ResourceUsage> getResourceUsage(Subprocess subprocess) {
+    if (!(subprocess instanceof WindowsSubprocess windowsSubprocess)) {
+      return Optional.empty();
+    }
+    long[] usage = windowsSubprocess.getResourceUsage();
+    if (usage == null) {
+      return Optional.empty();
+    }
+    long userTimeUsec = usage[0];
+    long kernelTimeUsec = usage[1];
+    Protos.ResourceUsage resourceUsage =
+        Protos.ResourceUsage.newBuilder()
+            .setUtimeSec(userTimeUsec / 1_000_000)
+            .setUtimeUsec(userTimeUsec % 1_000_000)
+            .setStimeSec(kernelTimeUsec / 1_000_000)
+            .setStimeUsec(kernelTimeUsec % 1_000_000)
+            .setInblock(usage[2])
+            .setOublock(usage[3])
+            // In kilobytes, like getrusage() reports it on Linux.
+            .setMaxrss(usage[6] / 1024)
+            .build();
+    Protos.CgroupStatistics jobStatistics =
+        Protos.CgroupStatistics.newBuilder()
+            .setCpuUsageUsec(userTimeUsec + kernelTimeUsec)
+            .setIoReadBytes(usage[4])
+            .setIoWriteBytes(usage[5])
+            .setMemoryPeakBytes(usage[7])
+            .build();
+    return Optional.of(new ResourceUsage(resourceUsage, Optional.of(jobStatistics)));
+  }
+
   /**
    * Provides resource usage statistics for command execution, derived from the getrusage() system
    * call.
    */
   public static class ResourceUsage {
     private final Protos.ResourceUsage resourceUsageProto;
+    private final Optional<Protos.CgroupStatistics> cgroupStatisticsProto;
 
     /** Provides resource usage statistics via a ResourceUsage proto object. */
     public ResourceUsage(Protos.ResourceUsage resourceUsageProto) {
+      this(resourceUsageProto, Optional.empty());
+    }
+
+    /**
+     * Provides resource usage statistics via a ResourceUsage proto object, and the statistics of
+     * the cgroup that the command ran in, if any.
+     */
+    public ResourceUsage(
+        Protos.ResourceUsage resourceUsageProto,
+        Optional<Protos.CgroupStatistics> cgroupStatisticsProto) {
       this.resourceUsageProto = resourceUsageProto;
+      this.cgroupStatisticsProto = cgroupStatisticsProto;
+    }
+
+    /**
+     * Returns the statistics of the cgroup v2 that the command ran in, which cover all of its
+     * processes, if it ran in one.
+     */
+    public Optional<Protos.CgroupStatistics> getCgroupStatistics() {
+      return cgroupStatisticsProto;
     }
 
     /** Returns the user time for command execution, if available. */
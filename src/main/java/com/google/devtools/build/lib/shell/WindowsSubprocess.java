@@ -299,6 +299,15 @@ public class WindowsSubprocess implements Subprocess {
     return nativeState.stderrStream;
   }
 
+  /**
+   * Returns what the process and its subprocesses used, in the layout documented by {@link
+   * WindowsProcesses#getResourceUsage}, or null if that is not known (yet).
+   */
+  synchronized long[] getResourceUsage() {
+    checkLiveness();
+    return WindowsProcesses.getResourceUsage(nativeState.nativeProcess);
+  }
+
   private synchronized void writeStdin(byte[] b, int off, int len) throws IOException {
     checkLiveness();
 
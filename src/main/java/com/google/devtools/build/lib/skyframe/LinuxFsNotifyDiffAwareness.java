@@ -0,0 +1,168 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.devtools.build.lib.skyframe;
+
+import com.google.common.base.Preconditions;
+import com.google.common.collect.ImmutableSet;
+import com.google.devtools.build.lib.jni.JniLoader;
+import com.google.devtools.common.options.OptionsProvider;
+import java.io.IOException;
+import java.nio.file.Path;
+import java.nio.file.Paths;
+import java.util.concurrent.CountDownLatch;
+
+/**
+ * A {@link DiffAwareness} that watches the filesystem natively on Linux, to use in lieu of {@link
+ * WatchServiceDiffAwareness}.
+ *
+ * <p>The WatchService registers every directory from Java and hands out events one directory at a
+ * time. The native watcher marks the whole filesystem with fanotify where the server is allowed to
+ * (which takes CAP_SYS_ADMIN), so that setting it up doesn't walk the tree, and otherwise sets up
+ * the inotify watches itself. Either way, it coalesces the changed paths until the next poll.
+ */
+public final class LinuxFsNotifyDiffAwareness extends LocalDiffAwareness {
+  private final ImmutableSet<Path> ignoredPaths;
+
+  private boolean closed;
+
+  // Keep a pointer to a native structure in the JNI code (the thread reading the events needs that
+  // structure).
+  private long nativePointer;
+
+  private boolean opened;
+
+  /**
+   * Watch changes on the file system under <code>watchRoot</code>, except for those under
+   * <code>ignoredPaths</code>.
+   */
+  LinuxFsNotifyDiffAwareness(String watchRoot, ImmutableSet<Path> ignoredPaths) {
+    super(watchRoot);
+    this.ignoredPaths = ignoredPaths;
+  }
+
+  /** Returns whether the native watcher can be used by this server. */
+  static boolean isAvailable() {
+    return JNI_AVAILABLE;
+  }
+
+  /**
+   * Helper function to start the watch of <code>root</code>, called by {@link #init}.
+   *
+   * @throws IOException if the root cannot be watched, e.g. because there are not enough inotify
+   *     watches left for the directories under it
+   */
+  private native void create(String root, String[] ignoredPaths) throws IOException;
+
+  /**
+   * Runs the main loop to listen for events, until {@link #doClose} is called.
+   *
+   * @param listening latch that is decremented when the loop has started. The caller must wait
+   *     until this happens before closing.
+   */
+  private native void run(CountDownLatch listening);
+
+  private void init() throws IOException {
+    Preconditions.checkState(!opened);
+    create(
+        watchRootPath.toAbsolutePath().toString(),
+        ignoredPaths.stream().map(Path::toString).toArray(String[]::new));
+    opened = true;
+
+    CountDownLatch listening = new CountDownLatch(1);
+    Thread thread =
+        new Thread(() -> LinuxFsNotifyDiffAwareness.this.run(listening), "linux-fs-notify");
+    thread.setDaemon(true);
+    thread.start();
+    try {
+      listening.await();
+    } catch (InterruptedException e) {
+      Thread.currentThread().interrupt();
+    }
+  }
+
+  /** Close this watch service, this service should not be used any longer after closing. */
+  @Override
+  public void close() {
+    if (opened && !closed) {
+      closed = true;
+      doClose();
+    }
+  }
+
+  private static final boolean JNI_AVAILABLE;
+
+  /** JNI code stopping the main loop and releasing the watches. */
+  private native void doClose();
+
+  /**
+   * JNI code returning the list of absolute path modified since last call.
+   *
+   * @return the list of paths modified since the last call, or null if we can't precisely tell what
+   *     changed
+   * @throws IOException if the root can no longer be watched
+   */
+  private native String[] poll() throws IOException;
+
+  static {
+    boolean loadJniWorked = false;
+    try {
+      JniLoader.loadJni();
+      loadJniWorked = true;
+    } catch (UnsatisfiedLinkError ignored) {
+      // See MacOSXFsEventsDiffAwareness; the bootstrap binary has no JNI code.
+    }
+    JNI_AVAILABLE = loadJniWorked;
+  }
+
+  @Override
+  public View getCurrentView(OptionsProvider options) throws BrokenDiffAwarenessException {
+    if (!JNI_AVAILABLE) {
+      return EVERYTHING_MODIFIED;
+    }
+    // See WatchServiceDiffAwareness#getCurrentView for an explanation of this logic.
+    boolean watchFs = options.getOptions(Options.class).watchFS;
+    if (watchFs && !opened) {
+      try {
+        init();
+      } catch (IOException e) {
+        throw new BrokenDiffAwarenessException(
+            "Error encountered with local file system watcher " + e);
+      }
+    } else if (!watchFs && opened) {
+      close();
+      throw new BrokenDiffAwarenessException("Switched off --watchfs again");
+    } else if (!opened) {
+      return EVERYTHING_MODIFIED;
+    }
+    Preconditions.checkState(!closed);
+    String[] polledPaths;
+    try {
+      polledPaths = poll();
+    } catch (IOException e) {
+      close();
+      throw new BrokenDiffAwarenessException(
+          "Error encountered with local file system watcher " + e);
+    }
+    if (polledPaths == null) {
+      return EVERYTHING_MODIFIED;
+    } else {
+      ImmutableSet.Builder<Path> paths = ImmutableSet.builder();
+      for (String path : polledPaths) {
+        paths.add(Paths.get(path));
+      }
+      return newView(paths.build());
+    }
+  }
+}
@@ -36,12 +36,13 @@ import javax.annotation.Nullable;
 
 /**
  * File system watcher for local filesystems. It's able to provide a list of changed files between
- * two consecutive calls. On Linux, uses the standard Java WatchService, which uses 'inotify' and,
- * on OS X, uses {@link MacOSXFsEventsDiffAwareness}, which use FSEvents.
+ * two consecutive calls. On Linux, uses the standard Java WatchService, which uses 'inotify', or
+ * {@link LinuxFsNotifyDiffAwareness} with --experimental_native_linux_watchfs and, on OS X, uses
+ * {@link MacOSXFsEventsDiffAwareness}, which use FSEvents.
  *
  * <p>
- * This is an abstract class, specialized by {@link MacOSXFsEventsDiffAwareness} and
- * {@link WatchServiceDiffAwareness}.
+ * This is an abstract class, specialized by {@link LinuxFsNotifyDiffAwareness}, {@link
+ * MacOSXFsEventsDiffAwareness} and {@link WatchServiceDiffAwareness}.
  */
 public abstract class LocalDiffAwareness implements DiffAwareness {
   /**
@@ -71,6 +72,18 @@ public abstract class LocalDiffAwareness implements DiffAwareness {
             "If true, experimental Windows support for --watchfs is enabled. Otherwise --watchfs"
                 + "is a non-op on Windows. Make sure to also enable --watchfs.")
     public boolean windowsWatchFS;
+
+    @Option(
+        name = "experimental_native_linux_watchfs",
+        defaultValue = "false",
+        documentationCategory = OptionDocumentationCategory.UNCATEGORIZED,
+        effectTags = {OptionEffectTag.UNKNOWN},
+        help =
+            "If true, --watchfs on Linux watches the filesystem natively, with fanotify where "
+                + "%{product} has the privileges for it and with inotify otherwise, instead of "
+                + "through the Java WatchService. Takes effect once the watcher is set up again, "
+                + "e.g. after a build with --nowatchfs.")
+    public boolean nativeLinuxWatchFS;
   }
 
   /** Factory for creating {@link LocalDiffAwareness} instances. */
@@ -111,9 +124,18 @@ public abstract class LocalDiffAwareness implements DiffAwareness {
         return new MacOSXFsEventsDiffAwareness(resolvedPathEntryFragment.toString());
       }
 
-      return new WatchServiceDiffAwareness(
-          resolvedPathEntryFragment.toString(),
-          ignoredPaths.stream().map(p -> Path.of(p.toString())).collect(toImmutableSet()));
+      ImmutableSet<Path> ignoredNioPaths =
+          ignoredPaths.stream().map(p -> Path.of(p.toString())).collect(toImmutableSet());
+      Options options = optionsProvider.getOptions(Options.class);
+      if (OS.getCurrent() == OS.LINUX
+          && options != null
+          && options.nativeLinuxWatchFS
+          && LinuxFsNotifyDiffAwareness.isAvailable()) {
+        return new LinuxFsNotifyDiffAwareness(
+            resolvedPathEntryFragment.toString(), ignoredNioPaths);
+      }
+
+      return new WatchServiceDiffAwareness(resolvedPathEntryFragment.toString(), ignoredNioPaths);
     }
   }
 
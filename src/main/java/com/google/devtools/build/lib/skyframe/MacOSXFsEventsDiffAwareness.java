@@ -14,6 +14,8 @@
 
 package com.google.devtools.build.lib.skyframe;
 
+import static java.nio.charset.StandardCharsets.UTF_8;
+
 import com.google.common.base.Preconditions;
 import com.google.common.collect.ImmutableSet;
 import com.google.devtools.build.lib.jni.JniLoader;
@@ -110,10 +112,10 @@ public final class MacOSXFsEventsDiffAwareness extends LocalDiffAwareness {
   /**
    * JNI code returning the list of absolute path modified since last call.
    *
-   * @return the list of paths modified since the last call, or null if we can't precisely tell what
-   *     changed
+   * @return the UTF-8 encoded paths modified since the last call, each followed by a NUL byte, or
+   *     null if we can't precisely tell what changed
    */
-  private native String[] poll();
+  private native byte[] poll();
 
   static {
     boolean loadJniWorked = false;
@@ -147,13 +149,17 @@ public final class MacOSXFsEventsDiffAwareness extends LocalDiffAwareness {
       return EVERYTHING_MODIFIED;
     }
     Preconditions.checkState(!closed);
-    String[] polledPaths = poll();
+    byte[] polledPaths = poll();
     if (polledPaths == null) {
       return EVERYTHING_MODIFIED;
     } else {
       ImmutableSet.Builder<Path> paths = ImmutableSet.builder();
-      for (String path : polledPaths) {
-        paths.add(Paths.get(path));
+      int start = 0;
+      for (int i = 0; i < polledPaths.length; i++) {
+        if (polledPaths[i] == 0) {
+          paths.add(Paths.get(new String(polledPaths, start, i - start, UTF_8)));
+          start = i + 1;
+        }
       }
       return newView(paths.build());
     }
@@ -43,17 +43,17 @@ public class ErrnoFileStatus extends FileStatus {
     ENODATA = constants.errnoENODATA;
   }
 
-  /** Constructs a ErrnoFileSatus instance. (Called only from JNI code.) */
-  private ErrnoFileStatus(
+  /** Constructs a ErrnoFileSatus instance. (Called from JNI code and {@link NativePosixFiles}.) */
+  ErrnoFileStatus(
       int mode, long atime, long mtime, long ctime, long size, int dev, long ino) {
     super(mode, atime, mtime, ctime, size, dev, ino);
     this.errno = 0;
   }
 
   /**
-   * Constructs a ErrnoFileSatus instance.  (Called only from JNI code.)
+   * Constructs a ErrnoFileSatus instance.  (Called from JNI code and {@link NativePosixFiles}.)
    */
-  private ErrnoFileStatus(int errno) {
+  ErrnoFileStatus(int errno) {
     super(0, 0, 0, 0, 0, 0, 0);
     this.errno = errno;
   }
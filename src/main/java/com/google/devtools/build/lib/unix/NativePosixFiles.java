@@ -14,13 +14,17 @@
 
 package com.google.devtools.build.lib.unix;
 
+import static java.nio.charset.StandardCharsets.ISO_8859_1;
+
 import com.google.common.annotations.VisibleForTesting;
 import com.google.common.flogger.GoogleLogger;
 import com.google.devtools.build.lib.jni.JniLoader;
 import com.google.devtools.build.lib.util.Blocker;
 import java.io.FileNotFoundException;
 import java.io.IOException;
+import java.nio.ByteBuffer;
 import java.util.logging.LogManager;
+import javax.annotation.Nullable;
 
 /**
  * Utility methods for access to UNIX filesystem calls not exposed by the Java
@@ -128,6 +132,121 @@ public final class NativePosixFiles {
    */
   public static native ErrnoFileStatus errnoLstat(String path);
 
+  /**
+   * Stats many files in one call, like {@link #errnoStat} or {@link #errnoLstat} would stat each
+   * of them, but without creating a {@link FileStatus} per file.
+   *
+   * @param dir the directory that relative paths are relative to, or null for the working
+   *     directory
+   * @param paths the files to stat
+   * @param followSymlinks whether to follow a symlink at the end of each path
+   * @param threads how many threads to stat the files on at most. Small batches use fewer.
+   * @return the results, element {@code i} of each array being that of {@code paths[i]}
+   * @throws IOException if {@code dir} cannot be opened
+   */
+  public static BatchStats statBatch(
+      @Nullable String dir, String[] paths, boolean followSymlinks, int threads)
+      throws IOException {
+    BatchStats stats = new BatchStats(paths.length);
+    var comp = Blocker.begin();
+    try {
+      statBatch(
+          dir,
+          paths,
+          followSymlinks,
+          threads,
+          stats.errnos,
+          stats.modes,
+          stats.sizes,
+          stats.lastModifiedTimes,
+          stats.lastChangeTimes,
+          stats.inodes,
+          stats.devices);
+    } finally {
+      Blocker.end(comp);
+    }
+    return stats;
+  }
+
+  private static native void statBatch(
+      String dir,
+      String[] paths,
+      boolean followSymlinks,
+      int threads,
+      int[] errnos,
+      int[] modes,
+      long[] sizes,
+      long[] lastModifiedTimes,
+      long[] lastChangeTimes,
+      long[] inodes,
+      int[] devices)
+      throws IOException;
+
+  /**
+   * The results of {@link #statBatch}, in parallel arrays with one element per file. The other
+   * elements of a file whose errno is not 0 are 0. Times are in milliseconds since the epoch, like
+   * those of {@link FileStatus}.
+   */
+  public static final class BatchStats {
+    public final int[] errnos;
+    public final int[] modes;
+    public final long[] sizes;
+    public final long[] lastModifiedTimes;
+    public final long[] lastChangeTimes;
+    public final long[] inodes;
+    public final int[] devices;
+
+    private BatchStats(int size) {
+      this(
+          new int[size],
+          new int[size],
+          new long[size],
+          new long[size],
+          new long[size],
+          new long[size],
+          new int[size]);
+    }
+
+    private BatchStats(
+        int[] errnos,
+        int[] modes,
+        long[] sizes,
+        long[] lastModifiedTimes,
+        long[] lastChangeTimes,
+        long[] inodes,
+        int[] devices) {
+      this.errnos = errnos;
+      this.modes = modes;
+      this.sizes = sizes;
+      this.lastModifiedTimes = lastModifiedTimes;
+      this.lastChangeTimes = lastChangeTimes;
+      this.inodes = inodes;
+      this.devices = devices;
+    }
+
+    public int size() {
+      return errnos.length;
+    }
+
+    /**
+     * Returns the status of the i-th file as {@link #errnoStat} would, except that its last access
+     * time is 0.
+     */
+    public ErrnoFileStatus get(int i) {
+      if (errnos[i] != 0) {
+        return new ErrnoFileStatus(errnos[i]);
+      }
+      return new ErrnoFileStatus(
+          modes[i],
+          /* atime= */ 0,
+          lastModifiedTimes[i],
+          lastChangeTimes[i],
+          sizes[i],
+          devices[i],
+          inodes[i]);
+    }
+  }
+
   /**
    * Native wrapper around POSIX utimensat(2) syscall.
    *
@@ -167,6 +286,23 @@ public final class NativePosixFiles {
    */
   public static native boolean mkdirWritable(String path);
 
+  /**
+   * Makes sure writable directories exist at the given paths below an existing directory, as
+   * {@link #mkdirWritable} would for each of them and their ancestors below it, from the top down.
+   * Each directory is made relative to an open descriptor of its parent, and each common ancestor
+   * only once.
+   *
+   * <p>Symlinks below {@code root} are not followed: one in the way of a directory fails it.
+   *
+   * @param root the directory that {@code dirs} are relative to
+   * @param dirs normalized relative paths of the directories to make
+   * @param results receives, for each directory, 1 if it was created, 0 if it already existed, or
+   *     the negated errno of why it or one of its ancestors could not be made
+   * @throws IOException if {@code root} cannot be opened
+   */
+  public static native void mkdirsWritable(String root, String[] dirs, int[] results)
+      throws IOException;
+
   /**
    * Implements (effectively) mkdir -p.
    *
@@ -211,6 +347,89 @@ public final class NativePosixFiles {
 
   private static native Dirents readdir(String path, char typeCode) throws IOException;
 
+  /**
+   * Reads a directory in as few system calls as possible (getdents64(2) on Linux), and optionally
+   * stats each of its entries relative to the directory, which saves a JNI call and a path lookup
+   * per entry over {@link #readdir} followed by {@link #lstat}.
+   *
+   * @param path the directory to read.
+   * @param followSymlinks whether types and stats are those of the targets of symlinks.
+   * @param statEntries whether to stat every entry. Otherwise, the listing has types only, which
+   *     usually come for free with the entries.
+   * @throws IOException if the directory cannot be opened or read.
+   */
+  public static DirectoryListing readdirPlus(
+      String path, boolean followSymlinks, boolean statEntries) throws IOException {
+    var comp = Blocker.begin();
+    try {
+      return readdirPlusNative(path, followSymlinks, statEntries);
+    } finally {
+      Blocker.end(comp);
+    }
+  }
+
+  private static native DirectoryListing readdirPlusNative(
+      String path, boolean followSymlinks, boolean statEntries) throws IOException;
+
+  /**
+   * The result of {@link #readdirPlus}. The names of the entries are kept in one byte array, in
+   * Bazel's internal Latin-1 encoding, and only made into strings on request.
+   */
+  public static final class DirectoryListing {
+    /** The names of the entries, each terminated by a NUL byte. */
+    private final byte[] names;
+
+    /** The offsets of the names in {@link #names}. */
+    private final int[] nameOffsets;
+
+    /** The types of the entries, encoded as in {@link Dirents}. */
+    private final byte[] types;
+
+    @Nullable private final BatchStats stats;
+
+    /** Called from JNI. The stat arrays are null unless the entries were stat'ed. */
+    private DirectoryListing(
+        byte[] names,
+        int[] nameOffsets,
+        byte[] types,
+        @Nullable int[] errnos,
+        @Nullable int[] modes,
+        @Nullable long[] sizes,
+        @Nullable long[] lastModifiedTimes,
+        @Nullable long[] lastChangeTimes,
+        @Nullable long[] inodes,
+        @Nullable int[] devices) {
+      this.names = names;
+      this.nameOffsets = nameOffsets;
+      this.types = types;
+      this.stats =
+          errnos == null
+              ? null
+              : new BatchStats(
+                  errnos, modes, sizes, lastModifiedTimes, lastChangeTimes, inodes, devices);
+    }
+
+    public int size() {
+      return nameOffsets.length;
+    }
+
+    public String getName(int i) {
+      int start = nameOffsets[i];
+      int end = i + 1 < nameOffsets.length ? nameOffsets[i + 1] - 1 : names.length - 1;
+      return new String(names, start, end - start, ISO_8859_1);
+    }
+
+    public Dirents.Type getType(int i) {
+      return Dirents.Type.forChar((char) types[i]);
+    }
+
+    /** Returns the stats of the entries, or null if they were not stat'ed. */
+    @Nullable
+    public BatchStats getStats() {
+      return stats;
+    }
+  }
+
   /**
    * An enum for specifying now the types of the individual entries returned by
    * {@link #readdir(String, ReadTypes)} is to be returned.
@@ -367,6 +586,37 @@ public final class NativePosixFiles {
   public static native byte[] lgetxattr(String path, String name)
       throws IOException;
 
+  /**
+   * Returns a stamp of the current state of a file, following symbolic links, for {@link
+   * #storeCachedDigest}. Returns null if the file is not a regular file, cannot be stat-ed, or was
+   * modified so recently that a later modification could leave its modification time unchanged.
+   */
+  @Nullable
+  public static native byte[] getDigestCacheStamp(String path);
+
+  /**
+   * Caches the digest of a file in its extended attribute {@code name}, along with the modification
+   * time, size and inode number of the file, unless the file has changed since {@code stamp} was
+   * taken by {@link #getDigestCacheStamp}, before the digest was computed. Setting the attribute is
+   * best effort.
+   *
+   * @return whether the digest was stored
+   */
+  public static native boolean storeCachedDigest(
+      String path, String name, byte[] stamp, byte[] digest);
+
+  /**
+   * Looks up the digests that {@link #storeCachedDigest} cached for many files at once, following
+   * symbolic links. A cached digest is valid while the modification time, size and inode number of
+   * its file stay the same.
+   *
+   * @param digests receives the valid cached digest of {@code paths[i]} at index {@code i *
+   *     digestLength}
+   * @return for each path, whether {@code digests} holds a valid cached digest for it
+   */
+  public static native boolean[] getCachedDigests(
+      String[] paths, String name, int digestLength, byte[] digests);
+
   /**
    * Deletes all directory trees recursively beneath the given path, which is expected to be a
    * directory. Does not remove the top directory.
@@ -377,6 +627,16 @@ public final class NativePosixFiles {
    */
   public static native void deleteTreesBelow(String dir) throws IOException;
 
+  /**
+   * Open a file descriptor for reading.
+   *
+   * <p>This is a low level API. The caller is responsible for calling {@link close} on the returned
+   * file descriptor.
+   *
+   * @param path file to open
+   */
+  public static native int openRead(String path) throws FileNotFoundException;
+
   /**
    * Open a file descriptor for writing.
    *
@@ -391,6 +651,54 @@ public final class NativePosixFiles {
   /** Write a segment of data to a file descriptor. */
   public static native int write(int fd, byte[] data, int off, int len) throws IOException;
 
+  /**
+   * Write a segment of a direct buffer to a file descriptor, straight from the buffer's memory.
+   *
+   * @param position the file offset to write at, or -1 to write at the current file offset
+   * @throws IllegalArgumentException if the buffer is not direct
+   */
+  public static native void writeDirect(int fd, ByteBuffer buffer, int off, int len, long position)
+      throws IOException;
+
+  /**
+   * Reserves disk space for the first {@code size} bytes of a file without changing its size,
+   * where the platform supports that. This is only a hint, except that it fails if there is not
+   * enough space.
+   */
+  public static native void preallocate(int fd, long size) throws IOException;
+
+  /**
+   * Copies up to {@code length} bytes from one file descriptor to another, starting at and
+   * advancing their file offsets. The kernel copies the data without passing it through user space
+   * where it can.
+   *
+   * @return the number of bytes copied, which is less than {@code length} only at the end of the
+   *     input
+   */
+  public static native long copyFileRange(int fromFd, int toFd, long length) throws IOException;
+
+  /**
+   * Creates {@code to}, which must not exist, as a clone of the regular file {@code from}: a copy
+   * that shares its data until either is written to, with the same permissions. Uses clonefile(2)
+   * on macOS and the FICLONE ioctl on Linux.
+   *
+   * @return whether the file was cloned; false, having created nothing, if the platform or the
+   *     file system cannot clone it there
+   * @throws IOException if cloning failed for another reason
+   */
+  public static native boolean cloneFile(String from, String to) throws IOException;
+
+  /**
+   * Copies all directory trees beneath the directory {@code from} into the directory {@code to},
+   * which must not have entries of the same names, on as many threads as the size of the trees
+   * warrants. Files are cloned where the file system can and copied otherwise, symbolic links are
+   * copied as they are, and all entries keep their modes and modification times.
+   *
+   * @throws IOException for the first entry that could not be copied, or if the trees have
+   *     entries other than files, directories and symbolic links
+   */
+  public static native void copyTreesBelow(String from, String to) throws IOException;
+
   /**
    * Close a file descriptor. Additionally, accept and ignore an object; this can be used to keep a
    * reference alive.
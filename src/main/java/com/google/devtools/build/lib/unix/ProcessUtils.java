@@ -14,6 +14,7 @@
 package com.google.devtools.build.lib.unix;
 
 import com.google.devtools.build.lib.jni.JniLoader;
+import java.io.IOException;
 
 /**
  * Various utilities related to UNIX processes.
@@ -46,4 +47,21 @@ public final class ProcessUtils {
    * @return the real user ID of the current process.
    */
   public static native int getuid();
+
+  /**
+   * Sets the CPU scheduling policy of every thread of this process, with sched_setscheduler(2),
+   * to SCHED_BATCH if {@code batch} and to SCHED_OTHER if not. Only on Linux.
+   *
+   * @throws IOException if it cannot be set
+   */
+  public static native void setBatchCpuScheduling(boolean batch) throws IOException;
+
+  /**
+   * Sets the I/O priority of every thread of this process, with ioprio_set(2), to the best-effort
+   * level {@code ioNiceLevel} from 0 to 7, or if it is negative, back to following their nice
+   * value. Only on Linux.
+   *
+   * @throws IOException if it cannot be set
+   */
+  public static native void setIoNiceLevel(int ioNiceLevel) throws IOException;
 }
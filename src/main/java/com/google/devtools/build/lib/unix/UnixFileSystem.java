@@ -28,6 +28,8 @@ import com.google.devtools.build.lib.vfs.Dirent;
 import com.google.devtools.build.lib.vfs.FileStatus;
 import com.google.devtools.build.lib.vfs.Path;
 import com.google.devtools.build.lib.vfs.PathFragment;
+import com.google.devtools.build.lib.vfs.bazel.Blake3HashFunction;
+import com.google.devtools.build.lib.vfs.bazel.Blake3MessageDigest;
 import java.io.File;
 import java.io.FileInputStream;
 import java.io.FileNotFoundException;
@@ -38,16 +40,28 @@ import java.nio.charset.StandardCharsets;
 import java.util.Arrays;
 import java.util.Collection;
 import java.util.List;
+import java.util.Locale;
 import javax.annotation.Nullable;
 
 /** This class implements the FileSystem interface using direct calls to the UNIX filesystem. */
 @ThreadSafe
 public class UnixFileSystem extends AbstractFileSystemWithCustomStat {
   protected final String hashAttributeName;
+  // The extended attribute that caches the digests computed by getDigest, or empty.
+  private final String digestCacheAttributeName;
 
   public UnixFileSystem(DigestHashFunction hashFunction, String hashAttributeName) {
+    this(hashFunction, hashAttributeName, /* digestCacheAttributeName= */ "");
+  }
+
+  public UnixFileSystem(
+      DigestHashFunction hashFunction, String hashAttributeName, String digestCacheAttributeName) {
     super(hashFunction);
     this.hashAttributeName = hashAttributeName;
+    this.digestCacheAttributeName =
+        digestCacheAttributeName.isEmpty()
+            ? ""
+            : digestCacheAttributeName + "." + hashFunction.toString().toLowerCase(Locale.ROOT);
   }
 
   public static Dirent.Type getDirentFromMode(int mode) {
@@ -378,6 +392,23 @@ public class UnixFileSystem extends AbstractFileSystemWithCustomStat {
     }
   }
 
+  @Override
+  protected int[] createWritableDirectories(PathFragment root, List<PathFragment> relativeDirs)
+      throws IOException {
+    String[] dirs = new String[relativeDirs.size()];
+    for (int i = 0; i < dirs.length; i++) {
+      dirs[i] = relativeDirs.get(i).getPathString();
+    }
+    int[] results = new int[dirs.length];
+    var comp = Blocker.begin();
+    try {
+      NativePosixFiles.mkdirsWritable(root.toString(), dirs, results);
+    } finally {
+      Blocker.end(comp);
+    }
+    return results;
+  }
+
   @Override
   public void createDirectoryAndParents(PathFragment path) throws IOException {
     var comp = Blocker.begin();
@@ -494,12 +525,61 @@ public class UnixFileSystem extends AbstractFileSystemWithCustomStat {
     String name = path.toString();
     long startTime = Profiler.nanoTimeMaybe();
     try {
-      return super.getDigest(path);
+      if (digestCacheAttributeName.isEmpty()) {
+        return computeDigest(path);
+      }
+      byte[] digest;
+      byte[] stamp = null;
+      var comp = Blocker.begin();
+      try {
+        digest = getCachedDigest(name);
+        if (digest == null) {
+          // Taken before hashing, so that a modification while hashing is noticed.
+          stamp = NativePosixFiles.getDigestCacheStamp(name);
+        }
+      } finally {
+        Blocker.end(comp);
+      }
+      if (digest == null) {
+        digest = computeDigest(path);
+        if (stamp != null) {
+          comp = Blocker.begin();
+          try {
+            NativePosixFiles.storeCachedDigest(name, digestCacheAttributeName, stamp, digest);
+          } finally {
+            Blocker.end(comp);
+          }
+        }
+      }
+      return digest;
     } finally {
       profiler.logSimpleTask(startTime, ProfilerTask.VFS_MD5, name);
     }
   }
 
+  @Nullable
+  private byte[] getCachedDigest(String name) {
+    int length = getDigestFunction().getDigestLength().getDigestMaximumLength();
+    byte[] digest = new byte[length];
+    boolean[] found =
+        NativePosixFiles.getCachedDigests(
+            new String[] {name}, digestCacheAttributeName, length, digest);
+    return found[0] ? digest : null;
+  }
+
+  private byte[] computeDigest(PathFragment path) throws IOException {
+    if (getDigestFunction().getHashFunction() instanceof Blake3HashFunction) {
+      // Saves streaming the file through the Java heap.
+      var comp = Blocker.begin();
+      try {
+        return Blake3MessageDigest.hashFile(path.toString());
+      } finally {
+        Blocker.end(comp);
+      }
+    }
+    return super.getDigest(path);
+  }
+
   @Override
   protected void createFSDependentHardLink(PathFragment linkPath, PathFragment originalPath)
       throws IOException {
@@ -511,6 +591,27 @@ public class UnixFileSystem extends AbstractFileSystemWithCustomStat {
     }
   }
 
+  @Override
+  protected boolean cloneFile(PathFragment from, PathFragment to) throws IOException {
+    var comp = Blocker.begin();
+    try {
+      return NativePosixFiles.cloneFile(from.toString(), to.toString());
+    } finally {
+      Blocker.end(comp);
+    }
+  }
+
+  @Override
+  protected boolean copyTreesBelow(PathFragment from, PathFragment to) throws IOException {
+    var comp = Blocker.begin();
+    try {
+      NativePosixFiles.copyTreesBelow(from.toString(), to.toString());
+      return true;
+    } finally {
+      Blocker.end(comp);
+    }
+  }
+
   @Override
   protected void deleteTreesBelow(PathFragment dir) throws IOException {
     if (isDirectory(dir, /*followSymlinks=*/ false)) {
@@ -16,6 +16,7 @@ package com.google.devtools.build.lib.util;
 
 import com.google.devtools.build.lib.concurrent.ThreadSafety.ThreadSafe;
 import com.google.devtools.build.lib.windows.WindowsProcesses;
+import java.io.IOException;
 
 /**
  * OS Process related utilities.
@@ -64,4 +65,34 @@ public final class ProcessUtils {
       return com.google.devtools.build.lib.unix.ProcessUtils.getuid();
     }
   }
+
+  /**
+   * Sets the CPU scheduling policy of this process to "batch" if {@code batch}, and back to the
+   * default one if not.
+   *
+   * @throws IOException if the policy cannot be set.
+   * @throws UnsatisfiedLinkError when JNI is not available.
+   * @throws UnsupportedOperationException on operating systems other than Linux.
+   */
+  public static void setBatchCpuScheduling(boolean batch) throws IOException {
+    if (OS.getCurrent() != OS.LINUX) {
+      throw new UnsupportedOperationException();
+    }
+    com.google.devtools.build.lib.unix.ProcessUtils.setBatchCpuScheduling(batch);
+  }
+
+  /**
+   * Sets the I/O priority of this process to the best-effort level {@code ioNiceLevel}, from 0 to
+   * 7, or if it is negative, back to the default one.
+   *
+   * @throws IOException if the priority cannot be set.
+   * @throws UnsatisfiedLinkError when JNI is not available.
+   * @throws UnsupportedOperationException on operating systems other than Linux.
+   */
+  public static void setIoNiceLevel(int ioNiceLevel) throws IOException {
+    if (OS.getCurrent() != OS.LINUX) {
+      throw new UnsupportedOperationException();
+    }
+    com.google.devtools.build.lib.unix.ProcessUtils.setIoNiceLevel(ioNiceLevel);
+  }
 }
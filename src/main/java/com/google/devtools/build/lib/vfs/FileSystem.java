@@ -31,8 +31,10 @@ import java.io.OutputStream;
 import java.nio.channels.SeekableByteChannel;
 import java.nio.file.FileAlreadyExistsException;
 import java.util.Collection;
+import java.util.HashMap;
 import java.util.Iterator;
 import java.util.List;
+import java.util.Map;
 import javax.annotation.Nullable;
 
 /** This interface models a file system. */
@@ -202,6 +204,41 @@ public abstract class FileSystem {
     return false;
   }
 
+  /**
+   * Creates writable directories below a given existing directory, and their missing ancestors,
+   * as {@link #createWritableDirectory} would one at a time from the top down. See {@link
+   * Path#createWritableDirectories} for specification.
+   */
+  protected int[] createWritableDirectories(PathFragment root, List<PathFragment> relativeDirs)
+      throws IOException {
+    int[] results = new int[relativeDirs.size()];
+    Map<PathFragment, Integer> made = new HashMap<>();
+    for (int i = 0; i < results.length; i++) {
+      results[i] = createWritableDirectoryBelow(root, relativeDirs.get(i), made);
+    }
+    return results;
+  }
+
+  private int createWritableDirectoryBelow(
+      PathFragment root, PathFragment relativeDir, Map<PathFragment, Integer> made) {
+    if (relativeDir.isEmpty()) {
+      return 0;
+    }
+    Integer result = made.get(relativeDir);
+    if (result == null) {
+      result = createWritableDirectoryBelow(root, relativeDir.getParentDirectory(), made);
+      if (result >= 0) {
+        try {
+          result = createWritableDirectory(root.getRelative(relativeDir)) ? 1 : 0;
+        } catch (IOException e) {
+          result = -1;
+        }
+      }
+      made.put(relativeDir, result);
+    }
+    return result;
+  }
+
   /**
    * Creates all directories up to the path. See {@link Path#createDirectoryAndParents} for
    * specification.
@@ -817,6 +854,32 @@ public abstract class FileSystem {
   protected abstract void createFSDependentHardLink(
       PathFragment linkPath, PathFragment originalPath) throws IOException;
 
+  /**
+   * Creates the file {@code to}, which must not exist, as a copy of the regular file {@code from}
+   * that shares its data with it until either is written to, with the same permissions, if the
+   * file system can do that in constant time (like APFS, Btrfs or XFS).
+   *
+   * @return whether the file was cloned; false, having created nothing, if the file system cannot
+   *     clone it there
+   * @throws IOException if cloning failed for another reason
+   */
+  protected boolean cloneFile(PathFragment from, PathFragment to) throws IOException {
+    return false;
+  }
+
+  /**
+   * Copies all directory trees beneath the directory {@code from} into the directory {@code to},
+   * which must not have entries of the same names, without following symbolic links and keeping
+   * the modes and modification times, if the file system can do that faster than entry by entry.
+   *
+   * @return whether the trees were copied; false, having copied nothing, if the file system cannot
+   *     copy them at once
+   * @throws IOException if copying failed
+   */
+  protected boolean copyTreesBelow(PathFragment from, PathFragment to) throws IOException {
+    return false;
+  }
+
   /**
    * Prefetch all directories and symlinks within the package rooted at "path". Enter at most
    * "maxDirs" total directories. Specializations for high-latency remote filesystems may wish to
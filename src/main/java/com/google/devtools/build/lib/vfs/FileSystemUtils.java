@@ -371,7 +371,8 @@ public class FileSystemUtils {
   /**
    * Copies the file from location "from" to location "to", while overwriting a
    * potentially existing "to". File's last modified time, executable and
-   * writable bits are also preserved.
+   * writable bits are also preserved. Where the file system can, the copy is
+   * a clone that shares the data of the original.
    *
    * <p>If no error occurs, the method returns normally. If a parent directory does
    * not exist, a FileNotFoundException is thrown. An IOException is thrown when
@@ -385,9 +386,13 @@ public class FileSystemUtils {
       throw new IOException("error copying file: "
           + "couldn't delete destination: " + e.getMessage());
     }
-    try (InputStream in = from.getInputStream();
-        OutputStream out = to.getOutputStream()) {
-      ByteStreams.copy(in, out);
+    FileSystem fileSystem = from.getFileSystem();
+    if (fileSystem != to.getFileSystem()
+        || !fileSystem.cloneFile(from.asFragment(), to.asFragment())) {
+      try (InputStream in = from.getInputStream();
+          OutputStream out = to.getOutputStream()) {
+        ByteStreams.copy(in, out);
+      }
     }
     to.setLastModifiedTime(from.getLastModifiedTime()); // Preserve mtime.
     if (!from.isWritable()) {
@@ -553,7 +558,9 @@ public class FileSystemUtils {
   /**
    * Copies all dir trees under a given 'from' dir to location 'to', while overwriting all files in
    * the potentially existing 'to'. Resolves symbolic links if {@code followSymlinks ==
-   * Symlinks#FOLLOW}. Otherwise copies symlinks as-is.
+   * Symlinks#FOLLOW}. Otherwise copies symlinks as-is, and if 'to' is empty, the file system may
+   * copy the trees at once, on several threads and keeping the modes and modification times of
+   * directories as well.
    *
    * <p>The source and the destination must be non-overlapping, otherwise an
    * IllegalArgumentException will be thrown. This method cannot be used to copy a dir tree to a sub
@@ -570,6 +577,15 @@ public class FileSystemUtils {
       throw new IllegalArgumentException(to + " is a subdirectory of " + from);
     }
 
+    FileSystem fileSystem = from.getFileSystem();
+    if (!followSymlinks.toBoolean()
+        && fileSystem == to.getFileSystem()
+        && to.isDirectory()
+        && to.getDirectoryEntries().isEmpty()
+        && fileSystem.copyTreesBelow(from.asFragment(), to.asFragment())) {
+      return;
+    }
+
     Collection<Path> entries = from.getDirectoryEntries();
     for (Path entry : entries) {
       Path toPath = to.getChild(entry.getBaseName());
@@ -30,6 +30,7 @@ import java.io.OutputStream;
 import java.nio.channels.SeekableByteChannel;
 import java.util.ArrayList;
 import java.util.Collection;
+import java.util.List;
 import javax.annotation.Nullable;
 
 /**
@@ -445,6 +446,22 @@ public class Path implements Comparable<Path>, FileType.HasFileType {
     return fileSystem.createWritableDirectory(asFragment());
   }
 
+  /**
+   * Creates the writable directories at the given paths relative to this existing directory, and
+   * their missing ancestors, as {@link #createWritableDirectory} would one at a time from the top
+   * down, but making each common ancestor only once. Does not follow symlinks below this
+   * directory.
+   *
+   * <p>Failing to create one of the directories does not stop the others from being created.
+   *
+   * @return for each directory, 1 if it was created, 0 if it already existed, or a negative value
+   *     if it or one of its ancestors could not be created
+   * @throws IOException if this directory could not be opened
+   */
+  public int[] createWritableDirectories(List<PathFragment> relativeDirs) throws IOException {
+    return fileSystem.createWritableDirectories(asFragment(), relativeDirs);
+  }
+
   /**
    * Ensures that the directory with the name of the current path and all its ancestor directories
    * exist.
@@ -21,6 +21,7 @@ import java.io.InputStream;
 import java.io.OutputStream;
 import java.nio.channels.SeekableByteChannel;
 import java.util.Collection;
+import java.util.List;
 
 /**
  * FileSystem implementation which delegates all operations to a provided instance with a
@@ -72,6 +73,12 @@ public abstract class PathTransformingDelegateFileSystem extends FileSystem {
     return delegateFs.createWritableDirectory(toDelegatePath(path));
   }
 
+  @Override
+  protected int[] createWritableDirectories(PathFragment root, List<PathFragment> relativeDirs)
+      throws IOException {
+    return delegateFs.createWritableDirectories(toDelegatePath(root), relativeDirs);
+  }
+
   @Override
   public void createDirectoryAndParents(PathFragment path) throws IOException {
     delegateFs.createDirectoryAndParents(toDelegatePath(path));
@@ -14,6 +14,7 @@
 package com.google.devtools.build.lib.vfs.bazel;
 
 import com.google.devtools.build.lib.jni.JniLoader;
+import java.io.IOException;
 import java.nio.ByteBuffer;
 import java.security.DigestException;
 import java.security.MessageDigest;
@@ -102,6 +103,26 @@ public final class Blake3MessageDigest extends MessageDigest {
     return digestBytes.length;
   }
 
+  /**
+   * Returns the digests of the files at the given paths, following symbolic links, as {@link
+   * #OUT_LEN} bytes for each file in turn. The files are read and hashed natively, on up to {@code
+   * threads} threads at once, without passing their contents through the Java heap.
+   *
+   * <p>Not available on Windows.
+   *
+   * @throws IOException if any of the files cannot be read
+   */
+  public static byte[] hashFiles(String[] paths, int threads) throws IOException {
+    byte[] digests = new byte[paths.length * OUT_LEN];
+    hash_files(paths, threads, digests);
+    return digests;
+  }
+
+  /** Returns the digest of the file at the given path, like {@link #hashFiles}. */
+  public static byte[] hashFile(String path) throws IOException {
+    return hashFiles(new String[] {path}, 1);
+  }
+
   public static final native int hasher_size();
 
   public static final native void initialize_hasher(byte[] hasher);
@@ -110,4 +131,7 @@ public final class Blake3MessageDigest extends MessageDigest {
       byte[] hasher, byte[] input, int offset, int inputLen);
 
   public static final native void blake3_hasher_finalize(byte[] hasher, byte[] out, int outLen);
+
+  private static native void hash_files(String[] paths, int threads, byte[] digests)
+      throws IOException;
 }
@@ -18,6 +18,9 @@ import com.google.devtools.build.lib.jni.JniLoader;
 import java.io.FileNotFoundException;
 import java.io.IOException;
 import java.nio.file.AccessDeniedException;
+import java.nio.file.NotDirectoryException;
+import java.util.ArrayList;
+import java.util.List;
 
 /** File operations on Windows. */
 public class WindowsFileOperations {
@@ -77,6 +80,73 @@ public class WindowsFileOperations {
     }
   }
 
+  /** An entry of a directory, as returned by {@link #readDirectory}. */
+  public static final class DirectoryEntry {
+    private static final int FILE_ATTRIBUTE_DIRECTORY = 0x10;
+    private static final int FILE_ATTRIBUTE_REPARSE_POINT = 0x400;
+
+    private final String name;
+    private final int attributes;
+    private final int reparseTag;
+    private final long size;
+    private final long lastWriteTime;
+    private final long changeTime;
+
+    private DirectoryEntry(
+        String name,
+        int attributes,
+        int reparseTag,
+        long size,
+        long lastWriteTime,
+        long changeTime) {
+      this.name = name;
+      this.attributes = attributes;
+      this.reparseTag = reparseTag;
+      this.size = size;
+      this.lastWriteTime = lastWriteTime;
+      this.changeTime = changeTime;
+    }
+
+    public String getName() {
+      return name;
+    }
+
+    /** The {@code FILE_ATTRIBUTE_*} flags of the entry. */
+    public int getAttributes() {
+      return attributes;
+    }
+
+    public boolean isDirectory() {
+      return (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    }
+
+    /**
+     * Whether the entry is a reparse point, which {@link #isSymlinkOrJunction} takes for a link.
+     */
+    public boolean isReparsePoint() {
+      return (attributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+    }
+
+    /** The {@code IO_REPARSE_TAG_*} of a reparse point, or 0. */
+    public int getReparseTag() {
+      return reparseTag;
+    }
+
+    public long getSize() {
+      return size;
+    }
+
+    /** The time of the last write to the entry, as a FILETIME. */
+    public long getLastWriteTime() {
+      return lastWriteTime;
+    }
+
+    /** The time of the last change to the entry, as {@link #getLastChangeTime} returns it. */
+    public long getChangeTime() {
+      return changeTime;
+    }
+  }
+
   // Keep IS_SYMLINK_OR_JUNCTION_* values in sync with src/main/native/windows/file.cc.
   private static final int IS_SYMLINK_OR_JUNCTION_SUCCESS = 0;
   // IS_SYMLINK_OR_JUNCTION_ERROR = 1;
@@ -88,6 +158,16 @@ public class WindowsFileOperations {
   private static final int GET_CHANGE_TIME_DOES_NOT_EXIST = 2;
   private static final int GET_CHANGE_TIME_ACCESS_DENIED = 3;
 
+  // Keep READ_DIRECTORY_* values in sync with src/main/native/windows/file.h.
+  private static final int READ_DIRECTORY_SUCCESS = 0;
+  // READ_DIRECTORY_ERROR = 1;
+  private static final int READ_DIRECTORY_DOES_NOT_EXIST = 2;
+  private static final int READ_DIRECTORY_ACCESS_DENIED = 3;
+  private static final int READ_DIRECTORY_NOT_A_DIRECTORY = 4;
+
+  // The number of longs per entry that nativeReadDirectory returns, see file-jni.cc.
+  private static final int READ_DIRECTORY_STATS_PER_ENTRY = 5;
+
   // Keep CREATE_JUNCTION_* values in sync with src/main/native/windows/file.h.
   private static final int CREATE_JUNCTION_SUCCESS = 0;
   // CREATE_JUNCTION_ERROR = 1;
@@ -123,6 +203,9 @@ public class WindowsFileOperations {
   private static native int nativeGetChangeTime(
       String path, boolean followReparsePoints, long[] result, String[] error);
 
+  private static native int nativeReadDirectory(
+      String path, String[][] names, long[][] stats, String[] error);
+
   private static native boolean nativeGetLongPath(String path, String[] result, String[] error);
 
   private static native int nativeCreateJunction(String name, String target, String[] error);
@@ -134,6 +217,8 @@ public class WindowsFileOperations {
 
   private static native int nativeDeletePath(String path, String[] error);
 
+  private static native int nativeDeleteTreesBelow(String path, String[] error);
+
   /** Determines whether `path` is a junction point or directory symlink. */
   public static boolean isSymlinkOrJunction(String path) throws IOException {
     boolean[] result = new boolean[] {false};
@@ -171,6 +256,44 @@ public class WindowsFileOperations {
     throw new IOException(String.format("Cannot get last change time of '%s': %s", path, error[0]));
   }
 
+  /**
+   * Lists the entries of the directory `path`, along with their attributes, sizes and times, all
+   * in a few system calls for the whole directory.
+   *
+   * @throws IOException if `path` is not a directory or cannot be read
+   */
+  public static List<DirectoryEntry> readDirectory(String path) throws IOException {
+    String[][] names = new String[][] {null};
+    long[][] stats = new long[][] {null};
+    String[] error = new String[] {null};
+    switch (nativeReadDirectory(asLongPath(path), names, stats, error)) {
+      case READ_DIRECTORY_SUCCESS:
+        break;
+      case READ_DIRECTORY_DOES_NOT_EXIST:
+        throw new FileNotFoundException(path);
+      case READ_DIRECTORY_ACCESS_DENIED:
+        throw new AccessDeniedException(path);
+      case READ_DIRECTORY_NOT_A_DIRECTORY:
+        throw new NotDirectoryException(path);
+      default:
+        // This is READ_DIRECTORY_ERROR (1). The JNI code puts a custom message in 'error[0]'.
+        throw new IOException(String.format("Cannot read directory '%s': %s", path, error[0]));
+    }
+    List<DirectoryEntry> entries = new ArrayList<>(names[0].length);
+    for (int i = 0; i < names[0].length; i++) {
+      int offset = i * READ_DIRECTORY_STATS_PER_ENTRY;
+      entries.add(
+          new DirectoryEntry(
+              names[0][i],
+              (int) stats[0][offset],
+              (int) stats[0][offset + 1],
+              stats[0][offset + 2],
+              stats[0][offset + 3],
+              stats[0][offset + 4]));
+    }
+    return entries;
+  }
+
   /**
    * Returns the long path associated with the input `path`.
    *
@@ -310,4 +433,25 @@ public class WindowsFileOperations {
         throw new IOException(String.format("Cannot delete path '%s': %s", path, error[0]));
     }
   }
+
+  /**
+   * Deletes everything below the directory `path`, but not `path` itself, in parallel for large
+   * trees. Junctions and symlinks below `path` are deleted without following them. Does nothing if
+   * `path` is not a directory.
+   *
+   * @throws IOException if something below `path` cannot be deleted
+   */
+  public static void deleteTreesBelow(String path) throws IOException {
+    String[] error = new String[] {null};
+    switch (nativeDeleteTreesBelow(asLongPath(path), error)) {
+      case DELETE_PATH_SUCCESS:
+        return;
+      case DELETE_PATH_DOES_NOT_EXIST:
+        throw new FileNotFoundException(path);
+      default:
+        // The JNI code puts a message naming the path that could not be deleted in 'error[0]'.
+        throw new IOException(
+            String.format("Cannot delete trees below '%s': %s", path, error[0]));
+    }
+  }
 }
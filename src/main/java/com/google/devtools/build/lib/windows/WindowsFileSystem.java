@@ -18,6 +18,7 @@ import com.google.devtools.build.lib.concurrent.ThreadSafety.ThreadSafe;
 import com.google.devtools.build.lib.profiler.Profiler;
 import com.google.devtools.build.lib.profiler.ProfilerTask;
 import com.google.devtools.build.lib.vfs.DigestHashFunction;
+import com.google.devtools.build.lib.vfs.Dirent;
 import com.google.devtools.build.lib.vfs.FileStatus;
 import com.google.devtools.build.lib.vfs.JavaIoFileSystem;
 import com.google.devtools.build.lib.vfs.PathFragment;
@@ -26,7 +27,11 @@ import java.io.FileNotFoundException;
 import java.io.IOException;
 import java.nio.file.Files;
 import java.nio.file.LinkOption;
+import java.nio.file.NotDirectoryException;
 import java.nio.file.attribute.DosFileAttributes;
+import java.util.ArrayList;
+import java.util.Collection;
+import java.util.List;
 
 /** File system implementation for Windows. */
 @ThreadSafe
@@ -63,6 +68,18 @@ public class WindowsFileSystem extends JavaIoFileSystem {
     }
   }
 
+  @Override
+  protected void deleteTreesBelow(PathFragment dir) throws IOException {
+    if (isDirectory(dir, /* followSymlinks= */ false)) {
+      long startTime = Profiler.nanoTimeMaybe();
+      try {
+        WindowsFileOperations.deleteTreesBelow(dir.getPathString());
+      } finally {
+        profiler.logSimpleTask(startTime, ProfilerTask.VFS_DELETE, dir.getPathString());
+      }
+    }
+  }
+
   @Override
   protected boolean createWritableDirectory(PathFragment path) throws IOException {
     // All directories are writable on Windows.
@@ -207,6 +224,54 @@ public class WindowsFileSystem extends JavaIoFileSystem {
     return status;
   }
 
+  @Override
+  protected Collection<String> getDirectoryEntries(PathFragment path) throws IOException {
+    List<WindowsFileOperations.DirectoryEntry> entries = readDirectory(path);
+    List<String> names = new ArrayList<>(entries.size());
+    for (WindowsFileOperations.DirectoryEntry entry : entries) {
+      names.add(entry.getName());
+    }
+    return names;
+  }
+
+  @Override
+  protected Collection<Dirent> readdir(PathFragment path, boolean followSymlinks)
+      throws IOException {
+    // The listing tells the type of every entry, so only links need a stat of their own (to
+    // follow them), where FileSystem#readdir would stat every entry.
+    List<WindowsFileOperations.DirectoryEntry> entries = readDirectory(path);
+    List<Dirent> dirents = new ArrayList<>(entries.size());
+    for (WindowsFileOperations.DirectoryEntry entry : entries) {
+      Dirent.Type type;
+      if (entry.isReparsePoint()) {
+        type =
+            followSymlinks
+                ? direntFromStat(statNullable(path.getChild(entry.getName()), true))
+                : Dirent.Type.SYMLINK;
+      } else {
+        type = entry.isDirectory() ? Dirent.Type.DIRECTORY : Dirent.Type.FILE;
+      }
+      dirents.add(new Dirent(entry.getName(), type));
+    }
+    return dirents;
+  }
+
+  private List<WindowsFileOperations.DirectoryEntry> readDirectory(PathFragment path)
+      throws IOException {
+    long startTime = Profiler.nanoTimeMaybe();
+    try {
+      return WindowsFileOperations.readDirectory(path.getPathString());
+    } catch (FileNotFoundException e) {
+      throw new FileNotFoundException(path + ERR_NO_SUCH_FILE_OR_DIR);
+    } catch (NotDirectoryException e) {
+      throw new IOException(path + ERR_NOT_A_DIRECTORY, e);
+    } catch (java.nio.file.AccessDeniedException e) {
+      throw new IOException(path + ERR_PERMISSION_DENIED, e);
+    } finally {
+      profiler.logSimpleTask(startTime, ProfilerTask.VFS_DIR, path.getPathString());
+    }
+  }
+
   @Override
   protected boolean isDirectory(PathFragment path, boolean followSymlinks) {
     if (!followSymlinks) {
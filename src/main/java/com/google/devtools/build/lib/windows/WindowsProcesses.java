@@ -115,6 +115,16 @@ public class WindowsProcesses {
   /** Returns the process ID of the given process or -1 if there was an error. */
   public static native int getProcessPid(long process);
 
+  /**
+   * Returns what the given process and its subprocesses used, as their job object accounts for it,
+   * or null if that is not known. Only known once {@link #waitFor} has returned.
+   *
+   * <p>The array holds, in this order: user and kernel CPU time in microseconds; the number of read
+   * and write operations; the bytes read and written; the peak commit charge in bytes of the
+   * process that used the most, and of all processes together.
+   */
+  public static native long[] getResourceUsage(long process);
+
   /** Terminates the given process. Returns true if the termination was successful. */
   public static native boolean terminate(long process);
 
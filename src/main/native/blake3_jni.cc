@@ -16,7 +16,22 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+#endif
+
 #include "c/blake3.h"
+#if !defined(_WIN32)
+#include "src/main/native/latin1_jni_path.h"
+#endif
 
 namespace blaze_jni {
 
@@ -70,4 +85,121 @@ Java_com_google_devtools_build_lib_vfs_bazel_Blake3MessageDigest_blake3_1hasher_
   }
 }
 
+#if !defined(_WIN32)
+namespace {
+// Files are read in pieces of this size.
+static const size_t kReadBufferSize = 1024 * 1024;
+
+// Hashes the file at path into out, reading it through buf. Returns 0 on
+// success, or an errno.
+static int HashFile(const char *path, std::vector<uint8_t> *buf,
+                    uint8_t *out) {
+  int fd;
+  while ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1 && errno == EINTR) {
+  }
+  if (fd == -1) {
+    return errno;
+  }
+  if (buf->empty()) {
+    buf->resize(kReadBufferSize);
+  }
+  blake3_hasher hasher;
+  blake3_hasher_init(&hasher);
+  int error = 0;
+  for (;;) {
+    ssize_t n = read(fd, buf->data(), buf->size());
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      error = errno;
+      break;
+    }
+    if (n == 0) {
+      break;
+    }
+    blake3_hasher_update(&hasher, buf->data(), n);
+  }
+  close(fd);
+  if (error == 0) {
+    blake3_hasher_finalize(&hasher, out, BLAKE3_OUT_LEN);
+  }
+  return error;
+}
+
+static void ThrowIOException(JNIEnv *env, int error, const char *path) {
+  jclass exception_class =
+      env->FindClass(error == ENOENT ? "java/io/FileNotFoundException"
+                                     : "java/io/IOException");
+  if (exception_class != nullptr) {
+    std::string message = std::string(path) + " (" + strerror(error) + ")";
+    env->ThrowNew(exception_class, message.c_str());
+  }
+}
+}  // namespace
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_vfs_bazel_Blake3MessageDigest_hash_1files(
+    JNIEnv *env, jclass clazz, jobjectArray jpaths, jint threads,
+    jbyteArray jdigests) {
+  const jsize count = env->GetArrayLength(jpaths);
+  std::vector<const char *> paths;
+  paths.reserve(count);
+  for (jsize i = 0; i < count; i++) {
+    jstring jpath = static_cast<jstring>(env->GetObjectArrayElement(jpaths, i));
+    const char *path = jpath != nullptr ? GetStringLatin1Chars(env, jpath)
+                                        : nullptr;
+    if (jpath != nullptr) {
+      env->DeleteLocalRef(jpath);
+    }
+    if (path == nullptr) {
+      break;
+    }
+    paths.push_back(path);
+  }
+
+  if (paths.size() == static_cast<size_t>(count)) {
+    // The files are hashed on this thread and on up to threads - 1 more,
+    // each of which takes the next file until there are none left.
+    std::vector<uint8_t> digests(paths.size() * BLAKE3_OUT_LEN);
+    std::vector<int> errors(paths.size());
+    std::atomic<size_t> next{0};
+    auto work = [&] {
+      std::vector<uint8_t> buf;
+      for (size_t i; (i = next++) < paths.size();) {
+        errors[i] = HashFile(paths[i], &buf, &digests[i * BLAKE3_OUT_LEN]);
+      }
+    };
+    std::vector<std::thread> workers;
+    const size_t max_workers =
+        std::min<size_t>(std::max(threads, 1), paths.size());
+    for (size_t i = 1; i < max_workers; i++) {
+      workers.emplace_back(work);
+    }
+    work();
+    for (std::thread &worker : workers) {
+      worker.join();
+    }
+
+    auto failed = std::find_if(errors.begin(), errors.end(),
+                               [](int error) { return error != 0; });
+    if (failed != errors.end()) {
+      ThrowIOException(env, *failed, paths[failed - errors.begin()]);
+    } else {
+      env->SetByteArrayRegion(jdigests, 0, digests.size(),
+                              reinterpret_cast<jbyte *>(digests.data()));
+    }
+  } else if (!env->ExceptionOccurred()) {
+    jclass npe = env->FindClass("java/lang/NullPointerException");
+    if (npe != nullptr) {
+      env->ThrowNew(npe, "paths");
+    }
+  }
+
+  for (const char *path : paths) {
+    ReleaseStringLatin1Chars(path);
+  }
+}
+#endif
+
 }  // namespace blaze_jni
@@ -12,24 +12,27 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/attr.h>
+#include <sys/clonefile.h>
 #include <sys/stat.h>
 #include <sys/sysctl.h>
 #include <sys/syslimits.h>
 #include <sys/types.h>
 #include <sys/xattr.h>
+#include <unistd.h>
 
 #include <string>
+#include <vector>
 
 #include "src/main/native/unix_jni.h"
 
 namespace blaze_jni {
 
-const int PATH_MAX2 = PATH_MAX * 2;
-
 using std::string;
 
 // See unix_jni.h.
@@ -44,37 +47,211 @@ string ErrorMessage(int error_number) {
 
 int portable_fstatat(int dirfd, char *name, portable_stat_struct *statbuf,
                      int flags) {
-  char dirPath[PATH_MAX2];  // Have enough room for relative path
+  return fstatat(dirfd, name, statbuf, flags);
+}
 
-  // No fstatat under darwin, simulate it
-  if (flags != 0) {
-    // We don't support any flags
-    errno = ENOSYS;
+int portable_read_dir_entries(int dirfd, std::vector<char> *names,
+                              std::vector<unsigned char> *types) {
+  // readdir(3) closes the file descriptor along with the stream.
+  int fd = dup(dirfd);
+  if (fd == -1) {
     return -1;
   }
-  if (strlen(name) == 0 || name[0] == '/') {
-    // Absolute path, simply stat
-    return portable_stat(name, statbuf);
-  }
-  // Relative path, construct an absolute path
-  if (fcntl(dirfd, F_GETPATH, dirPath) == -1) {
+  DIR *dirh = fdopendir(fd);
+  if (dirh == nullptr) {
+    close(fd);
     return -1;
   }
-  int l = strlen(dirPath);
-  if (dirPath[l - 1] != '/') {
-    // dirPath is twice the PATH_MAX size, we always have room for the extra /
-    dirPath[l] = '/';
-    dirPath[l + 1] = 0;
-    l++;
+  for (;;) {
+    errno = 0;
+    struct dirent *entry = readdir(dirh);
+    if (entry == nullptr) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    const char *name = entry->d_name;
+    if (name[0] == '.' &&
+        (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+      continue;
+    }
+    names->insert(names->end(), name, name + strlen(name) + 1);
+    types->push_back(entry->d_type);
+  }
+  int saved_errno = errno;
+  closedir(dirh);
+  errno = saved_errno;
+  return errno == 0 ? 0 : -1;
+}
+
+namespace {
+// Returns the d_type and the st_mode file type of a getattrlist object type.
+void ObjectType(fsobj_type_t type, unsigned char *d_type, mode_t *mode) {
+  switch (type) {
+    case VREG:
+      *d_type = DT_REG;
+      *mode = S_IFREG;
+      break;
+    case VDIR:
+      *d_type = DT_DIR;
+      *mode = S_IFDIR;
+      break;
+    case VLNK:
+      *d_type = DT_LNK;
+      *mode = S_IFLNK;
+      break;
+    case VBLK:
+      *d_type = DT_BLK;
+      *mode = S_IFBLK;
+      break;
+    case VCHR:
+      *d_type = DT_CHR;
+      *mode = S_IFCHR;
+      break;
+    case VSOCK:
+      *d_type = DT_SOCK;
+      *mode = S_IFSOCK;
+      break;
+    case VFIFO:
+      *d_type = DT_FIFO;
+      *mode = S_IFIFO;
+      break;
+    default:
+      *d_type = DT_UNKNOWN;
+      *mode = 0;
+  }
+}
+
+int64_t Milliseconds(const struct timespec &time) {
+  return time.tv_sec * 1000L + time.tv_nsec / 1000000;
+}
+
+// Reads the next attribute of type T at *field, which need not be aligned.
+template <typename T>
+T Next(const char **field) {
+  T value;
+  memcpy(&value, *field, sizeof(value));
+  *field += sizeof(value);
+  return value;
+}
+}  // namespace
+
+int portable_read_dir_entries_with_stats(int dirfd, std::vector<char> *names,
+                                         std::vector<unsigned char> *types,
+                                         std::vector<DirEntryStat> *stats) {
+  // getattrlistbulk(2) fills the buffer with as many entries as fit, with
+  // the attributes in the order of their bits, after the returned ones and
+  // the error. It never reports . and ..
+  struct attrlist request = {};
+  request.bitmapcount = ATTR_BIT_MAP_COUNT;
+  request.commonattr = ATTR_CMN_RETURNED_ATTRS | ATTR_CMN_ERROR |
+                       ATTR_CMN_NAME | ATTR_CMN_DEVID | ATTR_CMN_OBJTYPE |
+                       ATTR_CMN_MODTIME | ATTR_CMN_CHGTIME |
+                       ATTR_CMN_ACCESSMASK | ATTR_CMN_FILEID;
+  request.fileattr = ATTR_FILE_DATALENGTH;
+  std::vector<char> buf(64 * 1024);
+  for (bool first = true;; first = false) {
+    int count = getattrlistbulk(dirfd, &request, buf.data(), buf.size(), 0);
+    if (count == -1 && errno == EINTR) continue;
+    if (count == -1 && first && (errno == ENOTSUP || errno == EINVAL)) {
+      errno = ENOSYS;
+    }
+    if (count <= 0) {
+      return count;
+    }
+    const char *entry = buf.data();
+    for (int i = 0; i < count; ++i) {
+      uint32_t length;
+      memcpy(&length, entry, sizeof(length));
+      const char *field = entry + sizeof(length);
+      const attribute_set_t returned = Next<attribute_set_t>(&field);
+      DirEntryStat stat = {};
+      if (returned.commonattr & ATTR_CMN_ERROR) {
+        stat.error = Next<uint32_t>(&field);
+      }
+      const char *name = "";
+      if (returned.commonattr & ATTR_CMN_NAME) {
+        const char *reference = field;
+        const attrreference_t name_info = Next<attrreference_t>(&field);
+        name = reference + name_info.attr_dataoffset;
+      }
+      if (returned.commonattr & ATTR_CMN_DEVID) {
+        stat.device = Next<dev_t>(&field);
+      }
+      unsigned char d_type = DT_UNKNOWN;
+      if (returned.commonattr & ATTR_CMN_OBJTYPE) {
+        ObjectType(Next<fsobj_type_t>(&field), &d_type, &stat.mode);
+      }
+      if (returned.commonattr & ATTR_CMN_MODTIME) {
+        stat.mtime_millis = Milliseconds(Next<struct timespec>(&field));
+      }
+      if (returned.commonattr & ATTR_CMN_CHGTIME) {
+        stat.ctime_millis = Milliseconds(Next<struct timespec>(&field));
+      }
+      if (returned.commonattr & ATTR_CMN_ACCESSMASK) {
+        stat.mode |= Next<uint32_t>(&field) & ~S_IFMT;
+      }
+      if (returned.commonattr & ATTR_CMN_FILEID) {
+        stat.inode = Next<uint64_t>(&field);
+      }
+      if (returned.fileattr & ATTR_FILE_DATALENGTH) {
+        stat.size = Next<off_t>(&field);
+      }
+      if (stat.error == 0 && (!(returned.commonattr & ATTR_CMN_OBJTYPE) ||
+                              !(returned.commonattr & ATTR_CMN_FILEID))) {
+        // Without these, the entry would pass for something it is not.
+        stat.error = EIO;
+      }
+      entry += length;
+      if (name[0] == '.' &&
+          (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+        continue;
+      }
+      names->insert(names->end(), name, name + strlen(name) + 1);
+      types->push_back(d_type);
+      stats->push_back(stat);
+    }
+  }
+}
+
+int portable_preallocate(int fd, int64_t size) {
+  fstore_t store = {F_ALLOCATEALL, F_PEOFPOSMODE, 0, size, 0};
+  return fcntl(fd, F_PREALLOCATE, &store);
+}
+
+ssize_t portable_copy_file_range(int in_fd, int out_fd, size_t len) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int portable_clone_file(int from_dir_fd, const char *from, int to_dir_fd,
+                        const char *to) {
+  // clonefile(2) would clone a whole directory.
+  struct stat st;
+  if (fstatat(from_dir_fd, from, &st, 0) == -1) {
+    return -1;
   }
-  strncat(dirPath, name, PATH_MAX2 - l - 1);
-  char *newpath = realpath(dirPath, nullptr);  // this resolve the relative path
-  if (newpath == nullptr) {
+  if (!S_ISREG(st.st_mode)) {
+    errno = ENOTSUP;
     return -1;
   }
-  int r = portable_stat(newpath, statbuf);
-  free(newpath);
-  return r;
+  // APFS clones in one call, keeping the permissions and times.
+  if (clonefileat(from_dir_fd, from, to_dir_fd, to, 0) == 0) {
+    return 0;
+  }
+  if (errno == EOPNOTSUPP) {
+    errno = ENOTSUP;
+  }
+  return -1;
+}
+
+int portable_set_batch_cpu_scheduling(bool batch) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int portable_set_io_nice_level(int io_nice_level) {
+  errno = ENOSYS;
+  return -1;
 }
 
 uint64_t StatEpochMilliseconds(const portable_stat_struct &statbuf,
@@ -92,6 +269,20 @@ uint64_t StatEpochMilliseconds(const portable_stat_struct &statbuf,
   }
 }
 
+int64_t StatEpochNanoseconds(const portable_stat_struct &statbuf, StatTimes t) {
+  switch (t) {
+    case STAT_ATIME:
+      return statbuf.st_atimespec.tv_sec * 1000000000L +
+             statbuf.st_atimespec.tv_nsec;
+    case STAT_CTIME:
+      return statbuf.st_ctimespec.tv_sec * 1000000000L +
+             statbuf.st_ctimespec.tv_nsec;
+    case STAT_MTIME:
+      return statbuf.st_mtimespec.tv_sec * 1000000000L +
+             statbuf.st_mtimespec.tv_nsec;
+  }
+}
+
 ssize_t portable_getxattr(const char *path, const char *name, void *value,
                           size_t size, bool *attr_not_found) {
   ssize_t result = getxattr(path, name, value, size, 0, 0);
@@ -106,4 +297,9 @@ ssize_t portable_lgetxattr(const char *path, const char *name, void *value,
   return result;
 }
 
+int portable_setxattr(const char *path, const char *name, const void *value,
+                      size_t size) {
+  return setxattr(path, name, value, size, 0, 0);
+}
+
 }  // namespace blaze_jni
@@ -17,11 +17,15 @@
 #include <pthread.h>
 #include <stdlib.h>
 
-#include <list>
 #include <string>
+#include <unordered_set>
 
 namespace {
 
+// Once more paths than this changed between two polls, we report that
+// everything changed instead of handing all of them to Java.
+const size_t kMaxChangedPaths = 100000;
+
 // A structure to pass around the FSEvents info and the list of paths.
 struct JNIEventsDiffAwareness {
   // FSEvents run loop (thread)
@@ -33,8 +37,9 @@ struct JNIEventsDiffAwareness {
   // If true, fsevents dropped events so we don't know what changed exactly.
   bool everything_changed;
 
-  // List of paths that have been changed since last polling.
-  std::list<std::string> paths;
+  // Set of paths that have been changed since last polling. A path that
+  // changes many times, e.g. during a checkout, is only in here once.
+  std::unordered_set<std::string> paths;
 
   // Mutex to protect concurrent accesses to paths and everything_changed.
   pthread_mutex_t mutex;
@@ -57,7 +62,7 @@ void FsEventsDiffAwarenessCallback(ConstFSEventStreamRef streamRef,
   JNIEventsDiffAwareness *info =
       static_cast<JNIEventsDiffAwareness *>(clientCallBackInfo);
   pthread_mutex_lock(&(info->mutex));
-  for (size_t i = 0; i < numEvents; i++) {
+  for (size_t i = 0; i < numEvents && !info->everything_changed; i++) {
     if ((eventFlags[i] & kFSEventStreamEventFlagMustScanSubDirs) != 0) {
       // Either we lost events or they were coalesced. Assume everything changed
       // and give up, which matches the fsevents documentation in that the
@@ -77,10 +82,16 @@ void FsEventsDiffAwarenessCallback(ConstFSEventStreamRef streamRef,
       // too much complexity for this rather-uncommon use case.
       info->everything_changed = true;
       break;
+    } else if (info->paths.size() >= kMaxChangedPaths) {
+      info->everything_changed = true;
+      break;
     } else {
-      info->paths.push_back(std::string(paths[i]));
+      info->paths.emplace(paths[i]);
     }
   }
+  if (info->everything_changed) {
+    info->paths.clear();
+  }
   pthread_mutex_unlock(&(info->mutex));
 }
 
@@ -150,28 +161,33 @@ Java_com_google_devtools_build_lib_skyframe_MacOSXFsEventsDiffAwareness_run(
   CFRunLoopRun();
 }
 
-extern "C" JNIEXPORT jobjectArray JNICALL
+extern "C" JNIEXPORT jbyteArray JNICALL
 Java_com_google_devtools_build_lib_skyframe_MacOSXFsEventsDiffAwareness_poll(
     JNIEnv *env, jobject fsEventsDiffAwareness) {
   JNIEventsDiffAwareness *info = GetInfo(env, fsEventsDiffAwareness);
+  // Take the paths so that the callback doesn't wait for us to copy them.
+  std::unordered_set<std::string> paths;
   pthread_mutex_lock(&(info->mutex));
-
-  jobjectArray result;
-  if (info->everything_changed) {
-    result = nullptr;
-  } else {
-    jclass classString = env->FindClass("java/lang/String");
-    result = env->NewObjectArray(info->paths.size(), classString, nullptr);
-    int i = 0;
-    for (auto it = info->paths.begin(); it != info->paths.end(); it++, i++) {
-      env->SetObjectArrayElement(result, i, env->NewStringUTF(it->c_str()));
-    }
-  }
-
+  bool everything_changed = info->everything_changed;
+  paths.swap(info->paths);
   info->everything_changed = false;
-  info->paths.clear();
-
   pthread_mutex_unlock(&(info->mutex));
+
+  if (everything_changed) {
+    return nullptr;
+  }
+  // Hand the paths to Java in one array, each terminated by a NUL, rather
+  // than as a String each.
+  std::string encoded;
+  for (const std::string &path : paths) {
+    encoded += path;
+    encoded += '\0';
+  }
+  jbyteArray result = env->NewByteArray(encoded.size());
+  if (result != nullptr) {
+    env->SetByteArrayRegion(result, 0, encoded.size(),
+                            reinterpret_cast<const jbyte *>(encoded.data()));
+  }
   return result;
 }
 
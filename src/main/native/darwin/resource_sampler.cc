@@ -0,0 +1,85 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <jni.h>
+#include <libproc.h>
+#include <mach/mach_time.h>
+#include <sys/mount.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "src/main/native/darwin/util.h"
+#include "src/main/native/resource_sampler.h"
+#include "src/main/native/unix_jni.h"
+
+namespace blaze_jni {
+
+namespace {
+
+// The times of proc_pid_rusage() are in mach absolute time units.
+jlong MachTimeToNanos(uint64_t mach_time) {
+  static mach_timebase_info_data_t timebase;
+  static dispatch_once_t once_token;
+  dispatch_once(&once_token, ^{
+    mach_timebase_info(&timebase);
+  });
+  return static_cast<jlong>(mach_time * timebase.numer / timebase.denom);
+}
+
+void ReadRusage(jlong *fields) {
+  rusage_info_v4 info;
+  if (proc_pid_rusage(getpid(), RUSAGE_INFO_V4,
+                      reinterpret_cast<rusage_info_t *>(&info)) != 0) {
+    return;
+  }
+  fields[kMajorFaults] = info.ri_pageins;
+  fields[kReadBytes] = info.ri_diskio_bytesread;
+  fields[kWriteBytes] = info.ri_diskio_byteswritten;
+  // The time that the threads, live or not, were runnable but not running.
+  fields[kRunqueueWaitNanos] = MachTimeToNanos(info.ri_runnable_time);
+}
+
+void ReadDiskFree(jlong *free_bytes) {
+  // The volumes of an APFS container share their free space: the one of the
+  // workspace is also the one of the output base, unless it was moved to
+  // another disk.
+  struct statfs fs;
+  if (statfs(".", &fs) == 0) {
+    *free_bytes = static_cast<jlong>(fs.f_bavail) * fs.f_bsize;
+  }
+}
+
+}  // namespace
+
+void TakeResourceSample(jlong *fields) {
+  // The levels are kept up to date by the notifications of the monitoring,
+  // which is shared with their modules.
+  static dispatch_once_t once_token;
+  dispatch_once(&once_token, ^{
+    portable_start_memory_pressure_monitoring();
+    portable_start_thermal_monitoring();
+    portable_start_system_load_advisory_monitoring();
+  });
+  ReadRusage(fields);
+  // There is no pressure stall information on macOS: the levels below are
+  // what the system tells of its load instead.
+  fields[kMemoryPressure] = portable_memory_pressure();
+  fields[kThermalLoad] = bazel::darwin::ThermalLoad();
+  fields[kCpuSpeed] = bazel::darwin::CpuSpeed();
+  fields[kLoadAdvisory] = bazel::darwin::SystemLoadAdvisory();
+  fields[kDiskFreeBytes] = -1;
+  ReadDiskFree(&fields[kDiskFreeBytes]);
+}
+
+}  // namespace blaze_jni
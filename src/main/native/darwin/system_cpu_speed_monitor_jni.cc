@@ -52,7 +52,8 @@ void portable_start_cpu_speed_monitoring() {
   });
 }
 
-int portable_cpu_speed() {
+// Returns the current CPU speed, or -1 in case of error, without logging it.
+static int copy_cpu_speed() {
   CFDictionaryRef cfCpuPowerStatus = NULL;
   IOReturn ret = IOPMCopyCPUPowerStatus(&cfCpuPowerStatus);
   if (ret == kIOReturnNotFound) {
@@ -75,10 +76,39 @@ int portable_cpu_speed() {
   int speed;
   CFNumberGetValue(cfSpeed, kCFNumberIntType, &speed);
   CFRelease(cfCpuPowerStatus);
+  return speed;
+}
 
-  BAZEL_LOG(USER) << "cpu speed anomaly: " << speed;
-
+int portable_cpu_speed() {
+  int speed = copy_cpu_speed();
+  if (speed != -1) {
+    BAZEL_LOG(USER) << "cpu speed anomaly: " << speed;
+  }
   return speed;
 }
 
 }  // namespace blaze_jni
+
+namespace bazel {
+namespace darwin {
+
+int CpuSpeed() {
+  // Copying the power status takes a round trip to powerd: only do it again
+  // when the speed has changed, or while it is not known yet.
+  static int token;
+  static int speed = -1;
+  static dispatch_once_t once_token;
+  dispatch_once(&once_token, ^{
+    BAZEL_CHECK_EQ(notify_register_check(kIOPMCPUPowerNotificationKey, &token),
+                   NOTIFY_STATUS_OK);
+  });
+  int changed;
+  if (notify_check(token, &changed) != NOTIFY_STATUS_OK || changed ||
+      speed == -1) {
+    speed = blaze_jni::copy_cpu_speed();
+  }
+  return speed;
+}
+
+}  // namespace darwin
+}  // namespace bazel
@@ -46,35 +46,53 @@ void portable_start_system_load_advisory_monitoring() {
   });
 }
 
+// Returns the load of a system load advisory level and sets `name` to its
+// name, or returns -1 if the level is unknown.
+static int load_from_advisory_level(uint64_t state, const char **name) {
+  switch ((IOSystemLoadAdvisoryLevel)state) {
+    case kIOSystemLoadAdvisoryLevelGreat:
+      *name = "great";
+      return 0;
+    case kIOSystemLoadAdvisoryLevelOK:
+      *name = "ok";
+      return 25;
+    case kIOSystemLoadAdvisoryLevelBad:
+      *name = "bad";
+      return 75;
+  }
+  return -1;
+}
+
 int portable_system_load_advisory() {
   uint64_t state;
   uint32_t status = notify_get_state(gSystemLoadAdvisoryNotifyToken, &state);
   if (status != NOTIFY_STATUS_OK) {
     BAZEL_LOG(FATAL) << "notify_get_state failed:" << status;
   }
-  IOSystemLoadAdvisoryLevel advisoryLevel = (IOSystemLoadAdvisoryLevel)state;
-  int load = -1;
-  switch (advisoryLevel) {
-    case kIOSystemLoadAdvisoryLevelGreat:
-      BAZEL_LOG(USER) << "system load advisory great (0) anomaly";
-      load = 0;
-      break;
-
-    case kIOSystemLoadAdvisoryLevelOK:
-      BAZEL_LOG(USER) << "system load advisory ok (25) anomaly";
-      load = 25;
-      break;
-
-    case kIOSystemLoadAdvisoryLevelBad:
-      BAZEL_LOG(USER) << "system load advisory bad (75) anomaly";
-      load = 75;
-      break;
-  }
+  const char *name;
+  int load = load_from_advisory_level(state, &name);
   if (load == -1) {
-    BAZEL_LOG(FATAL) << "unknown system load advisory level: " << advisoryLevel;
+    BAZEL_LOG(FATAL) << "unknown system load advisory level: " << state;
   }
-
+  BAZEL_LOG(USER) << "system load advisory " << name << " (" << load
+                  << ") anomaly";
   return load;
 }
 
 }  // namespace blaze_jni
+
+namespace bazel {
+namespace darwin {
+
+int SystemLoadAdvisory() {
+  uint64_t state;
+  if (notify_get_state(blaze_jni::gSystemLoadAdvisoryNotifyToken, &state) !=
+      NOTIFY_STATUS_OK) {
+    return -1;
+  }
+  const char *name;
+  return blaze_jni::load_from_advisory_level(state, &name);
+}
+
+}  // namespace darwin
+}  // namespace bazel
@@ -24,42 +24,40 @@ namespace blaze_jni {
 
 static int gThermalNotifyToken = 0;
 
-static int thermal_load_from_token(int token) {
-  uint64_t state;
-  uint32_t status = notify_get_state(token, &state);
-  BAZEL_CHECK_EQ(status, NOTIFY_STATUS_OK);
-  OSThermalPressureLevel thermalLevel = (OSThermalPressureLevel)state;
-  int load = -1;
-  switch (thermalLevel) {
+// Returns the load of a thermal pressure level and sets `name` to its name,
+// or returns -1 if the level is unknown.
+static int thermal_load_from_state(uint64_t state, const char **name) {
+  switch ((OSThermalPressureLevel)state) {
     case kOSThermalPressureLevelNominal:
-      BAZEL_LOG(USER) << "thermal pressure nominal (0) anomaly";
-      load = 0;
-      break;
-
+      *name = "nominal";
+      return 0;
     case kOSThermalPressureLevelModerate:
-      BAZEL_LOG(USER) << "thermal pressure moderate (33) anomaly ";
-      load = 33;
-      break;
-
+      *name = "moderate";
+      return 33;
     case kOSThermalPressureLevelHeavy:
-      BAZEL_LOG(USER) << "thermal pressure heavy (50) anomaly";
-      load = 50;
-      break;
-
+      *name = "heavy";
+      return 50;
     case kOSThermalPressureLevelTrapping:
-      BAZEL_LOG(USER) << "thermal pressure trapping (90) anomaly";
-      load = 90;
-      break;
-
+      *name = "trapping";
+      return 90;
     case kOSThermalPressureLevelSleeping:
-      BAZEL_LOG(USER) << "thermal pressure sleeping (100) anomaly";
-      load = 100;
-      break;
+      *name = "sleeping";
+      return 100;
   }
+  return -1;
+}
+
+static int thermal_load_from_token(int token) {
+  uint64_t state;
+  uint32_t status = notify_get_state(token, &state);
+  BAZEL_CHECK_EQ(status, NOTIFY_STATUS_OK);
+  const char *name;
+  int load = thermal_load_from_state(state, &name);
   if (load == -1) {
-    BAZEL_LOG(FATAL) << "unknown thermal pressure level: " << thermalLevel;
+    BAZEL_LOG(FATAL) << "unknown thermal pressure level: " << state;
   }
-
+  BAZEL_LOG(USER) << "thermal pressure " << name << " (" << load
+                  << ") anomaly";
   return load;
 }
 
@@ -96,3 +94,19 @@ int portable_thermal_load() {
 }
 
 }  // namespace blaze_jni
+
+namespace bazel {
+namespace darwin {
+
+int ThermalLoad() {
+  uint64_t state;
+  if (notify_get_state(blaze_jni::gThermalNotifyToken, &state) !=
+      NOTIFY_STATUS_OK) {
+    return -1;
+  }
+  const char *name;
+  return blaze_jni::thermal_load_from_state(state, &name);
+}
+
+}  // namespace darwin
+}  // namespace bazel
@@ -24,6 +24,14 @@ namespace darwin {
 // Queue used for all of our anomaly tracking.
 dispatch_queue_t JniDispatchQueue();
 
+// Like portable_thermal_load(), portable_system_load_advisory() and
+// portable_cpu_speed(), for the resource sampler that reads them at every
+// sample: they do not log the level as an anomaly, and return -1 if it is not
+// known. The first two need the monitoring of their level to be started.
+int ThermalLoad();
+int SystemLoadAdvisory();
+int CpuSpeed();
+
 }  // namespace darwin
 }  // namespace bazel
 
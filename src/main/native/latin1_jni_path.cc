@@ -16,6 +16,8 @@
 
 #include <string.h>
 
+#include <memory>
+
 namespace blaze_jni {
 
 jstring NewStringLatin1(JNIEnv *env, const char *str) {
@@ -58,6 +60,44 @@ static bool CompactStringsEnabled(JNIEnv *env) {
   return false;
 }
 
+// A few buffers for the chars of each thread, reused from one call to the
+// next, so that the hot paths (stat and the like) do not allocate. Most calls
+// hold one path at a time, a few two (rename, link, symlink).
+namespace {
+
+constexpr int kBuffersPerThread = 2;
+constexpr size_t kMinBufferSize = 256;
+// Do not hold on to the buffers of the rare longer paths.
+constexpr size_t kMaxBufferSize = 4096;
+
+struct ThreadBuffers {
+  std::unique_ptr<char[]> buffers[kBuffersPerThread];
+  size_t sizes[kBuffersPerThread] = {};
+  bool in_use[kBuffersPerThread] = {};
+};
+
+thread_local ThreadBuffers thread_buffers;
+
+char *AllocateLatin1Chars(size_t size) {
+  if (size <= kMaxBufferSize) {
+    ThreadBuffers &buffers = thread_buffers;
+    for (int i = 0; i < kBuffersPerThread; i++) {
+      if (buffers.in_use[i]) {
+        continue;
+      }
+      if (buffers.sizes[i] < size) {
+        buffers.sizes[i] = size < kMinBufferSize ? kMinBufferSize : size;
+        buffers.buffers[i].reset(new char[buffers.sizes[i]]);
+      }
+      buffers.in_use[i] = true;
+      return buffers.buffers[i].get();
+    }
+  }
+  return new char[size];
+}
+
+}  // namespace
+
 char *GetStringLatin1Chars(JNIEnv *env, jstring jstr) {
   jint len = env->GetStringLength(jstr);
 
@@ -65,9 +105,10 @@ char *GetStringLatin1Chars(JNIEnv *env, jstring jstr) {
   static bool cs_enabled = CompactStringsEnabled(env);
   const int LATIN1 = 0;
   if (cs_enabled && env->GetByteField(jstr, String_coder_field) == LATIN1) {
-    char *result = new char[len + 1];
+    char *result = AllocateLatin1Chars(len + 1);
     if (jobject jvalue = env->GetObjectField(jstr, String_value_field)) {
       env->GetByteArrayRegion((jbyteArray)jvalue, 0, len, (jbyte *)result);
+      env->DeleteLocalRef(jvalue);
     }
     result[len] = 0;
     return result;
@@ -78,7 +119,7 @@ char *GetStringLatin1Chars(JNIEnv *env, jstring jstr) {
     return nullptr;
   }
 
-  char *result = new char[len + 1];
+  char *result = AllocateLatin1Chars(len + 1);
   for (int i = 0; i < len; i++) {
     jchar unicode = str[i];  // (unsigned)
     result[i] = unicode <= 0x00ff ? unicode : '?';
@@ -93,6 +134,15 @@ char *GetStringLatin1Chars(JNIEnv *env, jstring jstr) {
  * Release the Latin1 chars returned by a prior call to
  * GetStringLatin1Chars.
  */
-void ReleaseStringLatin1Chars(const char *s) { delete[] s; }
+void ReleaseStringLatin1Chars(const char *s) {
+  ThreadBuffers &buffers = thread_buffers;
+  for (int i = 0; i < kBuffersPerThread; i++) {
+    if (buffers.in_use[i] && s == buffers.buffers[i].get()) {
+      buffers.in_use[i] = false;
+      return;
+    }
+  }
+  delete[] s;
+}
 
 }  // namespace blaze_jni
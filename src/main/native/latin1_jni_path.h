@@ -42,7 +42,7 @@ char *GetStringLatin1Chars(JNIEnv *env, jstring jstr);
 
 /**
  * Release the Latin1 chars returned by a prior call to
- * GetStringLatin1Chars.
+ * GetStringLatin1Chars, on the same thread.
  */
 void ReleaseStringLatin1Chars(const char *s);
 
@@ -0,0 +1,650 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The native side of LinuxFsNotifyDiffAwareness. Where the server may mark
+// a whole filesystem with fanotify (which takes CAP_SYS_ADMIN), one mark
+// reports every change under the root; otherwise every directory under the
+// root gets an inotify watch, like the WatchService would set up.
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <jni.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/fanotify.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <condition_variable>  // NOLINT
+#include <fstream>
+#include <mutex>  // NOLINT
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+// Once more paths than this changed between two polls, we report that
+// everything changed, which is cheaper for Skyframe to handle by then.
+const size_t kMaxChangedPaths = 100000;
+
+// The most directory handles that we remember the paths of for fanotify.
+const size_t kMaxDirHandles = 100000;
+
+const uint32_t kInotifyMask = IN_ATTRIB | IN_CREATE | IN_DELETE |
+                              IN_DELETE_SELF | IN_MODIFY | IN_MOVE_SELF |
+                              IN_MOVED_FROM | IN_MOVED_TO | IN_DONT_FOLLOW |
+                              IN_EXCL_UNLINK | IN_ONLYDIR;
+
+// A structure to pass around the watches and the list of paths.
+struct JNIFsNotifyDiffAwareness {
+  // The directory to watch, without a trailing slash unless it is "/".
+  std::string root;
+
+  // Paths under root whose changes are not reported, nor watched.
+  std::vector<std::string> ignored_paths;
+
+  // The fanotify or inotify descriptor that the events are read from.
+  int notify_fd = -1;
+
+  // Whether notify_fd is a fanotify descriptor.
+  bool fanotify = false;
+
+  // A descriptor on the filesystem of root for open_by_handle_at (fanotify).
+  int mount_fd = -1;
+
+  // doClose writes to the second descriptor to stop run.
+  int stop_pipe[2] = {-1, -1};
+
+  // The directory of every inotify watch. Only used by create and run.
+  std::unordered_map<int, std::string> watched_dirs;
+
+  // The path of directories by their file handle, for fanotify. Only used by
+  // run.
+  std::unordered_map<std::string, std::string> dir_handles;
+
+  // Mutex to protect the fields below.
+  std::mutex mutex;
+
+  // Signalled when run returns.
+  std::condition_variable stopped;
+
+  // Whether run is listening for events.
+  bool running = false;
+
+  // If true, we lost events so we don't know what changed exactly.
+  bool everything_changed = false;
+
+  // If not empty, the reason why we can no longer watch the root.
+  std::string error;
+
+  // Set of paths that have been changed since last polling.
+  std::unordered_set<std::string> paths;
+
+  ~JNIFsNotifyDiffAwareness() {
+    for (int fd : {notify_fd, mount_fd, stop_pipe[0], stop_pipe[1]}) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  }
+
+  bool IsUnderRoot(const std::string &path) const {
+    if (root == "/") {
+      return path[0] == '/';
+    }
+    return path.compare(0, root.size(), root) == 0 &&
+           (path.size() == root.size() || path[root.size()] == '/');
+  }
+
+  bool IsIgnored(const std::string &path) const {
+    for (const std::string &ignored : ignored_paths) {
+      if (path.compare(0, ignored.size(), ignored) == 0 &&
+          (path.size() == ignored.size() || path[ignored.size()] == '/')) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void AddChangedPath(const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (everything_changed) {
+      return;
+    }
+    if (paths.size() >= kMaxChangedPaths) {
+      everything_changed = true;
+      paths.clear();
+      return;
+    }
+    paths.insert(path);
+  }
+
+  void SetEverythingChanged() {
+    std::lock_guard<std::mutex> lock(mutex);
+    everything_changed = true;
+    paths.clear();
+  }
+
+  void SetError(const std::string &message) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (error.empty()) {
+      error = message;
+    }
+  }
+};
+
+std::string ErrorMessage(const std::string &what, int error) {
+  return what + ": " + strerror(error);
+}
+
+std::string ChildOf(const std::string &dir, const char *name) {
+  return dir == "/" ? dir + name : dir + "/" + name;
+}
+
+// Decodes the octal escapes of a path in /proc/self/mountinfo.
+std::string UnescapeMountPath(const std::string &escaped) {
+  std::string path;
+  for (size_t i = 0; i < escaped.size(); i++) {
+    if (escaped[i] == '\\' && i + 3 < escaped.size()) {
+      path += static_cast<char>(strtol(escaped.substr(i + 1, 3).c_str(),
+                                       nullptr, 8));
+      i += 3;
+    } else {
+      path += escaped[i];
+    }
+  }
+  return path;
+}
+
+// Whether something is mounted below `root`, whose changes a fanotify mark
+// on the filesystem of `root` would not see.
+bool HasMountsBelow(const JNIFsNotifyDiffAwareness &info) {
+  std::ifstream mountinfo("/proc/self/mountinfo");
+  if (!mountinfo) {
+    return true;
+  }
+  std::string line;
+  while (std::getline(mountinfo, line)) {
+    // The fifth field is the mount point.
+    size_t start = 0;
+    for (int i = 0; i < 4 && start != std::string::npos; i++) {
+      start = line.find(' ', start);
+      if (start != std::string::npos) {
+        start++;
+      }
+    }
+    if (start == std::string::npos) {
+      continue;
+    }
+    std::string mount_point =
+        UnescapeMountPath(line.substr(start, line.find(' ', start) - start));
+    if (mount_point != info.root && info.IsUnderRoot(mount_point)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Sets up a fanotify mark on the filesystem of the root. Returns false if
+// that is not possible, in which case we fall back to inotify.
+bool WatchWithFanotify(JNIFsNotifyDiffAwareness *info) {
+#if defined(FAN_REPORT_DFID_NAME)
+  if (HasMountsBelow(*info)) {
+    return false;
+  }
+  int fd = fanotify_init(
+      FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_CLOEXEC | FAN_NONBLOCK,
+      O_RDONLY | O_CLOEXEC | O_LARGEFILE);
+  if (fd < 0) {
+    // Usually EPERM without CAP_SYS_ADMIN, or EINVAL on kernels before 5.9.
+    return false;
+  }
+  if (fanotify_mark(fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM,
+                    FAN_ATTRIB | FAN_CREATE | FAN_DELETE | FAN_DELETE_SELF |
+                        FAN_MODIFY | FAN_MOVED_FROM | FAN_MOVED_TO |
+                        FAN_MOVE_SELF | FAN_ONDIR,
+                    AT_FDCWD, info->root.c_str()) < 0) {
+    close(fd);
+    return false;
+  }
+  int mount_fd = open(info->root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (mount_fd < 0) {
+    close(fd);
+    return false;
+  }
+  info->notify_fd = fd;
+  info->mount_fd = mount_fd;
+  info->fanotify = true;
+  return true;
+#else
+  return false;
+#endif
+}
+
+// Adds inotify watches on `dir` and every directory below it. If `report`,
+// everything found below `dir` is reported as changed, which is how we
+// learn about the contents of a directory created or moved under the root.
+bool WatchTree(JNIFsNotifyDiffAwareness *info, const std::string &dir,
+               bool report) {
+  std::vector<std::string> pending = {dir};
+  while (!pending.empty()) {
+    std::string path = std::move(pending.back());
+    pending.pop_back();
+    // Watch the directory before listing it so that we don't miss entries
+    // created in between.
+    int wd = inotify_add_watch(info->notify_fd, path.c_str(), kInotifyMask);
+    if (wd < 0) {
+      if (errno == ENOENT || errno == ENOTDIR || errno == EACCES) {
+        // It is gone or replaced already, which we get an event for, or we
+        // cannot read it anyway.
+        continue;
+      }
+      info->SetError(ErrorMessage(
+          errno == ENOSPC ? "inotify watch limit reached (see "
+                            "/proc/sys/fs/inotify/max_user_watches)"
+                          : "inotify_add_watch(" + path + ")",
+          errno));
+      return false;
+    }
+    info->watched_dirs[wd] = path;
+
+    DIR *d = opendir(path.c_str());
+    if (d == nullptr) {
+      continue;
+    }
+    struct dirent *e;
+    while ((e = readdir(d)) != nullptr) {
+      if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) {
+        continue;
+      }
+      std::string child = ChildOf(path, e->d_name);
+      if (info->IsIgnored(child)) {
+        continue;
+      }
+      if (report) {
+        info->AddChangedPath(child);
+      }
+      bool is_dir = e->d_type == DT_DIR;
+      if (e->d_type == DT_UNKNOWN) {
+        struct stat statbuf;
+        is_dir = lstat(child.c_str(), &statbuf) == 0 &&
+                 S_ISDIR(statbuf.st_mode);
+      }
+      if (is_dir) {
+        pending.push_back(std::move(child));
+      }
+    }
+    closedir(d);
+  }
+  return true;
+}
+
+// Reads the inotify events in `buf`. Returns false once we cannot go on.
+bool HandleInotifyEvents(JNIFsNotifyDiffAwareness *info, const char *buf,
+                         ssize_t len) {
+  for (const char *p = buf; p < buf + len;) {
+    const struct inotify_event *event =
+        reinterpret_cast<const struct inotify_event *>(p);
+    p += sizeof(struct inotify_event) + event->len;
+
+    if (event->mask & IN_Q_OVERFLOW) {
+      info->SetEverythingChanged();
+      continue;
+    }
+    auto it = info->watched_dirs.find(event->wd);
+    if (it == info->watched_dirs.end()) {
+      continue;
+    }
+    if (event->mask & IN_IGNORED) {
+      if (it->second == info->root) {
+        info->SetError("the watched directory " + info->root + " is gone");
+        return false;
+      }
+      info->watched_dirs.erase(it);
+      continue;
+    }
+    if (event->mask & IN_MOVE_SELF) {
+      if (it->second == info->root) {
+        info->SetError("the watched directory " + info->root + " was moved");
+        return false;
+      }
+      // The event in the parent directory tells us about it.
+      continue;
+    }
+    std::string path =
+        event->len > 0 ? ChildOf(it->second, event->name) : it->second;
+    if (info->IsIgnored(path)) {
+      continue;
+    }
+    if ((event->mask & IN_ISDIR) &&
+        (event->mask & (IN_MOVED_FROM | IN_MOVED_TO))) {
+      // A directory was renamed. As with FSEvents, we cannot tell which files
+      // disappeared from under the source, and the watches below it now have
+      // the wrong paths, so start over.
+      info->SetEverythingChanged();
+      for (const auto &watch : info->watched_dirs) {
+        inotify_rm_watch(info->notify_fd, watch.first);
+      }
+      info->watched_dirs.clear();
+      if (!WatchTree(info, info->root, false)) {
+        return false;
+      }
+      continue;
+    }
+    info->AddChangedPath(path);
+    if ((event->mask & IN_ISDIR) && (event->mask & IN_CREATE)) {
+      if (!WatchTree(info, path, true)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+#if defined(FAN_REPORT_DFID_NAME)
+// Returns the path of the directory with the given handle, or an empty
+// string if it cannot be found, e.g. because it was deleted.
+std::string DirPath(JNIFsNotifyDiffAwareness *info,
+                    const struct file_handle *handle) {
+  std::string key(reinterpret_cast<const char *>(handle),
+                  sizeof(*handle) + handle->handle_bytes);
+  auto it = info->dir_handles.find(key);
+  if (it != info->dir_handles.end()) {
+    return it->second;
+  }
+
+  // open_by_handle_at wants a handle that it can write to.
+  std::vector<char> copy(key.begin(), key.end());
+  int fd = open_by_handle_at(info->mount_fd,
+                             reinterpret_cast<struct file_handle *>(&copy[0]),
+                             O_PATH | O_CLOEXEC);
+  if (fd < 0) {
+    return "";
+  }
+  char link[64];
+  snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+  char target[PATH_MAX];
+  ssize_t len = readlink(link, target, sizeof(target));
+  close(fd);
+  if (len <= 0 || len == sizeof(target)) {
+    return "";
+  }
+  std::string path(target, len);
+  static const char kDeleted[] = " (deleted)";
+  if (path.size() > sizeof(kDeleted) - 1 &&
+      path.compare(path.size() - (sizeof(kDeleted) - 1), std::string::npos,
+                   kDeleted) == 0) {
+    return "";
+  }
+  if (info->dir_handles.size() >= kMaxDirHandles) {
+    info->dir_handles.clear();
+  }
+  info->dir_handles[key] = path;
+  return path;
+}
+
+// Reads the fanotify events in `buf`. Returns false once we cannot go on.
+bool HandleFanotifyEvents(JNIFsNotifyDiffAwareness *info, const char *buf,
+                          ssize_t len) {
+  const struct fanotify_event_metadata *event =
+      reinterpret_cast<const struct fanotify_event_metadata *>(buf);
+  for (; FAN_EVENT_OK(event, len); event = FAN_EVENT_NEXT(event, len)) {
+    if (event->vers != FANOTIFY_METADATA_VERSION) {
+      info->SetError("unexpected fanotify metadata version");
+      return false;
+    }
+    if (event->mask & FAN_Q_OVERFLOW) {
+      info->SetEverythingChanged();
+      continue;
+    }
+    const struct fanotify_event_info_fid *fid =
+        reinterpret_cast<const struct fanotify_event_info_fid *>(event + 1);
+    if (event->event_len <= event->metadata_len ||
+        (fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME &&
+         fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID)) {
+      info->SetEverythingChanged();
+      continue;
+    }
+    const struct file_handle *handle =
+        reinterpret_cast<const struct file_handle *>(fid->handle);
+    std::string dir = DirPath(info, handle);
+    if (dir.empty()) {
+      // The directory is gone already, so we don't know where it was. This
+      // also happens for events outside the root that we don't care about,
+      // but we cannot tell these apart.
+      if (event->mask & (FAN_DELETE_SELF | FAN_DELETE)) {
+        continue;
+      }
+      info->SetEverythingChanged();
+      continue;
+    }
+    const char *name = "";
+    if (fid->hdr.info_type == FAN_EVENT_INFO_TYPE_DFID_NAME) {
+      name = reinterpret_cast<const char *>(handle->f_handle +
+                                            handle->handle_bytes);
+    }
+    std::string path = name[0] == '\0' || strcmp(name, ".") == 0
+                           ? dir
+                           : ChildOf(dir, name);
+    if (!info->IsUnderRoot(path) || info->IsIgnored(path)) {
+      continue;
+    }
+    if (path == info->root && (event->mask & (FAN_DELETE | FAN_MOVED_FROM))) {
+      // The root was deleted or moved away, which the event in its parent
+      // tells us about.
+      info->SetError("the watched directory " + info->root + " is gone");
+      return false;
+    }
+    if ((event->mask & FAN_ONDIR) &&
+        (event->mask & (FAN_MOVED_FROM | FAN_MOVED_TO | FAN_MOVE_SELF))) {
+      // See HandleInotifyEvents; the paths that we remember for the
+      // directories below it are wrong now, too.
+      info->SetEverythingChanged();
+      info->dir_handles.clear();
+      continue;
+    }
+    info->AddChangedPath(path);
+  }
+  return true;
+}
+#endif
+
+JNIFsNotifyDiffAwareness *GetInfo(JNIEnv *env, jobject diffAwareness) {
+  jclass clazz = env->GetObjectClass(diffAwareness);
+  jfieldID fid = env->GetFieldID(clazz, "nativePointer", "J");
+  jlong field = env->GetLongField(diffAwareness, fid);
+  return reinterpret_cast<JNIFsNotifyDiffAwareness *>(field);
+}
+
+void ThrowIOException(JNIEnv *env, const std::string &message) {
+  jclass clazz = env->FindClass("java/io/IOException");
+  if (clazz != nullptr) {
+    env->ThrowNew(clazz, message.c_str());
+  }
+}
+
+std::string GetString(JNIEnv *env, jstring str) {
+  const char *chars = env->GetStringUTFChars(str, nullptr);
+  std::string result(chars);
+  env->ReleaseStringUTFChars(str, chars);
+  while (result.size() > 1 && result.back() == '/') {
+    result.pop_back();
+  }
+  return result;
+}
+
+}  // namespace
+
+/*
+ * Class:     LinuxFsNotifyDiffAwareness
+ * Method:    create
+ * Signature: (Ljava/lang/String;[Ljava/lang/String;)V
+ * Throws:    java.io.IOException
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_skyframe_LinuxFsNotifyDiffAwareness_create(
+    JNIEnv *env, jobject diffAwareness, jstring root,
+    jobjectArray ignoredPaths) {
+  JNIFsNotifyDiffAwareness *info = new JNIFsNotifyDiffAwareness();
+  info->root = GetString(env, root);
+  jsize length = env->GetArrayLength(ignoredPaths);
+  for (jsize i = 0; i < length; i++) {
+    jstring path =
+        static_cast<jstring>(env->GetObjectArrayElement(ignoredPaths, i));
+    info->ignored_paths.push_back(GetString(env, path));
+    env->DeleteLocalRef(path);
+  }
+
+  if (pipe2(info->stop_pipe, O_CLOEXEC) < 0) {
+    ThrowIOException(env, ErrorMessage("pipe2", errno));
+    delete info;
+    return;
+  }
+  if (!WatchWithFanotify(info)) {
+    info->notify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (info->notify_fd < 0) {
+      ThrowIOException(env, ErrorMessage("inotify_init1", errno));
+      delete info;
+      return;
+    }
+    if (!WatchTree(info, info->root, false) ||
+        info->watched_dirs.empty()) {
+      ThrowIOException(env, info->error.empty()
+                                ? "cannot watch " + info->root
+                                : info->error);
+      delete info;
+      return;
+    }
+  }
+
+  // Save the info pointer to LinuxFsNotifyDiffAwareness#nativePointer
+  jclass clazz = env->GetObjectClass(diffAwareness);
+  jfieldID fid = env->GetFieldID(clazz, "nativePointer", "J");
+  env->SetLongField(diffAwareness, fid, reinterpret_cast<jlong>(info));
+}
+
+/*
+ * Class:     LinuxFsNotifyDiffAwareness
+ * Method:    run
+ * Signature: (Ljava/util/concurrent/CountDownLatch;)V
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_skyframe_LinuxFsNotifyDiffAwareness_run(
+    JNIEnv *env, jobject diffAwareness, jobject listening) {
+  JNIFsNotifyDiffAwareness *info = GetInfo(env, diffAwareness);
+  {
+    std::lock_guard<std::mutex> lock(info->mutex);
+    info->running = true;
+  }
+  jclass countDownLatchClass = env->GetObjectClass(listening);
+  jmethodID countDownMethod =
+      env->GetMethodID(countDownLatchClass, "countDown", "()V");
+  env->CallVoidMethod(listening, countDownMethod);
+
+  // Large enough for many events at once, and aligned for the structures
+  // that we read from it.
+  alignas(8) static thread_local char buf[64 * 1024];
+  bool ok = true;
+  while (ok) {
+    struct pollfd fds[2] = {{info->notify_fd, POLLIN, 0},
+                            {info->stop_pipe[0], POLLIN, 0}};
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      info->SetError(ErrorMessage("poll", errno));
+      break;
+    }
+    if (fds[1].revents != 0) {
+      break;
+    }
+    ssize_t len = read(info->notify_fd, buf, sizeof(buf));
+    if (len < 0) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      info->SetError(ErrorMessage("read", errno));
+      break;
+    }
+#if defined(FAN_REPORT_DFID_NAME)
+    ok = info->fanotify ? HandleFanotifyEvents(info, buf, len)
+                        : HandleInotifyEvents(info, buf, len);
+#else
+    ok = HandleInotifyEvents(info, buf, len);
+#endif
+  }
+
+  std::lock_guard<std::mutex> lock(info->mutex);
+  info->running = false;
+  info->stopped.notify_all();
+}
+
+/*
+ * Class:     LinuxFsNotifyDiffAwareness
+ * Method:    poll
+ * Signature: ()[Ljava/lang/String;
+ * Throws:    java.io.IOException
+ */
+extern "C" JNIEXPORT jobjectArray JNICALL
+Java_com_google_devtools_build_lib_skyframe_LinuxFsNotifyDiffAwareness_poll(
+    JNIEnv *env, jobject diffAwareness) {
+  JNIFsNotifyDiffAwareness *info = GetInfo(env, diffAwareness);
+  std::lock_guard<std::mutex> lock(info->mutex);
+  if (!info->error.empty()) {
+    ThrowIOException(env, info->error);
+    return nullptr;
+  }
+
+  jobjectArray result;
+  if (info->everything_changed) {
+    result = nullptr;
+  } else {
+    jclass classString = env->FindClass("java/lang/String");
+    result = env->NewObjectArray(info->paths.size(), classString, nullptr);
+    int i = 0;
+    for (auto it = info->paths.begin(); it != info->paths.end(); it++, i++) {
+      jstring path = env->NewStringUTF(it->c_str());
+      env->SetObjectArrayElement(result, i, path);
+      env->DeleteLocalRef(path);
+    }
+  }
+
+  info->everything_changed = false;
+  info->paths.clear();
+  return result;
+}
+
+/*
+ * Class:     LinuxFsNotifyDiffAwareness
+ * Method:    doClose
+ * Signature: ()V
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_skyframe_LinuxFsNotifyDiffAwareness_doClose(
+    JNIEnv *env, jobject diffAwareness) {
+  JNIFsNotifyDiffAwareness *info = GetInfo(env, diffAwareness);
+  {
+    std::unique_lock<std::mutex> lock(info->mutex);
+    while (write(info->stop_pipe[1], "x", 1) < 0 && errno == EINTR) {
+    }
+    info->stopped.wait(lock, [info] { return !info->running; });
+  }
+  delete info;
+}
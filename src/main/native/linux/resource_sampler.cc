@@ -0,0 +1,144 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <dirent.h>
+#include <jni.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/statvfs.h>
+
+#include <string>
+
+#include "src/main/native/linux/util.h"
+#include "src/main/native/resource_sampler.h"
+
+namespace blaze_jni {
+
+namespace {
+
+// Reads the "total=" of the "some" and "full" lines of a pressure file.
+void ReadPressure(const char *path, jlong *some, jlong *full) {
+  FILE *fp = fopen(path, "re");
+  if (fp == nullptr) {
+    return;
+  }
+  char kind[8];
+  unsigned long long total;
+  while (fscanf(fp, "%7s avg10=%*f avg60=%*f avg300=%*f total=%llu", kind,
+                &total) == 2) {
+    if (strcmp(kind, "some") == 0) {
+      *some = total;
+    } else if (full != nullptr && strcmp(kind, "full") == 0) {
+      *full = total;
+    }
+  }
+  fclose(fp);
+}
+
+// From /proc/self/stat.
+void ReadMajorFaults(jlong *major_faults) {
+  std::string stat;
+  if (!ReadFirstLine("/proc/self/stat", &stat)) {
+    return;
+  }
+  // The name may hold spaces and parentheses: the fields start after the
+  // last ')'. majflt is the 12th field, the 10th after the name.
+  size_t end = stat.rfind(')');
+  if (end == std::string::npos) {
+    return;
+  }
+  unsigned long long majflt;
+  if (sscanf(stat.c_str() + end + 1,
+             " %*c %*d %*d %*d %*d %*d %*u %*u %*u %llu", &majflt) == 1) {
+    *major_faults = majflt;
+  }
+}
+
+void ReadIo(jlong *read_bytes, jlong *write_bytes) {
+  // Only readable by the owner of the process, which the server is.
+  FILE *fp = fopen("/proc/self/io", "re");
+  if (fp == nullptr) {
+    return;
+  }
+  char name[32];
+  unsigned long long value;
+  while (fscanf(fp, "%31s %llu", name, &value) == 2) {
+    if (strcmp(name, "read_bytes:") == 0) {
+      *read_bytes = value;
+    } else if (strcmp(name, "write_bytes:") == 0) {
+      *write_bytes = value;
+    }
+  }
+  fclose(fp);
+}
+
+// From /proc/self/task/*/schedstat: threads that have exited no longer count.
+void ReadRunqueueWait(jlong *wait_nanos) {
+  DIR *dir = opendir("/proc/self/task");
+  if (dir == nullptr) {
+    return;
+  }
+  jlong total = 0;
+  char path[PATH_MAX];
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+    snprintf(path, sizeof path, "/proc/self/task/%s/schedstat", entry->d_name);
+    FILE *fp = fopen(path, "re");
+    if (fp == nullptr) {
+      continue;  // The thread has exited.
+    }
+    unsigned long long run, wait;
+    if (fscanf(fp, "%llu %llu", &run, &wait) == 2) {
+      total += wait;
+    }
+    fclose(fp);
+  }
+  closedir(dir);
+  *wait_nanos = total;
+}
+
+void ReadDiskFree(jlong *free_bytes) {
+  struct statvfs fs;
+  if (statvfs(".", &fs) == 0) {
+    *free_bytes = static_cast<jlong>(fs.f_bavail) * fs.f_frsize;
+  }
+}
+
+}  // namespace
+
+void TakeResourceSample(jlong *fields) {
+  ReadMajorFaults(&fields[kMajorFaults]);
+  ReadIo(&fields[kReadBytes], &fields[kWriteBytes]);
+  // The "full" line of the cpu pressure is not defined for the system.
+  ReadPressure("/proc/pressure/cpu", &fields[kCpuSomeMicros], nullptr);
+  ReadPressure("/proc/pressure/io", &fields[kIoSomeMicros],
+               &fields[kIoFullMicros]);
+  ReadPressure("/proc/pressure/memory", &fields[kMemorySomeMicros],
+               &fields[kMemoryFullMicros]);
+  ReadRunqueueWait(&fields[kRunqueueWaitNanos]);
+  // The levels are not sampled on Linux, where the PSI stall times tell
+  // more.
+  fields[kMemoryPressure] = -1;
+  fields[kThermalLoad] = -1;
+  fields[kCpuSpeed] = -1;
+  fields[kLoadAdvisory] = -1;
+  fields[kDiskFreeBytes] = -1;
+  ReadDiskFree(&fields[kDiskFreeBytes]);
+}
+
+}  // namespace blaze_jni
@@ -0,0 +1,86 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>  // NOLINT
+#include <string>
+
+#include "src/main/native/linux/util.h"
+#include "src/main/native/unix_jni.h"
+
+namespace blaze_jni {
+
+static const char kCpufreqDir[] = "/sys/devices/system/cpu/cpufreq";
+
+// Reads a frequency of a cpufreq policy, in kHz. Returns 0 if it cannot.
+static long ReadFrequency(const std::string &path) {
+  std::string value;
+  return ReadFirstLine(path, &value) ? strtol(value.c_str(), nullptr, 10) : 0;
+}
+
+int portable_cpu_speed() {
+  // The speed limit of the slowest policy, as a percentage of the fastest its
+  // cpus go, like the processor speed limit of macOS. The limit goes down
+  // when the kernel cools the cpus down or caps their power, unlike the
+  // current frequency, which also follows the load.
+  DIR *dir = opendir(kCpufreqDir);
+  if (dir == nullptr) {
+    return -1;
+  }
+  int speed = -1;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    if (strncmp(entry->d_name, "policy", 6) != 0) {
+      continue;
+    }
+    std::string policy = std::string(kCpufreqDir) + "/" + entry->d_name;
+    long max = ReadFrequency(policy + "/cpuinfo_max_freq");
+    long limit = ReadFrequency(policy + "/scaling_max_freq");
+    if (max <= 0 || limit <= 0) {
+      continue;
+    }
+    int policy_speed =
+        std::max(1, std::min(100, static_cast<int>(limit * 100 / max)));
+    if (speed == -1 || policy_speed < speed) {
+      speed = policy_speed;
+    }
+  }
+  closedir(dir);
+  return speed;
+}
+
+void portable_start_cpu_speed_monitoring() {
+  static std::once_flag once;
+  std::call_once(once, [] {
+    // cpufreq does not notify of changes to the limits: poll them instead,
+    // unless there is no cpufreq at all.
+    static std::atomic<int> last_speed(portable_cpu_speed());
+    if (last_speed.load() == -1) {
+      return;
+    }
+    StartPolling(10, [] {
+      int speed = portable_cpu_speed();
+      if (last_speed.exchange(speed) != speed) {
+        cpu_speed_callback(speed);
+      }
+    });
+  });
+}
+
+}  // namespace blaze_jni
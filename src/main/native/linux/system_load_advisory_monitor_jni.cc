@@ -0,0 +1,48 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+#include <mutex>  // NOLINT
+
+#include "src/main/native/linux/util.h"
+#include "src/main/native/unix_jni.h"
+
+namespace blaze_jni {
+
+// The advisories of SystemLoadAdvisoryModule, as on macOS.
+static const int kLoadGreat = 0;
+static const int kLoadOk = 25;
+static const int kLoadBad = 75;
+
+static std::atomic<int> g_system_load_advisory(kLoadGreat);
+
+void portable_start_system_load_advisory_monitoring() {
+  // To test, run more busy loops than there are cores.
+  static std::once_flag once;
+  std::call_once(once, [] {
+    // Runnable tasks waiting for a cpu for 20% of a 2s window make the load
+    // OK rather than great, and for half of it bad.
+    StartPressureMonitoring(
+        "/proc/pressure/cpu", "some 400000 2000000", "some 1000000 2000000",
+        [](int level) {
+          static const int kAdvisories[] = {kLoadGreat, kLoadOk, kLoadBad};
+          g_system_load_advisory.store(kAdvisories[level]);
+          system_load_advisory_callback(kAdvisories[level]);
+        });
+  });
+}
+
+int portable_system_load_advisory() { return g_system_load_advisory.load(); }
+
+}  // namespace blaze_jni
@@ -0,0 +1,55 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+#include <mutex>  // NOLINT
+#include <string>
+
+#include "src/main/native/linux/util.h"
+#include "src/main/native/unix_jni.h"
+
+namespace blaze_jni {
+
+static std::atomic<int> g_memory_pressure_level(MemoryPressureLevelNormal);
+
+void portable_start_memory_pressure_monitoring() {
+  // To test, fill the memory of a cgroup whose memory.high is set, as with
+  // --experimental_cgroup_memory_high.
+  static std::once_flag once;
+  std::call_once(once, [] {
+    // Stalls of 200ms in windows of 2s, the smallest window that users other
+    // than root may use: some stalls are a warning, and stalls of all the
+    // tasks at once are critical.
+    auto start = [](const std::string &path) {
+      return StartPressureMonitoring(
+          path, "some 200000 2000000", "full 200000 2000000", [](int level) {
+            // The levels of StartPressureMonitoring are MemoryPressureLevels.
+            g_memory_pressure_level.store(level);
+            memory_pressure_callback(static_cast<MemoryPressureLevel>(level));
+          });
+    };
+    // The pressure of the cgroup of the server, which is what a memory.high
+    // throttles, or else of the whole system. The root cgroup has none.
+    std::string cgroup = OwnCgroupDirectory();
+    if (cgroup.empty() || !start(cgroup + "/memory.pressure")) {
+      start("/proc/pressure/memory");
+    }
+  });
+}
+
+MemoryPressureLevel portable_memory_pressure() {
+  return static_cast<MemoryPressureLevel>(g_memory_pressure_level.load());
+}
+
+}  // namespace blaze_jni
@@ -0,0 +1,98 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <mutex>  // NOLINT
+#include <string>
+
+#include "src/main/native/linux/util.h"
+#include "src/main/native/unix_jni.h"
+
+namespace blaze_jni {
+
+static const char kThermalDir[] = "/sys/class/thermal";
+
+// Returns the thermal load of a zone of kThermalDir: how far its temperature
+// is along its trip points, with the values of the macOS pressure levels
+// that SystemThermalModule knows of.
+static int ZoneThermalLoad(const std::string &zone) {
+  std::string value;
+  if (!ReadFirstLine(zone + "/temp", &value)) {
+    return 0;
+  }
+  long temp = strtol(value.c_str(), nullptr, 10);
+  int load = 0;
+  for (int i = 0;; i++) {
+    std::string trip = zone + "/trip_point_" + std::to_string(i);
+    std::string type;
+    if (!ReadFirstLine(trip + "_type", &type) ||
+        !ReadFirstLine(trip + "_temp", &value)) {
+      break;
+    }
+    long trip_temp = strtol(value.c_str(), nullptr, 10);
+    if (trip_temp <= 0 || temp < trip_temp) {
+      continue;
+    }
+    if (type == "critical") {
+      load = 100;
+    } else if (type == "hot" && load < 90) {
+      load = 90;
+    } else if (type == "passive" && load < 50) {
+      // The kernel is throttling the zone.
+      load = 50;
+    }
+  }
+  return load;
+}
+
+int portable_thermal_load() {
+  DIR *dir = opendir(kThermalDir);
+  if (dir == nullptr) {
+    return 0;
+  }
+  int load = 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    if (strncmp(entry->d_name, "thermal_zone", 12) == 0) {
+      int zone_load =
+          ZoneThermalLoad(std::string(kThermalDir) + "/" + entry->d_name);
+      if (zone_load > load) {
+        load = zone_load;
+      }
+    }
+  }
+  closedir(dir);
+  return load;
+}
+
+void portable_start_thermal_monitoring() {
+  static std::once_flag once;
+  std::call_once(once, [] {
+    // The kernel only notifies of trip points through netlink, and only to
+    // root: poll the zones instead.
+    static std::atomic<int> last_load(portable_thermal_load());
+    StartPolling(10, [] {
+      int load = portable_thermal_load();
+      if (last_load.exchange(load) != load) {
+        thermal_callback(load);
+      }
+    });
+  });
+}
+
+}  // namespace blaze_jni
@@ -0,0 +1,166 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/native/linux/util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>  // NOLINT
+#include <functional>
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
+
+namespace blaze_jni {
+
+std::string OwnCgroupDirectory() {
+  std::string mount;
+  FILE *mounts = fopen("/proc/self/mounts", "re");
+  if (mounts == nullptr) {
+    return "";
+  }
+  char *line = nullptr;
+  size_t len = 0;
+  while (mount.empty() && getline(&line, &len, mounts) != -1) {
+    char *saveptr;
+    strtok_r(line, " ", &saveptr);
+    char *file = strtok_r(nullptr, " ", &saveptr);
+    char *type = strtok_r(nullptr, " ", &saveptr);
+    if (file != nullptr && type != nullptr && strcmp(type, "cgroup2") == 0) {
+      mount = file;
+    }
+  }
+  fclose(mounts);
+
+  std::string cgroup;
+  FILE *cgroups = mount.empty() ? nullptr : fopen("/proc/self/cgroup", "re");
+  if (cgroups != nullptr) {
+    while (cgroup.empty() && getline(&line, &len, cgroups) != -1) {
+      // The cgroup v2 entry is the one of hierarchy 0, "0::/path".
+      if (strncmp(line, "0::", 3) == 0) {
+        cgroup = mount + std::string(line + 3, strcspn(line + 3, "\n"));
+      }
+    }
+    fclose(cgroups);
+  }
+  free(line);
+  return cgroup;
+}
+
+bool ReadFirstLine(const std::string &path, std::string *line) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return false;
+  }
+  char buf[256];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof buf - 1)) == -1 && errno == EINTR) {
+  }
+  close(fd);
+  if (n < 0) {
+    return false;
+  }
+  buf[n] = '\0';
+  line->assign(buf, strcspn(buf, "\n"));
+  return true;
+}
+
+// Opens a pressure file and sets a trigger on it. Returns -1 on failure.
+static int OpenPressureTrigger(const std::string &path, const char *trigger) {
+  int fd = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (fd == -1) {
+    return -1;
+  }
+  if (write(fd, trigger, strlen(trigger) + 1) == -1) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Reports the pressure level from the triggers until they fail.
+static void MonitorPressure(int low_fd, int high_fd,
+                            const std::function<void(int)> &callback) {
+  // The triggers fire at most once per window: the pressure is over once
+  // neither has for several windows.
+  constexpr int kQuietMillis = 10000;
+  int level = 0;
+  auto last_high = std::chrono::steady_clock::now();
+  for (;;) {
+    struct pollfd fds[2] = {{low_fd, POLLPRI, 0}, {high_fd, POLLPRI, 0}};
+    int ready = poll(fds, 2, level == 0 ? -1 : kQuietMillis);
+    if (ready == -1 && errno == EINTR) {
+      continue;
+    }
+    if (ready == -1 || ((fds[0].revents | fds[1].revents) & POLLERR)) {
+      // The cgroup is gone, or the kernel no longer reports stalls.
+      break;
+    }
+    auto now = std::chrono::steady_clock::now();
+    int new_level;
+    if (ready == 0) {
+      new_level = 0;
+    } else if (fds[1].revents & POLLPRI) {
+      last_high = now;
+      new_level = 2;
+    } else if (level == 2 &&
+               now - last_high < std::chrono::milliseconds(kQuietMillis)) {
+      // The low trigger keeps firing along with the high one.
+      new_level = 2;
+    } else {
+      new_level = 1;
+    }
+    if (new_level != level) {
+      level = new_level;
+      callback(level);
+    }
+  }
+  close(low_fd);
+  close(high_fd);
+}
+
+bool StartPressureMonitoring(const std::string &path, const char *low_trigger,
+                             const char *high_trigger,
+                             std::function<void(int level)> callback) {
+  int low_fd = OpenPressureTrigger(path, low_trigger);
+  int high_fd = OpenPressureTrigger(path, high_trigger);
+  if (low_fd == -1 || high_fd == -1) {
+    if (low_fd != -1) {
+      close(low_fd);
+    }
+    if (high_fd != -1) {
+      close(high_fd);
+    }
+    return false;
+  }
+  std::thread(MonitorPressure, low_fd, high_fd, std::move(callback)).detach();
+  return true;
+}
+
+void StartPolling(int seconds, std::function<void()> poll) {
+  std::thread([seconds, poll] {
+    for (;;) {
+      std::this_thread::sleep_for(std::chrono::seconds(seconds));
+      poll();
+    }
+  }).detach();
+}
+
+}  // namespace blaze_jni
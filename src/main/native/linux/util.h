@@ -0,0 +1,48 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_MAIN_NATIVE_LINUX_UTIL_H_
+#define BAZEL_SRC_MAIN_NATIVE_LINUX_UTIL_H_
+
+#include <functional>
+#include <string>
+
+namespace blaze_jni {
+
+// Returns the directory of the cgroup v2 of the current process, or "" if it
+// is not in one.
+std::string OwnCgroupDirectory();
+
+// Reads the first line of a sysfs or procfs file, without the newline.
+// Returns false if it cannot be read.
+bool ReadFirstLine(const std::string &path, std::string *line);
+
+// Watches the pressure stall information in `path` (see
+// https://docs.kernel.org/accounting/psi.html) with two triggers, and calls
+// `callback` on a thread of its own whenever the pressure level changes:
+//  - 2 while `high_trigger` fires,
+//  - 1 while only `low_trigger` does,
+//  - 0 once neither has for a while.
+// Returns false if the triggers cannot be set up.
+bool StartPressureMonitoring(const std::string &path, const char *low_trigger,
+                             const char *high_trigger,
+                             std::function<void(int level)> callback);
+
+// Calls `poll` every `seconds` on a thread of its own, for the values that
+// the kernel does not notify of changes.
+void StartPolling(int seconds, std::function<void()> poll);
+
+}  // namespace blaze_jni
+
+#endif  // BAZEL_SRC_MAIN_NATIVE_LINUX_UTIL_H_
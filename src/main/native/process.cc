@@ -12,10 +12,12 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <errno.h>
 #include <jni.h>
-
 #include <unistd.h>
 
+#include "src/main/native/unix_jni.h"
+
 /*
  * Class:     com.google.devtools.build.lib.unix.ProcessUtils
  * Method:    getgid
@@ -45,3 +47,29 @@ extern "C" JNIEXPORT jint JNICALL
 Java_com_google_devtools_build_lib_unix_ProcessUtils_getuid(JNIEnv *env, jclass clazz) {
   return getuid();
 }
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.ProcessUtils
+ * Method:    setBatchCpuScheduling
+ * Signature: (Z)V
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_ProcessUtils_setBatchCpuScheduling(
+    JNIEnv *env, jclass clazz, jboolean batch) {
+  if (blaze_jni::portable_set_batch_cpu_scheduling(batch) == -1) {
+    blaze_jni::PostException(env, errno, "sched_setscheduler");
+  }
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.ProcessUtils
+ * Method:    setIoNiceLevel
+ * Signature: (I)V
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_ProcessUtils_setIoNiceLevel(
+    JNIEnv *env, jclass clazz, jint io_nice_level) {
+  if (blaze_jni::portable_set_io_nice_level(io_nice_level) == -1) {
+    blaze_jni::PostException(env, errno, "ioprio_set");
+  }
+}
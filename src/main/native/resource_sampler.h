@@ -0,0 +1,60 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_MAIN_NATIVE_RESOURCE_SAMPLER_H_
+#define BAZEL_SRC_MAIN_NATIVE_RESOURCE_SAMPLER_H_
+
+#include <jni.h>
+
+namespace blaze_jni {
+
+// The fields of a sample of NativeResourceSampler, in its order. The fields
+// up to kMemoryPressure are cumulative, the ones from it on are levels.
+enum ResourceSampleField {
+  // CLOCK_MONOTONIC, like System.nanoTime() on Linux.
+  kTimeNanos,
+  // The page faults of the server that had to read from disk.
+  kMajorFaults,
+  // What the server had read from and written to disk.
+  kReadBytes,
+  kWriteBytes,
+  // The "total" microseconds of the Linux /proc/pressure/*.
+  kCpuSomeMicros,
+  kIoSomeMicros,
+  kIoFullMicros,
+  kMemorySomeMicros,
+  kMemoryFullMicros,
+  // The time that the threads of the server spent waiting for a cpu.
+  kRunqueueWaitNanos,
+  // The levels of the system, as reported by SystemMemoryPressureMonitor,
+  // SystemThermalModule, SystemCPUSpeedModule and SystemLoadAdvisoryModule,
+  // or -1 if unknown.
+  kMemoryPressure,
+  kThermalLoad,
+  kCpuSpeed,
+  kLoadAdvisory,
+  // The bytes available to the server on the volume of its working
+  // directory, or -1 if unknown.
+  kDiskFreeBytes,
+  kResourceSampleFieldCount,
+};
+
+// Fills in the fields of a sample but the time, the only one that is set
+// already. The others are 0 on entry; the ones that cannot be read on this
+// platform may be left so. Called on the sampling thread only.
+void TakeResourceSample(jlong *fields);
+
+}  // namespace blaze_jni
+
+#endif  // BAZEL_SRC_MAIN_NATIVE_RESOURCE_SAMPLER_H_
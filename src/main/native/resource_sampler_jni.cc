@@ -0,0 +1,187 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The native side of NativeResourceSampler: a thread that samples counters of
+// the server and of the system at a fixed interval into a ring buffer, which
+// the profiler drains in bulk, so that sampling takes no JNI transitions. What
+// a sample holds is read by TakeResourceSample(), in linux/ and darwin/.
+
+#include <jni.h>
+#include <string.h>
+#include <time.h>
+
+#include <atomic>
+#include <chrono>              // NOLINT
+#include <condition_variable>  // NOLINT
+#include <mutex>               // NOLINT
+#include <thread>  // NOLINT
+
+#include "src/main/native/resource_sampler.h"
+
+namespace blaze_jni {
+
+namespace {
+
+constexpr int kFieldCount = kResourceSampleFieldCount;
+
+// About 3 minutes at the default interval, far more than the profiler lets
+// pile up between two drains.
+constexpr size_t kCapacity = 4096;
+
+struct Sample {
+  jlong fields[kFieldCount];
+};
+
+// A single-producer single-consumer queue of samples: the sampling thread
+// pushes, and the profiler drains. Samples are dropped while it is full.
+class SampleRing {
+ public:
+  SampleRing() : head_(0), tail_(0) {}
+
+  void Push(const Sample &sample) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) == kCapacity) {
+      return;
+    }
+    samples_[head % kCapacity] = sample;
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+  // Copies up to `max` samples into `out`, returning how many.
+  size_t Drain(jlong *out, size_t max) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t head = head_.load(std::memory_order_acquire);
+    size_t count = 0;
+    for (; tail != head && count < max; tail++, count++) {
+      memcpy(out + count * kFieldCount, samples_[tail % kCapacity].fields,
+             sizeof(Sample));
+    }
+    tail_.store(tail, std::memory_order_release);
+    return count;
+  }
+
+ private:
+  Sample samples_[kCapacity];
+  std::atomic<size_t> head_;
+  std::atomic<size_t> tail_;
+};
+
+void TakeSample(Sample *sample) {
+  memset(sample, 0, sizeof *sample);
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  sample->fields[kTimeNanos] =
+      static_cast<jlong>(now.tv_sec) * 1000000000 + now.tv_nsec;
+  TakeResourceSample(sample->fields);
+}
+
+class Sampler {
+ public:
+  // Starts sampling every `interval`, unless it already is.
+  void Start(std::chrono::milliseconds interval) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (thread_.joinable()) {
+      return;
+    }
+    stopping_ = false;
+    thread_ = std::thread(&Sampler::Run, this, interval);
+  }
+
+  void Stop() {
+    std::thread thread;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+      thread = std::move(thread_);
+    }
+    wakeup_.notify_all();
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+
+  SampleRing &ring() { return ring_; }
+
+ private:
+  void Run(std::chrono::milliseconds interval) {
+    auto next = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+      lock.unlock();
+      Sample sample;
+      TakeSample(&sample);
+      ring_.Push(sample);
+      lock.lock();
+      // A fixed rate rather than a fixed delay, so that the samples are
+      // evenly spaced.
+      next += interval;
+      wakeup_.wait_until(lock, next, [this] { return stopping_; });
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+  bool stopping_ = false;  // Guarded by mutex_.
+  std::thread thread_;     // Guarded by mutex_.
+  SampleRing ring_;
+};
+
+Sampler *GetSampler() {
+  static Sampler *sampler = new Sampler();
+  return sampler;
+}
+
+}  // namespace
+
+/*
+ * Class:     com_google_devtools_build_lib_profiler_NativeResourceSampler
+ * Method:    start
+ * Signature: (I)V
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_profiler_NativeResourceSampler_start(
+    JNIEnv *env, jclass clazz, jint interval_millis) {
+  GetSampler()->Start(std::chrono::milliseconds(interval_millis));
+}
+
+/*
+ * Class:     com_google_devtools_build_lib_profiler_NativeResourceSampler
+ * Method:    stop
+ * Signature: ()V
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_profiler_NativeResourceSampler_stop(
+    JNIEnv *env, jclass clazz) {
+  GetSampler()->Stop();
+}
+
+/*
+ * Class:     com_google_devtools_build_lib_profiler_NativeResourceSampler
+ * Method:    drain
+ * Signature: ([J)I
+ */
+extern "C" JNIEXPORT jint JNICALL
+Java_com_google_devtools_build_lib_profiler_NativeResourceSampler_drain(
+    JNIEnv *env, jclass clazz, jlongArray samples) {
+  jsize length = env->GetArrayLength(samples);
+  jlong *out = env->GetLongArrayElements(samples, nullptr);
+  if (out == nullptr) {
+    return 0;  // An OutOfMemoryError is pending.
+  }
+  size_t count = GetSampler()->ring().Drain(out, length / kFieldCount);
+  env->ReleaseLongArrayElements(samples, out, 0);
+  return static_cast<jint>(count);
+}
+
+}  // namespace blaze_jni
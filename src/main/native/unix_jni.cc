@@ -25,6 +25,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -37,8 +38,14 @@
 
 // Linting disabled for this line because for google code we could use
 // absl::Mutex but we cannot yet because Bazel doesn't depend on absl.
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <functional>
 #include <mutex>  // NOLINT
 #include <string>
+#include <thread>  // NOLINT
+#include <utility>
 #include <vector>
 
 #include "src/main/cpp/util/logging.h"
@@ -304,6 +311,8 @@ static jmethodID errno_file_status_class_no_error_ctor = nullptr;
 static jmethodID errno_file_status_class_errorno_ctor = nullptr;
 static jclass dirents_class = nullptr;
 static jmethodID dirents_ctor = nullptr;
+static jclass directory_listing_class = nullptr;
+static jmethodID directory_listing_ctor = nullptr;
 
 static jclass makeStaticClass(JNIEnv *env, const char *name) {
   jclass lookup_result = env->FindClass(name);
@@ -391,6 +400,11 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_initJNIClasses(
       env, "com/google/devtools/build/lib/unix/NativePosixFiles$Dirents");
   dirents_ctor =
       getConstructorID(env, dirents_class, "([Ljava/lang/String;[B)V");
+  directory_listing_class = makeStaticClass(
+      env,
+      "com/google/devtools/build/lib/unix/NativePosixFiles$DirectoryListing");
+  directory_listing_ctor = getConstructorID(env, directory_listing_class,
+                                            "([B[I[B[I[I[J[J[J[J[I)V");
 }
 
 extern "C" JNIEXPORT void JNICALL
@@ -490,6 +504,119 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_errnoLstat(JNIEnv *env,
   return StatCommon(env, path, portable_lstat, false);
 }
 
+namespace {
+// The results of statBatch, one element per path.
+struct BatchStatResults {
+  explicit BatchStatResults(size_t size)
+      : errnos(size), modes(size), sizes(size), mtimes(size), ctimes(size),
+        inodes(size), devices(size) {}
+
+  std::vector<jint> errnos;
+  std::vector<jint> modes;
+  std::vector<jlong> sizes;
+  std::vector<jlong> mtimes;
+  std::vector<jlong> ctimes;
+  std::vector<jlong> inodes;
+  std::vector<jint> devices;
+};
+
+// Stats paths [begin, end) relative to dirfd into results. Only makes
+// syscalls, so that it can run on any thread.
+static void BatchStatRange(int dirfd, const std::vector<const char *> &paths,
+                           int flags, size_t begin, size_t end,
+                           BatchStatResults *results) {
+  for (size_t i = begin; i < end; ++i) {
+    portable_stat_struct statbuf;
+    int r;
+    while ((r = portable_fstatat(dirfd, const_cast<char *>(paths[i]),
+                                 &statbuf, flags)) == -1 &&
+           errno == EINTR) {
+    }
+    if (r == -1) {
+      results->errnos[i] = errno;
+      continue;
+    }
+    results->modes[i] = statbuf.st_mode;
+    results->sizes[i] = statbuf.st_size;
+    results->mtimes[i] = StatEpochMilliseconds(statbuf, STAT_MTIME);
+    results->ctimes[i] = StatEpochMilliseconds(statbuf, STAT_CTIME);
+    results->inodes[i] = statbuf.st_ino;
+    results->devices[i] = statbuf.st_dev;
+  }
+}
+
+// Each thread of statBatch gets at least this many paths.
+static const size_t kMinPathsPerStatThread = 1024;
+}  // namespace
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    statBatch
+ * Signature: (Ljava/lang/String;[Ljava/lang/String;ZI[I[I[J[J[J[J[I)V
+ * Throws:    java.io.IOException
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_statBatch(
+    JNIEnv *env, jclass clazz, jstring dir, jobjectArray paths,
+    jboolean follow_symlinks, jint threads, jintArray errnos, jintArray modes,
+    jlongArray sizes, jlongArray mtimes, jlongArray ctimes, jlongArray inodes,
+    jintArray devices) {
+  int dirfd = AT_FDCWD;
+  if (dir != nullptr) {
+    JStringLatin1Holder dir_chars(env, dir);
+    while ((dirfd = open(dir_chars, O_RDONLY | PORTABLE_O_DIRECTORY)) == -1 &&
+           errno == EINTR) {
+    }
+    if (dirfd == -1) {
+      PostException(env, errno, dir_chars);
+      return;
+    }
+  }
+
+  const size_t size = env->GetArrayLength(paths);
+  std::vector<jstring> path_strings(size);
+  std::vector<const char *> path_chars(size);
+  for (size_t i = 0; i < size; ++i) {
+    path_strings[i] =
+        static_cast<jstring>(env->GetObjectArrayElement(paths, i));
+    path_chars[i] = GetStringLatin1Chars(env, path_strings[i]);
+  }
+
+  const int flags = follow_symlinks ? 0 : AT_SYMLINK_NOFOLLOW;
+  BatchStatResults results(size);
+  const size_t thread_count = std::max<size_t>(
+      1, std::min<size_t>(std::max(threads, 1), size / kMinPathsPerStatThread));
+  if (thread_count == 1) {
+    BatchStatRange(dirfd, path_chars, flags, 0, size, &results);
+  } else {
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < thread_count; ++t) {
+      workers.emplace_back(BatchStatRange, dirfd, std::cref(path_chars), flags,
+                           size * t / thread_count,
+                           size * (t + 1) / thread_count, &results);
+    }
+    for (std::thread &worker : workers) {
+      worker.join();
+    }
+  }
+
+  for (size_t i = 0; i < size; ++i) {
+    ReleaseStringLatin1Chars(path_chars[i]);
+    env->DeleteLocalRef(path_strings[i]);
+  }
+  if (dirfd != AT_FDCWD) {
+    close(dirfd);
+  }
+
+  env->SetIntArrayRegion(errnos, 0, size, results.errnos.data());
+  env->SetIntArrayRegion(modes, 0, size, results.modes.data());
+  env->SetLongArrayRegion(sizes, 0, size, results.sizes.data());
+  env->SetLongArrayRegion(mtimes, 0, size, results.mtimes.data());
+  env->SetLongArrayRegion(ctimes, 0, size, results.ctimes.data());
+  env->SetLongArrayRegion(inodes, 0, size, results.inodes.data());
+  env->SetIntArrayRegion(devices, 0, size, results.devices.data());
+}
+
 /*
  * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
  * Method:    utimensat
@@ -682,6 +809,169 @@ cleanup:
   ReleaseStringLatin1Chars(path_chars);
 }
 
+namespace {
+// A directory of the path that mkdirsWritable is at: its name, and either an
+// open fd for it or the errno of why it could not be made.
+struct OpenDirectory {
+  std::string name;
+  int fd;
+  int error;
+  bool created;
+};
+
+// Makes the directory `name` in parent_fd writable as mkdirWritable would,
+// creating it if need be, and returns an fd for it, or -1 with errno set.
+// Unlike mkdirWritable, a symlink to a directory is an error (ELOOP).
+static int OpenWritableDirectoryAt(int parent_fd, const char *name,
+                                   bool *created) {
+  // Use 0777 so that the permissions can be overridden by umask(2).
+  *created = mkdirat(parent_fd, name, 0777) == 0;
+  if (!*created) {
+    if (errno != EEXIST) {
+      return -1;
+    }
+    portable_stat_struct statbuf;
+    if (portable_fstatat(parent_fd, const_cast<char *>(name), &statbuf,
+                         AT_SYMLINK_NOFOLLOW) == -1) {
+      return -1;
+    }
+    if (!S_ISDIR(statbuf.st_mode)) {
+      errno = S_ISLNK(statbuf.st_mode) ? ELOOP : ENOTDIR;
+      return -1;
+    }
+    // Avoid touching permissions for group/other, as mkdirWritable does.
+    if ((statbuf.st_mode & S_IRWXU) != S_IRWXU &&
+        fchmodat(parent_fd, name, statbuf.st_mode | S_IRWXU, 0) == -1) {
+      return -1;
+    }
+  }
+  int fd;
+  while ((fd = openat(parent_fd, name,
+                      O_RDONLY | O_NOFOLLOW | PORTABLE_O_DIRECTORY)) == -1 &&
+         errno == EINTR) {
+  }
+  return fd;
+}
+
+// Splits a relative path into its names, or returns false if it has one that
+// mkdirsWritable cannot walk, such as "..".
+static bool SplitRelativePath(const char *path,
+                              std::vector<std::string> *names) {
+  names->clear();
+  if (*path == '/') {
+    return false;
+  }
+  for (const char *p = path; *p != '\0';) {
+    const char *end = p;
+    while (*end != '\0' && *end != '/') {
+      ++end;
+    }
+    if (end > p) {
+      if (end - p <= 2 && p[0] == '.' && (end - p == 1 || p[1] == '.')) {
+        return false;
+      }
+      names->emplace_back(p, end - p);
+    }
+    p = *end == '/' ? end + 1 : end;
+  }
+  return true;
+}
+}  // namespace
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    mkdirsWritable
+ * Signature: (Ljava/lang/String;[Ljava/lang/String;[I)V
+ * Throws:    java.io.IOException
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_mkdirsWritable(
+    JNIEnv *env, jclass clazz, jstring root, jobjectArray dirs,
+    jintArray results) {
+  int root_fd;
+  {
+    JStringLatin1Holder root_chars(env, root);
+    while ((root_fd = open(root_chars, O_RDONLY | PORTABLE_O_DIRECTORY)) ==
+               -1 &&
+           errno == EINTR) {
+    }
+    if (root_fd == -1) {
+      PostException(env, errno, root_chars);
+      return;
+    }
+  }
+
+  const size_t size = env->GetArrayLength(dirs);
+  std::vector<std::vector<std::string>> dir_names(size);
+  std::vector<jint> dir_results(size);
+  for (size_t i = 0; i < size; ++i) {
+    jstring dir = static_cast<jstring>(env->GetObjectArrayElement(dirs, i));
+    const char *dir_chars = GetStringLatin1Chars(env, dir);
+    if (!SplitRelativePath(dir_chars, &dir_names[i])) {
+      dir_results[i] = -EINVAL;
+    }
+    ReleaseStringLatin1Chars(dir_chars);
+    env->DeleteLocalRef(dir);
+  }
+
+  // Walk the directories in order, so that those with common parents follow
+  // each other, and keep the fds of the parents of the last one open: each
+  // parent is then made once, relative to its own parent.
+  std::vector<size_t> order(size);
+  for (size_t i = 0; i < size; ++i) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&dir_names](size_t a, size_t b) {
+    return dir_names[a] < dir_names[b];
+  });
+  std::vector<OpenDirectory> open_dirs;
+  for (size_t i : order) {
+    if (dir_results[i] != 0) {
+      continue;
+    }
+    const std::vector<std::string> &names = dir_names[i];
+    size_t common = 0;
+    while (common < open_dirs.size() && common < names.size() &&
+           open_dirs[common].name == names[common]) {
+      ++common;
+    }
+    while (open_dirs.size() > common) {
+      if (open_dirs.back().fd != -1) {
+        close(open_dirs.back().fd);
+      }
+      open_dirs.pop_back();
+    }
+    for (size_t n = common; n < names.size(); ++n) {
+      OpenDirectory dir = {names[n], -1, 0, false};
+      if (!open_dirs.empty() && open_dirs.back().fd == -1) {
+        dir.error = open_dirs.back().error;
+      } else {
+        int parent_fd = open_dirs.empty() ? root_fd : open_dirs.back().fd;
+        dir.fd = OpenWritableDirectoryAt(parent_fd, dir.name.c_str(),
+                                         &dir.created);
+        if (dir.fd == -1) {
+          dir.error = errno;
+        }
+      }
+      open_dirs.push_back(std::move(dir));
+    }
+    if (names.empty()) {
+      // The root itself, which exists.
+      continue;
+    }
+    const OpenDirectory &dir = open_dirs.back();
+    dir_results[i] = dir.fd == -1 ? -dir.error : dir.created;
+  }
+  for (const OpenDirectory &dir : open_dirs) {
+    if (dir.fd != -1) {
+      close(dir.fd);
+    }
+  }
+  close(root_fd);
+
+  env->SetIntArrayRegion(results, 0, size, dir_results.data());
+}
+
 namespace {
 static jobject NewDirents(JNIEnv *env,
                           jobjectArray names,
@@ -804,6 +1094,179 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_readdir(JNIEnv *env,
   return NewDirents(env, names_obj, types_obj);
 }
 
+namespace {
+// Returns the Dirents type code for a mode.
+static jbyte ModeToDirentType(mode_t mode, bool follow_symlinks) {
+  if (S_ISREG(mode)) return 'f';
+  if (S_ISDIR(mode)) return 'd';
+  if (S_ISLNK(mode) && !follow_symlinks) return 's';
+  return '?';
+}
+
+// Returns a Java array of the values, or null if an exception occurred.
+static jbyteArray NewJavaArray(JNIEnv *env, const std::vector<jbyte> &values) {
+  jbyteArray array = env->NewByteArray(values.size());
+  if (array != nullptr) {
+    env->SetByteArrayRegion(array, 0, values.size(), values.data());
+  }
+  return array;
+}
+
+static jintArray NewJavaArray(JNIEnv *env, const std::vector<jint> &values) {
+  jintArray array = env->NewIntArray(values.size());
+  if (array != nullptr) {
+    env->SetIntArrayRegion(array, 0, values.size(), values.data());
+  }
+  return array;
+}
+
+static jlongArray NewJavaArray(JNIEnv *env, const std::vector<jlong> &values) {
+  jlongArray array = env->NewLongArray(values.size());
+  if (array != nullptr) {
+    env->SetLongArrayRegion(array, 0, values.size(), values.data());
+  }
+  return array;
+}
+}  // namespace
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    readdirPlusNative
+ * Signature: (Ljava/lang/String;ZZ)Lcom/google/devtools/build/lib/unix/NativePosixFiles$DirectoryListing;
+ * Throws:    java.io.IOException
+ */
+extern "C" JNIEXPORT jobject JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_readdirPlusNative(
+    JNIEnv *env, jclass clazz, jstring path, jboolean follow_symlinks,
+    jboolean stat_entries) {
+  JStringLatin1Holder path_chars(env, path);
+  int dirfd;
+  while ((dirfd = open(path_chars, O_RDONLY | PORTABLE_O_DIRECTORY)) == -1 &&
+         errno == EINTR) {
+  }
+  if (dirfd == -1) {
+    // EACCES EMFILE ENFILE ENOENT ENOTDIR -> IOException
+    PostException(env, errno, path_chars);
+    return nullptr;
+  }
+  std::vector<char> names;
+  std::vector<unsigned char> dirent_types;
+  // Where the platform can, the entries come with their stats.
+  std::vector<DirEntryStat> entry_stats;
+  bool have_entry_stats = false;
+  if (stat_entries) {
+    if (portable_read_dir_entries_with_stats(dirfd, &names, &dirent_types,
+                                             &entry_stats) == 0) {
+      have_entry_stats = true;
+    } else if (errno != ENOSYS) {
+      PostException(env, errno, path_chars);
+      close(dirfd);
+      return nullptr;
+    }
+  }
+  if (!have_entry_stats &&
+      portable_read_dir_entries(dirfd, &names, &dirent_types) == -1) {
+    PostException(env, errno, path_chars);
+    close(dirfd);
+    return nullptr;
+  }
+
+  const size_t size = dirent_types.size();
+  std::vector<jint> offsets(size);
+  std::vector<const char *> entry_names(size);
+  for (size_t i = 0, offset = 0; i < size; ++i) {
+    offsets[i] = offset;
+    entry_names[i] = &names[offset];
+    offset += strlen(entry_names[i]) + 1;
+  }
+
+  const int flags = follow_symlinks ? 0 : AT_SYMLINK_NOFOLLOW;
+  std::vector<jbyte> types(size);
+  BatchStatResults results(stat_entries ? size : 0);
+  if (have_entry_stats) {
+    for (size_t i = 0; i < size; ++i) {
+      const DirEntryStat &stat = entry_stats[i];
+      if (stat.error == 0 && S_ISLNK(stat.mode) && follow_symlinks) {
+        // The stats are those of the symlink itself.
+        BatchStatRange(dirfd, entry_names, flags, i, i + 1, &results);
+        continue;
+      }
+      results.errnos[i] = stat.error;
+      results.modes[i] = stat.mode;
+      results.sizes[i] = stat.size;
+      results.mtimes[i] = stat.mtime_millis;
+      results.ctimes[i] = stat.ctime_millis;
+      results.inodes[i] = stat.inode;
+      results.devices[i] = stat.device;
+    }
+  } else if (stat_entries) {
+    BatchStatRange(dirfd, entry_names, flags, 0, size, &results);
+  }
+  if (stat_entries) {
+    for (size_t i = 0; i < size; ++i) {
+      types[i] = results.errnos[i] != 0
+                     ? '?'
+                     : ModeToDirentType(results.modes[i], follow_symlinks);
+    }
+  } else {
+    for (size_t i = 0; i < size; ++i) {
+      switch (dirent_types[i]) {
+        case DT_REG:
+          types[i] = 'f';
+          break;
+        case DT_DIR:
+          types[i] = 'd';
+          break;
+        case DT_LNK:
+          if (!follow_symlinks) {
+            types[i] = 's';
+            break;
+          }
+          FALLTHROUGH_INTENDED;
+        case DT_UNKNOWN: {
+          portable_stat_struct statbuf;
+          types[i] = portable_fstatat(dirfd, const_cast<char *>(entry_names[i]),
+                                      &statbuf, flags) == 0
+                         ? ModeToDirentType(statbuf.st_mode, follow_symlinks)
+                         : '?';
+          break;
+        }
+        default:
+          types[i] = '?';
+      }
+    }
+  }
+  close(dirfd);
+
+  std::vector<jbyte> name_bytes(names.begin(), names.end());
+  jbyteArray names_obj = NewJavaArray(env, name_bytes);
+  jintArray offsets_obj = NewJavaArray(env, offsets);
+  jbyteArray types_obj = NewJavaArray(env, types);
+  if (names_obj == nullptr || offsets_obj == nullptr || types_obj == nullptr) {
+    return nullptr;  // async exception!
+  }
+  if (!stat_entries) {
+    return env->NewObject(directory_listing_class, directory_listing_ctor,
+                          names_obj, offsets_obj, types_obj, nullptr, nullptr,
+                          nullptr, nullptr, nullptr, nullptr, nullptr);
+  }
+  jintArray errnos = NewJavaArray(env, results.errnos);
+  jintArray modes = NewJavaArray(env, results.modes);
+  jlongArray sizes = NewJavaArray(env, results.sizes);
+  jlongArray mtimes = NewJavaArray(env, results.mtimes);
+  jlongArray ctimes = NewJavaArray(env, results.ctimes);
+  jlongArray inodes = NewJavaArray(env, results.inodes);
+  jintArray devices = NewJavaArray(env, results.devices);
+  if (errnos == nullptr || modes == nullptr || sizes == nullptr ||
+      mtimes == nullptr || ctimes == nullptr || inodes == nullptr ||
+      devices == nullptr) {
+    return nullptr;  // async exception!
+  }
+  return env->NewObject(directory_listing_class, directory_listing_ctor,
+                        names_obj, offsets_obj, types_obj, errnos, modes, sizes,
+                        mtimes, ctimes, inodes, devices);
+}
+
 /*
  * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
  * Method:    rename
@@ -873,297 +1336,351 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_mkfifo(JNIEnv *env,
 }
 
 namespace {
-// Posts an exception generated by the DeleteTreesBelow algorithm and its helper
-// functions.
-//
-// This is just a convenience wrapper over PostException to format the
-// path that caused an error only when necessary, as we keep that path tokenized
-// throughout the deletion process.
-//
-// env is the JNI environment in which to post the exception. error and function
-// capture the errno value and the name of the system function that triggered
-// it. The faulty path is specified by all the components of dir_path and the
-// optional entry subcomponent, which may be NULL.
-static void PostDeleteTreesBelowException(
-    JNIEnv* env, int error, const char* function,
-    const std::vector<std::string>& dir_path, const char* entry) {
-  std::vector<std::string>::const_iterator iter = dir_path.begin();
-  std::string path;
-  if (iter != dir_path.end()) {
-    path = *iter;
-    while (++iter != dir_path.end()) {
-      path += "/";
-      path += *iter;
-    }
-    if (entry != nullptr) {
-      path += "/";
-      path += entry;
-    }
-  } else {
-    // When scanning the top-level directory given to DeleteTreesBelow, the
-    // dir_path buffer is still empty but we have the full path in entry.
-    path = entry;
-  }
-  BAZEL_CHECK(!env->ExceptionOccurred());
-  PostException(env, errno, std::string(function) + " (" + path + ")");
-}
+// A directory that DeleteTreesBelow is emptying.
+struct DeleteDir {
+  DeleteDir(DeleteDir *parent, std::string name, DIR *dir)
+      : parent(parent), name(std::move(name)), dir(dir) {}
+
+  // The parent directory, or null for the top directory.
+  DeleteDir *const parent;
+  // The name in the parent directory, or the full path of the top directory.
+  const std::string name;
+  DIR *const dir;
+  // The number of subdirectories not deleted yet, plus one while the entries
+  // of the directory are being read.
+  std::atomic<int> pending{1};
+};
 
-// Tries to open a directory and, if the first attempt fails, retries after
-// granting extra permissions to the directory.
-//
-// The directory to open is identified by the open descriptor of the parent
-// directory (dir_fd) and the subpath to resolve within that directory (entry).
-// dir_path contains the path components that were used when opening dir_fd and
-// is only used for error reporting purposes.
-//
-// Returns a directory handle on success or an errno on error. If the error is
-// other than ENOENT, posts an exception before returning.
-static DIROrError ForceOpendir(JNIEnv *env,
-                               const std::vector<std::string> &dir_path,
-                               const int dir_fd, const char *entry) {
-  static const int flags = O_RDONLY | O_NOFOLLOW | PORTABLE_O_DIRECTORY;
-  int fd = openat(dir_fd, entry, flags);
-  if (fd == -1) {
-    if (errno == ENOENT) {
-      return {nullptr, errno};
-    }
-    // If dir_fd is a readable but non-executable directory containing entry, we
-    // could have obtained entry by readdir()-ing, but any attempt to open or
-    // stat the entry would fail with EACCESS. In this case, we need to fix the
-    // permissions on dir_fd (which we can do only if it's a "real" file
-    // descriptor, not AT_FDCWD used as the starting point of DeleteTreesBelow
-    // recursion).
-    if (errno == EACCES && dir_fd != AT_FDCWD) {
-      if (fchmod(dir_fd, 0700) == -1) {
-        if (errno != ENOENT) {
-          PostDeleteTreesBelowException(env, errno, "fchmod", dir_path,
-                                        nullptr);
-        }
-        return {nullptr, errno};
-      }
-    }
-    if (fchmodat(dir_fd, entry, 0700, 0) == -1) {
-      if (errno != ENOENT) {
-        PostDeleteTreesBelowException(env, errno, "fchmodat", dir_path, entry);
+// Deletes the trees below a directory, on as many threads as the size of the
+// tree warrants. The threads only record the first error, and the JNI thread
+// posts it once all of them are done.
+class TreeDeleter {
+ public:
+  // Deletes all trees below `path`. Returns 0 on success. Returns -1 on error
+  // and posts an exception.
+  int Run(JNIEnv *env, const char *path) {
+    DIROrError dir_or_error = ForceOpendir(nullptr, path);
+    if (dir_or_error.dir != nullptr) {
+      DeleteDir top(nullptr, path, dir_or_error.dir);
+      EmptyDirectory(&top);
+      Work();
+      for (std::thread &thread : threads_) {
+        thread.join();
       }
-      return {nullptr, errno};
     }
-    fd = openat(dir_fd, entry, flags);
-    if (fd == -1) {
-      if (errno != ENOENT) {
-        PostDeleteTreesBelowException(env, errno, "opendir", dir_path, entry);
-      }
-      return {nullptr, errno};
+    if (error_ != 0) {
+      BAZEL_CHECK(!env->ExceptionOccurred());
+      PostException(env, error_, error_function_ + " (" + error_path_ + ")");
+      return -1;
     }
+    return 0;
   }
-  DIR* dir = fdopendir(fd);
-  if (dir == nullptr) {
-    if (errno != ENOENT) {
-      PostDeleteTreesBelowException(env, errno, "fdopendir", dir_path, entry);
+
+ private:
+  // A subdirectory to delete.
+  struct Task {
+    DeleteDir *parent;
+    std::string name;
+  };
+
+  // Runs the tasks until there are none left and none running.
+  void Work() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      changed_.wait(lock, [this] { return !tasks_.empty() || busy_ == 0; });
+      if (tasks_.empty()) {
+        return;
+      }
+      // Taking the most recent task first keeps few directories open.
+      Task task = std::move(tasks_.back());
+      tasks_.pop_back();
+      busy_++;
+      lock.unlock();
+      DeleteSubdir(task.parent, task.name);
+      lock.lock();
+      if (--busy_ == 0 && tasks_.empty()) {
+        changed_.notify_all();
+      }
     }
-    close(fd);
-    return {nullptr, errno};
   }
-  return {dir, 0};
-}
 
-// Tries to delete a file within a directory and, if the first attempt fails,
-// retries after granting extra write permissions to the directory.
-//
-// The file to delete is identified by the open descriptor of the parent
-// directory (dir_fd) and the subpath to resolve within that directory (entry).
-// dir_path contains the path components that were used when opening dir_fd and
-// is only used for error reporting purposes.
-//
-// is_dir indicates whether the entry to delete is a directory or not.
-//
-// Returns 0 when the file doesn't exist or is successfully deleted. Otherwise,
-// returns -1 and posts an exception.
-static int ForceDelete(JNIEnv* env, const std::vector<std::string>& dir_path,
-                       const int dir_fd, const char* entry,
-                       const bool is_dir) {
-  const int flags = is_dir ? AT_REMOVEDIR : 0;
-  if (unlinkat(dir_fd, entry, flags) == -1) {
-    if (errno == ENOENT) {
-      return 0;
-    }
-    if (fchmod(dir_fd, 0700) == -1) {
-      if (errno == ENOENT) {
-        return 0;
-      }
-      PostDeleteTreesBelowException(env, errno, "fchmod", dir_path, nullptr);
-      return -1;
+  // Queues the subdirectories of `parent`, starting another thread if there
+  // is enough work for one.
+  void AddTasks(DeleteDir *parent, std::vector<std::string> *subdirs) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (std::string &subdir : *subdirs) {
+      tasks_.push_back({parent, std::move(subdir)});
     }
-    if (unlinkat(dir_fd, entry, flags) == -1) {
-      if (errno == ENOENT) {
-        return 0;
-      }
-      PostDeleteTreesBelowException(env, errno, "unlinkat", dir_path, entry);
-      return -1;
+    if (tasks_.size() > kTasksPerThread * (threads_.size() + 1) &&
+        threads_.size() + 1 < MaxThreads()) {
+      threads_.emplace_back(&TreeDeleter::Work, this);
     }
+    changed_.notify_all();
   }
-  return 0;
-}
 
-// Returns true if the given directory entry represents a subdirectory of dir.
-//
-// The file to check is identified by the open descriptor of the parent
-// directory (dir_fd) and the directory entry within that directory (de).
-// dir_path contains the path components that were used when opening dir_fd and
-// is only used for error reporting purposes.
-//
-// This function prefers to extract the type information from the directory
-// entry itself if available. If not available, issues a stat starting from
-// dir_fd.
-//
-// Returns 0 on success and updates is_dir accordingly. Returns -1 on error and
-// posts an exception.
-static int IsSubdir(JNIEnv* env, const std::vector<std::string>& dir_path,
-                    const int dir_fd, const struct dirent* de, bool* is_dir) {
-  switch (de->d_type) {
-    case DT_DIR:
-      *is_dir = true;
-      return 0;
+  static size_t MaxThreads() {
+    return std::max(1u,
+                    std::min(kMaxThreads, std::thread::hardware_concurrency()));
+  }
 
-    case DT_UNKNOWN: {
-      struct stat st;
-      if (fstatat(dir_fd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
-        if (errno == ENOENT) {
-          *is_dir = false;
-          return 0;
-        }
-        PostDeleteTreesBelowException(env, errno, "fstatat", dir_path,
-                                      de->d_name);
-        return -1;
-      }
-      *is_dir = st.st_mode & S_IFDIR;
-      return 0;
+  // Records the error of `function` on `entry` in `dir`, unless there is an
+  // earlier one. Both `dir` and `entry` may be null.
+  void Fail(int error, const char *function, const DeleteDir *dir,
+            const char *entry) {
+    std::string path = entry != nullptr ? entry : "";
+    for (; dir != nullptr; dir = dir->parent) {
+      path = path.empty() ? dir->name : dir->name + "/" + path;
     }
+    std::lock_guard<std::mutex> lock(error_mutex_);
+    if (error_ == 0) {
+      error_ = error;
+      error_function_ = function;
+      error_path_ = path;
+      failed_ = true;
+    }
+  }
 
-    default:
-      *is_dir = false;
-      return 0;
+  static int DirFd(const DeleteDir *dir) {
+    return dir != nullptr ? dirfd(dir->dir) : AT_FDCWD;
   }
-}
 
-// Recursively deletes all trees under the given path.
-//
-// The directory to delete is identified by the open descriptor of the parent
-// directory (dir_fd) and the subpath to resolve within that directory (entry).
-// dir_path contains the path components that were used when opening dir_fd and
-// is only used for error reporting purposes.
-//
-// dir_path is an in/out parameter updated with the path to the directory being
-// processed. This avoids the need to construct unnecessary intermediate paths,
-// as this algorithm works purely on file descriptors: the paths are only used
-// for error reporting purposes, and therefore are only formatted at that
-// point.
-//
-// Returns 0 on success. Returns -1 on error and posts an exception.
-static int DeleteTreesBelow(JNIEnv* env, std::vector<std::string>* dir_path,
-                            const int dir_fd, const char* entry) {
-  DIROrError dir_or_error = ForceOpendir(env, *dir_path, dir_fd, entry);
-  DIR *dir = dir_or_error.dir;
-  if (dir == nullptr) {
-    if (dir_or_error.error == ENOENT) {
-      return 0;
-    }
-    BAZEL_CHECK_NE(env->ExceptionOccurred(), nullptr);
-    return -1;
-  }
-
-  dir_path->push_back(entry);
-  // On macOS and some other non-Linux OSes, on some filesystems, readdir(dir)
-  // may return NULL after an entry in dir is deleted even if not all files have
-  // been read yet - see
-  // https://pubs.opengroup.org/onlinepubs/9699919799/functions/readdir.html;
-  // "If a file is removed from or added to the directory after the most recent
-  // call to opendir() or rewinddir(), whether a subsequent call to readdir()
-  // returns an entry for that file is unspecified." We thus read all the names
-  // of dir's entries before deleting. We don't want to simply use fts(3)
-  // because we want to be able to chmod at any point in the directory hierarchy
-  // to retry a filesystem operation after hitting an EACCES.
-  // If in the future we hit any problems here due to the unspecified behavior
-  // of readdir() when a file has been deleted by a different thread we can use
-  // some form of locking to make sure the threads don't try to clean up the
-  // same directory at the same time; or doing it in a loop until the directory
-  // is really empty.
-  std::vector<std::string> dir_files, dir_subdirs;
-  for (;;) {
-    errno = 0;
-    struct dirent* de = readdir(dir);
-    if (de == nullptr) {
-      if (errno != 0 && errno != ENOENT) {
-        PostDeleteTreesBelowException(env, errno, "readdir", *dir_path,
-                                      nullptr);
+  // Deletes the subdirectory `name` of `parent` with all that is below it.
+  void DeleteSubdir(DeleteDir *parent, const std::string &name) {
+    if (!failed_) {
+      DIROrError dir_or_error = ForceOpendir(parent, name.c_str());
+      if (dir_or_error.dir != nullptr) {
+        EmptyDirectory(new DeleteDir(parent, name, dir_or_error.dir));
+        return;
       }
-      break;
     }
+    Release(parent);
+  }
+
+  // Deletes the files in `dir` and queues its subdirectories.
+  void EmptyDirectory(DeleteDir *dir) {
+    // On macOS and some other non-Linux OSes, on some filesystems,
+    // readdir(dir) may return NULL after an entry in dir is deleted even if
+    // not all files have been read yet - see
+    // https://pubs.opengroup.org/onlinepubs/9699919799/functions/readdir.html;
+    // "If a file is removed from or added to the directory after the most
+    // recent call to opendir() or rewinddir(), whether a subsequent call to
+    // readdir() returns an entry for that file is unspecified." We thus read
+    // all the names of dir's entries before deleting. We don't want to simply
+    // use fts(3) because we want to be able to chmod at any point in the
+    // directory hierarchy to retry a filesystem operation after hitting an
+    // EACCES.
+    std::vector<std::string> dir_files, dir_subdirs;
+    for (;;) {
+      errno = 0;
+      struct dirent *de = readdir(dir->dir);
+      if (de == nullptr) {
+        if (errno != 0 && errno != ENOENT) {
+          Fail(errno, "readdir", dir, nullptr);
+        }
+        break;
+      }
 
-    if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
-      continue;
-    }
+      if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
+        continue;
+      }
 
-    bool is_dir;
-    if (IsSubdir(env, *dir_path, dirfd(dir), de, &is_dir) == -1) {
-      BAZEL_CHECK_NE(env->ExceptionOccurred(), nullptr);
-      break;
-    }
-    if (is_dir) {
-      dir_subdirs.push_back(de->d_name);
-    } else {
-      dir_files.push_back(de->d_name);
+      bool is_dir;
+      if (IsSubdir(dir, de, &is_dir) == -1) {
+        break;
+      }
+      if (is_dir) {
+        dir_subdirs.push_back(de->d_name);
+      } else {
+        dir_files.push_back(de->d_name);
+      }
     }
-  }
-  if (env->ExceptionOccurred() == nullptr) {
     for (const auto &file : dir_files) {
-      if (ForceDelete(env, *dir_path, dirfd(dir), file.c_str(), false) == -1) {
-        BAZEL_CHECK_NE(env->ExceptionOccurred(), nullptr);
+      if (failed_ || ForceDelete(dir, file.c_str(), false) == -1) {
         break;
       }
     }
-    // DeleteTreesBelow is recursive; don't hold on to file names unnecessarily.
-    dir_files.clear();
+    if (!failed_ && !dir_subdirs.empty()) {
+      dir->pending += dir_subdirs.size();
+      AddTasks(dir, &dir_subdirs);
+    }
+    Release(dir);
   }
-  if (env->ExceptionOccurred() == nullptr) {
-    for (const auto &subdir : dir_subdirs) {
-      if (DeleteTreesBelow(env, dir_path, dirfd(dir), subdir.c_str()) == -1) {
-        BAZEL_CHECK_NE(env->ExceptionOccurred(), nullptr);
-        break;
+
+  // Marks one subdirectory of `dir`, or the reading of its entries, as done.
+  // Once all are, `dir` itself is deleted, unless it is the top directory.
+  void Release(DeleteDir *dir) {
+    while (dir != nullptr && --dir->pending == 0) {
+      if (closedir(dir->dir) == -1) {
+        Fail(errno, "closedir", dir, nullptr);
       }
-      if (ForceDelete(env, *dir_path, dirfd(dir), subdir.c_str(), true) == -1) {
-        BAZEL_CHECK_NE(env->ExceptionOccurred(), nullptr);
-        break;
+      DeleteDir *parent = dir->parent;
+      if (parent == nullptr) {
+        return;
       }
+      if (!failed_) {
+        ForceDelete(parent, dir->name.c_str(), true);
+      }
+      delete dir;
+      dir = parent;
     }
   }
-  if (closedir(dir) == -1) {
-    // Prefer reporting the error encountered while processing entries,
-    // not the (unlikely) error on close.
-    if (env->ExceptionOccurred() == nullptr) {
-      PostDeleteTreesBelowException(env, errno, "closedir", *dir_path, nullptr);
+
+  // Tries to open a directory and, if the first attempt fails, retries after
+  // granting extra permissions to the directory.
+  //
+  // The directory to open is identified by its parent directory (or null for
+  // AT_FDCWD) and the subpath to resolve within that directory (entry).
+  //
+  // Returns a directory handle on success or an errno on error. If the error
+  // is other than ENOENT, records it before returning.
+  DIROrError ForceOpendir(const DeleteDir *parent, const char *entry) {
+    static const int flags = O_RDONLY | O_NOFOLLOW | PORTABLE_O_DIRECTORY;
+    const int dir_fd = DirFd(parent);
+    int fd = openat(dir_fd, entry, flags);
+    if (fd == -1) {
+      if (errno == ENOENT) {
+        return {nullptr, errno};
+      }
+      // If dir_fd is a readable but non-executable directory containing
+      // entry, we could have obtained entry by readdir()-ing, but any attempt
+      // to open or stat the entry would fail with EACCESS. In this case, we
+      // need to fix the permissions on dir_fd (which we can do only if it's a
+      // "real" file descriptor, not AT_FDCWD used as the starting point of
+      // DeleteTreesBelow).
+      if (errno == EACCES && dir_fd != AT_FDCWD) {
+        if (fchmod(dir_fd, 0700) == -1) {
+          if (errno != ENOENT) {
+            Fail(errno, "fchmod", parent, nullptr);
+          }
+          return {nullptr, errno};
+        }
+      }
+      if (fchmodat(dir_fd, entry, 0700, 0) == -1) {
+        if (errno != ENOENT) {
+          Fail(errno, "fchmodat", parent, entry);
+        }
+        return {nullptr, errno};
+      }
+      fd = openat(dir_fd, entry, flags);
+      if (fd == -1) {
+        if (errno != ENOENT) {
+          Fail(errno, "opendir", parent, entry);
+        }
+        return {nullptr, errno};
+      }
+    }
+    DIR *dir = fdopendir(fd);
+    if (dir == nullptr) {
+      if (errno != ENOENT) {
+        Fail(errno, "fdopendir", parent, entry);
+      }
+      close(fd);
+      return {nullptr, errno};
     }
+    return {dir, 0};
   }
-  dir_path->pop_back();
-  return env->ExceptionOccurred() == nullptr ? 0 : -1;
-}
-}  // namespace
 
-/*
- * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
- * Method:    deleteTreesBelow
- * Signature: (Ljava/lang/String;)V
+  // Tries to delete a file within a directory and, if the first attempt
+  // fails, retries after granting extra write permissions to the directory.
+  //
+  // is_dir indicates whether the entry to delete is a directory or not.
+  //
+  // Returns 0 when the file doesn't exist or is successfully deleted.
+  // Otherwise, returns -1 and records the error.
+  int ForceDelete(const DeleteDir *dir, const char *entry, const bool is_dir) {
+    const int dir_fd = DirFd(dir);
+    const int flags = is_dir ? AT_REMOVEDIR : 0;
+    if (unlinkat(dir_fd, entry, flags) == -1) {
+      if (errno == ENOENT) {
+        return 0;
+      }
+      if (fchmod(dir_fd, 0700) == -1) {
+        if (errno == ENOENT) {
+          return 0;
+        }
+        Fail(errno, "fchmod", dir, nullptr);
+        return -1;
+      }
+      if (unlinkat(dir_fd, entry, flags) == -1) {
+        if (errno == ENOENT) {
+          return 0;
+        }
+        Fail(errno, "unlinkat", dir, entry);
+        return -1;
+      }
+    }
+    return 0;
+  }
+
+  // Returns true if the given directory entry represents a subdirectory of
+  // dir.
+  //
+  // This function prefers to extract the type information from the directory
+  // entry itself if available. If not available, issues a stat starting from
+  // dir.
+  //
+  // Returns 0 on success and updates is_dir accordingly. Returns -1 on error
+  // and records it.
+  int IsSubdir(const DeleteDir *dir, const struct dirent *de, bool *is_dir) {
+    switch (de->d_type) {
+      case DT_DIR:
+        *is_dir = true;
+        return 0;
+
+      case DT_UNKNOWN: {
+        struct stat st;
+        if (fstatat(DirFd(dir), de->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+          if (errno == ENOENT) {
+            *is_dir = false;
+            return 0;
+          }
+          Fail(errno, "fstatat", dir, de->d_name);
+          return -1;
+        }
+        *is_dir = st.st_mode & S_IFDIR;
+        return 0;
+      }
+
+      default:
+        *is_dir = false;
+        return 0;
+    }
+  }
+
+  // Another thread is started for every this many queued subdirectories.
+  static constexpr size_t kTasksPerThread = 64;
+  static constexpr unsigned kMaxThreads = 8;
+
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::vector<Task> tasks_;
+  // The number of tasks that are running.
+  int busy_ = 0;
+  std::vector<std::thread> threads_;
+
+  // Set once an error was recorded, after which no more work is started.
+  std::atomic<bool> failed_{false};
+  std::mutex error_mutex_;
+  int error_ = 0;
+  std::string error_function_;
+  std::string error_path_;
+};
+}  // namespace
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    deleteTreesBelow
+ * Signature: (Ljava/lang/String;)V
  * Throws:    java.io.IOException
  */
 extern "C" JNIEXPORT void JNICALL
 Java_com_google_devtools_build_lib_unix_NativePosixFiles_deleteTreesBelow(
     JNIEnv *env, jclass clazz, jstring path) {
   const char *path_chars = GetStringLatin1Chars(env, path);
-  std::vector<std::string> dir_path;
-  if (DeleteTreesBelow(env, &dir_path, AT_FDCWD, path_chars) == -1) {
+  TreeDeleter deleter;
+  if (deleter.Run(env, path_chars) == -1) {
     BAZEL_CHECK_NE(env->ExceptionOccurred(), nullptr);
   }
-  BAZEL_CHECK(dir_path.empty());
   ReleaseStringLatin1Chars(path_chars);
 }
 
@@ -1221,6 +1738,192 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_lgetxattr(JNIEnv *env,
   return getxattr_common(env, path, name, portable_lgetxattr);
 }
 
+////////////////////////////////////////////////////////////////////////
+// Digest cache in extended attributes
+
+namespace {
+// The state of a file that a cached digest is valid for, which is stored in
+// front of the digest in the extended attribute.
+struct DigestCacheStamp {
+  uint32_t magic;
+  uint32_t digest_length;
+  int64_t mtime;  // In nanoseconds since the epoch.
+  int64_t size;
+  uint64_t ino;
+};
+
+static const uint32_t kDigestCacheMagic = 0x42444331;  // "BDC1"
+static const size_t kMaxDigestLength = 64;
+
+static bool GetStamp(const char *path, DigestCacheStamp *stamp) {
+  portable_stat_struct statbuf;
+  if (portable_stat(path, &statbuf) == -1 || !S_ISREG(statbuf.st_mode)) {
+    return false;
+  }
+  stamp->magic = kDigestCacheMagic;
+  stamp->digest_length = 0;
+  stamp->mtime = StatEpochNanoseconds(statbuf, STAT_MTIME);
+  stamp->size = statbuf.st_size;
+  stamp->ino = statbuf.st_ino;
+  return true;
+}
+
+static bool IsSameFile(const DigestCacheStamp &a, const DigestCacheStamp &b) {
+  return a.magic == b.magic && a.mtime == b.mtime && a.size == b.size &&
+         a.ino == b.ino;
+}
+
+// Returns whether a modification of a file with the given modification time
+// could leave that time unchanged, because it is so recent that a later
+// modification could still get the same timestamp.
+static bool IsRacy(int64_t mtime) {
+  struct timespec now;
+  if (clock_gettime(CLOCK_REALTIME, &now) == -1) {
+    return true;
+  }
+  // A modification time in whole seconds suggests a filesystem that doesn't
+  // keep any finer ones.
+  const int64_t granularity =
+      mtime % 1000000000L == 0 ? 2000000000L : 100000000L;
+  return now.tv_sec * 1000000000L + now.tv_nsec - mtime < granularity;
+}
+}  // namespace
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    getDigestCacheStamp
+ * Signature: (Ljava/lang/String;)[B
+ */
+extern "C" JNIEXPORT jbyteArray JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_getDigestCacheStamp(
+    JNIEnv *env, jclass clazz, jstring path) {
+  const char *path_chars = GetStringLatin1Chars(env, path);
+  DigestCacheStamp stamp;
+  jbyteArray result = nullptr;
+  if (GetStamp(path_chars, &stamp) && !IsRacy(stamp.mtime)) {
+    result = env->NewByteArray(sizeof(stamp));
+    if (result != nullptr) {
+      env->SetByteArrayRegion(result, 0, sizeof(stamp),
+                              reinterpret_cast<jbyte *>(&stamp));
+    }
+  }
+  ReleaseStringLatin1Chars(path_chars);
+  return result;
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    storeCachedDigest
+ * Signature: (Ljava/lang/String;Ljava/lang/String;[B[B)Z
+ */
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_storeCachedDigest(
+    JNIEnv *env, jclass clazz, jstring path, jstring name, jbyteArray jstamp,
+    jbyteArray jdigest) {
+  const jsize digest_length = env->GetArrayLength(jdigest);
+  if (static_cast<size_t>(env->GetArrayLength(jstamp)) !=
+          sizeof(DigestCacheStamp) ||
+      static_cast<size_t>(digest_length) > kMaxDigestLength) {
+    return false;
+  }
+  char record[sizeof(DigestCacheStamp) + kMaxDigestLength];
+  DigestCacheStamp stamp;
+  env->GetByteArrayRegion(jstamp, 0, sizeof(stamp),
+                          reinterpret_cast<jbyte *>(&stamp));
+  env->GetByteArrayRegion(jdigest, 0, digest_length,
+                          reinterpret_cast<jbyte *>(record + sizeof(stamp)));
+
+  const char *path_chars = GetStringLatin1Chars(env, path);
+  const char *name_chars = GetStringLatin1Chars(env, name);
+  // The file must not have changed since the stamp was taken, before its
+  // digest was computed. Setting the attribute changes the ctime of the
+  // file, which is why the stamp doesn't include it.
+  DigestCacheStamp current;
+  bool stored = false;
+  if (GetStamp(path_chars, &current) && IsSameFile(stamp, current)) {
+    stamp.digest_length = digest_length;
+    memcpy(record, &stamp, sizeof(stamp));
+    stored = portable_setxattr(path_chars, name_chars, record,
+                               sizeof(stamp) + digest_length) == 0;
+  }
+  ReleaseStringLatin1Chars(path_chars);
+  ReleaseStringLatin1Chars(name_chars);
+  return stored;
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    getCachedDigests
+ * Signature: ([Ljava/lang/String;Ljava/lang/String;I[B)[Z
+ */
+extern "C" JNIEXPORT jbooleanArray JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_getCachedDigests(
+    JNIEnv *env, jclass clazz, jobjectArray paths, jstring name,
+    jint digest_length, jbyteArray digests) {
+  const jsize count = env->GetArrayLength(paths);
+  if (digest_length < 0 ||
+      static_cast<size_t>(digest_length) > kMaxDigestLength ||
+      env->GetArrayLength(digests) <
+          static_cast<int64_t>(count) * digest_length) {
+    PostException(env, "java/lang/IllegalArgumentException",
+                  "invalid digest length");
+    return nullptr;
+  }
+  jbooleanArray result = env->NewBooleanArray(count);
+  if (result == nullptr) {
+    return nullptr;
+  }
+  const char *name_chars = GetStringLatin1Chars(env, name);
+  std::vector<jboolean> found(count);
+  std::vector<jbyte> found_digests(static_cast<size_t>(count) * digest_length);
+  char record[sizeof(DigestCacheStamp) + kMaxDigestLength];
+  for (jsize i = 0; i < count; i++) {
+    jstring path = static_cast<jstring>(env->GetObjectArrayElement(paths, i));
+    const char *path_chars = GetStringLatin1Chars(env, path);
+    env->DeleteLocalRef(path);
+    if (path_chars == nullptr) {
+      break;
+    }
+    DigestCacheStamp current, stamp;
+    bool attr_not_found;
+    const ssize_t size = portable_getxattr(path_chars, name_chars, record,
+                                           sizeof(record), &attr_not_found);
+    if (size == static_cast<ssize_t>(sizeof(stamp) + digest_length) &&
+        GetStamp(path_chars, &current)) {
+      memcpy(&stamp, record, sizeof(stamp));
+      if (stamp.digest_length == static_cast<uint32_t>(digest_length) &&
+          IsSameFile(stamp, current)) {
+        memcpy(&found_digests[i * digest_length], record + sizeof(stamp),
+               digest_length);
+        found[i] = true;
+      }
+    }
+    ReleaseStringLatin1Chars(path_chars);
+  }
+  ReleaseStringLatin1Chars(name_chars);
+  if (env->ExceptionOccurred()) {
+    return nullptr;
+  }
+  env->SetBooleanArrayRegion(result, 0, count, found.data());
+  env->SetByteArrayRegion(digests, 0, found_digests.size(),
+                          found_digests.data());
+  return result;
+}
+
+extern "C" JNIEXPORT jint JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_openRead(
+    JNIEnv *env, jclass clazz, jstring path) {
+  const char *path_chars = GetStringLatin1Chars(env, path);
+  int fd;
+  while ((fd = open(path_chars, O_RDONLY)) == -1 && errno == EINTR) {
+  }
+  if (fd == -1) {
+    PostException(env, errno, path_chars);
+  }
+  ReleaseStringLatin1Chars(path_chars);
+  return fd;
+}
+
 extern "C" JNIEXPORT jint JNICALL
 Java_com_google_devtools_build_lib_unix_NativePosixFiles_openWrite(
     JNIEnv *env, jclass clazz, jstring path, jboolean append) {
@@ -1246,42 +1949,553 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_close(JNIEnv *env,
   }
 }
 
-extern "C" JNIEXPORT void JNICALL
-Java_com_google_devtools_build_lib_unix_NativePosixFiles_write(
-    JNIEnv *env, jclass clazz, jint fd, jbyteArray data, jint off, jint len) {
-  int data_len = env->GetArrayLength(data);
-  if (off < 0 || len < 0 || off > data_len || data_len - off < len) {
+namespace {
+// Writes of up to this many bytes go through a buffer on the stack.
+static const size_t kStackWriteBufferSize = 16 * 1024;
+// Larger writes go through a buffer of at most this many bytes on the heap.
+static const size_t kHeapWriteBufferSize = 1024 * 1024;
+
+// Throws an IndexOutOfBoundsException unless off and len are valid for an
+// array of size bytes. Returns whether they are.
+static bool CheckBounds(JNIEnv *env, jlong size, jint off, jint len) {
+  if (off < 0 || len < 0 || off > size || size - off < len) {
     jclass oob = env->FindClass("java/lang/IndexOutOfBoundsException");
     if (oob != nullptr) {
       env->ThrowNew(oob, nullptr);
     }
+    return false;
+  }
+  return true;
+}
+
+// Writes len bytes from buf to fd at offset, or at the current file offset
+// if offset is negative. Returns 0 on success, or -1 with errno set.
+static int WriteFully(int fd, const char *buf, size_t len, off_t offset) {
+  while (len > 0) {
+    ssize_t res = offset < 0 ? write(fd, buf, len)
+                             : pwrite(fd, buf, len, offset);
+    if (res == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    buf += res;
+    len -= res;
+    if (offset >= 0) {
+      offset += res;
+    }
+  }
+  return 0;
+}
+
+// Copies up to length bytes from in_fd to out_fd, starting at their file
+// offsets and advancing them. Returns the number of bytes copied, which is
+// less than length only at the end of in_fd, or -1 with errno set.
+static int64_t CopyFileRange(int in_fd, int out_fd, int64_t length) {
+  // The largest count that copy_file_range(2) takes on all platforms.
+  static const int64_t kMaxCopyFileRange = 1 << 30;
+  int64_t copied = 0;
+  // The kernel copies the data without passing it through user space, but
+  // not between all kinds of files, after which we copy the rest ourselves.
+  while (copied < length) {
+    ssize_t res = portable_copy_file_range(
+        in_fd, out_fd, std::min(length - copied, kMaxCopyFileRange));
+    if (res == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == ENOSYS || errno == EXDEV || errno == EINVAL ||
+          errno == EOPNOTSUPP) {
+        break;
+      }
+      return -1;
+    }
+    if (res == 0) {
+      return copied;
+    }
+    copied += res;
+  }
+  std::vector<char> buf;
+  while (copied < length) {
+    if (buf.empty()) {
+      buf.resize(std::min<int64_t>(length - copied, kHeapWriteBufferSize));
+    }
+    ssize_t res =
+        read(in_fd, buf.data(), std::min<int64_t>(length - copied, buf.size()));
+    if (res == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    if (res == 0) {
+      break;
+    }
+    if (WriteFully(out_fd, buf.data(), res, -1) == -1) {
+      return -1;
+    }
+    copied += res;
+  }
+  return copied;
+}
+}  // namespace
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_write(
+    JNIEnv *env, jclass clazz, jint fd, jbyteArray data, jint off, jint len) {
+  if (!CheckBounds(env, env->GetArrayLength(data), off, len)) {
     return;
   }
-  jbyte *buf = static_cast<jbyte *>(malloc(len));
-  if (buf == nullptr) {
-    PostException(env, ENOMEM, "write");
+  // The data is copied out of the array piecewise, so that small writes need
+  // no allocation and large ones only a bounded one. (Pinning the array
+  // instead could hold up the garbage collector for as long as a write
+  // blocks.)
+  jbyte stack_buf[kStackWriteBufferSize];
+  std::vector<jbyte> heap_buf;
+  jbyte *buf = stack_buf;
+  size_t buf_size = sizeof(stack_buf);
+  if (static_cast<size_t>(len) > buf_size) {
+    heap_buf.resize(std::min(static_cast<size_t>(len), kHeapWriteBufferSize));
+    buf = heap_buf.data();
+    buf_size = heap_buf.size();
+  }
+  while (len > 0) {
+    jint n = std::min(static_cast<size_t>(len), buf_size);
+    env->GetByteArrayRegion(data, off, n, buf);
+    if (env->ExceptionOccurred()) {
+      return;
+    }
+    if (WriteFully(fd, reinterpret_cast<char *>(buf), n, -1) == -1) {
+      PostException(env, errno, "write");
+      return;
+    }
+    off += n;
+    len -= n;
+  }
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    writeDirect
+ * Signature: (ILjava/nio/ByteBuffer;IIJ)V
+ * Throws:    java.io.IOException
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_writeDirect(
+    JNIEnv *env, jclass clazz, jint fd, jobject buffer, jint off, jint len,
+    jlong position) {
+  char *data = static_cast<char *>(env->GetDirectBufferAddress(buffer));
+  if (data == nullptr) {
+    PostException(env, "java/lang/IllegalArgumentException",
+                  "not a direct buffer");
     return;
   }
-  env->GetByteArrayRegion(data, off, len, buf);
-  // GetByteArrayRegion may raise ArrayIndexOutOfBoundsException if one of the
-  // indexes in the region is not valid. As we obtain the inidices from the
-  // caller, we have to check.
-  if (!env->ExceptionOccurred()) {
-    jbyte *p = buf;
-    while (len > 0) {
-      ssize_t res = write(fd, p, len);
-      if (res == -1) {
-        if (errno != EINTR) {
-          PostException(env, errno, "write");
-          break;
-        }
+  if (!CheckBounds(env, env->GetDirectBufferCapacity(buffer), off, len)) {
+    return;
+  }
+  if (WriteFully(fd, data + off, len, position) == -1) {
+    PostException(env, errno, "write");
+  }
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    preallocate
+ * Signature: (IJ)V
+ * Throws:    java.io.IOException
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_preallocate(
+    JNIEnv *env, jclass clazz, jint fd, jlong size) {
+  if (size <= 0) {
+    return;
+  }
+  // This is only a hint, except that it tells early that the data won't fit.
+  if (portable_preallocate(fd, size) == -1 &&
+      (errno == ENOSPC || errno == EDQUOT)) {
+    PostException(env, errno, "preallocate");
+  }
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    copyFileRange
+ * Signature: (IIJ)J
+ * Throws:    java.io.IOException
+ */
+extern "C" JNIEXPORT jlong JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_copyFileRange(
+    JNIEnv *env, jclass clazz, jint from_fd, jint to_fd, jlong length) {
+  int64_t copied = CopyFileRange(from_fd, to_fd, length);
+  if (copied == -1) {
+    PostException(env, errno, "copy_file_range");
+  }
+  return copied;
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    cloneFile
+ * Signature: (Ljava/lang/String;Ljava/lang/String;)Z
+ * Throws:    java.io.IOException
+ */
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_cloneFile(
+    JNIEnv *env, jclass clazz, jstring from, jstring to) {
+  const char *from_chars = GetStringLatin1Chars(env, from);
+  const char *to_chars = GetStringLatin1Chars(env, to);
+  bool cloned =
+      portable_clone_file(AT_FDCWD, from_chars, AT_FDCWD, to_chars) == 0;
+  if (!cloned && errno != ENOSYS && errno != ENOTSUP && errno != EXDEV) {
+    // EEXIST ENOENT EACCES ENOSPC EDQUOT EROFS -> IOException
+    std::string filename(std::string(from_chars) + " -> " + to_chars);
+    PostException(env, errno, filename);
+  }
+  ReleaseStringLatin1Chars(from_chars);
+  ReleaseStringLatin1Chars(to_chars);
+  return cloned;
+}
+
+namespace {
+// A directory that TreeCopier is copying.
+struct CopyDir {
+  CopyDir(CopyDir *parent, std::string name, int from_fd, int to_fd,
+          const portable_stat_struct &stat)
+      : parent(parent),
+        name(std::move(name)),
+        from_fd(from_fd),
+        to_fd(to_fd),
+        stat(stat) {}
+
+  // The parent directory, or null for the top directory.
+  CopyDir *const parent;
+  // The name in the parent directory, or "" for the top directory.
+  const std::string name;
+  const int from_fd;
+  const int to_fd;
+  // The status of the original, whose mode and times the copy gets once all
+  // of its entries are there.
+  const portable_stat_struct stat;
+  // The number of entries not copied yet, plus one while the entries of the
+  // directory are being read.
+  std::atomic<int> pending{1};
+};
+
+static struct timespec NanosToTimespec(int64_t nanos) {
+  struct timespec ts;
+  ts.tv_sec = nanos / 1000000000;
+  ts.tv_nsec = nanos % 1000000000;
+  return ts;
+}
+
+// Copies the trees below a directory into another one, on as many threads as
+// the size of the tree warrants, cloning the files where the file system can.
+// Like TreeDeleter, the threads only record the first error, and the JNI
+// thread posts it once all of them are done.
+class TreeCopier {
+ public:
+  // Copies all trees below `from` into `to`, which must not have entries of
+  // the same names. Returns 0 on success. Returns -1 on error and posts an
+  // exception.
+  int Run(JNIEnv *env, const char *from, const char *to) {
+    from_ = from;
+    to_ = to;
+    static const int flags = O_RDONLY | PORTABLE_O_DIRECTORY | O_CLOEXEC;
+    int from_fd = open(from, flags);
+    if (from_fd == -1) {
+      Fail(errno, "open", nullptr, nullptr);
+    } else {
+      int to_fd = open(to, flags);
+      if (to_fd == -1) {
+        Fail(errno, "open", nullptr, nullptr);
+        close(from_fd);
       } else {
-        p += res;
-        len -= res;
+        CopyDir top(nullptr, "", from_fd, to_fd, portable_stat_struct());
+        ReadDirectory(&top);
+        Work();
+        for (std::thread &thread : threads_) {
+          thread.join();
+        }
+      }
+    }
+    if (error_ != 0) {
+      BAZEL_CHECK(!env->ExceptionOccurred());
+      PostException(env, error_, error_function_ + " (" + error_path_ + ")");
+      return -1;
+    }
+    return 0;
+  }
+
+ private:
+  // An entry to copy.
+  struct Task {
+    CopyDir *dir;
+    std::string name;
+  };
+
+  // Runs the tasks until there are none left and none running.
+  void Work() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      changed_.wait(lock, [this] { return !tasks_.empty() || busy_ == 0; });
+      if (tasks_.empty()) {
+        return;
+      }
+      // Taking the most recent task first keeps few directories open.
+      Task task = std::move(tasks_.back());
+      tasks_.pop_back();
+      busy_++;
+      lock.unlock();
+      CopyEntry(task.dir, task.name.c_str());
+      lock.lock();
+      if (--busy_ == 0 && tasks_.empty()) {
+        changed_.notify_all();
+      }
+    }
+  }
+
+  // Queues the entries of `dir`, starting another thread if there is enough
+  // work for one.
+  void AddTasks(CopyDir *dir, const std::vector<char> &names) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < names.size(); i += strlen(&names[i]) + 1) {
+      tasks_.push_back({dir, &names[i]});
+    }
+    if (tasks_.size() > kTasksPerThread * (threads_.size() + 1) &&
+        threads_.size() + 1 < MaxThreads()) {
+      threads_.emplace_back(&TreeCopier::Work, this);
+    }
+    changed_.notify_all();
+  }
+
+  static size_t MaxThreads() {
+    return std::max(1u,
+                    std::min(kMaxThreads, std::thread::hardware_concurrency()));
+  }
+
+  // Records the error of `function` on `entry` in `dir`, unless there is an
+  // earlier one. Both `dir` and `entry` may be null.
+  void Fail(int error, const char *function, const CopyDir *dir,
+            const char *entry) {
+    std::string path = entry != nullptr ? entry : "";
+    for (; dir != nullptr && dir->parent != nullptr; dir = dir->parent) {
+      path = path.empty() ? dir->name : dir->name + "/" + path;
+    }
+    std::lock_guard<std::mutex> lock(error_mutex_);
+    if (error_ == 0) {
+      error_ = error;
+      error_function_ = function;
+      error_path_ = path.empty() ? from_ + " -> " + to_
+                                 : from_ + "/" + path + " -> " + to_ + "/" +
+                                       path;
+      failed_ = true;
+    }
+  }
+
+  // Reads the entries of `dir` and queues them.
+  void ReadDirectory(CopyDir *dir) {
+    std::vector<char> names;
+    std::vector<unsigned char> types;
+    if (portable_read_dir_entries(dir->from_fd, &names, &types) == -1) {
+      Fail(errno, "readdir", dir, nullptr);
+    } else if (!names.empty()) {
+      dir->pending += types.size();
+      AddTasks(dir, names);
+    }
+    Release(dir);
+  }
+
+  // Copies the entry `name` of `dir`, with all that is below it.
+  void CopyEntry(CopyDir *dir, const char *name) {
+    portable_stat_struct st;
+    if (failed_) {
+      // Nothing more to do.
+    } else if (portable_fstatat(dir->from_fd, const_cast<char *>(name), &st,
+                                AT_SYMLINK_NOFOLLOW) == -1) {
+      Fail(errno, "fstatat", dir, name);
+    } else if (S_ISDIR(st.st_mode)) {
+      CopyDirectory(dir, name, st);
+      return;
+    } else if (S_ISREG(st.st_mode)) {
+      CopyFile(dir, name, st);
+    } else if (S_ISLNK(st.st_mode)) {
+      CopySymlink(dir, name, st);
+    } else {
+      Fail(ENOTSUP, "copy", dir, name);
+    }
+    Release(dir);
+  }
+
+  // Creates the copy of the subdirectory `name` of `dir` and reads its
+  // entries, or releases `dir` on error.
+  void CopyDirectory(CopyDir *dir, const char *name,
+                     const portable_stat_struct &st) {
+    static const int flags =
+        O_RDONLY | O_NOFOLLOW | PORTABLE_O_DIRECTORY | O_CLOEXEC;
+    // Writable until its entries are there.
+    if (mkdirat(dir->to_fd, name, 0700) == -1) {
+      Fail(errno, "mkdirat", dir, name);
+      Release(dir);
+      return;
+    }
+    int from_fd = openat(dir->from_fd, name, flags);
+    if (from_fd == -1) {
+      Fail(errno, "openat", dir, name);
+      Release(dir);
+      return;
+    }
+    int to_fd = openat(dir->to_fd, name, flags);
+    if (to_fd == -1) {
+      Fail(errno, "openat", dir, name);
+      close(from_fd);
+      Release(dir);
+      return;
+    }
+    ReadDirectory(new CopyDir(dir, name, from_fd, to_fd, st));
+  }
+
+  // Clones the regular file `name` of `dir`, or copies it if the file system
+  // cannot clone it, with the mode and times of the original.
+  void CopyFile(CopyDir *dir, const char *name,
+                const portable_stat_struct &st) {
+    const struct timespec times[2] = {
+        NanosToTimespec(StatEpochNanoseconds(st, STAT_ATIME)),
+        NanosToTimespec(StatEpochNanoseconds(st, STAT_MTIME))};
+    if (!clone_unsupported_) {
+      if (portable_clone_file(dir->from_fd, name, dir->to_fd, name) == 0) {
+        if (utimensat(dir->to_fd, name, times, AT_SYMLINK_NOFOLLOW) == -1) {
+          Fail(errno, "utimensat", dir, name);
+        }
+        return;
+      }
+      if (errno != ENOSYS && errno != ENOTSUP && errno != EXDEV) {
+        Fail(errno, "clone", dir, name);
+        return;
+      }
+      // The trees are most likely on the same file systems throughout.
+      clone_unsupported_ = true;
+    }
+    int in = openat(dir->from_fd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (in == -1) {
+      Fail(errno, "openat", dir, name);
+      return;
+    }
+    int out = openat(dir->to_fd, name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                     0600);
+    if (out == -1) {
+      Fail(errno, "openat", dir, name);
+    } else {
+      if (CopyFileRange(in, out, st.st_size) == -1) {
+        Fail(errno, "copy_file_range", dir, name);
+      } else if (fchmod(out, st.st_mode & 07777) == -1) {
+        Fail(errno, "fchmod", dir, name);
+      } else if (futimens(out, times) == -1) {
+        Fail(errno, "futimens", dir, name);
+      }
+      if (close(out) == -1) {
+        Fail(errno, "close", dir, name);
       }
     }
+    close(in);
+  }
+
+  void CopySymlink(CopyDir *dir, const char *name,
+                   const portable_stat_struct &st) {
+    std::vector<char> target(st.st_size + 1);
+    ssize_t size = readlinkat(dir->from_fd, name, target.data(), target.size());
+    if (size == -1) {
+      Fail(errno, "readlinkat", dir, name);
+      return;
+    }
+    if (static_cast<size_t>(size) == target.size()) {
+      // Changed since the stat.
+      Fail(EAGAIN, "readlinkat", dir, name);
+      return;
+    }
+    target[size] = '\0';
+    if (symlinkat(target.data(), dir->to_fd, name) == -1) {
+      Fail(errno, "symlinkat", dir, name);
+      return;
+    }
+    const struct timespec times[2] = {
+        NanosToTimespec(StatEpochNanoseconds(st, STAT_ATIME)),
+        NanosToTimespec(StatEpochNanoseconds(st, STAT_MTIME))};
+    if (utimensat(dir->to_fd, name, times, AT_SYMLINK_NOFOLLOW) == -1) {
+      Fail(errno, "utimensat", dir, name);
+    }
+  }
+
+  // Marks one entry of `dir`, or the reading of its entries, as copied. Once
+  // all are, the copy of `dir` gets the mode and times of the original,
+  // unless it is the top directory.
+  void Release(CopyDir *dir) {
+    while (dir != nullptr && --dir->pending == 0) {
+      CopyDir *parent = dir->parent;
+      if (parent != nullptr && !failed_) {
+        const struct timespec times[2] = {
+            NanosToTimespec(StatEpochNanoseconds(dir->stat, STAT_ATIME)),
+            NanosToTimespec(StatEpochNanoseconds(dir->stat, STAT_MTIME))};
+        if (fchmod(dir->to_fd, dir->stat.st_mode & 07777) == -1) {
+          Fail(errno, "fchmod", dir, nullptr);
+        } else if (futimens(dir->to_fd, times) == -1) {
+          Fail(errno, "futimens", dir, nullptr);
+        }
+      }
+      close(dir->from_fd);
+      close(dir->to_fd);
+      if (parent == nullptr) {
+        return;
+      }
+      delete dir;
+      dir = parent;
+    }
+  }
+
+  // Another thread is started for every this many queued entries.
+  static constexpr size_t kTasksPerThread = 64;
+  static constexpr unsigned kMaxThreads = 8;
+
+  std::string from_;
+  std::string to_;
+
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::vector<Task> tasks_;
+  // The number of tasks that are running.
+  int busy_ = 0;
+  std::vector<std::thread> threads_;
+
+  // Set once cloning a file failed because the file system cannot clone, so
+  // that the other files are copied right away.
+  std::atomic<bool> clone_unsupported_{false};
+
+  // Set once an error was recorded, after which no more work is started.
+  std::atomic<bool> failed_{false};
+  std::mutex error_mutex_;
+  int error_ = 0;
+  std::string error_function_;
+  std::string error_path_;
+};
+}  // namespace
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    copyTreesBelow
+ * Signature: (Ljava/lang/String;Ljava/lang/String;)V
+ * Throws:    java.io.IOException
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_copyTreesBelow(
+    JNIEnv *env, jclass clazz, jstring from, jstring to) {
+  const char *from_chars = GetStringLatin1Chars(env, from);
+  const char *to_chars = GetStringLatin1Chars(env, to);
+  TreeCopier copier;
+  if (copier.Run(env, from_chars, to_chars) == -1) {
+    BAZEL_CHECK_NE(env->ExceptionOccurred(), nullptr);
   }
-  free(buf);
+  ReleaseStringLatin1Chars(from_chars);
+  ReleaseStringLatin1Chars(to_chars);
 }
 
 /*
@@ -1479,7 +2693,22 @@ Java_com_google_devtools_build_lib_platform_SystemMemoryPressureMonitor_register
   portable_start_memory_pressure_monitoring();
 }
 
+// The mapping of the admission gate file, once it is open: a 32-bit word that
+// the process-wrapper and the linux-sandbox read the memory pressure level
+// from (see WaitForAdmission in src/main/tools/process-tools.h).
+static std::atomic<uint32_t *> g_admission_gate;
+
+static void update_admission_gate(MemoryPressureLevel level) {
+  uint32_t *gate = g_admission_gate.load();
+  if (gate != nullptr) {
+    __atomic_store_n(gate, static_cast<uint32_t>(level), __ATOMIC_RELEASE);
+  }
+}
+
 void memory_pressure_callback(MemoryPressureLevel level) {
+  // Before anything else: the tools hold new actions back without waiting
+  // for the Java side.
+  update_admission_gate(level);
   if (g_memory_pressure_module != nullptr) {
     PerformIntegerValueCallback(g_memory_pressure_module,
                                 "memoryPressureCallback", level);
@@ -1497,6 +2726,41 @@ Java_com_google_devtools_build_lib_platform_SystemMemoryPressureMonitor_systemMe
   return portable_memory_pressure();
 }
 
+/*
+ * Class:     Java_com_google_devtools_build_lib_platform_SystemMemoryPressureMonitor
+ * Method:    openAdmissionGateNative
+ * Signature: (Ljava/lang/String;)V
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_platform_SystemMemoryPressureMonitor_openAdmissionGateNative(
+    JNIEnv *env, jobject local_object, jstring path) {
+  static std::mutex mutex;
+  std::lock_guard<std::mutex> lock(mutex);
+  if (g_admission_gate.load() != nullptr) {
+    return;
+  }
+  const char *path_chars = GetStringLatin1Chars(env, path);
+  int fd = open(path_chars, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    PostException(env, errno, path_chars);
+    ReleaseStringLatin1Chars(path_chars);
+    return;
+  }
+  void *gate = MAP_FAILED;
+  if (ftruncate(fd, sizeof(uint32_t)) == 0) {
+    gate = mmap(nullptr, sizeof(uint32_t), PROT_READ | PROT_WRITE, MAP_SHARED,
+                fd, 0);
+  }
+  if (gate == MAP_FAILED) {
+    PostException(env, errno, path_chars);
+  } else {
+    g_admission_gate.store(static_cast<uint32_t *>(gate));
+    update_admission_gate(portable_memory_pressure());
+  }
+  close(fd);
+  ReleaseStringLatin1Chars(path_chars);
+}
+
 jobject g_disk_space_module;
 
 /*
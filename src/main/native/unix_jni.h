@@ -23,6 +23,7 @@
 #include <sys/stat.h>
 
 #include <string>
+#include <vector>
 
 namespace blaze_jni {
 
@@ -59,6 +60,62 @@ extern std::string ErrorMessage(int error_number);
 int portable_fstatat(int dirfd, char *name, portable_stat_struct *statbuf,
                      int flags);
 
+// Reads all entries of the directory open as `dirfd`, except for . and ..,
+// appending their names to `names`, each terminated by a NUL, and their d_type
+// to `types`. Reads as many entries per system call as possible. Returns 0 on
+// success, or -1 with errno set.
+int portable_read_dir_entries(int dirfd, std::vector<char> *names,
+                              std::vector<unsigned char> *types);
+
+// What portable_read_dir_entries_with_stats reports of an entry, as lstat(2)
+// would.
+struct DirEntryStat {
+  // The errno of the failure to get the rest, or 0.
+  int error;
+  mode_t mode;
+  int64_t size;
+  int64_t mtime_millis;
+  int64_t ctime_millis;
+  uint64_t inode;
+  dev_t device;
+};
+
+// Like portable_read_dir_entries, but also appends what lstat(2) would report
+// of each entry to `stats`, from the same few system calls. Returns -1 with
+// errno set to ENOSYS, having read nothing, if the platform cannot do that.
+int portable_read_dir_entries_with_stats(int dirfd, std::vector<char> *names,
+                                         std::vector<unsigned char> *types,
+                                         std::vector<DirEntryStat> *stats);
+
+// Reserves disk space for the first `size` bytes of the file open as `fd`
+// without changing its size. Returns 0 on success, or -1 with errno set, to
+// ENOSYS if the platform cannot reserve space like that.
+int portable_preallocate(int fd, int64_t size);
+
+// Runs copy_file_range(2) with both file offsets, if available, or sets errno
+// to ENOSYS if not.
+ssize_t portable_copy_file_range(int in_fd, int out_fd, size_t len);
+
+// Creates the file `to` in the directory `to_dir_fd`, which must not exist,
+// as a clone of the regular file `from` in `from_dir_fd` that shares its data
+// until either is written to, with the same permissions. Either directory may
+// be AT_FDCWD. Returns 0 on success, or -1 with errno set, to ENOSYS if the
+// platform cannot clone files and to ENOTSUP or EXDEV if the file system
+// cannot clone this one there, having created nothing.
+int portable_clone_file(int from_dir_fd, const char *from, int to_dir_fd,
+                        const char *to);
+
+// Sets the CPU scheduling policy of every thread of this process to
+// SCHED_BATCH if `batch`, and to SCHED_OTHER if not. Returns 0 on success, or
+// -1 with errno set, to ENOSYS if the platform has no such policies.
+int portable_set_batch_cpu_scheduling(bool batch);
+
+// Sets the I/O priority of every thread of this process to the best-effort
+// level `io_nice_level`, from 0 to 7, or if it is negative, back to following
+// their nice value. Returns 0 on success, or -1 with errno set, to ENOSYS if
+// the platform has no I/O priorities.
+int portable_set_io_nice_level(int io_nice_level);
+
 // Encoding for different timestamps in a struct stat.
 enum StatTimes {
   STAT_ATIME,  // access
@@ -70,6 +127,9 @@ enum StatTimes {
 uint64_t StatEpochMilliseconds(const portable_stat_struct &statbuf,
                                StatTimes t);
 
+// Returns nanoseconds since Unix epoch from the given struct stat field.
+int64_t StatEpochNanoseconds(const portable_stat_struct &statbuf, StatTimes t);
+
 // Runs getxattr(2). If the attribute is not found, returns -1 and sets
 // attr_not_found to true. For all other errors, returns -1, sets attr_not_found
 // to false and leaves errno set to the error code returned by the system.
@@ -82,6 +142,11 @@ ssize_t portable_getxattr(const char *path, const char *name, void *value,
 ssize_t portable_lgetxattr(const char *path, const char *name, void *value,
                            size_t size, bool *attr_not_found);
 
+// Runs setxattr(2), following symbolic links, in the namespace that
+// portable_getxattr reads. Returns 0 on success, or -1 with errno set.
+int portable_setxattr(const char *path, const char *name, const void *value,
+                      size_t size);
+
 // Used to surround an region that we want sleep disabled for.
 // push_disable_sleep to start the area.
 // pop_disable_sleep to end the area.
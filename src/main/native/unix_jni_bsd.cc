@@ -22,6 +22,7 @@
 #endif
 
 #include <assert.h>
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
@@ -57,6 +58,77 @@ int portable_fstatat(int dirfd, char *name, portable_stat_struct *statbuf,
   return fstatat(dirfd, name, statbuf, flags);
 }
 
+int portable_read_dir_entries(int dirfd, std::vector<char> *names,
+                              std::vector<unsigned char> *types) {
+  // readdir(3) closes the file descriptor along with the stream.
+  int fd = dup(dirfd);
+  if (fd == -1) {
+    return -1;
+  }
+  DIR *dirh = fdopendir(fd);
+  if (dirh == nullptr) {
+    close(fd);
+    return -1;
+  }
+  for (;;) {
+    errno = 0;
+    struct dirent *entry = readdir(dirh);
+    if (entry == nullptr) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    const char *name = entry->d_name;
+    if (name[0] == '.' &&
+        (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+      continue;
+    }
+    names->insert(names->end(), name, name + strlen(name) + 1);
+    types->push_back(entry->d_type);
+  }
+  int saved_errno = errno;
+  closedir(dirh);
+  errno = saved_errno;
+  return errno == 0 ? 0 : -1;
+}
+
+int portable_read_dir_entries_with_stats(int dirfd, std::vector<char> *names,
+                                         std::vector<unsigned char> *types,
+                                         std::vector<DirEntryStat> *stats) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int portable_preallocate(int fd, int64_t size) {
+  // posix_fallocate(2) would change the size of the file.
+  errno = ENOSYS;
+  return -1;
+}
+
+ssize_t portable_copy_file_range(int in_fd, int out_fd, size_t len) {
+#if defined(__FreeBSD__) && __FreeBSD_version >= 1300037
+  return copy_file_range(in_fd, nullptr, out_fd, nullptr, len, 0);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+int portable_clone_file(int from_dir_fd, const char *from, int to_dir_fd,
+                        const char *to) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int portable_set_batch_cpu_scheduling(bool batch) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int portable_set_io_nice_level(int io_nice_level) {
+  errno = ENOSYS;
+  return -1;
+}
+
 uint64_t StatEpochMilliseconds(const portable_stat_struct &statbuf,
                                StatTimes t) {
   switch (t) {
@@ -72,6 +144,20 @@ uint64_t StatEpochMilliseconds(const portable_stat_struct &statbuf,
   }
 }
 
+int64_t StatEpochNanoseconds(const portable_stat_struct &statbuf, StatTimes t) {
+  switch (t) {
+    case STAT_ATIME:
+      return statbuf.st_atimespec.tv_sec * 1000000000L +
+             statbuf.st_atimespec.tv_nsec;
+    case STAT_CTIME:
+      return statbuf.st_ctimespec.tv_sec * 1000000000L +
+             statbuf.st_ctimespec.tv_nsec;
+    case STAT_MTIME:
+      return statbuf.st_mtimespec.tv_sec * 1000000000L +
+             statbuf.st_mtimespec.tv_nsec;
+  }
+}
+
 ssize_t portable_getxattr(const char *path, const char *name, void *value,
                           size_t size, bool *attr_not_found) {
 #if defined(HAVE_EXTATTR)
@@ -98,6 +184,18 @@ ssize_t portable_lgetxattr(const char *path, const char *name, void *value,
 #endif
 }
 
+int portable_setxattr(const char *path, const char *name, const void *value,
+                      size_t size) {
+#if defined(HAVE_EXTATTR)
+  ssize_t result =
+      extattr_set_file(path, EXTATTR_NAMESPACE_SYSTEM, name, value, size);
+  return result == -1 ? -1 : 0;
+#else
+  errno = ENOTSUP;
+  return -1;
+#endif
+}
+
 int portable_push_disable_sleep() {
   // Currently not supported.
   // https://wiki.freebsd.org/SuspendResume
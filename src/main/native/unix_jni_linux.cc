@@ -12,14 +12,23 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/xattr.h>
+#include <unistd.h>
 
+#include <functional>
+#include <set>
 #include <string>
+#include <vector>
 
 #include "src/main/native/unix_jni.h"
 
@@ -48,6 +57,169 @@ int portable_fstatat(
   return fstatat64(dirfd, name, statbuf, flags);
 }
 
+int portable_read_dir_entries(int dirfd, std::vector<char> *names,
+                              std::vector<unsigned char> *types) {
+  // The layout of the records that getdents64(2) returns.
+  struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;  // NOLINT
+    unsigned char d_type;
+    char d_name[];
+  };
+  std::vector<char> buf(64 * 1024);
+  for (;;) {
+    long n = syscall(SYS_getdents64, dirfd, buf.data(), buf.size());  // NOLINT
+    if (n == -1 && errno == EINTR) continue;
+    if (n <= 0) {
+      return n;
+    }
+    for (long offset = 0; offset < n;) {  // NOLINT
+      const auto *entry =
+          reinterpret_cast<const linux_dirent64 *>(buf.data() + offset);
+      offset += entry->d_reclen;
+      const char *name = entry->d_name;
+      if (name[0] == '.' &&
+          (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+        continue;
+      }
+      names->insert(names->end(), name, name + strlen(name) + 1);
+      types->push_back(entry->d_type);
+    }
+  }
+}
+
+int portable_read_dir_entries_with_stats(int dirfd, std::vector<char> *names,
+                                         std::vector<unsigned char> *types,
+                                         std::vector<DirEntryStat> *stats) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int portable_preallocate(int fd, int64_t size) {
+  return fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, size);
+}
+
+ssize_t portable_copy_file_range(int in_fd, int out_fd, size_t len) {
+#if defined(SYS_copy_file_range)
+  // Called through syscall(2), as older C libraries lack a wrapper for it.
+  return syscall(SYS_copy_file_range, in_fd, nullptr, out_fd, nullptr, len, 0);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+int portable_clone_file(int from_dir_fd, const char *from, int to_dir_fd,
+                        const char *to) {
+// From linux/fs.h, which conflicts with the C library's headers.
+#if !defined(FICLONE)
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+  int in = openat(from_dir_fd, from, O_RDONLY | O_CLOEXEC);
+  if (in == -1) {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(in, &st) == -1) {
+    int saved_errno = errno;
+    close(in);
+    errno = saved_errno;
+    return -1;
+  }
+  if (!S_ISREG(st.st_mode)) {
+    close(in);
+    errno = ENOTSUP;
+    return -1;
+  }
+  int out = openat(to_dir_fd, to, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                   st.st_mode & 07777);
+  if (out == -1) {
+    int saved_errno = errno;
+    close(in);
+    errno = saved_errno;
+    return -1;
+  }
+  int result = ioctl(out, FICLONE, in);
+  int saved_errno = errno;
+  // The mode of open(2) went through the umask.
+  if (result == 0 && fchmod(out, st.st_mode & 07777) == -1) {
+    result = -1;
+    saved_errno = errno;
+  }
+  close(in);
+  if (close(out) == -1 && result == 0) {
+    result = -1;
+    saved_errno = errno;
+  }
+  if (result == -1) {
+    unlinkat(to_dir_fd, to, 0);
+    // Btrfs, XFS and others clone, the rest reports one of these.
+    if (saved_errno == EOPNOTSUPP || saved_errno == EINVAL ||
+        saved_errno == ENOTTY) {
+      saved_errno = ENOTSUP;
+    }
+    errno = saved_errno;
+  }
+  return result;
+}
+
+// Runs `set(tid)` for every thread of this process. The scheduling
+// attributes are per thread, and threads started while the others are being
+// changed may have inherited the old ones: goes over the threads again until
+// there are no new ones. Returns 0 on success, or -1 with errno set.
+static int ForEachThread(const std::function<int(pid_t)> &set) {
+  std::set<pid_t> done;
+  for (bool changed = true; changed;) {
+    changed = false;
+    DIR *dir = opendir("/proc/self/task");
+    if (dir == nullptr) {
+      return -1;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+      pid_t tid = strtol(entry->d_name, nullptr, 10);
+      if (tid <= 0 || !done.insert(tid).second) {
+        continue;
+      }
+      changed = true;
+      // A thread that has exited since is not an error.
+      if (set(tid) == -1 && errno != ESRCH) {
+        int saved_errno = errno;
+        closedir(dir);
+        errno = saved_errno;
+        return -1;
+      }
+    }
+    closedir(dir);
+  }
+  return 0;
+}
+
+int portable_set_batch_cpu_scheduling(bool batch) {
+  return ForEachThread([batch](pid_t tid) {
+    sched_param param = {};
+    return sched_setscheduler(tid, batch ? SCHED_BATCH : SCHED_OTHER, &param);
+  });
+}
+
+// The encoding of I/O priorities, from linux/ioprio.h.
+static const int kIoprioWhoProcess = 1;
+static const int kIoprioClassShift = 13;
+static const int kIoprioClassBestEffort = 2;
+
+int portable_set_io_nice_level(int io_nice_level) {
+  // Class "none" makes the I/O priority follow the nice value again.
+  const int ioprio =
+      io_nice_level < 0
+          ? 0
+          : (kIoprioClassBestEffort << kIoprioClassShift) | io_nice_level;
+  return ForEachThread([ioprio](pid_t tid) {
+    return static_cast<int>(
+        syscall(SYS_ioprio_set, kIoprioWhoProcess, tid, ioprio));
+  });
+}
+
 uint64_t StatEpochMilliseconds(const portable_stat_struct &statbuf,
                                StatTimes t) {
   switch (t) {
@@ -60,6 +232,17 @@ uint64_t StatEpochMilliseconds(const portable_stat_struct &statbuf,
   }
 }
 
+int64_t StatEpochNanoseconds(const portable_stat_struct &statbuf, StatTimes t) {
+  switch (t) {
+    case STAT_ATIME:
+      return statbuf.st_atim.tv_sec * 1000000000L + statbuf.st_atim.tv_nsec;
+    case STAT_CTIME:
+      return statbuf.st_ctim.tv_sec * 1000000000L + statbuf.st_ctim.tv_nsec;
+    case STAT_MTIME:
+      return statbuf.st_mtim.tv_sec * 1000000000L + statbuf.st_mtim.tv_nsec;
+  }
+}
+
 ssize_t portable_getxattr(const char *path, const char *name, void *value,
                           size_t size, bool *attr_not_found) {
   ssize_t result = ::getxattr(path, name, value, size);
@@ -74,6 +257,11 @@ ssize_t portable_lgetxattr(const char *path, const char *name, void *value,
   return result;
 }
 
+int portable_setxattr(const char *path, const char *name, const void *value,
+                      size_t size) {
+  return ::setxattr(path, name, value, size, 0);
+}
+
 int portable_push_disable_sleep() {
   // Currently not supported.
   return -1;
@@ -88,47 +276,10 @@ void portable_start_suspend_monitoring() {
   // Currently not implemented.
 }
 
-void portable_start_thermal_monitoring() {
-  // Currently not implemented.
-}
-
-int portable_thermal_load() {
-  // Currently not implemented.
-  return 0;
-}
-
-void portable_start_system_load_advisory_monitoring() {
-  // Currently not implemented.
-}
-
-int portable_system_load_advisory() {
-  // Currently not implemented.
-  return 0;
-}
-
-void portable_start_memory_pressure_monitoring() {
-  // Currently not implemented.
-  // https://www.kernel.org/doc/Documentation/cgroup-v1/memory.txt
-}
-
-MemoryPressureLevel portable_memory_pressure() {
-  // Currently not implemented.
-  return MemoryPressureLevelNormal;
-}
-
 void portable_start_disk_space_monitoring() {
   // Currently not implemented.
 }
 
-void portable_start_cpu_speed_monitoring() {
-  // Currently not implemented.
-}
-
-int portable_cpu_speed() {
-  // Currently not implemented.
-  return -1;
-}
-
 extern "C" JNIEXPORT void JNICALL
 Java_com_google_devtools_build_lib_profiler_SystemNetworkStats_getNetIoCountersNative(
     JNIEnv *env, jclass clazz, jobject counters_list) {
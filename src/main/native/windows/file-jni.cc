@@ -21,6 +21,7 @@
 #include <memory>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "src/main/native/jni.h"
 #include "src/main/native/windows/file.h"
@@ -85,6 +86,53 @@ Java_com_google_devtools_build_lib_windows_WindowsFileOperations_nativeGetChange
   return static_cast<jint>(result);
 }
 
+extern "C" JNIEXPORT jint JNICALL
+Java_com_google_devtools_build_lib_windows_WindowsFileOperations_nativeReadDirectory(
+    JNIEnv* env, jclass clazz, jstring path, jobjectArray names_holder,
+    jobjectArray stats_holder, jobjectArray error_msg_holder) {
+  std::wstring wpath(bazel::windows::GetJavaWstring(env, path));
+  std::wstring error;
+  std::vector<bazel::windows::DirectoryEntry> entries;
+  int result = bazel::windows::ReadDirectory(wpath.c_str(), &entries, &error);
+  if (result != bazel::windows::ReadDirectoryResult::kSuccess) {
+    if (!error.empty() && CanReportError(env, error_msg_holder)) {
+      ReportLastError(
+          bazel::windows::MakeErrorMessage(
+              WSTR(__FILE__), __LINE__, L"nativeReadDirectory", wpath, error),
+          env, error_msg_holder);
+    }
+    return static_cast<jint>(result);
+  }
+
+  // Keep the layout of the stats in sync with WindowsFileOperations.
+  jclass string_class = env->FindClass("java/lang/String");
+  jobjectArray names =
+      env->NewObjectArray(entries.size(), string_class, nullptr);
+  jlongArray stats = env->NewLongArray(entries.size() * 5);
+  if (names == nullptr || stats == nullptr) {
+    // An OutOfMemoryError is pending.
+    return bazel::windows::ReadDirectoryResult::kError;
+  }
+  std::vector<jlong> stats_values;
+  stats_values.reserve(entries.size() * 5);
+  for (size_t i = 0; i < entries.size(); i++) {
+    const bazel::windows::DirectoryEntry& entry = entries[i];
+    jstring name = env->NewString(
+        reinterpret_cast<const jchar*>(entry.name.c_str()), entry.name.size());
+    env->SetObjectArrayElement(names, i, name);
+    env->DeleteLocalRef(name);
+    stats_values.push_back(entry.attributes);
+    stats_values.push_back(entry.reparse_tag);
+    stats_values.push_back(entry.size);
+    stats_values.push_back(entry.last_write_time);
+    stats_values.push_back(entry.change_time);
+  }
+  env->SetLongArrayRegion(stats, 0, stats_values.size(), stats_values.data());
+  env->SetObjectArrayElement(names_holder, 0, names);
+  env->SetObjectArrayElement(stats_holder, 0, stats);
+  return static_cast<jint>(result);
+}
+
 extern "C" JNIEXPORT jboolean JNICALL
 Java_com_google_devtools_build_lib_windows_WindowsFileOperations_nativeGetLongPath(
     JNIEnv* env, jclass clazz, jstring path, jobjectArray result_holder,
@@ -167,6 +215,19 @@ Java_com_google_devtools_build_lib_windows_WindowsFileOperations_nativeReadSymli
   return static_cast<jint>(result);
 }
 
+extern "C" JNIEXPORT jint JNICALL
+Java_com_google_devtools_build_lib_windows_WindowsFileOperations_nativeDeleteTreesBelow(
+    JNIEnv* env, jclass clazz, jstring path, jobjectArray error_msg_holder) {
+  std::wstring wpath(bazel::windows::GetJavaWstring(env, path));
+  std::wstring error;
+  int result = bazel::windows::DeleteTreesBelow(wpath, &error);
+  if (result != bazel::windows::DeletePathResult::kSuccess && !error.empty() &&
+      CanReportError(env, error_msg_holder)) {
+    ReportLastError(error, env, error_msg_holder);
+  }
+  return result;
+}
+
 extern "C" JNIEXPORT jint JNICALL
 Java_com_google_devtools_build_lib_windows_WindowsFileOperations_nativeDeletePath(
     JNIEnv* env, jclass clazz, jstring path, jobjectArray error_msg_holder) {
@@ -24,9 +24,12 @@
 #include <winbase.h>
 #include <windows.h>
 
+#include <atomic>
+#include <condition_variable>  // NOLINT
 #include <memory>
-#include <sstream>
+#include <mutex>  // NOLINT
 #include <string>
+#include <thread>  // NOLINT
 #include <vector>
 
 #include "src/main/native/windows/util.h"
@@ -168,12 +171,123 @@ int GetChangeTime(const WCHAR* path, bool follow_reparse_points,
   return GetChangeTimeResult::kSuccess;
 }
 
+int ReadDirectory(const WCHAR* path, std::vector<DirectoryEntry>* result,
+                  wstring* error) {
+  if (!IsAbsoluteNormalizedWindowsPath(path)) {
+    if (error) {
+      *error = MakeErrorMessage(WSTR(__FILE__), __LINE__, L"ReadDirectory",
+                                path, L"expected an absolute Windows path");
+    }
+    return ReadDirectoryResult::kError;
+  }
+
+  AutoHandle handle;
+  handle = CreateFileW(path, FILE_LIST_DIRECTORY,
+                       FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                       nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS,
+                       nullptr);
+  if (!handle.IsValid()) {
+    DWORD err = GetLastError();
+    if (err == ERROR_FILE_NOT_FOUND || err == ERROR_PATH_NOT_FOUND) {
+      return ReadDirectoryResult::kDoesNotExist;
+    } else if (err == ERROR_ACCESS_DENIED) {
+      return ReadDirectoryResult::kAccessDenied;
+    } else if (err == ERROR_DIRECTORY) {
+      return ReadDirectoryResult::kNotADirectory;
+    }
+    if (error) {
+      *error =
+          MakeErrorMessage(WSTR(__FILE__), __LINE__, L"CreateFileW", path, err);
+    }
+    return ReadDirectoryResult::kError;
+  }
+
+  // Each call fills the buffer with as many entries as fit, so a large
+  // buffer takes few calls even for large directories. (64 KiB is also the
+  // most that a query over SMB returns.) FILE_ID_BOTH_DIR_INFO needs 8-byte
+  // alignment.
+  static constexpr size_t kBufferSize = 64 * 1024;
+  std::unique_ptr<LONGLONG[]> buffer(
+      new LONGLONG[kBufferSize / sizeof(LONGLONG)]);
+  FILE_INFO_BY_HANDLE_CLASS info_class = FileIdBothDirectoryRestartInfo;
+  result->clear();
+  while (true) {
+    if (!GetFileInformationByHandleEx(handle, info_class, buffer.get(),
+                                      kBufferSize)) {
+      DWORD err = GetLastError();
+      if (err == ERROR_NO_MORE_FILES) {
+        return ReadDirectoryResult::kSuccess;
+      }
+      FILE_BASIC_INFO info;
+      if (err == ERROR_INVALID_PARAMETER &&
+          GetFileInformationByHandleEx(handle, FileBasicInfo, &info,
+                                       sizeof(info)) &&
+          !(info.FileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        return ReadDirectoryResult::kNotADirectory;
+      }
+      if (error) {
+        *error = MakeErrorMessage(WSTR(__FILE__), __LINE__,
+                                  L"GetFileInformationByHandleEx", path, err);
+      }
+      return ReadDirectoryResult::kError;
+    }
+    info_class = FileIdBothDirectoryInfo;
+
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(buffer.get());
+    while (true) {
+      const FILE_ID_BOTH_DIR_INFO* info =
+          reinterpret_cast<const FILE_ID_BOTH_DIR_INFO*>(p);
+      wstring name(info->FileName, info->FileNameLength / sizeof(WCHAR));
+      if (name != L"." && name != L"..") {
+        // For reparse points, EaSize holds the reparse tag.
+        DWORD reparse_tag =
+            (info->FileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) ? info->EaSize
+                                                                  : 0;
+        result->push_back({std::move(name), info->FileAttributes, reparse_tag,
+                           info->EndOfFile.QuadPart,
+                           info->LastWriteTime.QuadPart,
+                           info->ChangeTime.QuadPart});
+      }
+      if (info->NextEntryOffset == 0) {
+        break;
+      }
+      p += info->NextEntryOffset;
+    }
+  }
+}
+
+namespace {
+
+// The paths that GetLongPath resolved last on this thread. The same few
+// directories are asked for over and over, and the long name of a path that
+// exists only changes if it is renamed.
+struct LongPathCache {
+  static constexpr int kSize = 16;
+  wstring paths[kSize];
+  wstring long_paths[kSize];
+  int next = 0;
+};
+
+thread_local LongPathCache long_path_cache;
+
+}  // namespace
+
 wstring GetLongPath(const WCHAR* path, unique_ptr<WCHAR[]>* result) {
   if (!IsAbsoluteNormalizedWindowsPath(path)) {
     return MakeErrorMessage(WSTR(__FILE__), __LINE__, L"GetLongPath", path,
                             L"expected an absolute Windows path");
   }
 
+  LongPathCache& cache = long_path_cache;
+  for (int i = 0; i < LongPathCache::kSize; ++i) {
+    if (cache.paths[i] == path) {
+      const wstring& long_path = cache.long_paths[i];
+      result->reset(new WCHAR[long_path.size() + 1]);
+      wmemcpy(result->get(), long_path.c_str(), long_path.size() + 1);
+      return L"";
+    }
+  }
+
   std::wstring wpath(AddUncPrefixMaybe(path));
   DWORD size = ::GetLongPathNameW(wpath.c_str(), nullptr, 0);
   if (size == 0) {
@@ -183,6 +297,9 @@ wstring GetLongPath(const WCHAR* path, unique_ptr<WCHAR[]>* result) {
   }
   result->reset(new WCHAR[size]);
   ::GetLongPathNameW(wpath.c_str(), result->get(), size);
+  cache.paths[cache.next] = path;
+  cache.long_paths[cache.next] = result->get();
+  cache.next = (cache.next + 1) % LongPathCache::kSize;
   return L"";
 }
 
@@ -800,89 +917,355 @@ int DeletePath(const wstring& path, wstring* error) {
   return DeletePathResult::kSuccess;
 }
 
-template <typename C>
-std::basic_string<C> NormalizeImpl(const std::basic_string<C>& p) {
-  if (p.empty()) {
-    return p;
+namespace {
+
+// FILE_DISPOSITION_INFO_EX and its flags, which older SDKs don't define.
+struct DispositionInfoEx {
+  ULONG Flags;
+};
+const FILE_INFO_BY_HANDLE_CLASS kFileDispositionInfoEx =
+    static_cast<FILE_INFO_BY_HANDLE_CLASS>(21);
+const ULONG kDispositionDelete = 0x1;
+const ULONG kDispositionPosixSemantics = 0x2;
+const ULONG kDispositionIgnoreReadonlyAttribute = 0x10;
+
+// Deletes the file, link or empty directory at `path`, without following
+// reparse points. With POSIX semantics, the name goes away right when the
+// handle is closed, even if other processes still have the file open, so the
+// parent directory can be removed right after. Falls back to DeletePath where
+// the filesystem doesn't support that (e.g. FAT, or Windows before 10 1809).
+int DeleteEntry(const wstring& path, wstring* error) {
+  AutoHandle handle;
+  handle = CreateFileW(
+      path.c_str(), DELETE,
+      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+      OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OPEN_REPARSE_POINT,
+      nullptr);
+  if (!handle.IsValid()) {
+    DWORD err = GetLastError();
+    if (err == ERROR_FILE_NOT_FOUND || err == ERROR_PATH_NOT_FOUND) {
+      return DeletePathResult::kDoesNotExist;
+    }
+    return DeletePath(path, error);
   }
-  typedef std::basic_string<C> Str;
-  static const Str kDot(1, '.');
-  static const Str kDotDot(2, '.');
-  std::vector<std::pair<typename Str::size_type, typename Str::size_type> >
-      segments;
-  typename Str::size_type seg_start = Str::npos;
-  bool first = true;
-  bool abs = false;
-  bool starts_with_dot = false;
-  for (typename Str::size_type i = HasUncPrefix(p.c_str()) ? 4 : 0;
-       i <= p.size(); ++i) {
-    if (seg_start == Str::npos) {
-      if (i < p.size() && p[i] != '/' && p[i] != '\\') {
-        seg_start = i;
+  DispositionInfoEx info = {kDispositionDelete | kDispositionPosixSemantics |
+                            kDispositionIgnoreReadonlyAttribute};
+  if (SetFileInformationByHandle(handle, kFileDispositionInfoEx, &info,
+                                 sizeof(info))) {
+    return DeletePathResult::kSuccess;
+  }
+  // Close the handle first, or DeletePath cannot delete the file either.
+  handle = INVALID_HANDLE_VALUE;
+  return DeletePath(path, error);
+}
+
+// Deletes the trees below a directory. One thread lists each directory and
+// hands its files out in batches; while there is more work than threads,
+// more threads (up to kMaxThreads) join in. A directory is deleted once
+// everything in it is, by the thread that deletes its last entry.
+class TreeDeleter {
+ public:
+  int Run(const wstring& path, wstring* error);
+
+ private:
+  struct Dir {
+    Dir* parent;
+    wstring path;
+    // The tasks of this directory and the subdirectories in it that are not
+    // done yet, plus one while it is being listed.
+    std::atomic<int> pending{1};
+  };
+
+  // Deletes `files` in `dir`, or lists `dir` if `files` is empty.
+  struct Task {
+    Dir* dir;
+    std::vector<wstring> files;
+  };
+
+  static constexpr size_t kFilesPerTask = 64;
+  static constexpr size_t kMaxThreads = 8;
+
+  void Work();
+  void ListDirectory(Dir* dir);
+  void DeleteFiles(const std::vector<wstring>& files);
+  void Release(Dir* dir);
+  void AddTask(Task task);
+  void Fail(int result, const wstring& path, const wstring& error);
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::vector<Task> tasks_;
+  int busy_ = 0;
+  std::vector<std::thread> threads_;
+
+  std::atomic<bool> failed_{false};
+  int result_ = DeletePathResult::kSuccess;
+  wstring error_;
+};
+
+int TreeDeleter::Run(const wstring& path, wstring* error) {
+  AddTask({new Dir{nullptr, path}, {}});
+  Work();
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+  if (error) {
+    *error = error_;
+  }
+  return result_;
+}
+
+void TreeDeleter::Work() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cond_.wait(lock, [this] { return !tasks_.empty() || busy_ == 0; });
+    if (tasks_.empty()) {
+      return;
+    }
+    Task task = std::move(tasks_.back());
+    tasks_.pop_back();
+    busy_++;
+    lock.unlock();
+
+    if (!failed_) {
+      if (task.files.empty()) {
+        ListDirectory(task.dir);
+      } else {
+        DeleteFiles(task.files);
       }
+    }
+    Release(task.dir);
+
+    lock.lock();
+    if (--busy_ == 0 && tasks_.empty()) {
+      cond_.notify_all();
+    }
+  }
+}
+
+void TreeDeleter::ListDirectory(Dir* dir) {
+  std::vector<DirectoryEntry> entries;
+  wstring error;
+  switch (ReadDirectory(dir->path.c_str(), &entries, &error)) {
+    case ReadDirectoryResult::kSuccess:
+      break;
+    case ReadDirectoryResult::kDoesNotExist:
+      if (dir->parent == nullptr) {
+        Fail(DeletePathResult::kDoesNotExist, dir->path, L"");
+      }
+      return;
+    case ReadDirectoryResult::kNotADirectory:
+      // Nothing below it to delete, like FileSystem#deleteTreesBelow.
+      return;
+    case ReadDirectoryResult::kAccessDenied:
+      Fail(DeletePathResult::kAccessDenied, dir->path, L"");
+      return;
+    default:
+      Fail(DeletePathResult::kError, dir->path, error);
+      return;
+  }
+
+  std::vector<wstring> files;
+  for (DirectoryEntry& entry : entries) {
+    wstring path = dir->path + L"\\" + entry.name;
+    if ((entry.attributes & FILE_ATTRIBUTE_DIRECTORY) &&
+        !(entry.attributes & FILE_ATTRIBUTE_REPARSE_POINT)) {
+      dir->pending++;
+      AddTask({new Dir{dir, std::move(path)}, {}});
     } else {
-      if (i == p.size() || (p[i] == '/' || p[i] == '\\')) {
-        // The current character ends a segment.
-        typename Str::size_type len = i - seg_start;
-        if (first) {
-          first = false;
-          abs = len == 2 &&
-                ((p[seg_start] >= 'A' && p[seg_start] <= 'Z') ||
-                 (p[seg_start] >= 'a' && p[seg_start] <= 'z')) &&
-                p[seg_start + 1] == ':';
-          segments.push_back(std::make_pair(seg_start, len));
-          starts_with_dot = !abs && p.compare(seg_start, len, kDot) == 0;
-        } else {
-          if (p.compare(seg_start, len, kDot) == 0) {
-            if (segments.empty()) {
-              // Retain "." if that is the first (and possibly only segment).
-              segments.push_back(std::make_pair(seg_start, len));
-              starts_with_dot = true;
-            }
-          } else {
-            if (starts_with_dot) {
-              // Delete the existing "." if that was the only path segment.
-              segments.clear();
-              starts_with_dot = false;
-            }
-            if (p.compare(seg_start, len, kDotDot) == 0) {
-              if (segments.empty() ||
-                  p.compare(segments.back().first, segments.back().second,
-                            kDotDot) == 0) {
-                // Preserve ".." if the path is relative and there are only ".."
-                // segment(s) at the front.
-                segments.push_back(std::make_pair(seg_start, len));
-              } else if (!abs || segments.size() > 1) {
-                // Remove the last segment unless the path is already at the
-                // root directory.
-                segments.pop_back();
-              }  // Ignore ".." otherwise.
-            } else {
-              // This is a normal path segment, i.e. neither "." nor ".."
-              segments.push_back(std::make_pair(seg_start, len));
-            }
-          }
-        }
-        // Indicate that there's no segment started.
-        seg_start = Str::npos;
+      // A file, a symlink or a junction, which we delete without following.
+      files.push_back(std::move(path));
+      if (files.size() == kFilesPerTask) {
+        dir->pending++;
+        AddTask({dir, std::move(files)});
+        files.clear();
+      }
+    }
+  }
+  DeleteFiles(files);
+}
+
+void TreeDeleter::DeleteFiles(const std::vector<wstring>& files) {
+  for (const wstring& path : files) {
+    if (failed_) {
+      return;
+    }
+    wstring error;
+    int result = DeleteEntry(path, &error);
+    if (result != DeletePathResult::kSuccess &&
+        result != DeletePathResult::kDoesNotExist) {
+      Fail(result, path, error);
+    }
+  }
+}
+
+void TreeDeleter::Release(Dir* dir) {
+  while (dir != nullptr && --dir->pending == 0) {
+    Dir* parent = dir->parent;
+    // The directory that we delete the trees below stays.
+    if (parent != nullptr && !failed_) {
+      wstring error;
+      int result = DeleteEntry(dir->path, &error);
+      if (result != DeletePathResult::kSuccess &&
+          result != DeletePathResult::kDoesNotExist) {
+        Fail(result, dir->path, error);
       }
     }
+    delete dir;
+    dir = parent;
+  }
+}
+
+void TreeDeleter::AddTask(Task task) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  tasks_.push_back(std::move(task));
+  const size_t threads = threads_.size() + 1;
+  if (tasks_.size() > threads && threads < kMaxThreads &&
+      threads < std::thread::hardware_concurrency()) {
+    threads_.emplace_back(&TreeDeleter::Work, this);
+  }
+  cond_.notify_one();
+}
+
+void TreeDeleter::Fail(int result, const wstring& path, const wstring& error) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (failed_) {
+    return;
+  }
+  failed_ = true;
+  result_ = result;
+  if (!error.empty()) {
+    error_ = error;
+  } else if (result == DeletePathResult::kAccessDenied) {
+    error_ = MakeErrorMessage(WSTR(__FILE__), __LINE__, L"DeleteTreesBelow",
+                              path, L"access is denied");
+  } else if (result == DeletePathResult::kDirectoryNotEmpty) {
+    error_ = MakeErrorMessage(WSTR(__FILE__), __LINE__, L"DeleteTreesBelow",
+                              path, L"directory is not empty");
+  } else {
+    error_ = MakeErrorMessage(WSTR(__FILE__), __LINE__, L"DeleteTreesBelow",
+                              path, L"path does not exist");
+  }
+}
+
+}  // namespace
+
+int DeleteTreesBelow(const wstring& path, wstring* error) {
+  if (!IsAbsoluteNormalizedWindowsPath(path)) {
+    if (error) {
+      *error = MakeErrorMessage(WSTR(__FILE__), __LINE__, L"DeleteTreesBelow",
+                                path, L"expected an absolute Windows path");
+    }
+    return DeletePathResult::kError;
   }
-  std::basic_stringstream<C> res;
-  first = true;
-  for (const auto& i : segments) {
-    Str s = p.substr(i.first, i.second);
+  return TreeDeleter().Run(AddUncPrefixMaybe(path), error);
+}
+
+template <typename C>
+static bool IsSeparator(C c) {
+  return c == '/' || c == '\\';
+}
+
+template <typename C>
+static size_t NormalizeToImpl(const C* p, size_t len, C* out) {
+  // `out` holds the segments so far, joined by "\", so the last one starts
+  // after the last "\" in it and there is no list of them to allocate.
+  size_t n = 0;
+  size_t count = 0;
+  bool first = true;
+  bool abs = false;
+  bool starts_with_dot = false;
+  auto append = [&](const C* seg, size_t seg_len) {
+    if (count > 0) {
+      out[n++] = '\\';
+    }
+    // Copies forward: where `out` is `p`, it never overtakes the input.
+    for (size_t j = 0; j < seg_len; ++j) {
+      out[n++] = seg[j];
+    }
+    ++count;
+  };
+  size_t i = (len >= 4 && HasUncPrefix(p)) ? 4 : 0;
+  while (true) {
+    while (i < len && IsSeparator(p[i])) {
+      ++i;
+    }
+    if (i == len) {
+      break;
+    }
+    const C* seg = p + i;
+    while (i < len && !IsSeparator(p[i])) {
+      ++i;
+    }
+    const size_t seg_len = (p + i) - seg;
+    const bool is_dot = seg_len == 1 && seg[0] == '.';
     if (first) {
       first = false;
+      abs = seg_len == 2 &&
+            ((seg[0] >= 'A' && seg[0] <= 'Z') ||
+             (seg[0] >= 'a' && seg[0] <= 'z')) &&
+            seg[1] == ':';
+      append(seg, seg_len);
+      starts_with_dot = !abs && is_dot;
+    } else if (is_dot) {
+      if (count == 0) {
+        // Retain "." if that is the first (and possibly only segment).
+        append(seg, seg_len);
+        starts_with_dot = true;
+      }
     } else {
-      res << '\\';
+      if (starts_with_dot) {
+        // Delete the existing "." if that was the only path segment.
+        n = 0;
+        count = 0;
+        starts_with_dot = false;
+      }
+      if (seg_len == 2 && seg[0] == '.' && seg[1] == '.') {
+        size_t last = n;
+        while (last > 0 && out[last - 1] != '\\') {
+          --last;
+        }
+        if (count == 0 ||
+            (n - last == 2 && out[last] == '.' && out[last + 1] == '.')) {
+          // Preserve ".." if the path is relative and there are only ".."
+          // segment(s) at the front.
+          append(seg, seg_len);
+        } else if (!abs || count > 1) {
+          // Remove the last segment unless the path is already at the root
+          // directory.
+          n = last == 0 ? 0 : last - 1;
+          --count;
+        }  // Ignore ".." otherwise.
+      } else {
+        // This is a normal path segment, i.e. neither "." nor ".."
+        append(seg, seg_len);
+      }
     }
-    res << s;
   }
-  if (abs && segments.size() == 1) {
-    res << '\\';
+  if (abs && count == 1) {
+    out[n++] = '\\';
+  }
+  out[n] = 0;
+  return n;
+}
+
+template <typename C>
+std::basic_string<C> NormalizeImpl(const std::basic_string<C>& p) {
+  if (p.empty()) {
+    return p;
   }
-  return res.str();
+  // The only allocation: the result is never longer than `p` and a "\".
+  std::basic_string<C> result(p.size() + 1, 0);
+  result.resize(NormalizeToImpl(p.c_str(), p.size(), &result[0]));
+  return result;
+}
+
+size_t NormalizeTo(const char* p, size_t len, char* out) {
+  return NormalizeToImpl(p, len, out);
+}
+
+size_t NormalizeTo(const wchar_t* p, size_t len, wchar_t* out) {
+  return NormalizeToImpl(p, len, out);
 }
 
 std::string Normalize(const std::string& p) { return NormalizeImpl(p); }
@@ -26,6 +26,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace bazel {
 namespace windows {
@@ -92,6 +93,29 @@ struct GetChangeTimeResult {
   };
 };
 
+// Keep in sync with j.c.g.devtools.build.lib.windows.WindowsFileOperations
+struct ReadDirectoryResult {
+  enum {
+    kSuccess = 0,
+    kError = 1,
+    kDoesNotExist = 2,
+    kAccessDenied = 3,
+    kNotADirectory = 4,
+  };
+};
+
+// An entry of a directory, as returned by ReadDirectory.
+struct DirectoryEntry {
+  wstring name;
+  DWORD attributes;
+  // The reparse tag if `attributes` has FILE_ATTRIBUTE_REPARSE_POINT, else 0.
+  DWORD reparse_tag;
+  int64_t size;
+  // FILETIMEs, like GetChangeTime returns.
+  int64_t last_write_time;
+  int64_t change_time;
+};
+
 // Keep in sync with j.c.g.devtools.build.lib.windows.WindowsFileOperations
 struct DeletePathResult {
   enum {
@@ -153,6 +177,17 @@ int IsSymlinkOrJunction(const WCHAR* path, bool* result, wstring* error);
 int GetChangeTime(const WCHAR* path, bool follow_reparse_points,
                   int64_t* result, wstring* error);
 
+// Lists the entries of the directory `path` (other than "." and ".."), along
+// with their attributes, sizes and times, without opening any of them.
+//
+// `path` should be an absolute, normalized, Windows-style path, with "\\?\"
+// prefix if it's longer than MAX_PATH. Reparse points in `path` are followed.
+// Returns a value from `ReadDirectoryResult`. When it returns
+// `ReadDirectoryResult::kError` and `error` is non-null, `error` receives an
+// error message.
+int ReadDirectory(const WCHAR* path, std::vector<DirectoryEntry>* result,
+                  wstring* error);
+
 // Computes the long version of `path` if it has any 8dot3 style components.
 // Returns the empty string upon success, or a human-readable error message upon
 // failure.
@@ -160,6 +195,8 @@ int GetChangeTime(const WCHAR* path, bool follow_reparse_points,
 // prefix if it's longer than MAX_PATH. The result will have a "\\?\" prefix if
 // and only if `path` had one as well. (It's the caller's responsibility to keep
 // or remove this prefix.)
+// The last few results are cached per thread, so a path that was deleted or
+// renamed since it was last resolved may still resolve.
 // TODO(laszlocsomor): update GetLongPath so it succeeds even if the path does
 // not (fully) exist.
 wstring GetLongPath(const WCHAR* path, unique_ptr<WCHAR[]>* result);
@@ -205,6 +242,14 @@ int ReadSymlinkOrJunction(const wstring& path, wstring* result, wstring* error);
 // function writes an error message into it.
 int DeletePath(const wstring& path, wstring* error);
 
+// Deletes everything below the directory `path`, but not `path` itself,
+// using several threads for large trees. Junctions and symlinks below `path`
+// are deleted, not followed. Does nothing if `path` is not a directory.
+// Returns one of the DeletePathResult constants like DeletePath, and writes
+// an error message that names the offending path into `error` (if not null)
+// unless it returns DeletePathResult::kSuccess.
+int DeleteTreesBelow(const wstring& path, wstring* error);
+
 // Returns a normalized form of the input `path`.
 //
 // Normalization:
@@ -241,6 +286,12 @@ int DeletePath(const wstring& path, wstring* error);
 std::string Normalize(const std::string& p);
 std::wstring Normalize(const std::wstring& p);
 
+// Like Normalize, in one pass that allocates nothing: writes the result and a
+// terminating null into `out`, which must have room for `len` + 2 characters
+// and may be `p` itself. Returns the length of the result.
+size_t NormalizeTo(const char* p, size_t len, char* out);
+size_t NormalizeTo(const wchar_t* p, size_t len, wchar_t* out);
+
 bool GetCwd(std::wstring* result, DWORD* err_code);
 
 }  // namespace windows
@@ -20,9 +20,12 @@
 
 #include <windows.h>
 #include <VersionHelpers.h>
+#include <psapi.h>
 
 #include <memory>
+#include <mutex>  // NOLINT
 #include <sstream>
+#include <vector>
 
 namespace bazel {
 namespace windows {
@@ -34,16 +37,124 @@ static std::wstring ToString(const T& e) {
   return s.str();
 }
 
-static bool DupeHandle(HANDLE h, AutoHandle* out, std::wstring* error) {
-  HANDLE dup;
-  if (!DuplicateHandle(GetCurrentProcess(), h, GetCurrentProcess(), &dup, 0,
-                       TRUE, DUPLICATE_SAME_ACCESS)) {
-    DWORD err = GetLastError();
-    *error =
-        MakeErrorMessage(WSTR(__FILE__), __LINE__, L"DupeHandle", L"", err);
+// Job objects of processes that have exited, with the I/O completion ports
+// associated with them. Creating and configuring a job and a port for every
+// subprocess costs several system calls, so WaitFor() returns them here once
+// the job is empty and the next Create() reuses them.
+struct PooledJob {
+  HANDLE job;
+  HANDLE ioport;
+};
+
+static constexpr size_t kMaxPooledJobs = 16;
+
+static std::mutex* PoolMutex() {
+  static std::mutex* mu = new std::mutex();
+  return mu;
+}
+
+static std::vector<PooledJob>* Pool() {
+  static std::vector<PooledJob>* pool = new std::vector<PooledJob>();
+  return pool;
+}
+
+static bool TakePooledJob(AutoHandle* job, AutoHandle* ioport) {
+  PooledJob pooled;
+  {
+    std::lock_guard<std::mutex> lock(*PoolMutex());
+    if (Pool()->empty()) {
+      return false;
+    }
+    pooled = Pool()->back();
+    Pool()->pop_back();
+  }
+  // Drop any notifications about the job's previous processes that were
+  // posted after JOB_OBJECT_MSG_ACTIVE_PROCESS_ZERO, so that they don't end
+  // the next WaitFor() early.
+  DWORD code;
+  ULONG_PTR key;
+  LPOVERLAPPED overlapped;
+  while (GetQueuedCompletionStatus(pooled.ioport, &code, &key, &overlapped,
+                                   0)) {
+    // Stale notification.
+  }
+  *job = pooled.job;
+  *ioport = pooled.ioport;
+  return true;
+}
+
+static void ReturnJobToPool(AutoHandle* job, AutoHandle* ioport) {
+  std::lock_guard<std::mutex> lock(*PoolMutex());
+  if (Pool()->size() < kMaxPooledJobs) {
+    Pool()->push_back({job->Release(), ioport->Release()});
+  }
+}
+
+// Reads what the job has accounted for so far. The memory peaks are the
+// highest since the job was created.
+static bool QueryJobUsage(HANDLE job,
+                          WaitableProcess::ResourceUsage* result) {
+  JOBOBJECT_BASIC_AND_IO_ACCOUNTING_INFORMATION accounting;
+  JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits;
+  if (!QueryInformationJobObject(job, JobObjectBasicAndIoAccountingInformation,
+                                 &accounting, sizeof(accounting), nullptr) ||
+      !QueryInformationJobObject(job, JobObjectExtendedLimitInformation,
+                                 &limits, sizeof(limits), nullptr)) {
+    return false;
+  }
+  // The times are in 100-nanosecond ticks.
+  result->user_time_usec = accounting.BasicInfo.TotalUserTime.QuadPart / 10;
+  result->kernel_time_usec = accounting.BasicInfo.TotalKernelTime.QuadPart / 10;
+  result->read_operations = accounting.IoInfo.ReadOperationCount;
+  result->write_operations = accounting.IoInfo.WriteOperationCount;
+  result->read_bytes = accounting.IoInfo.ReadTransferCount;
+  result->write_bytes = accounting.IoInfo.WriteTransferCount;
+  result->peak_process_memory = limits.PeakProcessMemoryUsed;
+  result->peak_job_memory = limits.PeakJobMemoryUsed;
+  return true;
+}
+
+static bool CreateJob(const std::wstring& argv0, AutoHandle* job,
+                      AutoHandle* ioport, std::wstring* error) {
+  // MDSN says that the default for job objects is that breakaway is not
+  // allowed. Thus, we don't need to do any more setup here.
+  *job = CreateJobObject(nullptr, nullptr);
+  if (!job->IsValid()) {
+    DWORD err_code = GetLastError();
+    *error = MakeErrorMessage(WSTR(__FILE__), __LINE__,
+                              L"WaitableProcess::Create", argv0, err_code);
+    return false;
+  }
+
+  JOBOBJECT_EXTENDED_LIMIT_INFORMATION job_info = {0};
+  job_info.BasicLimitInformation.LimitFlags =
+      JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+  if (!SetInformationJobObject(*job, JobObjectExtendedLimitInformation,
+                               &job_info, sizeof(job_info))) {
+    DWORD err_code = GetLastError();
+    *error = MakeErrorMessage(WSTR(__FILE__), __LINE__,
+                              L"WaitableProcess::Create", argv0, err_code);
+    return false;
+  }
+
+  *ioport = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1);
+  if (!ioport->IsValid()) {
+    DWORD err_code = GetLastError();
+    *error = MakeErrorMessage(WSTR(__FILE__), __LINE__,
+                              L"WaitableProcess::Create", argv0, err_code);
+    return false;
+  }
+  JOBOBJECT_ASSOCIATE_COMPLETION_PORT port;
+  port.CompletionKey = *job;
+  port.CompletionPort = *ioport;
+  if (!SetInformationJobObject(*job,
+                               JobObjectAssociateCompletionPortInformation,
+                               &port, sizeof(port))) {
+    DWORD err_code = GetLastError();
+    *error = MakeErrorMessage(WSTR(__FILE__), __LINE__,
+                              L"WaitableProcess::Create", argv0, err_code);
     return false;
   }
-  *out = dup;
   return true;
 }
 
@@ -103,45 +214,12 @@ bool WaitableProcess::Create(const std::wstring& argv0,
       new WCHAR[commandline.size() + 1]);
   wcsncpy(mutable_commandline.get(), commandline.c_str(),
           commandline.size() + 1);
-  // MDSN says that the default for job objects is that breakaway is not
-  // allowed. Thus, we don't need to do any more setup here.
-  job_ = CreateJobObject(nullptr, nullptr);
-  if (!job_.IsValid()) {
-    DWORD err_code = GetLastError();
-    *error = MakeErrorMessage(WSTR(__FILE__), __LINE__,
-                              L"WaitableProcess::Create", argv0, err_code);
-    return false;
-  }
-
-  JOBOBJECT_EXTENDED_LIMIT_INFORMATION job_info = {0};
-  job_info.BasicLimitInformation.LimitFlags =
-      JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
-  if (!SetInformationJobObject(job_, JobObjectExtendedLimitInformation,
-                               &job_info, sizeof(job_info))) {
-    DWORD err_code = GetLastError();
-    *error = MakeErrorMessage(WSTR(__FILE__), __LINE__,
-                              L"WaitableProcess::Create", argv0, err_code);
-    return false;
-  }
-
-  ioport_ = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1);
-  if (!ioport_.IsValid()) {
-    DWORD err_code = GetLastError();
-    *error = MakeErrorMessage(WSTR(__FILE__), __LINE__,
-                              L"WaitableProcess::Create", argv0, err_code);
-    return false;
-  }
-  JOBOBJECT_ASSOCIATE_COMPLETION_PORT port;
-  port.CompletionKey = job_;
-  port.CompletionPort = ioport_;
-  if (!SetInformationJobObject(job_,
-                               JobObjectAssociateCompletionPortInformation,
-                               &port, sizeof(port))) {
-    DWORD err_code = GetLastError();
-    *error = MakeErrorMessage(WSTR(__FILE__), __LINE__,
-                              L"WaitableProcess::Create", argv0, err_code);
+  const bool pooled = TakePooledJob(&job_, &ioport_);
+  if (!pooled && !CreateJob(argv0, &job_, &ioport_, error)) {
     return false;
   }
+  usage_ = ResourceUsage();
+  usage_known_ = !pooled || QueryJobUsage(job_, &usage_);
 
   std::unique_ptr<AutoAttributeList> attr_list;
   if (!AutoAttributeList::Create(stdin_process, stdout_process, stderr_process,
@@ -289,13 +367,20 @@ int WaitableProcess::WaitFor(int64_t timeout_msec,
     DWORD CompletionCode;
     ULONG_PTR CompletionKey;
     LPOVERLAPPED Overlapped;
-    while (GetQueuedCompletionStatus(ioport_, &CompletionCode,
-                                     &CompletionKey, &Overlapped, INFINITE) &&
-           !((HANDLE)CompletionKey == (HANDLE)job_ &&
-             CompletionCode == JOB_OBJECT_MSG_ACTIVE_PROCESS_ZERO)) {
-      // Still waiting...
+    bool empty = false;
+    while (!empty &&
+           GetQueuedCompletionStatus(ioport_, &CompletionCode, &CompletionKey,
+                                     &Overlapped, INFINITE)) {
+      empty = (HANDLE)CompletionKey == (HANDLE)job_ &&
+              CompletionCode == JOB_OBJECT_MSG_ACTIVE_PROCESS_ZERO;
     }
 
+    CollectResourceUsage();
+
+    // Once the job is empty, the next process can use it.
+    if (empty) {
+      ReturnJobToPool(&job_, &ioport_);
+    }
     job_ = INVALID_HANDLE_VALUE;
     ioport_ = INVALID_HANDLE_VALUE;
   }
@@ -311,6 +396,38 @@ int WaitableProcess::WaitFor(int64_t timeout_msec,
   return result;
 }
 
+void WaitableProcess::CollectResourceUsage() {
+  ResourceUsage total;
+  if (!usage_known_ || !QueryJobUsage(job_, &total)) {
+    usage_known_ = false;
+    return;
+  }
+  const ResourceUsage& before = usage_;
+  ResourceUsage usage;
+  usage.user_time_usec = total.user_time_usec - before.user_time_usec;
+  usage.kernel_time_usec = total.kernel_time_usec - before.kernel_time_usec;
+  usage.read_operations = total.read_operations - before.read_operations;
+  usage.write_operations = total.write_operations - before.write_operations;
+  usage.read_bytes = total.read_bytes - before.read_bytes;
+  usage.write_bytes = total.write_bytes - before.write_bytes;
+
+  // The peaks of a pooled job cannot be reset. If this process didn't raise
+  // them, use its own peak as the best lower bound we have.
+  PROCESS_MEMORY_COUNTERS counters;
+  uint64_t own_peak = 0;
+  if (K32GetProcessMemoryInfo(process_, &counters, sizeof(counters))) {
+    own_peak = counters.PeakPagefileUsage;
+  }
+  usage.peak_process_memory =
+      total.peak_process_memory > before.peak_process_memory
+          ? total.peak_process_memory
+          : own_peak;
+  usage.peak_job_memory = total.peak_job_memory > before.peak_job_memory
+                              ? total.peak_job_memory
+                              : usage.peak_process_memory;
+  usage_ = usage;
+}
+
 int WaitableProcess::GetExitCode(std::wstring* error) {
   if (exit_code_ == STILL_ACTIVE) {
     if (!GetExitCodeProcess(process_, &exit_code_)) {
@@ -37,7 +37,23 @@ class WaitableProcess {
     kWaitError = 2,
   };
 
-  WaitableProcess() : pid_(0), exit_code_(STILL_ACTIVE) {}
+  // What the process and its subprocesses used, as their job object accounts
+  // for it. CPU times are in microseconds, memory sizes in bytes.
+  struct ResourceUsage {
+    int64_t user_time_usec;
+    int64_t kernel_time_usec;
+    uint64_t read_operations;
+    uint64_t write_operations;
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+    // Peak commit charge of the process that used the most, and of all of
+    // them together.
+    uint64_t peak_process_memory;
+    uint64_t peak_job_memory;
+  };
+
+  WaitableProcess()
+      : pid_(0), exit_code_(STILL_ACTIVE), usage_(), usage_known_(false) {}
 
   bool Create(const std::wstring& argv0, const std::wstring& argv_rest,
               void* env, const std::wstring& wcwd, std::wstring* error);
@@ -56,6 +72,17 @@ class WaitableProcess {
 
   DWORD GetPid() const { return pid_; }
 
+  // Returns false if the resource usage isn't known, because WaitFor() hasn't
+  // returned yet or the job object couldn't be queried.
+  bool GetResourceUsage(ResourceUsage* result) const {
+    // WaitFor() gives up the job once the process has exited.
+    if (!usage_known_ || job_.IsValid()) {
+      return false;
+    }
+    *result = usage_;
+    return true;
+  }
+
  private:
   bool Create(const std::wstring& argv0, const std::wstring& argv_rest,
               void* env, const std::wstring& wcwd, HANDLE stdin_process,
@@ -63,8 +90,15 @@ class WaitableProcess {
               LARGE_INTEGER* opt_out_start_time, bool create_window,
               bool handle_signals, std::wstring* error);
 
+  void CollectResourceUsage();
+
   AutoHandle process_, job_, ioport_;
   DWORD pid_, exit_code_;
+  // Until WaitFor() returns, `usage_` is what the job had accounted for
+  // before this process started (a job from the pool still counts its
+  // previous processes); afterwards it's the usage of this process.
+  ResourceUsage usage_;
+  bool usage_known_;
 };
 
 // Escape a command line argument using Windows escaping syntax.
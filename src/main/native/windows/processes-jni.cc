@@ -21,10 +21,15 @@
 #include <stdint.h>
 #include <wchar.h>
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>              // NOLINT
+#include <condition_variable>  // NOLINT
 #include <memory>
+#include <mutex>  // NOLINT
 #include <sstream>
 #include <string>
+#include <thread>       // NOLINT
 #include <type_traits>  // static_assert
 
 #include "src/main/native/jni.h"
@@ -78,91 +83,151 @@ class JavaByteArray {
   jbyte* ptr_;
 };
 
+// Creates a pipe whose reading end supports overlapped I/O, which anonymous
+// pipes don't. Only the writing end is inheritable.
+static bool CreateOverlappedPipe(SECURITY_ATTRIBUTES* write_sa,
+                                 const std::wstring& wpath, HANDLE* read,
+                                 bazel::windows::AutoHandle* write,
+                                 std::wstring* error) {
+  static LONG counter = 0;
+
+  std::wstringstream name;
+  name << L"\\\\.\\pipe\\bazel-process-" << GetCurrentProcessId() << L"-"
+       << InterlockedIncrement(&counter);
+  bazel::windows::AutoHandle read_h(CreateNamedPipeW(
+      name.str().c_str(),
+      PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED |
+          FILE_FLAG_FIRST_PIPE_INSTANCE,
+      PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT |
+          PIPE_REJECT_REMOTE_CLIENTS,
+      1, 0, PIPE_SIZE, 0, nullptr));
+  if (!read_h.IsValid()) {
+    DWORD err_code = GetLastError();
+    *error = bazel::windows::MakeErrorMessage(
+        WSTR(__FILE__), __LINE__, L"nativeCreateProcess", wpath, err_code);
+    return false;
+  }
+
+  *write = CreateFileW(name.str().c_str(), GENERIC_WRITE, 0, write_sa,
+                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (!write->IsValid()) {
+    DWORD err_code = GetLastError();
+    *error = bazel::windows::MakeErrorMessage(
+        WSTR(__FILE__), __LINE__, L"nativeCreateProcess", wpath, err_code);
+    return false;
+  }
+  *read = read_h.Release();
+  return true;
+}
+
+// Reads the stdout or stderr pipe of a process.
+//
+// A background thread drains the pipe into a buffer as soon as the process
+// writes to it, so that Java gets everything written so far in one call
+// instead of one pipe buffer at a time, and so that the process doesn't block
+// on the pipe while Java is busy with other streams.
 class NativeOutputStream {
  public:
   NativeOutputStream()
-      : handle_(INVALID_HANDLE_VALUE), error_(L""), closed_(false) {}
+      : handle_(INVALID_HANDLE_VALUE),
+        error_(L""),
+        closed_(false),
+        eof_(false),
+        reader_done_(false),
+        read_offset_(0) {}
 
   void Close() {
+    std::unique_lock<std::mutex> lock(mutex_);
     closed_.store(true);
+    changed_.notify_all();
     if (handle_ == INVALID_HANDLE_VALUE) {
       return;
     }
 
-    // CancelIoEx only cancels I/O operations in the current process.
-    // https://msdn.microsoft.com/en-us/library/windows/desktop/aa363792(v=vs.85).aspx
-    //
-    // Therefore if this process bequested `handle_` to a child process, we
-    // cannot cancel I/O in the child process.
-    CancelIoEx(handle_, nullptr);
+    if (reader_.joinable()) {
+      // The read may not have been started when CancelIoEx runs, so keep
+      // cancelling until the reader notices that the stream is closed.
+      while (!reader_done_) {
+        CancelIoEx(handle_, nullptr);
+        changed_.wait_for(lock, std::chrono::milliseconds(10));
+      }
+      lock.unlock();
+      reader_.join();
+    }
     CloseHandle(handle_);
     handle_ = INVALID_HANDLE_VALUE;
   }
 
   void SetHandle(HANDLE handle) { handle_ = handle; }
 
+  // Starts draining the pipe. Must be called once the process has been
+  // created, after SetHandle().
+  void StartReader() {
+    if (handle_ != INVALID_HANDLE_VALUE) {
+      reader_ = std::thread([this]() { ReaderMain(); });
+    }
+  }
+
   jint StreamBytesAvailable(JNIEnv* env) {
-    if (closed_.load() || handle_ == INVALID_HANDLE_VALUE) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_.load() || !reader_.joinable()) {
       error_ = L"";
       return 0;
     }
-
-    DWORD avail = 0;
-    if (!::PeekNamedPipe(handle_, nullptr, 0, nullptr, &avail, nullptr)) {
-      // Check if either the other end closed the pipe or we did it with
-      // NativeOutputStream.Close() . In the latter case, we'll get a "system
-      // call interrupted" error.
-      if (GetLastError() == ERROR_BROKEN_PIPE || closed_.load()) {
-        error_ = L"";
-        return 0;
-      } else {
-        DWORD err_code = GetLastError();
-        error_ = bazel::windows::MakeErrorMessage(WSTR(__FILE__), __LINE__,
-                                                  L"nativeStreamBytesAvailable",
-                                                  L"", err_code);
-        return -1;
-      }
-    } else {
-      error_ = L"";
+    const size_t avail = buffer_.size() - read_offset_;
+    if (avail == 0 && !read_error_.empty()) {
+      error_ = read_error_;
+      return -1;
     }
-    return avail;
+    error_ = L"";
+    return static_cast<jint>(avail);
   }
 
   jint ReadStream(JNIEnv* env, jbyteArray java_bytes, jint offset,
                   jint length) {
-    JavaByteArray bytes(env, java_bytes);
-    if (offset < 0 || length <= 0 || offset > bytes.size() - length) {
+    const jsize size = java_bytes != nullptr ? env->GetArrayLength(java_bytes)
+                                             : 0;
+    if (offset < 0 || length <= 0 || offset > size - length) {
       error_ = bazel::windows::MakeErrorMessage(WSTR(__FILE__), __LINE__,
                                                 L"nativeReadStream", L"",
                                                 L"Array index out of bounds");
       return -1;
     }
 
-    if (handle_ == INVALID_HANDLE_VALUE || closed_.load()) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!reader_.joinable()) {
       error_ = L"";
       return 0;
     }
-
-    DWORD bytes_read;
-    if (!::ReadFile(handle_, bytes.ptr() + offset, length, &bytes_read,
-                    nullptr)) {
-      // Check if either the other end closed the pipe or we did it with
-      // NativeOutputStream.Close() . In the latter case, we'll get a "system
-      // call interrupted" error.
-      if (GetLastError() == ERROR_BROKEN_PIPE || closed_.load()) {
-        // End of file.
-        error_ = L"";
-        bytes_read = 0;
-      } else {
-        DWORD err_code = GetLastError();
-        error_ = bazel::windows::MakeErrorMessage(
-            WSTR(__FILE__), __LINE__, L"nativeReadStream", L"", err_code);
-        bytes_read = -1;
-      }
-    } else {
+    changed_.wait(lock, [this]() {
+      return closed_.load() || eof_ || buffer_.size() > read_offset_;
+    });
+    if (closed_.load()) {
       error_ = L"";
+      return 0;
+    }
+    const size_t avail = buffer_.size() - read_offset_;
+    if (avail == 0) {
+      // End of file.
+      error_ = read_error_;
+      return read_error_.empty() ? 0 : -1;
     }
 
+    const jint bytes_read =
+        static_cast<jint>(std::min(avail, static_cast<size_t>(length)));
+    env->SetByteArrayRegion(
+        java_bytes, offset, bytes_read,
+        reinterpret_cast<const jbyte*>(buffer_.data() + read_offset_));
+    read_offset_ += bytes_read;
+    if (read_offset_ == buffer_.size()) {
+      buffer_.clear();
+      read_offset_ = 0;
+    } else if (read_offset_ >= buffer_.size() / 2) {
+      buffer_.erase(0, read_offset_);
+      read_offset_ = 0;
+    }
+    changed_.notify_all();
+    error_ = L"";
     return bytes_read;
   }
 
@@ -175,9 +240,80 @@ class NativeOutputStream {
   }
 
  private:
+  // The reader stops reading once this much is waiting for Java, so that a
+  // stream that is never read doesn't grow without bounds.
+  static constexpr size_t kMaxBufferedBytes = 16 * PIPE_SIZE;
+
+  void ReaderMain() {
+    std::unique_ptr<char[]> chunk(new char[PIPE_SIZE]);
+    bazel::windows::AutoHandle event(CreateEvent(nullptr, TRUE, FALSE,
+                                                 nullptr));
+    std::wstring error;
+    if (!event.IsValid()) {
+      DWORD err_code = GetLastError();
+      error = bazel::windows::MakeErrorMessage(
+          WSTR(__FILE__), __LINE__, L"nativeReadStream", L"", err_code);
+    }
+    while (error.empty()) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [this]() {
+          return closed_.load() ||
+                 buffer_.size() - read_offset_ < kMaxBufferedBytes;
+        });
+        if (closed_.load()) {
+          break;
+        }
+      }
+
+      OVERLAPPED overlapped = {0};
+      overlapped.hEvent = event;
+      DWORD bytes_read = 0;
+      DWORD err_code = ERROR_SUCCESS;
+      if (!::ReadFile(handle_, chunk.get(), PIPE_SIZE, nullptr, &overlapped) &&
+          GetLastError() != ERROR_IO_PENDING) {
+        err_code = GetLastError();
+      } else if (!GetOverlappedResult(handle_, &overlapped, &bytes_read,
+                                      TRUE)) {
+        err_code = GetLastError();
+      }
+      if (err_code != ERROR_SUCCESS) {
+        // Check if either the other end closed the pipe or we did it with
+        // NativeOutputStream.Close() . In the latter case, we'll get an
+        // "operation aborted" error.
+        if (err_code != ERROR_BROKEN_PIPE && !closed_.load()) {
+          error = bazel::windows::MakeErrorMessage(
+              WSTR(__FILE__), __LINE__, L"nativeReadStream", L"", err_code);
+        }
+        break;
+      }
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      buffer_.append(chunk.get(), bytes_read);
+      changed_.notify_all();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    read_error_ = error;
+    eof_ = true;
+    reader_done_ = true;
+    changed_.notify_all();
+  }
+
   HANDLE handle_;
   std::wstring error_;
   std::atomic<bool> closed_;
+
+  // Guards the members below, which the reader thread shares with Java.
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::thread reader_;
+  bool eof_;
+  bool reader_done_;
+  std::wstring read_error_;
+  // The bytes read from the pipe; Java has consumed the first read_offset_.
+  std::string buffer_;
+  size_t read_offset_;
 };
 
 class NativeProcess {
@@ -292,22 +428,12 @@ class NativeProcess {
         return false;
       }
     } else {
-      HANDLE pipe_read_h, pipe_write_h;
-      if (!CreatePipe(&pipe_read_h, &pipe_write_h, &sa, PIPE_SIZE)) {
-        DWORD err_code = GetLastError();
-        error_ = bazel::windows::MakeErrorMessage(
-            WSTR(__FILE__), __LINE__, L"nativeCreateProcess", wpath, err_code);
+      HANDLE pipe_read_h;
+      if (!CreateOverlappedPipe(&sa, wpath, &pipe_read_h, &stdout_process,
+                                &error_)) {
         return false;
       }
       stdout_.SetHandle(pipe_read_h);
-      stdout_process = pipe_write_h;
-      // "Our" end of the pipe must not be inherited by the child process
-      if (!SetHandleInformation(pipe_read_h, HANDLE_FLAG_INHERIT, 0)) {
-        DWORD err_code = GetLastError();
-        error_ = bazel::windows::MakeErrorMessage(
-            WSTR(__FILE__), __LINE__, L"nativeCreateProcess", wpath, err_code);
-        return false;
-      }
     }
 
     if (stderr_same_handle_as_stdout) {
@@ -353,27 +479,22 @@ class NativeProcess {
         return false;
       }
     } else {
-      HANDLE pipe_read_h, pipe_write_h;
-      if (!CreatePipe(&pipe_read_h, &pipe_write_h, &sa, PIPE_SIZE)) {
-        DWORD err_code = GetLastError();
-        error_ = bazel::windows::MakeErrorMessage(
-            WSTR(__FILE__), __LINE__, L"nativeCreateProcess", wpath, err_code);
+      HANDLE pipe_read_h;
+      if (!CreateOverlappedPipe(&sa, wpath, &pipe_read_h, &stderr_process,
+                                &error_)) {
         return false;
       }
       stderr_.SetHandle(pipe_read_h);
-      stderr_process = pipe_write_h;
-      // "Our" end of the pipe must not be inherited by the child process
-      if (!SetHandleInformation(pipe_read_h, HANDLE_FLAG_INHERIT, 0)) {
-        DWORD err_code = GetLastError();
-        error_ = bazel::windows::MakeErrorMessage(
-            WSTR(__FILE__), __LINE__, L"nativeCreateProcess", wpath, err_code);
-        return false;
-      }
     }
-    return proc_.Create(
-        wpath, bazel::windows::GetJavaWstring(env, java_argv_rest),
-        env_map.ptr(), bazel::windows::GetJavaWpath(env, java_cwd),
-        stdin_process, stdout_process, stderr_process, nullptr, &error_);
+    if (!proc_.Create(
+            wpath, bazel::windows::GetJavaWstring(env, java_argv_rest),
+            env_map.ptr(), bazel::windows::GetJavaWpath(env, java_cwd),
+            stdin_process, stdout_process, stderr_process, nullptr, &error_)) {
+      return false;
+    }
+    stdout_.StartReader();
+    stderr_.StartReader();
+    return true;
   }
 
   void CloseStdin() {
@@ -393,6 +514,31 @@ class NativeProcess {
 
   DWORD GetPid() const { return proc_.GetPid(); }
 
+  // Returns the resource usage in the layout that
+  // WindowsProcesses.getResourceUsage documents, or null if it isn't known.
+  jlongArray GetResourceUsage(JNIEnv* env) const {
+    bazel::windows::WaitableProcess::ResourceUsage usage;
+    if (!proc_.GetResourceUsage(&usage)) {
+      return nullptr;
+    }
+    const jlong values[] = {
+        static_cast<jlong>(usage.user_time_usec),
+        static_cast<jlong>(usage.kernel_time_usec),
+        static_cast<jlong>(usage.read_operations),
+        static_cast<jlong>(usage.write_operations),
+        static_cast<jlong>(usage.read_bytes),
+        static_cast<jlong>(usage.write_bytes),
+        static_cast<jlong>(usage.peak_process_memory),
+        static_cast<jlong>(usage.peak_job_memory),
+    };
+    const jsize size = sizeof(values) / sizeof(values[0]);
+    jlongArray result = env->NewLongArray(size);
+    if (result != nullptr) {
+      env->SetLongArrayRegion(result, 0, size, values);
+    }
+    return result;
+  }
+
   jint WriteStdin(JNIEnv* env, jbyteArray java_bytes, jint offset,
                   jint length) {
     JavaByteArray bytes(env, java_bytes);
@@ -539,6 +685,13 @@ Java_com_google_devtools_build_lib_windows_WindowsProcesses_getProcessPid(
   return static_cast<jint>(process->GetPid());
 }
 
+extern "C" JNIEXPORT jlongArray JNICALL
+Java_com_google_devtools_build_lib_windows_WindowsProcesses_getResourceUsage(
+    JNIEnv* env, jclass clazz, jlong process_long) {
+  NativeProcess* process = reinterpret_cast<NativeProcess*>(process_long);
+  return process->GetResourceUsage(env);
+}
+
 extern "C" JNIEXPORT jboolean JNICALL
 Java_com_google_devtools_build_lib_windows_WindowsProcesses_terminate(
     JNIEnv* env, jclass clazz, jlong process_long) {
@@ -64,6 +64,13 @@ class AutoHandle {
 
   operator HANDLE() const { return handle_; }
 
+  // Returns the handle without closing it; the caller must close it.
+  HANDLE Release() {
+    HANDLE result = handle_;
+    handle_ = INVALID_HANDLE_VALUE;
+    return result;
+  }
+
  private:
   HANDLE handle_;
 };
@@ -0,0 +1,109 @@
+#!/bin/bash
+#
+# Copyright 2024 The Bazel Authors. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Measures how long build-runfiles takes to create and update runfiles trees
+# of different sizes:
+#
+#   build-runfiles-benchmark.sh [-s "SIZES"] [-f FILES_PER_DIR] [-j JOBS]
+#       BUILD_RUNFILES
+#
+# For each size (default: 10000 100000 1000000 entries, FILES_PER_DIR of them
+# per directory), the tree is created from scratch, then updated with nothing
+# changed and with one line of the manifest changed, with and without
+# --incremental. For each run, the wall time and the time of each phase that
+# build-runfiles reports with --stats are printed in milliseconds, followed
+# by the number of file system calls it made.
+
+set -euo pipefail
+
+sizes="10000 100000 1000000"
+files_per_dir=100
+jobs=""
+
+usage() {
+  echo "Usage: $0 [-s SIZES] [-f FILES_PER_DIR] [-j JOBS] BUILD_RUNFILES" >&2
+  exit 1
+}
+
+while getopts "s:f:j:" opt; do
+  case "${opt}" in
+    s) sizes="${OPTARG}" ;;
+    f) files_per_dir="${OPTARG}" ;;
+    j) jobs="--jobs=${OPTARG}" ;;
+    *) usage ;;
+  esac
+done
+shift $((OPTIND - 1))
+[[ $# -eq 1 ]] || usage
+build_runfiles="$(cd "$(dirname "$1")" && pwd)/$(basename "$1")"
+
+dir="$(mktemp -d "${TMPDIR:-/tmp}/build-runfiles-benchmark.XXXXXXXX")"
+trap 'chmod -R u+w "${dir}"; rm -rf "${dir}"' EXIT
+
+# The symlinks point to a few real files, as they would in a build.
+for i in 0 1 2 3; do
+  echo "${i}" > "${dir}/target${i}"
+done
+
+# Runs build-runfiles on the manifest and prints its stats as one row.
+run() {
+  local name="$1"
+  shift
+  "${build_runfiles}" --stats ${jobs} "$@" "${dir}/manifest" \
+      "${dir}/runfiles" 2> "${dir}/stats" || { cat "${dir}/stats" >&2; exit 1; }
+  sed -n 's/.*: stats: //p' "${dir}/stats" | tr ' ' '\n' |
+      awk -F= -v name="${name}" '
+        { value[$1] = $2; keys[n++] = $1 }
+        END {
+          printf "  %-24s", name
+          for (i = 0; i < n; i++) {
+            if (keys[i] ~ /_ms$/) printf " %9.1f", value[keys[i]]
+          }
+          printf "  "
+          for (i = 0; i < n; i++) {
+            if (keys[i] !~ /_ms$/ && keys[i] != "entries" &&
+                value[keys[i]] != 0) {
+              printf " %s=%s", keys[i], value[keys[i]]
+            }
+          }
+          printf "\n"
+        }'
+}
+
+for size in ${sizes}; do
+  awk -v size="${size}" -v per_dir="${files_per_dir}" -v dir="${dir}" '
+      BEGIN {
+        for (i = 0; i < size; i++) {
+          printf "_main/pkg%d/file%d %s/target%d\n", i / per_dir, i, dir, i % 4
+        }
+      }' > "${dir}/manifest"
+  rm -rf "${dir}/runfiles"
+
+  echo "${size} entries, ${files_per_dir} per directory"
+  printf "  %-24s %9s %9s %9s %9s %9s %9s   %s\n" "run" "wall" \
+      "manifest" "scan" "create" "delete" "finish" "calls"
+  run "create"
+  run "nothing changed"
+  # The first run with --incremental has no digest to go by yet.
+  run "first incremental" --incremental
+  run "nothing changed, incr." --incremental
+  sed -i '1s/target[0-9]$/target-changed/' "${dir}/manifest"
+  run "one line changed, incr." --incremental
+  # Without --incremental, the digest is gone and the whole tree is scanned.
+  sed -i '1s/target-changed$/target0/' "${dir}/manifest"
+  run "one line changed"
+  rm -rf "${dir}/runfiles"
+done
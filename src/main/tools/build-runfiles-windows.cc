@@ -18,11 +18,18 @@
 #include <string.h>
 #include <windows.h>
 
+#include <algorithm>
+#include <atomic>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <thread>  // NOLINT
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "src/main/cpp/util/file_platform.h"
 #include "src/main/cpp/util/path_platform.h"
@@ -124,6 +131,57 @@ bool ReadSymlink(const wstring& abs_path, wstring* target, wstring* error) {
   return false;
 }
 
+// The 64-bit FNV-1a hash of the manifest lines, to tell whether the manifest
+// that the tree was built from is still the one in the tree.
+const uint64_t kDigestSeed = 0xcbf29ce484222325ULL;
+
+uint64_t UpdateDigest(uint64_t digest, const char* data, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    digest = (digest ^ static_cast<unsigned char>(data[i])) *
+             0x100000001b3ULL;
+  }
+  return digest;
+}
+
+// Runs `work` on every index in [0, count), split into `jobs` consecutive
+// ranges that run as work items of the thread pool of the process.
+void ParallelFor(size_t count, int jobs,
+                 const std::function<void(size_t)>& work) {
+  struct Range {
+    const std::function<void(size_t)>* work;
+    size_t begin;
+    size_t end;
+  };
+  jobs = static_cast<int>(std::min<size_t>(std::max(jobs, 1), count));
+  if (jobs <= 1) {
+    for (size_t i = 0; i < count; ++i) {
+      work(i);
+    }
+    return;
+  }
+  std::vector<Range> ranges(jobs);
+  std::vector<PTP_WORK> items(jobs);
+  for (int i = 0; i < jobs; ++i) {
+    ranges[i] = {&work, count * i / jobs, count * (i + 1) / jobs};
+    items[i] = CreateThreadpoolWork(
+        [](PTP_CALLBACK_INSTANCE, PVOID context, PTP_WORK) {
+          const Range* range = static_cast<const Range*>(context);
+          for (size_t j = range->begin; j < range->end; ++j) {
+            (*range->work)(j);
+          }
+        },
+        &ranges[i], nullptr);
+    if (items[i] == nullptr) {
+      die(L"CreateThreadpoolWork failed: %hs", GetLastErrorString().c_str());
+    }
+    SubmitThreadpoolWork(items[i]);
+  }
+  for (PTP_WORK item : items) {
+    WaitForThreadpoolWorkCallbacks(item, FALSE);
+    CloseThreadpoolWork(item);
+  }
+}
+
 // Replaces \s, \n, and \b with their respective characters.
 std::string Unescape(const std::string& path) {
   std::string result;
@@ -163,10 +221,13 @@ class RunfilesCreator {
   typedef std::unordered_map<std::wstring, std::wstring> ManifestFileMap;
 
  public:
+  // If `junctions`, directories are linked to with junctions rather than
+  // symlinks.
   RunfilesCreator(const wstring& manifest_path,
-                  const wstring& runfiles_output_base)
+                  const wstring& runfiles_output_base, bool junctions)
       : manifest_path_(manifest_path),
-        runfiles_output_base_(runfiles_output_base) {
+        runfiles_output_base_(runfiles_output_base),
+        junctions_(junctions) {
     SetupOutputBase();
     if (!SetCurrentDirectoryW(runfiles_output_base_.c_str())) {
       die(L"SetCurrentDirectoryW failed (%s): %hs",
@@ -174,18 +235,87 @@ class RunfilesCreator {
     }
   }
 
+  // Reads the manifest that the tree was built from, so that CreateRunfiles
+  // only has to apply the differences to the new one. Does nothing unless
+  // MANIFEST.digest matches the MANIFEST in the tree; it is removed until the
+  // tree is complete again.
+  void ReadPreviousManifest(bool allow_relative, bool ignore_metadata) {
+    incremental_ = true;
+    const wstring digest_path = runfiles_output_base_ + L"\\MANIFEST.digest";
+    string digest;
+    {
+      ifstream digest_file(digest_path.c_str());
+      if (!digest_file || !getline(digest_file, digest)) {
+        return;
+      }
+    }
+    DeleteFileOrDie(digest_path);
+
+    const wstring previous_path = runfiles_output_base_ + L"\\MANIFEST";
+    ManifestFileMap previous;
+    if (GetFileAttributesW(previous_path.c_str()) ==
+            INVALID_FILE_ATTRIBUTES ||
+        FormatDigest(ParseManifest(previous_path, allow_relative,
+                                   ignore_metadata, &previous)) != digest) {
+      return;
+    }
+    previous_.reset(new ManifestFileMap(std::move(previous)));
+  }
+
   void ReadManifest(bool allow_relative, bool ignore_metadata) {
-    ifstream manifest_file(
-        AsAbsoluteWindowsPath(manifest_path_.c_str()).c_str());
+    digest_ = FormatDigest(ParseManifest(manifest_path_, allow_relative,
+                                         ignore_metadata, &manifest_file_map));
+  }
+
+  // Creates the entries on `jobs` threads, or on a number that suits the size
+  // of the manifest if `jobs` is 0.
+  void CreateRunfiles(int jobs) {
+    if (jobs <= 0) {
+      // Threads only pay off for large trees, and Bazel runs many of us at
+      // once.
+      const int cpus = std::max(1u, std::thread::hardware_concurrency());
+      jobs = static_cast<int>(
+          std::min<size_t>({static_cast<size_t>(cpus), 8,
+                            1 + manifest_file_map.size() / kEntriesPerJob}));
+    }
+    if (!previous_ || !ApplyDifferences(jobs)) {
+      ScanTreeAndPrune(runfiles_output_base_);
+      CreateFiles(jobs);
+    }
+    CopyManifestFile();
+    if (incremental_) {
+      WriteDigest();
+    }
+  }
+
+ private:
+  // The number of manifest entries that make another thread worthwhile.
+  static const size_t kEntriesPerJob = 4096;
+
+  string FormatDigest(uint64_t digest) const {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%016llx %d", (unsigned long long)digest,
+             junctions_ ? 1 : 0);
+    return buf;
+  }
+
+  // Reads the entries of the manifest at `path` into `result`. Returns the
+  // digest of its lines.
+  uint64_t ParseManifest(const wstring& path, bool allow_relative,
+                         bool ignore_metadata, ManifestFileMap* result) {
+    ifstream manifest_file(AsAbsoluteWindowsPath(path.c_str()).c_str());
 
     if (!manifest_file) {
-      die(L"Couldn't open MANIFEST file: %s", manifest_path_.c_str());
+      die(L"Couldn't open MANIFEST file: %s", path.c_str());
     }
 
+    uint64_t digest = kDigestSeed;
     string line;
     int lineno = 0;
     while (getline(manifest_file, line)) {
       lineno++;
+      digest = UpdateDigest(digest, line.data(), line.size());
+      digest = UpdateDigest(digest, "\n", 1);
       // Skip metadata lines. They are used solely for
       // dependency checking.
       if (ignore_metadata && lineno % 2 == 0) {
@@ -227,17 +357,11 @@ class RunfilesCreator {
         target = AsAbsoluteWindowsPath(target.c_str());
       }
 
-      manifest_file_map.insert(make_pair(link, target));
+      result->insert(make_pair(link, target));
     }
+    return digest;
   }
 
-  void CreateRunfiles() {
-    ScanTreeAndPrune(runfiles_output_base_);
-    CreateFiles();
-    CopyManifestFile();
-  }
-
- private:
   void SetupOutputBase() {
     if (!DoesDirectoryPathExist(runfiles_output_base_.c_str())) {
       MakeDirectoriesOrDie(runfiles_output_base_);
@@ -257,6 +381,22 @@ class RunfilesCreator {
     }
   }
 
+  // Deletes the file or link at `path`. Returns false if it cannot.
+  bool DeleteEntry(const wstring& path) {
+    DWORD attributes = GetFileAttributesW(path.c_str());
+    if (attributes == INVALID_FILE_ATTRIBUTES) {
+      return false;
+    }
+    if (attributes & FILE_ATTRIBUTE_DIRECTORY) {
+      // A symlink to a directory, or a junction.
+      return RemoveDirectoryW(path.c_str());
+    }
+    if (attributes & FILE_ATTRIBUTE_READONLY) {
+      SetFileAttributesW(path.c_str(), attributes & ~FILE_ATTRIBUTE_READONLY);
+    }
+    return DeleteFileW(path.c_str());
+  }
+
   void DeleteFileOrDie(const wstring& path) {
     SetFileAttributesW(path.c_str(), GetFileAttributesW(path.c_str()) &
                                          ~FILE_ATTRIBUTE_READONLY);
@@ -337,63 +477,160 @@ class RunfilesCreator {
     ::FindClose(handle);
   }
 
-  void CreateFiles() {
+  // Brings the tree from the previous manifest to the new one by deleting
+  // and creating only the entries that changed. Returns false, leaving the
+  // tree to be scanned in full, if the tree turns out not to match the
+  // previous manifest.
+  bool ApplyDifferences(int jobs) {
+    std::vector<wstring> deleted_parents;
+    for (const auto& it : *previous_) {
+      ManifestFileMap::const_iterator current =
+          manifest_file_map.find(it.first);
+      if (current != manifest_file_map.end() && current->second == it.second &&
+          (it.second.empty() || !blaze_util::IsDirectoryW(it.second) ||
+           !junctions_ == !IsJunction(it.first))) {
+        manifest_file_map.erase(current);
+        continue;
+      }
+      if (!DeleteEntry(it.first)) {
+        return false;
+      }
+      deleted_parents.push_back(GetParentDirFromPath(it.first));
+    }
+    // Directories that the deletions left empty go. The others fail with
+    // ERROR_DIR_NOT_EMPTY.
+    std::sort(deleted_parents.begin(), deleted_parents.end());
+    deleted_parents.erase(
+        std::unique(deleted_parents.begin(), deleted_parents.end()),
+        deleted_parents.end());
+    for (const wstring& parent : deleted_parents) {
+      for (wstring dir = parent;
+           dir.size() > runfiles_output_base_.size() &&
+           RemoveDirectoryW(dir.c_str());
+           dir = GetParentDirFromPath(dir)) {
+      }
+    }
+    return CreateEntries(jobs, /* die_on_error */ false);
+  }
+
+  bool IsJunction(const wstring& path) {
+    HANDLE h = CreateFileW(
+        path.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING,
+        FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OPEN_REPARSE_POINT, nullptr);
+    if (h == INVALID_HANDLE_VALUE) {
+      return false;
+    }
+    FILE_ATTRIBUTE_TAG_INFO info;
+    bool result = GetFileInformationByHandleEx(h, FileAttributeTagInfo, &info,
+                                               sizeof(info)) &&
+                  info.ReparseTag == IO_REPARSE_TAG_MOUNT_POINT;
+    CloseHandle(h);
+    return result;
+  }
+
+  void CreateFiles(int jobs) { CreateEntries(jobs, /* die_on_error */ true); }
+
+  // Creates the entries that are left in manifest_file_map on `jobs` threads.
+  // The parent directories are created first, each of them once. Unless
+  // `die_on_error`, returns false if an entry cannot be created.
+  bool CreateEntries(int jobs, bool die_on_error) {
+    std::vector<const ManifestFileMap::value_type*> entries;
+    entries.reserve(manifest_file_map.size());
+    std::unordered_set<wstring> parents;
     for (const auto& it : manifest_file_map) {
-      // Ensure the parent directory exists
-      wstring parent_dir = GetParentDirFromPath(it.first);
-      if (!DoesDirectoryPathExist(parent_dir.c_str())) {
-        MakeDirectoriesOrDie(parent_dir);
+      entries.push_back(&it);
+      parents.insert(GetParentDirFromPath(it.first));
+    }
+    for (const wstring& parent : parents) {
+      if (!DoesDirectoryPathExist(parent.c_str())) {
+        MakeDirectoriesOrDie(parent);
       }
+    }
 
-      if (it.second.empty()) {
-        // Create an empty file
-        HANDLE h = CreateFileW(it.first.c_str(),  // name of the file
-                               GENERIC_WRITE,     // open for writing
-                               // Must share for reading, otherwise
-                               // symlink-following file existence checks (e.g.
-                               // java.nio.file.Files.exists()) fail.
-                               FILE_SHARE_READ,
-                               0,  // use default security descriptor
-                               CREATE_ALWAYS,  // overwrite if exists
-                               FILE_ATTRIBUTE_NORMAL, 0);
-        if (h != INVALID_HANDLE_VALUE) {
-          CloseHandle(h);
-        } else {
-          die(L"CreateFileW failed (%s): %hs", it.first.c_str(),
-              GetLastErrorString().c_str());
-        }
-      } else {
-        DWORD create_dir = 0;
-        if (blaze_util::IsDirectoryW(it.second.c_str())) {
-          create_dir = SYMBOLIC_LINK_FLAG_DIRECTORY;
-        }
-        if (!CreateSymbolicLinkW(
-                it.first.c_str(), it.second.c_str(),
-                bazel::windows::symlinkPrivilegeFlag | create_dir)) {
-          if (GetLastError() == ERROR_INVALID_PARAMETER) {
-            // We are on a version of Windows that does not support this flag.
-            // Retry without the flag and return to error handling if necessary.
-            if (CreateSymbolicLinkW(it.first.c_str(), it.second.c_str(),
-                                    create_dir)) {
-              return;
-            }
-          }
-          if (GetLastError() == ERROR_PRIVILEGE_NOT_HELD) {
-            die(L"CreateSymbolicLinkW failed:\n%hs\n",
-                "Bazel needs to create symlinks to build the runfiles tree.\n"
-                "Creating symlinks on Windows requires one of the following:\n"
-                "    1. Bazel is run with administrator privileges.\n"
-                "    2. The system version is Windows 10 Creators Update "
-                "(1703) or "
-                "later and developer mode is enabled.",
-                GetLastErrorString().c_str());
-          } else {
-            die(L"CreateSymbolicLinkW failed (%s -> %s): %hs", it.first.c_str(),
-                it.second.c_str(), GetLastErrorString().c_str());
-          }
-        }
+    std::atomic<bool> ok(true);
+    ParallelFor(entries.size(), jobs, [&](size_t i) {
+      if (ok && !CreateEntry(entries[i]->first, entries[i]->second,
+                             die_on_error)) {
+        ok = false;
       }
+    });
+    return ok;
+  }
+
+  // Creates the empty file or the link at `link`. Returns false if it cannot,
+  // or dies if `die_on_error`.
+  bool CreateEntry(const wstring& link, const wstring& target,
+                   bool die_on_error) {
+    if (target.empty()) {
+      // Create an empty file
+      HANDLE h = CreateFileW(link.c_str(),   // name of the file
+                             GENERIC_WRITE,  // open for writing
+                             // Must share for reading, otherwise
+                             // symlink-following file existence checks (e.g.
+                             // java.nio.file.Files.exists()) fail.
+                             FILE_SHARE_READ,
+                             0,  // use default security descriptor
+                             CREATE_ALWAYS,  // overwrite if exists
+                             FILE_ATTRIBUTE_NORMAL, 0);
+      if (h != INVALID_HANDLE_VALUE) {
+        CloseHandle(h);
+        return true;
+      }
+      if (die_on_error) {
+        die(L"CreateFileW failed (%s): %hs", link.c_str(),
+            GetLastErrorString().c_str());
+      }
+      return false;
+    }
+
+    DWORD create_dir = 0;
+    if (blaze_util::IsDirectoryW(target.c_str())) {
+      create_dir = SYMBOLIC_LINK_FLAG_DIRECTORY;
     }
+    if (create_dir && junctions_) {
+      // Junctions need no privilege, and are what Bazel makes for directories
+      // elsewhere too.
+      wstring werror;
+      if (bazel::windows::CreateJunction(link, target, &werror) ==
+          bazel::windows::CreateJunctionResult::kSuccess) {
+        return true;
+      }
+      if (die_on_error) {
+        die(L"CreateJunction failed (%s -> %s): %s", link.c_str(),
+            target.c_str(), werror.c_str());
+      }
+      return false;
+    }
+    if (CreateSymbolicLinkW(
+            link.c_str(), target.c_str(),
+            bazel::windows::symlinkPrivilegeFlag | create_dir)) {
+      return true;
+    }
+    if (GetLastError() == ERROR_INVALID_PARAMETER) {
+      // We are on a version of Windows that does not support this flag.
+      // Retry without the flag and return to error handling if necessary.
+      if (CreateSymbolicLinkW(link.c_str(), target.c_str(), create_dir)) {
+        return true;
+      }
+    }
+    if (!die_on_error) {
+      return false;
+    }
+    if (GetLastError() == ERROR_PRIVILEGE_NOT_HELD) {
+      die(L"CreateSymbolicLinkW failed:\n%hs\n",
+          "Bazel needs to create symlinks to build the runfiles tree.\n"
+          "Creating symlinks on Windows requires one of the following:\n"
+          "    1. Bazel is run with administrator privileges.\n"
+          "    2. The system version is Windows 10 Creators Update "
+          "(1703) or "
+          "later and developer mode is enabled.",
+          GetLastErrorString().c_str());
+    } else {
+      die(L"CreateSymbolicLinkW failed (%s -> %s): %hs", link.c_str(),
+          target.c_str(), GetLastErrorString().c_str());
+    }
+    return false;
   }
 
   void CopyManifestFile() {
@@ -405,10 +642,25 @@ class RunfilesCreator {
     }
   }
 
+  void WriteDigest() {
+    const wstring digest_path = runfiles_output_base_ + L"\\MANIFEST.digest";
+    std::ofstream digest_file(digest_path.c_str());
+    digest_file << digest_ << "\n";
+    if (!digest_file.good()) {
+      die(L"Couldn't write %s", digest_path.c_str());
+    }
+  }
+
  private:
   wstring manifest_path_;
   wstring runfiles_output_base_;
+  bool junctions_;
+  bool incremental_ = false;
+  // The digest of the new manifest, as recorded in MANIFEST.digest.
+  string digest_;
   ManifestFileMap manifest_file_map;
+  // The manifest that the tree was built from, if it is known.
+  std::unique_ptr<ManifestFileMap> previous_;
 };
 
 int wmain(int argc, wchar_t** argv) {
@@ -416,6 +668,9 @@ int wmain(int argc, wchar_t** argv) {
   argv++;
   bool allow_relative = false;
   bool ignore_metadata = false;
+  bool incremental = false;
+  bool junctions = false;
+  int jobs = 0;
 
   while (argc >= 1) {
     if (wcscmp(argv[0], L"--allow_relative") == 0) {
@@ -428,6 +683,21 @@ int wmain(int argc, wchar_t** argv) {
       ignore_metadata = true;
       argc--;
       argv++;
+    } else if (wcscmp(argv[0], L"--incremental") == 0) {
+      // Only apply the differences to the manifest the tree was built from,
+      // if it is known, instead of scanning the tree.
+      incremental = true;
+      argc--;
+      argv++;
+    } else if (wcscmp(argv[0], L"--junctions") == 0) {
+      // Link to directories with junctions instead of symlinks.
+      junctions = true;
+      argc--;
+      argv++;
+    } else if (wcsncmp(argv[0], L"--jobs=", 7) == 0) {
+      jobs = _wtoi(argv[0] + 7);
+      argc--;
+      argv++;
     } else {
       break;
     }
@@ -435,8 +705,8 @@ int wmain(int argc, wchar_t** argv) {
 
   if (argc != 2) {
     fprintf(stderr,
-            "usage: [--allow_relative] [--use_metadata] "
-            "<manifest_file> <runfiles_base_dir>\n");
+            "usage: [--allow_relative] [--use_metadata] [--incremental] "
+            "[--junctions] [--jobs=N] <manifest_file> <runfiles_base_dir>\n");
     return 1;
   }
 
@@ -447,9 +717,12 @@ int wmain(int argc, wchar_t** argv) {
   wstring output_base_absolute_path = AsAbsoluteWindowsPath(runfiles_base_dir);
 
   RunfilesCreator runfiles_creator(manifest_absolute_path,
-                                   output_base_absolute_path);
+                                   output_base_absolute_path, junctions);
+  if (incremental) {
+    runfiles_creator.ReadPreviousManifest(allow_relative, ignore_metadata);
+  }
   runfiles_creator.ReadManifest(allow_relative, ignore_metadata);
-  runfiles_creator.CreateRunfiles();
+  runfiles_creator.CreateRunfiles(jobs);
 
   return 0;
 }
@@ -37,6 +37,57 @@
 // If --use_metadata is supplied, every other line is treated as opaque
 // metadata, and is ignored here.
 //
+// The directories of the tree are reconciled with the manifest on --jobs
+// threads, by default more of them the larger the manifest is. Each thread
+// works relative to the file descriptor of the directory at hand.
+//
+// With --incremental, RUNFILES/MANIFEST.digest records the digest of the
+// manifest that the tree was built from. If the next run finds the digest to
+// match RUNFILES/MANIFEST, it only applies the differences between that
+// manifest and the new one, trusting that the tree has been left alone since.
+// Otherwise, or if the tree turns out not to match the previous manifest, the
+// whole tree is scanned as usual.
+//
+// With --materialize, symlinks to regular files are replaced by hardlinks to
+// the files, for programs that resolve every runfile they open. Where a
+// hardlink cannot be made, for instance across file systems, the file is
+// cloned (reflinked, or clonefile'd on macOS) if the file system supports it
+// and copied otherwise.
+// Symlinks to directories, to missing files and relative symlinks remain.
+//
+// With --index, RUNFILES/MANIFEST.index is written next to RUNFILES/MANIFEST,
+// so that runfiles libraries can look up entries in place instead of parsing
+// the whole manifest on startup. It holds, in host byte order:
+//   - a RunfilesIndexHeader, which records the size and modification time of
+//     the MANIFEST the index belongs to, so that readers can tell if it is
+//     stale;
+//   - the entries as RunfilesIndexEntry, sorted by link path and without
+//     duplicates; offsets are into the strings;
+//   - a hash table of `bucket_count` (a power of two) uint32_t slots, each
+//     either 0 or one more than the index of an entry. Entries are placed at
+//     the 32-bit FNV-1a hash of their link path modulo `bucket_count`, or the
+//     next free slot after it;
+//   - the link paths and targets, unescaped, with each distinct target stored
+//     once.
+// Keep the format in sync with tools/cpp/runfiles/runfiles_src.cc.
+//
+// With --shared_subtrees=STORE, directories of the tree whose entries are all
+// symlinks with absolute targets or empty files, at least kMinSharedEntries of
+// them, are created once in STORE, under the hex MD5 digest of their part of
+// the manifest, and linked to from the tree with a single symlink. Trees that
+// have the same toolchains or libraries then share their directories instead
+// of each holding a symlink for every file. The largest such directories are
+// shared, never the whole tree. The directories in STORE are created under a
+// temporary name and renamed into place, so that concurrent runs can create
+// the same one, and are never changed or removed afterwards. This does not
+// combine with --materialize, whose files would go stale in STORE when their
+// targets change.
+//
+// With --stats, the time of each phase (reading the manifests, scanning the
+// tree, creating and deleting entries, and writing the manifest) and the
+// number of file system calls of each kind are printed to stderr when done.
+// The phase times are summed over the threads.
+//
 // All output paths must be relative and generally (but not always) begin with
 // <workspace root>. No output path may be equal to another.  No output path may
 // be a path prefix of another.
@@ -47,14 +98,34 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 
-#include <map>
+#if defined(__linux__)
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#elif defined(__APPLE__)
+#include <sys/clonefile.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
 #include <string>
+#include <thread>  // NOLINT
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "src/main/cpp/util/md5.h"
+#include "src/main/cpp/util/probe.h"
+#include "src/main/cpp/util/task_pool.h"
 
 // program_invocation_short_name is not portable.
 static const char *argv0;
@@ -74,6 +145,12 @@ const char *output_base_dir;
   exit(1); \
 }
 
+#if defined(__APPLE__)
+#define ST_MTIM(st) (st).st_mtimespec
+#else
+#define ST_MTIM(st) (st).st_mtim
+#endif
+
 #define PDIE(args...) { \
   int saved_errno = errno; \
   LOG(); \
@@ -82,6 +159,133 @@ const char *output_base_dir;
   exit(1); \
 }
 
+// What --stats reports.
+enum Phase {
+  PHASE_READ_MANIFEST,
+  PHASE_SCAN,
+  PHASE_CREATE,
+  PHASE_DELETE,
+  PHASE_FINISH,
+  PHASE_COUNT,
+};
+
+static const char *const kPhaseNames[PHASE_COUNT] = {
+    "read_manifest", "scan", "create", "delete", "finish",
+};
+
+enum Call {
+  CALL_OPEN,
+  CALL_DIRENT,
+  CALL_STAT,
+  CALL_READLINK,
+  CALL_MKDIR,
+  CALL_SYMLINK,
+  CALL_LINK,
+  CALL_UNLINK,
+  CALL_CHMOD,
+  CALL_COUNT,
+};
+
+static const char *const kCallNames[CALL_COUNT] = {
+    "open", "dirent", "stat", "readlink", "mkdir",
+    "symlink", "link", "unlink", "chmod",
+};
+
+static bool stats = false;
+static std::atomic<uint64_t> phase_nanos[PHASE_COUNT];
+static std::atomic<uint64_t> calls[CALL_COUNT];
+
+// The phase the thread is in, and since when.
+static thread_local Phase current_phase = PHASE_COUNT;
+static thread_local uint64_t current_phase_start;
+
+static uint64_t NowNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Counts a file system call, or a directory entry read, if --stats.
+static void CountCall(Call call) {
+  if (stats) {
+    calls[call].fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+// Charges the time from here to the end of the scope to `phase` rather than
+// to the phase the thread was in, if --stats. DelTree recurses, so a phase
+// may be entered again while it is running.
+class PhaseTimer {
+ public:
+  explicit PhaseTimer(Phase phase) : outer_(current_phase) {
+    if (stats) {
+      Switch(phase);
+    }
+  }
+
+  ~PhaseTimer() {
+    if (stats) {
+      Switch(outer_);
+    }
+  }
+
+  PhaseTimer(const PhaseTimer &) = delete;
+  PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+ private:
+  static void Switch(Phase phase) {
+    const uint64_t now = NowNanos();
+    if (current_phase != PHASE_COUNT) {
+      phase_nanos[current_phase].fetch_add(now - current_phase_start,
+                                           std::memory_order_relaxed);
+    }
+    current_phase = phase;
+    current_phase_start = now;
+  }
+
+  const Phase outer_;
+};
+
+static void PrintStats(uint64_t start, size_t entries) {
+  fprintf(stderr, "%s: stats: entries=%zu wall_ms=%.3f", argv0, entries,
+          (NowNanos() - start) / 1e6);
+  for (int i = 0; i < PHASE_COUNT; i++) {
+    fprintf(stderr, " %s_ms=%.3f", kPhaseNames[i], phase_nanos[i] / 1e6);
+  }
+  for (int i = 0; i < CALL_COUNT; i++) {
+    fprintf(stderr, " %s=%" PRIu64, kCallNames[i], calls[i].load());
+  }
+  fprintf(stderr, "\n");
+}
+
+struct RunfilesIndexHeader {
+  char magic[8];
+  uint32_t entry_count;
+  uint32_t bucket_count;
+  uint64_t strings_size;
+  uint64_t manifest_size;
+  int64_t manifest_mtime_sec;
+  int64_t manifest_mtime_nsec;
+};
+
+struct RunfilesIndexEntry {
+  uint32_t link;
+  uint32_t link_size;
+  uint32_t target;
+  uint32_t target_size;
+};
+
+static const char kRunfilesIndexMagic[8] = {'R', 'F', 'I', 'N',
+                                            'D', 'E', 'X', '1'};
+
+static uint32_t RunfilesIndexHash(const char *data, size_t size) {
+  uint32_t hash = 2166136261U;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619U;
+  }
+  return hash;
+}
+
 enum FileType {
   FILE_TYPE_REGULAR,
   FILE_TYPE_DIRECTORY,
@@ -101,7 +305,90 @@ struct FileInfo {
   }
 };
 
-typedef std::map<std::string, FileInfo> FileInfoMap;
+// An entry of the manifest. Directories hold their entries by basename, so
+// that each directory of the tree is compared with its own entries only.
+struct ManifestNode {
+  FileInfo info;
+  std::unordered_map<std::string, std::unique_ptr<ManifestNode>> children;
+  // Whether the tree has this entry already. Only the thread that reconciles
+  // the parent directory touches it.
+  bool exists = false;
+  // The same entry of the previous manifest, if the tree has it already. Set
+  // along with `exists` when applying the differences between the manifests.
+  const ManifestNode *previous = nullptr;
+  // Whether to leave the entry alone, neither creating nor removing it.
+  bool keep = false;
+};
+
+// A directory of the tree to reconcile with the manifest.
+struct DirectoryTask {
+  // The path relative to the output directory, or "." for itself.
+  std::string path;
+  ManifestNode *node;
+  // Whether the directory exists already, or has to be scanned at all.
+  bool exists;
+};
+
+// A directory of the tree that is opened on first use.
+class LazyDirectory {
+ public:
+  // If `missing_ok`, fd() returns -1 for a directory that doesn't exist.
+  LazyDirectory(const std::string &path, bool missing_ok)
+      : path_(path), missing_ok_(missing_ok) {}
+  ~LazyDirectory() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  int fd() {
+    if (fd_ < 0) {
+      CountCall(CALL_OPEN);
+      fd_ = open(path_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (fd_ < 0 && !(missing_ok_ && errno == ENOENT)) {
+        PDIE("opendir '%s'", path_.c_str());
+      }
+    }
+    return fd_;
+  }
+
+ private:
+  const std::string &path_;
+  const bool missing_ok_;
+  int fd_ = -1;
+};
+
+// The manifest digest is a 64-bit FNV-1a hash, which is only meant to notice
+// that the manifest has changed.
+static const uint64_t kDigestSeed = 14695981039346656037ULL;
+
+static uint64_t UpdateDigest(uint64_t digest, const char *data, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    digest = (digest ^ static_cast<unsigned char>(data[i])) * 1099511628211ULL;
+  }
+  return digest;
+}
+
+// Returns the line of the digest file, which also records the options that
+// the manifest was read with. The store of --shared_subtrees, which the links
+// of the tree point into, goes into the digest, and only if there is one.
+static std::string FormatDigest(uint64_t digest, bool allow_relative,
+                                bool use_metadata, bool materialize,
+                                const std::string &shared_subtrees) {
+  if (!shared_subtrees.empty()) {
+    digest = UpdateDigest(digest, shared_subtrees.data(),
+                          shared_subtrees.size());
+  }
+  char buf[64];
+  snprintf(buf, sizeof buf, "%016" PRIx64 " %d %d %d\n", digest,
+           allow_relative, use_metadata, materialize);
+  return buf;
+}
+
+// Returns "dir/name", or "name" in the output directory itself.
+static std::string JoinPath(const std::string &dir, const char *name) {
+  return dir == "." ? name : dir + '/' + name;
+}
 
 // Replaces \s, \n, and \b with their respective characters.
 std::string Unescape(const std::string &path) {
@@ -138,18 +425,102 @@ std::string Unescape(const std::string &path) {
 
 class RunfilesCreator {
  public:
-  explicit RunfilesCreator(const std::string &output_base)
+  // If `materialize`, symlinks to regular files are made into hardlinks or
+  // copies of the files.
+  RunfilesCreator(const std::string &output_base, bool materialize)
       : output_base_(output_base),
         output_filename_("MANIFEST"),
-        temp_filename_(output_filename_ + ".tmp") {
+        temp_filename_(output_filename_ + ".tmp"),
+        digest_filename_(output_filename_ + ".digest"),
+        index_filename_(output_filename_ + ".index"),
+        materialize_(materialize) {
     SetupOutputBase();
     if (chdir(output_base_.c_str()) != 0) {
       PDIE("chdir '%s'", output_base_.c_str());
     }
+    root_.info.type = FILE_TYPE_DIRECTORY;
+  }
+
+  // Reads the manifest that the tree was built from, so that CreateRunfiles
+  // only has to apply the differences to the new one. Does nothing unless the
+  // digest of the previous run matches, which it stops doing until the tree
+  // is complete again.
+  void ReadPreviousManifest(bool allow_relative, bool use_metadata) {
+    PhaseTimer timer(PHASE_READ_MANIFEST);
+    incremental_ = true;
+    FILE *digest_file = fopen(digest_filename_.c_str(), "r");
+    if (!digest_file) {
+      return;
+    }
+    char digest_buf[64] = "";
+    if (!fgets(digest_buf, sizeof digest_buf, digest_file)) {
+      digest_buf[0] = '\0';
+    }
+    fclose(digest_file);
+    if (unlink(digest_filename_.c_str()) != 0) {
+      PDIE("removing '%s/%s'", output_base_.c_str(),
+           digest_filename_.c_str());
+    }
+
+    FILE *infile = fopen(output_filename_.c_str(), "r");
+    if (!infile) {
+      return;
+    }
+    uint64_t digest = kDigestSeed;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof buf, infile)) > 0) {
+      digest = UpdateDigest(digest, buf, n);
+    }
+    if (ferror(infile) ||
+        FormatDigest(digest, allow_relative, use_metadata, materialize_,
+                     shared_subtrees_) != digest_buf) {
+      fclose(infile);
+      return;
+    }
+    rewind(infile);
+
+    previous_root_.reset(new ManifestNode());
+    previous_root_->info.type = FILE_TYPE_DIRECTORY;
+    ParseManifest(infile, nullptr, allow_relative, use_metadata,
+                  previous_root_.get());
+    fclose(infile);
+    if (!shared_subtrees_.empty()) {
+      // The previous tree links to the store the same way.
+      ShareSubtrees(previous_root_.get(), false);
+    }
+    // The tree has the temporary manifest of this run already.
+    AddPath(previous_root_.get(), temp_filename_, 0)->info.type =
+        FILE_TYPE_REGULAR;
+    ManifestNode *digest_node =
+        AddPath(previous_root_.get(), digest_filename_, 0);
+    digest_node->info.type = FILE_TYPE_REGULAR;
+    digest_node->keep = true;
+    if (index_) {
+      ManifestNode *index_node =
+          AddPath(previous_root_.get(), index_filename_, 0);
+      index_node->info.type = FILE_TYPE_REGULAR;
+      index_node->keep = true;
+    }
   }
 
+  // Makes CreateRunfiles write MANIFEST.index. Call before reading the
+  // manifests.
+  void EnableIndex() { index_ = true; }
+
+  // Makes the tree link to directories in `store`, which has to be an
+  // absolute path, instead of holding their entries itself. Call before
+  // reading the manifests.
+  void EnableSharedSubtrees(const std::string &store) {
+    shared_subtrees_ = store;
+  }
+
+  // The number of entries in the manifest.
+  size_t entries() const { return entries_; }
+
   void ReadManifest(const std::string &manifest_file, bool allow_relative,
                     bool use_metadata) {
+    PhaseTimer timer(PHASE_READ_MANIFEST);
     // Remove file left over from previous invocation. This ensures that
     // opening succeeds if the existing file is read-only.
     if (unlink(temp_filename_.c_str()) != 0 && errno != ENOENT) {
@@ -166,12 +537,109 @@ class RunfilesCreator {
       PDIE("opening '%s' for reading", manifest_file.c_str());
     }
 
+    digest_ = FormatDigest(
+        ParseManifest(infile, outfile, allow_relative, use_metadata, &root_),
+        allow_relative, use_metadata, materialize_, shared_subtrees_);
+    if (fclose(outfile) != 0) {
+      PDIE("writing to '%s/%s'", output_base_.c_str(),
+           temp_filename_.c_str());
+    }
+    fclose(infile);
+    if (!shared_subtrees_.empty()) {
+      ShareSubtrees(&root_, true);
+    }
+
+    // Don't delete the temp manifest file.
+    AddPath(&root_, temp_filename_, 0)->info.type = FILE_TYPE_REGULAR;
+    if (incremental_) {
+      // Nor the digest, which is written once the tree is complete.
+      ManifestNode *digest_node = AddPath(&root_, digest_filename_, 0);
+      digest_node->info.type = FILE_TYPE_REGULAR;
+      digest_node->keep = true;
+    }
+    if (index_) {
+      // Nor the index, which is written once the manifest is in place.
+      ManifestNode *index_node = AddPath(&root_, index_filename_, 0);
+      index_node->info.type = FILE_TYPE_REGULAR;
+      index_node->keep = true;
+    }
+  }
+
+  // Reconciles the tree on `jobs` threads, or on a number that suits the
+  // size of the manifest if `jobs` is 0.
+  void CreateRunfiles(int jobs) {
+    if (unlink(output_filename_.c_str()) != 0 && errno != ENOENT) {
+      PDIE("removing previous file at '%s/%s'", output_base_.c_str(),
+           output_filename_.c_str());
+    }
+    if (index_ && unlink(index_filename_.c_str()) != 0 && errno != ENOENT) {
+      PDIE("removing previous file at '%s/%s'", output_base_.c_str(),
+           index_filename_.c_str());
+    }
+
+    if (jobs <= 0) {
+      // Threads only pay off for large trees, and Bazel runs many of us at
+      // once.
+      const int cpus = std::max(1u, std::thread::hardware_concurrency());
+      jobs = std::min<size_t>({static_cast<size_t>(cpus), 8,
+                               1 + entries_ / kEntriesPerJob});
+    }
+    CreateSharedSubtrees();
+    Reconcile(jobs, previous_root_.get());
+    if (stale_) {
+      // The tree doesn't match the previous manifest after all.
+      ResetTree(&root_);
+      stale_ = false;
+      Reconcile(jobs, nullptr);
+    }
+
+    PhaseTimer timer(PHASE_FINISH);
+    // rename output file into place
+    if (rename(temp_filename_.c_str(), output_filename_.c_str()) != 0) {
+      PDIE("renaming '%s/%s' to '%s/%s'",
+           output_base_.c_str(), temp_filename_.c_str(),
+           output_base_.c_str(), output_filename_.c_str());
+    }
+    if (index_) {
+      WriteIndex();
+    }
+
+    if (incremental_) {
+      FILE *digest_file = fopen(digest_filename_.c_str(), "w");
+      if (!digest_file || fputs(digest_.c_str(), digest_file) == EOF ||
+          fclose(digest_file) != 0) {
+        PDIE("writing to '%s/%s'", output_base_.c_str(),
+             digest_filename_.c_str());
+      }
+    }
+  }
+
+ private:
+  // The number of manifest entries that make another thread worthwhile.
+  static const size_t kEntriesPerJob = 8192;
+
+  // The number of entries that make it worthwhile to share a directory.
+  static const size_t kMinSharedEntries = 32;
+
+  // A directory of the manifest that is to be created in the store.
+  struct SharedSubtree {
+    // The name in the store, which is the digest of the entries.
+    std::string name;
+    std::unique_ptr<ManifestNode> node;
+  };
+
+  // Reads the entries of `infile` into the tree at `root`, copying the lines
+  // to `outfile` unless that is null. Returns the digest of the lines.
+  uint64_t ParseManifest(FILE *infile, FILE *outfile, bool allow_relative,
+                         bool use_metadata, ManifestNode *root) {
+    uint64_t digest = kDigestSeed;
     // read input manifest
     int lineno = 0;
     char buf[3 * PATH_MAX];
     while (fgets(buf, sizeof buf, infile)) {
+      digest = UpdateDigest(digest, buf, strlen(buf));
       // copy line to output manifest
-      if (fputs(buf, outfile) == EOF) {
+      if (outfile && fputs(buf, outfile) == EOF) {
         PDIE("writing to '%s/%s'", output_base_.c_str(),
              temp_filename_.c_str());
       }
@@ -215,53 +683,316 @@ class RunfilesCreator {
         DIE("expected absolute path at line %d: '%s'\n", lineno, buf);
       }
 
-      FileInfo *info = &manifest_[link];
+      ManifestNode *node = AddPath(root, link, lineno);
+      if (!node->children.empty()) {
+        DIE("a path is a prefix of another: line %d: '%s'\n", lineno, buf);
+      }
       if (target[0] == '\0') {
         // No target means an empty file.
-        info->type = FILE_TYPE_REGULAR;
+        node->info.type = FILE_TYPE_REGULAR;
+        node->info.symlink_target.clear();
       } else {
-        info->type = FILE_TYPE_SYMLINK;
-        info->symlink_target = target;
+        node->info.type = FILE_TYPE_SYMLINK;
+        node->info.symlink_target = target;
+      }
+      if (root == &root_) {
+        entries_++;
+        if (index_) {
+          index_entries_.emplace_back(std::move(link), std::move(target));
+        }
       }
+    }
+    return digest;
+  }
 
-      FileInfo parent_info;
-      parent_info.type = FILE_TYPE_DIRECTORY;
+  // Writes MANIFEST.index for the entries of the manifest, which has to be in
+  // place already. Writes nothing if the strings don't fit the 32-bit offsets.
+  void WriteIndex() {
+    struct stat st;
+    if (stat(output_filename_.c_str(), &st) != 0) {
+      PDIE("stat '%s/%s'", output_base_.c_str(), output_filename_.c_str());
+    }
 
-      while (true) {
-        int k = link.rfind('/');
-        if (k < 0) break;
-        link.erase(k, std::string::npos);
-        if (!manifest_.insert(std::make_pair(link, parent_info)).second) break;
+    // Later lines for the same link override earlier ones.
+    std::vector<std::pair<std::string, std::string>> &entries = index_entries_;
+    std::stable_sort(
+        entries.begin(), entries.end(),
+        [](const std::pair<std::string, std::string> &a,
+           const std::pair<std::string, std::string> &b) {
+          return a.first < b.first;
+        });
+    size_t kept = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+      if (i + 1 < entries.size() && entries[i].first == entries[i + 1].first) {
+        continue;
+      }
+      if (kept != i) {
+        entries[kept] = std::move(entries[i]);
       }
+      ++kept;
     }
-    if (fclose(outfile) != 0) {
-      PDIE("writing to '%s/%s'", output_base_.c_str(),
-           temp_filename_.c_str());
+    entries.resize(kept);
+
+    std::vector<RunfilesIndexEntry> index(entries.size());
+    std::string strings;
+    std::unordered_map<std::string, uint32_t> targets;
+    for (size_t i = 0; i < entries.size(); ++i) {
+      if (strings.size() + entries[i].first.size() +
+              entries[i].second.size() > UINT32_MAX) {
+        return;
+      }
+      index[i].link = strings.size();
+      index[i].link_size = entries[i].first.size();
+      strings += entries[i].first;
+      auto target = targets.emplace(entries[i].second, strings.size());
+      if (target.second) {
+        strings += entries[i].second;
+      }
+      index[i].target = target.first->second;
+      index[i].target_size = entries[i].second.size();
     }
-    fclose(infile);
 
-    // Don't delete the temp manifest file.
-    manifest_[temp_filename_].type = FILE_TYPE_REGULAR;
+    uint32_t bucket_count = 1;
+    while (bucket_count < 2 * entries.size()) {
+      bucket_count *= 2;
+    }
+    std::vector<uint32_t> buckets(bucket_count);
+    for (size_t i = 0; i < entries.size(); ++i) {
+      uint32_t slot =
+          RunfilesIndexHash(entries[i].first.data(), entries[i].first.size());
+      while (buckets[slot & (bucket_count - 1)] != 0) {
+        ++slot;
+      }
+      buckets[slot & (bucket_count - 1)] = i + 1;
+    }
+
+    RunfilesIndexHeader header;
+    memcpy(header.magic, kRunfilesIndexMagic, sizeof header.magic);
+    header.entry_count = entries.size();
+    header.bucket_count = bucket_count;
+    header.strings_size = strings.size();
+    header.manifest_size = st.st_size;
+    header.manifest_mtime_sec = ST_MTIM(st).tv_sec;
+    header.manifest_mtime_nsec = ST_MTIM(st).tv_nsec;
+
+    const std::string temp_filename = index_filename_ + ".tmp";
+    FILE *outfile = fopen(temp_filename.c_str(), "w");
+    if (!outfile ||
+        fwrite(&header, sizeof header, 1, outfile) != 1 ||
+        fwrite(index.data(), sizeof(RunfilesIndexEntry), index.size(),
+               outfile) != index.size() ||
+        fwrite(buckets.data(), sizeof(uint32_t), buckets.size(), outfile) !=
+            buckets.size() ||
+        fwrite(strings.data(), 1, strings.size(), outfile) != strings.size() ||
+        fclose(outfile) != 0) {
+      PDIE("writing to '%s/%s'", output_base_.c_str(), temp_filename.c_str());
+    }
+    if (rename(temp_filename.c_str(), index_filename_.c_str()) != 0) {
+      PDIE("renaming '%s/%s' to '%s/%s'", output_base_.c_str(),
+           temp_filename.c_str(), output_base_.c_str(),
+           index_filename_.c_str());
+    }
   }
 
-  void CreateRunfiles() {
-    if (unlink(output_filename_.c_str()) != 0 && errno != ENOENT) {
-      PDIE("removing previous file at '%s/%s'", output_base_.c_str(),
-           output_filename_.c_str());
+  // Replaces the largest directories of the tree at `root` that can be shared
+  // with symlinks into the store, remembering their entries for
+  // CreateSharedSubtrees if `create`.
+  void ShareSubtrees(ManifestNode *root, bool create) {
+    size_t entries;
+    FindSharedSubtrees(root, true, create, &entries);
+  }
+
+  // Returns whether the directory `node`, unless it is the `root` of the
+  // tree, can be shared as a whole, and puts the number of its entries into
+  // `entries`. Otherwise replaces those of its subdirectories that can.
+  bool FindSharedSubtrees(ManifestNode *node, bool root, bool create,
+                          size_t *entries) {
+    // The subdirectories that can be shared, and their number of entries.
+    std::vector<std::pair<std::unique_ptr<ManifestNode> *, size_t>> shareable;
+    bool all_shareable = true;
+    *entries = 0;
+    for (auto &it : node->children) {
+      const FileInfo &info = it.second->info;
+      if (info.type == FILE_TYPE_DIRECTORY) {
+        size_t child_entries;
+        if (FindSharedSubtrees(it.second.get(), false, create,
+                               &child_entries)) {
+          shareable.emplace_back(&it.second, child_entries);
+          *entries += child_entries;
+        } else {
+          all_shareable = false;
+        }
+        continue;
+      }
+      // A relative symlink would resolve in the store instead.
+      if (info.type == FILE_TYPE_SYMLINK && info.symlink_target[0] != '/') {
+        all_shareable = false;
+      }
+      ++*entries;
+    }
+    if (all_shareable && !root) {
+      return true;
     }
+    for (auto &it : shareable) {
+      if (it.second >= kMinSharedEntries) {
+        ShareSubtree(it.first, create);
+      }
+    }
+    return false;
+  }
 
-    ScanTreeAndPrune(".");
-    CreateFiles();
+  // Replaces the directory in `slot` with a symlink to its copy in the store.
+  void ShareSubtree(std::unique_ptr<ManifestNode> *slot, bool create) {
+    blaze_util::Md5Digest md5;
+    DigestSubtree(**slot, "", &md5);
+    unsigned char digest[blaze_util::Md5Digest::kDigestLength];
+    md5.Finish(digest);
+    std::unique_ptr<ManifestNode> link(new ManifestNode());
+    link->info.type = FILE_TYPE_SYMLINK;
+    link->info.symlink_target = shared_subtrees_ + '/' + md5.String();
+    if (create) {
+      shared_.push_back({md5.String(), std::move(*slot)});
+    }
+    *slot = std::move(link);
+  }
 
-    // rename output file into place
-    if (rename(temp_filename_.c_str(), output_filename_.c_str()) != 0) {
-      PDIE("renaming '%s/%s' to '%s/%s'",
-           output_base_.c_str(), temp_filename_.c_str(),
-           output_base_.c_str(), output_filename_.c_str());
+  // Digests the entries of the directory `node`, which is at `prefix` in the
+  // shared directory, in the order of their names.
+  static void DigestSubtree(const ManifestNode &node,
+                            const std::string &prefix,
+                            blaze_util::Md5Digest *md5) {
+    typedef std::pair<const std::string *, const ManifestNode *> Child;
+    std::vector<Child> children;
+    for (const auto &it : node.children) {
+      children.emplace_back(&it.first, it.second.get());
+    }
+    std::sort(children.begin(), children.end(),
+              [](const Child &a, const Child &b) {
+                return *a.first < *b.first;
+              });
+    for (const auto &child : children) {
+      const std::string path = prefix + *child.first;
+      if (child.second->info.type == FILE_TYPE_DIRECTORY) {
+        DigestSubtree(*child.second, path + '/', md5);
+        continue;
+      }
+      // Neither paths nor targets contain NULs.
+      const std::string &target = child.second->info.symlink_target;
+      const char type =
+          child.second->info.type == FILE_TYPE_SYMLINK ? 'l' : 'f';
+      md5->Update(&type, 1);
+      md5->Update(path.c_str(), path.size() + 1);
+      md5->Update(target.c_str(), target.size() + 1);
+    }
+  }
+
+  // Creates the directories that the tree links to and the store doesn't
+  // have yet.
+  void CreateSharedSubtrees() {
+    if (shared_.empty()) {
+      return;
+    }
+    PhaseTimer timer(PHASE_CREATE);
+    const char *store_path = shared_subtrees_.c_str();
+    CountCall(CALL_MKDIR);
+    if (mkdir(store_path, 0777) != 0 && errno != EEXIST) {
+      PDIE("creating directory '%s'", store_path);
+    }
+    CountCall(CALL_OPEN);
+    int store = open(store_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (store < 0) {
+      PDIE("opendir '%s'", store_path);
+    }
+    for (const SharedSubtree &subtree : shared_) {
+      const char *name = subtree.name.c_str();
+      struct stat st;
+      CountCall(CALL_STAT);
+      if (fstatat(store, name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+        continue;
+      }
+      // Concurrent runs that create the same directory each do so under a
+      // name of their own, so that the first to finish renames a complete
+      // one into place.
+      const std::string temp = subtree.name + ".tmp." +
+                               std::to_string(static_cast<long>(getpid()));
+      const std::string temp_path = JoinPath(shared_subtrees_, temp.c_str());
+      CountCall(CALL_MKDIR);
+      if (mkdirat(store, temp.c_str(), 0777) != 0) {
+        if (errno != EEXIST) {
+          PDIE("mkdir '%s'", temp_path.c_str());
+        }
+        // Left behind by a run that died.
+        DelTree(store, shared_subtrees_, temp.c_str(), FILE_TYPE_DIRECTORY);
+        CountCall(CALL_MKDIR);
+        if (mkdirat(store, temp.c_str(), 0777) != 0) {
+          PDIE("mkdir '%s'", temp_path.c_str());
+        }
+      }
+      CountCall(CALL_OPEN);
+      int fd = openat(store, temp.c_str(),
+                      O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+      if (fd < 0) {
+        PDIE("opendir '%s'", temp_path.c_str());
+      }
+      PopulateSharedSubtree(fd, temp_path, *subtree.node);
+      close(fd);
+      if (renameat(store, temp.c_str(), store, name) != 0) {
+        if (errno != EEXIST && errno != ENOTEMPTY) {
+          PDIE("renaming '%s' to '%s/%s'", temp_path.c_str(), store_path,
+               name);
+        }
+        // Another run was first.
+        DelTree(store, shared_subtrees_, temp.c_str(), FILE_TYPE_DIRECTORY);
+      }
+    }
+    close(store);
+  }
+
+  // Creates the entries of the directory `node` in the empty directory
+  // `dirfd`, which is at `path`.
+  void PopulateSharedSubtree(int dirfd, const std::string &path,
+                             const ManifestNode &node) {
+    for (const auto &it : node.children) {
+      const char *name = it.first.c_str();
+      const FileInfo &info = it.second->info;
+      switch (info.type) {
+        case FILE_TYPE_DIRECTORY: {
+          const std::string child_path = JoinPath(path, name);
+          CountCall(CALL_MKDIR);
+          if (mkdirat(dirfd, name, 0777) != 0) {
+            PDIE("mkdir '%s'", child_path.c_str());
+          }
+          CountCall(CALL_OPEN);
+          int fd = openat(dirfd, name,
+                          O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+          if (fd < 0) {
+            PDIE("opendir '%s'", child_path.c_str());
+          }
+          PopulateSharedSubtree(fd, child_path, *it.second);
+          close(fd);
+          break;
+        }
+        case FILE_TYPE_REGULAR: {
+          CountCall(CALL_OPEN);
+          int fd = openat(dirfd, name,
+                          O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0555);
+          if (fd < 0) {
+            PDIE("creating empty file '%s'", JoinPath(path, name).c_str());
+          }
+          close(fd);
+          break;
+        }
+        case FILE_TYPE_SYMLINK:
+          CountCall(CALL_SYMLINK);
+          if (symlinkat(info.symlink_target.c_str(), dirfd, name) != 0) {
+            PDIE("symlinking '%s' -> '%s'", JoinPath(path, name).c_str(),
+                 info.symlink_target.c_str());
+          }
+          break;
+      }
     }
   }
 
- private:
   void SetupOutputBase() {
     struct stat st;
     if (stat(output_base_.c_str(), &st) != 0) {
@@ -271,53 +1002,252 @@ class RunfilesCreator {
         PDIE("creating directory '%s'", output_base_.c_str());
       }
     } else {
-      EnsureDirReadAndWritePerms(output_base_);
+      EnsureDirReadAndWritePerms(AT_FDCWD, output_base_.c_str(), output_base_);
     }
   }
 
-  void ScanTreeAndPrune(const std::string &path) {
+  // Returns the entry for `link` in the tree at `root`, adding it and its
+  // parent directories as needed.
+  ManifestNode *AddPath(ManifestNode *root, const std::string &link,
+                        int lineno) {
+    ManifestNode *node = root;
+    size_t start = 0;
+    while (true) {
+      if (node->info.type != FILE_TYPE_DIRECTORY) {
+        DIE("a path is a prefix of another: line %d: '%s'\n", lineno,
+            link.c_str());
+      }
+      const size_t end = link.find('/', start);
+      std::unique_ptr<ManifestNode> &child =
+          node->children[link.substr(start, end - start)];
+      if (!child) {
+        child.reset(new ManifestNode());
+        child->info.type = FILE_TYPE_DIRECTORY;
+      }
+      node = child.get();
+      if (end == std::string::npos) {
+        return node;
+      }
+      start = end + 1;
+    }
+  }
+
+  // Reconciles the tree with the manifest on `jobs` threads, by applying the
+  // differences to `previous` unless that is null.
+  void Reconcile(int jobs, const ManifestNode *previous) {
+    root_.previous = previous;
+    // The main thread works on the directories too, while it waits.
+    blaze_util::TaskPool pool(jobs - 1);
+    blaze_util::TaskGroup directories(&pool);
+    directories_ = &directories;
+    QueueDirectory({".", &root_, true});
+    directories.Wait();
+    directories_ = nullptr;
+  }
+
+  static void ResetTree(ManifestNode *node) {
+    node->exists = false;
+    node->previous = nullptr;
+    for (auto &it : node->children) {
+      ResetTree(it.second.get());
+    }
+  }
+
+  // Reconciles the directory on the pool. The subdirectories it queues are
+  // taken by the same thread first, so the tree is walked depth first, and
+  // idle threads take the oldest ones, which are the highest in the tree.
+  void QueueDirectory(DirectoryTask task) {
+    directories_->Run(
+        [this, task = std::move(task)]() { ReconcileDirectory(task); });
+  }
+
+  // Removes what doesn't belong into the directory, creates its missing files
+  // and queues its subdirectories.
+  void ReconcileDirectory(const DirectoryTask &task) {
+    PhaseTimer scan_timer(PHASE_SCAN);
+    const std::string &path = task.path;
+    ManifestNode *node = task.node;
+    // When applying the differences, the directory may be gone already.
+    LazyDirectory dir(path, node->previous != nullptr);
+    if (task.exists) {
+      if (node->previous) {
+        PruneChanges(&dir, path, node);
+      } else {
+        ScanAndPrune(dir.fd(), path, node);
+      }
+    }
+
+    for (auto &it : node->children) {
+      const char *name = it.first.c_str();
+      ManifestNode *child = it.second.get();
+      if (child->exists || child->keep) {
+        if (child->info.type == FILE_TYPE_DIRECTORY) {
+          QueueDirectory({JoinPath(path, name), child, true});
+        }
+        continue;
+      }
+      const int dirfd = dir.fd();
+      if (dirfd < 0) {
+        stale_ = true;
+        return;
+      }
+      PhaseTimer create_timer(PHASE_CREATE);
+      bool created = true;
+      switch (child->info.type) {
+        case FILE_TYPE_DIRECTORY:
+          CountCall(CALL_MKDIR);
+          if (mkdirat(dirfd, name, 0777) != 0) {
+            created = false;
+          } else {
+            QueueDirectory({JoinPath(path, name), child, false});
+          }
+          break;
+        case FILE_TYPE_REGULAR: {
+          CountCall(CALL_OPEN);
+          int fd = openat(dirfd, name,
+                          O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0555);
+          if (fd < 0) {
+            created = false;
+          } else {
+            close(fd);
+          }
+          break;
+        }
+        case FILE_TYPE_SYMLINK:
+          if (!materialize_) {
+            CountCall(CALL_SYMLINK);
+          }
+          created = materialize_
+                        ? Materialize(dirfd, path, name, child->info)
+                        : symlinkat(child->info.symlink_target.c_str(), dirfd,
+                                    name) == 0;
+          break;
+      }
+      if (!created) {
+        if (node->previous && errno == EEXIST) {
+          // The tree has an entry that the previous manifest doesn't.
+          stale_ = true;
+          continue;
+        }
+        const std::string child_path = JoinPath(path, name);
+        switch (child->info.type) {
+          case FILE_TYPE_DIRECTORY:
+            PDIE("mkdir '%s'", child_path.c_str());
+          case FILE_TYPE_REGULAR:
+            PDIE("creating empty file '%s'", child_path.c_str());
+          case FILE_TYPE_SYMLINK:
+            PDIE("symlinking '%s' -> '%s'", child_path.c_str(),
+                 child->info.symlink_target.c_str());
+        }
+      }
+    }
+  }
+
+  // Removes the entries of the previous manifest that the new one has
+  // changed or dropped, and marks the others as existing.
+  void PruneChanges(LazyDirectory *dir, const std::string &path,
+                    ManifestNode *node) {
+    for (const auto &it : node->previous->children) {
+      const char *name = it.first.c_str();
+      const ManifestNode *previous = it.second.get();
+      if (previous->keep) {
+        continue;
+      }
+      auto expected_it = node->children.find(it.first);
+      const bool unchanged = expected_it != node->children.end() &&
+                             expected_it->second->info == previous->info;
+      if (unchanged && !(materialize_ &&
+                         previous->info.type == FILE_TYPE_SYMLINK)) {
+        expected_it->second->exists = true;
+        expected_it->second->previous = previous;
+        continue;
+      }
+
+      struct stat st;
+      CountCall(CALL_STAT);
+      if (dir->fd() < 0 ||
+          fstatat(dir->fd(), name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+        // The tree doesn't have the entry as the previous manifest does.
+        stale_ = true;
+        continue;
+      }
+      FileType actual_type = StatToFileType(st);
+      if (unchanged) {
+        // The file that the entry was made from may have changed since.
+        struct stat target;
+        if (actual_type == FILE_TYPE_SYMLINK
+                ? !IsMaterializable(previous->info, &target)
+                : IsMaterialized(st, previous->info)) {
+          expected_it->second->exists = true;
+          continue;
+        }
+      } else if (actual_type != previous->info.type &&
+                 !(materialize_ && actual_type == FILE_TYPE_REGULAR &&
+                   previous->info.type == FILE_TYPE_SYMLINK)) {
+        stale_ = true;
+        continue;
+      }
+      DelTree(dir->fd(), path, name, actual_type);
+    }
+  }
+
+  void ScanAndPrune(int dirfd, const std::string &path, ManifestNode *node) {
     // A note on non-empty files:
     // We don't distinguish between empty and non-empty files. That is, if
     // there's a file that has contents, we don't truncate it here, even though
     // the manifest supports creation of empty files, only. Given that
     // .runfiles are *supposed* to be immutable, this shouldn't be a problem.
-    EnsureDirReadAndWritePerms(path);
+    DIR *dh = OpenDirOrDie(dirfd, path);
 
     struct dirent *entry;
-    DIR *dh = opendir(path.c_str());
-    if (!dh) {
-      PDIE("opendir '%s'", path.c_str());
-    }
-
     errno = 0;
-    const std::string prefix = (path == "." ? "" : path + "/");
     while ((entry = readdir(dh)) != nullptr) {
+      CountCall(CALL_DIRENT);
       if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) continue;
 
-      std::string entry_path = prefix + entry->d_name;
       FileInfo actual_info;
-      actual_info.type = DentryToFileType(entry_path, entry);
+      actual_info.type = DentryToFileType(dirfd, path, entry);
 
       if (actual_info.type == FILE_TYPE_SYMLINK) {
-        ReadLinkOrDie(entry_path, &actual_info.symlink_target);
+        ReadLinkOrDie(dirfd, path, entry->d_name, &actual_info.symlink_target);
       }
 
-      FileInfoMap::iterator expected_it = manifest_.find(entry_path);
-      if (expected_it == manifest_.end() ||
-          expected_it->second != actual_info) {
+      auto expected_it = node->children.find(entry->d_name);
+      if (expected_it != node->children.end() && expected_it->second->keep) {
+        errno = 0;
+        continue;
+      }
+      if (materialize_ && actual_info.type == FILE_TYPE_REGULAR &&
+          expected_it != node->children.end() &&
+          expected_it->second->info.type == FILE_TYPE_SYMLINK) {
+        struct stat st;
+        LStatOrDie(dirfd, entry->d_name, JoinPath(path, entry->d_name), &st);
+        if (IsMaterialized(st, expected_it->second->info)) {
+          expected_it->second->exists = true;
+          errno = 0;
+          continue;
+        }
+      }
+      struct stat target;
+      if (expected_it == node->children.end() ||
+          expected_it->second->info != actual_info ||
+          (materialize_ && actual_info.type == FILE_TYPE_SYMLINK &&
+           IsMaterializable(actual_info, &target))) {
 #if !defined(__CYGWIN__)
-        DelTree(entry_path, actual_info.type);
+        DelTree(dirfd, path, entry->d_name, actual_info.type);
 #else
         // On Windows, if deleting failed, lamely assume that
         // the link points to the right place.
-        if (!DelTree(entry_path, actual_info.type)) {
-          manifest_.erase(expected_it);
+        if (!DelTree(dirfd, path, entry->d_name, actual_info.type) &&
+            expected_it != node->children.end()) {
+          expected_it->second->exists = true;
         }
 #endif
       } else {
-        manifest_.erase(expected_it);
+        expected_it->second->exists = true;
         if (actual_info.type == FILE_TYPE_DIRECTORY) {
-          ScanTreeAndPrune(entry_path);
+          EnsureDirReadAndWritePerms(dirfd, entry->d_name,
+                                     JoinPath(path, entry->d_name));
         }
       }
 
@@ -329,38 +1259,130 @@ class RunfilesCreator {
     closedir(dh);
   }
 
-  void CreateFiles() {
-    for (FileInfoMap::const_iterator it = manifest_.begin();
-         it != manifest_.end(); ++it) {
-      const std::string &path = it->first;
-      switch (it->second.type) {
-        case FILE_TYPE_DIRECTORY:
-          if (mkdir(path.c_str(), 0777) != 0) {
-            PDIE("mkdir '%s'", path.c_str());
-          }
-          break;
-        case FILE_TYPE_REGULAR:
-          {
-            int fd = open(path.c_str(), O_CREAT|O_EXCL|O_WRONLY, 0555);
-            if (fd < 0) {
-              PDIE("creating empty file '%s'", path.c_str());
-            }
-            close(fd);
-          }
-          break;
-        case FILE_TYPE_SYMLINK:
-          {
-            const std::string& target = it->second.symlink_target;
-            if (symlink(target.c_str(), path.c_str()) != 0) {
-              PDIE("symlinking '%s' -> '%s'", path.c_str(), target.c_str());
-            }
-          }
-          break;
+  // Returns whether the file `st` is the materialized form of the symlink
+  // `info`: a hardlink to its target, or a copy that has the size and
+  // modification time of the target.
+  static bool IsMaterialized(const struct stat &st, const FileInfo &info) {
+    struct stat target;
+    if (!S_ISREG(st.st_mode) || !IsMaterializable(info, &target)) {
+      return false;
+    }
+    if (st.st_dev == target.st_dev && st.st_ino == target.st_ino) {
+      return true;
+    }
+    return st.st_size == target.st_size &&
+           ST_MTIM(st).tv_sec == ST_MTIM(target).tv_sec &&
+           ST_MTIM(st).tv_nsec == ST_MTIM(target).tv_nsec;
+  }
+
+  // Returns whether the symlink `info` is materialized: whether its target is
+  // a regular file with an absolute path, whose status is put into `target`.
+  static bool IsMaterializable(const FileInfo &info, struct stat *target) {
+    const char *path = info.symlink_target.c_str();
+    if (path[0] != '/') {
+      return false;
+    }
+    CountCall(CALL_STAT);
+    return stat(path, target) == 0 &&
+           S_ISREG(target->st_mode);
+  }
+
+  // Creates `name` in `dirfd` as a hardlink to the target of the symlink
+  // `info`, or as a clone or a copy of it where hardlinks are not possible.
+  // Creates the symlink itself for a target that is not a regular file with
+  // an absolute path. Returns false with errno set if `name` exists already.
+  bool Materialize(int dirfd, const std::string &dir, const char *name,
+                   const FileInfo &info) {
+    const char *target = info.symlink_target.c_str();
+    struct stat st;
+    if (!IsMaterializable(info, &st)) {
+      CountCall(CALL_SYMLINK);
+      return symlinkat(target, dirfd, name) == 0;
+    }
+    CountCall(CALL_LINK);
+    if (linkat(AT_FDCWD, target, dirfd, name, AT_SYMLINK_FOLLOW) == 0) {
+      return true;
+    }
+    if (errno != EXDEV && errno != EPERM && errno != EMLINK) {
+      return false;
+    }
+
+    // The copy is read-only, like the files that Bazel creates.
+    const std::string path = JoinPath(dir, name);
+#if defined(__APPLE__)
+    // APFS makes the clone in one call, sharing the data of the target.
+    CountCall(CALL_LINK);
+    if (clonefileat(AT_FDCWD, target, dirfd, name, 0) == 0) {
+      CountCall(CALL_CHMOD);
+      if (fchmodat(dirfd, name, st.st_mode & 0555, 0) != 0) {
+        PDIE("chmod '%s'", path.c_str());
+      }
+      // Like for copies below.
+      struct timespec times[2] = {ST_MTIM(st), ST_MTIM(st)};
+      if (utimensat(dirfd, name, times, 0) != 0) {
+        PDIE("setting the modification time of '%s'", path.c_str());
+      }
+      return true;
+    }
+    if (errno == EEXIST) {
+      return false;
+    }
+#endif
+    CountCall(CALL_OPEN);
+    int out = openat(dirfd, name, O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC,
+                     st.st_mode & 0555);
+    if (out < 0) {
+      return false;
+    }
+    CountCall(CALL_OPEN);
+    int in = open(target, O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+      PDIE("opening '%s' for reading", target);
+    }
+#if defined(FICLONE)
+    bool cloned = ioctl(out, FICLONE, in) == 0;
+#else
+    bool cloned = false;
+#endif
+    if (!cloned) {
+      char buf[128 * 1024];
+      ssize_t n;
+      while ((n = read(in, buf, sizeof buf)) != 0) {
+        if (n < 0) {
+          PDIE("reading '%s'", target);
+        }
+        if (write(out, buf, n) != n) {
+          PDIE("writing to '%s'", path.c_str());
+        }
       }
     }
+    // Keep the modification time of the target, by which IsMaterialized
+    // recognizes the copy.
+    struct timespec times[2] = {ST_MTIM(st), ST_MTIM(st)};
+    if (futimens(out, times) != 0) {
+      PDIE("setting the modification time of '%s'", path.c_str());
+    }
+    close(in);
+    if (close(out) != 0) {
+      PDIE("writing to '%s'", path.c_str());
+    }
+    return true;
   }
 
-  FileType DentryToFileType(const std::string &path, struct dirent *ent) {
+  // Opens a stream for the entries of the directory `dirfd`, leaving `dirfd`
+  // open.
+  DIR *OpenDirOrDie(int dirfd, const std::string &path) {
+    CountCall(CALL_OPEN);
+    int fd = openat(dirfd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR *dh = fd < 0 ? nullptr : fdopendir(fd);
+    if (!dh) {
+      PDIE("opendir '%s'", path.c_str());
+    }
+    return dh;
+  }
+
+  FileType DentryToFileType(int dirfd, const std::string &dir,
+                            struct dirent *ent) {
 #ifdef _DIRENT_HAVE_D_TYPE
     if (ent->d_type != DT_UNKNOWN) {
       if (ent->d_type == DT_DIR) {
@@ -374,82 +1396,97 @@ class RunfilesCreator {
 #endif
     {
       struct stat st;
-      LStatOrDie(path, &st);
-      if (S_ISDIR(st.st_mode)) {
-        return FILE_TYPE_DIRECTORY;
-      } else if (S_ISLNK(st.st_mode)) {
-        return FILE_TYPE_SYMLINK;
-      } else {
-        return FILE_TYPE_REGULAR;
-      }
+      LStatOrDie(dirfd, ent->d_name, JoinPath(dir, ent->d_name), &st);
+      return StatToFileType(st);
     }
   }
 
-  void LStatOrDie(const std::string &path, struct stat *st) {
-    if (lstat(path.c_str(), st) != 0) {
-      PDIE("lstating file '%s'", path.c_str());
+  static FileType StatToFileType(const struct stat &st) {
+    if (S_ISDIR(st.st_mode)) {
+      return FILE_TYPE_DIRECTORY;
+    } else if (S_ISLNK(st.st_mode)) {
+      return FILE_TYPE_SYMLINK;
+    } else {
+      return FILE_TYPE_REGULAR;
     }
   }
 
-  void StatOrDie(const std::string &path, struct stat *st) {
-    if (stat(path.c_str(), st) != 0) {
-      PDIE("stating file '%s'", path.c_str());
+  // The functions below take the path of `name` in `dirfd` for their error
+  // messages.
+
+  void LStatOrDie(int dirfd, const char *name, const std::string &path,
+                  struct stat *st) {
+    CountCall(CALL_STAT);
+    if (fstatat(dirfd, name, st, AT_SYMLINK_NOFOLLOW) != 0) {
+      PDIE("lstating file '%s'", path.c_str());
     }
   }
 
-  void ReadLinkOrDie(const std::string &path, std::string *output) {
+  void ReadLinkOrDie(int dirfd, const std::string &dir, const char *name,
+                     std::string *output) {
     char readlink_buffer[PATH_MAX];
-    int sz = readlink(path.c_str(), readlink_buffer, sizeof(readlink_buffer));
+    CountCall(CALL_READLINK);
+    int sz = readlinkat(dirfd, name, readlink_buffer, sizeof(readlink_buffer));
     if (sz < 0) {
-      PDIE("reading symlink '%s'", path.c_str());
+      PDIE("reading symlink '%s'", JoinPath(dir, name).c_str());
     }
     // readlink returns a non-null terminated string.
     std::string(readlink_buffer, sz).swap(*output);
   }
 
-  void EnsureDirReadAndWritePerms(const std::string &path) {
+  void EnsureDirReadAndWritePerms(int dirfd, const char *name,
+                                  const std::string &path) {
     const int kMode = 0700;
     struct stat st;
-    LStatOrDie(path, &st);
+    LStatOrDie(dirfd, name, path, &st);
     if ((st.st_mode & kMode) != kMode) {
       int new_mode = st.st_mode | kMode;
-      if (chmod(path.c_str(), new_mode) != 0) {
+      CountCall(CALL_CHMOD);
+      if (fchmodat(dirfd, name, new_mode, 0) != 0) {
         PDIE("chmod '%s'", path.c_str());
       }
     }
   }
 
-  bool DelTree(const std::string &path, FileType file_type) {
+  bool DelTree(int dirfd, const std::string &dir, const char *name,
+               FileType file_type) {
+    PhaseTimer timer(PHASE_DELETE);
     if (file_type != FILE_TYPE_DIRECTORY) {
-      if (unlink(path.c_str()) != 0) {
+      CountCall(CALL_UNLINK);
+      if (unlinkat(dirfd, name, 0) != 0) {
 #if !defined(__CYGWIN__)
-        PDIE("unlinking '%s'", path.c_str());
+        PDIE("unlinking '%s'", JoinPath(dir, name).c_str());
 #endif
         return false;
       }
       return true;
     }
 
-    EnsureDirReadAndWritePerms(path);
+    const std::string path = JoinPath(dir, name);
+    EnsureDirReadAndWritePerms(dirfd, name, path);
 
-    struct dirent *entry;
-    DIR *dh = opendir(path.c_str());
+    CountCall(CALL_OPEN);
+    int fd =
+        openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    DIR *dh = fd < 0 ? nullptr : fdopendir(fd);
     if (!dh) {
       PDIE("opendir '%s'", path.c_str());
     }
+    struct dirent *entry;
     errno = 0;
     while ((entry = readdir(dh)) != nullptr) {
+      CountCall(CALL_DIRENT);
       if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) continue;
-      const std::string entry_path = path + '/' + entry->d_name;
-      FileType entry_file_type = DentryToFileType(entry_path, entry);
-      DelTree(entry_path, entry_file_type);
+      FileType entry_file_type = DentryToFileType(fd, path, entry);
+      DelTree(fd, path, entry->d_name, entry_file_type);
       errno = 0;
     }
     if (errno != 0) {
       PDIE("readdir '%s'", path.c_str());
     }
     closedir(dh);
-    if (rmdir(path.c_str()) != 0) {
+    CountCall(CALL_UNLINK);
+    if (unlinkat(dirfd, name, AT_REMOVEDIR) != 0) {
       PDIE("rmdir '%s'", path.c_str());
     }
     return true;
@@ -459,8 +1496,34 @@ class RunfilesCreator {
   std::string output_base_;
   std::string output_filename_;
   std::string temp_filename_;
+  std::string digest_filename_;
+  std::string index_filename_;
+  const bool materialize_;
 
-  FileInfoMap manifest_;
+  // Whether to write MANIFEST.index, and the entries to write into it.
+  bool index_ = false;
+  std::vector<std::pair<std::string, std::string>> index_entries_;
+
+  // The store of --shared_subtrees, if any, and the directories of the
+  // manifest to create in it.
+  std::string shared_subtrees_;
+  std::vector<SharedSubtree> shared_;
+
+  // Whether to apply the differences to the previous manifest, if there is
+  // one, and to write the digest of the new one.
+  bool incremental_ = false;
+  std::unique_ptr<ManifestNode> previous_root_;
+  // The digest line of the new manifest.
+  std::string digest_;
+  // Set when applying the differences finds that the tree doesn't match the
+  // previous manifest.
+  std::atomic<bool> stale_{false};
+
+  // The output directory and, through it, the whole manifest.
+  ManifestNode root_;
+  size_t entries_ = 0;
+  // The directories being reconciled.
+  blaze_util::TaskGroup *directories_ = nullptr;
 };
 
 int main(int argc, char **argv) {
@@ -469,6 +1532,12 @@ int main(int argc, char **argv) {
   argc--; argv++;
   bool allow_relative = false;
   bool use_metadata = false;
+  bool incremental = false;
+  bool materialize = false;
+  bool index = false;
+  const char *shared_subtrees = nullptr;
+  int jobs = 0;
+  const uint64_t start = NowNanos();
 
   while (argc >= 1) {
     if (strcmp(argv[0], "--allow_relative") == 0) {
@@ -477,15 +1546,34 @@ int main(int argc, char **argv) {
     } else if (strcmp(argv[0], "--use_metadata") == 0) {
       use_metadata = true;
       argc--; argv++;
+    } else if (strcmp(argv[0], "--incremental") == 0) {
+      incremental = true;
+      argc--; argv++;
+    } else if (strcmp(argv[0], "--materialize") == 0) {
+      materialize = true;
+      argc--; argv++;
+    } else if (strcmp(argv[0], "--index") == 0) {
+      index = true;
+      argc--; argv++;
+    } else if (strncmp(argv[0], "--shared_subtrees=", 18) == 0) {
+      shared_subtrees = argv[0] + 18;
+      argc--; argv++;
+    } else if (strcmp(argv[0], "--stats") == 0) {
+      stats = true;
+      argc--; argv++;
+    } else if (strncmp(argv[0], "--jobs=", 7) == 0) {
+      jobs = atoi(argv[0] + 7);
+      argc--; argv++;
     } else {
       break;
     }
   }
 
-  if (argc != 2) {
+  if (argc != 2 || (shared_subtrees && (!*shared_subtrees || materialize))) {
     fprintf(stderr, "usage: %s "
-            "[--allow_relative] [--use_metadata] "
-            "INPUT RUNFILES\n",
+            "[--allow_relative] [--use_metadata] [--incremental] "
+            "[--materialize | --shared_subtrees=STORE] [--index] [--jobs=N] "
+            "[--stats] INPUT RUNFILES\n",
             argv0);
     return 1;
   }
@@ -493,18 +1581,37 @@ int main(int argc, char **argv) {
   input_filename = argv[0];
   output_base_dir = argv[1];
 
+  char cwd_buf[PATH_MAX];
+  if (getcwd(cwd_buf, sizeof(cwd_buf)) == nullptr) {
+    PDIE("getcwd failed");
+  }
   std::string manifest_file = input_filename;
   if (input_filename[0] != '/') {
-    char cwd_buf[PATH_MAX];
-    if (getcwd(cwd_buf, sizeof(cwd_buf)) == nullptr) {
-      PDIE("getcwd failed");
-    }
     manifest_file = std::string(cwd_buf) + '/' + manifest_file;
   }
 
-  RunfilesCreator runfiles_creator(output_base_dir);
+  RunfilesCreator runfiles_creator(output_base_dir, materialize);
+  if (index) {
+    runfiles_creator.EnableIndex();
+  }
+  if (shared_subtrees) {
+    // The tree links into the store by absolute paths.
+    runfiles_creator.EnableSharedSubtrees(
+        shared_subtrees[0] == '/'
+            ? shared_subtrees
+            : std::string(cwd_buf) + '/' + shared_subtrees);
+  }
+  if (incremental) {
+    runfiles_creator.ReadPreviousManifest(allow_relative, use_metadata);
+  }
+  BAZEL_PROBE(build_runfiles, read_manifest_begin, manifest_file.c_str());
   runfiles_creator.ReadManifest(manifest_file, allow_relative, use_metadata);
-  runfiles_creator.CreateRunfiles();
+  BAZEL_PROBE(build_runfiles, read_manifest_end, runfiles_creator.entries());
+  runfiles_creator.CreateRunfiles(jobs);
+  BAZEL_PROBE(build_runfiles, create_runfiles_end, output_base_dir);
+  if (stats) {
+    PrintStats(start, runfiles_creator.entries());
+  }
 
   return 0;
 }
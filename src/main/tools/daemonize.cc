@@ -12,8 +12,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-// daemonize [-a] -l log_path -p pid_path [-c cgroup] -- binary_path binary_name
-// [args]
+// daemonize [-a] -l log_path -p pid_path [-c cgroup [-m memory_high]
+// [-M memory_max]] [-n numa_node] -- binary_path binary_name [args]
 //
 // daemonize spawns a program as a daemon, redirecting all of its output to the
 // given log_path and writing the daemon's PID to pid_path.  binary_path
@@ -23,6 +23,17 @@
 // is specified.  Also note that pid_path is guaranteed to exists when this
 // program terminates successfully.
 //
+// With -c, the daemon is moved into the given cgroup of every cgroup mount.
+// With -m or -M as well, on cgroup v2, it gets a sub-tree of that cgroup
+// instead, named after its pid: the daemon runs in its "server" leaf, the
+// server creates the cgroups of its actions next to it, and the memory.high
+// and memory.max of the sub-tree are set to the given values. Memory-heavy
+// builds are then throttled as a whole before they are OOM-killed.
+//
+// With -n, on Linux, the daemon runs on the CPUs of the given NUMA node and
+// prefers its memory, and so do the processes that it starts unless they
+// are bound elsewhere.
+//
 // Some important details about the implementation of this program:
 //
 // * No threads to ensure the use of fork below does not cause trouble.
@@ -37,6 +48,7 @@
 //   hit an error.
 
 #include <assert.h>
+#include <dirent.h>
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -46,6 +58,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -145,22 +158,155 @@ static void ExecAsDaemon(const char* log_path, bool log_append, int pid_done_fd,
 
   SetupStdio(log_path, log_append);
 
+  // The server gets nothing else of the client.
+  CloseFdsFrom(STDERR_FILENO + 1, -1, true);
+
   execv(exe, argv);
   err(EXIT_FAILURE, "Failed to execute %s", exe);
 }
 
 #ifdef __linux__
+// The limits of the cgroup v2 sub-tree, or NULL.
+struct CgroupLimits {
+  const char* memory_high;
+  const char* memory_max;
+};
+
+// Writes value to path, returning false with errno set instead of exiting if
+// it cannot.
+static bool TryWriteFile(const char* path, const char* value) {
+  int fd = open(path, O_WRONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return false;
+  }
+  bool ok = write(fd, value, strlen(value)) == (ssize_t)strlen(value);
+  int saved_errno = errno;
+  close(fd);
+  errno = saved_errno;
+  return ok;
+}
+
+// Removes the sub-trees left in parent by servers that are gone: those whose
+// server leaf is empty. The cgroups of actions still running make rmdir fail,
+// which leaves them be.
+static void RemoveStaleSubtrees(const char* parent) {
+  DIR* dir = opendir(parent);
+  if (dir == NULL) {
+    return;
+  }
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (strncmp(entry->d_name, "blaze_", 6) != 0) {
+      continue;
+    }
+    char* subtree;
+    char* events;
+    asprintf(&subtree, "%s/%s", parent, entry->d_name);
+    asprintf(&events, "%s/server/cgroup.events", subtree);
+    bool populated = true;
+    FILE* fp = fopen(events, "r");
+    if (fp != NULL) {
+      char* line = NULL;
+      size_t len = 0;
+      while (getline(&line, &len, fp) != -1) {
+        if (strcmp(line, "populated 0\n") == 0) {
+          populated = false;
+        }
+      }
+      free(line);
+      fclose(fp);
+    }
+    DIR* leaves = populated ? NULL : opendir(subtree);
+    if (leaves != NULL) {
+      struct dirent* leaf;
+      while ((leaf = readdir(leaves)) != NULL) {
+        if (leaf->d_type == DT_DIR && leaf->d_name[0] != '.') {
+          char* path;
+          asprintf(&path, "%s/%s", subtree, leaf->d_name);
+          rmdir(path);
+          free(path);
+        }
+      }
+      closedir(leaves);
+      rmdir(subtree);
+    }
+    free(events);
+    free(subtree);
+  }
+  closedir(dir);
+}
+
+// Moves the current process into the server leaf of a new sub-tree of
+// cgroup (see the top of the file). Returns false if the sub-tree cannot be
+// created, so that the process can be moved into cgroup itself instead.
+static bool MoveToCgroupSubtree(const char* cgroup,
+                                const struct CgroupLimits* limits) {
+  RemoveStaleSubtrees(cgroup);
+
+  char* subtree_control;
+  asprintf(&subtree_control, "%s/cgroup.subtree_control", cgroup);
+  bool ok = TryWriteFile(subtree_control, "+memory");
+  if (!ok) {
+    warn("Failed to enable the memory controller in %s", subtree_control);
+  } else {
+    // The cpu controller is only for the cgroups of the actions.
+    TryWriteFile(subtree_control, "+cpu");
+  }
+  free(subtree_control);
+
+  char* subtree;
+  asprintf(&subtree, "%s/blaze_%d", cgroup, getpid());
+  if (ok && mkdir(subtree, 0755) == -1) {
+    warn("Failed to create %s", subtree);
+    ok = false;
+  }
+  const char* files[] = {"memory.high", "memory.max"};
+  const char* values[] = {limits->memory_high, limits->memory_max};
+  for (int i = 0; ok && i < 2; i++) {
+    if (values[i] != NULL) {
+      char* path;
+      asprintf(&path, "%s/%s", subtree, files[i]);
+      ok = TryWriteFile(path, values[i]);
+      if (!ok) {
+        warn("Failed to write '%s' to %s", values[i], path);
+      }
+      free(path);
+    }
+  }
+
+  char* server;
+  asprintf(&server, "%s/server", subtree);
+  if (ok && mkdir(server, 0755) == -1) {
+    warn("Failed to create %s", server);
+    ok = false;
+  }
+  if (ok) {
+    char* procs_path;
+    asprintf(&procs_path, "%s/cgroup.procs", server);
+    WriteFile(procs_path, "%d", getpid());
+    free(procs_path);
+  } else {
+    rmdir(server);
+    rmdir(subtree);
+  }
+  free(server);
+  free(subtree);
+  return ok;
+}
+
 // Moves the bazel server into the specified cgroup for all the discovered
 // cgroups. This is useful when using the cgroup features in bazel and thus the
 // server must be started in a user-writable cgroup. Users can specify a
 // pre-setup cgroup where the server will be moved to. This is enabled by
 // the --experimental_cgroup_parent startup flag.
-static void MoveToCgroup(pid_t pid, const char* cgroup_path) {
+static void MoveToCgroup(pid_t pid, const char* cgroup_path,
+                         const struct CgroupLimits* limits) {
   FILE* mounts_fp = fopen("/proc/self/mounts", "r");
   if (mounts_fp == NULL) {
     err(EXIT_FAILURE, "Failed to open /proc/self/mounts");
   }
 
+  bool limited = limits->memory_high != NULL || limits->memory_max != NULL;
   char* line = NULL;
   size_t len = 0;
   while (getline(&line, &len, mounts_fp) != -1) {
@@ -170,10 +316,16 @@ static void MoveToCgroup(pid_t pid, const char* cgroup_path) {
     char* fs_vfstype = strtok_r(NULL, " ", &saveptr);
     if (strcmp(fs_vfstype, "cgroup") == 0 ||
         strcmp(fs_vfstype, "cgroup2") == 0) {
-      char* procs_path;
-      asprintf(&procs_path, "%s%s/cgroup.procs", fs_file, cgroup_path);
-      WriteFile(procs_path, "%d", pid);
-      free(procs_path);
+      char* cgroup;
+      asprintf(&cgroup, "%s%s", fs_file, cgroup_path);
+      if (!limited || strcmp(fs_vfstype, "cgroup2") != 0 ||
+          !MoveToCgroupSubtree(cgroup, limits)) {
+        char* procs_path;
+        asprintf(&procs_path, "%s/cgroup.procs", cgroup);
+        WriteFile(procs_path, "%d", pid);
+        free(procs_path);
+      }
+      free(cgroup);
     }
   }
   free(line);
@@ -189,6 +341,7 @@ static void MoveToCgroup(pid_t pid, const char* cgroup_path) {
 // contain the program name (which may or may not match the basename of exe).
 static void Daemonize(const char* log_path, bool log_append,
                       const char* pid_path, const char* cgroup_path,
+                      const struct CgroupLimits* limits, int numa_node,
                       const char* exe, char** argv) {
   assert(argv[0] != NULL);
 
@@ -204,7 +357,11 @@ static void Daemonize(const char* log_path, bool log_append,
     close(pid_done_fds[1]);
 #ifdef __linux__
     if (cgroup_path != NULL) {
-      MoveToCgroup(pid, cgroup_path);
+      MoveToCgroup(pid, cgroup_path, limits);
+    }
+    // The server still starts if it cannot be bound, only more slowly.
+    if (numa_node >= 0 && !BindToNumaNode(numa_node)) {
+      warn("Failed to bind to NUMA node %d", numa_node);
     }
 #endif
     ExecAsDaemon(log_path, log_append, pid_done_fds[0], exe, argv);
@@ -224,8 +381,10 @@ int main(int argc, char** argv) {
   const char* log_path = NULL;
   const char* pid_path = NULL;
   const char* cgroup_path = NULL;
+  struct CgroupLimits limits = {NULL, NULL};
+  int numa_node = -1;
   int opt;
-  while ((opt = getopt(argc, argv, ":al:p:c:")) != -1) {
+  while ((opt = getopt(argc, argv, ":al:p:c:m:M:n:")) != -1) {
     switch (opt) {
       case 'a':
         log_append = true;
@@ -243,6 +402,23 @@ int main(int argc, char** argv) {
         cgroup_path = optarg;
         break;
 
+      case 'm':
+        limits.memory_high = optarg;
+        break;
+
+      case 'M':
+        limits.memory_max = optarg;
+        break;
+
+      case 'n': {
+        char* end;
+        numa_node = strtol(optarg, &end, 10);
+        if (*optarg == '\0' || *end != '\0' || numa_node < 0) {
+          errx(EXIT_FAILURE, "Invalid NUMA node -n %s", optarg);
+        }
+        break;
+      }
+
       case ':':
         errx(EXIT_FAILURE, "Option -%c requires an argument", optopt);
 
@@ -264,6 +440,7 @@ int main(int argc, char** argv) {
   if (argc < 2) {
     errx(EXIT_FAILURE, "Must provide at least an executable name and arg0");
   }
-  Daemonize(log_path, log_append, pid_path, cgroup_path, argv[0], argv + 1);
+  Daemonize(log_path, log_append, pid_path, cgroup_path, &limits, numa_node,
+            argv[0], argv + 1);
   return EXIT_SUCCESS;
 }
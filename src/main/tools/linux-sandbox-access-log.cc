@@ -0,0 +1,239 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/tools/linux-sandbox-access-log.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/fanotify.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "src/main/tools/logging.h"
+
+// Asks for the file handle that fanotify reports, even on filesystems that
+// cannot be exported. Since Linux 6.5; older ones report the same as without
+// it, and only for filesystems that can be.
+#ifndef AT_HANDLE_FID
+#define AT_HANDLE_FID 0x200
+#endif
+
+static std::string MakeKey(const std::string &fsid,
+                           const struct file_handle *handle) {
+  std::string key = fsid;
+  key.append(reinterpret_cast<const char *>(&handle->handle_type),
+             sizeof(handle->handle_type));
+  key.append(reinterpret_cast<const char *>(handle->f_handle),
+             handle->handle_bytes);
+  return key;
+}
+
+static void WriteAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = write(fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      PRINT_DEBUG("cannot write the access log: %m");
+      return;
+    }
+    data += n;
+    size -= n;
+  }
+}
+
+AccessLog::AccessLog() : fd_(-1), overflowed_(false) {}
+
+AccessLog::~AccessLog() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool AccessLog::Start() {
+  PRINT_DEBUG_TIME("AccessLog::Start");
+  fd_ = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_FID | FAN_CLOEXEC |
+                          FAN_NONBLOCK,
+                      O_RDONLY);
+  if (fd_ < 0) {
+    PRINT_DEBUG("fanotify_init: %m");
+    return false;
+  }
+  if (!MarkTree("")) {
+    close(fd_);
+    fd_ = -1;
+    fsids_.clear();
+    paths_.clear();
+    return false;
+  }
+  PRINT_DEBUG("marked %zu files", paths_.size());
+  return true;
+}
+
+bool AccessLog::MarkTree(const std::string &dir) {
+  DIR *d = opendir(dir.empty() ? "." : dir.c_str());
+  if (d == nullptr) {
+    PRINT_DEBUG("opendir(%s): %m", dir.c_str());
+    return false;
+  }
+  bool ok = true;
+  struct dirent *e;
+  while (ok && (e = readdir(d)) != nullptr) {
+    if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) {
+      continue;
+    }
+    std::string path = dir.empty() ? e->d_name : dir + "/" + e->d_name;
+    bool is_dir = e->d_type == DT_DIR;
+    if (e->d_type == DT_UNKNOWN) {
+      struct stat st;
+      is_dir = lstat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    }
+    // Symlinks to directories are not followed, like the inputs of tree
+    // artifacts that point at the directory of the output: marking them only
+    // costs a mark that never reports anything.
+    ok = is_dir ? MarkTree(path) : MarkFile(path);
+  }
+  closedir(d);
+  return ok;
+}
+
+bool AccessLog::MarkFile(const std::string &path) {
+  std::string key = FileKey(path);
+  if (key.empty()) {
+    // A dangling symlink cannot be opened.
+    return errno == ENOENT || errno == ELOOP;
+  }
+  auto it = paths_.find(key);
+  if (it != paths_.end()) {
+    // Another symlink to the same file. We cannot tell which one an open
+    // went through, so an open counts for both.
+    it->second.push_back(path);
+    return true;
+  }
+  if (fanotify_mark(fd_, FAN_MARK_ADD, FAN_OPEN, AT_FDCWD, path.c_str()) < 0) {
+    PRINT_DEBUG("fanotify_mark(%s): %m", path.c_str());
+    return false;
+  }
+  paths_[key].push_back(path);
+  return true;
+}
+
+std::string AccessLog::FileKey(const std::string &path) {
+  static int flags = AT_SYMLINK_FOLLOW | AT_HANDLE_FID;
+  alignas(struct file_handle) char buf[sizeof(struct file_handle) +
+                                       MAX_HANDLE_SZ];
+  struct file_handle *handle = reinterpret_cast<struct file_handle *>(buf);
+  int mount_id;
+  while (true) {
+    handle->handle_bytes = MAX_HANDLE_SZ;
+    if (name_to_handle_at(AT_FDCWD, path.c_str(), handle, &mount_id, flags) ==
+        0) {
+      break;
+    }
+    if (errno != EINVAL || (flags & AT_HANDLE_FID) == 0) {
+      return "";
+    }
+    flags &= ~AT_HANDLE_FID;
+  }
+  auto it = fsids_.find(mount_id);
+  if (it == fsids_.end()) {
+    struct statfs fs;
+    if (statfs(path.c_str(), &fs) < 0) {
+      return "";
+    }
+    it = fsids_
+             .emplace(mount_id,
+                      std::string(reinterpret_cast<const char *>(&fs.f_fsid),
+                                  sizeof(fs.f_fsid)))
+             .first;
+  }
+  return MakeKey(it->second, handle);
+}
+
+void AccessLog::ReadEvents() {
+  alignas(struct fanotify_event_metadata) char buf[64 * 1024];
+  while (true) {
+    ssize_t len = read(fd_, buf, sizeof(buf));
+    if (len < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN) {
+        PRINT_DEBUG("read(fanotify): %m");
+        overflowed_ = true;
+      }
+      return;
+    }
+    auto *event = reinterpret_cast<struct fanotify_event_metadata *>(buf);
+    for (; FAN_EVENT_OK(event, len); event = FAN_EVENT_NEXT(event, len)) {
+      if (event->mask & FAN_Q_OVERFLOW) {
+        PRINT_DEBUG("fanotify queue overflow");
+        overflowed_ = true;
+        continue;
+      }
+      char *info = reinterpret_cast<char *>(event) + event->metadata_len;
+      char *end = reinterpret_cast<char *>(event) + event->event_len;
+      while (info + sizeof(struct fanotify_event_info_header) <= end) {
+        auto *header =
+            reinterpret_cast<struct fanotify_event_info_header *>(info);
+        if (header->len == 0) {
+          break;
+        }
+        if (header->info_type == FAN_EVENT_INFO_TYPE_FID) {
+          auto *fid = reinterpret_cast<struct fanotify_event_info_fid *>(info);
+          std::string key = MakeKey(
+              std::string(reinterpret_cast<const char *>(&fid->fsid),
+                          sizeof(fid->fsid)),
+              reinterpret_cast<const struct file_handle *>(fid->handle));
+          auto it = paths_.find(key);
+          if (it != paths_.end() && opened_.insert(key).second) {
+            // Events that are queued already still come, and are ignored.
+            fanotify_mark(fd_, FAN_MARK_REMOVE, FAN_OPEN, AT_FDCWD,
+                          it->second.front().c_str());
+          }
+        }
+        info += header->len;
+      }
+    }
+  }
+}
+
+void AccessLog::Finish(int out_fd) {
+  PRINT_DEBUG_TIME("AccessLog::Finish");
+  ReadEvents();
+  if (overflowed_) {
+    return;
+  }
+  std::vector<std::string> opened;
+  for (const std::string &key : opened_) {
+    const std::vector<std::string> &paths = paths_[key];
+    opened.insert(opened.end(), paths.begin(), paths.end());
+  }
+  std::sort(opened.begin(), opened.end());
+  std::string out;
+  for (const std::string &path : opened) {
+    out += path;
+    out += '\n';
+  }
+  WriteAll(out_fd, out.data(), out.size());
+  PRINT_DEBUG("%zu of %zu files were opened", opened_.size(), paths_.size());
+}
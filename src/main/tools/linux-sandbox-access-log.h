@@ -0,0 +1,80 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * With -I, PID 1 records which of the files under the working directory are
+ * opened while the command runs, typically which of its inputs it read.
+ * Before the command is spawned, every file there (or the file a symlink
+ * there points to) gets a fanotify inode mark, which unprivileged processes
+ * may set since Linux 5.13. An open of a marked file then queues an event that
+ * names the file by its file handle. Marks are removed at the first open, so
+ * that a file read over and over only costs one event.
+ *
+ * The kernel does not tell unprivileged listeners who opened a file, so opens
+ * from outside of the sandbox count too, like the ones of another action with
+ * the same input: the list may name files that the command did not read, but
+ * not miss any that it did. It is only written if it is complete, which it is
+ * not if the kernel is too old, if the marks allowed per user run out, which
+ * they may with many sandboxes at once, or if the event queue overflows.
+ */
+
+#ifndef SRC_MAIN_TOOLS_LINUX_SANDBOX_ACCESS_LOG_H_
+#define SRC_MAIN_TOOLS_LINUX_SANDBOX_ACCESS_LOG_H_
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class AccessLog {
+ public:
+  AccessLog();
+  ~AccessLog();
+
+  // Marks the files under the current directory. Returns false, having
+  // marked nothing, if they cannot all be marked.
+  bool Start();
+
+  // The fanotify file descriptor to poll for events.
+  int fd() const { return fd_; }
+
+  // Reads the events that are queued, without blocking.
+  void ReadEvents();
+
+  // Reads what is left of the events and writes the paths of the files that
+  // were opened, relative to the current directory and sorted, one per line
+  // to `out_fd`, unless the list is not complete.
+  void Finish(int out_fd);
+
+ private:
+  // Marks the files under `dir` ("" for the current directory), recursively.
+  bool MarkTree(const std::string &dir);
+  // Marks the file at `path`, following symlinks.
+  bool MarkFile(const std::string &path);
+  // What identifies a file in the events: its filesystem id and file handle,
+  // as bytes, or "" if it cannot be told.
+  std::string FileKey(const std::string &path);
+
+  int fd_;
+  // Whether an event may have been missed.
+  bool overflowed_;
+  // The filesystem ids of the mounts seen so far, by mount id, as bytes.
+  std::unordered_map<int, std::string> fsids_;
+  // The paths of each marked file, by the key of the file.
+  std::unordered_map<std::string, std::vector<std::string>> paths_;
+  // The keys of the files opened so far.
+  std::unordered_set<std::string> opened_;
+};
+
+#endif  // SRC_MAIN_TOOLS_LINUX_SANDBOX_ACCESS_LOG_H_
@@ -0,0 +1,129 @@
+#!/bin/bash
+#
+# Copyright 2024 The Bazel Authors. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Measures how long linux-sandbox takes to set up and tear down a sandbox
+# with many mounts around a command that does nothing:
+#
+#   linux-sandbox-benchmark.sh [-n RUNS] [-b BINDS] [-w WRITABLE] [-t TMPFS]
+#       [-H] LINUX_SANDBOX
+#
+# Each run bind mounts BINDS directories (-M/-m), makes WRITABLE directories
+# writable (-w) and mounts TMPFS tmpfs directories (-e), with -H in a
+# hermetic sandbox (-h). The median and the maximum of the wall time and of
+# each phase that linux-sandbox times in its debug output (-D) are printed,
+# in microseconds.
+
+set -euo pipefail
+
+runs=20
+binds=100
+writable=10
+tmpfs=10
+hermetic=0
+
+usage() {
+  echo "Usage: $0 [-n RUNS] [-b BINDS] [-w WRITABLE] [-t TMPFS] [-H]" \
+      "LINUX_SANDBOX" >&2
+  exit 1
+}
+
+while getopts "n:b:w:t:H" opt; do
+  case "${opt}" in
+    n) runs="${OPTARG}" ;;
+    b) binds="${OPTARG}" ;;
+    w) writable="${OPTARG}" ;;
+    t) tmpfs="${OPTARG}" ;;
+    H) hermetic=1 ;;
+    *) usage ;;
+  esac
+done
+shift $((OPTIND - 1))
+[[ $# -eq 1 ]] || usage
+linux_sandbox="$(cd "$(dirname "$1")" && pwd)/$(basename "$1")"
+
+dir="$(mktemp -d "${TMPDIR:-/tmp}/linux-sandbox-benchmark.XXXXXXXX")"
+trap 'rm -rf "${dir}"' EXIT
+
+# In a hermetic sandbox, only what is mounted is there, so the command needs
+# the system directories. The working directory is below the sandbox root,
+# and the bind mount targets are relative to it.
+args=()
+root=""
+work="${dir}/work"
+if [[ "${hermetic}" -eq 1 ]]; then
+  root="${dir}/root"
+  work="${root}/work"
+  args+=(-h "${root}")
+  for system_dir in /bin /lib /lib64 /usr; do
+    if [[ -L "${system_dir}" ]]; then
+      mkdir -p "${root}"
+      ln -s "$(readlink "${system_dir}")" "${root}${system_dir}"
+    elif [[ -d "${system_dir}" ]]; then
+      args+=(-M "${system_dir}")
+    fi
+  done
+fi
+mkdir -p "${work}"
+args+=(-W "${work}")
+
+for ((i = 0; i < binds; i++)); do
+  mkdir -p "${dir}/sources/${i}" "${work}/binds/${i}"
+  touch "${dir}/sources/${i}/file"
+  args+=(-M "${dir}/sources/${i}" -m "${work#"${root}"}/binds/${i}")
+done
+for ((i = 0; i < writable; i++)); do
+  mkdir -p "${work}/writable/${i}"
+  args+=(-w "${work}/writable/${i}")
+done
+for ((i = 0; i < tmpfs; i++)); do
+  mkdir -p "${work}/tmpfs/${i}"
+  args+=(-e "${work}/tmpfs/${i}")
+done
+
+# One line of "<phase> <microseconds>" per phase and run.
+times="${dir}/times"
+: > "${times}"
+for ((run = 0; run < runs; run++)); do
+  # linux-sandbox -h expects to make these itself.
+  [[ -z "${root}" ]] || rm -rf "${root}/dev" "${root}/tmp"
+  start=$(date +%s%N)
+  "${linux_sandbox}" -D "${dir}/debug" "${args[@]}" -- /bin/true
+  end=$(date +%s%N)
+  echo "wall $(((end - start) / 1000))" >> "${times}"
+  sed -n 's/.*: \([A-Za-z0-9]*\) took \([0-9]*\) us$/\1 \2/p' \
+      "${dir}/debug" >> "${times}"
+done
+
+mode=""
+[[ -z "${root}" ]] || mode=", hermetic"
+echo "${runs} runs, ${binds} bind mounts, ${writable} writable directories," \
+    "${tmpfs} tmpfs directories${mode}"
+printf "%-30s %10s %10s\n" "phase" "median" "max"
+# Phases in the order they first appear, with their times sorted.
+awk '!($1 in seen) { seen[$1] = 1; order[n++] = $1 }
+     { times[$1] = times[$1] " " $2 }
+     END {
+       for (i = 0; i < n; i++) {
+         count = split(times[order[i]], t, " ")
+         for (j = 2; j <= count; j++) {
+           for (k = j; k > 1 && t[k - 1] + 0 > t[k] + 0; k--) {
+             swap = t[k]; t[k] = t[k - 1]; t[k - 1] = swap
+           }
+         }
+         printf "%-30s %10d %10d\n", order[i], t[int((count + 1) / 2)],
+             t[count]
+       }
+     }' "${times}"
@@ -0,0 +1,503 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/tools/linux-sandbox-lazy-inputs.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <linux/fuse.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <thread>  // NOLINT
+#include <unordered_map>
+#include <vector>
+
+#include "src/main/tools/logging.h"
+
+// The threads that answer requests. Opens that wait for a blob to be
+// fetched hold up one each.
+static const int kThreads = 4;
+
+// The most that the kernel reads at once, and what a request can take on top
+// of it, which the buffers that requests are read into must have room for.
+static const uint32_t kMaxRead = 128 * 1024;
+static const size_t kBufferSize = kMaxRead + 4096;
+
+// The inputs do not change while the command runs, so the kernel may cache
+// the names and attributes for as long as it likes.
+static const uint64_t kValidSecs = 24 * 60 * 60;
+
+// Shortest and longest waits between looking for a blob being fetched.
+static const useconds_t kMinFetchPollUsec = 1000;
+static const useconds_t kMaxFetchPollUsec = 100 * 1000;
+
+static bool IsHash(const std::string &hash) {
+  return !hash.empty() && hash.size() <= 128 &&
+         hash.find_first_not_of("0123456789abcdef") == std::string::npos;
+}
+
+static bool IsRelativePath(const std::string &path) {
+  if (path.empty() || path[0] == '/' || path.back() == '/' ||
+      path.find("//") != std::string::npos) {
+    return false;
+  }
+  for (size_t start = 0; start <= path.size();) {
+    size_t end = path.find('/', start);
+    if (end == std::string::npos) {
+      end = path.size();
+    }
+    const std::string segment = path.substr(start, end - start);
+    if (segment == "." || segment == "..") {
+      return false;
+    }
+    start = end + 1;
+  }
+  return true;
+}
+
+LazyInputs::LazyInputs(const std::string &manifest_path)
+    : fuse_fd_(-1), store_fd_(-1), requests_fd_(-1), uid_(0), gid_(0),
+      mtime_() {
+  FILE *manifest = fopen(manifest_path.c_str(), "re");
+  if (manifest == nullptr) {
+    DIE("fopen(%s)", manifest_path.c_str());
+  }
+  struct stat sb;
+  if (fstat(fileno(manifest), &sb) < 0) {
+    DIE("fstat(%s)", manifest_path.c_str());
+  }
+  mtime_ = sb.st_mtim;
+
+  nodes_.push_back({"", true, false, "", 0, {}});
+  // The inode numbers of the directories, by path.
+  std::unordered_map<std::string, uint64_t> dirs = {{"", FUSE_ROOT_ID}};
+  char *line = nullptr;
+  size_t capacity = 0;
+  ssize_t length;
+  int line_number = 0;
+  while ((length = getline(&line, &capacity, manifest)) > 0) {
+    ++line_number;
+    if (line[length - 1] == '\n') {
+      line[--length] = '\0';
+    }
+    std::string path;
+    Node node = {"", false, false, "", 0, {}};
+    char hash[129];
+    int path_start = 0;
+    if (line[0] == 'd' && line[1] == ' ') {
+      node.is_dir = true;
+      path = line + 2;
+    } else if ((line[0] == 'f' || line[0] == 'x') &&
+               sscanf(line + 1, " %128s %" SCNu64 " %n", hash, &node.size,
+                      &path_start) == 2 &&
+               path_start > 0) {
+      node.executable = line[0] == 'x';
+      node.hash = hash;
+      path = line + 1 + path_start;
+    }
+    if (path.empty() || !IsRelativePath(path) ||
+        (!node.is_dir && !IsHash(node.hash))) {
+      DIE("%s:%d: expected 'f|x <hash> <size> <path>' or 'd <path>'",
+          manifest_path.c_str(), line_number);
+    }
+
+    // Add the directories above it, the parents first. A file of the same
+    // name as one of them is caught below, with the other duplicates.
+    uint64_t parent = FUSE_ROOT_ID;
+    for (size_t slash = path.find('/'); slash != std::string::npos;
+         slash = path.find('/', slash + 1)) {
+      const std::string dir = path.substr(0, slash);
+      auto it = dirs.find(dir);
+      if (it == dirs.end()) {
+        nodes_.push_back({dir.substr(dir.rfind('/') + 1), true, false, "", 0,
+                          {}});
+        it = dirs.emplace(dir, nodes_.size()).first;
+        nodes_[parent - 1].children.push_back(nodes_.size());
+      }
+      parent = it->second;
+    }
+    if (node.is_dir && dirs.count(path) != 0) {
+      continue;
+    }
+    node.name = path.substr(path.rfind('/') + 1);
+    nodes_.push_back(node);
+    nodes_[parent - 1].children.push_back(nodes_.size());
+    if (node.is_dir) {
+      dirs.emplace(path, nodes_.size());
+    }
+  }
+  free(line);
+  if (ferror(manifest)) {
+    DIE("getline(%s)", manifest_path.c_str());
+  }
+  fclose(manifest);
+
+  for (Node &dir : nodes_) {
+    std::sort(dir.children.begin(), dir.children.end(),
+              [this](uint64_t a, uint64_t b) {
+                return nodes_[a - 1].name < nodes_[b - 1].name;
+              });
+    for (size_t i = 1; i < dir.children.size(); ++i) {
+      const std::string &name = nodes_[dir.children[i] - 1].name;
+      if (name == nodes_[dir.children[i - 1] - 1].name) {
+        DIE("%s: %s is listed more than once", manifest_path.c_str(),
+            name.c_str());
+      }
+    }
+  }
+  PRINT_DEBUG("lazy inputs: %zu files and directories in %s", nodes_.size(),
+              manifest_path.c_str());
+}
+
+uint64_t LazyInputs::Lookup(uint64_t parent, const char *name) const {
+  const Node *dir = Find(parent);
+  if (dir == nullptr || !dir->is_dir) {
+    return 0;
+  }
+  auto it = std::lower_bound(
+      dir->children.begin(), dir->children.end(), name,
+      [this](uint64_t ino, const char *name) {
+        return strcmp(nodes_[ino - 1].name.c_str(), name) < 0;
+      });
+  if (it == dir->children.end() || nodes_[*it - 1].name != name) {
+    return 0;
+  }
+  return *it;
+}
+
+const LazyInputs::Node *LazyInputs::Find(uint64_t ino) const {
+  return ino >= 1 && ino <= nodes_.size() ? &nodes_[ino - 1] : nullptr;
+}
+
+void LazyInputs::Mount(const std::string &dir, const std::string &store_dir,
+                       int requests_fd) {
+  // Opened now, so that the blobs can still be read once the root has moved
+  // (-r) and the store is not at its path anymore.
+  store_fd_ = open(store_dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (store_fd_ < 0) {
+    DIE("open(%s)", store_dir.c_str());
+  }
+  requests_fd_ = requests_fd;
+  uid_ = getuid();
+  gid_ = getgid();
+  fuse_fd_ = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+  if (fuse_fd_ < 0) {
+    DIE("open(/dev/fuse)");
+  }
+  // The kernel checks the permissions against the modes, so that the
+  // command can read the inputs whatever its user.
+  char options[128];
+  snprintf(options, sizeof(options),
+           "fd=%d,rootmode=40000,user_id=%u,group_id=%u,default_permissions,"
+           "allow_other",
+           fuse_fd_, uid_, gid_);
+  PRINT_DEBUG("lazy inputs: mount(%s, %s)", dir.c_str(), options);
+  if (mount("lazy-inputs", dir.c_str(), "fuse",
+            MS_RDONLY | MS_NOSUID | MS_NODEV, options) < 0) {
+    DIE("mount(lazy-inputs, %s, fuse, MS_RDONLY | MS_NOSUID | MS_NODEV, %s)",
+        dir.c_str(), options);
+  }
+
+  // The signals of PID 1 are handled by its main thread, so the threads
+  // serving the filesystem must not take them.
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  // They run until PID 1 exits, which unmounts the filesystem with the
+  // rest of the sandbox.
+  for (int i = 0; i < kThreads; ++i) {
+    std::thread(&LazyInputs::Serve, this).detach();
+  }
+  pthread_sigmask(SIG_SETMASK, &old, nullptr);
+}
+
+void LazyInputs::Serve() {
+  std::vector<char> buffer(kBufferSize);
+  std::vector<char> reply;
+  for (;;) {
+    ssize_t n = read(fuse_fd_, buffer.data(), buffer.size());
+    if (n < 0) {
+      // ENOENT: the request was interrupted before we got it.
+      if (errno == EINTR || errno == EAGAIN || errno == ENOENT) {
+        continue;
+      }
+      if (errno == ENODEV) {
+        return;  // Unmounted.
+      }
+      DIE("read(/dev/fuse)");
+    }
+    if (static_cast<size_t>(n) < sizeof(fuse_in_header)) {
+      DIE("read(/dev/fuse): short request of %zd bytes", n);
+    }
+    // Older kernels pass shorter arguments to some requests, so what
+    // follows them reads as zeros.
+    memset(buffer.data() + n, 0,
+           std::min(buffer.size() - n, sizeof(fuse_init_in)));
+    const fuse_in_header *in =
+        reinterpret_cast<const fuse_in_header *>(buffer.data());
+    Handle(in, buffer.data() + sizeof(fuse_in_header), &reply);
+  }
+}
+
+void LazyInputs::Reply(uint64_t unique, int error, const void *data,
+                       size_t size) {
+  fuse_out_header out = {};
+  out.unique = unique;
+  out.error = -error;
+  struct iovec iov[2] = {{&out, sizeof(out)}, {const_cast<void *>(data), 0}};
+  if (error == 0) {
+    iov[1].iov_len = size;
+  }
+  out.len = sizeof(out) + iov[1].iov_len;
+  // ENOENT: the request was interrupted and needs no reply.
+  if (writev(fuse_fd_, iov, 2) < 0 && errno != ENOENT) {
+    PRINT_DEBUG("lazy inputs: writev(/dev/fuse): %s", strerror(errno));
+  }
+}
+
+void LazyInputs::FillAttr(uint64_t ino, fuse_attr *attr) const {
+  const Node &node = nodes_[ino - 1];
+  *attr = {};
+  attr->ino = ino;
+  if (node.is_dir) {
+    attr->mode = S_IFDIR | 0555;
+    attr->nlink = 2;
+  } else {
+    attr->mode = S_IFREG | (node.executable ? 0555 : 0444);
+    attr->nlink = 1;
+    attr->size = node.size;
+    attr->blocks = (node.size + 511) / 512;
+  }
+  attr->atime = attr->mtime = attr->ctime = mtime_.tv_sec;
+  attr->atimensec = attr->mtimensec = attr->ctimensec = mtime_.tv_nsec;
+  attr->uid = uid_;
+  attr->gid = gid_;
+  attr->blksize = 4096;
+}
+
+int LazyInputs::OpenBlob(const Node &node) {
+  const char *hash = node.hash.c_str();
+  useconds_t wait_usec = kMinFetchPollUsec;
+  int fd;
+  while ((fd = openat(store_fd_, hash, O_RDONLY | O_CLOEXEC)) < 0) {
+    if (errno != ENOENT || requests_fd_ < 0) {
+      int error = errno;
+      PRINT_DEBUG("lazy inputs: open(%s): %s", hash, strerror(error));
+      return -(error == ENOENT ? EIO : error);
+    }
+    bool request;
+    {
+      std::lock_guard<std::mutex> lock(requested_mutex_);
+      request = requested_.insert(node.hash).second;
+    }
+    if (request) {
+      const std::string line =
+          node.hash + " " + std::to_string(node.size) + "\n";
+      PRINT_DEBUG("lazy inputs: requesting %s", hash);
+      if (write(requests_fd_, line.data(), line.size()) !=
+          static_cast<ssize_t>(line.size())) {
+        PRINT_DEBUG("lazy inputs: write(requests): %s", strerror(errno));
+        return -EIO;
+      }
+    }
+    usleep(wait_usec);
+    wait_usec = std::min(2 * wait_usec, kMaxFetchPollUsec);
+  }
+  struct stat sb;
+  if (fstat(fd, &sb) < 0 || static_cast<uint64_t>(sb.st_size) != node.size) {
+    PRINT_DEBUG("lazy inputs: blob %s is not %" PRIu64 " bytes long", hash,
+                node.size);
+    close(fd);
+    return -EIO;
+  }
+  return fd;
+}
+
+void LazyInputs::Handle(const fuse_in_header *in, const char *arg,
+                        std::vector<char> *reply) {
+  const Node *node = Find(in->nodeid);
+  switch (in->opcode) {
+    case FUSE_INIT: {
+      const fuse_init_in *init = reinterpret_cast<const fuse_init_in *>(arg);
+      if (init->major != FUSE_KERNEL_VERSION) {
+        DIE("lazy inputs: unsupported FUSE protocol %u.%u", init->major,
+            init->minor);
+      }
+      fuse_init_out out = {};
+      out.major = FUSE_KERNEL_VERSION;
+      out.minor = std::min<uint32_t>(init->minor, FUSE_KERNEL_MINOR_VERSION);
+      out.max_readahead = init->max_readahead;
+      out.flags = init->flags & (FUSE_ASYNC_READ | FUSE_PARALLEL_DIROPS);
+      out.max_background = 16;
+      out.congestion_threshold = 12;
+      out.max_write = kMaxRead;
+      // The fields up to max_write are what every kernel knows, and it
+      // takes a shorter reply for the rest.
+      Reply(in->unique, 0, &out, FUSE_COMPAT_22_INIT_OUT_SIZE);
+      return;
+    }
+    case FUSE_FORGET:
+    case FUSE_BATCH_FORGET:
+    case FUSE_INTERRUPT:
+      // The nodes are kept until the end, and no request takes long but
+      // the opens that wait for a blob, which have to.
+      return;
+    case FUSE_LOOKUP: {
+      fuse_entry_out out = {};
+      // Names that are not there have an entry of 0, which the kernel
+      // caches as well.
+      out.nodeid = Lookup(in->nodeid, arg);
+      out.entry_valid = kValidSecs;
+      out.attr_valid = kValidSecs;
+      if (out.nodeid != 0) {
+        FillAttr(out.nodeid, &out.attr);
+      }
+      Reply(in->unique, 0, &out, sizeof(out));
+      return;
+    }
+    case FUSE_GETATTR: {
+      if (node == nullptr) {
+        Reply(in->unique, ENOENT, nullptr, 0);
+        return;
+      }
+      fuse_attr_out out = {};
+      out.attr_valid = kValidSecs;
+      FillAttr(in->nodeid, &out.attr);
+      Reply(in->unique, 0, &out, sizeof(out));
+      return;
+    }
+    case FUSE_OPEN: {
+      const fuse_open_in *open_in = reinterpret_cast<const fuse_open_in *>(arg);
+      if (node == nullptr || node->is_dir) {
+        Reply(in->unique, node == nullptr ? ENOENT : EISDIR, nullptr, 0);
+        return;
+      }
+      if ((open_in->flags & O_ACCMODE) != O_RDONLY) {
+        Reply(in->unique, EROFS, nullptr, 0);
+        return;
+      }
+      const int fd = OpenBlob(*node);
+      if (fd < 0) {
+        Reply(in->unique, -fd, nullptr, 0);
+        return;
+      }
+      fuse_open_out out = {};
+      out.fh = fd;
+      out.open_flags = FOPEN_KEEP_CACHE;
+      Reply(in->unique, 0, &out, sizeof(out));
+      return;
+    }
+    case FUSE_READ: {
+      const fuse_read_in *read_in = reinterpret_cast<const fuse_read_in *>(arg);
+      reply->resize(std::min(read_in->size, kMaxRead));
+      size_t done = 0;
+      while (done < reply->size()) {
+        ssize_t n = pread(read_in->fh, reply->data() + done,
+                          reply->size() - done, read_in->offset + done);
+        if (n < 0 && errno == EINTR) {
+          continue;
+        }
+        if (n < 0) {
+          Reply(in->unique, errno, nullptr, 0);
+          return;
+        }
+        if (n == 0) {
+          break;
+        }
+        done += n;
+      }
+      Reply(in->unique, 0, reply->data(), done);
+      return;
+    }
+    case FUSE_RELEASE: {
+      const fuse_release_in *release =
+          reinterpret_cast<const fuse_release_in *>(arg);
+      close(release->fh);
+      Reply(in->unique, 0, nullptr, 0);
+      return;
+    }
+    case FUSE_OPENDIR: {
+      if (node == nullptr || !node->is_dir) {
+        Reply(in->unique, node == nullptr ? ENOENT : ENOTDIR, nullptr, 0);
+        return;
+      }
+      fuse_open_out out = {};
+      out.open_flags = FOPEN_KEEP_CACHE | FOPEN_CACHE_DIR;
+      Reply(in->unique, 0, &out, sizeof(out));
+      return;
+    }
+    case FUSE_READDIR: {
+      if (node == nullptr || !node->is_dir) {
+        Reply(in->unique, ENOTDIR, nullptr, 0);
+        return;
+      }
+      // The offset of an entry is what to continue at after it: the index
+      // of the next one.
+      const fuse_read_in *read_in = reinterpret_cast<const fuse_read_in *>(arg);
+      reply->resize(std::min(read_in->size, kMaxRead));
+      size_t used = 0;
+      for (uint64_t i = read_in->offset; i < node->children.size(); ++i) {
+        const uint64_t ino = node->children[i];
+        const Node &child = nodes_[ino - 1];
+        const size_t size =
+            FUSE_DIRENT_ALIGN(FUSE_NAME_OFFSET + child.name.size());
+        if (used + size > reply->size()) {
+          break;
+        }
+        fuse_dirent *dirent =
+            reinterpret_cast<fuse_dirent *>(reply->data() + used);
+        memset(dirent, 0, size);
+        dirent->ino = ino;
+        dirent->off = i + 1;
+        dirent->namelen = child.name.size();
+        dirent->type = child.is_dir ? DT_DIR : DT_REG;
+        memcpy(dirent->name, child.name.data(), child.name.size());
+        used += size;
+      }
+      Reply(in->unique, 0, reply->data(), used);
+      return;
+    }
+    case FUSE_STATFS: {
+      fuse_statfs_out out = {};
+      out.st.bsize = 4096;
+      out.st.frsize = 4096;
+      out.st.files = nodes_.size();
+      out.st.namelen = 255;
+      Reply(in->unique, 0, &out, sizeof(out));
+      return;
+    }
+    case FUSE_FLUSH:
+    case FUSE_RELEASEDIR:
+    case FUSE_DESTROY:
+      Reply(in->unique, 0, nullptr, 0);
+      return;
+    default:
+      // The kernel takes this to mean that no such requests are to be sent
+      // again, for xattrs say, and the filesystem is read-only besides.
+      Reply(in->unique, ENOSYS, nullptr, 0);
+      return;
+  }
+}
@@ -0,0 +1,106 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * With -f, the inputs of the command do not have to be on disk before it
+ * starts. PID 1 mounts a read-only FUSE filesystem on the lower layer of the
+ * overlay (-o), showing the tree of the -f manifest, and serves it from
+ * threads of its own while the command runs. The contents of a file are
+ * only looked for when it is first opened, in the content-addressed store of
+ * -F, where each blob is a file named by its hash. So a command that has
+ * many inputs but reads few of them, like a toolchain or a large data
+ * dependency, starts with none of them fetched.
+ *
+ * With -g, a blob that is not in the store yet is requested, by writing
+ * "<hash> <size>" to the -g file or pipe once, and the open waits until
+ * the blob shows up in the store. The worker that runs linux-sandbox can so
+ * fetch the blobs that the command reads first, while it runs, and has to
+ * rename each one into the store when it is complete.
+ *
+ * The manifest has a line for each file, "f <hash> <size> <path>", or "x"
+ * instead of "f" for executables, and "d <path>" for a directory, which
+ * need only be listed when empty. The paths are relative to the working
+ * directory. The kernel has let user namespaces mount FUSE filesystems since
+ * Linux 4.18.
+ */
+
+#ifndef SRC_MAIN_TOOLS_LINUX_SANDBOX_LAZY_INPUTS_H_
+#define SRC_MAIN_TOOLS_LINUX_SANDBOX_LAZY_INPUTS_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <mutex>  // NOLINT
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+struct fuse_attr;
+struct fuse_in_header;
+
+class LazyInputs {
+ public:
+  // Reads the manifest, dying if it is not valid.
+  explicit LazyInputs(const std::string &manifest_path);
+
+  // Mounts the tree on `dir` and starts serving it from the blobs in
+  // `store_dir`, requesting the missing ones by writing to `requests_fd`
+  // unless it is -1. Must be called once the user namespace is set up, while
+  // /dev/fuse and `dir` can still be opened.
+  void Mount(const std::string &dir, const std::string &store_dir,
+             int requests_fd);
+
+ private:
+  struct Node {
+    std::string name;
+    bool is_dir;
+    bool executable;
+    std::string hash;
+    uint64_t size;
+    // The inode numbers of the entries of a directory, sorted by name.
+    std::vector<uint64_t> children;
+  };
+
+  // The inode number of the entry of `parent` called `name`, or 0.
+  uint64_t Lookup(uint64_t parent, const char *name) const;
+  // The node of `ino`, or nullptr.
+  const Node *Find(uint64_t ino) const;
+
+  // Reads and answers requests until the filesystem is unmounted.
+  void Serve();
+  void Handle(const fuse_in_header *in, const char *arg,
+              std::vector<char> *reply);
+  void Reply(uint64_t unique, int error, const void *data, size_t size);
+  void FillAttr(uint64_t ino, fuse_attr *attr) const;
+
+  // Opens the blob of `node`, waiting for it to be fetched if need be.
+  // Returns a file descriptor, or -errno.
+  int OpenBlob(const Node &node);
+
+  int fuse_fd_;
+  int store_fd_;
+  int requests_fd_;
+  uid_t uid_;
+  gid_t gid_;
+  // The time the files appear to have been modified at: the manifest's.
+  struct timespec mtime_;
+  // The node of inode number i is nodes_[i - 1], the root being 1.
+  std::vector<Node> nodes_;
+
+  std::mutex requested_mutex_;
+  std::unordered_set<std::string> requested_;  // Guarded by requested_mutex_.
+};
+
+#endif  // SRC_MAIN_TOOLS_LINUX_SANDBOX_LAZY_INPUTS_H_
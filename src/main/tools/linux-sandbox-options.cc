@@ -15,6 +15,7 @@
 #include "src/main/tools/linux-sandbox-options.h"
 
 #include <errno.h>
+#include <inttypes.h>
 #include <sched.h>
 #include <stdarg.h>
 #include <stdbool.h>
@@ -59,6 +60,8 @@ static void Usage(char *program_name, const char *fmt, ...) {
           "SIGTERM first and then as a SIGKILL after the -T timeout\n"
           "  -l <file>  redirect stdout to a file\n"
           "  -L <file>  redirect stderr to a file\n"
+          "  -c <bytes>  only write the last bytes of stdout and of stderr, "
+          "once the command has exited\n"
           "  -w <file>  make a file or directory writable for the sandboxed "
           "process\n"
           "  -e <dir>  mount an empty tmpfs on a directory\n"
@@ -68,6 +71,8 @@ static void Usage(char *program_name, const char *fmt, ...) {
           "    The -M option specifies which directory to mount, the -m option "
           "specifies where to\n"
           "  -S <file>  if set, write stats in protobuf format to a file\n"
+          "  -E  with -S, also write the instructions, cycles and cache misses "
+          "of the command, if the kernel lets us count them. Ignores -Z.\n"
           "  -H  if set, make hostname in the sandbox equal to 'localhost'\n"
           "  -n  if set, create a new network namespace\n"
           "  -N  if set, create a new network namespace with loopback\n"
@@ -79,9 +84,40 @@ static void Usage(char *program_name, const char *fmt, ...) {
           "  -p  if set, the process is persistent and ignores parent thread "
           "death signals\n"
           "  -C <dir> if set, put all subprocesses inside this cgroup.\n"
+          "  -Z <dir>  if set, run the command in namespaces cloned from "
+          "pre-built ones, kept by a sandbox pool server with its socket in "
+          "dir, which is started if needed. Ignored with -h.\n"
+          "  -o <dir>  if set, mount an overlay of dir on the working "
+          "directory, which becomes its upper layer. Requires -O.\n"
+          "  -O <dir>  the work directory of the overlay: an empty directory "
+          "on the filesystem of the working directory, outside of it\n"
+          "  -r <path>  if set, the root is a new, read-only tmpfs showing "
+          "only these host paths (read-only) and the paths of -W, -w, -e and "
+          "-M/-m, instead of all of the filesystem made read-only. Can be "
+          "repeated. Ignores -Z, cannot be used with -h.\n"
           "  -h <sandbox-dir>  if set, chroot to sandbox-dir and only "
           " mount whats been specified with -M/-m for improved hermeticity. "
           " The working-dir should be a folder inside the sandbox-dir\n"
+          "  -x <dir>  with -h, keep templates of the mount points of "
+          "sandboxes in dir and show the sandbox-dir on top of one, read-only "
+          "except for its tmp, the working-dir and -w, instead of creating "
+          "them in it\n"
+          "  -A <file>  before starting the sandbox, wait while the Bazel "
+          "server reports critical memory pressure in file\n"
+          "  -a <secs>  how long to wait at the -A admission gate at most\n"
+          "  -u <node>  run the command on the CPUs of this NUMA node, "
+          "preferring its memory\n"
+          "  -I <file>  if set, write the paths of the files under the "
+          "working-dir that the command opened to file, if they are all "
+          "known, one per line. Ignores -Z.\n"
+          "  -f <file>  if set, mount the tree listed in this manifest on "
+          "the -o lower layer, reading the contents of each file from the "
+          "-F store when it is first opened. Requires -o and -F.\n"
+          "  -F <dir>  the content-addressed store of -f, with a file for "
+          "each blob named by its hash\n"
+          "  -g <file>  with -f, write the hash and size of each blob that "
+          "is not in the store yet to file, once, and wait for it to show "
+          "up there\n"
           "  @FILE  read newline-separated arguments from FILE\n"
           "  --  command to run inside sandbox, followed by arguments\n");
   exit(EXIT_FAILURE);
@@ -94,6 +130,17 @@ static void ValidateIsAbsolutePath(char *path, char *program_name, char flag) {
   }
 }
 
+// Overlayfs takes its layers in a comma-separated list of options.
+static void ValidateIsOverlayPath(const char *path, char *program_name,
+                                  char flag) {
+  if (strpbrk(path, ",:\\") != nullptr) {
+    Usage(program_name,
+          "The -%c option cannot be used with paths containing ',', ':' or "
+          "'\\' together with -o.",
+          flag);
+  }
+}
+
 // Parses command line flags from an argv array and puts the results into an
 // Options structure passed in as an argument.
 static void ParseCommandLine(unique_ptr<vector<char *>> args) {
@@ -102,7 +149,8 @@ static void ParseCommandLine(unique_ptr<vector<char *>> args) {
   int c;
   bool source_specified = false;
   while ((c = getopt(args->size(), args->data(),
-                     ":W:T:t:il:L:w:e:M:m:S:h:pC:HnNRUPD:")) != -1) {
+                     ":W:T:t:il:L:c:w:e:M:m:S:Eh:pC:HnNRUPD:Z:o:O:r:x:A:a:I:u:"
+                     "f:F:g:")) != -1) {
     if (c != 'M' && c != 'm') source_specified = false;
     switch (c) {
       case 'W':
@@ -126,6 +174,12 @@ static void ParseCommandLine(unique_ptr<vector<char *>> args) {
           Usage(args->front(), "Invalid kill delay (-t) value: %s", optarg);
         }
         break;
+      case 'c':
+        if (sscanf(optarg, "%" SCNd64, &opt.output_tail_bytes) != 1 ||
+            opt.output_tail_bytes <= 0) {
+          Usage(args->front(), "Invalid output tail (-c) size: %s", optarg);
+        }
+        break;
       case 'i':
         opt.sigint_sends_sigterm = true;
         break;
@@ -248,6 +302,98 @@ static void ParseCommandLine(unique_ptr<vector<char *>> args) {
                 "Cannot write debug output to more than one file.");
         }
         break;
+      case 'Z':
+        if (opt.pool_dir.empty()) {
+          ValidateIsAbsolutePath(optarg, args->front(), static_cast<char>(c));
+          opt.pool_dir.assign(optarg);
+        } else {
+          Usage(args->front(), "Multiple pool directories (-Z) specified.");
+        }
+        break;
+      case 'o':
+        if (opt.overlay_lower_dir.empty()) {
+          ValidateIsAbsolutePath(optarg, args->front(), static_cast<char>(c));
+          ValidateIsOverlayPath(optarg, args->front(), static_cast<char>(c));
+          opt.overlay_lower_dir.assign(optarg);
+        } else {
+          Usage(args->front(), "Multiple overlay lower layers (-o) specified.");
+        }
+        break;
+      case 'O':
+        if (opt.overlay_work_dir.empty()) {
+          ValidateIsAbsolutePath(optarg, args->front(), static_cast<char>(c));
+          ValidateIsOverlayPath(optarg, args->front(), static_cast<char>(c));
+          opt.overlay_work_dir.assign(optarg);
+        } else {
+          Usage(args->front(),
+                "Multiple overlay work directories (-O) specified.");
+        }
+        break;
+      case 'r':
+        ValidateIsAbsolutePath(optarg, args->front(), static_cast<char>(c));
+        opt.root_paths.emplace_back(optarg);
+        break;
+      case 'x':
+        if (opt.template_dir.empty()) {
+          ValidateIsAbsolutePath(optarg, args->front(), static_cast<char>(c));
+          opt.template_dir.assign(optarg);
+        } else {
+          Usage(args->front(), "Multiple template directories (-x) specified.");
+        }
+        break;
+      case 'A':
+        if (opt.admission_gate_path.empty()) {
+          opt.admission_gate_path.assign(optarg);
+        } else {
+          Usage(args->front(), "Multiple admission gates (-A) specified.");
+        }
+        break;
+      case 'a':
+        if (sscanf(optarg, "%d", &opt.admission_wait_secs) != 1 ||
+            opt.admission_wait_secs < 0) {
+          Usage(args->front(), "Invalid admission wait (-a) value: %s",
+                optarg);
+        }
+        break;
+      case 'u':
+        if (sscanf(optarg, "%d", &opt.numa_node) != 1 || opt.numa_node < 0) {
+          Usage(args->front(), "Invalid NUMA node (-u) value: %s", optarg);
+        }
+        opt.bind_numa_node = true;
+        break;
+      case 'E':
+        opt.perf_counters = true;
+        break;
+      case 'I':
+        if (opt.access_log_path.empty()) {
+          opt.access_log_path.assign(optarg);
+        } else {
+          Usage(args->front(), "Multiple access logs (-I) specified.");
+        }
+        break;
+      case 'f':
+        if (opt.lazy_inputs_manifest.empty()) {
+          opt.lazy_inputs_manifest.assign(optarg);
+        } else {
+          Usage(args->front(), "Multiple lazy input manifests (-f) specified.");
+        }
+        break;
+      case 'F':
+        if (opt.lazy_inputs_store.empty()) {
+          ValidateIsAbsolutePath(optarg, args->front(), static_cast<char>(c));
+          opt.lazy_inputs_store.assign(optarg);
+        } else {
+          Usage(args->front(), "Multiple lazy input stores (-F) specified.");
+        }
+        break;
+      case 'g':
+        if (opt.lazy_inputs_requests.empty()) {
+          opt.lazy_inputs_requests.assign(optarg);
+        } else {
+          Usage(args->front(),
+                "Multiple lazy input request files (-g) specified.");
+        }
+        break;
       case '?':
         Usage(args->front(), "Unrecognized argument: -%c (%d)", optopt, optind);
         break;
@@ -264,6 +410,26 @@ static void ParseCommandLine(unique_ptr<vector<char *>> args) {
           "subdirectory of sandbox-dir %s (-h)",
           opt.working_dir.c_str(), opt.sandbox_root.c_str());
   }
+  if (opt.overlay_lower_dir.empty() != opt.overlay_work_dir.empty()) {
+    Usage(args->front(), "The -o and -O options must be used together.");
+  }
+  if (!opt.overlay_lower_dir.empty() && !opt.sandbox_root.empty()) {
+    Usage(args->front(), "The -o option cannot be used with -h.");
+  }
+  if (!opt.overlay_lower_dir.empty()) {
+    ValidateIsOverlayPath(opt.working_dir.c_str(), args->front(), 'W');
+  }
+  if (!opt.lazy_inputs_manifest.empty() &&
+      (opt.overlay_lower_dir.empty() || opt.lazy_inputs_store.empty())) {
+    Usage(args->front(), "The -f option requires -o and -F.");
+  }
+  if (opt.lazy_inputs_manifest.empty() &&
+      !(opt.lazy_inputs_store.empty() && opt.lazy_inputs_requests.empty())) {
+    Usage(args->front(), "The -F and -g options require -f.");
+  }
+  if (!opt.root_paths.empty() && opt.hermetic) {
+    Usage(args->front(), "The -r option cannot be used with -h.");
+  }
   if (optind < static_cast<int>(args->size())) {
     if (opt.args.empty()) {
       opt.args.assign(args->begin() + optind, args->end());
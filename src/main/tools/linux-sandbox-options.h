@@ -18,6 +18,8 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include <stdint.h>
+
 #include <string>
 #include <vector>
 
@@ -39,6 +41,9 @@ struct Options {
   std::string stdout_path;
   // Where to redirect stderr (-L)
   std::string stderr_path;
+  // Only keep this many bytes of the end of stdout and stderr, or all if 0
+  // (-c)
+  int64_t output_tail_bytes;
   // Files or directories to make writable for the sandboxed process (-w)
   std::vector<std::string> writable_files;
   // Directories where to mount an empty tmpfs (-e)
@@ -68,6 +73,38 @@ struct Options {
   std::string sandbox_root;
   // Directories to use for cgroup control
   std::vector<std::string> cgroups_dirs;
+  // Directory of the sockets of the sandbox pool servers (-Z)
+  std::string pool_dir;
+  // Lower layer of the overlay mounted on the working directory (-o)
+  std::string overlay_lower_dir;
+  // Work directory of that overlay (-O)
+  std::string overlay_work_dir;
+  // Host paths to build a new root from, instead of showing all of the
+  // filesystem (-r)
+  std::vector<std::string> root_paths;
+  // Directory of the templates of the mount points of hermetic sandboxes (-x)
+  std::string template_dir;
+  // Admission gate to wait at before starting the sandbox (-A)
+  std::string admission_gate_path;
+  // How long to wait at the admission gate at most (-a)
+  int admission_wait_secs;
+  // Whether to bind the command to the CPUs and memory of a NUMA node, and
+  // which one (-u)
+  bool bind_numa_node;
+  int numa_node;
+  // Where to write the paths of the files under the working directory that
+  // the command opened (-I)
+  std::string access_log_path;
+  // Whether to write the hardware performance counters of the command to the
+  // stats (-E)
+  bool perf_counters;
+  // Manifest of the tree to mount on the overlay lower layer, with the
+  // contents read from a content-addressed store on first access (-f)
+  std::string lazy_inputs_manifest;
+  // Directory of that store, with the blobs named by their hashes (-F)
+  std::string lazy_inputs_store;
+  // Where to request the blobs that are not in the store yet (-g)
+  std::string lazy_inputs_requests;
   // Command to run (--)
   std::vector<char *> args;
 };
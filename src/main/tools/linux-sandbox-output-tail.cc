@@ -0,0 +1,206 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/tools/linux-sandbox-output-tail.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "src/main/tools/logging.h"
+
+static void WriteAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = write(fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // There is nowhere left to report this.
+      return;
+    }
+    data += n;
+    size -= n;
+  }
+}
+
+OutputTail::OutputTail(int64_t limit) : limit_(limit) {
+  stop_pipe_[0] = stop_pipe_[1] = -1;
+}
+
+void OutputTail::Capture() {
+  struct stat out, err;
+  bool have_out = fstat(STDOUT_FILENO, &out) == 0;
+  bool have_err = fstat(STDERR_FILENO, &err) == 0;
+  // Reserved so that Reader() can hold on to the elements.
+  streams_.reserve(2);
+  if (have_out && have_err && out.st_dev == err.st_dev &&
+      out.st_ino == err.st_ino) {
+    streams_.push_back({{STDOUT_FILENO, STDERR_FILENO}, -1, -1, "", 0});
+  } else {
+    if (have_out) {
+      streams_.push_back({{STDOUT_FILENO}, -1, -1, "", 0});
+    }
+    if (have_err) {
+      streams_.push_back({{STDERR_FILENO}, -1, -1, "", 0});
+    }
+  }
+
+  for (Stream &stream : streams_) {
+    stream.file_fd = fcntl(stream.fds[0], F_DUPFD_CLOEXEC, 3);
+    if (stream.file_fd < 0) {
+      DIE("fcntl(%d, F_DUPFD_CLOEXEC)", stream.fds[0]);
+    }
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_CLOEXEC) < 0) {
+      DIE("pipe2");
+    }
+    stream.read_fd = pipe_fds[0];
+    // The copies on the stream's fds are inherited by the command, the
+    // original is not needed.
+    for (int fd : stream.fds) {
+      if (dup2(pipe_fds[1], fd) < 0) {
+        DIE("dup2(%d, %d)", pipe_fds[1], fd);
+      }
+    }
+    close(pipe_fds[1]);
+  }
+  PRINT_DEBUG("keeping the last %" PRId64 " bytes of %zu output streams",
+              limit_, streams_.size());
+}
+
+void OutputTail::Start() {
+  for (Stream &stream : streams_) {
+    for (int fd : stream.fds) {
+      if (dup2(stream.file_fd, fd) < 0) {
+        DIE("dup2(%d, %d)", stream.file_fd, fd);
+      }
+    }
+  }
+  if (pipe2(stop_pipe_, O_CLOEXEC) < 0) {
+    DIE("pipe2");
+  }
+
+  // The signals that end the command are handled by the main thread, so the
+  // reader must not take them.
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  reader_ = std::thread(&OutputTail::Reader, this);
+  pthread_sigmask(SIG_SETMASK, &old, nullptr);
+}
+
+void OutputTail::Finish() {
+  // The sandbox may still hold on to the pipes, so there is no EOF to wait
+  // for: what the command wrote is in the pipes by now, the reader takes it
+  // as soon as it is told to stop.
+  char stop = 0;
+  while (write(stop_pipe_[1], &stop, 1) < 0 && errno == EINTR) {
+  }
+  reader_.join();
+  close(stop_pipe_[0]);
+  close(stop_pipe_[1]);
+
+  for (Stream &stream : streams_) {
+    close(stream.read_fd);
+    int64_t kept =
+        std::min(limit_, static_cast<int64_t>(stream.tail.size()));
+    if (stream.total > kept) {
+      char line[128];
+      int n = snprintf(line, sizeof(line),
+                       "linux-sandbox: dropped %" PRId64
+                       " bytes of output, kept the last %" PRId64 "\n",
+                       stream.total - kept, kept);
+      WriteAll(stream.file_fd, line, n);
+    }
+    WriteAll(stream.file_fd, stream.tail.data() + stream.tail.size() - kept,
+             kept);
+    close(stream.file_fd);
+  }
+}
+
+void OutputTail::Reader() {
+  std::vector<Stream *> open;
+  for (Stream &stream : streams_) {
+    open.push_back(&stream);
+  }
+  std::vector<struct pollfd> fds;
+  while (!open.empty()) {
+    fds.assign(1, {stop_pipe_[0], POLLIN, 0});
+    for (Stream *stream : open) {
+      fds.push_back({stream->read_fd, POLLIN, 0});
+    }
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      DIE("poll");
+    }
+    if (fds[0].revents) {
+      break;
+    }
+    for (size_t i = open.size(); i-- > 0;) {
+      if (fds[i + 1].revents && !Read(open[i])) {
+        open.erase(open.begin() + i);
+      }
+    }
+  }
+
+  // Told to stop: take what is left without waiting for more.
+  for (Stream *stream : open) {
+    int flags = fcntl(stream->read_fd, F_GETFL);
+    if (flags < 0 ||
+        fcntl(stream->read_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+      DIE("fcntl(%d)", stream->read_fd);
+    }
+    while (Read(stream)) {
+    }
+  }
+}
+
+bool OutputTail::Read(Stream *stream) {
+  char buffer[16 << 10];
+  ssize_t n = read(stream->read_fd, buffer, sizeof(buffer));
+  if (n < 0) {
+    if (errno == EINTR) {
+      return true;
+    }
+    if (errno == EAGAIN) {
+      return false;
+    }
+    DIE("read(%d)", stream->read_fd);
+  }
+  if (n == 0) {
+    return false;
+  }
+  stream->total += n;
+  stream->tail.append(buffer, n);
+  // Trim only once twice the limit is reached, so that the bytes are not
+  // moved on every read.
+  if (static_cast<int64_t>(stream->tail.size()) > 2 * limit_) {
+    stream->tail.erase(0, stream->tail.size() - limit_);
+  }
+  return true;
+}
@@ -0,0 +1,76 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * With -c, the sandboxed command writes its stdout and stderr to pipes
+ * instead of the files (or whatever else) linux-sandbox has as stdout and
+ * stderr. A thread of linux-sandbox keeps the last bytes of each in memory,
+ * and they are written out when the command is done, after a line that says
+ * how much was dropped. So however much a command prints, only its tail is
+ * written to disk.
+ */
+
+#ifndef SRC_MAIN_TOOLS_LINUX_SANDBOX_OUTPUT_TAIL_H_
+#define SRC_MAIN_TOOLS_LINUX_SANDBOX_OUTPUT_TAIL_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+class OutputTail {
+ public:
+  // Keeps the last `limit` bytes of each stream.
+  explicit OutputTail(int64_t limit);
+
+  // Makes stdout and stderr pipes, to be inherited by the command. If both
+  // are the same file, they share a pipe so that their order is kept.
+  void Capture();
+
+  // Called once the command has been spawned: points stdout and stderr at
+  // their files again and starts reading the pipes.
+  void Start();
+
+  // Called once the command has exited: reads what is left in the pipes and
+  // writes the tails to the files.
+  void Finish();
+
+ private:
+  struct Stream {
+    // The file descriptors (STDOUT_FILENO and/or STDERR_FILENO) writing to
+    // this stream.
+    std::vector<int> fds;
+    // What fds pointed to before Capture().
+    int file_fd;
+    int read_fd;
+    // The last bytes read, up to twice the limit between trims.
+    std::string tail;
+    // How many bytes were read overall.
+    int64_t total;
+  };
+
+  // Reads the pipes until Finish() writes to stop_pipe_.
+  void Reader();
+  // Reads from `stream` once. Returns false on EOF, or if a non-blocking
+  // read finds nothing.
+  bool Read(Stream *stream);
+
+  const int64_t limit_;
+  std::vector<Stream> streams_;
+  int stop_pipe_[2];
+  std::thread reader_;
+};
+
+#endif  // SRC_MAIN_TOOLS_LINUX_SANDBOX_OUTPUT_TAIL_H_
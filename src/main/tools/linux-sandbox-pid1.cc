@@ -22,27 +22,38 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <grp.h>
+#include <inttypes.h>
 #include <libgen.h>
+#include <limits.h>
 #include <math.h>
 #include <mntent.h>
 #include <net/if.h>
+#include <poll.h>
 #include <pwd.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
 #include <sys/ioctl.h>
 #include <sys/mount.h>
 #include <sys/prctl.h>
+#include <sys/signalfd.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <memory>
 #include <string>
 #include <unordered_set>
+#include <vector>
 
 #ifndef MS_REC
 // Some systems do not define MS_REC in sys/mount.h. We might be able to grab it
@@ -63,6 +74,49 @@
   })
 #endif  // TEMP_FAILURE_RETRY
 
+// The new mount API, which lets us make a whole tree of mounts read-only at
+// once. C libraries and kernel headers may be too old to know it, and
+// linux/mount.h conflicts with sys/mount.h, so we declare what we use.
+// mount_setattr needs Linux 5.12.
+#ifndef SYS_open_tree
+#define SYS_open_tree 428
+#endif
+#ifndef SYS_move_mount
+#define SYS_move_mount 429
+#endif
+#ifndef SYS_mount_setattr
+#define SYS_mount_setattr 442
+#endif
+#ifndef OPEN_TREE_CLONE
+#define OPEN_TREE_CLONE 1
+#endif
+#ifndef OPEN_TREE_CLOEXEC
+#define OPEN_TREE_CLOEXEC O_CLOEXEC
+#endif
+#ifndef MOVE_MOUNT_F_EMPTY_PATH
+#define MOVE_MOUNT_F_EMPTY_PATH 0x00000004
+#endif
+#ifndef MOUNT_ATTR_RDONLY
+#define MOUNT_ATTR_RDONLY 0x00000001
+#endif
+#ifndef MOUNT_ATTR_NOSUID
+#define MOUNT_ATTR_NOSUID 0x00000002
+#endif
+#ifndef AT_RECURSIVE
+#define AT_RECURSIVE 0x8000
+#endif
+
+// struct mount_attr from linux/mount.h.
+struct MountAttr {
+  uint64_t attr_set;
+  uint64_t attr_clr;
+  uint64_t propagation;
+  uint64_t userns_fd;
+};
+
+#include "src/main/cpp/util/probe.h"
+#include "src/main/tools/linux-sandbox-access-log.h"
+#include "src/main/tools/linux-sandbox-lazy-inputs.h"
 #include "src/main/tools/linux-sandbox-options.h"
 #include "src/main/tools/linux-sandbox.h"
 #include "src/main/tools/logging.h"
@@ -71,6 +125,15 @@
 
 static int global_child_pid;
 
+// The read end of a close-on-exec pipe that the child has the write end of,
+// so that reading it returns once the child has called exec.
+static int global_exec_fd = -1;
+
+// Whether we use the new mount API, which we find out from the first call.
+// Inherited by the PID 1 processes of the sandbox pool server.
+enum MountApi { MOUNT_API_UNKNOWN, MOUNT_API_NEW, MOUNT_API_OLD };
+static MountApi global_mount_api = MOUNT_API_UNKNOWN;
+
 // Helper methods
 static void CreateFile(const char *path) {
   int handle = open(path, O_CREAT | O_WRONLY | O_EXCL, 0666);
@@ -174,6 +237,7 @@ static void SetupSelfDestruction(int *pipe_to_parent) {
 }
 
 static void SetupMountNamespace() {
+  PRINT_DEBUG_TIME("SetupMountNamespace");
   // Fully isolate our mount namespace private from outside events, so that
   // mounts in the outside environment do not affect our sandbox.
   if (mount(nullptr, "/", nullptr, MS_REC | MS_PRIVATE, nullptr) < 0) {
@@ -182,6 +246,7 @@ static void SetupMountNamespace() {
 }
 
 static void SetupUserNamespace() {
+  PRINT_DEBUG_TIME("SetupUserNamespace");
   // Disable needs for CAP_SETGID.
   struct stat sb;
   if (stat("/proc/self/setgroups", &sb) == 0) {
@@ -242,6 +307,7 @@ static void SetupUtsNamespace() {
 }
 
 static void MountFilesystems() {
+  PRINT_DEBUG_TIME("MountFilesystems");
   // An attempt to mount the sandbox in tmpfs will always fail, so this block is
   // slightly redundant with the next mount() check, but dumping the mount()
   // syscall is incredibly cryptic, so we explicitly check against and warn
@@ -298,6 +364,22 @@ static void MountFilesystems() {
   // this is by bind-mounting it upon itself.
   PRINT_DEBUG("working dir: %s", opt.working_dir.c_str());
 
+  if (!opt.overlay_lower_dir.empty()) {
+    // Show the lower layer through the working directory instead, with
+    // everything that the command writes going to the working directory
+    // underneath. This takes one mount however many inputs there are.
+    const std::string options = "lowerdir=" + opt.overlay_lower_dir +
+                                ",upperdir=" + opt.working_dir +
+                                ",workdir=" + opt.overlay_work_dir;
+    PRINT_DEBUG("overlay: %s", options.c_str());
+    if (mount("overlay", opt.working_dir.c_str(), "overlay", 0,
+              options.c_str()) < 0) {
+      DIE("mount(overlay, %s, overlay, 0, %s)", opt.working_dir.c_str(),
+          options.c_str());
+    }
+    return;
+  }
+
   if (mount(opt.working_dir.c_str(), opt.working_dir.c_str(), nullptr, MS_BIND,
             nullptr) < 0) {
     DIE("mount(%s, %s, nullptr, MS_BIND, nullptr)", opt.working_dir.c_str(),
@@ -305,6 +387,53 @@ static void MountFilesystems() {
   }
 }
 
+static int MountSetattr(int dirfd, const char *path, unsigned int flags,
+                        uint64_t attr_set, uint64_t attr_clr) {
+  MountAttr attr = {attr_set, attr_clr, 0, 0};
+  return syscall(SYS_mount_setattr, dirfd, path, flags, &attr, sizeof(attr));
+}
+
+// Whether we go on after failing to change the flags of a mount with `err`.
+static bool IsIgnoredRemountError(int err) {
+  switch (err) {
+    case EACCES:
+    case EPERM:
+    case EINVAL:
+    case ENOENT:
+    case ESTALE:
+    case ENODEV:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Remounts a mount point with new flags.
+static void Remount(const char *mnt_dir, int mountFlags) {
+  PRINT_DEBUG("remount %s: %s", (mountFlags & MS_RDONLY) ? "ro" : "rw",
+              mnt_dir);
+  if (mount(nullptr, mnt_dir, nullptr, mountFlags, nullptr) < 0) {
+    // If we get EACCES or EPERM, this might be a mount-point for which we
+    // don't have read access. Not much we can do about this, but it also
+    // won't do any harm, so let's go on. The same goes for EINVAL or ENOENT,
+    // which are fired in case a later mount overlaps an earlier mount, e.g.
+    // consider the case of /proc, /proc/sys/fs/binfmt_misc and /proc, with
+    // the latter /proc being the one that an outer sandbox has mounted on
+    // top of its parent /proc. In that case, we're not allowed to remount
+    // /proc/sys/fs/binfmt_misc, because it is hidden. If we get ESTALE, the
+    // mount is a broken NFS mount. In the ideal case, the user would either
+    // fix or remove that mount, but in cases where that's not possible, we
+    // should just ignore it. Similarly, one can get ENODEV in case of
+    // autofs/automount failure.
+    if (!IsIgnoredRemountError(errno)) {
+      DIE("remount(nullptr, %s, nullptr, %d, nullptr)", mnt_dir, mountFlags);
+    }
+    PRINT_DEBUG(
+        "remount(nullptr, %s, nullptr, %d, nullptr) failure (%m) ignored",
+        mnt_dir, mountFlags);
+  }
+}
+
 // We later remount everything read-only, except the paths for which this method
 // returns true.
 static bool ShouldBeWritable(const std::string &mnt_dir) {
@@ -331,9 +460,65 @@ static bool ShouldBeWritable(const std::string &mnt_dir) {
   return false;
 }
 
+// Makes a mount point on a read-only filesystem writable, keeping the other
+// flags of its mount.
+static void RemountWritable(const std::string &path) {
+  if (global_mount_api == MOUNT_API_NEW) {
+    PRINT_DEBUG("remount rw: %s", path.c_str());
+    if (MountSetattr(AT_FDCWD, path.c_str(), 0, 0, MOUNT_ATTR_RDONLY) < 0) {
+      if (!IsIgnoredRemountError(errno)) {
+        DIE("mount_setattr(%s, 0, ~MOUNT_ATTR_RDONLY)", path.c_str());
+      }
+      PRINT_DEBUG("mount_setattr(%s, 0, ~MOUNT_ATTR_RDONLY) failure (%m) "
+                  "ignored", path.c_str());
+    }
+    return;
+  }
+
+  struct statvfs sv;
+  if (statvfs(path.c_str(), &sv) < 0) {
+    DIE("statvfs(%s)", path.c_str());
+  }
+  int mountFlags = MS_BIND | MS_REMOUNT;
+  if (sv.f_flag & ST_NODEV) {
+    mountFlags |= MS_NODEV;
+  }
+  if (sv.f_flag & ST_NOEXEC) {
+    mountFlags |= MS_NOEXEC;
+  }
+  if (sv.f_flag & ST_NOSUID) {
+    mountFlags |= MS_NOSUID;
+  }
+  if (sv.f_flag & ST_NOATIME) {
+    mountFlags |= MS_NOATIME;
+  }
+  if (sv.f_flag & ST_NODIRATIME) {
+    mountFlags |= MS_NODIRATIME;
+  }
+  if (sv.f_flag & ST_RELATIME) {
+    mountFlags |= MS_RELATIME;
+  }
+  Remount(path.c_str(), mountFlags);
+}
+
 // Makes the whole filesystem read-only, except for the paths for which
 // ShouldBeWritable returns true.
 static void MakeFilesystemMostlyReadOnly() {
+  PRINT_DEBUG_TIME("MakeFilesystemMostlyReadOnly");
+  // With the new mount API, a single call makes every mount read-only, and
+  // only the few writable ones need another; remounting every mount one by
+  // one gets slower with every mount there is.
+  if (global_mount_api != MOUNT_API_OLD) {
+    if (MountSetattr(AT_FDCWD, "/", AT_RECURSIVE, MOUNT_ATTR_RDONLY, 0) == 0) {
+      PRINT_DEBUG("remount ro: / (recursively)");
+      global_mount_api = MOUNT_API_NEW;
+    } else {
+      PRINT_DEBUG("mount_setattr(/, AT_RECURSIVE, MOUNT_ATTR_RDONLY) failed "
+                  "(%m), remounting each mount");
+      global_mount_api = MOUNT_API_OLD;
+    }
+  }
+
   FILE *mounts = setmntent("/proc/self/mounts", "r");
   if (mounts == nullptr) {
     DIE("setmntent");
@@ -341,6 +526,13 @@ static void MakeFilesystemMostlyReadOnly() {
 
   struct mntent *ent;
   while ((ent = getmntent(mounts)) != nullptr) {
+    if (global_mount_api == MOUNT_API_NEW) {
+      if (ShouldBeWritable(ent->mnt_dir)) {
+        RemountWritable(ent->mnt_dir);
+      }
+      continue;
+    }
+
     int mountFlags = MS_BIND | MS_REMOUNT;
 
     // MS_REMOUNT does not allow us to change certain flags. This means, we have
@@ -370,43 +562,14 @@ static void MakeFilesystemMostlyReadOnly() {
       mountFlags |= MS_RDONLY;
     }
 
-    PRINT_DEBUG("remount %s: %s", (mountFlags & MS_RDONLY) ? "ro" : "rw",
-                ent->mnt_dir);
-    if (mount(nullptr, ent->mnt_dir, nullptr, mountFlags, nullptr) < 0) {
-      // If we get EACCES or EPERM, this might be a mount-point for which we
-      // don't have read access. Not much we can do about this, but it also
-      // won't do any harm, so let's go on. The same goes for EINVAL or ENOENT,
-      // which are fired in case a later mount overlaps an earlier mount, e.g.
-      // consider the case of /proc, /proc/sys/fs/binfmt_misc and /proc, with
-      // the latter /proc being the one that an outer sandbox has mounted on
-      // top of its parent /proc. In that case, we're not allowed to remount
-      // /proc/sys/fs/binfmt_misc, because it is hidden. If we get ESTALE, the
-      // mount is a broken NFS mount. In the ideal case, the user would either
-      // fix or remove that mount, but in cases where that's not possible, we
-      // should just ignore it. Similarly, one can get ENODEV in case of
-      // autofs/automount failure.
-      switch (errno) {
-        case EACCES:
-        case EPERM:
-        case EINVAL:
-        case ENOENT:
-        case ESTALE:
-        case ENODEV:
-          PRINT_DEBUG(
-              "remount(nullptr, %s, nullptr, %d, nullptr) failure (%m) ignored",
-              ent->mnt_dir, mountFlags);
-          break;
-        default:
-          DIE("remount(nullptr, %s, nullptr, %d, nullptr)", ent->mnt_dir,
-              mountFlags);
-      }
-    }
+    Remount(ent->mnt_dir, mountFlags);
   }
 
   endmntent(mounts);
 }
 
 static void MountProcAndSys() {
+  PRINT_DEBUG_TIME("MountProcAndSys");
   // Mount a new proc on top of the old one, because the old one still refers to
   // our parent PID namespace.
   if (mount("/proc", "/proc", "proc", MS_NODEV | MS_NOEXEC | MS_NOSUID,
@@ -425,33 +588,40 @@ static void MountProcAndSys() {
   }
 }
 
-static void SetupNetworking() {
-  // When running in a separate network namespace, enable the loopback interface
-  // because some application may want to use it.
-  if (opt.create_netns == NETNS_WITH_LOOPBACK) {
-    int fd;
-    fd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (fd < 0) {
-      DIE("socket");
-    }
+void BringUpLoopback() {
+  int fd;
+  fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    DIE("socket");
+  }
 
-    struct ifreq ifr = {};
-    strncpy(ifr.ifr_name, "lo", IF_NAMESIZE);
+  struct ifreq ifr = {};
+  strncpy(ifr.ifr_name, "lo", IF_NAMESIZE);
 
-    // Verify that name is valid.
-    if (if_nametoindex(ifr.ifr_name) == 0) {
-      DIE("if_nametoindex");
-    }
+  // Verify that name is valid.
+  if (if_nametoindex(ifr.ifr_name) == 0) {
+    DIE("if_nametoindex");
+  }
 
-    // Enable the interface.
-    ifr.ifr_flags |= IFF_UP;
-    if (ioctl(fd, SIOCSIFFLAGS, &ifr) < 0) {
-      DIE("ioctl");
-    }
+  // Enable the interface.
+  ifr.ifr_flags |= IFF_UP;
+  if (ioctl(fd, SIOCSIFFLAGS, &ifr) < 0) {
+    DIE("ioctl");
+  }
 
-    if (close(fd) < 0) {
-      DIE("close");
-    }
+  if (close(fd) < 0) {
+    DIE("close");
+  }
+}
+
+// Sets up the network namespace, if any, unless `loopback_is_up` because the
+// sandbox pool has done most of it already.
+static void SetupNetworking(bool loopback_is_up) {
+  PRINT_DEBUG_TIME("SetupNetworking");
+  // When running in a separate network namespace, enable the loopback interface
+  // because some application may want to use it.
+  if (opt.create_netns == NETNS_WITH_LOOPBACK && !loopback_is_up) {
+    BringUpLoopback();
   }
 
   if (opt.create_netns != NO_NETNS && opt.fake_root) {
@@ -479,6 +649,11 @@ static void ForwardSignal(int signum) {
 }
 
 static void SpawnChild() {
+  PRINT_DEBUG_TIME("SpawnChild");
+  int exec_pipe[2];
+  if (pipe2(exec_pipe, O_CLOEXEC) < 0) {
+    DIE("pipe2");
+  }
   PRINT_DEBUG("calling fork...");
   global_child_pid = fork();
 
@@ -517,15 +692,80 @@ static void SpawnChild() {
     }
   } else {
     PRINT_DEBUG("child started with PID %d", global_child_pid);
+    if (close(exec_pipe[1]) < 0) {
+      DIE("close");
+    }
+    global_exec_fd = exec_pipe[0];
   }
 }
 
-static int WaitForChild() {
+// Has the command run on the node of -u, which it inherits from us. This is
+// done before /sys may be hidden by the sandbox; and here rather than in the
+// client, for the PID 1 of a pool was forked by the pool server.
+static void BindToNumaNodeIfRequested() {
+  if (opt.bind_numa_node && !BindToNumaNode(opt.numa_node)) {
+    PRINT_DEBUG("cannot bind to NUMA node %d: %m", opt.numa_node);
+  }
+}
+
+// Waits until the child has called exec, or has died trying.
+static void WaitForExec() {
+  char buf;
+  if (TEMP_FAILURE_RETRY(read(global_exec_fd, &buf, 1)) < 0) {
+    DIE("read");
+  }
+  if (close(global_exec_fd) < 0) {
+    DIE("close");
+  }
+  global_exec_fd = -1;
+}
+
+// Like wait(), but reads the events of the access log while it waits.
+static pid_t WaitReadingEvents(AccessLog *access_log, int *status) {
+  static int sigchld_fd = -1;
+  if (sigchld_fd < 0) {
+    // A SIGCHLD that comes before it is blocked is not lost: we look for
+    // exited children before each poll.
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, nullptr) < 0) {
+      DIE("sigprocmask");
+    }
+    sigchld_fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+    if (sigchld_fd < 0) {
+      DIE("signalfd");
+    }
+  }
+  while (true) {
+    const pid_t pid = TEMP_FAILURE_RETRY(waitpid(-1, status, WNOHANG));
+    if (pid != 0) {
+      return pid;
+    }
+    struct pollfd fds[2] = {{sigchld_fd, POLLIN, 0},
+                            {access_log->fd(), POLLIN, 0}};
+    if (poll(fds, 2, -1) < 0 && errno != EINTR) {
+      DIE("poll");
+    }
+    if (fds[0].revents & POLLIN) {
+      struct signalfd_siginfo info;
+      while (read(sigchld_fd, &info, sizeof(info)) > 0) {
+      }
+    }
+    if (fds[1].revents & POLLIN) {
+      access_log->ReadEvents();
+    }
+  }
+}
+
+static int WaitForChild(AccessLog *access_log) {
   while (true) {
     // Wait for some process to exit. This includes reparented processes in our
     // PID namespace.
     int status;
-    const pid_t pid = TEMP_FAILURE_RETRY(wait(&status));
+    const pid_t pid = access_log != nullptr
+                          ? WaitReadingEvents(access_log, &status)
+                          : TEMP_FAILURE_RETRY(wait(&status));
 
     if (pid < 0) {
       // We don't expect any errors besides EINTR. In particular, ECHILD should
@@ -556,7 +796,50 @@ static int WaitForChild() {
   }
 }
 
+// Kills what is left of the command and sends its result, with the times
+// of the phases before, to our parent.
+static void ReportResult(int *result_pipe, int exit_code,
+                         SandboxTimes *times) {
+  PRINT_DEBUG_TIME("ReportResult");
+  if (close(result_pipe[0]) < 0) {
+    DIE("close");
+  }
+  // The cgroups cannot go away before we do, so there is no point in telling
+  // our parent about the command earlier than that.
+  if (!opt.cgroups_dirs.empty()) {
+    return;
+  }
+
+  // Our parent goes on once we report, so nothing may run on after that.
+  const int64_t teardown_start = MonotonicTimeUsec();
+  if (kill(-1, SIGKILL) < 0 && errno != ESRCH) {
+    DIE("kill");
+  }
+  while (TEMP_FAILURE_RETRY(wait(nullptr)) >= 0) {
+  }
+  if (errno != ECHILD) {
+    DIE("wait");
+  }
+
+  times->teardown_usec = MonotonicTimeUsec() - teardown_start;
+
+  Pid1Result result;
+  result.status = W_EXITCODE(exit_code, 0);
+  if (getrusage(RUSAGE_CHILDREN, &result.rusage) < 0) {
+    DIE("getrusage");
+  }
+  result.has_times = true;
+  result.times = *times;
+  // Our parent may be gone already, and then there is nobody to tell.
+  if (TEMP_FAILURE_RETRY(write(result_pipe[1], &result, sizeof(result))) !=
+      sizeof(result)) {
+    PRINT_DEBUG("cannot report the result to our parent: %m");
+  }
+  close(result_pipe[1]);
+}
+
 static void MountSandboxAndGoThere() {
+  PRINT_DEBUG_TIME("MountSandboxAndGoThere");
   if (mount(opt.sandbox_root.c_str(), opt.sandbox_root.c_str(), nullptr,
             MS_BIND | MS_NOSUID, nullptr) < 0) {
     DIE("mount");
@@ -575,23 +858,65 @@ static void CreateEmptyFile() {
 }
 
 static void MountDev() {
+  PRINT_DEBUG_TIME("MountDev");
   if (CreateTarget("dev", true) < 0) {
     DIE("CreateTarget /dev");
   }
   const char *devs[] = {"/dev/null", "/dev/random", "/dev/urandom", "/dev/zero",
                         NULL};
   for (int i = 0; devs[i] != NULL; i++) {
-    LinkFile(devs[i] + 1);
+    // On a template (-x), the mount points are there already.
+    if (CreateTarget(devs[i] + 1, false) < 0) {
+      DIE("CreateTarget %s", devs[i]);
+    }
     if (mount(devs[i], devs[i] + 1, NULL, MS_BIND, NULL) < 0) {
       DIE("mount");
     }
   }
-  if (symlink("/proc/self/fd", "dev/fd") < 0) {
+  if (symlink("/proc/self/fd", "dev/fd") < 0 && errno != EEXIST) {
     DIE("symlink");
   }
 }
 
+// Bind mounts `source`, with the mounts below it, on `target`, read-only.
+static void BindMountReadOnly(const char *source, const char *target) {
+  if (global_mount_api != MOUNT_API_OLD) {
+    // Make a detached copy of the tree read-only as a whole before attaching
+    // it, instead of remounting each of its mounts once attached.
+    int tree = syscall(SYS_open_tree, AT_FDCWD, source,
+                       OPEN_TREE_CLONE | OPEN_TREE_CLOEXEC | AT_RECURSIVE);
+    if (tree >= 0 &&
+        MountSetattr(tree, "", AT_EMPTY_PATH | AT_RECURSIVE, MOUNT_ATTR_RDONLY,
+                     0) == 0) {
+      global_mount_api = MOUNT_API_NEW;
+      if (syscall(SYS_move_mount, tree, "", AT_FDCWD, target,
+                  MOVE_MOUNT_F_EMPTY_PATH) < 0) {
+        DIE("move_mount(%s, %s)", source, target);
+      }
+      close(tree);
+      return;
+    }
+    // ENOSYS from an old kernel, or EPERM from a seccomp filter that does not
+    // know these system calls.
+    if (global_mount_api == MOUNT_API_NEW ||
+        (errno != ENOSYS && errno != EPERM)) {
+      DIE("%s(%s)", tree < 0 ? "open_tree" : "mount_setattr", source);
+    }
+    if (tree >= 0) {
+      close(tree);
+    }
+    PRINT_DEBUG("new mount API not available (%m), using mount(2)");
+    global_mount_api = MOUNT_API_OLD;
+  }
+
+  // MS_RDONLY has no effect on a new bind mount, so this one stays writable.
+  if (mount(source, target, NULL, MS_REC | MS_BIND | MS_RDONLY, NULL) < 0) {
+    DIE("mount");
+  }
+}
+
 static void MountAllMounts() {
+  PRINT_DEBUG_TIME("MountAllMounts");
   for (const std::string &tmpfs_dir : opt.tmpfs_dirs) {
     PRINT_DEBUG("tmpfs: %s", tmpfs_dir.c_str());
     if (mount("tmpfs", tmpfs_dir.c_str(), "tmpfs",
@@ -638,12 +963,8 @@ static void MountAllMounts() {
     if (CreateTarget(full_sandbox_path.c_str(), IsDirectory) < 0) {
       DIE("CreateTarget %s", full_sandbox_path.c_str());
     }
-    int result =
-        mount(opt.bind_mount_sources[i].c_str(), full_sandbox_path.c_str(),
-              NULL, MS_REC | MS_BIND | MS_RDONLY, NULL);
-    if (result != 0) {
-      DIE("mount");
-    }
+    BindMountReadOnly(opt.bind_mount_sources[i].c_str(),
+                      full_sandbox_path.c_str());
   }
   for (const std::string &writable_file : opt.writable_files) {
     PRINT_DEBUG("writable: %s", writable_file.c_str());
@@ -652,13 +973,22 @@ static void MountAllMounts() {
       DIE("mount(%s, %s, nullptr, MS_BIND | MS_REC, nullptr)",
           writable_file.c_str(), writable_file.c_str());
     }
+    // A writable file below one of the read-only bind mounts inherits that.
+    if (global_mount_api == MOUNT_API_NEW) {
+      RemountWritable(writable_file);
+    }
   }
 }
 
-static void ChangeRoot() {
+// Pivots to the current directory. The real root goes to `template_old_root`
+// if set, which must exist, or else to a new directory that is removed after.
+static void ChangeRoot(const char *template_old_root) {
+  PRINT_DEBUG_TIME("ChangeRoot");
   // move the real root to old_root, then detach it
-  char old_root[16] = "old-root-XXXXXX";
-  if (mkdtemp(old_root) == NULL) {
+  char old_root[PATH_MAX] = "old-root-XXXXXX";
+  if (template_old_root != nullptr) {
+    snprintf(old_root, sizeof(old_root), "%s", template_old_root);
+  } else if (mkdtemp(old_root) == NULL) {
     perror("mkdtemp");
     DIE("mkdtemp returned NULL\n");
   }
@@ -672,11 +1002,389 @@ static void ChangeRoot() {
   if (umount2(old_root, MNT_DETACH) < 0) {
     DIE("umount2");
   }
-  if (rmdir(old_root) < 0) {
+  if (template_old_root == nullptr && rmdir(old_root) < 0) {
     DIE("rmdir");
   }
 }
 
+// Where the real root goes in a sandbox shown on a template, read-only.
+static const char kTemplateOldRoot[] = "old-root-template";
+
+// Returns the name of the template with the mount points of the targets of
+// -M/-m: a hash of them with their types, which changes with every set.
+static std::string TemplateName() {
+  // 64-bit FNV-1a, which is stable across builds, unlike std::hash.
+  uint64_t hash = 14695981039346656037ULL;
+  auto add = [&hash](const char *data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+      hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ULL;
+    }
+  };
+  // The version of the layout of templates.
+  add("1", 2);
+  for (size_t i = 0; i < opt.bind_mount_sources.size(); ++i) {
+    struct stat sb;
+    if (stat(opt.bind_mount_sources[i].c_str(), &sb) < 0) {
+      DIE("stat(%s)", opt.bind_mount_sources[i].c_str());
+    }
+    add(S_ISDIR(sb.st_mode) ? "d" : "f", 1);
+    add(opt.bind_mount_targets[i].c_str(),
+        opt.bind_mount_targets[i].size() + 1);
+  }
+  char name[17];
+  snprintf(name, sizeof(name), "%016" PRIx64, hash);
+  return name;
+}
+
+// Creates what MountDev, MountAllMounts and ChangeRoot need in a sandbox in
+// `dir`, which is the current directory.
+static void FillTemplate(const std::string &dir) {
+  CreateEmptyFile();
+  if (CreateTarget("dev", true) < 0) {
+    DIE("CreateTarget dev");
+  }
+  for (const char *dev :
+       {"dev/null", "dev/random", "dev/urandom", "dev/zero"}) {
+    LinkFile(dev);
+  }
+  if (symlink("/proc/self/fd", "dev/fd") < 0) {
+    DIE("symlink");
+  }
+  if (mkdir(kTemplateOldRoot, 0755) < 0) {
+    DIE("mkdir(%s)", kTemplateOldRoot);
+  }
+  for (size_t i = 0; i < opt.bind_mount_sources.size(); ++i) {
+    struct stat sb;
+    if (stat(opt.bind_mount_sources[i].c_str(), &sb) < 0) {
+      DIE("stat(%s)", opt.bind_mount_sources[i].c_str());
+    }
+    const std::string target = dir + opt.bind_mount_targets[i];
+    if (CreateTarget(target.c_str(), S_ISDIR(sb.st_mode)) < 0) {
+      DIE("CreateTarget %s", target.c_str());
+    }
+  }
+}
+
+// Returns the template for the mounts of the sandbox in -x, creating it
+// first if it does not exist. Templates are never changed once they have
+// their name, so sandboxes can use them without taking the lock.
+static std::string GetTemplate() {
+  const std::string path = opt.template_dir + "/" + TemplateName();
+  struct stat sb;
+  if (stat(path.c_str(), &sb) == 0) {
+    return path;
+  }
+  if (mkdir(opt.template_dir.c_str(), 0755) < 0 && errno != EEXIST) {
+    DIE("mkdir(%s)", opt.template_dir.c_str());
+  }
+  const std::string lock_path = path + ".lock";
+  int lock = open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (lock < 0) {
+    DIE("open(%s)", lock_path.c_str());
+  }
+  if (TEMP_FAILURE_RETRY(flock(lock, LOCK_EX)) < 0) {
+    DIE("flock(%s)", lock_path.c_str());
+  }
+  if (stat(path.c_str(), &sb) < 0) {
+    // mkdtemp, because an earlier sandbox may have died half way through.
+    std::string building = path + "-XXXXXX";
+    if (mkdtemp(&building[0]) == nullptr) {
+      DIE("mkdtemp(%s)", building.c_str());
+    }
+    if (chmod(building.c_str(), 0755) < 0) {
+      DIE("chmod(%s)", building.c_str());
+    }
+    PRINT_DEBUG("creating the template %s", path.c_str());
+    if (chdir(building.c_str()) < 0) {
+      DIE("chdir(%s)", building.c_str());
+    }
+    FillTemplate(building);
+    if (rename(building.c_str(), path.c_str()) < 0) {
+      DIE("rename(%s, %s)", building.c_str(), path.c_str());
+    }
+  }
+  close(lock);
+  return path;
+}
+
+// Mounts a read-only union of the sandbox directory over its template from
+// -x on it and goes there, instead of MountSandboxAndGoThere. tmp, the working
+// directory and the writable files in it are copies of their own mounts, so
+// they stay writable. Targets below them are created in them as usual.
+// Returns false, with nothing changed that MountSandboxAndGoThere does not
+// change too, if the kernel cannot do this.
+static bool MountSandboxOnTemplate() {
+  PRINT_DEBUG_TIME("MountSandboxOnTemplate");
+  if (opt.working_dir == opt.sandbox_root ||
+      strpbrk(opt.sandbox_root.c_str(), ",:\\") != nullptr) {
+    return false;
+  }
+  const std::string template_root = GetTemplate();
+  if (strpbrk(template_root.c_str(), ",:\\") != nullptr) {
+    return false;
+  }
+  if (chdir(opt.sandbox_root.c_str()) < 0) {
+    DIE("chdir(%s)", opt.sandbox_root.c_str());
+  }
+  // The tmp of the sandbox also carries the file to link empty files from.
+  CreateEmptyFile();
+
+  std::vector<std::string> writable = {opt.sandbox_root + "/tmp",
+                                       opt.working_dir};
+  for (const std::string &writable_file : opt.writable_files) {
+    if (writable_file.compare(0, opt.sandbox_root.size() + 1,
+                              opt.sandbox_root + "/") == 0) {
+      writable.push_back(writable_file);
+    }
+  }
+  std::vector<int> trees;
+  for (const std::string &path : writable) {
+    int tree = syscall(SYS_open_tree, AT_FDCWD, path.c_str(),
+                       OPEN_TREE_CLONE | OPEN_TREE_CLOEXEC | AT_RECURSIVE);
+    if (tree < 0 ||
+        MountSetattr(tree, "", AT_EMPTY_PATH | AT_RECURSIVE,
+                     MOUNT_ATTR_NOSUID, 0) < 0) {
+      if (errno != ENOSYS && errno != EPERM) {
+        DIE("%s(%s)", tree < 0 ? "open_tree" : "mount_setattr", path.c_str());
+      }
+      PRINT_DEBUG("cannot use the template: %m");
+      if (tree >= 0) {
+        close(tree);
+      }
+      for (int other : trees) {
+        close(other);
+      }
+      return false;
+    }
+    trees.push_back(tree);
+  }
+
+  // The sandbox directory is the upper of the two lower layers.
+  const std::string options =
+      "lowerdir=" + opt.sandbox_root + ":" + template_root;
+  if (mount("overlay", opt.sandbox_root.c_str(), "overlay", MS_NOSUID,
+            options.c_str()) < 0) {
+    // Before Linux 5.11, user namespaces cannot mount overlays.
+    PRINT_DEBUG("cannot use the template: mount(overlay, %s): %m",
+                opt.sandbox_root.c_str());
+    for (int tree : trees) {
+      close(tree);
+    }
+    return false;
+  }
+  for (size_t i = 0; i < trees.size(); ++i) {
+    if (syscall(SYS_move_mount, trees[i], "", AT_FDCWD, writable[i].c_str(),
+                MOVE_MOUNT_F_EMPTY_PATH) < 0) {
+      DIE("move_mount(%s)", writable[i].c_str());
+    }
+    close(trees[i]);
+  }
+  if (chdir(opt.sandbox_root.c_str()) < 0) {
+    DIE("chdir(%s)", opt.sandbox_root.c_str());
+  }
+  return true;
+}
+
+// Where MountMinimalRoot keeps the host's root while it builds the new one.
+static const char kOldRoot[] = "/oldroot";
+
+// Creates an empty file or directory, with its parent directories, to mount
+// on at `path`, unless there is something there already. The root is there
+// already as "".
+static void CreateMountPoint(const std::string &path, bool is_directory) {
+  struct stat sb;
+  if (path.empty() || lstat(path.c_str(), &sb) == 0) {
+    return;
+  }
+  if (is_directory) {
+    if (CreateTarget(path.c_str(), true) < 0) {
+      DIE("CreateTarget %s", path.c_str());
+    }
+    return;
+  }
+  CreateMountPoint(path.substr(0, path.rfind('/')), true);
+  CreateFile(path.c_str());
+}
+
+// Shows the host's `path` at the same place in the new root, read-only. A
+// symlink is copied instead, so that it resolves in the new root.
+static void MountRootPath(const std::string &path) {
+  struct stat sb;
+  if (lstat(path.c_str(), &sb) == 0 && !S_ISDIR(sb.st_mode)) {
+    // Below a path shown already.
+    return;
+  }
+  const std::string source = kOldRoot + path;
+  if (lstat(source.c_str(), &sb) < 0) {
+    if (errno != ENOENT) {
+      DIE("lstat(%s)", source.c_str());
+    }
+    PRINT_DEBUG("root path %s does not exist", path.c_str());
+    return;
+  }
+  if (S_ISLNK(sb.st_mode)) {
+    char target[PATH_MAX];
+    const ssize_t size = readlink(source.c_str(), target, sizeof(target) - 1);
+    if (size < 0) {
+      DIE("readlink(%s)", source.c_str());
+    }
+    target[size] = '\0';
+    CreateMountPoint(path.substr(0, path.rfind('/')), true);
+    PRINT_DEBUG("root symlink: %s -> %s", path.c_str(), target);
+    if (symlink(target, path.c_str()) < 0) {
+      DIE("symlink(%s, %s)", target, path.c_str());
+    }
+    return;
+  }
+  CreateMountPoint(path, S_ISDIR(sb.st_mode));
+  PRINT_DEBUG("root path: %s", path.c_str());
+  BindMountReadOnly(source.c_str(), path.c_str());
+}
+
+// Bind mounts the host's `source` on `target` in the new root, writable.
+static void BindMountWritable(const std::string &source,
+                              const std::string &target, int flags) {
+  const std::string host_source = kOldRoot + source;
+  struct stat sb;
+  if (stat(host_source.c_str(), &sb) < 0) {
+    DIE("stat(%s)", host_source.c_str());
+  }
+  CreateMountPoint(target, S_ISDIR(sb.st_mode));
+  if (mount(host_source.c_str(), target.c_str(), nullptr, MS_BIND | flags,
+            nullptr) < 0) {
+    DIE("mount(%s, %s, nullptr, MS_BIND | %d, nullptr)", host_source.c_str(),
+        target.c_str(), flags);
+  }
+}
+
+static bool IsWritableFile(const std::string &path) {
+  for (const std::string &writable_file : opt.writable_files) {
+    if (writable_file == path) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Instead of MountFilesystems and MakeFilesystemMostlyReadOnly, which change
+// every mount of the host, builds a new root on a tmpfs from the paths of -r
+// and the ones of the command only. So it takes as long however many mounts
+// the host has.
+static void MountMinimalRoot() {
+  PRINT_DEBUG_TIME("MountMinimalRoot");
+  // The tmpfs only hides the host's /tmp until pivot_root moves the host's
+  // root below it, and the host's /tmp with it.
+  if (mount("tmpfs", "/tmp", "tmpfs", MS_NOSUID | MS_NODEV, "mode=0755") < 0) {
+    DIE("mount(tmpfs, /tmp, tmpfs, MS_NOSUID | MS_NODEV, mode=0755)");
+  }
+  if (chdir("/tmp") < 0) {
+    DIE("chdir(/tmp)");
+  }
+  if (mkdir(kOldRoot + 1, 0755) < 0) {
+    DIE("mkdir(%s)", kOldRoot + 1);
+  }
+  if (syscall(SYS_pivot_root, ".", kOldRoot + 1) < 0) {
+    DIE("pivot_root(/tmp, %s)", kOldRoot + 1);
+  }
+  if (chdir("/") < 0) {
+    DIE("chdir(/)");
+  }
+
+  // Parents come before the paths below them.
+  std::vector<std::string> root_paths = opt.root_paths;
+  std::sort(root_paths.begin(), root_paths.end());
+  for (const std::string &path : root_paths) {
+    MountRootPath(path);
+  }
+
+  // The mounts of the command, as MountFilesystems and
+  // MakeFilesystemMostlyReadOnly leave them.
+  for (size_t i = 0; i < opt.bind_mount_sources.size(); i++) {
+    const std::string &source = opt.bind_mount_sources[i];
+    const std::string &target = opt.bind_mount_targets[i];
+    PRINT_DEBUG("bind mount: %s -> %s", source.c_str(), target.c_str());
+    if (IsWritableFile(target)) {
+      BindMountWritable(source, target, MS_REC);
+      continue;
+    }
+    const std::string host_source = kOldRoot + source;
+    struct stat sb;
+    if (stat(host_source.c_str(), &sb) < 0) {
+      DIE("stat(%s)", host_source.c_str());
+    }
+    CreateMountPoint(target, S_ISDIR(sb.st_mode));
+    BindMountReadOnly(host_source.c_str(), target.c_str());
+  }
+  for (const std::string &tmpfs_dir : opt.tmpfs_dirs) {
+    PRINT_DEBUG("tmpfs: %s", tmpfs_dir.c_str());
+    CreateMountPoint(tmpfs_dir, true);
+    if (mount("tmpfs", tmpfs_dir.c_str(), "tmpfs",
+              MS_NOSUID | MS_NODEV | MS_NOATIME, nullptr) < 0) {
+      DIE("mount(tmpfs, %s, tmpfs, MS_NOSUID | MS_NODEV | MS_NOATIME, nullptr)",
+          tmpfs_dir.c_str());
+    }
+  }
+  for (const std::string &writable_file : opt.writable_files) {
+    bool mounted = false;
+    for (const std::string &target : opt.bind_mount_targets) {
+      mounted = mounted || target == writable_file;
+    }
+    if (!mounted) {
+      PRINT_DEBUG("writable: %s", writable_file.c_str());
+      BindMountWritable(writable_file, writable_file, MS_REC);
+    }
+  }
+  PRINT_DEBUG("working dir: %s", opt.working_dir.c_str());
+  if (!opt.overlay_lower_dir.empty()) {
+    const std::string options = std::string("lowerdir=") + kOldRoot +
+                                opt.overlay_lower_dir + ",upperdir=" +
+                                kOldRoot + opt.working_dir + ",workdir=" +
+                                kOldRoot + opt.overlay_work_dir;
+    PRINT_DEBUG("overlay: %s", options.c_str());
+    CreateMountPoint(opt.working_dir, true);
+    if (mount("overlay", opt.working_dir.c_str(), "overlay", 0,
+              options.c_str()) < 0) {
+      DIE("mount(overlay, %s, overlay, 0, %s)", opt.working_dir.c_str(),
+          options.c_str());
+    }
+  } else {
+    BindMountWritable(opt.working_dir, opt.working_dir, 0);
+  }
+
+  // A few devices, unless all of /dev is shown.
+  if (!std::binary_search(root_paths.begin(), root_paths.end(), "/dev")) {
+    for (const char *dev : {"/dev/null", "/dev/random", "/dev/urandom",
+                            "/dev/zero", "/dev/tty"}) {
+      BindMountWritable(dev, dev, 0);
+    }
+    if (symlink("/proc/self/fd", "/dev/fd") < 0) {
+      DIE("symlink(/proc/self/fd, /dev/fd)");
+    }
+    if (opt.enable_pty) {
+      BindMountWritable("/dev/pts", "/dev/pts", 0);
+      if (symlink("pts/ptmx", "/dev/ptmx") < 0) {
+        DIE("symlink(pts/ptmx, /dev/ptmx)");
+      }
+    }
+  }
+
+  // The kernel only lets us mount a proc or sysfs while the host's are
+  // still visible.
+  CreateMountPoint("/proc", true);
+  if (opt.create_netns != NO_NETNS) {
+    CreateMountPoint("/sys", true);
+  }
+  MountProcAndSys();
+
+  if (umount2(kOldRoot, MNT_DETACH) < 0) {
+    DIE("umount2(%s, MNT_DETACH)", kOldRoot);
+  }
+  if (rmdir(kOldRoot) < 0) {
+    DIE("rmdir(%s)", kOldRoot);
+  }
+  Remount("/", MS_BIND | MS_REMOUNT | MS_RDONLY | MS_NOSUID | MS_NODEV);
+}
+
 int Pid1Main(void *args) {
   PRINT_DEBUG("Pid1Main started");
 
@@ -692,31 +1400,71 @@ int Pid1Main(void *args) {
 
   // Start with default signal handlers and an empty signal mask.
   ClearSignalMask();
+  BindToNumaNodeIfRequested();
 
   SetupSelfDestruction(pid1Args.pipe_to_parent);
 
   // Sandbox ourselves.
+  SandboxTimes times = {};
+  int64_t start = MonotonicTimeUsec();
   SetupMountNamespace();
   SetupUserNamespace();
   if (opt.fake_hostname) {
     SetupUtsNamespace();
   }
-
+  int64_t end = MonotonicTimeUsec();
+  times.namespace_setup_usec = end - start;
+
+  start = end;
+  BAZEL_PROBE(linux_sandbox, mount_setup_begin, opt.working_dir.c_str());
+  LazyInputs *lazy_inputs = nullptr;
+  if (!opt.lazy_inputs_manifest.empty()) {
+    // Mounted on the lower layer before the overlay is. Never freed, since
+    // its threads serve the filesystem until we exit.
+    lazy_inputs = new LazyInputs(opt.lazy_inputs_manifest);
+    lazy_inputs->Mount(opt.overlay_lower_dir, opt.lazy_inputs_store,
+                       pid1Args.lazy_inputs_requests_fd);
+  }
   if (opt.hermetic) {
-    MountSandboxAndGoThere();
-    CreateEmptyFile();
+    const bool on_template =
+        !opt.template_dir.empty() && MountSandboxOnTemplate();
+    if (!on_template) {
+      MountSandboxAndGoThere();
+      CreateEmptyFile();
+    }
     MountDev();
     MountProcAndSys();
     MountAllMounts();
-    ChangeRoot();
+    ChangeRoot(on_template ? kTemplateOldRoot : nullptr);
+  } else if (!opt.root_paths.empty()) {
+    MountMinimalRoot();
   } else {
     MountFilesystems();
     MakeFilesystemMostlyReadOnly();
     MountProcAndSys();
   }
-  SetupNetworking();
+  end = MonotonicTimeUsec();
+  times.mount_setup_usec = end - start;
+  BAZEL_PROBE(linux_sandbox, mount_setup_end, times.mount_setup_usec);
+
+  start = end;
+  SetupNetworking(false);
+  end = MonotonicTimeUsec();
+  times.network_setup_usec = end - start;
+
+  start = end;
   EnterWorkingDirectory();
 
+  // Mark the files of the working directory before the command can open
+  // them. Without a complete list, there is none.
+  std::unique_ptr<AccessLog> access_log;
+  if (pid1Args.access_log_fd >= 0) {
+    access_log.reset(new AccessLog());
+    if (!access_log->Start()) {
+      access_log.reset();
+    }
+  }
+
   // Ignore terminal signals; we hand off the terminal to the child in
   // SpawnChild below.
   IgnoreSignal(SIGTTIN);
@@ -727,9 +1475,100 @@ int Pid1Main(void *args) {
 
   // Forward requests to shut down gracefully to the child.
   InstallSignalHandler(SIGTERM, ForwardSignal);
+  WaitForExec();
+  end = MonotonicTimeUsec();
+  times.spawn_usec = end - start;
+  BAZEL_PROBE(linux_sandbox, child_exec, global_child_pid, opt.args[0]);
 
   // Note that there's no need to kill any remaining descendant processes; they
   // are in our PID namespace and the kernel will send them SIGKILL
-  // automatically once we exit.
-  return WaitForChild();
+  // automatically once we exit. We only do it ourselves to report early.
+  start = end;
+  const int exit_code = WaitForChild(access_log.get());
+  times.command_usec = MonotonicTimeUsec() - start;
+  BAZEL_PROBE(linux_sandbox, child_exit, global_child_pid, exit_code);
+  if (access_log) {
+    access_log->Finish(pid1Args.access_log_fd);
+  }
+  if (pid1Args.access_log_fd >= 0) {
+    close(pid1Args.access_log_fd);
+  }
+  ReportResult(pid1Args.result_pipe, exit_code, &times);
+  if (lazy_inputs != nullptr) {
+    // Returning from the function that clone(2) runs only ends this thread,
+    // and the threads serving the inputs would keep us alive.
+    _exit(exit_code);
+  }
+  return exit_code;
+}
+
+void SetupPooledNamespaces() {
+  SetupMountNamespace();
+  SetupUserNamespace();
+  if (opt.fake_hostname) {
+    SetupUtsNamespace();
+  }
+  MakeFilesystemMostlyReadOnly();
+}
+
+int PooledPid1Main(void *args) {
+  PRINT_DEBUG("PooledPid1Main started");
+
+  Pid1Args pid1Args = *(static_cast<Pid1Args *>(args));
+
+  if (getpid() != 1) {
+    DIE("Using PID namespaces, but we are not PID 1");
+  }
+
+  WaitPipe(pid1Args.pipe_from_parent);
+  ClearSignalMask();
+  BindToNumaNodeIfRequested();
+  SetupSelfDestruction(pid1Args.pipe_to_parent);
+
+  // Enter the network namespace that the pool server has set up for us
+  // before /sys is mounted for it.
+  SandboxTimes times = {};
+  int64_t start = MonotonicTimeUsec();
+  if (pid1Args.netns_fd >= 0) {
+    if (setns(pid1Args.netns_fd, CLONE_NEWNET) < 0) {
+      DIE("setns");
+    }
+    close(pid1Args.netns_fd);
+  }
+  int64_t end = MonotonicTimeUsec();
+  times.namespace_setup_usec = end - start;
+
+  // Our mount namespace is a copy of the pool's, where everything is
+  // read-only already. Only the mounts of this command are left to do.
+  start = end;
+  MountFilesystems();
+  RemountWritable(opt.working_dir);
+  for (const std::string &writable_file : opt.writable_files) {
+    RemountWritable(writable_file);
+  }
+  MountProcAndSys();
+  end = MonotonicTimeUsec();
+  times.mount_setup_usec = end - start;
+
+  // This writes to /proc/sys, which is writable again in our new /proc.
+  start = end;
+  SetupNetworking(pid1Args.netns_fd >= 0);
+  end = MonotonicTimeUsec();
+  times.network_setup_usec = end - start;
+
+  start = end;
+  EnterWorkingDirectory();
+  IgnoreSignal(SIGTTIN);
+  IgnoreSignal(SIGTTOU);
+  SpawnChild();
+  InstallSignalHandler(SIGTERM, ForwardSignal);
+  WaitForExec();
+  end = MonotonicTimeUsec();
+  times.spawn_usec = end - start;
+
+  start = end;
+  const int exit_code = WaitForChild(nullptr);
+  times.command_usec = MonotonicTimeUsec() - start;
+  ReportResult(pid1Args.result_pipe, exit_code, &times);
+  return exit_code;
 }
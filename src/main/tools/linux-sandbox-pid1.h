@@ -15,11 +15,56 @@
 #ifndef SRC_MAIN_TOOLS_LINUX_SANDBOX_PID1_H_
 #define SRC_MAIN_TOOLS_LINUX_SANDBOX_PID1_H_
 
+#include <sys/resource.h>
+
+#include "src/main/tools/process-tools.h"
+
 struct Pid1Args {
   int *pipe_to_parent;
   int *pipe_from_parent;
+  // The write end of this pipe carries a Pid1Result, unless PID 1 exits before
+  // it gets to report one. Both ends must be close-on-exec.
+  int *result_pipe;
+  // For PooledPid1Main, a network namespace with its loopback interface set
+  // up as requested, to enter instead of the one it was cloned into.
+  int netns_fd = -1;
+  // For Pid1Main with -I, the file to write the access log to, close-on-exec.
+  int access_log_fd = -1;
+  // For Pid1Main with -g, the file to request the missing blobs of the lazy
+  // inputs from, close-on-exec.
+  int lazy_inputs_requests_fd = -1;
+};
+
+// What PID 1 reports when the command is done and nothing of it runs anymore,
+// before it exits: tearing down the namespaces of the sandbox, with all their
+// mounts, takes place when PID 1 exits and can take a while.
+struct Pid1Result {
+  // The status, like wait4 returns it, that PID 1 exits with.
+  int status;
+  // The resource usage of the command.
+  struct rusage rusage;
+  // Whether `times` is set, which it is unless PID 1 died before reporting.
+  bool has_times;
+  // The time PID 1 spent on each phase, except on the part of creating the
+  // namespaces that the clone(2) creating PID 1 does.
+  SandboxTimes times;
 };
 
 int Pid1Main(void *pid1Args);
 
+// Sets up the user, mount and (if requested) UTS namespaces that the calling
+// process was cloned into the way Pid1Main does, except that no path of a
+// command is made writable: the whole filesystem is read-only. The sandbox
+// pool server keeps these namespaces for the commands it runs.
+void SetupPooledNamespaces();
+
+// Brings up the loopback interface in the network namespace of the calling
+// process, dying on failure.
+void BringUpLoopback();
+
+// Like Pid1Main, for a process cloned into new PID, mount and IPC namespaces
+// by the sandbox pool server: only adds the mounts of the command in `opt`
+// to the ones of the pool, then runs it.
+int PooledPid1Main(void *pid1Args);
+
 #endif
@@ -0,0 +1,742 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/tools/linux-sandbox-pool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "src/main/tools/linux-sandbox-options.h"
+#include "src/main/tools/linux-sandbox-pid1.h"
+#include "src/main/tools/logging.h"
+#include "src/main/tools/process-tools.h"
+
+// A pool server exits after it has not been handed a command for this long.
+static const int kIdleTimeoutSecs = 10 * 60;
+
+static const int kStackSize = 1024 * 1024;
+
+// The file descriptors that come with a command: stdin, stdout, stderr and,
+// optionally, the file PRINT_DEBUG writes to.
+static const int kMaxRequestFds = 4;
+
+// How many network namespaces the server keeps ready for the next commands.
+static const size_t kSpareNetns = 4;
+
+// How many network namespaces given back by commands the server keeps at
+// most, for the next burst of commands.
+static const size_t kMaxIdleNetns = 256;
+
+static bool ReadAll(int fd, void *buf, size_t size) {
+  char *p = static_cast<char *>(buf);
+  while (size > 0) {
+    ssize_t r = read(fd, p, size);
+    if (r < 0 && errno == EINTR) {
+      continue;
+    }
+    if (r <= 0) {
+      return false;
+    }
+    p += r;
+    size -= r;
+  }
+  return true;
+}
+
+static bool WriteAll(int fd, const void *buf, size_t size) {
+  const char *p = static_cast<const char *>(buf);
+  while (size > 0) {
+    ssize_t r = write(fd, p, size);
+    if (r < 0 && errno == EINTR) {
+      continue;
+    }
+    if (r <= 0) {
+      return false;
+    }
+    p += r;
+    size -= r;
+  }
+  return true;
+}
+
+// Sends a byte and a file descriptor in a datagram.
+static bool SendFd(int socket, char tag, int fd) {
+  char control[CMSG_SPACE(sizeof(fd))] = {};
+  struct iovec iov = {&tag, 1};
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fd));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(fd));
+  return TEMP_FAILURE_RETRY(sendmsg(socket, &msg, MSG_NOSIGNAL)) == 1;
+}
+
+// Receives what SendFd sends. Returns the file descriptor, close-on-exec, or
+// -1 if there is none.
+static int ReceiveFd(int socket, char *tag) {
+  int fd = -1;
+  char control[CMSG_SPACE(sizeof(fd))] = {};
+  struct iovec iov = {tag, 1};
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  if (TEMP_FAILURE_RETRY(recvmsg(socket, &msg, MSG_CMSG_CLOEXEC)) != 1) {
+    return -1;
+  }
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg != nullptr && cmsg->cmsg_level == SOL_SOCKET &&
+      cmsg->cmsg_type == SCM_RIGHTS) {
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+  }
+  return fd;
+}
+
+// Names the server for the options that its namespaces depend on.
+static std::string PoolName() {
+  std::string flags;
+  if (opt.fake_hostname) flags += 'H';
+  if (opt.create_netns == NETNS) flags += 'n';
+  if (opt.create_netns == NETNS_WITH_LOOPBACK) flags += 'N';
+  if (opt.fake_root) flags += 'R';
+  if (opt.fake_username) flags += 'U';
+  if (opt.enable_pty) flags += 'P';
+  return flags.empty() ? "pool" : "pool-" + flags;
+}
+
+// Returns the arguments that make the server parse the same command as the
+// one in `opt`. Argument files are expanded already, and the client takes
+// care of redirecting the output, the timeout, the statistics and putting
+// PID 1 into the cgroups.
+static std::vector<std::string> PooledArgs() {
+  std::vector<std::string> args = {"linux-sandbox", "-W", opt.working_dir};
+  for (const std::string &writable_file : opt.writable_files) {
+    args.insert(args.end(), {"-w", writable_file});
+  }
+  for (const std::string &tmpfs_dir : opt.tmpfs_dirs) {
+    args.insert(args.end(), {"-e", tmpfs_dir});
+  }
+  for (size_t i = 0; i < opt.bind_mount_sources.size(); i++) {
+    args.insert(args.end(), {"-M", opt.bind_mount_sources[i], "-m",
+                             opt.bind_mount_targets[i]});
+  }
+  if (opt.fake_hostname) args.push_back("-H");
+  if (opt.create_netns == NETNS) args.push_back("-n");
+  if (opt.create_netns == NETNS_WITH_LOOPBACK) args.push_back("-N");
+  if (opt.fake_root) args.push_back("-R");
+  if (opt.fake_username) args.push_back("-U");
+  if (opt.enable_pty) args.push_back("-P");
+  for (const std::string &cgroups_dir : opt.cgroups_dirs) {
+    args.insert(args.end(), {"-C", cgroups_dir});
+  }
+  if (opt.bind_numa_node) {
+    args.insert(args.end(), {"-u", std::to_string(opt.numa_node)});
+  }
+  args.push_back("--");
+  args.insert(args.end(), opt.args.begin(), opt.args.end());
+  return args;
+}
+
+static int Connect(const std::string &socket_path) {
+  struct sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(addr.sun_path)) {
+    return -1;
+  }
+  strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (TEMP_FAILURE_RETRY(connect(fd, reinterpret_cast<sockaddr *>(&addr),
+                                 sizeof(addr))) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Sends the command: the size of the arguments together with the file
+// descriptors, then the NUL-terminated arguments.
+static bool SendRequest(int connection) {
+  std::string payload;
+  for (const std::string &arg : PooledArgs()) {
+    payload.append(arg).push_back('\0');
+  }
+  const uint32_t size = payload.size();
+
+  int fds[kMaxRequestFds] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+  int num_fds = 3;
+  if (global_debug != nullptr) {
+    fflush(global_debug);
+    fds[num_fds++] = fileno(global_debug);
+  }
+  char control[CMSG_SPACE(sizeof(fds))] = {};
+  struct iovec iov = {const_cast<uint32_t *>(&size), sizeof(size)};
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = CMSG_SPACE(num_fds * sizeof(int));
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(num_fds * sizeof(int));
+  memcpy(CMSG_DATA(cmsg), fds, num_fds * sizeof(int));
+
+  if (TEMP_FAILURE_RETRY(sendmsg(connection, &msg, MSG_NOSIGNAL)) !=
+      sizeof(size)) {
+    return false;
+  }
+  return WriteAll(connection, payload.data(), payload.size());
+}
+
+static bool ReceiveRequest(int connection, std::vector<std::string> *args,
+                           std::vector<int> *fds) {
+  uint32_t size;
+  char control[CMSG_SPACE(kMaxRequestFds * sizeof(int))] = {};
+  struct iovec iov = {&size, sizeof(size)};
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  if (TEMP_FAILURE_RETRY(recvmsg(connection, &msg, MSG_CMSG_CLOEXEC)) !=
+      sizeof(size)) {
+    return false;
+  }
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      const size_t num_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      fds->resize(num_fds);
+      memcpy(fds->data(), CMSG_DATA(cmsg), num_fds * sizeof(int));
+    }
+  }
+  if (fds->size() < 3) {
+    return false;
+  }
+
+  std::string payload(size, '\0');
+  if (!ReadAll(connection, &payload[0], size)) {
+    return false;
+  }
+  for (size_t start = 0; start < payload.size();) {
+    const size_t end = payload.find('\0', start);
+    if (end == std::string::npos) {
+      return false;
+    }
+    args->push_back(payload.substr(start, end - start));
+    start = end + 1;
+  }
+  return true;
+}
+
+// Runs one command in the server's namespaces, in a process of its own, in
+// the network namespace `netns_fd` if it is not -1. That namespace goes back
+// to the server over `netns_returns` when the command is done, unless the
+// command had a fake root to change it with. Returns the exit code of the
+// process.
+static int HandleCommand(int connection, int netns_fd, int netns_returns) {
+  // The server ignores SIGCHLD so that these processes don't linger, but we
+  // need to wait for our PID 1.
+  signal(SIGCHLD, SIG_DFL);
+
+  std::vector<std::string> args;
+  std::vector<int> fds;
+  if (!ReceiveRequest(connection, &args, &fds)) {
+    return EXIT_FAILURE;
+  }
+  for (int fd = 0; fd < 3; fd++) {
+    if (dup2(fds[fd], fd) < 0) {
+      DIE("dup2");
+    }
+    close(fds[fd]);
+  }
+  if (fds.size() > 3) {
+    global_debug = fdopen(fds[3], "w");
+  }
+
+  // `args` outlives opt.args, which points into it.
+  std::vector<char *> argv;
+  for (std::string &arg : args) {
+    argv.push_back(&arg[0]);
+  }
+  argv.push_back(nullptr);
+  opt = Options();
+  optind = 1;
+  ParseOptions(argv.size() - 1, argv.data());
+
+  sigset_t sigchld;
+  sigemptyset(&sigchld);
+  sigaddset(&sigchld, SIGCHLD);
+  if (sigprocmask(SIG_BLOCK, &sigchld, nullptr) < 0) {
+    DIE("sigprocmask");
+  }
+  int sigchld_fd = signalfd(-1, &sigchld, SFD_CLOEXEC);
+  if (sigchld_fd < 0) {
+    DIE("signalfd");
+  }
+
+  int pipe_from_child[2], pipe_to_child[2], result_pipe[2];
+  if (pipe(pipe_from_child) < 0 || pipe(pipe_to_child) < 0 ||
+      pipe2(result_pipe, O_CLOEXEC) < 0) {
+    DIE("pipe");
+  }
+  Pid1Args pid1Args;
+  pid1Args.pipe_to_parent = pipe_from_child;
+  pid1Args.pipe_from_parent = pipe_to_child;
+  pid1Args.result_pipe = result_pipe;
+  pid1Args.netns_fd = netns_fd;
+  int clone_flags = CLONE_NEWNS | CLONE_NEWIPC | CLONE_NEWPID | SIGCHLD;
+  if (opt.create_netns != NO_NETNS && netns_fd < 0) {
+    // The server has none ready, make one the slow way.
+    clone_flags |= CLONE_NEWNET;
+  }
+  std::vector<char> child_stack(kStackSize);
+  const pid_t pid1 = clone(PooledPid1Main, child_stack.data() + kStackSize,
+                           clone_flags, &pid1Args);
+  if (pid1 < 0) {
+    DIE("clone");
+  }
+  close(result_pipe[1]);
+  int result_fd = result_pipe[0];
+
+  // Let the client put PID 1 into its cgroups before it starts.
+  char go;
+  bool client_gone = !WriteAll(connection, &pid1, sizeof(pid1)) ||
+                     !ReadAll(connection, &go, 1);
+  if (client_gone) {
+    kill(pid1, SIGKILL);
+  }
+  SignalPipe(pipe_to_child);
+  WaitPipe(pipe_from_child);
+
+  // Nothing of the command is left in its network namespace once it is done,
+  // but a fake root may have changed its configuration.
+  if (netns_fd >= 0 && opt.fake_root) {
+    close(netns_fd);
+    netns_fd = -1;
+  }
+  while (true) {
+    struct pollfd fds[3] = {{sigchld_fd, POLLIN, 0},
+                            {client_gone ? -1 : connection, POLLIN, 0},
+                            {result_fd, POLLIN, 0}};
+    if (poll(fds, 3, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      DIE("poll");
+    }
+    if (fds[1].revents != 0) {
+      // The client sends nothing else; this is its end of the connection
+      // closing because it died. Take the command down with it.
+      PRINT_DEBUG("client went away, killing PID %d", pid1);
+      kill(pid1, SIGKILL);
+      client_gone = true;
+    }
+    if (fds[2].revents != 0) {
+      // The client need not wait for PID 1 to tear down its namespaces.
+      Pid1Result result;
+      if (ReadAll(result_fd, &result, sizeof(result))) {
+        WriteAll(connection, &result, sizeof(result));
+        if (netns_fd >= 0) {
+          SendFd(netns_returns, 'r', netns_fd);
+        }
+        return EXIT_SUCCESS;
+      }
+      close(result_fd);
+      result_fd = -1;
+    }
+    if (fds[0].revents != 0) {
+      struct signalfd_siginfo info;
+      if (read(sigchld_fd, &info, sizeof(info)) < 0 && errno != EAGAIN) {
+        DIE("read");
+      }
+      Pid1Result result = {};
+      const pid_t pid = wait4(pid1, &result.status, WNOHANG, &result.rusage);
+      if (pid < 0) {
+        DIE("wait4");
+      }
+      if (pid == pid1) {
+        WriteAll(connection, &result, sizeof(result));
+        if (netns_fd >= 0) {
+          SendFd(netns_returns, 'r', netns_fd);
+        }
+        return EXIT_SUCCESS;
+      }
+    }
+  }
+}
+
+// The network namespaces that the server hands to the commands that get one.
+// The kernel creates and destroys network namespaces one at a time, so that
+// many commands starting at once would wait for each other to get theirs.
+// Instead, a helper process of the server creates them ahead of time, and
+// commands give theirs back when they are done.
+struct NetnsPool {
+  // The server receives namespaces on returns[0]: new ones from the helper,
+  // tagged 'n', and used ones from the commands, tagged 'r'. Both send to
+  // returns[1].
+  int returns[2];
+  // The connection to the helper, or -1 if there is none.
+  int helper;
+  // How many namespaces the helper has been asked for and not sent yet.
+  size_t pending;
+  // The namespaces ready for commands.
+  std::vector<int> idle;
+};
+
+// The helper: for every byte read from `requests`, moves into a new network
+// namespace, sets it up and sends it to `returns`.
+static int NetnsHelperMain(int requests, int returns) {
+  char request;
+  while (ReadAll(requests, &request, 1)) {
+    if (unshare(CLONE_NEWNET) < 0) {
+      DIE("unshare(CLONE_NEWNET)");
+    }
+    if (opt.create_netns == NETNS_WITH_LOOPBACK) {
+      BringUpLoopback();
+    }
+    int netns_fd = open("/proc/self/ns/net", O_RDONLY | O_CLOEXEC);
+    if (netns_fd < 0) {
+      DIE("open(/proc/self/ns/net)");
+    }
+    if (!SendFd(returns, 'n', netns_fd)) {
+      DIE("sendmsg");
+    }
+    close(netns_fd);
+  }
+  return EXIT_SUCCESS;
+}
+
+// Starts the helper, if the commands of the server get network namespaces.
+// The helper must not keep the server's `listen_fd` open, or clients would
+// still connect to it once the server is gone.
+static void StartNetnsPool(NetnsPool *pool, int listen_fd) {
+  pool->returns[0] = pool->returns[1] = -1;
+  pool->helper = -1;
+  pool->pending = 0;
+  if (opt.create_netns == NO_NETNS) {
+    return;
+  }
+  int helper[2];
+  if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, pool->returns) < 0 ||
+      socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, helper) < 0) {
+    DIE("socketpair");
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    DIE("fork");
+  } else if (pid == 0) {
+    close(listen_fd);
+    close(helper[0]);
+    close(pool->returns[0]);
+    _exit(NetnsHelperMain(helper[1], pool->returns[1]));
+  }
+  // Only the helper has its end, so that writing to ours fails once it is
+  // gone.
+  close(helper[1]);
+  pool->helper = helper[0];
+}
+
+// Asks the helper for namespaces until enough are ready or on their way.
+static void FillNetnsPool(NetnsPool *pool) {
+  while (pool->helper >= 0 &&
+         pool->idle.size() + pool->pending < kSpareNetns) {
+    if (TEMP_FAILURE_RETRY(send(pool->helper, "", 1, MSG_NOSIGNAL)) != 1) {
+      // Commands that get no namespace from the pool make their own.
+      PRINT_DEBUG("network namespace helper went away");
+      close(pool->helper);
+      pool->helper = -1;
+      break;
+    }
+    pool->pending++;
+  }
+}
+
+// Takes in a namespace sent to the server.
+static void ReceiveNetns(NetnsPool *pool) {
+  char tag = 0;
+  int netns_fd = ReceiveFd(pool->returns[0], &tag);
+  if (tag == 'n' && pool->pending > 0) {
+    pool->pending--;
+  }
+  if (netns_fd < 0) {
+    return;
+  }
+  if (pool->idle.size() < kMaxIdleNetns) {
+    pool->idle.push_back(netns_fd);
+  } else {
+    close(netns_fd);
+  }
+}
+
+// Returns a namespace for the next command, or -1 if none is ready.
+static int TakeNetns(NetnsPool *pool) {
+  int netns_fd = -1;
+  if (!pool->idle.empty()) {
+    netns_fd = pool->idle.back();
+    pool->idle.pop_back();
+  }
+  FillNetnsPool(pool);
+  return netns_fd;
+}
+
+struct ServerArgs {
+  int listen_fd;
+  int ready_fd;
+};
+
+// The pool server, which runs in the namespaces it keeps.
+static int ServerMain(void *args) {
+  ServerArgs server_args = *(static_cast<ServerArgs *>(args));
+
+  SetupPooledNamespaces();
+  signal(SIGCHLD, SIG_IGN);
+  if (!WriteAll(server_args.ready_fd, "", 1)) {
+    DIE("write");
+  }
+  close(server_args.ready_fd);
+  NetnsPool netns_pool;
+  StartNetnsPool(&netns_pool, server_args.listen_fd);
+  FillNetnsPool(&netns_pool);
+
+  while (true) {
+    struct pollfd fds[2] = {{server_args.listen_fd, POLLIN, 0},
+                            {netns_pool.returns[0], POLLIN, 0}};
+    int ready = poll(fds, 2, kIdleTimeoutSecs * 1000);
+    if (ready < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ready < 0) {
+      DIE("poll");
+    }
+    if (ready == 0) {
+      // The socket stays behind; the next client finds no one listening and
+      // starts a new server.
+      return EXIT_SUCCESS;
+    }
+    if (fds[1].revents != 0) {
+      ReceiveNetns(&netns_pool);
+    }
+    if (fds[0].revents == 0) {
+      continue;
+    }
+    int connection = accept4(server_args.listen_fd, nullptr, nullptr,
+                             SOCK_CLOEXEC);
+    if (connection < 0) {
+      continue;
+    }
+    int netns_fd = opt.create_netns != NO_NETNS ? TakeNetns(&netns_pool) : -1;
+    pid_t handler = fork();
+    if (handler < 0) {
+      DIE("fork");
+    } else if (handler == 0) {
+      close(server_args.listen_fd);
+      _exit(HandleCommand(connection, netns_fd, netns_pool.returns[1]));
+    }
+    close(connection);
+    if (netns_fd >= 0) {
+      close(netns_fd);
+    }
+  }
+}
+
+// Starts the server listening on `socket_path`, in a process that is not our
+// child. Returns whether the server is ready for commands.
+static bool StartServer(const std::string &socket_path, int lock_fd) {
+  int ready_pipe[2];
+  if (pipe2(ready_pipe, O_CLOEXEC) < 0) {
+    return false;
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(ready_pipe[0]);
+    close(ready_pipe[1]);
+    return false;
+  } else if (pid == 0) {
+    close(ready_pipe[0]);
+    close(lock_fd);
+    // Detach from the client, so that the server outlives it.
+    if (setsid() < 0) {
+      DIE("setsid");
+    }
+    pid_t server = fork();
+    if (server != 0) {
+      _exit(server < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    // No output of the server goes to the client that happened to start it.
+    int null_fd = open("/dev/null", O_RDWR);
+    if (null_fd < 0) {
+      DIE("open(/dev/null)");
+    }
+    for (int fd = 0; fd < 3; fd++) {
+      if (dup2(null_fd, fd) < 0) {
+        DIE("dup2");
+      }
+    }
+    close(null_fd);
+    if (global_debug != nullptr) {
+      fclose(global_debug);
+      global_debug = nullptr;
+    }
+
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0 ||
+        bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) <
+            0 ||
+        listen(listen_fd, SOMAXCONN) < 0) {
+      _exit(EXIT_FAILURE);
+    }
+
+    // Only the namespace options matter for the server's own namespaces:
+    // nothing is writable there.
+    opt.working_dir.clear();
+    opt.writable_files.clear();
+    opt.tmpfs_dirs.clear();
+    opt.bind_mount_sources.clear();
+    opt.bind_mount_targets.clear();
+
+    // The server itself stays in our network namespace: the commands get
+    // theirs from its NetnsPool.
+    int clone_flags = CLONE_NEWUSER | CLONE_NEWNS;
+    if (opt.fake_hostname) {
+      clone_flags |= CLONE_NEWUTS;
+    }
+    std::vector<char> child_stack(kStackSize);
+    ServerArgs server_args = {listen_fd, ready_pipe[1]};
+    if (clone(ServerMain, child_stack.data() + kStackSize, clone_flags,
+              &server_args) < 0) {
+      _exit(EXIT_FAILURE);
+    }
+    _exit(EXIT_SUCCESS);
+  }
+
+  close(ready_pipe[1]);
+  TEMP_FAILURE_RETRY(waitpid(pid, nullptr, 0));
+  char ready;
+  // The server closes its end without writing if it fails to set up.
+  bool ok = ReadAll(ready_pipe[0], &ready, 1);
+  close(ready_pipe[0]);
+  return ok;
+}
+
+int SpawnPooledPid1(pid_t *pid1) {
+  if (opt.hermetic) {
+    PRINT_DEBUG("not using the sandbox pool with -h");
+    return -1;
+  }
+  if (!opt.overlay_lower_dir.empty()) {
+    // The overlay needs its upper layer on a writable mount when it is
+    // mounted, and everything is read-only in the pool already.
+    PRINT_DEBUG("not using the sandbox pool with -o");
+    return -1;
+  }
+  if (!opt.root_paths.empty()) {
+    // The pool's namespaces show all of the filesystem.
+    PRINT_DEBUG("not using the sandbox pool with -r");
+    return -1;
+  }
+  if (mkdir(opt.pool_dir.c_str(), 0700) < 0 && errno != EEXIST) {
+    PRINT_DEBUG("mkdir(%s): %s", opt.pool_dir.c_str(), strerror(errno));
+    return -1;
+  }
+  int dir_fd = open(opt.pool_dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd < 0) {
+    PRINT_DEBUG("open(%s): %s", opt.pool_dir.c_str(), strerror(errno));
+    return -1;
+  }
+
+  // Going through our file descriptor keeps the path of the socket short
+  // enough for sockaddr_un, however long the path of the directory is.
+  const std::string name = PoolName();
+  const std::string socket_path =
+      "/proc/self/fd/" + std::to_string(dir_fd) + "/" + name + ".sock";
+  int connection = Connect(socket_path);
+  if (connection < 0) {
+    // Only one client starts the server, the others wait for it.
+    int lock_fd = openat(dir_fd, (name + ".lock").c_str(),
+                         O_CREAT | O_RDWR | O_CLOEXEC, 0600);
+    if (lock_fd >= 0 && TEMP_FAILURE_RETRY(flock(lock_fd, LOCK_EX)) == 0) {
+      connection = Connect(socket_path);
+      if (connection < 0) {
+        PRINT_DEBUG("starting sandbox pool server %s", name.c_str());
+        unlinkat(dir_fd, (name + ".sock").c_str(), 0);
+        if (StartServer(socket_path, lock_fd)) {
+          connection = Connect(socket_path);
+        }
+      }
+    }
+    if (lock_fd >= 0) {
+      close(lock_fd);
+    }
+  }
+  close(dir_fd);
+  if (connection < 0) {
+    PRINT_DEBUG("cannot use sandbox pool server %s", name.c_str());
+    return -1;
+  }
+
+  // The server may also have just exited after being idle.
+  if (!SendRequest(connection) || !ReadAll(connection, pid1, sizeof(*pid1))) {
+    PRINT_DEBUG("sandbox pool server %s did not take the command",
+                name.c_str());
+    close(connection);
+    return -1;
+  }
+  PRINT_DEBUG("pooled linux-sandbox-pid1 has PID %d", *pid1);
+  return connection;
+}
+
+void StartPooledPid1(int connection) {
+  if (!WriteAll(connection, "", 1)) {
+    DIE("sandbox pool server went away");
+  }
+}
+
+void WaitForPooledPid1(int connection, Pid1Result *result) {
+  if (!ReadAll(connection, result, sizeof(*result))) {
+    DIE("sandbox pool server went away");
+  }
+}
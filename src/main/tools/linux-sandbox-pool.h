@@ -0,0 +1,51 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * The sandbox pool (-Z) saves setting up the namespaces of every command
+ * from scratch. A pool server process keeps a user and mount namespace (and
+ * a UTS namespace if requested) in which the whole filesystem is read-only
+ * already, one server per combination of the options that these namespaces
+ * depend on. For each command, linux-sandbox hands the command to the server
+ * over a Unix socket, and the server clones a PID 1 into new PID, mount and
+ * IPC namespaces. Its mount namespace starts as a copy of the pool's, so that
+ * PID 1 only adds the mounts of the command; when it exits, the copy goes
+ * away with it and the pool is left as it was. If requested, PID 1 also
+ * enters a network namespace of its own, which a helper of the server has
+ * set up ahead of time, and which the next command reuses unless this one
+ * ran as a fake root.
+ */
+
+#ifndef SRC_MAIN_TOOLS_LINUX_SANDBOX_POOL_H_
+#define SRC_MAIN_TOOLS_LINUX_SANDBOX_POOL_H_
+
+#include <sys/types.h>
+
+#include "src/main/tools/linux-sandbox-pid1.h"
+
+// Hands the command in `opt` to the pool server for the options in `opt`,
+// starting the server first if there is none. Returns the connection to the
+// server, or -1 if the pool cannot be used, in which case the command has
+// to be run without it. On success, `pid1` is the PID of the command's PID 1,
+// which waits for StartPooledPid1 before it sets up anything.
+int SpawnPooledPid1(pid_t *pid1);
+
+// Lets the PID 1 returned by SpawnPooledPid1 go ahead.
+void StartPooledPid1(int connection);
+
+// Waits until the PID 1 returned by SpawnPooledPid1 exits, and returns its
+// result, with the status and resource usage like wait4 would.
+void WaitForPooledPid1(int connection, Pid1Result *result);
+
+#endif  // SRC_MAIN_TOOLS_LINUX_SANDBOX_POOL_H_
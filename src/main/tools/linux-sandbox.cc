@@ -39,8 +39,6 @@
 
 #include "src/main/tools/linux-sandbox.h"
 
-#include <ctype.h>
-#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <math.h>
@@ -53,78 +51,53 @@
 #include <sys/prctl.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
-#include <atomic>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "src/main/tools/linux-sandbox-options.h"
+#include "src/main/tools/linux-sandbox-output-tail.h"
 #include "src/main/tools/linux-sandbox-pid1.h"
+#include "src/main/tools/linux-sandbox-pool.h"
 #include "src/main/tools/logging.h"
 #include "src/main/tools/process-tools.h"
 
+// clone3 (Linux 5.3) and CLONE_INTO_CGROUP (Linux 5.7). C libraries and kernel
+// headers may be too old to know them, so we declare what we use.
+#ifndef SYS_clone3
+#define SYS_clone3 435
+#endif
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP 0x200000000ULL
+#endif
+
+// struct clone_args of linux/sched.h, up to the cgroup field.
+struct CloneArgs {
+  uint64_t flags;
+  uint64_t pidfd;
+  uint64_t child_tid;
+  uint64_t parent_tid;
+  uint64_t exit_signal;
+  uint64_t stack;
+  uint64_t stack_size;
+  uint64_t tls;
+  uint64_t set_tid;
+  uint64_t set_tid_size;
+  uint64_t cgroup;
+};
+
 uid_t global_outer_uid;
 gid_t global_outer_gid;
 
-// The PID of our child process, for use in signal handlers.
-static std::atomic<pid_t> global_child_pid{0};
 // Our parent's pid at the outset, to check if the original parent has exited.
 pid_t initial_ppid;
 
-// Must we politely ask the child to exit before we send it a SIGKILL (once we
-// want it to exit)? Holds only zero or one.
-static std::atomic<int> global_need_polite_sigterm{false};
-
-#if __cplusplus >= 201703L
-static_assert(global_child_pid.is_always_lock_free);
-static_assert(global_need_polite_sigterm.is_always_lock_free);
-#endif
-
-// Make sure the child process does not inherit any accidentally left open file
-// handles from our parent.
-static void CloseFds() {
-  DIR *fds = opendir("/proc/self/fd");
-  if (fds == nullptr) {
-    DIE("opendir");
-  }
-
-  while (1) {
-    errno = 0;
-    struct dirent *dent = readdir(fds);
-
-    if (dent == nullptr) {
-      if (errno != 0) {
-        DIE("readdir");
-      }
-      break;
-    }
-
-    if (isdigit(dent->d_name[0])) {
-      errno = 0;
-      int fd = strtol(dent->d_name, nullptr, 10);
-
-      // (1) Skip unparseable entries.
-      // (2) Close everything except stdin, stdout, stderr and debug output.
-      // (3) Do not accidentally close our directory handle.
-      if (errno == 0 && fd > STDERR_FILENO &&
-          (global_debug == NULL || fd != fileno(global_debug)) &&
-          fd != dirfd(fds)) {
-        if (close(fd) < 0) {
-          DIE("close");
-        }
-      }
-    }
-  }
-
-  if (closedir(fds) < 0) {
-    DIE("closedir");
-  }
-}
-
 static void MaybeAddChildProcessToCgroup(const pid_t pid) {
   for (const std::string &cgroups_dir : opt.cgroups_dirs) {
     PRINT_DEBUG("Adding process %d to cgroups dir %s", pid,
@@ -133,32 +106,48 @@ static void MaybeAddChildProcessToCgroup(const pid_t pid) {
   }
 }
 
-static void OnTimeoutOrTerm(int) {
-  // Find the PID of the child, which main set up before installing us as a
-  // signal handler.
-  const pid_t child_pid = global_child_pid.load(std::memory_order_relaxed);
-
-  // Figure out whether we should send a SIGTERM here. If so, we won't want to
-  // next time we're called.
-  const bool need_polite_sigterm =
-      global_need_polite_sigterm.fetch_and(0, std::memory_order_relaxed);
-
-  // If we're not supposed to ask politely, simply forcibly kill the child.
-  if (!need_polite_sigterm) {
-    kill(child_pid, SIGKILL);
-    return;
-  }
-
-  // Otherwise make a polite request, then arrange to be called again after a
-  // delay, at which point we'll send SIGKILL.
-  //
-  // Note that main sets us up as the signal handler for SIGALRM, and arranges
-  // for this code path to be taken only if kill_delay_secs > 0.
-  kill(child_pid, SIGTERM);
-  alarm(opt.kill_delay_secs);
+// With a single cgroups dir, clones the child that runs Pid1Main(pid1Args)
+// right into it with clone3, so that the sandbox does not have to move it
+// there, and all of its processes are accounted for from the start. Only
+// cgroups v2 can do that; with v1, on older kernels, or if anything else
+// fails, returns -1 with nothing done, and the caller clones the child as
+// before.
+static pid_t CloneIntoCgroup(int clone_flags, Pid1Args *pid1Args) {
+  if (opt.cgroups_dirs.size() != 1) {
+    return -1;
+  }
+  const std::string &cgroups_dir = opt.cgroups_dirs[0];
+  const int cgroup_fd =
+      open(cgroups_dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (cgroup_fd < 0) {
+    return -1;
+  }
+  CloneArgs args;
+  memset(&args, 0, sizeof(args));
+  args.flags = (clone_flags & ~CSIGNAL) | CLONE_INTO_CGROUP;
+  args.exit_signal = clone_flags & CSIGNAL;
+  args.cgroup = cgroup_fd;
+  // Without a stack, the child goes on with a copy of ours, as after fork.
+  const pid_t child_pid = syscall(SYS_clone3, &args, sizeof(args));
+  if (child_pid == 0) {
+    _exit(Pid1Main(pid1Args));
+  }
+  const int clone_errno = errno;
+  close(cgroup_fd);
+  if (child_pid < 0) {
+    PRINT_DEBUG("clone3 into cgroups dir %s failed: %s", cgroups_dir.c_str(),
+                strerror(clone_errno));
+    return -1;
+  }
+  PRINT_DEBUG("Cloned process %d into cgroups dir %s", child_pid,
+              cgroups_dir.c_str());
+  return child_pid;
 }
 
-static pid_t SpawnPid1() {
+// Returns the PID of PID 1, and in `clone_usec` how long cloning it into its
+// namespaces took.
+static pid_t SpawnPid1(int *result_fd, int64_t *clone_usec) {
+  PRINT_DEBUG_TIME("SpawnPid1");
   const int kStackSize = 1024 * 1024;
   std::vector<char> child_stack(kStackSize);
 
@@ -171,6 +160,10 @@ static pid_t SpawnPid1() {
   if (pipe(pipe_to_child) < 0) {
       DIE("pipe");
     }
+  int result_pipe[2];
+  if (pipe2(result_pipe, O_CLOEXEC) < 0) {
+    DIE("pipe2");
+  }
 
   int clone_flags =
       CLONE_NEWUSER | CLONE_NEWNS | CLONE_NEWIPC | CLONE_NEWPID | SIGCHLD;
@@ -190,14 +183,51 @@ static pid_t SpawnPid1() {
   Pid1Args pid1Args;
   pid1Args.pipe_to_parent = pipe_from_child;
   pid1Args.pipe_from_parent = pipe_to_child;
-  const pid_t child_pid = clone(Pid1Main, child_stack.data() + kStackSize,
-                                clone_flags, &pid1Args);
+  pid1Args.result_pipe = result_pipe;
+  if (!opt.access_log_path.empty()) {
+    pid1Args.access_log_fd =
+        open(opt.access_log_path.c_str(),
+             O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (pid1Args.access_log_fd < 0) {
+      DIE("open(%s)", opt.access_log_path.c_str());
+    }
+  }
+  // Opened here, since a file open for writing on a mount of the sandbox
+  // would keep it from being made read-only.
+  if (!opt.lazy_inputs_requests.empty()) {
+    pid1Args.lazy_inputs_requests_fd =
+        open(opt.lazy_inputs_requests.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    if (pid1Args.lazy_inputs_requests_fd < 0) {
+      DIE("open(%s)", opt.lazy_inputs_requests.c_str());
+    }
+  }
+  const int64_t clone_start = MonotonicTimeUsec();
+  pid_t child_pid = CloneIntoCgroup(clone_flags, &pid1Args);
+  const bool in_cgroup = child_pid > 0;
+  if (!in_cgroup) {
+    child_pid = clone(Pid1Main, child_stack.data() + kStackSize, clone_flags,
+                      &pid1Args);
+  }
+  *clone_usec = MonotonicTimeUsec() - clone_start;
 
   if (child_pid < 0) {
     DIE("clone");
   }
+  if (close(result_pipe[1]) < 0) {
+    DIE("close");
+  }
+  *result_fd = result_pipe[0];
+  if (pid1Args.access_log_fd >= 0 && close(pid1Args.access_log_fd) < 0) {
+    DIE("close");
+  }
+  if (pid1Args.lazy_inputs_requests_fd >= 0 &&
+      close(pid1Args.lazy_inputs_requests_fd) < 0) {
+    DIE("close");
+  }
 
-  MaybeAddChildProcessToCgroup(child_pid);
+  if (!in_cgroup) {
+    MaybeAddChildProcessToCgroup(child_pid);
+  }
   // Signal the child that it can now proceed to spawn pid2.
   SignalPipe(pipe_to_child);
 
@@ -214,12 +244,56 @@ static pid_t SpawnPid1() {
   return child_pid;
 }
 
-static int WaitForPid1(const pid_t child_pid) {
+// Reads the result that the child reports before it exits. Returns false if
+// it exited without reporting one.
+static bool ReadPid1Result(const int result_fd, Pid1Result *result) {
+  char *buf = reinterpret_cast<char *>(result);
+  size_t size = 0;
+  while (size < sizeof(*result)) {
+    const ssize_t r = read(result_fd, buf + size, sizeof(*result) - size);
+    if (r < 0 && errno == EINTR) {
+      continue;
+    }
+    if (r < 0) {
+      DIE("read");
+    }
+    if (r == 0) {
+      return false;
+    }
+    size += r;
+  }
+  return true;
+}
+
+static int WaitForPid1(const pid_t child_pid, const int pool_connection,
+                       const int result_fd, const int64_t clone_usec,
+                       const std::vector<int> &perf_counter_fds) {
   // Wait for the child to exit, obtaining usage information. Restart in the
   // case of a signal interrupting us.
-  int child_status;
-  struct rusage child_rusage;
-  while (true) {
+  Pid1Result result;
+  int &child_status = result.status;
+  struct rusage &child_rusage = result.rusage;
+  bool done = false;
+  if (pool_connection >= 0) {
+    // The child is not ours but the pool server's, which reports on it.
+    WaitForPooledPid1(pool_connection, &result);
+    done = true;
+  } else if (ReadPid1Result(result_fd, &result)) {
+    result.times.namespace_setup_usec += clone_usec;
+    // Don't wait for the child to tear down the sandbox; it dies with us.
+    PRINT_DEBUG("child reported its result");
+    done = true;
+    if (global_debug) {
+      // Except when debugging, to time the teardown.
+      PRINT_DEBUG_TIME("teardown");
+      while (waitpid(child_pid, nullptr, 0) < 0 && errno == EINTR) {
+      }
+    }
+  }
+  if (!done) {
+    result.has_times = false;
+  }
+  while (!done) {
     const int ret = wait4(child_pid, &child_status, 0, &child_rusage);
     if (ret > 0) {
       break;
@@ -237,9 +311,24 @@ static int WaitForPid1(const pid_t child_pid) {
     DIE("wait4");
   }
 
-  // If we're supposed to write stats to a file, do so now.
+  // If we're supposed to write stats to a file, do so now. The command has
+  // been waited for by now, so its processes have added to the counters.
   if (!opt.stats_path.empty()) {
-    WriteStatsToFile(&child_rusage, opt.stats_path);
+    PerfCounters perf_counters;
+    const bool have_perf = !perf_counter_fds.empty() &&
+                           ReadPerfCounters(perf_counter_fds, &perf_counters);
+    WriteStatsToFile(&child_rusage, opt.cgroups_dirs, opt.stats_path,
+                     result.has_times ? &result.times : nullptr, nullptr,
+                     have_perf ? &perf_counters : nullptr);
+  }
+
+  // The child leaves the access log empty if it does not know what was opened,
+  // and then there is none.
+  if (!opt.access_log_path.empty()) {
+    struct stat st;
+    if (stat(opt.access_log_path.c_str(), &st) == 0 && st.st_size == 0) {
+      unlink(opt.access_log_path.c_str());
+    }
   }
 
   // We want to exit in the same manner as the child.
@@ -299,44 +388,68 @@ int main(int argc, char *argv[]) {
   global_outer_gid = getgid();
 
   // Ensure we don't pass on any FDs from our parent to our child other than
-  // stdin, stdout, stderr and global_debug.
-  CloseFds();
-
-  // Spawn the child that will fork the sandboxed program with fresh
-  // namespaces etc.
-  const pid_t child_pid = SpawnPid1();
-
-  // Let the signal handlers installed below know the PID of the child.
-  global_child_pid.store(child_pid, std::memory_order_relaxed);
-
-  // If a kill delay has been configured, let the signal handlers installed
-  // below know that it needs to be respected.
-  if (opt.kill_delay_secs > 0) {
-    global_need_polite_sigterm.store(1, std::memory_order_relaxed);
+  // stdin, stdout, stderr and global_debug. They are really closed, not only
+  // close-on-exec: the sandbox pool server that we may start never execs.
+  CloseFdsFrom(STDERR_FILENO + 1,
+               global_debug != nullptr ? fileno(global_debug) : -1, false);
+
+  // Hold back while the memory of the system is critically short, rather than
+  // start one more command that swaps.
+  if (!opt.admission_gate_path.empty()) {
+    WaitForAdmission(opt.admission_gate_path, opt.admission_wait_secs);
   }
 
-  // OnTimeoutOrTerm, which is used for other signals below, assumes that it
-  // handles SIGALRM. We also explicitly invoke it after the timeout using
-  // alarm(2).
-  InstallSignalHandler(SIGALRM, OnTimeoutOrTerm);
+  // With -c, the command writes to pipes that we keep the tails of.
+  std::unique_ptr<OutputTail> output_tail;
+  if (opt.output_tail_bytes > 0) {
+    output_tail.reset(new OutputTail(opt.output_tail_bytes));
+    output_tail->Capture();
+  }
 
-  // If requested, arrange for the child to be killed (optionally after being
-  // asked politely to terminate) once the timeout expires.
-  //
-  // Note that it's important to set this up before support for SIGTERM and
-  // SIGINT. Otherwise one of those signals could arrive before we get here,
-  // and then we would reset its opt.kill_delay_secs interval timer.
-  if (opt.timeout_secs > 0) {
-    alarm(opt.timeout_secs);
+  // Spawn the child that will fork the sandboxed program with fresh
+  // namespaces etc., from the pool if one is configured and takes it.
+  pid_t child_pid;
+  int pool_connection = -1;
+  int result_fd = -1;
+  int64_t clone_usec = 0;
+  // The command of a pooled child is not ours, and does not inherit our
+  // performance counters.
+  const bool perf_counters = opt.perf_counters && !opt.stats_path.empty();
+  if (!opt.pool_dir.empty() && opt.access_log_path.empty() && !perf_counters) {
+    pool_connection = SpawnPooledPid1(&child_pid);
+  }
+  std::vector<int> perf_counter_fds;
+  if (pool_connection < 0 && perf_counters) {
+    perf_counter_fds = OpenPerfCounters();
+  }
+  if (pool_connection >= 0) {
+    MaybeAddChildProcessToCgroup(child_pid);
+    StartPooledPid1(pool_connection);
+  } else {
+    child_pid = SpawnPid1(&result_fd, &clone_usec);
+  }
+  if (output_tail) {
+    output_tail->Start();
   }
 
-  // Also ask/tell the child to quit on SIGTERM, and optionally for SIGINT
-  // too.
-  InstallSignalHandler(SIGTERM, OnTimeoutOrTerm);
+  // Until the child reports its result or the pool server reports on it,
+  // ask/tell the child to quit once the timeout expires or on SIGTERM, and
+  // optionally on SIGINT too. The politeness of a SIGTERM first is only
+  // extended if a kill delay has been configured.
+  std::vector<int> signals = {SIGTERM};
   if (opt.sigint_sends_sigterm) {
-    InstallSignalHandler(SIGINT, OnTimeoutOrTerm);
+    signals.push_back(SIGINT);
   }
+  WaitForExitEvent(pool_connection >= 0 ? pool_connection : result_fd, -1,
+                   child_pid, opt.timeout_secs, opt.kill_delay_secs, signals,
+                   {});
 
   // Wait for the child to exit, returning an appropriate status.
-  return WaitForPid1(child_pid);
+  const int exit_code =
+      WaitForPid1(child_pid, pool_connection, result_fd, clone_usec,
+                  perf_counter_fds);
+  if (output_tail) {
+    output_tail->Finish();
+  }
+  return exit_code;
 }
@@ -59,4 +59,34 @@
 // Set in the linux-sandbox.cc main() if the -D command line option is set.
 extern FILE* global_debug;
 
+// Logs the time from here to the end of the scope as "<name> took <n> us",
+// if debugging. linux-sandbox-benchmark.sh adds these up per phase.
+#define PRINT_DEBUG_TIME(name) DebugTimer debug_timer_(name)
+
+class DebugTimer {
+ public:
+  explicit DebugTimer(const char* name) : name_(name) {
+    if (global_debug) {
+      clock_gettime(CLOCK_MONOTONIC, &start_);
+    }
+  }
+
+  ~DebugTimer() {
+    if (global_debug) {
+      struct timespec end;
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      const int64_t us = (end.tv_sec - start_.tv_sec) * 1000000 +
+                         (end.tv_nsec - start_.tv_nsec) / 1000;
+      PRINT_DEBUG("%s took %" PRId64 " us", name_, us);
+    }
+  }
+
+  DebugTimer(const DebugTimer&) = delete;
+  DebugTimer& operator=(const DebugTimer&) = delete;
+
+ private:
+  const char* name_;
+  struct timespec start_;
+};
+
 #endif  // SRC_MAIN_TOOLS_LOGGING_H_
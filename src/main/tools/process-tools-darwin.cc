@@ -19,8 +19,13 @@
 #include <stdlib.h>
 #include <sys/event.h>
 #include <sys/sysctl.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
 #include "src/main/tools/logging.h"
 #include "src/main/tools/process-tools.h"
 
@@ -61,8 +66,147 @@ retry:
   return close(kq);
 }
 
+// Returns the time of the monotonic clock in seconds.
+double MonotonicNow() {
+  struct timespec now;
+  if (clock_gettime(CLOCK_MONOTONIC, &now) < 0) {
+    DIE("clock_gettime");
+  }
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
 }  // namespace
 
+int WaitForProcessExitEvent(pid_t pid, int cancel_fd, pid_t kill_pid,
+                            double timeout_secs, double kill_delay_secs,
+                            const std::vector<int> &graceful_signals,
+                            const std::vector<int> &abrupt_signals) {
+  sigset_t signals, abrupt;
+  sigemptyset(&signals);
+  sigemptyset(&abrupt);
+  for (int sig : graceful_signals) {
+    sigaddset(&signals, sig);
+  }
+  for (int sig : abrupt_signals) {
+    sigaddset(&signals, sig);
+    sigaddset(&abrupt, sig);
+  }
+  // EVFILT_SIGNAL sees signals whatever their disposition, and blocking them
+  // keeps them from doing anything else.
+  if (sigprocmask(SIG_BLOCK, &signals, nullptr) < 0) {
+    DIE("sigprocmask");
+  }
+
+  const int kq = kqueue();
+  if (kq < 0) {
+    return -1;
+  }
+  std::vector<struct kevent> changes(1);
+  EV_SET(&changes.back(), pid, EVFILT_PROC, EV_ADD, NOTE_EXIT, 0, nullptr);
+  for (int sig = 1; sig < NSIG; ++sig) {
+    if (sigismember(&signals, sig) == 1) {
+      changes.emplace_back();
+      EV_SET(&changes.back(), sig, EVFILT_SIGNAL, EV_ADD, 0, 0, nullptr);
+    }
+  }
+  if (cancel_fd >= 0) {
+    // Only the first event counts.
+    changes.emplace_back();
+    EV_SET(&changes.back(), cancel_fd, EVFILT_READ, EV_ADD | EV_ONESHOT, 0, 0,
+           nullptr);
+  }
+  if (kevent(kq, changes.data(), changes.size(), nullptr, 0, nullptr) < 0) {
+    const int error = errno;
+    close(kq);
+    if (error == ESRCH) {
+      // The process is a zombie already.
+      return 0;
+    }
+    errno = error;
+    return -1;
+  }
+
+  // The deadlines for terminating the process politely and forcibly, or
+  // infinity once there is nothing left to do.
+  double term_deadline = INFINITY;
+  double kill_deadline = INFINITY;
+  if (timeout_secs > 0) {
+    term_deadline = MonotonicNow() + timeout_secs;
+  }
+  bool terminating = false;
+  int last_signal = 0;
+
+  while (true) {
+    const double deadline = std::min(term_deadline, kill_deadline);
+    struct timespec timeout;
+    struct timespec *timeout_ptr = nullptr;
+    if (deadline != INFINITY) {
+      const double wait = std::max(0.0, deadline - MonotonicNow());
+      timeout.tv_sec = static_cast<time_t>(wait);
+      timeout.tv_nsec = static_cast<long>((wait - timeout.tv_sec) * 1e9);
+      timeout_ptr = &timeout;
+    }
+
+    struct kevent event;
+    const int nev = kevent(kq, nullptr, 0, &event, 1, timeout_ptr);
+    if (nev < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      DIE("kevent");
+    }
+    if (nev == 1 && event.filter == EVFILT_PROC) {
+      break;
+    }
+
+    // Whether to ask the process to terminate, or to kill it.
+    bool terminate = false;
+    bool kill_now = false;
+    const double now = MonotonicNow();
+    if (nev == 1 && event.filter == EVFILT_SIGNAL) {
+      last_signal = static_cast<int>(event.ident);
+      PRINT_DEBUG("got signal %d", last_signal);
+      if (sigismember(&abrupt, last_signal) == 1) {
+        kill_now = true;
+      } else {
+        terminate = true;
+      }
+    } else if (nev == 1 && event.filter == EVFILT_READ) {
+      PRINT_DEBUG("cancelled");
+      last_signal = SIGKILL;
+      kill_now = true;
+    } else if (now >= term_deadline) {
+      PRINT_DEBUG("timed out");
+      last_signal = SIGALRM;
+      terminate = true;
+    } else if (now >= kill_deadline) {
+      kill_now = true;
+    }
+
+    if (terminate) {
+      if (terminating || kill_delay_secs <= 0) {
+        // This is not the first request, or there is no time for the process
+        // to clean up.
+        kill_now = true;
+      } else {
+        kill(kill_pid, SIGTERM);
+        terminating = true;
+        term_deadline = INFINITY;
+        kill_deadline = now + kill_delay_secs;
+      }
+    }
+    if (kill_now) {
+      kill(kill_pid, SIGKILL);
+      terminating = true;
+      term_deadline = INFINITY;
+      kill_deadline = INFINITY;
+    }
+  }
+
+  close(kq);
+  return last_signal;
+}
+
 int WaitForProcessToTerminate(pid_t pid) {
   if (pid < 0) {
     DIE("PID must be >= 0, got %" PRIdMAX, static_cast<intmax_t>(pid));
@@ -131,3 +275,8 @@ int WaitForProcessGroupToTerminate(pid_t pgid) {
     }
   }
 }
+
+bool BindToNumaNode(int node) {
+  errno = ENOSYS;
+  return false;
+}
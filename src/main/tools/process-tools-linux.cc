@@ -13,14 +13,223 @@
 // limitations under the License.
 
 #include <errno.h>
+#include <linux/mempolicy.h>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <sched.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "src/main/tools/logging.h"
 #include "src/main/tools/process-tools.h"
 
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+// Returns the time of the monotonic clock in seconds.
+static double MonotonicNow() {
+  struct timespec now;
+  if (clock_gettime(CLOCK_MONOTONIC, &now) < 0) {
+    DIE("clock_gettime");
+  }
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int OpenPidfd(pid_t pid) {
+  return syscall(SYS_pidfd_open, pid, 0);
+}
+
+// The counters of PerfCounters, in this order. The first one leads the group.
+static const uint64_t kPerfCounterConfigs[] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+};
+
+std::vector<int> OpenPerfCounters() {
+  std::vector<int> fds;
+  for (uint64_t config : kPerfCounterConfigs) {
+    const bool leader = fds.empty();
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // The group is off in this process, which never execs, and turned on in
+    // each copy that a child inherits once that execs.
+    attr.disabled = leader;
+    attr.enable_on_exec = leader;
+    attr.inherit = 1;
+    // Counting the kernel too needs a perf_event_paranoid of 1 or less.
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    const int fd = syscall(SYS_perf_event_open, &attr, 0, -1,
+                           leader ? -1 : fds.front(), PERF_FLAG_FD_CLOEXEC);
+    if (fd < 0) {
+      // EACCES or EPERM if perf_event_paranoid forbids it, ENOENT or
+      // EOPNOTSUPP if there are no such counters, as in many VMs.
+      PRINT_DEBUG("perf_event_open(%" PRIu64 "): %s", config, strerror(errno));
+      for (int open_fd : fds) {
+        close(open_fd);
+      }
+      return {};
+    }
+    fds.push_back(fd);
+  }
+  return fds;
+}
+
+bool ReadPerfCounters(const std::vector<int> &fds, PerfCounters *counters) {
+  int64_t values[sizeof(kPerfCounterConfigs) / sizeof(uint64_t)];
+  bool ok = fds.size() == sizeof(values) / sizeof(values[0]);
+  for (size_t i = 0; ok && i < fds.size(); ++i) {
+    // The value, and how long the counter was enabled and actually running.
+    uint64_t data[3];
+    if (read(fds[i], data, sizeof(data)) != sizeof(data)) {
+      ok = false;
+      break;
+    }
+    values[i] = data[0];
+    if (data[2] > 0 && data[2] < data[1]) {
+      values[i] = static_cast<int64_t>(static_cast<double>(data[0]) *
+                                       data[1] / data[2]);
+    }
+  }
+  for (int fd : fds) {
+    close(fd);
+  }
+  if (!ok) {
+    return false;
+  }
+  counters->cycles = values[0];
+  counters->instructions = values[1];
+  counters->cache_misses = values[2];
+  return true;
+}
+
+int WaitForExitEvent(int fd, int cancel_fd, pid_t kill_pid,
+                     double timeout_secs, double kill_delay_secs,
+                     const std::vector<int> &graceful_signals,
+                     const std::vector<int> &abrupt_signals) {
+  sigset_t signals, abrupt;
+  sigemptyset(&signals);
+  sigemptyset(&abrupt);
+  for (int sig : graceful_signals) {
+    sigaddset(&signals, sig);
+  }
+  for (int sig : abrupt_signals) {
+    sigaddset(&signals, sig);
+    sigaddset(&abrupt, sig);
+  }
+  if (sigprocmask(SIG_BLOCK, &signals, nullptr) < 0) {
+    DIE("sigprocmask");
+  }
+  int signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+  if (signal_fd < 0) {
+    DIE("signalfd");
+  }
+
+  // The deadlines for terminating the process politely and forcibly, or
+  // infinity once there is nothing left to do.
+  double term_deadline = INFINITY;
+  double kill_deadline = INFINITY;
+  if (timeout_secs > 0) {
+    term_deadline = MonotonicNow() + timeout_secs;
+  }
+  bool terminating = false;
+  int last_signal = 0;
+
+  while (true) {
+    const double deadline = std::min(term_deadline, kill_deadline);
+    int timeout_ms = -1;
+    if (deadline != INFINITY) {
+      // Round up so that we don't wake up just before the deadline.
+      timeout_ms = static_cast<int>(
+          std::ceil(std::max(0.0, deadline - MonotonicNow()) * 1000));
+    }
+
+    struct pollfd fds[3] = {
+        {fd, POLLIN, 0}, {signal_fd, POLLIN, 0}, {cancel_fd, POLLIN, 0}};
+    if (poll(fds, 3, timeout_ms) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      DIE("poll");
+    }
+    if (fds[0].revents != 0) {
+      break;
+    }
+
+    // Whether to ask the process to terminate, or to kill it.
+    bool terminate = false;
+    bool kill_now = false;
+    const double now = MonotonicNow();
+    if (fds[1].revents != 0) {
+      struct signalfd_siginfo info;
+      if (read(signal_fd, &info, sizeof(info)) != sizeof(info)) {
+        DIE("read");
+      }
+      last_signal = info.ssi_signo;
+      PRINT_DEBUG("got signal %d", last_signal);
+      if (sigismember(&abrupt, last_signal)) {
+        kill_now = true;
+      } else {
+        terminate = true;
+      }
+    } else if (fds[2].revents != 0) {
+      PRINT_DEBUG("cancelled");
+      last_signal = SIGKILL;
+      kill_now = true;
+      // Only the first event counts; poll ignores negative descriptors.
+      cancel_fd = -1;
+    } else if (now >= term_deadline) {
+      PRINT_DEBUG("timed out");
+      last_signal = SIGALRM;
+      terminate = true;
+    } else if (now >= kill_deadline) {
+      kill_now = true;
+    }
+
+    if (terminate) {
+      if (terminating || kill_delay_secs <= 0) {
+        // This is not the first request, or there is no time for the process
+        // to clean up.
+        kill_now = true;
+      } else {
+        kill(kill_pid, SIGTERM);
+        terminating = true;
+        term_deadline = INFINITY;
+        kill_deadline = now + kill_delay_secs;
+      }
+    }
+    if (kill_now) {
+      kill(kill_pid, SIGKILL);
+      terminating = true;
+      term_deadline = INFINITY;
+      kill_deadline = INFINITY;
+    }
+  }
+
+  close(signal_fd);
+  return last_signal;
+}
+
 int TerminateAndWaitForAll(pid_t pid) {
   kill(-pid, SIGKILL);
 
@@ -53,3 +262,59 @@ int TerminateAndWaitForAll(pid_t pid) {
 
   return 0;
 }
+
+// Reads a list of cpus like "0-3,8-11" from "path" into "cpus".
+static bool ReadCpuList(const std::string &path, cpu_set_t *cpus) {
+  FILE *f = fopen(path.c_str(), "r");
+  if (f == nullptr) {
+    return false;
+  }
+  char buf[4096];
+  const bool ok = fgets(buf, sizeof(buf), f) != nullptr;
+  fclose(f);
+  if (!ok) {
+    errno = EINVAL;
+    return false;
+  }
+  CPU_ZERO(cpus);
+  for (char *range = strtok(buf, ",\n"); range != nullptr;
+       range = strtok(nullptr, ",\n")) {
+    int first, last;
+    const int fields = sscanf(range, "%d-%d", &first, &last);
+    if (fields < 1) {
+      continue;
+    }
+    if (fields == 1) {
+      last = first;
+    }
+    for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) {
+      CPU_SET(cpu, cpus);
+    }
+  }
+  if (CPU_COUNT(cpus) == 0) {
+    errno = EINVAL;
+    return false;
+  }
+  return true;
+}
+
+bool BindToNumaNode(int node) {
+  cpu_set_t cpus;
+  if (!ReadCpuList(node < 0 ? std::string("/sys/devices/system/cpu/online")
+                            : "/sys/devices/system/node/node" +
+                                  std::to_string(node) + "/cpulist",
+                   &cpus) ||
+      sched_setaffinity(0, sizeof(cpus), &cpus) < 0) {
+    return false;
+  }
+  if (node < 0) {
+    return syscall(SYS_set_mempolicy, MPOL_DEFAULT, nullptr, 0) == 0;
+  }
+  // Preferred rather than bound: a node that runs out of memory falls back
+  // to the others instead of having the kernel kill a process on it.
+  const int kBits = 8 * sizeof(unsigned long);  // NOLINT
+  std::vector<unsigned long> mask(node / kBits + 1);  // NOLINT
+  mask[node / kBits] = 1UL << (node % kBits);
+  return syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask.data(),
+                 mask.size() * kBits + 1) == 0;
+}
@@ -14,22 +14,35 @@
 
 #include "src/main/tools/process-tools.h"
 
+#include <ctype.h>
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <math.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <fstream>
 #include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
 
 #include "src/main/protobuf/execution_statistics.pb.h"
 #include "src/main/tools/logging.h"
@@ -83,6 +96,82 @@ void Redirect(const std::string &target_path, int fd) {
   }
 }
 
+#if defined(__linux__) && defined(__NR_close_range)
+#if !defined(CLOSE_RANGE_CLOEXEC)
+// https://github.com/torvalds/linux/blob/v5.11/include/uapi/linux/close_range.h
+#define CLOSE_RANGE_CLOEXEC (1U << 2)
+#endif
+
+// Returns false if the kernel cannot do it, which is before Linux 5.9, or
+// before 5.11 for `on_exec`.
+static bool CloseRange(unsigned int first, unsigned int last, bool on_exec) {
+  if (first > last) {
+    return true;
+  }
+  return syscall(__NR_close_range, first, last,
+                 on_exec ? CLOSE_RANGE_CLOEXEC : 0) == 0;
+}
+#endif
+
+void CloseFdsFrom(int first_fd, int keep_fd, bool on_exec) {
+#if defined(__linux__) && defined(__NR_close_range)
+  bool closed;
+  if (keep_fd >= first_fd) {
+    closed = CloseRange(first_fd, keep_fd - 1, on_exec) &&
+             CloseRange(keep_fd + 1, ~0U, on_exec);
+  } else {
+    closed = CloseRange(first_fd, ~0U, on_exec);
+  }
+  if (closed) {
+    return;
+  }
+#endif
+
+#if defined(__linux__)
+  DIR *fds = opendir("/proc/self/fd");
+#else
+  DIR *fds = opendir("/dev/fd");
+#endif
+  if (fds == nullptr) {
+    DIE("opendir");
+  }
+
+  while (1) {
+    errno = 0;
+    struct dirent *dent = readdir(fds);
+
+    if (dent == nullptr) {
+      if (errno != 0) {
+        DIE("readdir");
+      }
+      break;
+    }
+
+    if (isdigit(dent->d_name[0])) {
+      errno = 0;
+      int fd = strtol(dent->d_name, nullptr, 10);
+
+      // (1) Skip unparseable entries.
+      // (2) Skip the file descriptors to keep.
+      // (3) Do not accidentally close our directory handle.
+      if (errno != 0 || fd < first_fd || fd == keep_fd || fd == dirfd(fds)) {
+        continue;
+      }
+      if (on_exec) {
+        if (fcntl(fd, F_SETFD, FD_CLOEXEC) < 0) {
+          DIE("fcntl");
+        }
+      } else if (close(fd) < 0) {
+        DIE("close");
+      }
+    }
+  }
+
+  if (closedir(fds) < 0) {
+    DIE("closedir");
+  }
+}
+
 static void ForciblyKillEverything(int signo) {
   // We don't update the last_signal field tracked in process-wrapper-legacy.cc,
   // which is used to report the signal back to the user, because we want to
@@ -233,11 +322,164 @@ int WaitChildWithRusage(pid_t pid, struct rusage *rusage,
   return status;
 }
 
+int64_t MonotonicTimeUsec() {
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0) {
+    DIE("clock_gettime");
+  }
+  return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Reads the value of `key` from a cgroup file of "key value" lines. Returns 0
+// if there is no such file or key.
+static int64_t ReadCgroupKeyedValue(const std::string &path,
+                                    const std::string &key) {
+  std::ifstream file(path);
+  for (std::string line; std::getline(file, line);) {
+    std::istringstream fields(line);
+    std::string name;
+    int64_t value;
+    if (fields >> name >> value && name == key) {
+      return value;
+    }
+  }
+  return 0;
+}
+
+// Sums the values of the "key=value" fields for `key` in a cgroup file of
+// lines that start with a name, over the lines with name `line_name`, or all
+// lines if it is null. Returns 0 if there is no such file or field.
+static int64_t SumCgroupFields(const std::string &path, const char *line_name,
+                               const std::string &key) {
+  std::ifstream file(path);
+  int64_t sum = 0;
+  for (std::string line; std::getline(file, line);) {
+    std::istringstream fields(line);
+    std::string name;
+    if (!(fields >> name) || (line_name != nullptr && name != line_name)) {
+      continue;
+    }
+    for (std::string field; fields >> field;) {
+      if (field.compare(0, key.size() + 1, key + "=") == 0) {
+        sum += strtoll(field.c_str() + key.size() + 1, nullptr, 10);
+      }
+    }
+  }
+  return sum;
+}
+
+// Fills in the statistics of the cgroup v2 in `cgroup_dir`. Directories of
+// cgroup v1 controllers have none of these files.
+static void ReadCgroupStatistics(const std::string &cgroup_dir,
+                                 tools::protos::CgroupStatistics *stats) {
+  std::ifstream memory_peak(cgroup_dir + "/memory.peak");
+  int64_t peak;
+  if (memory_peak >> peak) {
+    stats->set_memory_peak_bytes(peak);
+  }
+  stats->set_oom_kills(
+      ReadCgroupKeyedValue(cgroup_dir + "/memory.events", "oom_kill"));
+
+  const std::string cpu_stat = cgroup_dir + "/cpu.stat";
+  stats->set_cpu_usage_usec(ReadCgroupKeyedValue(cpu_stat, "usage_usec"));
+  stats->set_cpu_nr_throttled(ReadCgroupKeyedValue(cpu_stat, "nr_throttled"));
+  stats->set_cpu_throttled_usec(
+      ReadCgroupKeyedValue(cpu_stat, "throttled_usec"));
+
+  stats->set_cpu_some_stall_usec(
+      SumCgroupFields(cgroup_dir + "/cpu.pressure", "some", "total"));
+  const std::string memory_pressure = cgroup_dir + "/memory.pressure";
+  stats->set_memory_some_stall_usec(
+      SumCgroupFields(memory_pressure, "some", "total"));
+  stats->set_memory_full_stall_usec(
+      SumCgroupFields(memory_pressure, "full", "total"));
+  const std::string io_pressure = cgroup_dir + "/io.pressure";
+  stats->set_io_some_stall_usec(SumCgroupFields(io_pressure, "some", "total"));
+  stats->set_io_full_stall_usec(SumCgroupFields(io_pressure, "full", "total"));
+
+  // One line per device.
+  const std::string io_stat = cgroup_dir + "/io.stat";
+  stats->set_io_read_bytes(SumCgroupFields(io_stat, nullptr, "rbytes"));
+  stats->set_io_write_bytes(SumCgroupFields(io_stat, nullptr, "wbytes"));
+}
+
+bool ReadIoCounters(IoCounters *counters) {
+  std::ifstream file("/proc/self/io");
+  if (!file) {
+    return false;
+  }
+  *counters = {};
+  for (std::string line; std::getline(file, line);) {
+    std::istringstream fields(line);
+    std::string name;
+    int64_t value;
+    if (!(fields >> name >> value)) {
+      continue;
+    }
+    if (name == "rchar:") {
+      counters->read_chars = value;
+    } else if (name == "wchar:") {
+      counters->write_chars = value;
+    } else if (name == "read_bytes:") {
+      counters->read_bytes = value;
+    } else if (name == "write_bytes:") {
+      counters->write_bytes = value;
+    } else if (name == "cancelled_write_bytes:") {
+      counters->cancelled_write_bytes = value;
+    }
+  }
+  return true;
+}
+
 static std::unique_ptr<tools::protos::ExecutionStatistics>
-CreateExecutionStatisticsProto(struct rusage *rusage) {
+CreateExecutionStatisticsProto(struct rusage *rusage,
+                               const std::vector<std::string> &cgroups_dirs,
+                               const SandboxTimes *sandbox_times,
+                               const IoCounters *io_counters,
+                               const PerfCounters *perf_counters) {
   std::unique_ptr<tools::protos::ExecutionStatistics> execution_statistics(
       new tools::protos::ExecutionStatistics);
 
+  if (perf_counters != nullptr) {
+    tools::protos::PerfCounters *perf_counters_proto =
+        execution_statistics->mutable_perf_counters();
+    perf_counters_proto->set_instructions(perf_counters->instructions);
+    perf_counters_proto->set_cycles(perf_counters->cycles);
+    perf_counters_proto->set_cache_misses(perf_counters->cache_misses);
+  }
+
+  if (io_counters != nullptr) {
+    tools::protos::IoStatistics *io_statistics =
+        execution_statistics->mutable_io_statistics();
+    io_statistics->set_read_chars(io_counters->read_chars);
+    io_statistics->set_write_chars(io_counters->write_chars);
+    io_statistics->set_read_bytes(io_counters->read_bytes);
+    io_statistics->set_write_bytes(io_counters->write_bytes);
+    io_statistics->set_cancelled_write_bytes(
+        io_counters->cancelled_write_bytes);
+  }
+
+  if (sandbox_times != nullptr) {
+    tools::protos::SandboxStatistics *sandbox_statistics =
+        execution_statistics->mutable_sandbox_statistics();
+    sandbox_statistics->set_namespace_setup_usec(
+        sandbox_times->namespace_setup_usec);
+    sandbox_statistics->set_mount_setup_usec(sandbox_times->mount_setup_usec);
+    sandbox_statistics->set_network_setup_usec(
+        sandbox_times->network_setup_usec);
+    sandbox_statistics->set_spawn_usec(sandbox_times->spawn_usec);
+    sandbox_statistics->set_command_usec(sandbox_times->command_usec);
+    sandbox_statistics->set_teardown_usec(sandbox_times->teardown_usec);
+  }
+
+  for (const std::string &cgroups_dir : cgroups_dirs) {
+    if (access((cgroups_dir + "/cgroup.controllers").c_str(), F_OK) == 0) {
+      ReadCgroupStatistics(cgroups_dir,
+                           execution_statistics->mutable_cgroup_statistics());
+      break;
+    }
+  }
+
   tools::protos::ResourceUsage *resource_usage =
       execution_statistics->mutable_resource_usage();
 
@@ -264,7 +506,12 @@ CreateExecutionStatisticsProto(struct rusage *rusage) {
 }
 
 // Write execution statistics (e.g. resource usage) to a file.
-void WriteStatsToFile(struct rusage *rusage, const std::string &stats_path) {
+void WriteStatsToFile(struct rusage *rusage,
+                      const std::vector<std::string> &cgroups_dirs,
+                      const std::string &stats_path,
+                      const SandboxTimes *sandbox_times,
+                      const IoCounters *io_counters,
+                      const PerfCounters *perf_counters) {
   const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_APPEND;
   int fd_out = open(stats_path.c_str(), flags, 0666);
   if (fd_out < 0) {
@@ -272,7 +519,8 @@ void WriteStatsToFile(struct rusage *rusage, const std::string &stats_path) {
   }
 
   std::unique_ptr<tools::protos::ExecutionStatistics> execution_statistics =
-      CreateExecutionStatisticsProto(rusage);
+      CreateExecutionStatisticsProto(rusage, cgroups_dirs, sandbox_times,
+                                     io_counters, perf_counters);
   std::string serialized = execution_statistics->SerializeAsString();
 
   if (serialized.empty()) {
@@ -348,3 +596,39 @@ void SignalPipe(int *pipe) {
     DIE("close");
   }
 }
+
+void WaitForAdmission(const std::string &path, double max_wait_secs) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    PRINT_DEBUG("no admission gate at %s: %s", path.c_str(), strerror(errno));
+    return;
+  }
+  struct stat sb;
+  void *gate = MAP_FAILED;
+  // Reading past the end of the file would raise a SIGBUS.
+  if (fstat(fd, &sb) == 0 &&
+      sb.st_size >= static_cast<off_t>(sizeof(uint32_t))) {
+    gate = mmap(nullptr, sizeof(uint32_t), PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (gate == MAP_FAILED) {
+    return;
+  }
+  const uint32_t *level = static_cast<const uint32_t *>(gate);
+  const int64_t start = MonotonicTimeUsec();
+  const int64_t max_wait_usec = static_cast<int64_t>(max_wait_secs * 1e6);
+  int64_t waited = 0;
+  // The level only changes every few seconds at most: polling costs less
+  // than a semaphore that would need the server to post a wakeup for every
+  // waiting action.
+  while (__atomic_load_n(level, __ATOMIC_ACQUIRE) >=
+             kAdmissionGateCriticalLevel &&
+         (waited = MonotonicTimeUsec() - start) < max_wait_usec) {
+    struct timespec ts = {0, 20 * 1000 * 1000};
+    nanosleep(&ts, nullptr);
+  }
+  if (waited > 0) {
+    PRINT_DEBUG("waited %" PRId64 "ms at the admission gate", waited / 1000);
+  }
+  munmap(gate, sizeof(uint32_t));
+}
@@ -16,8 +16,10 @@
 #define SRC_MAIN_TOOLS_PROCESS_TOOLS_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <string>
+#include <vector>
 
 // Switch completely to the effective uid.
 // Some programs (notably, bash) ignore the euid and just use the uid. This
@@ -31,6 +33,12 @@ int SwitchToEgid();
 // Redirect fd to the file target_path (but not if target_path is empty or "-").
 void Redirect(const std::string &target_path, int fd);
 
+// Closes all file descriptors from `first_fd` on, except `keep_fd` (unless it
+// is -1), or only marks them close-on-exec if `on_exec`. This takes a
+// close_range(2) call per range of file descriptors on kernels that have it,
+// instead of going through all of the open file descriptors one by one.
+void CloseFdsFrom(int first_fd, int keep_fd, bool on_exec);
+
 // Make sure the process group "pgrp" and all its subprocesses are killed.
 // If "gracefully" is true, sends SIGTERM first and after a timeout of
 // "graceful_kill_delay" seconds, sends SIGKILL.
@@ -63,8 +71,67 @@ int WaitChild(pid_t pid, bool child_subreaper_enabled);
 int WaitChildWithRusage(pid_t pid, struct rusage *rusage,
                         bool child_subreaper_enabled);
 
-// Write execution statistics to a file.
-void WriteStatsToFile(struct rusage *rusage, const std::string &stats_path);
+// The time linux-sandbox spent in each phase of running a command, in
+// microseconds, as in the SandboxStatistics message.
+struct SandboxTimes {
+  int64_t namespace_setup_usec;
+  int64_t mount_setup_usec;
+  int64_t network_setup_usec;
+  int64_t spawn_usec;
+  int64_t command_usec;
+  int64_t teardown_usec;
+};
+
+// Returns the time of CLOCK_MONOTONIC in microseconds.
+int64_t MonotonicTimeUsec();
+
+// The I/O counters of /proc/<pid>/io, in bytes, as in the IoStatistics
+// message.
+struct IoCounters {
+  int64_t read_chars;
+  int64_t write_chars;
+  int64_t read_bytes;
+  int64_t write_bytes;
+  int64_t cancelled_write_bytes;
+};
+
+// Reads the I/O counters of this process, which include those of the children
+// that it has waited for. Returns false if the kernel does not keep them.
+bool ReadIoCounters(IoCounters *counters);
+
+// The hardware performance counters of a command, as in the PerfCounters
+// message.
+struct PerfCounters {
+  int64_t instructions;
+  int64_t cycles;
+  int64_t cache_misses;
+};
+
+// Opens a group of hardware performance counters that the processes started
+// from now on inherit, and that count in user space once they exec, so that
+// this process and what it does before the exec are not counted. Returns
+// their file descriptors, or none if the kernel does not let us count them
+// (see perf_event_paranoid) or the machine has no such counters.
+//
+// May not be implemented on all platforms.
+std::vector<int> OpenPerfCounters();
+
+// Reads the counters opened by OpenPerfCounters, which include those of the
+// children that we have waited for, and closes them. Returns false if they
+// cannot be read.
+//
+// May not be implemented on all platforms.
+bool ReadPerfCounters(const std::vector<int> &fds, PerfCounters *counters);
+
+// Write execution statistics to a file, including the statistics of the first
+// cgroup v2 in `cgroups_dirs`, the sandbox times, the I/O counters and the
+// performance counters, if any.
+void WriteStatsToFile(struct rusage *rusage,
+                      const std::vector<std::string> &cgroups_dirs,
+                      const std::string &stats_path,
+                      const SandboxTimes *sandbox_times = nullptr,
+                      const IoCounters *io_counters = nullptr,
+                      const PerfCounters *perf_counters = nullptr);
 
 // Write contents to a file.
 void WriteFile(const std::string &filename, const char *fmt, ...);
@@ -99,6 +166,42 @@ int WaitForProcessGroupToTerminate(pid_t pgid);
 // May not be implemented on all platforms.
 int TerminateAndWaitForAll(pid_t pid);
 
+// Opens a pidfd for "pid", which becomes readable once the process exits.
+// Returns -1 and sets errno (to ENOSYS if the kernel has no pidfds) on
+// failure.
+//
+// May not be implemented on all platforms.
+int OpenPidfd(pid_t pid);
+
+// Waits for "fd" to become readable, such as a pidfd or a pipe that the
+// process closes when it exits, from a single poll loop instead of signal
+// handlers and interval timers. Meanwhile, once "timeout_secs" have passed (if
+// positive) or one of "graceful_signals" arrives, sends SIGTERM to "kill_pid"
+// (negative for a process group) and SIGKILL "kill_delay_secs" later, or
+// SIGKILL at once if the delay is not positive. One of "abrupt_signals", any
+// signal after the first request, or "cancel_fd" (if not -1) becoming readable
+// or hung up sends SIGKILL at once.
+//
+// The signals are blocked on return. Returns the last signal that arrived,
+// SIGALRM if the timeout expired, SIGKILL if "cancel_fd" did, or 0.
+//
+// May not be implemented on all platforms.
+int WaitForExitEvent(int fd, int cancel_fd, pid_t kill_pid,
+                     double timeout_secs, double kill_delay_secs,
+                     const std::vector<int> &graceful_signals,
+                     const std::vector<int> &abrupt_signals);
+
+// Like WaitForExitEvent, but waits for the process "pid", which must be a
+// child of ours, to exit, from a single kqueue loop (EVFILT_PROC,
+// EVFILT_SIGNAL and EVFILT_READ, with the deadlines as kevent timeouts).
+// Returns -1 and sets errno if the kqueue cannot be set up.
+//
+// May not be implemented on all platforms.
+int WaitForProcessExitEvent(pid_t pid, int cancel_fd, pid_t kill_pid,
+                            double timeout_secs, double kill_delay_secs,
+                            const std::vector<int> &graceful_signals,
+                            const std::vector<int> &abrupt_signals);
+
 // Blocks and waits on a pipe for the a signal to proceed from the other process
 // `SignalPipe()`.
 void WaitPipe(int *pipe);
@@ -107,4 +210,22 @@ void WaitPipe(int *pipe);
 // that it can proceed by writing a byte to the pipe.
 void SignalPipe(int *pipe);
 
+// The memory pressure level at which the admission gate holds new actions
+// back, as in MemoryPressureLevel of src/main/native/unix_jni.h.
+const uint32_t kAdmissionGateCriticalLevel = 2;
+
+// Waits, for at most "max_wait_secs", while the admission gate at "path" is
+// closed: the Bazel server keeps the memory pressure level of the system in a
+// 32-bit word at the start of that file, and new actions wait while it is
+// critical, so that they do not add to the swapping of those that run. Returns
+// at once if there is no such file.
+void WaitForAdmission(const std::string &path, double max_wait_secs);
+
+// Runs the current process, and the ones it starts from now on, on the cpus
+// of NUMA node "node", and has their memory come from that node as long as it
+// has some. A "node" of -1 lifts these restrictions instead, such as the ones
+// inherited from a Bazel server bound to a node. Returns false, with errno
+// set, if this cannot be done, e.g. on other systems than Linux.
+bool BindToNumaNode(int node);
+
 #endif  // PROCESS_TOOLS_H__
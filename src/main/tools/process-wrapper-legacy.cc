@@ -14,6 +14,7 @@
 
 #include "src/main/tools/process-wrapper-legacy.h"
 
+#include <spawn.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -29,11 +30,18 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <memory>
+#include <vector>
+
+#include "src/main/cpp/util/probe.h"
 #include "src/main/tools/logging.h"
 #include "src/main/tools/process-tools.h"
 #include "src/main/tools/process-wrapper-options.h"
+#include "src/main/tools/process-wrapper-output-cap.h"
 #include "src/main/tools/process-wrapper.h"
 
+extern char **environ;
+
 static bool child_subreaper_enabled = false;
 #if defined(__linux__)
 #if !defined(PR_SET_CHILD_SUBREAPER)
@@ -45,12 +53,74 @@ static bool child_subreaper_enabled = false;
 pid_t LegacyProcessWrapper::child_pid = 0;
 volatile sig_atomic_t LegacyProcessWrapper::last_signal = 0;
 
+// Our I/O counters before spawning the child, if there are any and they are
+// needed for the stats.
+static bool have_io_counters = false;
+static IoCounters io_counters_before;
+
+#if defined(__linux__)
+// With --perf_counters, the performance counters that the child inherits, if
+// the kernel let us open them.
+static std::vector<int> perf_counter_fds;
+#endif
+
+// With --max_output_bytes, what passes the output of the child on to our
+// stdout and stderr.
+static std::unique_ptr<OutputCap> output_cap;
+
 void LegacyProcessWrapper::RunCommand() {
   SpawnChild();
-  WaitForChild();
+  const int status = WaitForChild(-1);
+
+  if (last_signal > 0) {
+    // Don't trust the exit code if we got a timeout or signal.
+    RaiseWithDefaultHandler(last_signal);
+  } else if (WIFEXITED(status)) {
+    exit(WEXITSTATUS(status));
+  } else {
+    RaiseWithDefaultHandler(WTERMSIG(status));
+  }
+}
+
+int LegacyProcessWrapper::RunCommandForClient(int connection) {
+  SpawnChild();
+  const int status = WaitForChild(connection);
+
+  // The exit code that a shell would report for process-wrapper itself.
+  if (last_signal > 0) {
+    return 128 + last_signal;
+  } else if (WIFEXITED(status)) {
+    return WEXITSTATUS(status);
+  } else {
+    return 128 + WTERMSIG(status);
+  }
 }
 
 void LegacyProcessWrapper::SpawnChild() {
+  if (!opt.admission_gate_path.empty()) {
+    WaitForAdmission(opt.admission_gate_path, opt.admission_wait_secs);
+  }
+
+  // The child inherits the CPUs and the memory policy that we bind to. An
+  // action that cannot be bound runs wherever the scheduler puts it.
+  if (opt.bind_numa_node && !BindToNumaNode(opt.numa_node)) {
+    PRINT_DEBUG("cannot bind to NUMA node %d: %m", opt.numa_node);
+  }
+
+  if (!opt.stats_path.empty()) {
+    have_io_counters = ReadIoCounters(&io_counters_before);
+#if defined(__linux__)
+    if (opt.perf_counters) {
+      perf_counter_fds = OpenPerfCounters();
+    }
+#endif
+  }
+
+  if (opt.max_output_bytes > 0) {
+    output_cap.reset(new OutputCap(opt.max_output_bytes));
+    output_cap->Capture();
+  }
+
 #if defined(__linux__)
   if (prctl(PR_SET_CHILD_SUBREAPER, 1, 0, 0, 0) == 0) {
     child_subreaper_enabled = true;
@@ -61,6 +131,56 @@ void LegacyProcessWrapper::SpawnChild() {
   }
 #endif
 
+#if defined(POSIX_SPAWN_SETSID)
+  // posix_spawn doesn't copy our page tables like fork does, and the C library
+  // implements it with vfork where it can.
+  posix_spawnattr_t attr;
+  if (posix_spawnattr_init(&attr) != 0) {
+    DIE("posix_spawnattr_init");
+  }
+  sigset_t signals;
+  sigemptyset(&signals);
+  posix_spawnattr_setsigmask(&attr, &signals);
+  sigfillset(&signals);
+  sigdelset(&signals, SIGKILL);
+  sigdelset(&signals, SIGSTOP);
+  posix_spawnattr_setsigdefault(&attr, &signals);
+  short flags =
+      POSIX_SPAWN_SETSID | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+  posix_spawn_file_actions_t *actions = nullptr;
+#if defined(POSIX_SPAWN_CLOEXEC_DEFAULT)
+  // Only pass on stdin, stdout and stderr, without having to look for the
+  // other descriptors first.
+  posix_spawn_file_actions_t inherit;
+  if (posix_spawn_file_actions_init(&inherit) != 0) {
+    DIE("posix_spawn_file_actions_init");
+  }
+  for (int fd = STDIN_FILENO; fd <= STDERR_FILENO; ++fd) {
+    if (posix_spawn_file_actions_addinherit_np(&inherit, fd) != 0) {
+      DIE("posix_spawn_file_actions_addinherit_np");
+    }
+  }
+  actions = &inherit;
+  flags |= POSIX_SPAWN_CLOEXEC_DEFAULT;
+#endif
+  posix_spawnattr_setflags(&attr, flags);
+
+  // Force umask to include read and execute for everyone, to make output
+  // permissions predictable. The child inherits it from us.
+  const mode_t old_umask = umask(022);
+  const int err = posix_spawnp(&child_pid, opt.args[0], actions, &attr,
+                               opt.args.data(), environ);
+  umask(old_umask);
+  if (actions != nullptr) {
+    posix_spawn_file_actions_destroy(actions);
+  }
+  posix_spawnattr_destroy(&attr);
+  if (err != 0) {
+    // posix_spawnp looks up the command like execvp, and fails like it.
+    errno = err;
+    DIE("execvp(%s, ...)", opt.args[0]);
+  }
+#else
   child_pid = fork();
   if (child_pid < 0) {
     DIE("fork");
@@ -80,6 +200,13 @@ void LegacyProcessWrapper::SpawnChild() {
       DIE("execvp(%s, ...)", opt.args[0]);
     }
   }
+#endif
+
+  BAZEL_PROBE(process_wrapper, child_spawn, child_pid, opt.args[0]);
+
+  if (output_cap) {
+    output_cap->Start();
+  }
 }
 
 // Sets up signal handlers to kill all subprocesses when the given signal is
@@ -102,17 +229,63 @@ void LegacyProcessWrapper::SetupSignalHandlers() {
   InstallSignalHandler(SIGINT, OnAbruptSignal);
 }
 
-void LegacyProcessWrapper::WaitForChild() {
-  SetupSignalHandlers();
-  if (opt.timeout_secs > 0) {
-    SetTimeout(opt.timeout_secs);
+// Waits for the child to exit on a pidfd (on Linux) or a kqueue (on macOS),
+// handling the timeout, the termination signals and the cancellation in the
+// same loop, so that the child can be waited for without blocking afterwards.
+// Returns false if neither is available.
+bool LegacyProcessWrapper::WaitForChildInEventLoop(int cancel_fd) {
+#if defined(__linux__) || defined(__APPLE__)
+  // The same signals as in SetupSignalHandlers, except that there is no
+  // SIGALRM: the event loop reports the timeout as such.
+  std::vector<int> graceful_signals;
+  std::vector<int> abrupt_signals = {SIGINT};
+  if (opt.graceful_sigterm) {
+    graceful_signals.push_back(SIGTERM);
+  } else {
+    abrupt_signals.push_back(SIGTERM);
+  }
+#endif
+#if defined(__linux__)
+  const int pidfd = OpenPidfd(child_pid);
+  if (pidfd < 0) {
+    if (errno != ENOSYS) {
+      DIE("pidfd_open");
+    }
+    return false;
+  }
+  last_signal =
+      WaitForExitEvent(pidfd, cancel_fd, -child_pid, opt.timeout_secs,
+                       opt.kill_delay_secs, graceful_signals, abrupt_signals);
+  close(pidfd);
+  return true;
+#elif defined(__APPLE__)
+  const int signal = WaitForProcessExitEvent(
+      child_pid, cancel_fd, -child_pid, opt.timeout_secs, opt.kill_delay_secs,
+      graceful_signals, abrupt_signals);
+  if (signal < 0) {
+    DIE("kqueue");
+  }
+  last_signal = signal;
+  return true;
+#else
+  return false;
+#endif
+}
+
+int LegacyProcessWrapper::WaitForChild(int cancel_fd) {
+  const bool waited = WaitForChildInEventLoop(cancel_fd);
+  if (!waited) {
+    SetupSignalHandlers();
+    if (opt.timeout_secs > 0) {
+      SetTimeout(opt.timeout_secs);
+    }
   }
 
   // On macOS, we have to ensure the whole process group is terminated before
   // collecting the status of the PID we are interested in. (Otherwise other
   // processes could race us and grab the PGID.)
 #if defined(__APPLE__)
-  if (WaitForProcessToTerminate(child_pid) == -1) {
+  if (!waited && WaitForProcessToTerminate(child_pid) == -1) {
     DIE("WaitForProcessToTerminate");
   }
 
@@ -130,10 +303,32 @@ void LegacyProcessWrapper::WaitForChild() {
     struct rusage child_rusage;
     status = WaitChildWithRusage(child_pid, &child_rusage,
                                  child_subreaper_enabled);
-    WriteStatsToFile(&child_rusage, opt.stats_path);
+    // Now that the child is waited for, its I/O counts as ours.
+    IoCounters io_counters;
+    const bool have_io = have_io_counters && ReadIoCounters(&io_counters);
+    if (have_io) {
+      io_counters.read_chars -= io_counters_before.read_chars;
+      io_counters.write_chars -= io_counters_before.write_chars;
+      io_counters.read_bytes -= io_counters_before.read_bytes;
+      io_counters.write_bytes -= io_counters_before.write_bytes;
+      io_counters.cancelled_write_bytes -=
+          io_counters_before.cancelled_write_bytes;
+    }
+    PerfCounters perf_counters;
+    bool have_perf = false;
+#if defined(__linux__)
+    if (!perf_counter_fds.empty()) {
+      have_perf = ReadPerfCounters(perf_counter_fds, &perf_counters);
+      perf_counter_fds.clear();
+    }
+#endif
+    WriteStatsToFile(&child_rusage, {}, opt.stats_path, nullptr,
+                     have_io ? &io_counters : nullptr,
+                     have_perf ? &perf_counters : nullptr);
   } else {
     status = WaitChild(child_pid, child_subreaper_enabled);
   }
+  BAZEL_PROBE(process_wrapper, child_exit, child_pid, status);
 
 #if !defined(__APPLE__) && !defined(__OpenBSD__)
   if (child_subreaper_enabled) {
@@ -155,17 +350,23 @@ void LegacyProcessWrapper::WaitForChild() {
   }
 #endif
 
-  if (last_signal > 0) {
-    // Don't trust the exit code if we got a timeout or signal.
-    InstallDefaultSignalHandler(last_signal);
-    raise(last_signal);
-  } else if (WIFEXITED(status)) {
-    exit(WEXITSTATUS(status));
-  } else {
-    int sig = WTERMSIG(status);
-    InstallDefaultSignalHandler(sig);
-    raise(sig);
+  if (output_cap) {
+    output_cap->Finish();
+    output_cap.reset();
   }
+
+  return status;
+}
+
+// Exits with the given signal, which WaitForChildInEventLoop may have
+// blocked.
+void LegacyProcessWrapper::RaiseWithDefaultHandler(int sig) {
+  InstallDefaultSignalHandler(sig);
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, sig);
+  sigprocmask(SIG_UNBLOCK, &set, nullptr);
+  raise(sig);
 }
 
 // Called when timeout or signal occurs.
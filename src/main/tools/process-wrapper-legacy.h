@@ -37,10 +37,17 @@ class LegacyProcessWrapper {
   // `opt.timeout_secs` seconds.
   static void RunCommand();
 
+  // Like RunCommand, but returns the exit code that process-wrapper would exit
+  // with instead of exiting, and kills the command if `connection` is closed
+  // (where pidfds or kqueues are available).
+  static int RunCommandForClient(int connection);
+
  private:
   static void SpawnChild();
   static void SetupSignalHandlers();
-  static void WaitForChild();
+  static bool WaitForChildInEventLoop(int cancel_fd);
+  static int WaitForChild(int cancel_fd);
+  static void RaiseWithDefaultHandler(int sig);
   static void OnAbruptSignal(int sig);
   static void OnGracefulSignal(int sig);
 
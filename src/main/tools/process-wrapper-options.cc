@@ -15,6 +15,7 @@
 #include "src/main/tools/process-wrapper-options.h"
 
 #include <getopt.h>
+#include <inttypes.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -51,6 +52,20 @@ static void Usage(char *program_name, const char *fmt, ...) {
       "  -e/--stderr <file>  redirect stderr to a file\n"
       "  -s/--stats <file>  if set, write stats in protobuf format to a file\n"
       "  -d/--debug  if set, debug info will be printed\n"
+      "  --server <socket>  instead of running a command, start a server in "
+      "the background that runs the commands sent to the Unix socket\n"
+      "  --admission_gate <file>  before running the command, wait while the "
+      "Bazel server reports critical memory pressure in this file\n"
+      "  --admission_wait <secs>  how long to wait at the admission gate at "
+      "most\n"
+      "  --numa_node <node>  run the command on the CPUs of this NUMA node, "
+      "preferring its memory\n"
+      "  --max_output_bytes <bytes>  write only the first and the last half "
+      "of this many bytes of stdout and of stderr, and how many were "
+      "dropped in between\n"
+      "  --perf_counters  also write the instructions, cycles and cache "
+      "misses of the command to the stats, if the kernel lets us count "
+      "them\n"
       "  --  command to run inside sandbox, followed by arguments\n");
   exit(EXIT_FAILURE);
 }
@@ -66,6 +81,12 @@ static void ParseCommandLine(const std::vector<char *> &args) {
       {"stderr", required_argument, 0, 'e'},
       {"stats", required_argument, 0, 's'},
       {"debug", no_argument, 0, 'd'},
+      {"server", required_argument, 0, 'S'},
+      {"admission_gate", required_argument, 0, 'A'},
+      {"admission_wait", required_argument, 0, 'W'},
+      {"numa_node", required_argument, 0, 'N'},
+      {"max_output_bytes", required_argument, 0, 'O'},
+      {"perf_counters", no_argument, 0, 'P'},
       {0, 0, 0, 0}};
   extern char *optarg;
   extern int optind, optopt;
@@ -114,6 +135,32 @@ static void ParseCommandLine(const std::vector<char *> &args) {
       case 'd':
         opt.debug = true;
         break;
+      case 'S':
+        opt.server_path.assign(optarg);
+        break;
+      case 'A':
+        opt.admission_gate_path.assign(optarg);
+        break;
+      case 'W':
+        if (sscanf(optarg, "%lf", &opt.admission_wait_secs) != 1) {
+          Usage(args.front(), "Invalid admission wait value: %s", optarg);
+        }
+        break;
+      case 'N':
+        if (sscanf(optarg, "%d", &opt.numa_node) != 1 || opt.numa_node < 0) {
+          Usage(args.front(), "Invalid NUMA node: %s", optarg);
+        }
+        opt.bind_numa_node = true;
+        break;
+      case 'O':
+        if (sscanf(optarg, "%" SCNd64, &opt.max_output_bytes) != 1 ||
+            opt.max_output_bytes <= 0) {
+          Usage(args.front(), "Invalid max output bytes: %s", optarg);
+        }
+        break;
+      case 'P':
+        opt.perf_counters = true;
+        break;
       case '?':
         Usage(args.front(), "Unrecognized argument: -%c (%d)", optopt, optind);
         break;
@@ -133,6 +180,12 @@ void ParseOptions(int argc, char *argv[]) {
 
   ParseCommandLine(args);
 
+  if (!opt.server_path.empty()) {
+    if (!opt.args.empty()) {
+      Usage(args.front(), "The server (--server) takes no command.");
+    }
+    return;
+  }
   if (opt.args.empty()) {
     Usage(args.front(), "No command specified.");
   }
@@ -15,6 +15,8 @@
 #ifndef SRC_MAIN_TOOLS_PROCESS_WRAPPER_OPTIONS_H_
 #define SRC_MAIN_TOOLS_PROCESS_WRAPPER_OPTIONS_H_
 
+#include <stdint.h>
+
 #include <string>
 #include <vector>
 
@@ -34,6 +36,22 @@ struct Options {
   bool debug;
   // Where to write stats, in protobuf format (-s)
   std::string stats_path;
+  // Where to listen for commands to run as a server (--server)
+  std::string server_path;
+  // The admission gate to wait at before running the command (--admission_gate)
+  std::string admission_gate_path;
+  // How long to wait at the admission gate at most (--admission_wait)
+  double admission_wait_secs;
+  // Whether to bind the command to the CPUs and memory of a NUMA node, and
+  // which one (--numa_node)
+  bool bind_numa_node;
+  int numa_node;
+  // How much of each of stdout and stderr to write at most, or 0 for all
+  // (--max_output_bytes)
+  int64_t max_output_bytes;
+  // Whether to write the hardware performance counters of the command to the
+  // stats (--perf_counters)
+  bool perf_counters;
   // Command to run (--)
   std::vector<char *> args;
 };
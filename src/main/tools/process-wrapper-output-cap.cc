@@ -0,0 +1,248 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/tools/process-wrapper-output-cap.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "src/main/tools/logging.h"
+
+static void WriteAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = write(fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // There is nowhere left to report this.
+      return;
+    }
+    data += n;
+    size -= n;
+  }
+}
+
+// Like pipe2(fds, O_CLOEXEC), which macOS does not have. We are single
+// threaded when this is called, so there is no race with a fork.
+static void MakePipe(int fds[2]) {
+  if (pipe(fds) < 0) {
+    DIE("pipe");
+  }
+  for (int i = 0; i < 2; ++i) {
+    if (fcntl(fds[i], F_SETFD, FD_CLOEXEC) < 0) {
+      DIE("fcntl(%d, F_SETFD)", fds[i]);
+    }
+  }
+}
+
+OutputCap::OutputCap(int64_t limit)
+    : head_limit_(limit / 2), tail_limit_(limit - limit / 2) {
+  stop_pipe_[0] = stop_pipe_[1] = -1;
+}
+
+void OutputCap::Capture() {
+  struct stat out, err;
+  bool have_out = fstat(STDOUT_FILENO, &out) == 0;
+  bool have_err = fstat(STDERR_FILENO, &err) == 0;
+  // Reserved so that Reader() can hold on to the elements.
+  streams_.reserve(2);
+  if (have_out && have_err && out.st_dev == err.st_dev &&
+      out.st_ino == err.st_ino) {
+    streams_.push_back({{STDOUT_FILENO, STDERR_FILENO}, -1, -1, 0, "", 0});
+  } else {
+    if (have_out) {
+      streams_.push_back({{STDOUT_FILENO}, -1, -1, 0, "", 0});
+    }
+    if (have_err) {
+      streams_.push_back({{STDERR_FILENO}, -1, -1, 0, "", 0});
+    }
+  }
+
+  for (Stream &stream : streams_) {
+    stream.file_fd = fcntl(stream.fds[0], F_DUPFD_CLOEXEC, 3);
+    if (stream.file_fd < 0) {
+      DIE("fcntl(%d, F_DUPFD_CLOEXEC)", stream.fds[0]);
+    }
+    int pipe_fds[2];
+    MakePipe(pipe_fds);
+    stream.read_fd = pipe_fds[0];
+    // The copies on the stream's fds are inherited by the command, the
+    // original is not needed.
+    for (int fd : stream.fds) {
+      if (dup2(pipe_fds[1], fd) < 0) {
+        DIE("dup2(%d, %d)", pipe_fds[1], fd);
+      }
+    }
+    close(pipe_fds[1]);
+  }
+  PRINT_DEBUG("writing at most %" PRId64 " bytes of %zu output streams",
+              head_limit_ + tail_limit_, streams_.size());
+}
+
+void OutputCap::Start() {
+  for (Stream &stream : streams_) {
+    for (int fd : stream.fds) {
+      if (dup2(stream.file_fd, fd) < 0) {
+        DIE("dup2(%d, %d)", stream.file_fd, fd);
+      }
+    }
+  }
+  MakePipe(stop_pipe_);
+
+  // The signals that end the command are handled by the main thread, so the
+  // reader must not take them.
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  reader_ = std::thread(&OutputCap::Reader, this);
+  pthread_sigmask(SIG_SETMASK, &old, nullptr);
+}
+
+void OutputCap::Finish() {
+  // Grandchildren that outlive the command may still hold on to the pipes,
+  // so there is no EOF to wait for: what the command wrote is in the pipes by
+  // now, the reader takes it as soon as it is told to stop.
+  char stop = 0;
+  while (write(stop_pipe_[1], &stop, 1) < 0 && errno == EINTR) {
+  }
+  reader_.join();
+  close(stop_pipe_[0]);
+  close(stop_pipe_[1]);
+
+  for (Stream &stream : streams_) {
+    close(stream.read_fd);
+    const int64_t kept = std::min(stream.total, head_limit_) +
+                         static_cast<int64_t>(stream.ring.size());
+    if (stream.total > kept) {
+      char line[160];
+      int n = snprintf(line, sizeof(line),
+                       "\nprocess-wrapper: dropped %" PRId64
+                       " bytes of output here, kept the first %" PRId64
+                       " and the last %" PRId64 "\n",
+                       stream.total - kept, head_limit_, tail_limit_);
+      WriteAll(stream.file_fd, line, n);
+    }
+    // The oldest bytes are at ring_next once the ring is full, and at its
+    // start until then, where ring_next is its size.
+    const std::string &ring = stream.ring;
+    const size_t oldest = stream.ring_next % std::max<size_t>(ring.size(), 1);
+    WriteAll(stream.file_fd, ring.data() + oldest, ring.size() - oldest);
+    WriteAll(stream.file_fd, ring.data(), oldest);
+    close(stream.file_fd);
+  }
+}
+
+void OutputCap::Reader() {
+  std::vector<Stream *> open;
+  for (Stream &stream : streams_) {
+    open.push_back(&stream);
+  }
+  std::vector<struct pollfd> fds;
+  while (!open.empty()) {
+    fds.assign(1, {stop_pipe_[0], POLLIN, 0});
+    for (Stream *stream : open) {
+      fds.push_back({stream->read_fd, POLLIN, 0});
+    }
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      DIE("poll");
+    }
+    if (fds[0].revents) {
+      break;
+    }
+    for (size_t i = open.size(); i-- > 0;) {
+      if (fds[i + 1].revents && !Read(open[i])) {
+        open.erase(open.begin() + i);
+      }
+    }
+  }
+
+  // Told to stop: take what is left without waiting for more.
+  for (Stream *stream : open) {
+    int flags = fcntl(stream->read_fd, F_GETFL);
+    if (flags < 0 ||
+        fcntl(stream->read_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+      DIE("fcntl(%d)", stream->read_fd);
+    }
+    while (Read(stream)) {
+    }
+  }
+}
+
+bool OutputCap::Read(Stream *stream) {
+  char buffer[16 << 10];
+  ssize_t n = read(stream->read_fd, buffer, sizeof(buffer));
+  if (n < 0) {
+    if (errno == EINTR) {
+      return true;
+    }
+    if (errno == EAGAIN) {
+      return false;
+    }
+    DIE("read(%d)", stream->read_fd);
+  }
+  if (n == 0) {
+    return false;
+  }
+  // The head goes to the file at once, like without a limit.
+  size_t head = 0;
+  if (stream->total < head_limit_) {
+    head = std::min(static_cast<int64_t>(n), head_limit_ - stream->total);
+    WriteAll(stream->file_fd, buffer, head);
+  }
+  stream->total += n;
+  KeepInRing(stream, buffer + head, n - head);
+  return true;
+}
+
+void OutputCap::KeepInRing(Stream *stream, const char *data, size_t size) {
+  const size_t capacity = tail_limit_;
+  if (size >= capacity) {
+    // Only the end of the data fits, and replaces all of the ring.
+    stream->ring.assign(data + size - capacity, capacity);
+    stream->ring_next = 0;
+    return;
+  }
+  std::string &ring = stream->ring;
+  if (ring.size() < capacity) {
+    // Not full yet: append, and move on to overwriting if the end is reached.
+    const size_t appended = std::min(size, capacity - ring.size());
+    ring.append(data, appended);
+    stream->ring_next = ring.size() % capacity;
+    data += appended;
+    size -= appended;
+  }
+  while (size > 0) {
+    const size_t chunk = std::min(size, capacity - stream->ring_next);
+    memcpy(&ring[stream->ring_next], data, chunk);
+    stream->ring_next = (stream->ring_next + chunk) % capacity;
+    data += chunk;
+    size -= chunk;
+  }
+}
@@ -0,0 +1,85 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * With --max_output_bytes, the command writes its stdout and stderr to pipes
+ * instead of the files (or whatever else) process-wrapper has as stdout and
+ * stderr. A thread of process-wrapper passes the first half of the limit of
+ * each stream on to its file as it comes, and keeps the last half in a ring
+ * buffer, which is written out when the command is done, after a line that
+ * says how much was dropped in between. So however much a command prints,
+ * at most about the limit of it is written to disk, and both how it started
+ * and how it ended are kept.
+ */
+
+#ifndef SRC_MAIN_TOOLS_PROCESS_WRAPPER_OUTPUT_CAP_H_
+#define SRC_MAIN_TOOLS_PROCESS_WRAPPER_OUTPUT_CAP_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+class OutputCap {
+ public:
+  // Writes at most about `limit` bytes of each stream.
+  explicit OutputCap(int64_t limit);
+
+  // Makes stdout and stderr pipes, to be inherited by the command. If both
+  // are the same file, they share a pipe so that their order is kept.
+  void Capture();
+
+  // Called once the command has been spawned: points stdout and stderr at
+  // their files again and starts reading the pipes.
+  void Start();
+
+  // Called once the command has exited: reads what is left in the pipes and
+  // writes the tails to the files.
+  void Finish();
+
+ private:
+  struct Stream {
+    // The file descriptors (STDOUT_FILENO and/or STDERR_FILENO) writing to
+    // this stream.
+    std::vector<int> fds;
+    // What fds pointed to before Capture().
+    int file_fd;
+    int read_fd;
+    // How many bytes were read overall.
+    int64_t total;
+    // The last bytes read past the head, in a ring of tail_limit_ bytes once
+    // it is needed, which is full once total exceeds the head and the tail.
+    std::string ring;
+    // Where the next byte goes in the ring, which is where the oldest one is
+    // if it is full.
+    size_t ring_next;
+  };
+
+  // Reads the pipes until Finish() writes to stop_pipe_.
+  void Reader();
+  // Reads from `stream` once. Returns false on EOF, or if a non-blocking
+  // read finds nothing.
+  bool Read(Stream *stream);
+  // Keeps `data` of `size` bytes at the end of the ring of `stream`.
+  void KeepInRing(Stream *stream, const char *data, size_t size);
+
+  const int64_t head_limit_;
+  const int64_t tail_limit_;
+  std::vector<Stream> streams_;
+  int stop_pipe_[2];
+  std::thread reader_;
+};
+
+#endif  // SRC_MAIN_TOOLS_PROCESS_WRAPPER_OUTPUT_CAP_H_
@@ -0,0 +1,300 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/tools/process-wrapper-server.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "src/main/tools/logging.h"
+#include "src/main/tools/process-tools.h"
+#include "src/main/tools/process-wrapper-legacy.h"
+#include "src/main/tools/process-wrapper-options.h"
+
+extern char **environ;
+
+// How long the server waits for a connection before it exits.
+static const int kIdleTimeoutMillis = 10 * 60 * 1000;
+
+// Requests larger than this are rejected.
+static const uint32_t kMaxRequestSize = 64 << 20;
+
+// Creates a Unix socket that is not inherited by commands. (Not all systems
+// have SOCK_CLOEXEC.)
+static int CreateSocket() {
+  const int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0) {
+    DIE("socket");
+  }
+  if (fcntl(sock, F_SETFD, FD_CLOEXEC) < 0) {
+    DIE("fcntl");
+  }
+  return sock;
+}
+
+static bool ReadAll(int fd, void *buf, size_t size) {
+  char *p = static_cast<char *>(buf);
+  while (size > 0) {
+    const ssize_t r = read(fd, p, size);
+    if (r < 0 && errno == EINTR) {
+      continue;
+    }
+    if (r <= 0) {
+      return false;
+    }
+    p += r;
+    size -= r;
+  }
+  return true;
+}
+
+static bool WriteAll(int fd, const void *buf, size_t size) {
+  const char *p = static_cast<const char *>(buf);
+  while (size > 0) {
+    const ssize_t w = write(fd, p, size);
+    if (w < 0 && errno == EINTR) {
+      continue;
+    }
+    if (w < 0) {
+      return false;
+    }
+    p += w;
+    size -= w;
+  }
+  return true;
+}
+
+// The connection of the request that this process handles.
+static int global_connection = -1;
+
+// Replies the EXIT_FAILURE that process-wrapper exits with when it fails, for
+// the exit(3) in DIE and in the usage errors.
+static void ReplyFailure() {
+  const uint32_t reply = htonl(EXIT_FAILURE);
+  WriteAll(global_connection, &reply, sizeof(reply));
+}
+
+// Runs the command of one request in this process, which the server forked
+// for the connection, and replies with its exit code.
+static void HandleConnection(int connection) {
+  // The server ignores SIGCHLD so that handlers don't linger as zombies, but
+  // we have to wait for the command.
+  signal(SIGCHLD, SIG_DFL);
+  global_connection = connection;
+  atexit(ReplyFailure);
+
+  uint32_t size;
+  if (!ReadAll(connection, &size, sizeof(size))) {
+    DIE("read");
+  }
+  size = ntohl(size);
+  if (size == 0 || size > kMaxRequestSize) {
+    DIE("invalid request size %u", size);
+  }
+  std::string request(size, '\0');
+  if (!ReadAll(connection, &request[0], size)) {
+    DIE("read");
+  }
+  if (request.back() != '\0') {
+    DIE("request does not end in NUL");
+  }
+
+  std::vector<char *> fields;
+  for (size_t i = 0; i < request.size(); i += strlen(&request[i]) + 1) {
+    fields.push_back(&request[i]);
+  }
+  size_t i = 0;
+  const char *working_dir = fields[i++];
+  std::vector<char *> env;
+  while (i < fields.size() && fields[i][0] != '\0') {
+    env.push_back(fields[i++]);
+  }
+  env.push_back(nullptr);
+  std::vector<char *> args(fields.begin() + std::min(i + 1, fields.size()),
+                           fields.end());
+  if (args.empty()) {
+    DIE("request has no arguments");
+  }
+
+  if (chdir(working_dir) < 0) {
+    DIE("chdir(%s)", working_dir);
+  }
+  environ = env.data();
+
+  // Parse the arguments of this command from scratch.
+  opt = Options();
+  optind = 1;
+  args.push_back(nullptr);
+  ParseOptions(args.size() - 1, args.data());
+  if (!opt.server_path.empty()) {
+    DIE("a server cannot start another server");
+  }
+
+  Redirect(opt.stdout_path, STDOUT_FILENO);
+  Redirect(opt.stderr_path, STDERR_FILENO);
+
+  const uint32_t reply =
+      htonl(LegacyProcessWrapper::RunCommandForClient(connection));
+  // The client may have gone away already, which we don't care about.
+  WriteAll(connection, &reply, sizeof(reply));
+}
+
+// Accepts connections until the server has been idle for a while.
+static void ServeConnections(int sock) {
+  while (true) {
+    struct pollfd pfd = {sock, POLLIN, 0};
+    const int ready = poll(&pfd, 1, kIdleTimeoutMillis);
+    if (ready < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ready < 0) {
+      DIE("poll");
+    }
+    if (ready == 0) {
+      return;
+    }
+
+    const int connection = accept(sock, nullptr, nullptr);
+    if (connection < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      DIE("accept");
+    }
+    if (fcntl(connection, F_SETFD, FD_CLOEXEC) < 0) {
+      DIE("fcntl");
+    }
+    const pid_t pid = fork();
+    if (pid < 0) {
+      DIE("fork");
+    }
+    if (pid == 0) {
+      close(sock);
+      HandleConnection(connection);
+      _exit(EXIT_SUCCESS);
+    }
+    close(connection);
+  }
+}
+
+// Binds `sock` to `path`, replacing a stale socket left by a server that has
+// exited. Returns false if another server listens on `path`.
+static bool Bind(int sock, const std::string &path) {
+  struct sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    DIE("socket path %s", path.c_str());
+  }
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+  if (bind(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) ==
+      0) {
+    return true;
+  }
+  if (errno != EADDRINUSE) {
+    DIE("bind(%s)", path.c_str());
+  }
+
+  const int probe = CreateSocket();
+  const bool in_use = connect(probe, reinterpret_cast<struct sockaddr *>(&addr),
+                              sizeof(addr)) == 0;
+  close(probe);
+  if (in_use) {
+    return false;
+  }
+
+  if (unlink(path.c_str()) < 0 && errno != ENOENT) {
+    DIE("unlink(%s)", path.c_str());
+  }
+  if (bind(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) <
+      0) {
+    DIE("bind(%s)", path.c_str());
+  }
+  return true;
+}
+
+void RunServer() {
+  const int sock = CreateSocket();
+  if (!Bind(sock, opt.server_path)) {
+    PRINT_DEBUG("another server listens on %s", opt.server_path.c_str());
+    close(sock);
+    return;
+  }
+  struct stat bound;
+  if (stat(opt.server_path.c_str(), &bound) < 0) {
+    DIE("stat(%s)", opt.server_path.c_str());
+  }
+  if (listen(sock, SOMAXCONN) < 0) {
+    DIE("listen");
+  }
+
+  // Leave the server running in the background, where it doesn't keep our
+  // caller's terminal or output files open.
+  const pid_t pid = fork();
+  if (pid < 0) {
+    DIE("fork");
+  }
+  if (pid > 0) {
+    close(sock);
+    return;
+  }
+  if (setsid() < 0) {
+    DIE("setsid");
+  }
+  if (chdir("/") < 0) {
+    DIE("chdir");
+  }
+  const int null_fd = open("/dev/null", O_RDWR);
+  if (null_fd < 0) {
+    DIE("open(/dev/null)");
+  }
+  for (int fd = STDIN_FILENO; fd <= STDERR_FILENO; fd++) {
+    if (dup2(null_fd, fd) < 0) {
+      DIE("dup2");
+    }
+  }
+  if (null_fd > STDERR_FILENO) {
+    close(null_fd);
+  }
+  signal(SIGCHLD, SIG_IGN);
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGHUP, SIG_IGN);
+
+  ServeConnections(sock);
+
+  // Remove the socket unless a newer server has replaced it already.
+  struct stat current;
+  if (stat(opt.server_path.c_str(), &current) == 0 &&
+      current.st_dev == bound.st_dev && current.st_ino == bound.st_ino) {
+    unlink(opt.server_path.c_str());
+  }
+  _exit(EXIT_SUCCESS);
+}
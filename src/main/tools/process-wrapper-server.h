@@ -0,0 +1,36 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The process-wrapper server (--server) saves its clients from starting a
+// process-wrapper for every command, which is costly for a client with a
+// large address space like the Bazel server. The server listens on a Unix
+// socket and forks a small copy of itself for each connection, which runs
+// the command like process-wrapper would and reports how it exited.
+//
+// A request is a 4-byte big-endian size followed by that many bytes of
+// NUL-terminated strings: the working directory, the environment as
+// NAME=value entries, an empty string, and then the arguments of
+// process-wrapper from argv[0] on, which include the command. The reply is
+// the exit code that process-wrapper would have exited with, again as 4 bytes
+// in big-endian order. Closing the connection before that kills the command.
+
+#ifndef SRC_MAIN_TOOLS_PROCESS_WRAPPER_SERVER_H_
+#define SRC_MAIN_TOOLS_PROCESS_WRAPPER_SERVER_H_
+
+// Starts listening on `opt.server_path`, and returns once clients can connect
+// to the server, which keeps running in the background until it has been idle
+// for a while. Exits right away if another server listens on the socket.
+void RunServer();
+
+#endif  // SRC_MAIN_TOOLS_PROCESS_WRAPPER_SERVER_H_
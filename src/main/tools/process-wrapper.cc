@@ -27,6 +27,7 @@
 #include <err.h>
 #include <errno.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -42,6 +43,7 @@
 #include "src/main/tools/process-tools.h"
 #include "src/main/tools/process-wrapper-legacy.h"
 #include "src/main/tools/process-wrapper-options.h"
+#include "src/main/tools/process-wrapper-server.h"
 
 int main(int argc, char *argv[]) {
   ParseOptions(argc, argv);
@@ -49,6 +51,17 @@ int main(int argc, char *argv[]) {
   SwitchToEuid();
   SwitchToEgid();
 
+  // Whatever our parent left open is not for the commands we run. Where
+  // posix_spawn can close it all by itself, there is no need to look for it.
+#if !defined(POSIX_SPAWN_SETSID) || !defined(POSIX_SPAWN_CLOEXEC_DEFAULT)
+  CloseFdsFrom(STDERR_FILENO + 1, -1, true);
+#endif
+
+  if (!opt.server_path.empty()) {
+    RunServer();
+    return 0;
+  }
+
   Redirect(opt.stdout_path, STDOUT_FILENO);
   Redirect(opt.stderr_path, STDERR_FILENO);
 
@@ -97,6 +97,10 @@ TEST_F(BazelStartupOptionsTest, ValidStartupFlags) {
   ExpectValidNullaryOption(options, "batch_cpu_scheduling");
   ExpectValidNullaryOption(options, "block_for_lock");
   ExpectValidNullaryOption(options, "client_debug");
+  ExpectValidNullaryOption(options, "experimental_per_command_scheduling");
+  ExpectValidNullaryOption(options, "experimental_server_class_data_sharing");
+  ExpectValidNullaryOption(options, "experimental_auto_size_server_jvm");
+  ExpectValidNullaryOption(options, "experimental_unix_domain_socket");
   ExpectValidNullaryOption(options, "fatal_event_bus_exceptions");
   ExpectValidNullaryOption(options, "home_rc");
   ExpectValidNullaryOption(options, "host_jvm_debug");
@@ -111,6 +115,12 @@ TEST_F(BazelStartupOptionsTest, ValidStartupFlags) {
   ExpectIsUnaryOption(options, "command_port");
   ExpectIsUnaryOption(options, "connect_timeout_secs");
   ExpectIsUnaryOption(options, "digest_function");
+  ExpectIsUnaryOption(options, "experimental_cgroup_memory_high");
+  ExpectIsUnaryOption(options, "experimental_cgroup_memory_max");
+  ExpectIsUnaryOption(options, "experimental_cgroup_parent");
+  ExpectIsUnaryOption(options, "experimental_output_base_max_age_days");
+  ExpectIsUnaryOption(options, "experimental_scoped_server_pid");
+  ExpectIsUnaryOption(options, "experimental_server_numa_node");
   ExpectIsUnaryOption(options, "host_jvm_args");
   ExpectIsUnaryOption(options, "install_base");
   ExpectIsUnaryOption(options, "invocation_policy");
@@ -24,9 +24,13 @@
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <memory>
+#include <string>
 
 #include "src/main/cpp/blaze_util.h"
 #include "src/main/cpp/blaze_util_platform.h"
+#include "src/main/cpp/util/file.h"
+#include "src/main/cpp/util/path.h"
 #include "googletest/include/gtest/gtest.h"
 
 namespace blaze {
@@ -209,4 +213,97 @@ TEST_F(UnlimitResourcesTest, Coredumps) {
   }
 }
 
+TEST(PosixDumperTest, WritesAllFiles) {
+  const std::string dir =
+      blaze_util::JoinPath(getenv("TEST_TMPDIR"), "dumper_all_files");
+  std::string error;
+  std::unique_ptr<embedded_binaries::Dumper> dumper(
+      embedded_binaries::Create(&error));
+  ASSERT_NE(nullptr, dumper) << error;
+  // More files than the dumper queues, in a few nested directories.
+  const int kFiles = 1000;
+  auto path = [&dir](int i) {
+    return blaze_util::JoinPath(dir, "d" + std::to_string(i % 7) + "/s" +
+                                         std::to_string(i % 3) + "/f" +
+                                         std::to_string(i));
+  };
+  for (int i = 0; i < kFiles; ++i) {
+    std::string content = "content " + std::to_string(i);
+    dumper->Dump(content.data(), content.size(), path(i));
+  }
+  ASSERT_TRUE(dumper->Finish(&error)) << error;
+
+  for (int i = 0; i < kFiles; ++i) {
+    std::string content;
+    ASSERT_TRUE(blaze_util::ReadFile(path(i), &content)) << path(i);
+    EXPECT_EQ("content " + std::to_string(i), content);
+  }
+}
+
+TEST(PosixDumperTest, ReportsErrors) {
+  const std::string dir =
+      blaze_util::JoinPath(getenv("TEST_TMPDIR"), "dumper_errors");
+  ASSERT_TRUE(blaze_util::MakeDirectories(dir, 0755));
+  // A file where a directory is expected.
+  const std::string file = blaze_util::JoinPath(dir, "file");
+  ASSERT_TRUE(blaze_util::WriteFile("x", 1, file));
+
+  std::string error;
+  std::unique_ptr<embedded_binaries::Dumper> dumper(
+      embedded_binaries::Create(&error));
+  ASSERT_NE(nullptr, dumper) << error;
+  dumper->Dump("y", 1, blaze_util::JoinPath(dir, "ok"));
+  dumper->Dump("y", 1, blaze_util::JoinPath(file, "child"));
+  EXPECT_FALSE(dumper->Finish(&error));
+  EXPECT_NE(std::string::npos, error.find("child")) << error;
+}
+
+// Starts a client that waits for the lock of `output_base`, appends `name` to
+// `log` once it has it, and exits a moment later. `held` is the lock of the
+// test itself, which the client must not share.
+static pid_t StartLockingClient(const blaze_util::Path& output_base,
+                                const std::string& log, const char* name,
+                                BlazeLock* held) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    ReleaseLock(held);
+    BlazeLock lock;
+    uint64_t wait_ms = AcquireLock(output_base, false, true, &lock);
+    FILE* f = fopen(log.c_str(), "a");
+    fprintf(f, "%s%s", name, wait_ms > 0 ? "" : "(no wait)");
+    fclose(f);
+    usleep(50 * 1000);
+    _exit(EXIT_SUCCESS);
+  }
+  return pid;
+}
+
+TEST(AcquireLockTest, WaitingClientsGetTheLockInOrder) {
+  const blaze_util::Path output_base(
+      blaze_util::JoinPath(getenv("TEST_TMPDIR"), "lock_order"));
+  ASSERT_TRUE(blaze_util::MakeDirectories(output_base, 0755));
+  const std::string log = output_base.GetRelative("log").AsNativePath();
+
+  BlazeLock lock;
+  ASSERT_EQ(0, AcquireLock(output_base, false, true, &lock));
+  pid_t pids[3];
+  const char* names[3] = {"a", "b", "c"};
+  for (int i = 0; i < 3; ++i) {
+    pids[i] = StartLockingClient(output_base, log, names[i], &lock);
+    ASSERT_NE(-1, pids[i]);
+    // Give it time to queue up.
+    usleep(300 * 1000);
+  }
+  ReleaseLock(&lock);
+  for (pid_t pid : pids) {
+    int status;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    EXPECT_TRUE(WIFEXITED(status));
+  }
+
+  std::string order;
+  ASSERT_TRUE(blaze_util::ReadFile(log, &order));
+  EXPECT_EQ("abc", order);
+}
+
 }  // namespace blaze
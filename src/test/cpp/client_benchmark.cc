@@ -0,0 +1,355 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// client_benchmark.cc -- measures what the client does on every invocation
+// before it talks to the server.
+//
+//   client_benchmark [--repeat N] [--work_dir DIR] [--rc_depth N]
+//       [--rc_lines N] [--archive_entries N] [--archive PATH]
+//
+// Reports the best of N runs of:
+//  - rc: OptionProcessor::ParseOptions with a workspace .bazelrc that starts a
+//    chain of --rc_depth files that import each other, of --rc_lines lines
+//    each, with the rc file cache cold and warm;
+//  - startup: StartupOptions::ProcessArgs on the startup lines of those files;
+//  - archive: DetermineArchiveContents on the Bazel binary given by --archive,
+//    or on a synthetic one with --archive_entries files next to a 32 MB
+//    server jar, about the size of Bazel's;
+//  - install base: ExtractData checking the install base extracted from it.
+//
+// Everything is written to DIR (default: a new directory in $TMPDIR or /tmp),
+// which is also the output root.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "src/main/cpp/archive_utils.h"
+#include "src/main/cpp/bazel_startup_options.h"
+#include "src/main/cpp/blaze_util_platform.h"
+#include "src/main/cpp/option_processor.h"
+#include "src/main/cpp/startup_options.h"
+#include "src/main/cpp/util/file.h"
+#include "src/main/cpp/util/file_platform.h"
+#include "src/main/cpp/util/path.h"
+#include "src/main/cpp/util/path_platform.h"
+#include "src/main/cpp/workspace_layout.h"
+#include "third_party/ijar/zip.h"
+
+namespace blaze {
+
+static double Now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+struct Timing {
+  double seconds = 0;
+
+  void Update(double start, int run) {
+    double elapsed = Now() - start;
+    if (run == 0 || elapsed < seconds) {
+      seconds = elapsed;
+    }
+  }
+};
+
+static void Report(const char *what, double seconds, size_t items,
+                   const char *unit) {
+  fprintf(stdout, "  %-22s %9.3f ms %12.0f %s/s\n", what, seconds * 1e3,
+          items / seconds, unit);
+}
+
+static void WriteFileOrDie(const std::string &path,
+                           const std::string &content) {
+  if (!blaze_util::WriteFile(content, path)) {
+    fprintf(stderr, "Cannot write %s\n", path.c_str());
+    exit(1);
+  }
+  // The rc file cache does not keep files modified in the last few seconds.
+  struct timeval times[2];
+  gettimeofday(&times[0], nullptr);
+  times[0].tv_sec -= 3600;
+  times[1] = times[0];
+  utimes(path.c_str(), times);
+}
+
+// Writes `depth` rc files, each importing the next, and returns the startup
+// flags in them.
+static std::vector<std::string> WriteRcFiles(const std::string &workspace,
+                                             int depth, int lines) {
+  std::vector<std::string> startup_flags;
+  blaze_util::MakeDirectories(blaze_util::JoinPath(workspace, "rc"), 0755);
+  for (int i = 0; i < depth; ++i) {
+    std::string content = "# Generated by client_benchmark.\n";
+    for (int line = 0; line < lines; ++line) {
+      const std::string n = std::to_string(i * lines + line);
+      switch (line % 8) {
+        case 0:
+          startup_flags.push_back("--host_jvm_args=-Dbenchmark." + n + "=1");
+          content += "startup " + startup_flags.back() + "\n";
+          break;
+        case 1:
+          content += "# A comment about the flags below, " + n + ".\n";
+          break;
+        case 2:
+          content += "common --experimental_benchmark_" + n + "\n";
+          break;
+        case 3:
+          content += "build:config" + std::to_string(line % 5) +
+                     " --define=key" + n + "=value" + n + "\n";
+          break;
+        case 4:
+          content += "test --test_env=BENCHMARK_" + n + " \\\n    --test_arg=" +
+                     n + "\n";
+          break;
+        default:
+          content += "build --copt=-DBENCHMARK_" + n + " --linkopt=-l" + n +
+                     "\n";
+          break;
+      }
+    }
+    if (i + 1 < depth) {
+      content +=
+          "import %workspace%/rc/" + std::to_string(i + 1) + ".bazelrc\n";
+    }
+    WriteFileOrDie(i == 0 ? blaze_util::JoinPath(workspace, ".bazelrc")
+                          : blaze_util::JoinPath(
+                                workspace, "rc/" + std::to_string(i) +
+                                               ".bazelrc"),
+                   content);
+  }
+  return startup_flags;
+}
+
+static void BenchmarkRc(const std::string &work_dir, int repeat, int depth,
+                        int lines) {
+  const std::string workspace = blaze_util::JoinPath(work_dir, "workspace");
+  blaze_util::MakeDirectories(workspace, 0755);
+  blaze_util::WriteFile("", blaze_util::JoinPath(workspace, "MODULE.bazel"));
+  const std::vector<std::string> startup_flags =
+      WriteRcFiles(workspace, depth, lines);
+  const std::vector<std::string> args = {
+      "bazel",        "--nosystem_rc", "--nohome_rc", "build",
+      "--config=config1", "//foo:bar"};
+  WorkspaceLayout workspace_layout;
+  const std::string rc_cache = blaze_util::JoinPath(
+      BazelStartupOptions(&workspace_layout).output_user_root, "rc_cache");
+
+  Timing cold;
+  Timing warm;
+  size_t command_args = 0;
+  for (int run = 0; run < repeat; ++run) {
+    for (bool cached : {false, true}) {
+      OptionProcessor option_processor(
+          &workspace_layout, std::unique_ptr<StartupOptions>(
+                                 new BazelStartupOptions(&workspace_layout)));
+      if (!cached) {
+        blaze_util::RemoveRecursively(rc_cache);
+      }
+      std::string error;
+      double start = Now();
+      if (option_processor.ParseOptions(args, workspace, workspace, &error) !=
+          blaze_exit_code::SUCCESS) {
+        fprintf(stderr, "ParseOptions failed: %s\n", error.c_str());
+        exit(1);
+      }
+      (cached ? warm : cold).Update(start, run);
+      command_args = option_processor.GetCommandArguments().size();
+    }
+  }
+
+  // The startup flags of the rc files on their own.
+  std::vector<RcStartupFlag> rc_startup_flags;
+  for (const std::string &flag : startup_flags) {
+    rc_startup_flags.emplace_back("benchmark.bazelrc", flag);
+  }
+  Timing startup;
+  for (int run = 0; run < repeat; ++run) {
+    BazelStartupOptions startup_options(&workspace_layout);
+    std::string error;
+    double start = Now();
+    if (startup_options.ProcessArgs(rc_startup_flags, &error) !=
+        blaze_exit_code::SUCCESS) {
+      fprintf(stderr, "ProcessArgs failed: %s\n", error.c_str());
+      exit(1);
+    }
+    startup.Update(start, run);
+  }
+
+  fprintf(stdout, "rc: %d files of %d lines, %zu command arguments\n", depth,
+          lines, command_args);
+  Report("ParseOptions cold", cold.seconds, depth, "files");
+  Report("ParseOptions warm", warm.seconds, depth, "files");
+  Report("ProcessArgs", startup.seconds, startup_flags.size(), "flags");
+}
+
+// Writes an archive laid out like the one appended to the Bazel binary, with
+// install_base_key last.
+static void WriteArchive(const std::string &path, int entries) {
+  const size_t kServerJarSize = 32 << 20;
+  const size_t kFileSize = 4096;
+  std::unique_ptr<devtools_ijar::ZipBuilder> zip(
+      devtools_ijar::ZipBuilder::Create(
+          path.c_str(),
+          kServerJarSize + (kFileSize + 256) * (entries + 2) + (1 << 20)));
+  if (zip == nullptr) {
+    fprintf(stderr, "Cannot create %s\n", path.c_str());
+    exit(1);
+  }
+  uint32_t state = 2463534242U;
+  auto add = [&](const std::string &name, const std::string &content,
+                 size_t size) {
+    devtools_ijar::u1 *p = zip->NewFile(name.c_str(), 0);
+    if (content.empty()) {
+      // Incompressible, like most of what is in there.
+      for (size_t i = 0; i < size; ++i) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        p[i] = static_cast<devtools_ijar::u1>(state);
+      }
+    } else {
+      memcpy(p, content.data(), size = content.size());
+    }
+    if (zip->FinishFile(size, /* compress: */ false,
+                        /* compute_crc: */ true) < 0) {
+      fprintf(stderr, "%s\n", zip->GetError());
+      exit(1);
+    }
+  };
+  add("A-server.jar", "", kServerJarSize);
+  for (int i = 0; i < entries; ++i) {
+    add("embedded_tools/tools/dir" + std::to_string(i % 97) + "/file" +
+            std::to_string(i),
+        "", kFileSize);
+  }
+  add("build-label.txt", "benchmark", 0);
+  add("install_base_key", "0123456789abcdef0123456789abcdef", 0);
+  if (zip->Finish() < 0) {
+    fprintf(stderr, "%s\n", zip->GetError());
+    exit(1);
+  }
+}
+
+static void BenchmarkArchive(const std::string &work_dir, int repeat,
+                             std::string archive, int entries) {
+  if (archive.empty()) {
+    archive = blaze_util::JoinPath(work_dir, "bazel.zip");
+    WriteArchive(archive, entries);
+  }
+
+  Timing contents;
+  std::vector<std::string> archive_contents;
+  std::string install_md5;
+  for (int run = 0; run < repeat; ++run) {
+    double start = Now();
+    DetermineArchiveContents(archive, &archive_contents, &install_md5);
+    contents.Update(start, run);
+  }
+
+  WorkspaceLayout workspace_layout;
+  BazelStartupOptions startup_options(&workspace_layout);
+  startup_options.install_base =
+      blaze_util::JoinPath(work_dir, "install/" + install_md5);
+  LoggingInfo logging_info(archive, 0);
+  double start = Now();
+  ExtractData(archive, archive_contents, install_md5, startup_options,
+              &logging_info);
+  double extract = Now() - start;
+
+  Timing check;
+  for (int run = 0; run < repeat; ++run) {
+    start = Now();
+    ExtractData(archive, archive_contents, install_md5, startup_options,
+                &logging_info);
+    check.Update(start, run);
+  }
+
+  fprintf(stdout, "archive: %s, %zu files\n", archive.c_str(),
+          archive_contents.size());
+  Report("DetermineArchiveContents", contents.seconds,
+         archive_contents.size(), "files");
+  Report("ExtractData extract", extract, archive_contents.size(), "files");
+  Report("ExtractData check", check.seconds, archive_contents.size(),
+         "files");
+}
+
+}  // namespace blaze
+
+static void usage() {
+  fprintf(stderr,
+          "Usage: client_benchmark [--repeat N] [--work_dir DIR] "
+          "[--rc_depth N]\n"
+          "    [--rc_lines N] [--archive_entries N] [--archive PATH]\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  int repeat = 10;
+  int rc_depth = 8;
+  int rc_lines = 200;
+  int archive_entries = 3000;
+  std::string archive;
+  std::string work_dir;
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      usage();
+    } else if (strcmp(argv[i], "--repeat") == 0) {
+      repeat = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--work_dir") == 0) {
+      work_dir = argv[++i];
+    } else if (strcmp(argv[i], "--rc_depth") == 0) {
+      rc_depth = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--rc_lines") == 0) {
+      rc_lines = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--archive_entries") == 0) {
+      archive_entries = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--archive") == 0) {
+      archive = argv[++i];
+    } else {
+      usage();
+    }
+  }
+  if (repeat < 1 || rc_depth < 1 || rc_lines < 1 || archive_entries < 0) {
+    usage();
+  }
+  bool remove_work_dir = false;
+  if (work_dir.empty()) {
+    const char *tmpdir = getenv("TMPDIR");
+    work_dir = blaze_util::CreateTempDir(
+        std::string(tmpdir != nullptr && *tmpdir ? tmpdir : "/tmp") +
+        "/client_benchmark.");
+    remove_work_dir = true;
+  }
+  work_dir = blaze_util::MakeAbsolute(work_dir);
+  // Keep the rc file cache and the install base away from the real ones.
+  blaze::SetEnv("XDG_CACHE_HOME", blaze_util::JoinPath(work_dir, "cache"));
+  blaze::UnsetEnv("TEST_TMPDIR");
+
+  blaze::BenchmarkRc(work_dir, repeat, rc_depth, rc_lines);
+  blaze::BenchmarkArchive(work_dir, repeat, archive, archive_entries);
+  if (remove_work_dir) {
+    blaze_util::RemoveRecursively(work_dir);
+  }
+  return 0;
+}
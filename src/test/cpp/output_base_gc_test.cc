@@ -0,0 +1,60 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/cpp/output_base_gc.h"
+
+#include <string>
+#include <vector>
+
+#include "src/main/cpp/blaze_util_platform.h"
+#include "src/main/cpp/util/file.h"
+#include "src/main/cpp/util/file_platform.h"
+#include "src/main/cpp/util/path.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace blaze {
+
+using std::string;
+
+TEST(OutputBaseGcTest, MovesAsideOnlyUnusedOutputBases) {
+  const string root =
+      blaze_util::JoinPath(blaze::GetPathEnv("TEST_TMPDIR"), "user_root");
+  const string own = blaze_util::JoinPath(root, "own");
+  const string old = blaze_util::JoinPath(root, "old");
+  const string install = blaze_util::JoinPath(root, "install");
+  for (const string &dir : {own, old, install}) {
+    ASSERT_TRUE(blaze_util::MakeDirectories(dir, 0755));
+  }
+  for (const string &dir : {own, old}) {
+    ASSERT_TRUE(
+        blaze_util::WriteFile("", blaze_util::JoinPath(dir, "lock")));
+  }
+
+  // Nothing is older than a day.
+  EXPECT_TRUE(
+      MoveAsideUnusedOutputBases(root, blaze_util::Path(own), 86400000)
+          .empty());
+
+  // Every output base with a lock file is old enough now, but ours is kept.
+  const std::vector<string> moved =
+      MoveAsideUnusedOutputBases(root, blaze_util::Path(own), 0);
+  ASSERT_EQ(1u, moved.size());
+  EXPECT_EQ(old + ".deleted", moved[0]);
+  EXPECT_TRUE(blaze_util::IsDirectory(moved[0]));
+  EXPECT_FALSE(blaze_util::PathExists(old));
+  EXPECT_TRUE(blaze_util::IsDirectory(own));
+  EXPECT_TRUE(blaze_util::IsDirectory(install));
+}
+
+}  // namespace blaze
@@ -0,0 +1,119 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/cpp/output_forwarder.h"
+
+#include <signal.h>
+#include <string>
+
+#include "src/main/cpp/blaze_util_platform.h"
+#include "src/main/cpp/util/file.h"
+#include "src/main/cpp/util/path.h"
+#include "googletest/include/gtest/gtest.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace blaze {
+
+using std::string;
+
+// Points stdout and stderr at files for the lifetime of the object.
+class RedirectedStdOutErr {
+ public:
+  RedirectedStdOutErr(const string &out, const string &err)
+      : saved_stdout_(dup(STDOUT_FILENO)), saved_stderr_(dup(STDERR_FILENO)) {
+    fflush(stdout);
+    Redirect(out, STDOUT_FILENO);
+    Redirect(err, STDERR_FILENO);
+  }
+
+  ~RedirectedStdOutErr() {
+    fflush(stdout);
+    dup2(saved_stdout_, STDOUT_FILENO);
+    dup2(saved_stderr_, STDERR_FILENO);
+    close(saved_stdout_);
+    close(saved_stderr_);
+  }
+
+ private:
+  static void Redirect(const string &path, int target) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    dup2(fd, target);
+    close(fd);
+  }
+
+  const int saved_stdout_;
+  const int saved_stderr_;
+};
+
+TEST(OutputForwarderTest, WritesChunksInOrder) {
+  const string tmpdir = blaze::GetPathEnv("TEST_TMPDIR");
+  const string out = blaze_util::JoinPath(tmpdir, "forwarded_stdout");
+  const string err = blaze_util::JoinPath(tmpdir, "forwarded_stderr");
+  string expected_out, expected_err;
+  {
+    RedirectedStdOutErr redirected(out, err);
+    // A tiny buffer makes Write() wait for the writing thread.
+    OutputForwarder forwarder(16);
+    for (int i = 0; i < 2000; ++i) {
+      string chunk =
+          std::to_string(i) + (i % 7 == 0 ? string(100000, 'x') : "");
+      const bool to_stdout = i % 3 != 0;
+      (to_stdout ? expected_out : expected_err) += chunk;
+      forwarder.Write(to_stdout, &chunk);
+      ASSERT_TRUE(chunk.empty());
+    }
+    forwarder.Flush();
+    EXPECT_EQ(nullptr, forwarder.BrokenPipeName());
+  }
+  string actual;
+  ASSERT_TRUE(blaze_util::ReadFile(out, &actual));
+  EXPECT_EQ(expected_out, actual);
+  ASSERT_TRUE(blaze_util::ReadFile(err, &actual));
+  EXPECT_EQ(expected_err, actual);
+}
+
+TEST(OutputForwarderTest, ReportsBrokenPipe) {
+  signal(SIGPIPE, SIG_IGN);
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  close(fds[0]);
+  fflush(stdout);
+  const int saved_stdout = dup(STDOUT_FILENO);
+  dup2(fds[1], STDOUT_FILENO);
+  close(fds[1]);
+  const char *broken_pipe_name;
+  {
+    OutputForwarder forwarder(1024);
+    string chunk = "dropped";
+    forwarder.Write(/* to_stdout */ true, &chunk);
+    forwarder.Flush();
+    broken_pipe_name = forwarder.BrokenPipeName();
+    // Later output is dropped rather than blocking.
+    chunk = string(4096, 'y');
+    forwarder.Write(/* to_stdout */ true, &chunk);
+    chunk = string(4096, 'y');
+    forwarder.Write(/* to_stdout */ true, &chunk);
+  }
+  clearerr(stdout);
+  dup2(saved_stdout, STDOUT_FILENO);
+  close(saved_stdout);
+  EXPECT_STREQ("standard output", broken_pipe_name);
+}
+
+}  // namespace blaze
+
+#endif  // !defined(_WIN32)
@@ -17,6 +17,8 @@
 #define WIN32_LEAN_AND_MEAN
 #endif
 #include <windows.h>
+#else
+#include <utime.h>
 #endif
 
 #include "src/main/cpp/rc_file.h"
@@ -28,6 +30,7 @@
 #include "src/main/cpp/blaze_util_platform.h"
 #include "src/main/cpp/option_processor-internal.h"
 #include "src/main/cpp/option_processor.h"
+#include "src/main/cpp/rc_file_cache.h"
 #include "src/main/cpp/util/file.h"
 #include "src/main/cpp/util/file_platform.h"
 #include "src/main/cpp/util/path.h"
@@ -950,4 +953,128 @@ TEST_F(ParseOptionsTest, ImportingStandardRcBeforeItIsLoadedCausesAWarning) {
 }
 #endif  // !defined(_WIN32) && !defined(__CYGWIN__)
 
+TEST_F(RcFileTest, SerializeRoundTrips) {
+  const std::string imported = blaze_util::JoinPath(workspace_, "imported");
+  ASSERT_TRUE(blaze_util::WriteFile("build --copt=-O2 # comment\n"
+                                    "startup --max_idle_secs=1",
+                                    imported, 0755));
+  std::string workspace_rc;
+  ASSERT_TRUE(SetUpWorkspaceRcFile(
+      "build --jobs 4\nimport " + imported + "\n" +
+          "try-import " + blaze_util::JoinPath(workspace_, "missing") + "\n" +
+          "common --config=\"a b\"",
+      &workspace_rc));
+
+  RcFile::ParseError error;
+  std::string error_text;
+  std::unique_ptr<RcFile> rc = RcFile::Parse(
+      workspace_rc, workspace_layout_.get(), workspace_, &error, &error_text);
+  ASSERT_NE(rc, nullptr) << error_text;
+  EXPECT_EQ(rc->read_paths().size(), 3);
+
+  std::unique_ptr<RcFile> copy = RcFile::Deserialize(rc->Serialize());
+  ASSERT_NE(copy, nullptr);
+  EXPECT_EQ(copy->canonical_source_paths(), rc->canonical_source_paths());
+  EXPECT_EQ(copy->read_paths(), rc->read_paths());
+  ASSERT_EQ(copy->options().size(), rc->options().size());
+  for (const auto& [command, options] : rc->options()) {
+    const auto it = copy->options().find(command);
+    ASSERT_NE(it, copy->options().end()) << command;
+    ASSERT_EQ(it->second.size(), options.size()) << command;
+    for (size_t i = 0; i < options.size(); ++i) {
+      EXPECT_EQ(it->second[i].option, options[i].option);
+      EXPECT_EQ(it->second[i].source_index, options[i].source_index);
+    }
+  }
+
+  const std::string serialized = rc->Serialize();
+  EXPECT_EQ(RcFile::Deserialize(serialized.substr(0, serialized.size() - 1)),
+            nullptr);
+  EXPECT_EQ(RcFile::Deserialize(serialized + "x"), nullptr);
+}
+
+#if !defined(_WIN32)
+class RcFileCacheTest : public RcFileTest {
+ protected:
+  RcFileCacheTest()
+      : cache_(blaze_util::JoinPath(blaze::GetPathEnv("TEST_TMPDIR"),
+                                    "rc_cache")),
+        imported_(blaze_util::JoinPath(workspace_, "imported")),
+        missing_(blaze_util::JoinPath(workspace_, "missing")) {}
+
+  // The cache ignores files changed in the last seconds, so pretend the files
+  // are older.
+  static void MakeOld(const std::string& path) {
+    struct utimbuf times;
+    times.actime = times.modtime = time(nullptr) - 3600;
+    ASSERT_EQ(utime(path.c_str(), &times), 0) << path;
+  }
+
+  void SetUpFiles() {
+    ASSERT_TRUE(blaze_util::WriteFile("build --copt=-O2", imported_, 0755));
+    ASSERT_TRUE(SetUpWorkspaceRcFile("import " + imported_ + "\n" +
+                                         "try-import " + missing_ + "\n",
+                                     &workspace_rc_));
+    MakeOld(imported_);
+    MakeOld(workspace_rc_);
+  }
+
+  std::unique_ptr<RcFile> Parse() {
+    RcFile::ParseError error;
+    std::string error_text;
+    std::unique_ptr<RcFile> rc = RcFile::Parse(
+        workspace_rc_, workspace_layout_.get(), workspace_, &error,
+        &error_text);
+    EXPECT_NE(rc, nullptr) << error_text;
+    return rc;
+  }
+
+  const RcFileCache cache_;
+  const std::string imported_;
+  const std::string missing_;
+  std::string workspace_rc_;
+};
+
+TEST_F(RcFileCacheTest, ReturnsStoredParse) {
+  SetUpFiles();
+  cache_.Store(workspace_rc_, workspace_, *Parse());
+
+  std::unique_ptr<RcFile> cached = cache_.Lookup(workspace_rc_, workspace_);
+  ASSERT_NE(cached, nullptr);
+  EXPECT_EQ(cached->canonical_source_paths(),
+            Parse()->canonical_source_paths());
+  ASSERT_EQ(cached->options().count("build"), 1);
+  EXPECT_EQ(cached->options().at("build")[0].option, "--copt=-O2");
+
+  // The entry is specific to the workspace.
+  EXPECT_EQ(cache_.Lookup(workspace_rc_, cwd_), nullptr);
+}
+
+TEST_F(RcFileCacheTest, MissesWhenAnImportChanges) {
+  SetUpFiles();
+  cache_.Store(workspace_rc_, workspace_, *Parse());
+  ASSERT_NE(cache_.Lookup(workspace_rc_, workspace_), nullptr);
+
+  ASSERT_TRUE(blaze_util::WriteFile("build --copt=-O3 -g", imported_, 0755));
+  MakeOld(imported_);
+  EXPECT_EQ(cache_.Lookup(workspace_rc_, workspace_), nullptr);
+}
+
+TEST_F(RcFileCacheTest, MissesWhenAMissingTryImportAppears) {
+  SetUpFiles();
+  cache_.Store(workspace_rc_, workspace_, *Parse());
+  ASSERT_NE(cache_.Lookup(workspace_rc_, workspace_), nullptr);
+
+  ASSERT_TRUE(blaze_util::WriteFile("build --copt=-O3", missing_, 0755));
+  EXPECT_EQ(cache_.Lookup(workspace_rc_, workspace_), nullptr);
+}
+
+TEST_F(RcFileCacheTest, DoesNotStoreRecentlyModifiedFiles) {
+  SetUpFiles();
+  ASSERT_TRUE(blaze_util::WriteFile("build --copt=-O3", imported_, 0755));
+  cache_.Store(workspace_rc_, workspace_, *Parse());
+  EXPECT_EQ(cache_.Lookup(workspace_rc_, workspace_), nullptr);
+}
+#endif  // !defined(_WIN32)
+
 }  // namespace blaze
@@ -0,0 +1,89 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/cpp/server_jvm_sizing.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace blaze {
+
+using std::string;
+using std::vector;
+
+static const uint64_t kGiB = 1024 * 1024 * 1024;
+
+static UsableResources Resources(uint64_t memory_gib, double cpus,
+                                 int numa_nodes = 1) {
+  UsableResources result;
+  result.memory_bytes = memory_gib * kGiB;
+  result.cpus = cpus;
+  result.numa_nodes = numa_nodes;
+  return result;
+}
+
+TEST(ServerJvmSizingTest, Laptop) {
+  EXPECT_EQ(GetServerJvmSizingArgs(Resources(8, 4), true, {}),
+            vector<string>({"-Xmx4096m", "-XX:+UseG1GC",
+                            "-XX:ActiveProcessorCount=4",
+                            "-XX:ParallelGCThreads=4",
+                            "-XX:ConcGCThreads=1"}));
+}
+
+TEST(ServerJvmSizingTest, Workstation) {
+  EXPECT_EQ(GetServerJvmSizingArgs(Resources(128, 32, 2), true, {}),
+            vector<string>({"-Xmx36864m", "-XX:+UseZGC",
+                            "-XX:+ZGenerational",
+                            "-XX:ActiveProcessorCount=32",
+                            "-XX:ParallelGCThreads=23",
+                            "-XX:ConcGCThreads=8", "-XX:+UseNUMA"}));
+}
+
+TEST(ServerJvmSizingTest, G1KeepsCompressedOops) {
+  EXPECT_EQ(GetServerJvmSizingArgs(Resources(128, 32), false, {})[0],
+            "-Xmx31744m");
+}
+
+TEST(ServerJvmSizingTest, CpuQuotaIsRoundedUp) {
+  EXPECT_EQ(GetServerJvmSizingArgs(Resources(16, 2.5), true, {}),
+            vector<string>({"-Xmx8192m", "-XX:+UseG1GC",
+                            "-XX:ActiveProcessorCount=3",
+                            "-XX:ParallelGCThreads=3",
+                            "-XX:ConcGCThreads=1"}));
+}
+
+TEST(ServerJvmSizingTest, UserFlagsWin) {
+  EXPECT_EQ(GetServerJvmSizingArgs(Resources(128, 32, 2), true,
+                                   {"-Xmx10g", "-XX:+UseParallelGC",
+                                    "-XX:ActiveProcessorCount=4",
+                                    "-XX:-UseNUMA"}),
+            vector<string>({"-XX:ParallelGCThreads=23"}));
+}
+
+TEST(ServerJvmSizingTest, UnknownResources) {
+  EXPECT_EQ(GetServerJvmSizingArgs(UsableResources(), true, {}),
+            vector<string>({"-XX:+UseG1GC"}));
+}
+
+TEST(ServerJvmSizingTest, Describe) {
+  EXPECT_EQ(DescribeUsableResources(Resources(16, 7.5)),
+            "16384 MiB, 7.5 cpus, 1 NUMA node");
+  EXPECT_EQ(DescribeUsableResources(Resources(64, 32, 2)),
+            "65536 MiB, 32 cpus, 2 NUMA nodes");
+}
+
+}  // namespace blaze
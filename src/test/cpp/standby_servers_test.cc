@@ -0,0 +1,71 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/cpp/standby_servers.h"
+
+#include <string>
+#include <vector>
+
+#include "src/main/cpp/blaze_util_platform.h"
+#include "src/main/cpp/startup_options.h"
+#include "src/main/cpp/util/file.h"
+#include "src/main/cpp/util/file_platform.h"
+#include "src/main/cpp/util/path.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace blaze {
+
+using std::string;
+
+TEST(StandbyServersTest, KeyLeavesOutClientOnlyOptions) {
+  const std::vector<RcStartupFlag> flags = {
+      RcStartupFlag("", "--host_jvm_args=-Xmx1g"),
+      RcStartupFlag("", "--client_debug"),
+      RcStartupFlag("/bazelrc", "--noblock_for_lock"),
+      RcStartupFlag("", "--client_profile=/tmp/profile.json"),
+      RcStartupFlag("", "--standby_servers=2"),
+      RcStartupFlag("/bazelrc", "--nowatchfs"),
+  };
+  EXPECT_EQ(string("--host_jvm_args=-Xmx1g\0--nowatchfs\0", 35),
+            GetStandbyServerKey(flags));
+  EXPECT_EQ("", GetStandbyServerKey({RcStartupFlag("", "--client_debug")}));
+}
+
+TEST(StandbyServersTest, ForgetsOutputBasesWithoutAServer) {
+  const string tmpdir = blaze::GetPathEnv("TEST_TMPDIR");
+  const string registry = blaze_util::JoinPath(tmpdir, "standby_registry");
+  const blaze_util::Path first(blaze_util::JoinPath(tmpdir, "first"));
+  const blaze_util::Path second(blaze_util::JoinPath(tmpdir, "second"));
+  ASSERT_TRUE(blaze_util::MakeDirectories(first, 0755));
+  ASSERT_TRUE(blaze_util::MakeDirectories(second, 0755));
+
+  StandbyServers standby(registry);
+  standby.RecordUse(first);
+  standby.RecordUse(second);
+  const string first_entry =
+      GetHashedBaseDir(registry, first.AsPrintablePath());
+  const string second_entry =
+      GetHashedBaseDir(registry, second.AsPrintablePath());
+  ASSERT_TRUE(blaze_util::PathExists(first_entry));
+  ASSERT_TRUE(blaze_util::PathExists(second_entry));
+
+  // Neither has a server, so there is nothing to shut down, but the other
+  // output base is no longer a standby server.
+  standby.ShutDownExcess(second, 0);
+  EXPECT_FALSE(blaze_util::PathExists(first_entry));
+  EXPECT_TRUE(blaze_util::PathExists(second_entry));
+  EXPECT_TRUE(blaze_util::IsDirectory(first));
+}
+
+}  // namespace blaze
@@ -18,6 +18,7 @@
 
 #include <memory>
 
+#include "src/main/cpp/blaze_util.h"
 #include "src/main/cpp/blaze_util_platform.h"
 #ifdef __linux
 #include "src/main/cpp/util/file_platform.h"
@@ -183,6 +184,25 @@ TEST_F(StartupOptionsTest, OutputUserRootTildeExpansion) {
   }
 }
 
+TEST_F(StartupOptionsTest, SharedInstallBaseRoot) {
+  EXPECT_EQ("", startup_options_->shared_install_base_root);
+
+  std::string error;
+  const std::vector<RcStartupFlag> flags{
+      RcStartupFlag("somewhere", "--shared_install_base_root=/shared/install"),
+  };
+  const blaze_exit_code::ExitCode ec =
+      startup_options_->ProcessArgs(flags, &error);
+  ASSERT_EQ(blaze_exit_code::SUCCESS, ec)
+      << "ProcessArgs failed with error " << error;
+  EXPECT_EQ(blaze::AbsolutePathFromFlag("/shared/install"),
+            startup_options_->shared_install_base_root);
+  EXPECT_EQ("somewhere",
+            startup_options_->option_sources["shared_install_base_root"]);
+  // Only the client decides whether the install base is shared.
+  EXPECT_FALSE(startup_options_->install_base_is_shared);
+}
+
 TEST_F(StartupOptionsTest, EmptyFlagsAreInvalidTest) {
   {
     bool result;
@@ -0,0 +1,109 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/cpp/util/arena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include <string>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace blaze_util {
+
+TEST(ArenaTest, PushIsAlignedAndZeroed) {
+  Arena *arena = AllocArena(MiB(64));
+  uint8_t *first = PushArray(arena, uint8_t, 3);
+  EXPECT_EQ(GetArenaFirst(arena), first);
+  memset(first, 0xff, 3);
+  uint64_t *second = PushArray(arena, uint64_t, 1);
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(second) % 8);
+  EXPECT_EQ(0u, *second);
+  // Large pushes commit the memory they need.
+  uint8_t *large = PushArray(arena, uint8_t, MiB(8));
+  EXPECT_EQ(0, large[MiB(8) - 1]);
+  large[MiB(8) - 1] = 1;
+  FreeArena(arena);
+}
+
+TEST(ArenaTest, TemporaryMemoryIsPopped) {
+  Arena *arena = AllocArena(MiB(64));
+  PushArray(arena, uint8_t, 100);
+  uint8_t *top = arena->top;
+  TemporaryMemory temp = BeginTemporaryMemory(arena);
+  uint8_t *block = PushArray(arena, uint8_t, KiB(64));
+  memset(block, 0xff, KiB(64));
+  EndTemporaryMemory(temp);
+  EXPECT_EQ(top, arena->top);
+  // The memory is zeroed again when it is pushed again.
+  block = PushArray(arena, uint8_t, KiB(64));
+  EXPECT_EQ(0, block[KiB(64) - 1]);
+  FreeArena(arena);
+}
+
+TEST(ArenaTest, HugePages) {
+  Arena *arena = AllocArena(GiB(1), /*huge_pages=*/true);
+  EXPECT_EQ(HugePageSize(), arena->commit_alignment);
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(arena->committed) %
+                    HugePageSize());
+  uint8_t *block = PushArray(arena, uint8_t, MiB(5));
+  block[MiB(5) - 1] = 1;
+  EXPECT_LE(arena->top, arena->committed);
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(arena->committed) %
+                    HugePageSize());
+  FreeArena(arena);
+
+  // Arenas smaller than a huge page keep small pages.
+  arena = AllocArena(KiB(64), /*huge_pages=*/true);
+  EXPECT_EQ(GetPageSize(), arena->commit_alignment);
+  FreeArena(arena);
+}
+
+TEST(ArenaTest, ScratchArenasAvoidConflicts) {
+  TemporaryMemory scratch = BeginScratch(nullptr);
+  TemporaryMemory other = BeginScratch(scratch.arena);
+  EXPECT_NE(scratch.arena, other.arena);
+  PushArray(other.arena, uint8_t, 10);
+  EndScratch(other);
+  EndScratch(scratch);
+}
+
+#ifndef _WIN32
+TEST(ArenaTest, FileArenaIsLoadedAgain) {
+  const char *tmpdir = getenv("TEST_TMPDIR");
+  std::string path = std::string(tmpdir ? tmpdir : "/tmp") + "/arena_test";
+  Arena *arena = AllocFileArena(path.c_str(), MiB(16));
+  ASSERT_NE(nullptr, arena);
+  char *text = PushArray(arena, char, 6);
+  memcpy(text, "hello", 6);
+  PushArray(arena, uint8_t, MiB(1));
+  FreeArena(arena);
+
+  ptrdiff_t moved_by;
+  arena = LoadFileArena(path.c_str(), MiB(16), &moved_by);
+  ASSERT_NE(nullptr, arena);
+  EXPECT_STREQ("hello", static_cast<char *>(GetArenaFirst(arena)));
+  // The arena can grow again.
+  PushArray(arena, uint8_t, MiB(1));
+  FreeArena(arena);
+  unlink(path.c_str());
+}
+#endif
+
+}  // namespace blaze_util
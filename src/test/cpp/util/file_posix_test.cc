@@ -79,6 +79,38 @@ TEST(FilePosixTest, GetAllFilesUnder) {
   ASSERT_EQ(expected, result);
 }
 
+TEST(FilePosixTest, GetAllFilesUnderTree) {
+  const char* tmp_dir = getenv("TEST_TMPDIR");
+  ASSERT_STRNE(tmp_dir, nullptr);
+  string root = JoinPath(tmp_dir, "GetAllFilesUnderTree");
+  ASSERT_TRUE(MakeDirectories(root, 0755));
+
+  // Enough directories, wide and deep, for the listing to be parallel.
+  vector<string> expected;
+  for (int i = 0; i < 20; i++) {
+    string dir = JoinPath(root, "dir" + std::to_string(i));
+    for (int j = 0; j < i % 4; j++) {
+      dir = JoinPath(dir, "sub");
+    }
+    ASSERT_TRUE(MakeDirectories(dir, 0755));
+    for (int j = 0; j < 5; j++) {
+      expected.push_back(JoinPath(dir, "file" + std::to_string(j)));
+      ASSERT_TRUE(CreateEmptyFile(expected.back()));
+    }
+  }
+  expected.push_back(JoinPath(root, "dir_sym"));
+  ASSERT_TRUE(Symlink(JoinPath(root, "dir0"), expected.back()));
+  std::sort(expected.begin(), expected.end());
+
+  vector<string> result;
+  GetAllFilesUnder(root, &result);
+  std::sort(result.begin(), result.end());
+  ASSERT_EQ(expected, result);
+
+  ASSERT_TRUE(RemoveRecursively(root));
+  ASSERT_FALSE(PathExists(root));
+}
+
 TEST(FilePosixTest, MakeDirectories) {
   const char* tmp_dir = getenv("TEST_TMPDIR");
   ASSERT_STRNE(tmp_dir, nullptr);
@@ -162,6 +194,21 @@ TEST(FilePosixTest, PathExists) {
   ASSERT_TRUE(PathExists("/usr/bin/yes"));
 }
 
+TEST(FilePosixTest, FindNonDirectory) {
+  const char* tmp_dir = getenv("TEST_TMPDIR");
+  ASSERT_NE(tmp_dir, nullptr);
+  string dir = JoinPath(tmp_dir, "find_non_directory");
+  ASSERT_TRUE(MakeDirectories(JoinPath(dir, "subdir"), 0755));
+  ASSERT_TRUE(WriteFile("", JoinPath(dir, "file"), 0644));
+  ASSERT_TRUE(Symlink("file", JoinPath(dir, "link")));
+
+  EXPECT_EQ(-1, FindNonDirectory(dir, {}));
+  EXPECT_EQ(-1, FindNonDirectory(dir, {"missing", "subdir"}));
+  EXPECT_EQ(2, FindNonDirectory(dir, {"missing", "subdir", "file"}));
+  EXPECT_EQ(0, FindNonDirectory(dir, {"link", "file"}));
+  EXPECT_EQ(-1, FindNonDirectory(JoinPath(dir, "missing"), {"file"}));
+}
+
 TEST(FilePosixTest, CanAccess) {
   ASSERT_FALSE(CanReadFile("/this/should/not/exist/mkay"));
   ASSERT_FALSE(CanExecuteFile("/this/should/not/exist/mkay"));
@@ -333,6 +380,14 @@ TEST(FileTest, TestRemoveRecursivelyPosix) {
   EXPECT_TRUE(WriteFile("junkdata", 8, JoinPath(unwritable_dir, "file")));
   ASSERT_EQ(0, chmod(unwritable_dir.c_str(), 0500));
   EXPECT_FALSE(RemoveRecursively(unwritable_dir));
+  string unwritable_subdir(JoinPath(unwritable_dir, "subdir"));
+  ASSERT_EQ(0, chmod(unwritable_dir.c_str(), 0700));
+  EXPECT_TRUE(MakeDirectories(unwritable_subdir, 0700));
+  EXPECT_TRUE(WriteFile("junkdata", 8, JoinPath(unwritable_subdir, "file")));
+  ASSERT_EQ(0, chmod(unwritable_subdir.c_str(), 0500));
+  ASSERT_EQ(0, chmod(unwritable_dir.c_str(), 0500));
+  EXPECT_TRUE(ForceRemoveRecursively(unwritable_dir));
+  EXPECT_FALSE(PathExists(unwritable_dir));
 
   string symlink_target_dir(JoinPath(tempdir, "test_rmr_symlink_target_dir"));
   EXPECT_TRUE(MakeDirectories(symlink_target_dir, 0700));
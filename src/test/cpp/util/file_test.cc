@@ -13,6 +13,7 @@
 // limitations under the License.
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include <algorithm>
 #include <map>
@@ -177,11 +178,18 @@ TEST(FileTest, TestMtimeHandling) {
   // Assert that SetToNow resets the timestamp.
   ASSERT_TRUE(mtime->SetToNow(file));
   ASSERT_FALSE(mtime->IsUntampered(file));
+  // Assert that the mtime is reported as about now.
+  uint64_t millis;
+  ASSERT_TRUE(mtime->GetMillisSinceEpoch(file, &millis));
+  const uint64_t now = static_cast<uint64_t>(time(nullptr)) * 1000;
+  EXPECT_LE(millis, now + 1000);
+  EXPECT_GE(millis + 60 * 1000, now);
   // Delete the file and assert that we can no longer set or query its mtime.
   ASSERT_TRUE(UnlinkPath(file));
   ASSERT_FALSE(mtime->SetToNow(file));
   ASSERT_FALSE(mtime->SetToDistantFuture(file));
   ASSERT_FALSE(mtime->IsUntampered(file));
+  ASSERT_FALSE(mtime->GetMillisSinceEpoch(file, &millis));
 }
 
 TEST(FileTest, TestCreateTempDir) {
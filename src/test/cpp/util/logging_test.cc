@@ -11,10 +11,14 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
+#include <cstdio>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <sstream>
 #include <string>
+#include <thread>  // NOLINT -- for windows portability
+#include <vector>
 
 #include "src/main/cpp/blaze_util_platform.h"
 #include "src/main/cpp/util/bazel_log_handler.h"
@@ -431,6 +435,48 @@ TEST(LoggingTest, BazelLogHandler_BufferedLogsGetDirectedToCerr) {
   EXPECT_THAT(stderr_output, HasSubstr(teststring));
 }
 
+TEST(LoggingTest, BazelLogHandler_ConcurrentLogsGetDirectedToCerr) {
+  // Set up logging and be prepared to capture stderr at destruction.
+  testing::internal::CaptureStderr();
+  std::unique_ptr<blaze_util::BazelLogHandler> handler(
+      new blaze_util::BazelLogHandler());
+  blaze_util::SetLogHandler(std::move(handler));
+  blaze_util::SetLoggingOutputStreamToStderr();
+
+  // Log more messages than the writer thread can queue, from several threads.
+  const int kThreads = 4;
+  const int kMessages = 2000;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; i++) {
+    threads.emplace_back([i] {
+      for (int j = 0; j < kMessages; j++) {
+        BAZEL_LOG(INFO) << "concurrent message " << i << "/" << j;
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  // Set a null log handler, which causes the BazelLogHandler to be destructed.
+  // This prompts its logs to be flushed, so we can capture them.
+  blaze_util::SetLogHandler(nullptr);
+  std::string stderr_output = testing::internal::GetCapturedStderr();
+  std::vector<int> next(kThreads, 0);
+  std::istringstream lines(stderr_output);
+  std::string line;
+  while (std::getline(lines, line)) {
+    std::string::size_type pos = line.find("] concurrent message ");
+    ASSERT_NE(pos, std::string::npos) << line;
+    int i, j;
+    ASSERT_EQ(sscanf(line.c_str() + pos, "] concurrent message %d/%d", &i, &j),
+              2);
+    // Each thread's messages are written in the order they were logged.
+    ASSERT_EQ(j, next[i]++);
+  }
+  EXPECT_EQ(next, std::vector<int>(kThreads, kMessages));
+}
+
 // We use the LoggingDeathTest test case to make sure that the death tests are
 // run in a single threaded environment, where it is safe to fork. These tests
 // are run before the other tests, which can be run in parallel.
@@ -223,6 +223,36 @@ TEST(BlazeUtil, Tokenize) {
   EXPECT_EQ("two three", result[1]);
 }
 
+TEST(BlazeUtil, LineTokenizer) {
+  string contents =
+      "  first 'line of' words # comment\n"
+      "\n"
+      "# a comment only\n"
+      "continued \\\n  line \\\r\n here\r\n"
+      "# continued \\\n comment\n"
+      "unterminated 'quote\n"
+      "last\\ one";
+  LineTokenizer lines(contents, '#');
+  vector<string> words;
+
+  ASSERT_TRUE(lines.Next(&words));
+  EXPECT_EQ(vector<string>({"first", "line of", "words"}), words);
+  EXPECT_EQ("  first 'line of' words # comment", lines.line());
+
+  ASSERT_TRUE(lines.Next(&words));
+  EXPECT_EQ(vector<string>({"continued", "line", "here"}), words);
+  EXPECT_EQ("continued \\\n  line \\\r\n here\r", lines.line());
+
+  ASSERT_TRUE(lines.Next(&words));
+  EXPECT_EQ(vector<string>({"unterminated", "quote"}), words);
+
+  ASSERT_TRUE(lines.Next(&words));
+  EXPECT_EQ(vector<string>({"last one"}), words);
+
+  EXPECT_FALSE(lines.Next(&words));
+  EXPECT_TRUE(words.empty());
+}
+
 static vector<string> SplitQuoted(const string &contents,
                                   const char delimiter) {
   vector<string> result;
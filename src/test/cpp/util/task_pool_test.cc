@@ -0,0 +1,127 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/cpp/util/task_pool.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace blaze_util {
+
+// Counts the nodes of a binary tree of the given depth, with a task for each
+// node.
+static void CountTree(TaskGroup *group, int depth, std::atomic<int> *count) {
+  (*count)++;
+  if (depth > 0) {
+    for (int i = 0; i < 2; ++i) {
+      group->Run([group, depth, count] { CountTree(group, depth - 1, count); });
+    }
+  }
+}
+
+TEST(TaskPoolTest, GroupWaitsForNestedTasks) {
+  for (int threads : {0, 1, 4}) {
+    TaskPool pool(threads);
+    std::atomic<int> count(0);
+    TaskGroup group(&pool);
+    group.Run([&group, &count] { CountTree(&group, 12, &count); });
+    group.Wait();
+    EXPECT_EQ((1 << 13) - 1, count) << threads << " threads";
+  }
+}
+
+TEST(TaskPoolTest, PoolRunsQueuedTasksWhenDestroyed) {
+  std::atomic<int> count(0);
+  {
+    TaskPool pool(2);
+    for (int i = 0; i < 100; ++i) {
+      pool.Run([&count] { count++; });
+    }
+  }
+  EXPECT_EQ(100, count);
+}
+
+TEST(TaskPoolTest, TasksRunOnThreads) {
+  TaskPool pool(4);
+  std::atomic<int> running(0);
+  std::atomic<int> most_running(0);
+  TaskGroup group(&pool);
+  for (int i = 0; i < 4; ++i) {
+    group.Run([&running, &most_running] {
+      int now = ++running;
+      int most = most_running;
+      while (now > most && !most_running.compare_exchange_weak(most, now)) {
+      }
+      // Long enough for the other tasks to start.
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      running--;
+    });
+  }
+  group.Wait();
+  EXPECT_GT(most_running, 1);
+}
+
+TEST(TaskPoolTest, ParallelForCallsEachIndexOnce) {
+  for (int threads : {0, 3}) {
+    TaskPool pool(threads);
+    std::vector<std::atomic<int>> calls(1000);
+    ParallelFor(&pool, calls.size(), [&calls](size_t i) { calls[i]++; });
+    for (size_t i = 0; i < calls.size(); ++i) {
+      ASSERT_EQ(1, calls[i]) << i;
+    }
+    ParallelFor(&pool, 0, [](size_t i) { FAIL(); });
+  }
+}
+
+TEST(TaskPoolTest, OrderedResultsKeepTheOrder) {
+  for (int threads : {0, 1, 4}) {
+    TaskPool pool(threads);
+    std::vector<int> results;
+    std::atomic<int> computing(0);
+    const size_t max_pending = 8;
+    {
+      OrderedResults<std::unique_ptr<int>> ordered(
+          &pool, max_pending, [&results](std::unique_ptr<int> value) {
+            results.push_back(*value);
+          });
+      for (int i = 0; i < 200; ++i) {
+        if (i % 7 == 0) {
+          ordered.AddDone(std::make_unique<int>(i));
+          continue;
+        }
+        ordered.Add([i, &computing, max_pending] {
+          EXPECT_LE(++computing, static_cast<int>(max_pending) + 1);
+          // Later values are done sooner, so that they have to wait.
+          std::this_thread::sleep_for(std::chrono::microseconds(200 - i));
+          computing--;
+          return std::make_unique<int>(i);
+        });
+      }
+      ordered.Finish();
+      EXPECT_EQ(200u, results.size());
+      ordered.Add([] { return std::make_unique<int>(200); });
+    }
+    ASSERT_EQ(201u, results.size()) << threads << " threads";
+    for (int i = 0; i <= 200; ++i) {
+      EXPECT_EQ(i, results[i]);
+    }
+  }
+}
+
+}  // namespace blaze_util
@@ -0,0 +1,260 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// util_benchmark.cc -- measures the arena and the task pool that the native
+// tools share.
+//
+//   util_benchmark [--repeat N] [--threads N] [--items N]
+//
+// Reports the best of N runs of:
+//  - arena: --items allocations of 16 to 256 bytes with malloc, and pushed
+//    onto an arena with small and with huge pages, then reads of random
+//    8-byte words of 256 MB of arena with small and with huge pages, where
+//    huge pages save the TLB misses;
+//  - pool: --items tasks of a little work on one thread, on a TaskGroup of a
+//    pool of --threads threads (default: one per CPU), as a tree of tasks
+//    that queue each other, and with ParallelFor;
+//  - ordered: --items values computed with OrderedResults on the pool and
+//    passed on in order, against computing them on one thread.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "src/main/cpp/util/arena.h"
+#include "src/main/cpp/util/task_pool.h"
+
+namespace blaze_util {
+
+static double Now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+struct Timing {
+  double seconds = 0;
+
+  void Update(double start, int run) {
+    double elapsed = Now() - start;
+    if (run == 0 || elapsed < seconds) {
+      seconds = elapsed;
+    }
+  }
+};
+
+static void Report(const char *what, double seconds, size_t items,
+                   const char *unit) {
+  fprintf(stdout, "  %-22s %9.3f ms %12.0f %s/s\n", what, seconds * 1e3,
+          items / seconds, unit);
+}
+
+// Keeps the compiler from optimizing the work away.
+static std::atomic<uint64_t> sink;
+
+// A little work, about what stripping a small class or statting a file
+// takes in user space.
+static uint64_t Work(uint64_t seed) {
+  uint64_t x = seed + 1;
+  for (int i = 0; i < 200; ++i) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+  }
+  return x;
+}
+
+static void BenchmarkArena(int repeat, size_t items) {
+  std::vector<size_t> sizes(items);
+  std::mt19937 random(42);
+  for (size_t &size : sizes) {
+    size = 16 + random() % 241;
+  }
+  Timing malloc_time, arena_time, huge_arena_time;
+  std::vector<void *> blocks(items);
+  for (int run = 0; run < repeat; ++run) {
+    double start = Now();
+    for (size_t i = 0; i < items; ++i) {
+      blocks[i] = calloc(1, sizes[i]);
+    }
+    for (size_t i = 0; i < items; ++i) {
+      free(blocks[i]);
+    }
+    malloc_time.Update(start, run);
+
+    for (bool huge_pages : {false, true}) {
+      start = Now();
+      Arena *arena = AllocArena(GiB(4), huge_pages);
+      for (size_t i = 0; i < items; ++i) {
+        blocks[i] = PushArena(arena, sizes[i]);
+      }
+      FreeArena(arena);
+      (huge_pages ? huge_arena_time : arena_time).Update(start, run);
+    }
+  }
+  fprintf(stdout, "arena: %zu allocations\n", items);
+  Report("malloc", malloc_time.seconds, items, "allocations");
+  Report("arena", arena_time.seconds, items, "allocations");
+  Report("arena, huge pages", huge_arena_time.seconds, items, "allocations");
+
+  const size_t words = MiB(256) / sizeof(uint64_t);
+  const size_t reads = 10 * 1000 * 1000;
+  Timing read_time, huge_read_time;
+  for (bool huge_pages : {false, true}) {
+    Arena *arena = AllocArena(GiB(1), huge_pages);
+    uint64_t *data = PushArray(arena, uint64_t, words);
+    for (size_t i = 0; i < words; ++i) {
+      data[i] = i;
+    }
+    for (int run = 0; run < repeat; ++run) {
+      double start = Now();
+      uint64_t index = 1, sum = 0;
+      for (size_t i = 0; i < reads; ++i) {
+        index = index * 6364136223846793005ULL + 1442695040888963407ULL;
+        sum += data[(index >> 16) % words];
+      }
+      sink += sum;
+      (huge_pages ? huge_read_time : read_time).Update(start, run);
+    }
+    FreeArena(arena);
+  }
+  Report("random reads", read_time.seconds, reads, "reads");
+  Report("random reads, huge", huge_read_time.seconds, reads, "reads");
+}
+
+static void CountTree(TaskGroup *group, size_t begin, size_t end) {
+  while (end - begin > 16) {
+    size_t middle = begin + (end - begin) / 2;
+    group->Run([group, middle, end] { CountTree(group, middle, end); });
+    end = middle;
+  }
+  uint64_t sum = 0;
+  for (size_t i = begin; i < end; ++i) {
+    sum += Work(i);
+  }
+  sink += sum;
+}
+
+static void BenchmarkPool(int repeat, int threads, size_t items) {
+  Timing serial_time, group_time, tree_time, for_time;
+  TaskPool pool(threads - 1);
+  for (int run = 0; run < repeat; ++run) {
+    double start = Now();
+    uint64_t sum = 0;
+    for (size_t i = 0; i < items; ++i) {
+      sum += Work(i);
+    }
+    sink += sum;
+    serial_time.Update(start, run);
+
+    start = Now();
+    {
+      TaskGroup group(&pool);
+      for (size_t i = 0; i < items; ++i) {
+        group.Run([i] { sink += Work(i); });
+      }
+    }
+    group_time.Update(start, run);
+
+    start = Now();
+    {
+      TaskGroup group(&pool);
+      group.Run([&group, items] { CountTree(&group, 0, items); });
+    }
+    tree_time.Update(start, run);
+
+    start = Now();
+    ParallelFor(&pool, items, [](size_t i) { sink += Work(i); });
+    for_time.Update(start, run);
+  }
+  fprintf(stdout, "pool: %zu tasks on %d threads\n", items, threads);
+  Report("one thread", serial_time.seconds, items, "tasks");
+  Report("task group", group_time.seconds, items, "tasks");
+  Report("task tree", tree_time.seconds, items, "tasks");
+  Report("parallel for", for_time.seconds, items, "tasks");
+}
+
+static void BenchmarkOrdered(int repeat, int threads, size_t items) {
+  Timing serial_time, ordered_time;
+  TaskPool pool(threads - 1);
+  for (int run = 0; run < repeat; ++run) {
+    double start = Now();
+    uint64_t expected = 0;
+    for (size_t i = 0; i < items; ++i) {
+      expected = expected * 31 + Work(i);
+    }
+    serial_time.Update(start, run);
+
+    start = Now();
+    uint64_t result = 0;
+    {
+      OrderedResults<uint64_t> ordered(
+          &pool, 8 * threads,
+          [&result](uint64_t value) { result = result * 31 + value; });
+      for (size_t i = 0; i < items; ++i) {
+        ordered.Add([i] { return Work(i); });
+      }
+    }
+    ordered_time.Update(start, run);
+    if (result != expected) {
+      fprintf(stderr, "OrderedResults passed on the values out of order\n");
+      exit(1);
+    }
+  }
+  fprintf(stdout, "ordered: %zu values on %d threads\n", items, threads);
+  Report("one thread", serial_time.seconds, items, "values");
+  Report("ordered results", ordered_time.seconds, items, "values");
+}
+
+}  // namespace blaze_util
+
+static void usage() {
+  fprintf(stderr,
+          "Usage: util_benchmark [--repeat N] [--threads N] [--items N]\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  int repeat = 5;
+  int threads = std::max(1u, std::thread::hardware_concurrency());
+  int items = 1000 * 1000;
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      usage();
+    } else if (strcmp(argv[i], "--repeat") == 0) {
+      repeat = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--threads") == 0) {
+      threads = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--items") == 0) {
+      items = atoi(argv[++i]);
+    } else {
+      usage();
+    }
+  }
+  if (repeat < 1 || threads < 1 || items < 1) {
+    usage();
+  }
+  blaze_util::BenchmarkArena(repeat, items);
+  blaze_util::BenchmarkPool(repeat, threads, items);
+  blaze_util::BenchmarkOrdered(repeat, threads, items);
+  return 0;
+}
@@ -176,6 +176,22 @@ public class ActionOutputDirectoryHelperTest {
     assertThat(parentPath.isExecutable()).isTrue();
   }
 
+  @Test
+  public void createOutputDirectories_overwritesExistingFileBelowKnownDirectory(
+      @TestParameter DirectoryCache cache) throws Exception {
+    ActionOutputDirectoryHelper outputDirectoryHelper = new ActionOutputDirectoryHelper(cache.spec);
+    Artifact fileOutput = createOutput("dir/file/out");
+    Artifact otherOutput = createOutput("dir/other/out");
+    Path filePath = fileOutput.getPath().getParentDirectory();
+    filePath.getParentDirectory().createDirectoryAndParents();
+    FileSystemUtils.writeContent(filePath, UTF_8, "garbage");
+
+    outputDirectoryHelper.createOutputDirectories(ImmutableSet.of(fileOutput, otherOutput));
+
+    assertThat(filePath.isDirectory()).isTrue();
+    assertThat(otherOutput.getPath().getParentDirectory().isDirectory()).isTrue();
+  }
+
   @Test
   public void createActionFsOutputDirectories_createsExpectedDirectoriesInActionFs(
       @TestParameter OutputSet outputSet) throws Exception {
@@ -425,6 +425,7 @@ public class BlazeRuntimeWrapper {
                 /* collectSystemNetworkUsage= */ false,
                 /* collectResourceManagerEstimation= */ false,
                 /* collectPressureStallIndicators= */ false,
+                /* collectNativeResourceUsage= */ false,
                 /* collectSkyframeCounts= */ false));
 
     StoredEventHandler storedEventHandler = new StoredEventHandler();
@@ -126,6 +126,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectNativeResourceUsage= */ false,
             /* collectSkyframeCounts= */ false));
     return buffer;
   }
@@ -155,6 +156,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectNativeResourceUsage= */ false,
             /* collectSkyframeCounts= */ false));
   }
 
@@ -269,6 +271,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectNativeResourceUsage= */ false,
             /* collectSkyframeCounts= */ false));
     try (SilentCloseable c = profiler.profile(ProfilerTask.ACTION, "action task")) {
       // Next task takes less than 10 ms but should be recorded anyway.
@@ -362,6 +365,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectNativeResourceUsage= */ false,
             /* collectSkyframeCounts= */ false));
     metricsCollected.await(10, TimeUnit.SECONDS);
     profiler.stop();
@@ -402,6 +406,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectNativeResourceUsage= */ false,
             /* collectSkyframeCounts= */ false));
     profiler.logSimpleTask(10000, 20000, ProfilerTask.VFS_STAT, "stat");
     // Unlike the VFS_STAT event above, the remote execution event will not be recorded since we
@@ -536,6 +541,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectNativeResourceUsage= */ false,
             /* collectSkyframeCounts= */ false));
     profiler.logSimpleTask(10000, 20000, ProfilerTask.VFS_STAT, "stat");
 
@@ -743,6 +749,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectNativeResourceUsage= */ false,
             /* collectSkyframeCounts= */ false));
     profiler.logSimpleTask(badClock.nanoTime(), ProfilerTask.INFO, "some task");
     profiler.stop();
@@ -798,6 +805,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectNativeResourceUsage= */ false,
             /* collectSkyframeCounts= */ false));
     profiler.logSimpleTaskDuration(
         Profiler.nanoTimeMaybe(), Duration.ofSeconds(10), ProfilerTask.INFO, "foo");
@@ -838,6 +846,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectNativeResourceUsage= */ false,
             /* collectSkyframeCounts= */ false));
     profiler.logSimpleTaskDuration(
         Profiler.nanoTimeMaybe(), Duration.ofSeconds(10), ProfilerTask.INFO, "foo");
@@ -873,6 +882,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectNativeResourceUsage= */ false,
             /* collectSkyframeCounts= */ false));
     try (SilentCloseable c =
         profiler.profileAction(
@@ -923,6 +933,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectNativeResourceUsage= */ false,
             /* collectSkyframeCounts= */ false));
     try (SilentCloseable c =
         profiler.profileAction(
@@ -973,6 +984,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectNativeResourceUsage= */ false,
             /* collectSkyframeCounts= */ false));
     try (SilentCloseable c =
         profiler.profileAction(
@@ -1016,6 +1028,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectNativeResourceUsage= */ false,
             /* collectSkyframeCounts= */ false));
     long curTime = Profiler.nanoTimeMaybe();
     for (int i = 0; i < 100_000; i++) {
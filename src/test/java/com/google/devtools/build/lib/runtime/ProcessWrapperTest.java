@@ -126,4 +126,15 @@ public final class ProcessWrapperTest {
     builder.addExecutionInfo(ImmutableMap.of(ExecutionRequirements.GRACEFUL_TERMINATION, "1"));
     assertThat(builder.build()).containsExactlyElementsIn(expectedWithExecutionInfo).inOrder();
   }
+
+  @Test
+  public void testNumaNodes_parseNodeList() {
+    assertThat(ProcessWrapper.NumaNodes.parseNodeList("0")).containsExactly(0);
+    assertThat(ProcessWrapper.NumaNodes.parseNodeList("0-3"))
+        .containsExactly(0, 1, 2, 3)
+        .inOrder();
+    assertThat(ProcessWrapper.NumaNodes.parseNodeList("0-1,4,6-7"))
+        .containsExactly(0, 1, 4, 6, 7)
+        .inOrder();
+  }
 }
@@ -92,6 +92,9 @@ public final class LinuxSandboxCommandLineBuilderTest {
 
     Path sandboxDebugPath = testFS.getPath("/debug.out");
     Path statisticsPath = testFS.getPath("/stats.out");
+    Path accessLogPath = testFS.getPath("/read_inputs");
+    Path admissionGate = testFS.getPath("/admission-gate");
+    Duration admissionWait = Duration.ofSeconds(30);
 
     Path workingDirectory = testFS.getPath("/all-work-and-no-play");
     Path stdoutPath = testFS.getPath("/stdout.txt");
@@ -141,6 +144,8 @@ public final class LinuxSandboxCommandLineBuilderTest {
             .add("-W", workingDirectory.getPathString())
             .add("-T", Long.toString(timeout.getSeconds()))
             .add("-t", Long.toString(killDelay.getSeconds()))
+            .add("-A", admissionGate.getPathString())
+            .add("-a", Long.toString(admissionWait.getSeconds()))
             .add("-l", stdoutPath.getPathString())
             .add("-L", stderrPath.getPathString())
             .add("-w", writableDir1.getPathString())
@@ -153,6 +158,7 @@ public final class LinuxSandboxCommandLineBuilderTest {
             .add("-M", bindMountSource2.getPathString())
             .add("-m", bindMountTarget2.getPathString())
             .add("-S", statisticsPath.getPathString())
+            .add("-I", accessLogPath.getPathString())
             .add("-H")
             .add("-N")
             .add("-U")
@@ -170,6 +176,7 @@ public final class LinuxSandboxCommandLineBuilderTest {
             .setStderrPath(stderrPath)
             .setTimeout(timeout)
             .setKillDelay(killDelay)
+            .setAdmissionGate(admissionGate, admissionWait)
             .setWritableFilesAndDirectories(writableFilesAndDirectories)
             .setTmpfsDirectories(tmpfsDirectories)
             .setBindMounts(bindMounts)
@@ -177,6 +184,7 @@ public final class LinuxSandboxCommandLineBuilderTest {
             .setCreateNetworkNamespace(createNetworkNamespace ? NETNS_WITH_LOOPBACK : NO_NETNS)
             .setUseFakeRoot(useFakeRoot)
             .setStatisticsPath(statisticsPath)
+            .setAccessLogPath(accessLogPath)
             .setUseFakeUsername(useFakeUsername)
             .setSandboxDebugPath(sandboxDebugPath.getPathString())
             .setPersistentProcess(true)
@@ -185,4 +193,56 @@ public final class LinuxSandboxCommandLineBuilderTest {
 
     assertThat(commandLine).containsExactlyElementsIn(expectedCommandLine).inOrder();
   }
+
+  @Test
+  public void testLinuxSandboxCommandLineBuilder_perfCountersNeedStatistics() {
+    Path linuxSandboxPath = testFS.getPath("/linux-sandbox");
+    Path statisticsPath = testFS.getPath("/stats.out");
+    ImmutableList<String> commandArguments = ImmutableList.of("echo", "hello, ada");
+
+    assertThat(
+            LinuxSandboxCommandLineBuilder.commandLineBuilder(linuxSandboxPath)
+                .setPerfCounters(true)
+                .buildForCommand(commandArguments))
+        .doesNotContain("-E");
+    assertThat(
+            LinuxSandboxCommandLineBuilder.commandLineBuilder(linuxSandboxPath)
+                .setStatisticsPath(statisticsPath)
+                .setPerfCounters(true)
+                .buildForCommand(commandArguments))
+        .containsAtLeast("-S", statisticsPath.getPathString(), "-E")
+        .inOrder();
+  }
+
+  @Test
+  public void testLinuxSandboxCommandLineBuilder_lazyInputsNeedOverlay() {
+    Path linuxSandboxPath = testFS.getPath("/linux-sandbox");
+    Path manifest = testFS.getPath("/inputs.manifest");
+    Path store = testFS.getPath("/cas");
+    Path requests = testFS.getPath("/requests");
+    ImmutableList<String> commandArguments = ImmutableList.of("echo", "hello, ada");
+
+    assertThat(
+            LinuxSandboxCommandLineBuilder.commandLineBuilder(linuxSandboxPath)
+                .setLazyInputs(manifest, store, requests)
+                .buildForCommand(commandArguments))
+        .doesNotContain("-f");
+    assertThat(
+            LinuxSandboxCommandLineBuilder.commandLineBuilder(linuxSandboxPath)
+                .setOverlay(testFS.getPath("/lower"), testFS.getPath("/overlay-work"))
+                .setLazyInputs(manifest, store, requests)
+                .buildForCommand(commandArguments))
+        .containsAtLeast(
+            "-o",
+            "/lower",
+            "-O",
+            "/overlay-work",
+            "-f",
+            manifest.getPathString(),
+            "-F",
+            store.getPathString(),
+            "-g",
+            requests.getPathString())
+        .inOrder();
+  }
 }
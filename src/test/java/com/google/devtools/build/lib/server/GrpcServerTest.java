@@ -27,6 +27,8 @@ import com.google.devtools.build.lib.runtime.proto.InvocationPolicyOuterClass.In
 import com.google.devtools.build.lib.server.CommandProtos.CancelRequest;
 import com.google.devtools.build.lib.server.CommandProtos.CancelResponse;
 import com.google.devtools.build.lib.server.CommandProtos.EnvironmentVariable;
+import com.google.devtools.build.lib.server.CommandProtos.PingRequest;
+import com.google.devtools.build.lib.server.CommandProtos.PingResponse;
 import com.google.devtools.build.lib.server.CommandProtos.RunRequest;
 import com.google.devtools.build.lib.server.CommandProtos.RunResponse;
 import com.google.devtools.build.lib.server.CommandServerGrpc.CommandServerStub;
@@ -42,6 +44,7 @@ import com.google.devtools.build.lib.util.io.CommandExtensionReporter;
 import com.google.devtools.build.lib.util.io.OutErr;
 import com.google.devtools.build.lib.vfs.DigestHashFunction;
 import com.google.devtools.build.lib.vfs.FileSystem;
+import com.google.devtools.build.lib.vfs.FileSystemUtils;
 import com.google.devtools.build.lib.vfs.Path;
 import com.google.devtools.build.lib.vfs.inmemoryfs.InMemoryFileSystem;
 import com.google.protobuf.Any;
@@ -57,6 +60,7 @@ import io.grpc.stub.ServerCallStreamObserver;
 import io.grpc.stub.StreamObserver;
 import java.io.IOException;
 import java.io.OutputStream;
+import java.nio.charset.StandardCharsets;
 import java.util.ArrayList;
 import java.util.Arrays;
 import java.util.List;
@@ -92,12 +96,16 @@ public final class GrpcServerTest {
             new PidFileWatcher(fileSystem.getPath("/thread-not-running-dont-need"), SERVER_PID),
             new JavaClock(),
             /* port= */ -1,
+            /* unixDomainSocket= */ false,
             REQUEST_COOKIE,
             "response-cookie",
             serverDirectory,
             SERVER_PID,
+            "install-md5",
+            "startup-options-digest",
             1000,
             false,
+            /* scopedServerPid= */ 0,
             false,
             "slow interrupt message suffix");
     String uniqueName = InProcessServerBuilder.generateName();
@@ -173,6 +181,84 @@ public final class GrpcServerTest {
     assertThat(responses.get(1).hasFailureDetail()).isFalse();
   }
 
+  @Test
+  public void testArgFile() throws Exception {
+    List<List<String>> argsReceived = new ArrayList<>();
+    CommandDispatcher dispatcher =
+        (invocationPolicy,
+            args,
+            outErr,
+            lockingMode,
+            clientDescription,
+            firstContactTimeMillis,
+            startupOptionsTaggedWithBazelRc,
+            commandExtensions,
+            commandExtensionReporter) -> {
+          argsReceived.add(args);
+          return BlazeCommandResult.success();
+        };
+    createServer(dispatcher);
+    Path argFile = fileSystem.getPath("/bazel_server_directory/run_request_args.1");
+    FileSystemUtils.writeContent(argFile, "build\0//foo\0\0".getBytes(StandardCharsets.UTF_8));
+    CommandServerStub stub = CommandServerGrpc.newStub(channel);
+    RunRequest request =
+        createRequest().toBuilder()
+            .setArgFile("run_request_args.1")
+            .setArgFileDigest("digest")
+            .build();
+
+    List<RunResponse> responses = new ArrayList<>();
+    CountDownLatch done = new CountDownLatch(1);
+    stub.run(request, createResponseObserver(responses, done));
+    done.await();
+    // The arguments of the same digest are not read again.
+    argFile.delete();
+    done = new CountDownLatch(1);
+    stub.run(request, createResponseObserver(responses, done));
+    done.await();
+    done = new CountDownLatch(1);
+    stub.run(
+        request.toBuilder().setArgFileDigest("other digest").build(),
+        createResponseObserver(responses, done));
+    done.await();
+    server.shutdown();
+    server.awaitTermination();
+
+    ImmutableList<String> args = ImmutableList.of("build", "//foo", "");
+    assertThat(argsReceived).containsExactly(args, args);
+    RunResponse last = Iterables.getLast(responses);
+    assertThat(last.getFinished()).isTrue();
+    assertThat(last.getExitCode()).isEqualTo(36);
+    assertThat(last.getFailureDetail().getGrpcServer().getCode())
+        .isEqualTo(GrpcServer.Code.ARG_FILE_UNREADABLE);
+  }
+
+  @Test
+  public void testPingReportsIdentity() throws Exception {
+    createServer(
+        (invocationPolicy,
+            args,
+            outErr,
+            lockingMode,
+            clientDescription,
+            firstContactTimeMillis,
+            startupOptionsTaggedWithBazelRc,
+            commandExtensions,
+            commandExtensionReporter) -> BlazeCommandResult.success());
+    CommandServerGrpc.CommandServerBlockingStub stub = CommandServerGrpc.newBlockingStub(channel);
+
+    PingResponse response = stub.ping(PingRequest.newBuilder().setCookie(REQUEST_COOKIE).build());
+    PingResponse badCookieResponse =
+        stub.ping(PingRequest.newBuilder().setCookie("bad-cookie").build());
+    server.shutdown();
+    server.awaitTermination();
+
+    assertThat(response.getCookie()).isEqualTo("response-cookie");
+    assertThat(response.getInstallMd5()).isEqualTo("install-md5");
+    assertThat(response.getStartupOptionsDigest()).isEqualTo("startup-options-digest");
+    assertThat(badCookieResponse).isEqualTo(PingResponse.getDefaultInstance());
+  }
+
   @Test
   public void testReceiveStreamingCommandExtensions() throws Exception {
     // Arrange: Set up a command that streams back three command extensions, using latches to
@@ -136,4 +136,40 @@ public final class ExecutionStatisticsTest {
     assertThat(resourceUsage.getInvoluntaryContextSwitches())
         .isEqualTo(riggedInvoluntaryContextSwitches);
   }
+
+  @Test
+  public void testCgroupStatisticsProvided_fromProtoFilename() throws Exception {
+    com.google.devtools.build.lib.shell.Protos.CgroupStatistics cgroupStatisticsProto =
+        com.google.devtools.build.lib.shell.Protos.CgroupStatistics.newBuilder()
+            .setMemoryPeakBytes(1 << 20)
+            .setCpuThrottledUsec(42)
+            .setIoWriteBytes(7)
+            .build();
+    com.google.devtools.build.lib.shell.Protos.ExecutionStatistics executionStatisticsProto =
+        com.google.devtools.build.lib.shell.Protos.ExecutionStatistics.newBuilder()
+            .setResourceUsage(
+                com.google.devtools.build.lib.shell.Protos.ResourceUsage.newBuilder().setMaxrss(1))
+            .setCgroupStatistics(cgroupStatisticsProto)
+            .build();
+    Path protoFilename = createExecutionStatisticsProtoFile(executionStatisticsProto);
+
+    ExecutionStatistics.ResourceUsage resourceUsage =
+        ExecutionStatistics.getResourceUsage(protoFilename).get();
+
+    assertThat(resourceUsage.getMaximumResidentSetSize()).isEqualTo(1);
+    assertThat(resourceUsage.getCgroupStatistics()).hasValue(cgroupStatisticsProto);
+  }
+
+  @Test
+  public void testNoCgroupStatistics_whenNoCgroupStatisticsProto() throws Exception {
+    com.google.devtools.build.lib.shell.Protos.ExecutionStatistics executionStatisticsProto =
+        com.google.devtools.build.lib.shell.Protos.ExecutionStatistics.newBuilder()
+            .setResourceUsage(
+                com.google.devtools.build.lib.shell.Protos.ResourceUsage.newBuilder().setMaxrss(1))
+            .build();
+    Path protoFilename = createExecutionStatisticsProtoFile(executionStatisticsProto);
+
+    assertThat(ExecutionStatistics.getResourceUsage(protoFilename).get().getCgroupStatistics())
+        .isEmpty();
+  }
 }
@@ -0,0 +1,187 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.devtools.build.lib.skyframe;
+
+import static com.google.common.truth.Truth.assertThat;
+import static org.junit.Assume.assumeFalse;
+import static org.junit.Assume.assumeTrue;
+
+import com.google.common.collect.ImmutableSet;
+import com.google.common.io.MoreFiles;
+import com.google.devtools.build.lib.skyframe.DiffAwareness.View;
+import com.google.devtools.build.lib.testing.common.FakeOptions;
+import com.google.devtools.build.lib.util.OS;
+import com.google.devtools.build.lib.vfs.ModifiedFileSet;
+import com.google.devtools.build.lib.vfs.PathFragment;
+import com.google.devtools.common.options.OptionsProvider;
+import com.google.errorprone.annotations.CanIgnoreReturnValue;
+import java.io.IOException;
+import java.nio.charset.StandardCharsets;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.util.Arrays;
+import java.util.HashSet;
+import java.util.Set;
+import org.junit.After;
+import org.junit.Before;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+import org.junit.runners.JUnit4;
+
+/** Tests for {@link LinuxFsNotifyDiffAwareness} */
+@RunWith(JUnit4.class)
+public class LinuxFsNotifyDiffAwarenessTest {
+  private LinuxFsNotifyDiffAwareness underTest;
+  private Path watchedPath;
+  private OptionsProvider watchFsEnabledProvider;
+
+  @Before
+  public void setUp() throws Exception {
+    assumeTrue(OS.getCurrent() == OS.LINUX);
+    watchedPath = Files.createTempDirectory("watched").toRealPath();
+    underTest =
+        new LinuxFsNotifyDiffAwareness(
+            watchedPath.toString(), ImmutableSet.of(watchedPath.resolve("ignored")));
+    LocalDiffAwareness.Options localDiffOptions = new LocalDiffAwareness.Options();
+    localDiffOptions.watchFS = true;
+    watchFsEnabledProvider = FakeOptions.of(localDiffOptions);
+  }
+
+  @After
+  public void tearDown() throws Exception {
+    if (underTest != null) {
+      underTest.close();
+      MoreFiles.deleteRecursively(watchedPath);
+    }
+  }
+
+  private void scratchDir(String path) throws IOException {
+    Files.createDirectories(watchedPath.resolve(path));
+  }
+
+  private void scratchFile(String path, String contents) throws IOException {
+    Files.writeString(watchedPath.resolve(path), contents, StandardCharsets.UTF_8);
+  }
+
+  private void scratchFile(String path) throws IOException {
+    scratchFile(path, "");
+  }
+
+  /**
+   * Checks that the union of the diffs between the current view and each member of some consecutive
+   * sequence of views is the specific set of given files.
+   *
+   * @param view1 the view to compare to
+   * @param rawPaths the files to expect in the view
+   * @return the new view
+   */
+  @CanIgnoreReturnValue
+  private View assertDiff(View view1, Iterable<String> rawPaths)
+      throws IncompatibleViewException, BrokenDiffAwarenessException, InterruptedException {
+    Set<PathFragment> allPaths = new HashSet<>();
+    for (String path : rawPaths) {
+      allPaths.add(PathFragment.create(path));
+    }
+    Set<PathFragment> pathsYetToBeSeen = new HashSet<>(allPaths);
+
+    // The events arrive asynchronously, so try for a while until we have seen all of them.
+    for (int attempts = 0; ; attempts++) {
+      View view2 = underTest.getCurrentView(watchFsEnabledProvider);
+
+      ModifiedFileSet diff = underTest.getDiff(view1, view2);
+      // The kernel may drop events when its queue overflows, which we cannot do anything about.
+      assumeFalse("Lost events; diff unknown", diff.equals(ModifiedFileSet.EVERYTHING_MODIFIED));
+
+      ImmutableSet<PathFragment> modifiedSourceFiles = diff.modifiedSourceFiles();
+      allPaths.removeAll(modifiedSourceFiles);
+      pathsYetToBeSeen.removeAll(modifiedSourceFiles);
+      if (pathsYetToBeSeen.isEmpty()) {
+        if (!allPaths.isEmpty()) {
+          throw new AssertionError("Paths " + allPaths + " unexpectedly reported as modified");
+        }
+        return view2;
+      }
+
+      if (attempts == 100) {
+        throw new AssertionError("Paths " + pathsYetToBeSeen + " not found as modified");
+      }
+      Thread.sleep(100);
+      view1 = view2; // getDiff requires views to be sequential if we want to get meaningful data.
+    }
+  }
+
+  @Test
+  public void testSimple() throws Exception {
+    View view1 = underTest.getCurrentView(watchFsEnabledProvider);
+
+    scratchDir("a/b");
+    scratchFile("a/b/c");
+    scratchDir("b/c");
+    scratchFile("b/c/d");
+    View view2 = assertDiff(view1, Arrays.asList("a", "a/b", "a/b/c", "b", "b/c", "b/c/d"));
+
+    scratchFile("a/b/c", "changed");
+    View view3 = assertDiff(view2, Arrays.asList("a/b/c"));
+
+    MoreFiles.deleteRecursively(watchedPath.resolve("a"));
+    assertDiff(view3, Arrays.asList("a", "a/b", "a/b/c"));
+  }
+
+  @Test
+  public void testIgnoredPaths() throws Exception {
+    View view1 = underTest.getCurrentView(watchFsEnabledProvider);
+
+    scratchDir("ignored/a");
+    scratchFile("ignored/a/b");
+    scratchFile("c");
+    assertDiff(view1, Arrays.asList("c"));
+  }
+
+  @Test
+  public void testRenameDirectory() throws Exception {
+    scratchDir("dir1");
+    scratchFile("dir1/file.c", "first");
+    View view1 = underTest.getCurrentView(watchFsEnabledProvider);
+
+    Files.move(watchedPath.resolve("dir1"), watchedPath.resolve("dir2"));
+    ModifiedFileSet diff;
+    do {
+      Thread.sleep(100);
+      View view2 = underTest.getCurrentView(watchFsEnabledProvider);
+      diff = underTest.getDiff(view1, view2);
+      view1 = view2;
+    } while (!diff.treatEverythingAsModified() && diff.modifiedSourceFiles().isEmpty());
+
+    // We cannot tell which files moved along with the directory.
+    assertThat(diff.treatEverythingAsModified()).isTrue();
+  }
+
+  @Test
+  public void testRootDeleted() throws Exception {
+    View view1 = underTest.getCurrentView(watchFsEnabledProvider);
+    Files.delete(watchedPath);
+    Files.createDirectory(watchedPath);
+
+    for (int attempts = 0; attempts < 100; attempts++) {
+      Thread.sleep(100);
+      try {
+        underTest.getDiff(view1, underTest.getCurrentView(watchFsEnabledProvider));
+      } catch (BrokenDiffAwarenessException e) {
+        return;
+      }
+    }
+    throw new AssertionError("Deleting the watched directory went unnoticed");
+  }
+}
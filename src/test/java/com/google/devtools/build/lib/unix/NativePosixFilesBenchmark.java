@@ -0,0 +1,242 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.devtools.build.lib.unix;
+
+import java.io.File;
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.nio.file.FileSystemException;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.nio.file.attribute.UserDefinedFileAttributeView;
+import java.util.ArrayList;
+import java.util.List;
+import java.util.concurrent.TimeUnit;
+import org.openjdk.jmh.annotations.Benchmark;
+import org.openjdk.jmh.annotations.BenchmarkMode;
+import org.openjdk.jmh.annotations.Level;
+import org.openjdk.jmh.annotations.Mode;
+import org.openjdk.jmh.annotations.OperationsPerInvocation;
+import org.openjdk.jmh.annotations.OutputTimeUnit;
+import org.openjdk.jmh.annotations.Param;
+import org.openjdk.jmh.annotations.Scope;
+import org.openjdk.jmh.annotations.Setup;
+import org.openjdk.jmh.annotations.State;
+import org.openjdk.jmh.annotations.TearDown;
+import org.openjdk.jmh.infra.Blackhole;
+
+/**
+ * Measures the file system primitives of {@link NativePosixFiles} through JNI.
+ *
+ * <p>native_posix_files_benchmark runs the same workloads with the system calls alone, and {@link
+ * #noop} and {@link #convertPath} measure the JNI transition and the conversion of a path without
+ * them, so that the cost of each can be told apart. The scores are per file, directory entry or
+ * directory, and per 64 MB written, like those of native_posix_files_benchmark.
+ */
+@BenchmarkMode(Mode.AverageTime)
+@OutputTimeUnit(TimeUnit.NANOSECONDS)
+@State(Scope.Benchmark)
+public class NativePosixFilesBenchmark {
+
+  static {
+    System.load(new File(System.getProperty("native_posix_files_benchmark.jni")).getAbsolutePath());
+  }
+
+  private static final int FILES = 10_000;
+  private static final int DEPTH = 100;
+  private static final int FILES_PER_DIRECTORY = 100;
+  private static final String DIGEST_ATTRIBUTE = "user.benchmark.digest";
+  private static final int WRITE_BYTES = 64 << 20;
+
+  private static native void nativeNoop();
+
+  private static native int nativeConvertPath(String path);
+
+  private Path dir;
+  private String[] paths;
+  private String wide;
+  private String[] chain;
+  private boolean haveXattrs;
+
+  @Setup(Level.Trial)
+  public void setup() throws IOException {
+    dir = Files.createTempDirectory("NativePosixFilesBenchmark");
+    wide = dir.resolve("wide").toString();
+    NativePosixFiles.mkdir(wide, 0755);
+    paths = new String[FILES];
+    for (int i = 0; i < FILES; i++) {
+      paths[i] = wide + "/file" + i;
+      Files.createFile(Path.of(paths[i]));
+    }
+
+    // Each directory of the chain has a few files besides the next one.
+    List<String> directories = new ArrayList<>();
+    String deep = dir.resolve("deep").toString();
+    for (int i = 0; i < DEPTH; i++) {
+      NativePosixFiles.mkdir(deep, 0755);
+      for (int j = 0; j < 10; j++) {
+        Files.createFile(Path.of(deep, "file" + j));
+      }
+      directories.add(deep);
+      deep += "/d";
+    }
+    chain = directories.toArray(new String[0]);
+
+    haveXattrs = true;
+    try {
+      for (String path : paths) {
+        Files.getFileAttributeView(Path.of(path), UserDefinedFileAttributeView.class)
+            .write(DIGEST_ATTRIBUTE.substring("user.".length()), ByteBuffer.allocate(32));
+      }
+    } catch (FileSystemException | UnsupportedOperationException e) {
+      haveXattrs = false;
+    }
+  }
+
+  @TearDown(Level.Trial)
+  public void tearDown() throws IOException {
+    NativePosixFiles.deleteTreesBelow(dir.toString());
+    NativePosixFiles.remove(dir.toString());
+  }
+
+  /** The tree that {@link #deleteTreesBelow} removes, made again before each invocation. */
+  @State(Scope.Thread)
+  public static class Tree {
+    private Path tree;
+
+    @Setup(Level.Trial)
+    public void setup() throws IOException {
+      tree = Files.createTempDirectory("NativePosixFilesBenchmark");
+    }
+
+    @Setup(Level.Invocation)
+    public void makeTree() throws IOException {
+      for (int i = 0; i < FILES; i++) {
+        Path directory = tree.resolve(Integer.toString(i / FILES_PER_DIRECTORY));
+        if (i % FILES_PER_DIRECTORY == 0) {
+          Files.createDirectory(directory);
+        }
+        Files.createFile(directory.resolve("file" + i));
+      }
+    }
+
+    @TearDown(Level.Trial)
+    public void tearDown() throws IOException {
+      NativePosixFiles.deleteTreesBelow(tree.toString());
+      NativePosixFiles.remove(tree.toString());
+    }
+  }
+
+  /** The file that {@link #write} writes, {@code bufferSize} bytes at a time. */
+  @State(Scope.Thread)
+  public static class Output {
+    @Param({"1024", "16384", "65536", "1048576"})
+    public int bufferSize;
+
+    private Path output;
+    private byte[] buffer;
+
+    @Setup(Level.Trial)
+    public void setup() throws IOException {
+      output = Files.createTempFile("NativePosixFilesBenchmark", null);
+      buffer = new byte[bufferSize];
+    }
+
+    @TearDown(Level.Trial)
+    public void tearDown() throws IOException {
+      Files.delete(output);
+    }
+  }
+
+  @Benchmark
+  public void noop() {
+    nativeNoop();
+  }
+
+  @Benchmark
+  @OperationsPerInvocation(FILES)
+  public void convertPath(Blackhole blackhole) {
+    for (String path : paths) {
+      blackhole.consume(nativeConvertPath(path));
+    }
+  }
+
+  @Benchmark
+  @OperationsPerInvocation(FILES)
+  public void stat(Blackhole blackhole) throws IOException {
+    for (String path : paths) {
+      blackhole.consume(NativePosixFiles.stat(path));
+    }
+  }
+
+  @Benchmark
+  @OperationsPerInvocation(FILES)
+  public void lstat(Blackhole blackhole) throws IOException {
+    for (String path : paths) {
+      blackhole.consume(NativePosixFiles.lstat(path));
+    }
+  }
+
+  @Benchmark
+  @OperationsPerInvocation(FILES)
+  public String[] readdirWide() throws IOException {
+    return NativePosixFiles.readdir(wide);
+  }
+
+  @Benchmark
+  @OperationsPerInvocation(DEPTH)
+  public void readdirDeep(Blackhole blackhole) throws IOException {
+    for (String directory : chain) {
+      blackhole.consume(NativePosixFiles.readdir(directory));
+    }
+  }
+
+  @Benchmark
+  @OperationsPerInvocation(FILES + FILES / FILES_PER_DIRECTORY)
+  public void deleteTreesBelow(Tree tree) throws IOException {
+    NativePosixFiles.deleteTreesBelow(tree.tree.toString());
+  }
+
+  @Benchmark
+  @OperationsPerInvocation(FILES)
+  public void getxattr(Blackhole blackhole) throws IOException {
+    if (!haveXattrs) {
+      return;
+    }
+    for (String path : paths) {
+      blackhole.consume(NativePosixFiles.getxattr(path, DIGEST_ATTRIBUTE));
+    }
+  }
+
+  @Benchmark
+  @OperationsPerInvocation(FILES)
+  public void getxattrMissing(Blackhole blackhole) throws IOException {
+    for (String path : paths) {
+      blackhole.consume(NativePosixFiles.getxattr(path, "user.benchmark.missing"));
+    }
+  }
+
+  @Benchmark
+  public void write(Output output) throws IOException {
+    int fd = NativePosixFiles.openWrite(output.output.toString(), false);
+    try {
+      for (int written = 0; written < WRITE_BYTES; written += output.bufferSize) {
+        NativePosixFiles.write(fd, output.buffer, 0, output.bufferSize);
+      }
+    } finally {
+      NativePosixFiles.close(fd, null);
+    }
+  }
+}
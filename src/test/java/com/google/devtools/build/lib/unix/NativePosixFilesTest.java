@@ -23,11 +23,17 @@ import com.google.devtools.build.lib.testutil.TestUtils;
 import com.google.devtools.build.lib.util.OS;
 import com.google.devtools.build.lib.vfs.DigestHashFunction;
 import com.google.devtools.build.lib.vfs.FileSystem;
+import com.google.devtools.build.lib.vfs.FileSystemUtils;
 import com.google.devtools.build.lib.vfs.Path;
+import com.google.devtools.build.lib.vfs.PathFragment;
 import java.io.File;
 import java.io.FileNotFoundException;
 import java.io.IOException;
+import java.nio.ByteBuffer;
 import java.nio.file.Files;
+import java.nio.file.attribute.FileTime;
+import java.util.HashMap;
+import java.util.Map;
 import org.junit.Before;
 import org.junit.Test;
 import org.junit.runner.RunWith;
@@ -111,6 +117,33 @@ public class NativePosixFilesTest {
         FileNotFoundException.class, () -> NativePosixFiles.lgetxattr(nonexistentFile, "foo"));
   }
 
+  @Test
+  public void digestCache() throws Exception {
+    assumeXattrsSupported();
+    java.nio.file.Path myfile = Files.write(Files.createTempFile("digestcache", null), new byte[1]);
+    String path = myfile.toString();
+    byte[] digest = {1, 2, 3, 4};
+    byte[] digests = new byte[8];
+
+    // A file modified just now may be modified again without a change in its modification time.
+    assertThat(NativePosixFiles.getDigestCacheStamp(path)).isNull();
+    Files.setLastModifiedTime(myfile, FileTime.fromMillis(1_000_000_000_000L));
+    byte[] stamp = NativePosixFiles.getDigestCacheStamp(path);
+    assertThat(stamp).isNotNull();
+    assertThat(NativePosixFiles.storeCachedDigest(path, "user.digest", stamp, digest)).isTrue();
+    assertThat(
+            NativePosixFiles.getCachedDigests(
+                new String[] {path, path + ".missing"}, "user.digest", 4, digests))
+        .isEqualTo(new boolean[] {true, false});
+    assertThat(digests).isEqualTo(new byte[] {1, 2, 3, 4, 0, 0, 0, 0});
+
+    Files.setLastModifiedTime(myfile, FileTime.fromMillis(1_000_000_001_000L));
+    assertThat(NativePosixFiles.getCachedDigests(new String[] {path}, "user.digest", 4, digests))
+        .isEqualTo(new boolean[] {false});
+    // The file has changed since the stamp was taken.
+    assertThat(NativePosixFiles.storeCachedDigest(path, "user.digest", stamp, digest)).isFalse();
+  }
+
   @Test
   public void writing() throws Exception {
     java.nio.file.Path myfile = Files.createTempFile("myfile", null);
@@ -136,4 +169,234 @@ public class NativePosixFilesTest {
     NativePosixFiles.close(fd2, null);
     assertThat(Files.readAllBytes(myfile)).isEqualTo(new byte[] {0, 1, 2, 3, 6, 7, 8});
   }
+
+  @Test
+  public void writeDirect() throws Exception {
+    java.nio.file.Path myfile = Files.createTempFile("myfile", null);
+    ByteBuffer buffer = ByteBuffer.allocateDirect(4).put(new byte[] {0, 1, 2, 3});
+    int fd = NativePosixFiles.openWrite(myfile.toString(), false);
+    NativePosixFiles.preallocate(fd, 6);
+    assertThrows(
+        IndexOutOfBoundsException.class, () -> NativePosixFiles.writeDirect(fd, buffer, 1, 4, -1));
+    assertThrows(
+        IllegalArgumentException.class,
+        () -> NativePosixFiles.writeDirect(fd, ByteBuffer.allocate(4), 0, 4, -1));
+    NativePosixFiles.writeDirect(fd, buffer, 0, 4, -1);
+    NativePosixFiles.writeDirect(fd, buffer, 1, 2, 4);
+    NativePosixFiles.writeDirect(fd, buffer, 3, 1, 0);
+    NativePosixFiles.close(fd, null);
+    assertThat(Files.readAllBytes(myfile)).isEqualTo(new byte[] {3, 1, 2, 3, 1, 2});
+  }
+
+  @Test
+  public void copyFileRange() throws Exception {
+    byte[] data = new byte[100000];
+    for (int i = 0; i < data.length; i++) {
+      data[i] = (byte) i;
+    }
+    java.nio.file.Path from = Files.write(Files.createTempFile("from", null), data);
+    java.nio.file.Path to = Files.createTempFile("to", null);
+    int fromFd = NativePosixFiles.openRead(from.toString());
+    int toFd = NativePosixFiles.openWrite(to.toString(), false);
+    assertThat(NativePosixFiles.copyFileRange(fromFd, toFd, 1000)).isEqualTo(1000);
+    assertThat(NativePosixFiles.copyFileRange(fromFd, toFd, Long.MAX_VALUE)).isEqualTo(99000);
+    assertThat(NativePosixFiles.copyFileRange(fromFd, toFd, 1000)).isEqualTo(0);
+    NativePosixFiles.close(fromFd, null);
+    NativePosixFiles.close(toFd, null);
+    assertThat(Files.readAllBytes(to)).isEqualTo(data);
+  }
+
+  @Test
+  public void cloneFile() throws Exception {
+    FileSystemUtils.writeContentAsLatin1(testFile, "contents");
+    testFile.chmod(0750);
+    Path clone = workingDir.getRelative("clone");
+    if (NativePosixFiles.cloneFile(testFile.getPathString(), clone.getPathString())) {
+      assertThat(new String(FileSystemUtils.readContentAsLatin1(clone))).isEqualTo("contents");
+      assertThat(NativePosixFiles.lstat(clone.getPathString()).getPermissions()).isEqualTo(0750);
+      assertThrows(
+          IOException.class,
+          () -> NativePosixFiles.cloneFile(testFile.getPathString(), clone.getPathString()));
+    } else {
+      // The file system of the test cannot clone files.
+      assertThat(clone.exists()).isFalse();
+    }
+  }
+
+  @Test
+  public void copyTreesBelow() throws Exception {
+    Path from = workingDir.getRelative("from");
+    from.getRelative("a/b").createDirectoryAndParents();
+    for (int i = 0; i < 200; i++) {
+      FileSystemUtils.writeContentAsLatin1(from.getRelative("a/file" + i), "contents" + i);
+    }
+    Path executable = from.getRelative("a/b/executable");
+    FileSystemUtils.writeContentAsLatin1(executable, "#!/bin/sh");
+    executable.chmod(0555);
+    executable.setLastModifiedTime(1000000);
+    from.getRelative("a/b/link").createSymbolicLink(PathFragment.create("../file0"));
+    from.getRelative("a/b").chmod(0555);
+    Path to = workingDir.getRelative("to");
+    to.createDirectory();
+
+    NativePosixFiles.copyTreesBelow(from.getPathString(), to.getPathString());
+
+    for (int i = 0; i < 200; i++) {
+      assertThat(new String(FileSystemUtils.readContentAsLatin1(to.getRelative("a/file" + i))))
+          .isEqualTo("contents" + i);
+    }
+    FileStatus copied = NativePosixFiles.lstat(to.getRelative("a/b/executable").getPathString());
+    assertThat(copied.getPermissions()).isEqualTo(0555);
+    assertThat(copied.getLastModifiedTime()).isEqualTo(1000000);
+    assertThat(to.getRelative("a/b/link").readSymbolicLink())
+        .isEqualTo(PathFragment.create("../file0"));
+    assertThat(NativePosixFiles.lstat(to.getRelative("a/b").getPathString()).getPermissions())
+        .isEqualTo(0555);
+
+    // The entries must not exist yet.
+    IOException e =
+        assertThrows(
+            IOException.class,
+            () -> NativePosixFiles.copyTreesBelow(from.getPathString(), to.getPathString()));
+    assertThat(e).hasMessageThat().contains("File exists");
+    from.getRelative("a/b").chmod(0755);
+    to.getRelative("a/b").chmod(0755);
+  }
+
+  @Test
+  public void copyTreesBelow_missingDirectory() throws Exception {
+    assertThrows(
+        FileNotFoundException.class,
+        () ->
+            NativePosixFiles.copyTreesBelow(
+                workingDir.getRelative("nonexistent").getPathString(),
+                workingDir.getPathString()));
+  }
+
+  @Test
+  public void statBatch() throws Exception {
+    FileSystemUtils.writeContentAsLatin1(testFile, "contents");
+    workingDir.getRelative("link").createSymbolicLink(testFile);
+    String[] paths = {"test", "link", "nonexistent", testFile.getPathString()};
+
+    NativePosixFiles.BatchStats stats =
+        NativePosixFiles.statBatch(
+            workingDir.getPathString(), paths, /* followSymlinks= */ false, /* threads= */ 4);
+
+    assertThat(stats.size()).isEqualTo(4);
+    FileStatus expected = NativePosixFiles.lstat(testFile.getPathString());
+    for (int i : new int[] {0, 3}) {
+      assertThat(stats.errnos[i]).isEqualTo(0);
+      assertThat(stats.modes[i]).isEqualTo(expected.getPermissions() | 0100000);
+      assertThat(stats.sizes[i]).isEqualTo(8);
+      assertThat(stats.lastModifiedTimes[i]).isEqualTo(expected.getLastModifiedTime());
+      assertThat(stats.inodes[i]).isEqualTo(expected.getInodeNumber());
+    }
+    assertThat(stats.get(1).isSymbolicLink()).isTrue();
+    assertThat(stats.errnos[2]).isEqualTo(ErrnoFileStatus.ENOENT);
+    assertThat(stats.get(2).hasError()).isTrue();
+
+    NativePosixFiles.BatchStats followed =
+        NativePosixFiles.statBatch(
+            workingDir.getPathString(), paths, /* followSymlinks= */ true, /* threads= */ 1);
+    assertThat(followed.inodes[1]).isEqualTo(expected.getInodeNumber());
+  }
+
+  @Test
+  public void statBatch_missingDirectory() throws Exception {
+    assertThrows(
+        FileNotFoundException.class,
+        () ->
+            NativePosixFiles.statBatch(
+                workingDir.getRelative("nonexistent").getPathString(),
+                new String[] {"test"},
+                /* followSymlinks= */ true,
+                /* threads= */ 1));
+  }
+
+  @Test
+  public void mkdirsWritable() throws Exception {
+    Path root = workingDir.getRelative("root");
+    root.getRelative("existing").createDirectoryAndParents();
+    root.getRelative("existing").setWritable(false);
+    FileSystemUtils.writeContentAsLatin1(root.getRelative("file"), "contents");
+    root.getRelative("link").createSymbolicLink(root.getRelative("existing"));
+    String[] dirs = {"a/b/c", "a/b", "existing", "existing/d", "file/e", "link/f", "a/b/c"};
+    int[] results = new int[dirs.length];
+
+    NativePosixFiles.mkdirsWritable(root.getPathString(), dirs, results);
+
+    assertThat(results)
+        .asList()
+        .containsExactly(1, 1, 0, 1, -ErrnoFileStatus.ENOTDIR, -ErrnoFileStatus.ELOOP, 1)
+        .inOrder();
+    assertThat(root.getRelative("a/b/c").isDirectory()).isTrue();
+    assertThat(root.getRelative("existing").isWritable()).isTrue();
+    assertThat(root.getRelative("existing/d").isDirectory()).isTrue();
+    assertThat(root.getRelative("existing/f").exists()).isFalse();
+  }
+
+  @Test
+  public void mkdirsWritable_missingRoot() throws Exception {
+    assertThrows(
+        FileNotFoundException.class,
+        () ->
+            NativePosixFiles.mkdirsWritable(
+                workingDir.getRelative("nonexistent").getPathString(),
+                new String[] {"a"},
+                new int[1]));
+  }
+
+  @Test
+  public void readdirPlus() throws Exception {
+    Path dir = workingDir.getRelative("dir");
+    dir.createDirectory();
+    FileSystemUtils.writeContentAsLatin1(dir.getRelative("file"), "contents");
+    dir.getRelative("subdir").createDirectory();
+    dir.getRelative("link").createSymbolicLink(PathFragment.create("file"));
+    dir.getRelative("dangling").createSymbolicLink(PathFragment.create("nonexistent"));
+
+    NativePosixFiles.DirectoryListing listing =
+        NativePosixFiles.readdirPlus(
+            dir.getPathString(), /* followSymlinks= */ false, /* statEntries= */ true);
+
+    Map<String, Integer> indices = new HashMap<>();
+    for (int i = 0; i < listing.size(); i++) {
+      indices.put(listing.getName(i), i);
+    }
+    assertThat(indices.keySet()).containsExactly("file", "subdir", "link", "dangling");
+    int file = indices.get("file");
+    assertThat(listing.getType(file)).isEqualTo(NativePosixFiles.Dirents.Type.FILE);
+    assertThat(listing.getType(indices.get("subdir")))
+        .isEqualTo(NativePosixFiles.Dirents.Type.DIRECTORY);
+    assertThat(listing.getType(indices.get("link")))
+        .isEqualTo(NativePosixFiles.Dirents.Type.SYMLINK);
+    FileStatus expected = NativePosixFiles.lstat(dir.getRelative("file").getPathString());
+    assertThat(listing.getStats().sizes[file]).isEqualTo(8);
+    assertThat(listing.getStats().inodes[file]).isEqualTo(expected.getInodeNumber());
+
+    NativePosixFiles.DirectoryListing followed =
+        NativePosixFiles.readdirPlus(
+            dir.getPathString(), /* followSymlinks= */ true, /* statEntries= */ false);
+    assertThat(followed.getStats()).isNull();
+    for (int i = 0; i < followed.size(); i++) {
+      NativePosixFiles.Dirents.Type expected =
+          switch (followed.getName(i)) {
+            case "file", "link" -> NativePosixFiles.Dirents.Type.FILE;
+            case "subdir" -> NativePosixFiles.Dirents.Type.DIRECTORY;
+            default -> NativePosixFiles.Dirents.Type.UNKNOWN;
+          };
+      assertThat(followed.getType(i)).isEqualTo(expected);
+    }
+  }
+
+  @Test
+  public void readdirPlus_notADirectory() throws Exception {
+    FileSystemUtils.writeContentAsLatin1(testFile, "contents");
+    assertThrows(
+        IOException.class,
+        () ->
+            NativePosixFiles.readdirPlus(
+                testFile.getPathString(), /* followSymlinks= */ false, /* statEntries= */ false));
+  }
 }
@@ -0,0 +1,354 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// native_posix_files_benchmark.cc -- measures the system calls behind the
+// file system primitives of src/main/native/unix_jni.cc, without the JVM.
+//
+//   native_posix_files_benchmark [--repeat N] [--dir DIR] [--files N]
+//       [--depth N]
+//
+// Reports the best of N runs of:
+//  - stat, lstat: of FILES files in one directory;
+//  - readdir wide: listing that directory;
+//  - readdir deep: listing each directory of a chain DEPTH deep;
+//  - delete tree: removing a tree of FILES files, as deleteTreesBelow does;
+//  - getxattr: reading a digest from an extended attribute of each file,
+//    and looking up one that is not there;
+//  - write: writing 64 MB with buffers of 1 KB to 1 MB.
+//
+// NativePosixFilesBenchmark runs the same workloads through JNI, so that the
+// difference is the cost of the JNI transitions and of converting the paths.
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace {
+
+// The attribute that holds a digest, as --unix_digest_hash_attribute_name
+// would name it.
+const char kDigestAttribute[] = "user.benchmark.digest";
+const size_t kDigestLength = 32;
+const size_t kWriteBytes = 64 << 20;
+const size_t kFilesPerDirectory = 100;
+
+double Now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void Die(const char *what, const std::string &path) {
+  fprintf(stderr, "%s '%s': %s\n", what, path.c_str(), strerror(errno));
+  abort();
+}
+
+struct Timing {
+  double seconds = 0;
+
+  void Update(double start, int run) {
+    double elapsed = Now() - start;
+    if (run == 0 || elapsed < seconds) {
+      seconds = elapsed;
+    }
+  }
+};
+
+void Report(const char *what, double seconds, size_t items,
+            const char *unit) {
+  fprintf(stdout, "  %-16s %9.3f ms %9.0f ns/%s\n", what, seconds * 1e3,
+          seconds * 1e9 / items, unit);
+}
+
+void MakeDirectory(const std::string &path) {
+  if (mkdir(path.c_str(), 0755) != 0) {
+    Die("mkdir", path);
+  }
+}
+
+void MakeFile(const std::string &path) {
+  int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    Die("open", path);
+  }
+  close(fd);
+}
+
+// Lists the directory as readdir does, returning the number of entries.
+size_t ListDirectory(const std::string &path) {
+  DIR *dir = opendir(path.c_str());
+  if (dir == nullptr) {
+    Die("opendir", path);
+  }
+  size_t entries = 0;
+  while (readdir(dir) != nullptr) {
+    entries++;
+  }
+  closedir(dir);
+  return entries;
+}
+
+// Removes what is below `dirfd`, as deleteTreesBelow does on one thread.
+void DeleteTreesBelow(int dirfd, const std::string &path) {
+  DIR *dir = fdopendir(dirfd);
+  if (dir == nullptr) {
+    Die("fdopendir", path);
+  }
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) {
+      continue;
+    }
+    if (entry->d_type == DT_DIR) {
+      int fd = openat(dirfd, entry->d_name,
+                      O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+      if (fd < 0) {
+        Die("openat", path + "/" + entry->d_name);
+      }
+      DeleteTreesBelow(fd, path + "/" + entry->d_name);
+    }
+    if (unlinkat(dirfd, entry->d_name,
+                 entry->d_type == DT_DIR ? AT_REMOVEDIR : 0) != 0) {
+      Die("unlinkat", path + "/" + entry->d_name);
+    }
+  }
+  closedir(dir);
+}
+
+void MakeTree(const std::string &root, size_t files) {
+  for (size_t i = 0; i < files; i++) {
+    const std::string dir =
+        root + "/" + std::to_string(i / kFilesPerDirectory);
+    if (i % kFilesPerDirectory == 0) {
+      MakeDirectory(dir);
+    }
+    MakeFile(dir + "/file" + std::to_string(i));
+  }
+}
+
+ssize_t GetXattr(const char *path, const char *name, void *value,
+                 size_t size) {
+#if defined(__APPLE__)
+  return getxattr(path, name, value, size, 0, 0);
+#else
+  return getxattr(path, name, value, size);
+#endif
+}
+
+int SetXattr(const char *path, const char *name, const void *value,
+             size_t size) {
+#if defined(__APPLE__)
+  return setxattr(path, name, value, size, 0, 0);
+#else
+  return setxattr(path, name, value, size, 0);
+#endif
+}
+
+void Benchmark(int repeat, const std::string &dir, size_t files,
+               size_t depth) {
+  const std::string wide = dir + "/wide";
+  MakeDirectory(wide);
+  std::vector<std::string> paths;
+  for (size_t i = 0; i < files; i++) {
+    paths.push_back(wide + "/file" + std::to_string(i));
+    MakeFile(paths.back());
+  }
+  fprintf(stdout, "%zu files, %zu directories deep\n", files, depth);
+
+  Timing stat_timing;
+  Timing lstat_timing;
+  for (int run = 0; run < repeat; run++) {
+    struct stat st;
+    double start = Now();
+    for (const std::string &path : paths) {
+      if (stat(path.c_str(), &st) != 0) {
+        Die("stat", path);
+      }
+    }
+    stat_timing.Update(start, run);
+    start = Now();
+    for (const std::string &path : paths) {
+      if (lstat(path.c_str(), &st) != 0) {
+        Die("lstat", path);
+      }
+    }
+    lstat_timing.Update(start, run);
+  }
+  Report("stat", stat_timing.seconds, files, "file");
+  Report("lstat", lstat_timing.seconds, files, "file");
+
+  Timing readdir_wide;
+  size_t entries = 0;
+  for (int run = 0; run < repeat; run++) {
+    double start = Now();
+    entries = ListDirectory(wide);
+    readdir_wide.Update(start, run);
+  }
+  Report("readdir wide", readdir_wide.seconds, entries, "entry");
+
+  // Each directory of the chain has a few files besides the next one.
+  std::vector<std::string> chain;
+  std::string deep = dir + "/deep";
+  for (size_t i = 0; i < depth; i++) {
+    MakeDirectory(deep);
+    for (int j = 0; j < 10; j++) {
+      MakeFile(deep + "/file" + std::to_string(j));
+    }
+    chain.push_back(deep);
+    deep += "/d";
+  }
+  Timing readdir_deep;
+  for (int run = 0; run < repeat; run++) {
+    double start = Now();
+    for (const std::string &path : chain) {
+      ListDirectory(path);
+    }
+    readdir_deep.Update(start, run);
+  }
+  Report("readdir deep", readdir_deep.seconds, depth, "directory");
+
+  Timing delete_tree;
+  const std::string tree = dir + "/tree";
+  MakeDirectory(tree);
+  for (int run = 0; run < repeat; run++) {
+    MakeTree(tree, files);
+    double start = Now();
+    int fd = open(tree.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+      Die("open", tree);
+    }
+    DeleteTreesBelow(fd, tree);
+    delete_tree.Update(start, run);
+  }
+  Report("delete tree", delete_tree.seconds,
+         files + (files + kFilesPerDirectory - 1) / kFilesPerDirectory,
+         "entry");
+
+  char digest[kDigestLength] = {1, 2, 3, 4};
+  if (SetXattr(paths[0].c_str(), kDigestAttribute, digest, sizeof digest) !=
+      0) {
+    fprintf(stdout, "  %-16s skipped: %s\n", "getxattr", strerror(errno));
+  } else {
+    for (const std::string &path : paths) {
+      if (SetXattr(path.c_str(), kDigestAttribute, digest, sizeof digest)) {
+        Die("setxattr", path);
+      }
+    }
+    Timing getxattr_hit;
+    Timing getxattr_miss;
+    for (int run = 0; run < repeat; run++) {
+      char value[kDigestLength];
+      double start = Now();
+      for (const std::string &path : paths) {
+        if (GetXattr(path.c_str(), kDigestAttribute, value, sizeof value) !=
+            sizeof value) {
+          Die("getxattr", path);
+        }
+      }
+      getxattr_hit.Update(start, run);
+      start = Now();
+      for (const std::string &path : paths) {
+        GetXattr(path.c_str(), "user.benchmark.missing", value, sizeof value);
+      }
+      getxattr_miss.Update(start, run);
+    }
+    Report("getxattr", getxattr_hit.seconds, files, "file");
+    Report("getxattr missing", getxattr_miss.seconds, files, "file");
+  }
+
+  const std::string output = dir + "/output";
+  std::vector<char> buffer(1 << 20, 'x');
+  for (size_t size = 1 << 10; size <= buffer.size(); size <<= 2) {
+    Timing write_timing;
+    for (int run = 0; run < repeat; run++) {
+      double start = Now();
+      int fd = open(output.c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC,
+                    0644);
+      if (fd < 0) {
+        Die("open", output);
+      }
+      for (size_t written = 0; written < kWriteBytes; written += size) {
+        if (write(fd, buffer.data(), size) != static_cast<ssize_t>(size)) {
+          Die("write", output);
+        }
+      }
+      close(fd);
+      write_timing.Update(start, run);
+    }
+    const std::string what = "write " + std::to_string(size >> 10) + " KB";
+    fprintf(stdout, "  %-16s %9.3f ms %9.1f MB/s %9.0f ns/write\n",
+            what.c_str(), write_timing.seconds * 1e3,
+            kWriteBytes / 1048576.0 / write_timing.seconds,
+            write_timing.seconds * 1e9 / (kWriteBytes / size));
+  }
+  fflush(stdout);
+}
+
+void Usage() {
+  fprintf(stderr,
+          "Usage: native_posix_files_benchmark [--repeat N] [--dir DIR] "
+          "[--files N] [--depth N]\n");
+  exit(1);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  int repeat = 5;
+  const char *tmpdir = getenv("TMPDIR");
+  std::string dir = tmpdir != nullptr && *tmpdir ? tmpdir : "/tmp";
+  size_t files = 10000;
+  size_t depth = 100;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+      repeat = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc) {
+      dir = argv[++i];
+    } else if (strcmp(argv[i], "--files") == 0 && i + 1 < argc) {
+      files = strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+      depth = strtoul(argv[++i], nullptr, 10);
+    } else {
+      Usage();
+    }
+  }
+  if (repeat < 1 || files < 1 || depth < 1) {
+    Usage();
+  }
+
+  std::string work = dir + "/native_posix_files_benchmark.XXXXXX";
+  if (mkdtemp(&work[0]) == nullptr) {
+    Die("mkdtemp", work);
+  }
+  Benchmark(repeat, work, files, depth);
+
+  int fd = open(work.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    Die("open", work);
+  }
+  DeleteTreesBelow(fd, work);
+  rmdir(work.c_str());
+  return 0;
+}
@@ -0,0 +1,41 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The native methods of NativePosixFilesBenchmark, which make no system
+// calls: they measure what the entry points of unix_jni.cc pay before
+// getting to theirs.
+
+#include <jni.h>
+#include <string.h>
+
+#include "src/main/native/latin1_jni_path.h"
+
+// Only the JNI transition.
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFilesBenchmark_nativeNoop(
+    JNIEnv *env, jclass clazz) {}
+
+// The JNI transition and the conversion of a path, as every entry point that
+// takes one does. Returns the length of the path.
+extern "C" JNIEXPORT jint JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFilesBenchmark_nativeConvertPath(  // NOLINT
+    JNIEnv *env, jclass clazz, jstring path) {
+  char *path_chars = blaze_jni::GetStringLatin1Chars(env, path);
+  if (path_chars == nullptr) {
+    return -1;
+  }
+  jint length = strlen(path_chars);
+  blaze_jni::ReleaseStringLatin1Chars(path_chars);
+  return length;
+}
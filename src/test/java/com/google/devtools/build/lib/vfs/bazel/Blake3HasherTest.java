@@ -14,9 +14,17 @@
 
 package com.google.devtools.build.lib.vfs.bazel;
 
+import static com.google.common.truth.Truth.assertThat;
 import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertThrows;
+import static org.junit.Assume.assumeTrue;
 
+import com.google.devtools.build.lib.util.OS;
+import java.io.FileNotFoundException;
 import java.nio.charset.StandardCharsets;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.util.Arrays;
 import org.junit.Test;
 import org.junit.runner.RunWith;
 import org.junit.runners.JUnit4;
@@ -45,4 +53,41 @@ public class Blake3HasherTest {
     assertEquals(
         "d74981efa70a0c880b8d8c1985d075dbcbf679b99a5f9914e5aaf96b831a9e24", h.hash().toString());
   }
+
+  @Test
+  public void hashFiles() throws Exception {
+    assumeTrue(OS.getCurrent() != OS.WINDOWS);
+    byte[] large = new byte[3 << 20];
+    for (int i = 0; i < large.length; i++) {
+      large[i] = (byte) (i * 31);
+    }
+    byte[][] contents = {new byte[0], "hello world".getBytes(StandardCharsets.US_ASCII), large};
+    String[] paths = new String[contents.length];
+    for (int i = 0; i < contents.length; i++) {
+      paths[i] = Files.write(Files.createTempFile("blake3", null), contents[i]).toString();
+    }
+
+    byte[] digests = Blake3MessageDigest.hashFiles(paths, 2);
+
+    assertThat(digests).hasLength(contents.length * Blake3MessageDigest.OUT_LEN);
+    for (int i = 0; i < contents.length; i++) {
+      assertThat(
+              Arrays.copyOfRange(
+                  digests, i * Blake3MessageDigest.OUT_LEN, (i + 1) * Blake3MessageDigest.OUT_LEN))
+          .isEqualTo(Blake3HashFunction.INSTANCE.hashBytes(contents[i]).asBytes());
+    }
+    assertThat(Blake3MessageDigest.hashFile(paths[1]))
+        .isEqualTo(Blake3HashFunction.INSTANCE.hashBytes(contents[1]).asBytes());
+  }
+
+  @Test
+  public void hashFiles_missingFile() throws Exception {
+    assumeTrue(OS.getCurrent() != OS.WINDOWS);
+    Path missing = Files.createTempDirectory("blake3").resolve("missing");
+
+    FileNotFoundException e =
+        assertThrows(
+            FileNotFoundException.class, () -> Blake3MessageDigest.hashFile(missing.toString()));
+    assertThat(e).hasMessageThat().isEqualTo(missing + " (No such file or directory)");
+  }
 }
@@ -22,8 +22,10 @@ import com.google.devtools.build.lib.testutil.TestSpec;
 import com.google.devtools.build.lib.util.OS;
 import com.google.devtools.build.lib.windows.util.WindowsTestUtil;
 import java.io.File;
+import java.io.FileNotFoundException;
 import java.io.IOException;
 import java.nio.file.Files;
+import java.nio.file.NotDirectoryException;
 import java.util.Arrays;
 import java.util.HashMap;
 import java.util.Map;
@@ -217,6 +219,71 @@ public class WindowsFileOperationsTest {
     assertThat(WindowsFileOperations.isSymlinkOrJunction(shortPath)).isFalse();
   }
 
+  @Test
+  public void testReadDirectory() throws Exception {
+    String root = testUtil.scratchDir("dir").toString();
+    testUtil.scratchFile("dir/file.txt", "hello");
+    testUtil.scratchDir("dir/sub");
+    testUtil.createJunctions(ImmutableMap.of("dir/junc", "dir/sub"));
+
+    Map<String, WindowsFileOperations.DirectoryEntry> entries = new HashMap<>();
+    for (WindowsFileOperations.DirectoryEntry entry : WindowsFileOperations.readDirectory(root)) {
+      entries.put(entry.getName(), entry);
+    }
+    assertThat(entries.keySet()).containsExactly("file.txt", "sub", "junc");
+
+    WindowsFileOperations.DirectoryEntry file = entries.get("file.txt");
+    assertThat(file.isDirectory()).isFalse();
+    assertThat(file.isReparsePoint()).isFalse();
+    assertThat(file.getSize()).isEqualTo(5);
+    assertThat(file.getChangeTime())
+        .isEqualTo(WindowsFileOperations.getLastChangeTime(root + "\\file.txt", false));
+    assertThat(entries.get("sub").isDirectory()).isTrue();
+    assertThat(entries.get("sub").isReparsePoint()).isFalse();
+    assertThat(entries.get("junc").isReparsePoint()).isTrue();
+    // IO_REPARSE_TAG_MOUNT_POINT
+    assertThat(entries.get("junc").getReparseTag()).isEqualTo(0xA0000003);
+
+    try {
+      WindowsFileOperations.readDirectory(root + "\\file.txt");
+      fail("expected to throw");
+    } catch (NotDirectoryException e) {
+      // Expected.
+    }
+    try {
+      WindowsFileOperations.readDirectory(root + "\\missing");
+      fail("expected to throw");
+    } catch (FileNotFoundException e) {
+      // Expected.
+    }
+  }
+
+  @Test
+  public void testDeleteTreesBelow() throws Exception {
+    String root = testUtil.scratchDir("dir").toString();
+    testUtil.scratchFile("dir/file.txt", "hello");
+    testUtil.scratchFile("dir/sub/file.txt", "hello");
+    testUtil.scratchFile("dir/sub/subsub/file.txt", "hello");
+    new File(root, "sub/readonly.txt").createNewFile();
+    new File(root, "sub/readonly.txt").setReadOnly();
+    testUtil.scratchFile("target/kept.txt", "kept");
+    testUtil.createJunctions(ImmutableMap.of("dir/sub/junc", "target"));
+
+    WindowsFileOperations.deleteTreesBelow(root);
+
+    assertThat(new File(root).isDirectory()).isTrue();
+    assertThat(new File(root).list()).isEmpty();
+    // The junction was deleted, but not what it pointed to.
+    assertThat(new File(scratchRoot, "target/kept.txt").exists()).isTrue();
+
+    try {
+      WindowsFileOperations.deleteTreesBelow(root + "\\missing");
+      fail("expected to throw");
+    } catch (FileNotFoundException e) {
+      // Expected.
+    }
+  }
+
   @Test
   public void testGetLongPath() throws Exception {
     File foo = testUtil.scratchDir("foo").toAbsolutePath().toFile();
@@ -180,6 +180,20 @@ public class WindowsProcessesTest {
     assertNoProcessError();
   }
 
+  @Test
+  public void testResourceUsage() throws Exception {
+    process =
+        WindowsProcesses.createProcess(mockBinary, mockArgs("X0"), null, null, null, null);
+    assertThat(WindowsProcesses.getResourceUsage(process)).isNull();
+    assertThat(WindowsProcesses.waitFor(process, -1)).isEqualTo(0);
+    long[] usage = WindowsProcesses.getResourceUsage(process);
+    assertThat(usage).hasLength(8);
+    // The JVM takes some CPU time and memory to start.
+    assertThat(usage[0] + usage[1]).isGreaterThan(0);
+    assertThat(usage[6]).isGreaterThan(0);
+    assertThat(usage[7]).isAtLeast(usage[6]);
+  }
+
   @Test
   public void testPartialRead() throws Exception {
     process =
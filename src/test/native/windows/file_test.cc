@@ -455,5 +455,24 @@ TEST(FileTests, TestNormalize) {
 #undef ASSERT_NORMALIZE
 }
 
+TEST(FileTests, TestNormalizeTo) {
+  wchar_t buf[64];
+  EXPECT_EQ(NormalizeTo(L"c:", 2, buf), 3u);
+  EXPECT_EQ(std::wstring(buf), L"c:\\");
+  EXPECT_EQ(NormalizeTo(L"\\\\?\\c:/foo/../bar/", 18, buf), 6u);
+  EXPECT_EQ(std::wstring(buf), L"c:\\bar");
+  // Only the first `len` characters count.
+  EXPECT_EQ(NormalizeTo(L"foo/bar/baz", 7, buf), 7u);
+  EXPECT_EQ(std::wstring(buf), L"foo\\bar");
+
+  // In place.
+  wcscpy(buf, L"./../foo//./bar");
+  EXPECT_EQ(NormalizeTo(buf, wcslen(buf), buf), 10u);
+  EXPECT_EQ(std::wstring(buf), L"..\\foo\\bar");
+  char cbuf[16] = "a/./../";
+  EXPECT_EQ(NormalizeTo(cbuf, strlen(cbuf), cbuf), 0u);
+  EXPECT_EQ(std::string(cbuf), "");
+}
+
 }  // namespace windows
 }  // namespace bazel
@@ -566,6 +566,10 @@ class LauncherTest(test_base.TestBase):
     classpath = stdout[stdout.index('-classpath') + 1]
     self.assertRegex(classpath, r'foo-[A-Za-z0-9]+-classpath.jar$')
 
+    # The classpath jar is kept and reused for the same classpath.
+    _, stdout, _ = self.RunProgram([binary, '--classpath_limit=0', print_cmd])
+    self.assertEqual(classpath, stdout[stdout.index('-classpath') + 1])
+
   def testWindowsNativeLauncherInNonEnglishPath(self):
     if not self.IsWindows():
       return
@@ -395,6 +395,32 @@ function test_proxy_settings() {
   fi
 }
 
+function test_unix_domain_socket() {
+  case "$(uname -s | tr '[:upper:]' '[:lower:]')" in
+    msys*|mingw*|cygwin*)
+      return
+      ;;
+  esac
+
+  local server_pid1
+  server_pid1="$(bazel --experimental_unix_domain_socket info server_pid \
+    2>$TEST_log)" || fail "Expected success"
+  local output_base
+  output_base="$(bazel --experimental_unix_domain_socket info output_base \
+    2>$TEST_log)" || fail "Expected success"
+  local server_pid2
+  server_pid2="$(bazel --experimental_unix_domain_socket info server_pid \
+    2>$TEST_log)" || fail "Expected success"
+  assert_equals "$server_pid1" "$server_pid2"
+  expect_not_log "WARNING.* Running B\\(azel\\|laze\\) server needs to be killed"
+  assert_contains "^unix" "$output_base/server/command_port"
+
+  # Going back to TCP restarts the server.
+  bazel info server_pid >/dev/null 2>$TEST_log || fail "Expected success"
+  expect_log "WARNING.* Running B\\(azel\\|laze\\) server needs to be killed"
+  assert_not_contains "^unix" "$output_base/server/command_port"
+}
+
 function test_macos_qos_class() {
   for class in utility background; do
     bazel --macos_qos_class="${class}" info >"${TEST_log}" 2>&1 \
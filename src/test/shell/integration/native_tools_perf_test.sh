@@ -0,0 +1,214 @@
+#!/bin/bash
+#
+# Copyright 2024 The Bazel Authors. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# A performance gate for the native tools: times each of them on the same
+# inputs and compares the times with the baselines.
+#
+#   native_tools_perf_test.sh BASELINES SINGLEJAR IJAR ZIPPER ONE_VERSION
+#       BUILD_RUNFILES PROCESS_WRAPPER LINUX_SANDBOX JAR...
+#
+# The inputs are the checked-in JARs and what is made from them: their
+# classes, and a runfiles manifest of as many entries as there are classes,
+# times 20. Each case runs its tool a number of times, and the best of
+# PERF_GATE_RUNS (default 5) such runs is its time.
+#
+# A case that takes more than PERF_GATE_TOLERANCE percent (default 15) longer
+# than in BASELINES fails the test, or only warns if PERF_GATE_MODE is "warn".
+# Cases without a baseline are only reported. The measured times are written
+# to baselines.txt in the undeclared outputs, to replace BASELINES with after
+# a deliberate change.
+#
+# The times depend on the machine, which is why the test is manual: the
+# baselines only mean something on the kind of machine they were taken on.
+
+set -euo pipefail
+
+runs="${PERF_GATE_RUNS:-5}"
+tolerance="${PERF_GATE_TOLERANCE:-15}"
+mode="${PERF_GATE_MODE:-fail}"
+
+[[ $# -ge 9 ]] || {
+  echo "Usage: $0 BASELINES SINGLEJAR IJAR ZIPPER ONE_VERSION" \
+      "BUILD_RUNFILES PROCESS_WRAPPER LINUX_SANDBOX JAR..." >&2
+  exit 1
+}
+absolute() {
+  echo "$(cd "$(dirname "$1")" && pwd)/$(basename "$1")"
+}
+baselines="$(absolute "$1")"
+singlejar="$(absolute "$2")"
+ijar="$(absolute "$3")"
+zipper="$(absolute "$4")"
+one_version="$(absolute "$5")"
+build_runfiles="$(absolute "$6")"
+process_wrapper="$(absolute "$7")"
+linux_sandbox="$(absolute "$8")"
+shift 8
+jars=()
+for jar in "$@"; do
+  jars+=("$(absolute "${jar}")")
+done
+
+dir="$(mktemp -d "${TEST_TMPDIR:-${TMPDIR:-/tmp}}/native_tools_perf.XXXXXXXX")"
+trap 'chmod -R u+w "${dir}"; rm -rf "${dir}"' EXIT
+outputs="${TEST_UNDECLARED_OUTPUTS_DIR:-${dir}}"
+measured="${outputs}/baselines.txt"
+
+# The classes of the JARs, for zipper and the runfiles manifest.
+class_jars=()
+for jar in "${jars[@]}"; do
+  [[ "${jar}" == *-sources.jar ]] || class_jars+=("${jar}")
+done
+mkdir "${dir}/classes"
+for jar in "${class_jars[@]}"; do
+  (cd "${dir}/classes" && "${zipper}" x "${jar}")
+done
+files=()
+while IFS= read -r file; do
+  files+=("${file}")
+done < <(cd "${dir}/classes" && find . -type f | sed 's|^\./||' | sort)
+for ((i = 0; i < 20; i++)); do
+  for file in "${files[@]}"; do
+    echo "_main/${i}/${file} ${dir}/classes/${file}"
+  done
+done > "${dir}/MANIFEST"
+
+one_version_inputs=()
+for jar in "${class_jars[@]}"; do
+  one_version_inputs+=("${jar},//third_party:$(basename "${jar}" .jar)")
+done
+
+# Runs `iterations` times the command of the case, PERF_GATE_RUNS times over,
+# and prints the best time in milliseconds.
+time_case() {
+  local iterations="$1"
+  shift
+  local best=""
+  for ((run = 0; run < runs; run++)); do
+    local start end
+    start=$(date +%s%N)
+    for ((i = 0; i < iterations; i++)); do
+      "$@" > /dev/null 2> "${dir}/stderr" || {
+        cat "${dir}/stderr" >&2
+        return 1
+      }
+    done
+    end=$(date +%s%N)
+    local ms=$(((end - start) / 1000000))
+    if [[ -z "${best}" || "${ms}" -lt "${best}" ]]; then
+      best="${ms}"
+    fi
+  done
+  echo "${best}"
+}
+
+case_singlejar() {
+  "${singlejar}" --output "${dir}/singlejar.jar" --sources "${jars[@]}"
+}
+
+case_ijar() {
+  local jar
+  for jar in "${class_jars[@]}"; do
+    "${ijar}" "${jar}" "${dir}/ijar.jar"
+  done
+}
+
+case_zipper_create() {
+  (cd "${dir}/classes" && "${zipper}" c "${dir}/zipper.zip" "${files[@]}")
+}
+
+case_zipper_extract() {
+  rm -rf "${dir}/extracted"
+  "${zipper}" x "${dir}/zipper.zip" -d "${dir}/extracted"
+}
+
+case_one_version() {
+  "${one_version}" --output "${dir}/one_version" \
+      --inputs "${one_version_inputs[@]}"
+}
+
+case_build_runfiles_create() {
+  rm -rf "${dir}/runfiles"
+  "${build_runfiles}" "${dir}/MANIFEST" "${dir}/runfiles"
+}
+
+case_build_runfiles_update() {
+  "${build_runfiles}" "${dir}/MANIFEST" "${dir}/runfiles"
+}
+
+case_process_wrapper() {
+  "${process_wrapper}" /bin/true
+}
+
+case_linux_sandbox() {
+  "${linux_sandbox}" -W "${dir}" -- /bin/true
+}
+
+# The cases and how many times to run them per run, for times that are long
+# enough to compare.
+cases=(
+  "singlejar 10"
+  "ijar 10"
+  "zipper_create 30"
+  "zipper_extract 10"
+  "one_version 50"
+  "build_runfiles_create 3"
+  "build_runfiles_update 5"
+  "process_wrapper 100"
+  "linux_sandbox 20"
+)
+
+{
+  echo "# The milliseconds that each case of native_tools_perf_test takes."
+  echo "# Written by the test on $(uname -srm)."
+} > "${measured}"
+printf "%-24s %10s %10s %8s\n" "case" "baseline" "measured" "change"
+exit_code=0
+for c in "${cases[@]}"; do
+  read -r name iterations <<< "${c}"
+  if [[ "${name}" == linux_sandbox ]] &&
+      ! "${linux_sandbox}" -W "${dir}" -- /bin/true 2> /dev/null; then
+    printf "%-24s skipped: linux-sandbox does not work here\n" "${name}"
+    continue
+  fi
+  if [[ "${name}" == zipper_extract ]]; then
+    case_zipper_create
+  elif [[ "${name}" == build_runfiles_update ]]; then
+    case_build_runfiles_create
+  fi
+  ms="$(time_case "${iterations}" "case_${name}")"
+  echo "${name} ${ms}" >> "${measured}"
+
+  baseline="$(awk -v name="${name}" '$1 == name { print $2 }' \
+      "${baselines}")"
+  if [[ -z "${baseline}" ]]; then
+    printf "%-24s %10s %10d\n" "${name}" "-" "${ms}"
+    continue
+  fi
+  change=$(((ms - baseline) * 100 / (baseline > 0 ? baseline : 1)))
+  verdict=""
+  if [[ "${change}" -gt "${tolerance}" ]]; then
+    if [[ "${mode}" == warn ]]; then
+      verdict="  WARNING: more than ${tolerance}% slower"
+    else
+      verdict="  FAIL: more than ${tolerance}% slower"
+      exit_code=1
+    fi
+  fi
+  printf "%-24s %10d %10d %7d%%%s\n" "${name}" "${baseline}" "${ms}" \
+      "${change}" "${verdict}"
+done
+exit "${exit_code}"
@@ -216,6 +216,27 @@ function test_sigterm_kill() {
   assert_stdout 'ignoring signal'
 }
 
+function test_max_output_bytes_keeps_short_output() {
+  $process_wrapper --max_output_bytes=1000 --stdout=$OUT --stderr=$ERR \
+    /bin/sh -c "echo out; echo err >&2" &> $TEST_log || fail
+  assert_output "out" "err"
+}
+
+function test_max_output_bytes_keeps_head_and_tail() {
+  $process_wrapper --max_output_bytes=20 --stdout=$OUT --stderr=$ERR \
+    /bin/sh -c "seq 1 100; echo err >&2" &> $TEST_log || fail
+  assert_equals "1
+2
+3
+4
+5
+
+process-wrapper: dropped 276 bytes of output here, kept the first 10 and the last 10
+9
+100" "$(cat $OUT)"
+  assert_equals "err" "$(cat $ERR)"
+}
+
 function test_execvp_error_message() {
   local code=0
   $process_wrapper --stdout=$OUT --stderr=$ERR /bin/notexisting &> $TEST_log || code=$?
@@ -12,8 +12,14 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
 #include "src/tools/launcher/java_launcher.h"
 
+#include <stdint.h>
+#include <windows.h>
+
 #include <memory>
 #include <sstream>
 #include <string>
@@ -161,37 +167,36 @@ static void WriteJarClasspath(const wstring& jar_path,
   }
 }
 
-wstring JavaBinaryLauncher::GetJunctionBaseDir() {
+// Return the 64-bit FNV-1a hash of `classpath` in hexadecimal.
+static wstring HashClasspath(const wstring& classpath) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (wchar_t c : classpath) {
+    hash ^= static_cast<uint64_t>(c);
+    hash *= 0x100000001b3ULL;
+  }
+  wchar_t buffer[17];
+  swprintf(buffer, 17, L"%016llx", static_cast<unsigned long long>(hash));
+  return buffer;
+}
+
+wstring JavaBinaryLauncher::GetJunctionBaseDir(const wstring& classpath_hash) {
   wstring binary_base_path = GetBinaryPathWithExtension(GetLauncherPath());
   wstring result;
-  if (!NormalizePath(binary_base_path + L".j", &result)) {
+  if (!NormalizePath(binary_base_path + L".j-" + classpath_hash, &result)) {
     die(L"Failed to get normalized junction base directory.");
   }
   return result;
 }
 
-void JavaBinaryLauncher::DeleteJunctionBaseDir() {
-  wstring junction_base_dir_norm = GetJunctionBaseDir();
-  if (!DoesDirectoryPathExist(junction_base_dir_norm.c_str())) {
-    return;
-  }
-  vector<wstring> junctions;
-  blaze_util::GetAllFilesUnderW(junction_base_dir_norm, &junctions);
-  for (const auto& junction : junctions) {
-    if (!DeleteDirectoryByPath(junction.c_str())) {
-      PrintError(L"Failed to delete junction directory: %hs",
-                 GetLastErrorString().c_str());
-    }
-  }
-  if (!DeleteDirectoryByPath(junction_base_dir_norm.c_str())) {
-    PrintError(L"Failed to delete junction directory: %hs",
-               GetLastErrorString().c_str());
-  }
-}
-
 wstring JavaBinaryLauncher::CreateClasspathJar(const wstring& classpath) {
   wstring binary_base_path = GetBinaryPathWithoutExtension(GetLauncherPath());
   wstring abs_manifest_jar_dir_norm = GetManifestJarDir(binary_base_path);
+  // The junctions and the jar only depend on the classpath and on the path of
+  // this binary, so a jar that an earlier launch created for the same
+  // classpath can be reused.
+  wstring classpath_hash = HashClasspath(classpath);
+  wstring manifest_jar_path =
+      binary_base_path + L"-" + classpath_hash + L"-classpath.jar";
 
   wostringstream manifest_classpath;
   manifest_classpath << L"Class-Path:";
@@ -201,10 +206,8 @@ wstring JavaBinaryLauncher::CreateClasspathJar(const wstring& classpath) {
   // A set to store all junctions created.
   // The key is the target path, the value is the junction path.
   std::unordered_map<wstring, wstring> jar_dirs;
-  wstring junction_base_dir_norm = GetJunctionBaseDir();
+  wstring junction_base_dir_norm = GetJunctionBaseDir(classpath_hash);
   int junction_count = 0;
-  // Make sure the junction base directory doesn't exist already.
-  DeleteJunctionBaseDir();
   blaze_util::MakeDirectoriesW(junction_base_dir_norm, 0755);
 
   while (getline(classpath_ss, path, L';')) {
@@ -224,6 +227,9 @@ wstring JavaBinaryLauncher::CreateClasspathJar(const wstring& classpath) {
           junction = junction_base_dir_norm + L"\\" +
                      std::to_wstring(junction_count++);
 
+          // This succeeds if an earlier launch created the same junction
+          // already, which checks that the junctions of a reused jar are
+          // still in place.
           wstring error;
           if (bazel::windows::CreateJunction(junction, jar_dir, &error) !=
               bazel::windows::CreateJunctionResult::kSuccess) {
@@ -244,6 +250,12 @@ wstring JavaBinaryLauncher::CreateClasspathJar(const wstring& classpath) {
     WriteJarClasspath(path, &manifest_classpath);
   }
 
+  if (DoesFilePathExist(manifest_jar_path.c_str())) {
+    return manifest_jar_path;
+  }
+
+  // Other launches of this binary may create the same jar concurrently, so
+  // create it under a unique name and move it in place once it is complete.
   wstring rand_id = L"-" + GetRandomStr(10);
   // Enable long path support for jar_manifest_file_path.
   wstring jar_manifest_file_path =
@@ -268,20 +280,36 @@ wstring JavaBinaryLauncher::CreateClasspathJar(const wstring& classpath) {
   }
 
   // Create the command for generating classpath jar.
-  wstring manifest_jar_path = binary_base_path + rand_id + L"-classpath.jar";
+  wstring tmp_jar_path = binary_base_path + rand_id + L"-classpath.jar";
   wstring jar_bin = this->Rlocation(this->GetLaunchInfoByKey(JAR_BIN_PATH));
   vector<wstring> arguments;
   arguments.push_back(L"cvfm");
-  arguments.push_back(manifest_jar_path);
+  arguments.push_back(tmp_jar_path);
   arguments.push_back(jar_manifest_file_path);
 
   if (this->LaunchProcess(jar_bin, arguments, /* suppressOutput */ true) != 0) {
-    die(L"Couldn't create classpath jar: %s", manifest_jar_path.c_str());
+    die(L"Couldn't create classpath jar: %s", tmp_jar_path.c_str());
   }
 
   // Delete jar_manifest_file after classpath jar is created.
   DeleteFileByPath(jar_manifest_file_path.c_str());
 
+  wstring tmp_jar_long_path = tmp_jar_path;
+  wstring manifest_jar_long_path = manifest_jar_path;
+  blaze_util::AddUncPrefixMaybe(&tmp_jar_long_path);
+  blaze_util::AddUncPrefixMaybe(&manifest_jar_long_path);
+  if (!MoveFileExW(tmp_jar_long_path.c_str(), manifest_jar_long_path.c_str(),
+                   0)) {
+    // Another launch may have moved its jar in place first.
+    DWORD err = GetLastError();
+    DeleteFileByPath(tmp_jar_path.c_str());
+    if (err != ERROR_ALREADY_EXISTS && err != ERROR_FILE_EXISTS) {
+      SetLastError(err);
+      die(L"Couldn't move classpath jar to %s: %hs",
+          manifest_jar_path.c_str(), GetLastErrorString().c_str());
+    }
+  }
+
   return manifest_jar_path;
 }
 
@@ -377,10 +405,8 @@ ExitCode JavaBinaryLauncher::Launch() {
   // Check if CLASSPATH is over classpath length limit.
   // If it does, then we create a classpath jar to pass CLASSPATH value.
   wstring classpath_str = classpath.str();
-  wstring classpath_jar = L"";
   if (classpath_str.length() > this->classpath_limit) {
-    classpath_jar = CreateClasspathJar(classpath_str);
-    arguments.push_back(classpath_jar);
+    arguments.push_back(CreateClasspathJar(classpath_str));
   } else {
     arguments.push_back(classpath_str);
   }
@@ -414,15 +440,8 @@ ExitCode JavaBinaryLauncher::Launch() {
     escaped_arguments.push_back(bazel::windows::WindowsEscapeArg(arg));
   }
 
-  ExitCode exit_code = this->LaunchProcess(java_bin, escaped_arguments);
-
-  // Delete classpath jar file after execution.
-  if (!classpath_jar.empty()) {
-    DeleteFileByPath(classpath_jar.c_str());
-    DeleteJunctionBaseDir();
-  }
-
-  return exit_code;
+  // The classpath jar is kept for the next launch.
+  return this->LaunchProcess(java_bin, escaped_arguments);
 }
 
 }  // namespace launcher
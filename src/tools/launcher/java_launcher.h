@@ -90,15 +90,16 @@ class JavaBinaryLauncher : public BinaryLauncherBase {
   // Create a classpath jar to pass CLASSPATH value when its length is over
   // limit.
   //
-  // Return the path of the classpath jar created.
+  // The jar and the junctions it refers to are named after a hash of
+  // `classpath`, and are kept after the program exits, so that later launches
+  // with the same classpath reuse them.
+  //
+  // Return the path of the classpath jar.
   std::wstring CreateClasspathJar(const std::wstring& classpath);
 
-  // Creat a directory based on the binary path, all the junctions will be
-  // generated under this directory.
-  std::wstring GetJunctionBaseDir();
-
-  // Delete all the junction directory and all the junctions under it.
-  void DeleteJunctionBaseDir();
+  // Creat a directory based on the binary path and the classpath hash, all the
+  // junctions will be generated under this directory.
+  std::wstring GetJunctionBaseDir(const std::wstring& classpath_hash);
 };
 
 }  // namespace launcher
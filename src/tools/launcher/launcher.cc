@@ -20,7 +20,6 @@
 #include <windows.h>
 
 #include <algorithm>
-#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -35,9 +34,7 @@
 namespace bazel {
 namespace launcher {
 
-using std::ifstream;
 using std::string;
-using std::unordered_map;
 using std::vector;
 using std::wostringstream;
 using std::wstring;
@@ -70,6 +67,8 @@ BinaryLauncherBase::BinaryLauncherBase(
       manifest_file(FindManifestFile(launcher_path.c_str())),
       runfiles_dir(GetRunfilesDir(launcher_path.c_str())),
       workspace_name(GetLaunchInfoByKey(WORKSPACE_NAME)),
+      manifest_data(nullptr),
+      manifest_size(0),
       symlink_runfiles_enabled(GetLaunchInfoByKey(SYMLINK_RUNFILES_ENABLED) ==
                                L"1") {
   for (int i = 0; i < argc; i++) {
@@ -79,7 +78,13 @@ BinaryLauncherBase::BinaryLauncherBase(
   // runfiles directory will be used by default. On Windows, the manifest is
   // used locally, and the runfiles directory is used remotely.
   if (!manifest_file.empty()) {
-    ParseManifestFile(&manifest_file_map, manifest_file);
+    MapManifestFile(manifest_file);
+  }
+}
+
+BinaryLauncherBase::~BinaryLauncherBase() {
+  if (manifest_data != nullptr) {
+    UnmapViewOfFile(manifest_data);
   }
 }
 
@@ -137,25 +142,41 @@ wstring BinaryLauncherBase::GetRunfilesPath() const {
   return runfiles_path;
 }
 
-void BinaryLauncherBase::ParseManifestFile(ManifestFileMap* manifest_file_map,
-                                           const wstring& manifest_path) {
-  ifstream manifest_file(AsAbsoluteWindowsPath(manifest_path.c_str()).c_str());
-
-  if (!manifest_file) {
+void BinaryLauncherBase::MapManifestFile(const wstring& manifest_path) {
+  wstring path = AsAbsoluteWindowsPath(manifest_path.c_str());
+  HANDLE file = CreateFileW(path.c_str(), GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
     die(L"Couldn't open MANIFEST file: %s", manifest_path.c_str());
   }
-
-  string line;
-  while (getline(manifest_file, line)) {
-    size_t space_pos = line.find_first_of(' ');
-    if (space_pos == string::npos) {
-      die(L"Wrong MANIFEST format at line: %s", line.c_str());
-    }
-    wstring wline = blaze_util::CstringToWstring(line);
-    wstring key = wline.substr(0, space_pos);
-    wstring value = wline.substr(space_pos + 1);
-    manifest_file_map->insert(make_pair(key, value));
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    die(L"Couldn't get the size of MANIFEST file %s: %hs",
+        manifest_path.c_str(), GetLastErrorString().c_str());
+  }
+  // An empty file cannot be mapped, and has no entries to look up anyway.
+  if (size.QuadPart == 0) {
+    CloseHandle(file);
+    return;
+  }
+  HANDLE mapping =
+      CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (mapping == nullptr) {
+    die(L"Couldn't map MANIFEST file %s: %hs", manifest_path.c_str(),
+        GetLastErrorString().c_str());
+  }
+  // The view keeps the mapping alive until it is unmapped.
+  manifest_data = static_cast<const char*>(
+      MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  CloseHandle(mapping);
+  if (manifest_data == nullptr) {
+    die(L"Couldn't map MANIFEST file %s: %hs", manifest_path.c_str(),
+        GetLastErrorString().c_str());
   }
+  manifest_size = static_cast<size_t>(size.QuadPart);
 }
 
 wstring BinaryLauncherBase::Rlocation(wstring path,
@@ -175,18 +196,20 @@ wstring BinaryLauncherBase::Rlocation(wstring path,
     path = this->workspace_name + L"/" + path;
   }
 
-  // If the manifest file map is empty, then we're using the runfiles directory
+  // If there are no manifest entries, then we're using the runfiles directory
   // instead.
-  if (manifest_file_map.empty()) {
+  if (manifest_data == nullptr) {
     return runfiles_dir + L"/" + path;
   }
 
-  auto entry = manifest_file_map.find(path);
-  if (entry == manifest_file_map.end()) {
+  // Only the entry we look for is converted.
+  string value;
+  if (!FindManifestEntry(manifest_data, manifest_size,
+                         blaze_util::WstringToCstring(path), &value)) {
     die(L"Rlocation failed on %s, path doesn't exist in MANIFEST file",
         path.c_str());
   }
-  return entry->second;
+  return blaze_util::CstringToWstring(value);
 }
 
 wstring BinaryLauncherBase::GetLaunchInfoByKey(const string& key) {
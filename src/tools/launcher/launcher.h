@@ -16,7 +16,6 @@
 #define BAZEL_SRC_TOOLS_LAUNCHER_LAUNCHER_H_
 
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 #include "src/tools/launcher/util/data_parser.h"
@@ -38,14 +37,12 @@ struct CmdLine {
 };
 
 class BinaryLauncherBase {
-  typedef std::unordered_map<std::wstring, std::wstring> ManifestFileMap;
-
  public:
   BinaryLauncherBase(const LaunchDataParser::LaunchInfo& launch_info,
                      const std::wstring& launcher_path, int argc,
                      wchar_t* argv[]);
 
-  virtual ~BinaryLauncherBase() = default;
+  virtual ~BinaryLauncherBase();
 
   // Get launch information based on a launch info key.
   std::wstring GetLaunchInfoByKey(const std::string& key);
@@ -111,8 +108,11 @@ class BinaryLauncherBase {
   // The workspace name of the repository this target belongs to.
   const std::wstring workspace_name;
 
-  // A map to store all entries of the manifest file.
-  ManifestFileMap manifest_file_map;
+  // The contents of the manifest file, mapped into memory, or null if there
+  // is no manifest file or it is empty. Rlocation looks up entries in place
+  // instead of parsing all of them up front.
+  const char* manifest_data;
+  size_t manifest_size;
 
   // If symlink runfiles tree is enabled, this value is true.
   const bool symlink_runfiles_enabled;
@@ -140,9 +140,9 @@ class BinaryLauncherBase {
   // or 2. <path>/<to>/<binary>/<target_name>.runfiles_manifest
   static std::wstring FindManifestFile(const wchar_t* launcher_path);
 
-  // Parse manifest file into a map
-  static void ParseManifestFile(ManifestFileMap* manifest_file_map,
-                                const std::wstring& manifest_path);
+  // Map the manifest file into memory, setting manifest_data and
+  // manifest_size.
+  void MapManifestFile(const std::wstring& manifest_path);
 };
 
 }  // namespace launcher
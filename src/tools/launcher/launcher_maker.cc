@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cerrno>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
@@ -20,7 +21,19 @@
 #include <string>
 
 #ifdef _WIN32
+#include <windows.h>
+
 #include "src/main/cpp/util/path_platform.h"
+#elif defined(__APPLE__)
+#include <copyfile.h>
+#include <unistd.h>
+#else
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif  // __linux__
 #endif  // _WIN32
 
 //  This is a replacement for
@@ -35,6 +48,11 @@
 //  appends each line of the launch info as a null-terminated string. At the
 //  end, the size of the launch data written is appended as a long value (8
 //  bytes).
+//
+//  The launcher is the same for every binary, so where the file system can,
+//  the copy shares its blocks instead of writing them again: CopyFileEx
+//  block-clones on ReFS, copyfile clones on APFS, and on Linux FICLONE does
+//  on Btrfs, XFS and others, with copy_file_range otherwise.
 
 #ifdef _WIN32
 
@@ -51,12 +69,121 @@ std::wstring convert_path(char* path) {
   return wpath;
 }
 
+bool copy_launcher(const std::wstring& src, const std::wstring& dst) {
+  if (!CopyFileExW(src.c_str(), dst.c_str(), nullptr, nullptr, nullptr, 0)) {
+    fprintf(stderr, "Failed to copy %ls to %ls: error %lu\n", src.c_str(),
+            dst.c_str(), GetLastError());
+    return false;
+  }
+  return true;
+}
+
 #else  // _WIN32
 
 #define STRING_TYPE std::string
 #define STRING_FORMAT "%s"
 std::string convert_path(char* path) { return path; }
 
+#ifdef __APPLE__
+
+bool copy_launcher(const std::string& src, const std::string& dst) {
+  // Cloning needs the output not to exist.
+  if (unlink(dst.c_str()) < 0 && errno != ENOENT) {
+    fprintf(stderr, "Failed to delete %s: %s\n", dst.c_str(),
+            strerror(errno));
+    return false;
+  }
+  // Clones if it can, copies otherwise.
+  if (copyfile(src.c_str(), dst.c_str(), nullptr, COPYFILE_CLONE) < 0) {
+    fprintf(stderr, "Failed to copy %s to %s: %s\n", src.c_str(),
+            dst.c_str(), strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+#else  // __APPLE__
+
+// Copies what is left of `src` to `dst`, in the kernel if it can.
+static bool copy_data(int src, int dst) {
+#ifdef __linux__
+  while (true) {
+    ssize_t n = copy_file_range(src, nullptr, dst, nullptr, 1 << 30, 0);
+    if (n == 0) {
+      return true;
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != ENOSYS && errno != EXDEV && errno != EINVAL &&
+          errno != EOPNOTSUPP) {
+        return false;
+      }
+      // Go on from where it stopped, through a buffer.
+      break;
+    }
+  }
+#endif  // __linux__
+  char buf[64 * 1024];
+  while (true) {
+    ssize_t n = read(src, buf, sizeof(buf));
+    if (n == 0) {
+      return true;
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    for (ssize_t written = 0; written < n;) {
+      ssize_t w = write(dst, buf + written, n - written);
+      if (w < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      written += w;
+    }
+  }
+}
+
+bool copy_launcher(const std::string& src, const std::string& dst) {
+  int src_fd = open(src.c_str(), O_RDONLY);
+  if (src_fd < 0) {
+    fprintf(stderr, "Failed to open %s: %s\n", src.c_str(), strerror(errno));
+    return false;
+  }
+  int dst_fd = open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0755);
+  if (dst_fd < 0) {
+    fprintf(stderr, "Failed to create %s: %s\n", dst.c_str(),
+            strerror(errno));
+    close(src_fd);
+    return false;
+  }
+  bool ok = true;
+#ifdef FICLONE
+  if (ioctl(dst_fd, FICLONE, src_fd) < 0)
+#endif  // FICLONE
+  {
+    ok = copy_data(src_fd, dst_fd);
+    if (!ok) {
+      fprintf(stderr, "Failed to copy %s to %s: %s\n", src.c_str(),
+              dst.c_str(), strerror(errno));
+    }
+  }
+  close(src_fd);
+  if (close(dst_fd) < 0 && ok) {
+    fprintf(stderr, "Failed to write %s: %s\n", dst.c_str(), strerror(errno));
+    ok = false;
+  }
+  return ok;
+}
+
+#endif  // __APPLE__
+
 #endif  // _WIN32
 
 int main(int argc, char** argv) {
@@ -69,19 +196,15 @@ int main(int argc, char** argv) {
   STRING_TYPE info_params = convert_path(argv[2]);
   STRING_TYPE output_path = convert_path(argv[3]);
 
-  std::ifstream src(launcher_path.c_str(), std::ios::binary);
-  if (!src.good()) {
-    fprintf(stderr, "Failed to open " STRING_FORMAT ": %s\n",
-            launcher_path.c_str(), strerror(errno));
+  if (!copy_launcher(launcher_path, output_path)) {
     return 1;
   }
-  std::ofstream dst(output_path.c_str(), std::ios::binary);
+  std::ofstream dst(output_path.c_str(), std::ios::binary | std::ios::app);
   if (!dst.good()) {
-    fprintf(stderr, "Failed to create " STRING_FORMAT ": %s\n",
+    fprintf(stderr, "Failed to open " STRING_FORMAT ": %s\n",
             output_path.c_str(), strerror(errno));
     return 1;
   }
-  dst << src.rdbuf();
 
   std::ifstream info_file(info_params.c_str());
   if (!info_file.good()) {
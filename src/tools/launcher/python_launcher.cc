@@ -14,6 +14,8 @@
 
 #include "src/tools/launcher/python_launcher.h"
 
+#include <windows.h>
+
 #include <string>
 #include <vector>
 
@@ -29,6 +31,45 @@ using std::wstring;
 static constexpr const char* PYTHON_BIN_PATH = "python_bin_path";
 static constexpr const char* USE_ZIP_FILE = "use_zip_file";
 static constexpr const char* PYTHON_FILE_SHORT_PATH = "python_file_short_path";
+static constexpr const char* ZIP_DIGEST = "zip_digest";
+
+// Returns the directory that the bootstrap stub of `zip_file` extracts it to,
+// and that later runs reuse: one per version of the zip file, named after its
+// digest if the launch info has it, and otherwise after the identity, size
+// and last write time of the file, which a rebuild changes. Returns "" if
+// the file cannot be queried.
+static wstring GetZipExtractDir(const wstring& zip_file,
+                                const wstring& digest) {
+  wchar_t temp_dir[MAX_PATH + 1];
+  DWORD len = GetTempPathW(MAX_PATH + 1, temp_dir);
+  if (len == 0 || len > MAX_PATH) {
+    return L"";
+  }
+  wstring key = digest;
+  if (key.empty()) {
+    HANDLE handle = CreateFileW(
+        AsAbsoluteWindowsPath(zip_file.c_str()).c_str(), 0,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+      return L"";
+    }
+    BY_HANDLE_FILE_INFORMATION info;
+    BOOL ok = GetFileInformationByHandle(handle, &info);
+    CloseHandle(handle);
+    if (!ok) {
+      return L"";
+    }
+    wchar_t buf[128];
+    swprintf_s(buf, L"%08lx-%08lx%08lx-%08lx%08lx-%08lx%08lx",
+               info.dwVolumeSerialNumber, info.nFileIndexHigh,
+               info.nFileIndexLow, info.nFileSizeHigh, info.nFileSizeLow,
+               info.ftLastWriteTime.dwHighDateTime,
+               info.ftLastWriteTime.dwLowDateTime);
+    key = buf;
+  }
+  return wstring(temp_dir, len) + L"Bazel.runfiles_cache\\" + key;
+}
 
 ExitCode PythonBinaryLauncher::Launch() {
   wstring python_binary = this->GetLaunchInfoByKey(PYTHON_BIN_PATH);
@@ -64,6 +105,12 @@ ExitCode PythonBinaryLauncher::Launch() {
     wstring use_zip_file = this->GetLaunchInfoByKey(USE_ZIP_FILE);
     if (use_zip_file == L"1") {
       python_file = GetBinaryPathWithoutExtension(GetLauncherPath()) + L".zip";
+      // Extracting the zip file on every run takes long with many files.
+      wstring extract_dir = GetZipExtractDir(
+          python_file, this->GetLaunchInfoByKeyOrEmpty(ZIP_DIGEST));
+      if (!extract_dir.empty()) {
+        SetEnv(L"BAZEL_PYTHON_ZIP_EXTRACT_DIR", extract_dir);
+      }
     } else {
       python_file = GetBinaryPathWithoutExtension(GetLauncherPath());
     }
@@ -12,7 +12,15 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include <fstream>
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+
+#include <string.h>
+
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -25,24 +33,73 @@
 namespace bazel {
 namespace launcher {
 
-using std::ifstream;
-using std::ios;
-using std::make_unique;
 using std::string;
 using std::unique_ptr;
 using std::wstring;
 
-int64_t LaunchDataParser::ReadDataSize(ifstream* binary) {
-  int64_t data_size;
-  binary->seekg(0 - sizeof(data_size), ios::end);
-  binary->read(reinterpret_cast<char*>(&data_size), sizeof(data_size));
-  return data_size;
+// How much of the end of the binary we read at first. The launch data is
+// usually much smaller, so that a single read gets both the data and its
+// size.
+static constexpr DWORD kTailSize = 16 * 1024;
+
+// Reads `size` bytes at `offset` in `binary` into `buffer`.
+static bool ReadAt(HANDLE binary, int64_t offset, DWORD size, char* buffer) {
+  OVERLAPPED overlapped = {0};
+  overlapped.Offset = static_cast<DWORD>(offset);
+  overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+  DWORD read;
+  return ReadFile(binary, buffer, size, &read, &overlapped) && read == size;
 }
 
-void LaunchDataParser::ReadLaunchData(ifstream* binary, char* launch_data,
-                                      int64_t data_size) {
-  binary->seekg(0 - data_size - sizeof(data_size), ios::end);
-  binary->read(launch_data, data_size);
+// Reads the launch data appended to `binary`, followed by its size as a
+// 64 bit integer. Sets `launch_data` to point to the data in `buffer`.
+static bool ReadLaunchData(HANDLE binary, unique_ptr<char[]>* buffer,
+                           const char** launch_data, int64_t* data_size) {
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(binary, &file_size)) {
+    PrintError(L"Cannot get the size of the binary: %hs",
+               GetLastErrorString().c_str());
+    return false;
+  }
+  const int64_t tail_size = std::min<int64_t>(file_size.QuadPart, kTailSize);
+  if (tail_size < static_cast<int64_t>(sizeof(*data_size))) {
+    PrintError(L"No data appended, cannot launch anything!");
+    return false;
+  }
+  buffer->reset(new char[tail_size]);
+  if (!ReadAt(binary, file_size.QuadPart - tail_size,
+              static_cast<DWORD>(tail_size), buffer->get())) {
+    PrintError(L"Cannot read launch data: %hs", GetLastErrorString().c_str());
+    return false;
+  }
+  memcpy(data_size, buffer->get() + tail_size - sizeof(*data_size),
+         sizeof(*data_size));
+  if (*data_size == 0) {
+    PrintError(L"No data appended, cannot launch anything!");
+    return false;
+  }
+  if (*data_size < 0 ||
+      *data_size > file_size.QuadPart - static_cast<int64_t>(sizeof(int64_t))) {
+    PrintError(L"Invalid launch data size: %lld", *data_size);
+    return false;
+  }
+
+  const int64_t total_size = *data_size + sizeof(*data_size);
+  if (total_size <= tail_size) {
+    *launch_data = buffer->get() + tail_size - total_size;
+    return true;
+  }
+  // The data doesn't fit into the tail we read; read all of it. The parser
+  // may look at the byte after the data, so null-terminate it.
+  buffer->reset(new char[*data_size + 1]);
+  buffer->get()[*data_size] = '\0';
+  if (!ReadAt(binary, file_size.QuadPart - total_size,
+              static_cast<DWORD>(*data_size), buffer->get())) {
+    PrintError(L"Cannot read launch data: %hs", GetLastErrorString().c_str());
+    return false;
+  }
+  *launch_data = buffer->get();
+  return true;
 }
 
 bool LaunchDataParser::ParseLaunchData(LaunchInfo* launch_info,
@@ -89,24 +146,20 @@ bool LaunchDataParser::ParseLaunchData(LaunchInfo* launch_info,
 
 bool LaunchDataParser::GetLaunchInfo(const wstring& binary_path,
                                      LaunchInfo* launch_info) {
-  unique_ptr<ifstream> binary =
-      make_unique<ifstream>(AsAbsoluteWindowsPath(binary_path.c_str()).c_str(),
-                            ios::binary | ios::in);
-  if (!binary->good()) {
+  HANDLE binary = CreateFileW(
+      AsAbsoluteWindowsPath(binary_path.c_str()).c_str(), GENERIC_READ,
+      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (binary == INVALID_HANDLE_VALUE) {
     PrintError(L"Cannot open the binary to read launch data");
     return false;
   }
-  int64_t data_size = ReadDataSize(binary.get());
-  if (data_size == 0) {
-    PrintError(L"No data appended, cannot launch anything!");
-    return false;
-  }
-  unique_ptr<char[]> launch_data(new char[data_size]);
-  ReadLaunchData(binary.get(), launch_data.get(), data_size);
-  if (!ParseLaunchData(launch_info, launch_data.get(), data_size)) {
-    return false;
-  }
-  return true;
+  unique_ptr<char[]> buffer;
+  const char* launch_data;
+  int64_t data_size;
+  const bool ok = ReadLaunchData(binary, &buffer, &launch_data, &data_size);
+  CloseHandle(binary);
+  return ok && ParseLaunchData(launch_info, launch_data, data_size);
 }
 
 }  // namespace launcher
@@ -130,6 +130,25 @@ TEST_F(LaunchDataParserTest, GetLaunchInfoTest) {
   ASSERT_EQ(GetLaunchInfo("no_such_key"), "Cannot find key: no_such_key");
 }
 
+TEST_F(LaunchDataParserTest, LargeLaunchInfoTest) {
+  // Larger than the tail of the binary that the parser reads at first.
+  vector<pair<string, string>> launch_info = {
+      {"binary_type", "Java"},
+      {"classpath", string(40000, 'x')},
+      {"workspace_name", "__main__"},
+  };
+
+  string binary_file = test_tmpdir + "/large_binary_file";
+  WriteBinaryFileWithMap(binary_file, launch_info);
+
+  parsed_launch_info = make_unique<LaunchDataParser::LaunchInfo>();
+  ASSERT_TRUE(ParseBinaryFile(binary_file, parsed_launch_info.get()));
+
+  for (auto const& entry : launch_info) {
+    ASSERT_EQ(entry.second, GetLaunchInfo(entry.first));
+  }
+}
+
 TEST_F(LaunchDataParserTest, EmptyLaunchInfoTest) {
   string binary_file = test_tmpdir + "/empty_binary_file";
   WriteBinaryFileWithMap(binary_file, {});
@@ -304,5 +304,66 @@ bool RelativeTo(const wstring& path, const wstring& base, wstring* result) {
   return true;
 }
 
+// Compare the key of the manifest line that starts at `line` to `key`, like
+// strcmp. `*value` and `*eol` are set to the start of the value and to the end
+// of the line.
+static int CompareManifestKey(const char* line, const char* end,
+                              const string& key, const char** value,
+                              const char** eol) {
+  *eol = std::find(line, end, '\n');
+  const char* space = std::find(line, *eol, ' ');
+  *value = space == *eol ? *eol : space + 1;
+  const size_t length = space - line;
+  const int result = memcmp(line, key.data(), std::min(length, key.size()));
+  if (result != 0) {
+    return result;
+  }
+  return length < key.size() ? -1 : (length > key.size() ? 1 : 0);
+}
+
+static void SetManifestValue(const char* value, const char* eol,
+                             string* result) {
+  if (value < eol && eol[-1] == '\r') {
+    eol--;
+  }
+  result->assign(value, eol);
+}
+
+bool FindManifestEntry(const char* data, size_t size, const string& key,
+                       string* result) {
+  const char* const end = data + size;
+  const char* value;
+  const char* eol;
+
+  // `lo` is always the start of a line, and all lines before it sort before
+  // `key`; all lines from `hi` onwards sort after it.
+  size_t lo = 0;
+  size_t hi = size;
+  while (lo < hi) {
+    size_t line = lo + (hi - lo) / 2;
+    while (line > lo && data[line - 1] != '\n') {
+      line--;
+    }
+    const int cmp = CompareManifestKey(data + line, end, key, &value, &eol);
+    if (cmp == 0) {
+      SetManifestValue(value, eol, result);
+      return true;
+    }
+    if (cmp < 0) {
+      lo = eol - data + 1;
+    } else {
+      hi = line;
+    }
+  }
+
+  for (const char* line = data; line < end; line = eol + 1) {
+    if (CompareManifestKey(line, end, key, &value, &eol) == 0) {
+      SetManifestValue(value, eol, result);
+      return true;
+    }
+  }
+  return false;
+}
+
 }  // namespace launcher
 }  // namespace bazel
@@ -103,6 +103,17 @@ std::wstring GetParentDirFromPath(const std::wstring& path);
 bool RelativeTo(const std::wstring& path, const std::wstring& base,
                 std::wstring* result);
 
+// Look up `key` in the `size` bytes of runfiles manifest at `data`, whose lines
+// have the form "<key> <value>".
+//
+// The manifests that Bazel writes are sorted by key, so this binary-searches
+// the lines in place. If that fails, e.g. because the manifest is not sorted,
+// it falls back to scanning all lines.
+//
+// Return true if found and the value is stored in `value`.
+bool FindManifestEntry(const char* data, size_t size, const std::string& key,
+                       std::string* value);
+
 }  // namespace launcher
 }  // namespace bazel
 
@@ -189,5 +189,42 @@ TEST_F(LaunchUtilTest, RelativeToTest) {
   ASSERT_FALSE(RelativeTo(L"c:\\foo\\bar1", L"d:\\foo\\bar2", &value));
 }
 
+TEST_F(LaunchUtilTest, FindManifestEntryTest) {
+  const string sorted =
+      "a/b c:/a/b\n"
+      "a/b/c c:/a/b/c\n"
+      "a/bc c:/a/bc\r\n"
+      "a/d \n"
+      "z c:/z";
+  string value;
+  ASSERT_TRUE(FindManifestEntry(sorted.data(), sorted.size(), "a/b", &value));
+  ASSERT_EQ("c:/a/b", value);
+  ASSERT_TRUE(
+      FindManifestEntry(sorted.data(), sorted.size(), "a/b/c", &value));
+  ASSERT_EQ("c:/a/b/c", value);
+  ASSERT_TRUE(FindManifestEntry(sorted.data(), sorted.size(), "a/bc", &value));
+  ASSERT_EQ("c:/a/bc", value);
+  ASSERT_TRUE(FindManifestEntry(sorted.data(), sorted.size(), "a/d", &value));
+  ASSERT_EQ("", value);
+  ASSERT_TRUE(FindManifestEntry(sorted.data(), sorted.size(), "z", &value));
+  ASSERT_EQ("c:/z", value);
+  ASSERT_FALSE(FindManifestEntry(sorted.data(), sorted.size(), "a", &value));
+  ASSERT_FALSE(FindManifestEntry(sorted.data(), sorted.size(), "a/c", &value));
+  ASSERT_FALSE(FindManifestEntry(sorted.data(), sorted.size(), "zz", &value));
+  ASSERT_FALSE(FindManifestEntry("", 0, "a", &value));
+
+  const string unsorted =
+      "z c:/z\n"
+      "a/b c:/a/b\n"
+      "m c:/m\n";
+  ASSERT_TRUE(
+      FindManifestEntry(unsorted.data(), unsorted.size(), "a/b", &value));
+  ASSERT_EQ("c:/a/b", value);
+  ASSERT_TRUE(FindManifestEntry(unsorted.data(), unsorted.size(), "z", &value));
+  ASSERT_EQ("c:/z", value);
+  ASSERT_FALSE(
+      FindManifestEntry(unsorted.data(), unsorted.size(), "y", &value));
+}
+
 }  // namespace launcher
 }  // namespace bazel
@@ -14,13 +14,25 @@
 
 #include "src/tools/one_version/allowlist.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/span.h"
 #include "src/tools/one_version/duplicate_class_collector.h"
+#include "src/tools/singlejar/mapped_file.h"
 
 namespace one_version {
 
@@ -67,4 +79,273 @@ absl::flat_hash_set<std::string> MapAllowlist::AllLabels(
   return allowlist_[package_name];
 }
 
+bool ReadAllowlist(
+    const std::string& path,
+    absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>>*
+        allowlist,
+    std::string* error) {
+  std::ifstream in(path);
+  if (!in) {
+    *error = absl::StrCat("unable to open allowlist file: ", path);
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    std::vector<std::string> parts =
+        absl::StrSplit(line, absl::MaxSplits(' ', 1));
+    if (parts.size() != 2) {
+      *error = absl::StrCat("expected <package> <label>, got: ", line);
+      return false;
+    }
+    (*allowlist)[parts[0]].insert(parts[1]);
+  }
+  return true;
+}
+
+namespace {
+
+constexpr char kBinaryAllowlistMagic[8] = {'O', 'V', 'A', 'L',
+                                           'L', 'O', 'W', '1'};
+
+}  // namespace
+
+struct BinaryAllowlist::Header {
+  char magic[8];
+  uint32_t node_count;
+  uint32_t label_count;
+  uint32_t label_index_count;
+  uint32_t strings_size;
+};
+
+struct BinaryAllowlist::Node {
+  uint32_t name_offset;
+  uint32_t name_size;
+  uint32_t first_child;
+  uint32_t child_count;
+  uint32_t first_label;
+  uint32_t label_count;
+};
+
+struct BinaryAllowlist::LabelEntry {
+  uint32_t offset;
+  uint32_t size;
+};
+
+bool BinaryAllowlist::Write(
+    const absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>>&
+        allowlist,
+    const std::string& path, std::string* error) {
+  // The trie, built with ordered maps so that the children come out sorted.
+  struct TrieNode {
+    std::map<std::string, TrieNode> children;
+    std::vector<uint32_t> labels;
+  };
+  TrieNode root;
+  std::map<std::string, uint32_t> label_ids;
+  for (const auto& package : allowlist) {
+    for (const std::string& label : package.second) {
+      label_ids.emplace(label, 0);
+    }
+  }
+  std::string strings;
+  std::vector<LabelEntry> labels;
+  for (auto& label : label_ids) {
+    label.second = static_cast<uint32_t>(labels.size());
+    labels.push_back(LabelEntry{
+        static_cast<uint32_t>(strings.size()),
+        static_cast<uint32_t>(label.first.size())});
+    strings.append(label.first);
+  }
+  for (const auto& package : allowlist) {
+    TrieNode* node = &root;
+    for (absl::string_view component : absl::StrSplit(package.first, '/')) {
+      node = &node->children[std::string(component)];
+    }
+    for (const std::string& label : package.second) {
+      node->labels.push_back(label_ids[label]);
+    }
+    std::sort(node->labels.begin(), node->labels.end());
+  }
+
+  // Numbers the nodes breadth first, so that siblings are adjacent.
+  std::vector<Node> nodes;
+  std::vector<uint32_t> label_indices;
+  std::vector<std::pair<const std::string*, const TrieNode*>> queue = {
+      {nullptr, &root}};
+  for (size_t ix = 0; ix < queue.size(); ++ix) {
+    const std::string* name = queue[ix].first;
+    const TrieNode* trie_node = queue[ix].second;
+    Node node;
+    node.name_offset = static_cast<uint32_t>(strings.size());
+    node.name_size = name == nullptr ? 0 : static_cast<uint32_t>(name->size());
+    if (name != nullptr) {
+      strings.append(*name);
+    }
+    node.first_child = static_cast<uint32_t>(queue.size());
+    node.child_count = static_cast<uint32_t>(trie_node->children.size());
+    node.first_label = static_cast<uint32_t>(label_indices.size());
+    node.label_count = static_cast<uint32_t>(trie_node->labels.size());
+    label_indices.insert(label_indices.end(), trie_node->labels.begin(),
+                         trie_node->labels.end());
+    for (const auto& child : trie_node->children) {
+      queue.emplace_back(&child.first, &child.second);
+    }
+    nodes.push_back(node);
+  }
+  if (strings.size() > UINT32_MAX || label_indices.size() > UINT32_MAX) {
+    *error = absl::StrCat("allowlist too large for ", path);
+    return false;
+  }
+
+  Header header;
+  memcpy(header.magic, kBinaryAllowlistMagic, sizeof(header.magic));
+  header.node_count = static_cast<uint32_t>(nodes.size());
+  header.label_count = static_cast<uint32_t>(labels.size());
+  header.label_index_count = static_cast<uint32_t>(label_indices.size());
+  header.strings_size = static_cast<uint32_t>(strings.size());
+  std::string temp_path = path + ".tmp";
+  {
+    std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(nodes.data()),
+              nodes.size() * sizeof(nodes[0]));
+    out.write(reinterpret_cast<const char*>(labels.data()),
+              labels.size() * sizeof(labels[0]));
+    out.write(reinterpret_cast<const char*>(label_indices.data()),
+              label_indices.size() * sizeof(label_indices[0]));
+    out.write(strings.data(), strings.size());
+    if (!out.flush()) {
+      std::remove(temp_path.c_str());
+      *error = absl::StrCat("unable to write ", temp_path);
+      return false;
+    }
+  }
+#ifdef _WIN32
+  // rename() does not replace an existing file on Windows.
+  std::remove(path.c_str());
+#endif
+  if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+    std::remove(temp_path.c_str());
+    *error = absl::StrCat("unable to rename ", temp_path, " to ", path);
+    return false;
+  }
+  return true;
+}
+
+bool BinaryAllowlist::IsBinaryAllowlist(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  char magic[sizeof(kBinaryAllowlistMagic)];
+  return in.read(magic, sizeof(magic)) &&
+         memcmp(magic, kBinaryAllowlistMagic, sizeof(magic)) == 0;
+}
+
+std::unique_ptr<BinaryAllowlist> BinaryAllowlist::Open(
+    const std::string& path, std::string* error) {
+  std::unique_ptr<BinaryAllowlist> allowlist(new BinaryAllowlist());
+  if (!allowlist->file_.Open(path)) {
+    *error = absl::StrCat("unable to open allowlist file: ", path);
+    return nullptr;
+  }
+  // Only the sizes are checked here, and every offset when it is used, so
+  // that opening doesn't read the whole file.
+  const unsigned char* start = allowlist->file_.start();
+  const size_t size = allowlist->file_.size();
+  Header header;
+  if (size < sizeof(header)) {
+    *error = absl::StrCat("malformed allowlist file: ", path);
+    return nullptr;
+  }
+  memcpy(&header, start, sizeof(header));
+  const uint64_t expected_size =
+      sizeof(header) + uint64_t{header.node_count} * sizeof(Node) +
+      uint64_t{header.label_count} * sizeof(LabelEntry) +
+      uint64_t{header.label_index_count} * sizeof(uint32_t) +
+      header.strings_size;
+  if (memcmp(header.magic, kBinaryAllowlistMagic, sizeof(header.magic)) !=
+          0 ||
+      header.node_count == 0 || expected_size != size) {
+    *error = absl::StrCat("malformed allowlist file: ", path);
+    return nullptr;
+  }
+  const unsigned char* p = start + sizeof(header);
+  allowlist->nodes_ = reinterpret_cast<const Node*>(p);
+  allowlist->node_count_ = header.node_count;
+  p += header.node_count * sizeof(Node);
+  allowlist->labels_ = reinterpret_cast<const LabelEntry*>(p);
+  allowlist->label_count_ = header.label_count;
+  p += header.label_count * sizeof(LabelEntry);
+  allowlist->label_indices_ = reinterpret_cast<const uint32_t*>(p);
+  allowlist->label_index_count_ = header.label_index_count;
+  p += header.label_index_count * sizeof(uint32_t);
+  allowlist->strings_ = reinterpret_cast<const char*>(p);
+  allowlist->strings_size_ = header.strings_size;
+  return allowlist;
+}
+
+absl::string_view BinaryAllowlist::String(uint32_t offset,
+                                          uint32_t size) const {
+  if (offset > strings_size_ || size > strings_size_ - offset) {
+    return absl::string_view();
+  }
+  return absl::string_view(strings_ + offset, size);
+}
+
+const BinaryAllowlist::Node* BinaryAllowlist::FindChild(
+    const Node& node, absl::string_view name) const {
+  if (node.first_child > node_count_ ||
+      node.child_count > node_count_ - node.first_child) {
+    return nullptr;
+  }
+  const Node* begin = nodes_ + node.first_child;
+  const Node* end = begin + node.child_count;
+  const Node* it =
+      std::lower_bound(begin, end, name, [this](const Node& a,
+                                                absl::string_view b) {
+        return String(a.name_offset, a.name_size) < b;
+      });
+  if (it == end || String(it->name_offset, it->name_size) != name) {
+    return nullptr;
+  }
+  return it;
+}
+
+absl::flat_hash_set<std::string> BinaryAllowlist::AllLabels(
+    absl::string_view package_name) {
+  absl::flat_hash_set<std::string> result;
+  const Node* node = nodes_;
+  for (absl::string_view component : absl::StrSplit(package_name, '/')) {
+    node = FindChild(*node, component);
+    if (node == nullptr) {
+      return result;
+    }
+  }
+  if (node->first_label > label_index_count_ ||
+      node->label_count > label_index_count_ - node->first_label) {
+    return result;
+  }
+  for (uint32_t ix = 0; ix < node->label_count; ++ix) {
+    uint32_t label = label_indices_[node->first_label + ix];
+    if (label < label_count_) {
+      result.emplace(String(labels_[label].offset, labels_[label].size));
+    }
+  }
+  return result;
+}
+
+std::unique_ptr<Allowlist> OpenAllowlist(const std::string& path,
+                                         std::string* error) {
+  if (path.empty()) {
+    return std::make_unique<MapAllowlist>(
+        absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>>());
+  }
+  if (BinaryAllowlist::IsBinaryAllowlist(path)) {
+    return BinaryAllowlist::Open(path, error);
+  }
+  absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>> map;
+  if (!ReadAllowlist(path, &map, error)) {
+    return nullptr;
+  }
+  return std::make_unique<MapAllowlist>(std::move(map));
+}
+
 }  // namespace one_version
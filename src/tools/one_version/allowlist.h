@@ -15,15 +15,18 @@
 #ifndef THIRD_PARTY_BAZEL_SRC_TOOLS_ONE_VERSION_ALLOWLIST_H_
 #define THIRD_PARTY_BAZEL_SRC_TOOLS_ONE_VERSION_ALLOWLIST_H_
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/span.h"
 #include "src/tools/one_version/duplicate_class_collector.h"
+#include "src/tools/singlejar/mapped_file.h"
 
 namespace one_version {
 
@@ -53,6 +56,79 @@ class MapAllowlist : public Allowlist {
   absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>> allowlist_;
 };
 
+// Reads a text allowlist, which has a "<package> <label>" pair on each
+// line. Returns false and sets `error` if the allowlist cannot be read.
+bool ReadAllowlist(
+    const std::string &path,
+    absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>>
+        *allowlist,
+    std::string *error);
+
+// A allowlist in a binary file, which is mapped rather than read, so that
+// loading it takes the same time however many packages it has.
+//
+// The packages form a trie of their components ("com", "google", ...). The
+// children of a node are adjacent and sorted by name, so that a lookup is a
+// binary search per component. Each label is stored once, and each node has
+// a range of label indices. The file is:
+//   header: "OVALLOW1", node count, label count, label index count,
+//           string area size
+//   nodes: name offset, name size, first child, child count, first label
+//          index, label index count; the root comes first
+//   labels: offset, size
+//   label indices
+//   string area
+// with all numbers 32-bit little-endian.
+class BinaryAllowlist : public Allowlist {
+ public:
+  // Writes the allowlist in this format. Returns false and sets `error` if
+  // the file cannot be written.
+  static bool Write(
+      const absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>>
+          &allowlist,
+      const std::string &path, std::string *error);
+
+  // Returns whether the file starts like a binary allowlist.
+  static bool IsBinaryAllowlist(const std::string &path);
+
+  // Maps the allowlist. Returns nullptr and sets `error` if the file cannot
+  // be mapped or is malformed.
+  static std::unique_ptr<BinaryAllowlist> Open(const std::string &path,
+                                               std::string *error);
+
+  absl::flat_hash_set<std::string> AllLabels(
+      absl::string_view package_name) override;
+
+ private:
+  struct Header;
+  struct Node;
+  struct LabelEntry;
+
+  BinaryAllowlist() = default;
+
+  // Returns the string of the string area, or an empty one if it is out of
+  // bounds.
+  absl::string_view String(uint32_t offset, uint32_t size) const;
+
+  // Returns the child of the node with the given name, or nullptr.
+  const Node *FindChild(const Node &node, absl::string_view name) const;
+
+  MappedFile file_;
+  const Node *nodes_ = nullptr;
+  uint32_t node_count_ = 0;
+  const LabelEntry *labels_ = nullptr;
+  uint32_t label_count_ = 0;
+  const uint32_t *label_indices_ = nullptr;
+  uint32_t label_index_count_ = 0;
+  const char *strings_ = nullptr;
+  uint32_t strings_size_ = 0;
+};
+
+// Opens the allowlist at `path`, binary or text, or returns an empty one if
+// `path` is empty. Returns nullptr and sets `error` if it cannot be read.
+std::unique_ptr<Allowlist> OpenAllowlist(const std::string &path,
+                                         std::string *error);
+
 }  // namespace one_version
 
 #endif  // THIRD_PARTY_BAZEL_SRC_TOOLS_ONE_VERSION_ALLOWLIST_H_
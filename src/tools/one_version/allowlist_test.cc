@@ -14,6 +14,9 @@
 
 #include "src/tools/one_version/allowlist.h"
 
+#include <cstdlib>
+#include <fstream>
+#include <memory>
 #include <string>
 
 #include "googletest/include/gtest/gtest.h"
@@ -70,4 +73,67 @@ TEST_F(AllowlistTest, Allowlisting) {
   EXPECT_TRUE(allowlist.Apply(vc.Violations()).empty());
 }
 
+TEST_F(AllowlistTest, BinaryAllowlist) {
+  absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>> map = {
+      {"com/google", {"//hello:bar", "//hello:foo"}},
+      {"com/google/common", {"//hello:bar"}},
+      {"com/example", {"//hello:baz"}},
+      {"Default", {"//hello:foo"}},
+  };
+  std::string path = std::string(getenv("TEST_TMPDIR")) + "/allowlist.bin";
+  std::string error;
+  ASSERT_TRUE(BinaryAllowlist::Write(map, path, &error)) << error;
+  ASSERT_TRUE(BinaryAllowlist::IsBinaryAllowlist(path));
+  std::unique_ptr<BinaryAllowlist> allowlist =
+      BinaryAllowlist::Open(path, &error);
+  ASSERT_NE(nullptr, allowlist) << error;
+
+  for (const auto& package : map) {
+    EXPECT_EQ(package.second, allowlist->AllLabels(package.first));
+  }
+  EXPECT_TRUE(allowlist->AllLabels("com").empty());
+  EXPECT_TRUE(allowlist->AllLabels("com/google/common/base").empty());
+  EXPECT_TRUE(allowlist->AllLabels("org/google").empty());
+  EXPECT_TRUE(allowlist->AllLabels("").empty());
+
+  DuplicateClassCollector vc;
+  vc.Add("com/google/Foo", 1, Label("//hello:foo", "hello/libfoo.jar"));
+  vc.Add("com/google/Foo", 2, Label("//hello:bar", "hello/libbar.jar"));
+  vc.Add("com/example/Baz", 1, Label("//hello:foo", "hello/libfoo.jar"));
+  vc.Add("com/example/Baz", 2, Label("//hello:bar", "hello/libbar.jar"));
+  std::string expected =
+      "  com/example/Baz has incompatible definitions in:\n"
+      "    crc32=1\n"
+      "      //hello:foo [new]\n"
+      "      via hello/libfoo.jar\n"
+      "    crc32=2\n"
+      "      //hello:bar [new]\n"
+      "      via hello/libbar.jar\n";
+  EXPECT_EQ(expected,
+            DuplicateClassCollector::Report(allowlist->Apply(vc.Violations())));
+}
+
+TEST_F(AllowlistTest, MalformedBinaryAllowlist) {
+  std::string path = std::string(getenv("TEST_TMPDIR")) + "/allowlist.txt";
+  {
+    std::ofstream out(path);
+    out << "com/google //hello:foo\n";
+  }
+  EXPECT_FALSE(BinaryAllowlist::IsBinaryAllowlist(path));
+  absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>> map;
+  std::string error;
+  ASSERT_TRUE(ReadAllowlist(path, &map, &error)) << error;
+  EXPECT_EQ(1u, map.size());
+
+  path = std::string(getenv("TEST_TMPDIR")) + "/truncated.bin";
+  ASSERT_TRUE(BinaryAllowlist::Write(map, path, &error)) << error;
+  {
+    std::ofstream out(path, std::ios::binary | std::ios::app);
+    out << "x";
+  }
+  EXPECT_TRUE(BinaryAllowlist::IsBinaryAllowlist(path));
+  EXPECT_EQ(nullptr, BinaryAllowlist::Open(path, &error));
+  EXPECT_FALSE(error.empty());
+}
+
 }  // namespace one_version
@@ -0,0 +1,55 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iostream>
+#include <ostream>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "src/tools/one_version/allowlist.h"
+#include "src/tools/singlejar/token_stream.h"
+
+// Converts a text allowlist into the binary format that one_version maps
+// instead of parsing it.
+//
+// usage: --input <text allowlist>
+//        --output <binary allowlist>
+int main(int argc, char *argv[]) {
+  std::string input_file;
+  std::string output_file;
+  ArgTokenStream tokens(argc - 1, argv + 1);
+  while (!tokens.AtEnd()) {
+    if (tokens.MatchAndSet("--input", &input_file) ||
+        tokens.MatchAndSet("--output", &output_file)) {
+    } else {
+      std::cerr << "error: bad command line argument " << tokens.token()
+                << std::endl;
+      return 1;
+    }
+  }
+  if (input_file.empty() || output_file.empty()) {
+    std::cerr << "error: --input and --output are required" << std::endl;
+    return 1;
+  }
+
+  absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>> allowlist;
+  std::string error;
+  if (!one_version::ReadAllowlist(input_file, &allowlist, &error) ||
+      !one_version::BinaryAllowlist::Write(allowlist, output_file, &error)) {
+    std::cerr << "error: " << error << std::endl;
+    return 1;
+  }
+  return 0;
+}
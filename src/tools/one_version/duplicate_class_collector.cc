@@ -15,25 +15,83 @@
 #include "src/tools/one_version/duplicate_class_collector.h"
 
 #include <algorithm>
+#include <cstddef>
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
 #include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
 
 namespace one_version {
 
-void DuplicateClassCollector::Add(const std::string& class_name, uint32_t crc32,
-                                  const Label& label) {
-  auto it = violations_.find(class_name);
-  if (it != violations_.end()) {
-    it->second.Add(crc32, label);
-    return;
+void DuplicateClassCollector::Add(absl::string_view class_name,
+                                  uint32_t crc32, const Label& label) {
+  // Callers usually add the classes of one jar after the other, each with
+  // the label of its jar, so only a label that differs from the last one
+  // is recorded again.
+  if (labels_.empty() || labels_.back().name() != label.name() ||
+      labels_.back().jar() != label.jar() ||
+      labels_.back().allowlisted() != label.allowlisted()) {
+    AddLabel(label);
   }
-  Violation v(class_name, std::vector<Version>());
-  v.Add(crc32, label);
-  violations_.emplace(class_name, std::move(v));
+  Add(class_name, crc32, labels_.size() - 1);
+}
+
+size_t DuplicateClassCollector::AddLabel(Label label) {
+  labels_.push_back(std::move(label));
+  return labels_.size() - 1;
+}
+
+void DuplicateClassCollector::Add(absl::string_view class_name,
+                                  uint32_t crc32, size_t label) {
+  uint32_t ix = static_cast<uint32_t>(occurrences_.size());
+  occurrences_.push_back(
+      Occurrence{crc32, static_cast<uint32_t>(label), kNoOccurrence});
+  Class c;
+  c.first = c.last = ix;
+  auto added = classes_.Emplace(
+      std::string_view(class_name.data(), class_name.size()), c);
+  if (!added.second) {
+    Class* existing = added.first;
+    occurrences_[existing->last].next = ix;
+    existing->last = ix;
+    if (occurrences_[existing->first].crc32 != crc32) {
+      existing->conflict = true;
+    }
+  }
+}
+
+void DuplicateClassCollector::Merge(const DuplicateClassCollector& other) {
+  const size_t label_offset = labels_.size();
+  labels_.insert(labels_.end(), other.labels_.begin(), other.labels_.end());
+  occurrences_.reserve(occurrences_.size() + other.occurrences_.size());
+  other.classes_.ForEach([&](std::string_view name, const Class& theirs) {
+    uint32_t first = static_cast<uint32_t>(occurrences_.size());
+    for (uint32_t ix = theirs.first; ix != kNoOccurrence;
+         ix = other.occurrences_[ix].next) {
+      const Occurrence& o = other.occurrences_[ix];
+      occurrences_.push_back(Occurrence{
+          o.crc32, static_cast<uint32_t>(o.label + label_offset),
+          static_cast<uint32_t>(occurrences_.size() + 1)});
+    }
+    uint32_t last = static_cast<uint32_t>(occurrences_.size() - 1);
+    occurrences_[last].next = kNoOccurrence;
+    Class c = theirs;
+    c.first = first;
+    c.last = last;
+    auto added = classes_.Emplace(name, c);
+    if (!added.second) {
+      Class* ours = added.first;
+      occurrences_[ours->last].next = first;
+      ours->last = last;
+      ours->conflict = ours->conflict || theirs.conflict ||
+                       occurrences_[ours->first].crc32 !=
+                           occurrences_[first].crc32;
+    }
+  });
 }
 
 void Violation::Add(uint32_t crc32, const Label& label) {
@@ -64,15 +122,19 @@ void Version::Sort() {
 
 std::vector<Violation> DuplicateClassCollector::Violations() {
   std::vector<Violation> violations;
-  for (const auto& e : violations_) {
-    Violation violation = e.second;
-    if (violation.versions().size() <= 1) {
+  classes_.ForEach([&](std::string_view name, const Class& c) {
+    if (!c.conflict) {
       // We only saw one crc32.
-      continue;
+      return;
+    }
+    Violation violation{std::string(name), std::vector<Version>()};
+    for (uint32_t ix = c.first; ix != kNoOccurrence;
+         ix = occurrences_[ix].next) {
+      violation.Add(occurrences_[ix].crc32, labels_[occurrences_[ix].label]);
     }
     violation.Sort();
-    violations.push_back(violation);
-  }
+    violations.push_back(std::move(violation));
+  });
   std::sort(violations.begin(), violations.end(),
             [](const Violation& a, const Violation& b) {
               return a.class_name() < b.class_name();
@@ -15,12 +15,14 @@
 #ifndef THIRD_PARTY_BAZEL_SRC_TOOLS_ONE_VERSION_DUPLICATE_CLASS_COLLECTOR_H_
 #define THIRD_PARTY_BAZEL_SRC_TOOLS_ONE_VERSION_DUPLICATE_CLASS_COLLECTOR_H_
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 #include <utility>
 #include <vector>
 
-#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "src/tools/singlejar/entry_table.h"
 
 namespace one_version {
 
@@ -77,10 +79,29 @@ class Violation {
 };
 
 // A collector for one version violations.
+//
+// Class names are interned in an arena, and each occurrence of a class only
+// takes the crc and the index of its label, so that a classpath does not
+// cost a string and a label copy per class file.
 class DuplicateClassCollector {
  public:
+  DuplicateClassCollector() = default;
+  DuplicateClassCollector(const DuplicateClassCollector &) = delete;
+  DuplicateClassCollector &operator=(const DuplicateClassCollector &) = delete;
+
   // Records the class name, crc, and label of a classpath entry.
-  void Add(const std::string &class_name, uint32_t crc32, const Label &label);
+  void Add(absl::string_view class_name, uint32_t crc32, const Label &label);
+
+  // Records a label for the Add() overload below, and returns its index.
+  size_t AddLabel(Label label);
+
+  // Records the class name and crc of a classpath entry, with a label that
+  // has been recorded by AddLabel().
+  void Add(absl::string_view class_name, uint32_t crc32, size_t label);
+
+  // Records the entries of `other` after the ones recorded so far, as if
+  // they had been added to this collector directly.
+  void Merge(const DuplicateClassCollector &other);
 
   // Returns the collection of one version violations.
   std::vector<Violation> Violations();
@@ -89,7 +110,25 @@ class DuplicateClassCollector {
   static std::string Report(const std::vector<Violation> &violations);
 
  private:
-  absl::flat_hash_map<std::string, Violation> violations_;
+  // The occurrences of a class, linked in the order they were added.
+  struct Occurrence {
+    uint32_t crc32;
+    uint32_t label;
+    uint32_t next;
+  };
+
+  struct Class {
+    uint32_t first = 0;
+    uint32_t last = 0;
+    // Whether the occurrences have more than one crc.
+    bool conflict = false;
+  };
+
+  static constexpr uint32_t kNoOccurrence = UINT32_MAX;
+
+  EntryTable<Class> classes_;
+  std::vector<Occurrence> occurrences_;
+  std::vector<Label> labels_;
 };
 
 }  // namespace one_version
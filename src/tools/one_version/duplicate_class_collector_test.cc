@@ -58,4 +58,67 @@ TEST_F(DuplicateClassCollectorTest, Violations) {
   EXPECT_EQ(expected, DuplicateClassCollector::Report(vc.Violations()));
 }
 
+TEST_F(DuplicateClassCollectorTest, LabelIndices) {
+  DuplicateClassCollector vc;
+  size_t foo = vc.AddLabel(Label("//hello:foo", "hello/libfoo.jar"));
+  size_t bar = vc.AddLabel(Label("//hello:bar", "hello/libbar.jar"));
+  vc.Add("com/google/Foo", 2, bar);
+  vc.Add("com/google/Foo", 1, foo);
+  vc.Add("com/google/Baz", 3, foo);
+  vc.Add("com/google/Baz", 3, bar);
+  std::string expected =
+      "  com/google/Foo has incompatible definitions in:\n"
+      "    crc32=1\n"
+      "      //hello:foo [new]\n"
+      "      via hello/libfoo.jar\n"
+      "    crc32=2\n"
+      "      //hello:bar [new]\n"
+      "      via hello/libbar.jar\n";
+  EXPECT_EQ(expected, DuplicateClassCollector::Report(vc.Violations()));
+}
+
+TEST_F(DuplicateClassCollectorTest, Merge) {
+  // Merging collectors gives the same result as adding all entries to one.
+  DuplicateClassCollector all;
+  DuplicateClassCollector first;
+  DuplicateClassCollector second;
+  DuplicateClassCollector third;
+  auto add = [&all](DuplicateClassCollector* vc, const char* class_name,
+                    uint32_t crc32, const char* target) {
+    Label label(target, absl::StrCat(target, ".jar"));
+    vc->Add(class_name, crc32, label);
+    all.Add(class_name, crc32, label);
+  };
+  add(&first, "com/google/Foo", 1, "//a:a");
+  add(&first, "com/google/Bar", 5, "//a:a");
+  add(&second, "com/google/Bar", 5, "//b:b");
+  add(&second, "com/google/Baz", 3, "//b:b");
+  add(&second, "com/google/Foo", 2, "//c:b");
+  add(&third, "com/google/Baz", 4, "//c:c");
+  add(&third, "com/google/Foo", 1, "//c:a");
+  add(&third, "com/google/Moo", 6, "//c:c");
+  first.Merge(second);
+  first.Merge(third);
+  std::string report = DuplicateClassCollector::Report(first.Violations());
+  EXPECT_EQ(DuplicateClassCollector::Report(all.Violations()), report);
+  std::string expected =
+      "  com/google/Baz has incompatible definitions in:\n"
+      "    crc32=3\n"
+      "      //b:b [new]\n"
+      "      via //b:b.jar\n"
+      "    crc32=4\n"
+      "      //c:c [new]\n"
+      "      via //c:c.jar\n"
+      "  com/google/Foo has incompatible definitions in:\n"
+      "    crc32=1\n"
+      "      //a:a [new]\n"
+      "      via //a:a.jar\n"
+      "      //c:a [new]\n"
+      "      via //c:a.jar\n"
+      "    crc32=2\n"
+      "      //c:b [new]\n"
+      "      via //c:b.jar\n";
+  EXPECT_EQ(expected, report);
+}
+
 }  // namespace one_version
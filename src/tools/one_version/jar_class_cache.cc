@@ -0,0 +1,240 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/one_version/jar_class_cache.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "src/tools/singlejar/fingerprint.h"
+
+namespace one_version {
+
+namespace {
+
+constexpr char kMagic[] = "OVCACHE1";
+constexpr size_t kMagicSize = sizeof(kMagic) - 1;
+
+void AppendVarint(std::string *out, uint64_t value) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+void AppendFixed(std::string *out, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; ++i) {
+    out->push_back(static_cast<char>(value >> (8 * i)));
+  }
+}
+
+uint64_t ReadFixed64(const char *p) {
+  uint64_t value = 0;
+  for (int i = 0; i < 8; ++i) {
+    value |= static_cast<uint64_t>(static_cast<uint8_t>(p[i])) << (8 * i);
+  }
+  return value;
+}
+
+}  // namespace
+
+uint64_t JarClassCache::Digest(const std::string &jar) {
+  struct stat st;
+  if (stat(jar.c_str(), &st) != 0) {
+    return 0;
+  }
+  Fingerprint fingerprint;
+  fingerprint.Update(jar);
+  fingerprint.Update(static_cast<uint64_t>(st.st_size));
+  fingerprint.Update(static_cast<uint64_t>(st.st_mtime));
+#if defined(__APPLE__)
+  fingerprint.Update(static_cast<uint64_t>(st.st_mtimespec.tv_nsec));
+#elif !defined(_WIN32)
+  fingerprint.Update(static_cast<uint64_t>(st.st_mtim.tv_nsec));
+#endif
+  // 0 stands for a jar that cannot be read.
+  return fingerprint.value() == 0 ? 1 : fingerprint.value();
+}
+
+std::string JarClassCache::Encode(
+    std::vector<std::pair<std::string, uint32_t>> *classes) {
+  std::sort(classes->begin(), classes->end());
+  std::string record;
+  AppendVarint(&record, classes->size());
+  const std::string *previous = nullptr;
+  for (const auto &c : *classes) {
+    size_t shared = 0;
+    if (previous != nullptr) {
+      shared = std::mismatch(previous->begin(),
+                             previous->begin() +
+                                 std::min(previous->size(), c.first.size()),
+                             c.first.begin())
+                   .first -
+               previous->begin();
+    }
+    AppendVarint(&record, shared);
+    AppendVarint(&record, c.first.size() - shared);
+    record.append(c.first, shared, std::string::npos);
+    AppendFixed(&record, c.second, 4);
+    previous = &c.first;
+  }
+  return record;
+}
+
+bool JarClassCache::ReadVarint(const char **p, const char *end,
+                               uint64_t *value) {
+  *value = 0;
+  for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+    uint8_t byte = static_cast<uint8_t>(*(*p)++);
+    *value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void JarClassCache::ReadFixed32(const char **p, uint32_t *value) {
+  *value = 0;
+  for (int i = 0; i < 4; ++i) {
+    *value |= static_cast<uint32_t>(static_cast<uint8_t>((*p)[i])) << (8 * i);
+  }
+  *p += 4;
+}
+
+bool JarClassCache::IsValidRecord(absl::string_view record) {
+  const char *p = record.data();
+  const char *end = p + record.size();
+  uint64_t count;
+  if (!ReadVarint(&p, end, &count)) {
+    return false;
+  }
+  uint64_t name_size = 0;
+  for (uint64_t i = 0; i < count; ++i) {
+    uint64_t shared, suffix_size;
+    if (!ReadVarint(&p, end, &shared) || !ReadVarint(&p, end, &suffix_size) ||
+        shared > name_size ||
+        suffix_size > static_cast<uint64_t>(end - p) ||
+        static_cast<uint64_t>(end - p) - suffix_size < 4) {
+      return false;
+    }
+    p += suffix_size + 4;
+    name_size = shared + suffix_size;
+  }
+  return p == end;
+}
+
+bool JarClassCache::Read(const std::string &path) {
+  jars_.clear();
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    return false;
+  }
+  std::string data((std::istreambuf_iterator<char>(in)),
+                   std::istreambuf_iterator<char>());
+  if (data.compare(0, kMagicSize, kMagic) != 0) {
+    return false;
+  }
+  const char *p = data.data() + kMagicSize;
+  const char *end = data.data() + data.size();
+  while (p < end) {
+    uint64_t path_size, record_size;
+    if (!ReadVarint(&p, end, &path_size) ||
+        path_size > static_cast<uint64_t>(end - p)) {
+      jars_.clear();
+      return false;
+    }
+    std::string jar(p, path_size);
+    p += path_size;
+    if (end - p < 8) {
+      jars_.clear();
+      return false;
+    }
+    uint64_t digest = ReadFixed64(p);
+    p += 8;
+    if (!ReadVarint(&p, end, &record_size) ||
+        record_size > static_cast<uint64_t>(end - p) ||
+        !IsValidRecord(absl::string_view(p, record_size))) {
+      jars_.clear();
+      return false;
+    }
+    jars_[jar] = Entry{digest, std::string(p, record_size)};
+    p += record_size;
+  }
+  return true;
+}
+
+bool JarClassCache::Write(const std::string &path) const {
+  std::vector<const std::pair<const std::string, Entry> *> jars;
+  for (const auto &jar : jars_) {
+    jars.push_back(&jar);
+  }
+  std::sort(jars.begin(), jars.end(),
+            [](const std::pair<const std::string, Entry> *a,
+               const std::pair<const std::string, Entry> *b) {
+              return a->first < b->first;
+            });
+  std::string data(kMagic, kMagicSize);
+  for (const auto *jar : jars) {
+    AppendVarint(&data, jar->first.size());
+    data.append(jar->first);
+    AppendFixed(&data, jar->second.digest, 8);
+    AppendVarint(&data, jar->second.record.size());
+    data.append(jar->second.record);
+  }
+
+  std::string temp_path = path + ".tmp";
+  {
+    std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+    if (!out.write(data.data(), data.size()) || !out.flush()) {
+      std::remove(temp_path.c_str());
+      return false;
+    }
+  }
+#ifdef _WIN32
+  // rename() does not replace an existing file on Windows.
+  std::remove(path.c_str());
+#endif
+  if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+    std::remove(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+void JarClassCache::Add(const std::string &jar, uint64_t digest,
+                        std::string record) {
+  jars_[jar] = Entry{digest, std::move(record)};
+}
+
+const std::string *JarClassCache::Find(const std::string &jar,
+                                       uint64_t digest) const {
+  auto it = jars_.find(jar);
+  if (it == jars_.end() || it->second.digest != digest) {
+    return nullptr;
+  }
+  return &it->second.record;
+}
+
+}  // namespace one_version
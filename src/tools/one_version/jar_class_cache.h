@@ -0,0 +1,110 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_BAZEL_SRC_TOOLS_ONE_VERSION_JAR_CLASS_CACHE_H_
+#define THIRD_PARTY_BAZEL_SRC_TOOLS_ONE_VERSION_JAR_CLASS_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+
+namespace one_version {
+
+// The class files and crcs of the jars seen by a previous run, so that the
+// jars that haven't changed since don't have to be opened again.
+//
+// A jar is identified by its path, and its digest covers the path, size and
+// modification time. The classes of a jar are sorted, and each name only
+// stores the suffix that differs from the previous one, which makes a
+// record a fraction of the size of the jar's central directory.
+//
+// The cache is a binary file:
+//   "OVCACHE1"
+//   for each jar:
+//     varint path size, path, 64-bit digest, varint record size, record
+// and a record is:
+//   varint class count
+//   for each class:
+//     varint length shared with the previous name, varint suffix size,
+//     suffix, 32-bit crc
+// with the integers in little-endian order.
+class JarClassCache {
+ public:
+  // Returns the digest of the jar as it is now, or 0 if it cannot be read.
+  static uint64_t Digest(const std::string &jar);
+
+  // Encodes the (name, crc32) pairs of a jar as a record. Sorts `classes`.
+  static std::string Encode(std::vector<std::pair<std::string, uint32_t>>
+                                *classes);
+
+  // Calls fn(absl::string_view name, uint32_t crc32) for each class of a
+  // record returned by Find().
+  template <typename Fn>
+  static void ForEachClass(absl::string_view record, Fn fn) {
+    const char *p = record.data();
+    const char *end = p + record.size();
+    uint64_t count;
+    ReadVarint(&p, end, &count);
+    std::string name;
+    for (uint64_t i = 0; i < count; ++i) {
+      uint64_t shared, suffix_size;
+      ReadVarint(&p, end, &shared);
+      ReadVarint(&p, end, &suffix_size);
+      name.resize(shared);
+      name.append(p, suffix_size);
+      p += suffix_size;
+      uint32_t crc32;
+      ReadFixed32(&p, &crc32);
+      fn(absl::string_view(name), crc32);
+    }
+  }
+
+  // Reads the cache, returns false if there is none or it is malformed.
+  bool Read(const std::string &path);
+
+  // Writes the cache to a temporary file and renames it.
+  bool Write(const std::string &path) const;
+
+  // Records the classes of a jar.
+  void Add(const std::string &jar, uint64_t digest, std::string record);
+
+  // Returns the record of the jar if it has been recorded with the digest,
+  // otherwise nullptr.
+  const std::string *Find(const std::string &jar, uint64_t digest) const;
+
+  size_t size() const { return jars_.size(); }
+
+ private:
+  struct Entry {
+    uint64_t digest;
+    std::string record;
+  };
+
+  static bool ReadVarint(const char **p, const char *end, uint64_t *value);
+  static void ReadFixed32(const char **p, uint32_t *value);
+
+  // Returns whether the record is well-formed.
+  static bool IsValidRecord(absl::string_view record);
+
+  std::unordered_map<std::string, Entry> jars_;
+};
+
+}  // namespace one_version
+
+#endif  // THIRD_PARTY_BAZEL_SRC_TOOLS_ONE_VERSION_JAR_CLASS_CACHE_H_
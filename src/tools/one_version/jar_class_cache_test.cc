@@ -0,0 +1,126 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/one_version/jar_class_cache.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "googletest/include/gtest/gtest.h"
+#include "absl/strings/string_view.h"
+
+namespace one_version {
+
+class JarClassCacheTest : public ::testing::Test {
+ protected:
+  static std::string TempPath(const std::string &name) {
+    return std::string(getenv("TEST_TMPDIR")) + "/" + name;
+  }
+
+  static std::vector<std::pair<std::string, uint32_t>> Decode(
+      const std::string &record) {
+    std::vector<std::pair<std::string, uint32_t>> classes;
+    JarClassCache::ForEachClass(
+        record, [&classes](absl::string_view name, uint32_t crc32) {
+          classes.emplace_back(std::string(name), crc32);
+        });
+    return classes;
+  }
+};
+
+TEST_F(JarClassCacheTest, EncodesSortedClasses) {
+  std::vector<std::pair<std::string, uint32_t>> classes = {
+      {"com/google/Foo", 1},
+      {"com/google/Bar", 0xffffffff},
+      {"com/google/Foo$Inner", 3},
+      {"Top", 4},
+  };
+  std::string record = JarClassCache::Encode(&classes);
+  std::vector<std::pair<std::string, uint32_t>> expected = {
+      {"Top", 4},
+      {"com/google/Bar", 0xffffffff},
+      {"com/google/Foo", 1},
+      {"com/google/Foo$Inner", 3},
+  };
+  EXPECT_EQ(expected, classes);
+  EXPECT_EQ(expected, Decode(record));
+}
+
+TEST_F(JarClassCacheTest, WritesAndReads) {
+  std::vector<std::pair<std::string, uint32_t>> a = {{"a/A", 1}, {"a/B", 2}};
+  std::vector<std::pair<std::string, uint32_t>> b;
+  JarClassCache cache;
+  cache.Add("a.jar", 10, JarClassCache::Encode(&a));
+  cache.Add("b.jar", 20, JarClassCache::Encode(&b));
+  std::string path = TempPath("cache");
+  ASSERT_TRUE(cache.Write(path));
+
+  JarClassCache read;
+  ASSERT_TRUE(read.Read(path));
+  EXPECT_EQ(2u, read.size());
+  ASSERT_NE(nullptr, read.Find("a.jar", 10));
+  EXPECT_EQ(a, Decode(*read.Find("a.jar", 10)));
+  ASSERT_NE(nullptr, read.Find("b.jar", 20));
+  EXPECT_TRUE(Decode(*read.Find("b.jar", 20)).empty());
+  // A jar that has changed since.
+  EXPECT_EQ(nullptr, read.Find("a.jar", 11));
+  EXPECT_EQ(nullptr, read.Find("c.jar", 10));
+}
+
+TEST_F(JarClassCacheTest, RejectsMalformedCache) {
+  std::vector<std::pair<std::string, uint32_t>> a = {{"a/A", 1}, {"a/B", 2}};
+  JarClassCache cache;
+  cache.Add("a.jar", 10, JarClassCache::Encode(&a));
+  std::string path = TempPath("truncated");
+  ASSERT_TRUE(cache.Write(path));
+  std::string data;
+  {
+    std::ifstream in(path, std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(in),
+                std::istreambuf_iterator<char>());
+  }
+  {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), data.size() - 1);
+  }
+
+  JarClassCache read;
+  EXPECT_FALSE(read.Read(path));
+  EXPECT_EQ(0u, read.size());
+  EXPECT_FALSE(read.Read(TempPath("missing")));
+}
+
+TEST_F(JarClassCacheTest, DigestsExistingFiles) {
+  std::string path = TempPath("lib.jar");
+  {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << "not really a jar";
+  }
+  uint64_t digest = JarClassCache::Digest(path);
+  EXPECT_NE(0u, digest);
+  EXPECT_EQ(digest, JarClassCache::Digest(path));
+  {
+    std::ofstream out(path, std::ios::binary | std::ios::app);
+    out << "!";
+  }
+  EXPECT_NE(digest, JarClassCache::Digest(path));
+  EXPECT_EQ(0u, JarClassCache::Digest(TempPath("missing.jar")));
+}
+
+}  // namespace one_version
@@ -14,44 +14,187 @@
 
 #include "src/tools/one_version/one_version.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "absl/log/die_if_null.h"
 #include "absl/strings/match.h"
 #include "absl/strings/string_view.h"
 #include "absl/strings/strip.h"
+#include "src/main/cpp/util/task_pool.h"
 #include "src/tools/one_version/duplicate_class_collector.h"
+#include "src/tools/one_version/jar_class_cache.h"
+#include "src/tools/singlejar/input_jar.h"
 #include "src/tools/singlejar/zip_headers.h"
 
 namespace one_version {
 
+namespace {
+
+// Strips the ".class" suffix from `file_name_of_entry` and returns true if
+// the entry is a class file that is subject to the check.
+bool IsCheckedClass(absl::string_view *file_name_of_entry) {
+  return absl::ConsumeSuffix(file_name_of_entry, ".class") &&
+         // module-info.class is a Java 9 Module specifier, and isn't a
+         // normal class. We expect it to be at the top of the jar or under
+         // META-INF/versions/{numeral} in a multi-release JAR.
+         *file_name_of_entry != "module-info" &&
+         !(absl::StartsWith(*file_name_of_entry, "META-INF/versions/") &&
+           absl::EndsWith(*file_name_of_entry, "/module-info")) &&
+         // R.class and R$....class should be removed from analysis as they
+         // are android resources, and are re-processed during the android
+         // binary build.
+         !absl::EndsWith(*file_name_of_entry, "/R") &&
+         !absl::StrContains(*file_name_of_entry, "/R$") &&
+         // BR.class should be removed from analysis as it is a special class
+         // generated by Android databinding, and is re-processed during the
+         // android binary build. Once the depot is migrated to Android
+         // databinding v2 (see b/73782031), this will no longer be necessary.
+         !absl::EndsWith(*file_name_of_entry, "/BR");
+}
+
+// The digest and cache record of each jar, for the updated cache.
+using CacheRecords = std::vector<std::pair<uint64_t, std::string>>;
+
+// Records the class files of jars[begin, end) in the collector. The names
+// are interned straight from the mapped jar. With a cache, the jars that it
+// has a current record of are not opened, and `records` gets the record of
+// each jar.
+bool ScanJars(const std::vector<Label> &jars, size_t begin, size_t end,
+              const JarClassCache *cache, CacheRecords *records,
+              DuplicateClassCollector *collector, std::string *failed_jar) {
+  for (size_t jar_ix = begin; jar_ix < end; ++jar_ix) {
+    const std::string &jar = jars[jar_ix].jar();
+    uint64_t digest = 0;
+    if (cache != nullptr) {
+      // Taken before the jar is read, so that a jar that changes while it is
+      // read won't match next time.
+      digest = JarClassCache::Digest(jar);
+      const std::string *record =
+          digest != 0 ? cache->Find(jar, digest) : nullptr;
+      if (record != nullptr) {
+        size_t label = collector->AddLabel(jars[jar_ix]);
+        JarClassCache::ForEachClass(
+            *record, [collector, label](absl::string_view name,
+                                        uint32_t crc32) {
+              collector->Add(name, crc32, label);
+            });
+        (*records)[jar_ix] = std::make_pair(digest, *record);
+        continue;
+      }
+    }
+
+    // Only the central directory is read, not the local headers spread
+    // over the jar.
+    InputJar input_jar;
+    CentralDirectoryIndex index;
+    if (!input_jar.Open(jar) || !input_jar.Index(&index)) {
+      *failed_jar = jar;
+      return false;
+    }
+    size_t label = collector->AddLabel(jars[jar_ix]);
+    std::vector<std::pair<std::string, uint32_t>> classes;
+    const char *start =
+        reinterpret_cast<const char *>(input_jar.mapped_start());
+    for (size_t i = 0; i < index.size(); ++i) {
+      absl::string_view file_name(start + index.file_name_offset(i),
+                                  index.file_name_length(i));
+      if (IsCheckedClass(&file_name)) {
+        collector->Add(file_name, index.crc32(i), label);
+        if (digest != 0) {
+          classes.emplace_back(std::string(file_name), index.crc32(i));
+        }
+      }
+    }
+    input_jar.Close();
+    if (digest != 0) {
+      (*records)[jar_ix] =
+          std::make_pair(digest, JarClassCache::Encode(&classes));
+    }
+  }
+  return true;
+}
+
+// Same as ScanJars() for all jars, on up to `jobs` threads.
+bool ScanJarsOnThreads(const std::vector<Label> &jars, int jobs,
+                       const JarClassCache *cache, CacheRecords *records,
+                       DuplicateClassCollector *collector,
+                       std::string *failed_jar) {
+  if (jobs <= 1 || jars.size() <= 1) {
+    return ScanJars(jars, 0, jars.size(), cache, records, collector,
+                    failed_jar);
+  }
+
+  // The jars are split into runs of consecutive jars, a few per thread so
+  // that a run of large jars doesn't hold up the others. The first run goes
+  // into the given collector, and the others are merged into it in order, so
+  // that the result doesn't depend on the job count.
+  const size_t shard_count =
+      std::min(jars.size(), static_cast<size_t>(jobs) * 4);
+  std::vector<std::unique_ptr<DuplicateClassCollector>> other_shards;
+  std::vector<DuplicateClassCollector *> shards{collector};
+  for (size_t ix = 1; ix < shard_count; ++ix) {
+    other_shards.push_back(std::make_unique<DuplicateClassCollector>());
+    shards.push_back(other_shards.back().get());
+  }
+  std::vector<std::string> failed_jars(shard_count);
+  std::vector<char> succeeded(shard_count);
+  blaze_util::TaskPool pool(jobs - 1);
+  blaze_util::ParallelFor(&pool, shard_count, [&](size_t ix) {
+    succeeded[ix] = ScanJars(jars, jars.size() * ix / shard_count,
+                             jars.size() * (ix + 1) / shard_count, cache,
+                             records, shards[ix], &failed_jars[ix]);
+  });
+
+  for (size_t ix = 0; ix < shard_count; ++ix) {
+    if (!succeeded[ix]) {
+      *failed_jar = failed_jars[ix];
+      return false;
+    }
+    if (ix > 0) {
+      collector->Merge(*shards[ix]);
+      other_shards[ix - 1].reset();
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
 // Record the jar entry (if it's a class file).
 void OneVersion::Add(absl::string_view file_name_of_entry, const CDH *jar_entry,
                      const Label &label) {
-  if (absl::ConsumeSuffix(&file_name_of_entry, ".class")) {
-    if (
-        // module-info.class is a Java 9 Module specifier, and isn't a
-        // normal class. We expect it to be at the top of the jar or under
-        // META-INF/versions/{numeral} in a multi-release JAR.
-        file_name_of_entry != "module-info" &&
-        !(absl::StartsWith(file_name_of_entry, "META-INF/versions/") &&
-          absl::EndsWith(file_name_of_entry, "/module-info")) &&
-        // R.class and R$....class should be removed from analysis as they
-        // are android resources, and are re-processed during the android
-        // binary build.
-        !absl::EndsWith(file_name_of_entry, "/R") &&
-        !absl::StrContains(file_name_of_entry, "/R$") &&
-        // BR.class should be removed from analysis as it is a special class
-        // generated by Android databinding, and is re-processed during the
-        // android binary build. Once the depot is migrated to Android
-        // databinding v2 (see b/73782031), this will no longer be necessary.
-        !absl::EndsWith(file_name_of_entry, "/BR")) {
-      duplicate_class_collector_.Add(std::string(file_name_of_entry),
-                                     ABSL_DIE_IF_NULL(jar_entry)->crc32(),
-                                     label);
+  if (IsCheckedClass(&file_name_of_entry)) {
+    duplicate_class_collector_.Add(
+        file_name_of_entry, ABSL_DIE_IF_NULL(jar_entry)->crc32(), label);
+  }
+}
+
+bool OneVersion::AddJars(const std::vector<Label> &jars, int jobs,
+                         JarClassCache *cache, std::string *failed_jar) {
+  CacheRecords records(cache != nullptr ? jars.size() : 0);
+  if (!ScanJarsOnThreads(jars, jobs, cache, &records,
+                         &duplicate_class_collector_, failed_jar)) {
+    return false;
+  }
+  if (cache != nullptr) {
+    // Only keep the jars of this run, so that the cache doesn't grow
+    // without bounds.
+    JarClassCache updated;
+    for (size_t ix = 0; ix < jars.size(); ++ix) {
+      if (records[ix].first != 0) {
+        updated.Add(jars[ix].jar(), records[ix].first,
+                    std::move(records[ix].second));
+      }
     }
+    *cache = std::move(updated);
   }
+  return true;
 }
 
 std::vector<one_version::Violation> OneVersion::Report() {
@@ -24,6 +24,7 @@
 #include "absl/strings/string_view.h"
 #include "src/tools/one_version/allowlist.h"
 #include "src/tools/one_version/duplicate_class_collector.h"
+#include "src/tools/one_version/jar_class_cache.h"
 #include "src/tools/singlejar/input_jar.h"
 #include "src/tools/singlejar/zip_headers.h"
 
@@ -37,6 +38,16 @@ class OneVersion {
   // Record the jar entry (if it's a class file).
   void Add(absl::string_view file_name_of_entry, const CDH* jar_entry,
            const Label& label);
+
+  // Records the class files of the jars, each with its label, as if their
+  // entries had been passed to Add() one jar after the other. With more
+  // than one job, the jars are scanned on that many threads. With a cache,
+  // the jars it has a current record of are not opened, and the cache is
+  // updated to hold the records of exactly these jars. Returns false and
+  // sets `failed_jar` if a jar cannot be opened.
+  bool AddJars(const std::vector<Label>& jars, int jobs, JarClassCache* cache,
+               std::string* failed_jar);
+
   std::vector<one_version::Violation> Report();
 
  private:
@@ -19,24 +19,26 @@
 #include <string>
 #include <vector>
 
-#include "absl/container/flat_hash_map.h"
-#include "absl/container/flat_hash_set.h"
-#include "absl/log/die_if_null.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/str_split.h"
 #include "absl/strings/string_view.h"
 #include "src/tools/one_version/allowlist.h"
 #include "src/tools/one_version/duplicate_class_collector.h"
+#include "src/tools/one_version/jar_class_cache.h"
 #include "src/tools/one_version/one_version.h"
-#include "src/tools/singlejar/input_jar.h"
 #include "src/tools/singlejar/token_stream.h"
-#include "src/tools/singlejar/zip_headers.h"
 
 // Scans a classpath and reports one version violations.
 //
 // usage: --output <file to touch>
 //        --inputs <jar1,label1 jar2,label2 ... jarN,labelN>
+//        [--jobs <number of threads to scan the jars on>]
+//        [--cache <file to keep the classes of the jars in between runs>]
+//        [--allowlist <text allowlist, or one converted by binary_allowlist>]
 int main(int argc, char *argv[]) {
   std::string output_file;
+  std::string jobs_arg;
+  std::string cache_file;
   bool succeed_on_found_violations = false;
   std::string allowlist_file;
   std::vector<std::string> inputs;
@@ -46,7 +48,9 @@ int main(int argc, char *argv[]) {
         tokens.MatchAndSet("--succeed_on_found_violations",
                            &succeed_on_found_violations) ||
         tokens.MatchAndSet("--allowlist", &allowlist_file) ||
-        tokens.MatchAndSet("--inputs", &inputs)) {
+        tokens.MatchAndSet("--inputs", &inputs) ||
+        tokens.MatchAndSet("--jobs", &jobs_arg) ||
+        tokens.MatchAndSet("--cache", &cache_file)) {
     } else {
       std::cerr << "error: bad command line argument " << tokens.token()
                 << std::endl;
@@ -54,33 +58,24 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  std::unique_ptr<one_version::Allowlist> allowlist;
-  if (allowlist_file.empty()) {
-    allowlist = std::make_unique<one_version::MapAllowlist>(
-        absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>>());
-  } else {
-    std::ifstream in(allowlist_file);
-    if (!in) {
-      std::cerr << "error: unable to open allowlist file: " << allowlist_file
-                << std::endl;
-      return 1;
-    }
-    absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>> map;
-    std::string line;
-    while (std::getline(in, line)) {
-      std::vector<std::string> parts =
-          absl::StrSplit(line, absl::MaxSplits(' ', 1));
-      if (parts.size() != 2) {
-        std::cerr << "error: expected <package> <label>, got: " << line
-                  << std::endl;
-        return 1;
-      }
-      map[parts[0]].insert(parts[1]);
-    }
-    allowlist = std::make_unique<one_version::MapAllowlist>(std::move(map));
+  int jobs = 1;
+  if (!jobs_arg.empty() &&
+      (!absl::SimpleAtoi(jobs_arg, &jobs) || jobs < 1 || jobs > 1024)) {
+    std::cerr << "error: --jobs expects a number between 1 and 1024, got: "
+              << jobs_arg << std::endl;
+    return 1;
+  }
+
+  std::string error;
+  std::unique_ptr<one_version::Allowlist> allowlist =
+      one_version::OpenAllowlist(allowlist_file, &error);
+  if (!allowlist) {
+    std::cerr << "error: " << error << std::endl;
+    return 1;
   }
   one_version::OneVersion one_version(std::move(allowlist));
 
+  std::vector<one_version::Label> jars;
   for (const std::string &input : inputs) {
     std::vector<std::string> pieces = absl::StrSplit(input, ',');
     if (pieces.size() != 2) {
@@ -88,22 +83,23 @@ int main(int argc, char *argv[]) {
                 << std::endl;
       return 1;
     }
-    std::string jar = pieces[0];
-    std::string label = pieces[1];
-    InputJar input_jar;
-    if (!input_jar.Open(jar)) {
-      std::cerr << "error: unable to open: " << jar << std::endl;
-      return 1;
-    }
-    const CDH *dir_entry;
-    const LH *local_header;
-    while ((dir_entry = input_jar.NextEntry(&local_header))) {
-      absl::string_view file_name(ABSL_DIE_IF_NULL(local_header)->file_name(),
-                                  local_header->file_name_length());
-      one_version.Add(file_name, dir_entry,
-                      one_version::Label(label, jar, /*allowlisted=*/false));
-    }
-    input_jar.Close();
+    jars.push_back(
+        one_version::Label(pieces[1], pieces[0], /*allowlisted=*/false));
+  }
+  // A missing or unreadable cache only means that all jars are scanned.
+  one_version::JarClassCache cache;
+  if (!cache_file.empty()) {
+    cache.Read(cache_file);
+  }
+  std::string failed_jar;
+  if (!one_version.AddJars(jars, jobs,
+                           cache_file.empty() ? nullptr : &cache,
+                           &failed_jar)) {
+    std::cerr << "error: unable to open: " << failed_jar << std::endl;
+    return 1;
+  }
+  if (!cache_file.empty() && !cache.Write(cache_file)) {
+    std::cerr << "warning: unable to write " << cache_file << std::endl;
   }
 
   std::vector<one_version::Violation> violations = one_version.Report();
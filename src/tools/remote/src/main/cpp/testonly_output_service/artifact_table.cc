@@ -0,0 +1,272 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/remote/src/main/cpp/testonly_output_service/artifact_table.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+
+#include "src/tools/remote/src/main/cpp/testonly_output_service/memory.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/string.h"
+
+constexpr size_t kInitialCapacity = 1024;
+// "ATABLE", and the version of the layout of the table.
+constexpr uint64_t kArtifactTableMagic = 0x454c424154410001ull;
+constexpr size_t kArtifactTableReserveSize = (size_t)16 << 30;
+
+static uint64_t HashPath(Str8 path) {
+  // FNV-1a
+  uint64_t result = 14695981039346656037ull;
+  for (size_t i = 0; i < path.len; ++i) {
+    result = (result ^ path.ptr[i]) * 1099511628211ull;
+  }
+  return result;
+}
+
+static bool EqualsStr8(Str8 a, Str8 b) {
+  bool result = a.len == b.len && memcmp(a.ptr, b.ptr, a.len) == 0;
+  return result;
+}
+
+static Artifact *InsertArtifact(ArtifactTable *table, uint64_t hash,
+                                Str8 path);
+
+static ArtifactTable *InitArtifactTable(Arena *arena) {
+  // The table is the first thing in the arena, where LoadArtifactTable()
+  // finds it.
+  ArtifactTable *table = PushArray(arena, ArtifactTable, 1);
+  table->arena = arena;
+  table->capacity = kInitialCapacity;
+  table->slots = PushArray(arena, ArtifactSlot, table->capacity);
+  Str8 root_path = Str8FromCStr("");
+  table->root = InsertArtifact(table, HashPath(root_path), root_path);
+  table->root->kind = kArtifactDirectory;
+  // Last, so that a table cut short by a crash isn't loaded.
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  table->magic = kArtifactTableMagic;
+  return table;
+}
+
+ArtifactTable *AllocArtifactTable() {
+  // Only the pages that are used are committed.
+  ArtifactTable *table =
+      InitArtifactTable(AllocArena(kArtifactTableReserveSize));
+  return table;
+}
+
+ArtifactTable *AllocArtifactTable(const char *path) {
+  Arena *arena = AllocFileArena(path, kArtifactTableReserveSize);
+  ArtifactTable *table = arena ? InitArtifactTable(arena) : 0;
+  return table;
+}
+
+void FreeArtifactTable(ArtifactTable *table) { FreeArena(table->arena); }
+
+template <typename T>
+static void MovePointer(T **pointer, ptrdiff_t moved_by) {
+  if (*pointer) {
+    *pointer = (T *)((uint8_t *)*pointer + moved_by);
+  }
+}
+
+static void MoveStr8(Str8 *str, ptrdiff_t moved_by) {
+  MovePointer(&str->ptr, moved_by);
+}
+
+// Moves the pointers of the table and of the artifacts in it by `moved_by`,
+// for an arena that is mapped elsewhere than it was. What has been removed
+// from the table isn't reachable any more, and isn't moved.
+static void MoveArtifactTable(ArtifactTable *table, ptrdiff_t moved_by) {
+  MovePointer(&table->arena, moved_by);
+  MovePointer(&table->slots, moved_by);
+  MovePointer(&table->root, moved_by);
+  MoveStr8(&table->info.output_path, moved_by);
+  MoveStr8(&table->info.disk_path, moved_by);
+  MoveStr8(&table->info.remote_cache, moved_by);
+  MoveStr8(&table->info.instance_name, moved_by);
+  MoveStr8(&table->info.build_id, moved_by);
+  for (size_t i = 0; i < table->capacity; ++i) {
+    ArtifactSlot *slot = table->slots + i;
+    MovePointer(&slot->artifact, moved_by);
+    Artifact *artifact = slot->artifact;
+    if (artifact) {
+      MoveStr8(&artifact->path, moved_by);
+      MoveStr8(&artifact->hash, moved_by);
+      MovePointer(&artifact->parent, moved_by);
+      MovePointer(&artifact->first_child, moved_by);
+      MovePointer(&artifact->prev_sibling, moved_by);
+      MovePointer(&artifact->next_sibling, moved_by);
+    }
+  }
+}
+
+ArtifactTable *LoadArtifactTable(const char *path) {
+  ptrdiff_t moved_by;
+  Arena *arena = LoadFileArena(path, kArtifactTableReserveSize, &moved_by);
+  if (!arena) {
+    return 0;
+  }
+  ArtifactTable *table = (ArtifactTable *)GetArenaFirst(arena);
+  if ((uint8_t *)(table + 1) > arena->top ||
+      table->magic != kArtifactTableMagic || table->updates != 0) {
+    FreeArena(arena);
+    return 0;
+  }
+  if (moved_by) {
+    BeginArtifactTableUpdate(table);
+    MoveArtifactTable(table, moved_by);
+    EndArtifactTableUpdate(table);
+  }
+  return table;
+}
+
+// A crash can come between any two writes, so the count is written before
+// and after everything the update writes.
+void BeginArtifactTableUpdate(ArtifactTable *table) {
+  ++table->updates;
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+}
+
+void EndArtifactTableUpdate(ArtifactTable *table) {
+  assert(table->updates > 0);
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  --table->updates;
+}
+
+static size_t FindSlot(ArtifactSlot *slots, size_t capacity, uint64_t hash,
+                       Str8 path) {
+  size_t mask = capacity - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    ArtifactSlot *slot = slots + i;
+    if (!slot->artifact ||
+        (slot->hash == hash && EqualsStr8(slot->artifact->path, path))) {
+      return i;
+    }
+  }
+}
+
+static void GrowArtifactTable(ArtifactTable *table) {
+  size_t capacity = table->capacity * 2;
+  ArtifactSlot *slots = PushArray(table->arena, ArtifactSlot, capacity);
+  for (size_t i = 0; i < table->capacity; ++i) {
+    ArtifactSlot *old_slot = table->slots + i;
+    if (old_slot->artifact) {
+      slots[FindSlot(slots, capacity, old_slot->hash,
+                     old_slot->artifact->path)] = *old_slot;
+    }
+  }
+  table->slots = slots;
+  table->capacity = capacity;
+}
+
+Artifact *FindArtifact(ArtifactTable *table, Str8 path) {
+  size_t index = FindSlot(table->slots, table->capacity, HashPath(path), path);
+  return table->slots[index].artifact;
+}
+
+static Artifact *InsertArtifact(ArtifactTable *table, uint64_t hash,
+                                Str8 path) {
+  // Keep the load factor below 3/4.
+  if ((table->count + 1) * 4 > table->capacity * 3) {
+    GrowArtifactTable(table);
+  }
+  ArtifactSlot *slot =
+      table->slots + FindSlot(table->slots, table->capacity, hash, path);
+  Artifact *artifact = PushArray(table->arena, Artifact, 1);
+  // The path may not be null terminated.
+  artifact->path = PushSubStr8(table->arena, path, 0, path.len);
+  slot->hash = hash;
+  slot->artifact = artifact;
+  ++table->count;
+  return artifact;
+}
+
+Artifact *UpsertArtifact(ArtifactTable *table, Str8 path) {
+  uint64_t hash = HashPath(path);
+  size_t index = FindSlot(table->slots, table->capacity, hash, path);
+  if (table->slots[index].artifact) {
+    return table->slots[index].artifact;
+  }
+
+  size_t parent_len = path.len;
+  while (parent_len > 0 && path.ptr[parent_len - 1] != '/') {
+    --parent_len;
+  }
+  Str8 parent_path = {path.ptr, parent_len ? parent_len - 1 : 0};
+  Artifact *parent = UpsertArtifact(table, parent_path);
+  if (parent->kind != kArtifactDirectory) {
+    parent->kind = kArtifactDirectory;
+    parent->staged = false;
+    parent->hash = Str8{};
+    parent->size_bytes = 0;
+  }
+
+  Artifact *artifact = InsertArtifact(table, hash, path);
+  artifact->parent = parent;
+  artifact->next_sibling = parent->first_child;
+  if (parent->first_child) {
+    parent->first_child->prev_sibling = artifact;
+  }
+  parent->first_child = artifact;
+  return artifact;
+}
+
+// Removes the slot with backward shift deletion, so that lookups don't need
+// tombstones.
+static void RemoveSlot(ArtifactTable *table, size_t index) {
+  size_t mask = table->capacity - 1;
+  size_t hole = index;
+  for (size_t i = (hole + 1) & mask; table->slots[i].artifact;
+       i = (i + 1) & mask) {
+    size_t home = table->slots[i].hash & mask;
+    // The entry can fill the hole unless its home is cyclically in
+    // (hole, i].
+    bool stays = hole <= i ? (hole < home && home <= i)
+                           : (hole < home || home <= i);
+    if (!stays) {
+      table->slots[hole] = table->slots[i];
+      hole = i;
+    }
+  }
+  table->slots[hole] = ArtifactSlot{};
+  --table->count;
+}
+
+void RemoveChildren(ArtifactTable *table, Artifact *directory) {
+  while (directory->first_child) {
+    RemoveArtifact(table, directory->first_child);
+  }
+}
+
+void RemoveArtifact(ArtifactTable *table, Artifact *artifact) {
+  assert(artifact != table->root && "Cannot remove the root");
+  RemoveChildren(table, artifact);
+
+  Artifact *parent = artifact->parent;
+  if (artifact->prev_sibling) {
+    artifact->prev_sibling->next_sibling = artifact->next_sibling;
+  } else {
+    parent->first_child = artifact->next_sibling;
+  }
+  if (artifact->next_sibling) {
+    artifact->next_sibling->prev_sibling = artifact->prev_sibling;
+  }
+
+  RemoveSlot(table, FindSlot(table->slots, table->capacity,
+                             HashPath(artifact->path), artifact->path));
+}
@@ -0,0 +1,129 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_TESTONLY_OUTPUT_SERVICE_ARTIFACT_TABLE_H_
+#define BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_TESTONLY_OUTPUT_SERVICE_ARTIFACT_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "src/tools/remote/src/main/cpp/testonly_output_service/memory.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/string.h"
+
+enum ArtifactKind {
+  kArtifactFile,
+  kArtifactDirectory,
+};
+
+struct Artifact {
+  // Relative to the output path. The root of the output path is "".
+  Str8 path;
+  ArtifactKind kind;
+  // Whether the file has only been staged, i.e. its contents are in the
+  // remote cache and it hasn't been written to the output path.
+  bool staged;
+  // The permission bits of a staged file.
+  uint32_t mode;
+  // The digest of a file.
+  Str8 hash;
+  int64_t size_bytes;
+
+  // The directory that contains the artifact, and the artifacts in a
+  // directory.
+  Artifact *parent;
+  Artifact *first_child;
+  Artifact *prev_sibling;
+  Artifact *next_sibling;
+};
+
+struct ArtifactSlot {
+  uint64_t hash;
+  Artifact *artifact;
+};
+
+// What the table of an output base in a file keeps of the output base, so
+// that it can be served again once the table has been loaded. The strings
+// are in the table's arena.
+struct ArtifactTableInfo {
+  Str8 output_path;
+  Str8 disk_path;
+  Str8 remote_cache;
+  Str8 instance_name;
+  Str8 build_id;
+};
+
+// The artifacts in the output path of an output base, in an open addressing
+// hash table keyed by path. The directories that contain an artifact are
+// always in the table too, starting with the root, so that the artifacts in
+// a directory can be listed.
+//
+// Everything lives in the table's own arena, so the whole table is released
+// at once when the output base is cleaned. Artifacts and strings that are
+// removed or replaced, and the slots of a table that has grown, are not freed
+// before that.
+//
+// The arena can be a file, so that the table outlives the process: a service
+// that restarts loads the table from it and answers from it right away,
+// rather than having Bazel stage the artifacts again. A crash in the middle
+// of an update leaves the table in a state it cannot be loaded from, see
+// BeginArtifactTableUpdate().
+struct ArtifactTable {
+  // Tells a table in a file from anything else, and from tables of another
+  // layout.
+  uint64_t magic;
+  Arena *arena;
+  ArtifactSlot *slots;
+  // A power of two.
+  size_t capacity;
+  size_t count;
+  Artifact *root;
+  // The number of updates in progress.
+  uint32_t updates;
+  ArtifactTableInfo info;
+};
+
+ArtifactTable *AllocArtifactTable();
+void FreeArtifactTable(ArtifactTable *table);
+
+// Allocates a table in the file at `path`, which is created or replaced.
+// Returns 0 if the file cannot be created.
+ArtifactTable *AllocArtifactTable(const char *path);
+
+// Maps the table in the file at `path` again. Returns 0 if the file is
+// missing, isn't a table, or was left in the middle of an update.
+ArtifactTable *LoadArtifactTable(const char *path);
+
+// Marks the table as being updated until the matching
+// EndArtifactTableUpdate(), so that a table in a file whose update is cut
+// short by a crash isn't loaded again. Updates can nest. Anything that
+// changes the table or its artifacts has to be in an update.
+void BeginArtifactTableUpdate(ArtifactTable *table);
+void EndArtifactTableUpdate(ArtifactTable *table);
+
+// Returns the artifact at the path, or 0.
+Artifact *FindArtifact(ArtifactTable *table, Str8 path);
+
+// Returns the artifact at the path, and adds a zeroed file if there is none.
+// The directories that contain it are added as well, and files in the way
+// become directories.
+Artifact *UpsertArtifact(ArtifactTable *table, Str8 path);
+
+// Removes the artifact and, if it is a directory, everything in it. The root
+// cannot be removed.
+void RemoveArtifact(ArtifactTable *table, Artifact *artifact);
+
+// Removes everything in the directory.
+void RemoveChildren(ArtifactTable *table, Artifact *directory);
+
+#endif  // BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_TESTONLY_OUTPUT_SERVICE_ARTIFACT_TABLE_H_
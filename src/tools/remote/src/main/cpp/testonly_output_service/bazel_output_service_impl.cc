@@ -14,58 +14,601 @@
 
 #include "src/tools/remote/src/main/cpp/testonly_output_service/bazel_output_service_impl.h"
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
+#include "src/main/protobuf/bazel_output_service.grpc.pb.h"
+#include "src/main/protobuf/bazel_output_service_rev2.pb.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/artifact_table.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/cas_fetcher.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/file_system.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/fuse_frontend.h"
 #include "src/tools/remote/src/main/cpp/testonly_output_service/memory.h"
 #include "src/tools/remote/src/main/cpp/testonly_output_service/string.h"
+#include "google/protobuf/arena.h"
+#include "grpcpp/completion_queue.h"
 #include "grpcpp/security/server_credentials.h"
 #include "grpcpp/server_builder.h"
 #include "grpcpp/server_context.h"
+#include "grpcpp/support/async_unary_call.h"
 #include "grpcpp/support/status.h"
 
-grpc::Status BazelOutputServiceImpl::Clean(
-    grpc::ServerContext* context,
-    const bazel_output_service::CleanRequest* request,
-    bazel_output_service::CleanResponse* response) {
-  return grpc::Status(grpc::StatusCode::UNIMPLEMENTED, "");
+using bazel_output_service::BatchStatRequest;
+using bazel_output_service::BatchStatResponse;
+using bazel_output_service::CleanRequest;
+using bazel_output_service::CleanResponse;
+using bazel_output_service::FinalizeArtifactsRequest;
+using bazel_output_service::FinalizeArtifactsResponse;
+using bazel_output_service::FinalizeBuildRequest;
+using bazel_output_service::FinalizeBuildResponse;
+using bazel_output_service::StageArtifactsRequest;
+using bazel_output_service::StageArtifactsResponse;
+using bazel_output_service::StartBuildRequest;
+using bazel_output_service::StartBuildResponse;
+using bazel_output_service_rev2::FileArtifactLocator;
+using bazel_output_service_rev2::StartBuildArgs;
+
+// protobuf strings are null terminated.
+static inline Str8 Str8FromString(const std::string& str) {
+  Str8 result = {(uint8_t*)str.data(), str.size()};
+  return result;
+}
+
+static inline bool EqualsStr8(Str8 a, Str8 b) {
+  // Strings that were never set have no pointer.
+  bool result = a.len == b.len && (!a.len || memcmp(a.ptr, b.ptr, a.len) == 0);
+  return result;
+}
+
+// Returns whether the path is a normalized relative path, i.e. it doesn't
+// start or end with a slash, and has no empty, "." or ".." segments.
+static bool IsValidRelativePath(Str8 path) {
+  size_t begin = 0;
+  for (size_t i = 0; i <= path.len; ++i) {
+    if (i == path.len || path.ptr[i] == '/') {
+      size_t len = i - begin;
+      if (len == 0 || (len == 1 && path.ptr[begin] == '.') ||
+          (len == 2 && path.ptr[begin] == '.' && path.ptr[begin + 1] == '.')) {
+        return false;
+      }
+      begin = i + 1;
+    }
+  }
+  return true;
+}
+
+// The id of an output base is used as the name of its directory.
+static bool IsValidOutputBaseId(Str8 id) {
+  bool result = IsValidRelativePath(id) && !memchr(id.ptr, '/', id.len);
+  return result;
+}
+
+// Like PushStr8(), for strings that may never have been set.
+static Str8 CopyStr8(Arena* arena, Str8 str) {
+  Str8 result = IsEmptyStr8(str) ? Str8{} : PushStr8(arena, str);
+  return result;
+}
+
+// Records what is needed to serve the output base again in its table.
+static void SaveOutputBase(OutputBase* output_base) {
+  ArtifactTable* table = output_base->table;
+  ArtifactTableInfo* info = &table->info;
+  BeginArtifactTableUpdate(table);
+  if (!EqualsStr8(info->output_path, output_base->output_path)) {
+    info->output_path = CopyStr8(table->arena, output_base->output_path);
+  }
+  if (!EqualsStr8(info->disk_path, output_base->disk_path)) {
+    info->disk_path = CopyStr8(table->arena, output_base->disk_path);
+  }
+  if (!EqualsStr8(info->remote_cache, output_base->remote_cache)) {
+    info->remote_cache = CopyStr8(table->arena, output_base->remote_cache);
+  }
+  if (!EqualsStr8(info->instance_name, output_base->instance_name)) {
+    info->instance_name = CopyStr8(table->arena, output_base->instance_name);
+  }
+  // Already in the table's arena.
+  info->build_id = output_base->build_id;
+  EndArtifactTableUpdate(table);
+}
+
+BazelOutputServiceImpl::BazelOutputServiceImpl(Str8 output_root,
+                                               Str8 disk_root, Str8 state_dir)
+    : arena_(AllocArena()), output_bases_(0) {
+  output_root_ = PushStr8(arena_, output_root);
+  disk_root_ = PushStr8(arena_, disk_root);
+  state_dir_ = CopyStr8(arena_, state_dir);
+  if (!IsEmptyStr8(state_dir_)) {
+    LoadOutputBases();
+  }
+}
+
+ArtifactTable* BazelOutputServiceImpl::AllocTable(Str8 id) {
+  if (IsEmptyStr8(state_dir_)) {
+    return AllocArtifactTable();
+  }
+  TemporaryMemory scratch = BeginScratch(arena_);
+  Str8 path = PushStr8F(scratch.arena, "%s/%s.table", state_dir_.ptr, id.ptr);
+  ArtifactTable* table = AllocArtifactTable((char*)path.ptr);
+  if (!table) {
+    fprintf(stderr, "Cannot create %s, keeping the table in memory\n",
+            path.ptr);
+    table = AllocArtifactTable();
+  }
+  EndScratch(scratch);
+  return table;
+}
+
+void BazelOutputServiceImpl::LoadOutputBases() {
+  if (!CreateDirectories(state_dir_)) {
+    fprintf(stderr, "Cannot create %s\n", state_dir_.ptr);
+    return;
+  }
+  TemporaryMemory scratch = BeginScratch(arena_);
+  Str8* names;
+  size_t count = ListDirectory(scratch.arena, state_dir_, &names);
+  Str8 suffix = Str8FromCStr(".table");
+  for (size_t i = 0; i < count; ++i) {
+    Str8 name = names[i];
+    if (name.len <= suffix.len ||
+        memcmp(name.ptr + name.len - suffix.len, suffix.ptr, suffix.len)) {
+      continue;
+    }
+    Str8 id = PushSubStr8(scratch.arena, name, 0, name.len - suffix.len);
+    Str8 path = PushStr8F(scratch.arena, "%s/%s", state_dir_.ptr, name.ptr);
+    ArtifactTable* table =
+        IsValidOutputBaseId(id) ? LoadArtifactTable((char*)path.ptr) : 0;
+    if (!table) {
+      // Bazel stages the artifacts of the output base again.
+      fprintf(stderr, "Discarding %s\n", path.ptr);
+      DeleteTree(path);
+      continue;
+    }
+    OutputBase* output_base = PushArray(arena_, OutputBase, 1);
+    output_base->id = PushStr8(arena_, id);
+    output_base->output_path = CopyStr8(arena_, table->info.output_path);
+    output_base->disk_path = CopyStr8(arena_, table->info.disk_path);
+    output_base->remote_cache = CopyStr8(arena_, table->info.remote_cache);
+    output_base->instance_name = CopyStr8(arena_, table->info.instance_name);
+    output_base->table = table;
+    output_base->build_id = table->info.build_id;
+    output_base->next = output_bases_;
+    output_bases_ = output_base;
+  }
+  EndScratch(scratch);
+}
+
+BazelOutputServiceImpl::~BazelOutputServiceImpl() {
+  for (OutputBase* output_base = output_bases_; output_base;
+       output_base = output_base->next) {
+    FreeArtifactTable(output_base->table);
+  }
+  FreeArena(arena_);
+}
+
+OutputBase* BazelOutputServiceImpl::FindOutputBase(Str8 id) {
+  for (OutputBase* output_base = output_bases_; output_base;
+       output_base = output_base->next) {
+    if (EqualsStr8(output_base->id, id)) {
+      return output_base;
+    }
+  }
+  return 0;
+}
+
+OutputBase* BazelOutputServiceImpl::FindBuild(Str8 build_id) {
+  if (IsEmptyStr8(build_id)) {
+    return 0;
+  }
+  for (OutputBase* output_base = output_bases_; output_base;
+       output_base = output_base->next) {
+    if (EqualsStr8(output_base->build_id, build_id)) {
+      return output_base;
+    }
+  }
+  return 0;
+}
+
+grpc::Status BazelOutputServiceImpl::Clean(grpc::ServerContext* context,
+                                           const CleanRequest* request,
+                                           CleanResponse* response) {
+  Str8 id = Str8FromString(request->output_base_id());
+  if (!IsValidOutputBaseId(id)) {
+    return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                        "Invalid output base id");
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  OutputBase* output_base = FindOutputBase(id);
+  TemporaryMemory scratch = BeginScratch(arena_);
+  // The output path is not known if the output base hasn't been used since
+  // the service started, but it's under the output root unless Bazel passes
+  // a prefix.
+  Str8 disk_path =
+      output_base ? output_base->disk_path
+                  : PushStr8F(scratch.arena, "%s/%s", disk_root_.ptr, id.ptr);
+  grpc::Status status;
+  if (output_base && !IsEmptyStr8(output_base->build_id)) {
+    status = grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                          "A build is running in the output base");
+  } else if (!DeleteTree(disk_path)) {
+    status = grpc::Status(grpc::StatusCode::INTERNAL,
+                          std::string("Failed to delete ") +
+                              (char*)disk_path.ptr);
+  } else if (output_base) {
+    FreeArtifactTable(output_base->table);
+    output_base->table = AllocTable(id);
+    SaveOutputBase(output_base);
+  }
+  EndScratch(scratch);
+  return status;
 }
 
 grpc::Status BazelOutputServiceImpl::StartBuild(
-    grpc::ServerContext* context,
-    const bazel_output_service::StartBuildRequest* request,
-    bazel_output_service::StartBuildResponse* response) {
-  return grpc::Status(grpc::StatusCode::UNIMPLEMENTED, "");
+    grpc::ServerContext* context, const StartBuildRequest* request,
+    StartBuildResponse* response) {
+  if (request->version() != 1) {
+    return grpc::Status(grpc::StatusCode::UNIMPLEMENTED,
+                        "Only version 1 is supported");
+  }
+  Str8 id = Str8FromString(request->output_base_id());
+  Str8 build_id = Str8FromString(request->build_id());
+  if (!IsValidOutputBaseId(id) || IsEmptyStr8(build_id)) {
+    return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                        "Invalid output base id or build id");
+  }
+  const std::string& prefix = request->output_path_prefix();
+  bool mounted = !EqualsStr8(output_root_, disk_root_);
+  if (mounted && !prefix.empty() &&
+      !EqualsStr8(Str8FromString(prefix), output_root_)) {
+    return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                        "The output path prefix must be the mount point");
+  }
+  StartBuildArgs args;
+  if (request->has_args() && !request->args().UnpackTo(&args)) {
+    return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                        "Unsupported args");
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  OutputBase* output_base = FindOutputBase(id);
+  if (!output_base) {
+    output_base = PushArray(arena_, OutputBase, 1);
+    output_base->id = PushStr8(arena_, id);
+    output_base->table = AllocTable(id);
+    output_base->next = output_bases_;
+    output_bases_ = output_base;
+  }
+
+  // The output path is <prefix>/<id>, where the prefix is where Bazel
+  // expects to find the output paths on this machine.
+  TemporaryMemory scratch = BeginScratch(arena_);
+  Str8 output_path = PushStr8F(scratch.arena, "%s/%s",
+                               prefix.empty() ? (char*)output_root_.ptr
+                                              : prefix.c_str(),
+                               id.ptr);
+  if (!EqualsStr8(output_path, output_base->output_path)) {
+    output_base->output_path = PushStr8(arena_, output_path);
+  }
+  Str8 disk_path =
+      mounted ? PushStr8F(scratch.arena, "%s/%s", disk_root_.ptr, id.ptr)
+              : output_path;
+  if (!EqualsStr8(disk_path, output_base->disk_path)) {
+    output_base->disk_path = PushStr8(arena_, disk_path);
+  }
+  Str8 remote_cache = Str8FromString(args.remote_cache());
+  if (!EqualsStr8(remote_cache, output_base->remote_cache)) {
+    output_base->remote_cache = PushStr8(arena_, remote_cache);
+  }
+  Str8 instance_name = Str8FromString(args.instance_name());
+  if (!EqualsStr8(instance_name, output_base->instance_name)) {
+    output_base->instance_name = PushStr8(arena_, instance_name);
+  }
+  EndScratch(scratch);
+  if (!CreateDirectories(output_base->disk_path)) {
+    return grpc::Status(grpc::StatusCode::INTERNAL,
+                        std::string("Failed to create ") +
+                            (char*)output_base->disk_path.ptr);
+  }
+
+  // A build that is still running has been abandoned by a Bazel server that
+  // went away, so the new one takes over.
+  output_base->build_id = PushStr8(output_base->table->arena, build_id);
+  SaveOutputBase(output_base);
+  if (prefix.empty()) {
+    response->set_output_path_suffix((char*)output_base->output_path.ptr,
+                                     output_base->output_path.len);
+  } else {
+    response->set_output_path_suffix((char*)id.ptr, id.len);
+  }
+  return grpc::Status::OK;
+}
+
+// Records a file that has the digest, and returns false if the path or
+// the locator is not supported. `locator` is where the locator is unpacked,
+// so that the artifacts of a request can share one.
+static bool AddFile(ArtifactTable* table, const std::string& path_string,
+                    const google::protobuf::Any& any_locator, bool staged,
+                    FileArtifactLocator* locator) {
+  Str8 path = Str8FromString(path_string);
+  if (!IsValidRelativePath(path) || !any_locator.UnpackTo(locator)) {
+    return false;
+  }
+  Artifact* artifact = UpsertArtifact(table, path);
+  Str8 hash = Str8FromString(locator->digest().hash());
+  if (artifact->kind == kArtifactDirectory) {
+    RemoveChildren(table, artifact);
+  }
+  artifact->kind = kArtifactFile;
+  artifact->staged = staged;
+  // Bazel doesn't say which outputs are executable.
+  artifact->mode = 0555;
+  // The same outputs are staged by every build, so only strings that change
+  // take up more memory.
+  if (!EqualsStr8(artifact->hash, hash)) {
+    artifact->hash = PushStr8(table->arena, hash);
+  }
+  artifact->size_bytes = locator->digest().size_bytes();
+  return true;
 }
 
 grpc::Status BazelOutputServiceImpl::StageArtifacts(
-    grpc::ServerContext* context,
-    const bazel_output_service::StageArtifactsRequest* request,
-    bazel_output_service::StageArtifactsResponse* response) {
-  return grpc::Status(grpc::StatusCode::UNIMPLEMENTED, "");
+    grpc::ServerContext* context, const StageArtifactsRequest* request,
+    StageArtifactsResponse* response) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  OutputBase* output_base = FindBuild(Str8FromString(request->build_id()));
+  if (!output_base) {
+    return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                        "Unknown build id");
+  }
+
+  response->mutable_responses()->Reserve(request->artifacts_size());
+  FileArtifactLocator locator;
+  BeginArtifactTableUpdate(output_base->table);
+  for (const auto& artifact : request->artifacts()) {
+    google::rpc::Status* status = response->add_responses()->mutable_status();
+    if (!AddFile(output_base->table, artifact.path(), artifact.locator(),
+                 /*staged=*/true, &locator)) {
+      status->set_code(grpc::StatusCode::INVALID_ARGUMENT);
+      status->set_message("Invalid path or unsupported locator");
+    }
+  }
+  EndArtifactTableUpdate(output_base->table);
+  return grpc::Status::OK;
 }
 
 grpc::Status BazelOutputServiceImpl::FinalizeArtifacts(
-    grpc::ServerContext* context,
-    const bazel_output_service::FinalizeArtifactsRequest* request,
-    bazel_output_service::FinalizeArtifactsResponse* response) {
-  return grpc::Status(grpc::StatusCode::UNIMPLEMENTED, "");
+    grpc::ServerContext* context, const FinalizeArtifactsRequest* request,
+    FinalizeArtifactsResponse* response) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  OutputBase* output_base = FindBuild(Str8FromString(request->build_id()));
+  if (!output_base) {
+    return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                        "Unknown build id");
+  }
+
+  bool all_valid = true;
+  FileArtifactLocator locator;
+  BeginArtifactTableUpdate(output_base->table);
+  for (const auto& artifact : request->artifacts()) {
+    all_valid &= AddFile(output_base->table, artifact.path(),
+                         artifact.locator(), /*staged=*/false, &locator);
+  }
+  EndArtifactTableUpdate(output_base->table);
+  if (!all_valid) {
+    return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                        "Invalid path or unsupported locator");
+  }
+  return grpc::Status::OK;
 }
 
 grpc::Status BazelOutputServiceImpl::FinalizeBuild(
-    grpc::ServerContext* context,
-    const bazel_output_service::FinalizeBuildRequest* request,
-    bazel_output_service::FinalizeBuildResponse* response) {
-  return grpc::Status(grpc::StatusCode::UNIMPLEMENTED, "");
+    grpc::ServerContext* context, const FinalizeBuildRequest* request,
+    FinalizeBuildResponse* response) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  OutputBase* output_base = FindBuild(Str8FromString(request->build_id()));
+  if (!output_base) {
+    return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                        "Unknown build id");
+  }
+  output_base->build_id = Str8{};
+  SaveOutputBase(output_base);
+  return grpc::Status::OK;
 }
 
 grpc::Status BazelOutputServiceImpl::BatchStat(
-    grpc::ServerContext* context,
-    const bazel_output_service::BatchStatRequest* request,
-    bazel_output_service::BatchStatResponse* response) {
-  return grpc::Status(grpc::StatusCode::UNIMPLEMENTED, "");
+    grpc::ServerContext* context, const BatchStatRequest* request,
+    BatchStatResponse* response) {
+  int count = request->paths_size();
+  TemporaryMemory scratch = BeginScratch(arena_);
+  // The paths that have to be looked up on disk.
+  Str8* disk_paths = PushArray(scratch.arena, Str8, count);
+  int* disk_indices = PushArray(scratch.arena, int, count);
+  int disk_count = 0;
+  Str8 disk_path = {};
+
+  response->mutable_responses()->Reserve(count);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    OutputBase* output_base = FindBuild(Str8FromString(request->build_id()));
+    if (!output_base) {
+      EndScratch(scratch);
+      return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                          "Unknown build id");
+    }
+    disk_path = PushStr8(scratch.arena, output_base->disk_path);
+
+    FileArtifactLocator locator;
+    for (int i = 0; i < count; ++i) {
+      BatchStatResponse::StatResponse* stat_response =
+          response->add_responses();
+      Str8 path = Str8FromString(request->paths(i));
+      if (IsEmptyStr8(path)) {
+        stat_response->mutable_stat()->mutable_directory();
+        continue;
+      }
+      if (!IsValidRelativePath(path)) {
+        continue;
+      }
+      Artifact* artifact = FindArtifact(output_base->table, path);
+      if (!artifact) {
+        disk_paths[disk_count] = path;
+        disk_indices[disk_count] = i;
+        ++disk_count;
+      } else if (artifact->kind == kArtifactDirectory) {
+        stat_response->mutable_stat()->mutable_directory();
+      } else {
+        locator.mutable_digest()->set_hash((char*)artifact->hash.ptr,
+                                           artifact->hash.len);
+        locator.mutable_digest()->set_size_bytes(artifact->size_bytes);
+        stat_response->mutable_stat()
+            ->mutable_file()
+            ->mutable_locator()
+            ->PackFrom(locator);
+      }
+    }
+  }
+
+  // Everything else is stat'ed without holding the lock.
+  if (disk_count) {
+    FileStat* stats = PushArray(scratch.arena, FileStat, disk_count);
+    StatFiles(scratch.arena, disk_path, disk_paths, disk_count, stats);
+    for (int i = 0; i < disk_count; ++i) {
+      BatchStatResponse::StatResponse* stat_response =
+          response->mutable_responses(disk_indices[i]);
+      switch (stats[i].type) {
+        case kFileTypeFile:
+          // Bazel computes the digest of files without a locator itself.
+          stat_response->mutable_stat()->mutable_file();
+          break;
+        case kFileTypeDirectory:
+          stat_response->mutable_stat()->mutable_directory();
+          break;
+        case kFileTypeSymlink:
+          stat_response->mutable_stat()->mutable_symlink()->set_target(
+              (char*)stats[i].symlink_target.ptr, stats[i].symlink_target.len);
+          break;
+        case kFileTypeNone:
+          break;
+      }
+    }
+  }
+  EndScratch(scratch);
+  return grpc::Status::OK;
+}
+
+// An RPC that is being served asynchronously. The completion queue returns
+// the call as the tag of its events.
+class Call {
+ public:
+  virtual ~Call() = default;
+  virtual void Proceed(bool ok) = 0;
+};
+
+template <typename Request, typename Response>
+class UnaryCall : public Call {
+ public:
+  using AsyncService = bazel_output_service::BazelOutputService::AsyncService;
+  using RequestMethod = void (AsyncService::*)(
+      grpc::ServerContext*, Request*,
+      grpc::ServerAsyncResponseWriter<Response>*, grpc::CompletionQueue*,
+      grpc::ServerCompletionQueue*, void*);
+  using Handler = grpc::Status (BazelOutputServiceImpl::*)(
+      grpc::ServerContext*, const Request*, Response*);
+
+  // Waits for the next call of the method on the completion queue.
+  static void Start(AsyncService* service, BazelOutputServiceImpl* impl,
+                    grpc::ServerCompletionQueue* cq, RequestMethod method,
+                    Handler handler) {
+    new UnaryCall(service, impl, cq, method, handler);
+  }
+
+  void Proceed(bool ok) override {
+    if (finished_ || !ok) {
+      // The response has been sent, or the server is shutting down.
+      delete this;
+      return;
+    }
+    // Take the next call before serving this one.
+    Start(service_, impl_, cq_, method_, handler_);
+    grpc::Status status = (impl_->*handler_)(&context_, request_, response_);
+    finished_ = true;
+    responder_.Finish(*response_, status, this);
+  }
+
+ private:
+  UnaryCall(AsyncService* service, BazelOutputServiceImpl* impl,
+            grpc::ServerCompletionQueue* cq, RequestMethod method,
+            Handler handler)
+      : service_(service),
+        impl_(impl),
+        cq_(cq),
+        method_(method),
+        handler_(handler),
+        arena_(CallArenaOptions()),
+        request_(google::protobuf::Arena::Create<Request>(&arena_)),
+        response_(google::protobuf::Arena::Create<Response>(&arena_)),
+        responder_(&context_),
+        finished_(false) {
+    (service_->*method_)(&context_, request_, &responder_, cq_, cq_, this);
+  }
+
+  // The request and the response of a call are allocated on an arena of
+  // their own, which is freed at once with the call: the messages of the
+  // artifacts of a large StageArtifacts or BatchStat are not allocated and
+  // freed one by one.
+  static google::protobuf::ArenaOptions CallArenaOptions() {
+    google::protobuf::ArenaOptions options;
+    options.start_block_size = 4 << 10;
+    options.max_block_size = 1 << 20;
+    return options;
+  }
+
+  AsyncService* service_;
+  BazelOutputServiceImpl* impl_;
+  grpc::ServerCompletionQueue* cq_;
+  RequestMethod method_;
+  Handler handler_;
+  grpc::ServerContext context_;
+  google::protobuf::Arena arena_;
+  Request* request_;
+  Response* response_;
+  grpc::ServerAsyncResponseWriter<Response> responder_;
+  bool finished_;
+};
+
+static void ServeCompletionQueue(
+    bazel_output_service::BazelOutputService::AsyncService* service,
+    BazelOutputServiceImpl* impl, grpc::ServerCompletionQueue* cq) {
+  using Impl = BazelOutputServiceImpl;
+  using Service = bazel_output_service::BazelOutputService::AsyncService;
+  UnaryCall<CleanRequest, CleanResponse>::Start(
+      service, impl, cq, &Service::RequestClean, &Impl::Clean);
+  UnaryCall<StartBuildRequest, StartBuildResponse>::Start(
+      service, impl, cq, &Service::RequestStartBuild, &Impl::StartBuild);
+  UnaryCall<StageArtifactsRequest, StageArtifactsResponse>::Start(
+      service, impl, cq, &Service::RequestStageArtifacts,
+      &Impl::StageArtifacts);
+  UnaryCall<FinalizeArtifactsRequest, FinalizeArtifactsResponse>::Start(
+      service, impl, cq, &Service::RequestFinalizeArtifacts,
+      &Impl::FinalizeArtifacts);
+  UnaryCall<FinalizeBuildRequest, FinalizeBuildResponse>::Start(
+      service, impl, cq, &Service::RequestFinalizeBuild, &Impl::FinalizeBuild);
+  UnaryCall<BatchStatRequest, BatchStatResponse>::Start(
+      service, impl, cq, &Service::RequestBatchStat, &Impl::BatchStat);
+
+  void* tag;
+  bool ok;
+  while (cq->Next(&tag, &ok)) {
+    static_cast<Call*>(tag)->Proceed(ok);
+  }
 }
 
 constexpr uint16_t kDefaultPort = 8080;
@@ -73,6 +616,15 @@ constexpr uint16_t kDefaultPort = 8080;
 struct ParsedCommandLine {
   Str8 error;
   uint16_t port;
+  Str8 output_root;
+  // The number of threads, each with its own completion queue.
+  uint32_t threads;
+  // If set, the output root is a FUSE mount whose files are kept here.
+  Str8 fuse_backing_root;
+  // Where the FUSE mount keeps the contents of staged files.
+  Str8 cas_dir;
+  // If set, where the tables of the output bases are kept across restarts.
+  Str8 state_dir;
 };
 
 static ParsedCommandLine* ParseCommandLine(Arena* arena, int argc,
@@ -80,7 +632,15 @@ static ParsedCommandLine* ParseCommandLine(Arena* arena, int argc,
   TemporaryMemory scratch = BeginScratch(arena);
   ParsedCommandLine* result = PushArray(arena, ParsedCommandLine, 1);
   result->port = kDefaultPort;
+  result->output_root = Str8FromCStr("/tmp/testonly_output_service");
+  result->threads = std::thread::hardware_concurrency();
+  result->cas_dir = Str8FromCStr("/tmp/testonly_output_service_cas");
   Str8 port_prefix = Str8FromCStr("--port=");
+  Str8 output_root_prefix = Str8FromCStr("--output_root=");
+  Str8 threads_prefix = Str8FromCStr("--threads=");
+  Str8 fuse_backing_root_prefix = Str8FromCStr("--fuse_backing_root=");
+  Str8 cas_dir_prefix = Str8FromCStr("--cas_dir=");
+  Str8 state_dir_prefix = Str8FromCStr("--state_dir=");
   for (int i = 1; i < argc; ++i) {
     Str8 arg = Str8FromCStr(argv[i]);
     if (StartsWithStr8(arg, port_prefix)) {
@@ -92,11 +652,54 @@ static ParsedCommandLine* ParseCommandLine(Arena* arena, int argc,
         result->error = PushStr8F(arena, "Not a valid port: %s", port_str.ptr);
         break;
       }
+    } else if (StartsWithStr8(arg, output_root_prefix)) {
+      result->output_root = PushSubStr8(arena, arg, output_root_prefix.len);
+      if (result->output_root.len == 0 || result->output_root.ptr[0] != '/') {
+        result->error = PushStr8F(arena, "Not an absolute path: %s",
+                                  result->output_root.ptr);
+        break;
+      }
+    } else if (StartsWithStr8(arg, threads_prefix)) {
+      Str8 threads_str = PushSubStr8(scratch.arena, arg, threads_prefix.len);
+      ParsedUInt32 threads = ParseUInt32(threads_str);
+      if (threads.valid && threads.value > 0 && threads.value <= 1024) {
+        result->threads = threads.value;
+      } else {
+        result->error = PushStr8F(arena, "Not a valid number of threads: %s",
+                                  threads_str.ptr);
+        break;
+      }
+    } else if (StartsWithStr8(arg, fuse_backing_root_prefix)) {
+      result->fuse_backing_root =
+          PushSubStr8(arena, arg, fuse_backing_root_prefix.len);
+      if (result->fuse_backing_root.len == 0 ||
+          result->fuse_backing_root.ptr[0] != '/') {
+        result->error = PushStr8F(arena, "Not an absolute path: %s",
+                                  result->fuse_backing_root.ptr);
+        break;
+      }
+    } else if (StartsWithStr8(arg, cas_dir_prefix)) {
+      result->cas_dir = PushSubStr8(arena, arg, cas_dir_prefix.len);
+      if (result->cas_dir.len == 0 || result->cas_dir.ptr[0] != '/') {
+        result->error = PushStr8F(arena, "Not an absolute path: %s",
+                                  result->cas_dir.ptr);
+        break;
+      }
+    } else if (StartsWithStr8(arg, state_dir_prefix)) {
+      result->state_dir = PushSubStr8(arena, arg, state_dir_prefix.len);
+      if (result->state_dir.len == 0 || result->state_dir.ptr[0] != '/') {
+        result->error = PushStr8F(arena, "Not an absolute path: %s",
+                                  result->state_dir.ptr);
+        break;
+      }
     } else {
       result->error = PushStr8F(arena, "Unknown command line: %s", arg.ptr);
       break;
     }
   }
+  if (result->threads == 0) {
+    result->threads = 1;
+  }
   EndScratch(scratch);
   return result;
 }
@@ -105,18 +708,47 @@ int RunServer(int argc, char** argv) {
   int exit_code = 0;
   TemporaryMemory scratch = BeginScratch(0);
   ParsedCommandLine* command_line = ParseCommandLine(scratch.arena, argc, argv);
+  bool mounted = !IsEmptyStr8(command_line->fuse_backing_root);
+  Str8 disk_root =
+      mounted ? command_line->fuse_backing_root : command_line->output_root;
+  BazelOutputServiceImpl impl(command_line->output_root, disk_root,
+                              command_line->state_dir);
+  CasFetcher fetcher((char*)command_line->cas_dir.ptr);
+  FuseFrontend frontend(&impl, &fetcher, (char*)command_line->output_root.ptr,
+                        (char*)disk_root.ptr);
+  std::string mount_error;
+  if (IsEmptyStr8(command_line->error) && mounted &&
+      !frontend.Mount(&mount_error)) {
+    command_line->error = PushStr8F(scratch.arena, "%s", mount_error.c_str());
+  }
   if (IsEmptyStr8(command_line->error)) {
-    BazelOutputServiceImpl service;
+    bazel_output_service::BazelOutputService::AsyncService service;
 
     Str8 address = PushStr8F(scratch.arena, "0.0.0.0:%d", command_line->port);
     grpc::ServerBuilder builder;
     builder.AddListeningPort((char*)address.ptr,
                              grpc::InsecureServerCredentials());
     builder.RegisterService(&service);
+    std::vector<std::unique_ptr<grpc::ServerCompletionQueue>> cqs;
+    for (uint32_t i = 0; i < command_line->threads; ++i) {
+      cqs.push_back(builder.AddCompletionQueue());
+    }
     std::unique_ptr<grpc::Server> server = builder.BuildAndStart();
     fprintf(stderr, "Server listening on port %d...\n", command_line->port);
 
-    server->Wait();
+    std::vector<std::thread> threads;
+    for (auto& cq : cqs) {
+      threads.emplace_back(ServeCompletionQueue, &service, &impl, cq.get());
+    }
+    if (mounted) {
+      fprintf(stderr, "Serving %s from %s...\n", command_line->output_root.ptr,
+              command_line->fuse_backing_root.ptr);
+      threads.emplace_back(&FuseFrontend::Serve, &frontend,
+                           command_line->threads);
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
   } else {
     fprintf(stderr, "%s\n", command_line->error.ptr);
     exit_code = 1;
@@ -15,40 +15,111 @@
 #ifndef BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_OUTPUT_SERVICE_BAZEL_OUTPUT_SERVICE_IMPL_H_
 #define BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_OUTPUT_SERVICE_BAZEL_OUTPUT_SERVICE_IMPL_H_
 
+#include <mutex>
+
 #include "src/main/protobuf/bazel_output_service.grpc.pb.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/artifact_table.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/memory.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/string.h"
 #include "grpcpp/server_context.h"
 #include "grpcpp/support/status.h"
 
-class BazelOutputServiceImpl
-    : public bazel_output_service::BazelOutputService::Service {
+struct OutputBase {
+  OutputBase *next;
+  Str8 id;
+  // The absolute path of the directory the builds of the output base write
+  // to.
+  Str8 output_path;
+  // Where the files in the output path are on disk. This is the output path
+  // unless it is served by a FuseFrontend.
+  Str8 disk_path;
+  // Where the contents of staged files can be fetched from, as passed by
+  // the last StartBuild.
+  Str8 remote_cache;
+  Str8 instance_name;
+  // The artifacts that have been staged or finalized in the output path.
+  ArtifactTable *table;
+  // The id of the build that is running, in the table's arena. Empty between
+  // builds.
+  Str8 build_id;
+};
+
+// Keeps track of the artifacts in the output paths in memory.
+//
+// Staged artifacts are only recorded with their digest, and are not written
+// to disk: BatchStat returns them from the table, so Bazel doesn't need to
+// download outputs it never reads, and a FuseFrontend fetches them when they
+// are opened. Artifacts that Bazel wrote itself are recorded when they are
+// finalized. Any other path is looked up on disk.
+//
+// With a state directory, the table of each output base is kept in a file
+// there, "<id>.table", and the output bases are loaded from their files when
+// the service starts, running builds included: a service that restarts knows
+// what was staged before without Bazel staging it again.
+//
+// The methods are called concurrently from the threads of the server.
+class BazelOutputServiceImpl {
+ public:
+  // The output paths of the output bases are created under `output_root`,
+  // unless Bazel passes a prefix. Their files are under `disk_root`, which
+  // is the output root unless it is served by a FuseFrontend. `state_dir`
+  // is empty to keep the tables in memory only.
+  BazelOutputServiceImpl(Str8 output_root, Str8 disk_root, Str8 state_dir);
+  ~BazelOutputServiceImpl();
+
   grpc::Status Clean(grpc::ServerContext* context,
                      const bazel_output_service::CleanRequest* request,
-                     bazel_output_service::CleanResponse* response) override;
+                     bazel_output_service::CleanResponse* response);
 
   grpc::Status StartBuild(
       grpc::ServerContext* context,
       const bazel_output_service::StartBuildRequest* request,
-      bazel_output_service::StartBuildResponse* response) override;
+      bazel_output_service::StartBuildResponse* response);
 
   grpc::Status StageArtifacts(
       grpc::ServerContext* context,
       const bazel_output_service::StageArtifactsRequest* request,
-      bazel_output_service::StageArtifactsResponse* response) override;
+      bazel_output_service::StageArtifactsResponse* response);
 
   grpc::Status FinalizeArtifacts(
       grpc::ServerContext* context,
       const bazel_output_service::FinalizeArtifactsRequest* request,
-      bazel_output_service::FinalizeArtifactsResponse* response) override;
+      bazel_output_service::FinalizeArtifactsResponse* response);
 
   grpc::Status FinalizeBuild(
       grpc::ServerContext* context,
       const bazel_output_service::FinalizeBuildRequest* request,
-      bazel_output_service::FinalizeBuildResponse* response) override;
+      bazel_output_service::FinalizeBuildResponse* response);
 
   grpc::Status BatchStat(
       grpc::ServerContext* context,
       const bazel_output_service::BatchStatRequest* request,
-      bazel_output_service::BatchStatResponse* response) override;
+      bazel_output_service::BatchStatResponse* response);
+
+  // Guards the output bases and their tables.
+  std::mutex& mutex() { return mutex_; }
+
+  // Returns the output base with the id, or 0. Requires the mutex.
+  OutputBase* FindOutputBase(Str8 id);
+
+ private:
+  OutputBase* FindBuild(Str8 build_id);
+
+  // Allocates a table for the output base with the id, in the state
+  // directory if there is one.
+  ArtifactTable* AllocTable(Str8 id);
+
+  // Adds the output bases whose tables are in the state directory, and
+  // deletes the files that cannot be loaded.
+  void LoadOutputBases();
+
+  std::mutex mutex_;
+  // Holds the output bases and the roots.
+  Arena* arena_;
+  Str8 output_root_;
+  Str8 disk_root_;
+  Str8 state_dir_;
+  OutputBase* output_bases_;
 };
 
 int RunServer(int argc, char** argv);
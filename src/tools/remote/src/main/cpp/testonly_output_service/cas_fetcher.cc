@@ -0,0 +1,294 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/remote/src/main/cpp/testonly_output_service/cas_fetcher.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "src/tools/remote/src/main/cpp/testonly_output_service/file_system.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/string.h"
+#include "grpcpp/client_context.h"
+#include "grpcpp/completion_queue.h"
+#include "grpcpp/create_channel.h"
+#include "grpcpp/generic/generic_stub.h"
+#include "grpcpp/security/credentials.h"
+#include "grpcpp/support/byte_buffer.h"
+#include "grpcpp/support/slice.h"
+#include "grpcpp/support/status.h"
+
+// The tree has no C++ bindings for google.bytestream, so the messages of
+// ByteStream.Read are encoded by hand:
+//
+//   message ReadRequest { string resource_name = 1; ... }
+//   message ReadResponse { bytes data = 10; }
+static const char kReadMethod[] = "/google.bytestream.ByteStream/Read";
+constexpr uint32_t kResourceNameField = 1;
+constexpr uint32_t kDataField = 10;
+
+enum WireType {
+  kWireTypeVarint = 0,
+  kWireTypeFixed64 = 1,
+  kWireTypeLengthDelimited = 2,
+  kWireTypeFixed32 = 5,
+};
+
+static void AppendVarint(std::string* out, uint64_t value) {
+  while (value >= 0x80) {
+    out->push_back((char)(value | 0x80));
+    value >>= 7;
+  }
+  out->push_back((char)value);
+}
+
+static bool ReadVarint(const uint8_t** ptr, const uint8_t* end,
+                       uint64_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 64 && *ptr < end; shift += 7) {
+    uint8_t byte = *(*ptr)++;
+    *value |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Finds the data of a ReadResponse. Returns false if it is malformed.
+static bool ParseReadResponse(const uint8_t* ptr, const uint8_t* end,
+                              const uint8_t** data, size_t* data_len) {
+  *data = ptr;
+  *data_len = 0;
+  while (ptr < end) {
+    uint64_t key;
+    uint64_t len;
+    if (!ReadVarint(&ptr, end, &key)) {
+      return false;
+    }
+    switch (key & 7) {
+      case kWireTypeVarint:
+        if (!ReadVarint(&ptr, end, &len)) {
+          return false;
+        }
+        break;
+      case kWireTypeFixed64:
+      case kWireTypeFixed32:
+        len = (key & 7) == kWireTypeFixed64 ? 8 : 4;
+        if ((uint64_t)(end - ptr) < len) {
+          return false;
+        }
+        ptr += len;
+        break;
+      case kWireTypeLengthDelimited:
+        if (!ReadVarint(&ptr, end, &len) || (uint64_t)(end - ptr) < len) {
+          return false;
+        }
+        if ((key >> 3) == kDataField) {
+          *data = ptr;
+          *data_len = len;
+        }
+        ptr += len;
+        break;
+      default:
+        return false;
+    }
+  }
+  return true;
+}
+
+static bool IsValidHash(const std::string& hash) {
+  if (hash.size() < 2) {
+    return false;
+  }
+  for (char c : hash) {
+    if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool WriteAll(int fd, const uint8_t* data, size_t len) {
+  while (len > 0) {
+    ssize_t written = write(fd, data, len);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    len -= written;
+  }
+  return true;
+}
+
+// Waits for the next event of a call that has a completion queue of its own.
+static bool Wait(grpc::CompletionQueue* cq) {
+  void* tag;
+  bool ok = false;
+  bool result = cq->Next(&tag, &ok) && ok;
+  return result;
+}
+
+CasFetcher::CasFetcher(std::string cas_dir) : cas_dir_(std::move(cas_dir)) {}
+
+std::shared_ptr<grpc::Channel> CasFetcher::GetChannel(
+    const std::string& target) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::shared_ptr<grpc::Channel>& channel = channels_[target];
+  if (!channel) {
+    channel = grpc::CreateChannel(target, grpc::InsecureChannelCredentials());
+  }
+  return channel;
+}
+
+std::string CasFetcher::Fetch(const std::string& remote_cache,
+                              const std::string& instance_name,
+                              const std::string& hash, int64_t size_bytes,
+                              std::string* error) {
+  if (!IsValidHash(hash) || size_bytes < 0) {
+    *error = "Invalid digest " + hash;
+    return std::string();
+  }
+  std::string dir = cas_dir_ + "/cas/" + hash.substr(0, 2);
+  std::string path = dir + "/" + hash;
+  struct stat st;
+  if (stat(path.c_str(), &st) == 0 && st.st_size == size_bytes) {
+    return path;
+  }
+
+  // Only plaintext gRPC is supported, since the service is linked against
+  // the unsecure gRPC library.
+  std::string target = remote_cache;
+  if (target.compare(0, 7, "grpc://") == 0) {
+    target = target.substr(7);
+  }
+  if (size_bytes > 0 &&
+      (target.empty() || target.find("://") != std::string::npos)) {
+    *error = "Cannot fetch " + hash + " from remote cache '" + remote_cache +
+             "'";
+    return std::string();
+  }
+
+  static std::atomic<uint64_t> counter{0};
+  std::string temp_path = path + ".tmp" + std::to_string(getpid()) + "-" +
+                          std::to_string(counter++);
+  if (!CreateDirectories(Str8FromCStr(dir.c_str()))) {
+    *error = "Failed to create " + dir;
+    return std::string();
+  }
+  int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                0644);
+  if (fd < 0) {
+    *error = "Failed to create " + temp_path + ": " + strerror(errno);
+    return std::string();
+  }
+
+  int64_t received = 0;
+  bool ok = true;
+  if (size_bytes > 0) {
+    std::string resource_name =
+        (instance_name.empty() ? std::string() : instance_name + "/") +
+        "blobs/" + hash + "/" + std::to_string(size_bytes);
+    std::string request;
+    AppendVarint(&request,
+                 (kResourceNameField << 3) | kWireTypeLengthDelimited);
+    AppendVarint(&request, resource_name.size());
+    request += resource_name;
+    grpc::Slice request_slice(request);
+    grpc::ByteBuffer request_buffer(&request_slice, 1);
+
+    grpc::GenericStub stub(GetChannel(target));
+    grpc::ClientContext context;
+    grpc::CompletionQueue cq;
+    std::unique_ptr<grpc::GenericClientAsyncReaderWriter> call =
+        stub.PrepareCall(&context, kReadMethod, &cq);
+    call->StartCall(0);
+    // The call fails below with its status if it cannot be started.
+    if (Wait(&cq)) {
+      call->WriteLast(request_buffer, grpc::WriteOptions(), 0);
+      if (Wait(&cq)) {
+        grpc::ByteBuffer response;
+        for (;;) {
+          call->Read(&response, 0);
+          if (!Wait(&cq)) {
+            break;
+          }
+          grpc::Slice slice;
+          const uint8_t* data;
+          size_t data_len;
+          if (!response.DumpToSingleSlice(&slice).ok() ||
+              !ParseReadResponse(slice.begin(), slice.end(), &data,
+                                 &data_len)) {
+            *error = "Malformed response for " + resource_name;
+            ok = false;
+            context.TryCancel();
+            break;
+          }
+          if (!WriteAll(fd, data, data_len)) {
+            *error = "Failed to write " + temp_path + ": " + strerror(errno);
+            ok = false;
+            context.TryCancel();
+            break;
+          }
+          received += data_len;
+        }
+      }
+    }
+    grpc::Status status;
+    call->Finish(&status, 0);
+    Wait(&cq);
+    cq.Shutdown();
+    void* tag;
+    bool ignored;
+    while (cq.Next(&tag, &ignored)) {
+    }
+    if (ok && !status.ok()) {
+      *error = "Failed to read " + resource_name + ": " +
+               status.error_message();
+      ok = false;
+    }
+  }
+  if (close(fd) != 0 && ok) {
+    *error = "Failed to write " + temp_path + ": " + strerror(errno);
+    ok = false;
+  }
+  if (ok && received != size_bytes) {
+    *error = "Got " + std::to_string(received) + " bytes for " + hash +
+             ", expected " + std::to_string(size_bytes);
+    ok = false;
+  }
+  if (ok && rename(temp_path.c_str(), path.c_str()) != 0) {
+    *error = "Failed to rename " + temp_path + ": " + strerror(errno);
+    ok = false;
+  }
+  if (!ok) {
+    unlink(temp_path.c_str());
+    return std::string();
+  }
+  return path;
+}
@@ -0,0 +1,52 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_TESTONLY_OUTPUT_SERVICE_CAS_FETCHER_H_
+#define BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_TESTONLY_OUTPUT_SERVICE_CAS_FETCHER_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "grpcpp/channel.h"
+
+// Fetches blobs from the remote cache into a local content addressed
+// directory, which has the same layout as Bazel's --disk_cache, so that a
+// disk cache can be shared with Bazel.
+//
+// Blobs are written to a temporary file and renamed into place once they are
+// complete, so concurrent fetches of the same blob are safe.
+class CasFetcher {
+ public:
+  explicit CasFetcher(std::string cas_dir);
+
+  // Returns the path of the blob in the local directory, and fetches it from
+  // the remote cache first unless it is already there. Returns an empty
+  // string and sets `error` on failure.
+  std::string Fetch(const std::string& remote_cache,
+                    const std::string& instance_name, const std::string& hash,
+                    int64_t size_bytes, std::string* error);
+
+ private:
+  std::shared_ptr<grpc::Channel> GetChannel(const std::string& target);
+
+  std::string cas_dir_;
+  std::mutex mutex_;
+  std::unordered_map<std::string, std::shared_ptr<grpc::Channel>> channels_;
+};
+
+#endif  // BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_TESTONLY_OUTPUT_SERVICE_CAS_FETCHER_H_
@@ -0,0 +1,53 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_TESTONLY_OUTPUT_SERVICE_FILE_SYSTEM_H_
+#define BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_TESTONLY_OUTPUT_SERVICE_FILE_SYSTEM_H_
+
+#include <stddef.h>
+
+#include "src/tools/remote/src/main/cpp/testonly_output_service/memory.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/string.h"
+
+enum FileType {
+  kFileTypeNone,
+  kFileTypeFile,
+  kFileTypeDirectory,
+  kFileTypeSymlink,
+};
+
+struct FileStat {
+  FileType type;
+  // The target of a symlink.
+  Str8 symlink_target;
+};
+
+// Stats the paths, which are relative to `root`, without following symlinks.
+// The root is opened once for the whole batch, so each path is only resolved
+// from there. The targets of symlinks are pushed onto the arena.
+void StatFiles(Arena *arena, Str8 root, Str8 *paths, size_t count,
+               FileStat *stats);
+
+// Creates the directory and its parents. Returns false on failure.
+bool CreateDirectories(Str8 path);
+
+// Deletes the directory and everything in it. Returns false on failure.
+bool DeleteTree(Str8 path);
+
+// Pushes the names of the entries of the directory, other than "." and "..",
+// onto the arena, and returns how many there are. A directory that cannot be
+// read has none.
+size_t ListDirectory(Arena *arena, Str8 path, Str8 **names);
+
+#endif  // BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_TESTONLY_OUTPUT_SERVICE_FILE_SYSTEM_H_
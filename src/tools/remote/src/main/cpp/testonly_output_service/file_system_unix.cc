@@ -0,0 +1,147 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "src/tools/remote/src/main/cpp/testonly_output_service/file_system.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/memory.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/string.h"
+
+static Str8 ReadLinkAt(Arena *arena, int dir_fd, Str8 path, size_t size) {
+  // st_size is 0 for some symlinks, e.g. in /proc.
+  size_t buf_len = size ? size + 1 : 256;
+  for (;;) {
+    uint8_t *buf_ptr = PushArray(arena, uint8_t, buf_len);
+    ssize_t len = readlinkat(dir_fd, (char *)path.ptr, (char *)buf_ptr,
+                             buf_len);
+    if (len < 0) {
+      PopArena(arena, buf_len);
+      return Str8{};
+    }
+    if ((size_t)len < buf_len) {
+      // Free the unused part of the buffer, but keep the null terminator.
+      PopArena(arena, buf_len - len - 1);
+      Str8 result = {buf_ptr, (size_t)len};
+      return result;
+    }
+    PopArena(arena, buf_len);
+    buf_len *= 2;
+  }
+}
+
+void StatFiles(Arena *arena, Str8 root, Str8 *paths, size_t count,
+               FileStat *stats) {
+  int root_fd = open((char *)root.ptr, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  for (size_t i = 0; i < count; ++i) {
+    FileStat *stat = stats + i;
+    *stat = FileStat{};
+    struct stat st;
+    if (root_fd < 0 ||
+        fstatat(root_fd, (char *)paths[i].ptr, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+      continue;
+    }
+    if (S_ISREG(st.st_mode)) {
+      stat->type = kFileTypeFile;
+    } else if (S_ISDIR(st.st_mode)) {
+      stat->type = kFileTypeDirectory;
+    } else if (S_ISLNK(st.st_mode)) {
+      stat->type = kFileTypeSymlink;
+      stat->symlink_target =
+          ReadLinkAt(arena, root_fd, paths[i], (size_t)st.st_size);
+    }
+  }
+  if (root_fd >= 0) {
+    close(root_fd);
+  }
+}
+
+bool CreateDirectories(Str8 path) {
+  TemporaryMemory scratch = BeginScratch(0);
+  Str8 copy = PushStr8(scratch.arena, path);
+  bool result = true;
+  for (size_t i = 1; i <= copy.len && result; ++i) {
+    if (i == copy.len || copy.ptr[i] == '/') {
+      uint8_t saved = copy.ptr[i];
+      copy.ptr[i] = 0;
+      if (mkdir((char *)copy.ptr, 0755) != 0 && errno != EEXIST) {
+        result = false;
+      }
+      copy.ptr[i] = saved;
+    }
+  }
+  EndScratch(scratch);
+  return result;
+}
+
+static int RemoveEntry(const char *path, const struct stat *st, int type,
+                       struct FTW *ftw) {
+  int result = remove(path);
+  return result;
+}
+
+bool DeleteTree(Str8 path) {
+  struct stat st;
+  if (lstat((char *)path.ptr, &st) != 0) {
+    bool result = errno == ENOENT;
+    return result;
+  }
+  bool result =
+      nftw((char *)path.ptr, RemoveEntry, 64, FTW_DEPTH | FTW_PHYS) == 0;
+  return result;
+}
+
+size_t ListDirectory(Arena *arena, Str8 path, Str8 **names) {
+  *names = 0;
+  DIR *dir = opendir((char *)path.ptr);
+  if (!dir) {
+    return 0;
+  }
+  // The list grows in scratch memory, so that only the names and the final
+  // list are left on the arena.
+  TemporaryMemory scratch = BeginScratch(arena);
+  Str8 *list = 0;
+  size_t count = 0;
+  size_t capacity = 0;
+  while (struct dirent *entry = readdir(dir)) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+    if (count == capacity) {
+      size_t new_capacity = capacity ? capacity * 2 : 64;
+      Str8 *new_list = PushArray(scratch.arena, Str8, new_capacity);
+      if (count) {
+        memcpy(new_list, list, count * sizeof(Str8));
+      }
+      list = new_list;
+      capacity = new_capacity;
+    }
+    list[count++] = PushStr8(arena, Str8FromCStr(entry->d_name));
+  }
+  closedir(dir);
+  if (count) {
+    *names = PushArray(arena, Str8, count);
+    memcpy(*names, list, count * sizeof(Str8));
+  }
+  EndScratch(scratch);
+  return count;
+}
@@ -0,0 +1,144 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_TESTONLY_OUTPUT_SERVICE_FUSE_FRONTEND_H_
+#define BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_TESTONLY_OUTPUT_SERVICE_FUSE_FRONTEND_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "src/tools/remote/src/main/cpp/testonly_output_service/bazel_output_service_impl.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/cas_fetcher.h"
+
+struct FuseRequest;
+struct StagedFile;
+
+// Serves the output root as a FUSE file system, so that staged artifacts
+// appear as regular files without being downloaded.
+//
+// The directory of each output base shows the merge of the files on disk,
+// under `disk_root`, and the artifact table of the output base. A staged file
+// takes its metadata from the table and is only fetched into the local CAS
+// when it is opened. Reads are then served by the kernel straight from the
+// blob if it supports FUSE passthrough, and by the frontend otherwise. A
+// staged file that is opened for writing is first copied to disk, and then
+// belongs to the disk, which fails with ETXTBSY while the staged file is open
+// with passthrough. Everything else is passed through to the disk.
+//
+// The FUSE protocol is spoken directly over /dev/fuse, which needs
+// CAP_SYS_ADMIN to mount.
+class FuseFrontend {
+ public:
+  FuseFrontend(BazelOutputServiceImpl* service, CasFetcher* fetcher,
+               std::string mount_point, std::string disk_root);
+  ~FuseFrontend();
+
+  // Mounts the file system over the mount point, replacing a stale mount.
+  // Returns false and sets `error` on failure.
+  bool Mount(std::string* error);
+
+  // Serves requests on `threads` threads until the file system is unmounted.
+  void Serve(uint32_t threads);
+
+ private:
+  struct Node {
+    uint64_t parent;
+    std::string name;
+    uint64_t lookups;
+  };
+  // The backing file registered with the kernel for the open files of a
+  // node. The kernel only allows one at a time.
+  struct Backing {
+    int32_t id;
+    dev_t dev;
+    ino_t ino;
+    uint32_t opens;
+  };
+
+  void ServeDevice(int fd);
+  void Dispatch(FuseRequest* request);
+
+  // The methods below that aren't documented otherwise require the mutex of
+  // the service.
+  bool NodePath(uint64_t nodeid, std::string* path);
+  uint64_t AddLookup(uint64_t parent, const std::string& name);
+  void Forget(uint64_t nodeid, uint64_t lookups);
+  void DetachNode(uint64_t parent, const std::string& name);
+  void MoveNode(uint64_t parent, const std::string& name, uint64_t new_parent,
+                const std::string& new_name);
+  Artifact* FindPathArtifact(const std::string& path, OutputBase** output_base);
+  bool IsOutputBase(const std::string& path);
+  int StatPath(const std::string& path, struct stat* st);
+  bool GetStagedFile(const std::string& path, StagedFile* file);
+  int EnsureDiskParent(const std::string& path);
+  bool IsEmptyDirectory(const std::string& path, Artifact* artifact);
+
+  // Copies the staged file to disk and drops it from the table. Doesn't
+  // require the mutex.
+  int Materialize(const std::string& path, bool fetch);
+  // Fetches the contents of the staged file. Doesn't require the mutex.
+  int FetchFile(const StagedFile& file, std::string* blob_path);
+  // Opens the file for reading or writing, with a passthrough to the opened
+  // file if possible. Doesn't require the mutex.
+  int OpenFile(uint64_t nodeid, const std::string& path, uint32_t flags,
+               uint64_t* fh, uint32_t* open_flags, int32_t* backing_id);
+
+  void Lookup(FuseRequest* request);
+  void GetAttr(FuseRequest* request);
+  void SetAttr(FuseRequest* request);
+  void ReadLink(FuseRequest* request);
+  void MakeNode(FuseRequest* request);
+  void Unlink(FuseRequest* request, bool directory);
+  void Rename(FuseRequest* request, uint64_t new_parent, uint32_t flags,
+              const char* names);
+  void Link(FuseRequest* request);
+  void Open(FuseRequest* request);
+  void Create(FuseRequest* request);
+  void Read(FuseRequest* request);
+  void Write(FuseRequest* request);
+  void Release(FuseRequest* request);
+  void Fsync(FuseRequest* request);
+  void OpenDir(FuseRequest* request);
+  void ReadDir(FuseRequest* request);
+  void ReleaseDir(FuseRequest* request);
+  void StatFs(FuseRequest* request);
+  void Init(FuseRequest* request);
+
+  BazelOutputServiceImpl* service_;
+  CasFetcher* fetcher_;
+  std::string mount_point_;
+  std::string disk_root_;
+  int fd_;
+  bool passthrough_;
+  // The owner and time of the directories and files that are only in the
+  // tables.
+  uid_t uid_;
+  gid_t gid_;
+  struct timespec mount_time_;
+  // Keyed by the node id that the kernel uses to refer to a path. The root
+  // is 1.
+  std::unordered_map<uint64_t, Node> nodes_;
+  // Keyed by the parent's id and the name.
+  std::unordered_map<std::string, uint64_t> children_;
+  uint64_t next_nodeid_;
+  std::mutex backings_mutex_;
+  std::unordered_map<uint64_t, Backing> backings_;
+};
+
+#endif  // BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_TESTONLY_OUTPUT_SERVICE_FUSE_FRONTEND_H_
@@ -0,0 +1,1402 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <linux/fuse.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "src/tools/remote/src/main/cpp/testonly_output_service/artifact_table.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/bazel_output_service_impl.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/cas_fetcher.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/file_system.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/fuse_frontend.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/memory.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/string.h"
+
+// Passthrough was added in protocol 7.40, which the headers may predate.
+#ifndef FUSE_PASSTHROUGH
+#define FUSE_PASSTHROUGH (1ULL << 37)
+#define FOPEN_PASSTHROUGH (1 << 7)
+struct fuse_backing_map {
+  int32_t fd;
+  uint32_t flags;
+  uint64_t padding;
+};
+#define FUSE_DEV_IOC_BACKING_OPEN \
+  _IOW(FUSE_DEV_IOC_MAGIC, 1, struct fuse_backing_map)
+#define FUSE_DEV_IOC_BACKING_CLOSE _IOW(FUSE_DEV_IOC_MAGIC, 2, uint32_t)
+// The fields took the place of the padding.
+static void SetMaxStackDepth(fuse_init_out* out, uint32_t depth) {
+  out->unused[0] = depth;
+}
+static void SetBackingId(fuse_open_out* out, int32_t backing_id) {
+  out->padding = (uint32_t)backing_id;
+}
+#else
+static void SetMaxStackDepth(fuse_init_out* out, uint32_t depth) {
+  out->max_stack_depth = depth;
+}
+static void SetBackingId(fuse_open_out* out, int32_t backing_id) {
+  out->backing_id = backing_id;
+}
+#endif
+
+#ifndef FUSE_DIRECT_IO_ALLOW_MMAP
+#define FUSE_DIRECT_IO_ALLOW_MMAP (1ULL << 36)
+#endif
+
+constexpr uint64_t kRootId = FUSE_ROOT_ID;
+// Reported as the inode number of directory entries, so that it is taken
+// from the attributes instead.
+constexpr uint64_t kUnknownIno = 0xffffffff;
+constexpr uint32_t kMaxWrite = 1024 * 1024;
+// Room for the largest write and its headers.
+constexpr size_t kBufferSize = kMaxWrite + 4096;
+// Set in the handle of a file that uses the backing file of its node.
+constexpr uint64_t kBackingBit = 1ull << 32;
+
+struct FuseRequest {
+  int fd;
+  fuse_in_header* header;
+  uint8_t* body;
+  size_t body_len;
+  // kMaxWrite bytes for the data of replies.
+  uint8_t* out;
+};
+
+struct StagedFile {
+  std::string hash;
+  int64_t size_bytes;
+  uint32_t mode;
+  std::string remote_cache;
+  std::string instance_name;
+};
+
+struct DirEntry {
+  std::string name;
+  uint32_t type;
+};
+
+struct DirHandle {
+  std::vector<DirEntry> entries;
+};
+
+static inline Str8 Str8FromString(const std::string& str) {
+  Str8 result = {(uint8_t*)str.data(), str.size()};
+  return result;
+}
+
+static std::string JoinPath(const std::string& parent, const char* name) {
+  std::string result = parent.empty() ? std::string(name)
+                                      : parent + "/" + name;
+  return result;
+}
+
+static std::string DiskPath(const std::string& disk_root,
+                            const std::string& path) {
+  std::string result = path.empty() ? disk_root : disk_root + "/" + path;
+  return result;
+}
+
+static std::string ChildKey(uint64_t parent, const std::string& name) {
+  std::string result((const char*)&parent, sizeof(parent));
+  result += name;
+  return result;
+}
+
+static const char* BaseName(Str8 path) {
+  const char* slash = (const char*)memrchr(path.ptr, '/', path.len);
+  const char* result = slash ? slash + 1 : (const char*)path.ptr;
+  return result;
+}
+
+static void FillAttr(uint64_t nodeid, const struct stat& st, fuse_attr* attr) {
+  *attr = fuse_attr{};
+  attr->ino = nodeid;
+  attr->size = st.st_size;
+  attr->blocks = st.st_blocks;
+  attr->atime = st.st_atim.tv_sec;
+  attr->atimensec = st.st_atim.tv_nsec;
+  attr->mtime = st.st_mtim.tv_sec;
+  attr->mtimensec = st.st_mtim.tv_nsec;
+  attr->ctime = st.st_ctim.tv_sec;
+  attr->ctimensec = st.st_ctim.tv_nsec;
+  attr->mode = st.st_mode;
+  attr->nlink = st.st_nlink;
+  attr->uid = st.st_uid;
+  attr->gid = st.st_gid;
+  attr->rdev = st.st_rdev;
+  attr->blksize = st.st_blksize;
+}
+
+// Gives a new file to the user that created it, like a local file system
+// would, when the service runs as root.
+static void SetOwner(const std::string& disk_path, uid_t uid, gid_t gid) {
+  if (geteuid() == 0) {
+    lchown(disk_path.c_str(), uid, gid);
+  }
+}
+
+static int CopyFile(const std::string& from, int to_fd) {
+  int from_fd = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+  if (from_fd < 0) {
+    return errno;
+  }
+  int error = 0;
+  // Share the blocks of the blob if the file system can, and copy them in
+  // the kernel otherwise.
+  if (ioctl(to_fd, FICLONE, from_fd) != 0) {
+    for (;;) {
+      ssize_t copied =
+          copy_file_range(from_fd, 0, to_fd, 0, kMaxWrite, 0);
+      if (copied > 0) {
+        continue;
+      }
+      if (copied < 0) {
+        error = errno;
+      }
+      break;
+    }
+    if (error == EXDEV || error == EINVAL || error == ENOSYS) {
+      error = 0;
+      uint8_t buffer[64 * 1024];
+      for (;;) {
+        ssize_t len = read(from_fd, buffer, sizeof(buffer));
+        if (len <= 0) {
+          error = len < 0 ? errno : 0;
+          break;
+        }
+        if (write(to_fd, buffer, len) != len) {
+          error = errno ? errno : EIO;
+          break;
+        }
+      }
+    }
+  }
+  close(from_fd);
+  return error;
+}
+
+static void Reply(FuseRequest* request, int error, const void* data,
+                  size_t len);
+
+static void ReplyError(FuseRequest* request, int error) {
+  Reply(request, error, 0, 0);
+}
+
+FuseFrontend::FuseFrontend(BazelOutputServiceImpl* service,
+                           CasFetcher* fetcher, std::string mount_point,
+                           std::string disk_root)
+    : service_(service),
+      fetcher_(fetcher),
+      mount_point_(std::move(mount_point)),
+      disk_root_(std::move(disk_root)),
+      fd_(-1),
+      passthrough_(false),
+      uid_(0),
+      gid_(0),
+      mount_time_{},
+      next_nodeid_(kRootId + 1) {
+  nodes_[kRootId] = Node{0, std::string(), 1};
+}
+
+FuseFrontend::~FuseFrontend() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool FuseFrontend::Mount(std::string* error) {
+  // A mount that is left behind by a service that died cannot be used.
+  umount2(mount_point_.c_str(), MNT_DETACH);
+  struct stat st;
+  if (!CreateDirectories(Str8FromString(mount_point_)) ||
+      !CreateDirectories(Str8FromString(disk_root_)) ||
+      stat(disk_root_.c_str(), &st) != 0) {
+    *error = "Failed to create " + mount_point_ + " or " + disk_root_;
+    return false;
+  }
+  uid_ = st.st_uid;
+  gid_ = st.st_gid;
+  clock_gettime(CLOCK_REALTIME, &mount_time_);
+  // The kernel applies the umask of the caller before it passes a mode on.
+  umask(0);
+
+  fd_ = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+  if (fd_ < 0) {
+    *error = std::string("Failed to open /dev/fuse: ") + strerror(errno);
+    return false;
+  }
+  std::string options = "fd=" + std::to_string(fd_) +
+                        ",rootmode=40000,user_id=" + std::to_string(getuid()) +
+                        ",group_id=" + std::to_string(getgid()) +
+                        ",allow_other";
+  if (mount("testonly_output_service", mount_point_.c_str(),
+            "fuse.testonly_output_service", MS_NOSUID | MS_NODEV,
+            options.c_str()) != 0) {
+    *error = "Failed to mount " + mount_point_ + ": " + strerror(errno);
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  return true;
+}
+
+void FuseFrontend::Serve(uint32_t threads) {
+  std::vector<int> fds = {fd_};
+  // Each thread reads from its own clone of the device, so that requests
+  // are spread across them.
+  for (uint32_t i = 1; i < threads; ++i) {
+    int fd = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+    uint32_t master_fd = fd_;
+    if (fd < 0 || ioctl(fd, FUSE_DEV_IOC_CLONE, &master_fd) != 0) {
+      if (fd >= 0) {
+        close(fd);
+      }
+      break;
+    }
+    fds.push_back(fd);
+  }
+  std::vector<std::thread> serving;
+  for (int fd : fds) {
+    serving.emplace_back(&FuseFrontend::ServeDevice, this, fd);
+  }
+  for (std::thread& thread : serving) {
+    thread.join();
+  }
+  for (size_t i = 1; i < fds.size(); ++i) {
+    close(fds[i]);
+  }
+}
+
+void FuseFrontend::ServeDevice(int fd) {
+  std::vector<uint8_t> in(kBufferSize);
+  std::vector<uint8_t> out(kMaxWrite);
+  for (;;) {
+    ssize_t len = read(fd, in.data(), in.size());
+    if (len < 0) {
+      // ENOENT means that the request was interrupted, and ENODEV that the
+      // file system was unmounted.
+      if (errno == EINTR || errno == EAGAIN || errno == ENOENT) {
+        continue;
+      }
+      if (errno != ENODEV) {
+        perror("Failed to read from /dev/fuse");
+      }
+      break;
+    }
+    if ((size_t)len < sizeof(fuse_in_header)) {
+      continue;
+    }
+    FuseRequest request = {};
+    request.fd = fd;
+    request.header = (fuse_in_header*)in.data();
+    request.body = in.data() + sizeof(fuse_in_header);
+    request.body_len = len - sizeof(fuse_in_header);
+    request.out = out.data();
+    Dispatch(&request);
+  }
+}
+
+static void Reply(FuseRequest* request, int error, const void* data,
+                  size_t len) {
+  fuse_out_header header = {};
+  header.len = sizeof(header) + (error ? 0 : len);
+  header.error = -error;
+  header.unique = request->header->unique;
+  struct iovec iov[2] = {{&header, sizeof(header)}, {(void*)data, len}};
+  // The kernel drops the replies to requests that were interrupted.
+  writev(request->fd, iov, error || !len ? 1 : 2);
+}
+
+void FuseFrontend::Dispatch(FuseRequest* request) {
+  uint64_t nodeid = request->header->nodeid;
+  switch (request->header->opcode) {
+    case FUSE_INIT:
+      Init(request);
+      break;
+    case FUSE_DESTROY:
+      ReplyError(request, 0);
+      break;
+    case FUSE_LOOKUP:
+      Lookup(request);
+      break;
+    case FUSE_FORGET: {
+      fuse_forget_in* in = (fuse_forget_in*)request->body;
+      std::lock_guard<std::mutex> lock(service_->mutex());
+      Forget(nodeid, in->nlookup);
+      break;
+    }
+    case FUSE_BATCH_FORGET: {
+      fuse_batch_forget_in* in = (fuse_batch_forget_in*)request->body;
+      fuse_forget_one* forgets = (fuse_forget_one*)(in + 1);
+      std::lock_guard<std::mutex> lock(service_->mutex());
+      for (uint32_t i = 0; i < in->count; ++i) {
+        Forget(forgets[i].nodeid, forgets[i].nlookup);
+      }
+      break;
+    }
+    case FUSE_GETATTR:
+      GetAttr(request);
+      break;
+    case FUSE_SETATTR:
+      SetAttr(request);
+      break;
+    case FUSE_READLINK:
+      ReadLink(request);
+      break;
+    case FUSE_MKNOD:
+    case FUSE_MKDIR:
+    case FUSE_SYMLINK:
+      MakeNode(request);
+      break;
+    case FUSE_UNLINK:
+      Unlink(request, false);
+      break;
+    case FUSE_RMDIR:
+      Unlink(request, true);
+      break;
+    case FUSE_RENAME: {
+      fuse_rename_in* in = (fuse_rename_in*)request->body;
+      Rename(request, in->newdir, 0, (const char*)(in + 1));
+      break;
+    }
+    case FUSE_RENAME2: {
+      fuse_rename2_in* in = (fuse_rename2_in*)request->body;
+      Rename(request, in->newdir, in->flags, (const char*)(in + 1));
+      break;
+    }
+    case FUSE_LINK:
+      Link(request);
+      break;
+    case FUSE_OPEN:
+      Open(request);
+      break;
+    case FUSE_CREATE:
+      Create(request);
+      break;
+    case FUSE_READ:
+      Read(request);
+      break;
+    case FUSE_WRITE:
+      Write(request);
+      break;
+    case FUSE_RELEASE:
+      Release(request);
+      break;
+    case FUSE_FSYNC:
+      Fsync(request);
+      break;
+    case FUSE_FLUSH:
+    case FUSE_FSYNCDIR:
+      ReplyError(request, 0);
+      break;
+    case FUSE_OPENDIR:
+      OpenDir(request);
+      break;
+    case FUSE_READDIR:
+      ReadDir(request);
+      break;
+    case FUSE_RELEASEDIR:
+      ReleaseDir(request);
+      break;
+    case FUSE_STATFS:
+      StatFs(request);
+      break;
+    case FUSE_INTERRUPT:
+      // Requests are short, so they are allowed to finish.
+      break;
+    default:
+      ReplyError(request, ENOSYS);
+      break;
+  }
+}
+
+void FuseFrontend::Init(FuseRequest* request) {
+  fuse_init_in* in = (fuse_init_in*)request->body;
+  if (in->major != FUSE_KERNEL_VERSION) {
+    fprintf(stderr, "Unsupported FUSE protocol %u.%u\n", in->major,
+            in->minor);
+    ReplyError(request, EPROTO);
+    return;
+  }
+  uint64_t offered = in->flags;
+  if (offered & FUSE_INIT_EXT) {
+    offered |= (uint64_t)in->flags2 << 32;
+  }
+  uint64_t flags = offered & (FUSE_ASYNC_READ | FUSE_ATOMIC_O_TRUNC |
+                              FUSE_BIG_WRITES | FUSE_PARALLEL_DIROPS |
+                              FUSE_MAX_PAGES | FUSE_INIT_EXT |
+                              FUSE_DIRECT_IO_ALLOW_MMAP | FUSE_PASSTHROUGH);
+  passthrough_ = (flags & FUSE_PASSTHROUGH) != 0;
+
+  fuse_init_out out = {};
+  out.major = FUSE_KERNEL_VERSION;
+  out.minor = FUSE_KERNEL_MINOR_VERSION;
+  out.max_readahead = in->max_readahead;
+  out.flags = (uint32_t)flags;
+  out.flags2 = (uint32_t)(flags >> 32);
+  out.max_background = 64;
+  out.congestion_threshold = 48;
+  out.max_write = kMaxWrite;
+  out.time_gran = 1;
+  out.max_pages = kMaxWrite / GetPageSize();
+  if (passthrough_) {
+    // The blobs and the files on disk are on regular file systems.
+    SetMaxStackDepth(&out, 1);
+  }
+  Reply(request, 0, &out, sizeof(out));
+}
+
+bool FuseFrontend::NodePath(uint64_t nodeid, std::string* path) {
+  std::vector<const std::string*> names;
+  while (nodeid != kRootId) {
+    auto it = nodes_.find(nodeid);
+    // Nodes without a parent have been removed.
+    if (it == nodes_.end() || !it->second.parent) {
+      return false;
+    }
+    names.push_back(&it->second.name);
+    nodeid = it->second.parent;
+  }
+  path->clear();
+  for (size_t i = names.size(); i-- > 0;) {
+    if (!path->empty()) {
+      path->push_back('/');
+    }
+    *path += *names[i];
+  }
+  return true;
+}
+
+uint64_t FuseFrontend::AddLookup(uint64_t parent, const std::string& name) {
+  uint64_t& nodeid = children_[ChildKey(parent, name)];
+  if (nodeid) {
+    ++nodes_[nodeid].lookups;
+  } else {
+    nodeid = next_nodeid_++;
+    nodes_[nodeid] = Node{parent, name, 1};
+  }
+  return nodeid;
+}
+
+void FuseFrontend::Forget(uint64_t nodeid, uint64_t lookups) {
+  auto it = nodes_.find(nodeid);
+  if (nodeid == kRootId || it == nodes_.end()) {
+    return;
+  }
+  Node* node = &it->second;
+  node->lookups -= lookups < node->lookups ? lookups : node->lookups;
+  if (!node->lookups) {
+    if (node->parent) {
+      children_.erase(ChildKey(node->parent, node->name));
+    }
+    nodes_.erase(it);
+  }
+}
+
+void FuseFrontend::DetachNode(uint64_t parent, const std::string& name) {
+  auto it = children_.find(ChildKey(parent, name));
+  if (it != children_.end()) {
+    nodes_[it->second].parent = 0;
+    children_.erase(it);
+  }
+}
+
+void FuseFrontend::MoveNode(uint64_t parent, const std::string& name,
+                            uint64_t new_parent, const std::string& new_name) {
+  DetachNode(new_parent, new_name);
+  auto it = children_.find(ChildKey(parent, name));
+  if (it != children_.end()) {
+    uint64_t nodeid = it->second;
+    children_.erase(it);
+    children_[ChildKey(new_parent, new_name)] = nodeid;
+    nodes_[nodeid].parent = new_parent;
+    nodes_[nodeid].name = new_name;
+  }
+}
+
+Artifact* FuseFrontend::FindPathArtifact(const std::string& path,
+                                         OutputBase** output_base) {
+  if (output_base) {
+    *output_base = 0;
+  }
+  if (path.empty()) {
+    return 0;
+  }
+  size_t slash = path.find('/');
+  std::string id = path.substr(0, slash);
+  OutputBase* base = service_->FindOutputBase(Str8FromString(id));
+  if (!base || !base->table) {
+    return 0;
+  }
+  if (output_base) {
+    *output_base = base;
+  }
+  std::string table_path =
+      slash == std::string::npos ? std::string() : path.substr(slash + 1);
+  Artifact* result = FindArtifact(base->table, Str8FromString(table_path));
+  return result;
+}
+
+bool FuseFrontend::IsOutputBase(const std::string& path) {
+  OutputBase* output_base;
+  FindPathArtifact(path, &output_base);
+  bool result = output_base && path.find('/') == std::string::npos;
+  return result;
+}
+
+int FuseFrontend::StatPath(const std::string& path, struct stat* st) {
+  Artifact* artifact = FindPathArtifact(path, 0);
+  if (artifact && artifact->kind == kArtifactFile && artifact->staged) {
+    *st = {};
+    st->st_mode = S_IFREG | artifact->mode;
+    st->st_nlink = 1;
+    st->st_size = artifact->size_bytes;
+    st->st_blocks = (artifact->size_bytes + 511) / 512;
+  } else {
+    int error = lstat(DiskPath(disk_root_, path).c_str(), st) == 0 ? 0 : errno;
+    bool is_directory = artifact && artifact->kind == kArtifactDirectory;
+    if (!error && (!is_directory || S_ISDIR(st->st_mode))) {
+      return 0;
+    }
+    if (!is_directory) {
+      return error;
+    }
+    // The directory is only in the table.
+    *st = {};
+    st->st_mode = S_IFDIR | 0755;
+    st->st_nlink = 2;
+  }
+  st->st_uid = uid_;
+  st->st_gid = gid_;
+  st->st_blksize = KiB(4);
+  st->st_atim = mount_time_;
+  st->st_mtim = mount_time_;
+  st->st_ctim = mount_time_;
+  return 0;
+}
+
+bool FuseFrontend::GetStagedFile(const std::string& path, StagedFile* file) {
+  OutputBase* output_base;
+  Artifact* artifact = FindPathArtifact(path, &output_base);
+  if (!artifact || artifact->kind != kArtifactFile || !artifact->staged) {
+    return false;
+  }
+  file->hash.assign((char*)artifact->hash.ptr, artifact->hash.len);
+  file->size_bytes = artifact->size_bytes;
+  file->mode = artifact->mode;
+  file->remote_cache.assign((char*)output_base->remote_cache.ptr,
+                            output_base->remote_cache.len);
+  file->instance_name.assign((char*)output_base->instance_name.ptr,
+                             output_base->instance_name.len);
+  return true;
+}
+
+int FuseFrontend::EnsureDiskParent(const std::string& path) {
+  size_t slash = path.rfind('/');
+  if (slash == std::string::npos) {
+    return 0;
+  }
+  std::string parent = path.substr(0, slash);
+  Artifact* artifact = FindPathArtifact(parent, 0);
+  // Directories that are only in the table are created on demand.
+  if (artifact && artifact->kind == kArtifactDirectory &&
+      !CreateDirectories(Str8FromString(DiskPath(disk_root_, parent)))) {
+    return errno ? errno : EIO;
+  }
+  return 0;
+}
+
+bool FuseFrontend::IsEmptyDirectory(const std::string& path,
+                                    Artifact* artifact) {
+  if (artifact && artifact->first_child) {
+    return false;
+  }
+  bool result = true;
+  DIR* dir = opendir(DiskPath(disk_root_, path).c_str());
+  if (dir) {
+    while (struct dirent* entry = readdir(dir)) {
+      if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..")) {
+        result = false;
+        break;
+      }
+    }
+    closedir(dir);
+  }
+  return result;
+}
+
+int FuseFrontend::FetchFile(const StagedFile& file, std::string* blob_path) {
+  std::string error;
+  *blob_path = fetcher_->Fetch(file.remote_cache, file.instance_name,
+                               file.hash, file.size_bytes, &error);
+  if (blob_path->empty()) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return EIO;
+  }
+  return 0;
+}
+
+int FuseFrontend::Materialize(const std::string& path, bool fetch) {
+  static std::atomic<uint64_t> counter{0};
+  std::string disk_path = DiskPath(disk_root_, path);
+  for (;;) {
+    StagedFile file;
+    {
+      std::lock_guard<std::mutex> lock(service_->mutex());
+      if (!GetStagedFile(path, &file)) {
+        return 0;
+      }
+      int error = EnsureDiskParent(path);
+      if (error) {
+        return error;
+      }
+    }
+    std::string blob_path;
+    if (fetch) {
+      int error = FetchFile(file, &blob_path);
+      if (error) {
+        return error;
+      }
+    }
+
+    // The copy is made next to the file without holding the lock, and only
+    // takes its place if the artifact hasn't changed in the meantime.
+    std::string temp_path = disk_path.substr(0, disk_path.rfind('/') + 1) +
+                            ".materialize-" + std::to_string(counter++);
+    int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                  file.mode);
+    if (fd < 0) {
+      return errno;
+    }
+    int error = fetch ? CopyFile(blob_path, fd) : 0;
+    if (!error && geteuid() == 0) {
+      fchown(fd, uid_, gid_);
+    }
+    if (close(fd) != 0 && !error) {
+      error = errno;
+    }
+    if (!error) {
+      std::lock_guard<std::mutex> lock(service_->mutex());
+      StagedFile current;
+      if (GetStagedFile(path, &current) && current.hash == file.hash &&
+          current.size_bytes == file.size_bytes) {
+        if (rename(temp_path.c_str(), disk_path.c_str()) != 0) {
+          error = errno;
+        } else {
+          OutputBase* output_base;
+          Artifact* artifact = FindPathArtifact(path, &output_base);
+          BeginArtifactTableUpdate(output_base->table);
+          RemoveArtifact(output_base->table, artifact);
+          EndArtifactTableUpdate(output_base->table);
+          return 0;
+        }
+      }
+    }
+    unlink(temp_path.c_str());
+    if (error) {
+      return error;
+    }
+  }
+}
+
+int FuseFrontend::OpenFile(uint64_t nodeid, const std::string& path,
+                           uint32_t flags, uint64_t* fh, uint32_t* open_flags,
+                           int32_t* backing_id) {
+  StagedFile file;
+  bool is_virtual;
+  {
+    std::lock_guard<std::mutex> lock(service_->mutex());
+    is_virtual = GetStagedFile(path, &file);
+  }
+  std::string open_path = DiskPath(disk_root_, path);
+  flags &= ~(O_CREAT | O_EXCL | O_NOCTTY);
+  int error = 0;
+  if (is_virtual && (flags & O_ACCMODE) == O_RDONLY) {
+    error = FetchFile(file, &open_path);
+    flags = O_RDONLY;
+  } else if (is_virtual) {
+    error = Materialize(path, !(flags & O_TRUNC));
+  }
+  if (error) {
+    return error;
+  }
+  int fd = open(open_path.c_str(), flags | O_CLOEXEC);
+  if (fd < 0) {
+    return errno;
+  }
+  *fh = (uint32_t)fd;
+  *open_flags = 0;
+  *backing_id = 0;
+  if (!passthrough_) {
+    return 0;
+  }
+
+  // The kernel requires all the opens of a node that has a backing file to
+  // use it, so a node cannot be open as a staged file and as the file on
+  // disk that it has become at the same time. The frontend serves the data
+  // if there is no backing file.
+  struct stat st;
+  fstat(fd, &st);
+  std::lock_guard<std::mutex> lock(backings_mutex_);
+  auto it = backings_.find(nodeid);
+  if (it == backings_.end()) {
+    fuse_backing_map map = {};
+    map.fd = fd;
+    int id = ioctl(fd_, FUSE_DEV_IOC_BACKING_OPEN, &map);
+    if (id < 0) {
+      *open_flags = FOPEN_DIRECT_IO;
+      return 0;
+    }
+    it = backings_.emplace(nodeid, Backing{id, st.st_dev, st.st_ino, 0}).first;
+  }
+  if (it->second.dev != st.st_dev || it->second.ino != st.st_ino) {
+    close(fd);
+    return ETXTBSY;
+  }
+  ++it->second.opens;
+  *fh |= kBackingBit;
+  *open_flags = FOPEN_PASSTHROUGH;
+  *backing_id = it->second.id;
+  return 0;
+}
+
+void FuseFrontend::Lookup(FuseRequest* request) {
+  const char* name = (const char*)request->body;
+  uint64_t parent = request->header->nodeid;
+  std::lock_guard<std::mutex> lock(service_->mutex());
+  std::string path;
+  if (!NodePath(parent, &path)) {
+    ReplyError(request, ENOENT);
+    return;
+  }
+  struct stat st;
+  int error = StatPath(JoinPath(path, name), &st);
+  if (error) {
+    ReplyError(request, error);
+    return;
+  }
+  fuse_entry_out out = {};
+  out.nodeid = AddLookup(parent, name);
+  FillAttr(out.nodeid, st, &out.attr);
+  Reply(request, 0, &out, sizeof(out));
+}
+
+void FuseFrontend::GetAttr(FuseRequest* request) {
+  fuse_getattr_in* in = (fuse_getattr_in*)request->body;
+  uint64_t nodeid = request->header->nodeid;
+  struct stat st;
+  int error;
+  {
+    std::lock_guard<std::mutex> lock(service_->mutex());
+    std::string path;
+    if (NodePath(nodeid, &path)) {
+      error = StatPath(path, &st);
+    } else if (in->getattr_flags & FUSE_GETATTR_FH) {
+      // The file was removed while it is open.
+      error = fstat((uint32_t)in->fh, &st) == 0 ? 0 : errno;
+    } else {
+      error = ENOENT;
+    }
+  }
+  if (error) {
+    ReplyError(request, error);
+    return;
+  }
+  fuse_attr_out out = {};
+  FillAttr(nodeid, st, &out.attr);
+  Reply(request, 0, &out, sizeof(out));
+}
+
+void FuseFrontend::SetAttr(FuseRequest* request) {
+  fuse_setattr_in* in = (fuse_setattr_in*)request->body;
+  uint64_t nodeid = request->header->nodeid;
+  std::string path;
+  {
+    std::lock_guard<std::mutex> lock(service_->mutex());
+    if (!NodePath(nodeid, &path)) {
+      ReplyError(request, ENOENT);
+      return;
+    }
+  }
+  int error = 0;
+  if (in->valid & FATTR_SIZE) {
+    error = Materialize(path, in->size != 0);
+  }
+
+  std::lock_guard<std::mutex> lock(service_->mutex());
+  std::string disk_path = DiskPath(disk_root_, path);
+  OutputBase* output_base;
+  Artifact* artifact = FindPathArtifact(path, &output_base);
+  if (!error && artifact && artifact->kind == kArtifactFile &&
+      artifact->staged) {
+    // Only the mode of a staged file can change without copying it.
+    if (in->valid & FATTR_MODE) {
+      BeginArtifactTableUpdate(output_base->table);
+      artifact->mode = in->mode & 07777;
+      EndArtifactTableUpdate(output_base->table);
+    }
+  } else if (!error) {
+    if (artifact && artifact->kind == kArtifactDirectory &&
+        !CreateDirectories(Str8FromString(disk_path))) {
+      error = errno ? errno : EIO;
+    }
+    if (!error && (in->valid & FATTR_MODE) &&
+        chmod(disk_path.c_str(), in->mode & 07777) != 0) {
+      error = errno;
+    }
+    if (!error && (in->valid & (FATTR_UID | FATTR_GID)) &&
+        lchown(disk_path.c_str(),
+               (in->valid & FATTR_UID) ? in->uid : (uid_t)-1,
+               (in->valid & FATTR_GID) ? in->gid : (gid_t)-1) != 0) {
+      error = errno;
+    }
+    if (!error && (in->valid & FATTR_SIZE) &&
+        truncate(disk_path.c_str(), in->size) != 0) {
+      error = errno;
+    }
+    if (!error && (in->valid & (FATTR_ATIME | FATTR_MTIME))) {
+      struct timespec times[2] = {{0, UTIME_OMIT}, {0, UTIME_OMIT}};
+      if (in->valid & FATTR_ATIME_NOW) {
+        times[0].tv_nsec = UTIME_NOW;
+      } else if (in->valid & FATTR_ATIME) {
+        times[0] = {(time_t)in->atime, (long)in->atimensec};
+      }
+      if (in->valid & FATTR_MTIME_NOW) {
+        times[1].tv_nsec = UTIME_NOW;
+      } else if (in->valid & FATTR_MTIME) {
+        times[1] = {(time_t)in->mtime, (long)in->mtimensec};
+      }
+      if (utimensat(AT_FDCWD, disk_path.c_str(), times,
+                    AT_SYMLINK_NOFOLLOW) != 0) {
+        error = errno;
+      }
+    }
+  }
+  struct stat st;
+  if (!error) {
+    error = StatPath(path, &st);
+  }
+  if (error) {
+    ReplyError(request, error);
+    return;
+  }
+  fuse_attr_out out = {};
+  FillAttr(nodeid, st, &out.attr);
+  Reply(request, 0, &out, sizeof(out));
+}
+
+void FuseFrontend::ReadLink(FuseRequest* request) {
+  std::lock_guard<std::mutex> lock(service_->mutex());
+  std::string path;
+  if (!NodePath(request->header->nodeid, &path)) {
+    ReplyError(request, ENOENT);
+    return;
+  }
+  StagedFile file;
+  if (GetStagedFile(path, &file)) {
+    ReplyError(request, EINVAL);
+    return;
+  }
+  ssize_t len = readlink(DiskPath(disk_root_, path).c_str(),
+                         (char*)request->out, kMaxWrite);
+  if (len < 0) {
+    ReplyError(request, errno);
+    return;
+  }
+  Reply(request, 0, request->out, len);
+}
+
+void FuseFrontend::MakeNode(FuseRequest* request) {
+  uint32_t opcode = request->header->opcode;
+  const char* name;
+  if (opcode == FUSE_MKNOD) {
+    name = (const char*)request->body + sizeof(fuse_mknod_in);
+  } else if (opcode == FUSE_MKDIR) {
+    name = (const char*)request->body + sizeof(fuse_mkdir_in);
+  } else {
+    name = (const char*)request->body;
+  }
+  uint64_t parent = request->header->nodeid;
+  std::lock_guard<std::mutex> lock(service_->mutex());
+  std::string path;
+  if (!NodePath(parent, &path)) {
+    ReplyError(request, ENOENT);
+    return;
+  }
+  path = JoinPath(path, name);
+  std::string disk_path = DiskPath(disk_root_, path);
+  struct stat st;
+  int error = StatPath(path, &st) == 0 ? EEXIST : EnsureDiskParent(path);
+  if (!error) {
+    int result;
+    if (opcode == FUSE_MKNOD) {
+      fuse_mknod_in* in = (fuse_mknod_in*)request->body;
+      result = mknod(disk_path.c_str(), in->mode, in->rdev);
+    } else if (opcode == FUSE_MKDIR) {
+      fuse_mkdir_in* in = (fuse_mkdir_in*)request->body;
+      result = mkdir(disk_path.c_str(), in->mode);
+    } else {
+      const char* target = name + strlen(name) + 1;
+      result = symlink(target, disk_path.c_str());
+    }
+    error = result == 0 ? 0 : errno;
+  }
+  if (!error) {
+    SetOwner(disk_path, request->header->uid, request->header->gid);
+    error = StatPath(path, &st);
+  }
+  if (error) {
+    ReplyError(request, error);
+    return;
+  }
+  fuse_entry_out out = {};
+  out.nodeid = AddLookup(parent, name);
+  FillAttr(out.nodeid, st, &out.attr);
+  Reply(request, 0, &out, sizeof(out));
+}
+
+void FuseFrontend::Unlink(FuseRequest* request, bool directory) {
+  const char* name = (const char*)request->body;
+  uint64_t parent = request->header->nodeid;
+  std::lock_guard<std::mutex> lock(service_->mutex());
+  std::string path;
+  if (!NodePath(parent, &path)) {
+    ReplyError(request, ENOENT);
+    return;
+  }
+  path = JoinPath(path, name);
+  if (IsOutputBase(path)) {
+    ReplyError(request, EBUSY);
+    return;
+  }
+  OutputBase* output_base;
+  Artifact* artifact = FindPathArtifact(path, &output_base);
+  std::string disk_path = DiskPath(disk_root_, path);
+  int error;
+  if (!directory) {
+    if (artifact && artifact->kind == kArtifactDirectory) {
+      error = EISDIR;
+    } else {
+      error = unlink(disk_path.c_str()) == 0 ? 0 : errno;
+    }
+  } else {
+    if (artifact && artifact->kind == kArtifactFile) {
+      error = ENOTDIR;
+    } else if (artifact && artifact->first_child) {
+      error = ENOTEMPTY;
+    } else {
+      error = rmdir(disk_path.c_str()) == 0 ? 0 : errno;
+    }
+  }
+  // A staged file or an empty directory may only be in the table.
+  if (artifact && (!error || error == ENOENT)) {
+    BeginArtifactTableUpdate(output_base->table);
+    RemoveArtifact(output_base->table, artifact);
+    EndArtifactTableUpdate(output_base->table);
+    error = 0;
+  }
+  if (!error) {
+    DetachNode(parent, name);
+  }
+  ReplyError(request, error);
+}
+
+// Copies the artifact and everything in it to the path in the table.
+static void CopyArtifacts(Artifact* from, ArtifactTable* table,
+                          const std::string& path) {
+  Artifact* to = UpsertArtifact(table, Str8FromString(path));
+  to->kind = from->kind;
+  to->staged = from->staged;
+  to->mode = from->mode;
+  to->hash = IsEmptyStr8(from->hash) ? Str8{}
+                                     : PushStr8(table->arena, from->hash);
+  to->size_bytes = from->size_bytes;
+  for (Artifact* child = from->first_child; child;
+       child = child->next_sibling) {
+    CopyArtifacts(child, table, JoinPath(path, BaseName(child->path)));
+  }
+}
+
+void FuseFrontend::Rename(FuseRequest* request, uint64_t new_parent,
+                          uint32_t flags, const char* names) {
+  const char* name = names;
+  const char* new_name = name + strlen(name) + 1;
+  uint64_t parent = request->header->nodeid;
+  if (flags & ~RENAME_NOREPLACE) {
+    ReplyError(request, EINVAL);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(service_->mutex());
+  std::string path;
+  std::string new_path;
+  if (!NodePath(parent, &path) || !NodePath(new_parent, &new_path)) {
+    ReplyError(request, ENOENT);
+    return;
+  }
+  path = JoinPath(path, name);
+  new_path = JoinPath(new_path, new_name);
+  if (IsOutputBase(path) || IsOutputBase(new_path)) {
+    ReplyError(request, EBUSY);
+    return;
+  }
+  OutputBase* output_base;
+  OutputBase* new_output_base;
+  Artifact* artifact = FindPathArtifact(path, &output_base);
+  Artifact* new_artifact = FindPathArtifact(new_path, &new_output_base);
+  struct stat st;
+  struct stat new_st;
+  int error = StatPath(path, &st);
+  bool replace = !error && StatPath(new_path, &new_st) == 0;
+  if (!error && replace && (flags & RENAME_NOREPLACE)) {
+    error = EEXIST;
+  } else if (!error && replace && S_ISDIR(new_st.st_mode) &&
+             !S_ISDIR(st.st_mode)) {
+    error = EISDIR;
+  } else if (!error && replace && !S_ISDIR(new_st.st_mode) &&
+             S_ISDIR(st.st_mode)) {
+    error = ENOTDIR;
+  } else if (!error && replace && S_ISDIR(new_st.st_mode) &&
+             !IsEmptyDirectory(new_path, new_artifact)) {
+    error = ENOTEMPTY;
+  } else if (!error && artifact && !new_output_base) {
+    // Staged files cannot leave the output bases. Callers like mv copy them
+    // instead.
+    error = EXDEV;
+  }
+
+  std::string disk_path = DiskPath(disk_root_, path);
+  std::string new_disk_path = DiskPath(disk_root_, new_path);
+  struct stat disk_st;
+  if (!error && lstat(disk_path.c_str(), &disk_st) == 0) {
+    error = EnsureDiskParent(new_path);
+    if (!error && rename(disk_path.c_str(), new_disk_path.c_str()) != 0) {
+      error = errno;
+    }
+  } else if (!error && lstat(new_disk_path.c_str(), &disk_st) == 0) {
+    // What is replaced by an artifact that is only in the table goes.
+    int result = S_ISDIR(disk_st.st_mode) ? rmdir(new_disk_path.c_str())
+                                          : unlink(new_disk_path.c_str());
+    error = result == 0 ? 0 : errno;
+  }
+  if (error) {
+    ReplyError(request, error);
+    return;
+  }
+
+  // Either artifact is only there if the new path is in an output base.
+  if (new_output_base) {
+    BeginArtifactTableUpdate(new_output_base->table);
+  }
+  if (new_artifact) {
+    RemoveArtifact(new_output_base->table, new_artifact);
+  }
+  if (artifact) {
+    std::string table_path = new_path.substr(new_path.find('/') + 1);
+    BeginArtifactTableUpdate(output_base->table);
+    CopyArtifacts(artifact, new_output_base->table, table_path);
+    RemoveArtifact(output_base->table, artifact);
+    EndArtifactTableUpdate(output_base->table);
+  }
+  if (new_output_base) {
+    EndArtifactTableUpdate(new_output_base->table);
+  }
+  MoveNode(parent, name, new_parent, new_name);
+  ReplyError(request, 0);
+}
+
+void FuseFrontend::Link(FuseRequest* request) {
+  fuse_link_in* in = (fuse_link_in*)request->body;
+  const char* new_name = (const char*)(in + 1);
+  uint64_t new_parent = request->header->nodeid;
+  std::string path;
+  std::string new_path;
+  {
+    std::lock_guard<std::mutex> lock(service_->mutex());
+    if (!NodePath(in->oldnodeid, &path) || !NodePath(new_parent, &new_path)) {
+      ReplyError(request, ENOENT);
+      return;
+    }
+  }
+  new_path = JoinPath(new_path, new_name);
+  // Only files on disk can have several names.
+  int error = Materialize(path, true);
+
+  std::lock_guard<std::mutex> lock(service_->mutex());
+  struct stat st;
+  if (!error) {
+    error = StatPath(new_path, &st) == 0 ? EEXIST : EnsureDiskParent(new_path);
+  }
+  if (!error && link(DiskPath(disk_root_, path).c_str(),
+                     DiskPath(disk_root_, new_path).c_str()) != 0) {
+    error = errno;
+  }
+  if (!error) {
+    error = StatPath(new_path, &st);
+  }
+  if (error) {
+    ReplyError(request, error);
+    return;
+  }
+  fuse_entry_out out = {};
+  out.nodeid = AddLookup(new_parent, new_name);
+  FillAttr(out.nodeid, st, &out.attr);
+  Reply(request, 0, &out, sizeof(out));
+}
+
+void FuseFrontend::Open(FuseRequest* request) {
+  fuse_open_in* in = (fuse_open_in*)request->body;
+  uint64_t nodeid = request->header->nodeid;
+  std::string path;
+  {
+    std::lock_guard<std::mutex> lock(service_->mutex());
+    if (!NodePath(nodeid, &path)) {
+      ReplyError(request, ENOENT);
+      return;
+    }
+  }
+  fuse_open_out out = {};
+  int32_t backing_id;
+  int error =
+      OpenFile(nodeid, path, in->flags, &out.fh, &out.open_flags, &backing_id);
+  if (error) {
+    ReplyError(request, error);
+    return;
+  }
+  SetBackingId(&out, backing_id);
+  Reply(request, 0, &out, sizeof(out));
+}
+
+void FuseFrontend::Create(FuseRequest* request) {
+  fuse_create_in* in = (fuse_create_in*)request->body;
+  const char* name = (const char*)(in + 1);
+  uint64_t parent = request->header->nodeid;
+  std::string path;
+  struct {
+    fuse_entry_out entry;
+    fuse_open_out open;
+  } out = {};
+  {
+    std::lock_guard<std::mutex> lock(service_->mutex());
+    if (!NodePath(parent, &path)) {
+      ReplyError(request, ENOENT);
+      return;
+    }
+    path = JoinPath(path, name);
+    std::string disk_path = DiskPath(disk_root_, path);
+    struct stat st;
+    int error = 0;
+    if (StatPath(path, &st) != 0) {
+      error = EnsureDiskParent(path);
+      int fd = error ? -1
+                     : open(disk_path.c_str(),
+                            O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, in->mode);
+      if (fd >= 0) {
+        close(fd);
+        SetOwner(disk_path, request->header->uid, request->header->gid);
+      } else if (!error) {
+        error = errno;
+      }
+    } else if (in->flags & O_EXCL) {
+      error = EEXIST;
+    }
+    if (!error) {
+      error = StatPath(path, &st);
+    }
+    if (error) {
+      ReplyError(request, error);
+      return;
+    }
+    out.entry.nodeid = AddLookup(parent, name);
+    FillAttr(out.entry.nodeid, st, &out.entry.attr);
+  }
+  int32_t backing_id;
+  int error = OpenFile(out.entry.nodeid, path, in->flags, &out.open.fh,
+                       &out.open.open_flags, &backing_id);
+  if (error) {
+    std::lock_guard<std::mutex> lock(service_->mutex());
+    Forget(out.entry.nodeid, 1);
+    ReplyError(request, error);
+    return;
+  }
+  SetBackingId(&out.open, backing_id);
+  Reply(request, 0, &out, sizeof(out));
+}
+
+void FuseFrontend::Read(FuseRequest* request) {
+  fuse_read_in* in = (fuse_read_in*)request->body;
+  size_t size = in->size < kMaxWrite ? in->size : kMaxWrite;
+  ssize_t len = pread((uint32_t)in->fh, request->out, size, in->offset);
+  if (len < 0) {
+    ReplyError(request, errno);
+    return;
+  }
+  Reply(request, 0, request->out, len);
+}
+
+void FuseFrontend::Write(FuseRequest* request) {
+  fuse_write_in* in = (fuse_write_in*)request->body;
+  ssize_t len = pwrite((uint32_t)in->fh, in + 1, in->size, in->offset);
+  if (len < 0) {
+    ReplyError(request, errno);
+    return;
+  }
+  fuse_write_out out = {};
+  out.size = len;
+  Reply(request, 0, &out, sizeof(out));
+}
+
+void FuseFrontend::Release(FuseRequest* request) {
+  fuse_release_in* in = (fuse_release_in*)request->body;
+  close((uint32_t)in->fh);
+  if (in->fh & kBackingBit) {
+    std::lock_guard<std::mutex> lock(backings_mutex_);
+    auto it = backings_.find(request->header->nodeid);
+    if (it != backings_.end() && !--it->second.opens) {
+      uint32_t id = it->second.id;
+      ioctl(fd_, FUSE_DEV_IOC_BACKING_CLOSE, &id);
+      backings_.erase(it);
+    }
+  }
+  ReplyError(request, 0);
+}
+
+void FuseFrontend::Fsync(FuseRequest* request) {
+  fuse_fsync_in* in = (fuse_fsync_in*)request->body;
+  int fd = (uint32_t)in->fh;
+  int result = (in->fsync_flags & 1) ? fdatasync(fd) : fsync(fd);
+  ReplyError(request, result == 0 ? 0 : errno);
+}
+
+void FuseFrontend::OpenDir(FuseRequest* request) {
+  DirHandle* handle = new DirHandle();
+  handle->entries.push_back(DirEntry{".", DT_DIR});
+  handle->entries.push_back(DirEntry{"..", DT_DIR});
+  {
+    std::lock_guard<std::mutex> lock(service_->mutex());
+    std::string path;
+    struct stat st;
+    int error = NodePath(request->header->nodeid, &path) ? StatPath(path, &st)
+                                                         : ENOENT;
+    if (!error && !S_ISDIR(st.st_mode)) {
+      error = ENOTDIR;
+    }
+    if (error) {
+      delete handle;
+      ReplyError(request, error);
+      return;
+    }
+
+    // The entries are read at once, so that later changes to the table don't
+    // affect the offsets.
+    std::unordered_map<std::string, size_t> indices;
+    DIR* dir = opendir(DiskPath(disk_root_, path).c_str());
+    if (dir) {
+      while (struct dirent* entry = readdir(dir)) {
+        if (strcmp(entry->d_name, ".") != 0 &&
+            strcmp(entry->d_name, "..") != 0) {
+          indices[entry->d_name] = handle->entries.size();
+          handle->entries.push_back(DirEntry{entry->d_name, entry->d_type});
+        }
+      }
+      closedir(dir);
+    }
+    Artifact* artifact = FindPathArtifact(path, 0);
+    for (Artifact* child = artifact ? artifact->first_child : 0; child;
+         child = child->next_sibling) {
+      std::string name = BaseName(child->path);
+      uint32_t type = child->kind == kArtifactDirectory ? DT_DIR : DT_REG;
+      auto it = indices.find(name);
+      if (it != indices.end()) {
+        // A staged file hides whatever is on disk.
+        handle->entries[it->second].type = type;
+      } else {
+        handle->entries.push_back(DirEntry{name, type});
+      }
+    }
+  }
+  fuse_open_out out = {};
+  out.fh = (uint64_t)handle;
+  Reply(request, 0, &out, sizeof(out));
+}
+
+void FuseFrontend::ReadDir(FuseRequest* request) {
+  fuse_read_in* in = (fuse_read_in*)request->body;
+  DirHandle* handle = (DirHandle*)in->fh;
+  size_t size = in->size < kMaxWrite ? in->size : kMaxWrite;
+  size_t used = 0;
+  for (uint64_t i = in->offset; i < handle->entries.size(); ++i) {
+    const DirEntry& entry = handle->entries[i];
+    size_t len = FUSE_DIRENT_ALIGN(FUSE_NAME_OFFSET + entry.name.size());
+    if (used + len > size) {
+      break;
+    }
+    fuse_dirent* dirent = (fuse_dirent*)(request->out + used);
+    memset(dirent, 0, len);
+    dirent->ino = kUnknownIno;
+    dirent->off = i + 1;
+    dirent->namelen = entry.name.size();
+    dirent->type = entry.type;
+    memcpy(dirent->name, entry.name.data(), entry.name.size());
+    used += len;
+  }
+  Reply(request, 0, request->out, used);
+}
+
+void FuseFrontend::ReleaseDir(FuseRequest* request) {
+  fuse_release_in* in = (fuse_release_in*)request->body;
+  delete (DirHandle*)in->fh;
+  ReplyError(request, 0);
+}
+
+void FuseFrontend::StatFs(FuseRequest* request) {
+  struct statvfs st;
+  if (statvfs(disk_root_.c_str(), &st) != 0) {
+    ReplyError(request, errno);
+    return;
+  }
+  fuse_statfs_out out = {};
+  out.st.blocks = st.f_blocks;
+  out.st.bfree = st.f_bfree;
+  out.st.bavail = st.f_bavail;
+  out.st.files = st.f_files;
+  out.st.ffree = st.f_ffree;
+  out.st.bsize = st.f_bsize;
+  out.st.namelen = st.f_namemax;
+  out.st.frsize = st.f_frsize;
+  Reply(request, 0, &out, sizeof(out));
+}
@@ -12,30 +12,27 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include <assert.h>
-#include <stddef.h>
-#include <sys/mman.h>
-#include <unistd.h>
+#include <stdint.h>
 
-#include "src/tools/remote/src/main/cpp/testonly_output_service/memory.h"
+#include <string>
+#include <utility>
 
-size_t GetPageSize() {
-  size_t result = getpagesize();
-  return result;
-}
+#include "src/tools/remote/src/main/cpp/testonly_output_service/fuse_frontend.h"
 
-void *ReserveMemory(size_t size) {
-  void *result = mmap(0, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-  assert(result != MAP_FAILED && "Failed to reserve memory");
-  return result;
-}
+FuseFrontend::FuseFrontend(BazelOutputServiceImpl* service,
+                           CasFetcher* fetcher, std::string mount_point,
+                           std::string disk_root)
+    : service_(service),
+      fetcher_(fetcher),
+      mount_point_(std::move(mount_point)),
+      disk_root_(std::move(disk_root)),
+      fd_(-1) {}
 
-void CommitMemory(void *ptr, size_t size) {
-  bool result = mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0;
-  assert(result && "Failed to commit memory");
-}
+FuseFrontend::~FuseFrontend() {}
 
-void ReleaseMemory(void *ptr, size_t size) {
-  bool result = munmap(ptr, size) == 0;
-  assert(result && "Failed to release memory");
+bool FuseFrontend::Mount(std::string* error) {
+  *error = "FUSE is only supported on Linux";
+  return false;
 }
+
+void FuseFrontend::Serve(uint32_t threads) {}
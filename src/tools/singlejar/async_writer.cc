@@ -0,0 +1,175 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/async_writer.h"
+
+#include <errno.h>
+#include <string.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+
+#include "src/tools/singlejar/diag.h"
+
+namespace {
+
+// Writes the whole buffer, returns 0 or the errno of the failure.
+int WriteFully(int fd, const char *data, size_t size) {
+  while (size > 0) {
+#ifdef _WIN32
+    int n = _write(fd, data, static_cast<unsigned int>(
+                                 std::min<size_t>(size, 1 << 30)));
+#else
+    ssize_t n = write(fd, data, size);
+#endif
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno;
+    }
+    if (n == 0) {
+      return EIO;
+    }
+    data += n;
+    size -= n;
+  }
+  return 0;
+}
+
+}  // namespace
+
+AsyncWriter::AsyncWriter(int fd, size_t buffer_size, int buffers)
+    : buffer_size_(buffer_size),
+      fd_(fd),
+      buffers_(buffers),
+      current_(nullptr),
+      error_(0),
+      shutdown_(false) {
+  if (buffer_size == 0 || buffers < 2) {
+    diag_errx(1, "%s:%d: need at least 2 non-empty buffers, got %d of %zu",
+              __FILE__, __LINE__, buffers, buffer_size);
+  }
+  for (auto &buffer : buffers_) {
+    buffer.data.reset(new char[buffer_size]);
+    buffer.size = 0;
+    free_.push_back(&buffer);
+  }
+  writer_ = std::thread(&AsyncWriter::Writer, this);
+}
+
+AsyncWriter::~AsyncWriter() {
+  if (fd_ >= 0) {
+    Close();
+  }
+}
+
+bool AsyncWriter::Write(const void *data, size_t count) {
+  const char *from = static_cast<const char *>(data);
+  while (count > 0) {
+    if (current_ == nullptr) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      written_.wait(lock, [this] { return error_ || !free_.empty(); });
+      if (error_) {
+        errno = error_;
+        return false;
+      }
+      current_ = free_.front();
+      free_.pop_front();
+    }
+    size_t n = std::min(count, buffer_size_ - current_->size);
+    memcpy(current_->data.get() + current_->size, from, n);
+    current_->size += n;
+    from += n;
+    count -= n;
+    if (current_->size == buffer_size_) {
+      Submit();
+    }
+  }
+  return true;
+}
+
+bool AsyncWriter::Flush() {
+  if (current_ != nullptr && current_->size > 0) {
+    Submit();
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  written_.wait(lock, [this] { return full_.empty(); });
+  if (error_) {
+    errno = error_;
+    return false;
+  }
+  return true;
+}
+
+bool AsyncWriter::Close() {
+  if (fd_ < 0) {
+    return true;
+  }
+  bool ok = Flush();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  submitted_.notify_all();
+  writer_.join();
+#ifdef _WIN32
+  if (_close(fd_) && ok) {
+#else
+  if (close(fd_) && ok) {
+#endif
+    ok = false;
+  }
+  fd_ = -1;
+  return ok;
+}
+
+void AsyncWriter::Submit() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    full_.push_back(current_);
+  }
+  current_ = nullptr;
+  submitted_.notify_all();
+}
+
+void AsyncWriter::Writer() {
+  for (;;) {
+    Buffer *buffer;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      submitted_.wait(lock, [this] { return shutdown_ || !full_.empty(); });
+      if (full_.empty()) {
+        return;
+      }
+      buffer = full_.front();
+    }
+    // After a failure, the rest is dropped: the file is broken anyway.
+    int error = error_ ? 0 : WriteFully(fd_, buffer->data.get(), buffer->size);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (error) {
+        error_ = error;
+      }
+      full_.pop_front();
+      buffer->size = 0;
+      free_.push_back(buffer);
+    }
+    written_.notify_all();
+  }
+}
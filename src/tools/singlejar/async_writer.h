@@ -0,0 +1,90 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_ASYNC_WRITER_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_ASYNC_WRITER_H_ 1
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Writes to a file descriptor on a thread of its own, so that the caller
+ * can go on with the next data while the previous data is being written.
+ * The data is copied to one of a fixed number of buffers of the given size,
+ * and a full buffer is written with a single write() while the caller fills
+ * the next one. The usage is:
+ *   AsyncWriter writer(fd, 128 << 10, 8);
+ *   if (!writer.Write(data, size)) { fail... }
+ *   ...
+ *   if (!writer.Close()) { fail... }
+ * The writes go to the current file offset, in order. A write error is
+ * reported by the calls following it, with errno set to its error.
+ */
+class AsyncWriter {
+ public:
+  // Takes over the file descriptor, which Close() closes.
+  AsyncWriter(int fd, size_t buffer_size, int buffers);
+
+  // Closes the file if Close() has not been called.
+  ~AsyncWriter();
+
+  // Copies the data to the buffers. Waits for a buffer to be written if all
+  // of them are full. Returns false if an earlier write has failed.
+  bool Write(const void *data, size_t count);
+
+  // Waits until all the data passed to Write() is in the file, so that the
+  // file descriptor can be used directly.
+  bool Flush();
+
+  // Flushes and closes the file.
+  bool Close();
+
+  int fd() const { return fd_; }
+
+ private:
+  struct Buffer {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+
+  // Hands the current buffer over to the writer thread.
+  void Submit();
+  void Writer();
+
+  const size_t buffer_size_;
+  int fd_;
+  std::vector<Buffer> buffers_;
+  // The buffer being filled by Write(), if any. Only used by the caller.
+  Buffer *current_;
+  std::mutex mutex_;
+  std::deque<Buffer *> free_;
+  // The buffers to write, in order. The one being written stays at the
+  // front until it is done.
+  std::deque<Buffer *> full_;
+  // Signaled by the caller when a buffer has been submitted.
+  std::condition_variable submitted_;
+  // Signaled by the writer thread when a buffer has been written.
+  std::condition_variable written_;
+  // The errno of the first failed write, or 0.
+  int error_;
+  bool shutdown_;
+  std::thread writer_;
+};
+
+#endif  //  BAZEL_SRC_TOOLS_SINGLEJAR_ASYNC_WRITER_H_
@@ -0,0 +1,91 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/async_writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+std::string TempPath(const std::string &name) {
+  const char *tmpdir = getenv("TEST_TMPDIR");
+  return std::string(tmpdir ? tmpdir : "/tmp") + "/" + name;
+}
+
+int OpenForWriting(const std::string &path) {
+  int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+  EXPECT_LE(0, fd) << path;
+  return fd;
+}
+
+std::string ReadAll(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  std::stringstream contents;
+  contents << in.rdbuf();
+  return contents.str();
+}
+
+TEST(AsyncWriterTest, WritesInOrder) {
+  std::string path = TempPath("in_order");
+  AsyncWriter writer(OpenForWriting(path), 64, 2);
+  std::string expected;
+  // Writes smaller than, as large as and larger than the buffers.
+  for (size_t size = 1; size < 300; size += 7) {
+    std::string data(size, static_cast<char>('a' + size % 26));
+    ASSERT_TRUE(writer.Write(data.data(), data.size()));
+    expected += data;
+  }
+  ASSERT_TRUE(writer.Close());
+  EXPECT_EQ(expected, ReadAll(path));
+}
+
+TEST(AsyncWriterTest, FlushLetsTheFileBeWrittenDirectly) {
+  std::string path = TempPath("flush");
+  AsyncWriter writer(OpenForWriting(path), 1024, 2);
+  ASSERT_TRUE(writer.Write("buffered ", 9));
+  ASSERT_TRUE(writer.Flush());
+  ASSERT_EQ(7, write(writer.fd(), "direct ", 7));
+  ASSERT_TRUE(writer.Write("buffered again", 14));
+  ASSERT_TRUE(writer.Close());
+  EXPECT_EQ("buffered direct buffered again", ReadAll(path));
+}
+
+TEST(AsyncWriterTest, ReportsWriteErrors) {
+  int fd = open("/dev/full", O_WRONLY);
+  if (fd < 0) {
+    GTEST_SKIP() << "no /dev/full";
+  }
+  AsyncWriter writer(fd, 16, 2);
+  char data[16] = {0};
+  // The first writes only fill the buffers, a later one sees the error.
+  bool ok = true;
+  for (int i = 0; ok && i < 100; ++i) {
+    ok = writer.Write(data, sizeof(data));
+  }
+  EXPECT_FALSE(ok && writer.Flush());
+  EXPECT_EQ(ENOSPC, errno);
+  EXPECT_FALSE(writer.Close());
+}
+
+}  // namespace
@@ -0,0 +1,160 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/checksum.h"
+
+#include <string.h>
+
+#include "zlib.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define CRC32_PCLMUL 1
+#define CRC32_PCLMUL_TARGET __attribute__((target("pclmul,sse4.1")))
+#elif defined(_M_X64) && defined(_MSC_VER)
+#include <intrin.h>
+#define CRC32_PCLMUL 1
+#define CRC32_PCLMUL_TARGET
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32_ARM 1
+#endif
+
+namespace {
+
+uint32_t ZlibCrc32(uint32_t crc, const uint8_t *data, size_t size) {
+  return crc32_z(crc, data, size);
+}
+
+#if defined(CRC32_PCLMUL)
+
+bool HasPclmul() {
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  // ECX bit 1 is PCLMULQDQ, bit 19 is SSE4.1.
+  return (info[2] & (1 << 1)) && (info[2] & (1 << 19));
+#else
+  return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+#endif
+}
+
+CRC32_PCLMUL_TARGET inline __m128i Load(const uint8_t *p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+// Multiplies the halves of x by the constants and adds y.
+CRC32_PCLMUL_TARGET inline __m128i Fold(__m128i x, __m128i k, __m128i y) {
+  return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00),
+                                     _mm_clmulepi64_si128(x, k, 0x11)),
+                       y);
+}
+
+// Folds the bytes into the CRC register (the complement of the zlib CRC),
+// as described in Intel's "Fast CRC Computation for Generic Polynomials
+// Using PCLMULQDQ Instruction". The size is a multiple of 16, at least 64.
+CRC32_PCLMUL_TARGET uint32_t FoldCrc32(uint32_t crc, const uint8_t *data,
+                                       size_t size) {
+  // The constants for the bit-reflected 0x04C11DB7 polynomial.
+  alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+  alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+  alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+  alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641};
+
+  __m128i x1 = _mm_xor_si128(Load(data), _mm_cvtsi32_si128(crc));
+  __m128i x2 = Load(data + 16);
+  __m128i x3 = Load(data + 32);
+  __m128i x4 = Load(data + 48);
+  data += 64;
+  size -= 64;
+
+  // Fold four 128-bit lanes in parallel.
+  __m128i k = _mm_load_si128(reinterpret_cast<const __m128i *>(k1k2));
+  for (; size >= 64; data += 64, size -= 64) {
+    x1 = Fold(x1, k, Load(data));
+    x2 = Fold(x2, k, Load(data + 16));
+    x3 = Fold(x3, k, Load(data + 32));
+    x4 = Fold(x4, k, Load(data + 48));
+  }
+
+  // Fold the lanes into one, then the remaining 16-byte blocks into it.
+  k = _mm_load_si128(reinterpret_cast<const __m128i *>(k3k4));
+  x1 = Fold(x1, k, x2);
+  x1 = Fold(x1, k, x3);
+  x1 = Fold(x1, k, x4);
+  for (; size >= 16; data += 16, size -= 16) {
+    x1 = Fold(x1, k, Load(data));
+  }
+
+  // Fold 128 bits to 64 bits.
+  const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+  x2 = _mm_clmulepi64_si128(x1, k, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+  k = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(k5k0));
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  // Barrett reduction to 32 bits.
+  k = _mm_load_si128(reinterpret_cast<const __m128i *>(poly));
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k, 0x10);
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask32), k, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+  return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+
+uint32_t PclmulCrc32(uint32_t crc, const uint8_t *data, size_t size) {
+  if (size < 64) {
+    return ZlibCrc32(crc, data, size);
+  }
+  size_t folded = size & ~static_cast<size_t>(15);
+  crc = ~FoldCrc32(~crc, data, folded);
+  return ZlibCrc32(crc, data + folded, size - folded);
+}
+
+#elif defined(CRC32_ARM)
+
+uint32_t ArmCrc32(uint32_t crc, const uint8_t *data, size_t size) {
+  crc = ~crc;
+  for (; size >= 8; data += 8, size -= 8) {
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
+    crc = __crc32d(crc, word);
+  }
+  for (; size > 0; ++data, --size) {
+    crc = __crc32b(crc, *data);
+  }
+  return ~crc;
+}
+
+#endif
+
+using Crc32Function = uint32_t (*)(uint32_t, const uint8_t *, size_t);
+
+Crc32Function SelectCrc32() {
+#if defined(CRC32_PCLMUL)
+  return HasPclmul() ? PclmulCrc32 : ZlibCrc32;
+#elif defined(CRC32_ARM)
+  return ArmCrc32;
+#else
+  return ZlibCrc32;
+#endif
+}
+
+}  // namespace
+
+uint32_t ComputeCrc32(uint32_t crc, const void *data, size_t size) {
+  static const Crc32Function crc32_function = SelectCrc32();
+  return crc32_function(crc, reinterpret_cast<const uint8_t *>(data), size);
+}
@@ -0,0 +1,32 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_CHECKSUM_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_CHECKSUM_H_ 1
+
+#include <cstddef>
+#include <cstdint>
+
+// Updates the running CRC32 of zip entries (the polynomial zlib's crc32()
+// uses) with the given bytes. Start with 0.
+//
+// Stock zlib computes the checksum a few bytes at a time, which makes it as
+// expensive as inflating. On x86-64 processors with PCLMULQDQ (detected at
+// run time) the buffer is folded 64 bytes at a time with carry-less
+// multiplications, and on ARMv8 with the CRC32 extension (when enabled at
+// compile time) the CRC32 instructions are used. Otherwise this is zlib's
+// crc32().
+uint32_t ComputeCrc32(uint32_t crc, const void *data, size_t size);
+
+#endif  // BAZEL_SRC_TOOLS_SINGLEJAR_CHECKSUM_H_
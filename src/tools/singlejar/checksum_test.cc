@@ -0,0 +1,56 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/checksum.h"
+
+#include <random>
+#include <vector>
+
+#include "googletest/include/gtest/gtest.h"
+#include "zlib.h"
+
+namespace {
+
+TEST(ChecksumTest, KnownValues) {
+  EXPECT_EQ(0U, ComputeCrc32(0, "", 0));
+  EXPECT_EQ(0xCBF43926U, ComputeCrc32(0, "123456789", 9));
+}
+
+// Compare with zlib for all sizes up to a few folding blocks, at every
+// alignment, and for a large buffer computed in pieces.
+TEST(ChecksumTest, SameAsZlib) {
+  std::vector<uint8_t> data(1 << 20);
+  std::mt19937 random(42);
+  for (auto &byte : data) {
+    byte = static_cast<uint8_t>(random());
+  }
+  for (size_t offset = 0; offset < 16; ++offset) {
+    for (size_t size = 0; size < 300; ++size) {
+      ASSERT_EQ(crc32(0x12345678, data.data() + offset, size),
+                ComputeCrc32(0x12345678, data.data() + offset, size))
+          << "offset " << offset << ", size " << size;
+    }
+  }
+  uint32_t expected = crc32(0, data.data(), data.size());
+  EXPECT_EQ(expected, ComputeCrc32(0, data.data(), data.size()));
+  uint32_t crc = 0;
+  for (size_t pos = 0; pos < data.size();) {
+    size_t size = std::min<size_t>(random() % 100000, data.size() - pos);
+    crc = ComputeCrc32(crc, data.data() + pos, size);
+    pos += size;
+  }
+  EXPECT_EQ(expected, crc);
+}
+
+}  // namespace
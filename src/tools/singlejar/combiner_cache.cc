@@ -0,0 +1,176 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/combiner_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cinttypes>
+#include <string>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif  // _WIN32
+
+#include "src/tools/singlejar/diag.h"
+#include "src/tools/singlejar/fingerprint.h"
+#include "src/tools/singlejar/zip_headers.h"
+
+// A cache file is the magic, the key size (4 bytes, little endian), the key
+// and the entry.
+static const char kMagic[] = "singlejar-combiner-cache 1\n";
+static const size_t kMagicSize = sizeof(kMagic) - 1;
+
+std::string CombinerCache::Path(const std::string &key) const {
+  Fingerprint fingerprint;
+  fingerprint.Update(key);
+  char name[32];
+  snprintf(name, sizeof(name), "/%016" PRIx64, fingerprint.value());
+  return directory_ + name;
+}
+
+void *CombinerCache::GetFromMemory(const std::string &key) const {
+  auto it = memory_index_.find(key);
+  if (it == memory_index_.end()) {
+    return nullptr;
+  }
+  memory_entries_.splice(memory_entries_.begin(), memory_entries_,
+                         it->second);
+  const std::string &bytes = it->second->second;
+  void *entry = malloc(bytes.size());
+  if (entry != nullptr) {
+    memcpy(entry, bytes.data(), bytes.size());
+  }
+  return entry;
+}
+
+void CombinerCache::PutInMemory(const std::string &key,
+                                const void *entry) const {
+  const LH *lh = reinterpret_cast<const LH *>(entry);
+  const size_t entry_size = lh->size() + lh->in_zip_size();
+  if (key.size() + entry_size > memory_limit_ || memory_index_.count(key)) {
+    return;
+  }
+  memory_size_ += key.size() + entry_size;
+  memory_entries_.emplace_front(
+      key, std::string(reinterpret_cast<const char *>(entry), entry_size));
+  memory_index_[key] = memory_entries_.begin();
+  while (memory_size_ > memory_limit_) {
+    const auto &oldest = memory_entries_.back();
+    memory_size_ -= oldest.first.size() + oldest.second.size();
+    memory_index_.erase(oldest.first);
+    memory_entries_.pop_back();
+  }
+}
+
+void *CombinerCache::Get(const std::string &key) const {
+  if (memory_limit_ > 0) {
+    void *entry = GetFromMemory(key);
+    if (entry != nullptr) {
+      return entry;
+    }
+  }
+  if (directory_.empty()) {
+    return nullptr;
+  }
+  FILE *in = fopen(Path(key).c_str(), "rb");
+  if (in == nullptr) {
+    return nullptr;
+  }
+  std::string contents;
+  char buffer[64 << 10];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+    contents.append(buffer, n);
+  }
+  bool read_error = ferror(in);
+  fclose(in);
+  if (read_error || contents.size() < kMagicSize + 4 ||
+      contents.compare(0, kMagicSize, kMagic) != 0) {
+    return nullptr;
+  }
+  const uint8_t *key_size_ptr =
+      reinterpret_cast<const uint8_t *>(contents.data()) + kMagicSize;
+  size_t key_size = key_size_ptr[0] | key_size_ptr[1] << 8 |
+                    key_size_ptr[2] << 16 |
+                    static_cast<size_t>(key_size_ptr[3]) << 24;
+  size_t entry_offset = kMagicSize + 4 + key_size;
+  if (contents.size() < entry_offset + sizeof(LH) ||
+      contents.compare(kMagicSize + 4, key_size, key) != 0) {
+    return nullptr;
+  }
+
+  // Make sure the entry is complete before handing it out.
+  size_t entry_size = contents.size() - entry_offset;
+  void *entry = malloc(entry_size);
+  if (entry == nullptr) {
+    return nullptr;
+  }
+  memcpy(entry, contents.data() + entry_offset, entry_size);
+  const LH *lh = reinterpret_cast<const LH *>(entry);
+  if (!lh->is() || lh->size() > entry_size ||
+      lh->size() + lh->in_zip_size() != entry_size) {
+    diag_warnx("%s:%d: ignoring corrupt %s", __FILE__, __LINE__,
+               Path(key).c_str());
+    free(entry);
+    return nullptr;
+  }
+  if (memory_limit_ > 0) {
+    PutInMemory(key, entry);
+  }
+  return entry;
+}
+
+void CombinerCache::Put(const std::string &key, const void *entry) const {
+  if (memory_limit_ > 0) {
+    PutInMemory(key, entry);
+  }
+  if (directory_.empty()) {
+    return;
+  }
+  const LH *lh = reinterpret_cast<const LH *>(entry);
+  const std::string path = Path(key);
+  const std::string temp_path = path + ".tmp" + std::to_string(getpid());
+  FILE *out = fopen(temp_path.c_str(), "wb");
+  if (out == nullptr) {
+    diag_warn("%s:%d: cannot create %s", __FILE__, __LINE__,
+              temp_path.c_str());
+    return;
+  }
+  const uint8_t key_size[] = {
+      static_cast<uint8_t>(key.size()), static_cast<uint8_t>(key.size() >> 8),
+      static_cast<uint8_t>(key.size() >> 16),
+      static_cast<uint8_t>(key.size() >> 24)};
+  const size_t entry_size = lh->size() + lh->in_zip_size();
+  bool ok = fwrite(kMagic, 1, kMagicSize, out) == kMagicSize &&
+            fwrite(key_size, 1, sizeof(key_size), out) == sizeof(key_size) &&
+            fwrite(key.data(), 1, key.size(), out) == key.size() &&
+            fwrite(entry, 1, entry_size, out) == entry_size;
+  if (fclose(out) || !ok) {
+    diag_warn("%s:%d: cannot write %s", __FILE__, __LINE__,
+              temp_path.c_str());
+    remove(temp_path.c_str());
+    return;
+  }
+  // If another process has stored the same entry in the meantime, either
+  // copy will do.
+  if (rename(temp_path.c_str(), path.c_str())) {
+    remove(temp_path.c_str());
+  }
+}
@@ -0,0 +1,76 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_COMBINER_CACHE_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_COMBINER_CACHE_H_ 1
+
+#include <cstddef>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+/*
+ * An on-disk cache of combined entries, shared by singlejar runs. The deploy
+ * jars of a project usually merge the same service provider files from
+ * the same dependencies, so the combined (and compressed) entry can be
+ * reused rather than produced again.
+ *
+ * The key is the description of everything the entry is made of: its name,
+ * the way it is combined and the CRC32 and size of each contributing input
+ * (see Concatenator). Each entry is kept in its own file named by the hash
+ * of the key, and the file starts with the key itself, so that a hash
+ * collision is a miss rather than a wrong entry. The files are written
+ * atomically, so concurrent singlejar runs may share the directory.
+ *
+ * A persistent worker also keeps the entries it has seen in memory, up to
+ * `memory_limit` bytes, the least recently used being dropped first. Its
+ * directory may be empty, for a cache in memory only.
+ */
+class CombinerCache {
+ public:
+  explicit CombinerCache(const std::string &directory)
+      : CombinerCache(directory, 0) {}
+
+  CombinerCache(const std::string &directory, size_t memory_limit)
+      : directory_(directory), memory_limit_(memory_limit), memory_size_(0) {}
+
+  // Changes the directory, for the next request of a persistent worker.
+  void set_directory(const std::string &directory) { directory_ = directory; }
+
+  // Returns the entry (Local Header followed by the payload, as returned by
+  // Combiner::OutputEntry()) stored under the key, or nullptr. The caller
+  // is responsible for freeing the returned buffer.
+  void *Get(const std::string &key) const;
+
+  // Stores the entry under the key. Failures are not fatal.
+  void Put(const std::string &key, const void *entry) const;
+
+ private:
+  std::string Path(const std::string &key) const;
+
+  void *GetFromMemory(const std::string &key) const;
+  void PutInMemory(const std::string &key, const void *entry) const;
+
+  typedef std::list<std::pair<std::string, std::string> > MemoryEntries;
+
+  std::string directory_;
+  const size_t memory_limit_;
+  mutable size_t memory_size_;
+  mutable MemoryEntries memory_entries_;  // Most recently used first.
+  mutable std::unordered_map<std::string, MemoryEntries::iterator>
+      memory_index_;
+};
+
+#endif  // BAZEL_SRC_TOOLS_SINGLEJAR_COMBINER_CACHE_H_
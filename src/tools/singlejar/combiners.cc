@@ -14,57 +14,42 @@
 
 #include "src/tools/singlejar/combiners.h"
 
+#include <algorithm>
 #include <cctype>
 #include <iostream>
 #include <iterator>
 #include <sstream>
 #include <string>
 
+#include "src/tools/singlejar/checksum.h"
 #include "src/tools/singlejar/diag.h"
+#include "src/tools/singlejar/parallel_deflater.h"
+#include "src/tools/singlejar/stats.h"
 
 Combiner::~Combiner() {}
 
 Concatenator::~Concatenator() {}
 
-bool Concatenator::Merge(const CDH *cdh, const LH *lh) {
-  if (insert_newlines_ && buffer_.get() && buffer_->data_size() &&
-      '\n' != buffer_->last_byte()) {
-    Append("\n", 1);
-  }
-  CreateBuffer();
-  if (Z_NO_COMPRESSION == lh->compression_method()) {
-    buffer_->ReadEntryContents(cdh, lh);
-  } else if (Z_DEFLATED == lh->compression_method()) {
-    if (!inflater_) {
-      inflater_.reset(new Inflater());
-    }
-    buffer_->DecompressEntryContents(cdh, lh, inflater_.get());
-  } else {
-    diag_errx(2, "%s is neither stored nor deflated", filename_.c_str());
-  }
-  return true;
-}
-
-void *Concatenator::OutputEntry(bool compress) {
-  if (!buffer_) {
-    return nullptr;
-  }
+// The raw entries are copied, as the input jars are closed before the output
+// is requested. Beyond this size, they are inflated right away.
+static const uint64_t kMaxRawSize = 64 << 20;
 
-  // Allocate a contiguous buffer for the local file header and
-  // deflated data. We assume that deflate decreases the size, so if
-  //  the deflater reports overflow, we just save original data.
-  size_t deflated_buffer_size =
-      sizeof(LH) + filename_.size() + buffer_->data_size();
+// Allocates a Local Header for an entry of the given size, followed by
+// `payload_size` bytes for its data. The checksum, the compression method
+// and the compressed size are set by the caller.
+static LH *NewLocalHeader(const std::string &filename,
+                          uint64_t uncompressed_size, uint64_t payload_size) {
+  size_t buffer_size = sizeof(LH) + filename.size() + payload_size;
 
   // Huge entry (>4GB) needs Zip64 extension field with 64-bit original
   // and compressed size values.
   uint8_t
       zip64_extension_buffer[sizeof(Zip64ExtraField) + 2 * sizeof(uint64_t)];
-  bool huge_buffer = ziph::zfield_needs_ext64(buffer_->data_size());
+  bool huge_buffer = ziph::zfield_needs_ext64(uncompressed_size);
   if (huge_buffer) {
-    deflated_buffer_size += sizeof(zip64_extension_buffer);
+    buffer_size += sizeof(zip64_extension_buffer);
   }
-  LH *lh = reinterpret_cast<LH *>(malloc(deflated_buffer_size));
+  LH *lh = reinterpret_cast<LH *>(malloc(buffer_size));
   if (lh == nullptr) {
     return nullptr;
   }
@@ -75,7 +60,7 @@ void *Concatenator::OutputEntry(bool compress) {
   lh->last_mod_file_date(30 << 9 | 1 << 5 | 1);  // 2010-01-01
   lh->crc32(0x12345678);
   lh->compressed_file_size32(0);
-  lh->file_name(filename_.c_str(), filename_.size());
+  lh->file_name(filename.c_str(), filename.size());
 
   if (huge_buffer) {
     // Add Z64 extension if this is a huge entry.
@@ -84,12 +69,255 @@ void *Concatenator::OutputEntry(bool compress) {
         reinterpret_cast<Zip64ExtraField *>(zip64_extension_buffer);
     z64->signature();
     z64->payload_size(2 * sizeof(uint64_t));
-    z64->attr64(0, buffer_->data_size());
+    z64->attr64(0, uncompressed_size);
     lh->extra_fields(reinterpret_cast<uint8_t *>(z64), z64->size());
   } else {
-    lh->uncompressed_file_size32(buffer_->data_size());
+    lh->uncompressed_file_size32(uncompressed_size);
     lh->extra_fields(nullptr, 0);
   }
+  return lh;
+}
+
+static void SetCompressedSize(LH *lh, uint64_t uncompressed_size,
+                              uint64_t compressed_size) {
+  if (ziph::zfield_needs_ext64(uncompressed_size)) {
+    lh->compressed_file_size32(ziph::zfield_needs_ext64(compressed_size)
+                                   ? 0xFFFFFFFF
+                                   : compressed_size);
+    // Not sure if this has to be written in the small case, but it shouldn't
+    // hurt.
+    const_cast<Zip64ExtraField *>(lh->zip64_extra_field())
+        ->attr64(1, compressed_size);
+  } else {
+    // If original data is <4GB, the compressed one is, too.
+    lh->compressed_file_size32(compressed_size);
+  }
+}
+
+// Where the last block of a deflate stream starts and where the stream ends.
+struct DeflateStreamEnd {
+  uint64_t last_block_bit;  // The bit offset of the last block's BFINAL bit.
+  size_t size;              // The size of the stream, in bytes.
+  int unused_bits;          // The number of unused high bits of its last byte.
+  int last_byte;            // The last inflated byte, or -1 if none.
+};
+
+// Inflates the deflate stream to find its end. Returns false if the stream
+// is invalid or does not inflate to `uncompressed_size` bytes.
+static bool FindDeflateStreamEnd(const uint8_t *data, size_t size,
+                                 uint64_t uncompressed_size,
+                                 Inflater *inflater, DeflateStreamEnd *end) {
+  Stats::Timer timer(Stats::kInflate);
+  uint8_t buffer[16384];
+  end->last_block_bit = 0;
+  end->unused_bits = 0;
+  end->last_byte = -1;
+  inflater->reset();
+  inflater->DataToInflate(data, size);
+  for (;;) {
+    int ret = inflater->InflateBlock(buffer, sizeof(buffer));
+    uint32_t inflated = sizeof(buffer) - inflater->available_out();
+    if (inflated) {
+      end->last_byte = buffer[inflated - 1];
+    }
+    size_t consumed = inflater->next_in() - data;
+    int unused_bits = inflater->data_type() & 7;
+    if (Z_STREAM_END == ret) {
+      end->size = consumed;
+      break;
+    }
+    if (Z_OK != ret) {
+      return false;
+    }
+    if (inflater->data_type() & 128) {
+      if (inflater->data_type() & 64) {
+        // The end of the last block. The unused bits are no longer
+        // reported once the end of the stream has been returned.
+        end->unused_bits = unused_bits;
+      } else {
+        // The end of a block which is not the last one. The next block
+        // starts at the first unused bit.
+        end->last_block_bit = consumed * 8 - unused_bits;
+      }
+    }
+  }
+  bool ok = inflater->total_out() == uncompressed_size;
+  inflater->reset();
+  return ok;
+}
+
+void Concatenator::SaveEntry(const CDH *cdh, const LH *lh) {
+  Piece piece{true, cdh->size(), std::string()};
+  piece.bytes.reserve(cdh->size() + lh->size() + cdh->compressed_file_size());
+  piece.bytes.append(reinterpret_cast<const char *>(cdh), cdh->size());
+  piece.bytes.append(reinterpret_cast<const char *>(lh),
+                     lh->size() + cdh->compressed_file_size());
+  pieces_.push_back(std::move(piece));
+}
+
+bool Concatenator::Merge(const CDH *cdh, const LH *lh) {
+  if (cache_ != nullptr) {
+    SaveEntry(cdh, lh);
+    return true;
+  }
+  if (!buffer_ && Z_DEFLATED == lh->compression_method() &&
+      raw_size_ + cdh->compressed_file_size() <= kMaxRawSize) {
+    raw_size_ += cdh->compressed_file_size();
+    SaveEntry(cdh, lh);
+    return true;
+  }
+  if (!pieces_.empty()) {
+    InflateRawEntries();
+  }
+  if (insert_newlines_ && buffer_.get() && buffer_->data_size() &&
+      '\n' != buffer_->last_byte()) {
+    Append("\n", 1);
+  }
+  CreateBuffer();
+  if (Z_NO_COMPRESSION == lh->compression_method()) {
+    buffer_->ReadEntryContents(cdh, lh);
+  } else if (Z_DEFLATED == lh->compression_method()) {
+    if (!inflater_) {
+      inflater_.reset(new Inflater());
+    }
+    buffer_->DecompressEntryContents(cdh, lh, inflater_.get());
+  } else {
+    diag_errx(2, "%s is neither stored nor deflated", filename_.c_str());
+  }
+  return true;
+}
+
+void Concatenator::InflateRawEntries() {
+  std::vector<Piece> pieces;
+  pieces.swap(pieces_);
+  raw_size_ = 0;
+  CreateBuffer();
+  for (auto &piece : pieces) {
+    Merge(reinterpret_cast<const CDH *>(piece.bytes.data()),
+          reinterpret_cast<const LH *>(piece.bytes.data() + piece.cdh_size));
+  }
+}
+
+void *Concatenator::JoinRawEntries() {
+  // A deflate stream ends with a block flagged as the last one, padded to a
+  // byte boundary. To join the streams, that flag is cleared in all of them
+  // but the last one, and each of them is followed by an empty stored block
+  // (or a stored block holding the newline to insert), which moves the next
+  // stream to a byte boundary. Finding the last block means inflating the
+  // stream, but the output is still not deflated again. A single entry is
+  // just copied.
+  struct RawStream {
+    const uint8_t *data;
+    DeflateStreamEnd end;
+    bool newline;  // Whether a newline follows the stream.
+  };
+  std::vector<RawStream> streams(pieces_.size());
+  uint64_t uncompressed_size = 0;
+  uint64_t payload_size = 0;
+  uint32_t checksum = 0;
+  int last_byte = -1;
+  for (size_t i = 0; i < pieces_.size(); ++i) {
+    const CDH *cdh = reinterpret_cast<const CDH *>(pieces_[i].bytes.data());
+    const LH *lh = reinterpret_cast<const LH *>(pieces_[i].bytes.data() +
+                                                pieces_[i].cdh_size);
+    RawStream &stream = streams[i];
+    stream.data = lh->data();
+    stream.newline = false;
+    if (i + 1 == pieces_.size()) {
+      stream.end.size = cdh->compressed_file_size();
+      payload_size += stream.end.size;
+    } else {
+      if (!inflater_) {
+        inflater_.reset(new Inflater());
+      }
+      if (!FindDeflateStreamEnd(stream.data, cdh->compressed_file_size(),
+                                cdh->uncompressed_file_size(),
+                                inflater_.get(), &stream.end)) {
+        return nullptr;
+      }
+      if (stream.end.last_byte >= 0) {
+        last_byte = stream.end.last_byte;
+      }
+      stream.newline = insert_newlines_ && last_byte >= 0 && last_byte != '\n';
+      // The stream, an extra byte for the stored block header, and the rest
+      // of the stored block.
+      payload_size += stream.end.size + 1 + 4 + stream.newline;
+    }
+    checksum = crc32_combine(checksum, cdh->crc32(),
+                             cdh->uncompressed_file_size());
+    uncompressed_size += cdh->uncompressed_file_size();
+    if (stream.newline) {
+      checksum = crc32_combine(checksum, ComputeCrc32(0, "\n", 1), 1);
+      uncompressed_size += 1;
+      last_byte = '\n';
+    }
+  }
+  // Like CompressOut(), store the data rather than expand it.
+  if (payload_size > uncompressed_size) {
+    return nullptr;
+  }
+
+  LH *lh = NewLocalHeader(filename_, uncompressed_size, payload_size);
+  if (lh == nullptr) {
+    return nullptr;
+  }
+  uint8_t *q = lh->data();
+  for (auto &stream : streams) {
+    memcpy(q, stream.data, stream.end.size);
+    if (&stream == &streams.back()) {
+      q += stream.end.size;
+      break;
+    }
+    uint64_t bit = stream.end.last_block_bit;
+    q[bit / 8] &= ~(1 << (bit % 8));
+    // The stored block header (BFINAL=0, BTYPE=00) takes the three bits
+    // following the stream, which are zeroed, then the block is aligned.
+    q += stream.end.size;
+    q[-1] &= 0xFF >> stream.end.unused_bits;
+    if (stream.end.unused_bits < 3) {
+      *q++ = 0;
+    }
+    if (stream.newline) {
+      const uint8_t block[] = {1, 0, 0xFE, 0xFF, '\n'};
+      memcpy(q, block, sizeof(block));
+      q += sizeof(block);
+    } else {
+      const uint8_t block[] = {0, 0, 0xFF, 0xFF};
+      memcpy(q, block, sizeof(block));
+      q += sizeof(block);
+    }
+  }
+  lh->crc32(checksum);
+  lh->compression_method(Z_DEFLATED);
+  SetCompressedSize(lh, uncompressed_size, q - lh->data());
+  return reinterpret_cast<void *>(lh);
+}
+
+void *Concatenator::OutputEntry(bool compress) {
+  if (cache_ != nullptr) {
+    return CachedOutputEntry(compress);
+  }
+  if (!pieces_.empty()) {
+    if (compress) {
+      void *entry = JoinRawEntries();
+      if (entry != nullptr) {
+        return entry;
+      }
+    }
+    InflateRawEntries();
+  }
+  if (!buffer_) {
+    return nullptr;
+  }
+
+  // Allocate a contiguous buffer for the local file header and
+  // deflated data. We assume that deflate decreases the size, so if
+  //  the deflater reports overflow, we just save original data.
+  LH *lh = NewLocalHeader(filename_, buffer_->data_size(),
+                          buffer_->data_size());
+  if (lh == nullptr) {
+    return nullptr;
+  }
 
   uint32_t checksum;
   uint64_t compressed_size;
@@ -103,21 +331,73 @@ void *Concatenator::OutputEntry(bool compress) {
   }
   lh->crc32(checksum);
   lh->compression_method(method);
-  if (huge_buffer) {
-    lh->compressed_file_size32(ziph::zfield_needs_ext64(compressed_size)
-                                   ? 0xFFFFFFFF
-                                   : compressed_size);
-    // Not sure if this has to be written in the small case, but it shouldn't
-    // hurt.
-    const_cast<Zip64ExtraField *>(lh->zip64_extra_field())
-        ->attr64(1, compressed_size);
-  } else {
-    // If original data is <4GB, the compressed one is, too.
-    lh->compressed_file_size32(compressed_size);
-  }
+  SetCompressedSize(lh, buffer_->data_size(), compressed_size);
   return reinterpret_cast<void *>(lh);
 }
 
+void *Concatenator::CachedOutputEntry(bool compress) {
+  if (pieces_.empty()) {
+    return nullptr;
+  }
+
+  // The output is determined by the name, the options, and the contents of
+  // the inputs, as represented by their CRC32 and size. Parallel compression
+  // produces different (equally valid) bytes, so it is a part of the key,
+  // too, to keep the output reproducible.
+  char line[64];
+  snprintf(line, sizeof(line), "%d %d %d\n", insert_newlines_, compress,
+           ParallelDeflater::max_threads() > 1);
+  std::string key = filename_ + '\n' + line;
+  for (auto &piece : pieces_) {
+    if (piece.is_entry) {
+      const CDH *cdh = reinterpret_cast<const CDH *>(piece.bytes.data());
+      snprintf(line, sizeof(line), "e %08" PRIx32 " %" PRIu64 "\n",
+               cdh->crc32(), cdh->uncompressed_file_size());
+      // The compressed output may be made of the deflated data of the inputs
+      // (see JoinRawEntries()), which then depends on how they have been
+      // compressed.
+      const LH *lh =
+          reinterpret_cast<const LH *>(piece.bytes.data() + piece.cdh_size);
+      if (compress && Z_DEFLATED == lh->compression_method()) {
+        key += line;
+        snprintf(line, sizeof(line), "d %08" PRIx32 " %" PRIu64 "\n",
+                 ComputeCrc32(0, lh->data(), cdh->compressed_file_size()),
+                 cdh->compressed_file_size());
+      }
+    } else {
+      uint32_t crc =
+          ComputeCrc32(0, piece.bytes.data(), piece.bytes.size());
+      snprintf(line, sizeof(line), "a %08" PRIx32 " %zu\n", crc,
+               piece.bytes.size());
+    }
+    key += line;
+  }
+  void *entry = cache_->Get(key);
+  if (entry != nullptr) {
+    return entry;
+  }
+
+  // Not in the cache: combine the inputs the usual way. From now on, this
+  // instance behaves as if it had no cache.
+  const CombinerCache *cache = cache_;
+  cache_ = nullptr;
+  std::vector<Piece> pieces;
+  pieces.swap(pieces_);
+  for (auto &piece : pieces) {
+    if (piece.is_entry) {
+      Merge(reinterpret_cast<const CDH *>(piece.bytes.data()),
+            reinterpret_cast<const LH *>(piece.bytes.data() + piece.cdh_size));
+    } else {
+      Append(piece.bytes);
+    }
+  }
+  entry = OutputEntry(compress);
+  if (entry != nullptr) {
+    cache->Put(key, entry);
+  }
+  return entry;
+}
+
 NullCombiner::~NullCombiner() {}
 
 bool NullCombiner::Merge(const CDH * /*cdh*/, const LH * /*lh*/) {
@@ -129,53 +409,218 @@ void *NullCombiner::OutputEntry(bool /*compress*/) { return nullptr; }
 XmlCombiner::~XmlCombiner() {}
 
 bool XmlCombiner::Merge(const CDH *cdh, const LH *lh) {
-  if (!concatenator_) {
-    concatenator_.reset(new Concatenator(filename_, false));
-    concatenator_->Append(start_tag_);
-    concatenator_->Append("\n");
-  }
-  // To ensure xml concatentation is idempotent, read in the entry being added
-  // and remove the start and end tags if they are present.
-  TransientBytes bytes_;
+  if (finished_) {
+    diag_errx(2, "%s: cannot merge after the output has been created",
+              filename_.c_str());
+  }
+  if (!deflater_) {
+    deflater_.reset(new Deflater());
+    Write(start_tag_.data(), start_tag_.size());
+    Write("\n", 1);
+  }
+  // To ensure xml concatentation is idempotent, the start and end tags of
+  // the entry being added are removed if they are present.
+  pending_.clear();
+  pending_offset_ = 0;
+  head_checked_ = false;
+  uint64_t in_bytes;
+  uint64_t out_bytes;
+  if (cdh->no_size_in_local_header()) {
+    in_bytes = cdh->compressed_file_size();
+    out_bytes = cdh->uncompressed_file_size();
+  } else {
+    in_bytes = lh->compressed_file_size();
+    out_bytes = lh->uncompressed_file_size();
+  }
   if (Z_NO_COMPRESSION == lh->compression_method()) {
-    bytes_.ReadEntryContents(cdh, lh);
+    MergeChunk(lh->data(), out_bytes);
   } else if (Z_DEFLATED == lh->compression_method()) {
+    Stats::Timer timer(Stats::kInflate);
     if (!inflater_) {
       inflater_.reset(new Inflater());
     }
-    bytes_.DecompressEntryContents(cdh, lh, inflater_.get());
+    inflater_->reset();
+    uint8_t buffer[65536];
+    const uint8_t *fed_end = lh->data();
+    inflater_->DataToInflate(fed_end, 0);
+    for (;;) {
+      if (inflater_->next_in() == fed_end && in_bytes > 0) {
+        // A single region to inflate cannot exceed 4GB-1.
+        uint32_t in_bytes_chunk = std::min(in_bytes, uint64_t{0xFFFFFFFF});
+        inflater_->DataToInflate(fed_end, in_bytes_chunk);
+        fed_end += in_bytes_chunk;
+        in_bytes -= in_bytes_chunk;
+      }
+      int ret = inflater_->Inflate(buffer, sizeof(buffer));
+      MergeChunk(buffer, sizeof(buffer) - inflater_->available_out());
+      if (Z_STREAM_END == ret) {
+        break;
+      }
+      if (Z_OK != ret &&
+          !(Z_BUF_ERROR == ret && inflater_->next_in() == fed_end &&
+            in_bytes > 0)) {
+        diag_errx(2, "%s:%d: Internal error inflating %.*s: inflate() call "
+                  "returned %d (%s)",
+                  __FILE__, __LINE__, lh->file_name_length(), lh->file_name(),
+                  ret, inflater_->error_message());
+      }
+    }
+    inflater_->reset();
   } else {
     diag_errx(2, "%s is neither stored nor deflated", filename_.c_str());
   }
-  uint32_t checksum;
-  char *buf = reinterpret_cast<char *>(malloc(bytes_.data_size()));
-  // TODO(b/37631490): optimize this to avoid copying the bytes twice
-  bytes_.CopyOut(reinterpret_cast<uint8_t *>(buf), &checksum);
-  int start_offset = 0;
-  if (strncmp(buf, start_tag_.c_str(), start_tag_.length()) == 0) {
-    start_offset = start_tag_.length();
-  }
-  uint64_t end = bytes_.data_size();
-  while (end >= end_tag_.length() && std::isspace(buf[end - 1])) end--;
-  if (strncmp(buf + end - end_tag_.length(), end_tag_.c_str(),
-              end_tag_.length()) == 0) {
+  FinishEntry();
+  return true;
+}
+
+void XmlCombiner::MergeChunk(const uint8_t *data, size_t size) {
+  if (!head_checked_) {
+    size_t n = std::min(size, start_tag_.size() - pending_.size());
+    pending_.append(reinterpret_cast<const char *>(data), n);
+    data += n;
+    size -= n;
+    if (pending_.size() < start_tag_.size()) {
+      return;
+    }
+    head_checked_ = true;
+    if (pending_ == start_tag_) {
+      pending_offset_ = pending_.size();
+      pending_.clear();
+    }
+  }
+
+  // Hold back the trailing whitespace and as many bytes before it as there
+  // are in the end tag.
+  size_t spaces = 0;
+  while (spaces < size && std::isspace(data[size - 1 - spaces])) {
+    ++spaces;
+  }
+  size_t keep = spaces + end_tag_.size();
+  if (keep < size) {
+    Write(pending_.data(), pending_.size());
+    pending_offset_ += pending_.size();
+    Write(data, size - keep);
+    pending_offset_ += size - keep;
+    pending_.assign(reinterpret_cast<const char *>(data) + size - keep, keep);
+    return;
+  }
+  pending_.append(reinterpret_cast<const char *>(data), size);
+  spaces = 0;
+  while (spaces < pending_.size() &&
+         std::isspace(static_cast<uint8_t>(
+             pending_[pending_.size() - 1 - spaces]))) {
+    ++spaces;
+  }
+  keep = spaces + end_tag_.size();
+  if (keep < pending_.size()) {
+    size_t n = pending_.size() - keep;
+    Write(pending_.data(), n);
+    pending_offset_ += n;
+    pending_.erase(0, n);
+  }
+}
+
+void XmlCombiner::FinishEntry() {
+  // The trailing whitespace is removed only if it follows the end tag. The
+  // held back bytes contain both.
+  uint64_t end = pending_offset_ + pending_.size();
+  while (end >= end_tag_.length() && end > pending_offset_ &&
+         std::isspace(static_cast<uint8_t>(pending_[end - pending_offset_ -
+                                                    1]))) {
+    end--;
+  }
+  if (end >= pending_offset_ + end_tag_.length() &&
+      pending_.compare(end - pending_offset_ - end_tag_.length(),
+                       end_tag_.length(), end_tag_) == 0) {
     end -= end_tag_.length();
   } else {
     // Leave trailing whitespace alone if we didn't find a match.
-    end = bytes_.data_size();
+    end = pending_offset_ + pending_.size();
   }
-  concatenator_->Append(buf + start_offset, end - start_offset);
-  free(buf);
-  return true;
+  Write(pending_.data(), end - pending_offset_);
+  pending_.clear();
+}
+
+void XmlCombiner::Write(const void *data, size_t size, int flush) {
+  Stats::Timer timer(Stats::kDeflate);
+  checksum_ = ComputeCrc32(checksum_, data, size);
+  uncompressed_size_ += size;
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(data);
+  uint8_t buffer[65536];
+  do {
+    // A single region to deflate cannot exceed 4GB-1.
+    uint32_t chunk_size =
+        static_cast<uint32_t>(std::min(size, size_t{0x40000000}));
+    deflater_->next_in = const_cast<uint8_t *>(p);
+    deflater_->avail_in = chunk_size;
+    p += chunk_size;
+    size -= chunk_size;
+    int chunk_flush = size ? Z_NO_FLUSH : flush;
+    do {
+      deflater_->next_out = buffer;
+      deflater_->avail_out = sizeof(buffer);
+      int ret = deflate(deflater_.get(), chunk_flush);
+      if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+        diag_errx(2, "%s:%d: deflate() call returned %d (%s)", __FILE__,
+                  __LINE__, ret, deflater_->msg);
+      }
+      compressed_.Append(buffer, sizeof(buffer) - deflater_->avail_out);
+    } while (deflater_->avail_out == 0);
+  } while (size > 0);
 }
 
 void *XmlCombiner::OutputEntry(bool compress) {
-  if (!concatenator_) {
+  if (!deflater_) {
     return nullptr;
   }
-  concatenator_->Append(end_tag_);
-  concatenator_->Append("\n");
-  return concatenator_->OutputEntry(compress);
+  if (!finished_) {
+    Write(end_tag_.data(), end_tag_.size());
+    Write("\n", 1, Z_FINISH);
+    finished_ = true;
+  }
+
+  // Store the data if it does not compress.
+  bool deflated = compress && compressed_.data_size() < uncompressed_size_;
+  uint64_t payload_size =
+      deflated ? compressed_.data_size() : uncompressed_size_;
+  LH *lh = NewLocalHeader(filename_, uncompressed_size_, payload_size);
+  if (lh == nullptr) {
+    return nullptr;
+  }
+  uint8_t *q = lh->data();
+  if (deflated) {
+    compressed_.stream_out([&q](const void *chunk, uint64_t chunk_size) {
+      memcpy(q, chunk, chunk_size);
+      q += chunk_size;
+    });
+  } else {
+    Stats::Timer timer(Stats::kInflate);
+    Inflater inflater;
+    uint64_t available = uncompressed_size_;
+    compressed_.stream_out([&](const void *chunk, uint64_t chunk_size) {
+      inflater.DataToInflate(reinterpret_cast<const uint8_t *>(chunk),
+                             chunk_size);
+      do {
+        uint32_t out_size = static_cast<uint32_t>(
+            std::min(available, uint64_t{0xFFFFFFFF}));
+        inflater.Inflate(q, out_size);
+        uint32_t inflated = out_size - inflater.available_out();
+        q += inflated;
+        available -= inflated;
+        if (!inflated) {
+          break;
+        }
+      } while (available > 0);
+    });
+    if (available) {
+      diag_errx(2, "%s:%d: Internal error inflating %s", __FILE__, __LINE__,
+                filename_.c_str());
+    }
+  }
+  lh->crc32(checksum_);
+  lh->compression_method(deflated ? Z_DEFLATED : Z_NO_COMPRESSION);
+  SetCompressedSize(lh, uncompressed_size_, payload_size);
+  return reinterpret_cast<void *>(lh);
 }
 
 PropertyCombiner::~PropertyCombiner() {}
@@ -21,6 +21,7 @@
 #include <unordered_map>
 #include <vector>
 
+#include "src/tools/singlejar/combiner_cache.h"
 #include "src/tools/singlejar/transient_bytes.h"
 #include "src/tools/singlejar/zip_headers.h"
 
@@ -43,7 +44,8 @@ class Combiner {
 class Concatenator : public Combiner {
  public:
   Concatenator(const std::string &filename, bool insert_newlines = true)
-      : filename_(filename), insert_newlines_(insert_newlines) {}
+      : filename_(filename), insert_newlines_(insert_newlines),
+        cache_(nullptr), raw_size_(0) {}
 
   ~Concatenator() override;
 
@@ -51,7 +53,25 @@ class Concatenator : public Combiner {
 
   void *OutputEntry(bool compress) override;
 
+  // Makes OutputEntry() look up the output in the given cache first. Merge()
+  // and Append() then just save the inputs, which are decompressed and
+  // concatenated only if the output is not in the cache. Has to be called
+  // before anything is added.
+  void set_cache(const CombinerCache *cache) { cache_ = cache; }
+
   void Append(const char *s, size_t n) {
+    if (cache_ != nullptr) {
+      // Consecutive appended bytes are saved (and looked up) as one piece.
+      if (!pieces_.empty() && !pieces_.back().is_entry) {
+        pieces_.back().bytes.append(s, n);
+      } else {
+        pieces_.push_back(Piece{false, 0, std::string(s, n)});
+      }
+      return;
+    }
+    if (!pieces_.empty()) {
+      InflateRawEntries();
+    }
     CreateBuffer();
     buffer_->Append(reinterpret_cast<const uint8_t *>(s), n);
   }
@@ -68,10 +88,35 @@ class Concatenator : public Combiner {
       buffer_.reset(new TransientBytes());
     }
   }
+  void *CachedOutputEntry(bool compress);
+  // Saves a copy of the input entry in pieces_.
+  void SaveEntry(const CDH *cdh, const LH *lh);
+  // Without a cache, the deflated input entries are saved as they are until
+  // the output is requested, and if it is to be compressed, the output data
+  // is their data, joined without being recompressed. Returns nullptr if
+  // the entries cannot be joined.
+  void *JoinRawEntries();
+  // Merges the saved input entries into the buffer.
+  void InflateRawEntries();
+
+  // An input saved until it is known whether the output is in the cache
+  // (either appended bytes, or a copy of an input entry's Central Directory
+  // Header followed by its Local Header and data), or without a cache, until
+  // it is known whether the deflated data can be copied to the output.
+  struct Piece {
+    bool is_entry;
+    size_t cdh_size;
+    std::string bytes;
+  };
+
   const std::string filename_;
   std::unique_ptr<TransientBytes> buffer_;
   std::unique_ptr<Inflater> inflater_;
   bool insert_newlines_;
+  const CombinerCache *cache_;
+  std::vector<Piece> pieces_;
+  // The compressed size of the raw entries saved in pieces_.
+  uint64_t raw_size_;
 };
 
 // The combiner that does nothing. Useful to represent for instance directory
@@ -86,12 +131,19 @@ class NullCombiner : public Combiner {
 
 // Combines the contents of the multiple input entries which are XML
 // files into a single XML output entry with given top level XML tag.
+// The inputs are inflated a chunk at a time and the output is deflated as
+// it is produced, so that neither is ever held uncompressed as a whole.
 class XmlCombiner : public Combiner {
  public:
   XmlCombiner(const std::string &filename, const std::string &xml_tag)
       : filename_(filename),
         start_tag_("<" + xml_tag + ">"),
-        end_tag_("</" + xml_tag + ">") {}
+        end_tag_("</" + xml_tag + ">"),
+        pending_offset_(0),
+        head_checked_(false),
+        uncompressed_size_(0),
+        checksum_(0),
+        finished_(false) {}
   ~XmlCombiner() override;
 
   bool Merge(const CDH *cdh, const LH *lh) override;
@@ -101,11 +153,31 @@ class XmlCombiner : public Combiner {
   const std::string filename() const { return filename_; }
 
  private:
+  // Adds the next bytes of an input entry, holding back the ones that may
+  // belong to its end tag or to the whitespace following it.
+  void MergeChunk(const uint8_t *data, size_t size);
+  // Adds the held back bytes, less the end tag, once an input has been read.
+  void FinishEntry();
+  // Deflates the bytes of the output.
+  void Write(const void *data, size_t size, int flush = Z_NO_FLUSH);
+
   const std::string filename_;
   const std::string start_tag_;
   const std::string end_tag_;
-  std::unique_ptr<Concatenator> concatenator_;
+  std::unique_ptr<Deflater> deflater_;
   std::unique_ptr<Inflater> inflater_;
+  // The deflated output.
+  TransientBytes compressed_;
+  // The held back bytes of the current input, and their offset in it.
+  std::string pending_;
+  uint64_t pending_offset_;
+  // Whether the beginning of the current input has been compared with the
+  // start tag.
+  bool head_checked_;
+  uint64_t uncompressed_size_;
+  uint32_t checksum_;
+  // Whether the output has been ended with the end tag.
+  bool finished_;
 };
 
 // A wrapper around Concatenator allowing to append
@@ -153,6 +225,11 @@ class ManifestCombiner : public Combiner {
 
   void AppendLine(const std::string &line);
 
+  // See Concatenator::set_cache().
+  void set_cache(const CombinerCache *cache) {
+    concatenator_->set_cache(cache);
+  }
+
   bool Merge(const CDH *cdh, const LH *lh) override;
 
   void *OutputEntry(bool compress) override;
@@ -14,6 +14,14 @@
 
 #include "src/tools/singlejar/combiners.h"
 
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+#include "src/tools/singlejar/checksum.h"
+#include "src/tools/singlejar/combiner_cache.h"
 #include "src/tools/singlejar/input_jar.h"
 #include "src/tools/singlejar/test_util.h"
 #include "src/tools/singlejar/zip_headers.h"
@@ -45,6 +53,28 @@ class CombinersTest : public ::testing::Test {
     ASSERT_TRUE(CreateFile("tag1.xml", kTag1Contents));
     ASSERT_TRUE(CreateFile("tag2.xml", kTag2Contents));
     ASSERT_EQ(0, system("zip -qm combiners.zip tag1.xml tag2.xml"));
+    ASSERT_TRUE(CreateFile("svc1", RawEntryContents(0).c_str()));
+    ASSERT_TRUE(CreateFile("svc2", RawEntryContents(1).c_str()));
+    ASSERT_TRUE(CreateFile("svc3", RawEntryContents(2).c_str()));
+    ASSERT_TRUE(CreateFile("svc4", RawEntryContents(3).c_str()));
+    ASSERT_EQ(0, system("zip -qm9 raw.zip svc1 svc2 svc3 svc4"));
+  }
+
+  // The contents of the compressible entries of raw.zip. The second one is
+  // large enough to be deflated into several blocks, and ends with a
+  // newline.
+  static std::string RawEntryContents(int index) {
+    std::string contents;
+    if (index == 1) {
+      for (int i = 0; i < 40000; ++i) {
+        contents += std::to_string(i * 7919 % 100003) + ' ';
+      }
+      return contents + '\n';
+    }
+    for (int i = 0; i < 100; ++i) {
+      contents += "com.google.Service" + std::to_string(index) + "Impl";
+    }
+    return contents;
   }
 
   static void TearDownTestCase() { remove("xmls.zip"); }
@@ -140,6 +170,134 @@ TEST_F(CombinersTest, ConcatenatorHuge) {
   free(reinterpret_cast<void *>(entry));
 }
 
+static int CountFiles(const char *dir_path) {
+  DIR *dir = opendir(dir_path);
+  if (dir == nullptr) {
+    return -1;
+  }
+  int count = 0;
+  while (struct dirent *dirent = readdir(dir)) {
+    count += dirent->d_name[0] != '.';
+  }
+  closedir(dir);
+  return count;
+}
+
+// Test Concatenator with a combiner cache.
+TEST_F(CombinersTest, ConcatenatorCache) {
+  ASSERT_EQ(0, mkdir("combiner_cache", 0777));
+  CombinerCache cache("combiner_cache");
+  auto combine = [&cache](bool with_tag1) {
+    InputJar input_jar;
+    EXPECT_TRUE(input_jar.Open("combiners.zip"));
+    Concatenator concatenator("concat");
+    concatenator.set_cache(&cache);
+    const LH *lh;
+    const CDH *cdh;
+    while ((cdh = input_jar.NextEntry(&lh))) {
+      if ((with_tag1 && cdh->file_name_is("tag1.xml")) ||
+          cdh->file_name_is("tag2.xml")) {
+        EXPECT_TRUE(concatenator.Merge(cdh, lh));
+      }
+    }
+    concatenator.Append("\n");
+    // The output does not refer to the input jar, which is closed here.
+    return concatenator.OutputEntry(true);
+  };
+
+  LH *entry = reinterpret_cast<LH *>(combine(true));
+  ASSERT_NE(nullptr, entry);
+  EXPECT_TRUE(entry->file_name_is("concat"));
+  EXPECT_EQ(Z_DEFLATED, entry->compression_method());
+  Inflater inflater;
+  inflater.DataToInflate(entry->data(), entry->compressed_file_size());
+  uint8_t buffer[256];
+  ASSERT_EQ(Z_STREAM_END, inflater.Inflate((buffer), sizeof(buffer)));
+  EXPECT_EQ(std::string(kConcatenatedContents) + "\n",
+            std::string(reinterpret_cast<char *>(buffer),
+                        entry->uncompressed_file_size()));
+  EXPECT_EQ(1, CountFiles("combiner_cache"));
+
+  // The same inputs: the entry comes from the cache.
+  LH *cached_entry = reinterpret_cast<LH *>(combine(true));
+  ASSERT_NE(nullptr, cached_entry);
+  size_t entry_size = entry->size() + entry->in_zip_size();
+  ASSERT_EQ(entry_size, cached_entry->size() + cached_entry->in_zip_size());
+  EXPECT_EQ(0, memcmp(entry, cached_entry, entry_size));
+  EXPECT_EQ(1, CountFiles("combiner_cache"));
+  free(cached_entry);
+
+  // Different inputs.
+  cached_entry = reinterpret_cast<LH *>(combine(false));
+  ASSERT_NE(nullptr, cached_entry);
+  EXPECT_EQ(strlen(kTag2Contents) + 1, cached_entry->uncompressed_file_size());
+  EXPECT_EQ(2, CountFiles("combiner_cache"));
+  free(cached_entry);
+  free(entry);
+}
+
+// Test that Concatenator copies the deflated data of the inputs to its
+// compressed output.
+TEST_F(CombinersTest, ConcatenatorRawEntries) {
+  std::string raw_svc1;
+  Concatenator single("single");
+  Concatenator joined("joined");
+  {
+    InputJar input_jar;
+    ASSERT_TRUE(input_jar.Open("raw.zip"));
+    const LH *lh;
+    const CDH *cdh;
+    while ((cdh = input_jar.NextEntry(&lh))) {
+      ASSERT_EQ(Z_DEFLATED, lh->compression_method());
+      if (cdh->file_name_is("svc1")) {
+        raw_svc1.assign(reinterpret_cast<const char *>(lh->data()),
+                        cdh->compressed_file_size());
+        ASSERT_TRUE(single.Merge(cdh, lh));
+      }
+      ASSERT_TRUE(joined.Merge(cdh, lh));
+    }
+  }
+
+  // A single input is copied.
+  std::string contents = RawEntryContents(0);
+  LH *entry = reinterpret_cast<LH *>(single.OutputEntry(true));
+  ASSERT_NE(nullptr, entry);
+  EXPECT_EQ(Z_DEFLATED, entry->compression_method());
+  EXPECT_EQ(contents.size(), entry->uncompressed_file_size());
+  EXPECT_EQ(ComputeCrc32(0, contents.data(), contents.size()),
+            entry->crc32());
+  EXPECT_EQ(raw_svc1,
+            std::string(reinterpret_cast<char *>(entry->data()),
+                        entry->compressed_file_size()));
+  free(entry);
+
+  // Several inputs are joined, with the newlines inserted in between.
+  contents = RawEntryContents(0) + '\n' + RawEntryContents(1) +
+             RawEntryContents(2) + '\n' + RawEntryContents(3);
+  entry = reinterpret_cast<LH *>(joined.OutputEntry(true));
+  ASSERT_NE(nullptr, entry);
+  EXPECT_EQ(Z_DEFLATED, entry->compression_method());
+  ASSERT_EQ(contents.size(), entry->uncompressed_file_size());
+  EXPECT_EQ(ComputeCrc32(0, contents.data(), contents.size()),
+            entry->crc32());
+  Inflater inflater;
+  inflater.DataToInflate(entry->data(), entry->compressed_file_size());
+  std::vector<uint8_t> buffer(contents.size() + 1);
+  ASSERT_EQ(Z_STREAM_END, inflater.Inflate(buffer.data(), buffer.size()));
+  EXPECT_EQ(contents.size(), inflater.total_out());
+  EXPECT_EQ(contents, std::string(reinterpret_cast<char *>(buffer.data()),
+                                  contents.size()));
+  free(entry);
+
+  // The inputs are still inflated for an uncompressed output.
+  entry = reinterpret_cast<LH *>(joined.OutputEntry(false));
+  ASSERT_NE(nullptr, entry);
+  EXPECT_EQ(Z_NO_COMPRESSION, entry->compression_method());
+  EXPECT_EQ(contents, std::string(reinterpret_cast<char *>(entry->data()),
+                                  entry->uncompressed_file_size()));
+  free(entry);
+}
+
 // Test NullCombiner.
 TEST_F(CombinersTest, NullCombiner) {
   NullCombiner null_combiner;
@@ -366,4 +524,39 @@ TEST_F(CombinersTest, ManifestCombinerFalse) {
   free(reinterpret_cast<void *>(entry));
 }
 
+// Test ManifestCombiner with an in-memory combiner cache.
+TEST_F(CombinersTest, ManifestCombinerCache) {
+  CombinerCache cache(std::string(), 1 << 20);
+  auto combine = [&cache](const std::string &main_class) {
+    ManifestCombiner manifest_combiner("META-INF/MANIFEST.MF");
+    manifest_combiner.set_cache(&cache);
+    manifest_combiner.AppendLine("Manifest-Version: 1.0");
+    manifest_combiner.AppendLine("Main-Class: " + main_class);
+    return reinterpret_cast<LH *>(manifest_combiner.OutputEntry(true));
+  };
+
+  LH *entry = combine("com.google.Main");
+  ASSERT_NE(nullptr, entry);
+  EXPECT_TRUE(entry->file_name_is("META-INF/MANIFEST.MF"));
+  EXPECT_EQ("Manifest-Version: 1.0\r\nMain-Class: com.google.Main\r\n\r\n",
+            std::string(reinterpret_cast<char *>(entry->data()),
+                        entry->uncompressed_file_size()));
+
+  // The same lines: the entry comes from the cache.
+  LH *cached_entry = combine("com.google.Main");
+  ASSERT_NE(nullptr, cached_entry);
+  size_t entry_size = entry->size() + entry->in_zip_size();
+  ASSERT_EQ(entry_size, cached_entry->size() + cached_entry->in_zip_size());
+  EXPECT_EQ(0, memcmp(entry, cached_entry, entry_size));
+  free(cached_entry);
+
+  // Different lines.
+  cached_entry = combine("com.google.Other");
+  ASSERT_NE(nullptr, cached_entry);
+  EXPECT_EQ(entry->uncompressed_file_size() + 1,
+            cached_entry->uncompressed_file_size());
+  free(cached_entry);
+  free(entry);
+}
+
 }  // anonymous namespace
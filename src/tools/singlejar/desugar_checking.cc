@@ -13,53 +13,100 @@
 // limitations under the License.
 
 #include "src/tools/singlejar/desugar_checking.h"
+
+#include <memory>
+#include <vector>
+
 #include "src/tools/singlejar/diag.h"
 #include "src/main/protobuf/desugar_deps.pb.h"
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+
+namespace {
+
+using bazel::tools::desugar::DesugarDepsInfo;
+using google::protobuf::io::ArrayInputStream;
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::io::ConcatenatingInputStream;
+using google::protobuf::io::ZeroCopyInputStream;
+
+void ParseDepsInfo(CodedInputStream *content, DesugarDepsInfo *deps_info) {
+  if (!deps_info->ParseFromCodedStream(content)) {
+    diag_errx(2, "META-INF/desugar_deps: unable to parse");
+  }
+  if (!content->ConsumedEntireMessage()) {
+    diag_errx(2, "META-INF/desugar_deps: unexpected trailing content");
+  }
+}
+
+// Parses the contents of the buffer where they are, one chunk after the
+// other, unless they were spilled to a file, which can only be read back into
+// a single reused chunk.
+void ParseDepsInfo(TransientBytes *buffer, DesugarDepsInfo *deps_info) {
+  if (buffer->spilled()) {
+    uint32_t checksum;
+    const size_t data_size = buffer->data_size();
+    std::unique_ptr<uint8_t[]> buf(new uint8_t[data_size]);
+    buffer->CopyOut(buf.get(), &checksum);
+    CodedInputStream content(buf.get(), static_cast<int>(data_size));
+    ParseDepsInfo(&content, deps_info);
+    return;
+  }
+  std::vector<std::unique_ptr<ArrayInputStream>> chunks;
+  std::vector<ZeroCopyInputStream *> streams;
+  buffer->stream_out([&chunks, &streams](const void *chunk, uint64_t size) {
+    chunks.emplace_back(new ArrayInputStream(chunk, static_cast<int>(size)));
+    streams.push_back(chunks.back().get());
+  });
+  ConcatenatingInputStream input(streams.data(),
+                                 static_cast<int>(streams.size()));
+  CodedInputStream content(&input);
+  ParseDepsInfo(&content, deps_info);
+}
+
+}  // namespace
 
 bool Java8DesugarDepsChecker::Merge(const CDH *cdh, const LH *lh) {
-  // Throw away anything previously read, no need to concatenate
-  buffer_.reset(new TransientBytes());
+  resolved_ = false;
+  DesugarDepsInfo deps_info;
   if (Z_NO_COMPRESSION == lh->compression_method()) {
-    buffer_->ReadEntryContents(cdh, lh);
+    // Parse the entry where it is mapped, no need to copy it anywhere.
+    const size_t data_size = cdh->no_size_in_local_header()
+                                 ? cdh->uncompressed_file_size()
+                                 : lh->uncompressed_file_size();
+    CodedInputStream content(lh->data(), static_cast<int>(data_size));
+    ParseDepsInfo(&content, &deps_info);
   } else if (Z_DEFLATED == lh->compression_method()) {
+    // Throw away anything previously read, no need to concatenate
+    buffer_.reset(new TransientBytes());
     if (!inflater_) {
       inflater_.reset(new Inflater());
     }
     buffer_->DecompressEntryContents(cdh, lh, inflater_.get());
+    ParseDepsInfo(buffer_.get(), &deps_info);
+    buffer_.reset();  // release buffer eagerly
   } else {
     diag_errx(2, "META-INF/desugar_deps is neither stored nor deflated");
   }
 
-  // TODO(kmb): Wrap buffer_ as ZeroCopyInputStream to avoid copying out.
-  // Note we only copy one file at a time, so overhead should be modest.
-  uint32_t checksum;
-  const size_t data_size = buffer_->data_size();
-  uint8_t *buf = reinterpret_cast<uint8_t *>(malloc(data_size));
-  buffer_->CopyOut(reinterpret_cast<uint8_t *>(buf), &checksum);
-  buffer_.reset();  // release buffer eagerly
-
-  bazel::tools::desugar::DesugarDepsInfo deps_info;
-  google::protobuf::io::CodedInputStream content(buf, data_size);
-  if (!deps_info.ParseFromCodedStream(&content)) {
-    diag_errx(2, "META-INF/desugar_deps: unable to parse");
-  }
-  if (!content.ConsumedEntireMessage()) {
-    diag_errx(2, "META-INF/desugar_deps: unexpected trailing content");
-  }
-  free(buf);
-
   for (const auto &assume_present : deps_info.assume_present()) {
     // This means we need file named <target>.class in the output.  Remember
     // the first origin of this requirement for error messages, drop others.
-    needed_deps_.emplace(assume_present.target().binary_name() + ".class",
-                         assume_present.origin().binary_name());
+    class_file_.assign(assume_present.target().binary_name());
+    class_file_.append(".class");
+    if (needed_deps_.find(class_file_) == needed_deps_.end()) {
+      needed_deps_.emplace(Intern(class_file_),
+                           Intern(assume_present.origin().binary_name()));
+    }
   }
 
   for (const auto &missing : deps_info.missing_interface()) {
     // Remember the first origin of this requirement for error messages, drop
     // subsequent ones.
-    missing_interfaces_.emplace(missing.target().binary_name(),
-                                missing.origin().binary_name());
+    const std::string &target = missing.target().binary_name();
+    if (missing_interfaces_.find(target) == missing_interfaces_.end()) {
+      missing_interfaces_.emplace(Intern(target),
+                                  Intern(missing.origin().binary_name()));
+    }
   }
 
   for (const auto &extends : deps_info.interface_with_supertypes()) {
@@ -67,14 +114,15 @@ bool Java8DesugarDepsChecker::Merge(const CDH *cdh, const LH *lh) {
     // subsequent ones for consistency with how singlejar will keep the first
     // occurrence of the file defining the interface.  We'll lazily derive
     // whether missing_interfaces_ inherit default methods with this data later.
-    if (extends.extended_interface_size() > 0) {
-      std::vector<std::string> extended;
+    const std::string &origin = extends.origin().binary_name();
+    if (extends.extended_interface_size() > 0 &&
+        extended_interfaces_.find(origin) == extended_interfaces_.end()) {
+      std::vector<std::string_view> extended;
       extended.reserve(extends.extended_interface_size());
       for (const auto &itf : extends.extended_interface()) {
-        extended.push_back(itf.binary_name());
+        extended.push_back(Intern(itf.binary_name()));
       }
-      extended_interfaces_.emplace(extends.origin().binary_name(),
-                                   std::move(extended));
+      extended_interfaces_.emplace(Intern(origin), std::move(extended));
     }
   }
 
@@ -83,7 +131,7 @@ bool Java8DesugarDepsChecker::Merge(const CDH *cdh, const LH *lh) {
     // For all other interfaces we'll transitively check extended interfaces
     // in HasDefaultMethods.
     if (companion.num_default_methods() > 0) {
-      has_default_methods_[companion.origin().binary_name()] = true;
+      has_default_methods_[Intern(companion.origin().binary_name())] = true;
     }
   }
   return true;
@@ -99,14 +147,18 @@ void *Java8DesugarDepsChecker::OutputEntry(bool compress) {
   }
   for (const auto &needed : needed_deps_) {
     if (verbose_) {
-      fprintf(stderr, "Looking for %s\n", needed.first.c_str());
+      fprintf(stderr, "Looking for %.*s\n",
+              static_cast<int>(needed.first.size()), needed.first.data());
     }
-    if (!known_member_(needed.first)) {
+    class_file_.assign(needed.first);
+    if (!known_member_(class_file_)) {
       if (fail_on_error_) {
         diag_errx(2,
-                  "%s referenced by %s but not found.  Is the former defined"
-                  " in a neverlink library?",
-                  needed.first.c_str(), needed.second.c_str());
+                  "%.*s referenced by %.*s but not found.  Is the former"
+                  " defined in a neverlink library?",
+                  static_cast<int>(needed.first.size()), needed.first.data(),
+                  static_cast<int>(needed.second.size()),
+                  needed.second.data());
       } else {
         error_ = true;
       }
@@ -115,15 +167,17 @@ void *Java8DesugarDepsChecker::OutputEntry(bool compress) {
 
   for (const auto &missing : missing_interfaces_) {
     if (verbose_) {
-      fprintf(stderr, "Checking %s\n", missing.first.c_str());
+      fprintf(stderr, "Checking %.*s\n",
+              static_cast<int>(missing.first.size()), missing.first.data());
     }
     if (HasDefaultMethods(missing.first)) {
       if (fail_on_error_) {
         diag_errx(
             2,
-            "%s needed on the classpath for desugaring %s.  Please add"
+            "%.*s needed on the classpath for desugaring %.*s.  Please add"
             " the missing dependency to the target containing the latter.",
-            missing.first.c_str(), missing.second.c_str());
+            static_cast<int>(missing.first.size()), missing.first.data(),
+            static_cast<int>(missing.second.size()), missing.second.data());
       } else {
         error_ = true;
       }
@@ -135,22 +189,65 @@ void *Java8DesugarDepsChecker::OutputEntry(bool compress) {
 }
 
 bool Java8DesugarDepsChecker::HasDefaultMethods(
-    const std::string &interface_name) {
-  auto cached = has_default_methods_.find(interface_name);
-  if (cached != has_default_methods_.end()) {
-    return cached->second;
+    std::string_view interface_name) {
+  if (!resolved_) {
+    ResolveDefaultMethods();
   }
+  auto resolved = has_default_methods_.find(interface_name);
+  return resolved != has_default_methods_.end() && resolved->second;
+}
 
-  // Prime with false in case there's a cycle.  We'll update with the true value
-  // (ignoring the cycle) below.
-  has_default_methods_.emplace(interface_name, false);
+void Java8DesugarDepsChecker::ResolveDefaultMethods() {
+  // Number the interfaces, and for each of them list the interfaces that
+  // extend it.
+  std::unordered_map<std::string_view, uint32_t> ids;
+  std::vector<std::string_view> names;
+  std::vector<std::vector<uint32_t>> subinterfaces;
+  auto id_of = [&](std::string_view name) {
+    auto inserted = ids.emplace(name, static_cast<uint32_t>(names.size()));
+    if (inserted.second) {
+      names.push_back(name);
+      subinterfaces.emplace_back();
+    }
+    return inserted.first->second;
+  };
+  for (const auto &extends : extended_interfaces_) {
+    const uint32_t id = id_of(extends.first);
+    for (std::string_view extended : extends.second) {
+      subinterfaces[id_of(extended)].push_back(id);
+    }
+  }
 
-  for (const std::string &extended : extended_interfaces_[interface_name]) {
-    if (HasDefaultMethods(extended)) {
-      has_default_methods_[interface_name] = true;
-      return true;
+  // An interface has default methods if it defines some, or if it extends an
+  // interface that has some.  Walk down from the ones that define them.
+  // Unlike a recursive walk up from each interface, this visits every
+  // interface once, however deep the hierarchy is and whatever cycles it has.
+  std::vector<bool> has_default_methods(names.size(), false);
+  std::vector<uint32_t> to_visit;
+  for (const auto &known : has_default_methods_) {
+    auto id = ids.find(known.first);
+    if (known.second && id != ids.end()) {
+      has_default_methods[id->second] = true;
+      to_visit.push_back(id->second);
+    }
+  }
+  while (!to_visit.empty()) {
+    const uint32_t id = to_visit.back();
+    to_visit.pop_back();
+    for (uint32_t subinterface : subinterfaces[id]) {
+      if (!has_default_methods[subinterface]) {
+        has_default_methods[subinterface] = true;
+        to_visit.push_back(subinterface);
+      }
     }
   }
-  has_default_methods_[interface_name] = false;
-  return false;
+
+  for (uint32_t id = 0; id < names.size(); ++id) {
+    has_default_methods_[names[id]] = has_default_methods[id];
+  }
+  resolved_ = true;
+}
+
+std::string_view Java8DesugarDepsChecker::Intern(const std::string &name) {
+  return *names_.insert(name).first;
 }
@@ -18,7 +18,9 @@
 #include <functional>
 #include <map>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "src/tools/singlejar/combiners.h"
@@ -54,10 +56,19 @@ class Java8DesugarDepsChecker : public Combiner {
         verbose_(verbose),
         fail_on_error_(fail_on_error),
         error_(false) {}
-  /// Computes and caches whether the given interface has default methods.
+  /// Returns whether the given interface has default methods.
   /// \param interface_name interface name as it would appear in bytecode, e.g.,
   ///        "java/lang/Runnable"
-  bool HasDefaultMethods(const std::string &interface_name);
+  bool HasDefaultMethods(std::string_view interface_name);
+
+  /// Derives for every interface in extended_interfaces_ whether it defines
+  /// or inherits default methods, and records the answers in
+  /// has_default_methods_.
+  void ResolveDefaultMethods();
+
+  /// Returns a view of the copy of the given name kept by this checker, so
+  /// that a name that many of the merged files mention is only stored once.
+  std::string_view Intern(const std::string &name);
 
   const std::function<bool (const std::string&)> known_member_;
   const bool verbose_;
@@ -65,18 +76,25 @@ class Java8DesugarDepsChecker : public Combiner {
 
   std::unique_ptr<TransientBytes> buffer_;
   std::unique_ptr<Inflater> inflater_;
+  /// The names that the maps below refer to.  The elements of an unordered set
+  /// stay where they are when it grows, and so do the views of them.
+  std::unordered_set<std::string> names_;
+  /// Scratch space for the names of the needed .class files.
+  std::string class_file_;
   /// Reverse mapping from needed dependencies to one of the users.
-  std::map<std::string, std::string> needed_deps_;
+  std::map<std::string_view, std::string_view> needed_deps_;
   /// Reverse mapping from missing interfaces to one of the classes that missed
   /// them.
-  std::map<std::string, std::string> missing_interfaces_;
-  std::unordered_map<std::string, std::vector<std::string> >
+  std::map<std::string_view, std::string_view> missing_interfaces_;
+  std::unordered_map<std::string_view, std::vector<std::string_view> >
       extended_interfaces_;
   /// Cache of interfaces known to definitely define or inherit default methods
   /// or definitely not define and not inherit default methods.  Merge()
-  /// populates initial entries and HasDefaultMethods() adds to the cache as
-  /// needed.
-  std::unordered_map<std::string, bool> has_default_methods_;
+  /// populates initial entries and ResolveDefaultMethods() adds the others.
+  std::unordered_map<std::string_view, bool> has_default_methods_;
+  /// Whether has_default_methods_ has the entries of ResolveDefaultMethods()
+  /// for everything merged so far.
+  bool resolved_ = false;
   bool error_;
 
   friend class Java8DesugarDepsCheckerTest;
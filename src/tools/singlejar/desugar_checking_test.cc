@@ -83,6 +83,34 @@ class Java8DesugarDepsCheckerTest : public ::testing::Test {
     EXPECT_EQ(nullptr, checker.OutputEntry(/*compress=*/true));
     EXPECT_TRUE(checker.error_);
   }
+
+  static void TestDefaultMethodsThroughCycle() {
+    Java8DesugarDepsChecker checker([](const std::string &) { return true; },
+                                    /*verbose=*/false);
+    checker.has_default_methods_["a"] = true;
+    checker.extended_interfaces_["x"] = {"y"};
+    checker.extended_interfaces_["y"] = {"x", "a"};
+
+    // The answer doesn't depend on where in the cycle we start.
+    EXPECT_TRUE(checker.HasDefaultMethods("y"));
+    EXPECT_TRUE(checker.HasDefaultMethods("x"));
+  }
+
+  static void TestDeepHierarchy() {
+    Java8DesugarDepsChecker checker([](const std::string &) { return true; },
+                                    /*verbose=*/false);
+    // i0 extends i1 extends ... extends i99999, which has default methods.
+    const int kDepth = 100000;
+    std::string_view previous = checker.Intern("i0");
+    for (int i = 1; i < kDepth; ++i) {
+      std::string_view current = checker.Intern("i" + std::to_string(i));
+      checker.extended_interfaces_[previous] = {current};
+      previous = current;
+    }
+    checker.has_default_methods_[previous] = true;
+    EXPECT_TRUE(checker.HasDefaultMethods("i0"));
+    EXPECT_TRUE(checker.HasDefaultMethods("i5000"));
+  }
 };
 
 TEST_F(Java8DesugarDepsCheckerTest, HasDefaultMethods) {
@@ -100,3 +128,11 @@ TEST_F(Java8DesugarDepsCheckerTest, NeededDepMissing) {
 TEST_F(Java8DesugarDepsCheckerTest, MissingDefaultMethods) {
   TestMissedDefaultMethods();
 }
+
+TEST_F(Java8DesugarDepsCheckerTest, DefaultMethodsThroughCycle) {
+  TestDefaultMethodsThroughCycle();
+}
+
+TEST_F(Java8DesugarDepsCheckerTest, DeepHierarchy) {
+  TestDeepHierarchy();
+}
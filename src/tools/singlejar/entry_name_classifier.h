@@ -0,0 +1,133 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_ENTRY_NAME_CLASSIFIER_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_ENTRY_NAME_CLASSIFIER_H_ 1
+
+#include <cinttypes>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*
+ * Matches an entry name against a set of prefixes and suffixes at once.
+ * Each pattern is registered with a set of flag bits, and Classify() returns
+ * the union of the flags of all the patterns the name matches.
+ *
+ * The prefixes are compiled into a trie walked from the first byte of the
+ * name, the suffixes into a trie walked from the last one. The bytes that
+ * do not occur in any pattern share a single class which leads to the dead
+ * state, so the transition tables have a column per distinct pattern byte
+ * rather than 256, and a walk stops at the first byte that cannot extend a
+ * match. Classifying a name thus costs at most the length of the longest
+ * prefix plus that of the longest suffix, however many patterns there are.
+ */
+class EntryNameClassifier {
+ public:
+  EntryNameClassifier() { Compile(); }
+
+  void AddPrefix(std::string_view prefix, uint32_t flags) {
+    prefixes_.patterns.emplace_back(std::string(prefix), flags);
+    Compile();
+  }
+
+  void AddSuffix(std::string_view suffix, uint32_t flags) {
+    suffixes_.patterns.emplace_back(std::string(suffix), flags);
+    Compile();
+  }
+
+  uint32_t Classify(const char *name, size_t length) const {
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(name);
+    uint32_t result = prefixes_.flags[kRoot] | suffixes_.flags[kRoot];
+    uint32_t state = kRoot;
+    for (size_t i = 0; i < length && state != kDead; ++i) {
+      state = prefixes_.next[state * classes_ + byte_class_[p[i]]];
+      result |= prefixes_.flags[state];
+    }
+    state = kRoot;
+    for (size_t i = length; i > 0 && state != kDead; --i) {
+      state = suffixes_.next[state * classes_ + byte_class_[p[i - 1]]];
+      result |= suffixes_.flags[state];
+    }
+    return result;
+  }
+
+  uint32_t Classify(std::string_view name) const {
+    return Classify(name.data(), name.size());
+  }
+
+ private:
+  static constexpr uint32_t kDead = 0;
+  static constexpr uint32_t kRoot = 1;
+
+  struct Trie {
+    std::vector<std::pair<std::string, uint32_t>> patterns;
+    // Row `state` holds the transitions of the state for each byte class.
+    std::vector<uint32_t> next;
+    // The flags of the patterns ending at each state.
+    std::vector<uint32_t> flags;
+  };
+
+  // Rebuilds the tables from the patterns. There are a few dozen patterns
+  // at most, added before any name is classified.
+  void Compile() {
+    for (auto &c : byte_class_) {
+      c = 0;
+    }
+    classes_ = 1;
+    for (const Trie *trie : {&prefixes_, &suffixes_}) {
+      for (auto &pattern : trie->patterns) {
+        for (char ch : pattern.first) {
+          uint16_t &c = byte_class_[static_cast<uint8_t>(ch)];
+          if (c == 0) {
+            c = classes_++;
+          }
+        }
+      }
+    }
+    Build(&prefixes_, false);
+    Build(&suffixes_, true);
+  }
+
+  void Build(Trie *trie, bool reversed) {
+    trie->next.assign(2 * classes_, kDead);
+    trie->flags.assign(2, 0);
+    for (auto &pattern : trie->patterns) {
+      const std::string &s = pattern.first;
+      uint32_t state = kRoot;
+      for (size_t i = 0; i < s.size(); ++i) {
+        uint8_t ch = static_cast<uint8_t>(reversed ? s[s.size() - 1 - i]
+                                                   : s[i]);
+        uint32_t &next = trie->next[state * classes_ + byte_class_[ch]];
+        if (next == kDead) {
+          next = static_cast<uint32_t>(trie->flags.size());
+          trie->flags.push_back(0);
+          trie->next.resize(trie->next.size() + classes_, kDead);
+        }
+        // The resize above may have moved the table.
+        state = trie->next[state * classes_ + byte_class_[ch]];
+      }
+      trie->flags[state] |= pattern.second;
+    }
+  }
+
+  uint16_t byte_class_[256];
+  uint32_t classes_;
+  Trie prefixes_;
+  Trie suffixes_;
+};
+
+#endif  // BAZEL_SRC_TOOLS_SINGLEJAR_ENTRY_NAME_CLASSIFIER_H_
@@ -0,0 +1,110 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/entry_name_classifier.h"
+
+#include <string>
+#include <vector>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+TEST(EntryNameClassifierTest, Empty) {
+  EntryNameClassifier classifier;
+  EXPECT_EQ(0U, classifier.Classify(""));
+  EXPECT_EQ(0U, classifier.Classify("com/google/Foo.class"));
+}
+
+TEST(EntryNameClassifierTest, PrefixesAndSuffixes) {
+  EntryNameClassifier classifier;
+  classifier.AddSuffix(".SF", 1);
+  classifier.AddSuffix(".RSA", 1);
+  classifier.AddSuffix(".class", 2);
+  classifier.AddPrefix("META-INF/services/", 4);
+  classifier.AddPrefix("j$/", 8);
+
+  EXPECT_EQ(1U, classifier.Classify("META-INF/FOO.SF"));
+  EXPECT_EQ(1U, classifier.Classify("META-INF/FOO.RSA"));
+  EXPECT_EQ(0U, classifier.Classify("META-INF/FOO.DSA"));
+  EXPECT_EQ(2U, classifier.Classify("com/google/Foo.class"));
+  EXPECT_EQ(0U, classifier.Classify("com/google/Foo.classes"));
+  EXPECT_EQ(0U, classifier.Classify("class"));
+  EXPECT_EQ(4U, classifier.Classify("META-INF/services/"));
+  EXPECT_EQ(4U, classifier.Classify("META-INF/services/a.b.Service"));
+  EXPECT_EQ(0U, classifier.Classify("META-INF/services"));
+  EXPECT_EQ(10U, classifier.Classify("j$/util/Map.class"));
+  EXPECT_EQ(0U, classifier.Classify("j$"));
+  EXPECT_EQ(0U, classifier.Classify(""));
+
+  // The length bounds the name, which does not have to be terminated.
+  const char name[] = "j$/Foo.classfile";
+  EXPECT_EQ(10U, classifier.Classify(name, 12));
+}
+
+TEST(EntryNameClassifierTest, OverlappingPatterns) {
+  EntryNameClassifier classifier;
+  classifier.AddPrefix("com/", 1);
+  classifier.AddPrefix("com/google/", 2);
+  classifier.AddPrefix("com/google/", 4);
+  classifier.AddSuffix(".jar", 8);
+  classifier.AddSuffix("s.jar", 16);
+
+  EXPECT_EQ(1U, classifier.Classify("com/foo"));
+  EXPECT_EQ(7U, classifier.Classify("com/google/foo"));
+  EXPECT_EQ(1U, classifier.Classify("com/googl"));
+  EXPECT_EQ(9U, classifier.Classify("com/a.jar"));
+  EXPECT_EQ(24U, classifier.Classify("libs.jar"));
+}
+
+TEST(EntryNameClassifierTest, EmptyPatternsMatchEverything) {
+  EntryNameClassifier classifier;
+  classifier.AddPrefix("", 1);
+  classifier.AddSuffix("", 2);
+  classifier.AddSuffix("x", 4);
+  EXPECT_EQ(3U, classifier.Classify(""));
+  EXPECT_EQ(3U, classifier.Classify("abc"));
+  EXPECT_EQ(7U, classifier.Classify("abcx"));
+}
+
+// Checks the classifier against plain prefix and suffix comparisons.
+TEST(EntryNameClassifierTest, ManyPatterns) {
+  std::vector<std::string> prefixes;
+  std::vector<std::string> suffixes;
+  EntryNameClassifier classifier;
+  for (int i = 0; i < 16; ++i) {
+    prefixes.push_back("p" + std::to_string(i * 7) + "/");
+    classifier.AddPrefix(prefixes.back(), 1U << i);
+    suffixes.push_back("." + std::to_string(i * 13));
+    classifier.AddSuffix(suffixes.back(), 1U << (16 + i));
+  }
+  for (int i = 0; i < 200; ++i) {
+    std::string name =
+        "p" + std::to_string(i) + "/x/y." + std::to_string(i * 3 % 200);
+    uint32_t expected = 0;
+    for (int j = 0; j < 16; ++j) {
+      if (name.compare(0, prefixes[j].size(), prefixes[j]) == 0) {
+        expected |= 1U << j;
+      }
+      if (name.size() >= suffixes[j].size() &&
+          name.compare(name.size() - suffixes[j].size(), suffixes[j].size(),
+                       suffixes[j]) == 0) {
+        expected |= 1U << (16 + j);
+      }
+    }
+    EXPECT_EQ(expected, classifier.Classify(name)) << name;
+  }
+}
+
+}  // namespace
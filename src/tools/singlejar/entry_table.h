@@ -0,0 +1,194 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_ENTRY_TABLE_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_ENTRY_TABLE_H_ 1
+
+#include <string.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*
+ * A map from entry names to small values, used by OutputJar to resolve the
+ * entries of a million-entry jar without allocating a node and a string for
+ * each of them. The names are copied into an arena owned by the table, as
+ * the input jars they come from are unmapped once they have been added. The
+ * table is open-addressed with linear probing. Lookups take a string_view,
+ * so a name can be looked up directly in a mapped central directory.
+ *
+ * Value pointers returned by Emplace() and Find() are invalidated by the
+ * next Emplace().
+ */
+template <typename Value>
+class EntryTable {
+ public:
+  EntryTable() : size_(0), used_(0), arena_next_(nullptr), arena_free_(0) {
+    Rehash(kMinCapacity);
+  }
+
+  EntryTable(const EntryTable &) = delete;
+  EntryTable &operator=(const EntryTable &) = delete;
+
+  // Adds the entry unless it is present. Returns the pointer to the value
+  // in the table and whether it has been added.
+  std::pair<Value *, bool> Emplace(std::string_view name, const Value &value) {
+    size_t hash = Hash(name);
+    size_t ix = Probe(name, hash);
+    if (slots_[ix].state == kFull) {
+      return std::make_pair(&slots_[ix].value, false);
+    }
+    if ((used_ + 1) * 4 > slots_.size() * 3) {
+      Rehash(slots_.size() * (size_ * 2 >= slots_.size() ? 2 : 1));
+      ix = Probe(name, hash);
+    }
+    Slot &slot = slots_[ix];
+    if (slot.state == kEmpty) {
+      ++used_;
+    }
+    slot.state = kFull;
+    slot.hash = hash;
+    slot.name = Store(name);
+    slot.value = value;
+    ++size_;
+    return std::make_pair(&slot.value, true);
+  }
+
+  Value *Find(std::string_view name) {
+    size_t ix = Probe(name, Hash(name));
+    return slots_[ix].state == kFull ? &slots_[ix].value : nullptr;
+  }
+
+  bool Contains(std::string_view name) const {
+    return const_cast<EntryTable *>(this)->Find(name) != nullptr;
+  }
+
+  // Removes the entry if it is present. The memory taken by its name is not
+  // reclaimed.
+  bool Erase(std::string_view name) {
+    size_t ix = Probe(name, Hash(name));
+    if (slots_[ix].state != kFull) {
+      return false;
+    }
+    slots_[ix].state = kErased;
+    --size_;
+    return true;
+  }
+
+  size_t size() const { return size_; }
+
+  // Calls fn(name, value) for each entry, in no particular order.
+  template <typename Fn>
+  void ForEach(Fn fn) const {
+    for (const Slot &slot : slots_) {
+      if (slot.state == kFull) {
+        fn(slot.name, slot.value);
+      }
+    }
+  }
+
+ private:
+  enum SlotState : uint8_t { kEmpty, kFull, kErased };
+
+  struct Slot {
+    Slot() : state(kEmpty), hash(0) {}
+    SlotState state;
+    size_t hash;
+    std::string_view name;
+    Value value;
+  };
+
+  static constexpr size_t kMinCapacity = 1024;
+  static constexpr size_t kArenaChunkSize = 256 << 10;
+
+  static size_t Hash(std::string_view name) {
+    return std::hash<std::string_view>()(name);
+  }
+
+  // Returns the index of the slot holding the name, or of the slot where it
+  // should be added (the first erased slot on the way, or an empty one).
+  size_t Probe(std::string_view name, size_t hash) const {
+    const size_t mask = slots_.size() - 1;
+    size_t erased = slots_.size();
+    for (size_t ix = hash & mask;; ix = (ix + 1) & mask) {
+      const Slot &slot = slots_[ix];
+      if (slot.state == kEmpty) {
+        return erased < slots_.size() ? erased : ix;
+      }
+      if (slot.state == kFull) {
+        if (slot.hash == hash && slot.name == name) {
+          return ix;
+        }
+      } else if (erased == slots_.size()) {
+        erased = ix;
+      }
+    }
+  }
+
+  // Rebuilds the slots with the given capacity (a power of 2), dropping the
+  // erased ones.
+  void Rehash(size_t capacity) {
+    std::vector<Slot> old_slots(capacity);
+    old_slots.swap(slots_);
+    const size_t mask = capacity - 1;
+    for (Slot &slot : old_slots) {
+      if (slot.state == kFull) {
+        size_t ix = slot.hash & mask;
+        while (slots_[ix].state != kEmpty) {
+          ix = (ix + 1) & mask;
+        }
+        slots_[ix] = std::move(slot);
+      }
+    }
+    used_ = size_;
+  }
+
+  // Copies the name into the arena. Long names get their own chunks.
+  std::string_view Store(std::string_view name) {
+    if (name.empty()) {
+      return std::string_view();
+    }
+    char *copy;
+    if (name.size() > kArenaChunkSize / 16) {
+      arena_.emplace_back(new char[name.size()]);
+      copy = arena_.back().get();
+    } else {
+      if (name.size() > arena_free_) {
+        arena_.emplace_back(new char[kArenaChunkSize]);
+        arena_next_ = arena_.back().get();
+        arena_free_ = kArenaChunkSize;
+      }
+      copy = arena_next_;
+      arena_next_ += name.size();
+      arena_free_ -= name.size();
+    }
+    memcpy(copy, name.data(), name.size());
+    return std::string_view(copy, name.size());
+  }
+
+  std::vector<Slot> slots_;
+  size_t size_;  // The number of entries.
+  size_t used_;  // The number of full or erased slots.
+  std::vector<std::unique_ptr<char[]> > arena_;
+  char *arena_next_;   // Free space in the current arena chunk.
+  size_t arena_free_;
+};
+
+#endif  // BAZEL_SRC_TOOLS_SINGLEJAR_ENTRY_TABLE_H_
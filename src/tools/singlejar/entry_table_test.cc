@@ -0,0 +1,97 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/entry_table.h"
+
+#include <map>
+#include <string>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+TEST(EntryTableTest, EmplaceAndFind) {
+  EntryTable<int> table;
+  auto got = table.Emplace("META-INF/", 1);
+  EXPECT_TRUE(got.second);
+  EXPECT_EQ(1, *got.first);
+  got = table.Emplace("META-INF/", 2);
+  EXPECT_FALSE(got.second);
+  EXPECT_EQ(1, *got.first);
+  EXPECT_EQ(1UL, table.size());
+
+  // The key does not have to outlive the table.
+  {
+    std::string name("com/google/Foo.class");
+    table.Emplace(name, 3);
+    name[0] = 'x';
+  }
+  ASSERT_NE(nullptr, table.Find("com/google/Foo.class"));
+  EXPECT_EQ(3, *table.Find("com/google/Foo.class"));
+  EXPECT_EQ(nullptr, table.Find("xom/google/Foo.class"));
+  EXPECT_TRUE(table.Contains(std::string_view("META-INF/x", 9)));
+  EXPECT_FALSE(table.Contains("META-INF"));
+}
+
+TEST(EntryTableTest, EmptyName) {
+  EntryTable<int> table;
+  EXPECT_FALSE(table.Contains(""));
+  EXPECT_TRUE(table.Emplace("", 7).second);
+  EXPECT_TRUE(table.Contains(""));
+  EXPECT_EQ(7, *table.Find(""));
+}
+
+TEST(EntryTableTest, Erase) {
+  EntryTable<int> table;
+  table.Emplace("a", 1);
+  table.Emplace("b", 2);
+  EXPECT_TRUE(table.Erase("a"));
+  EXPECT_FALSE(table.Erase("a"));
+  EXPECT_FALSE(table.Contains("a"));
+  EXPECT_TRUE(table.Contains("b"));
+  EXPECT_EQ(1UL, table.size());
+  EXPECT_TRUE(table.Emplace("a", 3).second);
+  EXPECT_EQ(3, *table.Find("a"));
+}
+
+// Grow the table well past its initial capacity, with long names, erasing
+// some of the entries on the way, and compare with std::map.
+TEST(EntryTableTest, Grow) {
+  EntryTable<int> table;
+  std::map<std::string, int> expected;
+  for (int i = 0; i < 200000; ++i) {
+    std::string name = "com/example/package" + std::to_string(i % 97) +
+                       "/Class" + std::to_string(i) + ".class";
+    if (i % 1000 == 0) {
+      name += std::string(20000, 'x');
+    }
+    EXPECT_TRUE(table.Emplace(name, i).second);
+    expected[name] = i;
+    if (i % 3 == 0) {
+      EXPECT_TRUE(table.Erase(name));
+      expected.erase(name);
+    }
+  }
+  EXPECT_EQ(expected.size(), table.size());
+  size_t count = 0;
+  table.ForEach([&expected, &count](std::string_view name, int value) {
+    auto it = expected.find(std::string(name));
+    ASSERT_NE(expected.end(), it);
+    EXPECT_EQ(it->second, value);
+    ++count;
+  });
+  EXPECT_EQ(expected.size(), count);
+}
+
+}  // namespace
@@ -0,0 +1,50 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_FINGERPRINT_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_FINGERPRINT_H_ 1
+
+#include <cinttypes>
+#include <cstddef>
+#include <string>
+
+/*
+ * 64-bit FNV-1a hash. Not cryptographic, only meant to tell whether an input
+ * (an input jar, the set of options) has changed since the previous run, and
+ * to spread the cached files.
+ */
+class Fingerprint {
+ public:
+  Fingerprint() : value_(14695981039346656037ULL) {}
+
+  void Update(const void *data, size_t size) {
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; ++i) {
+      value_ = (value_ ^ p[i]) * 1099511628211ULL;
+    }
+  }
+  void Update(const std::string &s) {
+    Update(s.data(), s.size());
+    // Terminate, so that "ab","c" and "a","bc" differ.
+    Update("", 1);
+  }
+  void Update(uint64_t n) { Update(&n, sizeof(n)); }
+
+  uint64_t value() const { return value_; }
+
+ private:
+  uint64_t value_;
+};
+
+#endif  // BAZEL_SRC_TOOLS_SINGLEJAR_FINGERPRINT_H_
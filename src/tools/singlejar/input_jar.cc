@@ -14,8 +14,11 @@
 
 #include "src/tools/singlejar/input_jar.h"
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <string>
+#include <vector>
 
 #include "src/tools/singlejar/diag.h"
 
@@ -38,7 +41,16 @@ bool InputJar::Open(const std::string &path) {
     mapped_file_.Close();
     return false;
   }
-  return LocateCentralDirectory(path);
+  if (!LocateCentralDirectory(path)) {
+    return false;
+  }
+  // The central directory is read first, as a whole. The entries are then
+  // read in its order, which usually is their order in the file.
+  const off64_t cen_offset = mapped_file_.offset(first_cdh_);
+  mapped_file_.Advise(cen_offset, mapped_file_.size() - cen_offset,
+                      MappedFile::kWillNeed);
+  mapped_file_.Advise(0, cen_offset, MappedFile::kSequential);
+  return true;
 }
 
 bool InputJar::Open(const std::string &path, unsigned char *data,
@@ -162,10 +174,130 @@ bool InputJar::LocateCentralDirectory(const std::string &path) {
       return false;
     }
   }
+  first_cdh_ = cdh_;
   path_ = path;
   return true;
 }
 
+bool InputJar::Entries(std::vector<Entry> *entries) const {
+  CentralDirectoryIndex index;
+  if (!Index(&index)) {
+    return false;
+  }
+  const uint64_t file_size = mapped_file_.size();
+  for (size_t i = 0; i < index.size(); ++i) {
+    // Index() has checked that the local header lies within the file.
+    const uint64_t lh_offset = index.local_header_offset(i);
+    const LH *lh =
+        reinterpret_cast<const LH *>(mapped_file_.address(lh_offset));
+    if (!lh->is() || lh->size() > file_size - lh_offset ||
+        index.compressed_file_size(i) > file_size - lh_offset - lh->size()) {
+      diag_warnx(
+          "%s:%d: %s is corrupt, the entry of the central directory record "
+          "at offset 0x%" PRIx64 " lacks a valid local header or data",
+          __FILE__, __LINE__, path_.c_str(), index.record_offset(i));
+      return false;
+    }
+    const CDH *cdh = reinterpret_cast<const CDH *>(
+        mapped_file_.address(index.record_offset(i)));
+    entries->push_back(Entry{cdh, lh});
+  }
+  return true;
+}
+
+bool InputJar::Index(CentralDirectoryIndex *index) const {
+  if (path_.empty()) {
+    diag_errx(1, "%s:%d: call Open() first!", __FILE__, __LINE__);
+  }
+  index->clear();
+  // The checks are done on offsets, which unlike pointers cannot go past the
+  // mapping. The file is at least sizeof(ECD) bytes long.
+  const uint64_t file_size = mapped_file_.size();
+  uint64_t offset = mapped_file_.offset(first_cdh_);
+  for (;;) {
+    const CDH *cdh = nullptr;
+    if (offset <= file_size - sizeof(uint32_t)) {
+      cdh = reinterpret_cast<const CDH *>(mapped_file_.address(offset));
+      if (!cdh->is()) {
+        return true;
+      }
+    }
+    // The record is followed by at least the signature of the next one.
+    if (cdh == nullptr || offset + sizeof(CDH) > file_size ||
+        offset + cdh->size() + sizeof(uint32_t) > file_size) {
+      diag_warnx(
+          "%s:%d: %s is corrupt, the central directory record at offset "
+          "0x%" PRIx64 " is truncated",
+          __FILE__, __LINE__, path_.c_str(), offset);
+      return false;
+    }
+    uint64_t uncompressed_size, compressed_size, lh_offset;
+    if (!cdh->checked_sizes(&uncompressed_size, &compressed_size,
+                            &lh_offset)) {
+      diag_warnx(
+          "%s:%d: %s is corrupt, the central directory record at offset "
+          "0x%" PRIx64 " lacks a valid Zip64 extra field",
+          __FILE__, __LINE__, path_.c_str(), offset);
+      return false;
+    }
+    lh_offset += preamble_size_;
+    if (lh_offset > file_size - sizeof(LH) ||
+        compressed_size > file_size - sizeof(LH) - lh_offset) {
+      diag_warnx(
+          "%s:%d: %s is corrupt, the entry of the central directory record "
+          "at offset 0x%" PRIx64 " lies outside the file",
+          __FILE__, __LINE__, path_.c_str(), offset);
+      return false;
+    }
+    index->add(offset, cdh, lh_offset, compressed_size, uncompressed_size);
+    offset += cdh->size();
+  }
+}
+
+void InputJar::Prefetch() const {
+  if (path_.empty()) {
+    diag_errx(1, "%s:%d: call Open() first!", __FILE__, __LINE__);
+  }
+  // Have the kernel start reading everything in at once, rather than in the
+  // read ahead windows of the page faults below.
+  mapped_file_.Advise(0, mapped_file_.offset(first_cdh_),
+                      MappedFile::kWillNeed);
+  // Reading a byte in each page is enough to have it faulted in. Adjacent
+  // entries often share a page, so remember the last page we have touched.
+  static constexpr uintptr_t kPageSize = 4096;
+  volatile uint8_t sink = 0;
+  uintptr_t last_page = 0;
+  for (const CDH *cdh = cdh_; cdh->is();) {
+    const uint8_t *next_cdh = ziph::byte_ptr(cdh) + cdh->size();
+    if (!mapped_file_.mapped(next_cdh)) {
+      // Corrupt directory, NextEntry() will report it.
+      break;
+    }
+    const uint8_t *from = ziph::byte_ptr(LocalHeader(cdh));
+    if (mapped_file_.mapped(from)) {
+      // The local header's extra fields may differ from the central
+      // directory's ones, so this is an estimate of the entry's extent.
+      const uint8_t *to = std::min(
+          from + sizeof(LH) + cdh->file_name_length() +
+              cdh->extra_fields_length() + cdh->compressed_file_size(),
+          mapped_file_.end());
+      uintptr_t page = reinterpret_cast<uintptr_t>(from) & ~(kPageSize - 1);
+      for (; page < reinterpret_cast<uintptr_t>(to); page += kPageSize) {
+        if (page != last_page) {
+          sink = *std::max(from, reinterpret_cast<const uint8_t *>(page));
+          last_page = page;
+        }
+      }
+    }
+    cdh = reinterpret_cast<const CDH *>(next_cdh);
+  }
+  (void)sink;
+}
+
+void InputJar::DropPages() const {
+  mapped_file_.Advise(0, mapped_file_.size(), MappedFile::kDone);
+}
+
 bool InputJar::Close() {
   mapped_file_.Close();
   path_.clear();
@@ -25,6 +25,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <string>
+#include <vector>
 
 #include "src/tools/singlejar/diag.h"
 #include "src/tools/singlejar/mapped_file.h"
@@ -40,6 +41,8 @@
  *     // process entry.
  *   }
  *   input_jar.Close(); // actually, called by destructor, too.
+ * Alternatively, Entries() returns all the entries at once, to be processed
+ * in any order or on several threads.
  */
 class InputJar {
  public:
@@ -48,7 +51,8 @@ class InputJar {
   ~InputJar() { Close(); }
 
 #ifndef _WIN32
-  // Not used on Windows, only in Google's own code. Don't add more usage of it.
+  // Not used on Windows. OutputJar uses it to have the kernel copy large
+  // entries. Returns -1 for a jar opened from memory.
   int fd() const { return mapped_file_.fd(); }
 #endif
 
@@ -83,9 +87,45 @@ class InputJar {
     return current_cdh;
   }
 
+  // A Central Directory Header with its Local Header.
+  struct Entry {
+    const CDH *cdh;
+    const LH *lh;
+  };
+
+  // Appends all the entries to the given vector, in the central directory
+  // order, having checked that their headers and data lie within the file.
+  // Returns false, with a warning, if they do not. Unlike NextEntry(), does
+  // not exit on a corrupt directory and does not move the NextEntry()
+  // cursor. The entries stay valid until Close(), and being read-only, they
+  // may be processed by several threads at once.
+  bool Entries(std::vector<Entry> *entries) const;
+
+  // Fills the index with the records of the central directory, in its
+  // order, having checked that each lies within the file, that the Zip64
+  // extra field has the values that do not fit in the record, and that the
+  // entry the record points at fits in the file. Returns false, with a
+  // warning, at the first record that fails the checks. Reads the central
+  // directory alone; the local header offsets in the index include the
+  // preamble.
+  bool Index(CentralDirectoryIndex *index) const;
+
+  // Makes NextEntry() start over from the first entry.
+  void Rewind() { cdh_ = first_cdh_; }
+
   // Closes the file.
   bool Close();
 
+  // Touches the local header and the data of every entry that has not been
+  // returned by NextEntry() yet, so that the pages backing them are read in.
+  // Does not move the NextEntry() cursor. This is intended to be called on a
+  // background thread to warm up the jar before it is processed.
+  void Prefetch() const;
+
+  // Tells the kernel that the jar is not going to be read again, so that the
+  // pages of its file can be dropped from the page cache.
+  void DropPages() const;
+
   uint64_t CentralDirectoryRecordOffset(const void *cdr) const {
     return mapped_file_.offset(cdr);
   }
@@ -103,12 +143,15 @@ class InputJar {
     return mapped_file_.address(0);
   }
 
+  size_t size() const { return mapped_file_.size(); }
+
  private:
   bool LocateCentralDirectory(const std::string &path);
 
   std::string path_;
   MappedFile mapped_file_;
   const CDH *cdh_;  // current directory entry
+  const CDH *first_cdh_;
   uint64_t preamble_size_;  // Bytes before the Zip proper.
 };
 
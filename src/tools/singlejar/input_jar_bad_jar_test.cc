@@ -12,7 +12,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <string.h>
+
 #include <string>
+#include <vector>
 
 #include "src/tools/singlejar/input_jar.h"
 #include "src/tools/singlejar/test_util.h"
@@ -34,3 +37,65 @@ TEST(InputJarBadJarTest, EmptyFile) {
   InputJar input_jar;
   ASSERT_FALSE(input_jar.Open(out_path));
 }
+
+// Check that Entries() reports an entry whose local header is not in the
+// file rather than return it.
+TEST(InputJarBadJarTest, LocalHeaderOutsideTheFile) {
+  // A central directory with a single record and no entries before it.
+  alignas(8) unsigned char data[sizeof(CDH) + sizeof(ECD)];
+  memset(data, 0, sizeof(data));
+  CDH *cdh = reinterpret_cast<CDH *>(data);
+  cdh->signature();
+  cdh->local_header_offset32(1000);
+  ECD *ecd = reinterpret_cast<ECD *>(data + sizeof(CDH));
+  ecd->signature();
+  ecd->this_disk_entries16(1);
+  ecd->total_entries16(1);
+  ecd->cen_size32(sizeof(CDH));
+  ecd->cen_offset32(0);
+  InputJar input_jar;
+  ASSERT_TRUE(input_jar.Open(kJar, data, sizeof(data)));
+  std::vector<InputJar::Entry> entries;
+  EXPECT_FALSE(input_jar.Entries(&entries));
+  EXPECT_TRUE(entries.empty());
+}
+
+// Check that Index() reports a record whose Zip64 extra field lacks a
+// value that the record has 0xFFFFFFFF for.
+TEST(InputJarBadJarTest, ShortZip64ExtraField) {
+  const uint16_t extra_size = Zip64ExtraField::space_needed(1);
+  alignas(8) unsigned char
+      data[sizeof(LH) + sizeof(CDH) + extra_size + sizeof(ECD)];
+  memset(data, 0, sizeof(data));
+  LH *lh = reinterpret_cast<LH *>(data);
+  lh->signature();
+  CDH *cdh = reinterpret_cast<CDH *>(data + sizeof(LH));
+  cdh->signature();
+  cdh->uncompressed_file_size32(0xFFFFFFFF);
+  cdh->compressed_file_size32(0xFFFFFFFF);
+  Zip64ExtraField *z64 =
+      reinterpret_cast<Zip64ExtraField *>(cdh->extra_fields());
+  z64->signature();
+  z64->attr_count(1);
+  z64->attr64(0, 0);
+  cdh->extra_fields(cdh->extra_fields(), extra_size);
+  ECD *ecd = reinterpret_cast<ECD *>(cdh->extra_fields() + extra_size);
+  ecd->signature();
+  ecd->this_disk_entries16(1);
+  ecd->total_entries16(1);
+  ecd->cen_size32(sizeof(CDH) + extra_size);
+  ecd->cen_offset32(sizeof(LH));
+  InputJar input_jar;
+  ASSERT_TRUE(input_jar.Open(kJar, data, sizeof(data)));
+  CentralDirectoryIndex index;
+  EXPECT_FALSE(input_jar.Index(&index));
+  EXPECT_EQ(0u, index.size());
+
+  // With the compressed size in the record, the extra field has it all.
+  cdh->compressed_file_size32(0);
+  ASSERT_TRUE(input_jar.Index(&index));
+  ASSERT_EQ(1u, index.size());
+  EXPECT_EQ(sizeof(LH), index.record_offset(0));
+  EXPECT_EQ(0u, index.uncompressed_file_size(0));
+  EXPECT_EQ(0u, index.local_header_offset(0));
+}
@@ -0,0 +1,65 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/input_jar_cache.h"
+
+#include <iterator>
+#include <memory>
+#include <string>
+#include <utility>
+
+std::string InputJarCache::Digest(const std::string &path) const {
+  auto it = digests_.find(path);
+  return it == digests_.end() ? std::string() : it->second;
+}
+
+void InputJarCache::Erase(Entries::iterator it) {
+  bytes_ -= it->input_jar->size();
+  index_.erase(it->path);
+  entries_.erase(it);
+}
+
+std::shared_ptr<InputJar> InputJarCache::Get(const std::string &path) {
+  auto it = index_.find(path);
+  if (it == index_.end()) {
+    return nullptr;
+  }
+  std::string digest = Digest(path);
+  if (digest.empty() || digest != it->second->digest) {
+    Erase(it->second);
+    return nullptr;
+  }
+  entries_.splice(entries_.begin(), entries_, it->second);
+  std::shared_ptr<InputJar> input_jar = it->second->input_jar;
+  input_jar->Rewind();
+  return input_jar;
+}
+
+void InputJarCache::Put(const std::string &path,
+                        std::shared_ptr<InputJar> input_jar) {
+  std::string digest = Digest(path);
+  if (digest.empty() || input_jar->size() > max_bytes_) {
+    return;
+  }
+  auto it = index_.find(path);
+  if (it != index_.end()) {
+    Erase(it->second);
+  }
+  bytes_ += input_jar->size();
+  entries_.push_front(Entry{path, std::move(digest), std::move(input_jar)});
+  index_[path] = entries_.begin();
+  while (entries_.size() > max_jars_ || bytes_ > max_bytes_) {
+    Erase(std::prev(entries_.end()));
+  }
+}
@@ -0,0 +1,80 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_INPUT_JAR_CACHE_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_INPUT_JAR_CACHE_H_ 1
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "src/tools/singlejar/input_jar.h"
+
+/*
+ * The input jars a persistent worker keeps open between requests. The
+ * deploy jars of a project share most of their inputs, and a jar found here
+ * is neither opened, mapped and paged in, nor its Central Directory located
+ * again.
+ *
+ * A jar is kept by its path along with the digest of its contents as sent
+ * by Bazel with the request, so a jar that has changed is a miss (and is
+ * closed). Jars without a digest are not kept. The least recently used jars
+ * are closed once there are more than `max_jars` of them, or their total
+ * size exceeds `max_bytes`; a jar still used by an OutputJar stays open
+ * until it is done with it.
+ */
+class InputJarCache {
+ public:
+  InputJarCache(size_t max_jars, size_t max_bytes)
+      : max_jars_(max_jars), max_bytes_(max_bytes), bytes_(0) {}
+
+  // Sets the digests of the inputs of the current request, by path.
+  void SetDigests(std::unordered_map<std::string, std::string> digests) {
+    digests_ = std::move(digests);
+  }
+
+  // Returns the jar at the path if it is cached with the digest it has in
+  // the current request, or nullptr.
+  std::shared_ptr<InputJar> Get(const std::string &path);
+
+  // Keeps the jar, opened from the path, if it has a digest in the current
+  // request.
+  void Put(const std::string &path, std::shared_ptr<InputJar> input_jar);
+
+ private:
+  struct Entry {
+    std::string path;
+    std::string digest;
+    std::shared_ptr<InputJar> input_jar;
+  };
+  typedef std::list<Entry> Entries;
+
+  // Returns the digest of the jar at the path, or the empty string if it has
+  // none.
+  std::string Digest(const std::string &path) const;
+
+  void Erase(Entries::iterator it);
+
+  const size_t max_jars_;
+  const size_t max_bytes_;
+  size_t bytes_;
+  std::unordered_map<std::string, std::string> digests_;
+  Entries entries_;  // Most recently used first.
+  std::unordered_map<std::string, Entries::iterator> index_;  // By path.
+};
+
+#endif  // BAZEL_SRC_TOOLS_SINGLEJAR_INPUT_JAR_CACHE_H_
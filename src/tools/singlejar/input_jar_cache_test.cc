@@ -0,0 +1,103 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/input_jar_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <memory>
+#include <string>
+
+#include "src/tools/singlejar/input_jar.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+// Writes an empty zip file, which is just an End of Central Directory
+// record, and returns its path.
+std::string WriteEmptyJar(const std::string &name) {
+  static const char kEmptyZip[22] = {'P', 'K', 5, 6};
+  const char *tmpdir = getenv("TEST_TMPDIR");
+  std::string path = std::string(tmpdir ? tmpdir : "/tmp") + "/" + name;
+  FILE *out = fopen(path.c_str(), "wb");
+  EXPECT_NE(nullptr, out);
+  EXPECT_EQ(sizeof(kEmptyZip), fwrite(kEmptyZip, 1, sizeof(kEmptyZip), out));
+  fclose(out);
+  return path;
+}
+
+std::shared_ptr<InputJar> OpenJar(const std::string &path) {
+  auto input_jar = std::make_shared<InputJar>();
+  EXPECT_TRUE(input_jar->Open(path));
+  return input_jar;
+}
+
+TEST(InputJarCacheTest, KeepsJarsWithTheSameDigest) {
+  std::string a = WriteEmptyJar("a.jar");
+  InputJarCache cache(10, 1 << 20);
+  cache.SetDigests({{a, "digest1"}});
+  EXPECT_EQ(nullptr, cache.Get(a));
+  std::shared_ptr<InputJar> jar = OpenJar(a);
+  cache.Put(a, jar);
+  EXPECT_EQ(jar, cache.Get(a));
+
+  // The next request has the same jar.
+  cache.SetDigests({{a, "digest1"}});
+  EXPECT_EQ(jar, cache.Get(a));
+
+  // A jar that has changed is a miss, and is dropped.
+  cache.SetDigests({{a, "digest2"}});
+  EXPECT_EQ(nullptr, cache.Get(a));
+  cache.SetDigests({{a, "digest1"}});
+  EXPECT_EQ(nullptr, cache.Get(a));
+}
+
+TEST(InputJarCacheTest, DoesNotKeepJarsWithoutDigest) {
+  std::string a = WriteEmptyJar("a.jar");
+  std::string b = WriteEmptyJar("b.jar");
+  InputJarCache cache(10, 1 << 20);
+  cache.SetDigests({{b, ""}});
+  cache.Put(a, OpenJar(a));
+  cache.Put(b, OpenJar(b));
+  EXPECT_EQ(nullptr, cache.Get(a));
+  EXPECT_EQ(nullptr, cache.Get(b));
+}
+
+TEST(InputJarCacheTest, DropsLeastRecentlyUsedJars) {
+  std::string a = WriteEmptyJar("a.jar");
+  std::string b = WriteEmptyJar("b.jar");
+  std::string c = WriteEmptyJar("c.jar");
+  InputJarCache cache(2, 1 << 20);
+  cache.SetDigests({{a, "a"}, {b, "b"}, {c, "c"}});
+  cache.Put(a, OpenJar(a));
+  cache.Put(b, OpenJar(b));
+  EXPECT_NE(nullptr, cache.Get(a));
+  cache.Put(c, OpenJar(c));
+  EXPECT_NE(nullptr, cache.Get(a));
+  EXPECT_EQ(nullptr, cache.Get(b));
+  EXPECT_NE(nullptr, cache.Get(c));
+
+  // The size limit, with one jar less.
+  InputJarCache small_cache(10, 2 * 22);
+  small_cache.SetDigests({{a, "a"}, {b, "b"}, {c, "c"}});
+  small_cache.Put(a, OpenJar(a));
+  small_cache.Put(b, OpenJar(b));
+  small_cache.Put(c, OpenJar(c));
+  EXPECT_EQ(nullptr, small_cache.Get(a));
+  EXPECT_NE(nullptr, small_cache.Get(b));
+  EXPECT_NE(nullptr, small_cache.Get(c));
+}
+
+}  // namespace
@@ -0,0 +1,91 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/input_jar_prefetcher.h"
+
+#include "src/tools/singlejar/diag.h"
+
+InputJarPrefetcher::InputJarPrefetcher(
+    const std::vector<std::pair<std::string, std::string> > &input_jars,
+    int jobs)
+    : input_jars_(input_jars),
+      window_(2 * static_cast<size_t>(jobs)),
+      slots_(input_jars.size()),
+      next_to_open_(0),
+      next_to_take_(0),
+      shutdown_(false) {
+  if (jobs < 1) {
+    diag_errx(1, "%s:%d: the number of jobs should be positive, got %d",
+              __FILE__, __LINE__, jobs);
+  }
+  for (int i = 0; i < jobs; ++i) {
+    workers_.emplace_back(&InputJarPrefetcher::Worker, this);
+  }
+}
+
+InputJarPrefetcher::~InputJarPrefetcher() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  taken_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+std::unique_ptr<InputJar> InputJarPrefetcher::Take(size_t index) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (index != next_to_take_ || index >= slots_.size()) {
+    diag_errx(1, "%s:%d: expected to take input jar #%zu, got #%zu", __FILE__,
+              __LINE__, next_to_take_, index);
+  }
+  opened_.wait(lock, [this, index] { return slots_[index].done; });
+  ++next_to_take_;
+  std::unique_ptr<InputJar> input_jar = std::move(slots_[index].input_jar);
+  lock.unlock();
+  taken_.notify_all();
+  return input_jar;
+}
+
+void InputJarPrefetcher::Worker() {
+  for (;;) {
+    size_t index;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      taken_.wait(lock, [this] {
+        return shutdown_ || next_to_open_ >= slots_.size() ||
+               next_to_open_ < next_to_take_ + window_;
+      });
+      if (shutdown_ || next_to_open_ >= slots_.size()) {
+        return;
+      }
+      index = next_to_open_++;
+    }
+
+    std::unique_ptr<InputJar> input_jar(new InputJar);
+    if (input_jar->Open(input_jars_[index].first)) {
+      input_jar->Prefetch();
+    } else {
+      input_jar.reset();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      slots_[index].input_jar = std::move(input_jar);
+      slots_[index].done = true;
+    }
+    opened_.notify_all();
+  }
+}
@@ -0,0 +1,79 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_INPUT_JAR_PREFETCHER_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_INPUT_JAR_PREFETCHER_H_ 1
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "src/tools/singlejar/input_jar.h"
+
+/*
+ * Opens, validates and pages in input jars on a pool of worker threads, ahead
+ * of a single consumer which takes them strictly in order. The usage is:
+ *   InputJarPrefetcher prefetcher(jar_paths, jobs);
+ *   for (size_t ix = 0; ix < jar_paths.size(); ++ix) {
+ *     std::unique_ptr<InputJar> input_jar = prefetcher.Take(ix);
+ *     if (!input_jar) { fail... }
+ *     // process input_jar entries
+ *   }
+ * At most 2 * `jobs` jars are kept open ahead of the consumer, so that the
+ * number of open files and the mapped address space stay bounded.
+ */
+class InputJarPrefetcher {
+ public:
+  // The input jars are the (path, label) pairs as they are held by Options.
+  // The vector has to outlive this instance.
+  InputJarPrefetcher(
+      const std::vector<std::pair<std::string, std::string> > &input_jars,
+      int jobs);
+
+  ~InputJarPrefetcher();
+
+  // Returns the input jar with the given index, waiting for the workers to
+  // open it if necessary, or nullptr if the jar could not be opened. Has to be
+  // called with indices 0, 1, 2,... in this order.
+  std::unique_ptr<InputJar> Take(size_t index);
+
+ private:
+  void Worker();
+
+  struct Slot {
+    Slot() : done(false) {}
+    bool done;
+    std::unique_ptr<InputJar> input_jar;
+  };
+
+  const std::vector<std::pair<std::string, std::string> > &input_jars_;
+  const size_t window_;
+  std::vector<Slot> slots_;
+  std::mutex mutex_;
+  // Signaled by the workers when a jar has been opened.
+  std::condition_variable opened_;
+  // Signaled by the consumer when it has taken a jar.
+  std::condition_variable taken_;
+  size_t next_to_open_;
+  size_t next_to_take_;
+  bool shutdown_;
+  std::vector<std::thread> workers_;
+};
+
+#endif  //  BAZEL_SRC_TOOLS_SINGLEJAR_INPUT_JAR_PREFETCHER_H_
@@ -21,6 +21,7 @@
 #endif
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "src/tools/singlejar/input_jar.h"
 #include "src/tools/singlejar/mapped_file.h"
@@ -177,6 +178,64 @@ TYPED_TEST_P(InputJarScanEntries, Basic) {
                             << kRes2 << "' file.";
 }
 
+/*
+ * Check that Entries() returns the entries NextEntry() does, in its order.
+ */
+TYPED_TEST_P(InputJarScanEntries, Entries) {
+  ASSERT_EQ(0, chdir(getenv("TEST_TMPDIR")));
+  this->CreateBasicJar();
+  ASSERT_TRUE(this->input_jar_->Open(kJar));
+  std::vector<InputJar::Entry> entries;
+  ASSERT_TRUE(this->input_jar_->Entries(&entries));
+  const LH *lh;
+  const CDH *cdh;
+  size_t entry_count = 0;
+  while ((cdh = this->input_jar_->NextEntry(&lh))) {
+    ASSERT_LT(entry_count, entries.size());
+    EXPECT_EQ(cdh, entries[entry_count].cdh);
+    EXPECT_EQ(lh, entries[entry_count].lh);
+    ++entry_count;
+  }
+  EXPECT_EQ(entries.size(), entry_count);
+  this->input_jar_->Close();
+  unlink(kJar);
+}
+
+/*
+ * Check that Index() has the values of the entries NextEntry() returns, in
+ * its order.
+ */
+TYPED_TEST_P(InputJarScanEntries, Index) {
+  ASSERT_EQ(0, chdir(getenv("TEST_TMPDIR")));
+  this->CreateBasicJar();
+  ASSERT_TRUE(this->input_jar_->Open(kJar));
+  CentralDirectoryIndex index;
+  ASSERT_TRUE(this->input_jar_->Index(&index));
+  const LH *lh;
+  const CDH *cdh;
+  size_t i = 0;
+  while ((cdh = this->input_jar_->NextEntry(&lh))) {
+    ASSERT_LT(i, index.size());
+    EXPECT_EQ(this->input_jar_->CentralDirectoryRecordOffset(cdh),
+              index.record_offset(i));
+    EXPECT_EQ(cdh->file_name_string(),
+              std::string(reinterpret_cast<const char *>(
+                              this->input_jar_->mapped_start() +
+                              index.file_name_offset(i)),
+                          index.file_name_length(i)));
+    EXPECT_EQ(this->input_jar_->LocalHeaderOffset(lh),
+              index.local_header_offset(i));
+    EXPECT_EQ(cdh->compressed_file_size(), index.compressed_file_size(i));
+    EXPECT_EQ(cdh->uncompressed_file_size(), index.uncompressed_file_size(i));
+    EXPECT_EQ(cdh->crc32(), index.crc32(i));
+    EXPECT_EQ(cdh->compression_method(), index.compression_method(i));
+    ++i;
+  }
+  EXPECT_EQ(index.size(), i);
+  this->input_jar_->Close();
+  unlink(kJar);
+}
+
 /*
  * Check we can handle >4GB jar with >4GB entry in it.
  */
@@ -234,6 +293,17 @@ TYPED_TEST_P(InputJarScanEntries, TestZip64) {
       EXPECT_LT(kHugeOffset, cdh->local_header_offset());
     }
   }
+  // The index has the values of the Zip64 extra fields.
+  CentralDirectoryIndex index;
+  ASSERT_TRUE(this->input_jar_->Index(&index));
+  this->input_jar_->Rewind();
+  for (size_t i = 0; (cdh = this->input_jar_->NextEntry(&lh)); ++i) {
+    ASSERT_LT(i, index.size());
+    EXPECT_EQ(cdh->uncompressed_file_size(), index.uncompressed_file_size(i));
+    EXPECT_EQ(cdh->compressed_file_size(), index.compressed_file_size(i));
+    EXPECT_EQ(this->input_jar_->LocalHeaderOffset(lh),
+              index.local_header_offset(i));
+  }
   this->input_jar_->Close();
   unlink(kJar);
 }
@@ -310,8 +380,8 @@ TYPED_TEST_P(InputJarScanEntries, BasicInMemory) {
       << "Jar file " << kJar << " lacks expected '" << kRes2 << "' file.";
 }
 
-REGISTER_TYPED_TEST_SUITE_P(InputJarScanEntries, OpenClose, Basic,
-                            HugeUncompressed, TestZip64, LotsOfEntries,
+REGISTER_TYPED_TEST_SUITE_P(InputJarScanEntries, OpenClose, Basic, Entries,
+                            Index, HugeUncompressed, TestZip64, LotsOfEntries,
                             BasicInMemory);
 
 #endif  // BAZEL_SRC_TOOLS_SINGLEJAR_INPUT_JAR_SCAN_ENTRIES_TEST_H_
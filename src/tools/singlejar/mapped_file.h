@@ -45,6 +45,17 @@ class MappedFile {
 
   void Close();
 
+  // How a range of the file is going to be read.
+  enum Access {
+    kWillNeed,    // Soon: the reading in can start now, in the background.
+    kSequential,  // Once, in order: aggressive read ahead pays off.
+    kDone,        // Not again: the pages may be dropped from the page cache.
+  };
+
+  // Passes a hint on the access to the given range to the kernel. Does
+  // nothing for the memory handed to MapExisting() and on Windows.
+  void Advise(off64_t offset, size_t length, Access access) const;
+
   bool mapped(const void *addr) const {
     return mapped_start_ <= addr && addr < mapped_end_;
   }
@@ -14,6 +14,9 @@
 
 #include "src/tools/singlejar/options.h"
 
+#include <stdint.h>
+#include <stdlib.h>
+
 #include "src/tools/singlejar/diag.h"
 
 void Options::ParseCommandLine(int argc, const char *const argv[]) {
@@ -23,7 +26,8 @@ void Options::ParseCommandLine(int argc, const char *const argv[]) {
     if (ParseToken(&tokens)) {
       continue;
     } else {
-      diag_errx(1, "Bad command line argument %s", tokens.token().c_str());
+      diag_errx(1, "Bad command line argument %s",
+                std::string(tokens.token()).c_str());
     }
   }
 
@@ -57,9 +61,22 @@ bool Options::ParseToken(ArgTokenStream *tokens) {
       tokens->MatchAndSet("--nocompress_suffixes", &nocompress_suffixes) ||
       tokens->MatchAndSet("--check_desugar_deps", &check_desugar_deps) ||
       tokens->MatchAndSet("--multi_release", &multi_release) ||
+      tokens->MatchAndSet("--share_identical_data", &share_identical_data) ||
+      tokens->MatchAndSet("--drop_input_pages", &drop_input_pages) ||
       tokens->MatchAndSet("--hermetic_java_home", &hermetic_java_home) ||
       tokens->MatchAndSet("--add_exports", &add_exports) ||
       tokens->MatchAndSet("--add_opens", &add_opens) ||
+      tokens->MatchAndSet("--incremental_index", &incremental_index) ||
+      tokens->MatchAndSet("--incremental_append", &incremental_append) ||
+      tokens->MatchAndSet("--combiner_cache", &combiner_cache) ||
+      tokens->MatchAndSet("--stats_file", &stats_file) ||
+      tokens->MatchAndSet("--output_digest_attribute",
+                          &output_digest_attribute) ||
+      tokens->MatchAndSet("--enforce_one_version", &enforce_one_version) ||
+      tokens->MatchAndSet("--one_version_allowlist",
+                          &one_version_allowlist) ||
+      tokens->MatchAndSet("--succeed_on_found_violations",
+                          &succeed_on_found_violations) ||
       tokens->MatchAndSet("--output_jar_creator", &output_jar_creator)) {
     return true;
   } else if (tokens->MatchAndSet("--build_info_file", &optarg)) {
@@ -68,6 +85,26 @@ bool Options::ParseToken(ArgTokenStream *tokens) {
   } else if (tokens->MatchAndSet("--extra_build_info", &optarg)) {
     build_info_lines.push_back(optarg);
     return true;
+  } else if (tokens->MatchAndSet("--jobs", &optarg)) {
+    char *end;
+    long value = strtol(optarg.c_str(), &end, 10);  // NOLINT(runtime/int)
+    if (optarg.empty() || *end != '\0' || value < 1 || value > 1024) {
+      diag_errx(1, "--jobs expects a number between 1 and 1024, got '%s'",
+                optarg.c_str());
+    }
+    jobs = static_cast<int>(value);
+    return true;
+  } else if (tokens->MatchAndSet("--transient_memory_limit_mb", &optarg)) {
+    char *end;
+    unsigned long long value =  // NOLINT(runtime/int)
+        strtoull(optarg.c_str(), &end, 10);
+    if (optarg.empty() || *end != '\0' || optarg[0] == '-' ||
+        value > (UINT64_MAX >> 20)) {
+      diag_errx(1, "--transient_memory_limit_mb expects a number, got '%s'",
+                optarg.c_str());
+    }
+    transient_memory_limit_mb = value;
+    return true;
   }
 
   return false;
@@ -82,4 +119,28 @@ void Options::PostValidateOptions() {
         1,
         "--compression and --dont_change_compression are mutually exclusive");
   }
+  // The jars reused with --incremental_index are copied as a whole, and the
+  // entries of one may not point into another.
+  if (share_identical_data && !incremental_index.empty()) {
+    diag_errx(
+        1,
+        "--share_identical_data and --incremental_index are mutually "
+        "exclusive");
+  }
+  if (incremental_append && incremental_index.empty()) {
+    diag_errx(1, "--incremental_append requires --incremental_index");
+  }
+  // The entries of the jars reused with --incremental_index are not gone
+  // through.
+  if (enforce_one_version && !incremental_index.empty()) {
+    diag_errx(
+        1,
+        "--enforce_one_version and --incremental_index are mutually "
+        "exclusive");
+  }
+  // The launcher has to stay at the beginning of the output.
+  if (incremental_append && !java_launcher.empty()) {
+    diag_errx(
+        1, "--incremental_append and --java_launcher are mutually exclusive");
+  }
 }
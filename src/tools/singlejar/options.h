@@ -15,6 +15,7 @@
 #ifndef THIRD_PARTY_BAZEL_SRC_TOOLS_SINGLEJAR_OPTIONS_H_
 #define THIRD_PARTY_BAZEL_SRC_TOOLS_SINGLEJAR_OPTIONS_H_
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -36,7 +37,14 @@ class Options {
         verbose(false),
         warn_duplicate_resources(false),
         check_desugar_deps(false),
-        multi_release(false) {}
+        multi_release(false),
+        share_identical_data(false),
+        drop_input_pages(false),
+        jobs(1),
+        transient_memory_limit_mb(0),
+        incremental_append(false),
+        enforce_one_version(false),
+        succeed_on_found_violations(false) {}
 
   virtual ~Options() {}
 
@@ -69,6 +77,54 @@ class Options {
   bool warn_duplicate_resources;
   bool check_desugar_deps;
   bool multi_release;
+  // Whether a copied file entry whose data is the same as that of an entry
+  // already copied shares the earlier entry's Local Header and data: only its
+  // Central Directory record is written, and it points at the earlier entry.
+  // Java's ZipFile, which goes by the Central Directory, reads such a jar
+  // fine, but the readers that go through the Local Headers in sequence only
+  // see the first name, and some tools (unzip) reject the overlapping
+  // entries as a possible zip bomb.
+  bool share_identical_data;
+  // Whether the pages of an input jar are dropped from the page cache once
+  // its entries have been added, so that large links do not push everything
+  // else out of it. The jars kept by a persistent worker are not dropped.
+  bool drop_input_pages;
+  // The number of threads opening and reading input jars ahead of the
+  // (always single-threaded) writer, and compressing large entries. With
+  // more than one, the output is also written on a thread of its own.
+  int jobs;
+  // The memory in MB the combined and recompressed entries may take before
+  // their contents are moved to temporary files, or 0 for no limit.
+  uint64_t transient_memory_limit_mb;
+  // The relink index kept next to the output jar. When set, the input jars
+  // which have not changed since the previous run are copied from the
+  // previous output rather than added entry by entry.
+  std::string incremental_index;
+  // With incremental_index: rather than writing the output anew, append the
+  // entries of the changed input jars and a new central directory to the
+  // previous output, leaving the entries of the other jars where they are.
+  // Once more than half of the output is no longer referenced, it is written
+  // anew. The output then depends on the previous one, so this is for the
+  // inner loop of local builds.
+  bool incremental_append;
+  // The directory holding CombinerCache files, shared between runs.
+  std::string combiner_cache;
+  // The file to write the phase times and the counters of the run to, as
+  // JSON.
+  std::string stats_file;
+  // The name of an extended attribute to set on the output to its SHA-256,
+  // which is computed as the output is written. Bazel reads it instead of
+  // the output with --unix_digest_hash_attribute_name set to the same name
+  // and the SHA-256 --digest_function.
+  std::string output_digest_attribute;
+  // Whether the classes of the input jars are checked for one version
+  // violations, as the one_version tool does, while they are added: the
+  // allowlist is the text or binary one of that tool. The violations fail
+  // the run, after the output has been written, unless
+  // succeed_on_found_violations is set.
+  bool enforce_one_version;
+  std::string one_version_allowlist;
+  bool succeed_on_found_violations;
   std::string hermetic_java_home;
   std::vector<std::string> add_exports;
   std::vector<std::string> add_opens;
@@ -159,6 +159,103 @@ TEST(OptionsTest, EmptyMultiOptargs) {
   EXPECT_EQ(1UL, options.include_prefixes.size());
 }
 
+TEST(OptionsTest, Jobs) {
+  const char *args[] = {"--output", "output_file", "--jobs", "8"};
+  Options options;
+  options.ParseCommandLine(arraysize(args), args);
+  EXPECT_EQ(8, options.jobs);
+}
+
+TEST(OptionsTest, DefaultJobs) {
+  const char *args[] = {"--output", "output_file"};
+  Options options;
+  options.ParseCommandLine(arraysize(args), args);
+  EXPECT_EQ(1, options.jobs);
+}
+
+TEST(OptionsTest, TransientMemoryLimit) {
+  const char *args[] = {"--output", "output_file",
+                        "--transient_memory_limit_mb", "512"};
+  Options options;
+  options.ParseCommandLine(arraysize(args), args);
+  EXPECT_EQ(512UL, options.transient_memory_limit_mb);
+}
+
+TEST(OptionsTest, DefaultTransientMemoryLimit) {
+  const char *args[] = {"--output", "output_file"};
+  Options options;
+  options.ParseCommandLine(arraysize(args), args);
+  EXPECT_EQ(0UL, options.transient_memory_limit_mb);
+}
+
+TEST(OptionsTest, IncrementalIndex) {
+  const char *args[] = {"--output", "output_file", "--incremental_index",
+                        "output_file.index"};
+  Options options;
+  options.ParseCommandLine(arraysize(args), args);
+  EXPECT_EQ("output_file.index", options.incremental_index);
+}
+
+TEST(OptionsTest, IncrementalAppend) {
+  const char *args[] = {"--output", "output_file", "--incremental_index",
+                        "output_file.index", "--incremental_append"};
+  Options options;
+  options.ParseCommandLine(arraysize(args), args);
+  EXPECT_TRUE(options.incremental_append);
+}
+
+TEST(OptionsTest, ShareIdenticalData) {
+  const char *args[] = {"--output", "output_file", "--share_identical_data"};
+  Options options;
+  options.ParseCommandLine(arraysize(args), args);
+  EXPECT_TRUE(options.share_identical_data);
+}
+
+TEST(OptionsTest, DropInputPages) {
+  const char *args[] = {"--output", "output_file", "--drop_input_pages"};
+  Options options;
+  options.ParseCommandLine(arraysize(args), args);
+  EXPECT_TRUE(options.drop_input_pages);
+}
+
+TEST(OptionsTest, CombinerCache) {
+  const char *args[] = {"--output", "output_file", "--combiner_cache",
+                        "/tmp/combiner_cache"};
+  Options options;
+  options.ParseCommandLine(arraysize(args), args);
+  EXPECT_EQ("/tmp/combiner_cache", options.combiner_cache);
+}
+
+TEST(OptionsTest, StatsFile) {
+  const char *args[] = {"--output", "output_file", "--stats_file",
+                        "output_file.stats.json"};
+  Options options;
+  options.ParseCommandLine(arraysize(args), args);
+  EXPECT_EQ("output_file.stats.json", options.stats_file);
+}
+
+TEST(OptionsTest, OutputDigestAttribute) {
+  const char *args[] = {"--output", "output_file", "--output_digest_attribute",
+                        "user.sha256"};
+  Options options;
+  options.ParseCommandLine(arraysize(args), args);
+  EXPECT_EQ("user.sha256", options.output_digest_attribute);
+}
+
+TEST(OptionsTest, EnforceOneVersion) {
+  const char *args[] = {"--output",
+                        "output_file",
+                        "--enforce_one_version",
+                        "--one_version_allowlist",
+                        "allowlist.txt",
+                        "--succeed_on_found_violations"};
+  Options options;
+  options.ParseCommandLine(arraysize(args), args);
+  EXPECT_TRUE(options.enforce_one_version);
+  EXPECT_EQ("allowlist.txt", options.one_version_allowlist);
+  EXPECT_TRUE(options.succeed_on_found_violations);
+}
+
 TEST(OptionTest, CustomCreatedBy) {
   const char *args[] = {"--output", "output_file", "--output_jar_creator",
                         "CustomCreatedBy 123.456"};
@@ -21,11 +21,25 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <time.h>
 
+#include <algorithm>
+#include <new>
+#include <string>
+#include <vector>
+
 #ifndef _WIN32
 #include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#endif  // __linux__
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/xattr.h>
+#endif
 #else
 
 #ifndef WIN32_LEAN_AND_MEAN
@@ -36,11 +50,16 @@
 #endif  // _WIN32
 
 #include "src/main/cpp/util/path_platform.h"
+#include "src/main/cpp/util/probe.h"
 #include "src/tools/singlejar/combiners.h"
 #include "src/tools/singlejar/diag.h"
 #include "src/tools/singlejar/input_jar.h"
 #include "src/tools/singlejar/mapped_file.h"
 #include "src/tools/singlejar/options.h"
+#include "src/tools/singlejar/parallel_deflater.h"
+#include "src/tools/singlejar/relink_index.h"
+#include "src/tools/singlejar/stats.h"
+#include "src/tools/singlejar/transient_bytes.h"
 #include "src/tools/singlejar/zip_headers.h"
 
 #include <zlib.h>
@@ -50,27 +69,49 @@
     diag_errx(2, "%s:%d: TODO(asmundak): " msg, __FILE__, __LINE__); \
   }
 
+// The classes of entry names reported by name_classifier_.
+enum EntryNameFlags : uint32_t {
+  kSignatureName = 1 << 0,
+  kIncludedName = 1 << 1,
+  kServiceName = 1 << 2,
+  kDesugaredName = 1 << 3,
+  kClassName = 1 << 4,
+  kNoCompressName = 1 << 5,
+};
+
 OutputJar::OutputJar()
     : options_(nullptr),
+      input_jar_cache_(nullptr),
+      next_uncached_input_jar_(0),
       file_(nullptr),
       outpos_(0),
+      kernel_copy_(false),
       buffer_(nullptr),
+      appending_(false),
+      append_offset_(0),
+      reused_bytes_(0),
+      reused_jars_(0),
       entries_(0),
       duplicate_entries_(0),
-      cen_(nullptr),
+      output_read_fd_(-1),
+      shared_entries_(0),
       cen_size_(0),
-      cen_capacity_(0),
+      entry_date_(0),
+      entry_time_(0),
       spring_handlers_("META-INF/spring.handlers"),
       spring_schemas_("META-INF/spring.schemas"),
       protobuf_meta_handler_("protobuf.meta", false),
       manifest_("META-INF/MANIFEST.MF"),
-      build_properties_("build-data.properties") {
-  known_members_.emplace(spring_handlers_.filename(),
+      build_properties_("build-data.properties"),
+      combiner_cache_(nullptr),
+      worker_combiner_cache_(nullptr),
+      preamble_cache_(nullptr) {
+  known_members_.Emplace(spring_handlers_.filename(),
                          EntryInfo{&spring_handlers_});
-  known_members_.emplace(spring_schemas_.filename(),
+  known_members_.Emplace(spring_schemas_.filename(),
                          EntryInfo{&spring_schemas_});
-  known_members_.emplace(manifest_.filename(), EntryInfo{&manifest_});
-  known_members_.emplace(protobuf_meta_handler_.filename(),
+  known_members_.Emplace(manifest_.filename(), EntryInfo{&manifest_});
+  known_members_.Emplace(protobuf_meta_handler_.filename(),
                          EntryInfo{&protobuf_meta_handler_});
 }
 
@@ -83,20 +124,86 @@ static std::string Basename(const std::string &path) {
   }
 }
 
+bool IsDir(const std::string &path);
+
+// The current local time as an MSDOS file date and time, which are what Zip
+// uses, see https://msdn.microsoft.com/en-us/library/9kkf9tah.aspx
+// ("32-Bit Windows Time/Date Formats").
+static void DosTimeNow(uint16_t *dos_date, uint16_t *dos_time) {
+  struct tm tm;
+  // Time has 2-second resolution, so round up:
+  time_t t_adjusted = (time(nullptr) + 1) & ~1;
+  localtime_r(&t_adjusted, &tm);
+  *dos_date = ((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday;
+  *dos_time = (tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec >> 1);
+}
+
 int OutputJar::Doit(Options *options) {
   if (nullptr != options_) {
     diag_errx(1, "%s:%d: Doit() can be called only once.", __FILE__, __LINE__);
   }
   options_ = options;
+  const uint64_t start_time = Stats::Now();
+  if (!options_->normalize_timestamps) {
+    DosTimeNow(&entry_date_, &entry_time_);
+  }
+  Stats::Reset();
+  Stats::set_enabled(options_->verbose || !options_->stats_file.empty());
+  TransientBytes::set_memory_limit(options_->transient_memory_limit_mb << 20);
+
+  // Special files that cannot be handled by looking up known_members_ map:
+  // * ignore *.SF, *.RSA, *.DSA
+  //   (TODO(asmundak): should this be done only in META-INF?
+  for (const char *suffix : {".SF", ".RSA", ".DSA"}) {
+    name_classifier_.AddSuffix(suffix, kSignatureName);
+  }
+  if (options_->include_prefixes.empty()) {
+    name_classifier_.AddPrefix("", kIncludedName);
+  }
+  for (auto &prefix : options_->include_prefixes) {
+    name_classifier_.AddPrefix(prefix, kIncludedName);
+  }
+  name_classifier_.AddPrefix("META-INF/services/", kServiceName);
+  name_classifier_.AddPrefix("j$/", kDesugaredName);
+  name_classifier_.AddSuffix(".class", kClassName);
+  for (auto &suffix : options_->nocompress_suffixes) {
+    name_classifier_.AddSuffix(suffix, kNoCompressName);
+  }
 
   // Register the handler for the build-data.properties file unless
   // --exclude_build_data is present. Otherwise we do not generate this file,
   // and it will be copied from the first source archive containing it.
   if (!options_->exclude_build_data) {
-    known_members_.emplace(build_properties_.filename(),
+    known_members_.Emplace(build_properties_.filename(),
                            EntryInfo{&build_properties_});
   }
 
+  std::string combiner_cache_directory;
+  if (!options_->combiner_cache.empty()) {
+    if (IsDir(options_->combiner_cache)) {
+      combiner_cache_directory = options_->combiner_cache;
+    } else {
+      diag_warnx("%s:%d: %s is not a directory, not using the combiner cache",
+                 __FILE__, __LINE__, options_->combiner_cache.c_str());
+    }
+  }
+  if (worker_combiner_cache_) {
+    worker_combiner_cache_->set_directory(combiner_cache_directory);
+    combiner_cache_ = worker_combiner_cache_;
+  } else if (!combiner_cache_directory.empty()) {
+    own_combiner_cache_.reset(new CombinerCache(combiner_cache_directory));
+    combiner_cache_ = own_combiner_cache_.get();
+  }
+  if (combiner_cache_) {
+    spring_handlers_.set_cache(combiner_cache_);
+    spring_schemas_.set_cache(combiner_cache_);
+    protobuf_meta_handler_.set_cache(combiner_cache_);
+  }
+  if (preamble_cache_) {
+    manifest_.set_cache(preamble_cache_);
+    build_properties_.set_cache(preamble_cache_);
+  }
+
   // Populate the manifest file.
   manifest_.AppendLine("Manifest-Version: 1.0");
   manifest_.AppendLine("Created-By: " + options_->output_jar_creator);
@@ -119,6 +226,9 @@ int OutputJar::Doit(Options *options) {
     fprintf(stderr, "%zu manifest lines\n", options_->manifest_lines.size());
   }
 
+  if (!options_->incremental_index.empty()) {
+    index_.reset(new RelinkIndex);
+  }
   if (!Open()) {
     exit(1);
   }
@@ -179,8 +289,10 @@ int OutputJar::Doit(Options *options) {
     const char *data = reinterpret_cast<const char *>(mapped_file.start());
     const char *data_end = reinterpret_cast<const char *>(mapped_file.end());
     // TODO(asmundak): this isn't right, we should parse properties file.
+    // The file is not NUL-terminated, look for the newlines within it.
     while (data < data_end) {
-      const char *next_data = strchr(static_cast<const char *>(data), '\n');
+      const char *next_data = static_cast<const char *>(
+          memchr(data, '\n', data_end - data));
       if (next_data) {
         ++next_data;
       } else {
@@ -225,68 +337,187 @@ int OutputJar::Doit(Options *options) {
   // First, write a directory entry for the META-INF, followed by the manifest
   // file, followed by the build properties file.
   WriteMetaInf();
-  WriteEntry(manifest_.OutputEntry(compress));
-  if (!options_->exclude_build_data) {
-    WriteEntry(build_properties_.OutputEntry(compress));
+  {
+    Stats::Timer timer(Stats::kCombine);
+    WriteEntry(manifest_.OutputEntry(compress));
+    if (!options_->exclude_build_data) {
+      WriteEntry(build_properties_.OutputEntry(compress));
+    }
   }
 
   // Then classpath resources.
   for (auto &classpath_resource : classpath_resources_) {
-    bool do_compress = compress;
-    if (do_compress && !options_->nocompress_suffixes.empty()) {
-      for (auto &suffix : options_->nocompress_suffixes) {
-        auto entry_name = classpath_resource->filename();
-        if (entry_name.length() >= suffix.size() &&
-            !entry_name.compare(entry_name.length() - suffix.size(),
-                                suffix.size(), suffix)) {
-          do_compress = false;
-          break;
-        }
-      }
-    }
+    Stats::Timer timer(Stats::kCombine);
+    bool do_compress =
+        compress &&
+        !(name_classifier_.Classify(classpath_resource->filename()) &
+          kNoCompressName);
 
     // Add parent directory entries.
-    size_t pos = classpath_resource->filename().find('/');
-    while (pos != std::string::npos) {
-      std::string dir(classpath_resource->filename(), 0, pos + 1);
+    const std::string_view filename = classpath_resource->filename();
+    size_t pos = filename.find('/');
+    while (pos != std::string_view::npos) {
+      std::string_view dir = filename.substr(0, pos + 1);
       if (NewEntry(dir)) {
         WriteDirEntry(dir, nullptr, 0);
       }
-      pos = classpath_resource->filename().find('/', pos + 1);
+      pos = filename.find('/', pos + 1);
     }
 
     WriteEntry(classpath_resource->OutputEntry(do_compress));
   }
 
-  // Then copy source files' contents.
+  // With --incremental_index, the input jars whose entries would end up in
+  // the output exactly as before are copied from the previous output.
+  if (index_) {
+    index_->set_settings(SettingsDigest());
+    if (previous_index_ &&
+        previous_index_->settings() != index_->settings()) {
+      if (options_->verbose) {
+        fprintf(stderr, "Options have changed, cannot reuse %s\n", path());
+      }
+      previous_index_.reset();
+      previous_output_.Close();
+    }
+  }
+
+  // Then copy source files' contents. With --jobs, the input jars are opened
+  // and read in on the worker threads, while the entries are still added in
+  // the order of the inputs, so the output does not depend on the job count.
+  // A persistent worker reads only the jars it does not have yet.
+  if (input_jar_cache_) {
+    cached_input_jars_.resize(options_->input_jars.size());
+    for (size_t ix = 0; ix < options_->input_jars.size(); ++ix) {
+      cached_input_jars_[ix] =
+          input_jar_cache_->Get(options_->input_jars[ix].first);
+      if (!cached_input_jars_[ix]) {
+        uncached_input_jars_.push_back(options_->input_jars[ix]);
+      }
+    }
+  } else {
+    uncached_input_jars_ = options_->input_jars;
+  }
+  if (options_->jobs > 1 && uncached_input_jars_.size() > 1) {
+    if (options_->verbose) {
+      fprintf(stderr, "Reading input jars with %d threads\n", options_->jobs);
+    }
+    prefetcher_.reset(
+        new InputJarPrefetcher(uncached_input_jars_, options_->jobs));
+  }
+  ParallelDeflater::set_max_threads(options_->jobs);
   for (size_t ix = 0; ix < options_->input_jars.size(); ++ix) {
+    BAZEL_PROBE(singlejar, add_jar_begin,
+                options_->input_jars[ix].first.c_str(), ix);
     if (!AddJar(ix)) {
       exit(1);
     }
+    BAZEL_PROBE(singlejar, add_jar_end,
+                options_->input_jars[ix].first.c_str(), ix, entries_);
+  }
+  prefetcher_.reset();
+  cached_input_jars_.clear();
+  if (previous_index_ && options_->verbose) {
+    fprintf(stderr, "Reused %d out of %zu input jars from the previous %s\n",
+            reused_jars_, options_->input_jars.size(), path());
   }
+  previous_index_.reset();
+  previous_output_.Close();
 
   // All entries written, write Central Directory and close.
   Close();
+  if (index_ && !index_->Write(options_->incremental_index)) {
+    diag_warnx("%s:%d: %s will be relinked from scratch next time", __FILE__,
+               __LINE__, path());
+  }
+  if (Stats::enabled()) {
+    ReportStats((Stats::Now() - start_time) / 1000);
+  }
   return 0;
 }
 
+void OutputJar::ReportStats(uint64_t wall_time_us) {
+  Stats::Add(Stats::kInputJars, options_->input_jars.size());
+  Stats::Add(Stats::kReusedInputJars, reused_jars_);
+  Stats::Add(Stats::kEntries, entries_);
+  Stats::Add(Stats::kDuplicateEntries, duplicate_entries_);
+  Stats::Add(Stats::kSharedEntries, shared_entries_);
+  Stats::Add(Stats::kBytesOut, outpos_);
+  if (options_->verbose) {
+    fprintf(stderr, "Done in %.3fs:", wall_time_us / 1e6);
+    for (int i = 0; i < Stats::kPhaseCount; ++i) {
+      Stats::Phase phase = static_cast<Stats::Phase>(i);
+      fprintf(stderr, " %s %.3fs", Stats::name(phase),
+              Stats::time_us(phase) / 1e6);
+    }
+    fprintf(stderr, ", read %" PRIu64 " bytes, wrote %" PRIu64 " bytes\n",
+            Stats::value(Stats::kBytesIn), Stats::value(Stats::kBytesOut));
+  }
+  if (options_->stats_file.empty()) {
+    return;
+  }
+  FILE *file = fopen(options_->stats_file.c_str(), "w");
+  std::string json = Stats::ToJson(wall_time_us);
+  if (file == nullptr || fwrite(json.data(), json.size(), 1, file) != 1 ||
+      fclose(file)) {
+    diag_warn("%s:%d: Cannot write %s", __FILE__, __LINE__,
+              options_->stats_file.c_str());
+  }
+}
+
 OutputJar::~OutputJar() {
-  if (file_) {
+  if (file_ || writer_) {
     diag_warnx("%s:%d: Close() should be called first", __FILE__, __LINE__);
   }
 }
 
+// Sets the extended attribute `name` of `path` to `digest`, its raw bytes,
+// which is what Bazel expects of --unix_digest_hash_attribute_name.
+static bool SetDigestAttribute(const char *path, const std::string &name,
+                               const uint8_t *digest) {
+#if defined(__linux__)
+  return setxattr(path, name.c_str(), digest, Sha256::kDigestLength, 0) ==
+         0;
+#elif defined(__APPLE__)
+  return setxattr(path, name.c_str(), digest, Sha256::kDigestLength, 0, 0) ==
+         0;
+#else
+  errno = ENOTSUP;
+  return false;
+#endif
+}
+
+static void RemoveDigestAttribute(const char *path, const std::string &name) {
+#if defined(__linux__)
+  removexattr(path, name.c_str());
+#elif defined(__APPLE__)
+  removexattr(path, name.c_str(), 0);
+#endif
+}
+
 // Try to perform I/O in units of this size.
 // (128KB is the default max request size for fuse filesystems.)
 static constexpr size_t kBufferSize = 128 << 10;
+// With --jobs > 1, this many such units can wait to be written.
+static constexpr int kAsyncBuffers = 8;
 
 bool OutputJar::Open() {
-  if (file_) {
+  if (file_ || writer_) {
     diag_errx(1, "%s:%d: Cannot open output archive twice", __FILE__, __LINE__);
   }
 
   int mode = O_CREAT | O_WRONLY | O_TRUNC;
 
+#ifndef _WIN32
+  // The previous output has to be opened before it is truncated. On Windows,
+  // an open file cannot be replaced, so it is always written from scratch.
+  if (index_) {
+    OpenPreviousOutput();
+  }
+  if (appending_) {
+    mode = O_WRONLY;
+  }
+#endif
+
 #ifdef _WIN32
   std::wstring wpath;
   std::string error;
@@ -320,15 +551,52 @@ bool OutputJar::Open() {
     diag_warn("%s:%d: %s", __FILE__, __LINE__, path());
     return false;
   }
-  file_ = fdopen(fd, "w");
-  if (file_ == nullptr) {
-    diag_warn("%s:%d: fdopen of %s", __FILE__, __LINE__, path());
-    close(fd);
-    return false;
-  }
   outpos_ = 0;
-  buffer_.reset(new char[kBufferSize]);
-  setvbuf(file_, buffer_.get(), _IOFBF, kBufferSize);
+#ifndef _WIN32
+  if (appending_) {
+    outpos_ = append_offset_ = previous_output_.size();
+    if (lseek(fd, outpos_, SEEK_SET) != outpos_) {
+      diag_warn("%s:%d: lseek %s", __FILE__, __LINE__, path());
+      close(fd);
+      return false;
+    }
+  }
+#endif
+#ifdef __linux__
+  struct stat st;
+  kernel_copy_ = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+#endif
+  if (!options_->output_digest_attribute.empty()) {
+    // A digest left from the previous output would be wrong once it is
+    // rewritten, whether or not the new one can be set at the end.
+    RemoveDigestAttribute(path(), options_->output_digest_attribute);
+    output_digest_.reset(new Sha256());
+#ifndef _WIN32
+    if (appending_) {
+      // The kept part of the previous output is not written again, it is
+      // read from the mapping instead.
+      output_digest_->Update(previous_output_.address(0), append_offset_);
+    }
+#endif
+    // All of the output has to go through WriteBytes() to be digested.
+    kernel_copy_ = false;
+  }
+#ifndef _WIN32
+  // Let the writing overlap with the reading and compressing of the entries.
+  if (options_->jobs > 1) {
+    writer_.reset(new AsyncWriter(fd, kBufferSize, kAsyncBuffers));
+  }
+#endif
+  if (!writer_) {
+    file_ = fdopen(fd, "w");
+    if (file_ == nullptr) {
+      diag_warn("%s:%d: fdopen of %s", __FILE__, __LINE__, path());
+      close(fd);
+      return false;
+    }
+    buffer_.reset(new char[kBufferSize]);
+    setvbuf(file_, buffer_.get(), _IOFBF, kBufferSize);
+  }
   if (options_->verbose) {
     fprintf(stderr, "Writing to %s\n", path());
   }
@@ -341,51 +609,104 @@ static const uint16_t kDefaultDate = 30 << 9 | 1 << 5 | 1;
 bool OutputJar::AddJar(int jar_path_index) {
   const std::string &input_jar_path =
       options_->input_jars[jar_path_index].first;
-  const std::string &input_jar_aux_label =
-      options_->input_jars[jar_path_index].second;
 
-  InputJar input_jar;
-  if (!input_jar.Open(input_jar_path)) {
-    return false;
+  // The jar is closed when the last reference to it is dropped, unless a
+  // persistent worker keeps it in input_jar_cache_.
+  std::shared_ptr<InputJar> input_jar;
+  {
+    // With --jobs, this is the time spent waiting for the prefetcher.
+    Stats::Timer timer(Stats::kOpenInputs);
+    if (input_jar_cache_) {
+      input_jar = std::move(cached_input_jars_[jar_path_index]);
+    }
+    if (input_jar) {
+      // The same jar may be listed more than once.
+      input_jar->Rewind();
+      Stats::Add(Stats::kCachedInputJars, 1);
+    } else {
+      if (prefetcher_) {
+        input_jar = prefetcher_->Take(next_uncached_input_jar_++);
+        if (!input_jar) {
+          return false;
+        }
+      } else {
+        input_jar.reset(new InputJar);
+        if (!input_jar->Open(input_jar_path)) {
+          return false;
+        }
+      }
+      if (input_jar_cache_) {
+        input_jar_cache_->Put(input_jar_path, input_jar);
+      }
+    }
+  }
+  Stats::Add(Stats::kBytesIn, input_jar->size());
+  if (previous_index_ && ReuseJarEntries(jar_path_index, input_jar.get())) {
+    return true;
+  }
+  RelinkIndex::JarRecord record;
+  record.begin = Position();
+  record.cen_begin = cen_size_;
+  const int entries = entries_;
+  record.digest = AddJarEntries(jar_path_index, input_jar.get(), nullptr);
+  if (options_->drop_input_pages && !input_jar_cache_) {
+    input_jar->DropPages();
   }
+  if (index_) {
+    record.end = Position();
+    record.cen_end = cen_size_;
+    record.entries = entries_ - entries;
+    index_->AddJar(input_jar_path, record);
+  }
+  return true;
+}
+
+// The decisions AddJarEntries() makes for an entry, as recorded in the digest.
+enum EntryDecision : uint64_t {
+  kSkipped = 1,
+  kMerged,
+  kDuplicate,
+  kDirectoryAdded,
+  kRecompressed,
+  kCopied,
+};
+
+uint64_t OutputJar::AddJarEntries(int jar_path_index, InputJar *input_jar,
+                                  ReplayLog *replay) {
+  const std::string &input_jar_path =
+      options_->input_jars[jar_path_index].first;
+  const std::string &input_jar_aux_label =
+      options_->input_jars[jar_path_index].second;
+  // The time not accounted to the nested timers is that of going through the
+  // central directory and deciding what to do with the entries.
+  Stats::Timer timer(Stats::kScanCentralDirectory);
+  Fingerprint digest;
+  // The positions of the slashes ending the parent directories of an entry
+  // that are missing, deepest first.
+  std::vector<size_t> missing_dirs;
   const CDH *jar_entry;
   const LH *lh;
-  while ((jar_entry = input_jar.NextEntry(&lh))) {
+  while ((jar_entry = input_jar->NextEntry(&lh))) {
+    digest.Update(jar_entry, jar_entry->size());
     const char *file_name = jar_entry->file_name();
     auto file_name_length = jar_entry->file_name_length();
     if (!file_name_length) {
       diag_errx(
           1, "%s:%d: Bad central directory record in %s at offset 0x%" PRIx64,
           __FILE__, __LINE__, input_jar_path.c_str(),
-          input_jar.CentralDirectoryRecordOffset(jar_entry));
-    }
-    // Special files that cannot be handled by looking up known_members_ map:
-    // * ignore *.SF, *.RSA, *.DSA
-    //   (TODO(asmundak): should this be done only in META-INF?
-    //
-    if (ends_with(file_name, file_name_length, ".SF") ||
-        ends_with(file_name, file_name_length, ".RSA") ||
-        ends_with(file_name, file_name_length, ".DSA")) {
-      continue;
-    }
-
-    bool include_entry = true;
-    if (!options_->include_prefixes.empty()) {
-      for (auto &prefix : options_->include_prefixes) {
-        if ((include_entry =
-                 (prefix.size() <= file_name_length &&
-                  0 == strncmp(file_name, prefix.c_str(), prefix.size())))) {
-          break;
-        }
-      }
+          input_jar->CentralDirectoryRecordOffset(jar_entry));
     }
-    if (!include_entry) {
+    // Skip the signature files and the entries not matching any of the
+    // include prefixes.
+    uint32_t name_flags =
+        name_classifier_.Classify(file_name, file_name_length);
+    if ((name_flags & kSignatureName) || !(name_flags & kIncludedName)) {
+      digest.Update(kSkipped);
       continue;
     }
 
     bool is_file = (file_name[file_name_length - 1] != '/');
-    if (is_file &&
-        begins_with(file_name, file_name_length, "META-INF/services/")) {
+    if (is_file && (name_flags & kServiceName)) {
       // The contents of the META-INF/services/<SERVICE> on the output is the
       // concatenation of the META-INF/services/<SERVICE> files from all inputs.
       std::string service_path(file_name, file_name_length);
@@ -393,15 +714,15 @@ bool OutputJar::AddJar(int jar_path_index) {
         // Create a concatenator and add it to the known_members_ map.
         // The call to Merge() below will then take care of the rest.
         Concatenator *service_handler = new Concatenator(service_path);
+        service_handler->set_cache(combiner_cache_);
         service_handlers_.emplace_back(service_handler);
-        known_members_.emplace(service_path, EntryInfo{service_handler});
+        known_members_.Emplace(service_path, EntryInfo{service_handler});
       }
     } else {
       ExtraHandler(input_jar_path, jar_entry, &input_jar_aux_label);
     }
 
-    if (options_->check_desugar_deps &&
-        begins_with(file_name, file_name_length, "j$/")) {
+    if (options_->check_desugar_deps && (name_flags & kDesugaredName)) {
       diag_errx(1, "%s:%d: desugar_jdk_libs file %.*s unexpectedly found in %s",
                 __FILE__, __LINE__, file_name_length, file_name,
                 input_jar_path.c_str());
@@ -413,15 +734,21 @@ bool OutputJar::AddJar(int jar_path_index) {
     // duplicates, or an ordinary plain entry, for which we save the index of
     // the first input jar (in order to provide diagnostics on duplicate).
     auto got =
-        known_members_.emplace(std::string(file_name, file_name_length),
+        known_members_.Emplace(std::string_view(file_name, file_name_length),
                                EntryInfo{is_file ? nullptr : &null_combiner_,
                                          is_file ? jar_path_index : -1});
     if (!got.second) {
-      auto &entry_info = got.first->second;
+      auto &entry_info = *got.first;
       // Handle special entries (the ones that have a combiner).
       if (entry_info.combiner_ != nullptr) {
+        digest.Update(kMerged);
+        if (replay) {
+          replay->merges.push_back({entry_info.combiner_, jar_entry, lh});
+          continue;
+        }
         // TODO(kmb,asmundak): Should be checking Merge() return value but fails
         // for build-data.properties when merging deploy jars into deploy jars.
+        Stats::Timer combine_timer(Stats::kCombine);
         entry_info.combiner_->Merge(jar_entry, lh);
         continue;
       }
@@ -429,29 +756,47 @@ bool OutputJar::AddJar(int jar_path_index) {
       // Plain file entry. If duplicates are not allowed, bail out. Otherwise
       // just ignore this entry.
       if (options_->no_duplicates ||
-          (options_->no_duplicate_classes &&
-           ends_with(file_name, file_name_length, ".class"))) {
+          (options_->no_duplicate_classes && (name_flags & kClassName))) {
         diag_errx(
             1, "%s:%d: %.*s is present both in %s and %s", __FILE__, __LINE__,
             file_name_length, file_name,
             options_->input_jars[entry_info.input_jar_index_].first.c_str(),
             input_jar_path.c_str());
       } else {
+        digest.Update(kDuplicate);
         duplicate_entries_++;
         continue;
       }
     }
+    if (replay) {
+      replay->added.emplace_back(file_name, file_name_length);
+    }
 
     // Add any missing parent directory entries (first) if requested.
     if (options_->add_missing_directories) {
+      // The parents of the directories added so far have all been added
+      // too, so looking from the deepest parent up, the first one that is
+      // known ends the search: the entries of a package cost one lookup.
       // Ignore very last character in case this entry is a directory itself.
-      for (size_t pos = 0; pos < static_cast<size_t>(file_name_length - 1);
-           ++pos) {
+      missing_dirs.clear();
+      for (size_t pos = file_name_length - 1; pos-- > 0;) {
         if (file_name[pos] == '/') {
-          std::string dir(file_name, 0, pos + 1);
-          if (NewEntry(dir)) {
-            WriteDirEntry(dir, nullptr, 0);
+          if (!NewEntry(std::string_view(file_name, pos + 1))) {
+            break;
           }
+          missing_dirs.push_back(pos);
+        }
+      }
+      for (size_t i = missing_dirs.size(); i-- > 0;) {
+        const size_t pos = missing_dirs[i];
+        std::string_view dir(file_name, pos + 1);
+        digest.Update(kDirectoryAdded);
+        digest.Update(pos);
+        if (replay) {
+          known_members_.Emplace(dir, EntryInfo{&null_combiner_});
+          replay->added.push_back(dir);
+        } else {
+          WriteDirEntry(dir, nullptr, 0);
         }
       }
     }
@@ -463,17 +808,20 @@ bool OutputJar::AddJar(int jar_path_index) {
       bool output_compressed =
           options_->force_compression ||
           (options_->preserve_compression && input_compressed);
-      if (output_compressed && !options_->nocompress_suffixes.empty()) {
-        for (auto &suffix : options_->nocompress_suffixes) {
-          if (file_name_length >= suffix.size() &&
-              !strncmp(file_name + file_name_length - suffix.size(),
-                       suffix.c_str(), suffix.size())) {
-            output_compressed = false;
-            break;
-          }
-        }
+      if (name_flags & kNoCompressName) {
+        output_compressed = false;
       }
-      if (input_compressed != output_compressed) {
+      // The Local Header of an entry of a jar written with
+      // --share_identical_data may be that of another entry. Such an entry
+      // gets a new one, with its own name.
+      bool own_local_header =
+          lh->file_name_length() == file_name_length &&
+          memcmp(lh->file_name(), file_name, file_name_length) == 0;
+      if (input_compressed != output_compressed || !own_local_header) {
+        digest.Update(kRecompressed);
+        if (replay) {
+          continue;
+        }
         Concatenator combiner(jar_entry->file_name_string());
         if (!combiner.Merge(jar_entry, lh)) {
           diag_err(1, "%s:%d: cannot add %.*s", __FILE__, __LINE__,
@@ -484,10 +832,16 @@ bool OutputJar::AddJar(int jar_path_index) {
       }
     }
 
+    digest.Update(kCopied);
+    if (replay) {
+      continue;
+    }
+
     // Now we have to copy:
     //  local header
     //  file data
     //  data descriptor, if present.
+    Stats::Timer copy_timer(Stats::kCopy);
     off64_t copy_from = jar_entry->local_header_offset();
     size_t num_bytes = lh->size();
     if (jar_entry->no_size_in_local_header()) {
@@ -512,7 +866,7 @@ bool OutputJar::AddJar(int jar_path_index) {
     const UnixTimeExtraField *lh_field_to_remove = nullptr;
     bool fix_timestamp = false;
     if (options_->normalize_timestamps) {
-      if (ends_with(file_name, file_name_length, ".class")) {
+      if (name_flags & kClassName) {
         normalized_time = 1;
       }
       lh_field_to_remove = lh->unix_time_extra_field();
@@ -520,6 +874,24 @@ bool OutputJar::AddJar(int jar_path_index) {
                       jar_entry->last_mod_file_time() != normalized_time ||
                       lh_field_to_remove != nullptr;
     }
+
+    // With --share_identical_data, an entry with the same data as one
+    // already copied only gets a Central Directory record, pointing at the
+    // earlier Local Header.
+    const bool share_data =
+        options_->share_identical_data && !jar_entry->no_size_in_local_header();
+    if (share_data) {
+      off64_t shared_offset = FindSharedData(jar_entry, lh);
+      if (shared_offset >= 0) {
+        AppendToDirectoryBuffer(jar_entry, shared_offset, normalized_time,
+                                fix_timestamp);
+        ++entries_;
+        ++shared_entries_;
+        continue;
+      }
+    }
+
+    size_t output_lh_size = lh->size();
     if (fix_timestamp) {
       uint8_t lh_buffer[512];
       size_t lh_size = lh->size();
@@ -540,6 +912,7 @@ bool OutputJar::AddJar(int jar_path_index) {
         }
         lh_new->extra_fields(lh_new->extra_fields(),
                              lh->extra_fields_length() - removed_size);
+        output_lh_size -= removed_size;
       } else {
         memcpy(lh_new, lh, lh_size);
       }
@@ -557,8 +930,17 @@ bool OutputJar::AddJar(int jar_path_index) {
       }
     }
 
-    // Do the actual copy.
-    if (!WriteBytes(input_jar.mapped_start() + copy_from, num_bytes)) {
+    // Do the actual copy. Large entries are copied by the kernel straight
+    // from the input file, if possible.
+#ifndef _WIN32
+    if (num_bytes >= kBufferSize) {
+      size_t copied =
+          KernelCopyAppendData(input_jar->fd(), copy_from, num_bytes);
+      copy_from += copied;
+      num_bytes -= copied;
+    }
+#endif
+    if (!WriteBytes(input_jar->mapped_start() + copy_from, num_bytes)) {
       diag_err(1, "%s:%d: Cannot write %zu bytes of %.*s from %s", __FILE__,
                __LINE__, num_bytes, file_name_length, file_name,
                input_jar_path.c_str());
@@ -567,12 +949,250 @@ bool OutputJar::AddJar(int jar_path_index) {
     AppendToDirectoryBuffer(jar_entry, local_header_offset, normalized_time,
                             fix_timestamp);
     ++entries_;
+    if (share_data) {
+      AddSharedData(jar_entry, local_header_offset, output_lh_size);
+    }
+  }
+  return digest.value();
+}
+
+off64_t OutputJar::FindSharedData(const CDH *jar_entry, const LH *lh) {
+#ifndef _WIN32
+  auto candidates = shared_data_.equal_range(jar_entry->crc32());
+  for (auto it = candidates.first; it != candidates.second; ++it) {
+    const SharedData &shared = it->second;
+    const uint64_t size = jar_entry->compressed_file_size();
+    if (shared.compressed_size != size ||
+        shared.uncompressed_size != jar_entry->uncompressed_file_size() ||
+        shared.compression_method != jar_entry->compression_method()) {
+      continue;
+    }
+    // Same CRC32 and sizes: compare the data with the copy in the output.
+    if (output_read_fd_ < 0) {
+      output_read_fd_ = open(path(), O_RDONLY);
+      if (output_read_fd_ < 0) {
+        diag_warn("%s:%d: cannot read %s back, not sharing data", __FILE__,
+                  __LINE__, path());
+        shared_data_.clear();
+        return -1;
+      }
+    }
+    if (!FlushOutput()) {
+      diag_err(1, "%s:%d: %s", __FILE__, __LINE__, path());
+    }
+    const uint8_t *data = lh->data();
+    const off64_t shared_data_offset = shared.lh_offset + shared.lh_size;
+    uint8_t buffer[16 << 10];
+    uint64_t compared = 0;
+    while (compared < size) {
+      size_t chunk_size = static_cast<size_t>(
+          std::min(static_cast<uint64_t>(sizeof(buffer)), size - compared));
+      if (pread(output_read_fd_, buffer, chunk_size,
+                shared_data_offset + compared) !=
+              static_cast<ssize_t>(chunk_size) ||
+          memcmp(buffer, data + compared, chunk_size) != 0) {
+        break;
+      }
+      compared += chunk_size;
+    }
+    if (compared == size) {
+      return shared.lh_offset;
+    }
+  }
+#endif  // _WIN32
+  return -1;
+}
+
+void OutputJar::AddSharedData(const CDH *jar_entry, off64_t lh_offset,
+                              size_t lh_size) {
+  shared_data_.emplace(
+      jar_entry->crc32(),
+      SharedData{lh_offset, lh_size, jar_entry->compressed_file_size(),
+                 jar_entry->uncompressed_file_size(),
+                 jar_entry->compression_method()});
+}
+
+bool OutputJar::ReuseJarEntries(int jar_path_index, InputJar *input_jar) {
+  const std::string &input_jar_path =
+      options_->input_jars[jar_path_index].first;
+  const RelinkIndex::JarRecord *record =
+      previous_index_->FindJar(input_jar_path);
+  if (record == nullptr) {
+    return false;
+  }
+  Stats::Timer timer(Stats::kScanCentralDirectory);
+
+  // The entries are going to move, so their local header offsets in the
+  // central directory have to be adjusted. Leave the entries with 64-bit
+  // offsets, which might need a different Zip64 extra field, to AddJar.
+  const uint64_t size = record->end - record->begin;
+  if (ziph::zfield_needs_ext64((appending_ ? record->begin : Position()) +
+                               size) ||
+      previous_index_->cen_offset() + record->cen_end >
+          previous_output_.size()) {
+    return false;
+  }
+  const uint8_t *cen = previous_output_.address(previous_index_->cen_offset());
+  uint64_t entries = 0;
+  uint64_t offset = record->cen_begin;
+  while (offset < record->cen_end) {
+    const CDH *cdh = reinterpret_cast<const CDH *>(cen + offset);
+    if (offset + sizeof(CDH) > record->cen_end || !cdh->is() ||
+        offset + cdh->size() > record->cen_end ||
+        cdh->zip64_extra_field() != nullptr ||
+        ziph::zfield_has_ext64(cdh->local_header_offset32())) {
+      return false;
+    }
+    offset += cdh->size();
+    ++entries;
+  }
+  if (entries != record->entries) {
+    return false;
+  }
+
+  // Make the same decisions for the jar entries as AddJarEntries would, and
+  // see if they are the ones made for the previous output. If they are not,
+  // undo the changes to known_members_ and let AddJar write the entries.
+  ReplayLog replay;
+  const int duplicate_entries = duplicate_entries_;
+  if (AddJarEntries(jar_path_index, input_jar, &replay) != record->digest) {
+    for (auto &name : replay.added) {
+      known_members_.Erase(name);
+    }
+    duplicate_entries_ = duplicate_entries;
+    input_jar->Rewind();
+    return false;
+  }
+  {
+    Stats::Timer combine_timer(Stats::kCombine);
+    for (auto &merge : replay.merges) {
+      merge.combiner->Merge(merge.cdh, merge.lh);
+    }
+  }
+
+  Stats::Timer copy_timer(Stats::kCopy);
+  RelinkIndex::JarRecord new_record = *record;
+  new_record.cen_begin = cen_size_;
+  uint32_t delta = 0;
+  if (appending_) {
+    // The entries are already in the output, only the central directory
+    // records are added.
+    reused_bytes_ += size;
+  } else {
+    new_record.begin = Position();
+    delta = static_cast<uint32_t>(Position() - record->begin);
+    size_t copied = 0;
+#ifndef _WIN32
+    copied = KernelCopyAppendData(previous_output_.fd(), record->begin, size);
+#endif
+    if (!WriteBytes(previous_output_.address(record->begin + copied),
+                    size - copied)) {
+      diag_err(1, "%s:%d: Cannot copy %" PRIu64 " bytes of %s from the "
+               "previous output", __FILE__, __LINE__, size,
+               input_jar_path.c_str());
+    }
+    new_record.end = Position();
+  }
+  const uint64_t cen_size = record->cen_end - record->cen_begin;
+  uint8_t *out_cen = ReserveCdr(cen_size);
+  memcpy(out_cen, cen + record->cen_begin, cen_size);
+  for (uint64_t out_offset = 0; out_offset < cen_size;) {
+    CDH *cdh = reinterpret_cast<CDH *>(out_cen + out_offset);
+    cdh->local_header_offset32(cdh->local_header_offset32() + delta);
+    out_offset += cdh->size();
+  }
+  entries_ += entries;
+  new_record.cen_end = cen_size_;
+  index_->AddJar(input_jar_path, new_record);
+  ++reused_jars_;
+  return true;
+}
+
+void OutputJar::OpenPreviousOutput() {
+  std::unique_ptr<RelinkIndex> index(new RelinkIndex);
+  if (!index->Read(options_->incremental_index)) {
+    if (options_->verbose) {
+      fprintf(stderr, "No usable relink index %s\n",
+              options_->incremental_index.c_str());
+    }
+    return;
+  }
+  if (!previous_output_.Open(path())) {
+    return;
+  }
+  // Make sure the output is the one the index describes.
+  bool intact = previous_output_.size() == index->output_size() &&
+                index->cen_offset() <= index->output_size();
+  if (intact) {
+    Fingerprint cen;
+    cen.Update(previous_output_.address(index->cen_offset()),
+               index->output_size() - index->cen_offset());
+    intact = cen.value() == index->cen_digest();
+  }
+  if (!intact) {
+    if (options_->verbose) {
+      fprintf(stderr, "%s does not match the relink index\n", path());
+    }
+    previous_output_.Close();
+    return;
+  }
+#ifndef _WIN32
+  // Append to the output as long as the most of it is still referenced.
+  if (options_->incremental_append) {
+    if (index->garbage() <= index->output_size() / 2) {
+      appending_ = true;
+      previous_index_ = std::move(index);
+      return;
+    }
+    if (options_->verbose) {
+      fprintf(stderr, "Writing %s anew, most of it is no longer used\n",
+              path());
+    }
+  }
+  // The new output is going to be a new file, while the previous one stays
+  // mapped until all the input jars have been added.
+  if (unlink(path())) {
+    diag_warn("%s:%d: unlink %s", __FILE__, __LINE__, path());
+    previous_output_.Close();
+    return;
+  }
+#endif
+  previous_index_ = std::move(index);
+}
+
+uint64_t OutputJar::SettingsDigest() const {
+  Fingerprint digest;
+  for (bool option :
+       {options_->force_compression, options_->preserve_compression,
+        options_->normalize_timestamps, options_->add_missing_directories,
+        options_->no_duplicates, options_->no_duplicate_classes,
+        options_->check_desugar_deps, options_->jobs > 1}) {
+    digest.Update(static_cast<uint64_t>(option));
+  }
+  digest.Update(options_->include_prefixes.size());
+  for (auto &prefix : options_->include_prefixes) {
+    digest.Update(prefix);
+  }
+  digest.Update(options_->nocompress_suffixes.size());
+  for (auto &suffix : options_->nocompress_suffixes) {
+    digest.Update(suffix);
+  }
+  std::vector<std::string> names;
+  names.reserve(known_members_.size());
+  known_members_.ForEach(
+      [&names](std::string_view name, const EntryInfo &entry_info) {
+        names.emplace_back(name);
+        names.back() += entry_info.combiner_ == nullptr ? '-' : '+';
+      });
+  std::sort(names.begin(), names.end());
+  for (auto &name : names) {
+    digest.Update(name);
   }
-  return input_jar.Close();
+  return digest.value();
 }
 
 off64_t OutputJar::Position() {
-  if (file_ == nullptr) {
+  if (file_ == nullptr && !writer_) {
     diag_err(1, "%s:%d: output file is not open", __FILE__, __LINE__);
   }
   // You'd think this could be "return ftell(file_);", but that
@@ -588,6 +1208,7 @@ void OutputJar::WriteEntry(void *buffer) {
   if (buffer == nullptr) {
     return;
   }
+  Stats::Timer timer(Stats::kCopy);
   LH *entry = reinterpret_cast<LH *>(buffer);
   if (options_->verbose) {
     fprintf(stderr, "%-.*s combiner has %zu bytes, %s to %zu\n",
@@ -598,10 +1219,8 @@ void OutputJar::WriteEntry(void *buffer) {
             entry->compressed_file_size());
   }
 
-  // Set this entry's timestamp.
-  // MSDOS file timestamp format that Zip uses is described here:
-  // https://msdn.microsoft.com/en-us/library/9kkf9tah.aspx
-  // ("32-Bit Windows Time/Date Formats")
+  // Set this entry's timestamp. Without --normalize, all of the entries
+  // written here get the time the output was started at.
   if (options_->normalize_timestamps) {
     // Regular "normalized" timestamp is 01/01/2010 00:00:00, while for the
     // .class file it is 01/01/2010 00:00:02
@@ -610,16 +1229,8 @@ void OutputJar::WriteEntry(void *buffer) {
         ends_with(entry->file_name(), entry->file_name_length(), ".class") ? 1
                                                                            : 0);
   } else {
-    struct tm tm;
-    // Time has 2-second resolution, so round up:
-    time_t t_adjusted = (time(nullptr) + 1) & ~1;
-    localtime_r(&t_adjusted, &tm);
-    uint16_t dos_date =
-        ((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday;
-    uint16_t dos_time =
-        (tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec >> 1);
-    entry->last_mod_file_time(dos_time);
-    entry->last_mod_file_date(dos_date);
+    entry->last_mod_file_time(entry_time_);
+    entry->last_mod_file_date(entry_date_);
   }
 
   uint8_t *data = reinterpret_cast<uint8_t *>(entry);
@@ -689,7 +1300,7 @@ void OutputJar::WriteMetaInf() {
 }
 
 // Writes a directory entry with the given name and extra fields.
-void OutputJar::WriteDirEntry(const std::string &name,
+void OutputJar::WriteDirEntry(std::string_view name,
                               const uint8_t *extra_fields,
                               const uint16_t n_extra_fields) {
   size_t lh_size = sizeof(LH) + name.size() + n_extra_fields;
@@ -701,9 +1312,9 @@ void OutputJar::WriteDirEntry(const std::string &name,
   lh->crc32(0);
   lh->compressed_file_size32(0);
   lh->uncompressed_file_size32(0);
-  lh->file_name(name.c_str(), name.size());
+  lh->file_name(name.data(), name.size());
   lh->extra_fields(extra_fields, n_extra_fields);
-  known_members_.emplace(name, EntryInfo{&null_combiner_});
+  known_members_.Emplace(name, EntryInfo{&null_combiner_});
   WriteEntry(lh);
 }
 
@@ -717,6 +1328,16 @@ void OutputJar::AppendToDirectoryBuffer(const CDH *cdh, off64_t lh_pos,
   // position relative to 4G boundary changes.
   // The rest of the input CDH is copied.
 
+  // Usually none of that is needed, and the input CDH is copied as it is.
+  const Zip64ExtraField *zip64_ef = cdh->zip64_extra_field();
+  const bool lh_pos_needs64 = ziph::zfield_needs_ext64(lh_pos);
+  if (!fix_timestamp && zip64_ef == nullptr && !lh_pos_needs64) {
+    CDH *out_cdh = reinterpret_cast<CDH *>(ReserveCdr(cdh->size()));
+    memcpy(out_cdh, cdh, cdh->size());
+    out_cdh->local_header_offset32(lh_pos);
+    return;
+  }
+
   // 1. Decide if we need to drop UnixTime.
   size_t removed_unix_time_field_size = 0;
   if (fix_timestamp) {
@@ -728,9 +1349,7 @@ void OutputJar::AppendToDirectoryBuffer(const CDH *cdh, off64_t lh_pos,
 
   // 2. Figure out how many attributes input entry has and how many
   // the output entry is going to have.
-  const Zip64ExtraField *zip64_ef = cdh->zip64_extra_field();
   const int zip64_attr_count = zip64_ef == nullptr ? 0 : zip64_ef->attr_count();
-  const bool lh_pos_needs64 = ziph::zfield_needs_ext64(lh_pos);
   int out_zip64_attr_count;
   if (zip64_attr_count > 0) {
     out_zip64_attr_count = zip64_attr_count;
@@ -815,16 +1434,22 @@ void OutputJar::AppendToDirectoryBuffer(const CDH *cdh, off64_t lh_pos,
   }
 }
 
+// The Central Directory chunks are at least that large.
+static constexpr size_t kCenChunkSize = 1 << 20;
+
 uint8_t *OutputJar::ReserveCdr(size_t chunk_size) {
-  if (cen_size_ + chunk_size > cen_capacity_) {
-    cen_capacity_ += 1000000;
-    cen_ = reinterpret_cast<uint8_t *>(realloc(cen_, cen_capacity_));
-    if (!cen_) {
+  if (cen_.empty() || cen_.back().size + chunk_size > cen_.back().capacity) {
+    size_t capacity = std::max(kCenChunkSize, chunk_size);
+    uint8_t *data = new (std::nothrow) uint8_t[capacity];
+    if (data == nullptr) {
       diag_errx(1, "%s:%d: Cannot allocate %zu bytes for the directory",
-                __FILE__, __LINE__, cen_capacity_);
+                __FILE__, __LINE__, capacity);
     }
+    cen_.push_back(CenChunk{std::unique_ptr<uint8_t[]>(data), 0, capacity});
   }
-  uint8_t *entry = cen_ + cen_size_;
+  CenChunk &chunk = cen_.back();
+  uint8_t *entry = chunk.data.get() + chunk.size;
+  chunk.size += chunk_size;
   cen_size_ += chunk_size;
   return entry;
 }
@@ -835,20 +1460,27 @@ uint8_t *OutputJar::ReserveCdh(size_t size) {
 
 // Write out combined jar.
 bool OutputJar::Close() {
-  if (file_ == nullptr) {
+  if (file_ == nullptr && !writer_) {
     return true;
   }
 
-  for (auto &service_handler : service_handlers_) {
-    WriteEntry(service_handler->OutputEntry(options_->force_compression));
-  }
-  for (auto &extra_combiner : extra_combiners_) {
-    WriteEntry(extra_combiner->OutputEntry(options_->force_compression));
+  {
+    Stats::Timer timer(Stats::kCombine);
+    BAZEL_PROBE(singlejar, combine_begin);
+    for (auto &service_handler : service_handlers_) {
+      WriteEntry(service_handler->OutputEntry(options_->force_compression));
+    }
+    for (auto &extra_combiner : extra_combiners_) {
+      WriteEntry(extra_combiner->OutputEntry(options_->force_compression));
+    }
+    WriteEntry(spring_handlers_.OutputEntry(options_->force_compression));
+    WriteEntry(spring_schemas_.OutputEntry(options_->force_compression));
+    WriteEntry(
+        protobuf_meta_handler_.OutputEntry(options_->force_compression));
+    BAZEL_PROBE(singlejar, combine_end, entries_);
   }
-  WriteEntry(spring_handlers_.OutputEntry(options_->force_compression));
-  WriteEntry(spring_schemas_.OutputEntry(options_->force_compression));
-  WriteEntry(protobuf_meta_handler_.OutputEntry(options_->force_compression));
   // TODO(asmundak): handle manifest;
+  Stats::Timer timer(Stats::kWriteCentralDirectory);
   off64_t output_position = Position();
   bool write_zip64_ecd = output_position >= 0xFFFFFFFF || entries_ >= 0xFFFF ||
                          cen_size_ >= 0xFFFFFFFF;
@@ -890,25 +1522,57 @@ bool OutputJar::Close() {
     ecd->cen_offset32(output_position);
   }
 
+  if (index_) {
+    Fingerprint cen;
+    for (auto &chunk : cen_) {
+      cen.Update(chunk.data.get(), chunk.size);
+    }
+    index_->set_output(output_position + cen_size_, output_position,
+                       cen.value());
+    // When appending, what this run has not written nor reused is garbage.
+    index_->set_garbage(appending_ ? append_offset_ - reused_bytes_ : 0);
+  }
+
   // Save Central Directory and wrap up.
-  if (!WriteBytes(cen_, cen_size_)) {
-    diag_err(1, "%s:%d: Cannot write central directory", __FILE__, __LINE__);
+  for (auto &chunk : cen_) {
+    if (!WriteBytes(chunk.data.get(), chunk.size)) {
+      diag_err(1, "%s:%d: Cannot write central directory", __FILE__, __LINE__);
+    }
   }
-  free(cen_);
+  cen_.clear();
 
-  if (fclose(file_)) {
+  if (writer_ ? !writer_->Close() : fclose(file_) != 0) {
     diag_err(1, "%s:%d: %s", __FILE__, __LINE__, path());
   }
   file_ = nullptr;
+  writer_.reset();
+  if (output_read_fd_ >= 0) {
+    close(output_read_fd_);
+    output_read_fd_ = -1;
+  }
   // Free the buffer only after fclose(); stdio may flush data from the
   // buffer on close.
   buffer_.reset();
 
+  if (output_digest_) {
+    uint8_t digest[Sha256::kDigestLength];
+    output_digest_->Finish(digest);
+    output_digest_.reset();
+    if (!SetDigestAttribute(path(), options_->output_digest_attribute,
+                            digest)) {
+      diag_warn("%s:%d: Cannot set %s on %s", __FILE__, __LINE__,
+                options_->output_digest_attribute.c_str(), path());
+    }
+  }
+
   if (options_->verbose) {
     fprintf(stderr, "Wrote %s with %d entries", path(), entries_);
     if (duplicate_entries_) {
       fprintf(stderr, ", skipped %d entries", duplicate_entries_);
     }
+    if (shared_entries_) {
+      fprintf(stderr, ", %d sharing the data of others", shared_entries_);
+    }
     fprintf(stderr, "\n");
   }
   return true;
@@ -925,7 +1589,7 @@ bool IsDir(const std::string &path) {
 
 void OutputJar::ClasspathResource(const std::string &resource_name,
                                   const std::string &resource_path) {
-  if (known_members_.count(resource_name)) {
+  if (known_members_.Contains(resource_name)) {
     if (options_->warn_duplicate_resources) {
       diag_warnx(
           "%s:%d: Duplicate resource name %s in the --classpath_resource or "
@@ -940,16 +1604,19 @@ void OutputJar::ClasspathResource(const std::string &resource_name,
   MappedFile mapped_file;
   if (mapped_file.Open(resource_path)) {
     Concatenator *classpath_resource = new Concatenator(resource_name);
+    if (preamble_cache_) {
+      classpath_resource->set_cache(preamble_cache_);
+    }
     classpath_resource->Append(
         reinterpret_cast<const char *>(mapped_file.start()),
         mapped_file.size());
     classpath_resources_.emplace_back(classpath_resource);
-    known_members_.emplace(resource_name, EntryInfo{classpath_resource});
+    known_members_.Emplace(resource_name, EntryInfo{classpath_resource});
   } else if (IsDir(resource_path)) {
     // add an empty entry for the directory so its path ends up in the
     // manifest
     classpath_resources_.emplace_back(new Concatenator(resource_name + "/"));
-    known_members_.emplace(resource_name, EntryInfo{&null_combiner_});
+    known_members_.Emplace(resource_name, EntryInfo{&null_combiner_});
   } else {
     diag_err(1, "%s:%d: %s", __FILE__, __LINE__, resource_path.c_str());
   }
@@ -982,6 +1649,7 @@ ssize_t OutputJar::CopyAppendData(int in_fd, off64_t offset, size_t count) {
     total_written += n_read;
   }
 #else
+  total_written = KernelCopyAppendData(in_fd, offset, count);
   while (static_cast<size_t>(total_written) < count) {
     size_t len = std::min(kBufferSize, count - total_written);
     ssize_t n_read = pread(in_fd, buffer.get(), len, offset + total_written);
@@ -1001,16 +1669,101 @@ ssize_t OutputJar::CopyAppendData(int in_fd, off64_t offset, size_t count) {
   return total_written;
 }
 
+size_t OutputJar::KernelCopyAppendData(int in_fd, off64_t offset,
+                                       size_t count) {
+#ifdef __linux__
+  if (!kernel_copy_ || in_fd < 0 || count == 0) {
+    return 0;
+  }
+  // The data still in the output buffer has to land first.
+  if (!FlushOutput()) {
+    return 0;
+  }
+  int out_fd = OutputFd();
+  size_t copied = 0;
+  bool use_sendfile = false;
+  while (copied < count) {
+    loff_t in_offset = offset + copied;
+    ssize_t n;
+    if (!use_sendfile) {
+      n = copy_file_range(in_fd, &in_offset, out_fd, nullptr, count - copied,
+                          0);
+      if (n < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL ||
+                    errno == EOPNOTSUPP)) {
+        // Not supported for this kernel or this pair of file systems.
+        use_sendfile = true;
+        continue;
+      }
+    } else {
+      off_t sendfile_offset = in_offset;
+      n = sendfile(out_fd, in_fd, &sendfile_offset, count - copied);
+      if (n < 0 && (errno == ENOSYS || errno == EINVAL)) {
+        kernel_copy_ = false;
+        break;
+      }
+    }
+    if (n <= 0) {
+      // Either an error or unexpected EOF, let the caller deal with it.
+      break;
+    }
+    copied += n;
+  }
+  if (copied > 0) {
+    outpos_ += copied;
+    // The kernel has advanced the file offset, make sure stdio follows it.
+    if (!SeekOutput(outpos_)) {
+      diag_err(1, "%s:%d: fseek %s", __FILE__, __LINE__, path());
+    }
+  }
+  return copied;
+#else
+  return 0;
+#endif  // __linux__
+}
+
+bool OutputJar::CloneAppendFile(int in_fd, size_t count) {
+#if defined(__linux__) && defined(FICLONERANGE)
+  if (!kernel_copy_ || in_fd < 0 || count == 0) {
+    return false;
+  }
+  // The data still in the output buffer has to land first.
+  if (!FlushOutput()) {
+    return false;
+  }
+  struct file_clone_range range;
+  range.src_fd = in_fd;
+  range.src_offset = 0;
+  range.src_length = count;
+  range.dest_offset = outpos_;
+  if (ioctl(OutputFd(), FICLONERANGE, &range)) {
+    // Not a file system with reflinks, not the same file system, or the
+    // output position is not aligned to its blocks.
+    return false;
+  }
+  outpos_ += count;
+  // The ioctl does not move the file offset, seek past the cloned data.
+  if (!SeekOutput(outpos_)) {
+    diag_err(1, "%s:%d: fseek %s", __FILE__, __LINE__, path());
+  }
+  return true;
+#else
+  return false;
+#endif  // __linux__ && FICLONERANGE
+}
+
 size_t OutputJar::AppendFile(Options *options, const char *const file_path) {
   int in_fd = open(file_path, O_RDONLY);
   struct stat statbuf;
   if (fstat(in_fd, &statbuf)) {
     diag_err(1, "%s", file_path);
   }
-  // TODO(asmundak):  Consider going back to sendfile() or reflink
-  // (BTRFS_IOC_CLONE/XFS_IOC_CLONE) here.  The launcher preamble can
-  // be very large for targets with many native deps.
-  ssize_t byte_count = CopyAppendData(in_fd, 0, statbuf.st_size);
+  // The launcher preamble can be very large for targets with many native deps,
+  // and so are the JDK modules and the CDS archive of hermetic jars, which
+  // start at a page boundary. Share the file's blocks with the output when the
+  // file system allows, otherwise CopyAppendData lets the kernel copy it.
+  ssize_t byte_count = CloneAppendFile(in_fd, statbuf.st_size)
+                           ? statbuf.st_size
+                           : CopyAppendData(in_fd, 0, statbuf.st_size);
   if (byte_count < 0) {
     diag_err(1, "%s:%d: Cannot copy %s to %s", __FILE__, __LINE__,
              file_path, options->output_jar.c_str());
@@ -1040,15 +1793,15 @@ off64_t OutputJar::PageAlignedAppendFile(const std::string &file_path,
 #endif
   off64_t aligned_offset = (cur_offset + (pagesize - 1)) & ~(pagesize - 1);
   size_t gap = aligned_offset - cur_offset;
-  size_t written;
   if (gap > 0) {
     char *zeros = (char *)malloc(gap);
     if (zeros == nullptr) {
       diag_err(1, "%s:%d: malloc", __FILE__, __LINE__);
     }
     memset(zeros, 0, gap);
-    written = fwrite(zeros, 1, gap, file_);
-    outpos_ += written;
+    if (!WriteBytes(zeros, gap)) {
+      diag_err(1, "%s:%d: %s", __FILE__, __LINE__, path());
+    }
     free(zeros);
   }
 
@@ -1096,14 +1849,39 @@ void OutputJar::AppendPageAlignedFile(
 void OutputJar::ExtraCombiner(const std::string &entry_name,
                               Combiner *combiner) {
   extra_combiners_.emplace_back(combiner);
-  known_members_.emplace(entry_name, EntryInfo{combiner});
+  known_members_.Emplace(entry_name, EntryInfo{combiner});
 }
 
 bool OutputJar::WriteBytes(const void *buffer, size_t count) {
+  if (output_digest_) {
+    output_digest_->Update(buffer, count);
+  }
+  if (writer_) {
+    if (!writer_->Write(buffer, count)) {
+      return false;
+    }
+    outpos_ += count;
+    return true;
+  }
   size_t written = fwrite(buffer, 1, count, file_);
   outpos_ += written;
   return written == count;
 }
 
+bool OutputJar::FlushOutput() {
+  return writer_ ? writer_->Flush() : fflush(file_) == 0;
+}
+
+#ifndef _WIN32
+bool OutputJar::SeekOutput(off64_t offset) {
+  if (writer_) {
+    return lseek(writer_->fd(), offset, SEEK_SET) == offset;
+  }
+  return fseeko(file_, offset, SEEK_SET) == 0;
+}
+
+int OutputJar::OutputFd() { return writer_ ? writer_->fd() : fileno(file_); }
+#endif  // _WIN32
+
 void OutputJar::ExtraHandler(const std::string &input_jar_path, const CDH *,
                              const std::string *) {}
@@ -21,6 +21,7 @@
 #include <cstddef>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
@@ -28,8 +29,16 @@
 #include "src/tools/singlejar/port.h"
 // Need newline so clang-format won't alpha-sort with other headers.
 
+#include "src/tools/singlejar/async_writer.h"
 #include "src/tools/singlejar/combiners.h"
+#include "src/tools/singlejar/entry_name_classifier.h"
+#include "src/tools/singlejar/entry_table.h"
+#include "src/tools/singlejar/input_jar_cache.h"
+#include "src/tools/singlejar/input_jar_prefetcher.h"
+#include "src/tools/singlejar/mapped_file.h"
 #include "src/tools/singlejar/options.h"
+#include "src/tools/singlejar/relink_index.h"
+#include "src/tools/singlejar/sha256.h"
 
 /*
  * Jar file we are writing.
@@ -45,14 +54,27 @@ class OutputJar {
   // Add a combiner to handle the entries with given name. OutputJar will
   // own the instance of the combiner and will delete it on self destruction.
   void ExtraCombiner(const std::string& entry_name, Combiner *combiner);
-  // Additional file handler to be redefined by a subclass.
+  // With a persistent worker: take the input jars from, and add them to, the
+  // given cache, and use the given combiner cache (with the directory of
+  // --combiner_cache, if any), and the given in-memory cache for the entries
+  // written ahead of the input jars' ones. All outlive this instance.
+  void SetWorkerCaches(InputJarCache *input_jar_cache,
+                       CombinerCache *combiner_cache,
+                       CombinerCache *preamble_cache) {
+    input_jar_cache_ = input_jar_cache;
+    worker_combiner_cache_ = combiner_cache;
+    preamble_cache_ = preamble_cache;
+  }
+  // Additional file handler to be redefined by a subclass. With
+  // --incremental_index, it may be called twice for the entries of an input
+  // jar that could not be reused from the previous output.
   virtual void ExtraHandler(const std::string &input_jar_path, const CDH *entry,
                             const std::string *input_jar_aux_label);
   // Return jar path.
   const char *path() const { return options_->output_jar.c_str(); }
   // True if an entry with given name have not been added to this archive.
-  bool NewEntry(const std::string& entry_name) {
-    return known_members_.count(entry_name) == 0;
+  bool NewEntry(std::string_view entry_name) {
+    return !known_members_.Contains(entry_name);
   }
 
  protected:
@@ -74,6 +96,33 @@ class OutputJar {
   bool Open();
   // Add the contents of the given input jar.
   bool AddJar(int jar_path_index);
+  // The entries added to known_members_ and the combiner merges while
+  // checking whether an input jar can be copied from the previous output.
+  struct ReplayLog {
+    struct Merge {
+      Combiner *combiner;
+      const CDH *cdh;
+      const LH *lh;
+    };
+    std::vector<std::string_view> added;
+    std::vector<Merge> merges;
+  };
+  // Add the entries of the given input jar, return the digest to save in the
+  // relink index. If `replay` is not null, make the same decisions without
+  // writing anything, log the added entries and defer the merges.
+  uint64_t AddJarEntries(int jar_path_index, InputJar *input_jar,
+                         ReplayLog *replay);
+  // Copy the entries of the given input jar from the previous output if the
+  // relink index shows they would be written the same way, or with
+  // --incremental_append, leave them where they are. Returns false (having
+  // changed nothing) otherwise.
+  bool ReuseJarEntries(int jar_path_index, InputJar *input_jar);
+  // Open the previous output described by the relink index, if it is intact,
+  // and decide whether to append to it.
+  void OpenPreviousOutput();
+  // Digest of the options and the entries registered before the input jars,
+  // which affect how the input jar entries are written.
+  uint64_t SettingsDigest() const;
   // Returns the current output position.
   off64_t Position();
   // Write Jar entry.
@@ -81,18 +130,22 @@ class OutputJar {
   // Write META_INF/ entry (the first entry on output).
   void WriteMetaInf();
   // Write a directory entry.
-  void WriteDirEntry(const std::string &name, const uint8_t *extra_fields,
+  void WriteDirEntry(std::string_view name, const uint8_t *extra_fields,
                      const uint16_t n_extra_fields);
   // Create output Central Directory Header for the given input entry and
   // append it to CEN (Central Directory) buffer.
   void AppendToDirectoryBuffer(const CDH *cdh, off64_t lh_pos,
                                uint16_t normalized_time, bool fix_timestamp);
-  // Reserve space in CEN buffer.
+  // Reserve space in CEN buffer. The space is contiguous, but it is not
+  // necessarily adjacent to the previously reserved one.
   uint8_t *ReserveCdr(size_t chunk_size);
   // Reserve space for the Central Directory Header in CEN buffer.
   uint8_t *ReserveCdh(size_t size);
   // Close output.
   bool Close();
+  // Print the phase times and the counters with --verbose, and write them to
+  // --stats_file.
+  void ReportStats(uint64_t wall_time_us);
   // Set classpath resource with given resource name and path.
   void ClasspathResource(const std::string& resource_name,
                          const std::string& resource_path);
@@ -105,34 +158,125 @@ class OutputJar {
                              const std::string &property_name);
   // Append data from the file specified by file_path.
   size_t AppendFile(Options *options, const char *file_path);
+  // Have the file system share the blocks of the given file, which is 'count'
+  // bytes long, with the output at its current position (FICLONERANGE),
+  // bypassing the output buffer. Returns false if it cannot: the output
+  // position has to be aligned to the file system blocks, for one.
+  bool CloneAppendFile(int in_fd, size_t count);
   // Copy 'count' bytes starting at 'offset' from the given file.
   ssize_t CopyAppendData(int in_fd, off64_t offset, size_t count);
+  // Same, but have the kernel do the copying (copy_file_range, which may
+  // reflink, or sendfile), bypassing the output buffer. Returns the number of
+  // bytes copied, which is less than 'count' (possibly 0) if the input or the
+  // output do not support it. The caller is expected to copy the rest.
+  size_t KernelCopyAppendData(int in_fd, off64_t offset, size_t count);
   // Write bytes to the output file, return true on success.
   bool WriteBytes(const void *buffer, size_t count);
+  // Has the data written so far land in the output file, so that its file
+  // descriptor can be used directly.
+  bool FlushOutput();
+  // Moves the output file offset, after it has been written to directly.
+  bool SeekOutput(off64_t offset);
+  int OutputFd();
+  // With --share_identical_data: finds an entry already copied to the output
+  // whose data is that of the given input entry, and returns the offset of
+  // its Local Header, or -1.
+  off64_t FindSharedData(const CDH *jar_entry, const LH *lh);
+  // Same: records the entry just copied to the given offset, with a Local
+  // Header of the given size.
+  void AddSharedData(const CDH *jar_entry, off64_t lh_offset, size_t lh_size);
 
   Options *options_;
   struct EntryInfo {
-    EntryInfo(Combiner *combiner, int index = -1)
+    EntryInfo(Combiner *combiner = nullptr, int index = -1)
         : combiner_(combiner), input_jar_index_(index) {}
     Combiner *combiner_;
     int input_jar_index_;  // Input jar index for the plain entry or -1.
   };
 
-  std::unordered_map<std::string, struct EntryInfo> known_members_;
+  EntryTable<EntryInfo> known_members_;
+  // Matches the entry names against the names AddJarEntries() treats
+  // specially and the prefixes and suffixes from the options.
+  EntryNameClassifier name_classifier_;
+  // Opens the input jars ahead of AddJar() when running with --jobs > 1.
+  // With a persistent worker, only the jars that are not in
+  // input_jar_cache_, which are then listed in uncached_input_jars_.
+  std::unique_ptr<InputJarPrefetcher> prefetcher_;
+  InputJarCache *input_jar_cache_;
+  // The jars found in input_jar_cache_, by input jar index, held from the
+  // start so that they are not closed by the Put() of the other jars.
+  std::vector<std::shared_ptr<InputJar> > cached_input_jars_;
+  std::vector<std::pair<std::string, std::string> > uncached_input_jars_;
+  size_t next_uncached_input_jar_;
+  // The output goes either to file_ or, with --jobs > 1, to writer_, which
+  // writes it on a thread of its own.
   FILE *file_;
+  std::unique_ptr<AsyncWriter> writer_;
   off64_t outpos_;
+  // Whether KernelCopyAppendData() may be attempted: the output is a regular
+  // file and the kernel has not refused to copy to it yet.
+  bool kernel_copy_;
+  // With --output_digest_attribute, the digest of what has been written.
+  std::unique_ptr<Sha256> output_digest_;
   std::unique_ptr<char[]> buffer_;
+  // With --incremental_index: the index being built for this output, the
+  // index of the previous output and the previous output itself, which stays
+  // mapped (but unlinked) while the new output is written.
+  std::unique_ptr<RelinkIndex> index_;
+  std::unique_ptr<RelinkIndex> previous_index_;
+  MappedFile previous_output_;
+  // With --incremental_append, whether the output is the previous one being
+  // appended to, its size before, and how much of that is still referenced.
+  bool appending_;
+  uint64_t append_offset_;
+  uint64_t reused_bytes_;
+  int reused_jars_;
   int entries_;
   int duplicate_entries_;
-  uint8_t *cen_;
-  size_t cen_size_;
-  size_t cen_capacity_;
+  // With --share_identical_data: the entries copied so far, by the CRC32 of
+  // their data, and the descriptor the output is read back through to make
+  // sure that the data of a candidate is the same.
+  struct SharedData {
+    off64_t lh_offset;
+    size_t lh_size;
+    uint64_t compressed_size;
+    uint64_t uncompressed_size;
+    uint16_t compression_method;
+  };
+  std::unordered_multimap<uint32_t, SharedData> shared_data_;
+  int output_read_fd_;
+  int shared_entries_;
+  // The Central Directory is accumulated in a list of chunks rather than in
+  // a single buffer, so that it is never copied as it grows.
+  struct CenChunk {
+    std::unique_ptr<uint8_t[]> data;
+    size_t size;
+    size_t capacity;
+  };
+  std::vector<CenChunk> cen_;
+  size_t cen_size_;  // The total size of the chunks.
+  // Without --normalize, the DOS date and time of the entries WriteEntry()
+  // writes, which are those of the start of the run.
+  uint16_t entry_date_;
+  uint16_t entry_time_;
   Concatenator spring_handlers_;
   Concatenator spring_schemas_;
   Concatenator protobuf_meta_handler_;
   ManifestCombiner manifest_;
   PropertyCombiner build_properties_;
   NullCombiner null_combiner_;
+  // With --combiner_cache or a persistent worker, the cache used by the
+  // combiners of the entries that are usually the same in many outputs
+  // (services, Spring, protobuf). It is either owned by this instance or
+  // the worker's one.
+  CombinerCache *combiner_cache_;
+  std::unique_ptr<CombinerCache> own_combiner_cache_;
+  CombinerCache *worker_combiner_cache_;
+  // With a persistent worker, the cache of the manifest, the build data and
+  // the classpath resources, which a worker writing the same output again
+  // would otherwise compress again. It is kept in memory only, as some of
+  // them change with every build.
+  const CombinerCache *preamble_cache_;
   std::vector<std::unique_ptr<Concatenator> > service_handlers_;
   std::vector<std::unique_ptr<Concatenator> > classpath_resources_;
   std::vector<std::unique_ptr<Combiner> > extra_combiners_;
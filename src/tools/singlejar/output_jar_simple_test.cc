@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -24,6 +25,7 @@
 #include "src/tools/singlejar/input_jar.h"
 #include "src/tools/singlejar/options.h"
 #include "src/tools/singlejar/output_jar.h"
+#include "src/tools/singlejar/sha256.h"
 #include "src/tools/singlejar/test_util.h"
 #include "googletest/include/gtest/gtest.h"
 
@@ -31,6 +33,10 @@
 #error "The path to jar tool has to be defined via -DJAR_TOOL_PATH="
 #endif
 
+#ifdef __linux__
+#include <sys/xattr.h>
+#endif
+
 #ifdef _WIN32
 #define unlink _unlink
 #define CMD_SEPARATOR "&"
@@ -278,6 +284,24 @@ TEST_F(OutputJarSimpleTest, JavaLauncher) {
   input_jar.Close();
 }
 
+// Entries large enough to be copied by the kernel are copied intact.
+TEST_F(OutputJarSimpleTest, LargeStoredEntry) {
+  string contents;
+  for (int i = 0; contents.size() < (1 << 20); ++i) {
+    contents += "line " + std::to_string(i) + "\n";
+  }
+  string large_path = CreateTextFile("large/large.txt", contents.c_str());
+  string large_jar_path = OutputFilePath("large.jar");
+  unlink(large_jar_path.c_str());
+  ASSERT_EQ(0, RunCommand("zip", "-0qj", large_jar_path.c_str(),
+                          large_path.c_str(), nullptr));
+  string launcher_path = CreateTextFile("launcher", "Dummy");
+  string out_path = OutputFilePath("out.jar");
+  CreateOutput(out_path, {"--java_launcher", launcher_path, "--sources",
+                          large_jar_path});
+  EXPECT_EQ(contents, GetEntryContents(out_path, "large.txt"));
+}
+
 // --cds_archive option
 TEST_F(OutputJarSimpleTest, CDSArchive) {
   string out_path = OutputFilePath("out.jar");
@@ -1082,4 +1106,281 @@ TEST_F(OutputJarSimpleTest, AddExportsTokenize) {
       manifest);
 }
 
+// --jobs does not change the output.
+TEST_F(OutputJarSimpleTest, Jobs) {
+  string libtest1 =
+      runfiles->Rlocation("io_bazel/src/tools/singlejar/libtest1.jar");
+  string libtest2 =
+      runfiles->Rlocation("io_bazel/src/tools/singlejar/libtest2.jar");
+  string stored =
+      runfiles->Rlocation("io_bazel/src/tools/singlejar/stored.jar");
+  string libdata1 = runfiles->Rlocation(kPathLibData1);
+  string libdata2 = runfiles->Rlocation(kPathLibData2);
+  string out_path = OutputFilePath("out.jar");
+  CreateOutput(out_path, {"--normalize", "--sources", libtest1, libtest2,
+                          stored, libdata1, libdata2});
+
+  string jobs_out_path = OutputFilePath("out_jobs.jar");
+  const char *jobs_args[] = {"--output",      jobs_out_path.c_str(),
+                             "--build_target", "//some/target",
+                             "--normalize",    "--jobs",
+                             "3",              "--sources",
+                             libtest1.c_str(), libtest2.c_str(),
+                             stored.c_str(),   libdata1.c_str(),
+                             libdata2.c_str()};
+  Options jobs_options;
+  jobs_options.ParseCommandLine(arraysize(jobs_args), jobs_args);
+  OutputJar jobs_output_jar;
+  ASSERT_EQ(0, jobs_output_jar.Doit(&jobs_options));
+
+  string expected;
+  string actual;
+  ASSERT_TRUE(blaze_util::ReadFile(out_path, &expected));
+  ASSERT_TRUE(blaze_util::ReadFile(jobs_out_path, &actual));
+  EXPECT_EQ(expected, actual);
+}
+
+// --stats_file option
+TEST_F(OutputJarSimpleTest, StatsFile) {
+  string libtest1 =
+      runfiles->Rlocation("io_bazel/src/tools/singlejar/libtest1.jar");
+  string libtest2 =
+      runfiles->Rlocation("io_bazel/src/tools/singlejar/libtest2.jar");
+  string out_path = OutputFilePath("out.jar");
+  string stats_path = OutputFilePath("out.stats.json");
+  CreateOutput(out_path, {"--stats_file", stats_path, "--sources", libtest1,
+                          libtest2, libtest1});
+  string stats;
+  ASSERT_TRUE(blaze_util::ReadFile(stats_path, &stats));
+  EXPECT_NE(string::npos, stats.find("\"phase_time_us\": {")) << stats;
+  EXPECT_NE(string::npos, stats.find("\"input_jars\": 3,")) << stats;
+
+  InputJar input_jar;
+  ASSERT_TRUE(input_jar.Open(out_path));
+  const LH *lh;
+  int entries = 0;
+  while (input_jar.NextEntry(&lh)) {
+    ++entries;
+  }
+  input_jar.Close();
+  EXPECT_NE(string::npos,
+            stats.find("\"entries\": " + std::to_string(entries) + ","))
+      << stats;
+}
+
+#ifdef __linux__
+// --output_digest_attribute option
+TEST_F(OutputJarSimpleTest, OutputDigestAttribute) {
+  string libtest1 =
+      runfiles->Rlocation("io_bazel/src/tools/singlejar/libtest1.jar");
+  string out_path = OutputFilePath("out.jar");
+  CreateOutput(out_path, {"--output_digest_attribute", "user.test.sha256",
+                          "--sources", libtest1});
+  uint8_t attribute[Sha256::kDigestLength + 1];
+  ssize_t size = getxattr(out_path.c_str(), "user.test.sha256", attribute,
+                          sizeof(attribute));
+  if (size < 0 && errno == ENOTSUP) {
+    GTEST_SKIP() << "no user extended attributes on " << out_path;
+  }
+  ASSERT_EQ(static_cast<ssize_t>(Sha256::kDigestLength), size)
+      << strerror(errno);
+
+  string output;
+  ASSERT_TRUE(blaze_util::ReadFile(out_path, &output));
+  Sha256 sha256;
+  sha256.Update(output.data(), output.size());
+  uint8_t digest[Sha256::kDigestLength];
+  sha256.Finish(digest);
+  EXPECT_EQ(0, memcmp(digest, attribute, Sha256::kDigestLength));
+}
+#endif  // __linux__
+
+// --incremental_index option
+static void RunSingleJar(const std::vector<string> &args) {
+  std::vector<const char *> argv;
+  for (auto &arg : args) {
+    argv.push_back(arg.c_str());
+  }
+  Options options;
+  options.ParseCommandLine(argv.size(), argv.data());
+  OutputJar output_jar;
+  ASSERT_EQ(0, output_jar.Doit(&options));
+}
+
+TEST_F(OutputJarSimpleTest, IncrementalIndex) {
+  string libtest1 =
+      runfiles->Rlocation("io_bazel/src/tools/singlejar/libtest1.jar");
+  string libdata1 = runfiles->Rlocation(kPathLibData1);
+  string middle_path = OutputFilePath("middle.jar");
+  string last_path = OutputFilePath("last.jar");
+  auto zip = [](const string &jar_path, const std::vector<string> &files) {
+    unlink(jar_path.c_str());
+    for (auto &file : files) {
+      ASSERT_EQ(0, RunCommand("zip", "-qj", jar_path.c_str(), file.c_str(),
+                              nullptr));
+    }
+  };
+  zip(middle_path, {CreateTextFile("middle/m.txt", "one\n")});
+  zip(last_path, {CreateTextFile("last/l.txt", "last\n")});
+
+  string out_path = OutputFilePath("out.jar");
+  string index_path = OutputFilePath("out.jar.index");
+  unlink(index_path.c_str());
+  std::vector<string> args = {"--output", out_path, "--build_target",
+                              "//some/target", "--normalize",
+                              "--add_missing_directories", "--sources",
+                              libtest1, middle_path, libdata1, last_path};
+  std::vector<string> incremental_args = args;
+  incremental_args.push_back("--incremental_index");
+  incremental_args.push_back(index_path);
+  RunSingleJar(incremental_args);
+  EXPECT_EQ("last\n", GetEntryContents(out_path, "l.txt"));
+
+  // Change the middle jar so that it also shadows the entry of the last one.
+  zip(middle_path, {CreateTextFile("middle/m.txt", "two\n"),
+                    CreateTextFile("middle/l.txt", "shadow\n")});
+  RunSingleJar(incremental_args);
+  EXPECT_EQ(0, VerifyZip(out_path));
+  EXPECT_EQ("two\n", GetEntryContents(out_path, "m.txt"));
+  EXPECT_EQ("shadow\n", GetEntryContents(out_path, "l.txt"));
+
+  // The result is the same as when writing the jar from scratch.
+  string scratch_path = OutputFilePath("scratch.jar");
+  args[1] = scratch_path;
+  RunSingleJar(args);
+  string expected;
+  string actual;
+  ASSERT_TRUE(blaze_util::ReadFile(scratch_path, &expected));
+  ASSERT_TRUE(blaze_util::ReadFile(out_path, &actual));
+  EXPECT_EQ(expected, actual);
+
+  // Nothing has changed, everything is copied.
+  RunSingleJar(incremental_args);
+  ASSERT_TRUE(blaze_util::ReadFile(out_path, &actual));
+  EXPECT_EQ(expected, actual);
+}
+
+// --incremental_append option
+TEST_F(OutputJarSimpleTest, IncrementalAppend) {
+  string first_path = OutputFilePath("first.jar");
+  string middle_path = OutputFilePath("middle.jar");
+  auto zip = [](const string &jar_path, const string &file) {
+    unlink(jar_path.c_str());
+    ASSERT_EQ(0, RunCommand("zip", "-qj", jar_path.c_str(), file.c_str(),
+                            nullptr));
+  };
+  string contents;
+  for (int i = 0; i < 1000; ++i) {
+    contents += "The first jar is the large one " + std::to_string(i);
+  }
+  zip(first_path, CreateTextFile("first/f.txt", contents.c_str()));
+  zip(middle_path, CreateTextFile("middle/m.txt", "one"));
+
+  string out_path = OutputFilePath("out.jar");
+  string index_path = OutputFilePath("out.jar.index");
+  unlink(index_path.c_str());
+  std::vector<string> args = {"--output", out_path, "--build_target",
+                              "//some/target", "--normalize", "--sources",
+                              first_path, middle_path};
+  std::vector<string> incremental_args = args;
+  incremental_args.insert(incremental_args.end(),
+                          {"--incremental_index", index_path,
+                           "--incremental_append"});
+  RunSingleJar(incremental_args);
+  string previous;
+  ASSERT_TRUE(blaze_util::ReadFile(out_path, &previous));
+
+  // The changed middle jar and a new central directory are appended.
+  zip(middle_path, CreateTextFile("middle/m.txt", "two"));
+  RunSingleJar(incremental_args);
+  string actual;
+  ASSERT_TRUE(blaze_util::ReadFile(out_path, &actual));
+  EXPECT_EQ(previous, actual.substr(0, previous.size()));
+  EXPECT_LT(actual.size(), 2 * previous.size());
+  EXPECT_EQ(contents, GetEntryContents(out_path, "f.txt"));
+  EXPECT_EQ("two", GetEntryContents(out_path, "m.txt"));
+
+  // Once most of the output is no longer referenced, it is written anew, the
+  // same as from scratch.
+  string scratch_path = OutputFilePath("scratch.jar");
+  args[1] = scratch_path;
+  bool compacted = false;
+  for (int i = 0; i < 4; ++i) {
+    zip(first_path,
+        CreateTextFile("first/f.txt", (contents + std::to_string(i)).c_str()));
+    size_t previous_size = actual.size();
+    RunSingleJar(incremental_args);
+    ASSERT_TRUE(blaze_util::ReadFile(out_path, &actual));
+    EXPECT_LT(actual.size(), 4 * previous.size());
+    if (actual.size() < previous_size) {
+      compacted = true;
+      RunSingleJar(args);
+      string expected;
+      ASSERT_TRUE(blaze_util::ReadFile(scratch_path, &expected));
+      EXPECT_EQ(expected, actual);
+    }
+  }
+  EXPECT_TRUE(compacted);
+  EXPECT_EQ(contents + "3", GetEntryContents(out_path, "f.txt"));
+}
+
+// --share_identical_data option
+TEST_F(OutputJarSimpleTest, ShareIdenticalData) {
+  string contents;
+  for (int i = 0; i < 1000; ++i) {
+    contents += "Licensed under the Apache License " + std::to_string(i);
+  }
+  CreateTextFile("shared/LICENSE", contents.c_str());
+  CreateTextFile("shared/NOTICE", contents.c_str());
+  CreateTextFile("shared/README", "Something else");
+  string jar_path = OutputFilePath("shared.jar");
+  unlink(jar_path.c_str());
+  ASSERT_EQ(0, RunCommand("cd", OutputFilePath("").c_str(), CMD_SEPARATOR,
+                          "zip", "-q", "shared.jar", "shared/LICENSE",
+                          "shared/NOTICE", "shared/README", nullptr));
+
+  string out_path = OutputFilePath("out.jar");
+  string shared_path = OutputFilePath("out_shared.jar");
+  std::vector<string> args = {"--output", out_path, "--build_target",
+                              "//some/target", "--compression", "--sources",
+                              jar_path};
+  RunSingleJar(args);
+  args[1] = shared_path;
+  args.push_back("--share_identical_data");
+  RunSingleJar(args);
+
+  // NOTICE points at the data of LICENSE.
+  string expected;
+  string actual;
+  ASSERT_TRUE(blaze_util::ReadFile(out_path, &expected));
+  ASSERT_TRUE(blaze_util::ReadFile(shared_path, &actual));
+  EXPECT_LT(actual.size(), expected.size());
+
+  // Tools that go by the Local Headers, such as zip, reject such a jar.
+  // Merged again, by singlejar, it has all its entries.
+  string merged_path = OutputFilePath("merged.jar");
+  RunSingleJar({"--output", merged_path, "--sources", shared_path});
+  EXPECT_EQ(0, VerifyZip(merged_path));
+  EXPECT_EQ(contents, GetEntryContents(merged_path, "shared/LICENSE"));
+  EXPECT_EQ(contents, GetEntryContents(merged_path, "shared/NOTICE"));
+  EXPECT_EQ("Something else", GetEntryContents(merged_path, "shared/README"));
+}
+
+// --drop_input_pages only affects the page cache, not what is written.
+TEST_F(OutputJarSimpleTest, DropInputPages) {
+  CreateTextFile("pages/file1", "file1");
+  CreateTextFile("pages/file2", "file2");
+  string jar_path = OutputFilePath("pages.jar");
+  unlink(jar_path.c_str());
+  ASSERT_EQ(0, RunCommand("cd", OutputFilePath("").c_str(), CMD_SEPARATOR,
+                          "zip", "-q", "pages.jar", "pages/file1",
+                          "pages/file2", nullptr));
+  string out_path = OutputFilePath("out.jar");
+  RunSingleJar({"--output", out_path, "--drop_input_pages", "--sources",
+                jar_path, jar_path});
+  EXPECT_EQ(0, VerifyZip(out_path));
+  EXPECT_EQ("file1", GetEntryContents(out_path, "pages/file1"));
+  EXPECT_EQ("file2", GetEntryContents(out_path, "pages/file2"));
+}
+
 }  // namespace
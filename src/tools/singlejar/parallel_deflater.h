@@ -0,0 +1,198 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_PARALLEL_DEFLATER_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_PARALLEL_DEFLATER_H_ 1
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "src/tools/singlejar/checksum.h"
+#include "src/tools/singlejar/diag.h"
+#include <zlib.h>
+
+/*
+ * Deflates a large buffer on several threads, the way pigz does it: the input
+ * is split into chunks which are compressed independently, each primed with
+ * the last 32K of the preceding input as the dictionary. All chunks but the
+ * last one end with a sync flush, so they end on a byte boundary and can be
+ * simply concatenated into a single raw deflate stream. The result does not
+ * depend on the number of threads.
+ *
+ * The input is a list of non-empty segments (address, size), because this is
+ * how TransientBytes holds its data.
+ */
+class ParallelDeflater {
+ public:
+  typedef std::pair<const uint8_t *, size_t> Segment;
+
+  // Inputs smaller than this are not worth splitting.
+  static constexpr uint64_t kMinParallelSize = 4 << 20;
+
+  // Chunks are at least that long (except the last one).
+  static constexpr uint64_t kChunkSize = 1 << 20;
+
+  // The number of threads that may be used. The default is 1, which disables
+  // parallel compression.
+  static int max_threads() { return max_threads_ref(); }
+  static void set_max_threads(int max_threads) {
+    max_threads_ref() = std::max(max_threads, 1);
+  }
+
+  // Whether given amount of data should be compressed by Deflate() rather
+  // than by a single Deflater.
+  static bool ShouldUse(uint64_t data_size) {
+    return max_threads() > 1 && data_size >= kMinParallelSize;
+  }
+
+  // Compresses the concatenation of the segments into the given buffer and
+  // computes CRC32 of the uncompressed data. Returns false if the compressed
+  // data does not fit into the buffer (in which case the buffer contents and
+  // *checksum are undefined).
+  static bool Deflate(const std::vector<Segment> &segments, uint8_t *buffer,
+                      uint64_t buffer_size, uint64_t *bytes_written,
+                      uint32_t *checksum) {
+    // Split the segments into chunks of consecutive segments.
+    std::vector<Chunk> chunks;
+    for (size_t i = 0; i < segments.size(); ++i) {
+      if (chunks.empty() || chunks.back().in_size >= kChunkSize) {
+        chunks.emplace_back();
+        chunks.back().first_segment = i;
+      }
+      chunks.back().last_segment = i + 1;
+      chunks.back().in_size += segments[i].second;
+    }
+    if (chunks.empty()) {
+      *bytes_written = 0;
+      *checksum = 0;
+      return true;
+    }
+    chunks.back().last = true;
+
+    std::atomic<size_t> next_chunk(0);
+    auto worker = [&segments, &chunks, &next_chunk]() {
+      for (size_t ix; (ix = next_chunk++) < chunks.size();) {
+        DeflateChunk(segments, &chunks[ix]);
+      }
+    };
+    size_t n_threads = std::min(static_cast<size_t>(max_threads()),
+                                chunks.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < n_threads; ++i) {
+      threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread : threads) {
+      thread.join();
+    }
+
+    // Concatenate the compressed chunks, combine the checksums.
+    bool fits = true;
+    uint64_t total_out = 0;
+    uint32_t crc = 0;
+    for (auto &chunk : chunks) {
+      if (fits && total_out + chunk.out_size <= buffer_size) {
+        memcpy(buffer + total_out, chunk.out, chunk.out_size);
+        total_out += chunk.out_size;
+        crc = crc32_combine(crc, chunk.crc, chunk.in_size);
+      } else {
+        fits = false;
+      }
+      free(chunk.out);
+    }
+    *bytes_written = total_out;
+    *checksum = crc;
+    return fits;
+  }
+
+ private:
+  struct Chunk {
+    Chunk()
+        : first_segment(0),
+          last_segment(0),
+          in_size(0),
+          last(false),
+          out(nullptr),
+          out_size(0),
+          crc(0) {}
+    size_t first_segment;
+    size_t last_segment;
+    uint64_t in_size;
+    bool last;
+    uint8_t *out;
+    uint64_t out_size;
+    uint32_t crc;
+  };
+
+  static int &max_threads_ref() {
+    static int max_threads = 1;
+    return max_threads;
+  }
+
+  static void DeflateChunk(const std::vector<Segment> &segments,
+                           Chunk *chunk) {
+    z_stream stream;
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    int ret = deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                           -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    if (ret != Z_OK) {
+      diag_errx(2, "%s:%d: deflateInit2 returned %d", __FILE__, __LINE__, ret);
+    }
+    if (chunk->first_segment > 0) {
+      // Prime the dictionary with the tail of the preceding segment.
+      const Segment &prev = segments[chunk->first_segment - 1];
+      size_t dict_size = std::min(prev.second, static_cast<size_t>(32768));
+      deflateSetDictionary(&stream, prev.first + prev.second - dict_size,
+                           dict_size);
+    }
+    // A sync flush adds at most 5 bytes, make room for a few more.
+    uint64_t capacity = deflateBound(&stream, chunk->in_size) + 16;
+    chunk->out = reinterpret_cast<uint8_t *>(malloc(capacity));
+    if (chunk->out == nullptr) {
+      diag_errx(1, "%s:%d: Cannot allocate %" PRIu64 " bytes", __FILE__,
+                __LINE__, capacity);
+    }
+    stream.next_out = chunk->out;
+    stream.avail_out = capacity;
+    for (size_t i = chunk->first_segment; i < chunk->last_segment; ++i) {
+      stream.next_in = const_cast<uint8_t *>(segments[i].first);
+      stream.avail_in = segments[i].second;
+      chunk->crc =
+          ComputeCrc32(chunk->crc, segments[i].first, segments[i].second);
+      bool last_input = i + 1 == chunk->last_segment;
+      int flush =
+          last_input ? (chunk->last ? Z_FINISH : Z_SYNC_FLUSH) : Z_NO_FLUSH;
+      ret = deflate(&stream, flush);
+      if (ret != (flush == Z_FINISH ? Z_STREAM_END : Z_OK) ||
+          stream.avail_in != 0) {
+        diag_errx(2, "%s:%d: deflate error %d(%s)", __FILE__, __LINE__, ret,
+                  stream.msg);
+      }
+    }
+    chunk->out_size = capacity - stream.avail_out;
+    deflateEnd(&stream);
+  }
+};
+
+#endif  // BAZEL_SRC_TOOLS_SINGLEJAR_PARALLEL_DEFLATER_H_
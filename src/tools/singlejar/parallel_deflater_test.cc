@@ -0,0 +1,105 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/parallel_deflater.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "src/tools/singlejar/zlib_interface.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+// Somewhat compressible data, split into segments of different sizes.
+class ParallelDeflaterTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    const size_t kSegmentSizes[] = {1000, 300000, 1 << 20, 5,
+                                    3 << 20, 123456, 777777};
+    uint32_t seed = 12345;
+    for (size_t size : kSegmentSizes) {
+      std::string *segment = new std::string(size, '\0');
+      for (size_t i = 0; i < size; ++i) {
+        seed = seed * 1103515245 + 12345;
+        (*segment)[i] = "abcdefgh"[(seed >> 16) & 7];
+      }
+      data_.emplace_back(segment);
+      segments_.emplace_back(
+          reinterpret_cast<const uint8_t *>(segment->data()), size);
+      expected_ += *segment;
+    }
+  }
+
+  void TearDown() override { ParallelDeflater::set_max_threads(1); }
+
+  std::string Compress(int threads) {
+    ParallelDeflater::set_max_threads(threads);
+    std::string compressed(expected_.size(), '\0');
+    uint64_t compressed_size;
+    uint32_t checksum;
+    EXPECT_TRUE(ParallelDeflater::Deflate(
+        segments_, reinterpret_cast<uint8_t *>(&compressed[0]),
+        compressed.size(), &compressed_size, &checksum));
+    EXPECT_EQ(crc32(0, reinterpret_cast<const uint8_t *>(expected_.data()),
+                    expected_.size()),
+              checksum);
+    compressed.resize(compressed_size);
+    return compressed;
+  }
+
+  std::vector<std::unique_ptr<std::string> > data_;
+  std::vector<ParallelDeflater::Segment> segments_;
+  std::string expected_;
+};
+
+TEST_F(ParallelDeflaterTest, RoundTrip) {
+  std::string compressed = Compress(4);
+  ASSERT_LT(compressed.size(), expected_.size());
+
+  Inflater inflater;
+  inflater.DataToInflate(reinterpret_cast<const uint8_t *>(compressed.data()),
+                         compressed.size());
+  std::string uncompressed(expected_.size() + 1, '\0');
+  EXPECT_EQ(Z_STREAM_END,
+            inflater.Inflate(reinterpret_cast<uint8_t *>(&uncompressed[0]),
+                             uncompressed.size()));
+  uncompressed.resize(uncompressed.size() - inflater.available_out());
+  EXPECT_EQ(expected_, uncompressed);
+}
+
+TEST_F(ParallelDeflaterTest, SameOutputForAnyThreadCount) {
+  std::string compressed = Compress(2);
+  EXPECT_EQ(compressed, Compress(3));
+  EXPECT_EQ(compressed, Compress(16));
+}
+
+TEST_F(ParallelDeflaterTest, DoesNotFit) {
+  ParallelDeflater::set_max_threads(4);
+  uint8_t buffer[100];
+  uint64_t compressed_size;
+  uint32_t checksum;
+  EXPECT_FALSE(ParallelDeflater::Deflate(segments_, buffer, sizeof(buffer),
+                                         &compressed_size, &checksum));
+}
+
+TEST_F(ParallelDeflaterTest, ShouldUse) {
+  EXPECT_FALSE(ParallelDeflater::ShouldUse(100 << 20));
+  ParallelDeflater::set_max_threads(2);
+  EXPECT_TRUE(ParallelDeflater::ShouldUse(100 << 20));
+  EXPECT_FALSE(ParallelDeflater::ShouldUse(1000));
+}
+
+}  //  namespace
@@ -0,0 +1,118 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/relink_index.h"
+
+#include <stdio.h>
+
+#include <fstream>
+#include <string>
+
+#include "src/tools/singlejar/diag.h"
+
+static const char kIndexHeader[] = "singlejar-relink-index 1";
+
+bool RelinkIndex::Read(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    return false;
+  }
+  std::string line;
+  if (!std::getline(in, line) || line != kIndexHeader) {
+    return false;
+  }
+  unsigned long long settings;  // NOLINT(runtime/int)
+  if (!std::getline(in, line) ||
+      sscanf(line.c_str(), "settings %llx", &settings) != 1) {
+    return false;
+  }
+  unsigned long long output_size, cen_offset, cen_digest;  // NOLINT
+  unsigned long long garbage = 0;                          // NOLINT
+  if (!std::getline(in, line) ||
+      sscanf(line.c_str(), "output %llu %llu %llx %llu", &output_size,
+             &cen_offset, &cen_digest, &garbage) < 3 ||
+      garbage > output_size) {
+    return false;
+  }
+  settings_ = settings;
+  set_output(output_size, cen_offset, cen_digest);
+  garbage_ = garbage;
+  jars_.clear();
+  while (std::getline(in, line)) {
+    unsigned long long digest, begin, end, cen_begin, cen_end,  // NOLINT
+        entries;
+    int path_pos = -1;
+    if (sscanf(line.c_str(), "jar %llx %llu %llu %llu %llu %llu %n", &digest,
+               &begin, &end, &cen_begin, &cen_end, &entries, &path_pos) != 6 ||
+        path_pos < 0 || begin > end || cen_begin > cen_end ||
+        end > output_size || cen_end > output_size) {
+      jars_.clear();
+      return false;
+    }
+    jars_[line.substr(path_pos)] =
+        JarRecord{digest, begin, end, cen_begin, cen_end, entries};
+  }
+  return true;
+}
+
+bool RelinkIndex::Write(const std::string &path) const {
+  std::string temp_path = path + ".tmp";
+  FILE *out = fopen(temp_path.c_str(), "wb");
+  if (out == nullptr) {
+    diag_warn("%s:%d: cannot create %s", __FILE__, __LINE__,
+              temp_path.c_str());
+    return false;
+  }
+  fprintf(out, "%s\n", kIndexHeader);
+  fprintf(out, "settings %" PRIx64 "\n", settings_);
+  fprintf(out, "output %" PRIu64 " %" PRIu64 " %" PRIx64 " %" PRIu64 "\n",
+          output_size_, cen_offset_, cen_digest_, garbage_);
+  for (const auto &jar : jars_) {
+    const JarRecord &r = jar.second;
+    fprintf(out,
+            "jar %" PRIx64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
+            " %" PRIu64 " %s\n",
+            r.digest, r.begin, r.end, r.cen_begin, r.cen_end, r.entries,
+            jar.first.c_str());
+  }
+  if (fclose(out)) {
+    diag_warn("%s:%d: cannot write %s", __FILE__, __LINE__, temp_path.c_str());
+    remove(temp_path.c_str());
+    return false;
+  }
+#ifdef _WIN32
+  // rename() does not replace existing files on Windows.
+  remove(path.c_str());
+#endif
+  if (rename(temp_path.c_str(), path.c_str())) {
+    diag_warn("%s:%d: cannot rename %s to %s", __FILE__, __LINE__,
+              temp_path.c_str(), path.c_str());
+    remove(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+void RelinkIndex::AddJar(const std::string &path, const JarRecord &record) {
+  if (path.empty() || path.find_first_of("\r\n") != std::string::npos) {
+    return;
+  }
+  jars_[path] = record;
+}
+
+const RelinkIndex::JarRecord *RelinkIndex::FindJar(
+    const std::string &path) const {
+  auto it = jars_.find(path);
+  return it == jars_.end() ? nullptr : &it->second;
+}
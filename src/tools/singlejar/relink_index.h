@@ -0,0 +1,103 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_RELINK_INDEX_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_RELINK_INDEX_H_ 1
+
+#include <cinttypes>
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+
+#include "src/tools/singlejar/fingerprint.h"
+
+/*
+ * The index singlejar keeps next to the output jar with --incremental_index.
+ * It describes where the contents of each input jar went in the output:
+ * a contiguous byte range (the local headers and data of its entries, plus
+ * the parent directory entries created for them), and a contiguous range of
+ * the central directory. An input jar is identified by its path, and its
+ * digest covers both the jar's central directory and the decisions made for
+ * each of its entries (skipped as a duplicate, merged into a combiner,
+ * copied, recompressed). The decisions also depend on the entries added by
+ * the preceding jars, so a matching digest means that the jar would be
+ * written exactly as before and its byte ranges can be copied.
+ * With --incremental_append, the ranges stay where they are, and the output
+ * accumulates the bytes an update no longer references, which the index
+ * counts so that the output can be written anew once there are too many.
+ *
+ * The index is a text file:
+ *   singlejar-relink-index 1
+ *   settings <hex digest of the options affecting all entries>
+ *   output <size> <central directory offset> <hex digest of the directory>
+ *       [<bytes no longer referenced by the central directory>]
+ *   jar <hex digest> <begin> <end> <cen begin> <cen end> <entries> <path>
+ *   ...
+ */
+class RelinkIndex {
+ public:
+  struct JarRecord {
+    uint64_t digest;
+    // Byte range in the output file.
+    uint64_t begin;
+    uint64_t end;
+    // Byte range in the central directory.
+    uint64_t cen_begin;
+    uint64_t cen_end;
+    // The number of the central directory entries in the above range.
+    uint64_t entries;
+  };
+
+  RelinkIndex() : settings_(0), output_size_(0), cen_offset_(0),
+                  cen_digest_(0), garbage_(0) {}
+
+  // Reads the index, returns false if there is none or it is malformed.
+  bool Read(const std::string &path);
+
+  // Writes the index to a temporary file and renames it.
+  bool Write(const std::string &path) const;
+
+  // Records an input jar. Paths containing line breaks are not recorded.
+  void AddJar(const std::string &path, const JarRecord &record);
+
+  // Returns the record for the given input jar or nullptr.
+  const JarRecord *FindJar(const std::string &path) const;
+
+  uint64_t settings() const { return settings_; }
+  void set_settings(uint64_t settings) { settings_ = settings; }
+
+  // The output file this index describes.
+  uint64_t output_size() const { return output_size_; }
+  uint64_t cen_offset() const { return cen_offset_; }
+  uint64_t cen_digest() const { return cen_digest_; }
+  void set_output(uint64_t output_size, uint64_t cen_offset,
+                  uint64_t cen_digest) {
+    output_size_ = output_size;
+    cen_offset_ = cen_offset;
+    cen_digest_ = cen_digest;
+  }
+  // The bytes of the output which its central directory does not reference.
+  uint64_t garbage() const { return garbage_; }
+  void set_garbage(uint64_t garbage) { garbage_ = garbage; }
+
+ private:
+  uint64_t settings_;
+  uint64_t output_size_;
+  uint64_t cen_offset_;
+  uint64_t cen_digest_;
+  uint64_t garbage_;
+  std::unordered_map<std::string, JarRecord> jars_;
+};
+
+#endif  // BAZEL_SRC_TOOLS_SINGLEJAR_RELINK_INDEX_H_
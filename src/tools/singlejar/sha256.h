@@ -0,0 +1,46 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_SHA256_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_SHA256_H_ 1
+
+#include <cstddef>
+#include <cstdint>
+
+// SHA-256 (FIPS 180-4) of a stream of bytes, which OutputJar computes of the
+// output as it writes it, so that Bazel does not have to read the output
+// back to digest it.
+class Sha256 {
+ public:
+  static constexpr size_t kDigestLength = 32;
+
+  Sha256();
+
+  void Update(const void *data, size_t size);
+
+  // Writes the digest of the bytes passed to Update() to `digest`. The
+  // instance cannot be updated any more afterwards.
+  void Finish(uint8_t digest[kDigestLength]);
+
+ private:
+  // Processes `count` blocks of 64 bytes.
+  void Transform(const uint8_t *blocks, size_t count);
+
+  uint32_t state_[8];
+  uint64_t length_;  // In bytes.
+  uint8_t buffer_[64];
+  size_t buffered_;
+};
+
+#endif  // BAZEL_SRC_TOOLS_SINGLEJAR_SHA256_H_
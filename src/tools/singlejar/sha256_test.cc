@@ -0,0 +1,94 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/sha256.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+std::string Hex(const uint8_t *digest) {
+  static const char kHex[] = "0123456789abcdef";
+  std::string hex;
+  for (size_t i = 0; i < Sha256::kDigestLength; ++i) {
+    hex += kHex[digest[i] >> 4];
+    hex += kHex[digest[i] & 0xF];
+  }
+  return hex;
+}
+
+std::string DigestOf(const std::string &data) {
+  Sha256 sha256;
+  sha256.Update(data.data(), data.size());
+  uint8_t digest[Sha256::kDigestLength];
+  sha256.Finish(digest);
+  return Hex(digest);
+}
+
+TEST(Sha256Test, KnownValues) {
+  EXPECT_EQ("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+            DigestOf(""));
+  EXPECT_EQ("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+            DigestOf("abc"));
+  EXPECT_EQ("248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+            DigestOf("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnop"
+                     "q"));
+  EXPECT_EQ("cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0",
+            DigestOf(std::string(1000000, 'a')));
+}
+
+// Updating in pieces of any size, across the block boundaries, gives the
+// same digest as at once. The sizes around 56 and 64 bytes are the edge
+// cases of the padding.
+TEST(Sha256Test, InPieces) {
+  std::vector<uint8_t> data(100000);
+  std::mt19937 random(42);
+  for (auto &byte : data) {
+    byte = static_cast<uint8_t>(random());
+  }
+  for (size_t size = 0; size < 200; ++size) {
+    uint8_t expected[Sha256::kDigestLength];
+    Sha256 at_once;
+    at_once.Update(data.data(), size);
+    at_once.Finish(expected);
+    Sha256 bytewise;
+    for (size_t i = 0; i < size; ++i) {
+      bytewise.Update(&data[i], 1);
+    }
+    uint8_t digest[Sha256::kDigestLength];
+    bytewise.Finish(digest);
+    ASSERT_EQ(Hex(expected), Hex(digest)) << "size " << size;
+  }
+
+  uint8_t expected[Sha256::kDigestLength];
+  Sha256 at_once;
+  at_once.Update(data.data(), data.size());
+  at_once.Finish(expected);
+  Sha256 pieces;
+  for (size_t pos = 0; pos < data.size();) {
+    size_t size = std::min<size_t>(random() % 1000, data.size() - pos);
+    pieces.Update(data.data() + pos, size);
+    pos += size;
+  }
+  uint8_t digest[Sha256::kDigestLength];
+  pieces.Finish(digest);
+  EXPECT_EQ(Hex(expected), Hex(digest));
+}
+
+}  // namespace
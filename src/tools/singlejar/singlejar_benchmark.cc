@@ -0,0 +1,511 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Measures singlejar on synthetic inputs.
+ *
+ *   singlejar_benchmark [--work_dir DIR] [--scale F] [--repeat N]
+ *                       [--scenario NAME]... [-- SINGLEJAR_OPTION...]
+ *
+ * Each scenario generates its input jars under DIR (default: $TMPDIR or
+ * /tmp), then runs OutputJar::Doit on them once per option combination,
+ * N times each. Every run happens in a forked child, so that its peak RSS
+ * is its own. The best wall time and the largest peak RSS of the runs are
+ * reported, along with the input bytes merged per second. The options
+ * after `--` are added to every run, e.g. `-- --jobs 8`.
+ *
+ * The generated jars depend only on the scenario and the scale, so the
+ * numbers from different trees can be compared.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cinttypes>
+#include <string>
+#include <vector>
+
+#include "src/tools/singlejar/diag.h"
+#include "src/tools/singlejar/options.h"
+#include "src/tools/singlejar/output_jar.h"
+#include "src/tools/singlejar/zip_headers.h"
+#include <zlib.h>
+
+namespace {
+
+// 2010-01-01 00:00:00 in DOS format.
+const uint16_t kDosDate = ((2010 - 1980) << 9) | (1 << 5) | 1;
+const uint16_t kDosTime = 0;
+
+// A deterministic source of pseudo-random bytes (xorshift64*).
+class Random {
+ public:
+  explicit Random(uint64_t seed) : state_(seed | 1) {}
+
+  uint64_t Next() {
+    state_ ^= state_ >> 12;
+    state_ ^= state_ << 25;
+    state_ ^= state_ >> 27;
+    return state_ * 0x2545F4914F6CDD1DULL;
+  }
+
+  void Fill(uint8_t *data, size_t size) {
+    for (size_t i = 0; i < size; i += 8) {
+      uint64_t v = Next();
+      memcpy(data + i, &v, size - i < 8 ? size - i : 8);
+    }
+  }
+
+ private:
+  uint64_t state_;
+};
+
+// Writes a jar entry by entry. The scenarios stay below 64K entries and
+// 4GB per jar, so there are no Zip64 records.
+class JarWriter {
+ public:
+  explicit JarWriter(const std::string &path) : path_(path), offset_(0) {
+    file_ = fopen(path.c_str(), "wb");
+    if (file_ == nullptr) {
+      diag_err(1, "%s:%d: %s", __FILE__, __LINE__, path.c_str());
+    }
+  }
+
+  // Adds an entry, deflating it if `compress` is set.
+  void Add(const std::string &name, const uint8_t *data, size_t size,
+           bool compress) {
+    const uint8_t *payload = data;
+    size_t payload_size = size;
+    std::vector<uint8_t> deflated;
+    if (compress) {
+      z_stream stream;
+      memset(&stream, 0, sizeof(stream));
+      if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS,
+                       8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        diag_errx(1, "%s:%d: deflateInit2 failed", __FILE__, __LINE__);
+      }
+      deflated.resize(deflateBound(&stream, size));
+      stream.next_in = const_cast<uint8_t *>(data);
+      stream.avail_in = size;
+      stream.next_out = deflated.data();
+      stream.avail_out = deflated.size();
+      if (deflate(&stream, Z_FINISH) != Z_STREAM_END) {
+        diag_errx(1, "%s:%d: deflate failed", __FILE__, __LINE__);
+      }
+      payload = deflated.data();
+      payload_size = stream.total_out;
+      deflateEnd(&stream);
+    }
+    uint32_t crc = crc32(0, data, size);
+
+    std::vector<uint8_t> lh_buffer(sizeof(LH) + name.size());
+    LH *lh = reinterpret_cast<LH *>(lh_buffer.data());
+    lh->signature();
+    lh->version(20);
+    lh->bit_flag(0);
+    lh->compression_method(compress ? Z_DEFLATED : 0);
+    lh->last_mod_file_time(kDosTime);
+    lh->last_mod_file_date(kDosDate);
+    lh->crc32(crc);
+    lh->compressed_file_size32(payload_size);
+    lh->uncompressed_file_size32(size);
+    lh->file_name(name.c_str(), name.size());
+    lh->extra_fields(nullptr, 0);
+    uint64_t lh_offset = offset_;
+    Write(lh, lh->size());
+    Write(payload, payload_size);
+
+    size_t cdh_offset = cdh_.size();
+    cdh_.resize(cdh_offset + sizeof(CDH) + name.size());
+    CDH *cdh = reinterpret_cast<CDH *>(cdh_.data() + cdh_offset);
+    cdh->signature();
+    cdh->version(20);
+    cdh->version_to_extract(20);
+    cdh->bit_flag(0);
+    cdh->compression_method(compress ? Z_DEFLATED : 0);
+    cdh->last_mod_file_time(kDosTime);
+    cdh->last_mod_file_date(kDosDate);
+    cdh->crc32(crc);
+    cdh->compressed_file_size32(payload_size);
+    cdh->uncompressed_file_size32(size);
+    cdh->file_name(name.c_str(), name.size());
+    cdh->extra_fields(nullptr, 0);
+    cdh->comment_length(0);
+    cdh->start_disk_nr(0);
+    cdh->internal_attributes(0);
+    cdh->external_attributes(0);
+    cdh->local_header_offset32(lh_offset);
+    ++entries_;
+  }
+
+  void Add(const std::string &name, const std::string &data, bool compress) {
+    Add(name, reinterpret_cast<const uint8_t *>(data.data()), data.size(),
+        compress);
+  }
+
+  // Writes the central directory and closes the file. Returns the size
+  // of the jar.
+  uint64_t Close() {
+    uint64_t cen_offset = offset_;
+    Write(cdh_.data(), cdh_.size());
+    ECD ecd;
+    ecd.signature();
+    ecd.this_disk_nr(0);
+    ecd.cen_disk_nr(0);
+    ecd.this_disk_entries16(entries_);
+    ecd.total_entries16(entries_);
+    ecd.cen_size32(cdh_.size());
+    ecd.cen_offset32(cen_offset);
+    ecd.comment(nullptr, 0);
+    Write(&ecd, sizeof(ecd));
+    if (fclose(file_)) {
+      diag_err(1, "%s:%d: %s", __FILE__, __LINE__, path_.c_str());
+    }
+    return offset_;
+  }
+
+ private:
+  void Write(const void *data, size_t size) {
+    if (size && fwrite(data, size, 1, file_) != 1) {
+      diag_err(1, "%s:%d: %s", __FILE__, __LINE__, path_.c_str());
+    }
+    offset_ += size;
+  }
+
+  std::string path_;
+  FILE *file_;
+  uint64_t offset_;
+  uint16_t entries_ = 0;
+  std::vector<uint8_t> cdh_;
+};
+
+// Returns the contents of a small class file. Class files share most of
+// their constant pool, so they are generated from a handful of words.
+std::string ClassContents(Random *random, const std::string &class_name,
+                          size_t size) {
+  static const char *const kWords[] = {
+      "java/lang/Object", "<init>", "()V", "Code", "LineNumberTable",
+      "SourceFile", "java/lang/String", "toString", "hashCode", "equals",
+      "(Ljava/lang/Object;)Z", "()I", "StackMapTable", "this"};
+  std::string contents("\xCA\xFE\xBA\xBE\x00\x00\x00\x34", 8);
+  contents += class_name;
+  while (contents.size() < size) {
+    uint64_t r = random->Next();
+    contents += kWords[r % (sizeof(kWords) / sizeof(kWords[0]))];
+    contents += static_cast<char>(r >> 32);
+    contents += static_cast<char>(r >> 40);
+  }
+  contents.resize(size);
+  return contents;
+}
+
+std::string ClassName(int jar, int index) {
+  char name[64];
+  snprintf(name, sizeof(name), "com/example/p%d/c%d/Class%d.class", jar,
+           index / 100, index);
+  return name;
+}
+
+struct Inputs {
+  std::vector<std::string> jars;
+  uint64_t bytes = 0;
+};
+
+// Thousands of small jars, as for a binary with a large classpath.
+void ManyJars(double scale, const std::string &dir, Inputs *inputs) {
+  Random random(1);
+  int jar_count = 4000 * scale;
+  for (int i = 0; i < jar_count; ++i) {
+    std::string path = dir + "/lib" + std::to_string(i) + ".jar";
+    JarWriter jar(path);
+    jar.Add("META-INF/", std::string(), false);
+    jar.Add("META-INF/MANIFEST.MF", "Manifest-Version: 1.0\r\n\r\n", true);
+    for (int j = 0; j < 25; ++j) {
+      jar.Add(ClassName(i, j),
+              ClassContents(&random, ClassName(i, j), 300 + j * 40), true);
+    }
+    jar.Add("com/example/p" + std::to_string(i) + "/strings.properties",
+            ClassContents(&random, "strings", 2000), true);
+    inputs->bytes += jar.Close();
+    inputs->jars.push_back(path);
+  }
+}
+
+// Millions of tiny classes in a few large jars.
+void TinyClasses(double scale, const std::string &dir, Inputs *inputs) {
+  Random random(2);
+  int class_count = 1000000 * scale;
+  const int kClassesPerJar = 50000;
+  for (int i = 0; i * kClassesPerJar < class_count; ++i) {
+    std::string path = dir + "/classes" + std::to_string(i) + ".jar";
+    JarWriter jar(path);
+    for (int j = 0; j < kClassesPerJar && i * kClassesPerJar + j < class_count;
+         ++j) {
+      jar.Add(ClassName(i, j),
+              ClassContents(&random, ClassName(i, j), 100 + j % 200), true);
+    }
+    inputs->bytes += jar.Close();
+    inputs->jars.push_back(path);
+  }
+}
+
+// A few jars with huge stored resources, which barely compress.
+void HugeResources(double scale, const std::string &dir, Inputs *inputs) {
+  Random random(3);
+  size_t resource_size = (256 << 20) * scale;
+  std::vector<uint8_t> data(resource_size);
+  for (int i = 0; i < 4; ++i) {
+    std::string path = dir + "/resources" + std::to_string(i) + ".jar";
+    JarWriter jar(path);
+    random.Fill(data.data(), data.size());
+    // Half of each resource is text, which does compress.
+    for (size_t j = 0; j < data.size() / 2; ++j) {
+      data[j] = 'a' + data[j] % 8;
+    }
+    jar.Add("assets/blob" + std::to_string(i) + ".bin", data.data(),
+            data.size(), false);
+    for (int j = 0; j < 10; ++j) {
+      jar.Add(ClassName(i, j), ClassContents(&random, ClassName(i, j), 500),
+              true);
+    }
+    inputs->bytes += jar.Close();
+    inputs->jars.push_back(path);
+  }
+}
+
+// Many jars registering providers of the same services, which singlejar
+// concatenates.
+void ManyServices(double scale, const std::string &dir, Inputs *inputs) {
+  Random random(4);
+  int jar_count = 2000 * scale;
+  for (int i = 0; i < jar_count; ++i) {
+    std::string path = dir + "/services" + std::to_string(i) + ".jar";
+    JarWriter jar(path);
+    for (int j = 0; j < 8; ++j) {
+      int service = (i + j * 7) % 32;
+      jar.Add("META-INF/services/com.example.Service" +
+                  std::to_string(service),
+              "com.example.p" + std::to_string(i) + ".Provider" +
+                  std::to_string(j) + "\n",
+              true);
+    }
+    for (int j = 0; j < 8; ++j) {
+      jar.Add(ClassName(i, j), ClassContents(&random, ClassName(i, j), 400),
+              true);
+    }
+    inputs->bytes += jar.Close();
+    inputs->jars.push_back(path);
+  }
+}
+
+struct Scenario {
+  const char *name;
+  void (*generate)(double scale, const std::string &dir, Inputs *inputs);
+};
+
+const Scenario kScenarios[] = {
+    {"many_jars", ManyJars},
+    {"tiny_classes", TinyClasses},
+    {"huge_resources", HugeResources},
+    {"many_services", ManyServices},
+};
+
+const std::vector<std::vector<std::string>> kOptionSets = {
+    {},
+    {"--normalize"},
+    {"--compression"},
+    {"--dont_change_compression"},
+    {"--normalize", "--compression"},
+};
+
+struct Result {
+  double wall_seconds;
+  uint64_t max_rss;
+  uint64_t output_bytes;
+};
+
+// Runs OutputJar::Doit in a child process.
+Result Run(const Inputs &inputs, const std::string &output,
+           const std::vector<std::string> &options) {
+  std::vector<std::string> args = {"--output", output, "--sources"};
+  args.insert(args.end(), inputs.jars.begin(), inputs.jars.end());
+  args.insert(args.end(), options.begin(), options.end());
+  std::vector<const char *> argv;
+  for (const auto &arg : args) {
+    argv.push_back(arg.c_str());
+  }
+
+  // The child would flush the buffered output again.
+  fflush(stdout);
+  auto start = std::chrono::steady_clock::now();
+  pid_t pid = fork();
+  if (pid < 0) {
+    diag_err(1, "%s:%d: fork", __FILE__, __LINE__);
+  }
+  if (pid == 0) {
+    Options parsed_options;
+    parsed_options.ParseCommandLine(argv.size(), argv.data());
+    OutputJar output_jar;
+    int exit_code = output_jar.Doit(&parsed_options);
+    fflush(stdout);
+    fflush(stderr);
+    _exit(exit_code);
+  }
+  int status;
+  struct rusage usage;
+  if (wait4(pid, &status, 0, &usage) != pid) {
+    diag_err(1, "%s:%d: wait4", __FILE__, __LINE__);
+  }
+  auto end = std::chrono::steady_clock::now();
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    diag_errx(1, "%s:%d: singlejar failed with status %d", __FILE__,
+              __LINE__, status);
+  }
+
+  Result result;
+  result.wall_seconds = std::chrono::duration<double>(end - start).count();
+#if defined(__APPLE__)
+  result.max_rss = usage.ru_maxrss;
+#else
+  result.max_rss = static_cast<uint64_t>(usage.ru_maxrss) << 10;
+#endif
+  struct stat st;
+  result.output_bytes = stat(output.c_str(), &st) ? 0 : st.st_size;
+  return result;
+}
+
+std::string Join(const std::vector<std::string> &options) {
+  std::string result;
+  for (const auto &option : options) {
+    if (!result.empty()) {
+      result += ' ';
+    }
+    result += option;
+  }
+  return result.empty() ? "(defaults)" : result;
+}
+
+void Usage() {
+  fprintf(stderr,
+          "usage: singlejar_benchmark [--work_dir DIR] [--scale F] "
+          "[--repeat N] [--scenario NAME]... [-- SINGLEJAR_OPTION...]\n"
+          "scenarios:");
+  for (const auto &scenario : kScenarios) {
+    fprintf(stderr, " %s", scenario.name);
+  }
+  fprintf(stderr, "\n");
+  exit(2);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  const char *tmpdir = getenv("TMPDIR");
+  std::string work_dir = tmpdir && *tmpdir ? tmpdir : "/tmp";
+  double scale = 1.0;
+  int repeat = 3;
+  std::vector<std::string> scenario_names;
+  std::vector<std::string> extra_options;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--") {
+      extra_options.assign(argv + i + 1, argv + argc);
+      break;
+    }
+    if (i + 1 >= argc) {
+      Usage();
+    }
+    if (arg == "--work_dir") {
+      work_dir = argv[++i];
+    } else if (arg == "--scale") {
+      scale = strtod(argv[++i], nullptr);
+    } else if (arg == "--repeat") {
+      repeat = atoi(argv[++i]);
+    } else if (arg == "--scenario") {
+      scenario_names.push_back(argv[++i]);
+    } else {
+      Usage();
+    }
+  }
+  if (scale <= 0 || repeat <= 0) {
+    Usage();
+  }
+  for (const auto &name : scenario_names) {
+    bool found = false;
+    for (const auto &scenario : kScenarios) {
+      found |= name == scenario.name;
+    }
+    if (!found) {
+      Usage();
+    }
+  }
+
+  printf("%-15s %-30s %9s %10s %9s %10s\n", "scenario", "options", "wall(s)",
+         "rss(MB)", "in(MB/s)", "out(MB)");
+  for (const auto &scenario : kScenarios) {
+    bool selected = scenario_names.empty();
+    for (const auto &name : scenario_names) {
+      selected |= name == scenario.name;
+    }
+    if (!selected) {
+      continue;
+    }
+    std::string dir =
+        work_dir + "/singlejar_benchmark." + std::to_string(getpid()) + "." +
+        scenario.name;
+    if (mkdir(dir.c_str(), 0777)) {
+      diag_err(1, "%s:%d: %s", __FILE__, __LINE__, dir.c_str());
+    }
+    Inputs inputs;
+    scenario.generate(scale, dir, &inputs);
+    std::string output = dir + "/output.jar";
+
+    for (const auto &option_set : kOptionSets) {
+      std::vector<std::string> options = option_set;
+      options.insert(options.end(), extra_options.begin(),
+                     extra_options.end());
+      Result best = {0, 0, 0};
+      for (int i = 0; i < repeat; ++i) {
+        Result result = Run(inputs, output, options);
+        if (i == 0 || result.wall_seconds < best.wall_seconds) {
+          best.wall_seconds = result.wall_seconds;
+        }
+        if (result.max_rss > best.max_rss) {
+          best.max_rss = result.max_rss;
+        }
+        best.output_bytes = result.output_bytes;
+        unlink(output.c_str());
+      }
+      printf("%-15s %-30s %9.3f %10.1f %9.1f %10.1f\n", scenario.name,
+             Join(options).c_str(), best.wall_seconds,
+             best.max_rss / 1048576.0,
+             inputs.bytes / 1048576.0 / best.wall_seconds,
+             best.output_bytes / 1048576.0);
+      fflush(stdout);
+    }
+
+    for (const auto &jar : inputs.jars) {
+      unlink(jar.c_str());
+    }
+    rmdir(dir.c_str());
+  }
+  return 0;
+}
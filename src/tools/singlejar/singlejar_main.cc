@@ -12,17 +12,104 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <stdio.h>
+#include <string.h>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "src/tools/one_version/allowlist.h"
+#include "src/tools/one_version/duplicate_class_collector.h"
+#include "src/tools/one_version/one_version.h"
+#include "src/tools/singlejar/combiner_cache.h"
 #include "src/tools/singlejar/combiners.h"
 #include "src/tools/singlejar/diag.h"
+#include "src/tools/singlejar/input_jar_cache.h"
 #include "src/tools/singlejar/options.h"
 #include "src/tools/singlejar/output_jar.h"
+#include "third_party/ijar/worker.h"
 
-int main(int argc, char *argv[]) {
-  Options options;
-  options.ParseCommandLine(argc - 1, argv + 1);
-  OutputJar output_jar;
+// What a persistent worker keeps between requests: the input jars, whose
+// number is bounded by the open files they take, combined entries, and the
+// manifests, build data and classpath resources it has written.
+static const size_t kWorkerInputJars = 512;
+static const size_t kWorkerInputJarBytes = static_cast<size_t>(2) << 30;
+static const size_t kWorkerCombinerCacheBytes = 64 << 20;
+static const size_t kWorkerPreambleCacheBytes = 16 << 20;
+
+// With --enforce_one_version: an output jar that also checks its classpath
+// for one version violations, from the central directories of the input jars
+// as it goes through them, rather than having a separate action open them
+// all once more.
+class OneVersionOutputJar : public OutputJar {
+ public:
+  explicit OneVersionOutputJar(
+      std::unique_ptr<one_version::Allowlist> allowlist)
+      : one_version_(std::move(allowlist)) {}
+
+  void ExtraHandler(const std::string &input_jar_path, const CDH *entry,
+                    const std::string *input_jar_aux_label) override {
+    // The entries of a jar come one after the other, so the label is only
+    // made anew for the next jar.
+    if (label_ == nullptr || label_->jar() != input_jar_path) {
+      label_ = std::make_unique<one_version::Label>(
+          input_jar_aux_label != nullptr && !input_jar_aux_label->empty()
+              ? *input_jar_aux_label
+              : input_jar_path,
+          input_jar_path, /*allowlisted=*/false);
+    }
+    one_version_.Add(
+        absl::string_view(entry->file_name(), entry->file_name_length()),
+        entry, *label_);
+  }
+
+  // Reports the violations found by Doit(). Returns whether there were any.
+  bool ReportViolations() {
+    std::vector<one_version::Violation> violations = one_version_.Report();
+    if (violations.empty()) {
+      return false;
+    }
+    fprintf(stderr, "Found one definition violations on the runtime classpath:"
+            "\n%s",
+            one_version::DuplicateClassCollector::Report(violations).c_str());
+    return true;
+  }
+
+ private:
+  one_version::OneVersion one_version_;
+  std::unique_ptr<one_version::Label> label_;
+};
+
+// Writes the output jar, with the caches of a persistent worker if they are
+// not null.
+static int Run(Options *options, InputJarCache *input_jar_cache,
+               CombinerCache *combiner_cache, CombinerCache *preamble_cache) {
+  std::unique_ptr<OneVersionOutputJar> one_version_jar;
+  std::unique_ptr<OutputJar> plain_jar;
+  if (options->enforce_one_version) {
+    std::string error;
+    std::unique_ptr<one_version::Allowlist> allowlist =
+        one_version::OpenAllowlist(options->one_version_allowlist, &error);
+    if (!allowlist) {
+      diag_errx(1, "%s:%d: %s", __FILE__, __LINE__, error.c_str());
+    }
+    one_version_jar =
+        std::make_unique<OneVersionOutputJar>(std::move(allowlist));
+  } else {
+    plain_jar = std::make_unique<OutputJar>();
+  }
+  OutputJar &output_jar =
+      one_version_jar != nullptr ? *one_version_jar : *plain_jar;
+  if (input_jar_cache != nullptr) {
+    output_jar.SetWorkerCaches(input_jar_cache, combiner_cache,
+                               preamble_cache);
+  }
   // TODO(b/67733424): support desugar deps checking in Bazel
-  if (options.check_desugar_deps) {
+  if (options->check_desugar_deps) {
     diag_errx(1, "%s:%d: Desugar checking not currently supported in Bazel.",
                  __FILE__, __LINE__);
   } else {
@@ -30,5 +117,50 @@ int main(int argc, char *argv[]) {
   }
   output_jar.ExtraCombiner("reference.conf",
                            new Concatenator("reference.conf"));
-  return output_jar.Doit(&options);
+  int exit_code = output_jar.Doit(options);
+  if (exit_code == 0 && one_version_jar != nullptr &&
+      one_version_jar->ReportViolations() &&
+      !options->succeed_on_found_violations) {
+    exit_code = 1;
+  }
+  return exit_code;
+}
+
+// Serves requests of the JSON worker protocol read from stdin, one output
+// jar each. The input jars and the combined entries stay cached between
+// requests, so that the deploy jars sharing most of their inputs do not read
+// them again. Errors are fatal, as they are for a single invocation, and
+// Bazel then reports the failure of the worker.
+static int RunPersistentWorker() {
+  InputJarCache input_jar_cache(kWorkerInputJars, kWorkerInputJarBytes);
+  CombinerCache combiner_cache(std::string(), kWorkerCombinerCacheBytes);
+  CombinerCache preamble_cache(std::string(), kWorkerPreambleCacheBytes);
+  devtools_ijar::WorkRequest request;
+  while (devtools_ijar::ReadWorkRequest(stdin, &request)) {
+    std::vector<const char *> argv;
+    for (const std::string &argument : request.arguments) {
+      argv.push_back(argument.c_str());
+    }
+    std::unordered_map<std::string, std::string> digests;
+    for (const devtools_ijar::WorkRequest::Input &input : request.inputs) {
+      digests[input.path] = input.digest;
+    }
+    input_jar_cache.SetDigests(std::move(digests));
+    Options options;
+    options.ParseCommandLine(argv.size(), argv.data());
+    int exit_code =
+        Run(&options, &input_jar_cache, &combiner_cache, &preamble_cache);
+    devtools_ijar::WriteWorkResponse(stdout, exit_code, "",
+                                     request.request_id);
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc == 2 && strcmp(argv[1], "--persistent_worker") == 0) {
+    return RunPersistentWorker();
+  }
+  Options options;
+  options.ParseCommandLine(argc - 1, argv + 1);
+  return Run(&options, nullptr, nullptr, nullptr);
 }
@@ -0,0 +1,198 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_STATS_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_STATS_H_ 1
+
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <string>
+
+/*
+ * The time spent in each phase of a singlejar run and the counters of what
+ * it did, printed with --verbose and written to --stats_file.
+ *
+ * The phase timers only run when enabled. A Stats::Timer accounts the time
+ * until its destruction to its phase, less the time of the timers nested in
+ * it on the same thread, so the phase times do not overlap:
+ *
+ *   {
+ *     Stats::Timer timer(Stats::kCombine);
+ *     ...  // Counts as combining.
+ *     {
+ *       Stats::Timer inner(Stats::kInflate);
+ *       ...  // Counts as inflating only.
+ *     }
+ *   }
+ */
+class Stats {
+ public:
+  enum Phase {
+    kOpenInputs,
+    kScanCentralDirectory,
+    kInflate,
+    kDeflate,
+    kCombine,
+    kCopy,
+    kWriteCentralDirectory,
+    kPhaseCount
+  };
+
+  enum Counter {
+    kInputJars,
+    kReusedInputJars,
+    kCachedInputJars,
+    kEntries,
+    kDuplicateEntries,
+    kSharedEntries,
+    kBytesIn,
+    kBytesOut,
+    kCounterCount
+  };
+
+  class Timer {
+   public:
+    explicit Timer(Phase phase) : active_(enabled()) {
+      if (!active_) {
+        return;
+      }
+      uint64_t now = Now();
+      Current &current = current_ref();
+      if (current.phase != kPhaseCount) {
+        AddTime(current.phase, now - current.start);
+      }
+      outer_phase_ = current.phase;
+      current.phase = phase;
+      current.start = now;
+    }
+
+    ~Timer() {
+      if (!active_) {
+        return;
+      }
+      uint64_t now = Now();
+      Current &current = current_ref();
+      AddTime(current.phase, now - current.start);
+      current.phase = outer_phase_;
+      current.start = now;
+    }
+
+    Timer(const Timer &) = delete;
+    Timer &operator=(const Timer &) = delete;
+
+   private:
+    // The phase of the innermost timer running on this thread, if any,
+    // and when it was last started or resumed.
+    struct Current {
+      Phase phase;
+      uint64_t start;
+    };
+
+    static Current &current_ref() {
+      static thread_local Current current = {kPhaseCount, 0};
+      return current;
+    }
+
+    bool active_;
+    Phase outer_phase_;
+  };
+
+  static bool enabled() { return enabled_ref(); }
+  static void set_enabled(bool enabled) { enabled_ref() = enabled; }
+
+  // Zeroes the times and the counters.
+  static void Reset() {
+    for (auto &time : data().times) {
+      time.store(0, std::memory_order_relaxed);
+    }
+    for (auto &counter : data().counters) {
+      counter.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // The time spent in the phase so far, in microseconds.
+  static uint64_t time_us(Phase phase) {
+    return data().times[phase].load(std::memory_order_relaxed) / 1000;
+  }
+
+  static uint64_t value(Counter counter) {
+    return data().counters[counter].load(std::memory_order_relaxed);
+  }
+  static void Add(Counter counter, uint64_t value) {
+    data().counters[counter].fetch_add(value, std::memory_order_relaxed);
+  }
+
+  static const char *name(Phase phase) {
+    static const char *const kNames[kPhaseCount] = {
+        "open_inputs", "scan_central_directory", "inflate", "deflate",
+        "combine",     "copy",                   "write_central_directory"};
+    return kNames[phase];
+  }
+
+  static const char *name(Counter counter) {
+    static const char *const kNames[kCounterCount] = {
+        "input_jars",        "reused_input_jars", "cached_input_jars",
+        "entries",           "duplicate_entries", "shared_entries",
+        "bytes_in",          "bytes_out"};
+    return kNames[counter];
+  }
+
+  // Returns the stats as a JSON object.
+  static std::string ToJson(uint64_t wall_time_us) {
+    std::string json =
+        "{\n  \"wall_time_us\": " + std::to_string(wall_time_us) + ",\n";
+    json += "  \"phase_time_us\": {\n";
+    for (int phase = 0; phase < kPhaseCount; ++phase) {
+      json += std::string("    \"") + name(static_cast<Phase>(phase)) +
+              "\": " + std::to_string(time_us(static_cast<Phase>(phase))) +
+              (phase + 1 < kPhaseCount ? ",\n" : "\n");
+    }
+    json += "  }";
+    for (int counter = 0; counter < kCounterCount; ++counter) {
+      json += std::string(",\n  \"") + name(static_cast<Counter>(counter)) +
+              "\": " + std::to_string(value(static_cast<Counter>(counter)));
+    }
+    json += "\n}\n";
+    return json;
+  }
+
+  static uint64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+ private:
+  struct Data {
+    std::atomic<uint64_t> times[kPhaseCount];  // In nanoseconds.
+    std::atomic<uint64_t> counters[kCounterCount];
+  };
+
+  static void AddTime(Phase phase, uint64_t nanoseconds) {
+    data().times[phase].fetch_add(nanoseconds, std::memory_order_relaxed);
+  }
+
+  static bool &enabled_ref() {
+    static bool enabled = false;
+    return enabled;
+  }
+
+  static Data &data() {
+    static Data data{};
+    return data;
+  }
+};
+
+#endif  // BAZEL_SRC_TOOLS_SINGLEJAR_STATS_H_
@@ -0,0 +1,88 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/stats.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+void Sleep(int ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+TEST(StatsTest, Disabled) {
+  Stats::Reset();
+  Stats::set_enabled(false);
+  {
+    Stats::Timer timer(Stats::kCopy);
+    Sleep(10);
+  }
+  EXPECT_EQ(0U, Stats::time_us(Stats::kCopy));
+}
+
+TEST(StatsTest, NestedTimers) {
+  Stats::Reset();
+  Stats::set_enabled(true);
+  {
+    Stats::Timer timer(Stats::kCombine);
+    Sleep(10);
+    {
+      Stats::Timer inner(Stats::kInflate);
+      Sleep(50);
+    }
+    Sleep(10);
+  }
+  Stats::set_enabled(false);
+  EXPECT_LE(50000U, Stats::time_us(Stats::kInflate));
+  // The time of the nested timer is not counted twice.
+  EXPECT_LE(20000U, Stats::time_us(Stats::kCombine));
+  EXPECT_GT(50000U, Stats::time_us(Stats::kCombine));
+}
+
+TEST(StatsTest, Json) {
+  Stats::Reset();
+  Stats::Add(Stats::kEntries, 3);
+  Stats::Add(Stats::kEntries, 4);
+  Stats::Add(Stats::kBytesOut, 1234);
+  EXPECT_EQ(7U, Stats::value(Stats::kEntries));
+  EXPECT_EQ(
+      "{\n"
+      "  \"wall_time_us\": 42,\n"
+      "  \"phase_time_us\": {\n"
+      "    \"open_inputs\": 0,\n"
+      "    \"scan_central_directory\": 0,\n"
+      "    \"inflate\": 0,\n"
+      "    \"deflate\": 0,\n"
+      "    \"combine\": 0,\n"
+      "    \"copy\": 0,\n"
+      "    \"write_central_directory\": 0\n"
+      "  },\n"
+      "  \"input_jars\": 0,\n"
+      "  \"reused_input_jars\": 0,\n"
+      "  \"cached_input_jars\": 0,\n"
+      "  \"entries\": 7,\n"
+      "  \"duplicate_entries\": 0,\n"
+      "  \"shared_entries\": 0,\n"
+      "  \"bytes_in\": 0,\n"
+      "  \"bytes_out\": 1234\n"
+      "}\n",
+      Stats::ToJson(42));
+}
+
+}  // namespace
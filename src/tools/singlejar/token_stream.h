@@ -15,17 +15,20 @@
 #ifndef THIRD_PARTY_BAZEL_SRC_TOOLS_SINGLEJAR_TOKEN_STREAM_H_
 #define THIRD_PARTY_BAZEL_SRC_TOOLS_SINGLEJAR_TOKEN_STREAM_H_ 1
 
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
-#include "src/main/cpp/util/path_platform.h"
 #include "src/tools/singlejar/diag.h"
+#include "src/tools/singlejar/mapped_file.h"
 
 /*
  * Tokenize command line containing indirect command line arguments.
@@ -59,33 +62,22 @@ class ArgTokenStream {
   class FileTokenStream {
    public:
     FileTokenStream(const char *filename) {
-#ifdef _WIN32
-      std::wstring wpath;
-      std::string error;
-      if (!blaze_util::AsAbsoluteWindowsPath(filename, &wpath, &error)) {
-        diag_err(1, "%s:%d: AsAbsoluteWindowsPath failed: %s", __FILE__,
-                 __LINE__, error.c_str());
-      }
-      fp_ = _wfopen(wpath.c_str(), L"r");
-#else
-      fp_ = fopen(filename, "r");
-#endif
-
-      if (!fp_) {
-        diag_err(1, "%s", filename);
+      if (!file_.Open(filename)) {
+        diag_errx(1, "Cannot read %s", filename);
       }
+      contents_ = std::string_view(
+          reinterpret_cast<const char *>(file_.start()), file_.size());
+      open_ = true;
       filename_ = filename;
       next_char();
     }
 
-    ~FileTokenStream() { close(); }
-
-    // Assign next token to TOKEN, return true on success, false on EOF.
-    bool next_token(std::string *token) {
-      if (!fp_) {
+    // Assign next token to TOKEN, return true on success, false on EOF. The
+    // token is valid until the next call.
+    bool next_token(std::string_view *token) {
+      if (!open_) {
         return false;
       }
-      *token = "";
       while (current_char_ != EOF && isspace(current_char_)) {
         next_char();
       }
@@ -93,19 +85,36 @@ class ArgTokenStream {
         close();
         return false;
       }
+      // Most tokens have nothing to unquote or unescape: return them as they
+      // are in the file.
+      size_t start = pos_ - 1;
+      size_t end = start;
+      while (end < contents_.size() && !is_special(contents_[end])) {
+        ++end;
+      }
+      if (end == contents_.size() || isspace(static_cast<unsigned char>(
+                                         contents_[end]))) {
+        *token = contents_.substr(start, end - start);
+        pos_ = std::min(end + 1, contents_.size());
+        next_char();
+        return true;
+      }
+      buffer_.assign(contents_.data() + start, end - start);
+      pos_ = end;
+      next_char();
       for (;;) {
         if (current_char_ == '\'' || current_char_ == '"') {
-          process_quoted(token);
+          process_quoted(&buffer_);
           if (isspace(current_char_)) {
             next_char();
-            return true;
+            break;
           } else {
             next_char();
           }
         } else if (current_char_ == '\\') {
           next_char();
           if ((current_char_ != EOF)) {
-            token->push_back(current_char_);
+            buffer_.push_back(current_char_);
             next_char();
           } else {
             diag_errx(1, "Expected character after \\, got EOF in %s",
@@ -113,23 +122,30 @@ class ArgTokenStream {
           }
         } else if (current_char_ == EOF || isspace(current_char_)) {
           next_char();
-          return true;
+          break;
         } else {
-          token->push_back(current_char_);
+          buffer_.push_back(current_char_);
           next_char();
         }
       }
+      *token = buffer_;
+      return true;
     }
 
    private:
     void close() {
-      if (fp_) {
-        fclose(fp_);
-        fp_ = nullptr;
-      }
+      open_ = false;
+      file_.Close();
+      contents_ = std::string_view();
       filename_.clear();
     }
 
+    // Whether C ends a token or needs handling inside of it.
+    static bool is_special(char c) {
+      return c == '\'' || c == '"' || c == '\\' ||
+             isspace(static_cast<unsigned char>(c));
+    }
+
     // Append the quoted string to the TOKEN. The quote character (which can be
     // single or double quote) is in the current character. Everything up to the
     // matching quote character is appended.
@@ -160,29 +176,50 @@ class ArgTokenStream {
       }
     }
 
+    // Returns the length of the newline at pos_, or 0 if there is none. On
+    // Windows, "\r\n" is a newline too, as it is to text mode streams.
+    size_t newline_length() const {
+      if (pos_ < contents_.size() && contents_[pos_] == '\n') {
+        return 1;
+      }
+#ifdef _WIN32
+      if (contents_.compare(pos_, 2, "\r\n") == 0) {
+        return 2;
+      }
+#endif
+      return 0;
+    }
+
     // Get the next character from the input stream. Skip backslash followed
     // by the newline.
     void next_char() {
-      if (feof(fp_)) {
-        current_char_ = EOF;
-        return;
-      }
-      current_char_ = getc(fp_);
-      // Eat "\\\n" sequence.
-      while (current_char_ == '\\') {
-        int c = getc(fp_);
-        if (c == '\n') {
-          current_char_ = getc(fp_);
-        } else {
-          if (c != EOF) {
-            ungetc(c, fp_);
-          }
-          break;
+      for (;;) {
+        if (pos_ == contents_.size()) {
+          current_char_ = EOF;
+          return;
+        }
+        if (size_t newline = newline_length()) {
+          pos_ += newline;
+          current_char_ = '\n';
+          return;
+        }
+        current_char_ = static_cast<unsigned char>(contents_[pos_++]);
+        // Eat "\\\n" sequence.
+        size_t newline = newline_length();
+        if (current_char_ != '\\' || newline == 0) {
+          return;
         }
+        pos_ += newline;
       }
     }
 
-    FILE *fp_;
+    bool open_ = false;
+    MappedFile file_;
+    std::string_view contents_;
+    // The position after the current character.
+    size_t pos_ = 0;
+    // The token being read, if it cannot be a view of the file.
+    std::string buffer_;
     std::string filename_;
     int current_char_;
   };
@@ -232,7 +269,7 @@ class ArgTokenStream {
     }
     next();
     while (!AtEnd() && '-' != token_.at(0)) {
-      optargs->push_back(token_);
+      optargs->emplace_back(token_);
       next();
     }
     return true;
@@ -250,12 +287,11 @@ class ArgTokenStream {
     next();
     while (!AtEnd() && '-' != token_.at(0)) {
       size_t commapos = token_.find(',');
-      if (commapos == std::string::npos) {
-        optargs->push_back(std::pair<std::string, std::string>(token_, ""));
+      if (commapos == std::string_view::npos) {
+        optargs->emplace_back(token_, "");
       } else {
-        std::string first = token_.substr(0, commapos);
-        token_.erase(0, commapos + 1);
-        optargs->push_back(std::pair<std::string, std::string>(first, token_));
+        optargs->emplace_back(token_.substr(0, commapos),
+                              token_.substr(commapos + 1));
       }
 
       next();
@@ -263,8 +299,8 @@ class ArgTokenStream {
     return true;
   }
 
-  // Current token.
-  const std::string &token() const { return token_; }
+  // Current token. It is valid until the next call to next().
+  std::string_view token() const { return token_; }
 
   // Read the next token.
   void next() {
@@ -285,6 +321,7 @@ class ArgTokenStream {
       }
     }
     argv_++;
+    token_ = std::string_view();
   }
 
   // True if there are no more tokens.
@@ -301,7 +338,8 @@ class ArgTokenStream {
   std::unique_ptr<FileTokenStream> file_token_stream_;
   const char *const *argv_;
   const char *const *argv_end_;
-  std::string token_;
+  // A view of an argument, or of a token of the current file.
+  std::string_view token_;
 };
 
 #endif  //  THIRD_PARTY_BAZEL_SRC_TOOLS_SINGLEJAR_TOKEN_STREAM_H_
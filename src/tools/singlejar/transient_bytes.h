@@ -19,10 +19,23 @@
 #endif
 
 #include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
 #include <algorithm>
+#include <atomic>
+#include <memory>
 #include <ostream>
+#include <string>
+#include <vector>
 
+#include "src/tools/singlejar/checksum.h"
 #include "src/tools/singlejar/diag.h"
+#include "src/tools/singlejar/parallel_deflater.h"
+#include "src/tools/singlejar/stats.h"
 #include "src/tools/singlejar/zip_headers.h"
 #include "src/tools/singlejar/zlib_interface.h"
 
@@ -34,6 +47,11 @@
  * Use Append() to append a sequence of bytes or a string.
  * Use Write() to write out the contents, it will compress the entry if
  * necessary.
+ *
+ * Once the chunks of all the instances use more memory than the limit set
+ * by set_memory_limit(), an instance needing another chunk moves the data
+ * of its chunks to an unlinked temporary file, keeping a single chunk for
+ * the data that follows. The data is read back from the file sequentially.
  */
 class TransientBytes {
  public:
@@ -41,17 +59,35 @@ class TransientBytes {
       : allocated_(0),
         data_size_(0),
         first_block_(nullptr),
-        last_block_(nullptr) {}
+        last_block_(nullptr),
+        spill_file_(nullptr),
+        spilled_size_(0),
+        spilled_last_byte_(0) {}
 
   ~TransientBytes() {
     while (first_block_) {
       auto block = first_block_;
       first_block_ = first_block_->next_block_;
       delete block;
+      resident_size_ref() -= sizeof(DataBlock);
     }
     last_block_ = nullptr;
+    if (spill_file_) {
+      fclose(spill_file_);
+    }
   }
 
+  // The amount of memory, in bytes, the chunks of all the instances may use
+  // before the data is moved to temporary files. The default is 0, which
+  // means there is no limit.
+  static uint64_t memory_limit() { return memory_limit_ref(); }
+  static void set_memory_limit(uint64_t memory_limit) {
+    memory_limit_ref() = memory_limit;
+  }
+
+  // Whether the data is partly kept in a temporary file.
+  bool spilled() const { return spill_file_ != nullptr; }
+
   // Appends raw bytes.
   void Append(const uint8_t *data, uint64_t data_size) {
     uint64_t chunk_size;
@@ -83,6 +119,7 @@ class TransientBytes {
   // used to decompress.
   void DecompressEntryContents(const CDH *cdh, const LH *lh,
                                Inflater *inflater) {
+    Stats::Timer timer(Stats::kInflate);
     uint64_t old_total_out = inflater->total_out();
     uint64_t in_bytes;
     uint64_t out_bytes;
@@ -159,9 +196,11 @@ class TransientBytes {
   // Writes the contents bytes to the given buffer in an optimal way, i.e., the
   // shorter of compressed or uncompressed. Sets the checksum and number of
   // bytes written and returns Z_DEFLATED if compression took place or
-  // Z_NO_COMPRESSION otherwise.
+  // Z_NO_COMPRESSION otherwise. Large contents are compressed on multiple
+  // threads if ParallelDeflater is enabled.
   uint16_t CompressOut(uint8_t *buffer, uint32_t *checksum,
                        uint64_t *bytes_written) {
+    Stats::Timer timer(Stats::kDeflate);
     *checksum = 0;
     uint64_t to_compress = data_size();
     if (to_compress == 0) {
@@ -169,27 +208,38 @@ class TransientBytes {
       return Z_NO_COMPRESSION;
     }
 
+    if (!spill_file_ && ParallelDeflater::ShouldUse(to_compress)) {
+      std::vector<ParallelDeflater::Segment> segments;
+      for (auto data_block = first_block_; data_block && to_compress;
+           data_block = data_block->next_block_) {
+        size_t chunk_size = std::min(
+            static_cast<uint64_t>(sizeof(data_block->data_)), to_compress);
+        segments.emplace_back(data_block->data_, chunk_size);
+        to_compress -= chunk_size;
+      }
+      if (ParallelDeflater::Deflate(segments, buffer, data_size(),
+                                    bytes_written, checksum)) {
+        return Z_DEFLATED;
+      }
+      CopyOut(buffer, checksum);
+      *bytes_written = data_size();
+      return Z_NO_COMPRESSION;
+    }
+
     Deflater deflater;
     deflater.next_out = buffer;
     uint16_t compression_method = Z_DEFLATED;
 
-    // Feed data blocks to the deflater one by one, but break if the compressed
-    // size exceeds the original size.
-    for (auto data_block = first_block_;
-         data_block && compression_method != Z_NO_COMPRESSION;
-         data_block = data_block->next_block_) {
+    // Feed data chunks to the deflater one by one, but break if the
+    // compressed size exceeds the original size.
+    ForEachChunk([&](const uint8_t *data, size_t chunk_size) {
       // The compressed size should not exceed the original size less the number
       // of bytes already compressed. And, it should not exceed 4GB-1.
       deflater.avail_out = std::min(data_size() - deflater.total_out,
                                     static_cast<uint64_t>(0xFFFFFFFF));
-      // Out of the total number of bytes that remain to be compressed, we
-      // can compress no more than this block.
-      uint32_t chunk_size = static_cast<uint32_t>(std::min(
-          static_cast<uint64_t>(sizeof(data_block->data_)), to_compress));
-      *checksum = crc32(*checksum, data_block->data_, chunk_size);
-      deflater.avail_in = chunk_size;
+      *checksum = ComputeCrc32(*checksum, data, chunk_size);
       to_compress -= chunk_size;
-      int ret = deflater.Deflate(data_block->data_, chunk_size,
+      int ret = deflater.Deflate(data, chunk_size,
                                  to_compress ? Z_NO_FLUSH : Z_FINISH);
       if (ret == Z_OK) {
         if (!deflater.avail_out) {
@@ -197,11 +247,12 @@ class TransientBytes {
           // that deflated size exceeds original size. Leave the loop
           // and just copy the data.
           compression_method = Z_NO_COMPRESSION;
+          return false;
         }
       } else if (ret == Z_BUF_ERROR && !deflater.avail_in) {
         // We ran out of data block, this is not a error.
       } else if (ret == Z_STREAM_END) {
-        if (data_block->next_block_ || to_compress) {
+        if (to_compress) {
           diag_errx(2,
                     "%s:%d: Internal error: deflate() call at the end, but "
                     "there is more data to compress!",
@@ -211,7 +262,8 @@ class TransientBytes {
         diag_errx(2, "%s:%d: deflate error %d(%s)", __FILE__, __LINE__, ret,
                   deflater.msg);
       }
-    }
+      return true;
+    });
     if (compression_method != Z_NO_COMPRESSION) {
       *bytes_written = deflater.total_out;
       return compression_method;
@@ -225,17 +277,13 @@ class TransientBytes {
 
   // Copies the bytes to the buffer and sets the checksum.
   void CopyOut(uint8_t *buffer, uint32_t *checksum) {
-    uint64_t to_copy = data_size();
-    uint8_t *buffer_end = buffer + to_copy;
     *checksum = 0;
-    for (auto data_block = first_block_; data_block;
-         data_block = data_block->next_block_) {
-      size_t chunk_size =
-          std::min(static_cast<uint64_t>(sizeof(data_block->data_)), to_copy);
-      *checksum = crc32(*checksum, data_block->data_, chunk_size);
-      memcpy(buffer_end - to_copy, data_block->data_, chunk_size);
-      to_copy -= chunk_size;
-    }
+    ForEachChunk([&](const uint8_t *data, size_t chunk_size) {
+      *checksum = ComputeCrc32(*checksum, data, chunk_size);
+      memcpy(buffer, data, chunk_size);
+      buffer += chunk_size;
+      return true;
+    });
   }
 
   // Number of data bytes.
@@ -247,16 +295,10 @@ class TransientBytes {
   //
   template <class Sink>
   void stream_out(const Sink &sink) const {
-    uint64_t to_copy = data_size();
-    for (auto data_block = first_block_; data_block;
-         data_block = data_block->next_block_) {
-      uint64_t chunk_size = sizeof(data_block->data_);
-      if (chunk_size > to_copy) {
-        chunk_size = to_copy;
-      }
-      sink.operator()(data_block->data_, chunk_size);
-      to_copy -= chunk_size;
-    }
+    ForEachChunk([&sink](const uint8_t *data, size_t chunk_size) {
+      sink.operator()(data, chunk_size);
+      return true;
+    });
   }
 
   uint8_t last_byte() const {
@@ -264,6 +306,9 @@ class TransientBytes {
       diag_errx(1, "%s:%d: last_char() cannot be called if buffer is empty",
                 __FILE__, __LINE__);
     }
+    if (data_size() == spilled_size_) {
+      return spilled_last_byte_;
+    }
     if (free_size() >= sizeof(last_block_->data_)) {
       diag_errx(1, "%s:%d: internal error: the last data block is empty",
                 __FILE__, __LINE__);
@@ -275,7 +320,15 @@ class TransientBytes {
   // Ensures there is some space to write to, returns the amount available.
   uint64_t ensure_space() {
     if (!free_size()) {
+      if (last_block_ &&
+          (spill_file_ ||
+           (memory_limit() &&
+            resident_size_ref() + sizeof(DataBlock) > memory_limit()))) {
+        Spill();
+        return free_size();
+      }
       auto *data_block = new DataBlock();
+      resident_size_ref() += sizeof(DataBlock);
       if (last_block_) {
         last_block_->next_block_ = data_block;
       }
@@ -312,6 +365,102 @@ class TransientBytes {
   // Returns the amount of free space.
   uint64_t free_size() const { return allocated_ - data_size_; }
 
+  // Calls visit(data, size) for the consecutive chunks of the data, until it
+  // returns false.
+  template <class Visitor>
+  void ForEachChunk(const Visitor &visit) const {
+    uint64_t to_visit = data_size();
+    if (spill_file_) {
+      // Read the spilled data back into a chunk-sized buffer.
+      std::unique_ptr<DataBlock> buffer(new DataBlock());
+      rewind(spill_file_);
+      for (uint64_t left = spilled_size_; left > 0;) {
+        size_t chunk_size = static_cast<size_t>(
+            std::min(static_cast<uint64_t>(sizeof(buffer->data_)), left));
+        if (fread(buffer->data_, 1, chunk_size, spill_file_) != chunk_size) {
+          diag_err(2, "%s:%d: cannot read back the spilled data", __FILE__,
+                   __LINE__);
+        }
+        left -= chunk_size;
+        to_visit -= chunk_size;
+        if (!visit(static_cast<const uint8_t *>(buffer->data_), chunk_size)) {
+          return;
+        }
+      }
+    }
+    for (auto data_block = first_block_; data_block && to_visit;
+         data_block = data_block->next_block_) {
+      size_t chunk_size = static_cast<size_t>(std::min(
+          static_cast<uint64_t>(sizeof(data_block->data_)), to_visit));
+      to_visit -= chunk_size;
+      if (!visit(static_cast<const uint8_t *>(data_block->data_),
+                 chunk_size)) {
+        return;
+      }
+    }
+  }
+
+  // Appends the data of the chunks, all of which are full, to the temporary
+  // file, and keeps the first chunk, now empty, for the data that follows.
+  void Spill() {
+    if (!spill_file_) {
+      spill_file_ = OpenSpillFile();
+    }
+    if (fseek(spill_file_, 0, SEEK_END)) {
+      diag_err(2, "%s:%d: cannot seek in the spill file", __FILE__, __LINE__);
+    }
+    for (auto data_block = first_block_; data_block;
+         data_block = data_block->next_block_) {
+      if (fwrite(data_block->data_, sizeof(data_block->data_), 1,
+                 spill_file_) != 1) {
+        diag_err(2, "%s:%d: cannot write the spill file", __FILE__, __LINE__);
+      }
+    }
+    spilled_last_byte_ = *(last_block_->End() - 1);
+    while (first_block_->next_block_) {
+      auto block = first_block_->next_block_;
+      first_block_->next_block_ = block->next_block_;
+      delete block;
+      resident_size_ref() -= sizeof(DataBlock);
+    }
+    last_block_ = first_block_;
+    spilled_size_ = data_size_;
+    allocated_ = data_size_ + sizeof(first_block_->data_);
+  }
+
+  // Creates an unlinked temporary file in $TMPDIR, or /tmp.
+  static FILE *OpenSpillFile() {
+#ifdef _WIN32
+    FILE *file = tmpfile();
+#else
+    const char *dir = getenv("TMPDIR");
+    std::string path =
+        std::string(dir && *dir ? dir : "/tmp") + "/singlejar_spill.XXXXXX";
+    FILE *file = nullptr;
+    int fd = mkstemp(&path[0]);
+    if (fd >= 0) {
+      unlink(path.c_str());
+      file = fdopen(fd, "w+b");
+    }
+#endif
+    if (file == nullptr) {
+      diag_err(2, "%s:%d: cannot create a temporary file", __FILE__,
+               __LINE__);
+    }
+    return file;
+  }
+
+  static uint64_t &memory_limit_ref() {
+    static uint64_t memory_limit = 0;
+    return memory_limit;
+  }
+
+  // The memory used by the chunks of all the instances.
+  static std::atomic<uint64_t> &resident_size_ref() {
+    static std::atomic<uint64_t> resident_size(0);
+    return resident_size;
+  }
+
   // The bytes are kept in an linked list of the DataBlock instances.
   // TODO(asmundak): perhaps use mmap to allocate these?
   struct DataBlock {
@@ -325,6 +474,11 @@ class TransientBytes {
   uint64_t data_size_;
   struct DataBlock *first_block_;
   struct DataBlock *last_block_;
+  // The temporary file holding the first spilled_size_ bytes, if any, and
+  // the last of them.
+  FILE *spill_file_;
+  uint64_t spilled_size_;
+  uint8_t spilled_last_byte_;
 };
 
 #endif  // SRC_TOOLS_SINGLEJAR_TRANSIENT_BYTES_H_
@@ -18,6 +18,8 @@
 #include <iostream>
 #include <memory>
 #include <sstream>
+#include <string>
+#include <vector>
 
 #include "src/tools/singlejar/input_jar.h"
 #include "src/tools/singlejar/test_util.h"
@@ -317,6 +319,33 @@ TEST_F(TransientBytesTest, CompressOutStore) {
   ASSERT_EQ(0xE8B7BE43, crc32);
 }
 
+// Verify CompressOut: large contents compressed on multiple threads inflate
+// back to the original.
+TEST_F(TransientBytesTest, CompressOutParallel) {
+  const uint64_t kDataSize = 10 << 20;
+  std::unique_ptr<uint8_t[]> data(new uint8_t[kDataSize]);
+  for (uint64_t i = 0; i < kDataSize; ++i) {
+    data[i] = file_byte_at(i * i / 7);
+  }
+  transient_bytes_->Append(data.get(), kDataSize);
+  std::unique_ptr<uint8_t[]> buffer(new uint8_t[kDataSize]);
+  uint32_t checksum = 0;
+  uint64_t bytes_written;
+  ParallelDeflater::set_max_threads(4);
+  uint16_t rc =
+      transient_bytes_->CompressOut(buffer.get(), &checksum, &bytes_written);
+  ParallelDeflater::set_max_threads(1);
+  ASSERT_EQ(Z_DEFLATED, rc);
+  EXPECT_EQ(crc32(0, data.get(), kDataSize), checksum);
+
+  std::unique_ptr<uint8_t[]> inflated(new uint8_t[kDataSize]);
+  Inflater inflater;
+  inflater.DataToInflate(buffer.get(), bytes_written);
+  ASSERT_EQ(Z_STREAM_END, inflater.Inflate(inflated.get(), kDataSize));
+  EXPECT_EQ(0, inflater.available_out());
+  EXPECT_EQ(0, memcmp(data.get(), inflated.get(), kDataSize));
+}
+
 // Verify CompressOut: if there are zero bytes in the buffer, just store.
 TEST_F(TransientBytesTest, CompressZero) {
   transient_bytes_->Append("");
@@ -342,4 +371,58 @@ TEST_F(TransientBytesTest, CopyOut) {
   ASSERT_EQ(0xE8B7BE43, crc32);
 }
 
+// Verify that the data spilled to a temporary file is read back.
+TEST_F(TransientBytesTest, Spill) {
+  // Any chunk allocated while there is another one causes a spill.
+  TransientBytes::set_memory_limit(1);
+  std::string expected;
+  auto append = [&](size_t size) {
+    std::string bytes;
+    for (size_t i = 0; i < size; ++i) {
+      bytes += static_cast<char>(file_byte_at(expected.size() + i) ^ (i % 7));
+    }
+    transient_bytes_->Append(reinterpret_cast<const uint8_t *>(bytes.data()),
+                             bytes.size());
+    expected += bytes;
+  };
+  auto verify = [&]() {
+    ASSERT_EQ(expected.size(), transient_bytes_->data_size());
+    EXPECT_EQ(static_cast<uint8_t>(expected.back()),
+              transient_bytes_->last_byte());
+    std::ostringstream out;
+    out << *transient_bytes_;
+    EXPECT_TRUE(out.str() == expected);
+
+    uint32_t expected_checksum =
+        ComputeCrc32(0, expected.data(), expected.size());
+    std::vector<uint8_t> buffer(expected.size());
+    uint32_t checksum;
+    transient_bytes_->CopyOut(buffer.data(), &checksum);
+    EXPECT_EQ(expected_checksum, checksum);
+    EXPECT_TRUE(0 == memcmp(expected.data(), buffer.data(), buffer.size()));
+
+    uint64_t bytes_written;
+    ASSERT_EQ(Z_DEFLATED, transient_bytes_->CompressOut(
+                              buffer.data(), &checksum, &bytes_written));
+    EXPECT_EQ(expected_checksum, checksum);
+    Inflater inflater;
+    inflater.DataToInflate(buffer.data(), bytes_written);
+    std::vector<uint8_t> inflated(expected.size());
+    ASSERT_EQ(Z_STREAM_END, inflater.Inflate(inflated.data(), inflated.size()));
+    EXPECT_TRUE(0 == memcmp(expected.data(), inflated.data(), inflated.size()));
+  };
+
+  append(100000);
+  EXPECT_FALSE(transient_bytes_->spilled());
+  verify();
+  // Fill the chunks exactly, then add more after the data has been read.
+  append(0x40000 - 8 - 100000);
+  append(0x40000 - 8);
+  EXPECT_TRUE(transient_bytes_->spilled());
+  verify();
+  append(1000000);
+  verify();
+  TransientBytes::set_memory_limit(0);
+}
+
 }  // namespace
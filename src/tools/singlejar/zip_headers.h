@@ -43,6 +43,7 @@
 
 #include <string>
 #include <type_traits>
+#include <vector>
 
 #if defined(_MSC_VER) && !defined(__clang__)
 #pragma pack(push, 1)
@@ -507,6 +508,51 @@ class CDH {
                                     extra_fields() + extra_fields_length());
   }
 
+  // Gets the sizes and the local header offset, the ones that are 0xFFFFFFFF
+  // from the Zip64 extra field. Like the accessors above, takes 0xFFFFFFFF
+  // as the value if there is no Zip64 extra field, as some zip tools write
+  // a size of exactly 0xFFFFFFFF this way. Unlike them, returns false if the
+  // Zip64 extra field lacks a value, or if the extra fields overrun their
+  // length.
+  bool checked_sizes(uint64_t *uncompressed_size, uint64_t *compressed_size,
+                     uint64_t *local_header_offset) const {
+    *uncompressed_size = uncompressed_file_size32();
+    *compressed_size = compressed_file_size32();
+    *local_header_offset = local_header_offset32();
+    // The values in the Zip64 extra field, in this order.
+    uint64_t *values[3];
+    int needed = 0;
+    for (uint64_t *value :
+         {uncompressed_size, compressed_size, local_header_offset}) {
+      if (ziph::zfield_has_ext64(*value)) {
+        values[needed++] = value;
+      }
+    }
+    if (needed == 0) {
+      return true;
+    }
+    const uint8_t *field = extra_fields();
+    const uint8_t *end = field + extra_fields_length();
+    while (field + sizeof(ExtraField) <= end) {
+      auto extra_field = reinterpret_cast<const ExtraField *>(field);
+      if (extra_field->size() > end - field) {
+        return false;
+      }
+      if (extra_field->is_zip64()) {
+        auto z64 = reinterpret_cast<const Zip64ExtraField *>(extra_field);
+        if (z64->attr_count() < needed) {
+          return false;
+        }
+        for (int i = 0; i < needed; ++i) {
+          *values[i] = z64->attr64(i);
+        }
+        return true;
+      }
+      field += extra_field->size();
+    }
+    return true;
+  }
+
  private:
   uint32_t signature_;
   uint16_t version_;
@@ -530,6 +576,68 @@ class CDH {
 } attr_packed;
 static_assert(46 == sizeof(CDH), "Class CDH fields layout is incorrect.");
 
+/* The values of the records of a central directory that are needed to find
+ * and read their entries, each in an array of its own, so that going over
+ * one of them, say over the names to find the class files, reads no more
+ * than that. The sizes and the offset are the actual ones, taken from the
+ * Zip64 extra field where needed.
+ */
+class CentralDirectoryIndex {
+ public:
+  size_t size() const { return record_offset_.size(); }
+
+  void clear() {
+    record_offset_.clear();
+    local_header_offset_.clear();
+    compressed_size_.clear();
+    uncompressed_size_.clear();
+    crc32_.clear();
+    compression_method_.clear();
+    file_name_length_.clear();
+  }
+
+  void add(uint64_t record_offset, const CDH *cdh,
+           uint64_t local_header_offset, uint64_t compressed_size,
+           uint64_t uncompressed_size) {
+    record_offset_.push_back(record_offset);
+    local_header_offset_.push_back(local_header_offset);
+    compressed_size_.push_back(compressed_size);
+    uncompressed_size_.push_back(uncompressed_size);
+    crc32_.push_back(cdh->crc32());
+    compression_method_.push_back(cdh->compression_method());
+    file_name_length_.push_back(cdh->file_name_length());
+  }
+
+  // The offsets are those in the file the index was made of.
+  uint64_t record_offset(size_t i) const { return record_offset_[i]; }
+  uint64_t file_name_offset(size_t i) const {
+    return record_offset_[i] + sizeof(CDH);
+  }
+  uint16_t file_name_length(size_t i) const { return file_name_length_[i]; }
+  uint64_t local_header_offset(size_t i) const {
+    return local_header_offset_[i];
+  }
+  uint64_t compressed_file_size(size_t i) const {
+    return compressed_size_[i];
+  }
+  uint64_t uncompressed_file_size(size_t i) const {
+    return uncompressed_size_[i];
+  }
+  uint32_t crc32(size_t i) const { return crc32_[i]; }
+  uint16_t compression_method(size_t i) const {
+    return compression_method_[i];
+  }
+
+ private:
+  std::vector<uint64_t> record_offset_;
+  std::vector<uint64_t> local_header_offset_;
+  std::vector<uint64_t> compressed_size_;
+  std::vector<uint64_t> uncompressed_size_;
+  std::vector<uint32_t> crc32_;
+  std::vector<uint16_t> compression_method_;
+  std::vector<uint16_t> file_name_length_;
+};
+
 /* Zip64 End of Central Directory Locator.  */
 class ECD64Locator {
  public:
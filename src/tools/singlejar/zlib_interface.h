@@ -63,6 +63,17 @@ class Inflater {
     return inflate(&zstream_, Z_SYNC_FLUSH);
   }
 
+  // Same, but also stops at the end of each deflate block. data_type() then
+  // tells where in the input the inflation has stopped (see Z_BLOCK in
+  // zlib.h).
+  int InflateBlock(uint8_t *out_buffer, uint32_t out_buffer_length) {
+    zstream_.next_out = out_buffer;
+    zstream_.avail_out = out_buffer_length;
+    return inflate(&zstream_, Z_BLOCK);
+  }
+
+  int data_type() const { return zstream_.data_type; }
+
   const uint8_t *next_in() const { return zstream_.next_in; }
   uint64_t total_in() const { return zstream_.total_in; }
 
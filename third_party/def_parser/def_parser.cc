@@ -65,10 +65,13 @@
 #include "third_party/def_parser/def_parser.h"
 
 #include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <fstream>
 #include <memory>    // unique_ptr
 #include <sstream>
+#include <thread>
+#include <vector>
 #include <windows.h>
 
 #ifdef _WIN32
@@ -427,6 +430,9 @@ static bool DumpFile(const char* filename,
   const PIMAGE_DOS_HEADER dosHeader = (PIMAGE_DOS_HEADER)lpFileBase;
   if (dosHeader->e_magic == IMAGE_DOS_SIGNATURE) {
     fprintf(stderr, "File is an executable.  I don't dump those.\n");
+    UnmapViewOfFile(lpFileBase);
+    CloseHandle(hFileMapping);
+    CloseHandle(hFile);
     return false;
   } else {
     const PIMAGE_FILE_HEADER imageHeader = (PIMAGE_FILE_HEADER)lpFileBase;
@@ -469,6 +475,9 @@ static bool DumpFile(const char* filename,
       } else {
         printf("unrecognized file format in '%s, %u'\n", filename,
                imageHeader->Machine);
+        UnmapViewOfFile(lpFileBase);
+        CloseHandle(hFileMapping);
+        CloseHandle(hFile);
         return false;
       }
     }
@@ -537,6 +546,56 @@ bool DefParser::AddFile(const string& file) {
   return true;
 }
 
+bool DefParser::AddFiles(const std::vector<string>& files, int jobs) {
+  std::vector<string> objects;
+  for (const string& file : files) {
+    if (IsDefFile(file)) {
+      if (!this->AddDefinitionFile(file.c_str())) {
+        return false;
+      }
+    } else {
+      objects.push_back(file);
+    }
+  }
+
+  // Every object file is dumped into symbol sets of its own, so the threads
+  // share nothing but the index of the next file. The sets are merged in the
+  // order of the files afterwards, which also drops the duplicates.
+  struct ObjectSymbols {
+    std::set<string> symbols;
+    std::set<string> dataSymbols;
+  };
+  std::vector<ObjectSymbols> results(objects.size());
+  std::atomic<size_t> next(0);
+  std::atomic<bool> failed(false);
+  auto dump = [&]() {
+    for (size_t i; !failed && (i = next++) < objects.size();) {
+      if (!DumpFile(objects[i].c_str(), results[i].symbols,
+                    results[i].dataSymbols)) {
+        failed = true;
+      }
+    }
+  };
+  size_t threads = std::min<size_t>(jobs > 1 ? jobs : 1, objects.size());
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < threads; i++) {
+    workers.emplace_back(dump);
+  }
+  dump();
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  if (failed) {
+    return false;
+  }
+  for (ObjectSymbols const& result : results) {
+    this->Symbols.insert(result.symbols.begin(), result.symbols.end());
+    this->DataSymbols.insert(result.dataSymbols.begin(),
+                             result.dataSymbols.end());
+  }
+  return true;
+}
+
 void DefParser::WriteFile(FILE* file)
 {
   if (!this->DLLName.empty()) {
@@ -7,6 +7,7 @@
 #include <set>
 #include <stdio.h>
 #include <string>
+#include <vector>
 
 std::wstring AsAbsoluteWindowsPath(const std::string& path);
 
@@ -25,6 +26,10 @@ class DefParser{
   // Add a file, the function itself will tell which type of file it is.
   bool AddFile(const std::string& filename);
 
+  // Add files like AddFile() does, parsing the object files among them on up
+  // to `jobs` threads. The result is the same as adding them one by one.
+  bool AddFiles(const std::vector<std::string>& filenames, int jobs);
+
   // Set the DLL name the output DEF file is used for.
   // This will cause a "LIBRARY <DLLName>" entry in the output DEF file.
   void SetDLLName(const std::string& filename);
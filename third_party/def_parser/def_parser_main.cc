@@ -4,6 +4,8 @@
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "third_party/def_parser/def_parser.h"
 
@@ -48,6 +50,7 @@ int main(int argc, char* argv[]) {
 
   deffile.SetDLLName(argv[2]);
 
+  std::vector<std::string> files;
   for (int i = 3; i < argc; i++) {
     // If the argument starts with @, then treat it as a parameter file.
     if (argv[i][0] == '@') {
@@ -60,19 +63,20 @@ int main(int argc, char* argv[]) {
       std::string file;
       while (std::getline(paramfile, file)) {
         trim(&file);
-        if (!deffile.AddFile(file)) {
-          return 1;
-        }
+        files.push_back(file);
       }
     } else {
       std::string file(argv[i]);
       trim(&file);
-      if (!deffile.AddFile(argv[i])) {
-        return 1;
-      }
+      files.push_back(argv[i]);
     }
   }
 
+  // The object files are independent of each other, parse them on all cores.
+  if (!deffile.AddFiles(files, std::thread::hardware_concurrency())) {
+    return 1;
+  }
+
   deffile.WriteFile(fout);
   fclose(fout);
   return 0;
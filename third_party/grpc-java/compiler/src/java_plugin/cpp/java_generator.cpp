@@ -380,7 +380,7 @@ void GrpcWriteMethodDocComment(Printer* printer,
 
 static void PrintMethodFields(
     const ServiceDescriptor* service, std::map<std::string, std::string>* vars,
-    Printer* p, ProtoFlavor flavor) {
+    Printer* p, ProtoFlavor flavor, bool shared_descriptor_supplier) {
   p->Print("// Static method descriptors that strictly reflect the proto.\n");
   (*vars)["service_name"] = service->name();
   for (int i = 0; i < service->method_count(); ++i) {
@@ -456,7 +456,12 @@ static void PrintMethodFields(
         "                $output_type$.getDefaultInstance()))\n");
 
     (*vars)["proto_method_descriptor_supplier"] = service->name() + "MethodDescriptorSupplier";
-    if (flavor == ProtoFlavor::NORMAL) {
+    if (flavor == ProtoFlavor::NORMAL && shared_descriptor_supplier) {
+      p->Print(
+          *vars,
+        "            .setSchemaDescriptor(new $shared_descriptor_supplier$(\n"
+        "                \"$service_name$\", \"$method_name$\"))\n");
+    } else if (flavor == ProtoFlavor::NORMAL) {
       p->Print(
           *vars,
         "            .setSchemaDescriptor(new $proto_method_descriptor_supplier$(\"$method_name$\"))\n");
@@ -918,14 +923,57 @@ static void PrintMethodHandlerClass(const ServiceDescriptor* service,
   p->Print("}\n\n");
 }
 
+// Prints the schema descriptor supplier shared by all the services of a file.
+// A supplier without a method name is the one of the service.
+static void PrintSharedDescriptorSupplier(
+    const ServiceDescriptor* service,
+    std::map<std::string, std::string>* vars,
+    Printer* p) {
+  (*vars)["proto_class_name"] = protobuf::compiler::java::ClassName(service->file());
+  p->Print(
+      *vars,
+      "static final class GrpcDescriptorSupplier\n"
+      "    implements $ProtoFileDescriptorSupplier$, $ProtoServiceDescriptorSupplier$,\n"
+      "        $ProtoMethodDescriptorSupplier$ {\n"
+      "  private final String serviceName;\n"
+      "  private final String methodName;\n"
+      "\n"
+      "  GrpcDescriptorSupplier(String serviceName, String methodName) {\n"
+      "    this.serviceName = serviceName;\n"
+      "    this.methodName = methodName;\n"
+      "  }\n"
+      "\n"
+      "  @$Override$\n"
+      "  public com.google.protobuf.Descriptors.FileDescriptor getFileDescriptor() {\n"
+      "    return $proto_class_name$.getDescriptor();\n"
+      "  }\n"
+      "\n"
+      "  @$Override$\n"
+      "  public com.google.protobuf.Descriptors.ServiceDescriptor getServiceDescriptor() {\n"
+      "    return getFileDescriptor().findServiceByName(serviceName);\n"
+      "  }\n"
+      "\n"
+      "  @$Override$\n"
+      "  public com.google.protobuf.Descriptors.MethodDescriptor getMethodDescriptor() {\n"
+      "    return methodName == null\n"
+      "        ? null : getServiceDescriptor().findMethodByName(methodName);\n"
+      "  }\n"
+      "}\n\n");
+}
+
 static void PrintGetServiceDescriptorMethod(const ServiceDescriptor* service,
                                    std::map<std::string, std::string>* vars,
                                    Printer* p,
-                                   ProtoFlavor flavor) {
+                                   ProtoFlavor flavor,
+                                   bool shared_descriptor_supplier) {
   (*vars)["service_name"] = service->name();
 
 
-  if (flavor == ProtoFlavor::NORMAL) {
+  if (flavor == ProtoFlavor::NORMAL && shared_descriptor_supplier) {
+    if (service == service->file()->service(0)) {
+      PrintSharedDescriptorSupplier(service, vars, p);
+    }
+  } else if (flavor == ProtoFlavor::NORMAL) {
     (*vars)["proto_base_descriptor_supplier"] = service->name() + "BaseDescriptorSupplier";
     (*vars)["proto_file_descriptor_supplier"] = service->name() + "FileDescriptorSupplier";
     (*vars)["proto_method_descriptor_supplier"] = service->name() + "MethodDescriptorSupplier";
@@ -994,7 +1042,12 @@ static void PrintGetServiceDescriptorMethod(const ServiceDescriptor* service,
       "serviceDescriptor = result = $ServiceDescriptor$.newBuilder(SERVICE_NAME)");
   p->Indent();
   p->Indent();
-  if (flavor == ProtoFlavor::NORMAL) {
+  if (flavor == ProtoFlavor::NORMAL && shared_descriptor_supplier) {
+    p->Print(
+        *vars,
+        "\n.setSchemaDescriptor(new $shared_descriptor_supplier$(\n"
+        "    \"$service_name$\", null))");
+  } else if (flavor == ProtoFlavor::NORMAL) {
     p->Print(
         *vars,
         "\n.setSchemaDescriptor(new $proto_file_descriptor_supplier$())");
@@ -1077,10 +1130,14 @@ static void PrintService(const ServiceDescriptor* service,
                          std::map<std::string, std::string>* vars,
                          Printer* p,
                          ProtoFlavor flavor,
-                         bool disable_version) {
+                         bool disable_version,
+                         int client_stubs,
+                         bool shared_descriptor_supplier) {
   (*vars)["service_name"] = service->name();
   (*vars)["file_name"] = service->file()->name();
   (*vars)["service_class_name"] = ServiceClassName(service);
+  (*vars)["shared_descriptor_supplier"] =
+      ServiceClassName(service->file()->service(0)) + ".GrpcDescriptorSupplier";
   (*vars)["grpc_version"] = "";
   #ifdef GRPC_VERSION
   if (!disable_version) {
@@ -1113,56 +1170,69 @@ static void PrintService(const ServiceDescriptor* service,
       "public static final String SERVICE_NAME = "
       "\"$Package$$service_name$\";\n\n");
 
-  PrintMethodFields(service, vars, p, flavor);
+  PrintMethodFields(service, vars, p, flavor, shared_descriptor_supplier);
 
-  // TODO(nmittler): Replace with WriteDocComment once included by protobuf distro.
-  GrpcWriteDocComment(p, " Creates a new async stub that supports all call types for the service");
-  p->Print(
-      *vars,
-      "public static $service_name$Stub newStub($Channel$ channel) {\n");
-  p->Indent();
-  PrintStubFactory(service, vars, p, ASYNC_CLIENT_IMPL);
-  p->Print(*vars, "return $service_name$Stub.newStub(factory, channel);\n");
-  p->Outdent();
-  p->Print("}\n\n");
+  if (client_stubs & ASYNC_STUB) {
+    // TODO(nmittler): Replace with WriteDocComment once included by protobuf distro.
+    GrpcWriteDocComment(p, " Creates a new async stub that supports all call types for the service");
+    p->Print(
+        *vars,
+        "public static $service_name$Stub newStub($Channel$ channel) {\n");
+    p->Indent();
+    PrintStubFactory(service, vars, p, ASYNC_CLIENT_IMPL);
+    p->Print(*vars, "return $service_name$Stub.newStub(factory, channel);\n");
+    p->Outdent();
+    p->Print("}\n\n");
+  }
 
-  // TODO(nmittler): Replace with WriteDocComment once included by protobuf distro.
-  GrpcWriteDocComment(p, " Creates a new blocking-style stub that supports unary and streaming "
-                         "output calls on the service");
-  p->Print(
-      *vars,
-      "public static $service_name$BlockingStub newBlockingStub(\n"
-      "    $Channel$ channel) {\n");
-  p->Indent();
-  PrintStubFactory(service, vars, p, BLOCKING_CLIENT_IMPL);
-  p->Print(
-      *vars,
-      "return $service_name$BlockingStub.newStub(factory, channel);\n");
-  p->Outdent();
-  p->Print("}\n\n");
+  if (client_stubs & BLOCKING_STUB) {
+    // TODO(nmittler): Replace with WriteDocComment once included by protobuf distro.
+    GrpcWriteDocComment(p, " Creates a new blocking-style stub that supports unary and streaming "
+                           "output calls on the service");
+    p->Print(
+        *vars,
+        "public static $service_name$BlockingStub newBlockingStub(\n"
+        "    $Channel$ channel) {\n");
+    p->Indent();
+    PrintStubFactory(service, vars, p, BLOCKING_CLIENT_IMPL);
+    p->Print(
+        *vars,
+        "return $service_name$BlockingStub.newStub(factory, channel);\n");
+    p->Outdent();
+    p->Print("}\n\n");
+  }
 
-  // TODO(nmittler): Replace with WriteDocComment once included by protobuf distro.
-  GrpcWriteDocComment(p, " Creates a new ListenableFuture-style stub that supports unary calls "
-                         "on the service");
-  p->Print(
-      *vars,
-      "public static $service_name$FutureStub newFutureStub(\n"
-      "    $Channel$ channel) {\n");
-  p->Indent();
-  PrintStubFactory(service, vars, p, FUTURE_CLIENT_IMPL);
-  p->Print(
-      *vars,
-      "return $service_name$FutureStub.newStub(factory, channel);\n");
-  p->Outdent();
-  p->Print("}\n\n");
+  if (client_stubs & FUTURE_STUB) {
+    // TODO(nmittler): Replace with WriteDocComment once included by protobuf distro.
+    GrpcWriteDocComment(p, " Creates a new ListenableFuture-style stub that supports unary calls "
+                           "on the service");
+    p->Print(
+        *vars,
+        "public static $service_name$FutureStub newFutureStub(\n"
+        "    $Channel$ channel) {\n");
+    p->Indent();
+    PrintStubFactory(service, vars, p, FUTURE_CLIENT_IMPL);
+    p->Print(
+        *vars,
+        "return $service_name$FutureStub.newStub(factory, channel);\n");
+    p->Outdent();
+    p->Print("}\n\n");
+  }
 
   PrintStub(service, vars, p, ABSTRACT_CLASS);
-  PrintStub(service, vars, p, ASYNC_CLIENT_IMPL);
-  PrintStub(service, vars, p, BLOCKING_CLIENT_IMPL);
-  PrintStub(service, vars, p, FUTURE_CLIENT_IMPL);
+  if (client_stubs & ASYNC_STUB) {
+    PrintStub(service, vars, p, ASYNC_CLIENT_IMPL);
+  }
+  if (client_stubs & BLOCKING_STUB) {
+    PrintStub(service, vars, p, BLOCKING_CLIENT_IMPL);
+  }
+  if (client_stubs & FUTURE_STUB) {
+    PrintStub(service, vars, p, FUTURE_CLIENT_IMPL);
+  }
 
   PrintMethodHandlerClass(service, vars, p);
-  PrintGetServiceDescriptorMethod(service, vars, p, flavor);
+  PrintGetServiceDescriptorMethod(service, vars, p, flavor,
+                                  shared_descriptor_supplier);
   p->Outdent();
   p->Print("}\n");
 }
@@ -1176,7 +1246,9 @@ void PrintImports(Printer* p) {
 void GenerateService(const ServiceDescriptor* service,
                      protobuf::io::ZeroCopyOutputStream* out,
                      ProtoFlavor flavor,
-                     bool disable_version) {
+                     bool disable_version,
+                     int client_stubs,
+                     bool shared_descriptor_supplier) {
   // All non-generated classes must be referred by fully qualified names to
   // avoid collision with generated classes.
   std::map<std::string, std::string> vars;
@@ -1227,7 +1299,8 @@ void GenerateService(const ServiceDescriptor* service,
   if (!vars["Package"].empty()) {
     vars["Package"].append(".");
   }
-  PrintService(service, &vars, &printer, flavor, disable_version);
+  PrintService(service, &vars, &printer, flavor, disable_version,
+               client_stubs, shared_descriptor_supplier);
 }
 
 std::string ServiceJavaPackage(const FileDescriptor* file) {
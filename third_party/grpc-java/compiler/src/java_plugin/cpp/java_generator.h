@@ -57,6 +57,15 @@ enum ProtoFlavor {
   NORMAL, LITE
 };
 
+// The client stubs to generate, or-ed together. The server side is always
+// generated.
+enum ClientStubs {
+  ASYNC_STUB = 1,
+  BLOCKING_STUB = 2,
+  FUTURE_STUB = 4,
+  ALL_STUBS = ASYNC_STUB | BLOCKING_STUB | FUTURE_STUB
+};
+
 // Returns the package name of the gRPC services defined in the given file.
 std::string ServiceJavaPackage(const impl::protobuf::FileDescriptor* file);
 
@@ -65,10 +74,15 @@ std::string ServiceJavaPackage(const impl::protobuf::FileDescriptor* file);
 std::string ServiceClassName(const impl::protobuf::ServiceDescriptor* service);
 
 // Writes the generated service interface into the given ZeroCopyOutputStream
+// If shared_descriptor_supplier is set, the schema descriptors of all the
+// services of the file use one supplier class, generated in the class of the
+// first service, instead of three classes per service.
 void GenerateService(const impl::protobuf::ServiceDescriptor* service,
                      impl::protobuf::io::ZeroCopyOutputStream* out,
                      ProtoFlavor flavor,
-                     bool disable_version);
+                     bool disable_version,
+                     int client_stubs = ALL_STUBS,
+                     bool shared_descriptor_supplier = false);
 
 }  // namespace java_grpc_generator
 
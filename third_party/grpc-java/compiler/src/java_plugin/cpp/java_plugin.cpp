@@ -60,11 +60,21 @@ class JavaGrpcGenerator : public protobuf::compiler::CodeGenerator {
         java_grpc_generator::ProtoFlavor::NORMAL;
 
     bool disable_version = false;
+    int client_stubs = java_grpc_generator::ALL_STUBS;
+    bool shared_descriptor_supplier = false;
     for (size_t i = 0; i < options.size(); i++) {
       if (options[i].first == "lite") {
         flavor = java_grpc_generator::ProtoFlavor::LITE;
       } else if (options[i].first == "noversion") {
         disable_version = true;
+      } else if (options[i].first == "noasyncstub") {
+        client_stubs &= ~java_grpc_generator::ASYNC_STUB;
+      } else if (options[i].first == "noblockingstub") {
+        client_stubs &= ~java_grpc_generator::BLOCKING_STUB;
+      } else if (options[i].first == "nofuturestub") {
+        client_stubs &= ~java_grpc_generator::FUTURE_STUB;
+      } else if (options[i].first == "shareddescriptorsupplier") {
+        shared_descriptor_supplier = true;
       }
     }
 
@@ -77,7 +87,8 @@ class JavaGrpcGenerator : public protobuf::compiler::CodeGenerator {
       std::unique_ptr<protobuf::io::ZeroCopyOutputStream> output(
           context->Open(filename));
       java_grpc_generator::GenerateService(
-          service, output.get(), flavor, disable_version);
+          service, output.get(), flavor, disable_version, client_stubs,
+          shared_descriptor_supplier);
     }
     return true;
   }
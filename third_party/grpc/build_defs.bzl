@@ -34,7 +34,7 @@ def _gensource_impl(ctx):
         command = " ".join([
                                ctx.executable._protoc.path,
                                "--plugin=protoc-gen-grpc-java={0}".format(ctx.executable._java_plugin.path),
-                               "--grpc-java_out=enable_deprecated={0}:{1}".format(str(ctx.attr.enable_deprecated).lower(), srcdotjar.path),
+                               "--grpc-java_out={0}:{1}".format(",".join(ctx.attr.plugin_options + ["enable_deprecated=" + str(ctx.attr.enable_deprecated).lower()]), srcdotjar.path),
                            ] +
                            ["-I{0}={1}".format(_path_ignoring_repository(include), include.path) for include in includes] +
                            [src.path for src in srcs]),
@@ -61,6 +61,7 @@ _java_grpc_gensource = rule(
         "enable_deprecated": attr.bool(
             default = False,
         ),
+        "plugin_options": attr.string_list(),
         "_protoc": attr.label(
             default = Label("@protobuf//:protoc"),
             executable = True,
@@ -79,7 +80,7 @@ _java_grpc_gensource = rule(
     implementation = _gensource_impl,
 )
 
-def java_grpc_library(name, srcs, deps, enable_deprecated = None, visibility = None, constraints = None, **kwargs):
+def java_grpc_library(name, srcs, deps, enable_deprecated = None, plugin_options = [], visibility = None, constraints = None, **kwargs):
     """Generates and compiles gRPC Java sources for services defined in a proto
     file. This rule is compatible with proto_library with java_api_version,
     java_proto_library, and java_lite_proto_library.
@@ -93,6 +94,10 @@ def java_grpc_library(name, srcs, deps, enable_deprecated = None, visibility = N
           service. Required.
       deps: (list) a single java_proto_library target for the proto_library in
           srcs.  Required.
+      plugin_options: (list) options for the gRPC Java code generator, e.g.
+          "noasyncstub", "noblockingstub" and "nofuturestub" to leave out those
+          client stubs, or "shareddescriptorsupplier" for one schema descriptor
+          supplier class for all the services of the file.
       visibility: (list) the visibility list
       **kwargs: Passed through to generated targets
     """
@@ -101,6 +106,7 @@ def java_grpc_library(name, srcs, deps, enable_deprecated = None, visibility = N
         name = gensource_name,
         srcs = srcs,
         enable_deprecated = enable_deprecated,
+        plugin_options = plugin_options,
         visibility = ["//visibility:private"],
         tags = [
             "avoid_dep",
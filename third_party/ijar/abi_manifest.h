@@ -0,0 +1,46 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// abi_manifest.h -- per-entry digests of an interface jar.
+//
+// An ABI manifest has one line per class or other file that ijar wrote to
+// the interface jar, in the order of the jar:
+//
+//   <ABI digest> <name>
+//
+// The ABI digest is the SHA-256 of the file in the interface jar, in
+// lowercase hex. Since ijar's output only depends on the ABI of the classes,
+// a change of the implementation of a class doesn't change its line.
+//
+
+#ifndef THIRD_PARTY_IJAR_ABI_MANIFEST_H_
+#define THIRD_PARTY_IJAR_ABI_MANIFEST_H_
+
+#include <stddef.h>
+
+#include <string>
+
+namespace devtools_ijar {
+
+// Returns the SHA-256 digest of the data in lowercase hex.
+std::string Sha256Hex(const void *data, size_t size);
+
+// Appends the line of a file to the manifest.
+void AppendAbiManifestEntry(const std::string &name,
+                            const std::string &abi_digest,
+                            std::string *manifest);
+
+}  // namespace devtools_ijar
+
+#endif  // THIRD_PARTY_IJAR_ABI_MANIFEST_H_
@@ -32,9 +32,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <memory>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <unordered_set>
 #include <vector>
 
@@ -112,12 +115,114 @@ enum TARGET_TYPE {
 
 struct Constant;
 
+// A bump allocator for the objects that describe the class being stripped.
+// They all die together once the class has been written, so instead of being
+// created with new and freed one by one, they are taken from an arena that is
+// rewound between classes. The blocks are kept for the next class.
+class ClassArena {
+ public:
+  void *Alloc(size_t size) {
+    size = (size + kAlignment - 1) & ~(kAlignment - 1);
+    if (block_ == blocks_.size() || blocks_[block_].size - used_ < size) {
+      NextBlock(size);
+    }
+    void *result = blocks_[block_].data.get() + used_;
+    used_ += size;
+    return result;
+  }
+
+  void Reset() {
+    block_ = 0;
+    used_ = 0;
+  }
+
+ private:
+  static constexpr size_t kAlignment = alignof(max_align_t);
+  static constexpr size_t kBlockSize = 64 * 1024;
+
+  struct Block {
+    std::unique_ptr<u1[]> data;
+    size_t size;
+  };
+
+  void NextBlock(size_t size) {
+    if (block_ < blocks_.size()) {
+      ++block_;
+    }
+    used_ = 0;
+    if (block_ == blocks_.size() || blocks_[block_].size < size) {
+      size_t block_size = size > kBlockSize ? size : kBlockSize;
+      blocks_.insert(blocks_.begin() + block_,
+                     Block{std::unique_ptr<u1[]>(new u1[block_size]),
+                           block_size});
+    }
+  }
+
+  std::vector<Block> blocks_;
+  size_t block_ = 0;  // the block being filled
+  size_t used_ = 0;   // bytes used in that block
+};
+
 // TODO(adonovan) these globals are unfortunate
-static std::vector<Constant *> const_pool_in;   // input constant pool
-static std::vector<Constant *> const_pool_out;  // output constant_pool
-static std::set<std::string> used_class_names;
-static Constant *class_name;
+// They describe the class being stripped, so they are per thread: ijar may
+// strip the classes of a jar on several threads (see --jobs).
+static thread_local ClassArena arena;
+static thread_local std::vector<Constant *> const_pool_in;   // input pool
+static thread_local std::vector<Constant *> const_pool_out;  // output pool
+// Views of the input class file.
+static thread_local std::unordered_set<std::string_view> used_class_names;
+static thread_local Constant *class_name;
+// The UTF-8 constants of the input pool, for the pre-scan of IsAbiMinimal().
+static thread_local std::vector<std::string_view> scanned_utf8;
 static std::unordered_set<std::string> unknown_attributes;
+static std::mutex unknown_attributes_mutex;
+
+// Base of the objects that are allocated from the arena. They are never
+// destroyed, so they must not own anything that needs a destructor.
+struct ArenaObject {
+  static void *operator new(size_t size) { return arena.Alloc(size); }
+  static void operator delete(void * /*ptr*/) {}
+};
+
+// A vector of trivially copyable elements that is stored in the arena. Its
+// capacity is set once by Reserve(), since the class file always gives the
+// number of items before the items themselves.
+template <typename T>
+class ArenaArray {
+ public:
+  void Reserve(size_t capacity) {
+    data_ = static_cast<T *>(arena.Alloc(capacity * sizeof(T)));
+    size_ = 0;
+    capacity_ = capacity;
+  }
+
+  void push_back(const T &value) {
+    if (size_ == capacity_) {
+      fprintf(stderr, "ArenaArray::push_back() past its capacity.\n");
+      abort();
+    }
+    data_[size_++] = value;
+  }
+
+  void erase(T *position) {
+    memmove(position, position + 1, (end() - position - 1) * sizeof(T));
+    --size_;
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  T &operator[](size_t i) { return data_[i]; }
+  const T &operator[](size_t i) const { return data_[i]; }
+  T *begin() { return data_; }
+  T *end() { return data_ + size_; }
+  const T *begin() const { return data_; }
+  const T *end() const { return data_ + size_; }
+
+ private:
+  T *data_ = NULL;
+  size_t size_ = 0;
+  size_t capacity_ = 0;
+};
 
 // Returns the Constant object, given an index into the input constant pool.
 // Note: constant(0) == NULL; this invariant is exploited by the
@@ -137,18 +242,21 @@ inline Constant *constant(int idx) {
  **********************************************************************/
 
 // See sec.4.4 of JVM spec.
-struct Constant {
+struct Constant : ArenaObject {
 
   Constant(u1 tag) :
       slot_(0),
       tag_(tag) {}
 
-  virtual ~Constant() {}
-
   // For UTF-8 string constants, returns the encoded string.
   // Otherwise, returns an undefined string value suitable for debugging.
   virtual std::string Display() = 0;
 
+  // For UTF-8 string constants, returns a view of the encoded string in the
+  // input class file, and for class constants, of the class name. Otherwise,
+  // returns an empty view. Unlike Display(), this doesn't copy.
+  std::string_view Utf8();
+
   virtual void Write(u1 *&p) = 0;
 
   // Called by slot() when a constant has been identified as required
@@ -191,7 +299,7 @@ struct Constant {
 //
 // desc: the descriptor class names should be extracted from.
 // p: the position where the extraction should tart.
-void ExtractClassNames(const std::string& desc, size_t* p);
+void ExtractClassNames(std::string_view desc, size_t* p);
 
 // See sec.4.4.1 of JVM spec.
 struct Constant_Class : Constant
@@ -350,6 +458,20 @@ struct Constant_Utf8 : Constant
   const u1 *utf8_;
 };
 
+std::string_view Constant::Utf8() {
+  switch (tag_) {
+    case CONSTANT_Utf8: {
+      Constant_Utf8 *utf8 = static_cast<Constant_Utf8 *>(this);
+      return std::string_view((const char *)utf8->utf8_, utf8->length_);
+    }
+    case CONSTANT_Class:
+      return constant(static_cast<Constant_Class *>(this)->name_index_)
+          ->Utf8();
+    default:
+      return std::string_view();
+  }
+}
+
 // See sec.4.4.8 of JVM spec.
 struct Constant_MethodHandle : Constant
 {
@@ -443,9 +565,8 @@ struct Constant_InvokeDynamic : Constant {
  **********************************************************************/
 
 // See sec.4.7 of JVM spec.
-struct Attribute {
+struct Attribute : ArenaObject {
 
-  virtual ~Attribute() {}
   virtual void Write(u1 *&p) = 0;
   virtual void ExtractClassNames() {}
   virtual bool KeepForCompile() const { return false; }
@@ -458,18 +579,12 @@ struct Attribute {
   Constant *attribute_name_;
 };
 
-struct HasAttrs {
-  std::vector<Attribute*> attributes;
+struct HasAttrs : ArenaObject {
+  ArenaArray<Attribute*> attributes;
 
   void WriteAttrs(u1 *&p);
   void ReadAttrs(const u1 *&p);
 
-  virtual ~HasAttrs() {
-    for (const auto *attribute : attributes) {
-      delete attribute;
-    }
-  }
-
   void ExtractClassNames() {
     for (auto *attribute : attributes) {
       attribute->ExtractClassNames();
@@ -484,6 +599,7 @@ struct ExceptionsAttribute : Attribute {
     ExceptionsAttribute *attr = new ExceptionsAttribute;
     attr->attribute_name_ = attribute_name;
     u2 number_of_exceptions = get_u2be(p);
+    attr->exceptions_.Reserve(number_of_exceptions);
     for (int ii = 0; ii < number_of_exceptions; ++ii) {
       attr->exceptions_.push_back(constant(get_u2be(p)));
     }
@@ -498,30 +614,25 @@ struct ExceptionsAttribute : Attribute {
     }
   }
 
-  std::vector<Constant*> exceptions_;
+  ArenaArray<Constant*> exceptions_;
 };
 
 // See sec.4.7.6 of JVM spec.
 struct InnerClassesAttribute : Attribute {
 
-  struct Entry {
+  struct Entry : ArenaObject {
     Constant *inner_class_info;
     Constant *outer_class_info;
     Constant *inner_name;
     u2 inner_class_access_flags;
   };
 
-  virtual ~InnerClassesAttribute() {
-    for (size_t i = 0; i < entries_.size(); i++) {
-      delete entries_[i];
-    }
-  }
-
   static InnerClassesAttribute* Read(const u1 *&p, Constant *attribute_name) {
     InnerClassesAttribute *attr = new InnerClassesAttribute;
     attr->attribute_name_ = attribute_name;
 
     u2 number_of_classes = get_u2be(p);
+    attr->entries_.Reserve(number_of_classes);
     for (int ii = 0; ii < number_of_classes; ++ii) {
       Entry *entry = new Entry;
       entry->inner_class_info = constant(get_u2be(p));
@@ -547,7 +658,7 @@ struct InnerClassesAttribute : Attribute {
            ++i_entry) {
         Entry* entry = entries_[i_entry];
         if (entry->inner_class_info->Kept() ||
-            used_class_names.find(entry->inner_class_info->Display()) !=
+            used_class_names.find(entry->inner_class_info->Utf8()) !=
                 used_class_names.end() ||
             entry->outer_class_info == class_name) {
           if (entry->inner_name == NULL) {
@@ -591,7 +702,7 @@ struct InnerClassesAttribute : Attribute {
     }
   }
 
-  std::vector<Entry*> entries_;
+  ArenaArray<Entry*> entries_;
 };
 
 // See sec.4.7.7 of JVM spec.
@@ -623,8 +734,7 @@ struct EnclosingMethodAttribute : Attribute {
 
 // See sec.4.7.16.1 of JVM spec.
 // Used by AnnotationDefault and other attributes.
-struct ElementValue {
-  virtual ~ElementValue() {}
+struct ElementValue : ArenaObject {
   virtual void Write(u1 *&p) = 0;
   virtual void ExtractClassNames() {}
   static ElementValue* Read(const u1 *&p);
@@ -669,7 +779,7 @@ struct ClassTypeElementValue : ElementValue {
 
   virtual void ExtractClassNames() {
     size_t idx = 0;
-    devtools_ijar::ExtractClassNames(class_info_->Display(), &idx);
+    devtools_ijar::ExtractClassNames(class_info_->Utf8(), &idx);
   }
 
   static ClassTypeElementValue *Read(const u1 *&p) {
@@ -681,12 +791,6 @@ struct ClassTypeElementValue : ElementValue {
 };
 
 struct ArrayTypeElementValue : ElementValue {
-  virtual ~ArrayTypeElementValue() {
-    for (const auto *value : values_) {
-      delete value;
-    }
-  }
-
   virtual void ExtractClassNames() {
     for (auto *value : values_) {
       value->ExtractClassNames();
@@ -703,23 +807,17 @@ struct ArrayTypeElementValue : ElementValue {
   static ArrayTypeElementValue *Read(const u1 *&p) {
     ArrayTypeElementValue *value = new ArrayTypeElementValue;
     u2 num_values = get_u2be(p);
+    value->values_.Reserve(num_values);
     for (int ii = 0; ii < num_values; ++ii) {
       value->values_.push_back(ElementValue::Read(p));
     }
     return value;
   }
-  std::vector<ElementValue*> values_;
+  ArenaArray<ElementValue*> values_;
 };
 
 // See sec.4.7.16 of JVM spec.
-struct Annotation {
-  virtual ~Annotation() {
-    for (size_t i = 0; i < element_value_pairs_.size(); i++) {
-      delete element_value_pairs_[i]->element_value_;
-      delete element_value_pairs_[i];
-    }
-  }
-
+struct Annotation : ArenaObject {
   void ExtractClassNames() {
     for (size_t i = 0; i < element_value_pairs_.size(); i++) {
       element_value_pairs_[i]->element_value_->ExtractClassNames();
@@ -738,6 +836,7 @@ struct Annotation {
     Annotation *value = new Annotation;
     value->type_ = constant(get_u2be(p));
     u2 num_element_value_pairs = get_u2be(p);
+    value->element_value_pairs_.Reserve(num_element_value_pairs);
     for (int ii = 0; ii < num_element_value_pairs; ++ii) {
       ElementValuePair *pair = new ElementValuePair;
       pair->element_name_ = constant(get_u2be(p));
@@ -747,11 +846,11 @@ struct Annotation {
     return value;
   }
   Constant *type_;
-  struct ElementValuePair {
+  struct ElementValuePair : ArenaObject {
     Constant *element_name_;
     ElementValue *element_value_;
   };
-  std::vector<ElementValuePair*> element_value_pairs_;
+  ArenaArray<ElementValuePair*> element_value_pairs_;
 };
 
 // See sec 4.7.20 of Java 8 JVM Spec
@@ -784,13 +883,7 @@ struct Annotation {
 //   element_value_pairs[num_element_value_pairs];
 // }
 //
-struct TypeAnnotation {
-  virtual ~TypeAnnotation() {
-    delete target_info_;
-    delete type_path_;
-    delete annotation_;
-  }
-
+struct TypeAnnotation : ArenaObject {
   void ExtractClassNames() {
     annotation_->ExtractClassNames();
   }
@@ -811,8 +904,7 @@ struct TypeAnnotation {
     return value;
   }
 
-  struct TargetInfo {
-    virtual ~TargetInfo() {}
+  struct TargetInfo : ArenaObject {
     virtual void Write(u1 *&p) = 0;
   };
 
@@ -909,7 +1001,7 @@ struct TypeAnnotation {
     }
   }
 
-  struct TypePath {
+  struct TypePath : ArenaObject {
     void Write(u1 *&p) {
       put_u1(p, path_.size());
       for (TypePathEntry entry : path_) {
@@ -920,6 +1012,7 @@ struct TypeAnnotation {
     static TypePath *Read(const u1 *&p) {
       TypePath *value = new TypePath;
       u1 path_length = get_u1(p);
+      value->path_.Reserve(path_length);
       for (int ii = 0; ii < path_length; ++ii) {
         TypePathEntry entry;
         entry.type_path_kind_ = get_u1(p);
@@ -933,7 +1026,7 @@ struct TypeAnnotation {
       u1 type_path_kind_;
       u1 type_argument_index_;
     };
-    std::vector<TypePathEntry> path_;
+    ArenaArray<TypePathEntry> path_;
   };
 
   u1 target_type_;
@@ -943,10 +1036,6 @@ struct TypeAnnotation {
 };
 
 struct AnnotationTypeElementValue : ElementValue {
-  virtual ~AnnotationTypeElementValue() {
-    delete annotation_;
-  }
-
   void Write(u1 *&p) {
     put_u1(p, tag_);
     annotation_->Write(p);
@@ -987,10 +1076,6 @@ ElementValue* ElementValue::Read(const u1 *&p) {
 // We preserve AnnotationDefault attributes because they are required
 // in order to make use of an annotation in new code.
 struct AnnotationDefaultAttribute : Attribute {
-  virtual ~AnnotationDefaultAttribute() {
-    delete default_value_;
-  }
-
   static AnnotationDefaultAttribute* Read(const u1 *&p,
                                           Constant *attribute_name) {
     AnnotationDefaultAttribute *attr = new AnnotationDefaultAttribute;
@@ -1050,7 +1135,7 @@ struct SignatureAttribute : Attribute {
 
   virtual void ExtractClassNames() {
     size_t signature_idx = 0;
-    devtools_ijar::ExtractClassNames(signature_->Display(), &signature_idx);
+    devtools_ijar::ExtractClassNames(signature_->Utf8(), &signature_idx);
   }
 
   Constant *signature_;
@@ -1077,16 +1162,11 @@ struct DeprecatedAttribute : Attribute {
 //
 // We preserve all annotations.
 struct AnnotationsAttribute : Attribute {
-  virtual ~AnnotationsAttribute() {
-    for (size_t i = 0; i < annotations_.size(); i++) {
-      delete annotations_[i];
-    }
-  }
-
   static AnnotationsAttribute* Read(const u1 *&p, Constant *attribute_name) {
     AnnotationsAttribute *attr = new AnnotationsAttribute;
     attr->attribute_name_ = attribute_name;
     u2 num_annotations = get_u2be(p);
+    attr->annotations_.Reserve(num_annotations);
     for (int ii = 0; ii < num_annotations; ++ii) {
       Annotation *annotation = Annotation::Read(p);
       attr->annotations_.push_back(annotation);
@@ -1102,7 +1182,7 @@ struct AnnotationsAttribute : Attribute {
 
   virtual bool KeepForCompile() const {
     for (auto *annotation : annotations_) {
-      if (annotation->type_->Display() == "Lkotlin/Metadata;") {
+      if (annotation->type_->Utf8() == "Lkotlin/Metadata;") {
         return true;
       }
     }
@@ -1119,7 +1199,7 @@ struct AnnotationsAttribute : Attribute {
     put_u4be(payload_start, p - 4 - payload_start);  // backpatch length
   }
 
-  std::vector<Annotation*> annotations_;
+  ArenaArray<Annotation*> annotations_;
 };
 
 // See sec.4.7.18-19 of JVM spec.  Includes RuntimeVisible and
@@ -1133,9 +1213,11 @@ struct ParameterAnnotationsAttribute : Attribute {
     ParameterAnnotationsAttribute *attr = new ParameterAnnotationsAttribute;
     attr->attribute_name_ = attribute_name;
     u1 num_parameters = get_u1(p);
+    attr->parameter_annotations_.Reserve(num_parameters);
     for (int ii = 0; ii < num_parameters; ++ii) {
-      std::vector<Annotation*> annotations;
+      ArenaArray<Annotation*> annotations;
       u2 num_annotations = get_u2be(p);
+      annotations.Reserve(num_annotations);
       for (int ii = 0; ii < num_annotations; ++ii) {
         Annotation *annotation = Annotation::Read(p);
         annotations.push_back(annotation);
@@ -1147,7 +1229,7 @@ struct ParameterAnnotationsAttribute : Attribute {
 
   virtual void ExtractClassNames() {
     for (size_t i = 0; i < parameter_annotations_.size(); i++) {
-      const std::vector<Annotation*>& annotations = parameter_annotations_[i];
+      const ArenaArray<Annotation*>& annotations = parameter_annotations_[i];
       for (size_t j = 0; j < annotations.size(); j++) {
         annotations[j]->ExtractClassNames();
       }
@@ -1159,7 +1241,7 @@ struct ParameterAnnotationsAttribute : Attribute {
     u1 *payload_start = p - 4;
     put_u1(p, parameter_annotations_.size());
     for (size_t ii = 0; ii < parameter_annotations_.size(); ++ii) {
-      std::vector<Annotation *> &annotations = parameter_annotations_[ii];
+      ArenaArray<Annotation *> &annotations = parameter_annotations_[ii];
       put_u2be(p, annotations.size());
       for (size_t jj = 0; jj < annotations.size(); ++jj) {
         annotations[jj]->Write(p);
@@ -1168,7 +1250,7 @@ struct ParameterAnnotationsAttribute : Attribute {
     put_u4be(payload_start, p - 4 - payload_start);  // backpatch length
   }
 
-  std::vector<std::vector<Annotation*> > parameter_annotations_;
+  ArenaArray<ArenaArray<Annotation*> > parameter_annotations_;
 };
 
 // See sec.4.7.20 of Java 8 JVM spec. Includes RuntimeVisibleTypeAnnotations
@@ -1179,6 +1261,7 @@ struct TypeAnnotationsAttribute : Attribute {
     auto attr = new TypeAnnotationsAttribute;
     attr->attribute_name_ = attribute_name;
     u2 num_annotations = get_u2be(p);
+    attr->type_annotations_.Reserve(num_annotations);
     for (int ii = 0; ii < num_annotations; ++ii) {
       TypeAnnotation *annotation = TypeAnnotation::Read(p);
       attr->type_annotations_.push_back(annotation);
@@ -1202,7 +1285,7 @@ struct TypeAnnotationsAttribute : Attribute {
     put_u4be(payload_start, p - 4 - payload_start);  // backpatch length
   }
 
-  std::vector<TypeAnnotation*> type_annotations_;
+  ArenaArray<TypeAnnotation*> type_annotations_;
 };
 
 // See JVMS §4.7.24
@@ -1212,6 +1295,7 @@ struct MethodParametersAttribute : Attribute {
     auto attr = new MethodParametersAttribute;
     attr->attribute_name_ = attribute_name;
     u1 parameters_count = get_u1(p);
+    attr->parameters_.Reserve(parameters_count);
     for (int ii = 0; ii < parameters_count; ++ii) {
       MethodParameter* parameter = new MethodParameter;
       int name_id = get_u2be(p);
@@ -1233,12 +1317,12 @@ struct MethodParametersAttribute : Attribute {
     put_u4be(payload_start, p - 4 - payload_start);  // backpatch length
   }
 
-  struct MethodParameter {
+  struct MethodParameter : ArenaObject {
     Constant *name_;
     u2 access_flags_;
   };
 
-  std::vector<MethodParameter*> parameters_;
+  ArenaArray<MethodParameter*> parameters_;
 };
 
 // See JVMS §4.7.28
@@ -1266,6 +1350,7 @@ struct NestMembersAttribute : Attribute {
     auto attr = new NestMembersAttribute;
     attr->attribute_name_ = attribute_name;
     u2 number_of_classes = get_u2be(p);
+    attr->classes_.Reserve(number_of_classes);
     for (int ii = 0; ii < number_of_classes; ++ii) {
       attr->classes_.push_back(constant(get_u2be(p)));
     }
@@ -1276,7 +1361,7 @@ struct NestMembersAttribute : Attribute {
     std::set<int> kept_entries;
     for (size_t ii = 0; ii < classes_.size(); ++ii) {
       Constant *class_ = classes_[ii];
-      if (class_->Kept() || (used_class_names.find(class_->Display()) !=
+      if (class_->Kept() || (used_class_names.find(class_->Utf8()) !=
                              used_class_names.end())) {
         kept_entries.insert(ii);
       }
@@ -1292,7 +1377,7 @@ struct NestMembersAttribute : Attribute {
     }
   }
 
-  std::vector<Constant *> classes_;
+  ArenaArray<Constant *> classes_;
 };
 
 // See JVMS §4.7.30
@@ -1303,6 +1388,7 @@ struct RecordAttribute : Attribute {
     attr->attribute_name_ = attribute_name;
     attr->attribute_length_ = attribute_length;
     u2 components_length = get_u2be(p);
+    attr->components_.Reserve(components_length);
     for (int i = 0; i < components_length; ++i) {
       attr->components_.push_back(RecordComponentInfo::Read(p));
     }
@@ -1310,7 +1396,7 @@ struct RecordAttribute : Attribute {
   }
 
   void Write(u1 *&p) {
-    u1 *tmp = new u1[attribute_length_];
+    u1 *tmp = static_cast<u1 *>(arena.Alloc(attribute_length_));
     u1 *start = tmp;
     put_u2be(tmp, components_.size());
     for (size_t i = 0; i < components_.size(); ++i) {
@@ -1341,7 +1427,7 @@ struct RecordAttribute : Attribute {
   };
 
   u4 attribute_length_;
-  std::vector<RecordComponentInfo *> components_;
+  ArenaArray<RecordComponentInfo *> components_;
 };
 
 // See JVMS §4.7.31
@@ -1351,6 +1437,7 @@ struct PermittedSubclassesAttribute : Attribute {
     PermittedSubclassesAttribute *attr = new PermittedSubclassesAttribute;
     attr->attribute_name_ = attribute_name;
     u2 number_of_exceptions = get_u2be(p);
+    attr->permitted_subclasses_.Reserve(number_of_exceptions);
     for (int ii = 0; ii < number_of_exceptions; ++ii) {
       attr->permitted_subclasses_.push_back(constant(get_u2be(p)));
     }
@@ -1365,7 +1452,7 @@ struct PermittedSubclassesAttribute : Attribute {
     }
   }
 
-  std::vector<Constant *> permitted_subclasses_;
+  ArenaArray<Constant *> permitted_subclasses_;
 };
 
 struct GeneralAttribute : Attribute {
@@ -1432,21 +1519,9 @@ struct ClassFile : HasAttrs {
   u2 access_flags;
   Constant *this_class;
   Constant *super_class;
-  std::vector<Constant*> interfaces;
-  std::vector<Member*> fields;
-  std::vector<Member*> methods;
-
-  virtual ~ClassFile() {
-    for (size_t i = 0; i < fields.size(); i++) {
-      delete fields[i];
-    }
-
-    for (size_t i = 0; i < methods.size(); i++) {
-      delete methods[i];
-    }
-
-    // Constants do not need to be deleted; they are owned by the constant pool.
-  }
+  ArenaArray<Constant*> interfaces;
+  ArenaArray<Member*> fields;
+  ArenaArray<Member*> methods;
 
   void WriteClass(u1 *&p);
 
@@ -1491,7 +1566,7 @@ struct ClassFile : HasAttrs {
     // Make the inner classes attribute the last, so that it can know which
     // constants were needed
     for (size_t ii = 0; ii < attributes.size(); ii++) {
-      if (attributes[ii]->attribute_name_->Display() == "InnerClasses") {
+      if (attributes[ii]->attribute_name_->Utf8() == "InnerClasses") {
         inner_classes = attributes[ii];
         attributes.erase(attributes.begin() + ii);
         break;
@@ -1505,7 +1580,7 @@ struct ClassFile : HasAttrs {
     Attribute* nest_members = NULL;
 
     for (size_t ii = 0; ii < attributes.size(); ii++) {
-      if (attributes[ii]->attribute_name_->Display() == "NestMembers") {
+      if (attributes[ii]->attribute_name_->Utf8() == "NestMembers") {
         nest_members = attributes[ii];
         attributes.erase(attributes.begin() + ii);
         break;
@@ -1523,11 +1598,12 @@ struct ClassFile : HasAttrs {
 
 void HasAttrs::ReadAttrs(const u1 *&p) {
   u2 attributes_count = get_u2be(p);
+  attributes.Reserve(attributes_count);
   for (int ii = 0; ii < attributes_count; ii++) {
     Constant *attribute_name = constant(get_u2be(p));
     u4 attribute_length = get_u4be(p);
 
-    std::string attr_name = attribute_name->Display();
+    std::string_view attr_name = attribute_name->Utf8();
     if (attr_name == "SourceFile" ||
         attr_name == "StackMapTable" ||
         attr_name == "LineNumberTable" ||
@@ -1595,9 +1671,10 @@ void HasAttrs::ReadAttrs(const u1 *&p) {
       if (attr_name != "com.android.tools.r8.SynthesizedClass" &&
           attr_name != "com.android.tools.r8.SynthesizedClassV2") {
         // Only warn about the first occurrence of each unknown attribute.
-        if (unknown_attributes.insert(attr_name).second) {
-          fprintf(stderr, "ijar: skipping unknown attribute: \"%s\".\n",
-                  attr_name.c_str());
+        std::lock_guard<std::mutex> lock(unknown_attributes_mutex);
+        if (unknown_attributes.insert(std::string(attr_name)).second) {
+          fprintf(stderr, "ijar: skipping unknown attribute: \"%.*s\".\n",
+                  (int)attr_name.size(), attr_name.data());
         }
       }
       p += attribute_length;
@@ -1628,6 +1705,7 @@ bool ClassFile::ReadConstantPool(const u1 *&p) {
   const_pool_in.push_back(NULL); // dummy first item
 
   u2 cp_count = get_u2be(p);
+  const_pool_in.reserve(cp_count);
   for (int ii = 1; ii < cp_count; ++ii) {
     u1 tag = get_u1(p);
 
@@ -1730,7 +1808,7 @@ bool ClassFile::ReadConstantPool(const u1 *&p) {
 
 bool ClassFile::IsLocalOrAnonymous() {
   for (const Attribute *attribute : attributes) {
-    if (attribute->attribute_name_->Display() == "EnclosingMethod") {
+    if (attribute->attribute_name_->Utf8() == "EnclosingMethod") {
       // JVMS 4.7.6: a class must has EnclosingMethod attribute iff it
       // represents a local class or an anonymous class
       return true;
@@ -1739,7 +1817,7 @@ bool ClassFile::IsLocalOrAnonymous() {
   return false;
 }
 
-static bool HasKeepForCompile(const std::vector<Attribute *> attributes) {
+static bool HasKeepForCompile(const ArenaArray<Attribute *> &attributes) {
   for (const Attribute *attribute : attributes) {
     if (attribute->KeepForCompile()) {
       return true;
@@ -1771,7 +1849,6 @@ static ClassFile *ReadClass(const void *classdata, size_t length) {
   clazz->minor = get_u2be(p);
 
   if (!clazz->ReadConstantPool(p)) {
-    delete clazz;
     return NULL;
   }
 
@@ -1783,11 +1860,13 @@ static ClassFile *ReadClass(const void *classdata, size_t length) {
   clazz->super_class = super_class_id == 0 ? NULL : constant(super_class_id);
 
   u2 interfaces_count = get_u2be(p);
+  clazz->interfaces.Reserve(interfaces_count);
   for (int ii = 0; ii < interfaces_count; ++ii) {
     clazz->interfaces.push_back(constant(get_u2be(p)));
   }
 
   u2 fields_count = get_u2be(p);
+  clazz->fields.Reserve(fields_count);
   for (int ii = 0; ii < fields_count; ++ii) {
     Member *field = Member::Read(p);
 
@@ -1799,11 +1878,12 @@ static ClassFile *ReadClass(const void *classdata, size_t length) {
   }
 
   u2 methods_count = get_u2be(p);
+  clazz->methods.Reserve(methods_count);
   for (int ii = 0; ii < methods_count; ++ii) {
     Member *method = Member::Read(p);
 
     // drop class initializers
-    if (method->name->Display() == "<clinit>") continue;
+    if (method->name->Utf8() == "<clinit>") continue;
 
     if ((method->access_flags & ACC_PRIVATE) == ACC_PRIVATE) {
       // drop private methods
@@ -1829,10 +1909,21 @@ static ClassFile *ReadClass(const void *classdata, size_t length) {
 // this works just as well as in plain ASCII.
 static const char *SIGNATURE_NON_IDENTIFIER_CHARS = ".;[<>:";
 
-void Expect(const std::string& desc, size_t* p, char expected) {
-  if (desc[*p] != expected) {
+// Returns the character at the position in the descriptor, or NUL past its
+// end. Descriptors are views of the input, so they aren't NUL-terminated.
+static inline char CharAt(std::string_view desc, size_t p) {
+  return p < desc.size() ? desc[p] : '\0';
+}
+
+// Returns the rest of the descriptor from the position, for error messages.
+static std::string Rest(std::string_view desc, size_t p) {
+  return std::string(p < desc.size() ? desc.substr(p) : std::string_view());
+}
+
+void Expect(std::string_view desc, size_t* p, char expected) {
+  if (CharAt(desc, *p) != expected) {
     fprintf(stderr, "Expected '%c' in '%s' at %zd in signature\n",
-            expected, desc.substr(*p).c_str(), *p);
+            expected, Rest(desc, *p).c_str(), *p);
     exit(1);
   }
 
@@ -1844,47 +1935,49 @@ void Expect(const std::string& desc, size_t* p, char expected) {
 //
 // This parser is a bit more liberal than the spec, but this should be fine,
 // because it accepts all valid class files and croaks only on invalid ones.
-void ParseFromClassTypeSignature(const std::string& desc, size_t* p);
-void ParseSimpleClassTypeSignature(const std::string& desc, size_t* p);
-void ParseClassTypeSignatureSuffix(const std::string& desc, size_t* p);
-void ParseIdentifier(const std::string& desc, size_t* p);
-void ParseTypeArgumentsOpt(const std::string& desc, size_t* p);
-void ParseMethodDescriptor(const std::string& desc, size_t* p);
-
-void ParseClassTypeSignature(const std::string& desc, size_t* p) {
+void ParseFromClassTypeSignature(std::string_view desc, size_t* p);
+void ParseSimpleClassTypeSignature(std::string_view desc, size_t* p);
+void ParseClassTypeSignatureSuffix(std::string_view desc, size_t* p);
+void ParseIdentifier(std::string_view desc, size_t* p);
+void ParseTypeArgumentsOpt(std::string_view desc, size_t* p);
+void ParseMethodDescriptor(std::string_view desc, size_t* p);
+
+void ParseClassTypeSignature(std::string_view desc, size_t* p) {
   Expect(desc, p, 'L');
   ParseSimpleClassTypeSignature(desc, p);
   ParseClassTypeSignatureSuffix(desc, p);
   Expect(desc, p, ';');
 }
 
-void ParseSimpleClassTypeSignature(const std::string& desc, size_t* p) {
+void ParseSimpleClassTypeSignature(std::string_view desc, size_t* p) {
   ParseIdentifier(desc, p);
   ParseTypeArgumentsOpt(desc, p);
 }
 
-void ParseClassTypeSignatureSuffix(const std::string& desc, size_t* p) {
-  while (desc[*p] == '.') {
+void ParseClassTypeSignatureSuffix(std::string_view desc, size_t* p) {
+  while (CharAt(desc, *p) == '.') {
     *p += 1;
     ParseSimpleClassTypeSignature(desc, p);
   }
 }
 
-void ParseIdentifier(const std::string& desc, size_t* p) {
+void ParseIdentifier(std::string_view desc, size_t* p) {
   size_t next = desc.find_first_of(SIGNATURE_NON_IDENTIFIER_CHARS, *p);
-  std::string id = desc.substr(*p, next - *p);
-  used_class_names.insert(id);
+  if (next == std::string_view::npos) {
+    next = desc.size();
+  }
+  used_class_names.insert(desc.substr(*p, next - *p));
   *p = next;
 }
 
-void ParseTypeArgumentsOpt(const std::string& desc, size_t* p) {
-  if (desc[*p] != '<') {
+void ParseTypeArgumentsOpt(std::string_view desc, size_t* p) {
+  if (CharAt(desc, *p) != '<') {
     return;
   }
 
   *p += 1;
-  while (desc[*p] != '>') {
-    switch (desc[*p]) {
+  while (CharAt(desc, *p) != '>') {
+    switch (CharAt(desc, *p)) {
       case '*':
         *p += 1;
         break;
@@ -1904,9 +1997,9 @@ void ParseTypeArgumentsOpt(const std::string& desc, size_t* p) {
   *p += 1;
 }
 
-void ParseMethodDescriptor(const std::string& desc, size_t* p) {
+void ParseMethodDescriptor(std::string_view desc, size_t* p) {
   Expect(desc, p, '(');
-  while (desc[*p] != ')') {
+  while (CharAt(desc, *p) != ')') {
     ExtractClassNames(desc, p);
   }
 
@@ -1914,16 +2007,16 @@ void ParseMethodDescriptor(const std::string& desc, size_t* p) {
   ExtractClassNames(desc, p);
 }
 
-void ParseFormalTypeParameters(const std::string& desc, size_t* p) {
+void ParseFormalTypeParameters(std::string_view desc, size_t* p) {
   Expect(desc, p, '<');
-  while (desc[*p] != '>') {
+  while (CharAt(desc, *p) != '>') {
     ParseIdentifier(desc, p);
     Expect(desc, p, ':');
-    if (desc[*p] != ':' && desc[*p] != '>') {
+    if (CharAt(desc, *p) != ':' && CharAt(desc, *p) != '>') {
       ExtractClassNames(desc, p);
     }
 
-    while (desc[*p] == ':') {
+    while (CharAt(desc, *p) == ':') {
       Expect(desc, p, ':');
       ExtractClassNames(desc, p);
     }
@@ -1932,8 +2025,8 @@ void ParseFormalTypeParameters(const std::string& desc, size_t* p) {
   Expect(desc, p, '>');
 }
 
-void ExtractClassNames(const std::string& desc, size_t* p) {
-  switch (desc[*p]) {
+void ExtractClassNames(std::string_view desc, size_t* p) {
+  switch (CharAt(desc, *p)) {
     case '<':
       ParseFormalTypeParameters(desc, p);
       ExtractClassNames(desc, p);
@@ -1971,7 +2064,7 @@ void ExtractClassNames(const std::string& desc, size_t* p) {
       break;
 
     default:
-      fprintf(stderr, "Invalid signature %s\n", desc.substr(*p).c_str());
+      fprintf(stderr, "Invalid signature %s\n", Rest(desc, *p).c_str());
   }
 }
 
@@ -1983,23 +2076,192 @@ void ClassFile::WriteClass(u1 *&p) {
   ExtractClassNames();
   for (auto *member : members) {
     size_t idx = 0;
-    devtools_ijar::ExtractClassNames(member->descriptor->Display(), &idx);
+    devtools_ijar::ExtractClassNames(member->descriptor->Utf8(), &idx);
     member->ExtractClassNames();
   }
 
   // We have to write the body out before the header in order to reference
   // the essential constants and populate the output constant pool:
-  u1 *body = new u1[length];
+  u1 *body = static_cast<u1 *>(arena.Alloc(length));
   u1 *q = body;
   WriteBody(q); // advances q
   u4 body_length = q - body;
 
   WriteHeader(p); // advances p
   put_n(p, body, body_length);
-  delete[] body;
+}
+
+/**********************************************************************
+ *                                                                    *
+ *                              Pre-scan                              *
+ *                                                                    *
+ **********************************************************************/
+
+// Returns true for the attributes that StripClass() keeps as they are.
+// Attributes that it prunes, like InnerClasses, are not among them.
+static bool IsKeptAsIs(std::string_view attr_name) {
+  return attr_name == "Exceptions" ||
+         attr_name == "Signature" ||
+         attr_name == "Deprecated" ||
+         attr_name == "AnnotationDefault" ||
+         attr_name == "ConstantValue" ||
+         attr_name == "RuntimeVisibleAnnotations" ||
+         attr_name == "RuntimeInvisibleAnnotations" ||
+         attr_name == "RuntimeVisibleParameterAnnotations" ||
+         attr_name == "RuntimeInvisibleParameterAnnotations" ||
+         attr_name == "RuntimeVisibleTypeAnnotations" ||
+         attr_name == "RuntimeInvisibleTypeAnnotations" ||
+         attr_name == "MethodParameters" ||
+         attr_name == "NestHost" ||
+         attr_name == "PermittedSubclasses";
+}
+
+// Skips the attributes, if they are all kept as they are.
+static bool SkipKeptAttributes(const u1 *&p, const u1 *end) {
+  if (end - p < 2) {
+    return false;
+  }
+  u2 attributes_count = get_u2be(p);
+  for (int ii = 0; ii < attributes_count; ++ii) {
+    if (end - p < 6) {
+      return false;
+    }
+    u2 name_index = get_u2be(p);
+    u4 attribute_length = get_u4be(p);
+    if (name_index >= scanned_utf8.size() ||
+        !IsKeptAsIs(scanned_utf8[name_index]) ||
+        (size_t)(end - p) < attribute_length) {
+      return false;
+    }
+    p += attribute_length;
+  }
+  return true;
+}
+
+// Skips the fields or methods, if StripClass() would keep all of them as
+// they are.
+static bool SkipKeptMembers(const u1 *&p, const u1 *end, bool methods) {
+  if (end - p < 2) {
+    return false;
+  }
+  u2 members_count = get_u2be(p);
+  for (int ii = 0; ii < members_count; ++ii) {
+    if (end - p < 6) {
+      return false;
+    }
+    u2 access_flags = get_u2be(p);
+    u2 name_index = get_u2be(p);
+    p += 2;  // descriptor_index
+    if ((access_flags & ACC_PRIVATE) == ACC_PRIVATE) {
+      return false;
+    }
+    if (methods) {
+      if (name_index >= scanned_utf8.size() ||
+          scanned_utf8[name_index] == "<clinit>" ||
+          (access_flags & (ACC_SYNTHETIC | ACC_BRIDGE | ACC_PUBLIC |
+                           ACC_PROTECTED)) == ACC_SYNTHETIC) {
+        return false;
+      }
+    }
+    // A method with a body has a Code attribute, which isn't kept.
+    if (!SkipKeptAttributes(p, end)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns true if the class is already as small as StripClass() would make
+// it, so that it can be copied as it is without being parsed. This is the
+// case for interfaces and annotations without code, and for classes that
+// have already been stripped, e.g. by ijar or turbine: they have no code, no
+// private or synthetic members, and only attributes that are kept as they
+// are. The class files of javac have a SourceFile attribute unless they are
+// compiled with -g:none, so they go through StripClass() as usual.
+//
+// Only the structure of the class is checked, in a single pass over it that
+// allocates nothing. A class file that is truncated or has constants
+// unknown to ijar is left to the full parser.
+static bool IsAbiMinimal(const u1 *classdata, size_t length) {
+  const u1 *p = classdata;
+  const u1 *end = classdata + length;
+  if (length < 10 || get_u4be(p) != 0xCAFEBABE) {
+    return false;
+  }
+  p += 4;  // minor and major versions
+
+  u2 cp_count = get_u2be(p);
+  scanned_utf8.assign(cp_count, std::string_view());
+  for (int ii = 1; ii < cp_count; ++ii) {
+    if (end - p < 1) {
+      return false;
+    }
+    size_t size;
+    switch (get_u1(p)) {
+      case CONSTANT_Class:
+      case CONSTANT_String:
+      case CONSTANT_MethodType:
+        size = 2;
+        break;
+      case CONSTANT_MethodHandle:
+        size = 3;
+        break;
+      case CONSTANT_FieldRef:
+      case CONSTANT_Methodref:
+      case CONSTANT_Interfacemethodref:
+      case CONSTANT_NameAndType:
+      case CONSTANT_Integer:
+      case CONSTANT_Float:
+      case CONSTANT_Dynamic:
+      case CONSTANT_InvokeDynamic:
+        size = 4;
+        break;
+      case CONSTANT_Long:
+      case CONSTANT_Double:
+        size = 8;
+        ii++;  // They occupy two slots.
+        break;
+      case CONSTANT_Utf8: {
+        if (end - p < 2) {
+          return false;
+        }
+        size = get_u2be(p);
+        if ((size_t)(end - p) >= size) {
+          scanned_utf8[ii] = std::string_view((const char *)p, size);
+        }
+        break;
+      }
+      default:
+        return false;
+    }
+    if ((size_t)(end - p) < size) {
+      return false;
+    }
+    p += size;
+  }
+
+  if (end - p < 8) {
+    return false;
+  }
+  p += 6;  // access_flags, this_class and super_class
+  u2 interfaces_count = get_u2be(p);
+  if ((size_t)(end - p) < interfaces_count * 2u) {
+    return false;
+  }
+  p += interfaces_count * 2u;
+
+  // Trailing bytes would be dropped.
+  return SkipKeptMembers(p, end, /* methods: */ false) &&
+         SkipKeptMembers(p, end, /* methods: */ true) &&
+         SkipKeptAttributes(p, end) && p == end;
 }
 
 bool StripClass(u1 *&classdata_out, const u1 *classdata_in, size_t in_length) {
+  if (IsAbiMinimal(classdata_in, in_length)) {
+    put_n(classdata_out, classdata_in, in_length);
+    return true;
+  }
+
   ClassFile *clazz = ReadClass(classdata_in, in_length);
   bool keep = true;
   if (clazz == NULL || clazz->KeepForCompile()) {
@@ -2013,16 +2275,12 @@ bool StripClass(u1 *&classdata_out, const u1 *classdata_in, size_t in_length) {
     // fail if called prior to this.
     const_pool_out.push_back(NULL);
     clazz->WriteClass(classdata_out);
-
-    delete clazz;
-  }
-
-  // Now clean up all the mess we left behind.
-
-  for (size_t i = 0; i < const_pool_in.size(); i++) {
-    delete const_pool_in[i];
   }
 
+  // Now clean up all the mess we left behind. The objects of the class are
+  // all in the arena, and the names only point into the input.
+  arena.Reset();
+  used_class_names.clear();
   const_pool_in.clear();
   const_pool_out.clear();
   return keep;
@@ -21,13 +21,18 @@ namespace devtools_ijar {
 
 u4 ComputeCrcChecksum(u1* buf, size_t length) { return 0; }
 
-size_t TryDeflate(u1* buf, size_t length) { return 0; }
+size_t TryDeflate(u1* buf, size_t length, int level) { return 0; }
+
+size_t TryDeflateTo(const u1* in, size_t length, u1* out, int level) {
+  return 0;
+}
 
 Decompressor::Decompressor() {}
 Decompressor::~Decompressor() {}
 
 DecompressedFile* Decompressor::UncompressFile(const u1* buffer,
-                                                      size_t bytes_avail) {
+                                                size_t bytes_avail,
+                                                size_t expected_size) {
   return NULL;
 }
 
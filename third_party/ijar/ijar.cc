@@ -20,8 +20,20 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <memory>
 
+#include <list>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "src/main/cpp/util/probe.h"
+#include "src/main/cpp/util/task_pool.h"
+#include "third_party/ijar/abi_manifest.h"
+#include "third_party/ijar/platform_utils.h"
+#include "third_party/ijar/worker.h"
 #include "third_party/ijar/zip.h"
 
 namespace devtools_ijar {
@@ -74,6 +86,8 @@ class JarExtractorProcessor : public ZipExtractorProcessor {
   void SetZipBuilder(ZipBuilder *builder) { this->builder_ = builder; }
   virtual void WriteManifest(const char *target_label,
                              const char *injecting_rule_kind) = 0;
+  // Writes the files still being processed. Called after ProcessAll().
+  virtual void Finish() {}
 
  protected:
   // Not owned by JarStripperProcessor, see SetZipBuilder().
@@ -83,10 +97,17 @@ class JarExtractorProcessor : public ZipExtractorProcessor {
 // ZipExtractorProcessor that select only .class file and use
 // StripClass to generate an interface class, storing as a new file
 // in the specified ZipBuilder.
+//
+// With more than one job, the classes are stripped on a pool of threads
+// while the main thread keeps reading the input. The results are written in
+// the order of the input, so the output does not depend on the number of
+// jobs.
 class JarStripperProcessor : public JarExtractorProcessor {
  public:
-  JarStripperProcessor() {}
-  virtual ~JarStripperProcessor() {}
+  JarStripperProcessor(int jobs, bool abi_manifest);
+
+  // The ABI manifest of the files written so far, if it was asked for.
+  const std::string &abi_manifest() const { return abi_manifest_; }
 
   virtual void Process(const char *filename, const u4 attr, const u1 *data,
                        const size_t size);
@@ -94,6 +115,34 @@ class JarStripperProcessor : public JarExtractorProcessor {
 
   virtual void WriteManifest(const char *target_label,
                              const char *injecting_rule_kind);
+  virtual void Finish();
+
+ private:
+  // A file to be written, in the order of the input.
+  struct Entry {
+    std::string filename;
+    std::vector<u1> data;  // The input, then the output once stripped.
+    std::string abi_digest;  // Of the output, if there is a manifest.
+    bool keep = true;
+  };
+
+  // The number of files per thread which may be read ahead of the output.
+  static const size_t kMaxQueuedPerJob = 8;
+
+  // Writes the file, and its line of the ABI manifest with the digest of the
+  // data unless it is known.
+  void WriteFile(const char *filename, const u1 *data, const size_t size,
+                 const std::string &abi_digest = std::string());
+  void WriteEntry(Entry entry);
+  // Strips the class of the entry, on the pool.
+  Entry StripEntry(Entry entry);
+
+  const bool digest_;
+  std::string abi_manifest_;
+  // With more than one job, the pool that strips the classes, and the
+  // entries not written yet.
+  std::unique_ptr<blaze_util::TaskPool> pool_;
+  std::unique_ptr<blaze_util::OrderedResults<Entry>> entries_;
 };
 
 static bool StartsWith(const char *str, const size_t str_len,
@@ -152,29 +201,99 @@ static bool IsModuleInfo(const char *filename) {
   return strcmp(slash, "module-info.class") == 0;
 }
 
+JarStripperProcessor::JarStripperProcessor(int jobs, bool abi_manifest)
+    : digest_(abi_manifest) {
+  if (jobs > 1) {
+    // The main thread strips classes too while it waits for the output.
+    pool_.reset(new blaze_util::TaskPool(jobs - 1));
+    entries_.reset(new blaze_util::OrderedResults<Entry>(
+        pool_.get(), kMaxQueuedPerJob * (jobs - 1),
+        [this](Entry entry) { WriteEntry(std::move(entry)); }));
+  }
+}
+
+void JarStripperProcessor::WriteFile(const char *filename, const u1 *data,
+                                     const size_t size,
+                                     const std::string &abi_digest) {
+  u1 *q = builder_->NewFile(filename, 0);
+  memcpy(q, data, size);
+  builder_->FinishFile(size, /* compress: */ false, /* compute_crc: */ true);
+  if (digest_) {
+    AppendAbiManifestEntry(
+        filename, abi_digest.empty() ? Sha256Hex(data, size) : abi_digest,
+        &abi_manifest_);
+  }
+}
+
 void JarStripperProcessor::Process(const char *filename, const u4 /*attr*/,
                                    const u1 *data, const size_t size) {
   if (verbose) {
     fprintf(stderr, "INFO: StripClass: %s\n", filename);
   }
-  if (IsModuleInfo(filename) || IsKotlinModule(filename, strlen(filename)) ||
-      IsScalaTasty(filename, strlen(filename))) {
-    u1 *q = builder_->NewFile(filename, 0);
-    memcpy(q, data, size);
-    builder_->FinishFile(size, /* compress: */ false, /* compute_crc: */ true);
-  } else {
+  bool copy = IsModuleInfo(filename) ||
+              IsKotlinModule(filename, strlen(filename)) ||
+              IsScalaTasty(filename, strlen(filename));
+  if (!entries_) {
+    if (copy) {
+      WriteFile(filename, data, size);
+      return;
+    }
     u1 *buf = reinterpret_cast<u1 *>(malloc(size));
     u1 *classdata_out = buf;
-    if (!StripClass(buf, data, size)) {
-      free(classdata_out);
-      return;
+    BAZEL_PROBE(ijar, strip_class_begin, filename, size);
+    const bool keep = StripClass(buf, data, size);
+    BAZEL_PROBE(ijar, strip_class_end, filename, size, buf - classdata_out,
+                keep);
+    if (keep) {
+      WriteFile(filename, classdata_out, buf - classdata_out);
     }
-    u1 *q = builder_->NewFile(filename, 0);
-    size_t out_length = buf - classdata_out;
-    memcpy(q, classdata_out, out_length);
-    builder_->FinishFile(out_length, /* compress: */ false,
-                         /* compute_crc: */ true);
     free(classdata_out);
+    return;
+  }
+
+  // The data is only valid until the next file is read, so the entry gets a
+  // copy.
+  Entry entry;
+  entry.filename = filename;
+  entry.data.assign(data, data + size);
+  if (copy) {
+    entries_->AddDone(std::move(entry));
+  } else {
+    entries_->Add([this, entry = std::move(entry)]() mutable {
+      return StripEntry(std::move(entry));
+    });
+  }
+}
+
+void JarStripperProcessor::WriteEntry(Entry entry) {
+  if (entry.keep) {
+    WriteFile(entry.filename.c_str(), entry.data.data(), entry.data.size(),
+              entry.abi_digest);
+  }
+}
+
+JarStripperProcessor::Entry JarStripperProcessor::StripEntry(Entry entry) {
+  std::vector<u1> out(entry.data.size());
+  u1 *classdata_out = out.data();
+  BAZEL_PROBE(ijar, strip_class_begin, entry.filename.c_str(),
+              entry.data.size());
+  bool keep = StripClass(classdata_out, entry.data.data(), entry.data.size());
+  out.resize(classdata_out - out.data());
+  BAZEL_PROBE(ijar, strip_class_end, entry.filename.c_str(),
+              entry.data.size(), out.size(), keep);
+  // The digest is taken here, so that the main thread doesn't hash all the
+  // classes.
+  if (digest_ && keep) {
+    entry.abi_digest = Sha256Hex(out.data(), out.size());
+  }
+  entry.data.swap(out);
+  entry.keep = keep;
+  return entry;
+}
+
+void JarStripperProcessor::Finish() {
+  if (entries_) {
+    entries_->Finish();
   }
 }
 
@@ -221,6 +340,11 @@ class JarCopierProcessor : public JarExtractorProcessor {
 
   virtual void Process(const char *filename, const u4 /*attr*/, const u1 *data,
                        const size_t size);
+  // Copies the files but the manifest as they are, still compressed and with
+  // their CRCs, so that stamping a jar is little more than copying it.
+  virtual bool ProcessRaw(const char *filename, const u4 /*attr*/,
+                          const u1 *data, const size_t length,
+                          const size_t size, const u4 crc);
   virtual bool Accept(const char *filename, const u4 /*attr*/);
 
   virtual void WriteManifest(const char *target_label,
@@ -269,6 +393,24 @@ void JarCopierProcessor::Process(const char *filename, const u4 /*attr*/,
   builder_->FinishFile(size, /* compress: */ false, /* compute_crc: */ true);
 }
 
+bool JarCopierProcessor::ProcessRaw(const char *filename, const u4 /*attr*/,
+                                    const u1 *data, const size_t length,
+                                    const size_t size, const u4 crc) {
+  if (verbose) {
+    fprintf(stderr, "INFO: CopyFile: %s\n", filename);
+  }
+  // We already handled the manifest in WriteManifest
+  if (strcmp(filename, MANIFEST_DIR_PATH) == 0 ||
+      strcmp(filename, MANIFEST_PATH) == 0) {
+    return true;
+  }
+  if (builder_->WriteFile(filename, 0, data, length, size, crc) < 0) {
+    fprintf(stderr, "Cannot copy %s: %s\n", filename, builder_->GetError());
+    abort();
+  }
+  return true;
+}
+
 bool JarCopierProcessor::Accept(const char * /*filename*/, const u4 /*attr*/) {
   return true;
 }
@@ -378,14 +520,17 @@ static size_t EstimateManifestOutputSize(const char *target_label,
 }
 
 // Opens "file_in" (a .jar file) for reading, and writes an interface
-// .jar to "file_out".
+// .jar to "file_out", and its ABI manifest to "abi_manifest" unless it is
+// null.
 static void OpenFilesAndProcessJar(const char *file_out, const char *file_in,
                                    bool strip_jar, const char *target_label,
-                                   const char *injecting_rule_kind) {
+                                   const char *injecting_rule_kind, int jobs,
+                                   const char *abi_manifest) {
   std::unique_ptr<JarExtractorProcessor> processor;
+  JarStripperProcessor *stripper = nullptr;
   if (strip_jar) {
-    processor =
-        std::unique_ptr<JarExtractorProcessor>(new JarStripperProcessor());
+    stripper = new JarStripperProcessor(jobs, abi_manifest != nullptr);
+    processor = std::unique_ptr<JarExtractorProcessor>(stripper);
   } else {
     processor =
         std::unique_ptr<JarExtractorProcessor>(new JarCopierProcessor(file_in));
@@ -418,6 +563,7 @@ static void OpenFilesAndProcessJar(const char *file_out, const char *file_in,
     fprintf(stderr, "%s\n", in->GetError());
     abort();
   }
+  processor->Finish();
 
   // Add dummy file, since javac doesn't like truly empty jars.
   if (out->GetNumberFiles() == 0) {
@@ -428,6 +574,11 @@ static void OpenFilesAndProcessJar(const char *file_out, const char *file_in,
     fprintf(stderr, "%s\n", out->GetError());
     abort();
   }
+  if (abi_manifest != nullptr &&
+      !write_file(abi_manifest, 0644, stripper->abi_manifest().data(),
+                  stripper->abi_manifest().size())) {
+    abort();
+  }
   // Get all file size
   size_t in_length = in->GetSize();
   size_t out_length = out->GetSize();
@@ -436,79 +587,255 @@ static void OpenFilesAndProcessJar(const char *file_out, const char *file_in,
             file_out, static_cast<int>(100.0 * out_length / in_length));
   }
 }
-}  // namespace devtools_ijar
-
-//
-// main method
-//
-static void usage() {
-  fprintf(stderr,
-          "Usage: ijar "
-          "[-v] [--[no]strip_jar] "
-          "[--target label label] [--injecting_rule_kind kind] "
-          "x.jar [x_interface.jar>]\n");
-  fprintf(stderr, "Creates an interface jar from the specified jar file.\n");
-  exit(1);
-}
-
-int main(int argc, char **argv) {
+// The arguments of one ijar invocation. The strings belong to the caller.
+struct Invocation {
   bool strip_jar = true;
-  const char *target_label = NULL;
-  const char *injecting_rule_kind = NULL;
-  const char *filename_in = NULL;
-  const char *filename_out = NULL;
+  const char *target_label = nullptr;
+  const char *injecting_rule_kind = nullptr;
+  const char *filename_in = nullptr;
+  const char *filename_out = nullptr;
+  int jobs = 1;
+  const char *abi_manifest = nullptr;
+  std::string guessed_filename_out;
+};
 
-  for (int ii = 1; ii < argc; ++ii) {
+// Parses the arguments (without the program name). Returns false if they are
+// not valid.
+static bool ParseArguments(int argc, const char *const *argv,
+                           Invocation *invocation) {
+  for (int ii = 0; ii < argc; ++ii) {
     if (strcmp(argv[ii], "-v") == 0) {
-      devtools_ijar::verbose = true;
+      verbose = true;
     } else if (strcmp(argv[ii], "--strip_jar") == 0) {
-      strip_jar = true;
+      invocation->strip_jar = true;
     } else if (strcmp(argv[ii], "--nostrip_jar") == 0) {
-      strip_jar = false;
+      invocation->strip_jar = false;
     } else if (strcmp(argv[ii], "--target_label") == 0) {
       if (++ii >= argc) {
-        usage();
+        return false;
       }
-      target_label = argv[ii];
+      invocation->target_label = argv[ii];
     } else if (strcmp(argv[ii], "--injecting_rule_kind") == 0) {
       if (++ii >= argc) {
-        usage();
+        return false;
+      }
+      invocation->injecting_rule_kind = argv[ii];
+    } else if (strcmp(argv[ii], "--jobs") == 0) {
+      if (++ii >= argc) {
+        return false;
       }
-      injecting_rule_kind = argv[ii];
-    } else if (filename_in == NULL) {
-      filename_in = argv[ii];
-    } else if (filename_out == NULL) {
-      filename_out = argv[ii];
+      invocation->jobs = atoi(argv[ii]);
+      if (invocation->jobs == 0) {
+        invocation->jobs = std::thread::hardware_concurrency();
+      }
+    } else if (strcmp(argv[ii], "--abi_manifest") == 0) {
+      if (++ii >= argc) {
+        return false;
+      }
+      invocation->abi_manifest = argv[ii];
+    } else if (invocation->filename_in == nullptr) {
+      invocation->filename_in = argv[ii];
+    } else if (invocation->filename_out == nullptr) {
+      invocation->filename_out = argv[ii];
     } else {
-      usage();
+      return false;
     }
   }
+  // Only the classes of a stripped jar have an ABI.
+  if (invocation->abi_manifest != nullptr && !invocation->strip_jar) {
+    return false;
+  }
+  return invocation->filename_in != nullptr;
+}
 
-  if (filename_in == NULL) {
-    usage();
+// Guesses the output filename from the input if it is not given. Returns
+// false if it cannot.
+static bool SetOutputFilename(Invocation *invocation) {
+  if (invocation->filename_out != nullptr) {
+    return true;
+  }
+  size_t len = strlen(invocation->filename_in);
+  if (len > 4 && strncmp(invocation->filename_in + len - 4, ".jar", 4) == 0) {
+    invocation->guessed_filename_out =
+        std::string(invocation->filename_in, len - 4) + "-interface.jar";
+    invocation->filename_out = invocation->guessed_filename_out.c_str();
+    return true;
+  }
+  fprintf(stderr,
+          "Can't determine output filename since input filename "
+          "doesn't end with '.jar'.\n");
+  return false;
+}
+
+static void Run(const Invocation &invocation) {
+  if (verbose) {
+    fprintf(stderr, "INFO: writing to '%s'.\n", invocation.filename_out);
+  }
+  OpenFilesAndProcessJar(invocation.filename_out, invocation.filename_in,
+                         invocation.strip_jar, invocation.target_label,
+                         invocation.injecting_rule_kind, invocation.jobs,
+                         invocation.abi_manifest);
+}
+
+// The interface jars produced by a persistent worker, keyed by the digest of
+// the input jar and the options they were produced with. The least recently
+// used jars are dropped once the total size exceeds the limit.
+class InterfaceJarCache {
+ public:
+  explicit InterfaceJarCache(size_t max_bytes)
+      : max_bytes_(max_bytes), bytes_(0) {}
+
+  // Returns the cached jar or nullptr.
+  const std::string *Get(const std::string &key) {
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      return nullptr;
+    }
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return &it->second->second;
+  }
+
+  void Put(const std::string &key, std::string jar) {
+    if (jar.size() > max_bytes_ || index_.count(key)) {
+      return;
+    }
+    bytes_ += jar.size();
+    entries_.emplace_front(key, std::move(jar));
+    index_[key] = entries_.begin();
+    while (bytes_ > max_bytes_) {
+      bytes_ -= entries_.back().second.size();
+      index_.erase(entries_.back().first);
+      entries_.pop_back();
+    }
+  }
+
+ private:
+  typedef std::list<std::pair<std::string, std::string>> Entries;
+
+  const size_t max_bytes_;
+  size_t bytes_;
+  Entries entries_;  // Most recently used first.
+  std::unordered_map<std::string, Entries::iterator> index_;
+};
+
+// The total size of the interface jars a worker keeps.
+static const size_t kWorkerCacheBytes = 256 << 20;
+
+// Returns the cache key of the invocation, or the empty string if the
+// request does not have the digest of the input jar. Invocations that write
+// an ABI manifest aren't cached, since the cache only has the jars.
+static std::string CacheKey(const WorkRequest &request,
+                            const Invocation &invocation) {
+  if (invocation.abi_manifest != nullptr) {
+    return std::string();
+  }
+  for (const WorkRequest::Input &input : request.inputs) {
+    if (input.path == invocation.filename_in && !input.digest.empty()) {
+      std::string key = input.digest;
+      key += '\0';
+      key += invocation.strip_jar ? "strip" : "nostrip";
+      key += '\0';
+      if (invocation.target_label != nullptr) {
+        key += invocation.target_label;
+      }
+      key += '\0';
+      if (invocation.injecting_rule_kind != nullptr) {
+        key += invocation.injecting_rule_kind;
+      }
+      return key;
+    }
   }
+  return std::string();
+}
 
-  // Guess output filename from input:
-  char filename_out_buf[PATH_MAX];
-  if (filename_out == NULL) {
-    size_t len = strlen(filename_in);
-    if (len > 4 && strncmp(filename_in + len - 4, ".jar", 4) == 0) {
-      strcpy(filename_out_buf, filename_in);
-      strcpy(filename_out_buf + len - 4, "-interface.jar");
-      filename_out = filename_out_buf;
+// Reads the file, returns false if it cannot.
+static bool ReadWholeFile(const char *path, std::string *contents) {
+  Stat file_stat;
+  if (!stat_file(path, &file_stat)) {
+    return false;
+  }
+  contents->resize(file_stat.total_size);
+  return read_file(path, &(*contents)[0], contents->size());
+}
+
+// Serves requests of the JSON worker protocol read from stdin. The
+// interface jars of recently seen input jars are kept in memory, so that the
+// same jar is only stripped once per worker. Errors in processing a jar are
+// fatal, as they are for a single invocation, and Bazel then reports the
+// failure of the worker.
+static int RunPersistentWorker() {
+  InterfaceJarCache cache(kWorkerCacheBytes);
+  WorkRequest request;
+  while (ReadWorkRequest(stdin, &request)) {
+    std::vector<const char *> argv;
+    for (const std::string &argument : request.arguments) {
+      argv.push_back(argument.c_str());
+    }
+    verbose = false;
+    Invocation invocation;
+    if (!ParseArguments(argv.size(), argv.data(), &invocation) ||
+        !SetOutputFilename(&invocation)) {
+      WriteWorkResponse(stdout, 1, "ijar: invalid arguments\n",
+                        request.request_id);
+      continue;
+    }
+
+    std::string key = CacheKey(request, invocation);
+    const std::string *cached = key.empty() ? nullptr : cache.Get(key);
+    if (cached != nullptr) {
+      if (verbose) {
+        fprintf(stderr, "INFO: reusing the interface jar of %s.\n",
+                invocation.filename_in);
+      }
+      if (!write_file(invocation.filename_out, 0644, cached->data(),
+                      cached->size())) {
+        WriteWorkResponse(stdout, 1, "ijar: cannot write the output\n",
+                          request.request_id);
+        continue;
+      }
     } else {
-      fprintf(stderr,
-              "Can't determine output filename since input filename "
-              "doesn't end with '.jar'.\n");
-      return 1;
+      Run(invocation);
+      std::string jar;
+      if (!key.empty() && ReadWholeFile(invocation.filename_out, &jar)) {
+        cache.Put(key, std::move(jar));
+      }
     }
+    WriteWorkResponse(stdout, 0, "", request.request_id);
   }
+  return 0;
+}
+
+}  // namespace devtools_ijar
 
-  if (devtools_ijar::verbose) {
-    fprintf(stderr, "INFO: writing to '%s'.\n", filename_out);
+//
+// main method
+//
+static void usage() {
+  fprintf(stderr,
+          "Usage: ijar "
+          "[-v] [--[no]strip_jar] [--jobs n] "
+          "[--target label label] [--injecting_rule_kind kind] "
+          "[--abi_manifest file] x.jar [x_interface.jar>]\n"
+          "       ijar --persistent_worker\n");
+  fprintf(stderr, "Creates an interface jar from the specified jar file.\n");
+  fprintf(stderr,
+          "With --abi_manifest, also writes the digest of each of its "
+          "files.\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  if (argc == 2 && strcmp(argv[1], "--persistent_worker") == 0) {
+    return devtools_ijar::RunPersistentWorker();
   }
 
-  devtools_ijar::OpenFilesAndProcessJar(filename_out, filename_in, strip_jar,
-                                        target_label, injecting_rule_kind);
+  devtools_ijar::Invocation invocation;
+  if (!devtools_ijar::ParseArguments(argc - 1, argv + 1, &invocation)) {
+    usage();
+  }
+  if (!devtools_ijar::SetOutputFilename(&invocation)) {
+    return 1;
+  }
+  devtools_ijar::Run(invocation);
   return 0;
 }
@@ -0,0 +1,316 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// ijar_benchmark.cc -- measures the parts of ijar on a corpus of jars.
+//
+//   ijar_benchmark [--repeat N] [--output_dir DIR] JAR...
+//
+// For each jar, reports the best of N runs of:
+//  - scan: going through the entries with InputZipFile, reading nothing;
+//  - read: inflating all the .class files;
+//  - strip: StripClass on each class, with the operator new calls it makes;
+//  - write: writing the stripped classes with OutputZipFile, stored and
+//    deflated, to DIR (default: $TMPDIR or /tmp).
+//
+// Any jar will do. Jars of JDK, Kotlin, Scala and protobuf-generated classes
+// exercise different parts of classfile.cc, so the corpus should have some
+// of each.
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "third_party/ijar/common.h"
+#include "third_party/ijar/zip.h"
+
+namespace devtools_ijar {
+
+bool verbose = false;
+
+bool StripClass(u1 *&classdata_out, const u1 *classdata_in, size_t in_length);
+
+}  // namespace devtools_ijar
+
+// Every operator new is counted, so that the allocations StripClass makes
+// per class can be reported.
+static std::atomic<size_t> allocations(0);
+static std::atomic<size_t> allocated_bytes(0);
+
+void *operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  void *p = malloc(size ? size : 1);
+  if (p == NULL) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+namespace devtools_ijar {
+
+static double Now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// The classes ijar strips: module-info.class is copied as is.
+static bool IsClass(const char *filename) {
+  size_t length = strlen(filename);
+  const char *slash = strrchr(filename, '/');
+  return length > 6 && strcmp(filename + length - 6, ".class") == 0 &&
+         strcmp(slash == NULL ? filename : slash + 1, "module-info.class");
+}
+
+struct ClassFile {
+  std::string name;
+  std::vector<u1> data;
+};
+
+// Skips all the entries, or keeps the .class files in memory.
+class BenchmarkProcessor : public ZipExtractorProcessor {
+ public:
+  explicit BenchmarkProcessor(std::vector<ClassFile> *classes)
+      : classes_(classes) {}
+
+  bool Accept(const char *filename, const u4 attr) override {
+    ++entries_;
+    return classes_ != NULL && IsClass(filename);
+  }
+
+  void Process(const char *filename, const u4 attr, const u1 *data,
+               const size_t size) override {
+    classes_->push_back(
+        ClassFile{filename, std::vector<u1>(data, data + size)});
+  }
+
+  size_t entries() const { return entries_; }
+
+ private:
+  std::vector<ClassFile> *classes_;
+  size_t entries_ = 0;
+};
+
+struct Timing {
+  double seconds = 0;
+
+  void Update(double start, int run) {
+    double elapsed = Now() - start;
+    if (run == 0 || elapsed < seconds) {
+      seconds = elapsed;
+    }
+  }
+};
+
+static void Report(const char *what, double seconds, size_t bytes,
+                   size_t items, const char *unit) {
+  fprintf(stdout, "  %-14s %9.3f ms %9.1f MB/s %12.0f %s/s\n", what,
+          seconds * 1e3, bytes / 1048576.0 / seconds, items / seconds, unit);
+}
+
+static std::unique_ptr<ZipExtractor> Open(const char *jar,
+                                          BenchmarkProcessor *processor) {
+  std::unique_ptr<ZipExtractor> in(ZipExtractor::Create(jar, processor));
+  if (in == NULL) {
+    fprintf(stderr, "Unable to open Zip file %s: %s\n", jar, strerror(errno));
+    abort();
+  }
+  return in;
+}
+
+static void Write(const char *path, const std::vector<ClassFile> &classes,
+                  size_t estimated_size, bool compress) {
+  std::unique_ptr<ZipBuilder> out(ZipBuilder::Create(path, estimated_size));
+  if (out == NULL) {
+    fprintf(stderr, "Unable to open output file %s: %s\n", path,
+            strerror(errno));
+    abort();
+  }
+  for (const ClassFile &clazz : classes) {
+    u1 *q = out->NewFile(clazz.name.c_str(), 0);
+    memcpy(q, clazz.data.data(), clazz.data.size());
+    if (out->FinishFile(clazz.data.size(), compress,
+                        /* compute_crc: */ true) < 0) {
+      fprintf(stderr, "%s\n", out->GetError());
+      abort();
+    }
+  }
+  if (out->Finish() < 0) {
+    fprintf(stderr, "%s\n", out->GetError());
+    abort();
+  }
+}
+
+static void Benchmark(const char *jar, int repeat,
+                      const std::string &output_dir) {
+  // Scan the central directory and the local headers, reading no data.
+  Timing scan;
+  size_t jar_size = 0;
+  size_t entries = 0;
+  for (int run = 0; run < repeat; ++run) {
+    BenchmarkProcessor processor(NULL);
+    double start = Now();
+    std::unique_ptr<ZipExtractor> in = Open(jar, &processor);
+    if (in->ProcessAll() < 0) {
+      fprintf(stderr, "%s\n", in->GetError());
+      abort();
+    }
+    scan.Update(start, run);
+    jar_size = in->GetSize();
+    entries = processor.entries();
+  }
+
+  // Read (and inflate) the classes.
+  Timing read;
+  std::vector<ClassFile> classes;
+  size_t estimated_size = 0;
+  for (int run = 0; run < repeat; ++run) {
+    classes.clear();
+    BenchmarkProcessor processor(&classes);
+    double start = Now();
+    std::unique_ptr<ZipExtractor> in = Open(jar, &processor);
+    if (in->ProcessAll() < 0) {
+      fprintf(stderr, "%s\n", in->GetError());
+      abort();
+    }
+    read.Update(start, run);
+    estimated_size = in->CalculateOutputLength();
+  }
+  size_t class_bytes = 0;
+  for (const ClassFile &clazz : classes) {
+    class_bytes += clazz.data.size();
+  }
+
+  // Strip them.
+  Timing strip;
+  std::vector<ClassFile> stripped;
+  size_t strip_allocations = 0;
+  size_t strip_allocated_bytes = 0;
+  size_t stripped_bytes = 0;
+  for (int run = 0; run < repeat; ++run) {
+    // The output of a class is never larger than its input.
+    std::vector<std::vector<u1>> buffers(classes.size());
+    std::vector<u1 *> ends(classes.size());
+    std::vector<char> kept(classes.size());
+    for (size_t i = 0; i < classes.size(); ++i) {
+      buffers[i].resize(classes[i].data.size());
+    }
+    size_t allocations_before = allocations.load();
+    size_t allocated_bytes_before = allocated_bytes.load();
+    double start = Now();
+    for (size_t i = 0; i < classes.size(); ++i) {
+      u1 *p = buffers[i].data();
+      if (StripClass(p, classes[i].data.data(), classes[i].data.size())) {
+        ends[i] = p;
+        kept[i] = 1;
+      }
+    }
+    strip.Update(start, run);
+    strip_allocations = allocations.load() - allocations_before;
+    strip_allocated_bytes = allocated_bytes.load() - allocated_bytes_before;
+
+    stripped.clear();
+    stripped_bytes = 0;
+    for (size_t i = 0; i < classes.size(); ++i) {
+      if (kept[i]) {
+        stripped.push_back(ClassFile{
+            classes[i].name, std::vector<u1>(buffers[i].data(), ends[i])});
+        stripped_bytes += stripped.back().data.size();
+      }
+    }
+  }
+
+  // Write the interface jar, stored as ijar does, and deflated.
+  std::string output = output_dir + "/ijar_benchmark." +
+                       std::to_string(getpid()) + ".jar";
+  Timing write_stored;
+  Timing write_deflated;
+  for (int run = 0; run < repeat; ++run) {
+    double start = Now();
+    Write(output.c_str(), stripped, estimated_size, false);
+    write_stored.Update(start, run);
+    start = Now();
+    Write(output.c_str(), stripped, estimated_size, true);
+    write_deflated.Update(start, run);
+  }
+  unlink(output.c_str());
+
+  fprintf(stdout, "%s: %zu entries, %zu classes, %zu bytes\n", jar, entries,
+          classes.size(), jar_size);
+  Report("scan", scan.seconds, jar_size, entries, "entries");
+  Report("read", read.seconds, class_bytes, classes.size(), "classes");
+  Report("strip", strip.seconds, class_bytes, classes.size(), "classes");
+  if (!classes.empty()) {
+    fprintf(stdout,
+            "  %-14s %9.0f ns/class %6.1f allocations/class %8.0f "
+            "bytes/class, %zu of %zu bytes kept\n",
+            "", strip.seconds * 1e9 / classes.size(),
+            static_cast<double>(strip_allocations) / classes.size(),
+            static_cast<double>(strip_allocated_bytes) / classes.size(),
+            stripped_bytes, class_bytes);
+  }
+  Report("write", write_stored.seconds, stripped_bytes, stripped.size(),
+         "classes");
+  Report("write deflated", write_deflated.seconds, stripped_bytes,
+         stripped.size(), "classes");
+  fflush(stdout);
+}
+
+}  // namespace devtools_ijar
+
+static void usage() {
+  fprintf(stderr,
+          "Usage: ijar_benchmark [--repeat N] [--output_dir DIR] JAR...\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  int repeat = 5;
+  const char *tmpdir = getenv("TMPDIR");
+  std::string output_dir = tmpdir != NULL && *tmpdir ? tmpdir : "/tmp";
+  std::vector<const char *> jars;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+      repeat = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--output_dir") == 0 && i + 1 < argc) {
+      output_dir = argv[++i];
+    } else if (argv[i][0] == '-') {
+      usage();
+    } else {
+      jars.push_back(argv[i]);
+    }
+  }
+  if (jars.empty() || repeat < 1) {
+    usage();
+  }
+  for (const char *jar : jars) {
+    devtools_ijar::Benchmark(jar, repeat, output_dir);
+  }
+  return 0;
+}
@@ -21,6 +21,7 @@ namespace devtools_ijar {
 
 struct MappedInputFileImpl;
 struct MappedOutputFileImpl;
+struct StreamedOutputFileImpl;
 
 // A memory mapped input file.
 class MappedInputFile {
@@ -51,6 +52,9 @@ class MappedInputFile {
 
   // Unmap a given number of bytes from the beginning of the file.
   void Discard(size_t bytes);
+
+  // Hint that the given range of the file is going to be read soon.
+  void Prefetch(size_t offset, size_t bytes);
   int Close();
 };
 
@@ -79,5 +83,30 @@ class MappedOutputFile {
   int Close(size_t size);
 };
 
+// An output file which is written from the beginning to the end, so that its
+// size need not be known in advance.
+class StreamedOutputFile {
+ private:
+  StreamedOutputFileImpl *impl_;
+
+ protected:
+  const char* errmsg_;
+  bool opened_;
+
+ public:
+  StreamedOutputFile(const char* name);
+  virtual ~StreamedOutputFile();
+
+  // If opening the file succeeded or not.
+  bool Opened() const { return opened_; }
+
+  // Description of the last error that happened.
+  const char* Error() const { return errmsg_; }
+
+  // Appends the data to the file.
+  int Write(const void* data, size_t size);
+  int Close();
+};
+
 }  // namespace devtools_ijar
 #endif
@@ -59,6 +59,10 @@ MappedInputFile::MappedInputFile(const char* name) {
     return;
   }
 
+  // The file is read from the beginning to the end, except for the central
+  // directory.
+  madvise(buffer, length, MADV_SEQUENTIAL);
+
   impl_ = new MappedInputFileImpl();
   impl_->fd_ = fd;
   impl_->discarded_ = 0;
@@ -76,6 +80,15 @@ void MappedInputFile::Discard(size_t bytes) {
   impl_->discarded_ += bytes;
 }
 
+void MappedInputFile::Prefetch(size_t offset, size_t bytes) {
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  size_t start = std::max(offset, impl_->discarded_) / page_size * page_size;
+  size_t end = std::min(offset + bytes, length_);
+  if (start < end) {
+    madvise(buffer_ + start, end - start, MADV_WILLNEED);
+  }
+}
+
 int MappedInputFile::Close() {
   if (close(impl_->fd_) < 0) {
     snprintf(errmsg, MAX_ERROR, "close(): %s", strerror(errno));
@@ -157,4 +170,57 @@ int MappedOutputFile::Close(size_t size) {
   return 0;
 }
 
+struct StreamedOutputFileImpl {
+  int fd_;
+};
+
+StreamedOutputFile::StreamedOutputFile(const char* name) {
+  impl_ = NULL;
+  opened_ = false;
+  int fd = open(name, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+  if (fd < 0) {
+    snprintf(errmsg, MAX_ERROR, "open(): %s", strerror(errno));
+    errmsg_ = errmsg;
+    return;
+  }
+
+  impl_ = new StreamedOutputFileImpl();
+  impl_->fd_ = fd;
+  opened_ = true;
+}
+
+StreamedOutputFile::~StreamedOutputFile() {
+  delete impl_;
+}
+
+int StreamedOutputFile::Write(const void* data, size_t size) {
+  const char* p = reinterpret_cast<const char*>(data);
+  while (size > 0) {
+    // write fails with EINVAL on MacOS for more than INT32_MAX bytes.
+    size_t max_write = std::numeric_limits<int32_t>::max();
+    ssize_t written = write(impl_->fd_, p, std::min(size, max_write));
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      snprintf(errmsg, MAX_ERROR, "write(): %s", strerror(errno));
+      errmsg_ = errmsg;
+      return -1;
+    }
+    p += written;
+    size -= written;
+  }
+  return 0;
+}
+
+int StreamedOutputFile::Close() {
+  if (close(impl_->fd_) < 0) {
+    snprintf(errmsg, MAX_ERROR, "close(): %s", strerror(errno));
+    errmsg_ = errmsg;
+    return -1;
+  }
+
+  return 0;
+}
+
 }  // namespace devtools_ijar
@@ -100,6 +100,10 @@ void MappedInputFile::Discard(size_t bytes) {
   // At any rate, this only matters for >2GB (or maybe >4GB?) input files.
 }
 
+void MappedInputFile::Prefetch(size_t offset, size_t bytes) {
+  // Not implemented on Windows, which reads mapped files ahead by itself.
+}
+
 int MappedInputFile::Close() {
   if (!UnmapViewOfFile(buffer_)) {
     string errormsg = blaze_util::GetLastErrorString();
@@ -208,4 +212,61 @@ int MappedOutputFile::Close(size_t size) {
   return 0;
 }
 
+struct StreamedOutputFileImpl {
+  HANDLE file_;
+};
+
+StreamedOutputFile::StreamedOutputFile(const char* name) {
+  impl_ = NULL;
+  opened_ = false;
+  errmsg_ = errmsg;
+
+  wstring wname;
+  string error;
+  if (!blaze_util::AsAbsoluteWindowsPath(name, &wname, &error)) {
+    BAZEL_DIE(255) << "StreamedOutputFile(" << name
+                   << "): AsAbsoluteWindowsPath failed: " << error;
+  }
+  HANDLE file = CreateFileW(wname.c_str(), GENERIC_WRITE, 0, NULL,
+                            CREATE_ALWAYS, 0, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    string errormsg = blaze_util::GetLastErrorString();
+    BAZEL_DIE(255) << "StreamedOutputFile(" << name << "): CreateFileW("
+                   << blaze_util::WstringToCstring(wname)
+                   << ") failed: " << errormsg;
+  }
+
+  impl_ = new StreamedOutputFileImpl();
+  impl_->file_ = file;
+  opened_ = true;
+}
+
+StreamedOutputFile::~StreamedOutputFile() {
+  delete impl_;
+}
+
+int StreamedOutputFile::Write(const void* data, size_t size) {
+  const char* p = reinterpret_cast<const char*>(data);
+  while (size > 0) {
+    DWORD written;
+    DWORD to_write = size > MAXDWORD ? MAXDWORD : static_cast<DWORD>(size);
+    if (!::WriteFile(impl_->file_, p, to_write, &written, NULL)) {
+      BAZEL_DIE(255) << "StreamedOutputFile::Write: WriteFile failed: "
+                     << blaze_util::GetLastErrorString();
+    }
+    p += written;
+    size -= written;
+  }
+  return 0;
+}
+
+int StreamedOutputFile::Close() {
+  if (!CloseHandle(impl_->file_)) {
+    BAZEL_DIE(255) << "StreamedOutputFile::Close: CloseHandle failed: "
+                   << blaze_util::GetLastErrorString();
+  }
+
+  return 0;
+}
+
 }  // namespace devtools_ijar
@@ -264,6 +264,140 @@ function test_ijar_output() {
     fail "ijars from jar and zip are different"
 }
 
+function test_parallel_output() {
+  # Stripping the classes on several threads must not change the output.
+  $JAVAC -g -d $TEST_TMPDIR/classes $IJAR_SRCDIR/test/A.java \
+    $IJAR_SRCDIR/test/Annotations.java \
+    $IJAR_SRCDIR/test/LocalAndAnonymous.java || fail "javac failed"
+  $JAR cf $A_JAR -C $TEST_TMPDIR/classes . || fail "jar failed"
+  $IJAR $A_JAR $A_INTERFACE_JAR || fail "ijar failed"
+  for jobs in 2 4 0; do
+    $IJAR --jobs $jobs $A_JAR $TEST_TMPDIR/A-parallel-interface.jar ||
+      fail "ijar --jobs $jobs failed"
+    cmp $A_INTERFACE_JAR $TEST_TMPDIR/A-parallel-interface.jar ||
+      fail "ijar --jobs $jobs output differs"
+  done
+}
+
+function test_abi_minimal_classes() {
+  # Classes that are already stripped go through unchanged, so stripping an
+  # interface jar again gives the same jar.
+  $JAVAC -g -d $TEST_TMPDIR/classes $IJAR_SRCDIR/test/A.java \
+    $IJAR_SRCDIR/test/Annotations.java || fail "javac failed"
+  $JAR cf $A_JAR -C $TEST_TMPDIR/classes . || fail "jar failed"
+  $IJAR $A_JAR $A_INTERFACE_JAR || fail "ijar failed"
+  $IJAR $A_INTERFACE_JAR $TEST_TMPDIR/A-interface2.jar || fail "ijar failed"
+  cmp $A_INTERFACE_JAR $TEST_TMPDIR/A-interface2.jar ||
+    fail "stripping an interface jar changed it"
+
+  # So do interfaces and annotations without code or debugging information.
+  cd $TEST_TMPDIR
+  mkdir -p minimal/m
+  cat > minimal/m/I.java <<EOF
+package m;
+
+import java.util.List;
+
+public interface I<T> {
+  int ANSWER = 42;
+
+  List<T> items(int count) throws Exception;
+}
+EOF
+
+  cat > minimal/m/Note.java <<EOF
+package m;
+
+public @interface Note {
+  String value() default "";
+}
+EOF
+
+  $JAVAC -g:none minimal/m/I.java minimal/m/Note.java || fail "javac failed"
+  (cd minimal && $JAR cf ../minimal.jar m/I.class m/Note.class) ||
+    fail "jar failed"
+  $IJAR minimal.jar minimal-interface.jar || fail "ijar failed"
+  local class
+  for class in m/I.class m/Note.class; do
+    $UNZIP -p minimal-interface.jar $class | cmp - minimal/$class ||
+      fail "$class was changed"
+  done
+}
+
+function test_abi_manifest() {
+  # The ABI manifest has the digest of each class of the interface jar, which
+  # only changes with the ABI.
+  cd $TEST_TMPDIR
+  mkdir -p abi/{one,two,three}/a
+  cat > abi/one/a/A.java <<EOF
+package a;
+
+public class A {
+  public static int number() {
+    return 1;
+  }
+}
+EOF
+
+  cat > abi/two/a/A.java <<EOF
+package a;
+
+public class A {
+  public static int number() {
+    return 2;
+  }
+}
+EOF
+
+  cat > abi/three/a/A.java <<EOF
+package a;
+
+public class A {
+  public static long number() {
+    return 3;
+  }
+}
+EOF
+
+  local version
+  for version in one two three; do
+    $JAVAC -d abi/$version abi/$version/a/A.java || fail "javac failed"
+    $JAR cf abi/$version.jar -C abi/$version a/A.class || fail "jar failed"
+    $IJAR --abi_manifest abi/$version.abi abi/$version.jar \
+      abi/$version-interface.jar || fail "ijar failed"
+  done
+
+  local -r digest="$($UNZIP -p abi/one-interface.jar a/A.class | ${SHA256SUM} |
+    awk '{ print $1; }')"
+  assert_equals "$digest a/A.class" "$(cat abi/one.abi)"
+  cmp abi/one.abi abi/two.abi || fail "an implementation change changed the ABI"
+  cmp abi/one.abi abi/three.abi && fail "an ABI change was missed"
+
+  $IJAR --nostrip_jar --abi_manifest abi/copy.abi abi/one.jar abi/copy.jar &&
+    fail "--abi_manifest should need a stripped jar"
+  return 0
+}
+
+function test_persistent_worker() {
+  # The worker produces the same jars as single invocations, also when it
+  # serves a jar from its cache.
+  $JAVAC -g -d $TEST_TMPDIR/classes $IJAR_SRCDIR/test/A.java ||
+    fail "javac failed"
+  $JAR cf $A_JAR -C $TEST_TMPDIR/classes . || fail "jar failed"
+  $IJAR $A_JAR $A_INTERFACE_JAR || fail "ijar failed"
+  local -r input="{\"path\":\"$A_JAR\",\"digest\":\"AAEC\"}"
+  for i in 1 2; do
+    echo "{\"arguments\":[\"$A_JAR\",\"$TEST_TMPDIR/worker$i.jar\"]," \
+      "\"inputs\":[$input],\"requestId\":$i}"
+  done | $IJAR --persistent_worker > $TEST_log || fail "ijar worker failed"
+  expect_log '{"exitCode":0,"output":"","requestId":1}'
+  expect_log '{"exitCode":0,"output":"","requestId":2}'
+  cmp $A_INTERFACE_JAR $TEST_TMPDIR/worker1.jar ||
+    fail "worker output differs"
+  cmp $A_INTERFACE_JAR $TEST_TMPDIR/worker2.jar ||
+    fail "cached worker output differs"
+}
+
 function do_test_large_file() {
   # Compiles A.java, builds A.jar and A-interface.jar
   $JAVAC -g -d $TEST_TMPDIR/classes $IJAR_SRCDIR/test/A.java ||
@@ -39,9 +39,11 @@ if [[ "$PLATFORM" = "linux" ]]; then
     stat -c "%s" $1
   }
   MD5SUM=md5sum
+  SHA256SUM=sha256sum
 else
   function statfmt() {
     stat -f "%z" $1
   }
   MD5SUM=/sbin/md5
+  SHA256SUM="shasum -a 256"
 fi
@@ -211,6 +211,29 @@ function test_zipper_permissions() {
   fi
 }
 
+function test_zipper_unzip_many_files() {
+  local -r test_dir="${TEST_TMPDIR}/${FUNCNAME[0]}"
+  mkdir -p "${test_dir}/source"
+  cd "${test_dir}/source"
+  # Enough files of various sizes and modes to keep several writers busy.
+  for i in $(seq 1 200); do
+    mkdir -p "dir$((i % 7))/sub$((i % 3))"
+    head -c $((i * 997)) /dev/urandom > "dir$((i % 7))/sub$((i % 3))/file$i"
+    if (( i % 5 == 0 )); then
+      chmod +x "dir$((i % 7))/sub$((i % 3))/file$i"
+    fi
+  done
+  "${ZIP}" -qr ../many.zip .
+  cd ..
+
+  assert_unzip_same_as_zipper "${test_dir}/many.zip"
+  mkdir out
+  (cd out && "${ZIPPER}" x ../many.zip)
+  diff <(cd source && find . -type f -perm -u+x | sort) \
+      <(cd out && find . -type f -perm -u+x | sort) &> "${TEST_log}" \
+      || fail "Zipper did not keep the modes of the files"
+}
+
 function test_unzipper_zip64_archive() {
   local -r test_dir="${TEST_TMPDIR}/${FUNCNAME[0]}"
   mkdir -p "${test_dir}"
@@ -233,6 +256,24 @@ function test_unzipper_zip64_archive() {
   diff -r unzipped source
 }
 
+function test_zipper_zip64_output() {
+  local -r test_dir="${TEST_TMPDIR}/${FUNCNAME[0]}"
+  mkdir -p "${test_dir}/source"
+  cd "${test_dir}"
+  # A file which needs the zip64 extensions for its size, compressed so that
+  # the zip stays small.
+  local -r mb=$((2 ** 20))
+  /bin/dd if=/dev/zero of=source/file1 bs="${mb}" count=4097 conv=sparse \
+      >& "${TEST_log}"
+  echo "hello" > source/file2
+  (cd source && "${ZIPPER}" cC ../zip.zip file1 file2)
+
+  "${UNZIP}" -l zip.zip >& "${TEST_log}" || fail "unzip failed"
+  expect_log "$((4097 * mb)) .* file1"
+  "${ZIPPER}" x zip.zip -d unzipped file2
+  diff unzipped/file2 source/file2 || fail "file2 differs"
+}
+
 function test_zipper_file_large_than_2G() {
   dd if=/dev/zero of=${TEST_TMPDIR}/file_2064M.bin bs=16M count=129
   $ZIPPER c ${TEST_TMPDIR}/output.zip ${TEST_TMPDIR}/file_2064M.bin
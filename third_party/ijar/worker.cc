@@ -0,0 +1,304 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "third_party/ijar/worker.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+
+namespace devtools_ijar {
+
+namespace {
+
+// A minimal reader of the JSON values making up a WorkRequest. Unknown
+// members are parsed and ignored.
+class JsonReader {
+ public:
+  explicit JsonReader(FILE *in) : in_(in) {}
+
+  int Peek() {
+    SkipWhitespace();
+    int c = getc(in_);
+    if (c != EOF) {
+      ungetc(c, in_);
+    }
+    return c;
+  }
+
+  bool Expect(char expected) {
+    SkipWhitespace();
+    int c = getc(in_);
+    if (c != expected) {
+      return Error(c == EOF ? "unexpected end of input"
+                            : "unexpected character");
+    }
+    return true;
+  }
+
+  // Parses an object, calling member(key) for each member with the reader
+  // positioned at its value.
+  template <typename Fn>
+  bool ReadObject(Fn member) {
+    if (!Expect('{')) {
+      return false;
+    }
+    if (Peek() == '}') {
+      return Expect('}');
+    }
+    for (;;) {
+      std::string key;
+      if (!ReadString(&key) || !Expect(':') || !member(key)) {
+        return false;
+      }
+      if (Peek() != ',') {
+        return Expect('}');
+      }
+      Expect(',');
+    }
+  }
+
+  // Parses an array, calling element() for each element.
+  template <typename Fn>
+  bool ReadArray(Fn element) {
+    if (!Expect('[')) {
+      return false;
+    }
+    if (Peek() == ']') {
+      return Expect(']');
+    }
+    for (;;) {
+      if (!element()) {
+        return false;
+      }
+      if (Peek() != ',') {
+        return Expect(']');
+      }
+      Expect(',');
+    }
+  }
+
+  bool ReadString(std::string *value) {
+    if (!Expect('"')) {
+      return false;
+    }
+    value->clear();
+    for (;;) {
+      int c = getc(in_);
+      if (c == EOF) {
+        return Error("unterminated string");
+      } else if (c == '"') {
+        return true;
+      } else if (c != '\\') {
+        value->push_back(static_cast<char>(c));
+        continue;
+      }
+      switch (c = getc(in_)) {
+        case '"':
+        case '\\':
+        case '/':
+          value->push_back(static_cast<char>(c));
+          break;
+        case 'b':
+          value->push_back('\b');
+          break;
+        case 'f':
+          value->push_back('\f');
+          break;
+        case 'n':
+          value->push_back('\n');
+          break;
+        case 'r':
+          value->push_back('\r');
+          break;
+        case 't':
+          value->push_back('\t');
+          break;
+        case 'u': {
+          unsigned code_point;
+          if (!ReadHex4(&code_point)) {
+            return false;
+          }
+          if (code_point >= 0xD800 && code_point < 0xDC00) {
+            unsigned low;
+            if (getc(in_) != '\\' || getc(in_) != 'u' || !ReadHex4(&low) ||
+                low < 0xDC00 || low >= 0xE000) {
+              return Error("invalid surrogate pair");
+            }
+            code_point = 0x10000 + ((code_point - 0xD800) << 10) +
+                         (low - 0xDC00);
+          }
+          AppendUtf8(code_point, value);
+          break;
+        }
+        default:
+          return Error("invalid escape sequence");
+      }
+    }
+  }
+
+  bool ReadInteger(long long *value) {
+    SkipWhitespace();
+    std::string text;
+    int c;
+    while ((c = getc(in_)) != EOF &&
+           (isdigit(c) || c == '-' || c == '+' || c == '.' || c == 'e' ||
+            c == 'E')) {
+      text.push_back(static_cast<char>(c));
+    }
+    if (c != EOF) {
+      ungetc(c, in_);
+    }
+    char *end;
+    *value = strtoll(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0') {
+      return Error("invalid integer");
+    }
+    return true;
+  }
+
+  // Parses and discards any value.
+  bool SkipValue() {
+    switch (Peek()) {
+      case '{':
+        return ReadObject([this](const std::string &) { return SkipValue(); });
+      case '[':
+        return ReadArray([this]() { return SkipValue(); });
+      case '"': {
+        std::string ignored;
+        return ReadString(&ignored);
+      }
+      default: {
+        // A number or a literal.
+        SkipWhitespace();
+        int c;
+        bool empty = true;
+        while ((c = getc(in_)) != EOF && (isalnum(c) || c == '-' ||
+                                          c == '+' || c == '.')) {
+          empty = false;
+        }
+        if (c != EOF) {
+          ungetc(c, in_);
+        }
+        return !empty || Error("value expected");
+      }
+    }
+  }
+
+  bool Error(const char *message) {
+    fprintf(stderr, "ijar: malformed work request: %s\n", message);
+    return false;
+  }
+
+ private:
+  void SkipWhitespace() {
+    int c;
+    while ((c = getc(in_)) != EOF && isspace(c)) {
+    }
+    if (c != EOF) {
+      ungetc(c, in_);
+    }
+  }
+
+  bool ReadHex4(unsigned *value) {
+    *value = 0;
+    for (int i = 0; i < 4; ++i) {
+      int c = getc(in_);
+      if (c == EOF || !isxdigit(c)) {
+        return Error("invalid \\u escape");
+      }
+      *value = *value * 16 +
+               (isdigit(c) ? c - '0' : (tolower(c) - 'a' + 10));
+    }
+    return true;
+  }
+
+  static void AppendUtf8(unsigned code_point, std::string *out) {
+    if (code_point < 0x80) {
+      out->push_back(static_cast<char>(code_point));
+    } else if (code_point < 0x800) {
+      out->push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+      out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else if (code_point < 0x10000) {
+      out->push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+      out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+      out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else {
+      out->push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+      out->push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+      out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+      out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+  }
+
+  FILE *in_;
+};
+
+void WriteJsonString(FILE *out, const std::string &value) {
+  putc('"', out);
+  for (unsigned char c : value) {
+    if (c == '"' || c == '\\') {
+      putc('\\', out);
+      putc(c, out);
+    } else if (c < 0x20) {
+      fprintf(out, "\\u%04x", c);
+    } else {
+      putc(c, out);
+    }
+  }
+  putc('"', out);
+}
+
+}  // namespace
+
+bool ReadWorkRequest(FILE *in, WorkRequest *request) {
+  JsonReader reader(in);
+  if (reader.Peek() == EOF) {
+    return false;
+  }
+  *request = WorkRequest();
+  return reader.ReadObject([&](const std::string &key) {
+    if (key == "arguments") {
+      return reader.ReadArray([&]() {
+        request->arguments.emplace_back();
+        return reader.ReadString(&request->arguments.back());
+      });
+    } else if (key == "inputs") {
+      return reader.ReadArray([&]() {
+        request->inputs.emplace_back();
+        WorkRequest::Input *input = &request->inputs.back();
+        return reader.ReadObject([&](const std::string &input_key) {
+          if (input_key == "path") {
+            return reader.ReadString(&input->path);
+          } else if (input_key == "digest") {
+            return reader.ReadString(&input->digest);
+          }
+          return reader.SkipValue();
+        });
+      });
+    } else if (key == "requestId") {
+      return reader.ReadInteger(&request->request_id);
+    }
+    return reader.SkipValue();
+  });
+}
+
+void WriteWorkResponse(FILE *out, int exit_code, const std::string &output,
+                       long long request_id) {
+  fprintf(out, "{\"exitCode\":%d,\"output\":", exit_code);
+  WriteJsonString(out, output);
+  fprintf(out, ",\"requestId\":%lld}\n", request_id);
+  fflush(out);
+}
+
+}  // namespace devtools_ijar
@@ -0,0 +1,53 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// worker.h -- the JSON flavour of Bazel's persistent worker protocol.
+//
+
+#ifndef THIRD_PARTY_IJAR_WORKER_H_
+#define THIRD_PARTY_IJAR_WORKER_H_
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+namespace devtools_ijar {
+
+// The fields of a WorkRequest (see worker_protocol.proto) ijar uses.
+struct WorkRequest {
+  struct Input {
+    std::string path;
+    // The digest of the file as sent by Bazel (base64-encoded in JSON), or
+    // empty.
+    std::string digest;
+  };
+
+  std::vector<std::string> arguments;
+  std::vector<Input> inputs;
+  long long request_id = 0;
+};
+
+// Reads the next request, a JSON object, from the stream. Returns false at
+// the end of the stream, or if it does not contain a valid request; in the
+// latter case, the error is reported to stderr.
+bool ReadWorkRequest(FILE *in, WorkRequest *request);
+
+// Writes a WorkResponse as a single line of JSON and flushes the stream.
+void WriteWorkResponse(FILE *out, int exit_code, const std::string &output,
+                       long long request_id);
+
+}  // namespace devtools_ijar
+
+#endif  // THIRD_PARTY_IJAR_WORKER_H_
@@ -31,7 +31,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <algorithm>
 #include <limits>
+#include <string>
 #include <vector>
 
 #include "third_party/ijar/mapped_file.h"
@@ -59,6 +61,8 @@
 // version to extract: 1.0 - default value from APPNOTE.TXT.
 // Output JAR files contain no extra ZIP features, so this is enough.
 #define ZIP_VERSION_TO_EXTRACT                10
+// version to extract: 4.5 - needed for the zip64 extensions.
+#define ZIP64_VERSION_TO_EXTRACT              45
 #define COMPRESSION_METHOD_STORED             0   // no compression
 #define COMPRESSION_METHOD_DEFLATED           8
 
@@ -106,7 +110,7 @@ class InputZipFile : public ZipExtractor {
   virtual bool ProcessCentralDirEntry(const u1 *&p, u8 *compressed_size,
                                       u8 *uncompressed_size, char *filename,
                                       size_t filename_size, u4 *attr,
-                                      u8 *offset);
+                                      u8 *offset, u4 *crc = nullptr);
 
  private:
   ZipExtractorProcessor *processor;
@@ -153,6 +157,9 @@ class InputZipFile : public ZipExtractor {
   char filename[PATH_MAX];
   // The external file attribute field
   u4 attr;
+  // The CRC32 of the last entry, from the central directory: the local file
+  // header may leave it to a data descriptor.
+  u4 crc32_;
 
   // last error
   char errmsg[4*PATH_MAX];
@@ -221,6 +228,8 @@ class OutputZipFile : public ZipBuilder {
   virtual int FinishFile(size_t filelength, bool compress = false,
                          bool compute_crc = false);
   virtual int WriteEmptyFile(const char *filename);
+  virtual int WriteFile(const char *filename, const u4 attr, const u1 *data,
+                        size_t length, size_t uncompressed_length, u4 crc);
   virtual size_t GetSize() {
     return Offset(q);
   }
@@ -308,6 +317,81 @@ class OutputZipFile : public ZipBuilder {
                                         const u4 crc = 0);
 };
 
+//
+// A class implementing ZipBuilder that writes the zip file as the files are
+// added, so that the size of the output need not be estimated in advance. The
+// zip64 extensions are used for the files and offsets which need them.
+//
+class StreamingZipFile : public ZipBuilder {
+ public:
+  StreamingZipFile(const char *filename)
+      : output_file_(NULL), filename_(filename), offset_(0), finished_(false) {
+    errmsg[0] = 0;
+  }
+
+  virtual const char* GetError() {
+    if (errmsg[0] == 0) {
+      return NULL;
+    }
+    return errmsg;
+  }
+
+  virtual ~StreamingZipFile() {
+    Finish();
+    delete output_file_;
+  }
+  virtual u1* NewFile(const char* filename, const u4 attr);
+  virtual int FinishFile(size_t filelength, bool compress = false,
+                         bool compute_crc = false);
+  virtual int WriteEmptyFile(const char *filename);
+  virtual int WriteFile(const char *filename, const u4 attr, const u1 *data,
+                        size_t length, size_t uncompressed_length, u4 crc);
+  virtual size_t GetSize() {
+    return offset_;
+  }
+  virtual int GetNumberFiles() {
+    return entries_.size();
+  }
+  virtual int Finish();
+  bool Open();
+
+ private:
+  struct Entry {
+    std::string file_name;
+    u8 local_header_offset;
+    u8 compressed_length;
+    u8 uncompressed_length;
+    u4 crc32;
+    u4 external_attr;
+    u2 compression_method;
+  };
+
+  // The writes to the output file are buffered up to this size.
+  static constexpr size_t kBufferSize = 1 << 20;
+
+  StreamedOutputFile* output_file_;
+  const char* filename_;
+  u8 offset_;  // The size of the output so far, including the buffer.
+  bool finished_;
+  std::vector<u1> buffer_;
+  std::vector<Entry> entries_;
+
+  // last error
+  char errmsg[4*PATH_MAX];
+
+  int error(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(errmsg, 4*PATH_MAX, fmt, ap);
+    va_end(ap);
+    return -1;
+  }
+
+  // Appends the data to the output.
+  int Append(const void *data, size_t size);
+  int Flush();
+};
+
 //
 // Implementation of InputZipFile
 //
@@ -317,7 +401,7 @@ bool InputZipFile::ProcessNext() {
   u8 compressed, uncompressed;
   u8 offset;
   if (!ProcessCentralDirEntry(central_dir_current_, &compressed, &uncompressed,
-                              filename, PATH_MAX, &attr, &offset)) {
+                              filename, PATH_MAX, &attr, &offset, &crc32_)) {
     return false;
   }
 
@@ -430,6 +514,9 @@ int InputZipFile::ProcessLocalFileEntry(
   if (bytes_processed > bytes_unmapped_ + MAX_MAPPED_REGION) {
     input_file_->Discard(MAX_MAPPED_REGION);
     bytes_unmapped_ += MAX_MAPPED_REGION;
+    // Read the region after the current one ahead.
+    input_file_->Prefetch(bytes_unmapped_ + MAX_MAPPED_REGION,
+                          MAX_MAPPED_REGION);
   }
 
   return 0;
@@ -456,7 +543,7 @@ u1* InputZipFile::UncompressFile() {
   size_t in_offset = p - zipdata_in_;
   size_t remaining = input_file_->Length() - in_offset;
   DecompressedFile *decompressed_file =
-      decompressor_->UncompressFile(p, remaining);
+      decompressor_->UncompressFile(p, remaining, uncompressed_size_);
   if (decompressed_file == NULL) {
     if (decompressor_->GetError() != NULL) {
       error(decompressor_->GetError());
@@ -473,6 +560,18 @@ u1* InputZipFile::UncompressFile() {
 }
 
 int InputZipFile::ProcessFile(const bool compressed) {
+  // ZipBuilder::WriteFile tells deflated data by its being smaller.
+  if (!compressed || compressed_size_ < uncompressed_size_) {
+    if (EnsureRemaining(compressed_size_, "file_data") < 0) {
+      return -1;
+    }
+    if (processor->ProcessRaw(filename, attr, p, compressed_size_,
+                              uncompressed_size_, crc32_)) {
+      p += compressed_size_;
+      return 0;
+    }
+  }
+
   const u1 *file_data;
   if (compressed) {
     file_data = UncompressFile();
@@ -511,7 +610,7 @@ int InputZipFile::ProcessFile(const bool compressed) {
 bool InputZipFile::ProcessCentralDirEntry(const u1 *&p, u8 *compressed_size,
                                           u8 *uncompressed_size, char *filename,
                                           size_t filename_size, u4 *attr,
-                                          u8 *offset) {
+                                          u8 *offset, u4 *crc) {
   u4 signature = get_u4le(p);
 
   if (signature != CENTRAL_FILE_HEADER_SIGNATURE) {
@@ -522,7 +621,11 @@ bool InputZipFile::ProcessCentralDirEntry(const u1 *&p, u8 *compressed_size,
     return false;
   }
 
-  p += 16;  // skip to 'compressed size' field
+  p += 12;  // skip to 'crc-32' field
+  u4 entry_crc = get_u4le(p);
+  if (crc != nullptr) {
+    *crc = entry_crc;
+  }
   *compressed_size = get_u4le(p);
   *uncompressed_size = get_u4le(p);
   u2 file_name_length = get_u2le(p);
@@ -856,6 +959,7 @@ bool InputZipFile::Open() {
   central_dir_ = central_dir;
   central_dir_current_ = central_dir;
   p = zipdata_in_ + in_offset_;
+  input_file_->Prefetch(0, 2 * MAX_MAPPED_REGION);
   errmsg[0] = 0;
   return true;
 }
@@ -906,39 +1010,16 @@ int OutputZipFile::WriteEmptyFile(const char *filename) {
   return 0;
 }
 
-void OutputZipFile::WriteCentralDirectory() {
-  // central directory:
-  const u1 *central_directory_start = q;
-  for (size_t ii = 0; ii < entries_.size(); ++ii) {
-    LocalFileEntry *entry = entries_[ii];
-    put_u4le(q, CENTRAL_FILE_HEADER_SIGNATURE);
-    put_u2le(q, UNIX_ZIP_FILE_VERSION);
-
-    put_u2le(q, ZIP_VERSION_TO_EXTRACT);  // version to extract
-    put_u2le(q, 0);  // general purpose bit flag
-    put_u2le(q, entry->compression_method);  // compression method:
-    put_u4le(q, kDefaultTimestamp);          // last_mod_file date and time
-    put_u4le(q, entry->crc32);  // crc32
-    put_u4le(q, entry->compressed_length);    // compressed_size
-    put_u4le(q, entry->uncompressed_length);  // uncompressed_size
-    put_u2le(q, entry->file_name_length);
-    put_u2le(q, entry->extra_field_length);
-
-    put_u2le(q, 0);  // file comment length
-    put_u2le(q, 0);  // disk number start
-    put_u2le(q, 0);  // internal file attributes
-    put_u4le(q, entry->external_attr);  // external file attributes
-    // relative offset of local header:
-    put_u4le(q, entry->local_header_offset);
-
-    put_n(q, entry->file_name, entry->file_name_length);
-    put_n(q, entry->extra_field, entry->extra_field_length);
-  }
-  u8 central_directory_size = q - central_directory_start;
-
-  if (entries_.size() > U2_MAX || central_directory_size > U4_MAX ||
-      Offset(central_directory_start) > U4_MAX) {
-    u1 *zip64_end_of_central_directory_start = q;
+// Writes the end of central directory record after the central directory,
+// which starts at central_directory_offset, and the zip64 records before it
+// if they are needed.
+static void WriteEndOfCentralDirectory(u1 *&q, u8 entries,
+                                       u8 central_directory_offset,
+                                       u8 central_directory_size) {
+  if (entries > U2_MAX || central_directory_size > U4_MAX ||
+      central_directory_offset > U4_MAX) {
+    u8 zip64_end_of_central_directory_offset =
+        central_directory_offset + central_directory_size;
 
     put_u4le(q, ZIP64_EOCD_SIGNATURE);
     // signature and size field doesn't count towards size
@@ -947,17 +1028,17 @@ void OutputZipFile::WriteCentralDirectory() {
     put_u2le(q, 0);  // version needed to extract
     put_u4le(q, 0);  // number of this disk
     put_u4le(q, 0);  // # of the disk with the start of the central directory
-    put_u8le(q, entries_.size());  // # central dir entries on this disk
-    put_u8le(q, entries_.size());  // total # entries in the central directory
+    put_u8le(q, entries);  // # central dir entries on this disk
+    put_u8le(q, entries);  // total # entries in the central directory
     put_u8le(q, central_directory_size);  // size of the central directory
     // offset of start of central directory wrt starting disk
-    put_u8le(q, Offset(central_directory_start));
+    put_u8le(q, central_directory_offset);
 
     put_u4le(q, ZIP64_EOCD_LOCATOR_SIGNATURE);
     // number of the disk with the start of the zip64 end of central directory
     put_u4le(q, 0);
     // relative offset of the zip64 end of central directory record
-    put_u8le(q, Offset(zip64_end_of_central_directory_start));
+    put_u8le(q, zip64_end_of_central_directory_offset);
     // total number of disks
     put_u4le(q, 1);
 
@@ -965,31 +1046,64 @@ void OutputZipFile::WriteCentralDirectory() {
     put_u2le(q, 0);  // number of this disk
     put_u2le(q, 0);  // # of disk with the start of the central directory
     // # central dir entries on this disk
-    put_u2le(q, entries_.size() > 0xffff ? 0xffff : entries_.size());
+    put_u2le(q, entries > 0xffff ? 0xffff : entries);
     // total # entries in the central directory
-    put_u2le(q, entries_.size() > 0xffff ? 0xffff : entries_.size());
+    put_u2le(q, entries > 0xffff ? 0xffff : entries);
     // size of the central directory
     put_u4le(q,
              central_directory_size > U4_MAX ? U4_MAX : central_directory_size);
     // offset of start of central
-    put_u4le(q, Offset(central_directory_start) > U4_MAX
-                    ? U4_MAX
-                    : Offset(central_directory_start));
+    put_u4le(q, central_directory_offset > U4_MAX ? U4_MAX
+                                                  : central_directory_offset);
     put_u2le(q, 0);  // .ZIP file comment length
 
   } else {
     put_u4le(q, EOCD_SIGNATURE);
     put_u2le(q, 0);  // number of this disk
     put_u2le(q, 0);  // # of the disk with the start of the central directory
-    put_u2le(q, entries_.size());  // # central dir entries on this disk
-    put_u2le(q, entries_.size());  // total # entries in the central directory
+    put_u2le(q, entries);  // # central dir entries on this disk
+    put_u2le(q, entries);  // total # entries in the central directory
     put_u4le(q, central_directory_size);  // size of the central directory
     // offset of start of central directory wrt starting disk
-    put_u4le(q, Offset(central_directory_start));
+    put_u4le(q, central_directory_offset);
     put_u2le(q, 0);  // .ZIP file comment length
   }
 }
 
+void OutputZipFile::WriteCentralDirectory() {
+  // central directory:
+  const u1 *central_directory_start = q;
+  for (size_t ii = 0; ii < entries_.size(); ++ii) {
+    LocalFileEntry *entry = entries_[ii];
+    put_u4le(q, CENTRAL_FILE_HEADER_SIGNATURE);
+    put_u2le(q, UNIX_ZIP_FILE_VERSION);
+
+    put_u2le(q, ZIP_VERSION_TO_EXTRACT);  // version to extract
+    put_u2le(q, 0);  // general purpose bit flag
+    put_u2le(q, entry->compression_method);  // compression method:
+    put_u4le(q, kDefaultTimestamp);          // last_mod_file date and time
+    put_u4le(q, entry->crc32);  // crc32
+    put_u4le(q, entry->compressed_length);    // compressed_size
+    put_u4le(q, entry->uncompressed_length);  // uncompressed_size
+    put_u2le(q, entry->file_name_length);
+    put_u2le(q, entry->extra_field_length);
+
+    put_u2le(q, 0);  // file comment length
+    put_u2le(q, 0);  // disk number start
+    put_u2le(q, 0);  // internal file attributes
+    put_u4le(q, entry->external_attr);  // external file attributes
+    // relative offset of local header:
+    put_u4le(q, entry->local_header_offset);
+
+    put_n(q, entry->file_name, entry->file_name_length);
+    put_n(q, entry->extra_field, entry->extra_field_length);
+  }
+  u8 central_directory_size = q - central_directory_start;
+  WriteEndOfCentralDirectory(q, entries_.size(),
+                             Offset(central_directory_start),
+                             central_directory_size);
+}
+
 u1* OutputZipFile::WriteLocalFileHeader(const char* filename, const u4 attr) {
   off_t file_name_length_ = strlen(filename);
   LocalFileEntry *entry = new LocalFileEntry;
@@ -1094,6 +1208,30 @@ int OutputZipFile::FinishFile(size_t filelength, bool compress,
   return 0;
 }
 
+int OutputZipFile::WriteFile(const char *filename, const u4 attr,
+                             const u1 *data, size_t length,
+                             size_t uncompressed_length, u4 crc) {
+  if (length > uncompressed_length) {
+    return error("%s: compressed size %zu exceeds uncompressed size %zu\n",
+                 filename, length, uncompressed_length);
+  }
+  u1 *header = WriteLocalFileHeader(filename, attr);
+  const u2 method = length < uncompressed_length ? COMPRESSION_METHOD_DEFLATED
+                                                 : COMPRESSION_METHOD_STORED;
+  put_u2le(header, method);
+  header += 4;
+  put_u4le(header, crc);                  // crc32
+  put_u4le(header, length);               // compressed_size
+  put_u4le(header, uncompressed_length);  // uncompressed_size
+  put_n(q, data, length);
+
+  entries_.back()->crc32 = crc;
+  entries_.back()->compressed_length = length;
+  entries_.back()->uncompressed_length = uncompressed_length;
+  entries_.back()->compression_method = method;
+  return 0;
+}
+
 bool OutputZipFile::Open() {
   if (estimated_size_ > kMaximumOutputSize) {
     fprintf(stderr,
@@ -1129,6 +1267,209 @@ ZipBuilder *ZipBuilder::Create(const char *zip_file, size_t estimated_size) {
   return result;
 }
 
+//
+// Implementation of StreamingZipFile
+//
+u1* StreamingZipFile::NewFile(const char* filename, const u4 attr) {
+  error("%s: files cannot be written in place when streaming\n", filename);
+  return NULL;
+}
+
+int StreamingZipFile::FinishFile(size_t filelength, bool compress,
+                                 bool compute_crc) {
+  return error("FinishFile() without NewFile()\n");
+}
+
+int StreamingZipFile::WriteEmptyFile(const char *filename) {
+  return WriteFile(filename, 0, NULL, 0, 0, 0);
+}
+
+int StreamingZipFile::WriteFile(const char *filename, const u4 attr,
+                                const u1 *data, size_t length,
+                                size_t uncompressed_length, u4 crc) {
+  if (length > uncompressed_length) {
+    return error("%s: compressed size %zu exceeds uncompressed size %zu\n",
+                 filename, length, uncompressed_length);
+  }
+  size_t file_name_length = strlen(filename);
+  if (file_name_length > U2_MAX) {
+    return error("%s: file name too long\n", filename);
+  }
+
+  Entry entry;
+  entry.file_name = filename;
+  entry.local_header_offset = offset_;
+  entry.compressed_length = length;
+  entry.uncompressed_length = uncompressed_length;
+  entry.crc32 = crc;
+  entry.external_attr = attr;
+  entry.compression_method = length < uncompressed_length
+                                 ? COMPRESSION_METHOD_DEFLATED
+                                 : COMPRESSION_METHOD_STORED;
+  // The local header has both sizes in a zip64 extra field if either does not
+  // fit. The compressed size is never the larger one.
+  const bool zip64 = uncompressed_length >= U4_MAX;
+
+  u1 header[30 + 20];
+  u1 *q = header;
+  put_u4le(q, LOCAL_FILE_HEADER_SIGNATURE);
+  put_u2le(q, zip64 ? ZIP64_VERSION_TO_EXTRACT : ZIP_VERSION_TO_EXTRACT);
+  put_u2le(q, 0);  // general purpose bit flag
+  put_u2le(q, entry.compression_method);
+  put_u4le(q, kDefaultTimestamp);  // last_mod_file date and time
+  put_u4le(q, crc);                // crc32
+  put_u4le(q, zip64 ? U4_MAX : length);               // compressed_size
+  put_u4le(q, zip64 ? U4_MAX : uncompressed_length);  // uncompressed_size
+  put_u2le(q, file_name_length);
+  put_u2le(q, zip64 ? 20 : 0);  // extra_field_length
+  if (Append(header, q - header) < 0 ||
+      Append(filename, file_name_length) < 0) {
+    return -1;
+  }
+  if (zip64) {
+    q = header;
+    put_u2le(q, ZIP64_EXTRA_FIELD_TAG);
+    put_u2le(q, 16);  // size of the extra field
+    put_u8le(q, uncompressed_length);
+    put_u8le(q, length);
+    if (Append(header, q - header) < 0) {
+      return -1;
+    }
+  }
+  if (Append(data, length) < 0) {
+    return -1;
+  }
+  entries_.push_back(entry);
+  return 0;
+}
+
+int StreamingZipFile::Append(const void *data, size_t size) {
+  offset_ += size;
+  if (buffer_.size() + size > kBufferSize) {
+    if (Flush() < 0) {
+      return -1;
+    }
+    if (size >= kBufferSize) {
+      if (output_file_->Write(data, size) < 0) {
+        return error("%s", output_file_->Error());
+      }
+      return 0;
+    }
+  }
+  const u1 *p = static_cast<const u1 *>(data);
+  buffer_.insert(buffer_.end(), p, p + size);
+  return 0;
+}
+
+int StreamingZipFile::Flush() {
+  if (!buffer_.empty() &&
+      output_file_->Write(buffer_.data(), buffer_.size()) < 0) {
+    return error("%s", output_file_->Error());
+  }
+  buffer_.clear();
+  return 0;
+}
+
+int StreamingZipFile::Finish() {
+  if (finished_ || output_file_ == NULL) {
+    return 0;
+  }
+  finished_ = true;
+
+  size_t central_directory_size = 0;
+  for (const Entry &entry : entries_) {
+    central_directory_size += 46 + entry.file_name.size() + 28;
+  }
+  std::vector<u1> central_directory(central_directory_size +
+                                    ZIP64_EOCD_FIXED_SIZE +
+                                    ZIP64_EOCD_LOCATOR_SIZE + 22);
+  u1 *q = central_directory.data();
+  for (const Entry &entry : entries_) {
+    // The zip64 extra field has the values that do not fit, in this order.
+    u1 extra_field[28];
+    u1 *e = extra_field + 4;
+    if (entry.uncompressed_length >= U4_MAX) {
+      put_u8le(e, entry.uncompressed_length);
+    }
+    if (entry.compressed_length >= U4_MAX) {
+      put_u8le(e, entry.compressed_length);
+    }
+    if (entry.local_header_offset >= U4_MAX) {
+      put_u8le(e, entry.local_header_offset);
+    }
+    u2 extra_field_length = 0;
+    if (e != extra_field + 4) {
+      extra_field_length = e - extra_field;
+      e = extra_field;
+      put_u2le(e, ZIP64_EXTRA_FIELD_TAG);
+      put_u2le(e, extra_field_length - 4);  // size of the extra field
+    }
+
+    put_u4le(q, CENTRAL_FILE_HEADER_SIGNATURE);
+    put_u2le(q, UNIX_ZIP_FILE_VERSION);
+    // version to extract
+    put_u2le(q, extra_field_length > 0 ? ZIP64_VERSION_TO_EXTRACT
+                                       : ZIP_VERSION_TO_EXTRACT);
+    put_u2le(q, 0);  // general purpose bit flag
+    put_u2le(q, entry.compression_method);  // compression method:
+    put_u4le(q, kDefaultTimestamp);         // last_mod_file date and time
+    put_u4le(q, entry.crc32);               // crc32
+    // compressed_size
+    put_u4le(q, std::min<u8>(entry.compressed_length, U4_MAX));
+    // uncompressed_size
+    put_u4le(q, std::min<u8>(entry.uncompressed_length, U4_MAX));
+    put_u2le(q, entry.file_name.size());
+    put_u2le(q, extra_field_length);
+
+    put_u2le(q, 0);  // file comment length
+    put_u2le(q, 0);  // disk number start
+    put_u2le(q, 0);  // internal file attributes
+    put_u4le(q, entry.external_attr);  // external file attributes
+    // relative offset of local header:
+    put_u4le(q, std::min<u8>(entry.local_header_offset, U4_MAX));
+
+    put_n(q, reinterpret_cast<const u1 *>(entry.file_name.data()),
+          entry.file_name.size());
+    put_n(q, extra_field, extra_field_length);
+  }
+  u8 central_directory_offset = offset_;
+  WriteEndOfCentralDirectory(q, entries_.size(), central_directory_offset,
+                             q - central_directory.data());
+
+  if (Append(central_directory.data(), q - central_directory.data()) < 0 ||
+      Flush() < 0) {
+    return -1;
+  }
+  if (output_file_->Close() < 0) {
+    return error("%s", output_file_->Error());
+  }
+  return 0;
+}
+
+bool StreamingZipFile::Open() {
+  StreamedOutputFile* output_file = new StreamedOutputFile(filename_);
+  if (!output_file->Opened()) {
+    snprintf(errmsg, sizeof(errmsg), "%s", output_file->Error());
+    delete output_file;
+    return false;
+  }
+
+  output_file_ = output_file;
+  buffer_.reserve(kBufferSize);
+  return true;
+}
+
+ZipBuilder *ZipBuilder::CreateStreaming(const char *zip_file) {
+  StreamingZipFile* result = new StreamingZipFile(zip_file);
+  if (!result->Open()) {
+    fprintf(stderr, "%s\n", result->GetError());
+    delete result;
+    return NULL;
+  }
+
+  return result;
+}
+
 u8 ZipBuilder::EstimateSize(char const* const* files,
                             char const* const* zip_paths,
                             int nb_entries) {
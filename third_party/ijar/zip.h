@@ -71,6 +71,17 @@ class ZipBuilder {
   // On failure, returns -1 and GetError() will return an non-empty message.
   virtual int WriteEmptyFile(const char* filename) = 0;
 
+  // Add a file whose data the caller has prepared already, e.g. on another
+  // thread. The first `length` bytes of `data` are the content of the file,
+  // deflated with TryDeflate() if `length` is less than `uncompressed_length`,
+  // and `crc` is the CRC32 of the uncompressed content. It is equivalent to
+  // NewFile() followed by FinishFile() with the same arguments, but the data is
+  // copied in whole.
+  // On failure, returns -1 and GetError() will return an non-empty message.
+  virtual int WriteFile(const char* filename, const u4 attr, const u1* data,
+                        size_t length, size_t uncompressed_length,
+                        u4 crc) = 0;
+
   // Finish writing the ZIP file. This method can be called only once
   // (subsequent calls will do nothing) and none of
   // NewFile/FinishFile/WriteEmptyFile should be called after calling Finish. If
@@ -95,6 +106,13 @@ class ZipBuilder {
   // On failure, returns NULL. Refer to errno for error code.
   static ZipBuilder* Create(const char* zip_file, size_t estimated_size);
 
+  // Create a new ZipBuilder writing the file zip_file as the files are added,
+  // with no limit on its size. The files must be added with WriteFile() or
+  // WriteEmptyFile(): NewFile() is not supported since the builder does not
+  // keep a buffer of the output.
+  // On failure, returns NULL. Refer to errno for error code.
+  static ZipBuilder* CreateStreaming(const char* zip_file);
+
   // Estimate the maximum size of the ZIP files containing files in the "files"
   // null-terminated array.
   // Returns 0 on error.
@@ -121,6 +139,19 @@ class ZipExtractorProcessor {
   // in the buffer pointed by "data".
   virtual void Process(const char* filename, const u4 attr,
                        const u1* data, const size_t size) = 0;
+
+  // Called before Process, with the content of the file as it is stored in
+  // the ZIP: "length" bytes, deflated if "length" is less than "size", and
+  // "crc" the CRC32 of the uncompressed content as the ZIP records it, as
+  // ZipBuilder::WriteFile takes them. Returns true if the file was processed,
+  // and false to have it decompressed and passed to Process, which the
+  // default does. Files that are deflated but not smaller are always
+  // decompressed.
+  virtual bool ProcessRaw(const char* /*filename*/, const u4 /*attr*/,
+                          const u1* /*data*/, const size_t /*length*/,
+                          const size_t /*size*/, const u4 /*crc*/) {
+    return false;
+  }
 };
 
 //
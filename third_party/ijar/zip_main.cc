@@ -27,18 +27,31 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
 #include <memory>
-#include <set>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
+#include "third_party/ijar/mapped_file.h"
 #include "third_party/ijar/platform_utils.h"
 #include "third_party/ijar/zip.h"
+#include "third_party/ijar/zlib_client.h"
 
 namespace devtools_ijar {
 
 //
 // A ZipExtractorProcessor that extract files in the ZIP file.
 //
+// The files are written on a pool of threads while the main thread keeps
+// reading the input. The directories are made by the main thread, while no
+// file is being written, since making a directory may change the umask.
+//
 class UnzipProcessor : public ZipExtractorProcessor {
  public:
   // Create a processor who will extract the given files (or all files if NULL)
@@ -55,9 +68,15 @@ class UnzipProcessor : public ZipExtractorProcessor {
         file_names.insert(std::string(files[i]));
       }
     }
+    if (extract_) {
+      int jobs = std::min<int>(std::thread::hardware_concurrency(), kMaxJobs);
+      for (int i = 1; i < jobs; ++i) {
+        workers_.emplace_back(&UnzipProcessor::WriteLoop, this);
+      }
+    }
   }
 
-  virtual ~UnzipProcessor() {}
+  virtual ~UnzipProcessor();
 
   virtual void Process(const char* filename, const u4 attr,
                        const u1* data, const size_t size);
@@ -71,12 +90,54 @@ class UnzipProcessor : public ZipExtractorProcessor {
     }
   }
 
+  // Waits for all the files to be written.
+  void Finish();
+
  private:
+  struct WriteTask {
+    std::string path;
+    mode_t perm;
+    std::vector<u1> data;
+  };
+
+  // More threads don't make the writes faster.
+  static constexpr int kMaxJobs = 8;
+  // The bytes which may be queued for writing, besides one file of any size.
+  static constexpr size_t kMaxQueuedBytes = 64 * 1024 * 1024;
+
+  // Makes the parent directories of the path, or the directory itself if
+  // "isdir" is set. The calls to make_dirs() which would not change anything
+  // are skipped.
+  void MakeDirs(const char *path, mode_t perm, bool isdir);
+  void WriteFile(const char *path, mode_t perm, const u1 *data,
+                 const size_t size);
+  // Waits until at most max_queued_bytes are queued or being written, or
+  // until all the files are written if it is zero.
+  void WaitForWrites(std::unique_lock<std::mutex> *lock,
+                     size_t max_queued_bytes);
+  void WriteLoop();
+
   const char *output_root_;
   const bool verbose_;
   const bool extract_;
   const bool flatten_;
-  std::set<std::string> file_names;
+  std::unordered_set<std::string> file_names;
+
+  // The mode last passed to make_dirs() for a directory.
+  std::unordered_map<std::string, mode_t> dir_perms_;
+  // The files written so far, so that a later entry with the same path waits
+  // for the first one to be written.
+  std::unordered_set<std::string> written_paths_;
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable work_available_;
+  std::condition_variable write_done_;
+  std::deque<std::unique_ptr<WriteTask>> tasks_;
+  // Including the files being written.
+  size_t queued_files_ = 0;
+  size_t queued_bytes_ = 0;
+  bool stopping_ = false;
 };
 
 // Concatene 2 path, path1 and path2, using / as a directory separator and
@@ -128,14 +189,110 @@ void UnzipProcessor::Process(const char* filename, const u4 attr,
   }
   if (extract_) {
     char path[PATH_MAX];
-    if (!concat_path(path, sizeof(path), output_root_, output_file_name) ||
-        !make_dirs(path, perm) ||
-        (!isdir && !write_file(path, perm, data, size))) {
+    if (!concat_path(path, sizeof(path), output_root_, output_file_name)) {
+      abort();
+    }
+    MakeDirs(path, perm, isdir);
+    if (!isdir) {
+      WriteFile(path, perm, data, size);
+    }
+  }
+}
+
+UnzipProcessor::~UnzipProcessor() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  work_available_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+void UnzipProcessor::MakeDirs(const char *path, mode_t perm, bool isdir) {
+  std::string dir(path);
+  size_t slash = dir.find_last_of('/');
+  if (!isdir && slash != std::string::npos) {
+    dir.resize(slash);
+  }
+  while (dir.size() > 1 && dir.back() == '/') {
+    dir.pop_back();
+  }
+  auto it = dir_perms_.find(dir);
+  if (it != dir_perms_.end() && it->second == perm) {
+    return;
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    WaitForWrites(&lock, 0);
+  }
+  if (!make_dirs(path, perm)) {
+    abort();
+  }
+  dir_perms_[dir] = perm;
+}
+
+void UnzipProcessor::WriteFile(const char *path, mode_t perm, const u1 *data,
+                               const size_t size) {
+  if (workers_.empty()) {
+    if (!write_file(path, perm, data, size)) {
       abort();
     }
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!written_paths_.insert(path).second) {
+    WaitForWrites(&lock, 0);
+  }
+  WaitForWrites(&lock, kMaxQueuedBytes - std::min(size, kMaxQueuedBytes));
+  // The data is only valid until the next file is read, so the task gets a
+  // copy.
+  std::unique_ptr<WriteTask> task(new WriteTask);
+  task->path = path;
+  task->perm = perm;
+  task->data.assign(data, data + size);
+  ++queued_files_;
+  queued_bytes_ += size;
+  tasks_.push_back(std::move(task));
+  work_available_.notify_one();
+}
+
+void UnzipProcessor::WaitForWrites(std::unique_lock<std::mutex> *lock,
+                                   size_t max_queued_bytes) {
+  write_done_.wait(*lock, [this, max_queued_bytes] {
+    return max_queued_bytes > 0 ? queued_bytes_ <= max_queued_bytes
+                                : queued_files_ == 0;
+  });
+}
+
+void UnzipProcessor::WriteLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    work_available_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+    if (tasks_.empty()) {
+      return;
+    }
+    std::unique_ptr<WriteTask> task = std::move(tasks_.front());
+    tasks_.pop_front();
+    lock.unlock();
+    if (!write_file(task->path.c_str(), task->perm, task->data.data(),
+                    task->data.size())) {
+      abort();
+    }
+    lock.lock();
+    --queued_files_;
+    queued_bytes_ -= task->data.size();
+    write_done_.notify_all();
   }
 }
 
+void UnzipProcessor::Finish() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  WaitForWrites(&lock, 0);
+}
+
 // Get the basename of path and store it in output. output_size
 // is the size of the output buffer.
 void basename(const char *path, char *output, size_t output_size) {
@@ -182,20 +339,189 @@ int extract(char *zipfile, char *exdir, char **files, bool verbose,
     fprintf(stderr, "%s.\n", extractor->GetError());
     return -1;
   }
+  processor.Finish();
   return 0;
 }
 
-// add a file to the zip
-int add_file(std::unique_ptr<ZipBuilder> const &builder, char *file,
-             char *zip_path, bool flatten, bool verbose, bool compress) {
-  Stat file_stat = {0, 0666, false};
-  if (file != NULL) {
-    if (!stat_file(file, &file_stat)) {
-      fprintf(stderr, "Cannot stat file %s: %s\n", file, strerror(errno));
-      return -1;
+//
+// Reads the files to add to a zip on a pool of threads, and deflates them if
+// asked to, while the main thread writes the files before them to the zip.
+//
+class ZipEntryReader {
+ public:
+  // A file to add to the zip, with its content once it is read.
+  struct Entry {
+    const char *file;  // NULL for an empty file.
+    Stat stat = {0, 0666, false};
+    std::string error;  // Set if the file could not be read.
+    // The content, deflated if that makes it smaller.
+    const u1 *content = NULL;
+    size_t length = 0;
+    u4 crc = 0;
+    std::unique_ptr<u1[]> buffer;
+    // Large files are mapped rather than read.
+    std::unique_ptr<MappedInputFile> mapped;
+    bool done = false;
+
+    ~Entry() {
+      if (mapped != NULL) {
+        mapped->Discard(mapped->Length());
+        mapped->Close();
+      }
+    }
+  };
+
+  explicit ZipEntryReader(bool compress) : compress_(compress) {
+    int jobs = std::min<int>(std::thread::hardware_concurrency(), kMaxJobs);
+    for (int i = 0; i < jobs; ++i) {
+      workers_.emplace_back(&ZipEntryReader::ReadLoop, this);
+    }
+  }
+
+  ~ZipEntryReader();
+
+  // The number of files which may be read ahead of the next one.
+  size_t Capacity() const {
+    return kMaxQueuedPerJob * std::max<size_t>(workers_.size(), 1);
+  }
+
+  // Starts reading the file.
+  void Add(const char *file);
+
+  // Returns the first file added and not returned yet, once it is read.
+  std::unique_ptr<Entry> Next();
+
+ private:
+  // More threads don't make the reads faster.
+  static constexpr int kMaxJobs = 8;
+  static constexpr size_t kMaxQueuedPerJob = 16;
+  // Files up to this size are read, larger ones are mapped.
+  static constexpr size_t kMaxReadSize = 1024 * 1024;
+
+  void Read(Entry *entry);
+  void ReadLoop();
+
+  const bool compress_;
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable work_available_;
+  std::condition_variable entry_done_;
+  std::deque<std::unique_ptr<Entry>> entries_;  // Not returned yet.
+  std::deque<Entry *> pending_;                 // Not read yet.
+  bool stopping_ = false;
+};
+
+ZipEntryReader::~ZipEntryReader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  work_available_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+void ZipEntryReader::Add(const char *file) {
+  std::unique_ptr<Entry> entry(new Entry);
+  entry->file = file;
+  if (workers_.empty()) {
+    Read(entry.get());
+    entry->done = true;
+    entries_.push_back(std::move(entry));
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  pending_.push_back(entry.get());
+  entries_.push_back(std::move(entry));
+  work_available_.notify_one();
+}
+
+std::unique_ptr<ZipEntryReader::Entry> ZipEntryReader::Next() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  entry_done_.wait(lock, [this] { return entries_.front()->done; });
+  std::unique_ptr<Entry> entry = std::move(entries_.front());
+  entries_.pop_front();
+  return entry;
+}
+
+void ZipEntryReader::Read(Entry *entry) {
+  if (entry->file == NULL) {
+    return;
+  }
+  if (!stat_file(entry->file, &entry->stat)) {
+    entry->error = std::string("Cannot stat file ") + entry->file + ": " +
+                   strerror(errno);
+    return;
+  }
+  if (entry->stat.is_directory || entry->stat.total_size == 0) {
+    return;
+  }
+
+  size_t size = entry->stat.total_size;
+  u1 *content;
+  if (size <= kMaxReadSize) {
+    entry->buffer.reset(new u1[size]);
+    if (!read_file(entry->file, entry->buffer.get(), size)) {
+      entry->error = std::string("Cannot read file ") + entry->file;
+      return;
     }
+    content = entry->buffer.get();
+  } else {
+    entry->mapped.reset(new MappedInputFile(entry->file));
+    if (!entry->mapped->Opened() || entry->mapped->Length() < size) {
+      entry->error = std::string("Cannot read file ") + entry->file;
+      entry->mapped.reset();
+      return;
+    }
+    content = entry->mapped->Buffer();
+  }
+  entry->crc = ComputeCrcChecksum(content, size);
+  entry->content = content;
+  entry->length = size;
+
+  if (compress_) {
+    std::unique_ptr<u1[]> deflated(new u1[size]);
+    size_t deflated_size = TryDeflateTo(content, size, deflated.get());
+    if (deflated_size == 0) {
+      entry->error = "Error compressing files.";
+    } else if (deflated_size < size) {
+      entry->buffer = std::move(deflated);
+      entry->content = entry->buffer.get();
+      entry->length = deflated_size;
+    }
+  }
+}
+
+void ZipEntryReader::ReadLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    work_available_.wait(lock,
+                         [this] { return stopping_ || !pending_.empty(); });
+    if (pending_.empty()) {
+      return;
+    }
+    Entry *entry = pending_.front();
+    pending_.pop_front();
+    lock.unlock();
+    Read(entry);
+    lock.lock();
+    entry->done = true;
+    entry_done_.notify_all();
+  }
+}
+
+// add a file to the zip
+int add_file(std::unique_ptr<ZipBuilder> const &builder,
+             const ZipEntryReader::Entry &entry, char *zip_path, bool flatten,
+             bool verbose) {
+  if (!entry.error.empty()) {
+    fprintf(stderr, "%s\n", entry.error.c_str());
+    return -1;
   }
-  char *final_path = zip_path != NULL ? zip_path : file;
+  const Stat &file_stat = entry.stat;
+  const char *final_path = zip_path != NULL ? zip_path : entry.file;
 
   bool isdir = file_stat.is_directory;
 
@@ -227,14 +553,11 @@ int add_file(std::unique_ptr<ZipBuilder> const &builder, char *file,
     printf("%c %o %s\n", isdir ? 'd' : 'f', perm, path);
   }
 
-  u1 *buffer = builder->NewFile(path, stat_to_zipattr(file_stat));
-  if (isdir || file_stat.total_size == 0) {
-    builder->FinishFile(0);
-  } else {
-    if (!read_file(file, buffer, file_stat.total_size)) {
-      return -1;
-    }
-    builder->FinishFile(file_stat.total_size, compress, true);
+  if (builder->WriteFile(path, stat_to_zipattr(file_stat), entry.content,
+                         entry.length, isdir ? 0 : file_stat.total_size,
+                         entry.crc) < 0) {
+    fprintf(stderr, "%s\n", builder->GetError());
+    return -1;
   }
   return 0;
 }
@@ -336,19 +659,21 @@ int create(char *zipfile, char **file_entries, bool flatten, bool verbose,
     return -1;
   }
 
-  u8 size = ZipBuilder::EstimateSize(files, zip_paths, nb_entries);
-  if (size == 0) {
-    return -1;
-  }
-  std::unique_ptr<ZipBuilder> builder(ZipBuilder::Create(zipfile, size));
+  std::unique_ptr<ZipBuilder> builder(ZipBuilder::CreateStreaming(zipfile));
   if (builder == NULL) {
     fprintf(stderr, "Unable to create zip file %s: %s.\n",
             zipfile, strerror(errno));
     return -1;
   }
 
+  // The files are read ahead of the one being written.
+  ZipEntryReader reader(compress);
+  int next = 0;
   for (int i = 0; i < nb_entries; i++) {
-    if (add_file(builder, files[i], zip_paths[i], flatten, verbose, compress) <
+    for (; next < nb_entries && next - i < (int)reader.Capacity(); next++) {
+      reader.Add(files[next]);
+    }
+    if (add_file(builder, *reader.Next(), zip_paths[i], flatten, verbose) <
         0) {
       return -1;
     }
@@ -22,44 +22,75 @@
 
 namespace devtools_ijar {
 
+// zlib counts the bytes of a buffer in a uInt, so larger buffers are passed
+// to it in pieces of this size.
+static const size_t kMaxZlibPiece = 1 << 30;
+
 u4 ComputeCrcChecksum(u1 *buf, size_t length) {
-  return crc32(0, buf, length);
+  uLong crc = crc32(0, Z_NULL, 0);
+  for (size_t done = 0; done < length; done += kMaxZlibPiece) {
+    crc = crc32(crc, buf + done, std::min(length - done, kMaxZlibPiece));
+  }
+  return crc;
 }
 
-size_t TryDeflate(u1 *buf, size_t length) {
-  u1 *outbuf = reinterpret_cast<u1 *>(malloc(length));
+size_t TryDeflateTo(const u1 *in, size_t length, u1 *out, int level) {
   z_stream stream;
 
-  // Initialize the z_stream strcut for reading from buf and wrinting in outbuf.
+  // Initialize the z_stream struct for reading from in and writing in out.
   stream.zalloc = Z_NULL;
   stream.zfree = Z_NULL;
   stream.opaque = Z_NULL;
-  stream.total_in = length;
-  stream.avail_in = length;
-  stream.total_out = length;
-  stream.avail_out = length;
-  stream.next_in = buf;
-  stream.next_out = outbuf;
+  stream.avail_in = 0;
+  stream.avail_out = 0;
+  stream.next_in = const_cast<Bytef *>(in);
+  stream.next_out = out;
 
   // deflateInit2 negative windows size prevent the zlib wrapper to be used.
-  if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+  if (deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8,
                    Z_DEFAULT_STRATEGY) != Z_OK) {
     // Failure to compress => return the buffer uncompressed
-    free(outbuf);
     return length;
   }
 
-  if (deflate(&stream, Z_FINISH) == Z_STREAM_END) {
-    // Compression successful and fits in outbuf, let's copy the result in buf.
-    length = stream.total_out;
-    memcpy(buf, outbuf, length);
+  size_t in_left = length;
+  size_t out_left = length;
+  int ret = Z_OK;
+  while (ret == Z_OK) {
+    if (stream.avail_in == 0) {
+      stream.avail_in = std::min(in_left, kMaxZlibPiece);
+      in_left -= stream.avail_in;
+    }
+    if (stream.avail_out == 0) {
+      if (out_left == 0) {
+        // The compressed data would not be smaller.
+        break;
+      }
+      stream.avail_out = std::min(out_left, kMaxZlibPiece);
+      out_left -= stream.avail_out;
+    }
+    ret = deflate(&stream, in_left == 0 ? Z_FINISH : Z_NO_FLUSH);
   }
-
+  size_t compressed_length = length - out_left - stream.avail_out;
   deflateEnd(&stream);
+
+  if (ret != Z_STREAM_END || compressed_length >= length) {
+    return length;
+  }
+  return compressed_length;
+}
+
+size_t TryDeflate(u1 *buf, size_t length, int level) {
+  u1 *outbuf = reinterpret_cast<u1 *>(malloc(length));
+  size_t compressed_length = TryDeflateTo(buf, length, outbuf, level);
+  if (compressed_length < length) {
+    // Compression successful and fits in outbuf, let's copy the result in buf.
+    memcpy(buf, outbuf, compressed_length);
+  }
   free(outbuf);
 
   // Return the length of the resulting buffer
-  return length;
+  return compressed_length;
 }
 
 Decompressor::Decompressor() {
@@ -71,7 +102,17 @@ Decompressor::Decompressor() {
 Decompressor::~Decompressor() { free(uncompressed_data_); }
 
 DecompressedFile *Decompressor::UncompressFile(const u1 *buffer,
-                                               size_t bytes_avail) {
+                                               size_t bytes_avail,
+                                               size_t expected_size) {
+  if (expected_size > uncompressed_data_allocated_) {
+    // Nothing in the buffer needs to be kept, so don't realloc() it.
+    free(uncompressed_data_);
+    uncompressed_data_allocated_ =
+        expected_size < MAX_BUFFER_SIZE ? expected_size : MAX_BUFFER_SIZE;
+    uncompressed_data_ =
+        reinterpret_cast<u1 *>(malloc(uncompressed_data_allocated_));
+  }
+
   z_stream stream;
 
   stream.zalloc = Z_NULL;
@@ -23,11 +23,21 @@
 #include "third_party/ijar/common.h"
 
 namespace devtools_ijar {
+// The zlib compression level to deflate with, from 1 (fastest) to 9 (best),
+// or -1 for the default of zlib, Z_DEFAULT_COMPRESSION.
+static const int kDefaultDeflateLevel = -1;
+
 // Try to compress a file entry in memory using the deflate algorithm.
 // It will compress buf (of size length) unless the compressed size is bigger
 // than the input size. The result will overwrite the content of buf and the
 // final size is returned.
-size_t TryDeflate(u1* buf, size_t length);
+size_t TryDeflate(u1* buf, size_t length, int level = kDefaultDeflateLevel);
+
+// Like TryDeflate, but writes the compressed data to out, which must have room
+// for length bytes, and leaves the input alone. Returns length if the
+// compressed data would not be smaller than the input.
+size_t TryDeflateTo(const u1* in, size_t length, u1* out,
+                    int level = kDefaultDeflateLevel);
 
 u4 ComputeCrcChecksum(u1* buf, size_t length);
 
@@ -41,7 +51,11 @@ class Decompressor {
  public:
   Decompressor();
   ~Decompressor();
-  DecompressedFile* UncompressFile(const u1* buffer, size_t bytes_avail);
+  // Decompresses the data at the beginning of the buffer. If the size of
+  // the decompressed data is known, pass it as `expected_size`: the buffer
+  // is then grown to it at once, instead of doubling.
+  DecompressedFile* UncompressFile(const u1* buffer, size_t bytes_avail,
+                                   size_t expected_size = 0);
   char* GetError();
 
  private:
@@ -14,63 +14,70 @@
 
 #include <fstream>
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include "tools/cpp/modules_tools/aggregate-ddi/aggregate-ddi.h"
+#include "tools/cpp/modules_tools/common/worker.h"
 
-// Main function
-int main(int argc, char *argv[]) {
+int run(const std::vector<std::string> &args, ParsedInputCache &cache,
+        std::ostream &err) {
   std::vector<std::string> cpp20modules_info;
   std::vector<std::string> ddi;
   std::vector<std::string> module_file;
   std::string output;
-  for (int i = 1; i < argc; ++i) {
-    std::string arg = argv[i];
-    if (arg == "-m" && i + 1 < argc) {
-      cpp20modules_info.emplace_back(argv[++i]);
-    } else if (arg == "-d" && i + 2 < argc) {
-      ddi.emplace_back(argv[++i]);
-      module_file.emplace_back(argv[++i]);
-    } else if (arg == "-o" && i + 1 < argc) {
-      output = argv[++i];
+  for (std::size_t i = 0; i < args.size(); ++i) {
+    const std::string &arg = args[i];
+    if (arg == "-m" && i + 1 < args.size()) {
+      cpp20modules_info.emplace_back(args[++i]);
+    } else if (arg == "-d" && i + 2 < args.size()) {
+      ddi.emplace_back(args[++i]);
+      module_file.emplace_back(args[++i]);
+    } else if (arg == "-o" && i + 1 < args.size()) {
+      output = args[++i];
     } else {
-      std::cerr << "ERROR: Unknown or incomplete argument: " << arg
-                << std::endl;
-      std::exit(1);
+      err << "ERROR: Unknown or incomplete argument: " << arg << std::endl;
+      return 1;
     }
   }
   if (output.empty()) {
-    std::cerr << "ERROR: output not specified" << std::endl;
-    std::exit(1);
+    err << "ERROR: output not specified" << std::endl;
+    return 1;
   }
 
   Cpp20ModulesInfo full_info{};
 
   // Process cpp20modules_info files
   for (const auto &info_filename : cpp20modules_info) {
-    std::ifstream info_stream(info_filename);
-    auto info = parse_info(info_stream);
-    full_info.merge(info);
+    full_info.merge(*cache.info(info_filename));
   }
 
   // Process ddi files
   for (std::size_t i = 0; i < ddi.size(); i++) {
-    auto ddi_filename = ddi[i];
-    auto pcm_path = module_file[i];
-    std::ifstream ddi_stream(ddi_filename);
-    auto dep = parse_ddi(ddi_stream);
-    if (dep.gen_bmi) {
-      full_info.modules[dep.name] = pcm_path;
-      full_info.usages[dep.name] = dep.require_list;
+    auto dep = cache.ddi(ddi[i]);
+    if (dep->gen_bmi) {
+      full_info.modules[dep->name] = module_file[i];
+      full_info.usages[dep->name] = dep->require_list;
     }
   }
 
   // Write final output to file
   std::ofstream of(output);
   if (!of.is_open()) {
-    std::cerr << "ERROR: Failed to open the file " << output << "\n";
-    std::exit(1);
+    err << "ERROR: Failed to open the file " << output << "\n";
+    return 1;
   }
   write_output(of, full_info);
 
   return 0;
 }
+
+// Main function
+int main(int argc, char *argv[]) {
+  if (argc == 2 && std::string(argv[1]) == "--persistent_worker") {
+    return run_persistent_worker(run);
+  }
+  ParsedInputCache cache;
+  return run(std::vector<std::string>(argv + 1, argv + argc), cache,
+             std::cerr);
+}
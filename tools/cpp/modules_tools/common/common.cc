@@ -15,158 +15,258 @@
 #include "tools/cpp/modules_tools/common/common.h"
 
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
 
-#include "json.hpp"
+#include "json_scanner.hpp"
 
 void die(const std::string &msg) {
   std::cerr << msg << std::endl;
   std::exit(1);
 }
 
-void parse_provides(const JsonValue &provides_data, ModuleDep &dep) {
-  if (provides_data.is_null()) {
+// Reads the whole stream with one read when its size is known.
+std::string read_all(std::istream &stream) {
+  std::string content;
+  std::streampos begin = stream.tellg();
+  if (begin != std::streampos(-1) && stream.seekg(0, std::ios::end)) {
+    std::streampos end = stream.tellg();
+    stream.seekg(begin);
+    if (end != std::streampos(-1) && end >= begin) {
+      content.resize(static_cast<size_t>(end - begin));
+      stream.read(&content[0], content.size());
+      content.resize(static_cast<size_t>(stream.gcount()));
+      return content;
+    }
+  }
+  stream.clear();
+  std::ostringstream buffer;
+  buffer << stream.rdbuf();
+  return buffer.str();
+}
+
+// The DDI and info files are read with a JsonScanner, which only keeps the
+// strings that end up in the result. Members that are not used are skipped,
+// and when a member appears more than once, the last one wins, as it does
+// in a JsonValue.
+
+void parse_provides(JsonScanner &json, ModuleDep &dep) {
+  dep.gen_bmi = false;
+  dep.name.clear();
+  if (json.peek() == JsonScanner::kNull) {
+    json.read_null();
     return;
   }
-  if (!provides_data.is_array()) {
+  if (json.peek() != JsonScanner::kArray) {
     die("require ddi content 'rules[0][\"provides\"]' is JSON array");
   }
   // Only 1 provide in rule
   // In C++20 Modules, one TU provide only one module.
   // Fortran can provide more than one module per TU.
   // This check is fine for C++20 Modules.
-  auto provides = provides_data.as_array();
-  if (provides.size() > 1) {
-    die("require ddi content 'rules[0][\"provides\"]' has only 1 provide");
-  }
-  if (provides.size() == 1) {
-    auto provide_data = provides[0];
-    if (!provide_data.is_object()) {
+  json.begin_array();
+  bool seen_provide = false;
+  while (json.next_element()) {
+    if (seen_provide) {
+      die("require ddi content 'rules[0][\"provides\"]' has only 1 provide");
+    }
+    seen_provide = true;
+    if (json.peek() != JsonScanner::kObject) {
       die("require ddi content 'rules[0][\"provides\"][0]' is JSON object");
     }
-    auto provide_obj = provide_data.as_object();
-    if (provide_obj.find("logical-name") == provide_obj.end()) {
-      die("require 'logical-name' in 'rules[0][\"provides\"][0]'");
+    bool has_name = false;
+    json.begin_object();
+    std::string_view key;
+    while (json.next_member(&key)) {
+      if (key != "logical-name") {
+        json.skip_value();
+        continue;
+      }
+      if (json.peek() != JsonScanner::kString) {
+        die("require ddi content 'rules[0][\"provides\"][0][\"logical-name\"]' "
+            "is JSON string");
+      }
+      dep.name = json.read_string();
+      has_name = true;
     }
-    auto name_data = provide_obj.at("logical-name");
-    if (!name_data.is_string()) {
-      die("require ddi content 'rules[0][\"provides\"][0][\"logical-name\"]' "
-          "is JSON string");
+    if (!has_name) {
+      die("require 'logical-name' in 'rules[0][\"provides\"][0]'");
     }
     dep.gen_bmi = true;
-    dep.name = name_data.as_string();
   }
 }
 
-void parse_requires(const JsonValue &requires_data, ModuleDep &dep) {
-  if (requires_data.is_null()) {
+void parse_requires(JsonScanner &json, ModuleDep &dep) {
+  dep.require_list.clear();
+  if (json.peek() == JsonScanner::kNull) {
+    json.read_null();
     return;
   }
-  if (!requires_data.is_array()) {
+  if (json.peek() != JsonScanner::kArray) {
     die("require ddi content 'rules[0][\"requires\"]' is JSON array");
   }
-  for (const auto &item_data : requires_data.as_array()) {
-    if (!item_data.is_object()) {
-      die("require JSON object, but got " + item_data.dump());
+  json.begin_array();
+  while (json.next_element()) {
+    if (json.peek() != JsonScanner::kObject) {
+      die("require JSON object, but got " + std::string(json.raw_value()));
     }
-    auto item_obj = item_data.as_object();
-    if (item_obj.find("logical-name") == item_obj.end()) {
-      die("requrie 'logical-name' in 'rules[0][\"requires\"]' item");
+    bool has_name = false;
+    std::string name;
+    json.begin_object();
+    std::string_view key;
+    while (json.next_member(&key)) {
+      if (key != "logical-name") {
+        json.skip_value();
+        continue;
+      }
+      if (json.peek() != JsonScanner::kString) {
+        die("require JSON string, but got " + std::string(json.raw_value()));
+      }
+      name = json.read_string();
+      has_name = true;
     }
-    auto name_data = item_obj.at("logical-name");
-    if (!name_data.is_string()) {
-      die("require JSON string, but got " + name_data.dump());
+    if (!has_name) {
+      die("requrie 'logical-name' in 'rules[0][\"requires\"]' item");
     }
-    dep.require_list.push_back(name_data.as_string());
+    dep.require_list.push_back(std::move(name));
   }
 }
 
-ModuleDep parse_ddi(std::istream &ddi_stream) {
-  ModuleDep dep{};
-  std::string ddi_string((std::istreambuf_iterator<char>(ddi_stream)),
-                         std::istreambuf_iterator<char>());
-  JsonValue data = parse_json(ddi_string);
-  if (!data.is_object()) {
-    die("require ddi content is JSON object");
-  }
-
-  auto data_obj = data.as_object();
-  if (data_obj.find("rules") == data_obj.end()) {
-    die("require 'rules' in ddi content");
-  }
-
-  auto rules_data = data.as_object().at("rules");
-  if (!rules_data.is_array()) {
+void parse_rules(JsonScanner &json, ModuleDep &dep) {
+  if (json.peek() != JsonScanner::kArray) {
     die("require ddi content 'rules' is JSON array");
   }
-  auto rules = rules_data.as_array();
   // Only 1 rule in DDI file
   // DDI files can contain multiple rules (in general).
   // bazel does per-TU scanning rather than batch scanning.
   // Therefore, report error if multiple rules here
-  if (rules.size() > 1) {
-    die("require ddi content 'rules' has only 1 rule");
-  }
-  if (rules.empty()) {
-    return dep;
+  json.begin_array();
+  bool seen_rule = false;
+  while (json.next_element()) {
+    if (seen_rule) {
+      die("require ddi content 'rules' has only 1 rule");
+    }
+    seen_rule = true;
+    if (json.peek() != JsonScanner::kObject) {
+      die("require ddi content 'rules[0]' is JSON object");
+    }
+    json.begin_object();
+    std::string_view key;
+    while (json.next_member(&key)) {
+      if (key == "provides") {
+        parse_provides(json, dep);
+      } else if (key == "requires") {
+        parse_requires(json, dep);
+      } else {
+        json.skip_value();
+      }
+    }
   }
-  auto rule_data = rules[0];
-  if (!rule_data.is_object()) {
-    die("require ddi content 'rules[0]' is JSON object");
+}
+
+ModuleDep parse_ddi(std::istream &ddi_stream) {
+  ModuleDep dep{};
+  std::string ddi_string = read_all(ddi_stream);
+  try {
+    JsonScanner json(ddi_string);
+    if (json.peek() != JsonScanner::kObject) {
+      die("require ddi content is JSON object");
+    }
+    bool has_rules = false;
+    json.begin_object();
+    std::string_view key;
+    while (json.next_member(&key)) {
+      if (key == "rules") {
+        dep = ModuleDep{};
+        parse_rules(json, dep);
+        has_rules = true;
+      } else {
+        json.skip_value();
+      }
+    }
+    json.end();
+    if (!has_rules) {
+      die("require 'rules' in ddi content");
+    }
+  } catch (const std::runtime_error &e) {
+    die(e.what());
   }
-  auto rule = rule_data.as_object();
-  auto provides_data = rule["provides"];
-  auto requires_data = rule["requires"];
-  parse_provides(provides_data, dep);
-  parse_requires(requires_data, dep);
   return dep;
 }
 
-Cpp20ModulesInfo parse_info(std::istream &info_stream) {
-  std::string info_string((std::istreambuf_iterator<char>(info_stream)),
-                          std::istreambuf_iterator<char>());
-  JsonValue data = parse_json(info_string);
-  if (!data.is_object()) {
-    die("require content is JSON object");
-  }
-  auto data_obj = data.as_object();
-  if (data_obj.find("modules") == data_obj.end()) {
-    die("require 'modules' in JSON object");
-  }
-  auto modules_data = data_obj.at("modules");
-  if (!modules_data.is_object()) {
+void parse_modules(JsonScanner &json, Cpp20ModulesInfo &info) {
+  if (json.peek() != JsonScanner::kObject) {
     die("require 'modules' is JSON object");
   }
-  if (data_obj.find("usages") == data_obj.end()) {
-    die("require 'usages' in JSON object");
+  info.modules.clear();
+  json.begin_object();
+  std::string_view key;
+  while (json.next_member(&key)) {
+    std::string name(key);
+    if (json.peek() != JsonScanner::kString) {
+      die("require JSON string, but got " + std::string(json.raw_value()));
+    }
+    info.modules[name] = json.read_string();
   }
-  auto usages_data = data_obj.at("usages");
-  if (!usages_data.is_object()) {
+}
+
+void parse_usages(JsonScanner &json, Cpp20ModulesInfo &info) {
+  if (json.peek() != JsonScanner::kObject) {
     die("require 'usages' is JSON object");
   }
-  Cpp20ModulesInfo info;
-  for (const auto &item_data : modules_data.as_object()) {
-    auto name = item_data.first;
-    auto bmi_data = item_data.second;
-    if (!bmi_data.is_string()) {
-      die("require JSON string, but got " + bmi_data.dump());
+  info.usages.clear();
+  json.begin_object();
+  std::string_view key;
+  while (json.next_member(&key)) {
+    std::vector<std::string> &require_list = info.usages[std::string(key)];
+    require_list.clear();
+    if (json.peek() != JsonScanner::kArray) {
+      die("require JSON array");
+    }
+    json.begin_array();
+    while (json.next_element()) {
+      if (json.peek() != JsonScanner::kString) {
+        die("require JSON string, but got " + std::string(json.raw_value()));
+      }
+      require_list.push_back(json.read_string());
     }
-    info.modules[name] = bmi_data.as_string();
   }
-  for (const auto &item_data : usages_data.as_object()) {
-    auto name = item_data.first;
-    auto require_list_data = item_data.second;
-    if (!require_list_data.is_array()) {
-      die("require JSON array");
+}
+
+Cpp20ModulesInfo parse_info(std::istream &info_stream) {
+  std::string info_string = read_all(info_stream);
+  Cpp20ModulesInfo info;
+  try {
+    JsonScanner json(info_string);
+    if (json.peek() != JsonScanner::kObject) {
+      die("require content is JSON object");
     }
-    std::vector<std::string> require_list;
-    for (const auto &require_item_data : require_list_data.as_array()) {
-      if (!require_item_data.is_string()) {
-        die("require JSON string, but got " + require_item_data.dump());
+    bool has_modules = false;
+    bool has_usages = false;
+    json.begin_object();
+    std::string_view key;
+    while (json.next_member(&key)) {
+      if (key == "modules") {
+        parse_modules(json, info);
+        has_modules = true;
+      } else if (key == "usages") {
+        parse_usages(json, info);
+        has_usages = true;
+      } else {
+        json.skip_value();
       }
-      require_list.push_back(require_item_data.as_string());
     }
-    info.usages[name] = require_list;
+    json.end();
+    if (!has_modules) {
+      die("require 'modules' in JSON object");
+    }
+    if (!has_usages) {
+      die("require 'usages' in JSON object");
+    }
+  } catch (const std::runtime_error &e) {
+    die(e.what());
   }
   return info;
 }
-
@@ -0,0 +1,340 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_TOOLS_CPP_MODULE_TOOLS_COMMON_JSON_SCANNER_HPP_
+#define BAZEL_TOOLS_CPP_MODULE_TOOLS_COMMON_JSON_SCANNER_HPP_
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// A pull parser over a JSON document in memory, for reading a few fields
+// without building a JsonValue for the whole document. The caller walks the
+// document with begin_object()/next_member() and begin_array()/
+// next_element(), reads the strings it needs and skips everything else.
+// Malformed JSON throws std::runtime_error.
+//
+//   JsonScanner json(text);
+//   json.begin_object();
+//   std::string_view key;
+//   while (json.next_member(&key)) {
+//     if (key == "name") {
+//       name = json.read_string();
+//     } else {
+//       json.skip_value();
+//     }
+//   }
+//   json.end();
+class JsonScanner {
+ public:
+  // The kinds of values, as returned by peek().
+  enum Kind { kObject, kArray, kString, kNumber, kTrue, kFalse, kNull };
+
+  explicit JsonScanner(std::string_view text) : s_(text), i_(0) {}
+
+  // Returns the kind of the next value without consuming it.
+  Kind peek() {
+    switch (next()) {
+      case '{':
+        return kObject;
+      case '[':
+        return kArray;
+      case '"':
+        return kString;
+      case 't':
+        return kTrue;
+      case 'f':
+        return kFalse;
+      case 'n':
+        return kNull;
+      default:
+        if (s_[i_] == '-' || (s_[i_] >= '0' && s_[i_] <= '9')) {
+          return kNumber;
+        }
+        fail("Unexpected character");
+    }
+  }
+
+  // Consumes the '{' of an object.
+  void begin_object() {
+    expect('{');
+    first_ = true;
+  }
+
+  // Moves to the next member of the current object and sets `key` to its
+  // name, which is valid until the scanner is used again. Returns false and
+  // consumes the '}' at the end of the object.
+  bool next_member(std::string_view *key) {
+    if (!next_item('}')) {
+      return false;
+    }
+    if (next() != '"') {
+      fail("Expected a string");
+    }
+    *key = scan_string(&key_);
+    if (next() != ':') {
+      fail("Expected ':'");
+    }
+    ++i_;
+    return true;
+  }
+
+  // Consumes the '[' of an array.
+  void begin_array() {
+    expect('[');
+    first_ = true;
+  }
+
+  // Moves to the next element of the current array. Returns false and
+  // consumes the ']' at the end of the array.
+  bool next_element() { return next_item(']'); }
+
+  // Consumes a string and returns its value.
+  std::string read_string() {
+    if (next() != '"') {
+      fail("Expected a string");
+    }
+    std::string value;
+    std::string_view result = scan_string(&value);
+    return result.data() == value.data() ? value : std::string(result);
+  }
+
+  // Consumes an integer and returns its value.
+  long long read_integer() {
+    if (peek() != kNumber) {
+      fail("Expected a number");
+    }
+    size_t start = i_;
+    bool negative = s_[i_] == '-';
+    if (negative) {
+      ++i_;
+    }
+    long long value = 0;
+    size_t digits = 0;
+    for (; i_ < s_.size() && s_[i_] >= '0' && s_[i_] <= '9'; ++i_, ++digits) {
+      if (digits == 18) {
+        i_ = start;
+        fail("Integer out of range");
+      }
+      value = value * 10 + (s_[i_] - '0');
+    }
+    if (digits == 0 || (i_ < s_.size() && (s_[i_] == '.' || s_[i_] == 'e' ||
+                                           s_[i_] == 'E'))) {
+      i_ = start;
+      fail("Expected an integer");
+    }
+    return negative ? -value : value;
+  }
+
+  // Consumes a null.
+  void read_null() { expect_literal("null"); }
+
+  // Consumes the next value, whatever it is.
+  void skip_value() { skip_value(0); }
+
+  // Consumes the next value and returns its JSON text, for error messages.
+  std::string_view raw_value() {
+    next();
+    size_t start = i_;
+    skip_value(0);
+    return s_.substr(start, i_ - start);
+  }
+
+  // Checks that nothing but white space follows.
+  void end() {
+    if (skip_space()) {
+      fail("Unexpected character after value");
+    }
+  }
+
+ private:
+  static constexpr int kMaxDepth = 1000;
+
+  [[noreturn]] void fail(const char *reason) const {
+    throw std::runtime_error(std::string("Invalid JSON string: ") + reason +
+                             " at offset " + std::to_string(i_));
+  }
+
+  bool skip_space() {
+    while (i_ < s_.size() && (s_[i_] == ' ' || s_[i_] == '\t' ||
+                              s_[i_] == '\n' || s_[i_] == '\r')) {
+      ++i_;
+    }
+    return i_ < s_.size();
+  }
+
+  char next() {
+    if (!skip_space()) {
+      fail("Unexpected end of input");
+    }
+    return s_[i_];
+  }
+
+  void expect(char c) {
+    if (next() != c) {
+      fail("Unexpected character");
+    }
+    ++i_;
+  }
+
+  void expect_literal(std::string_view literal) {
+    if (s_.substr(i_, literal.size()) != literal) {
+      fail("Unexpected character");
+    }
+    i_ += literal.size();
+  }
+
+  // Consumes the ',' before an item or the closing bracket.
+  bool next_item(char close) {
+    char c = next();
+    if (c == close) {
+      ++i_;
+      first_ = false;
+      return false;
+    }
+    if (!first_) {
+      if (c != ',') {
+        fail(close == '}' ? "Expected ',' or '}'" : "Expected ',' or ']'");
+      }
+      ++i_;
+    }
+    first_ = false;
+    return true;
+  }
+
+  // Consumes a string at the current position. Returns a view into the
+  // text if it has no escapes, otherwise unescapes it into `scratch`.
+  std::string_view scan_string(std::string *scratch) {
+    size_t start = ++i_;
+    size_t end = s_.find_first_of("\"\\", start);
+    if (end == std::string_view::npos) {
+      fail("Unclosed string literal");
+    }
+    if (s_[end] == '"') {
+      i_ = end + 1;
+      return s_.substr(start, end - start);
+    }
+    scratch->assign(s_.data() + start, end - start);
+    i_ = end;
+    while (i_ < s_.size()) {
+      char c = s_[i_++];
+      if (c == '"') {
+        return *scratch;
+      }
+      if (c != '\\') {
+        scratch->push_back(c);
+        continue;
+      }
+      if (i_ >= s_.size()) {
+        break;
+      }
+      c = s_[i_++];
+      switch (c) {
+        case 'b':
+          scratch->push_back('\b');
+          break;
+        case 'f':
+          scratch->push_back('\f');
+          break;
+        case 'n':
+          scratch->push_back('\n');
+          break;
+        case 'r':
+          scratch->push_back('\r');
+          break;
+        case 't':
+          scratch->push_back('\t');
+          break;
+        case 'u': {
+          // Same as JsonValue: only the low byte of \uXXXX is kept.
+          if (s_.size() - i_ < 4) {
+            fail("Unclosed string literal");
+          }
+          unsigned value = 0;
+          for (int k = 0; k < 4; ++k) {
+            char h = s_[i_++];
+            value <<= 4;
+            if (h >= '0' && h <= '9') {
+              value |= h - '0';
+            } else if (h >= 'a' && h <= 'f') {
+              value |= h - 'a' + 10;
+            } else if (h >= 'A' && h <= 'F') {
+              value |= h - 'A' + 10;
+            } else {
+              fail("Invalid \\u escape");
+            }
+          }
+          scratch->push_back(static_cast<char>(value));
+          break;
+        }
+        default:
+          scratch->push_back(c);
+      }
+    }
+    fail("Unclosed string literal");
+  }
+
+  void skip_value(int depth) {
+    if (depth > kMaxDepth) {
+      fail("nesting depth limit exceeded");
+    }
+    switch (peek()) {
+      case kObject: {
+        begin_object();
+        std::string_view key;
+        while (next_member(&key)) {
+          skip_value(depth + 1);
+        }
+        break;
+      }
+      case kArray:
+        begin_array();
+        while (next_element()) {
+          skip_value(depth + 1);
+        }
+        break;
+      case kString:
+        scan_string(&key_);
+        break;
+      case kNumber:
+        ++i_;
+        while (i_ < s_.size() &&
+               ((s_[i_] >= '0' && s_[i_] <= '9') || s_[i_] == '-' ||
+                s_[i_] == '+' || s_[i_] == '.' || s_[i_] == 'e' ||
+                s_[i_] == 'E')) {
+          ++i_;
+        }
+        break;
+      case kTrue:
+        expect_literal("true");
+        break;
+      case kFalse:
+        expect_literal("false");
+        break;
+      case kNull:
+        expect_literal("null");
+        break;
+    }
+  }
+
+  std::string_view s_;
+  size_t i_;
+  // Whether the current object or array has no items yet.
+  bool first_ = false;
+  // Holds member names and skipped strings that have escapes.
+  std::string key_;
+};
+
+#endif  // BAZEL_TOOLS_CPP_MODULE_TOOLS_COMMON_JSON_SCANNER_HPP_
@@ -0,0 +1,110 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tools/cpp/modules_tools/common/json_scanner.hpp"
+
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+TEST(JsonScannerTest, ReadsSelectedMembers) {
+  JsonScanner json(R"( {
+    "skipped": {"a": [1, -2.5e3, true, false, null, {"b": "c\"d"}]},
+    "names": ["x", "y\n\u0041", ""],
+    "name": "z"
+  } )");
+  std::vector<std::string> names;
+  std::string name;
+  json.begin_object();
+  std::string_view key;
+  while (json.next_member(&key)) {
+    if (key == "names") {
+      ASSERT_EQ(json.peek(), JsonScanner::kArray);
+      json.begin_array();
+      while (json.next_element()) {
+        names.push_back(json.read_string());
+      }
+    } else if (key == "name") {
+      name = json.read_string();
+    } else {
+      ASSERT_EQ(key, "skipped");
+      ASSERT_EQ(json.peek(), JsonScanner::kObject);
+      json.skip_value();
+    }
+  }
+  json.end();
+  EXPECT_EQ(names, (std::vector<std::string>{"x", "y\nA", ""}));
+  EXPECT_EQ(name, "z");
+}
+
+TEST(JsonScannerTest, EmptyContainers) {
+  JsonScanner json("{\"a\": [], \"b\": {}}");
+  json.begin_object();
+  std::string_view key;
+  ASSERT_TRUE(json.next_member(&key));
+  EXPECT_EQ(key, "a");
+  json.begin_array();
+  EXPECT_FALSE(json.next_element());
+  ASSERT_TRUE(json.next_member(&key));
+  EXPECT_EQ(key, "b");
+  json.begin_object();
+  EXPECT_FALSE(json.next_member(&key));
+  EXPECT_FALSE(json.next_member(&key));
+  json.end();
+}
+
+TEST(JsonScannerTest, RawValue) {
+  JsonScanner json("[ {\"a\" : 1} , 2]");
+  json.begin_array();
+  ASSERT_TRUE(json.next_element());
+  EXPECT_EQ(json.raw_value(), "{\"a\" : 1}");
+  ASSERT_TRUE(json.next_element());
+  EXPECT_EQ(json.raw_value(), "2");
+  EXPECT_FALSE(json.next_element());
+}
+
+TEST(JsonScannerTest, ReadsIntegers) {
+  JsonScanner json("[0, 42, -7, 1.5, 1e3, \"1\", 12345678901234567890]");
+  json.begin_array();
+  ASSERT_TRUE(json.next_element());
+  EXPECT_EQ(json.read_integer(), 0);
+  ASSERT_TRUE(json.next_element());
+  EXPECT_EQ(json.read_integer(), 42);
+  ASSERT_TRUE(json.next_element());
+  EXPECT_EQ(json.read_integer(), -7);
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(json.next_element());
+    EXPECT_THROW(json.read_integer(), std::runtime_error);
+    json.skip_value();
+  }
+  EXPECT_FALSE(json.next_element());
+}
+
+TEST(JsonScannerTest, RejectsMalformedJson) {
+  for (const char *text :
+       {"", "{", "[1 2]", "{\"a\" 1}", "{\"a\": 1,}", "\"abc", "[1]]",
+        "[nul]", "{1: 2}", "[\"\\u12\"]"}) {
+    JsonScanner json(text);
+    EXPECT_THROW(
+        {
+          json.skip_value();
+          json.end();
+        },
+        std::runtime_error)
+        << text;
+  }
+}
@@ -0,0 +1,251 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tools/cpp/modules_tools/common/worker.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "json.hpp"
+#include "json_scanner.hpp"
+
+namespace {
+
+[[noreturn]] void fail(const std::string &msg) {
+  std::cerr << msg << std::endl;
+  std::exit(1);
+}
+
+// Reads the text of the next JSON object. Bazel may spread a request over
+// several lines, so the end of the object is found by counting brackets.
+bool read_object(std::istream &in, std::string *text) {
+  text->clear();
+  int c;
+  while ((c = in.get()) == ' ' || c == '\t' || c == '\n' || c == '\r') {
+  }
+  if (c == EOF) {
+    return false;
+  }
+  if (c != '{') {
+    fail("ERROR: Invalid work request");
+  }
+  text->push_back('{');
+  int depth = 1;
+  bool in_string = false;
+  while (depth > 0 && (c = in.get()) != EOF) {
+    text->push_back(static_cast<char>(c));
+    if (in_string) {
+      if (c == '\\') {
+        if ((c = in.get()) == EOF) {
+          break;
+        }
+        text->push_back(static_cast<char>(c));
+      } else if (c == '"') {
+        in_string = false;
+      }
+    } else if (c == '"') {
+      in_string = true;
+    } else if (c == '{' || c == '[') {
+      ++depth;
+    } else if (c == '}' || c == ']') {
+      --depth;
+    }
+  }
+  if (depth > 0) {
+    fail("ERROR: Truncated work request");
+  }
+  return true;
+}
+
+std::vector<std::string> read_strings(JsonScanner &json) {
+  std::vector<std::string> strings;
+  json.begin_array();
+  while (json.next_element()) {
+    strings.push_back(json.read_string());
+  }
+  return strings;
+}
+
+std::vector<WorkInput> read_inputs(JsonScanner &json) {
+  std::vector<WorkInput> inputs;
+  json.begin_array();
+  while (json.next_element()) {
+    WorkInput input;
+    json.begin_object();
+    std::string_view key;
+    while (json.next_member(&key)) {
+      if (key == "path") {
+        input.path = json.read_string();
+      } else if (key == "digest") {
+        input.digest = json.read_string();
+      } else {
+        json.skip_value();
+      }
+    }
+    inputs.push_back(std::move(input));
+  }
+  return inputs;
+}
+
+size_t estimate_bytes(const std::vector<std::string> &strings) {
+  size_t bytes = sizeof(strings);
+  for (const auto &s : strings) {
+    bytes += sizeof(s) + s.size();
+  }
+  return bytes;
+}
+
+// How much of the parsed inputs a worker holds on to.
+constexpr size_t kWorkerCacheBytes = 256 << 20;
+
+std::ifstream open_file(const std::string &path) {
+  std::ifstream stream(path);
+  if (!stream.is_open()) {
+    fail("ERROR: Failed to open the file " + path);
+  }
+  return stream;
+}
+
+}  // namespace
+
+bool read_work_request(std::istream &in, WorkRequest *request) {
+  std::string text;
+  if (!read_object(in, &text)) {
+    return false;
+  }
+  *request = WorkRequest();
+  try {
+    JsonScanner json(text);
+    json.begin_object();
+    std::string_view key;
+    while (json.next_member(&key)) {
+      if (key == "arguments") {
+        request->arguments = read_strings(json);
+      } else if (key == "inputs") {
+        request->inputs = read_inputs(json);
+      } else if (key == "requestId") {
+        request->request_id = static_cast<long>(json.read_integer());
+      } else {
+        json.skip_value();
+      }
+    }
+    json.end();
+  } catch (const std::runtime_error &e) {
+    fail(std::string("ERROR: Invalid work request: ") + e.what());
+  }
+  return true;
+}
+
+void write_work_response(std::ostream &out, int exit_code,
+                         const std::string &output, long request_id) {
+  out << "{\"exitCode\":" << exit_code
+      << ",\"output\":" << to_json(JsonValue(output))
+      << ",\"requestId\":" << request_id << "}\n";
+  out.flush();
+}
+
+void ParsedInputCache::start_request(const WorkRequest &request) {
+  digests_.clear();
+  for (const auto &input : request.inputs) {
+    if (!input.digest.empty()) {
+      digests_[input.path] = input.digest;
+    }
+  }
+}
+
+ParsedInputCache::Entry *ParsedInputCache::find(char kind,
+                                                const std::string &path,
+                                                std::string *key) {
+  key->clear();
+  auto digest = digests_.find(path);
+  if (digest == digests_.end() || max_bytes_ == 0) {
+    return nullptr;
+  }
+  *key = kind + path + '\0' + digest->second;
+  auto it = index_.find(*key);
+  if (it == index_.end()) {
+    return nullptr;
+  }
+  entries_.splice(entries_.begin(), entries_, it->second);
+  return &entries_.front();
+}
+
+void ParsedInputCache::insert(Entry entry) {
+  if (entry.key.empty() || entry.bytes > max_bytes_) {
+    return;
+  }
+  bytes_ += entry.bytes;
+  entries_.push_front(std::move(entry));
+  index_[entries_.front().key] = entries_.begin();
+  while (bytes_ > max_bytes_) {
+    bytes_ -= entries_.back().bytes;
+    index_.erase(entries_.back().key);
+    entries_.pop_back();
+  }
+}
+
+std::shared_ptr<const ModuleDep> ParsedInputCache::ddi(
+    const std::string &path) {
+  std::string key;
+  Entry *entry = find('d', path, &key);
+  if (entry != nullptr) {
+    return entry->ddi;
+  }
+  std::ifstream stream = open_file(path);
+  auto dep = std::make_shared<const ModuleDep>(parse_ddi(stream));
+  insert(Entry{key,
+               sizeof(ModuleDep) + dep->name.size() +
+                   estimate_bytes(dep->require_list),
+               dep, nullptr});
+  return dep;
+}
+
+std::shared_ptr<const Cpp20ModulesInfo> ParsedInputCache::info(
+    const std::string &path) {
+  std::string key;
+  Entry *entry = find('i', path, &key);
+  if (entry != nullptr) {
+    return entry->info;
+  }
+  std::ifstream stream = open_file(path);
+  auto info = std::make_shared<const Cpp20ModulesInfo>(parse_info(stream));
+  size_t bytes = sizeof(Cpp20ModulesInfo);
+  for (const auto &item : info->modules) {
+    bytes += 2 * sizeof(std::string) + item.first.size() + item.second.size();
+  }
+  for (const auto &item : info->usages) {
+    bytes += sizeof(std::string) + item.first.size() +
+             estimate_bytes(item.second);
+  }
+  insert(Entry{key, bytes, nullptr, info});
+  return info;
+}
+
+int run_persistent_worker(const WorkerTool &tool) {
+  ParsedInputCache cache(kWorkerCacheBytes);
+  WorkRequest request;
+  while (read_work_request(std::cin, &request)) {
+    cache.start_request(request);
+    std::ostringstream err;
+    int exit_code = tool(request.arguments, cache, err);
+    write_work_response(std::cout, exit_code, err.str(), request.request_id);
+  }
+  return 0;
+}
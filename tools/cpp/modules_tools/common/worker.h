@@ -0,0 +1,105 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_TOOLS_CPP_MODULE_TOOLS_COMMON_WORKER_H_
+#define BAZEL_TOOLS_CPP_MODULE_TOOLS_COMMON_WORKER_H_
+
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "common.h"
+
+// Bazel's persistent worker protocol in its JSON form, which needs no
+// protobuf dependency: one WorkRequest object per request on stdin and one
+// WorkResponse object per line on stdout.
+
+struct WorkInput {
+  std::string path;
+  std::string digest;
+};
+
+struct WorkRequest {
+  std::vector<std::string> arguments;
+  std::vector<WorkInput> inputs;
+  long request_id = 0;
+};
+
+// Reads the next request. Returns false at the end of the input, and dies
+// if the request is malformed.
+bool read_work_request(std::istream &in, WorkRequest *request);
+
+void write_work_response(std::ostream &out, int exit_code,
+                         const std::string &output, long request_id);
+
+// Parses the DDI and info files of a tool, and holds on to the results in a
+// persistent worker so that the inputs that are used again by later
+// requests are not parsed again.
+//
+// A file is only reused if it has the same digest as when it was parsed,
+// and Bazel sends the digests of the inputs with each request. A file
+// without a digest, e.g. outside of a worker, is always parsed. The least
+// recently used results are dropped once they take up more than `max_bytes`.
+class ParsedInputCache {
+ public:
+  explicit ParsedInputCache(size_t max_bytes = 0) : max_bytes_(max_bytes) {}
+
+  // Takes the digests of the inputs of the request.
+  void start_request(const WorkRequest &request);
+
+  // Returns the parsed file, and dies if it cannot be read.
+  std::shared_ptr<const ModuleDep> ddi(const std::string &path);
+  std::shared_ptr<const Cpp20ModulesInfo> info(const std::string &path);
+
+  size_t size() const { return entries_.size(); }
+
+ private:
+  struct Entry {
+    std::string key;
+    size_t bytes;
+    std::shared_ptr<const ModuleDep> ddi;
+    std::shared_ptr<const Cpp20ModulesInfo> info;
+  };
+
+  // Returns the entry of the path with its current digest, or nullptr, and
+  // sets `key` to its key if there is a digest. `kind` tells DDI and info
+  // files apart.
+  Entry *find(char kind, const std::string &path, std::string *key);
+  void insert(Entry entry);
+
+  size_t max_bytes_;
+  size_t bytes_ = 0;
+  std::unordered_map<std::string, std::string> digests_;
+  // Most recently used first.
+  std::list<Entry> entries_;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+};
+
+// Runs a tool with the arguments of a request, writing its messages to
+// `err`, and returns its exit code.
+using WorkerTool = std::function<int(const std::vector<std::string> &args,
+                                     ParsedInputCache &cache,
+                                     std::ostream &err)>;
+
+// Serves the requests on stdin until it is closed, reusing the parsed
+// inputs across requests.
+int run_persistent_worker(const WorkerTool &tool);
+
+#endif  // BAZEL_TOOLS_CPP_MODULE_TOOLS_COMMON_WORKER_H_
@@ -0,0 +1,136 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tools/cpp/modules_tools/common/worker.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace {
+
+std::string temp_path(const std::string &name) {
+  return std::string(std::getenv("TEST_TMPDIR")) + "/" + name;
+}
+
+void write_file(const std::string &path, const std::string &content) {
+  std::ofstream out(path, std::ios::trunc);
+  out << content;
+}
+
+std::string ddi_content(const std::string &name) {
+  return R"({"revision": 0, "version": 1, "rules": [{
+    "primary-output": "a.o",
+    "provides": [{"logical-name": ")" +
+         name + R"("}]}]})";
+}
+
+WorkRequest request_with(const std::string &path, const std::string &digest) {
+  WorkRequest request;
+  request.inputs.push_back(WorkInput{path, digest});
+  return request;
+}
+
+}  // namespace
+
+TEST(WorkerTest, ReadsRequests) {
+  std::istringstream in(R"({
+  "arguments": ["-o", "out\"put"],
+  "inputs": [{"path": "a.ddi", "digest": "abc"}, {"path": "b.ddi"}],
+  "requestId": 12,
+  "verbosity": 0
+}
+{"arguments": [], "requestId": 0}
+)");
+  WorkRequest request;
+  ASSERT_TRUE(read_work_request(in, &request));
+  EXPECT_EQ(request.arguments,
+            std::vector<std::string>({"-o", "out\"put"}));
+  ASSERT_EQ(request.inputs.size(), 2u);
+  EXPECT_EQ(request.inputs[0].path, "a.ddi");
+  EXPECT_EQ(request.inputs[0].digest, "abc");
+  EXPECT_EQ(request.inputs[1].path, "b.ddi");
+  EXPECT_EQ(request.inputs[1].digest, "");
+  EXPECT_EQ(request.request_id, 12);
+  ASSERT_TRUE(read_work_request(in, &request));
+  EXPECT_TRUE(request.arguments.empty());
+  EXPECT_TRUE(request.inputs.empty());
+  EXPECT_EQ(request.request_id, 0);
+  EXPECT_FALSE(read_work_request(in, &request));
+}
+
+TEST(WorkerTest, WritesResponses) {
+  std::ostringstream out;
+  write_work_response(out, 1, "ERROR: \"x\"\n", 7);
+  EXPECT_EQ(out.str(),
+            "{\"exitCode\":1,\"output\":\"ERROR: \\\"x\\\"\\n\","
+            "\"requestId\":7}\n");
+}
+
+TEST(WorkerTest, ReusesInputsWithTheSameDigest) {
+  std::string path = temp_path("foo.ddi");
+  write_file(path, ddi_content("foo"));
+  ParsedInputCache cache(1 << 20);
+  cache.start_request(request_with(path, "1"));
+  EXPECT_EQ(cache.ddi(path)->name, "foo");
+
+  // The digest says that the file hasn't changed, so it isn't read again.
+  write_file(path, ddi_content("bar"));
+  cache.start_request(request_with(path, "1"));
+  EXPECT_EQ(cache.ddi(path)->name, "foo");
+  EXPECT_EQ(cache.size(), 1u);
+
+  cache.start_request(request_with(path, "2"));
+  EXPECT_EQ(cache.ddi(path)->name, "bar");
+
+  // Without a digest, the file is always parsed.
+  write_file(path, ddi_content("baz"));
+  cache.start_request(WorkRequest());
+  EXPECT_EQ(cache.ddi(path)->name, "baz");
+  EXPECT_EQ(cache.size(), 2u);
+}
+
+TEST(WorkerTest, DropsLeastRecentlyUsedInputs) {
+  std::string foo = temp_path("foo.ddi");
+  std::string bar = temp_path("bar.ddi");
+  write_file(foo, ddi_content("foo"));
+  write_file(bar, ddi_content("bar"));
+  WorkRequest request = request_with(foo, "1");
+  request.inputs.push_back(WorkInput{bar, "2"});
+  // Room for about one parsed file.
+  ParsedInputCache cache(sizeof(ModuleDep) + 100);
+  cache.start_request(request);
+  cache.ddi(foo);
+  cache.ddi(bar);
+  EXPECT_EQ(cache.size(), 1u);
+
+  write_file(foo, ddi_content("changed"));
+  write_file(bar, ddi_content("changed"));
+  EXPECT_EQ(cache.ddi(bar)->name, "bar");
+  EXPECT_EQ(cache.ddi(foo)->name, "changed");
+}
+
+TEST(WorkerTest, ParsesInfoFiles) {
+  std::string path = temp_path("foo.CXXModules.json");
+  write_file(path,
+             R"({"modules": {"foo": "foo.pcm"}, "usages": {"foo": []}})");
+  ParsedInputCache cache(1 << 20);
+  cache.start_request(request_with(path, "1"));
+  auto info = cache.info(path);
+  EXPECT_EQ(info->modules.at("foo"), "foo.pcm");
+  EXPECT_EQ(cache.info(path), info);
+}
@@ -13,57 +13,52 @@
 // limitations under the License.
 
 #include <fstream>
+#include <string>
+#include <vector>
 
+#include "tools/cpp/modules_tools/common/worker.h"
 #include "tools/cpp/modules_tools/generate-modmap/generate-modmap.h"
 
-int main(int argc, char *argv[]) {
-  if (argc != 5) {
-    std::cerr << "Usage: generate-modmap <ddi-file> <cpp20modules-info-file> "
-                 "<output> <compiler>"
-              << std::endl;
-    std::exit(1);
+int run(const std::vector<std::string> &args, ParsedInputCache &cache,
+        std::ostream &err) {
+  if (args.size() != 4) {
+    err << "Usage: generate-modmap <ddi-file> <cpp20modules-info-file> "
+           "<output> <compiler>"
+        << std::endl;
+    return 1;
   }
 
   // Retrieve the values of the flags
-  std::string ddi_filename = argv[1];
-  std::string info_filename = argv[2];
-  std::string output = argv[3];
-  std::string compiler = argv[4];
+  const std::string &ddi_filename = args[0];
+  const std::string &info_filename = args[1];
+  const std::string &output = args[2];
+  const std::string &compiler = args[3];
 
-  std::ifstream info_stream(info_filename);
-  if (!info_stream.is_open()) {
-    std::cerr << "ERROR: Failed to open the file " << info_filename
-              << std::endl;
-    std::exit(1);
-  }
-  std::ifstream ddi_stream(ddi_filename);
-  if (!ddi_stream.is_open()) {
-    std::cerr << "ERROR: Failed to open the file " << ddi_filename << std::endl;
-    std::exit(1);
-  }
-  auto dep = parse_ddi(ddi_stream);
-  auto info = parse_info(info_stream);
-  auto modmap = process(dep, info);
+  auto info = cache.info(info_filename);
+  auto dep = cache.ddi(ddi_filename);
+  auto modmap = process(*dep, *info);
 
   std::string modmap_filename = output;
   std::string modmap_dot_input_filename = modmap_filename + ".input";
   std::ofstream modmap_file_stream(modmap_filename);
   std::ofstream modmap_file_dot_input_stream(modmap_dot_input_filename);
   if (!modmap_file_stream.is_open()) {
-    std::cerr << "ERROR: Failed to open the file " << modmap_filename
-              << std::endl;
-    std::exit(1);
+    err << "ERROR: Failed to open the file " << modmap_filename << std::endl;
+    return 1;
   }
   if (!modmap_file_dot_input_stream.is_open()) {
-    std::cerr << "ERROR: Failed to open the file " << modmap_dot_input_filename
-              << std::endl;
-    std::exit(1);
+    err << "ERROR: Failed to open the file " << modmap_dot_input_filename
+        << std::endl;
+    return 1;
   }
   std::optional<ModmapItem> generated;
-  if (dep.gen_bmi) {
+  if (dep->gen_bmi) {
     ModmapItem item;
-    item.name = dep.name;
-    item.path = info.modules[dep.name];
+    item.name = dep->name;
+    auto it = info->modules.find(dep->name);
+    if (it != info->modules.end()) {
+      item.path = it->second;
+    }
     generated = item;
   }
   write_modmap(modmap_file_stream, modmap_file_dot_input_stream, modmap,
@@ -73,3 +68,12 @@ int main(int argc, char *argv[]) {
 
   return 0;
 }
+
+int main(int argc, char *argv[]) {
+  if (argc == 2 && std::string(argv[1]) == "--persistent_worker") {
+    return run_persistent_worker(run);
+  }
+  ParsedInputCache cache;
+  return run(std::vector<std::string>(argv + 1, argv + argc), cache,
+             std::cerr);
+}
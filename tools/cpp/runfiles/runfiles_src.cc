@@ -19,31 +19,33 @@
 #ifdef _WIN32
 #include <windows.h>
 #else  // not _WIN32
+#include <fcntl.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #endif  // _WIN32
 
+#include <stdint.h>
+#include <string.h>
+
 #include <algorithm>
+#include <cerrno>
 #include <fstream>
 #include <functional>
-#include <map>
+#include <memory>
 #include <sstream>
 #include <vector>
 
-#ifdef _WIN32
-#include <memory>
-#endif  // _WIN32
-
 namespace bazel {
 namespace tools {
 namespace cpp {
 namespace runfiles {
 
 using std::function;
-using std::map;
 using std::pair;
+using std::shared_ptr;
 using std::string;
 using std::vector;
 
@@ -104,13 +106,149 @@ bool PathsFrom(const std::string& argv0, std::string runfiles_manifest_file,
                std::function<bool(const std::string&)> is_runfiles_directory,
                std::string* out_manifest, std::string* out_directory);
 
-bool ParseManifest(const string& path, map<string, string>* result,
-                   string* error);
-bool ParseRepoMapping(const string& path,
-                      map<pair<string, string>, string>* result, string* error);
+// The 32-bit FNV-1a hash of `key[0, key_size)`, which picks the first slot of
+// an entry in MANIFEST.index.
+uint32_t IndexHash(const char* key, size_t key_size) {
+  uint32_t hash = 2166136261U;
+  for (size_t i = 0; i < key_size; ++i) {
+    hash = (hash ^ static_cast<unsigned char>(key[i])) * 16777619U;
+  }
+  return hash;
+}
 
 }  // namespace
 
+string GetEnv(const string& key);
+
+// Manifests of large test binaries have hundreds of thousands of lines, so
+// instead of a node and two strings per entry, the manifest is read into one
+// buffer and indexed by a sorted array of the entries' offsets into it.
+// Looking up a path, or a prefix of it, is a binary search that doesn't
+// allocate.
+//
+// If build-runfiles wrote a MANIFEST.index for the manifest (see its --index
+// flag), that is mapped into memory and used in place instead, so that
+// creating the Runfiles object doesn't take longer the more runfiles there
+// are.
+//
+// Otherwise, with RUNFILES_SHARE_MANIFEST_INDEX=1 in the environment, the
+// index is written for the manifest once it has been parsed, on Linux into a
+// sealed memfd that child processes inherit, and RUNFILES_MANIFEST_INDEX in
+// EnvVars() names it: children (and theirs) that create a Runfiles object map
+// that index rather than parsing the manifest again.
+class Runfiles::Manifest {
+ public:
+  // Parses the manifest at `path`, or maps `shared_index` or the
+  // MANIFEST.index next to it if there is one for the manifest as it is.
+  // `share` makes a shared index of the parsed manifest.
+  static bool Parse(const string& path, const string& shared_index, bool share,
+                    shared_ptr<const Manifest>* result, string* error);
+
+  ~Manifest();
+
+  // Returns the target of the runfiles path `key[0, key_size)`, or nullptr if
+  // the manifest doesn't list it.
+  const char* Find(const char* key, size_t key_size,
+                   size_t* target_size) const;
+
+  // The path that child processes can map the index of this manifest from,
+  // or the empty string if there is none.
+  const string& SharedIndex() const { return shared_index_; }
+
+ private:
+  struct Entry {
+    size_t source;
+    size_t source_size;
+    size_t target;
+    size_t target_size;
+  };
+
+  // The layout of MANIFEST.index. Keep it in sync with
+  // src/main/tools/build-runfiles.cc, which describes it.
+  struct IndexHeader {
+    char magic[8];
+    uint32_t entry_count;
+    uint32_t bucket_count;
+    uint64_t strings_size;
+    uint64_t manifest_size;
+    int64_t manifest_mtime_sec;
+    int64_t manifest_mtime_nsec;
+  };
+  struct IndexEntry {
+    uint32_t link;
+    uint32_t link_size;
+    uint32_t target;
+    uint32_t target_size;
+  };
+
+  Manifest() : index_(nullptr), index_size_(0), shared_fd_(-1) {}
+
+  // Maps the index at `index_path` of the manifest at `path`, if there is one
+  // and it was written for the manifest as it is.
+  bool MapIndex(const string& path, const string& index_path);
+
+  // Writes the index of the parsed manifest at `path` into a sealed memfd,
+  // which stays open for as long as this object lives, and sets
+  // `shared_index_` to its path. Does nothing where there is no memfd.
+  void ShareIndex(const string& path);
+
+  const char* FindInIndex(const char* key, size_t key_size,
+                          size_t* target_size) const;
+
+  // Orders like comparing the strings would.
+  int Compare(const Entry& entry, const char* key, size_t key_size) const {
+    int result = memcmp(data_.data() + entry.source, key,
+                        std::min(entry.source_size, key_size));
+    if (result != 0) {
+      return result;
+    }
+    return entry.source_size < key_size   ? -1
+           : entry.source_size > key_size ? 1
+                                          : 0;
+  }
+
+  string data_;
+  vector<Entry> entries_;
+  const char* index_;
+  size_t index_size_;
+  int shared_fd_;
+  string shared_index_;
+};
+
+class Runfiles::RepoMapping {
+ public:
+  // Parses the "_repo_mapping" file at `path`. A missing file is an empty
+  // mapping.
+  static bool Parse(const string& path, shared_ptr<const RepoMapping>* result,
+                    string* error);
+
+  // Returns the canonical name of the repository that `source` sees as
+  // `apparent[0, apparent_size)`, or nullptr if it isn't mapped.
+  const string* Find(const string& source, const char* apparent,
+                     size_t apparent_size) const;
+
+ private:
+  struct Entry {
+    string source;
+    string target_apparent;
+    string target;
+  };
+
+  RepoMapping() {}
+
+  static int Compare(const Entry& entry, const string& source,
+                     const char* apparent, size_t apparent_size) {
+    int result = entry.source.compare(source);
+    if (result != 0) {
+      return result;
+    }
+    return entry.target_apparent.compare(0, string::npos, apparent,
+                                         apparent_size);
+  }
+
+  vector<Entry> entries_;
+};
+
 Runfiles* Runfiles::Create(const string& argv0,
                            const string& runfiles_manifest_file,
                            const string& runfiles_dir,
@@ -134,17 +272,22 @@ Runfiles* Runfiles::Create(const string& argv0,
       // pick up RUNFILES_DIR.
       {"JAVA_RUNFILES", directory}};
 
-  map<string, string> runfiles;
+  shared_ptr<const Manifest> runfiles;
   if (!manifest.empty()) {
-    if (!ParseManifest(manifest, &runfiles, error)) {
+    if (!Manifest::Parse(manifest, GetEnv("RUNFILES_MANIFEST_INDEX"),
+                         GetEnv("RUNFILES_SHARE_MANIFEST_INDEX") == "1",
+                         &runfiles, error)) {
       return nullptr;
     }
+    if (!runfiles->SharedIndex().empty()) {
+      envvars.emplace_back("RUNFILES_MANIFEST_INDEX", runfiles->SharedIndex());
+    }
   }
 
-  map<pair<string, string>, string> mapping;
-  if (!ParseRepoMapping(
-          RlocationUnchecked("_repo_mapping", runfiles, directory), &mapping,
-          error)) {
+  string repo_mapping_path("_repo_mapping");
+  RlocationUnchecked(runfiles.get(), directory, &repo_mapping_path);
+  shared_ptr<const RepoMapping> mapping;
+  if (!RepoMapping::Parse(repo_mapping_path, &mapping, error)) {
     return nullptr;
   }
 
@@ -179,101 +322,130 @@ string GetEnv(const string& key) {
 #endif
 }
 
-// Replaces \s, \n, and \b with their respective characters.
-string Unescape(const string& path) {
-  string result;
-  result.reserve(path.size());
-  for (size_t i = 0; i < path.size(); ++i) {
-    if (path[i] == '\\' && i + 1 < path.size()) {
+// Replaces \s, \n, and \b in `path[0, size)` with their respective
+// characters, in place. Returns the new size.
+size_t Unescape(char* path, size_t size) {
+  size_t result = 0;
+  for (size_t i = 0; i < size; ++i) {
+    if (path[i] == '\\' && i + 1 < size) {
       switch (path[i + 1]) {
         case 's': {
-          result.push_back(' ');
+          path[result++] = ' ';
           break;
         }
         case 'n': {
-          result.push_back('\n');
+          path[result++] = '\n';
           break;
         }
         case 'b': {
-          result.push_back('\\');
+          path[result++] = '\\';
           break;
         }
         default: {
-          result.push_back(path[i]);
-          result.push_back(path[i + 1]);
+          path[result++] = path[i];
+          path[result++] = path[i + 1];
           break;
         }
       }
       ++i;
     } else {
-      result.push_back(path[i]);
+      path[result++] = path[i];
     }
   }
   return result;
 }
 
 string Runfiles::Rlocation(const string& path) const {
-  return Rlocation(path, source_repository_);
+  string result;
+  Rlocation(path, source_repository_, &result);
+  return result;
 }
 
 string Runfiles::Rlocation(const string& path,
                            const string& source_repo) const {
+  string result;
+  Rlocation(path, source_repo, &result);
+  return result;
+}
+
+void Runfiles::Rlocation(const string& path, string* result) const {
+  Rlocation(path, source_repository_, result);
+}
+
+void Runfiles::Rlocation(const string& path, const string& source_repo,
+                         string* result) const {
   if (path.empty() || starts_with(path, "../") || contains(path, "/..") ||
       starts_with(path, "./") || contains(path, "/./") ||
       ends_with(path, "/.") || contains(path, "//")) {
-    return string();
+    result->clear();
+    return;
   }
   if (IsAbsolute(path)) {
-    return path;
+    result->assign(path);
+    return;
   }
 
   string::size_type first_slash = path.find_first_of('/');
-  if (first_slash == string::npos) {
-    return RlocationUnchecked(path, runfiles_map_, directory_);
-  }
-  string target_apparent = path.substr(0, first_slash);
-  auto target =
-      repo_mapping_.find(std::make_pair(source_repo, target_apparent));
-  if (target == repo_mapping_.cend()) {
-    return RlocationUnchecked(path, runfiles_map_, directory_);
+  const string* target =
+      first_slash == string::npos
+          ? nullptr
+          : repo_mapping_->Find(source_repo, path.data(), first_slash);
+  if (target == nullptr) {
+    result->assign(path);
+  } else {
+    result->assign(*target);
+    result->append(path, first_slash, string::npos);
   }
-  return RlocationUnchecked(target->second + path.substr(first_slash),
-                            runfiles_map_, directory_);
+  RlocationUnchecked(manifest_.get(), directory_, result);
 }
 
-string Runfiles::RlocationUnchecked(const string& path,
-                                    const map<string, string>& runfiles_map,
-                                    const string& directory) {
-  const auto exact_match = runfiles_map.find(path);
-  if (exact_match != runfiles_map.end()) {
-    return exact_match->second;
-  }
-  if (!runfiles_map.empty()) {
+void Runfiles::RlocationUnchecked(const Manifest* manifest,
+                                  const string& directory, string* path) {
+  if (manifest != nullptr) {
+    size_t target_size;
+    const char* target =
+        manifest->Find(path->data(), path->size(), &target_size);
+    if (target != nullptr) {
+      path->assign(target, target_size);
+      return;
+    }
     // If path references a runfile that lies under a directory that itself is a
     // runfile, then only the directory is listed in the manifest. Look up all
-    // prefixes of path in the manifest and append the relative path from the
-    // prefix to the looked up path.
-    std::size_t prefix_end = path.size();
-    while ((prefix_end = path.find_last_of('/', prefix_end - 1)) !=
+    // prefixes of path in the manifest and replace the prefix with the looked
+    // up path.
+    std::size_t prefix_end = path->size();
+    while ((prefix_end = path->find_last_of('/', prefix_end - 1)) !=
            string::npos) {
-      const string prefix = path.substr(0, prefix_end);
-      const auto prefix_match = runfiles_map.find(prefix);
-      if (prefix_match != runfiles_map.end()) {
-        return prefix_match->second + "/" + path.substr(prefix_end + 1);
+      target = manifest->Find(path->data(), prefix_end, &target_size);
+      if (target != nullptr) {
+        path->replace(0, prefix_end, target, target_size);
+        return;
       }
     }
   }
   if (!directory.empty()) {
-    return directory + "/" + path;
+    path->insert(0, 1, '/');
+    path->insert(0, directory);
+    return;
   }
-  return "";
+  path->clear();
 }
 
-namespace {
-
-bool ParseManifest(const string& path, map<string, string>* result,
-                   string* error) {
-  std::ifstream stm(path);
+bool Runfiles::Manifest::Parse(const string& path, const string& shared_index,
+                               bool share, shared_ptr<const Manifest>* result,
+                               string* error) {
+  std::unique_ptr<Manifest> manifest(new Manifest());
+  if (!shared_index.empty() && manifest->MapIndex(path, shared_index)) {
+    // Passed on to the children, as long as they inherit the memfd.
+    manifest->shared_index_ = shared_index;
+    result->reset(manifest.release());
+    return true;
+  }
+  if (manifest->MapIndex(path, path + ".index")) {
+    result->reset(manifest.release());
+    return true;
+  }
+  std::ifstream stm(path, std::ios::binary);
   if (!stm.is_open()) {
     if (error) {
       std::ostringstream err;
@@ -283,54 +455,286 @@ bool ParseManifest(const string& path, map<string, string>* result,
     }
     return false;
   }
-  string line;
-  std::getline(stm, line);
+  string& data = manifest->data_;
+  stm.seekg(0, std::ios::end);
+  std::streamoff size = stm.tellg();
+  stm.seekg(0, std::ios::beg);
+  if (size > 0) {
+    data.resize(static_cast<size_t>(size));
+    stm.read(&data[0], size);
+    data.resize(static_cast<size_t>(stm.gcount()));
+  }
+
+  // Like reading the manifest line by line, stop at the first empty line.
   size_t line_count = 1;
-  while (!line.empty()) {
-    std::string source;
-    std::string target;
-    if (line[0] == ' ') {
-      // The link path contains escape sequences for spaces and backslashes.
-      string::size_type idx = line.find(' ', 1);
-      if (idx == string::npos) {
-        if (error) {
-          std::ostringstream err;
-          err << "ERROR: " << __FILE__ << "(" << __LINE__
-              << "): bad runfiles manifest entry in \"" << path << "\" line #"
-              << line_count << ": \"" << line << "\"";
-          *error = err.str();
-        }
-        return false;
+  for (size_t line = 0, line_end; line < data.size() && data[line] != '\n';
+       line = line_end + 1, ++line_count) {
+    line_end = data.find('\n', line);
+    if (line_end == string::npos) {
+      line_end = data.size();
+    }
+    // The link path contains escape sequences for spaces and backslashes if
+    // the line starts with a space.
+    const bool escaped = data[line] == ' ';
+    const size_t source = escaped ? line + 1 : line;
+    const size_t separator = data.find(' ', source);
+    if (separator == string::npos || separator >= line_end) {
+      if (error) {
+        std::ostringstream err;
+        err << "ERROR: " << __FILE__ << "(" << __LINE__
+            << "): bad runfiles manifest entry in \"" << path << "\" line #"
+            << line_count << ": \"" << data.substr(line, line_end - line)
+            << "\"";
+        *error = err.str();
       }
-      source = Unescape(line.substr(1, idx - 1));
-      target = Unescape(line.substr(idx + 1));
-    } else {
-      string::size_type idx = line.find(' ');
-      if (idx == string::npos) {
-        if (error) {
-          std::ostringstream err;
-          err << "ERROR: " << __FILE__ << "(" << __LINE__
-              << "): bad runfiles manifest entry in \"" << path << "\" line #"
-              << line_count << ": \"" << line << "\"";
-          *error = err.str();
-        }
-        return false;
+      return false;
+    }
+    Entry entry = {source, separator - source, separator + 1,
+                   line_end - separator - 1};
+    if (escaped) {
+      entry.source_size = Unescape(&data[entry.source], entry.source_size);
+      entry.target_size = Unescape(&data[entry.target], entry.target_size);
+    }
+    manifest->entries_.push_back(entry);
+  }
+
+  // Bazel writes the manifest sorted, so sorting is usually not necessary.
+  // Later lines for the same path override earlier ones, so after sorting,
+  // keep the last entry of every path.
+  vector<Entry>& entries = manifest->entries_;
+  const Manifest& m = *manifest;
+  auto less = [&m](const Entry& a, const Entry& b) {
+    return m.Compare(a, m.data_.data() + b.source, b.source_size) < 0;
+  };
+  auto not_less = [&less](const Entry& a, const Entry& b) {
+    return !less(a, b);
+  };
+  if (std::adjacent_find(entries.begin(), entries.end(), not_less) !=
+      entries.end()) {
+    std::stable_sort(entries.begin(), entries.end(), less);
+    size_t kept = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+      if (i + 1 < entries.size() && !less(entries[i], entries[i + 1])) {
+        continue;
       }
-      source = line.substr(0, idx);
-      target = line.substr(idx + 1);
+      entries[kept++] = entries[i];
     }
-    (*result)[source] = target;
-    std::getline(stm, line);
-    ++line_count;
+    entries.resize(kept);
+  }
+  entries.shrink_to_fit();
+
+  if (share) {
+    manifest->ShareIndex(path);
   }
+  result->reset(manifest.release());
   return true;
 }
 
-bool ParseRepoMapping(const string& path,
-                      map<pair<string, string>, string>* result,
-                      string* error) {
+Runfiles::Manifest::~Manifest() {
+#ifndef _WIN32
+  if (index_ != nullptr) {
+    munmap(const_cast<char*>(index_), index_size_);
+  }
+  if (shared_fd_ >= 0) {
+    close(shared_fd_);
+  }
+#endif  // not _WIN32
+}
+
+void Runfiles::Manifest::ShareIndex(const string& path) {
+#if defined(__linux__) && defined(MFD_ALLOW_SEALING)
+  struct stat manifest_st;
+  if (stat(path.c_str(), &manifest_st) != 0) {
+    return;
+  }
+  // Laid out like build-runfiles writes MANIFEST.index. The targets are not
+  // stored once each, which only makes the index larger.
+  uint64_t strings_size = 0;
+  for (const Entry& entry : entries_) {
+    strings_size += entry.source_size + entry.target_size;
+  }
+  if (strings_size > UINT32_MAX) {
+    return;
+  }
+  uint32_t bucket_count = 1;
+  while (bucket_count < 2 * entries_.size()) {
+    bucket_count *= 2;
+  }
+  const size_t tables_size =
+      sizeof(IndexEntry) * entries_.size() + sizeof(uint32_t) * bucket_count;
+  string index(sizeof(IndexHeader) + tables_size + strings_size, '\0');
+  IndexHeader* header = reinterpret_cast<IndexHeader*>(&index[0]);
+  memcpy(header->magic, "RFINDEX1", sizeof(header->magic));
+  header->entry_count = static_cast<uint32_t>(entries_.size());
+  header->bucket_count = bucket_count;
+  header->strings_size = strings_size;
+  header->manifest_size = manifest_st.st_size;
+  header->manifest_mtime_sec = manifest_st.st_mtim.tv_sec;
+  header->manifest_mtime_nsec = manifest_st.st_mtim.tv_nsec;
+  IndexEntry* index_entries =
+      reinterpret_cast<IndexEntry*>(&index[sizeof(IndexHeader)]);
+  uint32_t* buckets =
+      reinterpret_cast<uint32_t*>(index_entries + entries_.size());
+  char* strings = reinterpret_cast<char*>(buckets + bucket_count);
+  uint32_t offset = 0;
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    const Entry& entry = entries_[i];
+    const char* source = data_.data() + entry.source;
+    index_entries[i].link = offset;
+    index_entries[i].link_size = static_cast<uint32_t>(entry.source_size);
+    memcpy(strings + offset, source, entry.source_size);
+    offset += entry.source_size;
+    index_entries[i].target = offset;
+    index_entries[i].target_size = static_cast<uint32_t>(entry.target_size);
+    memcpy(strings + offset, data_.data() + entry.target, entry.target_size);
+    offset += entry.target_size;
+    uint32_t slot = IndexHash(source, entry.source_size);
+    while (buckets[slot & (bucket_count - 1)] != 0) {
+      ++slot;
+    }
+    buckets[slot & (bucket_count - 1)] = static_cast<uint32_t>(i + 1);
+  }
+
+  // Not close-on-exec: the children inherit it. Sealed, so that none of them
+  // can change it under the others.
+  int fd = memfd_create("runfiles_manifest_index", MFD_ALLOW_SEALING);
+  if (fd < 0) {
+    return;
+  }
+  size_t written = 0;
+  while (written < index.size()) {
+    ssize_t n = write(fd, index.data() + written, index.size() - written);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      close(fd);
+      return;
+    }
+    written += n;
+  }
+  if (fcntl(fd, F_ADD_SEALS,
+            F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+    close(fd);
+    return;
+  }
+  // A child that has closed the memfd, or has another file under its
+  // number, sees that it is not an index of the manifest.
+  shared_fd_ = fd;
+  shared_index_ = "/proc/self/fd/" + std::to_string(fd);
+#endif  // __linux__ && MFD_ALLOW_SEALING
+}
+
+bool Runfiles::Manifest::MapIndex(const string& path,
+                                  const string& index_path) {
+#ifdef _WIN32
+  // build-runfiles only writes the index on Linux and macOS.
+  return false;
+#else  // not _WIN32
+  struct stat manifest_st;
+  if (stat(path.c_str(), &manifest_st) != 0) {
+    return false;
+  }
+  int fd = open(index_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  void* data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 &&
+      static_cast<uint64_t>(st.st_size) >= sizeof(IndexHeader)) {
+    data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+
+#if defined(__APPLE__)
+  const struct timespec& mtime = manifest_st.st_mtimespec;
+#else
+  const struct timespec& mtime = manifest_st.st_mtim;
+#endif
+  const IndexHeader* header = static_cast<const IndexHeader*>(data);
+  const uint64_t size = st.st_size;
+  // The sizes are checked one by one, so that the sum cannot overflow.
+  const uint64_t tables_size =
+      sizeof(IndexEntry) * static_cast<uint64_t>(header->entry_count) +
+      sizeof(uint32_t) * static_cast<uint64_t>(header->bucket_count);
+  if (memcmp(header->magic, "RFINDEX1", sizeof(header->magic)) != 0 ||
+      header->manifest_size != static_cast<uint64_t>(manifest_st.st_size) ||
+      header->manifest_mtime_sec != mtime.tv_sec ||
+      header->manifest_mtime_nsec != mtime.tv_nsec ||
+      header->bucket_count <= header->entry_count ||
+      (header->bucket_count & (header->bucket_count - 1)) != 0 ||
+      tables_size > size - sizeof(IndexHeader) ||
+      header->strings_size != size - sizeof(IndexHeader) - tables_size) {
+    munmap(data, st.st_size);
+    return false;
+  }
+  index_ = static_cast<const char*>(data);
+  index_size_ = st.st_size;
+  return true;
+#endif  // _WIN32
+}
+
+const char* Runfiles::Manifest::FindInIndex(const char* key, size_t key_size,
+                                            size_t* target_size) const {
+  const IndexHeader* header = reinterpret_cast<const IndexHeader*>(index_);
+  const IndexEntry* entries =
+      reinterpret_cast<const IndexEntry*>(index_ + sizeof(IndexHeader));
+  const uint32_t* buckets =
+      reinterpret_cast<const uint32_t*>(entries + header->entry_count);
+  const char* strings =
+      reinterpret_cast<const char*>(buckets + header->bucket_count);
+  const uint64_t strings_size = header->strings_size;
+
+  uint32_t slot = IndexHash(key, key_size);
+  const uint32_t mask = header->bucket_count - 1;
+  for (uint32_t probes = 0; probes < header->bucket_count; ++probes, ++slot) {
+    const uint32_t bucket = buckets[slot & mask];
+    if (bucket == 0 || bucket > header->entry_count) {
+      return nullptr;
+    }
+    const IndexEntry& entry = entries[bucket - 1];
+    if (entry.link_size == key_size && entry.link <= strings_size &&
+        key_size <= strings_size - entry.link &&
+        memcmp(strings + entry.link, key, key_size) == 0) {
+      if (entry.target > strings_size ||
+          entry.target_size > strings_size - entry.target) {
+        return nullptr;
+      }
+      *target_size = entry.target_size;
+      return strings + entry.target;
+    }
+  }
+  return nullptr;
+}
+
+const char* Runfiles::Manifest::Find(const char* key, size_t key_size,
+                                     size_t* target_size) const {
+  if (index_ != nullptr) {
+    return FindInIndex(key, key_size, target_size);
+  }
+  auto it = std::lower_bound(entries_.begin(), entries_.end(), key,
+                             [this, key_size](const Entry& entry,
+                                              const char* k) {
+                               return Compare(entry, k, key_size) < 0;
+                             });
+  if (it == entries_.end() || Compare(*it, key, key_size) != 0) {
+    return nullptr;
+  }
+  *target_size = it->target_size;
+  return data_.data() + it->target;
+}
+
+bool Runfiles::RepoMapping::Parse(const string& path,
+                                  shared_ptr<const RepoMapping>* result,
+                                  string* error) {
+  std::unique_ptr<RepoMapping> mapping(new RepoMapping());
   std::ifstream stm(path);
   if (!stm.is_open()) {
+    result->reset(mapping.release());
     return true;
   }
   string line;
@@ -360,19 +764,53 @@ bool ParseRepoMapping(const string& path,
       return false;
     }
 
-    string source = line.substr(0, first_comma);
-    string target_apparent =
+    Entry entry;
+    entry.source = line.substr(0, first_comma);
+    entry.target_apparent =
         line.substr(first_comma + 1, second_comma - (first_comma + 1));
-    string target = line.substr(second_comma + 1);
-
-    (*result)[std::make_pair(source, target_apparent)] = target;
+    entry.target = line.substr(second_comma + 1);
+    mapping->entries_.push_back(std::move(entry));
     std::getline(stm, line);
     ++line_count;
   }
+
+  // Like for the manifest, later lines override earlier ones.
+  vector<Entry>& entries = mapping->entries_;
+  auto less = [](const Entry& a, const Entry& b) {
+    return Compare(a, b.source, b.target_apparent.data(),
+                   b.target_apparent.size()) < 0;
+  };
+  std::stable_sort(entries.begin(), entries.end(), less);
+  size_t kept = 0;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (i + 1 < entries.size() && !less(entries[i], entries[i + 1])) {
+      continue;
+    }
+    if (kept != i) {
+      entries[kept] = std::move(entries[i]);
+    }
+    ++kept;
+  }
+  entries.resize(kept);
+
+  result->reset(mapping.release());
   return true;
 }
 
-}  // namespace
+const string* Runfiles::RepoMapping::Find(const string& source,
+                                          const char* apparent,
+                                          size_t apparent_size) const {
+  auto it = std::lower_bound(
+      entries_.begin(), entries_.end(), source,
+      [apparent, apparent_size](const Entry& entry, const string& s) {
+        return Compare(entry, s, apparent, apparent_size) < 0;
+      });
+  if (it == entries_.end() ||
+      Compare(*it, source, apparent, apparent_size) != 0) {
+    return nullptr;
+  }
+  return &it->target;
+}
 
 namespace testing {
 
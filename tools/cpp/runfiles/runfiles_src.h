@@ -76,6 +76,12 @@
 //       }
 //       execv(args[0], args);
 //     }
+//
+// With RUNFILES_SHARE_MANIFEST_INDEX=1 in the environment, a Runfiles object
+// that parsed the runfiles manifest also gives the children (on Linux only) an
+// index of it to map in RUNFILES_MANIFEST_INDEX, so that they don't parse the
+// manifest again. The index is an open file that all children inherit, and
+// that stays open until the Runfiles object is deleted.
 
 #ifndef TOOLS_CPP_RUNFILES_RUNFILES_H_
 #define TOOLS_CPP_RUNFILES_RUNFILES_H_ 1
@@ -173,6 +179,15 @@ class Runfiles {
   std::string Rlocation(const std::string& path,
                         const std::string& source_repository) const;
 
+  // Same as above, except that it writes the path of the runfile into
+  // `result`, reusing its buffer. Looking up a runfile doesn't allocate
+  // otherwise, so callers that resolve many runfiles can keep one string
+  // around for this.
+  void Rlocation(const std::string& path, std::string* result) const;
+  void Rlocation(const std::string& path,
+                 const std::string& source_repository,
+                 std::string* result) const;
+
   // Returns environment variables for subprocesses.
   //
   // The caller should set the returned key-value pairs in the environment of
@@ -189,16 +204,22 @@ class Runfiles {
   std::unique_ptr<Runfiles> WithSourceRepository(
       const std::string& source_repository) const {
     return std::unique_ptr<Runfiles>(new Runfiles(
-        runfiles_map_, directory_, repo_mapping_, envvars_, source_repository));
+        manifest_, directory_, repo_mapping_, envvars_, source_repository));
   }
 
  private:
-  Runfiles(
-      std::map<std::string, std::string> runfiles_map, std::string directory,
-      std::map<std::pair<std::string, std::string>, std::string> repo_mapping,
-      std::vector<std::pair<std::string, std::string> > envvars,
-      std::string source_repository)
-      : runfiles_map_(std::move(runfiles_map)),
+  // The parsed runfiles manifest, sorted by runfiles path. Instances created
+  // by WithSourceRepository share it.
+  class Manifest;
+  // The parsed repository mapping, sorted by source repository and apparent
+  // name. Instances created by WithSourceRepository share it.
+  class RepoMapping;
+
+  Runfiles(std::shared_ptr<const Manifest> manifest, std::string directory,
+           std::shared_ptr<const RepoMapping> repo_mapping,
+           std::vector<std::pair<std::string, std::string> > envvars,
+           std::string source_repository)
+      : manifest_(std::move(manifest)),
         directory_(std::move(directory)),
         repo_mapping_(std::move(repo_mapping)),
         envvars_(std::move(envvars)),
@@ -208,15 +229,16 @@ class Runfiles {
   Runfiles& operator=(const Runfiles&) = delete;
   Runfiles& operator=(Runfiles&&) = delete;
 
-  static std::string RlocationUnchecked(
-      const std::string& path,
-      const std::map<std::string, std::string>& runfiles_map,
-      const std::string& directory);
+  // Replaces the runfiles path in `path` by the path of the runfile, or by
+  // the empty string if it isn't known. `manifest` is null if there is no
+  // runfiles manifest.
+  static void RlocationUnchecked(const Manifest* manifest,
+                                 const std::string& directory,
+                                 std::string* path);
 
-  const std::map<std::string, std::string> runfiles_map_;
+  const std::shared_ptr<const Manifest> manifest_;
   const std::string directory_;
-  const std::map<std::pair<std::string, std::string>, std::string>
-      repo_mapping_;
+  const std::shared_ptr<const RepoMapping> repo_mapping_;
   const std::vector<std::pair<std::string, std::string> > envvars_;
   const std::string source_repository_;
 };
@@ -16,6 +16,10 @@
 
 #ifdef _WIN32
 #include <windows.h>
+#else  // not _WIN32
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
 #endif  // _WIN32
 
 #include <fstream>
@@ -275,6 +279,109 @@ TEST_F(RunfilesTest, ManifestBasedRunfilesRlocationAndEnvVars) {
   EXPECT_EQ(r->Rlocation("not_escaped"), "with\\backslash and spaces");
 }
 
+TEST_F(RunfilesTest, ManifestBasedRunfilesUnsortedAndDuplicateEntries) {
+  unique_ptr<MockFile> mf(
+      MockFile::Create("foo" LINE_AS_STRING() ".runfiles_manifest",
+                       {
+                           "z/y first",
+                           "a/b/c nested",
+                           "a/b dir",
+                           "a/bc sibling",
+                           "z/y second",
+                           "a/b/ trailing",
+                       }));
+  ASSERT_TRUE(mf != nullptr);
+
+  string error;
+  unique_ptr<Runfiles> r(
+      Runfiles::Create("ignore-argv0", mf->Path(), "", &error));
+
+  ASSERT_TRUE(r != nullptr);
+  EXPECT_TRUE(error.empty());
+  // Later entries override earlier ones.
+  EXPECT_EQ(r->Rlocation("z/y"), "second");
+  EXPECT_EQ(r->Rlocation("a/b"), "dir");
+  EXPECT_EQ(r->Rlocation("a/bc"), "sibling");
+  EXPECT_EQ(r->Rlocation("a/b/c"), "nested");
+  EXPECT_EQ(r->Rlocation("a/b/c/d"), "nested/d");
+  EXPECT_EQ(r->Rlocation("a/b/d"), "dir/d");
+  EXPECT_EQ(r->Rlocation("a/bc/d"), "sibling/d");
+  EXPECT_EQ(r->Rlocation("a/bcd"), "");
+  EXPECT_EQ(r->Rlocation("a"), "");
+}
+
+TEST_F(RunfilesTest, ManifestBasedRunfilesIgnoreStaleIndex) {
+  string uid = LINE_AS_STRING();
+  unique_ptr<MockFile> mf(
+      MockFile::Create("foo" + uid + ".runfiles_manifest", {"a/b c/d"}));
+  ASSERT_TRUE(mf != nullptr);
+  // Not an index of this manifest.
+  unique_ptr<MockFile> index(
+      MockFile::Create("foo" + uid + ".runfiles_manifest.index",
+                       {"RFINDEX1 but not really an index"}));
+  ASSERT_TRUE(index != nullptr);
+
+  string error;
+  unique_ptr<Runfiles> r(
+      Runfiles::Create("ignore-argv0", mf->Path(), "", &error));
+
+  ASSERT_TRUE(r != nullptr);
+  EXPECT_TRUE(error.empty());
+  EXPECT_EQ(r->Rlocation("a/b"), "c/d");
+  EXPECT_EQ(r->Rlocation("a/b/e"), "c/d/e");
+}
+
+#ifdef __linux__
+TEST_F(RunfilesTest, ManifestBasedRunfilesShareIndexWithChildren) {
+  unique_ptr<MockFile> mf(MockFile::Create(
+      "foo" LINE_AS_STRING() ".runfiles_manifest", {"a/b c/d", "e/f g/h"}));
+  ASSERT_TRUE(mf != nullptr);
+
+  string error;
+  setenv("RUNFILES_SHARE_MANIFEST_INDEX", "1", 1);
+  unique_ptr<Runfiles> parent(
+      Runfiles::Create("ignore-argv0", mf->Path(), "", &error));
+  unsetenv("RUNFILES_SHARE_MANIFEST_INDEX");
+  ASSERT_TRUE(parent != nullptr);
+  EXPECT_TRUE(error.empty());
+  string shared_index;
+  for (const auto& envvar : parent->EnvVars()) {
+    if (envvar.first == "RUNFILES_MANIFEST_INDEX") {
+      shared_index = envvar.second;
+    }
+  }
+  ASSERT_FALSE(shared_index.empty());
+
+  // Change the manifest behind the index's back, so that only a child using
+  // the index finds the old targets.
+  struct stat st;
+  ASSERT_EQ(stat(mf->Path().c_str(), &st), 0);
+  std::ofstream(mf->Path()) << "a/b x/y\ne/f g/h\n";
+  struct timespec times[2] = {st.st_atim, st.st_mtim};
+  ASSERT_EQ(utimensat(AT_FDCWD, mf->Path().c_str(), times, 0), 0);
+
+  setenv("RUNFILES_MANIFEST_INDEX", shared_index.c_str(), 1);
+  unique_ptr<Runfiles> child(
+      Runfiles::Create("ignore-argv0", mf->Path(), "", &error));
+  unsetenv("RUNFILES_MANIFEST_INDEX");
+  ASSERT_TRUE(child != nullptr);
+  EXPECT_EQ(child->Rlocation("a/b"), "c/d");
+  EXPECT_EQ(child->Rlocation("e/f/i"), "g/h/i");
+  EXPECT_EQ(child->Rlocation("x/y"), "");
+  EXPECT_EQ(child->EnvVars(), parent->EnvVars());
+
+  // Without the parent's index, the child parses the manifest.
+  parent.reset();
+  setenv("RUNFILES_MANIFEST_INDEX", shared_index.c_str(), 1);
+  unique_ptr<Runfiles> orphan(
+      Runfiles::Create("ignore-argv0", mf->Path(), "", &error));
+  unsetenv("RUNFILES_MANIFEST_INDEX");
+  ASSERT_TRUE(orphan != nullptr);
+  EXPECT_EQ(orphan->Rlocation("a/b"), "x/y");
+  AssertEnvvars(*orphan, mf->Path(), "");
+}
+#endif  // __linux__
+
 TEST_F(RunfilesTest, DirectoryBasedRunfilesRlocationAndEnvVars) {
   unique_ptr<MockFile> dummy(
       MockFile::Create("foo" LINE_AS_STRING() ".runfiles/dummy", {"a/b c/d"}));
@@ -661,6 +768,40 @@ TEST_F(RunfilesTest, ManifestBasedRlocationWithRepoMapping_fromMain) {
   EXPECT_EQ(r->Rlocation("protobuf"), "");
 }
 
+TEST_F(RunfilesTest, RlocationIntoBuffer) {
+  string uid = LINE_AS_STRING();
+  unique_ptr<MockFile> rm(
+      MockFile::Create("foo" + uid + ".repo_mapping",
+                       {",my_protobuf,protobuf+3.19.2",
+                        "protobuf+3.19.2,protobuf,protobuf+3.19.2"}));
+  ASSERT_TRUE(rm != nullptr);
+  unique_ptr<MockFile> mf(MockFile::Create(
+      "foo" + uid + ".runfiles_manifest",
+      {"_repo_mapping " + rm->Path(),
+       "protobuf+3.19.2/bar/dir E:\\Actual Path\\Directory"}));
+  ASSERT_TRUE(mf != nullptr);
+
+  string error;
+  unique_ptr<Runfiles> r(Runfiles::Create("ignore-argv0", mf->Path(), "",
+                                          /*source_repository=*/"", &error));
+  ASSERT_TRUE(r != nullptr);
+  EXPECT_TRUE(error.empty());
+
+  string result = "previous contents";
+  r->Rlocation("my_protobuf/bar/dir/file", &result);
+  EXPECT_EQ(result, "E:\\Actual Path\\Directory/file");
+  r->Rlocation("my_protobuf/bar/dir", &result);
+  EXPECT_EQ(result, "E:\\Actual Path\\Directory");
+  r->Rlocation("protobuf/bar/dir", "protobuf+3.19.2", &result);
+  EXPECT_EQ(result, "E:\\Actual Path\\Directory");
+  r->Rlocation("protobuf/bar/dir", &result);
+  EXPECT_EQ(result, "");
+  r->Rlocation("/absolute/path", &result);
+  EXPECT_EQ(result, "/absolute/path");
+  r->Rlocation("../foo", &result);
+  EXPECT_EQ(result, "");
+}
+
 TEST_F(RunfilesTest, ManifestBasedRlocationWithRepoMapping_fromOtherRepo) {
   string uid = LINE_AS_STRING();
   unique_ptr<MockFile> rm(
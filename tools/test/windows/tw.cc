@@ -31,13 +31,18 @@
 #include <wchar.h>
 
 #include <algorithm>
+#include <condition_variable>  // NOLINT
 #include <cstdio>
 #include <fstream>
 #include <functional>
 #include <iomanip>
 #include <memory>
+#include <mutex>  // NOLINT
 #include <sstream>
 #include <string>
+#include <thread>  // NOLINT
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "src/main/cpp/util/file_platform.h"
@@ -49,6 +54,7 @@
 #include "third_party/ijar/common.h"
 #include "third_party/ijar/platform_utils.h"
 #include "third_party/ijar/zip.h"
+#include "third_party/ijar/zlib_client.h"
 #include "tools/cpp/runfiles/runfiles.h"
 
 namespace bazel {
@@ -73,27 +79,34 @@ class Defer {
 
 const std::function<void()> Defer::kEmpty = []() {};
 
+class LogStream;
+
 // Streams data from an input to two outputs.
 // Inspired by tee(1) in the GNU coreutils.
 class TeeImpl : Tee {
  public:
   // Creates a background thread to stream data from `input` to the two outputs.
+  // `input` must be open for overlapped I/O, e.g. the reading end of a pipe
+  // created by CreateOverlappedPipe.
   // The thread terminates when ReadFile fails on the input (e.g. the input is
   // the reading end of a pipe and the writing end is closed) or when WriteFile
   // fails on one of the outputs (e.g. the same output handle is closed
   // elsewhere).
+  // If `stream` is not null, the data is also appended to it. The stream must
+  // outlive the thread.
   static bool Create(bazel::windows::AutoHandle* input,
                      bazel::windows::AutoHandle* output1,
                      bazel::windows::AutoHandle* output2,
-                     std::unique_ptr<Tee>* result);
+                     std::unique_ptr<Tee>* result,
+                     LogStream* stream = nullptr);
 
  private:
   static DWORD WINAPI ThreadFunc(LPVOID lpParam);
 
   TeeImpl(bazel::windows::AutoHandle* input,
           bazel::windows::AutoHandle* output1,
-          bazel::windows::AutoHandle* output2)
-      : input_(input), output1_(output1), output2_(output2) {}
+          bazel::windows::AutoHandle* output2, LogStream* stream)
+      : input_(input), output1_(output1), output2_(output2), stream_(stream) {}
   TeeImpl(const TeeImpl&) = delete;
   TeeImpl& operator=(const TeeImpl&) = delete;
 
@@ -102,6 +115,7 @@ class TeeImpl : Tee {
   bazel::windows::AutoHandle input_;
   bazel::windows::AutoHandle output1_;
   bazel::windows::AutoHandle output2_;
+  LogStream* stream_;
 };
 
 // Buffered input stream (based on a Windows HANDLE) with peek-ahead support.
@@ -179,6 +193,10 @@ struct UndeclaredOutputs {
   Path manifest;
   Path annotations;
   Path annotations_dir;
+  // Whether to deflate the files in the zip.
+  bool compress;
+  // The zlib level to deflate them with, or -1 for the default.
+  int compression_level;
 };
 
 struct Duration {
@@ -891,18 +909,83 @@ bool AppendFileTo(const Path& file, const size_t total_size, HANDLE output) {
   return true;
 }
 
-// Returns the MIME type of the file name.
+// Reads the rest of the file into `output`, appending to it.
+bool AppendFileToString(const Path& file, const size_t size_hint,
+                        std::string* output) {
+  bazel::windows::AutoHandle input;
+  if (!OpenExistingFileForRead(file, &input)) {
+    LogErrorWithArg(__LINE__, "Failed to open file for reading", file.Get());
+    return false;
+  }
+  output->reserve(output->size() + size_hint);
+  char buffer[0x10000];
+  while (true) {
+    DWORD read = 0;
+    if (!ReadFile(input, buffer, sizeof(buffer), &read, nullptr)) {
+      DWORD err = GetLastError();
+      LogErrorWithArgAndValue(__LINE__, "Failed to read file", file.Get(), err);
+      return false;
+    }
+    if (read == 0) {
+      return true;
+    }
+    output->append(buffer, read);
+  }
+}
+
+// Splits the items [0, count) into consecutive ranges and calls `work` on
+// each of them, on up to 8 threads, with the output of the range. Fills in
+// `outputs` in the order of the ranges, so that joined they are in the order
+// of the items.
+//
+// Returns false if `work` did for any of the ranges.
+bool ParallelForRanges(
+    size_t count, std::vector<std::string>* outputs,
+    const std::function<bool(size_t begin, size_t end, std::string* output)>&
+        work) {
+  static constexpr unsigned kMaxThreads = 8;
+  // Below this, a range is not worth a thread.
+  static constexpr size_t kMinRangeSize = 256;
+  const size_t threads = std::min<size_t>(
+      std::min(std::max(std::thread::hardware_concurrency(), 1u), kMaxThreads),
+      std::max<size_t>(count / kMinRangeSize, 1));
+  outputs->assign(threads, std::string());
+  if (threads == 1) {
+    return work(0, count, &(*outputs)[0]);
+  }
+  std::vector<char> ok(threads, 0);
+  std::vector<std::thread> workers;
+  workers.reserve(threads);
+  for (size_t i = 0; i < threads; ++i) {
+    workers.emplace_back([i, count, threads, outputs, &work, &ok]() {
+      ok[i] = work(count * i / threads, count * (i + 1) / threads,
+                   &(*outputs)[i]);
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  return std::find(ok.begin(), ok.end(), 0) == ok.end();
+}
+
+// Returns the part of the file name whose MIME type GetMimeType() looks up:
+// what starts at the last dot, or "" if there is none.
+std::string MimeTypeKey(const std::string& filename) {
+  std::string::size_type pos = filename.find_last_of('.');
+  return pos == std::string::npos ? std::string() : filename.substr(pos);
+}
+
+// Returns the MIME type of the extension, as returned by MimeTypeKey().
 // If the MIME type is unknown or an error occurs, the method returns
 // "application/octet-stream".
-std::string GetMimeType(const std::string& filename) {
+std::string GetMimeTypeOfExtension(const std::string& extension) {
   static constexpr char* kDefaultMimeType = "application/octet-stream";
-  std::string::size_type pos = filename.find_last_of('.');
-  if (pos == std::string::npos) {
+  if (extension.empty()) {
     return kDefaultMimeType;
   }
   char data[1000];
   DWORD data_size = 1000 * sizeof(char);
-  if (RegGetValueA(HKEY_CLASSES_ROOT, filename.c_str() + pos, "Content Type",
+  if (RegGetValueA(HKEY_CLASSES_ROOT, extension.c_str(), "Content Type",
                    RRF_RT_REG_SZ, nullptr, data, &data_size) == ERROR_SUCCESS) {
     return data;
   }
@@ -911,26 +994,76 @@ std::string GetMimeType(const std::string& filename) {
   return kDefaultMimeType;
 }
 
+// Returns the MIME type of the file name.
+// If the MIME type is unknown or an error occurs, the method returns
+// "application/octet-stream".
+std::string GetMimeType(const std::string& filename) {
+  return GetMimeTypeOfExtension(MimeTypeKey(filename));
+}
+
 bool CreateUndeclaredOutputsManifestContent(const std::vector<FileInfo>& files,
                                             std::string* result) {
-  std::stringstream stm;
+  std::vector<const FileInfo*> regular_files;
+  regular_files.reserve(files.size());
   for (const auto& e : files) {
     if (!e.IsDirectory()) {
-      // For each file, write a tab-separated line to the manifest with name
-      // (relative to TEST_UNDECLARED_OUTPUTS_DIR), size, and mime type.
-      // Example:
-      //   foo.txt<TAB>9<TAB>text/plain
-      //   bar/baz<TAB>2944<TAB>application/octet-stream
-      std::string acp_path;
-      if (!WcsToAcp(AsMixedPath(e.RelativePath()), &acp_path)) {
-        return false;
-      }
+      regular_files.push_back(&e);
+    }
+  }
 
-      stm << acp_path << "\t" << e.Size() << "\t" << GetMimeType(acp_path)
-          << "\n";
+  std::vector<std::string> acp_paths(regular_files.size());
+  std::vector<std::string> unused;
+  if (!ParallelForRanges(
+          regular_files.size(), &unused,
+          [&regular_files, &acp_paths](size_t begin, size_t end,
+                                       std::string*) {
+            for (size_t i = begin; i < end; ++i) {
+              if (!WcsToAcp(AsMixedPath(regular_files[i]->RelativePath()),
+                            &acp_paths[i])) {
+                return false;
+              }
+            }
+            return true;
+          })) {
+    return false;
+  }
+
+  // Every registry lookup is done once, up front, so that the threads below
+  // only read the map. Outputs tend to share a few extensions.
+  std::unordered_map<std::string, std::string> mime_types;
+  for (const auto& acp_path : acp_paths) {
+    std::string key = MimeTypeKey(acp_path);
+    if (mime_types.find(key) == mime_types.end()) {
+      std::string mime_type = GetMimeTypeOfExtension(key);
+      mime_types.emplace(std::move(key), std::move(mime_type));
     }
   }
-  *result = stm.str();
+
+  std::vector<std::string> parts;
+  ParallelForRanges(
+      regular_files.size(), &parts,
+      [&regular_files, &acp_paths, &mime_types](size_t begin, size_t end,
+                                                std::string* output) {
+        for (size_t i = begin; i < end; ++i) {
+          // For each file, write a tab-separated line to the manifest with
+          // name (relative to TEST_UNDECLARED_OUTPUTS_DIR), size, and mime
+          // type. Example:
+          //   foo.txt<TAB>9<TAB>text/plain
+          //   bar/baz<TAB>2944<TAB>application/octet-stream
+          const std::string& acp_path = acp_paths[i];
+          output->append(acp_path);
+          output->push_back('\t');
+          output->append(std::to_string(regular_files[i]->Size()));
+          output->push_back('\t');
+          output->append(mime_types.find(MimeTypeKey(acp_path))->second);
+          output->push_back('\n');
+        }
+        return true;
+      });
+  result->clear();
+  for (const auto& part : parts) {
+    result->append(part);
+  }
   return true;
 }
 
@@ -1000,8 +1133,217 @@ bool GetZipEntryPtr(devtools_ijar::ZipBuilder* zip_builder,
   return true;
 }
 
-bool CreateZip(const Path& root, const std::vector<FileInfo>& files,
-               const Path& abs_zip) {
+// Whether deflating the file is worth its time: not for files too small to
+// shrink by much, nor for the formats whose MIME types are compressed already,
+// like images, audio and video, and archives.
+bool IsWorthDeflating(const FileInfo& file) {
+  static constexpr int kMinDeflatedSize = 256;
+  static const wchar_t* const kCompressedExtensions[] = {
+      L".7z",  L".apk",  L".avif", L".br",  L".bz2", L".docx", L".gif",
+      L".gz",  L".heic", L".jar",  L".jpeg", L".jpg", L".lz4", L".mkv",
+      L".mov", L".mp3",  L".mp4",  L".ogg", L".png", L".pptx", L".tgz",
+      L".webm", L".webp", L".whl", L".xlsx", L".xz", L".zip",  L".zst",
+  };
+  if (file.Size() < kMinDeflatedSize) {
+    return false;
+  }
+  const std::wstring& path = file.RelativePath();
+  std::wstring::size_type pos = path.find_last_of(L"\\.");
+  if (pos == std::wstring::npos || path[pos] != L'.') {
+    return true;
+  }
+  std::wstring extension = path.substr(pos);
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 ::towlower);
+  for (const wchar_t* compressed : kCompressedExtensions) {
+    if (extension == compressed) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Reads (and deflates, if requested) the files to archive on background
+// threads, ahead of the thread that writes them into the zip in order.
+//
+// Only small files are read into memory, and only up to kMaxBufferedBytes at a
+// time. The writer reads the larger files itself, straight into the zip.
+class ZipFileReader {
+ public:
+  ZipFileReader(const Path& root, const std::vector<FileInfo>& files,
+                bool compress, int compression_level);
+  ~ZipFileReader();
+
+  // The contents of a file, as passed to ZipBuilder::WriteFile.
+  struct Data {
+    std::unique_ptr<devtools_ijar::u1[]> buffer;
+    size_t length = 0;
+    devtools_ijar::u4 crc = 0;
+  };
+
+  // Waits until the file at `index` has been read, and moves its data into
+  // `result`. Files are taken in order.
+  //
+  // Returns false if reading failed. `result->buffer` is null if the writer
+  // has to read the file itself.
+  bool Take(size_t index, Data* result);
+
+ private:
+  static constexpr size_t kMaxBufferedFileSize = 16 << 20;  // 16 MiB
+  static constexpr size_t kMaxBufferedBytes = 256 << 20;    // 256 MiB
+  static constexpr unsigned kMaxThreads = 8;
+
+  enum class State { kPending, kDone, kFailed };
+
+  size_t Size(size_t index) const {
+    return static_cast<size_t>(files_[index].Size());
+  }
+
+  bool IsBuffered(size_t index) const {
+    return !files_[index].IsDirectory() && Size(index) <= kMaxBufferedFileSize;
+  }
+
+  void Work();
+  bool Read(size_t index, Data* result) const;
+
+  const Path& root_;
+  const std::vector<FileInfo>& files_;
+  const bool compress_;
+  const int compression_level_;
+
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::vector<State> states_;
+  std::vector<Data> data_;
+  size_t next_;
+  size_t buffered_bytes_;
+  bool stopped_;
+  std::vector<std::thread> threads_;
+};
+
+ZipFileReader::ZipFileReader(const Path& root,
+                             const std::vector<FileInfo>& files, bool compress,
+                             int compression_level)
+    : root_(root),
+      files_(files),
+      compress_(compress),
+      compression_level_(compression_level),
+      states_(files.size(), State::kPending),
+      data_(files.size()),
+      next_(0),
+      buffered_bytes_(0),
+      stopped_(false) {
+  unsigned threads =
+      std::min(std::max(std::thread::hardware_concurrency(), 1u), kMaxThreads);
+  for (unsigned i = 0; i < threads; ++i) {
+    threads_.emplace_back(&ZipFileReader::Work, this);
+  }
+}
+
+ZipFileReader::~ZipFileReader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_ = true;
+  }
+  changed_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void ZipFileReader::Work() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    // Wait for files to read, but don't buffer more than kMaxBufferedBytes,
+    // unless nothing is buffered at all.
+    changed_.wait(lock, [this]() {
+      return stopped_ || next_ == files_.size() || !IsBuffered(next_) ||
+             buffered_bytes_ == 0 ||
+             buffered_bytes_ + Size(next_) <= kMaxBufferedBytes;
+    });
+    if (stopped_ || next_ == files_.size()) {
+      return;
+    }
+    const size_t index = next_++;
+    if (!IsBuffered(index)) {
+      states_[index] = State::kDone;
+      changed_.notify_all();
+      continue;
+    }
+    buffered_bytes_ += Size(index);
+
+    lock.unlock();
+    Data data;
+    const bool ok = Read(index, &data);
+    lock.lock();
+    data_[index] = std::move(data);
+    states_[index] = ok ? State::kDone : State::kFailed;
+    changed_.notify_all();
+  }
+}
+
+bool ZipFileReader::Read(size_t index, Data* result) const {
+  const FileInfo& file = files_[index];
+  Path path;
+  bazel::windows::AutoHandle handle;
+  if (!path.Set(root_.Get() + L"\\" + file.RelativePath()) ||
+      !OpenExistingFileForRead(path, &handle)) {
+    LogErrorWithArg(__LINE__, "Failed to open file for reading", path.Get());
+    return false;
+  }
+  const size_t size = Size(index);
+  result->buffer.reset(new devtools_ijar::u1[std::max<size_t>(size, 1)]);
+  if (!ReadFromFile(handle, result->buffer.get(), size)) {
+    LogErrorWithArg(__LINE__, "Failed to read file", path.Get());
+    return false;
+  }
+  result->crc =
+      size > 0 ? devtools_ijar::ComputeCrcChecksum(result->buffer.get(), size)
+               : 0;
+  // TryDeflate leaves the data alone if deflating doesn't make it smaller.
+  result->length = compress_ && IsWorthDeflating(file)
+                       ? devtools_ijar::TryDeflate(result->buffer.get(), size,
+                                                   compression_level_)
+                       : size;
+  return true;
+}
+
+bool ZipFileReader::Take(size_t index, Data* result) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  changed_.wait(lock,
+                [this, index]() { return states_[index] != State::kPending; });
+  *result = std::move(data_[index]);
+  if (IsBuffered(index)) {
+    buffered_bytes_ -= Size(index);
+    changed_.notify_all();
+  }
+  return states_[index] == State::kDone;
+}
+
+// Returns the files but the directories that are not empty: unzipping a file
+// creates the directories above it anyway. The empty ones are kept so that
+// they are unzipped too.
+std::vector<FileInfo> WithoutImpliedDirectories(
+    const std::vector<FileInfo>& files) {
+  std::unordered_set<std::wstring> parents;
+  for (const auto& e : files) {
+    std::wstring::size_type pos = e.RelativePath().find_last_of(L'\\');
+    if (pos != std::wstring::npos) {
+      parents.insert(e.RelativePath().substr(0, pos));
+    }
+  }
+  std::vector<FileInfo> result;
+  result.reserve(files.size());
+  for (const auto& e : files) {
+    if (!e.IsDirectory() || parents.find(e.RelativePath()) == parents.end()) {
+      result.push_back(e);
+    }
+  }
+  return result;
+}
+
+bool CreateZip(const Path& root, const std::vector<FileInfo>& all_files,
+               const Path& abs_zip, bool compress, int compression_level) {
   bool restore_oem_api = false;
   if (!AreFileApisANSI()) {
     // devtools_ijar::ZipBuilder uses the ANSI file APIs so we must set the
@@ -1015,6 +1357,7 @@ bool CreateZip(const Path& root, const std::vector<FileInfo>& files,
     }
   });
 
+  const std::vector<FileInfo> files = WithoutImpliedDirectories(all_files);
   ZipEntryPaths zip_entry_paths;
   if (!ToZipEntryPaths(root, files, &zip_entry_paths)) {
     LogError(__LINE__, "Failed to create zip entry paths");
@@ -1027,7 +1370,29 @@ bool CreateZip(const Path& root, const std::vector<FileInfo>& files,
     return false;
   }
 
+  ZipFileReader reader(root, files, compress, compression_level);
   for (size_t i = 0; i < files.size(); ++i) {
+    ZipFileReader::Data data;
+    if (!reader.Take(i, &data)) {
+      LogErrorWithArg(__LINE__, "Failed to dump file into zip",
+                      files[i].RelativePath());
+      return false;
+    }
+    if (data.buffer) {
+      if (zip_builder->WriteFile(zip_entry_paths.EntryPathPtrs()[i],
+                                 GetZipAttr(files[i]), data.buffer.get(),
+                                 data.length, files[i].Size(),
+                                 data.crc) == -1) {
+        LogErrorWithArg2(__LINE__, "Failed to add file to zip",
+                         zip_entry_paths.EntryPathPtrs()[i],
+                         zip_builder->GetError());
+        return false;
+      }
+      continue;
+    }
+
+    // A directory, or a file too large to buffer: write it straight into the
+    // zip.
     bazel::windows::AutoHandle handle;
     Path path;
     if (!path.Set(root.Get() + L"\\" + files[i].RelativePath()) ||
@@ -1045,7 +1410,9 @@ bool CreateZip(const Path& root, const std::vector<FileInfo>& files,
       return false;
     }
 
-    if (zip_builder->FinishFile(files[i].Size(), /* compress */ false,
+    // ZipBuilder deflates these at the default level.
+    if (zip_builder->FinishFile(files[i].Size(),
+                                compress && IsWorthDeflating(files[i]),
                                 /* compute_crc */ true) == -1) {
       LogErrorWithArg(__LINE__, "Failed to finish writing file to zip",
                       path.Get());
@@ -1066,9 +1433,18 @@ bool GetAndUnexportUndeclaredOutputsEnvvars(const Path& cwd,
                                             UndeclaredOutputs* result) {
   // The test may only see TEST_UNDECLARED_OUTPUTS_DIR and
   // TEST_UNDECLARED_OUTPUTS_ANNOTATIONS_DIR, so keep those but unexport others.
+  std::wstring compress;
+  std::wstring compression_level;
   if (!GetPathEnv(L"TEST_UNDECLARED_OUTPUTS_ZIP", &(result->zip)) ||
       !UnsetEnv(L"TEST_UNDECLARED_OUTPUTS_ZIP") ||
 
+      !GetEnv(L"TEST_UNDECLARED_OUTPUTS_ZIP_COMPRESS", &compress) ||
+      !UnsetEnv(L"TEST_UNDECLARED_OUTPUTS_ZIP_COMPRESS") ||
+
+      !GetEnv(L"TEST_UNDECLARED_OUTPUTS_ZIP_COMPRESSION_LEVEL",
+              &compression_level) ||
+      !UnsetEnv(L"TEST_UNDECLARED_OUTPUTS_ZIP_COMPRESSION_LEVEL") ||
+
       !GetPathEnv(L"TEST_UNDECLARED_OUTPUTS_MANIFEST", &(result->manifest)) ||
       !UnsetEnv(L"TEST_UNDECLARED_OUTPUTS_MANIFEST") ||
 
@@ -1083,6 +1459,13 @@ bool GetAndUnexportUndeclaredOutputsEnvvars(const Path& cwd,
     return false;
   }
 
+  result->compress = compress == L"1";
+  // Anything but a level from 1 to 9 leaves the default.
+  int level;
+  result->compression_level = ToInt(compression_level.c_str(), &level) &&
+                                      level >= 1 && level <= 9
+                                  ? level
+                                  : devtools_ijar::kDefaultDeflateLevel;
   result->root.Absolutize(cwd);
   result->annotations_dir.Absolutize(cwd);
   result->zip.Absolutize(cwd);
@@ -1225,10 +1608,51 @@ bool CreateCommandLine(const Path& path, const std::wstring& args,
   return true;
 }
 
+// Creates a pipe whose reading end supports overlapped I/O, which anonymous
+// pipes don't, and whose buffer is large enough that a chatty subprocess
+// rarely has to wait for the reader.
+//
+// The reading end is not inheritable; the writing end is if `write_sa` says
+// so.
+bool CreateOverlappedPipe(SECURITY_ATTRIBUTES* write_sa,
+                          bazel::windows::AutoHandle* read,
+                          bazel::windows::AutoHandle* write) {
+  static constexpr DWORD kPipeBufferSize = 0x100000;  // 1 MB
+  static LONG counter = 0;
+
+  std::wstringstream name;
+  name << L"\\\\.\\pipe\\bazel-tw-" << GetCurrentProcessId() << L"-"
+       << InterlockedIncrement(&counter);
+  HANDLE read_h = CreateNamedPipeW(
+      name.str().c_str(),
+      PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED |
+          FILE_FLAG_FIRST_PIPE_INSTANCE,
+      PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT |
+          PIPE_REJECT_REMOTE_CLIENTS,
+      1, 0, kPipeBufferSize, 0, nullptr);
+  if (read_h == INVALID_HANDLE_VALUE) {
+    DWORD err = GetLastError();
+    LogErrorWithValue(__LINE__, "CreateNamedPipeW", err);
+    return false;
+  }
+  *read = read_h;
+
+  HANDLE write_h = CreateFileW(name.str().c_str(), GENERIC_WRITE, 0, write_sa,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (write_h == INVALID_HANDLE_VALUE) {
+    DWORD err = GetLastError();
+    LogErrorWithValue(__LINE__, "CreateFileW", err);
+    return false;
+  }
+  *write = write_h;
+  return true;
+}
+
 bool StartSubprocess(const Path& path, const std::wstring& args,
-                     const Path& outerr, std::unique_ptr<Tee>* tee,
-                     LARGE_INTEGER* start_time,
-                     bazel::windows::WaitableProcess* process) {
+                     const Path& outerr, const bool tee_to_stdout,
+                     std::unique_ptr<Tee>* tee, LARGE_INTEGER* start_time,
+                     bazel::windows::WaitableProcess* process,
+                     LogStream* stream = nullptr) {
   SECURITY_ATTRIBUTES inheritable_handle_sa = {sizeof(SECURITY_ATTRIBUTES),
                                                nullptr, TRUE};
 
@@ -1237,13 +1661,10 @@ bool StartSubprocess(const Path& path, const std::wstring& args,
   // for stderr). This process closes its copies of the handles.
   // This process keeps the reading end and streams data from the pipe to the
   // test log and to stdout.
-  HANDLE pipe_read_h, pipe_write_h;
-  if (!CreatePipe(&pipe_read_h, &pipe_write_h, &inheritable_handle_sa, 0)) {
-    DWORD err = GetLastError();
-    LogErrorWithValue(__LINE__, "CreatePipe", err);
+  bazel::windows::AutoHandle pipe_read, pipe_write;
+  if (!CreateOverlappedPipe(&inheritable_handle_sa, &pipe_read, &pipe_write)) {
     return false;
   }
-  bazel::windows::AutoHandle pipe_read(pipe_read_h), pipe_write(pipe_write_h);
 
   // Duplicate the write end of the pipe.
   // The original will be connected to the stdout of the process, the duplicate
@@ -1278,20 +1699,32 @@ bool StartSubprocess(const Path& path, const std::wstring& args,
   }
 
   // Duplicate stdout's handle, and pass it to the tee thread, who will own it
-  // and close it in the end.
+  // and close it in the end. If the output should not go to stdout, the tee
+  // thread writes it to NUL instead.
   HANDLE stdout_dup_h;
-  if (!DuplicateHandle(GetCurrentProcess(), GetStdHandle(STD_OUTPUT_HANDLE),
-                       GetCurrentProcess(), &stdout_dup_h, 0, FALSE,
-                       DUPLICATE_SAME_ACCESS)) {
-    DWORD err = GetLastError();
-    LogErrorWithValue(__LINE__, "DuplicateHandle", err);
-    return false;
+  if (tee_to_stdout) {
+    if (!DuplicateHandle(GetCurrentProcess(), GetStdHandle(STD_OUTPUT_HANDLE),
+                         GetCurrentProcess(), &stdout_dup_h, 0, FALSE,
+                         DUPLICATE_SAME_ACCESS)) {
+      DWORD err = GetLastError();
+      LogErrorWithValue(__LINE__, "DuplicateHandle", err);
+      return false;
+    }
+  } else {
+    stdout_dup_h = CreateFileW(L"NUL", GENERIC_WRITE,
+                               FILE_SHARE_WRITE | FILE_SHARE_READ, nullptr,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (stdout_dup_h == INVALID_HANDLE_VALUE) {
+      DWORD err = GetLastError();
+      LogErrorWithValue(__LINE__, "CreateFileW", err);
+      return false;
+    }
   }
   bazel::windows::AutoHandle stdout_dup(stdout_dup_h);
 
   // Create the tee thread, and transfer ownerships of the `pipe_read`,
   // `test_outerr`, and `stdout_dup` handles.
-  if (!TeeImpl::Create(&pipe_read, &test_outerr, &stdout_dup, tee)) {
+  if (!TeeImpl::Create(&pipe_read, &test_outerr, &stdout_dup, tee, stream)) {
     LogError(__LINE__);
     return false;
   }
@@ -1333,7 +1766,8 @@ bool ArchiveUndeclaredOutputs(const UndeclaredOutputs& undecl) {
   if (files.empty()) {
     return true;
   }
-  return CreateZip(undecl.root, files, undecl.zip) &&
+  return CreateZip(undecl.root, files, undecl.zip, undecl.compress,
+                   undecl.compression_level) &&
          CreateUndeclaredOutputsManifest(files, undecl.manifest) &&
          RemoveRelativeRecursively(undecl.root, files);
 }
@@ -1368,19 +1802,44 @@ bool CreateUndeclaredOutputsAnnotations(const Path& undecl_annot_dir,
     return false;
   }
 
+  // Only consume "*.part" files.
+  std::vector<const FileInfo*> parts;
   for (const auto& e : files) {
     if (!e.IsDirectory() &&
         e.RelativePath().rfind(L".part") == e.RelativePath().size() - 5) {
-      // Only consume "*.part" files.
-      Path path;
-      if (!path.Set(undecl_annot_dir.Get() + L"\\" + e.RelativePath()) ||
-          !AppendFileTo(path, e.Size(), handle)) {
-        LogErrorWithArg2(__LINE__, "Failed to append file to another",
-                         path.Get(), output.Get());
-        return false;
-      }
+      parts.push_back(&e);
     }
   }
+
+  // The parts are read on several threads, and written at once. They are
+  // annotations, so even many of them add up to little memory.
+  std::vector<std::string> contents;
+  if (!ParallelForRanges(
+          parts.size(), &contents,
+          [&undecl_annot_dir, &parts, &output](size_t begin, size_t end,
+                                               std::string* content) {
+            for (size_t i = begin; i < end; ++i) {
+              Path path;
+              if (!path.Set(undecl_annot_dir.Get() + L"\\" +
+                            parts[i]->RelativePath()) ||
+                  !AppendFileToString(path, parts[i]->Size(), content)) {
+                LogErrorWithArg2(__LINE__, "Failed to append file to another",
+                                 path.Get(), output.Get());
+                return false;
+              }
+            }
+            return true;
+          })) {
+    return false;
+  }
+  std::string content;
+  for (const auto& part : contents) {
+    content.append(part);
+  }
+  if (!WriteToFile(handle, content.data(), content.size())) {
+    LogErrorWithArg(__LINE__, "Failed to write file", output.Get());
+    return false;
+  }
   return true;
 }
 
@@ -1438,11 +1897,119 @@ bool ParseXmlWriterArgs(int argc, wchar_t** argv, const Path& cwd,
   return true;
 }
 
+// Copies the test log, as it is written, to where the server reads it while
+// the test runs: the file or named pipe at TEST_LOG_STREAM, which the server
+// opens before it starts the test wrapper. The server can then show progress,
+// watch for flakiness or upload the log without waiting for the test to end,
+// and without running the tests one at a time like --test_output=streamed.
+//
+// The test never waits for the server: the log is copied into a ring buffer
+// that a background thread writes out, and what does not fit is dropped.
+// test.log stays complete.
+class LogStream {
+ public:
+  // Takes ownership of `output`.
+  explicit LogStream(HANDLE output);
+  ~LogStream() { Close(); }
+
+  // Copies the data to the ring buffer, or as much of it as fits.
+  void Append(const uint8_t* data, DWORD size);
+
+  // Writes out what is left in the buffer, and closes the output. Data that is
+  // appended afterwards is dropped.
+  void Close();
+
+ private:
+  static constexpr size_t kBufferSize = 4 << 20;  // 4 MiB
+
+  void Work();
+
+  bazel::windows::AutoHandle output_;
+  std::unique_ptr<uint8_t[]> buffer_;
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  // The buffered data starts at `begin_` and is `size_` bytes long, wrapping
+  // around the end of the buffer.
+  size_t begin_;
+  size_t size_;
+  size_t dropped_;
+  bool closed_;
+  std::thread thread_;
+};
+
+LogStream::LogStream(HANDLE output)
+    : output_(output),
+      buffer_(new uint8_t[kBufferSize]),
+      begin_(0),
+      size_(0),
+      dropped_(0),
+      closed_(false),
+      thread_(&LogStream::Work, this) {}
+
+void LogStream::Append(const uint8_t* data, DWORD size) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_) {
+      return;
+    }
+    size_t n = std::min<size_t>(size, kBufferSize - size_);
+    dropped_ += size - n;
+    size_t end = (begin_ + size_) % kBufferSize;
+    size_t first = std::min(n, kBufferSize - end);
+    memcpy(buffer_.get() + end, data, first);
+    memcpy(buffer_.get(), data + first, n - first);
+    size_ += n;
+  }
+  changed_.notify_one();
+}
+
+void LogStream::Close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+  }
+  changed_.notify_one();
+  if (!thread_.joinable()) {
+    return;
+  }
+  thread_.join();
+  if (dropped_ > 0) {
+    LogErrorWithValue(__LINE__, "Bytes of the log not streamed",
+                      static_cast<DWORD>(dropped_));
+  }
+}
+
+void LogStream::Work() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    changed_.wait(lock, [this]() { return closed_ || size_ > 0; });
+    if (size_ == 0) {
+      return;
+    }
+    // The part up to the end of the buffer. Append() doesn't touch it while
+    // it is written out.
+    const uint8_t* data = buffer_.get() + begin_;
+    size_t n = std::min(size_, kBufferSize - begin_);
+    lock.unlock();
+    bool ok = WriteToFile(output_, data, n);
+    lock.lock();
+    if (!ok) {
+      // The server went away. The test goes on.
+      closed_ = true;
+      dropped_ += size_;
+      size_ = 0;
+      return;
+    }
+    begin_ = (begin_ + n) % kBufferSize;
+    size_ -= n;
+  }
+}
+
 bool TeeImpl::Create(bazel::windows::AutoHandle* input,
                      bazel::windows::AutoHandle* output1,
                      bazel::windows::AutoHandle* output2,
-                     std::unique_ptr<Tee>* result) {
-  std::unique_ptr<TeeImpl> tee(new TeeImpl(input, output1, output2));
+                     std::unique_ptr<Tee>* result, LogStream* stream) {
+  std::unique_ptr<TeeImpl> tee(new TeeImpl(input, output1, output2, stream));
   bazel::windows::AutoHandle thread(
       CreateThread(nullptr, 0, ThreadFunc, tee.get(), 0, nullptr));
   if (!thread.IsValid()) {
@@ -1457,25 +2024,111 @@ DWORD WINAPI TeeImpl::ThreadFunc(LPVOID lpParam) {
 }
 
 bool TeeImpl::MainFunc() const {
-  static constexpr size_t kBufferSize = 0x10000;
-  DWORD read;
-  uint8_t content[kBufferSize];
-  while (ReadFile(input_, content, kBufferSize, &read, nullptr)) {
-    DWORD written;
-    if (read > 0 && (!WriteFile(output1_, content, read, &written, nullptr) ||
-                     !WriteFile(output2_, content, read, &written, nullptr))) {
+  // The input is the reading end of an overlapped pipe. While one buffer is
+  // written to the outputs, the next read into the other buffer is already
+  // pending, so the subprocess can keep writing even if the outputs (the
+  // console, in particular) are slow.
+  static constexpr DWORD kBufferSize = 0x100000;  // 1 MB
+  std::unique_ptr<uint8_t[]> buffers[2] = {
+      std::unique_ptr<uint8_t[]>(new uint8_t[kBufferSize]),
+      std::unique_ptr<uint8_t[]>(new uint8_t[kBufferSize])};
+  bazel::windows::AutoHandle event(CreateEventW(nullptr, TRUE, FALSE, nullptr));
+  if (!event.IsValid()) {
+    return false;
+  }
+  OVERLAPPED overlapped = {};
+  overlapped.hEvent = event;
+
+  // Starts reading into `buffer`. Returns false if there is nothing left to
+  // read, i.e. all writing ends of the pipe are closed.
+  auto start_read = [this, &overlapped](uint8_t* buffer) {
+    return ReadFile(input_, buffer, kBufferSize, nullptr, &overlapped) ||
+           GetLastError() == ERROR_IO_PENDING;
+  };
+
+  int current = 0;
+  if (!start_read(buffers[current].get())) {
+    return true;
+  }
+  while (true) {
+    DWORD read;
+    if (!GetOverlappedResult(input_, &overlapped, &read, TRUE)) {
+      // ERROR_BROKEN_PIPE: the subprocess closed its ends of the pipe.
+      return true;
+    }
+    const uint8_t* content = buffers[current].get();
+    current ^= 1;
+    const bool pending = start_read(buffers[current].get());
+    if (read > 0 && stream_) {
+      stream_->Append(content, read);
+    }
+    if (read > 0 && (!WriteToFile(output1_, content, read) ||
+                     !WriteToFile(output2_, content, read))) {
+      if (pending) {
+        // Don't let the pending read outlive the buffer.
+        CancelIoEx(input_, &overlapped);
+        GetOverlappedResult(input_, &overlapped, &read, TRUE);
+      }
       return false;
     }
+    if (!pending) {
+      return true;
+    }
+  }
+}
+
+// Sets `duration` to the time between two QueryPerformanceCounter readings,
+// rounded to seconds.
+void SetDuration(const LARGE_INTEGER& start, const LARGE_INTEGER& end,
+                 Duration* duration) {
+  LARGE_INTEGER freq;
+  QueryPerformanceFrequency(&freq);
+  const decltype(LARGE_INTEGER::QuadPart) elapsed =
+      end.QuadPart - start.QuadPart;
+  decltype(LARGE_INTEGER::QuadPart) seconds;
+  // Compute the number of seconds the test ran for.
+  seconds = elapsed / freq.QuadPart;
+  // Check the remainder: if it's at least 0.5 seconds, round up.
+  if ((elapsed - seconds * freq.QuadPart) * 2 >= freq.QuadPart) {
+    seconds += 1;
+  }
+  duration->seconds = (seconds > Duration::kMax) ? Duration::kMax : seconds;
+}
+
+// Opens the stream at TEST_LOG_STREAM, if the server asked for one, and
+// unexports the variable. Failing to open it is not an error: the server
+// reads test.log at the end, as without a stream.
+bool GetAndUnexportLogStream(std::unique_ptr<LogStream>* result) {
+  std::wstring path;
+  if (!GetEnv(L"TEST_LOG_STREAM", &path) || !UnsetEnv(L"TEST_LOG_STREAM")) {
+    return false;
+  }
+  if (path.empty()) {
+    return true;
+  }
+  // Not a Path: the name of a pipe, like \\.\pipe\bazel-1234, is passed as
+  // it is.
+  HANDLE handle = CreateFileW(path.c_str(), GENERIC_WRITE,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (handle == INVALID_HANDLE_VALUE) {
+    DWORD err = GetLastError();
+    LogErrorWithArgAndValue(__LINE__, "Failed to open the log stream", path,
+                            err);
+    return true;
   }
+  result->reset(new LogStream(handle));
   return true;
 }
 
 int RunSubprocess(const Path& test_path, const std::wstring& args,
-                  const Path& test_outerr, Duration* test_duration) {
+                  const Path& test_outerr, Duration* test_duration,
+                  LogStream* stream) {
   std::unique_ptr<Tee> tee;
   bazel::windows::WaitableProcess process;
-  LARGE_INTEGER start, end, freq;
-  if (!StartSubprocess(test_path, args, test_outerr, &tee, &start, &process)) {
+  LARGE_INTEGER start, end;
+  if (!StartSubprocess(test_path, args, test_outerr, /* tee_to_stdout */ true,
+                       &tee, &start, &process, stream)) {
     LogErrorWithArg(__LINE__, "Failed to start test process", test_path.Get());
     return 1;
   }
@@ -1494,17 +2147,7 @@ int RunSubprocess(const Path& test_path, const std::wstring& args,
     return 1;
   }
 
-  QueryPerformanceFrequency(&freq);
-  end.QuadPart -= start.QuadPart;
-  decltype(LARGE_INTEGER::QuadPart) seconds;
-  // Compute the number of seconds the test ran for.
-  seconds = end.QuadPart / freq.QuadPart;
-  // Check the remainder: if it's at least 0.5 seconds, round up.
-  if ((end.QuadPart - seconds * freq.QuadPart) * 2 >= freq.QuadPart) {
-    seconds += 1;
-  }
-  test_duration->seconds =
-      (seconds > Duration::kMax) ? Duration::kMax : seconds;
+  SetDuration(start, end, test_duration);
   return result;
 }
 
@@ -1528,32 +2171,47 @@ int RunSubprocess(const Path& test_path, const std::wstring& args,
 //
 // Every octet-sequence matching one of these regexps will be left alone, all
 // other octet-sequences will be replaced by '?' characters.
-bool CdataEscape(IFStream* in, std::basic_ostream<char>* out) {
-  int c0 = in->Get();
+//
+// Escapes the first `max_bytes` bytes of the input (or a few more, to finish
+// the last sequence) if `max_bytes` is not negative, otherwise all of it.
+bool CdataEscape(IFStream* in, std::basic_ostream<char>* out,
+                 int64_t max_bytes) {
+  // The escaped output is collected here and written in large chunks, which
+  // is much faster than writing to `out` one octet at a time.
+  static constexpr size_t kChunkSize = 0x10000;  // 64 KB
+  std::string chunk;
+  chunk.reserve(kChunkSize + 32);
+  auto flush = [&chunk, out]() {
+    out->write(chunk.data(), chunk.size());
+    chunk.clear();
+    return out->good();
+  };
+
+  int64_t consumed = 0;
+  int c0 = IFStream::kIFStreamErrorEOF;
   uint8_t p[3];
-  for (; c0 < 256; c0 = in->Get()) {
+  while (max_bytes < 0 || consumed < max_bytes) {
+    c0 = in->Get();
+    if (c0 >= 256) {
+      break;
+    }
+    consumed++;
     if (c0 == ']' && in->Peek(2, p) == 2 && p[0] == ']' && p[1] == '>') {
-      *out << "]]>]]<![CDATA[>";
-      if (!out->good()) {
-        return false;
-      }
+      chunk.append("]]>]]<![CDATA[>");
       (void)in->Get();
       (void)in->Get();
+      consumed += 2;
     } else if (c0 == 0x9 || c0 == 0xA || c0 == 0xD ||
                (c0 >= 0x20 && c0 <= 0x7F)) {
       // Matched legal single-octet sequence.
-      *out << (char)c0;
-      if (!out->good()) {
-        return false;
-      }
+      chunk.push_back((char)c0);
     } else if (c0 >= 0xC0 && c0 <= 0xDF && in->Peek(1, p) == 1 &&
                p[0] >= 0x80 && p[0] <= 0xBF) {
       // Matched legal double-octet sequence. Skip the next octet.
-      *out << (char)c0 << (char)p[0];
-      if (!out->good()) {
-        return false;
-      }
+      chunk.push_back((char)c0);
+      chunk.push_back((char)p[0]);
       (void)in->Get();
+      consumed += 1;
     } else if (in->Peek(2, p) == 2 &&
                ((c0 >= 0xE0 && c0 <= 0xEC && p[0] >= 0x80 && p[0] <= 0xBF &&
                  p[1] >= 0x80 && p[1] <= 0xBF) ||
@@ -1565,32 +2223,34 @@ bool CdataEscape(IFStream* in, std::basic_ostream<char>* out) {
                  p[1] <= 0xBF) ||
                 (c0 == 0xEF && p[0] == 0xBF && p[1] >= 0x80 && p[1] <= 0xBD))) {
       // Matched legal triple-octet sequence. Skip the next two octets.
-      *out << (char)c0 << (char)p[0] << (char)p[1];
-      if (!out->good()) {
-        return false;
-      }
+      chunk.push_back((char)c0);
+      chunk.append(reinterpret_cast<const char*>(p), 2);
       (void)in->Get();
       (void)in->Get();
+      consumed += 2;
     } else if (in->Peek(3, p) == 3 && c0 >= 0xF0 && c0 <= 0xF7 &&
                p[0] >= 0x80 && p[0] <= 0xBF && p[1] >= 0x80 && p[1] <= 0xBF &&
                p[2] >= 0x80 && p[2] <= 0xBF) {
       // Matched legal quadruple-octet sequence. Skip the next three octets.
-      *out << (char)c0 << (char)p[0] << (char)p[1] << (char)p[2];
-      if (!out->good()) {
-        return false;
-      }
+      chunk.push_back((char)c0);
+      chunk.append(reinterpret_cast<const char*>(p), 3);
       (void)in->Get();
       (void)in->Get();
       (void)in->Get();
+      consumed += 3;
     } else {
       // Illegal octet; replace.
-      *out << (char)'?';
-      if (!out->good()) {
-        return false;
-      }
+      chunk.push_back('?');
+    }
+    if (chunk.size() >= kChunkSize && !flush()) {
+      return false;
     }
   }
-  return c0 == IFStream::kIFStreamErrorEOF;
+  return flush() && c0 != IFStream::kIFStreamErrorIO;
+}
+
+bool CdataEscape(IFStream* in, std::basic_ostream<char>* out) {
+  return CdataEscape(in, out, -1);
 }
 
 bool GetTestName(std::wstring* result) {
@@ -1745,11 +2405,50 @@ bool CreateXmlLog(const Path& output, const Path& test_outerr,
     return false;
   }
 
-  // Encode test log to make it embeddable in CDATA.
-  if (!CdataEscape(istm.get(), &ostm)) {
-    LogError(__LINE__, output.Get().c_str());
+  // Encode test log to make it embeddable in CDATA. If the log is larger than
+  // %TEST_XML_MAX_LOG_BYTES%, only embed its head and its tail; the full log
+  // is in test.log anyway.
+  std::wstring max_log_bytes_str;
+  int max_log_bytes = 0;
+  LARGE_INTEGER log_size;
+  if (!GetIntEnv(L"TEST_XML_MAX_LOG_BYTES", &max_log_bytes_str,
+                 &max_log_bytes)) {
+    LogError(__LINE__);
     return false;
   }
+  if (!GetFileSizeEx(test_log, &log_size)) {
+    DWORD err = GetLastError();
+    LogErrorWithArgAndValue(__LINE__, "Failed to get file size",
+                            test_outerr.Get(), err);
+    return false;
+  }
+  if (max_log_bytes <= 0 || log_size.QuadPart <= max_log_bytes) {
+    if (!CdataEscape(istm.get(), &ostm)) {
+      LogError(__LINE__, output.Get().c_str());
+      return false;
+    }
+  } else {
+    const int64_t head = max_log_bytes / 2;
+    LARGE_INTEGER tail_start;
+    tail_start.QuadPart = log_size.QuadPart - (max_log_bytes - head);
+    if (!CdataEscape(istm.get(), &ostm, head)) {
+      LogError(__LINE__, output.Get().c_str());
+      return false;
+    }
+    ostm << "\n[... " << (tail_start.QuadPart - head)
+         << " bytes omitted, see the test log ...]\n";
+    if (!SetFilePointerEx(test_log, tail_start, nullptr, FILE_BEGIN)) {
+      DWORD err = GetLastError();
+      LogErrorWithArgAndValue(__LINE__, "Failed to seek in file",
+                              test_outerr.Get(), err);
+      return false;
+    }
+    std::unique_ptr<IFStream> tail_stm(IFStreamImpl::Create(test_log));
+    if (tail_stm == nullptr || !CdataEscape(tail_stm.get(), &ostm)) {
+      LogError(__LINE__, output.Get().c_str());
+      return false;
+    }
+  }
 
   // Append CDATA end and closing tags.
   ostm << "]]></system-out>\n</testsuite>\n</testsuites>\n";
@@ -1760,6 +2459,261 @@ bool CreateXmlLog(const Path& output, const Path& test_outerr,
   return true;
 }
 
+// Returns the number of shards that the test wrapper should run at the same
+// time, or 0 if it should run the test as usual.
+//
+// %TEST_WRAPPER_PARALLEL_SHARDS% opts into running the test binary as that
+// many shards in this one wrapper process, which saves each of them the
+// action and wrapper setup. Bazel's own sharding takes precedence.
+bool GetAndUnexportParallelShards(int* result) {
+  *result = 0;
+  std::wstring shards_str, total_shards_str;
+  int shards = 0, total_shards = 0;
+  if (!GetIntEnv(L"TEST_WRAPPER_PARALLEL_SHARDS", &shards_str, &shards) ||
+      !UnsetEnv(L"TEST_WRAPPER_PARALLEL_SHARDS") ||
+      !GetIntEnv(L"TEST_TOTAL_SHARDS", &total_shards_str, &total_shards)) {
+    return false;
+  }
+  if (shards > 1 && total_shards == 0) {
+    *result = shards;
+  }
+  return true;
+}
+
+// Returns the affinity mask for shard `index` out of `shards`: shards get
+// disjoint sets of the CPUs this process may run on, or share them
+// round-robin if there are more shards than CPUs. Returns 0 if the affinity
+// is unknown.
+DWORD_PTR GetShardAffinity(const int index, const int shards) {
+  DWORD_PTR process_mask, system_mask;
+  if (!GetProcessAffinityMask(GetCurrentProcess(), &process_mask,
+                              &system_mask)) {
+    return 0;
+  }
+  std::vector<DWORD_PTR> cpus;
+  for (DWORD_PTR bit = 1; bit != 0; bit <<= 1) {
+    if (process_mask & bit) {
+      cpus.push_back(bit);
+    }
+  }
+  if (cpus.empty()) {
+    return 0;
+  }
+  if (cpus.size() <= static_cast<size_t>(shards)) {
+    return cpus[index % cpus.size()];
+  }
+  DWORD_PTR mask = 0;
+  for (size_t i = cpus.size() * index / shards;
+       i < cpus.size() * (index + 1) / shards; ++i) {
+    mask |= cpus[i];
+  }
+  return mask;
+}
+
+// Sets the sharding environment of shard `index`, which the shard's
+// subprocess inherits.
+bool ExportShardEnvvars(const int index, const int shards,
+                        const Path& test_tmpdir, const Path& shard_xml,
+                        Path* shard_tmpdir) {
+  std::wstringstream index_str, shards_str;
+  index_str << index;
+  shards_str << shards;
+  Path status_file;
+  if (!shard_tmpdir->Set(test_tmpdir.Get() + L"\\shard_" + index_str.str()) ||
+      !CreateDirectories(*shard_tmpdir) ||
+      !status_file.Set(shard_tmpdir->Get() + L"\\shard_status")) {
+    return false;
+  }
+  const std::wstring xml = AsMixedPath(shard_xml.Get());
+  return SetEnv(L"TEST_TOTAL_SHARDS", shards_str.str()) &&
+         SetEnv(L"TEST_SHARD_INDEX", index_str.str()) &&
+         SetPathEnv(L"TEST_SHARD_STATUS_FILE", status_file) &&
+         SetPathEnv(L"TEST_TMPDIR", *shard_tmpdir) &&
+         SetEnv(L"GTEST_TOTAL_SHARDS", shards_str.str()) &&
+         SetEnv(L"GTEST_SHARD_INDEX", index_str.str()) &&
+         SetPathEnv(L"GTEST_SHARD_STATUS_FILE", status_file) &&
+         SetPathEnv(L"GTEST_TMP_DIR", *shard_tmpdir) &&
+         SetEnv(L"XML_OUTPUT_FILE", xml) &&
+         SetEnv(L"GUNIT_OUTPUT", L"xml:" + xml);
+}
+
+// Appends the <testsuite> elements of the XML file `shard_xml` to `out`.
+bool AppendTestSuites(const Path& shard_xml, std::ostream* out) {
+  std::ifstream in(AddUncPrefixMaybe(shard_xml).c_str(),
+                   std::ios_base::in | std::ios_base::binary);
+  if (!in.is_open()) {
+    LogErrorWithArg(__LINE__, "Failed to open file", shard_xml.Get());
+    return false;
+  }
+  std::stringstream content_stm;
+  content_stm << in.rdbuf();
+  const std::string content = content_stm.str();
+
+  size_t begin = 0, end = content.size();
+  const size_t suites = content.find("<testsuites");
+  if (suites != std::string::npos) {
+    begin = content.find('>', suites);
+    begin = begin == std::string::npos ? end : begin + 1;
+    const size_t suites_end = content.rfind("</testsuites>");
+    if (suites_end != std::string::npos && suites_end >= begin) {
+      end = suites_end;
+    }
+  } else if (content.compare(0, 5, "<?xml") == 0) {
+    begin = content.find("?>");
+    begin = begin == std::string::npos ? end : begin + 2;
+  }
+  out->write(content.data() + begin, end - begin);
+  return out->good();
+}
+
+// Runs the test as `shards` shards at the same time, each with its own
+// TEST_TMPDIR, test log, and XML file, and pinned to its own CPUs. Then
+// appends the logs to `test_outerr` and to stdout in shard order, and merges
+// the XML files into `xml_log`. The shards share the undeclared outputs
+// directory.
+//
+// Returns the exit code of the first failing shard, or 0.
+int RunShardsInParallel(const Path& test_path, const std::wstring& args,
+                        const Path& test_tmpdir, const Path& test_outerr,
+                        const Path& xml_log, const int shards,
+                        Duration* test_duration) {
+  std::vector<Path> shard_outerrs(shards), shard_xmls(shards);
+  std::vector<std::unique_ptr<Tee>> tees(shards);
+  std::vector<bazel::windows::WaitableProcess> processes(shards);
+  std::vector<LARGE_INTEGER> starts(shards), ends(shards);
+
+  DWORD_PTR process_mask = 0, system_mask = 0;
+  const bool has_affinity = GetProcessAffinityMask(
+      GetCurrentProcess(), &process_mask, &system_mask);
+  // Subprocesses inherit the affinity of this process, so restore it once all
+  // shards are running.
+  Defer restore_affinity([has_affinity, process_mask]() {
+    if (has_affinity) {
+      SetProcessAffinityMask(GetCurrentProcess(), process_mask);
+    }
+  });
+
+  for (int i = 0; i < shards; ++i) {
+    std::wstringstream suffix;
+    suffix << L".shard_" << i;
+    Path shard_tmpdir;
+    if (!shard_outerrs[i].Set(test_outerr.Get() + suffix.str()) ||
+        !shard_xmls[i].Set(xml_log.Get() + suffix.str() + L".xml") ||
+        !ExportShardEnvvars(i, shards, test_tmpdir, shard_xmls[i],
+                            &shard_tmpdir)) {
+      LogError(__LINE__);
+      return 1;
+    }
+
+    const DWORD_PTR affinity = GetShardAffinity(i, shards);
+    if (affinity != 0 &&
+        !SetProcessAffinityMask(GetCurrentProcess(), affinity)) {
+      DWORD err = GetLastError();
+      LogErrorWithValue(__LINE__, "SetProcessAffinityMask", err);
+    }
+
+    if (!StartSubprocess(test_path, args, shard_outerrs[i],
+                         /* tee_to_stdout */ false, &tees[i], &starts[i],
+                         &processes[i])) {
+      LogErrorWithArg(__LINE__, "Failed to start test process",
+                      test_path.Get());
+      return 1;
+    }
+  }
+  restore_affinity.DoNow();
+
+  int result = 0;
+  std::vector<int> exit_codes(shards);
+  for (int i = 0; i < shards; ++i) {
+    std::wstring werror;
+    int wait_res = processes[i].WaitFor(-1, &ends[i], &werror);
+    if (wait_res != bazel::windows::WaitableProcess::kWaitSuccess) {
+      LogErrorWithValue(__LINE__, werror, wait_res);
+      return 1;
+    }
+    werror.clear();
+    exit_codes[i] = processes[i].GetExitCode(&werror);
+    if (!werror.empty()) {
+      LogError(__LINE__, werror);
+      return 1;
+    }
+    if (result == 0) {
+      result = exit_codes[i];
+    }
+  }
+  LARGE_INTEGER first_start = starts[0], last_end = ends[0];
+  for (int i = 1; i < shards; ++i) {
+    first_start.QuadPart = std::min(first_start.QuadPart, starts[i].QuadPart);
+    last_end.QuadPart = std::max(last_end.QuadPart, ends[i].QuadPart);
+  }
+  SetDuration(first_start, last_end, test_duration);
+
+  bazel::windows::AutoHandle outerr;
+  if (!OpenFileForWriting(test_outerr, &outerr)) {
+    LogErrorWithArg(__LINE__, "Failed to open file for writing",
+                    test_outerr.Get());
+    return 1;
+  }
+  bool any_xml = false;
+  for (int i = 0; i < shards; ++i) {
+    std::stringstream header;
+    header << "==================== Shard " << i << " of " << shards
+           << " (exit code " << exit_codes[i] << ") ====================\n";
+    WriteStdout(header.str());
+    if (!WriteToFile(outerr, header.str().c_str(), header.str().size()) ||
+        !AppendFileTo(shard_outerrs[i], /* 1 MB */ 0x100000, outerr) ||
+        !AppendFileTo(shard_outerrs[i], /* 1 MB */ 0x100000,
+                      GetStdHandle(STD_OUTPUT_HANDLE))) {
+      LogErrorWithArg(__LINE__, "Failed to append shard log",
+                      shard_outerrs[i].Get());
+      return 1;
+    }
+
+    // Write the shard's XML file from its log unless the test did. The test
+    // name in it includes the shard index.
+    Duration shard_duration;
+    SetDuration(starts[i], ends[i], &shard_duration);
+    std::wstringstream index_str;
+    index_str << i;
+    if (!SetEnv(L"TEST_SHARD_INDEX", index_str.str()) ||
+        !CreateXmlLog(shard_xmls[i], shard_outerrs[i], shard_duration,
+                      exit_codes[i], DeleteAfterwards::kDisabled,
+                      MainType::kTestWrapperMain)) {
+      return 1;
+    }
+    DeleteFileW(AddUncPrefixMaybe(shard_outerrs[i]).c_str());
+    any_xml = any_xml || IsReadableFile(shard_xmls[i]);
+  }
+
+  // The merged XML file, if this wrapper writes it from the test log, is for
+  // the whole test.
+  if (!UnsetEnv(L"TEST_TOTAL_SHARDS") || !UnsetEnv(L"TEST_SHARD_INDEX")) {
+    return 1;
+  }
+
+  if (any_xml) {
+    std::ofstream xml(
+        AddUncPrefixMaybe(xml_log).c_str(),
+        std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    xml << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<testsuites>\n";
+    for (int i = 0; i < shards; ++i) {
+      if (IsReadableFile(shard_xmls[i]) &&
+          !AppendTestSuites(shard_xmls[i], &xml)) {
+        LogErrorWithArg(__LINE__, "Failed to merge XML file",
+                        shard_xmls[i].Get());
+        return 1;
+      }
+      DeleteFileW(AddUncPrefixMaybe(shard_xmls[i]).c_str());
+    }
+    xml << "</testsuites>\n";
+    if (!xml.good()) {
+      LogErrorWithArg(__LINE__, "Failed to write XML file", xml_log.Get());
+      return 1;
+    }
+  }
+  return result;
+}
+
 bool Duration::FromString(const wchar_t* str) {
   int result;
   if (!ToInt(str, &result)) {
@@ -1947,8 +2901,25 @@ int TestWrapperMain(int argc, wchar_t** argv) {
     return 1;
   }
 
+  int parallel_shards;
+  std::unique_ptr<LogStream> log_stream;
+  if (!GetAndUnexportParallelShards(&parallel_shards) ||
+      !GetAndUnexportLogStream(&log_stream)) {
+    return 1;
+  }
+
+  // The logs of parallel shards are only put together at the end, so they
+  // aren't streamed.
   Duration test_duration;
-  int result = RunSubprocess(test_path, args, test_outerr, &test_duration);
+  int result =
+      parallel_shards > 1
+          ? RunShardsInParallel(test_path, args, tmpdir, test_outerr, xml_log,
+                                parallel_shards, &test_duration)
+          : RunSubprocess(test_path, args, test_outerr, &test_duration,
+                          log_stream.get());
+  if (log_stream) {
+    log_stream->Close();
+  }
   if (!CreateXmlLog(xml_log, test_outerr, test_duration, result,
                     DeleteAfterwards::kEnabled, MainType::kTestWrapperMain) ||
       !ArchiveUndeclaredOutputs(undecl) ||
@@ -1999,17 +2970,23 @@ bool TestOnly_ToZipEntryPaths(const std::wstring& abs_root,
 
 bool TestOnly_CreateZip(const std::wstring& abs_root,
                         const std::vector<FileInfo>& files,
-                        const std::wstring& abs_zip) {
+                        const std::wstring& abs_zip, bool compress) {
   Path root, zip;
   return blaze_util::IsAbsolute(abs_root) && root.Set(abs_root) &&
          blaze_util::IsAbsolute(abs_zip) && zip.Set(abs_zip) &&
-         CreateZip(root, files, zip);
+         CreateZip(root, files, zip, compress,
+                   devtools_ijar::kDefaultDeflateLevel);
 }
 
 std::string TestOnly_GetMimeType(const std::string& filename) {
   return GetMimeType(filename);
 }
 
+bool TestOnly_AppendTestSuites(const std::wstring& abs_xml, std::ostream* out) {
+  Path path;
+  return path.Set(abs_xml) && AppendTestSuites(path, out);
+}
+
 bool TestOnly_CreateUndeclaredOutputsManifest(
     const std::vector<FileInfo>& files, std::string* result) {
   return CreateUndeclaredOutputsManifestContent(files, result);
@@ -2035,8 +3012,14 @@ bool TestOnly_CreateTee(bazel::windows::AutoHandle* input,
   return TeeImpl::Create(input, output1, output2, result);
 }
 
-bool TestOnly_CdataEncode(IFStream* in_stm, std::basic_ostream<char>* out_stm) {
-  return CdataEscape(in_stm, out_stm);
+bool TestOnly_CreateOverlappedPipe(bazel::windows::AutoHandle* read,
+                                   bazel::windows::AutoHandle* write) {
+  return CreateOverlappedPipe(nullptr, read, write);
+}
+
+bool TestOnly_CdataEncode(IFStream* in_stm, std::basic_ostream<char>* out_stm,
+                          int64_t max_bytes) {
+  return CdataEscape(in_stm, out_stm, max_bytes);
 }
 
 IFStream* TestOnly_CreateIFStream(HANDLE handle, DWORD page_size) {
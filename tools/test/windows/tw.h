@@ -18,6 +18,8 @@
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 
+#include <stdint.h>
+
 #include <memory>
 #include <ostream>
 #include <string>
@@ -174,11 +176,14 @@ bool TestOnly_ToZipEntryPaths(
 // Archives `files` into a zip file at `abs_zip` (absolute path to the zip).
 bool TestOnly_CreateZip(const std::wstring& abs_root,
                         const std::vector<FileInfo>& files,
-                        const std::wstring& abs_zip);
+                        const std::wstring& abs_zip, bool compress = false);
 
 // Returns the MIME type of a file. The file does not need to exist.
 std::string TestOnly_GetMimeType(const std::string& filename);
 
+// Appends the <testsuite> elements of an XML file to `out`.
+bool TestOnly_AppendTestSuites(const std::wstring& abs_xml, std::ostream* out);
+
 // Returns the contents of the Undeclared Outputs manifest.
 bool TestOnly_CreateUndeclaredOutputsManifest(
     const std::vector<FileInfo>& files, std::string* result);
@@ -194,7 +199,13 @@ bool TestOnly_CreateTee(bazel::windows::AutoHandle* input,
                         bazel::windows::AutoHandle* output2,
                         std::unique_ptr<Tee>* result);
 
-bool TestOnly_CdataEncode(IFStream* in_stm, std::basic_ostream<char>* out_stm);
+// Creates a pipe for the input of a Tee, whose reading end supports overlapped
+// I/O.
+bool TestOnly_CreateOverlappedPipe(bazel::windows::AutoHandle* read,
+                                   bazel::windows::AutoHandle* write);
+
+bool TestOnly_CdataEncode(IFStream* in_stm, std::basic_ostream<char>* out_stm,
+                          int64_t max_bytes = -1);
 
 IFStream* TestOnly_CreateIFStream(HANDLE handle, DWORD page_size);
 
@@ -40,6 +40,7 @@ using bazel::tools::test_wrapper::ZipEntryPaths;
 using bazel::tools::test_wrapper::testing::TestOnly_AsMixedPath;
 using bazel::tools::test_wrapper::testing::TestOnly_CdataEncode;
 using bazel::tools::test_wrapper::testing::TestOnly_CreateIFStream;
+using bazel::tools::test_wrapper::testing::TestOnly_CreateOverlappedPipe;
 using bazel::tools::test_wrapper::testing::TestOnly_CreateTee;
 using bazel::tools::test_wrapper::testing::
     TestOnly_CreateUndeclaredOutputsAnnotations;
@@ -325,6 +326,7 @@ TEST_F(TestWrapperWindowsTest, TestCreateZip) {
       blaze_util::CreateDummyFile(root + L"\\foo\\sub\\file2", "hello"));
   EXPECT_TRUE(blaze_util::CreateDummyFile(root + L"\\foo\\file1", "foo"));
   EXPECT_TRUE(blaze_util::CreateDummyFile(root + L"\\foo\\file2", "foobar"));
+  EXPECT_TRUE(CreateDirectoryW((root + L"\\foo\\empty").c_str(), nullptr));
   CREATE_JUNCTION(root + L"\\foo\\junc", root + L"\\foo\\sub");
 
   std::vector<FileInfo> file_list = {FileInfo(L"foo"),
@@ -335,7 +337,8 @@ TEST_F(TestWrapperWindowsTest, TestCreateZip) {
                                      FileInfo(L"foo\\file2", 6),
                                      FileInfo(L"foo\\junc"),
                                      FileInfo(L"foo\\junc\\file1", 0),
-                                     FileInfo(L"foo\\junc\\file2", 5)};
+                                     FileInfo(L"foo\\junc\\file2", 5),
+                                     FileInfo(L"foo\\empty")};
 
   ASSERT_TRUE(TestOnly_CreateZip(root, file_list, root + L"\\x.zip"));
 
@@ -350,32 +353,81 @@ TEST_F(TestWrapperWindowsTest, TestCreateZip) {
   EXPECT_NE(zip.get(), nullptr);
   EXPECT_EQ(zip->ProcessAll(), 0);
 
-  EXPECT_EQ(extracted.size(), 9);
+  // Only the empty directory has an entry of its own: the others are created
+  // with the files in them.
+  ASSERT_EQ(extracted.size(), 7);
 
-  EXPECT_EQ(extracted[0].path, std::string("foo/"));
-  EXPECT_EQ(extracted[1].path, std::string("foo/sub/"));
-  EXPECT_EQ(extracted[2].path, std::string("foo/sub/file1"));
-  EXPECT_EQ(extracted[3].path, std::string("foo/sub/file2"));
-  EXPECT_EQ(extracted[4].path, std::string("foo/file1"));
-  EXPECT_EQ(extracted[5].path, std::string("foo/file2"));
-  EXPECT_EQ(extracted[6].path, std::string("foo/junc/"));
-  EXPECT_EQ(extracted[7].path, std::string("foo/junc/file1"));
-  EXPECT_EQ(extracted[8].path, std::string("foo/junc/file2"));
+  EXPECT_EQ(extracted[0].path, std::string("foo/sub/file1"));
+  EXPECT_EQ(extracted[1].path, std::string("foo/sub/file2"));
+  EXPECT_EQ(extracted[2].path, std::string("foo/file1"));
+  EXPECT_EQ(extracted[3].path, std::string("foo/file2"));
+  EXPECT_EQ(extracted[4].path, std::string("foo/junc/file1"));
+  EXPECT_EQ(extracted[5].path, std::string("foo/junc/file2"));
+  EXPECT_EQ(extracted[6].path, std::string("foo/empty/"));
 
   EXPECT_EQ(extracted[0].size, 0);
-  EXPECT_EQ(extracted[1].size, 0);
-  EXPECT_EQ(extracted[2].size, 0);
-  EXPECT_EQ(extracted[3].size, 5);
-  EXPECT_EQ(extracted[4].size, 3);
-  EXPECT_EQ(extracted[5].size, 6);
+  EXPECT_EQ(extracted[1].size, 5);
+  EXPECT_EQ(extracted[2].size, 3);
+  EXPECT_EQ(extracted[3].size, 6);
+  EXPECT_EQ(extracted[4].size, 0);
+  EXPECT_EQ(extracted[5].size, 5);
   EXPECT_EQ(extracted[6].size, 0);
-  EXPECT_EQ(extracted[7].size, 0);
-  EXPECT_EQ(extracted[8].size, 5);
 
-  EXPECT_EQ(memcmp(extracted[3].data.get(), "hello", 5), 0);
-  EXPECT_EQ(memcmp(extracted[4].data.get(), "foo", 3), 0);
-  EXPECT_EQ(memcmp(extracted[5].data.get(), "foobar", 6), 0);
-  EXPECT_EQ(memcmp(extracted[8].data.get(), "hello", 5), 0);
+  EXPECT_EQ(memcmp(extracted[1].data.get(), "hello", 5), 0);
+  EXPECT_EQ(memcmp(extracted[2].data.get(), "foo", 3), 0);
+  EXPECT_EQ(memcmp(extracted[3].data.get(), "foobar", 6), 0);
+  EXPECT_EQ(memcmp(extracted[5].data.get(), "hello", 5), 0);
+}
+
+TEST_F(TestWrapperWindowsTest, TestCreateCompressedZip) {
+  std::wstring tmpdir;
+  GET_TEST_TMPDIR(&tmpdir);
+
+  std::wstring root = tmpdir + L"\\tmp" + WLINE;
+  const std::string compressible(100000, 'x');
+  EXPECT_TRUE(CreateDirectoryW(root.c_str(), nullptr));
+  EXPECT_TRUE(CreateDirectoryW((root + L"\\foo").c_str(), nullptr));
+  EXPECT_TRUE(blaze_util::CreateDummyFile(root + L"\\foo\\file1", ""));
+  EXPECT_TRUE(blaze_util::CreateDummyFile(root + L"\\foo\\file2", "foo"));
+  EXPECT_TRUE(
+      blaze_util::CreateDummyFile(root + L"\\foo\\file3", compressible));
+
+  std::vector<FileInfo> file_list = {
+      FileInfo(L"foo"),
+      FileInfo(L"foo\\file1", 0),
+      FileInfo(L"foo\\file2", 3),
+      FileInfo(L"foo\\file3", static_cast<int>(compressible.size())),
+  };
+
+  ASSERT_TRUE(TestOnly_CreateZip(root, file_list, root + L"\\x.zip",
+                                 /* compress */ true));
+
+  // The compressible file takes up much less space than it would stored.
+  WIN32_FILE_ATTRIBUTE_DATA zip_info;
+  ASSERT_TRUE(GetFileAttributesExW((root + L"\\x.zip").c_str(),
+                                   GetFileExInfoStandard, &zip_info));
+  EXPECT_LT(zip_info.nFileSizeLow, compressible.size() / 10);
+
+  std::string zip_path;
+  EXPECT_TRUE(TestOnly_AsMixedPath(root + L"\\x.zip", &zip_path));
+  std::vector<InMemoryExtractor::ExtractedFile> extracted;
+  InMemoryExtractor extractor(&extracted);
+  std::unique_ptr<devtools_ijar::ZipExtractor> zip(
+      devtools_ijar::ZipExtractor::Create(zip_path.c_str(), &extractor));
+  EXPECT_NE(zip.get(), nullptr);
+  EXPECT_EQ(zip->ProcessAll(), 0);
+
+  ASSERT_EQ(extracted.size(), 3);
+  EXPECT_EQ(extracted[0].path, std::string("foo/file1"));
+  EXPECT_EQ(extracted[1].path, std::string("foo/file2"));
+  EXPECT_EQ(extracted[2].path, std::string("foo/file3"));
+  EXPECT_EQ(extracted[0].size, 0);
+  EXPECT_EQ(extracted[1].size, 3);
+  EXPECT_EQ(extracted[2].size, compressible.size());
+  EXPECT_EQ(memcmp(extracted[1].data.get(), "foo", 3), 0);
+  EXPECT_EQ(memcmp(extracted[2].data.get(), compressible.data(),
+                   compressible.size()),
+            0);
 }
 
 TEST_F(TestWrapperWindowsTest, TestGetMimeType) {
@@ -391,6 +443,26 @@ TEST_F(TestWrapperWindowsTest, TestGetMimeType) {
             std::string("application/octet-stream"));
 }
 
+TEST_F(TestWrapperWindowsTest, TestAppendTestSuites) {
+  std::wstring tmpdir;
+  GET_TEST_TMPDIR(&tmpdir);
+  std::wstring root = tmpdir + L"\\tmp" + WLINE;
+  EXPECT_TRUE(CreateDirectoryW(root.c_str(), nullptr));
+  EXPECT_TRUE(blaze_util::CreateDummyFile(
+      root + L"\\a.xml",
+      "<?xml version=\"1.0\"?>\n<testsuites name=\"a\">\n"
+      "<testsuite name=\"a\"></testsuite>\n</testsuites>\n"));
+  EXPECT_TRUE(blaze_util::CreateDummyFile(
+      root + L"\\b.xml",
+      "<?xml version=\"1.0\"?>\n<testsuite name=\"b\"></testsuite>\n"));
+
+  std::stringstream out;
+  ASSERT_TRUE(TestOnly_AppendTestSuites(root + L"\\a.xml", &out));
+  ASSERT_TRUE(TestOnly_AppendTestSuites(root + L"\\b.xml", &out));
+  ASSERT_EQ(out.str(), std::string("\n<testsuite name=\"a\"></testsuite>\n"
+                                   "\n<testsuite name=\"b\"></testsuite>\n"));
+}
+
 TEST_F(TestWrapperWindowsTest, TestUndeclaredOutputsManifest) {
   // Pretend we already acquired a file list. The files don't have to exist.
   // Assert that the root is allowed to have the `\\?\` prefix, but the zip
@@ -438,9 +510,8 @@ TEST_F(TestWrapperWindowsTest, TestCreateUndeclaredOutputsAnnotations) {
 }
 
 TEST_F(TestWrapperWindowsTest, TestTee) {
-  HANDLE read1_h, write1_h;
-  EXPECT_TRUE(CreatePipe(&read1_h, &write1_h, nullptr, 0));
-  bazel::windows::AutoHandle read1(read1_h), write1(write1_h);
+  bazel::windows::AutoHandle read1, write1;
+  EXPECT_TRUE(TestOnly_CreateOverlappedPipe(&read1, &write1));
   HANDLE read2_h, write2_h;
   EXPECT_TRUE(CreatePipe(&read2_h, &write2_h, nullptr, 0));
   bazel::windows::AutoHandle read2(read2_h), write2(write2_h);
@@ -493,6 +564,21 @@ TEST_F(TestWrapperWindowsTest, TestCdataEscapeNullTerminator) {
   AssertCdataEncodeBuffer(WLINE, "x\0y", 3, "x?y");
 }
 
+TEST_F(TestWrapperWindowsTest, TestCdataEscapeMaxBytes) {
+  const char* input = "abc\xc3\xa9]]>def";
+  bazel::windows::AutoHandle h(FopenContents(WLINE, input, strlen(input)));
+  std::unique_ptr<IFStream> istm(TestOnly_CreateIFStream(h, /* page_size */ 4));
+  std::stringstream out_stm;
+  // Stops after the first 3 octets.
+  ASSERT_TRUE(TestOnly_CdataEncode(istm.get(), &out_stm, 3));
+  ASSERT_EQ("abc", out_stm.str());
+  // Finishes the double-octet sequence that the limit falls into.
+  ASSERT_TRUE(TestOnly_CdataEncode(istm.get(), &out_stm, 1));
+  ASSERT_EQ("abc\xc3\xa9", out_stm.str());
+  ASSERT_TRUE(TestOnly_CdataEncode(istm.get(), &out_stm));
+  ASSERT_EQ("abc\xc3\xa9]]>]]<![CDATA[>def", out_stm.str());
+}
+
 TEST_F(TestWrapperWindowsTest, TestCdataEscapeCdataEndings) {
   AssertCdataEncodeBuffer(
       WLINE,